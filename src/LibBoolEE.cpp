@@ -16,133 +16,298 @@ this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "LibBoolEE.h"
 
-std::vector<std::string> LibBoolEE::singleParse(const std::string & formula, const char op, ErrorReport* errorReport) {
-    int start_pos = -1;
-    int parity_count = 0;
-    std::vector<std::string> subexpressions;
-    for (int i = 0; i < static_cast<int>(formula.size()); i++) {
-        if (formula[i] == ')') {
-            parity_count--;
-        }
-        else if (formula[i] == '(') {
-            parity_count++;
-            if (start_pos == -1) {
-                start_pos = i;
-            }
-        }
-        else if (parity_count == 0) {
-            if (start_pos == -1) {
-                if (belongsToName(formula[i]) || formula[i] == '!') {
-                    start_pos = i;
-                }
-            }
-            else if (!(belongsToName(formula[i]) || formula[i] == '!')) {
-                if (op == formula[i]) {
-                    subexpressions.push_back(formula.substr(start_pos, i - start_pos));
-                    start_pos = i+1;
-                }
-                else if (formula[i] != '&' && formula[i] != '|') {
-                    if (errorReport) {
-                        errorReport->type = ErrorReport::ErrorType::EmptySubExpression;
-                        errorReport->vecUserData.emplace_back(std::string(1, formula[i]));
-                        errorReport->vecUserData.emplace_back(formula);
-                        errorReport->strDevData = "invalid-verifier-unknown-operator-in-expression";
+#include <algorithm>
+
+enum ProgramOp : uint8_t {
+    PROG_FALSE = 0,
+    PROG_TRUE = 1,
+    PROG_VAR = 2,  // followed by the variable index
+    PROG_NOT = 3,
+    PROG_AND = 4,  // followed by the little endian offset to jump to when the value is false
+    PROG_OR = 5    // followed by the little endian offset to jump to when the value is true
+};
+
+/**
+ * Single pass over the tokens of a whitespace free formula, emitting the bytecode as it goes. Conjunction binds
+ * tighter than disjunction and negation tighter than both. Each operand of a chain is followed by a jump to the
+ * end of the chain, taken when that operand decides it, so evaluate() only ever holds the last value.
+ *
+ * The recursive splitter this replaced ignored whatever came before the first operand of a (sub)expression when
+ * that (sub)expression contained an operator, so "|a|b" and "(+a&b)" resolve. Verifier strings accepted that way
+ * are valid on chain, so the leading characters of a formula, and the '&'s right after a '|', are skipped the same way.
+ */
+class LibBoolEE::Parser {
+public:
+    Parser(const std::string & formula, const std::vector<std::string> * variables, const Vals * valuation, ErrorReport* errorReport)
+        : formula(formula), variables(variables), valuation(valuation), errorReport(errorReport), pos(0) {
+        tokenize();
+    }
+
+    Program parse() {
+        parseFormula();
+        expect(TOKEN_END);
+        return program;
+    }
+
+private:
+    enum TokenType { TOKEN_NAME, TOKEN_NOT, TOKEN_OPEN, TOKEN_CLOSE, TOKEN_AND, TOKEN_OR, TOKEN_OTHER, TOKEN_END };
+
+    struct Token {
+        TokenType type;
+        size_t begin;
+        size_t length;
+    };
+
+    const std::string & formula;
+    const std::vector<std::string> * variables; ///< Compiling: variables become PROG_VAR
+    const Vals * valuation;                     ///< Resolving: variables become constants
+    ErrorReport* errorReport;
+
+    std::vector<Token> tokens;
+    size_t pos;
+    Program program;
+
+    void tokenize() {
+        for (size_t i = 0; i < formula.size(); i++) {
+            Token token = {TOKEN_OTHER, i, 1};
+            switch (formula[i]) {
+                case '!': token.type = TOKEN_NOT; break;
+                case '(': token.type = TOKEN_OPEN; break;
+                case ')': token.type = TOKEN_CLOSE; break;
+                case '&': token.type = TOKEN_AND; break;
+                case '|': token.type = TOKEN_OR; break;
+                default:
+                    if (belongsToName(formula[i])) {
+                        token.type = TOKEN_NAME;
+                        while (i + 1 < formula.size() && belongsToName(formula[i + 1]))
+                            i++;
+                        token.length = i + 1 - token.begin;
                     }
-                    throw std::runtime_error("Unknown operator '" + std::string(1, formula[i]) + "' in the (sub)expression '" + formula + "'.");
-                }
             }
+            tokens.push_back(token);
         }
+        tokens.push_back(Token{TOKEN_END, formula.size(), 0});
     }
-    if (start_pos != -1) {
-        subexpressions.push_back(formula.substr(start_pos, formula.size() - start_pos));
+
+    const Token & peek() const {
+        return tokens[pos];
     }
-    if (parity_count != 0) {
-        if (errorReport) {
-            errorReport->type = ErrorReport::ErrorType::ParenthesisParity;
-            errorReport->vecUserData.emplace_back(formula);
-            errorReport->strDevData = "invalid-verifier-parenthesis-parity";
+
+    // The whole formula, or the inside of a pair of parentheses
+    void parseFormula() {
+        bool skipped = false;
+        while (peek().type == TOKEN_AND || peek().type == TOKEN_OR || peek().type == TOKEN_OTHER) {
+            skipped = true;
+            pos++;
         }
-        throw std::runtime_error("Wrong parenthesis parity in the (sub)expression '" + formula + "'.");
+
+        size_t operators = 0;
+        parseDisjunction(operators);
+        if (skipped && operators == 0)
+            failInvalidFormula();
     }
-    return subexpressions;
-}
 
-bool LibBoolEE::resolve(const std::string &source, const Vals & valuation, ErrorReport* errorReport) {
-    return resolveRec(removeWhitespaces(source), valuation, errorReport);
-}
+    void parseDisjunction(size_t & operators) {
+        std::vector<size_t> jumps;
+        parseConjunction(operators);
+        while (peek().type == TOKEN_OR) {
+            pos++;
+            jumps.push_back(emitJump(PROG_OR));
+            operators++;
 
-bool LibBoolEE::resolveRec(const std::string &source, const Vals & valuation, ErrorReport* errorReport) {
-    if (source.empty()) {
-        if (errorReport) {
-            errorReport->type = ErrorReport::ErrorType::EmptySubExpression;
-            errorReport->vecUserData.emplace_back(source);
-            errorReport->strDevData = "bad-txns-null-verifier-empty-sub-expression";
+            bool skipped = false;
+            while (peek().type == TOKEN_AND) {
+                skipped = true;
+                pos++;
+            }
+
+            size_t conjunctions = 0;
+            parseConjunction(conjunctions);
+            if (skipped && conjunctions == 0)
+                failInvalidFormula();
+            operators += conjunctions;
         }
-        throw std::runtime_error("An empty subexpression was encountered");
+        patchJumps(jumps);
     }
 
-    std::string formula = source;
-    char current_op = '|';
-    // Try to divide by |
-    std::vector<std::string> subexpressions = singleParse(source, current_op, errorReport);
-    // No | on the top level
-    if (subexpressions.size() == 1) {
-        current_op = '&';
-        subexpressions = singleParse(source, current_op, errorReport);
+    void parseConjunction(size_t & operators) {
+        std::vector<size_t> jumps;
+        parseUnary();
+        while (peek().type == TOKEN_AND) {
+            pos++;
+            jumps.push_back(emitJump(PROG_AND));
+            operators++;
+            parseUnary();
+        }
+        patchJumps(jumps);
     }
 
-    // No valid name found
-    if (subexpressions.size() == 0) {
-        if (errorReport) {
-            errorReport->type = ErrorReport::ErrorType::InvalidQualifierName;
-            errorReport->vecUserData.emplace_back(source);
-            errorReport->strDevData = "bad-txns-null-verifier-no-sub-expressions";
+    void parseUnary() {
+        const Token & token = tokens[pos++];
+        switch (token.type) {
+            case TOKEN_NOT:
+                parseUnary();
+                program.push_back(PROG_NOT);
+                break;
+            case TOKEN_OPEN:
+                parseFormula();
+                expect(TOKEN_CLOSE);
+                pos++;
+                break;
+            case TOKEN_NAME:
+                emitOperand(formula.substr(token.begin, token.length));
+                break;
+            case TOKEN_OTHER:
+                failUnknownOperator(formula[token.begin]);
+            default:
+                if (errorReport) {
+                    errorReport->type = ErrorReport::ErrorType::EmptySubExpression;
+                    errorReport->vecUserData.emplace_back(formula);
+                    errorReport->strDevData = "bad-txns-null-verifier-empty-sub-expression";
+                }
+                throw std::runtime_error("An empty subexpression was encountered");
         }
-        throw std::runtime_error("The subexpression " + source + " is not a valid formula.");
     }
 
-    // No binary top level operator found
-    else if (subexpressions.size() == 1) {
-        if (source[0] == '!') {
-            return !resolve(source.substr(1), valuation, errorReport);
-        }
-        else if (source[0] == '(') {
-            return resolve(source.substr(1, source.size() - 2), valuation, errorReport);
+    // Fail unless the next token is the one closing the current formula
+    void expect(TokenType type) {
+        const Token & token = peek();
+        if (token.type == type)
+            return;
+        if (token.type == TOKEN_OTHER)
+            failUnknownOperator(formula[token.begin]);
+        if (token.type == TOKEN_CLOSE || token.type == TOKEN_END) {
+            if (errorReport) {
+                errorReport->type = ErrorReport::ErrorType::ParenthesisParity;
+                errorReport->vecUserData.emplace_back(formula);
+                errorReport->strDevData = "invalid-verifier-parenthesis-parity";
+            }
+            throw std::runtime_error("Wrong parenthesis parity in the (sub)expression '" + formula + "'.");
         }
-        else if (source == "1") {
-            return true;
+        failInvalidFormula();
+    }
+
+    void emitOperand(const std::string & name) {
+        if (name == "1") {
+            program.push_back(PROG_TRUE);
+            return;
         }
-        else if (source == "0") {
-            return false;
+        if (name == "0") {
+            program.push_back(PROG_FALSE);
+            return;
         }
-        else if (valuation.count(source) == 0) {
-            if (errorReport) {
-                errorReport->type = ErrorReport::ErrorType::VariableNotFound;
-                errorReport->vecUserData.emplace_back(source);
-                errorReport->strDevData = "bad-txns-null-verifier-variable-not-found";
+
+        if (variables) {
+            std::vector<std::string>::const_iterator it = std::find(variables->begin(), variables->end(), name);
+            if (it != variables->end()) {
+                program.push_back(PROG_VAR);
+                program.push_back(static_cast<uint8_t>(it - variables->begin()));
+                return;
+            }
+        } else {
+            Vals::const_iterator it = valuation->find(name);
+            if (it != valuation->end()) {
+                program.push_back(it->second ? PROG_TRUE : PROG_FALSE);
+                return;
             }
-            throw std::runtime_error("Variable '" + source + "' not found in the interpretation.");
         }
-        else {
-            return valuation.at(source);
+
+        if (errorReport) {
+            errorReport->type = ErrorReport::ErrorType::VariableNotFound;
+            errorReport->vecUserData.emplace_back(name);
+            errorReport->strDevData = "bad-txns-null-verifier-variable-not-found";
         }
+        throw std::runtime_error("Variable '" + name + "' not found in the interpretation.");
     }
-    else {
-        if (current_op == '|') {
-            bool result = false;
-            for (std::vector<std::string>::iterator it = subexpressions.begin(); it != subexpressions.end(); it++) {
-                result |= resolve(*it, valuation, errorReport);
-            }
-            return result;
+
+    // @return  the position of the jump offset, filled in by patchJumps()
+    size_t emitJump(ProgramOp op) {
+        program.push_back(op);
+        program.push_back(0);
+        program.push_back(0);
+        return program.size() - 2;
+    }
+
+    // Point the jumps at the end of the program emitted so far
+    void patchJumps(const std::vector<size_t> & jumps) {
+        if (jumps.empty())
+            return;
+        if (program.size() > UINT16_MAX)
+            throw std::runtime_error("The formula '" + formula + "' is too large to compile.");
+        for (size_t jump : jumps) {
+            program[jump] = program.size() & 0xff;
+            program[jump + 1] = program.size() >> 8;
         }
-        else { // The operator was set to &
-            bool result = true;
-            for (std::vector<std::string>::iterator it = subexpressions.begin(); it != subexpressions.end(); it++) {
-                result &= resolve(*it, valuation, errorReport);
-            }
-            return result;
+    }
+
+    [[noreturn]] void failUnknownOperator(const char ch) {
+        if (errorReport) {
+            errorReport->type = ErrorReport::ErrorType::UnknownOperator;
+            errorReport->vecUserData.emplace_back(std::string(1, ch));
+            errorReport->vecUserData.emplace_back(formula);
+            errorReport->strDevData = "invalid-verifier-unknown-operator-in-expression";
+        }
+        throw std::runtime_error("Unknown operator '" + std::string(1, ch) + "' in the (sub)expression '" + formula + "'.");
+    }
+
+    [[noreturn]] void failInvalidFormula() {
+        if (errorReport) {
+            errorReport->type = ErrorReport::ErrorType::InvalidQualifierName;
+            errorReport->vecUserData.emplace_back(formula);
+            errorReport->strDevData = "bad-txns-null-verifier-no-sub-expressions";
+        }
+        throw std::runtime_error("The subexpression " + formula + " is not a valid formula.");
+    }
+};
+
+bool LibBoolEE::resolve(const std::string &source, const Vals & valuation, ErrorReport* errorReport) {
+    std::string formula = removeWhitespaces(source);
+    return evaluate(Parser(formula, nullptr, &valuation, errorReport).parse(), 0);
+}
+
+LibBoolEE::Program LibBoolEE::compile(const std::string &source, const std::vector<std::string> & variables, ErrorReport* errorReport) {
+    if (variables.size() > MAX_PROGRAM_VARIABLES) {
+        throw std::runtime_error("Too many variables to compile the formula '" + source + "'.");
+    }
+
+    std::string formula = removeWhitespaces(source);
+    return Parser(formula, &variables, nullptr, errorReport).parse();
+}
+
+bool LibBoolEE::evaluate(const Program & program, uint64_t valuation) {
+    bool value = false;
+    size_t i = 0;
+    while (i < program.size()) {
+        switch (program[i]) {
+            case PROG_FALSE:
+                value = false;
+                i++;
+                break;
+            case PROG_TRUE:
+                value = true;
+                i++;
+                break;
+            case PROG_VAR:
+                value = (valuation >> program[i + 1]) & 1;
+                i += 2;
+                break;
+            case PROG_NOT:
+                value = !value;
+                i++;
+                break;
+            case PROG_AND:
+            case PROG_OR:
+                // A false conjunct or a true disjunct decides the chain, skip the rest of its operands
+                if (value == (program[i] == PROG_OR))
+                    i = program[i + 1] | (program[i + 2] << 8);
+                else
+                    i += 3;
+                break;
+            default:
+                return false;
         }
     }
+    return value;
 }
 
 std::string LibBoolEE::trim(const std::string &source) {
@@ -33,6 +33,7 @@ this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "tokens/tokens.h"
 
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
@@ -53,16 +54,25 @@ public:
     // @return new string made from the source by removing removal all character that match the given character
     static std::string removeCharacter(const std::string &source, const char ch);
 
+    typedef std::vector<uint8_t> Program; ///< Short-circuit bytecode of a formula, see compile()
+
+    /// Largest number of variables a compiled formula can reference, one bit of the valuation each
+    static const size_t MAX_PROGRAM_VARIABLES = 64;
+
+    // @return  the formula compiled to bytecode. The i'th entry of variables is bit i of the valuation
+    //          passed to evaluate(). Throws on exactly the formulas resolve() throws on, whatever the valuation.
+    static Program compile(const std::string & source, const std::vector<std::string> & variables, ErrorReport* errorReport = nullptr);
+
+    // @return	true iff the compiled formula is true under the valuation (bit i is the value of the i'th variable).
+    //          Stops at the first operand that decides a conjunction or disjunction and does not allocate.
+    static bool evaluate(const Program & program, uint64_t valuation);
+
 private:
-    static std::vector<std::string> singleParse(const std::string & formula, const char op, ErrorReport* errorReport = nullptr);
+    class Parser;
 
     // @return	true iff ch is possibly part of a valid name
     static bool belongsToName(const char ch);
 
-    // @return	true iff the formula is true under the valuation (where the valuation are pairs (variable,value))---used internally
-    static bool resolveRec(const std::string & source, const Vals & valuation, ErrorReport* errorReport = nullptr);
-
-
     // @return	new string made from the source by removing the leading and trailing white spaces
     static std::string trim(const std::string & source);
 };
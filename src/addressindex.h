@@ -203,6 +203,25 @@ struct CAddressIndexKey {
     }
 };
 
+/** What an address received, can spend and has timelocked of one token, summed over its address index entries */
+struct CAddressIndexBalance {
+    CAmount received;
+    CAmount balance;
+    CAmount locked;
+
+    CAddressIndexBalance() : received(0), balance(0), locked(0) {}
+
+    //! Count an entry, timeLock being unlocked once it is below nLockHeight or nLockTime
+    void Add(int timeLock, CAmount nValue, int nLockHeight, int64_t nLockTime) {
+        if (nValue > 0)
+            received += nValue;
+        if (timeLock < ((int64_t)timeLock < LOCKTIME_THRESHOLD ? (int64_t)nLockHeight : nLockTime))
+            balance += nValue;
+        else
+            locked += nValue;
+    }
+};
+
 struct CAddressIndexIteratorKey {
     unsigned int type;
     uint160 hashBytes;
@@ -66,36 +66,142 @@ double CAddrInfo::GetChance(int64_t nNow) const
     return fChance;
 }
 
+/** Markers of the vAddrIndex slots that hold no nId */
+static const int ADDR_INDEX_EMPTY = -1;
+static const int ADDR_INDEX_DELETED = -2;
+
+static uint64_t AddrIndexHash(const CNetAddr& addr, uint64_t k0, uint64_t k1)
+{
+    struct in6_addr ip;
+    addr.GetIn6Addr(&ip);
+    return CSipHasher(k0, k1).Write((const unsigned char*)&ip, sizeof(ip)).Finalize();
+}
+
+int CAddrMan::FindId(const CNetAddr& addr) const
+{
+    const size_t nMask = vAddrIndex.size() - 1;
+    for (size_t nSlot = AddrIndexHash(addr, nAddrIndexK0, nAddrIndexK1) & nMask; vAddrIndex[nSlot] != ADDR_INDEX_EMPTY; nSlot = (nSlot + 1) & nMask) {
+        int nId = vAddrIndex[nSlot];
+        if (nId >= 0 && (const CNetAddr&)vInfo[nId] == addr)
+            return nId;
+    }
+    return -1;
+}
+
+void CAddrMan::IndexAddr(const CNetAddr& addr, int nId)
+{
+    // Keep at least half of the slots empty, so a probe ends after two slots on average
+    if ((nAddrIndexFilled + 1) * 2 > vAddrIndex.size())
+        ResizeAddrIndex(vRandom.size() + 1);
+
+    const size_t nMask = vAddrIndex.size() - 1;
+    size_t nFree = vAddrIndex.size();
+    size_t nSlot = AddrIndexHash(addr, nAddrIndexK0, nAddrIndexK1) & nMask;
+    for (; vAddrIndex[nSlot] != ADDR_INDEX_EMPTY; nSlot = (nSlot + 1) & nMask) {
+        int nOld = vAddrIndex[nSlot];
+        if (nOld >= 0 && (const CNetAddr&)vInfo[nOld] == addr) {
+            vAddrIndex[nSlot] = nId;
+            return;
+        }
+        if (nOld == ADDR_INDEX_DELETED && nFree == vAddrIndex.size())
+            nFree = nSlot;
+    }
+    if (nFree == vAddrIndex.size()) {
+        nFree = nSlot;
+        nAddrIndexFilled++;
+    }
+    vAddrIndex[nFree] = nId;
+}
+
+void CAddrMan::UnindexAddr(const CNetAddr& addr)
+{
+    const size_t nMask = vAddrIndex.size() - 1;
+    for (size_t nSlot = AddrIndexHash(addr, nAddrIndexK0, nAddrIndexK1) & nMask; vAddrIndex[nSlot] != ADDR_INDEX_EMPTY; nSlot = (nSlot + 1) & nMask) {
+        int nId = vAddrIndex[nSlot];
+        if (nId >= 0 && (const CNetAddr&)vInfo[nId] == addr) {
+            vAddrIndex[nSlot] = ADDR_INDEX_DELETED;
+            return;
+        }
+    }
+}
+
+void CAddrMan::ResizeAddrIndex(size_t nEntries)
+{
+    size_t nSize = 64;
+    while (nSize < nEntries * 4)
+        nSize *= 2;
+
+    // Deleted slots are dropped by rebuilding from the entries themselves
+    vAddrIndex.assign(nSize, ADDR_INDEX_EMPTY);
+    nAddrIndexFilled = 0;
+    for (int nId : vRandom) {
+        size_t nSlot = AddrIndexHash(vInfo[nId], nAddrIndexK0, nAddrIndexK1) & (nSize - 1);
+        while (vAddrIndex[nSlot] != ADDR_INDEX_EMPTY)
+            nSlot = (nSlot + 1) & (nSize - 1);
+        vAddrIndex[nSlot] = nId;
+        nAddrIndexFilled++;
+    }
+}
+
+static void SetTablePosition(int& nEntry, int nPos, int nId, std::vector<int>& vUsed, std::vector<int>& vUsedIndex)
+{
+    if (nEntry == -1 && nId != -1) {
+        vUsedIndex[nPos] = vUsed.size();
+        vUsed.push_back(nPos);
+    } else if (nEntry != -1 && nId == -1) {
+        int nIndex = vUsedIndex[nPos];
+        vUsed[nIndex] = vUsed.back();
+        vUsedIndex[vUsed[nIndex]] = nIndex;
+        vUsed.pop_back();
+        vUsedIndex[nPos] = -1;
+    }
+    nEntry = nId;
+}
+
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    SetTablePosition(vvNew[nUBucket][nUBucketPos], nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos, nId, vNewUsed, vNewUsedIndex);
+}
+
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    SetTablePosition(vvTried[nKBucket][nKBucketPos], nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos, nId, vTriedUsed, vTriedUsedIndex);
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
-    if (it == mapAddr.end())
+    int nId = FindId(addr);
+    if (nId == -1)
         return nullptr;
     if (pnId)
-        *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end())
-        return &(*it2).second;
-    return nullptr;
+        *pnId = nId;
+    return &vInfo[nId];
 }
 
 CAddrInfo* CAddrMan::ById(unsigned long nId) 
 {
-    if ((mapInfo.count(nId) == 0) || (nId < mapInfo.count(nId) - 1))
+    if (nId >= vInfo.size() || vInfo[nId].nRandomPos == -1)
         return(nullptr);
-    return &mapInfo[nId];
+    return &vInfo[nId];
 }
 
 CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, int* pnId)
 {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
-    mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
+    int nId;
+    if (!vFreeIds.empty()) {
+        nId = vFreeIds.back();
+        vFreeIds.pop_back();
+        vInfo[nId] = CAddrInfo(addr, addrSource);
+    } else {
+        nId = vInfo.size();
+        vInfo.emplace_back(addr, addrSource);
+    }
+    vInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    IndexAddr(addr, nId);
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &vInfo[nId];
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -108,11 +214,8 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     int nId1 = vRandom[nRndPos1];
     int nId2 = vRandom[nRndPos2];
 
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
-
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
+    vInfo[nId1].nRandomPos = nRndPos2;
+    vInfo[nId2].nRandomPos = nRndPos1;
 
     vRandom[nRndPos1] = nId2;
     vRandom[nRndPos2] = nId1;
@@ -120,15 +223,16 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
 
 void CAddrMan::Delete(int nId)
 {
-    assert(mapInfo.count(nId) != 0);
-    CAddrInfo& info = mapInfo[nId];
+    assert(ById(nId) != nullptr);
+    CAddrInfo& info = vInfo[nId];
     assert(!info.fInTried);
     assert(info.nRefCount == 0);
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
-    mapAddr.erase(info);
-    mapInfo.erase(nId);
+    UnindexAddr(info);
+    info = CAddrInfo();
+    vFreeIds.push_back(nId);
     nNew--;
 }
 
@@ -137,10 +241,10 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
     // if there is an entry in the specified bucket, delete it.
     if (vvNew[nUBucket][nUBucketPos] != -1) {
         int nIdDelete = vvNew[nUBucket][nUBucketPos];
-        CAddrInfo& infoDelete = mapInfo[nIdDelete];
+        CAddrInfo& infoDelete = vInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -153,7 +257,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -169,12 +273,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     if (vvTried[nKBucket][nKBucketPos] != -1) {
         // find an item to evict
         int nIdEvict = vvTried[nKBucket][nKBucketPos];
-        assert(mapInfo.count(nIdEvict) == 1);
-        CAddrInfo& infoOld = mapInfo[nIdEvict];
+        assert(ById(nIdEvict) != nullptr);
+        CAddrInfo& infoOld = vInfo[nIdEvict];
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -185,12 +289,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -301,7 +405,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
-            CAddrInfo& infoExisting = mapInfo[vvNew[nUBucket][nUBucketPos]];
+            CAddrInfo& infoExisting = vInfo[vvNew[nUBucket][nUBucketPos]];
             if (infoExisting.IsTerrible() || (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
                 // Overwrite the existing new table entry.
                 fInsert = true;
@@ -310,7 +414,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -351,41 +455,18 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         return CAddrInfo();
 
     // Use a 50% chance for choosing between tried and new table entries.
-    if (!newOnly &&
-       (nTried > 0 && (nNew == 0 || RandomInt(2) == 0))) { 
-        // use a tried node
-        double fChanceFactor = 1.0;
-        while (1) {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
-            if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
-                return info;
-            fChanceFactor *= 1.2;
-        }
-    } else {
-        // use a new node
-        double fChanceFactor = 1.0;
-        while (1) {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
-            if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
-                return info;
-            fChanceFactor *= 1.2;
-        }
+    // The occupied positions of each table are listed, so drawing one takes a single random number
+    // however sparse the table is.
+    const bool fTried = !newOnly && (nTried > 0 && (nNew == 0 || RandomInt(2) == 0));
+    const std::vector<int>& vUsed = fTried ? vTriedUsed : vNewUsed;
+    double fChanceFactor = 1.0;
+    while (1) {
+        int nPos = vUsed[RandomInt(vUsed.size())];
+        int nId = fTried ? vvTried[nPos / ADDRMAN_BUCKET_SIZE][nPos % ADDRMAN_BUCKET_SIZE] : vvNew[nPos / ADDRMAN_BUCKET_SIZE][nPos % ADDRMAN_BUCKET_SIZE];
+        CAddrInfo& info = vInfo[nId];
+        if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
+            return info;
+        fChanceFactor *= 1.2;
     }
 }
 
@@ -398,9 +479,10 @@ int CAddrMan::Check_()
     if (vRandom.size() != nTried + nNew)
         return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-        int n = (*it).first;
-        CAddrInfo& info = (*it).second;
+    for (int n = 0; n < (int)vInfo.size(); n++) {
+        CAddrInfo& info = vInfo[n];
+        if (info.nRandomPos == -1)
+            continue;
         if (info.fInTried) {
             if (!info.nLastSuccess)
                 return -1;
@@ -414,7 +496,7 @@ int CAddrMan::Check_()
                 return -4;
             mapNew[n] = info.nRefCount;
         }
-        if (mapAddr[info] != n)
+        if (FindId(info) != n)
             return -5;
         if (info.nRandomPos < 0 || info.nRandomPos >= vRandom.size() || vRandom[info.nRandomPos] != n)
             return -14;
@@ -424,7 +506,7 @@ int CAddrMan::Check_()
             return -8;
     }
 
-    if (setTried.size() != nTried)
+    if (setTried.size() != nTried || vTriedUsed.size() != nTried)
         return -9;
     if (mapNew.size() != nNew)
         return -10;
@@ -434,10 +516,12 @@ int CAddrMan::Check_()
              if (vvTried[n][i] != -1) {
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
-                 if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
+                 if (vInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
                      return -17;
-                 if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
+                 if (vInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
                      return -18;
+                 if (vTriedUsed[vTriedUsedIndex[n * ADDRMAN_BUCKET_SIZE + i]] != n * ADDRMAN_BUCKET_SIZE + i)
+                     return -20;
                  setTried.erase(vvTried[n][i]);
              }
         }
@@ -448,8 +532,10 @@ int CAddrMan::Check_()
             if (vvNew[n][i] != -1) {
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
-                if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
+                if (vInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
                     return -19;
+                if (vNewUsed[vNewUsedIndex[n * ADDRMAN_BUCKET_SIZE + i]] != n * ADDRMAN_BUCKET_SIZE + i)
+                    return -21;
                 if (--mapNew[vvNew[n][i]] == 0)
                     mapNew.erase(vvNew[n][i]);
             }
@@ -480,9 +566,8 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
 
         int nRndPos = RandomInt(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = vInfo[vRandom[n]];
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -14,6 +14,7 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <limits>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -186,14 +187,19 @@ private:
     //! critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
-    //! last used nId
-    int nIdCount;
+    //! information about all nIds, indexed by nId; unused ids have nRandomPos -1 and are kept in vFreeIds
+    std::vector<CAddrInfo> vInfo;
+    std::vector<int> vFreeIds;
 
-    //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    //! open-addressed table to find an nId based on its network address: a power of two
+    //! slots holding an nId, ADDR_INDEX_EMPTY or ADDR_INDEX_DELETED, probed linearly
+    std::vector<int> vAddrIndex;
 
-    //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    //! slots of vAddrIndex not empty (nIds and deleted ones)
+    size_t nAddrIndexFilled;
+
+    //! salt of the vAddrIndex hash, so peers cannot pick addresses that all land in one run of slots
+    uint64_t nAddrIndexK0, nAddrIndexK1;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -210,6 +216,15 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position) of the "tried" and "new" tables,
+    //! in no particular order, so Select can draw one in constant time
+    std::vector<int> vTriedUsed;
+    std::vector<int> vNewUsed;
+
+    //! index of each position of the "tried" and "new" tables in vTriedUsed and vNewUsed, or -1
+    std::vector<int> vTriedUsedIndex;
+    std::vector<int> vNewUsedIndex;
+
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
@@ -217,12 +232,25 @@ protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
 
-    //! Source of random numbers for randomization in inner loops
-    FastRandomContext insecure_rand;
-
     //! Find an entry.
     CAddrInfo* Find(const CNetAddr& addr, int *pnId = nullptr);
 
+    //! Find the nId of an address, or -1.
+    int FindId(const CNetAddr& addr) const;
+
+    //! Make an address find nId in vAddrIndex, in place of any entry it found before.
+    void IndexAddr(const CNetAddr& addr, int nId);
+
+    //! Make an address find no entry in vAddrIndex.
+    void UnindexAddr(const CNetAddr& addr);
+
+    //! Rebuild vAddrIndex with room for nEntries entries.
+    void ResizeAddrIndex(size_t nEntries);
+
+    //! Set a position of the "new" or "tried" table to an nId or -1, keeping track of the occupied positions.
+    void SetNew(int nUBucket, int nUBucketPos, int nId);
+    void SetTried(int nKBucket, int nKBucketPos, int nId);
+
     //! find an entry, creating it if necessary.
     //! nTime and nServices of the found node are updated, if necessary.
     CAddrInfo* Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId = nullptr);
@@ -286,7 +314,7 @@ public:
      * as incompatible. This is necessary because it did not check the version number on
      * deserialization.
      *
-     * Notice that vvTried, mapAddr and vVector are never encoded explicitly;
+     * Notice that vvTried, vAddrIndex and vRandom are never encoded explicitly;
      * they are instead reconstructed from the other information.
      *
      * vvNew is serialized, but only used if ADDRMAN_UNKNOWN_BUCKET_COUNT didn't change,
@@ -312,20 +340,19 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::vector<int> vUnkIds(vInfo.size(), -1);
         int nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            mapUnkIds[(*it).first] = nIds;
-            const CAddrInfo &info = (*it).second;
+        for (size_t nId = 0; nId < vInfo.size(); nId++) {
+            const CAddrInfo &info = vInfo[nId];
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
+                vUnkIds[nId] = nIds;
                 s << info;
                 nIds++;
             }
         }
         nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            const CAddrInfo &info = (*it).second;
+        for (const CAddrInfo &info : vInfo) {
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
@@ -341,7 +368,7 @@ public:
             s << nSize;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
+                    int nIndex = vUnkIds[vvNew[bucket][i]];
                     s << nIndex;
                 }
             }
@@ -369,19 +396,25 @@ public:
             nUBuckets ^= (1 << 30);
         }
 
-        if (nNew > ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
+        if (nNew < 0 || nNew > ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
             throw std::ios_base::failure("Corrupt CAddrMan serialization, nNew exceeds limit.");
         }
 
-        if (nTried > ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
+        if (nTried < 0 || nTried > ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
             throw std::ios_base::failure("Corrupt CAddrMan serialization, nTried exceeds limit.");
         }
 
+        // Size the tables for all entries at once, rather than growing them entry by entry.
+        vInfo.reserve(nNew + nTried);
+        vRandom.reserve(nNew + nTried);
+        ResizeAddrIndex(nNew + nTried);
+
         // Deserialize entries from the new table.
+        vInfo.resize(nNew);
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+            CAddrInfo &info = vInfo[n];
             s >> info;
-            mapAddr[info] = n;
+            IndexAddr(info, n);
             info.nRandomPos = vRandom.size();
             vRandom.push_back(n);
             if (nVersion != 1 || nUBuckets != ADDRMAN_NEW_BUCKET_COUNT) {
@@ -390,12 +423,11 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
         }
-        nIdCount = nNew;
 
         // Deserialize entries from the tried table.
         int nLost = 0;
@@ -405,13 +437,13 @@ public:
             int nKBucket = info.GetTriedBucket(nKey);
             int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
             if (vvTried[nKBucket][nKBucketPos] == -1) {
+                int nId = vInfo.size();
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
+                vRandom.push_back(nId);
+                vInfo.push_back(info);
+                IndexAddr(info, nId);
+                SetTried(nKBucket, nKBucketPos, nId);
             } else {
                 nLost++;
             }
@@ -426,11 +458,11 @@ public:
                 int nIndex = 0;
                 s >> nIndex;
                 if (nIndex >= 0 && nIndex < nNew) {
-                    CAddrInfo &info = mapInfo[nIndex];
+                    CAddrInfo &info = vInfo[nIndex];
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -438,13 +470,10 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
-                Delete(itCopy->first);
+        for (int n = 0, nEntries = nNew; n < nEntries; n++) {
+            if (vInfo[n].nRandomPos != -1 && vInfo[n].nRefCount == 0) {
+                Delete(n);
                 nLostUnk++;
-            } else {
-                it++;
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -468,13 +497,19 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        vTriedUsed.clear();
+        vNewUsed.clear();
+        vTriedUsedIndex.assign(ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE, -1);
+        vNewUsedIndex.assign(ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE, -1);
 
-        nIdCount = 0;
         nTried = 0;
         nNew = 0;
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
-        mapInfo.clear();
-        mapAddr.clear();
+        vInfo.clear();
+        vFreeIds.clear();
+        nAddrIndexK0 = GetRand(std::numeric_limits<uint64_t>::max());
+        nAddrIndexK1 = GetRand(std::numeric_limits<uint64_t>::max());
+        ResizeAddrIndex(0);
     }
 
     CAddrMan()
@@ -0,0 +1,92 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "txdb.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <memory>
+
+// One address with a million address index entries, spread over PLB and a few tokens
+static const int ADDRESS_BENCH_ENTRIES = 1000000;
+static const int ADDRESS_BENCH_TOKENS = 8;
+static const int ADDRESS_BENCH_ENTRIES_PER_BLOCK = 10;
+
+static const uint160 ADDRESS_BENCH_HASH = uint160(ParseHex("1f2e3d4c5b6a79881f2e3d4c5b6a79881f2e3d4c"));
+
+static std::string BenchTokenName(int n)
+{
+    return n == 0 ? PLB : strprintf("TOKEN%d", n);
+}
+
+static CBlockTreeDB& AddressIndexBenchDB()
+{
+    static std::unique_ptr<CBlockTreeDB> db;
+    if (db)
+        return *db;
+
+    fs::path pathTemp = fs::temp_directory_path() / strprintf("bench_paladeum_%lu", (unsigned long)GetTime());
+    ClearDatadirCache();
+    gArgs.ForceSetArg("-datadir", pathTemp.string());
+    fs::create_directories(pathTemp);
+    db.reset(new CBlockTreeDB(1 << 24, true));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (int i = 0; i < ADDRESS_BENCH_ENTRIES; i++) {
+        const int nHeight = i / ADDRESS_BENCH_ENTRIES_PER_BLOCK / ADDRESS_BENCH_TOKENS;
+        const bool fSpending = i % 3 == 0;
+        vEntries.emplace_back(CAddressIndexKey(1, ADDRESS_BENCH_HASH, BenchTokenName(i % ADDRESS_BENCH_TOKENS), nHeight, i % ADDRESS_BENCH_ENTRIES_PER_BLOCK,
+                                               ArithToUint256(arith_uint256(i)), 0, fSpending), fSpending ? -COIN : COIN);
+        if (vEntries.size() == 10000) {
+            db->WriteAddressIndex(vEntries);
+            vEntries.clear();
+        }
+    }
+    db->WriteAddressIndex(vEntries);
+    return *db;
+}
+
+// The per token balances of the address, what getaddressbalance with includeTokens asks for
+static void AddressIndexBalances(benchmark::State& state)
+{
+    CBlockTreeDB& db = AddressIndexBenchDB();
+    while (state.KeepRunning()) {
+        std::map<std::string, CAddressIndexBalance> balances;
+        db.ReadAddressIndexBalances(ADDRESS_BENCH_HASH, 1, "", std::numeric_limits<int>::max(), 0, balances);
+        assert(balances.size() == ADDRESS_BENCH_TOKENS);
+    }
+}
+
+// The same balances summed from every entry read into memory first
+static void AddressIndexBalancesFromEntries(benchmark::State& state)
+{
+    CBlockTreeDB& db = AddressIndexBenchDB();
+    while (state.KeepRunning()) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        db.ReadAddressIndex(ADDRESS_BENCH_HASH, 1, addressIndex);
+        std::map<std::string, CAddressIndexBalance> balances;
+        for (const auto& entry : addressIndex)
+            balances[entry.first.token].Add(entry.first.timeLock, entry.second, std::numeric_limits<int>::max(), 0);
+        assert(balances.size() == ADDRESS_BENCH_TOKENS);
+    }
+}
+
+// The entries of every token in a range of 100 blocks, the rest of each token skipped with a seek
+static void AddressIndexHeightRange(benchmark::State& state)
+{
+    CBlockTreeDB& db = AddressIndexBenchDB();
+    const int nStart = ADDRESS_BENCH_ENTRIES / ADDRESS_BENCH_ENTRIES_PER_BLOCK / ADDRESS_BENCH_TOKENS / 2;
+    while (state.KeepRunning()) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        db.ReadAddressIndex(ADDRESS_BENCH_HASH, 1, addressIndex, nStart, nStart + 99);
+        assert(addressIndex.size() == 100 * ADDRESS_BENCH_ENTRIES_PER_BLOCK * ADDRESS_BENCH_TOKENS);
+    }
+}
+
+BENCHMARK(AddressIndexBalances);
+BENCHMARK(AddressIndexBalancesFromEntries);
+BENCHMARK(AddressIndexHeightRange);
@@ -0,0 +1,95 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "addrman.h"
+#include "random.h"
+#include "timedata.h"
+
+#include <vector>
+
+static const int ADDRMAN_BENCH_ADDRESSES = 100000;
+// Peers relaying the addresses, each from its own /16
+static const int ADDRMAN_BENCH_SOURCES = 64;
+
+struct AddrManBenchEntry
+{
+    CAddress addr;
+    CNetAddr source;
+};
+
+static CNetAddr AddrManBenchIPv4(uint32_t n)
+{
+    struct in_addr ip;
+    ip.s_addr = htonl(n);
+    return CNetAddr(ip);
+}
+
+static std::vector<AddrManBenchEntry> CreateAddrManBenchEntries()
+{
+    FastRandomContext rng(true);
+    std::vector<AddrManBenchEntry> vEntries;
+    vEntries.reserve(ADDRMAN_BENCH_ADDRESSES);
+    for (int i = 0; i < ADDRMAN_BENCH_ADDRESSES; i++) {
+        // Routable addresses spread over many /16 groups, starting at 1.0.0.0
+        const uint32_t nIP = 0x01000000 + rng.randrange(0xDF000000 - 0x01000000);
+        CAddress addr(CService(AddrManBenchIPv4(nIP), 8767), NODE_NETWORK);
+        addr.nTime = GetAdjustedTime() - rng.randrange(7 * 24 * 60 * 60);
+        const CNetAddr source = AddrManBenchIPv4(0x02000000 + (i % ADDRMAN_BENCH_SOURCES) * 0x10000 + 1);
+        vEntries.push_back({addr, source});
+    }
+    return vEntries;
+}
+
+// Fills addrman and moves every eighth address to tried, as connections to it would
+static void FillAddrMan(const std::vector<AddrManBenchEntry>& vEntries, CAddrMan& addrman)
+{
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        addrman.Add(vEntries[i].addr, vEntries[i].source);
+        if (i % 8 == 0)
+            addrman.Good(vEntries[i].addr);
+    }
+}
+
+// Adding 100k addresses to an empty addrman
+static void AddrManAdd(benchmark::State& state)
+{
+    const std::vector<AddrManBenchEntry> vEntries = CreateAddrManBenchEntries();
+
+    while (state.KeepRunning()) {
+        CAddrMan addrman;
+        for (const auto& entry : vEntries)
+            addrman.Add(entry.addr, entry.source);
+    }
+}
+
+// Picking addresses to connect to from a full addrman, as ThreadOpenConnections does
+static void AddrManSelect(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(CreateAddrManBenchEntries(), addrman);
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            CAddrInfo addr = addrman.Select();
+            assert(addr.IsValid());
+        }
+    }
+}
+
+// Answering a getaddr from a full addrman
+static void AddrManGetAddr(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(CreateAddrManBenchEntries(), addrman);
+
+    while (state.KeepRunning()) {
+        std::vector<CAddress> vAddr = addrman.GetAddr();
+        assert(!vAddr.empty());
+    }
+}
+
+BENCHMARK(AddrManAdd);
+BENCHMARK(AddrManSelect);
+BENCHMARK(AddrManGetAddr);
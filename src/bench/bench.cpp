@@ -37,6 +37,7 @@ benchmark::BenchRunner::RunAll(double elapsedTimeForOne)
     for (const auto &p: benchmarks()) {
         State state(p.first, elapsedTimeForOne);
         p.second(state);
+        state.PrintCounters();
     }
     perf_fini();
 }
@@ -103,3 +104,24 @@ bool benchmark::State::KeepRunning()
 
     return false;
 }
+
+void benchmark::State::SetCounter(const std::string& counterName, double value)
+{
+    for (auto& counter : counters) {
+        if (counter.first == counterName) {
+            counter.second = value;
+            return;
+        }
+    }
+    counters.emplace_back(counterName, value);
+}
+
+void benchmark::State::PrintCounters() const
+{
+    // Same columns as the timing rows: the value is the min, max and average of a single count
+    for (const auto& counter : counters) {
+        std::cout << std::fixed << std::setprecision(15) << name << "/" << counter.first << ",1," << counter.second << ","
+                  << counter.second << "," << counter.second << ",0,0,0\n";
+        std::cout.copyfmt(std::ios(nullptr));
+    }
+}
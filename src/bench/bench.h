@@ -10,6 +10,7 @@
 #include <limits>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/stringize.hpp>
@@ -49,6 +50,7 @@ namespace benchmark {
         uint64_t lastCycles;
         uint64_t minCycles;
         uint64_t maxCycles;
+        std::vector<std::pair<std::string, double> > counters;
     public:
         State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0) {
             minTime = std::numeric_limits<double>::max();
@@ -58,6 +60,10 @@ namespace benchmark {
             countMask = 1;
         }
         bool KeepRunning();
+
+        //! Report a value the benchmark measures besides its time, printed as a row of its own once it finishes
+        void SetCounter(const std::string& counterName, double value);
+        void PrintCounters() const;
     };
 
     typedef std::function<void(State&)> BenchFunction;
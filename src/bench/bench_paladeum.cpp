@@ -6,6 +6,7 @@
 #include <chainparamsbase.h>
 #include <chainparams.h>
 #include "bench.h"
+#include "crypto/blake2b_headers.h"
 #include "crypto/sha256.h"
 #include "key.h"
 #include "validation.h"
@@ -16,6 +17,7 @@ int
 main(int argc, char **argv)
 {
     SHA256AutoDetect();
+    Blake2bAutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -4,8 +4,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "arith_uint256.h"
 #include "coins.h"
 #include "policy/policy.h"
+#include "random.h"
 #include "wallet/crypter.h"
 
 #include <vector>
@@ -85,4 +87,43 @@ static void CCoinsCaching(benchmark::State& state)
     }
 }
 
+// Connecting blocks during initial sync: each block adds outputs and spends
+// outputs of earlier blocks in a cache of its own on top of the tip cache, and
+// flushes into it; the tip cache is flushed once it grows past 64 MiB, as
+// FlushStateToDisk does with -dbcache.
+static void CCoinsCachingIBD(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache tip(&coinsDummy);
+    FastRandomContext rng(true);
+    std::vector<COutPoint> vUnspent;
+    uint32_t nTx = 0;
+    int nHeight = 0;
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&tip);
+        nHeight++;
+        for (int i = 0; i < 1000 && !vUnspent.empty(); i++) {
+            const size_t n = rng.randrange(vUnspent.size());
+            view.SpendCoin(vUnspent[n]);
+            vUnspent[n] = vUnspent.back();
+            vUnspent.pop_back();
+        }
+        for (int i = 0; i < 2000; i++) {
+            const COutPoint outpoint(ArithToUint256(arith_uint256(++nTx)), i % 2);
+            CTxOut out(50 * CENT, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG);
+            view.AddCoin(outpoint, Coin(std::move(out), nHeight, false, false, 0), false);
+            vUnspent.push_back(outpoint);
+        }
+        view.Flush();
+
+        if (tip.DynamicMemoryUsage() > (64 << 20)) {
+            // The dummy base keeps nothing, so the flushed outputs are gone
+            tip.Flush();
+            vUnspent.clear();
+        }
+    }
+}
+
 BENCHMARK(CCoinsCaching);
+BENCHMARK(CCoinsCachingIBD);
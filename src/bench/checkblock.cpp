@@ -8,7 +8,15 @@
 #include "chainparams.h"
 #include "validation.h"
 #include "streams.h"
+#include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "tokens/tokens.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <boost/thread/thread.hpp>
 
 namespace block_bench {
 #include "bench/data/block566553.raw.h"
@@ -50,9 +58,116 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
         assert(stream.Rewind(sizeof(block_bench::block566553)));
 
         CValidationState validationState;
-        assert(CheckBlock(block, validationState, chainParams->GetConsensus()));
+        assert(CheckBlock(block, validationState, block.GetIndexHash(), chainParams->GetConsensus()));
+    }
+}
+
+static void BlockMerkleRootTest(benchmark::State& state)
+{
+    CDataStream stream((const char*)block_bench::block566553,
+            (const char*)&block_bench::block566553[sizeof(block_bench::block566553)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    bool mutated;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100; i++)
+            assert(BlockMerkleRoot(block, &mutated) == block.hashMerkleRoot && !mutated);
+    }
+}
+
+// A block full of token transfers, most of them with a tag removal or a global freeze besides,
+// which is the kind of block that spends the longest in the token checks of CheckBlock
+static const int TOKEN_BLOCK_TXS = 2000;
+
+static CBlock CreateTokenBlock()
+{
+    CBlock block;
+    block.nVersion = 7;
+    block.nTime = GetTime();
+
+    CMutableTransaction coinbase;
+    coinbase.nTime = block.nTime;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    coinbase.vout[0].nValue = 10 * COIN;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    for (int n = 1; n < TOKEN_BLOCK_TXS; n++) {
+        const std::string strName = strprintf("TOKEN%d", n % 100);
+        const CTxDestination dest = CKeyID(uint160(ParseHex(strprintf("%040x", n))));
+
+        CMutableTransaction tx;
+        tx.nTime = block.nTime;
+        tx.vin.resize(2);
+        tx.vin[0].prevout = COutPoint(uint256S(strprintf("%064x", n)), 0);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vin[1].prevout = COutPoint(uint256S(strprintf("%064x", n)), 1);
+        tx.vin[1].scriptSig = CScript() << OP_1;
+        tx.vout.resize(4);
+        for (int i = 0; i < 3; i++) {
+            tx.vout[i].scriptPubKey = GetScriptForDestination(dest);
+            CTokenTransfer(strName, (i + 1) * COIN, 0).ConstructTransaction(tx.vout[i].scriptPubKey);
+        }
+        tx.vout[3].scriptPubKey = GetScriptForDestination(dest);
+        tx.vout[3].nValue = COIN;
+        if (n % 3 == 1) {
+            tx.vout.resize(6);
+            tx.vout[4].scriptPubKey = GetScriptForDestination(dest);
+            CTokenTransfer(strprintf("#TAG%d", n % 16), COIN, 0).ConstructTransaction(tx.vout[4].scriptPubKey);
+            tx.vout[5].scriptPubKey = GetScriptForNullTokenDataDestination(dest);
+            CNullTokenTxData(strprintf("#TAG%d", n % 16), 0).ConstructTransaction(tx.vout[5].scriptPubKey);
+        } else if (n % 3 == 2) {
+            tx.vout.resize(6);
+            tx.vout[4].scriptPubKey = GetScriptForDestination(dest);
+            CTokenTransfer(strprintf("FROZEN%d!", n % 16), OWNER_TOKEN_AMOUNT, 0).ConstructTransaction(tx.vout[4].scriptPubKey);
+            CNullTokenTxData(strprintf("$FROZEN%d", n % 16), 1).ConstructGlobalRestrictionTransaction(tx.vout[5].scriptPubKey);
+        }
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static void CheckTokenBlock(benchmark::State& state, int nThreads)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CBlock blockTemplate = CreateTokenBlock();
+    const uint256 hash = blockTemplate.GetIndexHash();
+
+    // The script check threads, the calling thread being one of them
+    boost::thread_group threadGroup;
+    nScriptCheckThreads = nThreads;
+    for (int i = 0; i < nThreads - 1; i++)
+        threadGroup.create_thread(&ThreadScriptCheck);
+
+    while (state.KeepRunning()) {
+        CBlock block(blockTemplate); // CBlock caches its checked state
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, hash, chainParams->GetConsensus(), false, true, false, false));
     }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nScriptCheckThreads = 0;
+}
+
+static void CheckTokenBlockTest(benchmark::State& state)
+{
+    CheckTokenBlock(state, 0);
+}
+
+static void CheckTokenBlockParallelTest(benchmark::State& state)
+{
+    CheckTokenBlock(state, 4);
 }
 
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(BlockMerkleRootTest);
+BENCHMARK(CheckTokenBlockTest);
+BENCHMARK(CheckTokenBlockParallelTest);
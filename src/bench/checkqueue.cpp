@@ -12,6 +12,177 @@
 #include <boost/thread/thread.hpp>
 #include "random.h"
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace {
+
+/**
+ * The check queue as it was before the work stealing one: one vector under one
+ * mutex that every worker takes its batches from. Kept here to compare against.
+ */
+template <typename T>
+class SingleMutexCheckQueue
+{
+private:
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
+
+    //! The queue of elements to be processed.
+    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
+    std::vector<T> queue;
+
+    //! The number of workers (including the master) that are idle.
+    int nIdle;
+
+    //! The total number of workers (including the master).
+    int nTotal;
+
+    //! The temporary evaluation result.
+    bool fAllOk;
+
+    /**
+     * Number of verifications that haven't completed yet.
+     * This includes elements that are no longer queued, but still in the
+     * worker's own batches.
+     */
+    unsigned int nTodo;
+
+    //! Whether we're shutting down.
+    bool fQuit;
+
+    //! The maximum number of elements to be processed in one batch
+    unsigned int nBatchSize;
+
+    /** Internal function that does bulk of the verification work. */
+    bool Loop(bool fMaster = false)
+    {
+        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        unsigned int nNow = 0;
+        bool fOk = true;
+        do {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
+                if (nNow) {
+                    fAllOk &= fOk;
+                    nTodo -= nNow;
+                    if (nTodo == 0 && !fMaster)
+                        // We processed the last element; inform the master it can exit and return the result
+                        condMaster.notify_one();
+                } else {
+                    // first iteration
+                    nTotal++;
+                }
+                // logically, the do loop starts here
+                while (queue.empty()) {
+                    if ((fMaster || fQuit) && nTodo == 0) {
+                        nTotal--;
+                        bool fRet = fAllOk;
+                        // reset the status for new work later
+                        if (fMaster)
+                            fAllOk = true;
+                        // return the current status
+                        return fRet;
+                    }
+                    nIdle++;
+                    cond.wait(lock); // wait
+                    nIdle--;
+                }
+                // Decide how many work units to process now.
+                // * Do not try to do everything at once, but aim for increasingly smaller batches so
+                //   all workers finish approximately simultaneously.
+                // * Try to account for idle jobs which will instantly start helping.
+                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
+                vChecks.resize(nNow);
+                for (unsigned int i = 0; i < nNow; i++) {
+                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
+                    // queue to the local batch vector instead of copying.
+                    vChecks[i].swap(queue.back());
+                    queue.pop_back();
+                }
+                // Check whether we need to do work at all
+                fOk = fAllOk;
+            }
+            // execute work
+            for (T& check : vChecks)
+                if (fOk)
+                    fOk = check();
+            vChecks.clear();
+        } while (true);
+    }
+
+public:
+    //! Mutex to ensure only one concurrent CCheckQueueControl
+    boost::mutex ControlMutex;
+
+    //! Create a new check queue
+    explicit SingleMutexCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+
+    //! Worker thread
+    void Thread()
+    {
+        Loop();
+    }
+
+    //! Wait until execution finishes, and return whether all evaluations were successful.
+    bool Wait()
+    {
+        return Loop(true);
+    }
+
+    //! Add a batch of checks to the queue
+    void Add(std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (T& check : vChecks) {
+            queue.push_back(T());
+            check.swap(queue.back());
+        }
+        nTodo += vChecks.size();
+        if (vChecks.size() == 1)
+            condWorker.notify_one();
+        else if (vChecks.size() > 1)
+            condWorker.notify_all();
+    }
+
+    ~SingleMutexCheckQueue()
+    {
+    }
+
+};
+
+/** Adds the batches and waits for them on either queue */
+template <typename T>
+void RunChecks(CCheckQueue<T>& queue, std::vector<std::vector<T>>& vBatches)
+{
+    CCheckQueueControl<T> control(&queue);
+    for (auto& vChecks : vBatches)
+        control.Add(vChecks);
+    // control waits for completion by RAII, but
+    // it is done explicitly here for clarity
+    control.Wait();
+}
+
+template <typename T>
+void RunChecks(SingleMutexCheckQueue<T>& queue, std::vector<std::vector<T>>& vBatches)
+{
+    for (auto& vChecks : vBatches)
+        queue.Add(vChecks);
+    queue.Wait();
+}
+
+} // namespace
+
 
 // This Benchmark tests the CheckQueue with the lightest
 // weight Checks, so it should make any lock contention
@@ -21,23 +192,28 @@ static const size_t BATCHES = 101;
 static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const int QUEUE_BATCH_SIZE = 128;
-static void CCheckQueueSpeed(benchmark::State& state)
+// A block of token transfers: many transactions of one or two inputs,
+// each check doing a little work
+static const size_t TRANSFER_TXS = 3000;
+static const int TRANSFER_CHECK_ROUNDS = 200;
+
+struct FakeJobNoWork {
+    bool operator()()
+    {
+        return true;
+    }
+    void swap(FakeJobNoWork& x){};
+};
+
+template <typename Queue>
+static void CheckQueueSpeed(benchmark::State& state)
 {
-    struct FakeJobNoWork {
-        bool operator()()
-        {
-            return true;
-        }
-        void swap(FakeJobNoWork& x){};
-    };
-    CCheckQueue<FakeJobNoWork> queue {QUEUE_BATCH_SIZE};
+    Queue queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
-        CCheckQueueControl<FakeJobNoWork> control(&queue);
-
         // We call Add a number of times to simulate the behavior of adding
         // a block of transactions at once.
 
@@ -45,39 +221,46 @@ static void CCheckQueueSpeed(benchmark::State& state)
         for (auto& vChecks : vBatches) {
             vChecks.resize(BATCH_SIZE);
         }
-        for (auto& vChecks : vBatches) {
-            // We can't make vChecks in the inner loop because we want to measure
-            // the cost of getting the memory to each thread and we might get the same
-            // memory
-            control.Add(vChecks);
-        }
-        // control waits for completion by RAII, but
-        // it is done explicitly here for clarity
-        control.Wait();
+        // We can't make vChecks in the inner loop because we want to measure
+        // the cost of getting the memory to each thread and we might get the same
+        // memory
+        RunChecks(queue, vBatches);
     }
     tg.interrupt_all();
     tg.join_all();
 }
 
+static void CCheckQueueSpeed(benchmark::State& state)
+{
+    CheckQueueSpeed<CCheckQueue<FakeJobNoWork>>(state);
+}
+
+static void CCheckQueueSpeedSingleMutex(benchmark::State& state)
+{
+    CheckQueueSpeed<SingleMutexCheckQueue<FakeJobNoWork>>(state);
+}
+
+struct PrevectorJob {
+    prevector<PREVECTOR_SIZE, uint8_t> p;
+    PrevectorJob(){
+    }
+    explicit PrevectorJob(FastRandomContext& insecure_rand){
+        p.resize(insecure_rand.randrange(PREVECTOR_SIZE*2));
+    }
+    bool operator()()
+    {
+        return true;
+    }
+    void swap(PrevectorJob& x){p.swap(x.p);};
+};
+
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+template <typename Queue>
+static void CheckQueueSpeedPrevectorJob(benchmark::State& state)
 {
-    struct PrevectorJob {
-        prevector<PREVECTOR_SIZE, uint8_t> p;
-        PrevectorJob(){
-        }
-        explicit PrevectorJob(FastRandomContext& insecure_rand){
-            p.resize(insecure_rand.randrange(PREVECTOR_SIZE*2));
-        }
-        bool operator()()
-        {
-            return true;
-        }
-        void swap(PrevectorJob& x){p.swap(x.p);};
-    };
-    CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
+    Queue queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
     for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
        tg.create_thread([&]{queue.Thread();});
@@ -85,20 +268,79 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     while (state.KeepRunning()) {
         // Make insecure_rand here so that each iteration is identical.
         FastRandomContext insecure_rand(true);
-        CCheckQueueControl<PrevectorJob> control(&queue);
         std::vector<std::vector<PrevectorJob>> vBatches(BATCHES);
         for (auto& vChecks : vBatches) {
             vChecks.reserve(BATCH_SIZE);
             for (size_t x = 0; x < BATCH_SIZE; ++x)
                 vChecks.emplace_back(insecure_rand);
-            control.Add(vChecks);
         }
-        // control waits for completion by RAII, but
-        // it is done explicitly here for clarity
-        control.Wait();
+        RunChecks(queue, vBatches);
     }
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CheckQueueSpeedPrevectorJob<CCheckQueue<PrevectorJob>>(state);
+}
+
+static void CCheckQueueSpeedPrevectorJobSingleMutex(benchmark::State& state)
+{
+    CheckQueueSpeedPrevectorJob<SingleMutexCheckQueue<PrevectorJob>>(state);
+}
+
+struct TransferJob {
+    uint64_t nSeed;
+    TransferJob() : nSeed(0) {}
+    explicit TransferJob(uint64_t nSeedIn) : nSeed(nSeedIn) {}
+    bool operator()()
+    {
+        uint64_t x = nSeed;
+        for (int i = 0; i < TRANSFER_CHECK_ROUNDS; i++)
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        return x != 0 || nSeed == 0;
+    }
+    void swap(TransferJob& x){std::swap(nSeed, x.nSeed);};
+};
+
+// Checks a block of small token transfers: one Add per transaction of one or
+// two inputs, which is where the workers meet on the queue the most
+template <typename Queue>
+static void CheckQueueSpeedTokenTransfers(benchmark::State& state)
+{
+    Queue queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        FastRandomContext insecure_rand(true);
+        std::vector<std::vector<TransferJob>> vBatches(TRANSFER_TXS);
+        for (auto& vChecks : vBatches) {
+            const size_t nInputs = 1 + insecure_rand.randrange(2);
+            for (size_t x = 0; x < nInputs; ++x)
+                vChecks.emplace_back(insecure_rand.rand64());
+        }
+        RunChecks(queue, vBatches);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueSpeedTokenTransfers(benchmark::State& state)
+{
+    CheckQueueSpeedTokenTransfers<CCheckQueue<TransferJob>>(state);
+}
+
+static void CCheckQueueSpeedTokenTransfersSingleMutex(benchmark::State& state)
+{
+    CheckQueueSpeedTokenTransfers<SingleMutexCheckQueue<TransferJob>>(state);
+}
+
 BENCHMARK(CCheckQueueSpeed);
+BENCHMARK(CCheckQueueSpeedSingleMutex);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueSpeedPrevectorJobSingleMutex);
+BENCHMARK(CCheckQueueSpeedTokenTransfers);
+BENCHMARK(CCheckQueueSpeedTokenTransfersSingleMutex);
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "tokens/tokens.h"
 #include "wallet/wallet.h"
 
 #include <set>
@@ -57,4 +58,70 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+
+static void addTokenCoin(const CAmount& nAmount, const CWallet& wallet, std::vector<COutput>& vCoins)
+{
+    static int nextLockTime = 0;
+    CMutableTransaction tx;
+    tx.nLockTime = nextLockTime++; // so all transactions get different hashes
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = GetScriptForDestination(CKeyID());
+    CTokenTransfer("BENCH", nAmount, 0).ConstructTransaction(tx.vout[0].scriptPubKey);
+    CWalletTx* wtx = new CWalletTx(&wallet, MakeTransactionRef(std::move(tx)));
+
+    int nAge = 6 * 24;
+    COutput output(wtx, 0, nAge, true /* spendable */, true /* solvable */, true /* safe */);
+    vCoins.push_back(output);
+}
+
+static void TokenCoinSelection(benchmark::State& state, const std::vector<CAmount>& vAmounts, const CAmount& nTarget, size_t nInputs)
+{
+    const CWallet wallet;
+    std::map<std::string, std::vector<COutput> > mapTokenCoins;
+    std::vector<COutput>& vCoins = mapTokenCoins["BENCH"];
+    for (const CAmount& nAmount : vAmounts)
+        addTokenCoin(nAmount, wallet, vCoins);
+    std::map<std::string, CAmount> mapTarget = {{"BENCH", nTarget}};
+    LOCK(wallet.cs_wallet);
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        std::map<std::string, CAmount> mapValueRet;
+        bool success = wallet.SelectTokens(mapTokenCoins, mapTarget, setCoinsRet, mapValueRet);
+        assert(success);
+        assert(mapValueRet["BENCH"] == nTarget);
+        assert(setCoinsRet.size() == nInputs);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
+// The token version of CoinSelection: 1000 large outputs and a small one that makes the exact amount
+static void TokenCoinSelectionExact(benchmark::State& state)
+{
+    std::vector<CAmount> vAmounts(1000, 1000 * COIN);
+    vAmounts.push_back(3 * COIN);
+    TokenCoinSelection(state, vAmounts, 1003 * COIN, 2);
+}
+
+// A payout from a wallet holding 5000 outputs of assorted small amounts
+static void TokenCoinSelectionMany(benchmark::State& state)
+{
+    std::vector<CAmount> vAmounts;
+    for (int i = 0; i < 5000; i++)
+        vAmounts.push_back((1 + (i * 7919) % 100) * COIN);
+    TokenCoinSelection(state, vAmounts, 250 * COIN, 3);
+}
+
+// Sweeping every output of the wallet
+static void TokenCoinSelectionSweep(benchmark::State& state)
+{
+    std::vector<CAmount> vAmounts(2000, 5 * COIN);
+    TokenCoinSelection(state, vAmounts, 10000 * COIN, 2000);
+}
+
 BENCHMARK(CoinSelection);
+BENCHMARK(TokenCoinSelectionExact);
+BENCHMARK(TokenCoinSelectionMany);
+BENCHMARK(TokenCoinSelectionSweep);
@@ -11,6 +11,9 @@
 #include "random.h"
 #include "uint256.h"
 #include "utiltime.h"
+#include "crypto/blake2b.h"
+#include "crypto/blake2b_headers.h"
+#include "crypto/pbkdf2_hmac_sha512.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -53,6 +56,67 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D_Final4(benchmark::State& state)
+{
+    uint32_t states[4 * 8] = {};
+    uint8_t blocks[4 * 64] = {};
+    uint8_t hashes[4 * CSHA256::OUTPUT_SIZE];
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 250000; i++) {
+            SHA256DFinal(hashes, states, blocks, 4);
+            blocks[0] = hashes[0];
+        }
+    }
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
+static void SHA256D64_1024_Single(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1024; i++)
+            CHash256().Write(&in[64 * i], 64).Finalize(&in[32 * i]);
+    }
+}
+
+/* Number of block headers to work hash per iteration */
+static const size_t HEADER_COUNT = 10000;
+
+static void BLAKE2b_Header_Portable(benchmark::State& state)
+{
+    std::vector<uint8_t> in(HEADER_COUNT * BLAKE2B_HEADER_SIZE, 0);
+    std::vector<uint8_t> out(HEADER_COUNT * 32);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < HEADER_COUNT; i++)
+            blake2b_hash(&out[i * 32], &in[i * BLAKE2B_HEADER_SIZE], BLAKE2B_HEADER_SIZE);
+    }
+}
+
+static void BLAKE2b_Header(benchmark::State& state)
+{
+    std::vector<uint8_t> in(HEADER_COUNT * BLAKE2B_HEADER_SIZE, 0);
+    std::vector<uint8_t> out(HEADER_COUNT * 32);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < HEADER_COUNT; i++)
+            Blake2b256Headers(&out[i * 32], &in[i * BLAKE2B_HEADER_SIZE], 1);
+    }
+}
+
+static void BLAKE2b_Header_Batch(benchmark::State& state)
+{
+    std::vector<uint8_t> in(HEADER_COUNT * BLAKE2B_HEADER_SIZE, 0);
+    std::vector<uint8_t> out(HEADER_COUNT * 32);
+    while (state.KeepRunning())
+        Blake2b256Headers(out.data(), in.data(), HEADER_COUNT);
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -61,6 +125,16 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+// A BIP39 mnemonic to seed: 2048 rounds for a 64 byte seed
+static void PBKDF2_HMAC_SHA512_BIP39(benchmark::State& state)
+{
+    const std::string strMnemonic = "legal winner thank year wave sausage worth useful legal winner thank yellow";
+    const std::string strSalt = "mnemonicTREZOR";
+    uint8_t seed[64];
+    while (state.KeepRunning())
+        PBKDF2_HMAC_SHA512((const uint8_t*)strMnemonic.data(), strMnemonic.size(), (const uint8_t*)strSalt.data(), strSalt.size(), 2048, seed, sizeof(seed));
+}
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -97,8 +171,15 @@ BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
+BENCHMARK(PBKDF2_HMAC_SHA512_BIP39);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D_Final4);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(SHA256D64_1024_Single);
+BENCHMARK(BLAKE2b_Header_Portable);
+BENCHMARK(BLAKE2b_Header);
+BENCHMARK(BLAKE2b_Header_Batch);
 BENCHMARK(SipHash_32b);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
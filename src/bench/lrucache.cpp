@@ -0,0 +1,105 @@
+// Copyright (c) 2021-2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "tokens/tokentypes.h"
+
+#include <list>
+#include <unordered_map>
+
+//! The std::list backed LRU cache CLRUCache replaced, kept as a baseline
+template<typename cache_key_t, typename cache_value_t>
+class ListLRUCache
+{
+public:
+    typedef typename std::pair<cache_key_t, cache_value_t> key_value_pair_t;
+    typedef typename std::list<key_value_pair_t>::iterator list_iterator_t;
+
+    ListLRUCache(size_t max_size) : maxSize(max_size) {}
+
+    void Put(const cache_key_t& key, const cache_value_t& value)
+    {
+        auto it = cacheItemsMap.find(key);
+        cacheItemsList.push_front(key_value_pair_t(key, value));
+        if (it != cacheItemsMap.end()) {
+            cacheItemsList.erase(it->second);
+            cacheItemsMap.erase(it);
+        }
+        cacheItemsMap[key] = cacheItemsList.begin();
+
+        if (cacheItemsMap.size() > maxSize) {
+            auto last = cacheItemsList.end();
+            last--;
+            cacheItemsMap.erase(last->first);
+            cacheItemsList.pop_back();
+        }
+    }
+
+    const cache_value_t& Get(const cache_key_t& key)
+    {
+        auto it = cacheItemsMap.find(key);
+        if (it == cacheItemsMap.end())
+            throw std::range_error("There is no such key in cache");
+        cacheItemsList.splice(cacheItemsList.begin(), cacheItemsList, it->second);
+        return it->second->second;
+    }
+
+    bool Exists(const cache_key_t& key) const
+    {
+        return cacheItemsMap.find(key) != cacheItemsMap.end();
+    }
+
+private:
+    std::list<key_value_pair_t> cacheItemsList;
+    std::unordered_map<cache_key_t, list_iterator_t> cacheItemsMap;
+    size_t maxSize;
+};
+
+static const size_t LRU_BENCH_CACHE_SIZE = 2500;
+static const size_t LRU_BENCH_KEYS = 4 * LRU_BENCH_CACHE_SIZE;
+
+static std::vector<std::string> LRUBenchKeys()
+{
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < LRU_BENCH_KEYS; i++)
+        keys.emplace_back("BENCHMARK_TOKEN/SUB_TOKEN_" + std::to_string(i));
+    return keys;
+}
+
+// Token lookups: check the cache, read on a hit and insert on a miss, with a working set larger than the cache
+template<typename Cache>
+static void LRUCacheLookups(benchmark::State& state)
+{
+    const std::vector<std::string> keys = LRUBenchKeys();
+    Cache cache(LRU_BENCH_CACHE_SIZE);
+    uint64_t nRand = 0;
+    int64_t nSum = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            // Skewed towards the low keys so most lookups hit
+            nRand = nRand * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t nKey = (nRand >> 33) % LRU_BENCH_KEYS;
+            nKey = nKey * nKey / LRU_BENCH_KEYS;
+            const std::string& key = keys[nKey];
+            if (cache.Exists(key))
+                nSum += cache.Get(key);
+            else
+                cache.Put(key, (int64_t)nKey);
+        }
+    }
+    assert(nSum >= 0);
+}
+
+static void IntrusiveLRUCacheLookups(benchmark::State& state)
+{
+    LRUCacheLookups<CLRUCache<std::string, int64_t> >(state);
+}
+
+static void ListLRUCacheLookups(benchmark::State& state)
+{
+    LRUCacheLookups<ListLRUCache<std::string, int64_t> >(state);
+}
+
+BENCHMARK(IntrusiveLRUCacheLookups);
+BENCHMARK(ListLRUCacheLookups);
@@ -0,0 +1,228 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "base58.h"
+#include "policy/policy.h"
+#include "script/standard.h"
+#include "tokens/tokens.h"
+#include "txmempool.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+// Each group is an issuance, a chain of three restricted token transfers spending from it, a tag and a global freeze
+static const int TOKEN_BENCH_GROUPS = 400;
+static const int TOKEN_BENCH_CHAIN = 3;
+
+enum class TokenBenchKind { ISSUE, TRANSFER, TAG, FREEZE };
+
+struct TokenBenchTx
+{
+    CTransactionRef tx;
+    CAmount nFee;
+    TokenBenchKind kind;
+    std::string strName;
+    std::string strAddress;
+};
+
+static CTxDestination TokenBenchDestination(int n)
+{
+    return CKeyID(uint160(ParseHex(strprintf("%040x", n + 1))));
+}
+
+static std::vector<TokenBenchTx> CreateTokenBenchTxs()
+{
+    std::vector<TokenBenchTx> vTxs;
+    for (int g = 0; g < TOKEN_BENCH_GROUPS; g++) {
+        const std::string strName = strprintf("$TOKEN%d", g);
+        const CTxDestination dest = TokenBenchDestination(g);
+        const std::string strAddress = EncodeDestination(dest);
+
+        CMutableTransaction issue;
+        issue.vin.resize(1);
+        issue.vin[0].prevout = COutPoint(uint256S(strprintf("%064x", g + 1)), 0);
+        issue.vin[0].scriptSig = CScript() << OP_1;
+        issue.vout.resize(2);
+        issue.vout[0].scriptPubKey = GetScriptForDestination(dest);
+        CNewToken(strName, 1000 * COIN).ConstructTransaction(issue.vout[0].scriptPubKey);
+        issue.vout[1].scriptPubKey = GetScriptForDestination(dest);
+        issue.vout[1].nValue = 10 * COIN;
+        vTxs.push_back({MakeTransactionRef(issue), 1000 + (g * 37) % 5000, TokenBenchKind::ISSUE, strName, strAddress});
+
+        // Each transfer spends the token output of the one before it
+        uint256 hashPrev = issue.GetHash();
+        for (int c = 0; c < TOKEN_BENCH_CHAIN; c++) {
+            CMutableTransaction transfer;
+            transfer.vin.resize(1);
+            transfer.vin[0].prevout = COutPoint(hashPrev, 0);
+            transfer.vin[0].scriptSig = CScript() << OP_1;
+            transfer.vout.resize(2);
+            const CTxDestination destTo = TokenBenchDestination(TOKEN_BENCH_GROUPS + g * TOKEN_BENCH_CHAIN + c);
+            transfer.vout[0].scriptPubKey = GetScriptForDestination(destTo);
+            CTokenTransfer(strName, (1000 - c) * COIN, 0).ConstructTransaction(transfer.vout[0].scriptPubKey);
+            transfer.vout[1].scriptPubKey = GetScriptForDestination(dest);
+            CTokenTransfer(strName, COIN, 0).ConstructTransaction(transfer.vout[1].scriptPubKey);
+            vTxs.push_back({MakeTransactionRef(transfer), 1000 + ((g + c) * 53) % 5000, TokenBenchKind::TRANSFER, strName, EncodeDestination(destTo)});
+            hashPrev = transfer.GetHash();
+        }
+
+        CMutableTransaction tag;
+        tag.vin.resize(1);
+        tag.vin[0].prevout = COutPoint(uint256S(strprintf("%064x", g + 1)), 1);
+        tag.vin[0].scriptSig = CScript() << OP_1;
+        tag.vout.resize(1);
+        tag.vout[0].scriptPubKey = GetScriptForNullTokenDataDestination(dest);
+        CNullTokenTxData(strprintf("#TAG%d", g % 16), 1).ConstructTransaction(tag.vout[0].scriptPubKey);
+        vTxs.push_back({MakeTransactionRef(tag), 1000 + (g * 71) % 5000, TokenBenchKind::TAG, strprintf("#TAG%d", g % 16), strAddress});
+
+        CMutableTransaction freeze;
+        freeze.vin.resize(1);
+        freeze.vin[0].prevout = COutPoint(uint256S(strprintf("%064x", g + 1)), 2);
+        freeze.vin[0].scriptSig = CScript() << OP_1;
+        freeze.vout.resize(1);
+        const std::string strFrozen = strprintf("$FROZEN%d", g);
+        CNullTokenTxData(strFrozen, 1).ConstructGlobalRestrictionTransaction(freeze.vout[0].scriptPubKey);
+        vTxs.push_back({MakeTransactionRef(freeze), 1000 + (g * 89) % 5000, TokenBenchKind::FREEZE, strFrozen, ""});
+    }
+    return vTxs;
+}
+
+// Adds the entry and records it in the token helper maps the way AcceptToMemoryPoolWorker does
+static void AddTokenTx(const TokenBenchTx& btx, CTxMemPool& pool)
+{
+    LockPoints lp;
+    const uint256& hash = btx.tx->GetHash();
+    pool.addUnchecked(hash, CTxMemPoolEntry(btx.tx, btx.nFee, 0, 1, false, 4, lp));
+
+    LOCK(pool.cs);
+    switch (btx.kind) {
+        case TokenBenchKind::ISSUE:
+            pool.AddNewToken(btx.strName, hash);
+            break;
+        case TokenBenchKind::TRANSFER:
+            pool.restrictedStateIndex.Add(CRestrictedStateIndex::QUALIFIERS_CHANGED, hash, btx.strAddress);
+            pool.restrictedStateIndex.Add(CRestrictedStateIndex::VERIFIER_CHANGED, hash, btx.strName);
+            pool.restrictedStateIndex.Add(CRestrictedStateIndex::MARKED_FROZEN, hash, btx.strName, btx.strAddress);
+            break;
+        case TokenBenchKind::TAG:
+            pool.restrictedStateIndex.Add(CRestrictedStateIndex::ADDED_TAG, hash, btx.strName, btx.strAddress);
+            break;
+        case TokenBenchKind::FREEZE:
+            pool.restrictedStateIndex.Add(CRestrictedStateIndex::GLOBAL_FREEZING, hash, btx.strName);
+            break;
+    }
+}
+
+static void FillTokenMempool(const std::vector<TokenBenchTx>& vTxs, CTxMemPool& pool)
+{
+    for (const auto& btx : vTxs)
+        AddTokenTx(btx, pool);
+}
+
+// Filling an empty mempool with the token flood, then clearing it
+static void MempoolTokenAdd(benchmark::State& state)
+{
+    const std::vector<TokenBenchTx> vTxs = CreateTokenBenchTxs();
+    CTxMemPool pool;
+
+    bool fReported = false;
+    while (state.KeepRunning()) {
+        FillTokenMempool(vTxs, pool);
+        if (!fReported) {
+            state.SetCounter("bytes_per_entry", (double)pool.DynamicMemoryUsage() / pool.size());
+            fReported = true;
+        }
+        pool.clear();
+    }
+}
+
+// As MempoolTokenAdd, then every issuance removed with the transfers spending from it; the difference is the removal
+static void MempoolTokenRemove(benchmark::State& state)
+{
+    const std::vector<TokenBenchTx> vTxs = CreateTokenBenchTxs();
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        FillTokenMempool(vTxs, pool);
+        for (const auto& btx : vTxs)
+            if (btx.kind != TokenBenchKind::TRANSFER)
+                pool.removeRecursive(*btx.tx);
+        assert(pool.size() == 0);
+    }
+}
+
+// As MempoolTokenAdd, then the mempool trimmed to half its size
+static void MempoolTokenTrim(benchmark::State& state)
+{
+    const std::vector<TokenBenchTx> vTxs = CreateTokenBenchTxs();
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        FillTokenMempool(vTxs, pool);
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+        pool.clear();
+    }
+}
+
+// As MempoolTokenAdd, then a block that issues every token and freezes every frozen token of the mempool first
+static void MempoolTokenConflicts(benchmark::State& state)
+{
+    const std::vector<TokenBenchTx> vTxs = CreateTokenBenchTxs();
+    CTxMemPool pool;
+
+    ConnectedBlockTokenData connectedBlockData;
+    for (const auto& btx : vTxs) {
+        if (btx.kind == TokenBenchKind::ISSUE)
+            connectedBlockData.newTokensToAdd.insert(CTokenCacheNewToken(CNewToken(btx.strName, 1000 * COIN), btx.strAddress, 2, uint256()));
+        else if (btx.kind == TokenBenchKind::FREEZE)
+            connectedBlockData.newGlobalRestrictionsToAdd.insert(CTokenCacheRestrictedGlobal(btx.strName, RestrictedType::GLOBAL_FREEZE));
+    }
+
+    while (state.KeepRunning()) {
+        FillTokenMempool(vTxs, pool);
+        pool.removeForBlock({}, 2, connectedBlockData);
+        pool.clear();
+    }
+}
+
+// A wallet's payout chain: 25 token transfers, each spending the one before, checked against the package limits and added
+static void MempoolTokenChain(benchmark::State& state)
+{
+    const int nDepth = 25;
+    const CTxDestination dest = TokenBenchDestination(0);
+    std::vector<CTransactionRef> vChain;
+    for (int i = 0; i < nDepth; i++) {
+        CMutableTransaction transfer;
+        transfer.vin.resize(1);
+        transfer.vin[0].prevout = i == 0 ? COutPoint(uint256S("01"), 0) : COutPoint(vChain.back()->GetHash(), 0);
+        transfer.vin[0].scriptSig = CScript() << OP_1;
+        transfer.vout.resize(2);
+        transfer.vout[0].scriptPubKey = GetScriptForDestination(dest);
+        CTokenTransfer("$TOKEN", (1000 - i) * COIN, 0).ConstructTransaction(transfer.vout[0].scriptPubKey);
+        transfer.vout[1].scriptPubKey = GetScriptForDestination(TokenBenchDestination(i + 1));
+        CTokenTransfer("$TOKEN", COIN, 0).ConstructTransaction(transfer.vout[1].scriptPubKey);
+        vChain.push_back(MakeTransactionRef(transfer));
+    }
+
+    CTxMemPool pool;
+    LockPoints lp;
+    std::string errString;
+    while (state.KeepRunning()) {
+        for (const auto& tx : vChain) {
+            CTxMemPoolEntry entry(tx, 1000, 0, 1, false, 4, lp);
+            CTxMemPool::setEntries setAncestors;
+            bool fValid = pool.CalculateMemPoolAncestors(entry, setAncestors, nDepth, 101000, nDepth, 101000, errString);
+            assert(fValid);
+            pool.addUnchecked(tx->GetHash(), entry, setAncestors);
+        }
+        pool.clear();
+    }
+}
+
+BENCHMARK(MempoolTokenAdd);
+BENCHMARK(MempoolTokenRemove);
+BENCHMARK(MempoolTokenTrim);
+BENCHMARK(MempoolTokenConflicts);
+BENCHMARK(MempoolTokenChain);
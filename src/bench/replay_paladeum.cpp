@@ -0,0 +1,285 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparamsbase.h>
+#include <chainparams.h>
+#include "crypto/blake2b_headers.h"
+#include "crypto/sha256.h"
+#include "key.h"
+#include "memusage.h"
+#include "prevector.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "trace.h"
+#include "txdb.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+
+#include <stdio.h>
+
+#include <map>
+
+#include <boost/thread.hpp>
+
+static const int DEFAULT_REPLAY_BLOCKS = 100;
+static const int DEFAULT_REPLAY_ROUNDS = 5;
+static const int64_t REPLAY_DB_CACHE = 64 << 20;
+
+static void PrintUsage()
+{
+    std::string strUsage = "Paladeum block replay benchmark\n\n"
+        "Disconnects the last blocks of a chainstate and connects them again, in memory,\n"
+        "and reports the block, transaction and token output rates and the time of each\n"
+        "traced phase. Point it at a copy of a stopped node's datadir: nothing is flushed,\n"
+        "but the databases are opened for writing.\n\n"
+        "Usage: replay_paladeum -datadir=<dir> [options]\n";
+    strUsage += HelpMessageGroup("Options:");
+    strUsage += HelpMessageOpt("-?", "Print this help message and exit");
+    strUsage += HelpMessageOpt("-datadir=<dir>", "Data directory holding the blocks, chainstate and token databases");
+    strUsage += HelpMessageOpt("-blocks=<n>", strprintf("Replay the last <n> blocks of the chainstate (default: %u)", DEFAULT_REPLAY_BLOCKS));
+    strUsage += HelpMessageOpt("-rounds=<n>", strprintf("Disconnect and connect the blocks <n> times (default: %u)", DEFAULT_REPLAY_ROUNDS));
+    strUsage += HelpMessageOpt("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, default: %d)", -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-tracefile=<file>", "Also write the spans of the replay to <file> in the Chrome trace event format");
+    strUsage += HelpMessageOpt("-scriptsizes", "Instead of replaying, report the sizes of the unspent output scripts and the memory each inline capacity of CScript would hold them in");
+    strUsage += HelpMessageOpt("-testnet", "Use the test chain");
+    strUsage += HelpMessageOpt("-regtest", "Use the regression test chain");
+    fprintf(stdout, "%s", strUsage.c_str());
+}
+
+/** Open the databases the way AppInitMain does, less messaging and the wallet's */
+static bool OpenChainState(const CChainParams& chainparams)
+{
+    pblocktree = new CBlockTreeDB(REPLAY_DB_CACHE, false, false);
+    pdbenv = new CDBEnvironment(REPLAY_DB_CACHE);
+    ptokensdb = new CTokensDB(REPLAY_DB_CACHE, false, false, pdbenv);
+    ptokens = new CTokensCache();
+    ptokensCache = new CShardedLRUCache<std::string, CDatabasedTokenData>(MAX_CACHE_TOKENS_SIZE);
+    prestricteddb = new CRestrictedDB(REPLAY_DB_CACHE, false, false, pdbenv);
+    ptokensVerifierCache = new CLRUCache<std::string, CNullTokenTxVerifierString>(MAX_CACHE_TOKENS_SIZE);
+    ptokensQualifierCache = new CRestrictedLRUCache(MAX_CACHE_TOKENS_SIZE);
+    ptokensRestrictionCache = new CRestrictedLRUCache(MAX_CACHE_TOKENS_SIZE);
+    ptokensGlobalRestrictionCache = new CRestrictedLRUCache(MAX_CACHE_TOKENS_SIZE);
+    pSnapshotRequestDb = new CSnapshotRequestDB(REPLAY_DB_CACHE, false, false, pdbenv);
+    pTokenSnapshotDb = new CTokenSnapshotDB(REPLAY_DB_CACHE, false, false, pdbenv);
+    pDistributeSnapshotDb = new CDistributeSnapshotRequestDB(REPLAY_DB_CACHE, false, false, pdbenv);
+    governance = new CGovernance(REPLAY_DB_CACHE, false, false, pdbenv);
+
+    pblocktree->ReadFlag("tokenindex", fTokenIndex);
+    // Replayed messages would be announced and stored
+    fMessaging = false;
+    if (!ptokensdb->LoadTokens())
+        return error("Failed to load the token database");
+    if (!governance->Init(false, chainparams))
+        return error("Failed to load the governance database");
+    if (!LoadBlockIndex(chainparams))
+        return error("Failed to load the block index");
+    // Connecting would rewrite the entries of the transaction index
+    fTxIndex = false;
+
+    pcoinsdbview = new CCoinsViewDB(REPLAY_DB_CACHE, false, false);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    if (pcoinsTip->GetBestBlock().IsNull() || !LoadChainTip(chainparams))
+        return error("The datadir has no chainstate to replay");
+    return true;
+}
+
+static void CloseChainState()
+{
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    pcoinsTip = nullptr;
+    delete pcoinsdbview;
+    pcoinsdbview = nullptr;
+    delete pblocktree;
+    pblocktree = nullptr;
+    delete ptokens;
+    ptokens = nullptr;
+    delete ptokensdb;
+    ptokensdb = nullptr;
+    delete ptokensCache;
+    ptokensCache = nullptr;
+    delete prestricteddb;
+    prestricteddb = nullptr;
+    delete ptokensVerifierCache;
+    ptokensVerifierCache = nullptr;
+    delete ptokensQualifierCache;
+    ptokensQualifierCache = nullptr;
+    delete ptokensRestrictionCache;
+    ptokensRestrictionCache = nullptr;
+    delete ptokensGlobalRestrictionCache;
+    ptokensGlobalRestrictionCache = nullptr;
+    delete pSnapshotRequestDb;
+    pSnapshotRequestDb = nullptr;
+    delete pTokenSnapshotDb;
+    pTokenSnapshotDb = nullptr;
+    delete pDistributeSnapshotDb;
+    pDistributeSnapshotDb = nullptr;
+    delete governance;
+    governance = nullptr;
+    delete pdbenv;
+    pdbenv = nullptr;
+}
+
+static double PerSecond(int64_t nCount, int64_t nMicros)
+{
+    return nMicros > 0 ? nCount * 1000000.0 / nMicros : 0;
+}
+
+static void PrintReport(const CChainReplayStats& stats)
+{
+    std::string strReport = strprintf("Replayed %d blocks, %d transactions and %d token outputs %d times\n\n",
+        stats.nBlocks, stats.nTransactions, stats.nTokenOutputs, stats.vConnectMicros.size());
+    strReport += strprintf("%-6s %14s %14s %12s %12s %14s\n", "round", "disconnect_ms", "connect_ms", "blocks/s", "txs/s", "token_outs/s");
+    for (size_t i = 0; i < stats.vConnectMicros.size(); i++) {
+        const int64_t nConnect = stats.vConnectMicros[i];
+        strReport += strprintf("%-6d %14.2f %14.2f %12.1f %12.1f %14.1f\n", i + 1, 0.001 * stats.vDisconnectMicros[i], 0.001 * nConnect,
+            PerSecond(stats.nBlocks, nConnect), PerSecond(stats.nTransactions, nConnect), PerSecond(stats.nTokenOutputs, nConnect));
+    }
+
+    // Summed over the rounds; the first reads the coins from the database, the later ones mostly find them in memory
+    strReport += strprintf("\n%-40s %10s %12s %10s\n", "phase", "count", "total_ms", "max_ms");
+    for (const TraceSpanStats& span : GetTraceStats())
+        strReport += strprintf("%-40s %10d %12.2f %10.2f\n", span.strName, span.nCount, 0.001 * span.nTotalMicros, 0.001 * span.nMaxMicros);
+    fprintf(stdout, "%s", strReport.c_str());
+}
+
+//! The number of unspent outputs with a script of a size, and how many of them are token outputs
+struct ScriptSizeCount {
+    int64_t nOutputs = 0;
+    int64_t nTokenOutputs = 0;
+};
+
+//! A CTxOut with the script inline up to N bytes, as CScriptBase is for N = 28
+template <unsigned int N>
+struct TxOutWithInline {
+    CAmount nValue;
+    prevector<N, unsigned char> script;
+};
+static_assert(sizeof(TxOutWithInline<28>) == sizeof(CTxOut), "the model of CTxOut is out of date");
+
+template <unsigned int N>
+static void ReportInlineCapacity(const std::map<size_t, ScriptSizeCount>& mapSizes, std::string& strReport)
+{
+    int64_t nOutputs = 0, nHeapOutputs = 0, nHeapTokenOutputs = 0, nHeapBytes = 0;
+    for (const auto& size : mapSizes) {
+        nOutputs += size.second.nOutputs;
+        if (size.first <= N)
+            continue;
+        nHeapOutputs += size.second.nOutputs;
+        nHeapTokenOutputs += size.second.nTokenOutputs;
+        nHeapBytes += size.second.nOutputs * memusage::MallocUsage(size.first);
+    }
+    const int64_t nInlineBytes = nOutputs * sizeof(TxOutWithInline<N>);
+    strReport += strprintf("%-8u %10u %14d %14d %14.1f %14.1f %14.1f\n", N, sizeof(TxOutWithInline<N>), nHeapOutputs, nHeapTokenOutputs,
+        nInlineBytes / 1048576.0, nHeapBytes / 1048576.0, (nInlineBytes + nHeapBytes) / 1048576.0);
+}
+
+/**
+ * Walk the unspent outputs and report what CScriptBase at its inline capacity and at larger ones would take to hold
+ * their scripts: the outputs that go to the heap, and the bytes of the outputs themselves and of their heap blocks.
+ */
+static bool ReportScriptSizes()
+{
+    std::map<size_t, ScriptSizeCount> mapSizes;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    while (pcursor->Valid()) {
+        Coin coin;
+        if (!pcursor->GetValue(coin))
+            return error("Unable to read an unspent output");
+        ScriptSizeCount& count = mapSizes[coin.out.scriptPubKey.size()];
+        count.nOutputs++;
+        if (coin.out.scriptPubKey.IsTokenScript())
+            count.nTokenOutputs++;
+        pcursor->Next();
+    }
+
+    std::string strReport = strprintf("%-8s %14s %14s\n", "size", "outputs", "token_outputs");
+    for (const auto& size : mapSizes)
+        strReport += strprintf("%-8d %14d %14d\n", size.first, size.second.nOutputs, size.second.nTokenOutputs);
+
+    strReport += strprintf("\n%-8s %10s %14s %14s %14s %14s %14s\n", "inline", "txout_size", "heap_outputs", "heap_tokens", "txouts_mb", "heap_mb", "total_mb");
+    ReportInlineCapacity<28>(mapSizes, strReport);
+    ReportInlineCapacity<36>(mapSizes, strReport);
+    ReportInlineCapacity<44>(mapSizes, strReport);
+    ReportInlineCapacity<52>(mapSizes, strReport);
+    ReportInlineCapacity<60>(mapSizes, strReport);
+    ReportInlineCapacity<76>(mapSizes, strReport);
+    fprintf(stdout, "%s", strReport.c_str());
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    SetupEnvironment();
+    gArgs.ParseParameters(argc, argv);
+    if (argc < 2 || gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help")) {
+        PrintUsage();
+        return EXIT_SUCCESS;
+    }
+    if (!fs::is_directory(GetDataDir(false))) {
+        fprintf(stderr, "Error: Specified data directory \"%s\" does not exist.\n", gArgs.GetArg("-datadir", "").c_str());
+        return EXIT_FAILURE;
+    }
+    try {
+        SelectParams(ChainNameFromCommandLine());
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    fPrintToDebugLog = false;
+    fPrintToConsole = gArgs.GetBoolArg("-printtoconsole", false);
+
+    SHA256AutoDetect();
+    Blake2bAutoDetect();
+    RandomInit();
+    ECC_Start();
+    InitSignatureCache();
+    InitScriptExecutionCache();
+
+    // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
+    nScriptCheckThreads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += GetNumCores();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        threadGroup.create_thread(&ThreadScriptCheck);
+
+    const CChainParams& chainparams = GetParams();
+    int nRet = EXIT_FAILURE;
+    try {
+        if (!OpenChainState(chainparams)) {
+            fprintf(stderr, "Error: could not open the chainstate in %s, run with -printtoconsole for details\n", GetDataDir().string().c_str());
+        } else if (gArgs.GetBoolArg("-scriptsizes", false)) {
+            if (ReportScriptSizes())
+                nRet = EXIT_SUCCESS;
+            else
+                fprintf(stderr, "Error: could not read the unspent outputs, run with -printtoconsole for details\n");
+        } else {
+            CChainReplayStats stats;
+            SetTracing(true);
+            if (ReplayChainTip(chainparams, gArgs.GetArg("-blocks", DEFAULT_REPLAY_BLOCKS), std::max<int64_t>(1, gArgs.GetArg("-rounds", DEFAULT_REPLAY_ROUNDS)), stats)) {
+                PrintReport(stats);
+                if (gArgs.IsArgSet("-tracefile") && WriteTraceEvents(fs::absolute(gArgs.GetArg("-tracefile", ""))) < 0)
+                    fprintf(stderr, "Error: could not write %s\n", gArgs.GetArg("-tracefile", "").c_str());
+                nRet = EXIT_SUCCESS;
+            } else {
+                fprintf(stderr, "Error: the replay failed, run with -printtoconsole for details\n");
+            }
+            SetTracing(false);
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    CloseChainState();
+    ECC_Stop();
+    return nRet;
+}
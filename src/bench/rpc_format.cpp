@@ -0,0 +1,75 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "core_io.h"
+#include "pubkey.h"
+#include "primitives/transaction.h"
+#include "rpc/protocol.h"
+#include "script/standard.h"
+#include "tinyformat.h"
+#include "utilstrencodings.h"
+
+#include <univalue.h>
+
+static const int FORMAT_OUTPUTS = 1000;
+static const int FORMAT_ADDRESSES = 10000;
+
+// What getblock with verbosity 2 does for every transaction of a block
+static void RpcFormatTransaction(benchmark::State& state)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(10);
+    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
+        mtx.vin[i].prevout = COutPoint(uint256S(strprintf("%064x", i + 1)), i);
+        mtx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+    }
+    mtx.vout.resize(FORMAT_OUTPUTS);
+    for (int i = 0; i < FORMAT_OUTPUTS; i++) {
+        mtx.vout[i].nValue = i * 12345678;
+        mtx.vout[i].scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, (unsigned char)i))));
+    }
+    const CTransaction tx(mtx);
+
+    while (state.KeepRunning()) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(tx, uint256(), entry, true);
+        entry.write();
+    }
+}
+
+// What listaddressesbytoken streams for every holder of a token
+static void RpcFormatAddressAmounts(benchmark::State& state)
+{
+    std::vector<std::string> vAddresses;
+    for (int i = 0; i < FORMAT_ADDRESSES; i++)
+        vAddresses.push_back(strprintf("P%033d", i));
+
+    size_t nOutput = 0;
+    while (state.KeepRunning()) {
+        JSONStreamWriter stream([&nOutput](const std::string& strChunk) {
+            nOutput += strChunk.size();
+            return true;
+        });
+        stream.BeginObject();
+        for (int i = 0; i < FORMAT_ADDRESSES; i++)
+            stream.KeyAmount(vAddresses[i], (CAmount)i * 98765432, 4);
+        stream.EndObject();
+        stream.Flush();
+    }
+}
+
+static void RpcFormatHashes(benchmark::State& state)
+{
+    const uint256 hash = uint256S("c4a1f2f3e9b0d8a7c6b5a4938271605f4e3d2c1b0a99887766554433221100ff");
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            hash.GetHex();
+        }
+    }
+}
+
+BENCHMARK(RpcFormatTransaction);
+BENCHMARK(RpcFormatAddressAmounts);
+BENCHMARK(RpcFormatHashes);
@@ -0,0 +1,102 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "rpc/register.h"
+#include "rpc/server.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static const int RPC_LOAD_CHAIN_LENGTH = 1000;
+static const int RPC_LOAD_CALLS_PER_THREAD = 2000;
+// How long the contending thread holds cs_main at a time, roughly a small block being connected
+static const int64_t RPC_LOAD_HOLD_MICROS = 500;
+
+// Tip queries from nThreads concurrent RPC workers while another thread keeps taking cs_main
+static void RpcLoad(benchmark::State& state, int nThreads)
+{
+    std::vector<uint256> vHashes(RPC_LOAD_CHAIN_LENGTH);
+    std::vector<CBlockIndex> vIndex(RPC_LOAD_CHAIN_LENGTH);
+    for (int i = 0; i < RPC_LOAD_CHAIN_LENGTH; i++) {
+        vHashes[i] = uint256S(strprintf("%064x", i + 1));
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].nBits = 0x1d00ffff;
+        vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : nullptr;
+        vIndex[i].BuildSkip();
+    }
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(&vIndex.back());
+        PublishChainTipState();
+    }
+
+    CRPCTable table;
+    RegisterBlockchainRPCCommands(table);
+
+    std::vector<std::pair<const CRPCCommand*, JSONRPCRequest> > vCalls;
+    const std::vector<std::string> vMethods = {"getblockcount", "getbestblockhash", "getblockhash", "getdifficulty"};
+    for (const std::string& strMethod : vMethods) {
+        JSONRPCRequest request;
+        request.strMethod = strMethod;
+        request.params = UniValue(UniValue::VARR);
+        if (strMethod == "getblockhash")
+            request.params.push_back(RPC_LOAD_CHAIN_LENGTH / 2);
+        vCalls.emplace_back(table[strMethod], request);
+    }
+
+    std::atomic<bool> fStop(false);
+    std::thread contender([&fStop] {
+        while (!fStop) {
+            LOCK(cs_main);
+            int64_t nEnd = GetTimeMicros() + RPC_LOAD_HOLD_MICROS;
+            while (GetTimeMicros() < nEnd) {}
+        }
+    });
+
+    while (state.KeepRunning()) {
+        std::vector<std::thread> vWorkers;
+        for (int t = 0; t < nThreads; t++) {
+            vWorkers.emplace_back([&vCalls, t] {
+                for (int i = 0; i < RPC_LOAD_CALLS_PER_THREAD; i++) {
+                    const auto& call = vCalls[(i + t) % vCalls.size()];
+                    call.first->actor(call.second);
+                }
+            });
+        }
+        for (auto& worker : vWorkers)
+            worker.join();
+    }
+
+    fStop = true;
+    contender.join();
+
+    LOCK(cs_main);
+    chainActive.SetTip(nullptr);
+    PublishChainTipState();
+}
+
+static void RpcLoad1Thread(benchmark::State& state)
+{
+    RpcLoad(state, 1);
+}
+
+static void RpcLoad4Threads(benchmark::State& state)
+{
+    RpcLoad(state, 4);
+}
+
+static void RpcLoad16Threads(benchmark::State& state)
+{
+    RpcLoad(state, 16);
+}
+
+BENCHMARK(RpcLoad1Thread);
+BENCHMARK(RpcLoad4Threads);
+BENCHMARK(RpcLoad16Threads);
@@ -0,0 +1,56 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "key.h"
+#include "script/standard.h"
+#include "tokens/tokens.h"
+#include "utilstrencodings.h"
+#include "wallet/wallet.h"
+
+#include <vector>
+
+static const int SIGN_BENCH_INPUTS = 500;
+
+// A token sweep: SIGN_BENCH_INPUTS token outputs of the wallet's key merged into one transfer
+static void SignTokenTransaction(benchmark::State& state, int nThreads)
+{
+    CWallet wallet;
+    CKey key;
+    key.MakeNewKey(true);
+    wallet.LoadKey(key, key.GetPubKey());
+    const CScript scriptDest = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction tx;
+    std::vector<CTxOut> vPrevOuts;
+    for (int i = 0; i < SIGN_BENCH_INPUTS; i++) {
+        CScript scriptPrev = scriptDest;
+        CTokenTransfer("TOKEN", COIN, 0).ConstructTransaction(scriptPrev);
+        vPrevOuts.emplace_back(0, scriptPrev);
+        tx.vin.emplace_back(COutPoint(uint256S(strprintf("%064x", i + 1)), 0));
+    }
+    CScript scriptTransfer = scriptDest;
+    CTokenTransfer("TOKEN", SIGN_BENCH_INPUTS * COIN, 0).ConstructTransaction(scriptTransfer);
+    tx.vout.emplace_back(0, scriptTransfer);
+
+    while (state.KeepRunning()) {
+        CMutableTransaction txSign(tx);
+        unsigned int nFailedIn;
+        bool fSigned = wallet.SignInputs(txSign, vPrevOuts, nFailedIn, nThreads);
+        assert(fSigned);
+    }
+}
+
+static void SignTokenTransaction1Thread(benchmark::State& state)
+{
+    SignTokenTransaction(state, 1);
+}
+
+static void SignTokenTransactionAllCores(benchmark::State& state)
+{
+    SignTokenTransaction(state, 0);
+}
+
+BENCHMARK(SignTokenTransaction1Thread);
+BENCHMARK(SignTokenTransactionAllCores);
@@ -0,0 +1,143 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Counts the heap allocations of the token checks every transaction of a block goes
+// through, and of building token outputs. To count them this file replaces the global operator new and delete of
+// bench_paladeum, which adds a relaxed atomic increment to every allocation of every
+// benchmark.
+
+#include "bench.h"
+#include "consensus/tx_verify.h"
+#include "consensus/validation.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "tokens/tokens.h"
+#include "utilstrencodings.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> g_nAllocations(0);
+
+void* operator new(size_t n)
+{
+    g_nAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+static const int TOKEN_ALLOC_BENCH_TXS = 200;
+
+static std::vector<CTransactionRef> CreateTokenAllocationTxs()
+{
+    std::vector<CTransactionRef> vTxs;
+    for (int n = 0; n < TOKEN_ALLOC_BENCH_TXS; n++) {
+        const std::string strName = strprintf("TOKEN%d", n % 20);
+        const CTxDestination dest = CKeyID(uint160(ParseHex(strprintf("%040x", n + 1))));
+
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vin[0].prevout = COutPoint(uint256S(strprintf("%064x", n + 1)), 0);
+        tx.vin[1].prevout = COutPoint(uint256S(strprintf("%064x", n + 1)), 1);
+        tx.vout.resize(6);
+        for (int i = 0; i < 4; i++) {
+            tx.vout[i].scriptPubKey = GetScriptForDestination(dest);
+            CTokenTransfer(strName, (i + 1) * COIN, 0).ConstructTransaction(tx.vout[i].scriptPubKey);
+        }
+        tx.vout[4].scriptPubKey = GetScriptForDestination(dest);
+        CTokenTransfer(strprintf("#TAG%d", n % 8), COIN, 0).ConstructTransaction(tx.vout[4].scriptPubKey);
+        tx.vout[5].scriptPubKey = GetScriptForNullTokenDataDestination(dest);
+        CNullTokenTxData(strprintf("#TAG%d", n % 8), 0).ConstructTransaction(tx.vout[5].scriptPubKey);
+        vTxs.push_back(MakeTransactionRef(tx));
+    }
+    return vTxs;
+}
+
+static void ReportAllocations(benchmark::State& state, uint64_t nAllocations, uint64_t nTxs)
+{
+    state.SetCounter("allocations_per_tx", nTxs ? (double)nAllocations / nTxs : 0);
+}
+
+// CheckTransaction and the token type queries the mempool and CheckBlock make of every transaction
+static void TokenTransactionChecksAllocations(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vTxs = CreateTokenAllocationTxs();
+
+    uint64_t nTxs = 0;
+    const uint64_t nStart = g_nAllocations.load();
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : vTxs) {
+            CValidationState validationState;
+            assert(CheckTransaction(*tx, validationState, true, false, true));
+            assert(!tx->IsNewToken() && !tx->IsReissueToken() && !tx->IsNewUniqueToken());
+            nTxs++;
+        }
+    }
+    ReportAllocations(state, g_nAllocations.load() - nStart, nTxs);
+}
+
+// The script parsing the address and token indexes do for every output
+static void TokenScriptParseAllocations(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vTxs = CreateTokenAllocationTxs();
+
+    uint64_t nTxs = 0;
+    const uint64_t nStart = g_nAllocations.load();
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : vTxs) {
+            for (const CTxOut& out : tx->vout) {
+                uint160 hashBytes;
+                int nScriptType;
+                std::string strTokenName;
+                CAmount nTokenAmount;
+                uint32_t nTimeLock;
+                ParseTokenScript(out.scriptPubKey, hashBytes, nScriptType, strTokenName, nTokenAmount, nTimeLock);
+            }
+            nTxs++;
+        }
+    }
+    ReportAllocations(state, g_nAllocations.load() - nStart, nTxs);
+}
+
+// The outputs of a distribution transaction, built the way the wallet builds them
+static void BuildTokenTransferOutputs(benchmark::State& state)
+{
+    const CScript scriptDest = GetScriptForDestination(CKeyID(uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"))));
+    CMutableTransaction tx;
+
+    uint64_t nTxs = 0;
+    const uint64_t nStart = g_nAllocations.load();
+    while (state.KeepRunning()) {
+        tx.vout.clear();
+        tx.vout.reserve(1000);
+        for (int i = 0; i < 1000; i++) {
+            CScript scriptPubKey = scriptDest;
+            CTokenTransfer("DISTRIBUTION", (i + 1) * COIN, 0).ConstructTransaction(scriptPubKey);
+            tx.vout.emplace_back(0, scriptPubKey);
+        }
+        nTxs++;
+    }
+    ReportAllocations(state, g_nAllocations.load() - nStart, nTxs);
+}
+
+BENCHMARK(TokenTransactionChecksAllocations);
+BENCHMARK(TokenScriptParseAllocations);
+BENCHMARK(BuildTokenTransferOutputs);
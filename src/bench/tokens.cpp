@@ -0,0 +1,227 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "base58.h"
+#include "coins.h"
+#include "consensus/tx_verify.h"
+#include "consensus/validation.h"
+#include "script/standard.h"
+#include "tokens/rewards.h"
+#include "tokens/tokens.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+
+#include <vector>
+
+// About as many token outputs as a full block of transfers has
+static const int TOKEN_BENCH_OUTPUTS = 1000;
+// The holders of a widely held token a reward is distributed over
+static const int TOKEN_BENCH_OWNERS = 20000;
+
+static CTxDestination TokenBenchDest(int n)
+{
+    return CKeyID(uint160(ParseHex(strprintf("%040x", n + 1))));
+}
+
+// A name of every kind, valid and not, in the proportions the chain sees them: mostly root and sub tokens
+static std::vector<std::string> TokenBenchNames()
+{
+    std::vector<std::string> vNames;
+    for (int n = 0; n < 100; n++) {
+        vNames.push_back(strprintf("TOKEN%d", n));
+        vNames.push_back(strprintf("TOKEN%d/SUB_TOKEN.%d", n, n));
+        vNames.push_back(strprintf("TOKEN%d!", n));
+        if (n % 4 == 0) {
+            vNames.push_back(strprintf("TOKEN%d#UNIQUE_%d", n, n));
+            vNames.push_back(strprintf("TOKEN%d~CHANNEL", n));
+            vNames.push_back(strprintf("#KYC%d", n));
+            vNames.push_back(strprintf("$SECURITY%d", n));
+        }
+        if (n % 10 == 0) {
+            vNames.push_back(strprintf("TOKEN%d..BAD", n));
+            vNames.push_back(strprintf("lowercase%d", n));
+            vNames.push_back(strprintf("A_VERY_LONG_TOKEN_NAME_THAT_GOES_ON_%d", n));
+        }
+    }
+    return vNames;
+}
+
+static void TokenNameValidation(benchmark::State& state)
+{
+    const std::vector<std::string> vNames = TokenBenchNames();
+    int nValid = 0;
+    while (state.KeepRunning()) {
+        for (const std::string& strName : vNames) {
+            KnownTokenType type;
+            nValid += IsTokenNameValid(strName, type);
+        }
+    }
+    assert(nValid > 0);
+}
+
+static void TokenTransferScriptDecode(benchmark::State& state)
+{
+    std::vector<CScript> vScripts;
+    for (int n = 0; n < TOKEN_BENCH_OUTPUTS; n++) {
+        CScript script = GetScriptForDestination(TokenBenchDest(n));
+        CTokenTransfer(strprintf("TOKEN%d", n % 50), (n + 1) * COIN, 0).ConstructTransaction(script);
+        vScripts.push_back(script);
+    }
+
+    while (state.KeepRunning()) {
+        for (const CScript& script : vScripts) {
+            CTokenTransfer transfer;
+            std::string strAddress;
+            bool fDecoded = TransferTokenFromScript(script, transfer, strAddress);
+            assert(fDecoded);
+        }
+    }
+}
+
+static void TokenIssueScriptDecode(benchmark::State& state)
+{
+    std::vector<CScript> vScripts;
+    for (int n = 0; n < TOKEN_BENCH_OUTPUTS; n++) {
+        CScript script = GetScriptForDestination(TokenBenchDest(n));
+        CNewToken(strprintf("TOKEN%d", n), 21000000 * COIN, 8, 1, 1, DecodeIPFS("QmTqu3Lk3gmTsQVtjU7rYYM37EAW4xNmbuEAp2Mjr4AV7E"), 0, "", 0).ConstructTransaction(script);
+        vScripts.push_back(script);
+    }
+
+    while (state.KeepRunning()) {
+        for (const CScript& script : vScripts) {
+            CNewToken token;
+            std::string strAddress;
+            bool fDecoded = TokenFromScript(script, token, strAddress);
+            assert(fDecoded);
+        }
+    }
+}
+
+// The cache-free part of CheckTxTokens over a block of transactions that each split a token output in four
+static void CheckTxTokensTransfers(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache coins(&viewDummy);
+    std::vector<CTransactionRef> vTxs;
+    for (int n = 0; n < TOKEN_BENCH_OUTPUTS / 4; n++) {
+        const std::string strName = strprintf("TOKEN%d", n % 50);
+        CTxOut prevout;
+        prevout.nValue = 0;
+        prevout.scriptPubKey = GetScriptForDestination(TokenBenchDest(n));
+        CTokenTransfer(strName, 4 * COIN, 0).ConstructTransaction(prevout.scriptPubKey);
+        const COutPoint outpoint(uint256S(strprintf("%064x", n + 1)), 0);
+        coins.AddCoin(outpoint, Coin(prevout, 10, false, false, 0), false);
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = outpoint;
+        tx.vout.resize(4);
+        for (int i = 0; i < 4; i++) {
+            tx.vout[i].scriptPubKey = GetScriptForDestination(TokenBenchDest(n + i + 1));
+            CTokenTransfer(strName, COIN, 0).ConstructTransaction(tx.vout[i].scriptPubKey);
+        }
+        vTxs.push_back(MakeTransactionRef(tx));
+    }
+
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : vTxs) {
+            CValidationState validationState;
+            std::vector<std::pair<std::string, uint256> > vReissueTokens;
+            bool fValid = Consensus::CheckTxTokens(*tx, validationState, coins, 1000, 0, nullptr, false, vReissueTokens, true);
+            assert(fValid);
+        }
+    }
+}
+
+// What connecting and then disconnecting a block of transfers does to a token cache: add the outputs, spend
+// them, undo both, and flush the result into the global cache
+static void TokensCacheAddSpendUndoFlush(benchmark::State& state)
+{
+    struct BenchOutput {
+        CTokenTransfer transfer;
+        std::string strAddress;
+        COutPoint out;
+        CTxOut txOut;
+    };
+    std::vector<BenchOutput> vOutputs;
+    for (int n = 0; n < TOKEN_BENCH_OUTPUTS; n++) {
+        BenchOutput output;
+        output.transfer = CTokenTransfer(strprintf("TOKEN%d", n % 50), (n + 1) * COIN, 0);
+        output.strAddress = EncodeDestination(TokenBenchDest(n));
+        output.out = COutPoint(uint256S(strprintf("%064x", n + 1)), n % 4);
+        output.txOut.nValue = 0;
+        output.txOut.scriptPubKey = GetScriptForDestination(TokenBenchDest(n));
+        output.transfer.ConstructTransaction(output.txOut.scriptPubKey);
+        vOutputs.push_back(output);
+    }
+
+    CTokensCache* ptokensSaved = ptokens;
+    CTokensCache tokensGlobal;
+    ptokens = &tokensGlobal;
+    while (state.KeepRunning()) {
+        CTokensCache cache;
+        for (const BenchOutput& output : vOutputs)
+            cache.AddTransferToken(output.transfer, output.strAddress, output.out, output.txOut);
+        for (const BenchOutput& output : vOutputs)
+            cache.TrySpendCoin(output.out, output.txOut);
+        for (const BenchOutput& output : vOutputs) {
+            cache.UndoTokenCoin(Coin(output.txOut, 10, false, false, 0), output.out);
+            cache.RemoveTransfer(output.transfer, output.strAddress, output.out);
+        }
+        bool fFlushed = cache.Flush();
+        assert(fFlushed);
+        tokensGlobal.ClearDirtyCache();
+    }
+    ptokens = ptokensSaved;
+}
+
+// Verifiers as they are stored and checked, with whitespace and '#' stripped
+static void VerifierStringCheck(benchmark::State& state)
+{
+    const std::vector<std::string> vVerifiers = {
+        "true",
+        "KYC",
+        "KYC&ACCREDITED",
+        "(KYC&!BLACKLIST)|EXEMPT",
+        "KYC&ACCREDITED&(USA|EUR|GBR)&!SANCTIONED&!FROZEN&(TIER1|TIER2)",
+    };
+    while (state.KeepRunning()) {
+        for (const std::string& strVerifier : vVerifiers) {
+            std::set<std::string> setQualifiers;
+            std::string strError;
+            bool fValid = CheckVerifierString(strVerifier, setQualifiers, strError);
+            assert(fValid);
+        }
+    }
+}
+
+// The share computation GenerateDistributionList does once it has the owners from the snapshot database
+static void DistributionShares(benchmark::State& state)
+{
+    std::vector<std::pair<std::string, CAmount> > vOwners;
+    for (int n = 0; n < TOKEN_BENCH_OWNERS; n++)
+        vOwners.emplace_back(EncodeDestination(TokenBenchDest(n)), (n % 997 + 1) * COIN);
+    const OwnerWalker walkOwners = [&vOwners](const std::function<bool(const std::string&, const CAmount&)>& visitor) {
+        for (const auto& owner : vOwners) {
+            if (!visitor(owner.first, owner.second))
+                return false;
+        }
+        return true;
+    };
+
+    while (state.KeepRunning()) {
+        std::vector<OwnerAndAmount> vShares;
+        bool fComputed = ComputeDistributionShares(walkOwners, 1000000, COIN, vShares);
+        assert(fComputed);
+    }
+}
+
+BENCHMARK(TokenNameValidation);
+BENCHMARK(TokenTransferScriptDecode);
+BENCHMARK(TokenIssueScriptDecode);
+BENCHMARK(CheckTxTokensTransfers);
+BENCHMARK(TokensCacheAddSpendUndoFlush);
+BENCHMARK(VerifierStringCheck);
+BENCHMARK(DistributionShares);
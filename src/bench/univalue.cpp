@@ -0,0 +1,82 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "utilstrencodings.h"
+
+#include <univalue.h>
+
+#include <string>
+
+static const int JSON_OUTPUTS = 1000;
+
+// A reply shaped like decoderawtransaction of a transaction paying many token outputs
+static UniValue BuildDecodedTransaction()
+{
+    UniValue vout(UniValue::VARR);
+    for (int i = 0; i < JSON_OUTPUTS; i++) {
+        UniValue token(UniValue::VOBJ);
+        token.pushKV("name", "TOKEN" + std::to_string(i));
+        token.pushKV("amount", 1.5 * i);
+
+        UniValue scriptPubKey(UniValue::VOBJ);
+        scriptPubKey.pushKV("asm", "OP_DUP OP_HASH160 " + std::string(40, 'a') + " OP_EQUALVERIFY OP_CHECKSIG OP_PLB_TOKEN " + std::string(80, 'b') + " OP_DROP");
+        scriptPubKey.pushKV("hex", std::string(110, 'c'));
+        scriptPubKey.pushKV("type", "transfer_token");
+        scriptPubKey.pushKV("token", token);
+
+        UniValue out(UniValue::VOBJ);
+        out.pushKV("value", 0);
+        out.pushKV("n", i);
+        out.pushKV("scriptPubKey", scriptPubKey);
+        vout.push_back(out);
+    }
+
+    UniValue tx(UniValue::VOBJ);
+    tx.pushKV("txid", std::string(64, 'd'));
+    tx.pushKV("version", 2);
+    tx.pushKV("memo", "a \"quoted\" note\nover two lines");
+    tx.pushKV("vout", vout);
+    return tx;
+}
+
+static void JsonWrite(benchmark::State& state)
+{
+    const UniValue tx = BuildDecodedTransaction();
+    while (state.KeepRunning()) {
+        tx.write();
+    }
+}
+
+static void JsonWritePretty(benchmark::State& state)
+{
+    const UniValue tx = BuildDecodedTransaction();
+    while (state.KeepRunning()) {
+        tx.write(4);
+    }
+}
+
+static void JsonRead(benchmark::State& state)
+{
+    const std::string strJson = BuildDecodedTransaction().write();
+    while (state.KeepRunning()) {
+        UniValue tx;
+        tx.read(strJson);
+    }
+}
+
+// A sendrawtransaction request, one long hex string
+static void JsonReadRawTransaction(benchmark::State& state)
+{
+    const std::string strJson = "{\"method\":\"sendrawtransaction\",\"params\":[\"" + HexStr(std::string(100000, 'x')) + "\"],\"id\":1}";
+    while (state.KeepRunning()) {
+        UniValue request;
+        request.read(strJson);
+    }
+}
+
+BENCHMARK(JsonWrite);
+BENCHMARK(JsonWritePretty);
+BENCHMARK(JsonRead);
+BENCHMARK(JsonReadRawTransaction);
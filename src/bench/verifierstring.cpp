@@ -0,0 +1,81 @@
+// Copyright (c) 2021-2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "LibBoolEE.h"
+
+// Verifier strings may be at most 80 characters once whitespace and '#' are stripped
+static const size_t VERIFIER_BENCH_LENGTH = 80;
+
+// Negated parentheses nested as deep as the length allows: !(!(...!(KYC&ABC)...))
+static std::string DeepVerifier()
+{
+    std::string verifier = "KYC&ABC";
+    while (verifier.size() + 3 <= VERIFIER_BENCH_LENGTH)
+        verifier = "!(" + verifier + ")";
+    return verifier;
+}
+
+// As many operands as the length allows, alternating conjunctions and disjunctions: Q0|Q1&Q2|Q3&...
+static std::string WideVerifier(std::vector<std::string>& vVariables)
+{
+    std::string verifier;
+    for (size_t i = 0; verifier.size() + 4 <= VERIFIER_BENCH_LENGTH; i++) {
+        vVariables.emplace_back("Q" + std::to_string(i));
+        if (i > 0)
+            verifier += i % 2 ? "|" : "&";
+        verifier += vVariables.back();
+    }
+    return verifier;
+}
+
+static void VerifierResolve(benchmark::State& state, const std::string& verifier, const std::vector<std::string>& vVariables)
+{
+    LibBoolEE::Vals vals;
+    for (size_t i = 0; i < vVariables.size(); i++)
+        vals.insert(std::make_pair(vVariables[i], i % 3 == 0));
+    while (state.KeepRunning()) {
+        LibBoolEE::resolve(verifier, vals);
+    }
+}
+
+static void VerifierEvaluate(benchmark::State& state, const std::string& verifier, const std::vector<std::string>& vVariables)
+{
+    LibBoolEE::Program program = LibBoolEE::compile(verifier, vVariables);
+    uint64_t valuation = 0;
+    bool fResult = false;
+    while (state.KeepRunning()) {
+        fResult ^= LibBoolEE::evaluate(program, valuation++);
+    }
+    (void)fResult;
+}
+
+static void VerifierResolveDeep(benchmark::State& state)
+{
+    VerifierResolve(state, DeepVerifier(), {"KYC", "ABC"});
+}
+
+static void VerifierResolveWide(benchmark::State& state)
+{
+    std::vector<std::string> vVariables;
+    std::string verifier = WideVerifier(vVariables);
+    VerifierResolve(state, verifier, vVariables);
+}
+
+static void VerifierEvaluateDeep(benchmark::State& state)
+{
+    VerifierEvaluate(state, DeepVerifier(), {"KYC", "ABC"});
+}
+
+static void VerifierEvaluateWide(benchmark::State& state)
+{
+    std::vector<std::string> vVariables;
+    std::string verifier = WideVerifier(vVariables);
+    VerifierEvaluate(state, verifier, vVariables);
+}
+
+BENCHMARK(VerifierResolveDeep);
+BENCHMARK(VerifierResolveWide);
+BENCHMARK(VerifierEvaluateDeep);
+BENCHMARK(VerifierEvaluateWide);
@@ -0,0 +1,161 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompression.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+const size_t LZ4_MIN_MATCH = 4;
+//! The last literals of a block, no match may cover them
+const size_t LZ4_LAST_LITERALS = 5;
+//! No match starts in the last bytes of a block
+const size_t LZ4_MF_LIMIT = 12;
+const size_t LZ4_MAX_OFFSET = 65535;
+const int LZ4_HASH_LOG = 16;
+
+void WriteLength(std::vector<unsigned char>& vOut, size_t nLength)
+{
+    while (nLength >= 255) {
+        vOut.push_back(255);
+        nLength -= 255;
+    }
+    vOut.push_back((unsigned char)nLength);
+}
+
+bool ReadLength(const unsigned char* pdata, size_t nSize, size_t& nPos, size_t& nLength)
+{
+    unsigned char b;
+    do {
+        if (nPos >= nSize)
+            return false;
+        b = pdata[nPos++];
+        nLength += b;
+    } while (b == 255);
+    return true;
+}
+
+/** One sequence: literals, then a match of nMatch bytes at nOffset back, or no match for the last one */
+void WriteSequence(std::vector<unsigned char>& vOut, const unsigned char* pliterals, size_t nLiterals, size_t nOffset, size_t nMatch)
+{
+    const size_t nMatchCode = nMatch ? nMatch - LZ4_MIN_MATCH : 0;
+    vOut.push_back((unsigned char)((std::min<size_t>(nLiterals, 15) << 4) | std::min<size_t>(nMatchCode, 15)));
+    if (nLiterals >= 15)
+        WriteLength(vOut, nLiterals - 15);
+    vOut.insert(vOut.end(), pliterals, pliterals + nLiterals);
+    if (!nMatch)
+        return;
+    vOut.push_back((unsigned char)(nOffset & 0xff));
+    vOut.push_back((unsigned char)(nOffset >> 8));
+    if (nMatchCode >= 15)
+        WriteLength(vOut, nMatchCode - 15);
+}
+
+} // namespace
+
+void LZ4CompressBlock(const unsigned char* pdata, size_t nSize, std::vector<unsigned char>& vOut)
+{
+    size_t nAnchor = 0;
+    if (nSize > LZ4_MF_LIMIT) {
+        std::vector<uint32_t> vTable(1 << LZ4_HASH_LOG, 0);
+        const size_t nMatchStartLimit = nSize - LZ4_MF_LIMIT;
+        const size_t nMatchEndLimit = nSize - LZ4_LAST_LITERALS;
+        size_t nPos = 0;
+        while (nPos < nMatchStartLimit) {
+            const uint32_t nSequence = ReadLE32(pdata + nPos);
+            const uint32_t nHash = (nSequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+            size_t nRef = vTable[nHash];
+            vTable[nHash] = nPos;
+            if (nRef >= nPos || nPos - nRef > LZ4_MAX_OFFSET || ReadLE32(pdata + nRef) != nSequence) {
+                nPos++;
+                continue;
+            }
+
+            size_t nMatch = LZ4_MIN_MATCH;
+            while (nPos + nMatch < nMatchEndLimit && pdata[nRef + nMatch] == pdata[nPos + nMatch])
+                nMatch++;
+            while (nPos > nAnchor && nRef > 0 && pdata[nPos - 1] == pdata[nRef - 1]) {
+                nPos--;
+                nRef--;
+                nMatch++;
+            }
+
+            WriteSequence(vOut, pdata + nAnchor, nPos - nAnchor, nPos - nRef, nMatch);
+            nPos += nMatch;
+            nAnchor = nPos;
+        }
+    }
+    WriteSequence(vOut, pdata + nAnchor, nSize - nAnchor, 0, 0);
+}
+
+bool LZ4DecompressBlock(const unsigned char* pdata, size_t nSize, unsigned char* pout, size_t nOut)
+{
+    size_t nPos = 0;
+    size_t nOutPos = 0;
+    while (true) {
+        if (nPos >= nSize)
+            return false;
+        const unsigned char nToken = pdata[nPos++];
+
+        size_t nLiterals = nToken >> 4;
+        if (nLiterals == 15 && !ReadLength(pdata, nSize, nPos, nLiterals))
+            return false;
+        if (nLiterals > nSize - nPos || nLiterals > nOut - nOutPos)
+            return false;
+        if (nLiterals)
+            memcpy(pout + nOutPos, pdata + nPos, nLiterals);
+        nPos += nLiterals;
+        nOutPos += nLiterals;
+
+        // The last sequence has no match
+        if (nPos == nSize)
+            return nOutPos == nOut;
+
+        if (nSize - nPos < 2)
+            return false;
+        const size_t nOffset = pdata[nPos] | ((size_t)pdata[nPos + 1] << 8);
+        nPos += 2;
+        if (nOffset == 0 || nOffset > nOutPos)
+            return false;
+
+        size_t nMatch = nToken & 15;
+        if (nMatch == 15 && !ReadLength(pdata, nSize, nPos, nMatch))
+            return false;
+        nMatch += LZ4_MIN_MATCH;
+        if (nMatch > nOut - nOutPos)
+            return false;
+        // The match may overlap what it produces, copy it byte by byte
+        const unsigned char* pmatch = pout + nOutPos - nOffset;
+        for (size_t i = 0; i < nMatch; i++)
+            pout[nOutPos + i] = pmatch[i];
+        nOutPos += nMatch;
+    }
+}
+
+bool CompressBlockRecord(const unsigned char* pdata, size_t nSize, std::vector<unsigned char>& vPayload)
+{
+    if (nSize > 0xffffffff)
+        return false;
+    vPayload.clear();
+    vPayload.reserve(nSize);
+    vPayload.resize(4);
+    WriteLE32(vPayload.data(), (uint32_t)nSize);
+    LZ4CompressBlock(pdata, nSize, vPayload);
+    return vPayload.size() < nSize;
+}
+
+bool DecompressBlockRecord(const unsigned char* pdata, size_t nSize, std::vector<unsigned char>& vData, size_t nMaxSize)
+{
+    if (nSize < 4)
+        return false;
+    const uint32_t nDataSize = ReadLE32(pdata);
+    if (nDataSize > nMaxSize)
+        return false;
+    vData.resize(nDataSize);
+    return LZ4DecompressBlock(pdata + 4, nSize - 4, vData.data(), nDataSize);
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_BLOCKCOMPRESSION_H
+#define PLB_BLOCKCOMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** -blockcompression default */
+static const bool DEFAULT_BLOCK_COMPRESSION = false;
+
+/**
+ * Set in the size after the message start of a block or undo record whose payload is compressed;
+ * the payload length is the rest of the size. Serialized blocks are far below 2 GiB, so older
+ * versions never wrote it, and the records without it are read as before.
+ */
+static const uint32_t BLOCK_RECORD_COMPRESSED = 0x80000000;
+
+/**
+ * Append the LZ4 block format compression of [pdata, pdata + nSize) to vOut. Greedy matching
+ * with one hash table probe per position: fast, and the repeated scripts and token names of
+ * token heavy blocks compress well with it.
+ */
+void LZ4CompressBlock(const unsigned char* pdata, size_t nSize, std::vector<unsigned char>& vOut);
+
+/**
+ * Decompress an LZ4 block into exactly nOut bytes at pout. Returns false for input that is
+ * malformed or decompresses to another size, without reading or writing out of bounds.
+ */
+bool LZ4DecompressBlock(const unsigned char* pdata, size_t nSize, unsigned char* pout, size_t nOut);
+
+/**
+ * The payload of a compressed record for [pdata, pdata + nSize): the size of the data (4 bytes,
+ * little endian) and its compression. False, with vPayload undefined, if it isn't smaller than
+ * the data itself.
+ */
+bool CompressBlockRecord(const unsigned char* pdata, size_t nSize, std::vector<unsigned char>& vPayload);
+
+/** The data of a compressed record payload, false if it is malformed or larger than nMaxSize */
+bool DecompressBlockRecord(const unsigned char* pdata, size_t nSize, std::vector<unsigned char>& vData, size_t nMaxSize);
+
+#endif // PLB_BLOCKCOMPRESSION_H
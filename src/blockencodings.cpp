@@ -18,13 +18,17 @@
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), vchBlockSig(block.vchBlockSig), header(block) {
+        prefilledtxn(1), vchBlockSig(block.vchBlockSig), header(block) {
     FillShortTxIDSelector();
     //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
     prefilledtxn[0] = {0, block.vtx[0]};
-    for (size_t i = 1; i < block.vtx.size(); i++) {
+    // No peer can have the coinstake of a proof-of-stake block, and it carries the key of the block signature
+    if (block.IsProofOfStake())
+        prefilledtxn.push_back({0, block.vtx[1]});
+    shorttxids.resize(block.vtx.size() - prefilledtxn.size());
+    for (size_t i = prefilledtxn.size(); i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        shorttxids[i - prefilledtxn.size()] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
     }
 }
 
@@ -53,6 +57,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         return READ_STATUS_INVALID;
 
     assert(header.IsNull() && txn_available.empty());
+    nTimeInit = GetTimeMicros();
     header = cmpctblock.header;
     vchBlockSig = cmpctblock.vchBlockSig;
     txn_available.resize(cmpctblock.BlockTxCount());
@@ -75,6 +80,17 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
     prefilled_count = cmpctblock.prefilledtxn.size();
 
+    // With the coinstake prefilled the block signature can be checked before any transaction is looked up or requested
+    if (txn_available.size() > 1 && txn_available[1] && txn_available[1]->IsCoinStake()) {
+        fProofOfStake = true;
+        CBlock block(header);
+        block.vtx.resize(2);
+        block.vtx[1] = txn_available[1];
+        block.vchBlockSig = vchBlockSig;
+        if (!CheckBlockSignature(block, block.GetIndexHash()))
+            return READ_STATUS_INVALID;
+    }
+
     // Calculate map of txids -> positions and check mempool to see what we have (or don't)
     // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
     // of short IDs, any highly-uneven distribution of elements can be safely treated as a
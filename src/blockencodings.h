@@ -200,6 +200,8 @@ class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
     size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
+    int64_t nTimeInit = 0;
+    bool fProofOfStake = false;
     CTxMemPool* pool;
 public:
     CBlockHeader header;
@@ -210,6 +212,14 @@ public:
     ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
     bool IsTxAvailable(size_t index) const;
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
+
+    size_t GetPrefilledCount() const { return prefilled_count; }
+    size_t GetMempoolCount() const { return mempool_count - extra_count; }
+    size_t GetExtraCount() const { return extra_count; }
+    //! Time InitData was called, in microseconds
+    int64_t GetTimeInit() const { return nTimeInit; }
+    //! Whether the block was sent with its coinstake prefilled and its signature checked
+    bool IsProofOfStake() const { return fProofOfStake; }
 };
 
 class SerializedTokenData {
@@ -0,0 +1,106 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "chain.h"
+#include "util.h"
+#include "validation.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileMap g_blockfilemap;
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    const size_t nSize = st.st_size;
+    void* p = mmap(nullptr, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file referenced, the descriptor isn't needed any more
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrintf("Unable to map %s: %s\n", path.string(), strerror(errno));
+        return nullptr;
+    }
+    return std::shared_ptr<const CMappedFile>(new CMappedFile(static_cast<const unsigned char*>(p), nSize));
+#else
+    return nullptr;
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(pdata), nSize);
+#endif
+}
+
+void CBlockFileMap::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (listFiles.size() > nMaxFiles) {
+        mapFiles.erase(listFiles.back().first);
+        listFiles.pop_back();
+    }
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMap::Get(int nFile, uint64_t nMinSize)
+{
+    LOCK(cs);
+    if (nMaxFiles == 0)
+        return nullptr;
+
+    auto it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        listFiles.splice(listFiles.begin(), listFiles, it->second);
+        if (it->second->second->size() >= nMinSize)
+            return it->second->second;
+        // The file grew since it was mapped, the old mapping lives on with its holders
+        listFiles.erase(it->second);
+        mapFiles.erase(it);
+    }
+
+    std::shared_ptr<const CMappedFile> file = CMappedFile::Open(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    if (!file || file->size() < nMinSize)
+        return nullptr;
+
+    listFiles.emplace_front(nFile, file);
+    mapFiles[nFile] = listFiles.begin();
+    if (listFiles.size() > nMaxFiles) {
+        mapFiles.erase(listFiles.back().first);
+        listFiles.pop_back();
+    }
+    return file;
+}
+
+void CBlockFileMap::Invalidate(int nFile)
+{
+    LOCK(cs);
+    auto it = mapFiles.find(nFile);
+    if (it == mapFiles.end())
+        return;
+    listFiles.erase(it->second);
+    mapFiles.erase(it);
+}
+
+void CBlockFileMap::Clear()
+{
+    LOCK(cs);
+    listFiles.clear();
+    mapFiles.clear();
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_BLOCKFILEMAP_H
+#define PLB_BLOCKFILEMAP_H
+
+#include "fs.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+/** -blockfilemaps default, the block files kept mapped at most (0 reads them with stdio) */
+static const int DEFAULT_BLOCKFILE_MAPS = sizeof(void*) > 4 ? 8 : 0;
+
+/** A file mapped read-only into memory, as large as it was when it was mapped */
+class CMappedFile
+{
+public:
+    /** Map the file at path, returns null if it can't be opened or mapped or is empty */
+    static std::shared_ptr<const CMappedFile> Open(const fs::path& path);
+
+    ~CMappedFile();
+
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+    const unsigned char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+
+private:
+    CMappedFile(const unsigned char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+
+    const unsigned char* pdata;
+    size_t nSize;
+};
+
+/**
+ * The most recently read block files (blk?????.dat), kept mapped so that a block read is
+ * deserialized straight from the page cache, without opening, seeking and buffered reads
+ * through stdio each time. Files are only appended to while mapped; a read past the end
+ * of a mapping maps the file again. A mapping stays valid for whoever holds it after it
+ * was dropped from the cache.
+ */
+class CBlockFileMap
+{
+public:
+    explicit CBlockFileMap(size_t nMaxFilesIn = DEFAULT_BLOCKFILE_MAPS) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Keep at most nMaxFiles mapped, 0 turns mapping off */
+    void SetMaxFiles(size_t nMaxFilesIn);
+
+    /**
+     * The mapping of block file nFile covering at least its first nMinSize bytes, null if
+     * mapping is off, not available on this platform or the file isn't that large.
+     */
+    std::shared_ptr<const CMappedFile> Get(int nFile, uint64_t nMinSize);
+
+    /** Forget the mapping of nFile, to be called before the file is deleted */
+    void Invalidate(int nFile);
+    void Clear();
+
+private:
+    typedef std::list<std::pair<int, std::shared_ptr<const CMappedFile>>> MapList;
+
+    CCriticalSection cs;
+    size_t nMaxFiles;
+    //! most recently used first
+    MapList listFiles;
+    std::map<int, MapList::iterator> mapFiles;
+};
+
+extern CBlockFileMap g_blockfilemap;
+
+#endif // PLB_BLOCKFILEMAP_H
@@ -0,0 +1,148 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_BLOCKFILTER_H
+#define PLB_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-coded set (BIP 158): the elements are hashed into [0, N * M), sorted, and the differences
+ * between neighbours written with Golomb-Rice coding of parameter P. Matching decodes the set in order,
+ * so a test costs a pass over the filter and false positives come at a rate of about 1 / M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params
+    {
+        uint64_t m_siphash_k0;
+        uint64_t m_siphash_k1;
+        uint8_t m_P;  //!< Golomb-Rice coding parameter
+        uint32_t m_M; //!< Inverse false positive rate
+
+        Params(uint64_t siphash_k0 = 0, uint64_t siphash_k1 = 0, uint8_t P = 0, uint32_t M = 1)
+            : m_siphash_k0(siphash_k0), m_siphash_k1(siphash_k1), m_P(P), m_M(M) {}
+    };
+
+private:
+    Params m_params;
+    uint32_t m_N; //!< Number of elements in the filter
+    uint64_t m_F; //!< Range of element hashes, F = N * M
+    std::vector<unsigned char> m_encoded;
+
+    //! Hash a data element to an integer in the range [0, N * M)
+    uint64_t HashToRange(const Element& element) const;
+
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+
+    //! Whether any of the sorted hashes is in the filter
+    bool MatchInternal(const uint64_t* sorted_element_hashes, size_t size) const;
+
+public:
+    //! An empty filter
+    explicit GCSFilter(const Params& params = Params());
+
+    //! Reconstruct a filter from its encoding, throwing std::ios_base::failure when it doesn't decode
+    GCSFilter(const Params& params, std::vector<unsigned char> encoded_filter);
+
+    //! Build the filter of a set of elements
+    GCSFilter(const Params& params, const ElementSet& elements);
+
+    uint32_t GetN() const { return m_N; }
+    const Params& GetParams() const { return m_params; }
+    const std::vector<unsigned char>& GetEncoded() const { return m_encoded; }
+
+    //! Whether the element may be in the set, false positives are possible
+    bool Match(const Element& element) const;
+
+    //! Whether any of the elements may be in the set, checked in one pass over the filter
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+enum class BlockFilterType : uint8_t
+{
+    BASIC = 0,
+    INVALID = 255,
+};
+
+//! The name of a filter type, empty for an unknown one
+const std::string& BlockFilterTypeName(BlockFilterType filter_type);
+
+//! Parse a filter type name, false for an unknown one
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filter_type);
+
+/**
+ * The filter of a block. The basic filter holds every output script the block creates and spends,
+ * other than empty and OP_RETURN scripts, and for token outputs the token name as well, so a light
+ * client can look for the payments to its scripts and for every transfer of a token.
+ */
+class BlockFilter
+{
+private:
+    BlockFilterType m_filter_type;
+    uint256 m_block_hash;
+    GCSFilter m_filter;
+
+    bool BuildParams(GCSFilter::Params& params) const;
+
+public:
+    BlockFilter() : m_filter_type(BlockFilterType::INVALID) {}
+
+    //! Reconstruct a filter from its parts, throwing std::invalid_argument for an unknown type
+    BlockFilter(BlockFilterType filter_type, const uint256& block_hash, std::vector<unsigned char> filter);
+
+    //! Compute the filter of a block from the block and the outputs it spends
+    BlockFilter(BlockFilterType filter_type, const CBlock& block, const CBlockUndo& block_undo);
+
+    BlockFilterType GetFilterType() const { return m_filter_type; }
+    const uint256& GetBlockHash() const { return m_block_hash; }
+    const GCSFilter& GetFilter() const { return m_filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return m_filter.GetEncoded(); }
+
+    //! The double SHA256 of the encoded filter
+    uint256 GetHash() const;
+
+    //! The filter header, which commits to the filter and to the headers of every block before it
+    uint256 ComputeHeader(const uint256& prev_header) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << static_cast<uint8_t>(m_filter_type) << m_block_hash << m_filter.GetEncoded();
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        std::vector<unsigned char> encoded_filter;
+        uint8_t filter_type;
+
+        s >> filter_type >> m_block_hash >> encoded_filter;
+        m_filter_type = static_cast<BlockFilterType>(filter_type);
+
+        GCSFilter::Params params;
+        if (!BuildParams(params))
+            throw std::ios_base::failure("unknown filter_type");
+        m_filter = GCSFilter(params, std::move(encoded_filter));
+    }
+};
+
+#endif // PLB_BLOCKFILTER_H
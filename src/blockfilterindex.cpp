@@ -0,0 +1,235 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilterindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+static const char DB_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+CBlockFilterIndex* pblockfilterindex = nullptr;
+
+namespace {
+/** The filter of a block as it is stored, with its hash and header so range lookups don't hash */
+struct CFilterEntry
+{
+    uint256 hash;
+    uint256 header;
+    std::vector<unsigned char> vEncoded;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(header);
+        READWRITE(vEncoded);
+    }
+};
+}
+
+CBlockFilterIndex::CBlockFilterIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+    : CDBWrapper(GetDataDir() / "indexes" / "blockfilter" / BlockFilterTypeName(BlockFilterType::BASIC), nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CBlockFilterIndex::WriteFilter(const BlockFilter& filter, const CBlockIndex* pindex)
+{
+    uint256 prevHeader;
+    if (pindex->pprev) {
+        CFilterEntry prev;
+        if (!Read(std::make_pair(DB_FILTER, pindex->pprev->GetIndexHash()), prev))
+            return error("%s: no filter stored for block %s", __func__, pindex->pprev->GetIndexHash().ToString());
+        prevHeader = prev.header;
+    }
+
+    CFilterEntry entry;
+    entry.hash = filter.GetHash();
+    entry.header = filter.ComputeHeader(prevHeader);
+    entry.vEncoded = filter.GetEncodedFilter();
+
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_FILTER, pindex->GetIndexHash()), entry);
+    batch.Write(DB_BEST_BLOCK, pindex->GetIndexHash());
+    return WriteBatch(batch);
+}
+
+bool CBlockFilterIndex::ReadBestBlock(uint256& hashBlock) const
+{
+    return Read(DB_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const
+{
+    CFilterEntry entry;
+    if (!Read(std::make_pair(DB_FILTER, pindex->GetIndexHash()), entry))
+        return false;
+    filter = BlockFilter(BlockFilterType::BASIC, pindex->GetIndexHash(), std::move(entry.vEncoded));
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const
+{
+    CFilterEntry entry;
+    if (!Read(std::make_pair(DB_FILTER, pindex->GetIndexHash()), entry))
+        return false;
+    header = entry.header;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<BlockFilter>& vFilters) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    vFilters.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (size_t i = vFilters.size(); i > 0; --i, pindex = pindex->pprev) {
+        if (!LookupFilter(pindex, vFilters[i - 1]))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHashes) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    vHashes.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (size_t i = vHashes.size(); i > 0; --i, pindex = pindex->pprev) {
+        CFilterEntry entry;
+        if (!Read(std::make_pair(DB_FILTER, pindex->GetIndexHash()), entry))
+            return false;
+        vHashes[i - 1] = entry.hash;
+    }
+    return true;
+}
+
+namespace {
+std::mutex csBlockFilterIndex;
+std::condition_variable condBlockFilterIndex;
+bool fBlockFilterIndexStop = false;
+bool fBlockFilterIndexRunning = false;
+std::thread threadBlockFilterIndex;
+}
+
+/** Wait for up to a second, false once the thread has to stop */
+static bool BlockFilterIndexWait()
+{
+    std::unique_lock<std::mutex> lock(csBlockFilterIndex);
+    if (!fBlockFilterIndexStop)
+        condBlockFilterIndex.wait_for(lock, std::chrono::seconds(1));
+    return !fBlockFilterIndexStop;
+}
+
+static bool BlockFilterIndexStopping()
+{
+    std::lock_guard<std::mutex> lock(csBlockFilterIndex);
+    return fBlockFilterIndexStop;
+}
+
+static void ThreadBlockFilterIndex()
+{
+    const Consensus::Params& consensusParams = GetParams().GetConsensus();
+
+    // Blocks being imported or reindexed aren't on the active chain yet
+    while (fImporting || fReindex) {
+        if (!BlockFilterIndexWait())
+            return;
+    }
+
+    // The last block of the active chain with a filter, null before the genesis block has one
+    const CBlockIndex* pindexBest = nullptr;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (pblockfilterindex->ReadBestBlock(hashBest)) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it != mapBlockIndex.end())
+                pindexBest = it->second;
+        }
+        LogPrintf("%s: building block filters from height %d\n", __func__, pindexBest ? pindexBest->nHeight + 1 : 0);
+    }
+
+    bool fSynced = false;
+    while (!BlockFilterIndexStopping()) {
+        const CBlockIndex* pindexNext;
+        {
+            LOCK(cs_main);
+            // After a reorg the filters of the fork block and the blocks before it are still right
+            if (pindexBest && !chainActive.Contains(pindexBest))
+                pindexBest = chainActive.FindFork(pindexBest);
+            pindexNext = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+        }
+        if (!pindexNext) {
+            if (!fSynced && pindexBest) {
+                LogPrintf("%s: block filters built up to height %d\n", __func__, pindexBest->nHeight);
+                fSynced = true;
+            }
+            BlockFilterIndexWait();
+            continue;
+        }
+
+        CBlock block;
+        CBlockUndo blockUndo;
+        if (!ReadBlockFromDisk(block, pindexNext, consensusParams)) {
+            error("%s: failed to read block %s", __func__, pindexNext->GetIndexHash().ToString());
+            return;
+        }
+        if (pindexNext->pprev && !UndoReadFromDisk(blockUndo, pindexNext->GetUndoPos(), pindexNext->pprev->GetIndexHash())) {
+            error("%s: failed to read undo data of block %s", __func__, pindexNext->GetIndexHash().ToString());
+            return;
+        }
+
+        BlockFilter filter(BlockFilterType::BASIC, block, blockUndo);
+        if (!pblockfilterindex->WriteFilter(filter, pindexNext)) {
+            error("%s: failed to write the filter of block %s", __func__, pindexNext->GetIndexHash().ToString());
+            return;
+        }
+        pindexBest = pindexNext;
+        if (!fSynced && pindexBest->nHeight % 10000 == 0)
+            LogPrintf("%s: block filters built up to height %d\n", __func__, pindexBest->nHeight);
+    }
+}
+
+void StartBlockFilterIndex()
+{
+    std::lock_guard<std::mutex> lock(csBlockFilterIndex);
+    if (fBlockFilterIndexRunning || !pblockfilterindex)
+        return;
+
+    fBlockFilterIndexStop = false;
+    fBlockFilterIndexRunning = true;
+    threadBlockFilterIndex = std::thread(&TraceThread<std::function<void()> >, "blockfilter", std::function<void()>(ThreadBlockFilterIndex));
+}
+
+void StopBlockFilterIndex()
+{
+    {
+        std::lock_guard<std::mutex> lock(csBlockFilterIndex);
+        if (!fBlockFilterIndexRunning)
+            return;
+        fBlockFilterIndexStop = true;
+    }
+    condBlockFilterIndex.notify_all();
+    threadBlockFilterIndex.join();
+
+    std::lock_guard<std::mutex> lock(csBlockFilterIndex);
+    fBlockFilterIndexRunning = false;
+}
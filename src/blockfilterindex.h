@@ -0,0 +1,64 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_BLOCKFILTERINDEX_H
+#define PLB_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "dbwrapper.h"
+
+#include <vector>
+
+class CBlockIndex;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+
+/** Most filters a getcfilters request can ask for */
+static const int MAX_GETCFILTERS_SIZE = 1000;
+/** Most filter hashes a getcfheaders request can ask for */
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+/** Distance between the filter headers a cfcheckpt message holds */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * The basic filters and filter headers of the blocks of the active chain, kept by block hash so
+ * the entries of a block a reorg disconnects stay right for it. A background thread builds them
+ * from the blocks and undo data on disk, a block behind the other, and follows the tip once it
+ * has caught up.
+ */
+class CBlockFilterIndex : public CDBWrapper
+{
+public:
+    explicit CBlockFilterIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    CBlockFilterIndex(const CBlockFilterIndex&) = delete;
+    CBlockFilterIndex& operator=(const CBlockFilterIndex&) = delete;
+
+    //! Store the filter of a block, after the entry of its parent, and make it the best block
+    bool WriteFilter(const BlockFilter& filter, const CBlockIndex* pindex);
+
+    //! The last block a filter was written for
+    bool ReadBestBlock(uint256& hashBlock) const;
+
+    bool LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const;
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const;
+
+    //! The filters of the blocks from nStartHeight up to pindexStop, lowest first
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<BlockFilter>& vFilters) const;
+
+    //! The filter hashes of the blocks from nStartHeight up to pindexStop, lowest first
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHashes) const;
+};
+
+/** The block filter index, null unless -blockfilterindex is set */
+extern CBlockFilterIndex* pblockfilterindex;
+
+/** Start the thread that builds the filters of the blocks pblockfilterindex is missing */
+void StartBlockFilterIndex();
+
+/** Stop the block filter thread, before pblockfilterindex goes away */
+void StopBlockFilterIndex();
+
+#endif // PLB_BLOCKFILTERINDEX_H
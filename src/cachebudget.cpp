@@ -0,0 +1,169 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachebudget.h"
+
+#include "scheduler.h"
+#include "tinyformat.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <algorithm>
+
+namespace {
+
+struct CCacheBudgetState
+{
+    CCacheBudgetEntry entry;
+    uint64_t nLastHits;
+    uint64_t nLastMisses;
+    uint64_t nLastEvictions;
+};
+
+bool g_cache_budget_started GUARDED_BY(cs_main) = false;
+CCacheBudgetStats g_cache_budget GUARDED_BY(cs_main);
+CCacheBudgetState g_token_cache_budget GUARDED_BY(cs_main);
+CCacheBudgetState g_qualifier_cache_budget GUARDED_BY(cs_main);
+CCacheBudgetState g_restriction_cache_budget GUARDED_BY(cs_main);
+CCacheBudgetState g_global_restriction_cache_budget GUARDED_BY(cs_main);
+
+template<typename Cache>
+void StartBudget(const Cache* pcache, const std::string& strName, CCacheBudgetState& state)
+{
+    state.entry.strName = strName;
+    state.entry.nBaseSize = pcache ? pcache->MaxSize() : 0;
+    state.entry.nMaxSize = state.entry.nBaseSize;
+    state.entry.nBytesTaken = 0;
+    state.entry.dHitRate = -1;
+    state.nLastHits = pcache ? pcache->Hits() : 0;
+    state.nLastMisses = pcache ? pcache->Misses() : 0;
+    state.nLastEvictions = pcache ? pcache->Evictions() : 0;
+}
+
+int64_t BytesTaken()
+{
+    return g_token_cache_budget.entry.nBytesTaken + g_qualifier_cache_budget.entry.nBytesTaken +
+           g_restriction_cache_budget.entry.nBytesTaken + g_global_restriction_cache_budget.entry.nBytesTaken;
+}
+
+template<typename Cache>
+void AdjustBudget(Cache* pcache, CCacheBudgetState& state, int64_t nNow)
+{
+    AssertLockHeld(cs_main);
+    if (!pcache || state.entry.nBaseSize == 0)
+        return;
+
+    const uint64_t nHits = pcache->Hits();
+    const uint64_t nMisses = pcache->Misses();
+    const uint64_t nEvictions = pcache->Evictions();
+    // SetNull resets the counters
+    if (nHits < state.nLastHits || nMisses < state.nLastMisses || nEvictions < state.nLastEvictions) {
+        state.nLastHits = nHits;
+        state.nLastMisses = nMisses;
+        state.nLastEvictions = nEvictions;
+        return;
+    }
+    const uint64_t nIntervalHits = nHits - state.nLastHits;
+    const uint64_t nIntervalMisses = nMisses - state.nLastMisses;
+    const uint64_t nIntervalEvictions = nEvictions - state.nLastEvictions;
+    if (nIntervalHits + nIntervalMisses >= CACHE_BUDGET_MIN_LOOKUPS)
+        state.entry.dHitRate = (double)nIntervalHits / (nIntervalHits + nIntervalMisses);
+
+    const size_t nMaxSize = pcache->MaxSize();
+    const CacheBudgetAction action = DecideCacheBudget(nIntervalHits, nIntervalMisses, nIntervalEvictions, pcache->Size(), nMaxSize, state.entry.nBaseSize);
+    if (action == CacheBudgetAction::GROW) {
+        const size_t nNewSize = std::min(2 * nMaxSize, state.entry.nBaseSize * CACHE_BUDGET_MAX_GROWTH);
+        const int64_t nEntryBytes = pcache->DynamicMemoryUsage() / std::max<size_t>(pcache->Size(), 1);
+        const int64_t nCost = (int64_t)(nNewSize - nMaxSize) * nEntryBytes;
+        if (BytesTaken() + nCost > g_cache_budget.nInitialCoinBudget * CACHE_BUDGET_MAX_TAKEN_PERCENT / 100) {
+            LogPrint(BCLog::BENCH, "%s: %s cache misses %.1f%% but the UTXO cache has no budget to spare\n", __func__,
+                state.entry.strName, 100.0 * nIntervalMisses / (nIntervalHits + nIntervalMisses));
+        } else {
+            pcache->SetSize(nNewSize);
+            nCoinCacheUsage -= nCost;
+            state.entry.nBytesTaken += nCost;
+            g_cache_budget.nGrows++;
+            g_cache_budget.nLastDecisionTime = nNow;
+            g_cache_budget.strLastDecision = strprintf("%s cache grown to %u entries, missed %.1f%%, took %.1fMiB from the UTXO cache",
+                state.entry.strName, nNewSize, 100.0 * nIntervalMisses / (nIntervalHits + nIntervalMisses), nCost * (1.0 / 1024 / 1024));
+            LogPrintf("%s: %s\n", __func__, g_cache_budget.strLastDecision);
+        }
+    } else if (action == CacheBudgetAction::SHRINK) {
+        const size_t nNewSize = std::max(nMaxSize / 2, state.entry.nBaseSize);
+        // Gives back the share of what it took that the dropped entries stand for
+        const int64_t nFreed = nNewSize == state.entry.nBaseSize ? state.entry.nBytesTaken :
+                               state.entry.nBytesTaken * (int64_t)(nMaxSize - nNewSize) / (int64_t)(nMaxSize - state.entry.nBaseSize);
+        pcache->SetSize(nNewSize);
+        nCoinCacheUsage += nFreed;
+        state.entry.nBytesTaken -= nFreed;
+        g_cache_budget.nShrinks++;
+        g_cache_budget.nLastDecisionTime = nNow;
+        g_cache_budget.strLastDecision = strprintf("%s cache shrunk to %u entries, held %u, gave %.1fMiB back to the UTXO cache",
+            state.entry.strName, nNewSize, pcache->Size(), nFreed * (1.0 / 1024 / 1024));
+        LogPrintf("%s: %s\n", __func__, g_cache_budget.strLastDecision);
+    }
+
+    state.entry.nMaxSize = pcache->MaxSize();
+    state.nLastHits = pcache->Hits();
+    state.nLastMisses = pcache->Misses();
+    state.nLastEvictions = pcache->Evictions();
+}
+
+} // namespace
+
+CacheBudgetAction DecideCacheBudget(uint64_t nHits, uint64_t nMisses, uint64_t nEvictions, size_t nSize, size_t nMaxSize, size_t nBaseSize)
+{
+    const uint64_t nLookups = nHits + nMisses;
+    if (nEvictions > 0 && nLookups >= CACHE_BUDGET_MIN_LOOKUPS && nMisses > CACHE_BUDGET_GROW_MISS_RATE * nLookups &&
+        nMaxSize < nBaseSize * CACHE_BUDGET_MAX_GROWTH)
+        return CacheBudgetAction::GROW;
+    if (nMaxSize > nBaseSize && nEvictions == 0 && 2 * nSize < nMaxSize)
+        return CacheBudgetAction::SHRINK;
+    return CacheBudgetAction::KEEP;
+}
+
+void StartCacheBudget(CScheduler& scheduler)
+{
+    {
+        LOCK(cs_main);
+        g_cache_budget.nInitialCoinBudget = nCoinCacheUsage;
+        g_cache_budget.nCoinBudget = nCoinCacheUsage;
+        g_cache_budget.nGrows = 0;
+        g_cache_budget.nShrinks = 0;
+        g_cache_budget.nLastDecisionTime = 0;
+        g_cache_budget.strLastDecision.clear();
+        StartBudget(ptokensCache, "token metadata", g_token_cache_budget);
+        StartBudget(ptokensQualifierCache, "qualifier", g_qualifier_cache_budget);
+        StartBudget(ptokensRestrictionCache, "restriction", g_restriction_cache_budget);
+        StartBudget(ptokensGlobalRestrictionCache, "global restriction", g_global_restriction_cache_budget);
+        g_cache_budget_started = true;
+    }
+    scheduler.scheduleEvery(AdjustCacheBudget, CACHE_BUDGET_INTERVAL * 1000, CScheduler::PRIORITY_LOW);
+}
+
+void AdjustCacheBudget()
+{
+    LOCK(cs_main);
+    if (!g_cache_budget_started)
+        return;
+    const int64_t nNow = GetTime();
+    AdjustBudget(ptokensCache, g_token_cache_budget, nNow);
+    AdjustBudget(ptokensQualifierCache, g_qualifier_cache_budget, nNow);
+    AdjustBudget(ptokensRestrictionCache, g_restriction_cache_budget, nNow);
+    AdjustBudget(ptokensGlobalRestrictionCache, g_global_restriction_cache_budget, nNow);
+    g_cache_budget.nCoinBudget = nCoinCacheUsage;
+}
+
+void GetCacheBudgetStats(CCacheBudgetStats& stats)
+{
+    LOCK(cs_main);
+    stats = g_cache_budget;
+    stats.nCoinBudget = nCoinCacheUsage;
+    stats.vCaches.clear();
+    if (!g_cache_budget_started)
+        return;
+    for (const CCacheBudgetState* state : {&g_token_cache_budget, &g_qualifier_cache_budget, &g_restriction_cache_budget, &g_global_restriction_cache_budget})
+        stats.vCaches.push_back(state->entry);
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_CACHEBUDGET_H
+#define PLB_CACHEBUDGET_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CScheduler;
+
+/** Seconds between two looks at the hit rates of the token caches */
+static const int64_t CACHE_BUDGET_INTERVAL = 60;
+/** Fewest lookups in an interval for a cache's hit rate to count */
+static const uint64_t CACHE_BUDGET_MIN_LOOKUPS = 1000;
+/** A full cache missing more than this share of its lookups grows */
+static const double CACHE_BUDGET_GROW_MISS_RATE = 0.2;
+/** A token cache grows to at most this many times its size at startup */
+static const size_t CACHE_BUDGET_MAX_GROWTH = 64;
+/** Share of the UTXO cache budget the token caches may take at most, in percent */
+static const int64_t CACHE_BUDGET_MAX_TAKEN_PERCENT = 25;
+
+enum class CacheBudgetAction {
+    KEEP,
+    GROW,
+    SHRINK,
+};
+
+/**
+ * What to do with a cache given its lookups over the last interval. A full
+ * cache (it evicted) that misses often doubles, one that was grown earlier
+ * and now holds less than half of its entries without evicting halves.
+ */
+CacheBudgetAction DecideCacheBudget(uint64_t nHits, uint64_t nMisses, uint64_t nEvictions, size_t nSize, size_t nMaxSize, size_t nBaseSize);
+
+/** How one token cache stands in the budget */
+struct CCacheBudgetEntry
+{
+    std::string strName;
+    //! entries at startup, the cache never shrinks below it
+    size_t nBaseSize;
+    size_t nMaxSize;
+    //! bytes of the UTXO cache budget the cache holds now
+    int64_t nBytesTaken;
+    //! hit rate over the last interval with enough lookups, -1 before there was one
+    double dHitRate;
+};
+
+struct CCacheBudgetStats
+{
+    //! UTXO cache budget -dbcache left at startup
+    int64_t nInitialCoinBudget;
+    //! UTXO cache budget now, nCoinCacheUsage
+    int64_t nCoinBudget;
+    uint64_t nGrows;
+    uint64_t nShrinks;
+    //! time and text of the last decision that moved budget, 0 and empty before the first
+    int64_t nLastDecisionTime;
+    std::string strLastDecision;
+    std::vector<CCacheBudgetEntry> vCaches;
+};
+
+/**
+ * Moves in-memory cache budget between the UTXO cache and the token metadata and
+ * restricted token caches, which start at fixed sizes. -dbcache stays the total:
+ * what a token cache grows by is taken off nCoinCacheUsage, what it shrinks by is
+ * given back. Starts from the caches as they are after loading the chain.
+ */
+void StartCacheBudget(CScheduler& scheduler);
+
+/** One look at the caches, done every CACHE_BUDGET_INTERVAL by the scheduler */
+void AdjustCacheBudget();
+
+void GetCacheBudgetStats(CCacheBudgetStats& stats);
+
+#endif // PLB_CACHEBUDGET_H
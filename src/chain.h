@@ -500,6 +500,15 @@ public:
         return (*this)[pindex->nHeight] == pindex;
     }
 
+    /** The ancestor of a block at a height, looked up in this chain when the block is in it rather than walked to. */
+    CBlockIndex *GetAncestor(const CBlockIndex *pindex, int nHeight) const {
+        if (nHeight > pindex->nHeight || nHeight < 0)
+            return nullptr;
+        if (Contains(pindex))
+            return (*this)[nHeight];
+        return const_cast<CBlockIndex*>(pindex)->GetAncestor(nHeight);
+    }
+
     /** Find the successor of a block in this chain, or nullptr if the given index is not found or is the tip. */
     CBlockIndex *Next(const CBlockIndex *pindex) const {
         if (Contains(pindex))
@@ -219,6 +219,10 @@ public:
             0
         };
 
+        // Snapshots by height, see dumpchainstatesnapshot
+        mapAssumeValidSnapshots = {
+        };
+
         /** PLB Start **/
         // Fee Amounts
         nIssueTokenFeeAmount = 10 * COIN;
@@ -339,6 +343,10 @@ public:
             0
         };
 
+        // Snapshots by height, see dumpchainstatesnapshot
+        mapAssumeValidSnapshots = {
+        };
+
         /** PLB Start **/
         // Fee Amounts
         nIssueTokenFeeAmount = 10 * COIN;
@@ -445,6 +453,10 @@ public:
             0
         };
 
+        // Snapshots by height, see dumpchainstatesnapshot
+        mapAssumeValidSnapshots = {
+        };
+
         base58Prefixes[PUBKEY_ADDRESS] = std::vector<unsigned char>(1,83);
         base58Prefixes[SCRIPT_ADDRESS] = std::vector<unsigned char>(1,196);
         base58Prefixes[SECRET_KEY] =     std::vector<unsigned char>(1,239);
@@ -32,6 +32,14 @@ struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
 };
 
+/** A chainstate snapshot the chain parameters commit to: the block it was taken at and the hash of its contents */
+struct CAssumeValidSnapshot {
+    uint256 hashBlock;
+    uint256 hashContents;
+};
+
+typedef std::map<int, CAssumeValidSnapshot> MapAssumeValidSnapshots;
+
 struct ChainTxData {
     int64_t nTime;
     int64_t nTxCount;
@@ -80,6 +88,7 @@ public:
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
+    const MapAssumeValidSnapshots& AssumeValidSnapshots() const { return mapAssumeValidSnapshots; }
     void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
     void TurnOffSegwit();
     void TurnOffCSV();
@@ -148,6 +157,7 @@ protected:
     bool fMiningRequiresPeers;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    MapAssumeValidSnapshots mapAssumeValidSnapshots;
 
     /** PLB Start **/
     // Fee Amounts
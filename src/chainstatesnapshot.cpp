@@ -0,0 +1,271 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainstatesnapshot.h"
+
+#include "chainparams.h"
+#include "coins.h"
+#include "dbwrapper.h"
+#include "governance/governance.h"
+#include "hash.h"
+#include "streams.h"
+#include "tokens/restricteddb.h"
+#include "tokens/tokendb.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <memory>
+
+#include <boost/thread.hpp>
+
+namespace {
+// Sections of a snapshot, each a list of entries ended by a false marker
+static const char SNAPSHOT_COINS = 'c';
+static const char SNAPSHOT_TOKENS = 't';
+static const char SNAPSHOT_RESTRICTED = 'r';
+static const char SNAPSHOT_GOVERNANCE = 'g';
+
+// The records of the token, restricted and governance databases that are chain state, by key prefix
+static const std::string SNAPSHOT_TOKEN_PREFIXES = "A";
+static const std::string SNAPSHOT_RESTRICTED_PREFIXES = "VTQRG";
+// Frozen addresses, authorities, costs, the fee address and the frozen and authorized counters; the event log and
+// its markers differ between an upgraded database and a fresh sync at the same tip
+static const std::string SNAPSHOT_GOVERNANCE_PREFIXES = "apcfNA";
+
+/** Writes to the snapshot file and the hash of its contents at once */
+class CSnapshotWriter
+{
+private:
+    CAutoFile& fileout;
+    CHashWriter hasher;
+
+public:
+    explicit CSnapshotWriter(CAutoFile& fileoutIn) : fileout(fileoutIn), hasher(SER_DISK, CLIENT_VERSION) {}
+
+    template<typename T>
+    CSnapshotWriter& operator<<(const T& obj)
+    {
+        fileout << obj;
+        hasher << obj;
+        return *this;
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/** Reads from the snapshot file and hashes what it read */
+class CSnapshotReader
+{
+private:
+    CAutoFile& filein;
+    CHashWriter hasher;
+
+public:
+    explicit CSnapshotReader(CAutoFile& fileinIn) : filein(fileinIn), hasher(SER_DISK, CLIENT_VERSION) {}
+
+    template<typename T>
+    CSnapshotReader& operator>>(T& obj)
+    {
+        filein >> obj;
+        hasher << obj;
+        return *this;
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+}
+
+/**
+ * Re-encode a token record in the current layout. Records written before it are only migrated when the token is next
+ * written, so the raw bytes of a token differ between an upgraded database and a fresh sync at the same tip.
+ */
+static void CanonicalizeTokenRecord(std::vector<unsigned char>& vValue)
+{
+    CDataStream ssRecord(vValue, SER_DISK, CLIENT_VERSION);
+    CDatabasedTokenData data;
+    ssRecord >> data;
+
+    CDataStream ssCanonical(SER_DISK, CLIENT_VERSION);
+    ssCanonical << data;
+    vValue.assign(ssCanonical.begin(), ssCanonical.end());
+}
+
+/**
+ * Write the entries of a database whose key starts with one of strPrefixes, returning how many there were. Canonicalize,
+ * when given, brings each value to the one encoding every node agrees on before it is written and hashed.
+ */
+static uint64_t WriteSnapshotSection(CSnapshotWriter& writer, char chSection, CDBIterator* pcursor, const std::string& strPrefixes,
+                                     void (*Canonicalize)(std::vector<unsigned char>&) = nullptr)
+{
+    uint64_t nEntries = 0;
+    writer << chSection;
+    std::vector<unsigned char> vKey, vValue;
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        if (!pcursor->GetRawEntry(vKey, vValue) || vKey.empty())
+            continue;
+        if (!strPrefixes.empty() && strPrefixes.find((char)vKey[0]) == std::string::npos)
+            continue;
+        if (Canonicalize)
+            Canonicalize(vValue);
+        writer << true << vKey << vValue;
+        nEntries++;
+    }
+    writer << false;
+    return nEntries;
+}
+
+static uint64_t ReadSnapshotSection(CSnapshotReader& reader, char chSection)
+{
+    char ch;
+    reader >> ch;
+    if (ch != chSection)
+        throw std::ios_base::failure(strprintf("expected snapshot section '%c', found '%c'", chSection, ch));
+
+    uint64_t nEntries = 0;
+    std::vector<unsigned char> vKey, vValue;
+    bool fMore;
+    for (reader >> fMore; fMore; reader >> fMore) {
+        boost::this_thread::interruption_point();
+        reader >> vKey >> vValue;
+        nEntries++;
+    }
+    return nEntries;
+}
+
+bool WriteChainStateSnapshot(const fs::path& path, CChainStateSnapshotInfo& info, std::string& strError)
+{
+    // Take the iterators after a flush under cs_main: each reads the database as it was when it was created
+    std::unique_ptr<CCoinsViewCursor> pcoinsCursor;
+    std::unique_ptr<CDBIterator> ptokensCursor;
+    std::unique_ptr<CDBIterator> prestrictedCursor;
+    std::unique_ptr<CDBIterator> pgovernanceCursor;
+    {
+        LOCK(cs_main);
+        if (!ptokensdb || !prestricteddb || !governance) {
+            strError = "the chainstate databases are not loaded";
+            return false;
+        }
+
+        FlushStateToDisk();
+        if (!chainActive.Tip() || pcoinsdbview->GetBestBlock() != chainActive.Tip()->GetIndexHash()) {
+            strError = "the coins database is not at the tip";
+            return false;
+        }
+        info.hashBlock = chainActive.Tip()->GetIndexHash();
+        info.nHeight = chainActive.Height();
+
+        pcoinsCursor.reset(pcoinsdbview->Cursor());
+        ptokensCursor.reset(ptokensdb->NewIterator());
+        prestrictedCursor.reset(prestricteddb->NewIterator());
+        pgovernanceCursor.reset(governance->NewIterator());
+    }
+
+    fs::path pathTmp = path;
+    pathTmp += ".incomplete";
+    CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        strError = strprintf("unable to open %s for writing", pathTmp.string());
+        return false;
+    }
+
+    try {
+        CSnapshotWriter writer(fileout);
+        writer << CHAINSTATE_SNAPSHOT_VERSION << info.hashBlock << info.nHeight;
+
+        writer << SNAPSHOT_COINS;
+        info.nCoins = 0;
+        while (pcoinsCursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcoinsCursor->GetKey(key) || !pcoinsCursor->GetValue(coin)) {
+                strError = "unable to read the coins database";
+                return false;
+            }
+            writer << true << key << coin;
+            info.nCoins++;
+            pcoinsCursor->Next();
+        }
+        writer << false;
+
+        info.nTokenRecords = WriteSnapshotSection(writer, SNAPSHOT_TOKENS, ptokensCursor.get(), SNAPSHOT_TOKEN_PREFIXES, CanonicalizeTokenRecord);
+        info.nRestrictedRecords = WriteSnapshotSection(writer, SNAPSHOT_RESTRICTED, prestrictedCursor.get(), SNAPSHOT_RESTRICTED_PREFIXES);
+        info.nGovernanceRecords = WriteSnapshotSection(writer, SNAPSHOT_GOVERNANCE, pgovernanceCursor.get(), SNAPSHOT_GOVERNANCE_PREFIXES);
+
+        info.hashContents = writer.GetHash();
+        fileout << info.hashContents;
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to write the snapshot: %s", e.what());
+        return false;
+    }
+
+    FileCommit(fileout.Get());
+    fileout.fclose();
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("unable to rename %s to %s", pathTmp.string(), path.string());
+        return false;
+    }
+    return true;
+}
+
+bool ReadChainStateSnapshotInfo(const fs::path& path, CChainStateSnapshotInfo& info, std::string& strError)
+{
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf("unable to open %s", path.string());
+        return false;
+    }
+
+    try {
+        CSnapshotReader reader(filein);
+        int nVersion;
+        reader >> nVersion;
+        if (nVersion != CHAINSTATE_SNAPSHOT_VERSION) {
+            strError = strprintf("unsupported snapshot version %d", nVersion);
+            return false;
+        }
+        reader >> info.hashBlock >> info.nHeight;
+
+        char ch;
+        reader >> ch;
+        if (ch != SNAPSHOT_COINS) {
+            strError = "the snapshot does not start with the coins";
+            return false;
+        }
+        info.nCoins = 0;
+        bool fMore;
+        for (reader >> fMore; fMore; reader >> fMore) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            reader >> key >> coin;
+            info.nCoins++;
+        }
+
+        info.nTokenRecords = ReadSnapshotSection(reader, SNAPSHOT_TOKENS);
+        info.nRestrictedRecords = ReadSnapshotSection(reader, SNAPSHOT_RESTRICTED);
+        info.nGovernanceRecords = ReadSnapshotSection(reader, SNAPSHOT_GOVERNANCE);
+
+        info.hashContents = reader.GetHash();
+        uint256 hashExpected;
+        filein >> hashExpected;
+        if (hashExpected != info.hashContents) {
+            strError = "the snapshot contents do not match its hash";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to read the snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool IsAssumeValidSnapshot(const CChainParams& chainparams, const CChainStateSnapshotInfo& info)
+{
+    const MapAssumeValidSnapshots& mapSnapshots = chainparams.AssumeValidSnapshots();
+    MapAssumeValidSnapshots::const_iterator it = mapSnapshots.find(info.nHeight);
+    return it != mapSnapshots.end() && it->second.hashBlock == info.hashBlock && it->second.hashContents == info.hashContents;
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_CHAINSTATESNAPSHOT_H
+#define PLB_CHAINSTATESNAPSHOT_H
+
+#include "fs.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+
+class CChainParams;
+
+/** Version of the chainstate snapshot format */
+static const int CHAINSTATE_SNAPSHOT_VERSION = 1;
+
+/**
+ * A chainstate snapshot holds the state a node needs to carry on from a block without replaying
+ * the blocks before it: the coins, the token definitions, the restricted token state and the
+ * governance state. Node-local data (token index, my tokens, undo data, mempool state) is left
+ * out, so that every node writes the same snapshot at the same block and the hash of its
+ * contents can be committed to in the chain parameters.
+ */
+struct CChainStateSnapshotInfo
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nCoins;
+    uint64_t nTokenRecords;
+    uint64_t nRestrictedRecords;
+    uint64_t nGovernanceRecords;
+    uint256 hashContents;
+
+    CChainStateSnapshotInfo() : nHeight(0), nCoins(0), nTokenRecords(0), nRestrictedRecords(0), nGovernanceRecords(0) {}
+};
+
+/** Flush the chainstate and write a snapshot of it at the tip to path */
+bool WriteChainStateSnapshot(const fs::path& path, CChainStateSnapshotInfo& info, std::string& strError);
+
+/** Read the snapshot at path and check it against the hash it ends with, without applying it */
+bool ReadChainStateSnapshotInfo(const fs::path& path, CChainStateSnapshotInfo& info, std::string& strError);
+
+/** Whether the chain parameters commit to a snapshot with the block and contents of info */
+bool IsAssumeValidSnapshot(const CChainParams& chainparams, const CChainStateSnapshotInfo& info);
+
+#endif // PLB_CHAINSTATESNAPSHOT_H
@@ -9,6 +9,8 @@
 #include "sync.h"
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -26,12 +28,28 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker, and the master, has a queue of its own that the batches
+  * added are dealt out to. A worker takes from the back of its own queue
+  * and, once that is empty, steals from the front of the others, so the
+  * workers only meet on a lock when one runs dry. The global mutex is only
+  * taken to sleep and to wake up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! The checks of one worker, the master has the first
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Workers beyond this many share the queues
+    static const int MAX_WORKER_QUEUES = 64;
+
+    //! Mutex that sleeping and waking up go through
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -40,90 +58,136 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The queues of the master and the workers
+    std::vector<WorkerQueue> vQueues;
+
+    //! The number of worker threads started, the master not included
+    std::atomic<int> nWorkers;
 
     //! The number of workers (including the master) that are idle.
-    int nIdle;
+    std::atomic<int> nIdle;
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    /**
+     * Number of verifications waiting in the queues. Counted after they are queued
+     * and uncounted as they are taken, so it is briefly below the real number.
+     */
+    std::atomic<int64_t> nQueued;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The queue the next batch added goes to, only the master touches it
+    size_t nNextQueue;
+
+    size_t QueuesInUse() const
+    {
+        return std::min<size_t>(vQueues.size(), 1 + nWorkers.load());
+    }
+
+    /**
+     * Move a batch of checks to vChecks, from the back of queue nQueue or else from the
+     * front of another queue. Returns false if all of them are empty.
+     */
+    bool Take(size_t nQueue, std::vector<T>& vChecks)
+    {
+        // Decide how many work units to process now.
+        // * Do not try to do everything at once, but aim for increasingly smaller batches so
+        //   all workers finish approximately simultaneously.
+        // * Try to account for idle jobs which will instantly start helping.
+        // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+        const int64_t nShare = std::max<int64_t>(nQueued.load(), 0) / (nTotal.load() + nIdle.load() + 1);
+        const size_t nNow = std::max<size_t>(1, std::min<int64_t>(nBatchSize, nShare));
+        const size_t nQueues = QueuesInUse();
+        for (size_t i = 0; i < nQueues; i++) {
+            WorkerQueue& queue = vQueues[(nQueue + i) % nQueues];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            if (queue.checks.empty())
+                continue;
+            // A thief leaves at least half of the queue to its owner
+            const size_t nTake = i == 0 ? std::min(nNow, queue.checks.size()) : std::min(nNow, (queue.checks.size() + 1) / 2);
+            vChecks.resize(nTake);
+            for (size_t j = 0; j < nTake; j++) {
+                // We want the lock on the mutex to be as short as possible, so swap jobs from the
+                // queue to the local batch vector instead of copying.
+                if (i == 0) {
+                    vChecks[j].swap(queue.checks.back());
+                    queue.checks.pop_back();
+                } else {
+                    vChecks[j].swap(queue.checks.front());
+                    queue.checks.pop_front();
+                }
+            }
+            nQueued -= nTake;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const size_t nQueue = fMaster ? 0 : 1 + nWorkers++ % (vQueues.size() - 1);
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        nTotal++;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (Take(nQueue, vChecks)) {
+                // Check whether we need to do work at all
+                bool fOk = fAllOk.load();
+                // execute work
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                const unsigned int nNow = vChecks.size();
+                // the checks go before they count as done, the master may return right after
+                vChecks.clear();
+                if (!fOk)
+                    fAllOk = false;
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // Only the master adds work, so all that is left now is for the workers to finish theirs
+                while (nTodo.load() != 0 && nQueued.load() <= 0)
+                    condMaster.wait(lock);
+                if (nTodo.load() == 0) {
+                    nTotal--;
+                    bool fRet = fAllOk.load();
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+            } else if (nQueued.load() <= 0) {
+                nIdle++;
+                try {
+                    condWorker.wait(lock); // wait
+                } catch (...) {
+                    nIdle--;
+                    nTotal--;
+                    throw;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                nIdle--;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -132,7 +196,8 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : vQueues(MAX_WORKER_QUEUES), nWorkers(0), nIdle(0), nTotal(0), fAllOk(true),
+        nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn), nNextQueue(0) {}
 
     //! Worker thread
     void Thread()
@@ -149,15 +214,30 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
+
+        // Deal the checks out over the queues in use, at most nBatchSize to one queue at a time
+        const size_t nQueues = QueuesInUse();
+        for (size_t nStart = 0; nStart < vChecks.size(); nStart += nBatchSize) {
+            const size_t nEnd = std::min<size_t>(vChecks.size(), nStart + nBatchSize);
+            WorkerQueue& queue = vQueues[nNextQueue++ % nQueues];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            for (size_t i = nStart; i < nEnd; i++) {
+                queue.checks.emplace_back();
+                vChecks[i].swap(queue.checks.back());
+            }
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nQueued += vChecks.size();
+        // The workers change nIdle under the mutex, so none is asleep when it is 0
+        if (nIdle.load() == 0)
+            return;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
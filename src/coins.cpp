@@ -42,7 +42,8 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cacheCoinsMemory(new CCoinsMapMemoryResource()),
+    cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), cacheCoinsMemory.get()), cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -282,7 +283,7 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, uint2
                     if (tokenData.type == TX_TRANSFER_TOKEN && tokenData.nAmount > 0) {
                         // Create the objects needed from the tokenData
                         CTokenTransfer tokenTransfer(tokenData.tokenName, tokenData.nAmount, tokenData.nTimeLock, tokenData.message, tokenData.expireTime);
-                        std::string address = EncodeDestination(tokenData.destination);
+                        std::string address = EncodeTokenDestination(tokenData.destination);
 
                         // Add the transfer token data to the token cache
                         if (!tokensCache->AddTransferToken(tokenTransfer, address, COutPoint(txid, i), tx.vout[i]))
@@ -322,10 +323,10 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, uint2
                                 if (vpwallets[0]->IsMine(tx.vout[i]) == ISMINE_SPENDABLE) {
                                     if (aType == KnownTokenType::ROOT || aType == KnownTokenType::SUB) {
                                         AddChannel(tokenData.tokenName + OWNER_TAG);
-                                        AddAddressSeen(EncodeDestination(tokenData.destination));
+                                        AddAddressSeen(EncodeTokenDestination(tokenData.destination));
                                     } else if (aType == KnownTokenType::OWNER || aType == KnownTokenType::MSGCHANNEL) {
                                         AddChannel(tokenData.tokenName);
-                                        AddAddressSeen(EncodeDestination(tokenData.destination));
+                                        AddAddressSeen(EncodeTokenDestination(tokenData.destination));
                                     }
                                 } else {
                                     if (aType == KnownTokenType::MSGCHANNEL) {
@@ -418,6 +419,26 @@ bool CCoinsViewCache::HaveCoin(const COutPoint &outpoint) const {
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
+void CCoinsViewCache::ForEachChange(const std::function<void(const COutPoint&, const Coin*, const Coin&)>& fn) const
+{
+    for (const auto& entry : cacheCoins) {
+        if (!(entry.second.flags & CCoinsCacheEntry::DIRTY))
+            continue;
+
+        // The base doesn't have fresh coins, the ones added by this cache are the most of them
+        if (entry.second.flags & CCoinsCacheEntry::FRESH) {
+            if (!entry.second.coin.IsSpent())
+                fn(entry.first, nullptr, entry.second.coin);
+            continue;
+        }
+
+        Coin coinOld;
+        const bool fOld = base->GetCoin(entry.first, coinOld) && !coinOld.IsSpent();
+        if (fOld || !entry.second.coin.IsSpent())
+            fn(entry.first, fOld ? &coinOld : nullptr, entry.second.coin);
+    }
+}
+
 bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = cacheCoins.find(outpoint);
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
@@ -493,9 +514,24 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    ReallocateCache();
     return fOk;
 }
 
+std::unique_ptr<CCoinsMapBatch> CCoinsViewCache::DetachCache() {
+    std::unique_ptr<CCoinsMapBatch> batch(new CCoinsMapBatch(std::move(cacheCoinsMemory), std::move(cacheCoins), hashBlock));
+    cachedCoinsUsage = 0;
+    ReallocateCache();
+    return batch;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    cacheCoins.~CCoinsMap();
+    cacheCoinsMemory.reset(new CCoinsMapMemoryResource());
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), cacheCoinsMemory.get());
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -13,10 +13,13 @@
 #include "core_memusage.h"
 #include "hash.h"
 #include "memusage.h"
+#include "support/allocators/pool.h"
 #include "serialize.h"
 #include "uint256.h"
 
 #include <assert.h>
+#include <functional>
+#include <memory>
 #include <stdint.h>
 
 #include <unordered_map>
@@ -141,7 +144,26 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * Largest block CCoinsMap takes from its pool: one node, which holds the entry next to a few
+ * pointers and the cached hash, depending on the standard library.
+ */
+static const size_t COINS_MAP_POOL_BLOCK_SIZE = sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4;
+
+typedef PoolResource<COINS_MAP_POOL_BLOCK_SIZE, alignof(void*)> CCoinsMapMemoryResource;
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>, COINS_MAP_POOL_BLOCK_SIZE, alignof(void*)> > CCoinsMap;
+
+/** The entries of a cache together with the pool they live in, taken out of the cache as a whole */
+struct CCoinsMapBatch
+{
+    std::unique_ptr<CCoinsMapMemoryResource> memory;
+    CCoinsMap map;
+    uint256 hashBlock;
+
+    CCoinsMapBatch(std::unique_ptr<CCoinsMapMemoryResource>&& memoryIn, CCoinsMap&& mapIn, const uint256& hashBlockIn)
+        : memory(std::move(memoryIn)), map(std::move(mapIn)), hashBlock(hashBlockIn) {}
+};
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -228,6 +250,8 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    //! Where the nodes of cacheCoins come from, declared first to outlive the map
+    mutable std::unique_ptr<CCoinsMapMemoryResource> cacheCoinsMemory;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -290,6 +314,19 @@ public:
      */
     bool Flush();
 
+    /**
+     * Empty the cache like Flush, but hand its entries to the caller instead of writing
+     * them to the base, which still has to be given them before reading from it again.
+     */
+    std::unique_ptr<CCoinsMapBatch> DetachCache();
+
+    /**
+     * Call fn for every coin this cache changed, with the unspent coin it replaces in the base view (or nullptr if
+     * there was none) and the coin that replaces it, which is spent when it was erased. Used before Flush to follow
+     * what the flush will do to the base.
+     */
+    void ForEachChange(const std::function<void(const COutPoint&, const Coin*, const Coin&)>& fn) const;
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -317,6 +354,9 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    /** Drops the emptied or moved from cacheCoins with its pool and starts a new one, giving all of the memory back at once */
+    void ReallocateCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
@@ -64,6 +64,17 @@ typedef unsigned int SOCKET;
 #define SOCKET_ERROR        -1
 #endif
 
+// The socket handler waits on epoll or kqueue where available, and single
+// sockets are then waited on with poll(), so sockets are not limited to FD_SETSIZE
+#if !defined(WIN32) && defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#elif !defined(WIN32) && defined(HAVE_SYS_EVENT_H)
+#define USE_KQUEUE
+#endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+#define USE_SOCKET_EVENTS
+#endif
+
 #ifndef PRIO_MAX
 #define PRIO_MAX 20
 #endif
@@ -94,7 +105,7 @@ size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(const SOCKET& s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_SOCKET_EVENTS)
     return true;
 #else
     return (s < FD_SETSIZE);
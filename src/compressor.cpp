@@ -9,6 +9,20 @@
 #include "hash.h"
 #include "pubkey.h"
 #include "script/standard.h"
+#include "streams.h"
+#include "tokens/tokens.h"
+#include "version.h"
+
+/** The script of a token transfer without a message, after the pubkey hash or script hash part */
+static void AppendTokenTransfer(CScript& script, const std::string& strName, CAmount nAmount, uint32_t nTimeLock)
+{
+    CDataStream ssTransfer(SER_NETWORK, PROTOCOL_VERSION);
+    ssTransfer << strName << nAmount << nTimeLock;
+
+    std::vector<unsigned char> vchMessage = {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_T};
+    vchMessage.insert(vchMessage.end(), ssTransfer.begin(), ssTransfer.end());
+    script << OP_PLB_TOKEN << vchMessage << OP_DROP;
+}
 
 bool CScriptCompressor::IsToKeyID(CKeyID &hash) const
 {
@@ -46,6 +60,67 @@ bool CScriptCompressor::IsToPubKey(CPubKey &pubkey) const
     return false;
 }
 
+bool CScriptCompressor::IsToTokenTransfer(unsigned int &nCode, CTokenTransferParts &parts) const
+{
+    size_t nPrefix;
+    if (script.size() > 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG && script[25] == OP_PLB_TOKEN) {
+        nCode = nTokenTransferToKeyID;
+        nPrefix = 25;
+        memcpy(parts.hash.begin(), &script[3], 20);
+    } else if (script.size() > 23 && script[0] == OP_HASH160 && script[1] == 20 && script[22] == OP_EQUAL &&
+               script[23] == OP_PLB_TOKEN) {
+        nCode = nTokenTransferToScriptID;
+        nPrefix = 23;
+        memcpy(parts.hash.begin(), &script[2], 20);
+    } else {
+        return false;
+    }
+
+    CScript::const_iterator pc = script.begin() + nPrefix + 1;
+    opcodetype opcode;
+    std::vector<unsigned char> vchMessage;
+    if (!script.GetOp(pc, opcode, vchMessage) || opcode > OP_PUSHDATA4 || vchMessage.size() < 4 ||
+        vchMessage[0] != TOKEN_Y || vchMessage[1] != TOKEN_N || vchMessage[2] != TOKEN_A || vchMessage[3] != TOKEN_T)
+        return false;
+
+    vchMessage.erase(vchMessage.begin(), vchMessage.begin() + 4);
+    CAmount nAmount;
+    try {
+        CDataStream ssTransfer(vchMessage, SER_NETWORK, PROTOCOL_VERSION);
+        ssTransfer >> parts.strName >> nAmount >> parts.nTimeLock;
+        // Transfers with a message or an expiry are kept as they are
+        if (!ssTransfer.empty())
+            return false;
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (nAmount < 0)
+        return false;
+    parts.nAmount = CTxOutCompressor::CompressAmount(nAmount);
+    if (CTxOutCompressor::DecompressAmount(parts.nAmount) != (uint64_t)nAmount)
+        return false;
+
+    // Only scripts that come back byte for byte, with minimal pushes and nothing after the OP_DROP
+    CScript rebuilt(script.begin(), script.begin() + nPrefix);
+    AppendTokenTransfer(rebuilt, parts.strName, nAmount, parts.nTimeLock);
+    return rebuilt == script;
+}
+
+bool CScriptCompressor::DecompressTokenTransfer(unsigned int nCode, const CTokenTransferParts &parts)
+{
+    const uint64_t nAmount = CTxOutCompressor::DecompressAmount(parts.nAmount);
+    if (nAmount > (uint64_t)std::numeric_limits<CAmount>::max())
+        return false;
+    script.clear();
+    if (nCode == nTokenTransferToKeyID)
+        script << OP_DUP << OP_HASH160 << ToByteVector(parts.hash) << OP_EQUALVERIFY << OP_CHECKSIG;
+    else
+        script << OP_HASH160 << ToByteVector(parts.hash) << OP_EQUAL;
+    AppendTokenTransfer(script, parts.strName, (CAmount)nAmount, parts.nTimeLock);
+    return true;
+}
+
 bool CScriptCompressor::Compress(std::vector<unsigned char> &out) const
 {
     CKeyID keyID;
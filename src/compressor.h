@@ -10,6 +10,7 @@
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "serialize.h"
+#include "uint256.h"
 
 class CKeyID;
 class CPubKey;
@@ -25,6 +26,14 @@ class CScriptID;
  *
  *  Other scripts up to 121 bytes require 1 byte + script length. Above
  *  that, scripts up to 16505 bytes require 2 bytes + script length.
+ *
+ *  Token transfers to a pubkey hash or a script hash without a message are
+ *  encoded as 2 bytes, the hash, the token name, the compressed amount and
+ *  the time lock. Their codes come after the largest script length, which
+ *  keeps every encoding written before them readable. Binaries from before
+ *  them would read the codes as script lengths, so the chainstate records
+ *  its format version (see CCoinsViewDB::WriteFormatVersion) to keep them
+ *  from opening it.
  */
 class CScriptCompressor
 {
@@ -37,6 +46,30 @@ private:
      */
     static const unsigned int nSpecialScripts = 6;
 
+    /** Codes of the token transfers, above those of plain scripts up to MAX_SCRIPT_SIZE */
+    static const unsigned int nTokenTransferToKeyID = nSpecialScripts + MAX_SCRIPT_SIZE + 1;
+    static const unsigned int nTokenTransferToScriptID = nSpecialScripts + MAX_SCRIPT_SIZE + 2;
+
+    /** What is stored of a token transfer script */
+    struct CTokenTransferParts
+    {
+        uint160 hash;
+        std::string strName;
+        //! compressed like the amounts of outputs
+        uint64_t nAmount;
+        uint32_t nTimeLock;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(hash);
+            READWRITE(LIMITED_STRING(strName, MAX_SCRIPT_SIZE));
+            READWRITE(VARINT(nAmount));
+            READWRITE(VARINT(nTimeLock));
+        }
+    };
+
     CScript &script;
 protected:
     /**
@@ -49,6 +82,8 @@ protected:
     bool IsToKeyID(CKeyID &hash) const;
     bool IsToScriptID(CScriptID &hash) const;
     bool IsToPubKey(CPubKey &pubkey) const;
+    bool IsToTokenTransfer(unsigned int &nCode, CTokenTransferParts &parts) const;
+    bool DecompressTokenTransfer(unsigned int nCode, const CTokenTransferParts &parts);
 
     bool Compress(std::vector<unsigned char> &out) const;
     unsigned int GetSpecialSize(unsigned int nSize) const;
@@ -63,6 +98,13 @@ public:
             s << CFlatData(compr);
             return;
         }
+        unsigned int nCode;
+        CTokenTransferParts parts;
+        if (IsToTokenTransfer(nCode, parts)) {
+            s << VARINT(nCode);
+            s << parts;
+            return;
+        }
         unsigned int nSize = script.size() + nSpecialScripts;
         s << VARINT(nSize);
         s << CFlatData(script);
@@ -78,6 +120,15 @@ public:
             Decompress(nSize, vch);
             return;
         }
+        if (nSize == nTokenTransferToKeyID || nSize == nTokenTransferToScriptID) {
+            CTokenTransferParts parts;
+            s >> parts;
+            if (!DecompressTokenTransfer(nSize, parts)) {
+                script.clear();
+                script << OP_RETURN;
+            }
+            return;
+        }
         nSize -= nSpecialScripts;
         if (nSize > MAX_SCRIPT_SIZE) {
             // Overly long script, replace with a short invalid one
@@ -22,6 +22,7 @@
 // TODO remove the following dependencies
 #include "chain.h"
 #include "coins.h"
+#include "trace.h"
 #include "utilmoneystr.h"
 
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
@@ -262,11 +263,10 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
         /** TOKENS END */
 
         /** TOKENS START */
-        bool isToken = false;
-        int nType;
-        bool fIsOwner;
-        if (txout.scriptPubKey.IsTokenScript(nType, fIsOwner))
-            isToken = true;
+        const uint32_t nOut = &txout - tx.vout.data();
+        const CTxTokenOutput* tokenOutput = tx.GetTokenOutput(nOut);
+        bool isToken = tokenOutput != nullptr;
+        int nType = isToken ? tokenOutput->nType : 0;
         
         // Check for transfers that don't meet the tokens units only if the tokenCache is not null
         if (isToken) {
@@ -274,7 +274,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
             if (nType == TX_TRANSFER_TOKEN) {
                 CTokenTransfer transfer;
                 std::string address;
-                if (!TransferTokenFromScript(txout.scriptPubKey, transfer, address))
+                if (!TransferTokenFromTx(tx, nOut, transfer, address))
                     return state.DoS(100, false, REJECT_INVALID, "bad-txns-transfer-token-bad-deserialize");
 
                 // insert into set, so that later on we can check token null data transactions
@@ -575,6 +575,14 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
     return true;
 }
 
+void CheckTransactions(const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState, int nMaxThreads, bool fMempoolCheck)
+{
+    vState.assign(vtx.size(), CValidationState());
+    RunInParallel(vtx.size(), nMaxThreads, [&vtx, &vState, fMempoolCheck](size_t k) {
+        CheckTransaction(*vtx[k], vState[k], true, fMempoolCheck);
+    });
+}
+
 bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, CAmount& txfee)
 {
     // are the actual inputs available?
@@ -635,17 +643,92 @@ bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, c
 }
 
 //! Check to make sure that the inputs and outputs CAmount match exactly.
-bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, int64_t nSpendTime, CTokensCache* tokenCache, bool fCheckMempool, std::vector<std::pair<std::string, uint256> >& vPairReissueTokens, const bool fRunningUnitTests, std::set<CMessage>* setMessages, int64_t nBlocktime,   std::vector<std::pair<std::string, CNullTokenTxData>>* myNullTokenData)
+bool Consensus::CheckTxTokenAmounts(const CTransaction& tx, CValidationState& state, const std::vector<CTxOut>& vSpentTokens, int nSpendHeight, int64_t nSpendTime, bool* pfTimeLocked)
+{
+    // Create map that stores the amount of an token transaction input. Used to verify no tokens are burned
+    std::map<std::string, CAmount> totalInputs;
+
+    for (const auto& spent : vSpentTokens) {
+        CTokenOutputEntry data;
+        if (!GetTokenData(spent.scriptPubKey, data))
+            return state.DoS(100, false, REJECT_INVALID, "bad-txns-failed-to-get-token-from-script", false, "", tx.GetHash());
+
+        // Add to the total value of tokens in the inputs
+        if (totalInputs.count(data.tokenName))
+            totalInputs.at(data.tokenName) += data.nAmount;
+        else
+            totalInputs.insert(make_pair(data.tokenName, data.nAmount));
+
+        if (pfTimeLocked && data.nTimeLock > 0)
+            *pfTimeLocked = true;
+
+        if ((int64_t)data.nTimeLock > ((int64_t)data.nTimeLock < LOCKTIME_THRESHOLD ? (int64_t)nSpendHeight : nSpendTime)) {
+            std::string errorMsg = strprintf("Tried to spend token before %d", data.nTimeLock);
+            return state.DoS(100, false,
+                REJECT_INVALID, "bad-txns-premature-spend-timelock" + errorMsg);
+        }
+    }
+
+    // Create map that stores the amount of an token transaction output. Used to verify no tokens are burned
+    std::map<std::string, CAmount> totalOutputs;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CTxTokenOutput* tokenOutput = tx.GetTokenOutput(i);
+        if (!tokenOutput || tokenOutput->nType != TX_TRANSFER_TOKEN)
+            continue;
+
+        CTokenTransfer transfer;
+        std::string address;
+        if (!TransferTokenFromTx(tx, i, transfer, address))
+            return state.DoS(100, false, REJECT_INVALID, "bad-tx-token-transfer-bad-deserialize", false, "",
+                             tx.GetHash());
+
+        // Add to the total value of tokens in the outputs
+        if (totalOutputs.count(transfer.strName))
+            totalOutputs.at(transfer.strName) += transfer.nAmount;
+        else
+            totalOutputs.insert(make_pair(transfer.strName, transfer.nAmount));
+    }
+
+    for (const auto& outValue : totalOutputs) {
+        if (!totalInputs.count(outValue.first)) {
+            std::string errorMsg;
+            errorMsg = strprintf("Bad Transaction - Trying to create outpoint for token that you don't have: %s", outValue.first);
+            return state.DoS(100, false, REJECT_INVALID, "bad-tx-inputs-outputs-mismatch " + errorMsg, false, "", tx.GetHash());
+        }
+
+        if (totalInputs.at(outValue.first) != outValue.second) {
+            std::string errorMsg;
+            errorMsg = strprintf("Bad Transaction - Tokens would be burnt %s", outValue.first);
+            return state.DoS(100, false, REJECT_INVALID, "bad-tx-inputs-outputs-mismatch " + errorMsg, false, "", tx.GetHash());
+        }
+    }
+
+    // Check the input size and the output size
+    if (totalOutputs.size() != totalInputs.size()) {
+        return state.DoS(100, false, REJECT_INVALID, "bad-tx-token-inputs-size-does-not-match-outputs-size", false, "", tx.GetHash());
+    }
+    return true;
+}
+
+bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, int64_t nSpendTime, CTokensCache* tokenCache, bool fCheckMempool, std::vector<std::pair<std::string, uint256> >& vPairReissueTokens, const bool fRunningUnitTests, std::set<CMessage>* setMessages, int64_t nBlocktime,   std::vector<std::pair<std::string, CNullTokenTxData>>* myNullTokenData, bool fAmountsChecked)
 {
+    TRACE_SPAN("CheckTxTokens");
     // are the actual inputs available?
     if (!inputs.HaveInputs(tx)) {
         return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-missing-or-spent", false,
                          strprintf("%s: inputs missing/spent", __func__), tx.GetHash());
     }
 
-    // Create map that stores the amount of an token transaction input. Used to verify no tokens are burned
-    std::map<std::string, CAmount> totalInputs;
+    // The input addresses are only needed to pick up the messages carried by the outputs
+    bool fNeedAddresses = false;
+    if (AreMessagesDeployed() && fMessaging && setMessages) {
+        for (unsigned int n = 0; n < tx.vout.size() && !fNeedAddresses; n++) {
+            const CTxTokenOutput* tokenOutput = GetTxTokenOutput(tx, n);
+            fNeedAddresses = tokenOutput && tokenOutput->transfer && !tokenOutput->transfer->message.empty();
+        }
+    }
 
+    std::vector<CTxOut> vSpentTokens;
     std::map<std::string, std::string> mapAddresses;
 
     for (unsigned int i = 0; i < tx.vin.size(); ++i) {
@@ -654,55 +737,57 @@ bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, c
         assert(!coin.IsSpent());
 
         if (coin.IsToken()) {
+            if (!fAmountsChecked)
+                vSpentTokens.push_back(coin.out);
+
+            // Decoding the destination is the costly part, so skip it for the unrestricted tokens when no message needs it
+            std::string strName;
+            if (!TokenNameFromScript(coin.out.scriptPubKey, strName))
+                return state.DoS(100, false, REJECT_INVALID, "bad-txns-failed-to-get-token-from-script", false, "", tx.GetHash());
+
+            bool fRestricted = IsTokenNameAnRestricted(strName);
+            if (!fRestricted && !fNeedAddresses)
+                continue;
+
             CTokenOutputEntry data;
             if (!GetTokenData(coin.out.scriptPubKey, data))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-failed-to-get-token-from-script", false, "", tx.GetHash());
 
-            // Add to the total value of tokens in the inputs
-            if (totalInputs.count(data.tokenName))
-                totalInputs.at(data.tokenName) += data.nAmount;
-            else
-                totalInputs.insert(make_pair(data.tokenName, data.nAmount));
-
-            if (AreMessagesDeployed()) {
-                mapAddresses.insert(make_pair(data.tokenName,EncodeDestination(data.destination)));
+            std::string strAddress = EncodeTokenDestination(data.destination);
+            if (fNeedAddresses) {
+                mapAddresses.insert(make_pair(data.tokenName, strAddress));
             }
 
-            if (IsTokenNameAnRestricted(data.tokenName)) {
-                if (tokenCache->CheckForAddressRestriction(data.tokenName, EncodeDestination(data.destination), true)) {
+            if (fRestricted) {
+                TRACE_SPAN("CheckTxTokens.Restricted");
+                if (tokenCache->CheckForAddressRestriction(data.tokenName, strAddress, true)) {
                     return state.DoS(100, false, REJECT_INVALID, "bad-txns-restricted-token-transfer-from-frozen-address", false, "", tx.GetHash());
                 }
             }
-
-            if ((int64_t)data.nTimeLock > ((int64_t)data.nTimeLock < LOCKTIME_THRESHOLD ? (int64_t)nSpendHeight : nSpendTime)) {
-                std::string errorMsg = strprintf("Tried to spend token before %d", data.nTimeLock);
-                return state.DoS(100, false,
-                    REJECT_INVALID, "bad-txns-premature-spend-timelock" + errorMsg);
-            }
         }
     }
 
-    // Create map that stores the amount of an token transaction output. Used to verify no tokens are burned
+    if (!fAmountsChecked && !CheckTxTokenAmounts(tx, state, vSpentTokens, nSpendHeight, nSpendTime))
+        return false;
+
+    // Create map that records whether each royalty bearing token pays its royalty
     std::map<std::string, bool> tokenRoyalties;
-    std::map<std::string, CAmount> totalOutputs;
     int index = 0;
     int64_t currentTime = GetTime();
     std::string strError = "";
     int i = 0;
     for (const auto& txout : tx.vout) {
         i++;
-        bool fIsToken = false;
-        int nType = 0;
-        int nScriptType = 0;
-        bool fIsOwner = false;
-        if (txout.scriptPubKey.IsTokenScript(nType, nScriptType, fIsOwner))
-            fIsToken = true;
+        const CTxTokenOutput* tokenOutput = tx.GetTokenOutput(i - 1);
+        bool fIsToken = tokenOutput != nullptr;
+        int nType = fIsToken ? tokenOutput->nType : 0;
 
         if (tokenCache) {
             if (fIsToken && !AreTokensDeployed())
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-is-token-and-token-not-active");
 
             if (txout.scriptPubKey.IsNullToken()) {
+                TRACE_SPAN("CheckTxTokens.NullTokenData");
                 if (!AreRestrictedTokensDeployed())
                     return state.DoS(100, false, REJECT_INVALID,
                                      "bad-tx-null-token-data-before-restricted-tokens-activated");
@@ -725,19 +810,13 @@ bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, c
         if (nType == TX_TRANSFER_TOKEN) {
             CTokenTransfer transfer;
             std::string address = "";
-            if (!TransferTokenFromScript(txout.scriptPubKey, transfer, address))
+            if (!TransferTokenFromTx(tx, i - 1, transfer, address))
                 return state.DoS(100, false, REJECT_INVALID, "bad-tx-token-transfer-bad-deserialize", false, "",
                                  tx.GetHash());
 
             if (!ContextualCheckTransferToken(tokenCache, transfer, address, strError))
                 return state.DoS(100, false, REJECT_INVALID, strError, false, "", tx.GetHash());
 
-            // Add to the total value of tokens in the outputs
-            if (totalOutputs.count(transfer.strName))
-                totalOutputs.at(transfer.strName) += transfer.nAmount;
-            else
-                totalOutputs.insert(make_pair(transfer.strName, transfer.nAmount));
-
             if (!fRunningUnitTests) {
                 if (IsTokenNameAnOwner(transfer.strName)) {
                     if (transfer.nAmount != OWNER_TOKEN_AMOUNT)
@@ -813,7 +892,7 @@ bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, c
             // Get the token type
             CNewToken token;
             std::string address;
-            if (!TokenFromScript(tx.vout[tx.vout.size() - 1].scriptPubKey, token, address)) {
+            if (!TokenFromTx(tx, tx.vout.size() - 1, token, address)) {
                 error("%s : Failed to get new token from transaction: %s", __func__, tx.GetHash().GetHex());
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-issue-serialzation-failed", false, "", tx.GetHash());
             }
@@ -910,23 +989,5 @@ bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, c
         }
     }
 
-    for (const auto& outValue : totalOutputs) {
-        if (!totalInputs.count(outValue.first)) {
-            std::string errorMsg;
-            errorMsg = strprintf("Bad Transaction - Trying to create outpoint for token that you don't have: %s", outValue.first);
-            return state.DoS(100, false, REJECT_INVALID, "bad-tx-inputs-outputs-mismatch " + errorMsg, false, "", tx.GetHash());
-        }
-
-        if (totalInputs.at(outValue.first) != outValue.second) {
-            std::string errorMsg;
-            errorMsg = strprintf("Bad Transaction - Tokens would be burnt %s", outValue.first);
-            return state.DoS(100, false, REJECT_INVALID, "bad-tx-inputs-outputs-mismatch " + errorMsg, false, "", tx.GetHash());
-        }
-    }
-
-    // Check the input size and the output size
-    if (totalOutputs.size() != totalInputs.size()) {
-        return state.DoS(100, false, REJECT_INVALID, "bad-tx-token-inputs-size-does-not-match-outputs-size", false, "", tx.GetHash());
-    }
     return true;
 }
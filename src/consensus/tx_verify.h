@@ -8,6 +8,7 @@
 
 #include "amount.h"
 
+#include <memory>
 #include <stdint.h>
 #include <vector>
 #include <string>
@@ -23,10 +24,14 @@ class uint256;
 class CMessage;
 class CNullTokenTxData;
 
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+
 /** Transaction validation functions */
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fCheckDuplicateInputs=true, bool fMempoolCheck = false, bool fBlockCheck = false);
+/** CheckTransaction for every transaction of vtx, on up to nMaxThreads threads. vState gets the state of each, in order */
+void CheckTransactions(const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState, int nMaxThreads, bool fMempoolCheck = false);
 
 namespace Consensus {
 /**
@@ -38,7 +43,20 @@ namespace Consensus {
 bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, CAmount& txfee);
 
 /** TOKENS START */
-bool CheckTxTokens(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, int64_t nSpendTime, CTokensCache* tokenCache, bool fCheckMempool, std::vector<std::pair<std::string, uint256> >& vPairReissueTokens, const bool fRunningUnitTests = false, std::set<CMessage>* setMessages = nullptr, int64_t nBlocktime = 0,  std::vector<std::pair<std::string, CNullTokenTxData>>* myNullTokenData = nullptr);
+/**
+ * Contextual token checks against the token cache. Unless fAmountsChecked is set the
+ * cache-independent checks of CheckTxTokenAmounts are run as well; ConnectBlock hands those
+ * to the script check threads instead.
+ */
+bool CheckTxTokens(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, int64_t nSpendTime, CTokensCache* tokenCache, bool fCheckMempool, std::vector<std::pair<std::string, uint256> >& vPairReissueTokens, const bool fRunningUnitTests = false, std::set<CMessage>* setMessages = nullptr, int64_t nBlocktime = 0,  std::vector<std::pair<std::string, CNullTokenTxData>>* myNullTokenData = nullptr, bool fAmountsChecked = false);
+
+/**
+ * The token checks that need neither the token cache nor the coins view: decoding the spent
+ * token outputs, their timelocks, and that every token's input and output amounts match.
+ * @param[in] vSpentTokens The token outputs spent by tx, in input order
+ * @param[out] pfTimeLocked Set when a spent token output is time locked, so the result depends on the spend height and time
+ */
+bool CheckTxTokenAmounts(const CTransaction& tx, CValidationState& state, const std::vector<CTxOut>& vSpentTokens, int nSpendHeight, int64_t nSpendTime, bool* pfTimeLocked = nullptr);
 /** TOKENS END */
 } // namespace Consensus
 
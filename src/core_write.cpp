@@ -22,18 +22,9 @@
 
 std::string ValueFromAmountString(const CAmount& amount, const int8_t units)
 {
-    bool sign = amount < 0;
-    int64_t n_abs = (sign ? -amount : amount);
-    int64_t quotient = n_abs / COIN;
-    int64_t remainder = n_abs % COIN;
-    remainder = remainder / pow(10, 8 - units);
-
-    if (units == 0 && remainder == 0) {
-        return strprintf("%s%d", sign ? "-" : "", quotient);
-    }
-    else {
-        return strprintf("%s%d.%0" + std::to_string(units) + "d", sign ? "-" : "", quotient, remainder);
-    }
+    std::string str;
+    AppendAmount(str, amount, units);
+    return str;
 }
 
 UniValue ValueFromAmount(const CAmount& amount, const int8_t units)
@@ -120,7 +111,7 @@ std::string ScriptToAsmStr(const CScript& script, const bool fAttemptSighashDeco
             str += HexStr(vch);
         } else if (0 <= opcode && opcode <= OP_PUSHDATA4) {
             if (vch.size() <= static_cast<std::vector<unsigned char>::size_type>(4)) {
-                str += strprintf("%d", CScriptNum(vch, false).getint());
+                str += std::to_string(CScriptNum(vch, false).getint());
             } else {
                 // the IsUnspendable check makes sure not to try to decode OP_RETURN data that may match the format of a signature
                 if (fAttemptSighashDecode && !script.IsUnspendable()) {
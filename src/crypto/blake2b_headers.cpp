@@ -0,0 +1,151 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/blake2b_headers.h"
+#include "crypto/blake2b.h"
+#include "crypto/common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__)
+#include <cpuid.h>
+namespace blake2b_avx2
+{
+bool Available();
+void Hash80x4(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b-256 implementation for messages of exactly one 80-byte block.
+namespace blake2b_header
+{
+const uint64_t IV[8] = {
+    0x6A09E667F3BCC908ull, 0xBB67AE8584CAA73Bull, 0x3C6EF372FE94F82Bull, 0xA54FF53A5F1D36F1ull,
+    0x510E527FADE682D1ull, 0x9B05688C2B3E6C1Full, 0x1F83D9ABFB41BD6Bull, 0x5BE0CD19137E2179ull,
+};
+
+const uint8_t SIGMA[12][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+    { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+    { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+    { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+    { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+    { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+    { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+    { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+    { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+};
+
+uint64_t inline Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+void inline G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t x, uint64_t y)
+{
+    a = a + b + x;
+    d = Rotr(d ^ a, 32);
+    c = c + d;
+    b = Rotr(b ^ c, 24);
+    a = a + b + y;
+    d = Rotr(d ^ a, 16);
+    c = c + d;
+    b = Rotr(b ^ c, 63);
+}
+
+/** The whole message is the first and last block: no key, 32-byte digest, 80 bytes counted. */
+void Hash80(unsigned char* out, const unsigned char* in)
+{
+    uint64_t m[16] = {0};
+    for (int i = 0; i < 10; i++)
+        m[i] = ReadLE64(in + 8 * i);
+
+    uint64_t h0 = IV[0] ^ 0x01010020;
+    uint64_t v[16] = {h0, IV[1], IV[2], IV[3], IV[4], IV[5], IV[6], IV[7],
+                      IV[0], IV[1], IV[2], IV[3], IV[4] ^ BLAKE2B_HEADER_SIZE, IV[5], ~IV[6], IV[7]};
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    WriteLE64(out, h0 ^ v[0] ^ v[8]);
+    for (int i = 1; i < 4; i++)
+        WriteLE64(out + 8 * i, IV[i] ^ v[i] ^ v[i + 8]);
+}
+
+} // namespace blake2b_header
+
+typedef void (*Hash80x4Type)(unsigned char*, const unsigned char*);
+
+/** Checks a four-way implementation against the portable blake2b over distinct headers. */
+bool SelfTest(Hash80x4Type hash)
+{
+    unsigned char in[4 * BLAKE2B_HEADER_SIZE];
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = (unsigned char)(i * 7 + 3);
+
+    unsigned char out[4 * 32];
+    hash(out, in);
+    for (int n = 0; n < 4; n++) {
+        unsigned char expected[32];
+        blake2b_hash(expected, in + n * BLAKE2B_HEADER_SIZE, BLAKE2B_HEADER_SIZE);
+        if (memcmp(out + 32 * n, expected, 32))
+            return false;
+    }
+    return true;
+}
+
+Hash80x4Type Hash80x4 = nullptr;
+
+} // namespace
+
+std::string Blake2bAutoDetect()
+{
+    // The single header path is checked whatever the CPU
+    unsigned char in[BLAKE2B_HEADER_SIZE] = {0};
+    unsigned char out[32], expected[32];
+    blake2b_header::Hash80(out, in);
+    blake2b_hash(expected, in, sizeof(in));
+    assert(memcmp(out, expected, sizeof(out)) == 0);
+
+#if defined(__x86_64__) || defined(__amd64__)
+    if (blake2b_avx2::Available()) {
+        Hash80x4 = blake2b_avx2::Hash80x4;
+        assert(SelfTest(Hash80x4));
+        return "avx2";
+    }
+#endif
+
+    return "standard";
+}
+
+void Blake2b256Headers(unsigned char* out, const unsigned char* in, size_t count)
+{
+    if (Hash80x4) {
+        while (count >= 4) {
+            Hash80x4(out, in);
+            out += 4 * 32;
+            in += 4 * BLAKE2B_HEADER_SIZE;
+            count -= 4;
+        }
+    }
+
+    while (count--) {
+        blake2b_header::Hash80(out, in);
+        out += 32;
+        in += BLAKE2B_HEADER_SIZE;
+    }
+}
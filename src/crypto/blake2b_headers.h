@@ -0,0 +1,25 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_CRYPTO_BLAKE2B_HEADERS_H
+#define PLB_CRYPTO_BLAKE2B_HEADERS_H
+
+#include <stddef.h>
+#include <string>
+
+/** Size of the part of a block header covered by the work hash, nVersion to nNonce */
+static const size_t BLAKE2B_HEADER_SIZE = 80;
+
+/** BLAKE2b-256 of 'count' headers of BLAKE2B_HEADER_SIZE bytes laid end to end in 'in', the
+ *  32-byte hashes to 'out'. Each header is a single compression; headers are hashed four at a
+ *  time where AVX2 allows.
+ */
+void Blake2b256Headers(unsigned char* out, const unsigned char* in, size_t count);
+
+/** Autodetect the best available implementation of Blake2b256Headers.
+ *  Returns the name of the implementation.
+ */
+std::string Blake2bAutoDetect();
+
+#endif // PLB_CRYPTO_BLAKE2B_HEADERS_H
@@ -0,0 +1,178 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/sha256.h"
+
+#include <limits>
+
+namespace {
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr int LIMB_BYTES = LIMB_SIZE / 8;
+constexpr limb_t MAX_LIMB = std::numeric_limits<limb_t>::max();
+//! 2^3072 - MAX_PRIME_DIFF is prime, so 2^3072 is MAX_PRIME_DIFF modulo it
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+} // namespace
+
+Num3072::Num3072(const unsigned char* data)
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = 0;
+        for (int b = 0; b < LIMB_BYTES; ++b)
+            limbs[i] |= (limb_t)data[i * LIMB_BYTES + b] << (8 * b);
+    }
+    // Below 2^3072, so at most one prime above the reduced value
+    if (IsOverflow())
+        FullReduce();
+}
+
+void Num3072::ToBytes(unsigned char* out) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        for (int b = 0; b < LIMB_BYTES; ++b)
+            out[i * LIMB_BYTES + b] = (unsigned char)(limbs[i] >> (8 * b));
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+//! Whether the value is the prime or above it, which is only possible below 2^3072 for the top MAX_PRIME_DIFF values
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= MAX_LIMB - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != MAX_LIMB)
+            return false;
+    }
+    return true;
+}
+
+//! Subtract the prime from an overflowing value: add MAX_PRIME_DIFF and drop the 2^3072 that carries out
+void Num3072::FullReduce()
+{
+    double_limb_t t = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; ++i) {
+        t += limbs[i];
+        limbs[i] = (limb_t)t;
+        t >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t tmp[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            const double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> LIMB_SIZE);
+        }
+        tmp[i + LIMBS] = carry;
+    }
+
+    // Fold the high half onto the low half times MAX_PRIME_DIFF, which leaves a carry below MAX_PRIME_DIFF + 1
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        const double_limb_t t = (double_limb_t)tmp[i + LIMBS] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+
+    // Fold the carry the same way, until nothing carries out of the top limb
+    while (carry) {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && t; ++i) {
+            t += limbs[i];
+            limbs[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat's little theorem: the inverse is the value to the power of the prime minus two, whose limbs are all
+    // ones but the lowest
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        const limb_t exponent = i == 0 ? MAX_LIMB - MAX_PRIME_DIFF - 1 : MAX_LIMB;
+        for (int bit = LIMB_SIZE - 1; bit >= 0; --bit) {
+            result.Multiply(result);
+            if ((exponent >> bit) & 1)
+                result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hashed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hashed);
+    unsigned char stretched[Num3072::BYTE_SIZE];
+    ChaCha20(hashed, sizeof(hashed)).Output(stretched, sizeof(stretched));
+    return Num3072(stretched);
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len) : m_numerator(ToNum3072(data, len))
+{
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    m_numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    m_denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char* out)
+{
+    m_numerator.Divide(m_denominator);
+    m_denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/pbkdf2_hmac_sha512.h"
+
+#include "crypto/common.h"
+#include "crypto/hmac_sha512.h"
+
+#include <algorithm>
+#include <string.h>
+
+void PBKDF2_HMAC_SHA512(const unsigned char* password, size_t passwordlen, const unsigned char* salt, size_t saltlen, unsigned int nIterations, unsigned char* out, size_t outlen)
+{
+    // Every round keys the HMAC with the password, so its padded key is hashed once
+    // and the hasher copied for each round
+    const CHMAC_SHA512 hmacKeyed(password, passwordlen);
+
+    unsigned char u[CHMAC_SHA512::OUTPUT_SIZE];
+    unsigned char t[CHMAC_SHA512::OUTPUT_SIZE];
+    for (uint32_t nBlock = 1; outlen > 0; nBlock++) {
+        unsigned char vchBlock[4];
+        WriteBE32(vchBlock, nBlock);
+        CHMAC_SHA512 hmac(hmacKeyed);
+        hmac.Write(salt, saltlen).Write(vchBlock, sizeof(vchBlock)).Finalize(u);
+        memcpy(t, u, sizeof(t));
+
+        for (unsigned int i = 1; i < nIterations; i++) {
+            CHMAC_SHA512 hmacRound(hmacKeyed);
+            hmacRound.Write(u, sizeof(u)).Finalize(u);
+            for (size_t j = 0; j < sizeof(t); j++)
+                t[j] ^= u[j];
+        }
+
+        const size_t nCopy = std::min(outlen, sizeof(t));
+        memcpy(out, t, nCopy);
+        out += nCopy;
+        outlen -= nCopy;
+    }
+}
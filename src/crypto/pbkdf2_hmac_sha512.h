@@ -0,0 +1,17 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_CRYPTO_PBKDF2_HMAC_SHA512_H
+#define PLB_CRYPTO_PBKDF2_HMAC_SHA512_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * PBKDF2 (RFC 8018) with HMAC-SHA-512, writing outlen bytes of key derived
+ * from the password and salt in nIterations rounds to out.
+ */
+void PBKDF2_HMAC_SHA512(const unsigned char* password, size_t passwordlen, const unsigned char* salt, size_t saltlen, unsigned int nIterations, unsigned char* out, size_t outlen);
+
+#endif // PLB_CRYPTO_PBKDF2_HMAC_SHA512_H
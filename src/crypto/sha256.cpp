@@ -18,6 +18,22 @@ namespace sha256_sse4
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 }
 #endif
+namespace sha256d_sse2
+{
+void TransformD(unsigned char* out, const uint32_t* states, const unsigned char* blocks);
+void TransformD64(unsigned char* out, const unsigned char* in);
+}
+namespace sha256d_avx2
+{
+bool Available();
+void TransformD64(unsigned char* out, const unsigned char* in);
+}
+namespace sha256_shani
+{
+bool Available();
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+void TransformD64_2way(unsigned char* out, const unsigned char* in);
+}
 #endif
 
 // Internal implementation code.
@@ -175,21 +191,172 @@ bool SelfTest(TransformType tr) {
 
 TransformType Transform = sha256::Transform;
 
+/** Double-SHA256 of one 64 byte message with the single stream Transform. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char pad64[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+    uint32_t s[8];
+    sha256::Initialize(s);
+    Transform(s, in, 1);
+    Transform(s, pad64, 1);
+
+    unsigned char buf[64] = {0};
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i]);
+    buf[32] = 0x80;
+    WriteBE64(buf + 56, 256);
+    sha256::Initialize(s);
+    Transform(s, buf, 1);
+
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+//! Kernels hashing 2, 4 and 8 messages at once, nullptr where the CPU has none
+TransformD64Type TransformD64_2way = nullptr;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+/** Checks a kernel hashing lanes 64 byte messages at once against the portable code. */
+bool SelfTestD64(TransformD64Type tr, int lanes)
+{
+    unsigned char in[8 * 64], out[8 * 32], expected[8 * 32];
+    for (int i = 0; i < 8 * 64; i++)
+        in[i] = i * 7 + 1;
+    for (int n = 0; n < lanes; n++) {
+        uint32_t s[8];
+        unsigned char buf[64] = {0};
+        sha256::Initialize(s);
+        sha256::Transform(s, in + 64 * n, 1);
+        buf[0] = 0x80;
+        buf[62] = 2;
+        sha256::Transform(s, buf, 1);
+        memset(buf, 0, sizeof(buf));
+        for (int i = 0; i < 8; i++)
+            WriteBE32(buf + 4 * i, s[i]);
+        buf[32] = 0x80;
+        buf[62] = 1;
+        sha256::Initialize(s);
+        sha256::Transform(s, buf, 1);
+        for (int i = 0; i < 8; i++)
+            WriteBE32(expected + 32 * n + 4 * i, s[i]);
+    }
+    tr(out, in);
+    return memcmp(out, expected, 32 * lanes) == 0;
+}
+
 } // namespace
 
 std::string SHA256AutoDetect()
 {
-#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    std::string ret = "standard";
+#if defined(__x86_64__) || defined(__amd64__)
+    bool have_shani = sha256_shani::Available();
+#if defined(USE_ASM)
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    if (!have_shani && __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        ret = "sse4(1way)";
+    }
+#endif
+    if (have_shani) {
+        // Two interleaved SHA-NI streams also beat eight AVX2 lanes, which spend
+        // three instructions on every rotate
+        Transform = sha256_shani::Transform;
+        TransformD64_2way = sha256_shani::TransformD64_2way;
+        ret = "shani(1way,2way)";
+    } else {
+        if (sha256d_avx2::Available()) {
+            TransformD64_8way = sha256d_avx2::TransformD64;
+            ret += ",avx2(8way)";
+        }
+        TransformD64_4way = sha256d_sse2::TransformD64;
+        ret += ",sse2(4way)";
     }
 #endif
 
     assert(SelfTest(Transform));
-    return "standard";
+    assert(SelfTestD64(TransformD64, 1));
+    if (TransformD64_2way) assert(SelfTestD64(TransformD64_2way, 2));
+    if (TransformD64_4way) assert(SelfTestD64(TransformD64_4way, 4));
+    if (TransformD64_8way) assert(SelfTestD64(TransformD64_8way, 8));
+    return ret;
+}
+
+void SHA256Midstate(uint32_t state[8], const unsigned char* data, size_t blocks)
+{
+    sha256::Initialize(state);
+    Transform(state, data, blocks);
+}
+
+void SHA256DFinal(unsigned char* out, const uint32_t* states, const unsigned char* blocks, size_t count)
+{
+#if defined(__x86_64__) || defined(__amd64__)
+    while (count >= 4) {
+        sha256d_sse2::TransformD(out, states, blocks);
+        out += 4 * CSHA256::OUTPUT_SIZE;
+        states += 4 * 8;
+        blocks += 4 * 64;
+        count -= 4;
+    }
+#endif
+
+    while (count--) {
+        uint32_t s[8];
+        memcpy(s, states, sizeof(s));
+        Transform(s, blocks, 1);
+
+        unsigned char buf[64] = {0};
+        for (int i = 0; i < 8; i++)
+            WriteBE32(buf + 4 * i, s[i]);
+        buf[32] = 0x80;
+        WriteBE64(buf + 56, 256);
+        sha256::Initialize(s);
+        Transform(s, buf, 1);
+
+        for (int i = 0; i < 8; i++)
+            WriteBE32(out + 4 * i, s[i]);
+        out += CSHA256::OUTPUT_SIZE;
+        states += 8;
+        blocks += 64;
+    }
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 8 * CSHA256::OUTPUT_SIZE;
+            in += 8 * 64;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 4 * CSHA256::OUTPUT_SIZE;
+            in += 4 * 64;
+            blocks -= 4;
+        }
+    }
+    if (TransformD64_2way) {
+        while (blocks >= 2) {
+            TransformD64_2way(out, in);
+            out += 2 * CSHA256::OUTPUT_SIZE;
+            in += 2 * 64;
+            blocks -= 2;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += CSHA256::OUTPUT_SIZE;
+        in += 64;
+        blocks--;
+    }
 }
 
 ////// SHA-256
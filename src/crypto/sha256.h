@@ -27,6 +27,21 @@ public:
     CSHA256& Reset();
 };
 
+/** The SHA-256 state after the first 'blocks' 64-byte chunks of data. */
+void SHA256Midstate(uint32_t state[8], const unsigned char* data, size_t blocks);
+
+/** Finish 'count' double-SHA256 hashes at once, four at a time where SIMD allows. Each
+ *  message is given by its midstate (8 words in states) and its final 64-byte block,
+ *  padding included (64 bytes in blocks); the 32-byte results go to out.
+ */
+void SHA256DFinal(unsigned char* out, const uint32_t* states, const unsigned char* blocks, size_t count);
+
+/** Double-SHA256 of 'blocks' 64-byte messages (like the pairs of hashes in a merkle tree) from
+ *  in, eight, four or two at a time where the CPU allows. The 32-byte results go to out, which
+ *  may be in itself: every message is read before its own or any later result is written.
+ */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
 /** Autodetect the best available SHA256 implementation.
  *  Returns the name of the implementation.
  */
@@ -0,0 +1,176 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Eight independent double-SHA256 hashes of 64 byte messages side by side, one per
+// 32-bit lane of an AVX2 register. The functions carry their own target attribute,
+// so the file needs no extra compiler flags; Available() says whether they can run.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+namespace sha256d_avx2
+{
+namespace
+{
+const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+AVX2_TARGET __m256i inline K(uint32_t x) { return _mm256_set1_epi32(x); }
+
+AVX2_TARGET __m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+AVX2_TARGET __m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+AVX2_TARGET __m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+AVX2_TARGET __m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+AVX2_TARGET __m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+AVX2_TARGET __m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+AVX2_TARGET __m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+AVX2_TARGET __m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+AVX2_TARGET __m256i inline ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+AVX2_TARGET __m256i inline Ror(__m256i x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+
+AVX2_TARGET __m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+AVX2_TARGET __m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+AVX2_TARGET __m256i inline Sigma0(__m256i x) { return Xor(Ror(x, 2), Ror(x, 13), Ror(x, 22)); }
+AVX2_TARGET __m256i inline Sigma1(__m256i x) { return Xor(Ror(x, 6), Ror(x, 11), Ror(x, 25)); }
+AVX2_TARGET __m256i inline sigma0(__m256i x) { return Xor(Ror(x, 7), Ror(x, 18), ShR(x, 3)); }
+AVX2_TARGET __m256i inline sigma1(__m256i x) { return Xor(Ror(x, 17), Ror(x, 19), ShR(x, 10)); }
+
+/** One round of SHA-256 in every lane, kw being the round constant plus the message word. */
+AVX2_TARGET void inline Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, __m256i kw)
+{
+    __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), kw);
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** One SHA-256 transformation of the 16 message words w, which are overwritten by the schedule. */
+AVX2_TARGET void Transform(__m256i* s, __m256i* w)
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int i = 0; i < 64; i += 8) {
+        if (i >= 16) {
+            for (int n = i; n < i + 8; n++)
+                w[n & 15] = Add(w[n & 15], sigma1(w[(n - 2) & 15]), w[(n - 7) & 15], sigma0(w[(n - 15) & 15]));
+        }
+        Round(a, b, c, d, e, f, g, h, Add(K(K256[i + 0]), w[(i + 0) & 15]));
+        Round(h, a, b, c, d, e, f, g, Add(K(K256[i + 1]), w[(i + 1) & 15]));
+        Round(g, h, a, b, c, d, e, f, Add(K(K256[i + 2]), w[(i + 2) & 15]));
+        Round(f, g, h, a, b, c, d, e, Add(K(K256[i + 3]), w[(i + 3) & 15]));
+        Round(e, f, g, h, a, b, c, d, Add(K(K256[i + 4]), w[(i + 4) & 15]));
+        Round(d, e, f, g, h, a, b, c, Add(K(K256[i + 5]), w[(i + 5) & 15]));
+        Round(c, d, e, f, g, h, a, b, Add(K(K256[i + 6]), w[(i + 6) & 15]));
+        Round(b, c, d, e, f, g, h, a, Add(K(K256[i + 7]), w[(i + 7) & 15]));
+    }
+
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+AVX2_TARGET void inline Initialize(__m256i* s)
+{
+    s[0] = K(0x6a09e667ul);
+    s[1] = K(0xbb67ae85ul);
+    s[2] = K(0x3c6ef372ul);
+    s[3] = K(0xa54ff53aul);
+    s[4] = K(0x510e527ful);
+    s[5] = K(0x9b05688cul);
+    s[6] = K(0x1f83d9abul);
+    s[7] = K(0x5be0cd19ul);
+}
+
+/** Word i of the eight 64 byte messages at in, one per lane. */
+AVX2_TARGET __m256i inline Read8(const unsigned char* in, int i)
+{
+    return _mm256_set_epi32(ReadBE32(in + 448 + 4 * i), ReadBE32(in + 384 + 4 * i), ReadBE32(in + 320 + 4 * i), ReadBE32(in + 256 + 4 * i),
+                            ReadBE32(in + 192 + 4 * i), ReadBE32(in + 128 + 4 * i), ReadBE32(in + 64 + 4 * i), ReadBE32(in + 4 * i));
+}
+
+} // namespace
+
+bool Available()
+{
+    uint32_t eax, ebx, ecx, edx;
+    // AVX and OSXSAVE, then the OS saving the YMM registers, then AVX2 itself
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || ((ecx >> 27) & 3) != 3)
+        return false;
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6)
+        return false;
+    if (__get_cpuid_max(0, nullptr) < 7)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+}
+
+/** Double-SHA256 of eight 64 byte messages, see SHA256D64. All input is read before out is written. */
+AVX2_TARGET void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], w[16];
+    Initialize(s);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read8(in, i);
+    Transform(s, w);
+
+    // The padding block of a 64 byte message
+    w[0] = K(0x80000000);
+    for (int i = 1; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(512);
+    Transform(s, w);
+
+    // The second hash is over the 32 byte digests, padded to a single block
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = K(0x80000000);
+    for (int i = 9; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(256);
+    Initialize(s);
+    Transform(s, w);
+
+    uint32_t lanes[8];
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)lanes, s[i]);
+        for (int n = 0; n < 8; n++)
+            WriteBE32(out + 32 * n + 4 * i, lanes[n]);
+    }
+}
+
+} // namespace sha256d_avx2
+
+#else
+
+namespace sha256d_avx2
+{
+bool Available() { return false; }
+void TransformD64(unsigned char* out, const unsigned char* in) { abort(); }
+}
+
+#endif
@@ -0,0 +1,204 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 on the x86 SHA extensions, which do two rounds per instruction. The
+// double-SHA256 of 64 byte messages runs two of them interleaved, so one's rounds
+// fill the latency of the other's. The functions carry their own target attribute,
+// so the file needs no extra compiler flags; Available() says whether they can run.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+#define SHANI_TARGET __attribute__((target("sha,sse4.1")))
+
+namespace sha256_shani
+{
+namespace
+{
+alignas(16) const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+//! The padding block of a 64 byte message, and the one after a 32 byte digest
+alignas(16) const unsigned char PAD64[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+alignas(16) const unsigned char PAD32[32] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0};
+
+/**
+ * The SHA instructions keep the state as ABEF and CDGH. Transforms LANES
+ * independent streams, each a state in s0/s1 and the 16 big endian message words
+ * in m0..m3, with the rounds of the streams next to each other.
+ */
+template <int LANES>
+SHANI_TARGET void inline Rounds(__m128i* s0, __m128i* s1, __m128i* m0, __m128i* m1, __m128i* m2, __m128i* m3)
+{
+    __m128i save0[LANES], save1[LANES];
+    for (int n = 0; n < LANES; n++) {
+        save0[n] = s0[n];
+        save1[n] = s1[n];
+    }
+
+    __m128i* m[4] = {m0, m1, m2, m3};
+    for (int i = 0; i < 16; i++) {
+        __m128i* cur = m[i & 3];
+        const __m128i k = _mm_load_si128((const __m128i*)&K256[4 * i]);
+        for (int n = 0; n < LANES; n++) {
+            const __m128i msg = _mm_add_epi32(cur[n], k);
+            s1[n] = _mm_sha256rnds2_epu32(s1[n], s0[n], msg);
+            s0[n] = _mm_sha256rnds2_epu32(s0[n], s1[n], _mm_shuffle_epi32(msg, 0x0e));
+        }
+        // Words 16 to 63 of the schedule, four at a time into the message register used four rounds later
+        if (i >= 3 && i < 15) {
+            __m128i* prev = m[(i + 3) & 3];
+            __m128i* next = m[(i + 1) & 3];
+            for (int n = 0; n < LANES; n++)
+                next[n] = _mm_sha256msg2_epu32(_mm_add_epi32(next[n], _mm_alignr_epi8(cur[n], prev[n], 4)), cur[n]);
+        }
+        if (i >= 1 && i < 13) {
+            __m128i* prev = m[(i + 3) & 3];
+            for (int n = 0; n < LANES; n++)
+                prev[n] = _mm_sha256msg1_epu32(prev[n], cur[n]);
+        }
+    }
+
+    for (int n = 0; n < LANES; n++) {
+        s0[n] = _mm_add_epi32(s0[n], save0[n]);
+        s1[n] = _mm_add_epi32(s1[n], save1[n]);
+    }
+}
+
+SHANI_TARGET __m128i inline Load(const unsigned char* in)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), MASK);
+}
+
+SHANI_TARGET void inline Store(unsigned char* out, __m128i x)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(x, MASK));
+}
+
+/** ABCD EFGH to ABEF CDGH */
+SHANI_TARGET void inline Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** ABEF CDGH back to ABCD EFGH */
+SHANI_TARGET void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+} // namespace
+
+bool Available()
+{
+    uint32_t eax, ebx, ecx, edx;
+    // SSE4.1 and SSSE3 for the shuffles, then the SHA extensions
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !((ecx >> 19) & 1) || !((ecx >> 9) & 1))
+        return false;
+    if (__get_cpuid_max(0, nullptr) < 7)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 29) & 1;
+}
+
+SHANI_TARGET void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--) {
+        __m128i m0 = Load(chunk), m1 = Load(chunk + 16), m2 = Load(chunk + 32), m3 = Load(chunk + 48);
+        Rounds<1>(&s0, &s1, &m0, &m1, &m2, &m3);
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+
+/** Double-SHA256 of two 64 byte messages, see SHA256D64. All input is read before out is written. */
+SHANI_TARGET void TransformD64_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s0[2], s1[2], m0[2], m1[2], m2[2], m3[2];
+    const __m128i init0 = _mm_loadu_si128((const __m128i*)INIT);
+    const __m128i init1 = _mm_loadu_si128((const __m128i*)(INIT + 4));
+    for (int n = 0; n < 2; n++) {
+        s0[n] = init0;
+        s1[n] = init1;
+        Shuffle(s0[n], s1[n]);
+        m0[n] = Load(in + 64 * n);
+        m1[n] = Load(in + 64 * n + 16);
+        m2[n] = Load(in + 64 * n + 32);
+        m3[n] = Load(in + 64 * n + 48);
+    }
+    Rounds<2>(s0, s1, m0, m1, m2, m3);
+
+    for (int n = 0; n < 2; n++) {
+        m0[n] = Load(PAD64);
+        m1[n] = Load(PAD64 + 16);
+        m2[n] = Load(PAD64 + 32);
+        m3[n] = Load(PAD64 + 48);
+    }
+    Rounds<2>(s0, s1, m0, m1, m2, m3);
+
+    // The second hash is over the 32 byte digests, padded to a single block
+    for (int n = 0; n < 2; n++) {
+        Unshuffle(s0[n], s1[n]);
+        m0[n] = s0[n];
+        m1[n] = s1[n];
+        m2[n] = Load(PAD32);
+        m3[n] = Load(PAD32 + 16);
+        s0[n] = init0;
+        s1[n] = init1;
+        Shuffle(s0[n], s1[n]);
+    }
+    Rounds<2>(s0, s1, m0, m1, m2, m3);
+
+    for (int n = 0; n < 2; n++) {
+        Unshuffle(s0[n], s1[n]);
+        Store(out + 32 * n, s0[n]);
+        Store(out + 32 * n + 16, s1[n]);
+    }
+}
+
+} // namespace sha256_shani
+
+#else
+
+namespace sha256_shani
+{
+bool Available() { return false; }
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks) { abort(); }
+void TransformD64_2way(unsigned char* out, const unsigned char* in) { abort(); }
+}
+
+#endif
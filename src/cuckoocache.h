@@ -369,6 +369,33 @@ public:
         return setup(bytes/sizeof(Element));
     }
 
+    /** resize sets the container up to store no more than new_size elements,
+     * like setup, and inserts the elements it held that were not allowed to be
+     * erased into it again. Not threadsafe.
+     *
+     * @param new_size the desired number of elements to store
+     * @returns the maximum number of elements storable
+     */
+    uint32_t resize(uint32_t new_size)
+    {
+        std::vector<Element> kept;
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                kept.push_back(std::move(table[i]));
+        std::vector<Element>().swap(table);
+        epoch_flags.clear();
+        setup(new_size);
+        for (Element& e : kept)
+            insert(std::move(e));
+        return size;
+    }
+
+    /** resize_bytes is resize counting in bytes, see setup_bytes */
+    uint32_t resize_bytes(size_t bytes)
+    {
+        return resize(bytes/sizeof(Element));
+    }
+
     /** insert loops at most depth_limit times trying to insert a hash
      * at various locations in the table via a variant of the Cuckoo Algorithm
      * with eight hash locations.
@@ -388,8 +415,12 @@ public:
      * now in the table, one previously inserted element is evicted from the
      * table, the entry attempted to be inserted is evicted.
      *
+     * @returns true if e took the place of an element of an older epoch, or
+     * an element had to be dropped: the cache is full enough to lose entries
+     * nobody erased. Empty slots and elements erased in the current epoch
+     * don't count.
      */
-    inline void insert(Element e)
+    inline bool insert(Element e)
     {
         epoch_check();
         uint32_t last_loc = invalid();
@@ -401,17 +432,18 @@ public:
             if (table[loc] == e) {
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return false;
             }
         for (uint8_t depth = 0; depth < depth_limit; ++depth) {
             // First try to insert to an empty slot, if one exists
             for (uint32_t loc : locs) {
                 if (!collection_flags.bit_is_set(loc))
                     continue;
+                const bool aged = !epoch_flags[loc] && !(table[loc] == Element());
                 table[loc] = std::move(e);
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return aged;
             }
             /** Swap with the element at the location that was
             * not the last one looked at. Example:
@@ -437,6 +469,7 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        return true;
     }
 
     /* contains iterates through the hash locations for a given element
@@ -6,6 +6,7 @@
 #include "dbwrapper.h"
 
 #include "fs.h"
+#include "metrics.h"
 #include "util.h"
 #include "random.h"
 
@@ -99,12 +100,17 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize, size_t maxFileSize)
+static leveldb::Options GetOptions(size_t nCacheSize, size_t maxFileSize, leveldb::Cache* shared_cache, const leveldb::FilterPolicy* shared_filter_policy)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
+    if (shared_cache) {
+        options.block_cache = shared_cache;
+        options.filter_policy = shared_filter_policy;
+    } else {
+        options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
+        options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    }
     options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
     options.compression = leveldb::kNoCompression;
     options.info_log = new CPaladeumLevelDBLogger();
     options.max_file_size = maxFileSize;
@@ -117,14 +123,15 @@ static leveldb::Options GetOptions(size_t nCacheSize, size_t maxFileSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, size_t maxFileSize)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, size_t maxFileSize, CDBEnvironment* dbenvIn)
+    : dbpath(path), dbenv(dbenvIn), nDirtySequence(0)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize, maxFileSize);
+    options = GetOptions(nCacheSize, maxFileSize, dbenv ? dbenv->block_cache : nullptr, dbenv ? dbenv->filter_policy : nullptr);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -166,10 +173,19 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    if (dbenv)
+        dbenv->Register(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    if (dbenv) {
+        dbenv->Unregister(this);
+        // Shared with the other members of the environment
+        options.filter_policy = nullptr;
+        options.block_cache = nullptr;
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -182,13 +198,108 @@ CDBWrapper::~CDBWrapper()
     options.env = nullptr;
 }
 
+static CMetricCounter metricDBBatches("paladeum_db_write_batches_total", "Batches written to the LevelDB databases");
+static CMetricCounter metricDBSyncedBatches("paladeum_db_synced_write_batches_total", "Batches written to the LevelDB databases with a sync");
+static CMetricCounter metricDBBatchBytes("paladeum_db_write_bytes_total", "Estimated size of the batches written to the LevelDB databases");
+static CMetricHistogram metricDBWriteSeconds("paladeum_db_write_batch_seconds", "Time to write a batch to a LevelDB database", MetricDurationBounds(), 1e-6);
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
+    const int64_t nTimeStart = GetTimeMicros();
+    // A synced write makes the writes before it durable as well. Clearing the mark first means a
+    // write racing with this one either lands in the log ahead of the sync or marks the database again
+    if (dbenv && fSync)
+        nDirtySequence = 0;
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
+    if (dbenv && !fSync && nDirtySequence == 0)
+        dbenv->MarkDirty(this);
+    metricDBBatches.Inc();
+    if (fSync)
+        metricDBSyncedBatches.Inc();
+    metricDBBatchBytes.Inc(batch.SizeEstimate());
+    metricDBWriteSeconds.Observe(GetTimeMicros() - nTimeStart);
+    return true;
+}
+
+CDBEnvironment::CDBEnvironment(size_t nCacheSize) : nWriteSequence(0)
+{
+    block_cache = leveldb::NewLRUCache(nCacheSize);
+    filter_policy = leveldb::NewBloomFilterPolicy(10);
+}
+
+CDBEnvironment::~CDBEnvironment()
+{
+    assert(vMembers.empty());
+    delete filter_policy;
+    filter_policy = nullptr;
+    delete block_cache;
+    block_cache = nullptr;
+}
+
+void CDBEnvironment::Register(CDBWrapper* pdbw)
+{
+    LOCK(cs);
+    vMembers.push_back(pdbw);
+}
+
+void CDBEnvironment::Unregister(CDBWrapper* pdbw)
+{
+    LOCK(cs);
+    vMembers.erase(std::remove(vMembers.begin(), vMembers.end(), pdbw), vMembers.end());
+}
+
+void CDBEnvironment::MarkDirty(CDBWrapper* pdbw)
+{
+    LOCK(cs);
+    if (pdbw->nDirtySequence == 0)
+        pdbw->nDirtySequence = ++nWriteSequence;
+}
+
+bool CDBEnvironment::Sync()
+{
+    LOCK(cs);
+    std::vector<std::pair<uint64_t, CDBWrapper*>> vDirty;
+    for (CDBWrapper* pdbw : vMembers) {
+        const uint64_t nSequence = pdbw->nDirtySequence;
+        if (nSequence != 0)
+            vDirty.emplace_back(nSequence, pdbw);
+    }
+    std::sort(vDirty.begin(), vDirty.end());
+
+    leveldb::WriteBatch empty;
+    for (const auto& dirty : vDirty) {
+        CDBWrapper* pdbw = dirty.second;
+        // Cleared ahead of the sync for the same reason as in WriteBatch, and put back if it fails
+        pdbw->nDirtySequence = 0;
+        leveldb::Status status = pdbw->pdb->Write(pdbw->syncoptions, &empty);
+        if (!status.ok()) {
+            uint64_t nSynced = 0;
+            pdbw->nDirtySequence.compare_exchange_strong(nSynced, dirty.first);
+            dbwrapper_private::HandleError(status);
+        }
+    }
+    if (!vDirty.empty())
+        LogPrint(BCLog::LEVELDB, "%s: synced %u of %u databases\n", __func__, vDirty.size(), vMembers.size());
     return true;
 }
 
+size_t CDBEnvironment::GetDirtyCount() const
+{
+    LOCK(cs);
+    size_t nDirty = 0;
+    for (const CDBWrapper* pdbw : vMembers) {
+        if (pdbw->nDirtySequence != 0)
+            nDirty++;
+    }
+    return nDirty;
+}
+
+size_t CDBEnvironment::GetCacheUsage() const
+{
+    return block_cache->TotalCharge();
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -209,6 +320,32 @@ std::vector<unsigned char> CDBWrapper::CreateObfuscateKey() const
 
 }
 
+uint64_t CDBWrapper::GetDiskUsage() const
+{
+    if (penv)
+        return 0;
+    // Databases nested in the directory count on their own
+    uint64_t nUsage = 0;
+    try {
+        for (fs::directory_iterator it(dbpath); it != fs::directory_iterator(); ++it) {
+            if (fs::is_regular_file(it->status()))
+                nUsage += fs::file_size(it->path());
+        }
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    return nUsage;
+}
+
+CDBIterator* CDBWrapper::NewIterator(const CDBIteratorOptions& opts)
+{
+    assert(!opts.pSnapshot || opts.pSnapshot->pdb == pdb);
+    leveldb::ReadOptions readopts = iteroptions;
+    readopts.fill_cache = opts.fFillCache;
+    readopts.snapshot = opts.pSnapshot ? opts.pSnapshot->psnapshot : nullptr;
+    return new CDBIterator(*this, pdb->NewIterator(readopts));
+}
+
 bool CDBWrapper::IsEmpty()
 {
     std::unique_ptr<CDBIterator> it(NewIterator());
@@ -221,6 +358,26 @@ bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
 void CDBIterator::Next() { piter->Next(); }
 
+bool CDBIterator::GetRawEntry(std::vector<unsigned char>& vKey, std::vector<unsigned char>& vValue)
+{
+    CDataStream ssObfuscateKey(SER_DISK, CLIENT_VERSION);
+    ssObfuscateKey << CDBWrapper::OBFUSCATE_KEY_KEY;
+
+    leveldb::Slice slKey = piter->key();
+    if (slKey == leveldb::Slice(ssObfuscateKey.data(), ssObfuscateKey.size()))
+        return false;
+    vKey.assign(slKey.data(), slKey.data() + slKey.size());
+
+    leveldb::Slice slValue = piter->value();
+    vValue.assign(slValue.data(), slValue.data() + slValue.size());
+    const std::vector<unsigned char>& vObfuscateKey = parent.obfuscate_key;
+    if (!vObfuscateKey.empty()) {
+        for (size_t i = 0; i < vValue.size(); i++)
+            vValue[i] ^= vObfuscateKey[i % vObfuscateKey.size()];
+    }
+    return true;
+}
+
 namespace dbwrapper_private {
 
 void HandleError(const leveldb::Status& status)
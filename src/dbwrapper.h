@@ -10,10 +10,14 @@
 #include "fs.h"
 #include "serialize.h"
 #include "streams.h"
+#include "sync.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <atomic>
+#include <memory>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -115,6 +119,53 @@ public:
     size_t SizeEstimate() const { return size_estimate; }
 };
 
+/** A read view of a CDBWrapper as of the moment it was taken, released when destroyed */
+class CDBSnapshot
+{
+    friend class CDBWrapper;
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* psnapshot;
+
+    explicit CDBSnapshot(leveldb::DB* _pdb) : pdb(_pdb), psnapshot(_pdb->GetSnapshot()) {}
+
+public:
+    ~CDBSnapshot() { pdb->ReleaseSnapshot(psnapshot); }
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+};
+
+/**
+ * How an iterator reads the database. The defaults suit scans over many keys:
+ * they don't fill the block cache, so one listing doesn't evict the blocks the
+ * point reads keep coming back to.
+ */
+struct CDBIteratorOptions
+{
+    //! keep the blocks the iterator reads in the block cache
+    bool fFillCache;
+    //! read as of this snapshot of the same database, it must outlive the iterator
+    const CDBSnapshot* pSnapshot;
+
+    CDBIteratorOptions() : fFillCache(false), pSnapshot(nullptr) {}
+
+    /** For a few short seeks among hot keys, whose blocks are worth caching */
+    static CDBIteratorOptions Lookup()
+    {
+        CDBIteratorOptions opts;
+        opts.fFillCache = true;
+        return opts;
+    }
+
+    /** For a scan that reads the database as of the snapshot */
+    static CDBIteratorOptions AtSnapshot(const CDBSnapshot& snapshot)
+    {
+        CDBIteratorOptions opts;
+        opts.pSnapshot = &snapshot;
+        return opts;
+    }
+};
+
 class CDBIterator
 {
 private:
@@ -172,11 +223,69 @@ public:
         return piter->value().size();
     }
 
+    /**
+     * The key the iterator points at as stored and its value without the obfuscation, so that the
+     * entry is the same in every database holding it. False for the database's obfuscation key.
+     */
+    bool GetRawEntry(std::vector<unsigned char>& vKey, std::vector<unsigned char>& vValue);
+
+};
+
+/**
+ * Databases that share one block cache budget and are made durable together.
+ *
+ * Each member stays a LevelDB instance of its own with its own write-ahead log,
+ * as LevelDB has no column families or commits spanning databases. Members
+ * write without syncing and Sync() then fsyncs the log of each member written
+ * since the last pass, in the order they were first written, so a flush costs
+ * one sync per database that changed instead of one per write.
+ */
+class CDBEnvironment
+{
+    friend class CDBWrapper;
+private:
+    //! the block cache all members read through
+    leveldb::Cache* block_cache;
+
+    //! bloom filter policy of all members, it holds no state
+    const leveldb::FilterPolicy* filter_policy;
+
+    mutable CCriticalSection cs;
+
+    //! the open members
+    std::vector<CDBWrapper*> vMembers;
+
+    //! counts the first writes after a sync of the members, to sync them in write order
+    uint64_t nWriteSequence;
+
+    void Register(CDBWrapper* pdbw);
+    void Unregister(CDBWrapper* pdbw);
+    void MarkDirty(CDBWrapper* pdbw);
+
+public:
+    /**
+     * @param[in] nCacheSize  Size of the block cache shared by all members.
+     */
+    explicit CDBEnvironment(size_t nCacheSize);
+    ~CDBEnvironment();
+    CDBEnvironment(const CDBEnvironment&) = delete;
+    CDBEnvironment& operator=(const CDBEnvironment&) = delete;
+
+    /** Makes every write to the members durable. Throws dbwrapper_error on failure */
+    bool Sync();
+
+    /** Number of members written since the last sync */
+    size_t GetDirtyCount() const;
+
+    /** Bytes held in the shared block cache */
+    size_t GetCacheUsage() const;
 };
 
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBIterator;
+    friend class CDBEnvironment;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -187,7 +296,7 @@ private:
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
-    //! options used when iterating over values of the database
+    //! options used when iterating over values of the database, the default CDBIteratorOptions
     leveldb::ReadOptions iteroptions;
 
     //! options used when writing to the database
@@ -199,6 +308,9 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! the directory the database is stored in
+    fs::path dbpath;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -208,6 +320,12 @@ private:
     //! the length of the obfuscate key in number of bytes
     static const unsigned int OBFUSCATE_KEY_NUM_BYTES;
 
+    //! shared environment this database is a member of (may be nullptr)
+    CDBEnvironment* dbenv;
+
+    //! position of the first write since the last sync among the writes of the environment, 0 while synced
+    std::atomic<uint64_t> nDirtySequence;
+
     std::vector<unsigned char> CreateObfuscateKey() const;
 
 public:
@@ -218,8 +336,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dbenvIn     If set, read through the block cache of the environment and
+     *                        leave syncing to it; nCacheSize then only sizes the write buffer.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, size_t maxFileSize = 2 << 20);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, size_t maxFileSize = 2 << 20, CDBEnvironment* dbenvIn = nullptr);
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -248,6 +368,32 @@ public:
         return true;
     }
 
+    /** The value of a key as serialized, for records that are read in place rather than deserialized */
+    template <typename K>
+    bool ReadRaw(const K& key, std::string& strValue) const
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey << key;
+        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+
+        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        if (!status.ok()) {
+            if (status.IsNotFound())
+                return false;
+            LogPrintf("LevelDB read failure: %s\n", status.ToString());
+            dbwrapper_private::HandleError(status);
+        }
+        if (!obfuscate_key.empty()) {
+            for (size_t i = 0, j = 0; i < strValue.size(); i++) {
+                strValue[i] ^= obfuscate_key[j++];
+                if (j == obfuscate_key.size())
+                    j = 0;
+            }
+        }
+        return true;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -297,16 +443,28 @@ public:
         return WriteBatch(batch, true);
     }
 
+    /** An iterator for scans, see CDBIteratorOptions */
     CDBIterator *NewIterator()
     {
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    CDBIterator *NewIterator(const CDBIteratorOptions& opts);
+
+    /** A consistent view for iterators that must agree with each other */
+    std::unique_ptr<CDBSnapshot> NewSnapshot() const
+    {
+        return std::unique_ptr<CDBSnapshot>(new CDBSnapshot(pdb));
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
 
+    /** Bytes the files of the database take on disk, 0 for a database in memory */
+    uint64_t GetDiskUsage() const;
+
     template<typename K>
     size_t EstimateSize(const K& key_begin, const K& key_end) const
     {
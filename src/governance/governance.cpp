@@ -12,8 +12,12 @@
 #include <amount.h>
 #include <base58.h>
 #include <chain.h>
+#include <random.h>
+#include <trace.h>
 #include <util.h>
 
+#include <boost/thread.hpp>
+
 static const CScript DUMMY_SCRIPT = CScript() << ParseHex("6885777789"); 
 static const int DUMMY_TYPE = 0;
 
@@ -23,6 +27,8 @@ static const char DB_AUTORIZATION = 'p';
 static const char DB_FEE_ADDRESS = 'f';
 static const char DB_ADDRESS = 'a';
 static const char DB_COST = 'c';
+static const char DB_EVENT = 'e';
+static const char DB_EVENT_LOG_COMPLETE = 'L';
 
 static const char DB_GOVERNANCE_INIT  = 'G';
 
@@ -161,6 +167,50 @@ namespace {
         }
     };
 
+    struct EventEntry {
+        char key;
+        CGovernanceEvent event;
+
+        EventEntry() : key(DB_EVENT) {}
+        EventEntry(const CGovernanceEvent& event) : key(DB_EVENT), event(event) {}
+
+        template<typename Stream>
+        void Serialize(Stream &s) const {
+            s << key;
+            // Big endian so the log is in height order
+            ser_writedata32be(s, event.nHeight);
+            ser_writedata8(s, event.nType);
+            ser_writedata8(s, event.nCostType);
+            s << event.script;
+        }
+
+        template<typename Stream>
+        void Unserialize(Stream& s) {
+            s >> key;
+            event.nHeight = ser_readdata32be(s);
+            event.nType = ser_readdata8(s);
+            event.nCostType = ser_readdata8(s);
+            s >> event.script;
+        }
+    };
+
+    struct EventDetails {
+        CAmount cost;
+
+        EventDetails() : cost(0) {}
+        EventDetails(CAmount cost) : cost(cost) {}
+
+        template<typename Stream>
+        void Serialize(Stream &s) const {
+            s << cost;
+        }
+
+        template<typename Stream>
+        void Unserialize(Stream& s) {
+            s >> cost;
+        }
+    };
+
     struct AuthorityDetails {
         bool authorized;
 
@@ -179,7 +229,9 @@ namespace {
     };
 }
 
-CGovernance::CGovernance(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "governance", nCacheSize, fMemory, fWipe) 
+SaltedScriptHasher::SaltedScriptHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+CGovernance::CGovernance(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv) : CDBWrapper(GetDataDir() / "governance", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv), nFrozenScripts(0), nAuthorizedScripts(0), nValidatorGeneration(0), nCostGeneration(0), fEventLogComplete(false)
 {
 }
 
@@ -199,16 +251,22 @@ bool CGovernance::Init(bool fWipe, const CChainParams& chainparams) {
         batch.Write(CostEntry(), CostDetails());
 
         // Add initial token issuance cost values
-        batch.Write(CostEntry(GOVERNANCE_COST_ROOT, 0), CostDetails(chainparams.IssueTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_REISSUE, 0), CostDetails(chainparams.ReissueTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_UNIQUE, 0), CostDetails(chainparams.IssueUniqueTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_SUB, 0), CostDetails(chainparams.IssueUniqueTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_USERNAME, 0), CostDetails(chainparams.IssueUsernameTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_MSG_CHANNEL, 0), CostDetails(chainparams.IssueMsgChannelTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_QUALIFIER, 0), CostDetails(chainparams.IssueQualifierTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_SUB_QUALIFIER, 0), CostDetails(chainparams.IssueSubQualifierTokenFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_NULL_QUALIFIER, 0), CostDetails(chainparams.AddNullQualifierTagFeeAmount()));
-        batch.Write(CostEntry(GOVERNANCE_COST_RESTRICTED, 0), CostDetails(chainparams.IssueRestrictedTokenFeeAmount()));
+        const std::vector<std::pair<int, CAmount> > vInitialCosts = {
+            {GOVERNANCE_COST_ROOT, chainparams.IssueTokenFeeAmount()},
+            {GOVERNANCE_COST_REISSUE, chainparams.ReissueTokenFeeAmount()},
+            {GOVERNANCE_COST_UNIQUE, chainparams.IssueUniqueTokenFeeAmount()},
+            {GOVERNANCE_COST_SUB, chainparams.IssueUniqueTokenFeeAmount()},
+            {GOVERNANCE_COST_USERNAME, chainparams.IssueUsernameTokenFeeAmount()},
+            {GOVERNANCE_COST_MSG_CHANNEL, chainparams.IssueMsgChannelTokenFeeAmount()},
+            {GOVERNANCE_COST_QUALIFIER, chainparams.IssueQualifierTokenFeeAmount()},
+            {GOVERNANCE_COST_SUB_QUALIFIER, chainparams.IssueSubQualifierTokenFeeAmount()},
+            {GOVERNANCE_COST_NULL_QUALIFIER, chainparams.AddNullQualifierTagFeeAmount()},
+            {GOVERNANCE_COST_RESTRICTED, chainparams.IssueRestrictedTokenFeeAmount()},
+        };
+        for (const auto& cost : vInitialCosts) {
+            batch.Write(CostEntry(cost.first, 0), CostDetails(cost.second));
+            batch.Write(EventEntry(CGovernanceEvent(0, GOVERNANCE_COST, CScript(), cost.first, cost.second)), EventDetails(cost.second));
+        }
 
         // Init PoS-A addresses
         const std::set<std::string> init_authorized = chainparams.GetInitAuthorized();
@@ -216,170 +274,289 @@ bool CGovernance::Init(bool fWipe, const CChainParams& chainparams) {
             CTxDestination auth_destination = DecodeDestination(auth_address);
             CScript authScript = GetScriptForDestination(auth_destination);
             batch.Write(AuthorityEntry(authScript), AuthorityDetails(true));
+            batch.Write(EventEntry(CGovernanceEvent(0, GOVERNANCE_AUTHORIZATION, authScript)), EventDetails());
         }
 
         // Add initial token fee address from chainparams
         CTxDestination destination = DecodeDestination(GetParams().TokenFeeAddress());
         CScript feeScript = GetScriptForDestination(destination);
         batch.Write(FeeEntry(), FeeDetails(feeScript));
+        batch.Write(EventEntry(CGovernanceEvent(0, GOVERNANCE_FEE, feeScript)), EventDetails());
 
+        // A new database logs every event from the genesis block on
+        batch.Write(DB_EVENT_LOG_COMPLETE, true);
         batch.Write(DB_GOVERNANCE_INIT, true);
         WriteBatch(batch);
     }
 
+    LoadMirror();
+
     return true;
 }
 
-unsigned int CGovernance::GetNumberOfFrozenScripts() {
-    unsigned int number;
-
-    Read(DB_NUMBER_FROZEN, number);
-
-    return number;
-}
+void CGovernance::LoadMirror() {
+    LOCK(cs_mirror);
+    setFrozenScripts.clear();
+    setAuthorizedScripts.clear();
+    mapCostHistory.clear();
+    mapFeeScriptHistory.clear();
+    dirty.Clear();
+    nValidatorGeneration++;
+    validatorSet.reset();
+    nCostGeneration++;
+    costTable.reset();
+
+    nFrozenScripts = 0;
+    nAuthorizedScripts = 0;
+    fEventLogComplete = false;
+    Read(DB_NUMBER_FROZEN, nFrozenScripts);
+    Read(DB_EVENT_LOG_COMPLETE, fEventLogComplete);
+    Read(DB_NUMBER_AUTHORIZED, nAuthorizedScripts);
 
-bool CGovernance::FreezeScript(CScript script) {
-    FreezeEntry entry(script);
-    FreezeDetails details = FreezeDetails();
-    CDBBatch batch(*this);
+    std::unique_ptr<CDBIterator> it(NewIterator());
+    for (it->Seek(FreezeEntry(DUMMY_SCRIPT)); it->Valid(); it->Next()) {
+        FreezeEntry entry;
+        if (it->GetKey(entry) && entry.key == DB_ADDRESS) {
+            FreezeDetails details;
+            if (it->GetValue(details) && details.frozen)
+                setFrozenScripts.insert(entry.script);
+        } else {
+            break;
+        }
+    }
 
-    unsigned int number;
-    Read(DB_NUMBER_FROZEN, number);
+    for (it->Seek(AuthorityEntry(DUMMY_SCRIPT)); it->Valid(); it->Next()) {
+        AuthorityEntry entry;
+        if (it->GetKey(entry) && entry.key == DB_AUTORIZATION) {
+            AuthorityDetails details;
+            if (it->GetValue(details) && details.authorized)
+                setAuthorizedScripts.insert(entry.script);
+        } else {
+            break;
+        }
+    }
 
-    if (Read(entry, details)) {
-        if (!details.frozen) {
-            LogPrintf("Governance: Adding script %s back to freeze list\n", HexStr(script));
+    for (it->Seek(CostEntry()); it->Valid(); it->Next()) {
+        CostEntry entry;
+        if (it->GetKey(entry) && entry.key == DB_COST) {
+            CostDetails details;
+            if (it->GetValue(details))
+                mapCostHistory[entry.type][entry.height] = details.cost;
+        } else {
+            break;
+        }
+    }
 
-            details.frozen = true;
-            batch.Write(entry, details);
-            batch.Write(DB_NUMBER_FROZEN, number + 1);
+    for (it->Seek(FeeEntry()); it->Valid(); it->Next()) {
+        FeeEntry entry;
+        if (it->GetKey(entry) && entry.key == DB_FEE_ADDRESS) {
+            FeeDetails details;
+            if (it->GetValue(details))
+                mapFeeScriptHistory[entry.height] = details.script;
         } else {
-            LogPrintf("Governance: Script %s already frozen\n", HexStr(script));
-            batch.Write(entry, details);
+            break;
         }
-    } else {
-        LogPrintf("Governance: Freezing previously unknown script %s\n", HexStr(script));
+    }
+
+    LogPrintf("Governance: Loaded %u frozen and %u authorized scripts\n", setFrozenScripts.size(), setAuthorizedScripts.size());
+}
 
-        batch.Write(entry, FreezeDetails());
-        batch.Write(DB_NUMBER_FROZEN, number + 1);
+void CGovernance::UpdateMirror(std::unordered_set<CScript, SaltedScriptHasher>& setScripts, const CScript& script, bool fInSet) {
+    AssertLockHeld(cs_mirror);
+    bool fChanged = fInSet ? setScripts.insert(script).second : setScripts.erase(script) > 0;
+
+    if (fChanged && &setScripts == &setAuthorizedScripts) {
+        nValidatorGeneration++;
+        validatorSet.reset();
     }
+}
 
-    return WriteBatch(batch);
+bool CGovernanceChanges::IsEmpty() const {
+    return mapFreezeEntries.empty() && mapAuthorityEntries.empty() && mapCostEntries.empty() && mapFeeEntries.empty() && mapEventEntries.empty() && nFrozenChange == 0 && nAuthorizedChange == 0;
 }
 
-bool CGovernance::UnfreezeScript(CScript script) {
-    FreezeEntry entry(script);
-    FreezeDetails details = FreezeDetails();
-    CDBBatch batch(*this);
+void CGovernanceChanges::Clear() {
+    mapFreezeEntries.clear();
+    mapAuthorityEntries.clear();
+    mapCostEntries.clear();
+    mapFeeEntries.clear();
+    mapEventEntries.clear();
+    nFrozenChange = 0;
+    nAuthorizedChange = 0;
+}
 
-    unsigned int number;
-    Read(DB_NUMBER_FROZEN, number);
+void CGovernance::ApplyChanges(const CGovernanceChanges& changes) {
+    LOCK(cs_mirror);
 
-    if (Read(entry, details)) {
-        if (details.frozen) {
-            LogPrintf("Governance: Removing script %s from freeze list\n", HexStr(script));
+    for (const auto& item : changes.mapFreezeEntries) {
+        dirty.mapFreezeEntries[item.first] = item.second;
+        UpdateMirror(setFrozenScripts, item.first, item.second);
+    }
 
-            details.frozen = false;
-            batch.Write(entry, details);
-            batch.Write(DB_NUMBER_FROZEN, number - 1);
-        } else {
-            LogPrintf("Governance: Script %s already unfrozen\n", HexStr(script));
-            batch.Write(entry, details);
-        }
-    } else {
-        LogPrintf("Governance: Unfreezing previously unknown script %s\n", HexStr(script));
-        batch.Write(entry, FreezeDetails(false));
+    for (const auto& item : changes.mapAuthorityEntries) {
+        dirty.mapAuthorityEntries[item.first] = item.second;
+        UpdateMirror(setAuthorizedScripts, item.first, item.second);
     }
 
-    return WriteBatch(batch);
+    for (const auto& item : changes.mapCostEntries) {
+        dirty.mapCostEntries[item.first] = item.second;
+        if (item.second.first)
+            mapCostHistory[item.first.first][item.first.second] = item.second.second;
+        else
+            mapCostHistory[item.first.first].erase(item.first.second);
+    }
+
+    for (const auto& item : changes.mapFeeEntries) {
+        dirty.mapFeeEntries[item.first] = item.second;
+        if (item.second.first)
+            mapFeeScriptHistory[item.first] = item.second.second;
+        else
+            mapFeeScriptHistory.erase(item.first);
+    }
+
+    for (const auto& item : changes.mapEventEntries) {
+        dirty.mapEventEntries.erase(item.first);
+        dirty.mapEventEntries.emplace(item.first, item.second);
+    }
+
+    if (!changes.mapCostEntries.empty() || !changes.mapFeeEntries.empty()) {
+        nCostGeneration++;
+        costTable.reset();
+    }
+
+    nFrozenScripts += changes.nFrozenChange;
+    nAuthorizedScripts += changes.nAuthorizedChange;
+    dirty.nFrozenChange += changes.nFrozenChange;
+    dirty.nAuthorizedChange += changes.nAuthorizedChange;
 }
 
-bool CGovernance::RevertFreezeScript(CScript script) {
-    // This is different from unfreezing
-    // Reverting immediately removes script from the freeze list,
-    // This routine only does so if scrip was only added to the list once
+bool CGovernance::Flush() {
+    LOCK(cs_mirror);
+    if (dirty.IsEmpty())
+        return true;
 
-    FreezeEntry entry(script);
-    FreezeDetails details = FreezeDetails();
     CDBBatch batch(*this);
+    for (const auto& item : dirty.mapFreezeEntries)
+        batch.Write(FreezeEntry(item.first), FreezeDetails(item.second));
+
+    for (const auto& item : dirty.mapAuthorityEntries)
+        batch.Write(AuthorityEntry(item.first), AuthorityDetails(item.second));
+
+    for (const auto& item : dirty.mapCostEntries) {
+        CostEntry entry(item.first.first, item.first.second);
+        if (item.second.first)
+            batch.Write(entry, CostDetails(item.second.second));
+        else
+            batch.Erase(entry);
+    }
 
-    unsigned int number;
-    Read(DB_NUMBER_FROZEN, number);
+    for (const auto& item : dirty.mapFeeEntries) {
+        FeeEntry entry(item.first);
+        if (item.second.first)
+            batch.Write(entry, FeeDetails(item.second.second));
+        else
+            batch.Erase(entry);
+    }
 
-    if (Read(entry, details)) {
-        if (details.frozen) {
-            LogPrintf("Governance: Revert adding of script %s to freeze list\n", HexStr(script));
+    for (const auto& item : dirty.mapEventEntries) {
+        EventEntry entry(item.first);
+        if (item.second)
+            batch.Write(entry, EventDetails(item.first.nCost));
+        else
+            batch.Erase(entry);
+    }
 
-            LogPrintf("Governance: Unfreezing script %s\n", HexStr(script));
-            details.frozen = false;
-            batch.Write(DB_NUMBER_FROZEN, number - 1);
+    if (dirty.nFrozenChange != 0)
+        batch.Write(DB_NUMBER_FROZEN, nFrozenScripts);
+    if (dirty.nAuthorizedChange != 0)
+        batch.Write(DB_NUMBER_AUTHORIZED, nAuthorizedScripts);
 
-            batch.Write(entry, details);
-        } else {
-            LogPrintf("Trying to revert freezing of script, database is corrupted\n");
-            return false;
-        }
-    } else {
-        LogPrintf("Trying to revert freezing of unknown script, database is corrupted\n");
-        return false;
-    }
+    // Made durable by the sync pass of the database environment, see FlushStateToDisk
+    if (!WriteBatch(batch))
+        return error("%s: Failed to write governance changes", __func__);
 
-    return WriteBatch(batch);
+    dirty.Clear();
+    return true;
 }
 
-bool CGovernance::RevertUnfreezeScript(CScript script) {
-    // This is different from freezing
-    // Reverting immediately adds script to the freeze list,
-    // This routine only does so if script was only removed from the list once
+bool CGovernance::ReadFreezeEntry(const CScript& script, bool& fFrozen) {
+    LOCK(cs_mirror);
 
-    FreezeEntry entry(script);
-    FreezeDetails details = FreezeDetails();
-    CDBBatch batch(*this);
+    auto it = dirty.mapFreezeEntries.find(script);
+    if (it != dirty.mapFreezeEntries.end()) {
+        fFrozen = it->second;
+        return true;
+    }
 
-    unsigned int number;
-    Read(DB_NUMBER_FROZEN, number);
+    FreezeDetails details;
+    if (!Read(FreezeEntry(script), details))
+        return false;
+    fFrozen = details.frozen;
+    return true;
+}
 
-    if (Read(entry, details)) {
-        if (!details.frozen) {
-            LogPrintf("Governance: Revert disabling of script %s\n", HexStr(script));
+bool CGovernance::ReadAuthorityEntry(const CScript& script, bool& fAuthorized) {
+    LOCK(cs_mirror);
 
-            LogPrintf("Governance: Freezing script %s\n", HexStr(script));
-            details.frozen = true;
-            batch.Write(DB_NUMBER_FROZEN, number + 1);
+    auto it = dirty.mapAuthorityEntries.find(script);
+    if (it != dirty.mapAuthorityEntries.end()) {
+        fAuthorized = it->second;
+        return true;
+    }
 
-            batch.Write(entry, details);
-        } else {
-            LogPrintf("Trying to revert unfreezing of script, database is corrupted\n");
-            return false;
-        }
-    } else {
-        LogPrintf("Governance: Trying to revert unfreezing of unknown script, database is corrupted\n");
+    AuthorityDetails details;
+    if (!Read(AuthorityEntry(script), details))
         return false;
-    }
+    fAuthorized = details.authorized;
+    return true;
+}
 
-    return WriteBatch(batch);
+bool CGovernance::ReadCostEntry(int type, int height, CAmount& cost) {
+    LOCK(cs_mirror);
+
+    // The history mirrors every cost entry, flushed or not
+    auto history = mapCostHistory.find(type);
+    if (history == mapCostHistory.end())
+        return false;
+    auto it = history->second.find(height);
+    if (it == history->second.end())
+        return false;
+    cost = it->second;
+    return true;
 }
 
-bool CGovernance::ScriptExist(CScript script) {
-    return Exists(FreezeEntry(script));
+bool CGovernance::ReadFeeEntry(int height, CScript& script) {
+    LOCK(cs_mirror);
+
+    auto it = mapFeeScriptHistory.find(height);
+    if (it == mapFeeScriptHistory.end())
+        return false;
+    script = it->second;
+    return true;
 }
 
-bool CGovernance::CanSend(CScript script) {
-    FreezeEntry entry(script);
-    FreezeDetails details = FreezeDetails();
+unsigned int CGovernance::GetNumberOfFrozenScripts() {
+    LOCK(cs_mirror);
+    return nFrozenScripts;
+}
 
-    if (!Exists(entry)) {
-        return true;
-    }
+bool CGovernance::ScriptExist(const CScript& script) {
+    bool fFrozen;
+    return ReadFreezeEntry(script, fFrozen);
+}
 
-    Read(entry, details);
-    return !details.frozen;
+bool CGovernance::CanSend(const CScript& script) {
+    LOCK(cs_mirror);
+    return !setFrozenScripts.count(script);
 }
 
 bool CGovernance::DumpFreezeStats(std::vector< std::pair< CScript, bool > > *FreezeVector) {
     if (IsEmpty())
         LogPrintf("Governance: DB is empty\n");
 
+    LOCK(cs_mirror);
+    std::set<CScript> setSeen;
+
     std::unique_ptr<CDBIterator> it(NewIterator());
     for (it->Seek(FreezeEntry(DUMMY_SCRIPT)); it->Valid(); it->Next()) { // DUMMY_SCRIPT is the lexically first script.
         FreezeEntry entry;
@@ -387,246 +564,410 @@ bool CGovernance::DumpFreezeStats(std::vector< std::pair< CScript, bool > > *Fre
             FreezeDetails details;
             it->GetValue(details);
 
+            // Changes not flushed yet take precedence over the database
+            auto dirtyEntry = dirty.mapFreezeEntries.find(entry.script);
+            if (dirtyEntry != dirty.mapFreezeEntries.end()) {
+                details.frozen = dirtyEntry->second;
+                setSeen.insert(entry.script);
+            }
+
             FreezeVector->emplace_back(entry.script, details.frozen);
         } else {
             break; // we are done with the scripts.
         }
     }
 
+    for (const auto& item : dirty.mapFreezeEntries) {
+        if (!setSeen.count(item.first))
+            FreezeVector->emplace_back(item.first, item.second);
+    }
+
     return true;
 }
 
-bool CGovernance::GetFrozenScripts(std::vector< CScript > *FreezeVector) {
+bool CGovernance::ForEachEvent(const CGovernanceEvent* pAfter, int nEndHeight, const std::function<bool(const CGovernanceEvent&)>& fn) {
+    LOCK(cs_mirror);
+
+    // Merge the database with the changes not flushed yet, which take precedence
+    auto dirtyIt = pAfter ? dirty.mapEventEntries.upper_bound(*pAfter) : dirty.mapEventEntries.begin();
     std::unique_ptr<CDBIterator> it(NewIterator());
-    for (it->Seek(FreezeEntry(DUMMY_SCRIPT)); it->Valid(); it->Next()) {
-        FreezeEntry entry;
-        if (it->GetKey(entry) && entry.key == DB_ADDRESS) {
-            FreezeDetails details;
-            it->GetValue(details);
+    it->Seek(EventEntry(pAfter ? *pAfter : CGovernanceEvent()));
 
-            if (details.frozen)
-                FreezeVector->emplace_back(entry.script);
-        } else { 
+    EventEntry entry;
+    auto fnValid = [&]() {
+        return it->Valid() && it->GetKey(entry) && entry.key == DB_EVENT && entry.event.nHeight <= nEndHeight;
+    };
+    if (pAfter && fnValid() && !(*pAfter < entry.event))
+        it->Next();
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        bool fDatabase = fnValid();
+        bool fDirty = dirtyIt != dirty.mapEventEntries.end() && dirtyIt->first.nHeight <= nEndHeight;
+        if (!fDatabase && !fDirty)
             break;
+
+        CGovernanceEvent event;
+        if (fDirty && (!fDatabase || !(entry.event < dirtyIt->first))) {
+            // Replaces the database entry of the same event, if any
+            if (fDatabase && !(dirtyIt->first < entry.event))
+                it->Next();
+            bool fWritten = dirtyIt->second;
+            event = dirtyIt->first;
+            ++dirtyIt;
+            if (!fWritten)
+                continue;
+        } else {
+            EventDetails details;
+            if (!it->GetValue(details))
+                return error("%s: failed to read governance event at height %d", __func__, entry.event.nHeight);
+            event = entry.event;
+            event.nCost = details.cost;
+            it->Next();
         }
-    } 
+
+        if (!fn(event))
+            break;
+    }
 
     return true;
 }
 
-CAmount CGovernance::GetCost(int type) {
-    CostDetails details = CostDetails();
-    int height = -1;
-
-    std::unique_ptr<CDBIterator> it(NewIterator());
-    for (it->Seek(CostEntry()); it->Valid(); it->Next()) {
-        CostEntry entry;
-        if (it->GetKey(entry) && entry.key == DB_COST) {
-            if (entry.type == type && entry.height > height) {
-                height = entry.height;
-                it->GetValue(details);
-            }
-        } else {
-            break;
+bool CGovernance::GetStateAtHeight(int nHeight, CGovernanceState& state) {
+    return ForEachEvent(nullptr, nHeight, [&state](const CGovernanceEvent& event) {
+        switch (event.nType) {
+            case GOVERNANCE_FREEZE: state.setFrozen.insert(event.script); break;
+            case GOVERNANCE_UNFREEZE: state.setFrozen.erase(event.script); break;
+            case GOVERNANCE_AUTHORIZATION: state.setAuthorized.insert(event.script); break;
+            case GOVERNANCE_UNAUTHORIZATION: state.setAuthorized.erase(event.script); break;
+            case GOVERNANCE_COST: state.mapCosts[event.nCostType] = std::make_pair(event.nCost, event.nHeight); break;
+            case GOVERNANCE_FEE:
+                state.feeScript = event.script;
+                state.nFeeHeight = event.nHeight;
+                break;
         }
-    }
+        return true;
+    });
+}
 
-    return details.cost;
+bool CGovernance::IsEventLogComplete() {
+    LOCK(cs_mirror);
+    return fEventLogComplete;
 }
 
-bool CGovernance::UpdateCost(CAmount cost, int type, int height) {
-    CostEntry entry(type, height);
-    CostDetails details = CostDetails();
-    CDBBatch batch(*this);
-    std::string type_name;
+bool CGovernance::GetFrozenScripts(std::vector< CScript > *FreezeVector) {
+    std::vector< std::pair< CScript, bool > > vEntries;
+    DumpFreezeStats(&vEntries);
 
-    if (type == GOVERNANCE_COST_ROOT) {
-        type_name = "root";
-    } else if (type == GOVERNANCE_COST_REISSUE) {
-        type_name = "reissue";
-    } else if (type == GOVERNANCE_COST_UNIQUE) {
-        type_name = "unique";
-    } else if (type == GOVERNANCE_COST_SUB) {
-        type_name = "sub";
-    } else if (type == GOVERNANCE_COST_USERNAME) {
-        type_name = "username";
-    } else {
-        LogPrintf("Governance: Trying to update issuance cost for unknow type\n");
-        return false;
+    for (const auto& entry : vEntries) {
+        if (entry.second)
+            FreezeVector->emplace_back(entry.first);
     }
 
-    if (!Read(entry, details)) {
-        LogPrintf("Governance: Updating issuance cost for \"%s\" to %s AOK\n", type_name, ValueFromAmountString(cost, 8));
-        batch.Write(entry, CostDetails(cost));
+    return true;
+}
+
+CAmount CGovernance::GetCost(int type, int* pHeight) {
+    LOCK(cs_mirror);
+
+    auto history = mapCostHistory.find(type);
+    if (history == mapCostHistory.end() || history->second.empty()) {
+        if (pHeight)
+            *pHeight = -1;
+        return CostDetails().cost;
     }
 
-    return WriteBatch(batch);
+    // The latest update is in force
+    if (pHeight)
+        *pHeight = history->second.rbegin()->first;
+    return history->second.rbegin()->second;
 }
 
-bool CGovernance::RevertUpdateCost(int type, int height) {
-    CostEntry entry(type, height);
-    CostDetails details = CostDetails();
-    CDBBatch batch(*this);
+CScript CGovernance::GetFeeScript(int* pHeight) {
+    LOCK(cs_mirror);
 
-    std::string type_name;
+    if (mapFeeScriptHistory.empty()) {
+        if (pHeight)
+            *pHeight = -1;
+        return FeeDetails().script;
+    }
 
-    if (type == GOVERNANCE_COST_ROOT) {
-        type_name = "root";
-    } else if (type == GOVERNANCE_COST_REISSUE) {
-        type_name = "reissue";
-    } else if (type == GOVERNANCE_COST_UNIQUE) {
-        type_name = "unique";
-    } else if (type == GOVERNANCE_COST_SUB) {
-        type_name = "sub";
-    } else if (type == GOVERNANCE_COST_USERNAME) {
-        type_name = "username";
+    // The latest update is in force
+    if (pHeight)
+        *pHeight = mapFeeScriptHistory.rbegin()->first;
+    return mapFeeScriptHistory.rbegin()->second;
+}
+
+CCostTableRef CGovernance::GetCostTable() {
+    LOCK(cs_mirror);
+
+    // Like the validator set, built once per generation
+    if (!costTable) {
+        std::shared_ptr<CCostTable> table = std::make_shared<CCostTable>();
+        table->nGeneration = nCostGeneration;
+        for (const auto& history : mapCostHistory) {
+            if (!history.second.empty())
+                table->mapCosts[history.first] = std::make_pair(history.second.rbegin()->second, history.second.rbegin()->first);
+        }
+        if (mapFeeScriptHistory.empty()) {
+            table->feeScript = FeeDetails().script;
+        } else {
+            table->feeScript = mapFeeScriptHistory.rbegin()->second;
+            table->nFeeHeight = mapFeeScriptHistory.rbegin()->first;
+        }
+        costTable = table;
     }
 
-    if (Read(entry, details)) {
-        LogPrintf("Governance: Revert updating issuance cost for \"%s\" to %s AOK\n", type_name, ValueFromAmountString(details.cost, 8));
-        batch.Erase(entry);
-    } else {
-        LogPrintf("Governance: Trying to revert unknown issuance cost update, database is corrupted\n");
-        return false;
+    return costTable;
+}
+
+CAmount CCostTable::GetCost(int type, int* pHeight) const {
+    auto it = mapCosts.find(type);
+    if (pHeight)
+        *pHeight = it == mapCosts.end() ? -1 : it->second.second;
+    return it == mapCosts.end() ? CostDetails().cost : it->second.first;
+}
+
+const CScript& CCostTable::GetFeeScript(int* pHeight) const {
+    if (pHeight)
+        *pHeight = nFeeHeight;
+    return feeScript;
+}
+
+unsigned int CGovernance::GetNumberOfAuthorizedScripts() {
+    LOCK(cs_mirror);
+    return nAuthorizedScripts;
+}
+
+bool CGovernance::AuthorityExist(const CScript& script) {
+    bool fAuthorized;
+    return ReadAuthorityEntry(script, fAuthorized);
+}
+
+bool CGovernance::CanStake(const CScript& script) {
+    TRACE_SPAN("CGovernance::CanStake");
+    // Handle pay-to-public-key outputs properly
+    if (script.IsPayToPublicKey()) {
+        uint160 hashBytes(Hash160(script.begin() + 1, script.end() - 1));
+        const CScript scriptKeyHash = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hashBytes) << OP_EQUALVERIFY << OP_CHECKSIG;
+        LOCK(cs_mirror);
+        return setAuthorizedScripts.count(scriptKeyHash) > 0;
     }
 
-    return WriteBatch(batch);
+    LOCK(cs_mirror);
+    return setAuthorizedScripts.count(script) > 0;
+}
+
+CValidatorSetRef CGovernance::GetValidatorSet() {
+    LOCK(cs_mirror);
+
+    // Build the snapshot once per generation, every holder shares it until the next change
+    if (!validatorSet)
+        validatorSet = std::make_shared<CValidatorSet>(nValidatorGeneration, setAuthorizedScripts);
+
+    return validatorSet;
 }
 
-CScript CGovernance::GetFeeScript() {
-    FeeDetails details = FeeDetails();
-    int height = -1;
+bool CGovernance::GetActiveValidators(std::vector< CScript > *ValidatorsVector) {
+    if (IsEmpty())
+        LogPrintf("Governance: DB is empty\n");
+
+    LOCK(cs_mirror);
+    std::set<CScript> setSeen;
 
     std::unique_ptr<CDBIterator> it(NewIterator());
-    for (it->Seek(FeeEntry()); it->Valid(); it->Next()) {
-        FeeEntry entry;
-        if (it->GetKey(entry) && entry.key == DB_FEE_ADDRESS) {
-            if (entry.height > height) {
-                height = entry.height;
-                it->GetValue(details);
+    for (it->Seek(AuthorityEntry(DUMMY_SCRIPT)); it->Valid(); it->Next()) {
+        AuthorityEntry entry;
+        if (it->GetKey(entry) && entry.key == DB_AUTORIZATION) {
+            AuthorityDetails details;
+            it->GetValue(details);
+
+            // Changes not flushed yet take precedence over the database
+            auto dirtyEntry = dirty.mapAuthorityEntries.find(entry.script);
+            if (dirtyEntry != dirty.mapAuthorityEntries.end()) {
+                details.authorized = dirtyEntry->second;
+                setSeen.insert(entry.script);
             }
+
+            if (details.authorized)
+                ValidatorsVector->emplace_back(entry.script);
         } else {
-            break;
+            break; // we are done with the scripts.
         }
     }
 
-    return details.script;
+    for (const auto& item : dirty.mapAuthorityEntries) {
+        if (item.second && !setSeen.count(item.first))
+            ValidatorsVector->emplace_back(item.first);
+    }
+
+    return true;
 }
 
-bool CGovernance::UpdateFeeScript(CScript script, int height) {
-    FeeEntry entry(height);
-    FeeDetails details = FeeDetails();
-    CDBBatch batch(*this);
+bool CGovernanceCache::ReadFreezeEntry(const CScript& script, bool& fFrozen) {
+    auto it = changes.mapFreezeEntries.find(script);
+    if (it != changes.mapFreezeEntries.end()) {
+        fFrozen = it->second;
+        return true;
+    }
+
+    return base && base->ReadFreezeEntry(script, fFrozen);
+}
 
-    if (!Read(entry, details)) {
-        LogPrintf("Governance: Updating fee script to %s\n", HexStr(script));
-        batch.Write(entry, FeeDetails(script));
+bool CGovernanceCache::ReadAuthorityEntry(const CScript& script, bool& fAuthorized) {
+    auto it = changes.mapAuthorityEntries.find(script);
+    if (it != changes.mapAuthorityEntries.end()) {
+        fAuthorized = it->second;
+        return true;
     }
 
-    return WriteBatch(batch);
+    return base && base->ReadAuthorityEntry(script, fAuthorized);
 }
 
-bool CGovernance::RevertUpdateFeeScript(int height) {
-    FeeEntry entry(height);
-    FeeDetails details = FeeDetails();
-    CDBBatch batch(*this);
+bool CGovernanceCache::FreezeScript(const CScript& script, int height) {
+    bool fFrozen;
 
-    if (Read(entry, details)) {
-        LogPrintf("Governance: Revert updating fee script to %s\n", HexStr(details.script));
-        batch.Erase(entry);
+    if (ReadFreezeEntry(script, fFrozen)) {
+        if (!fFrozen) {
+            LogPrintf("Governance: Adding script %s back to freeze list\n", HexStr(script));
+            changes.nFrozenChange++;
+        } else {
+            LogPrintf("Governance: Script %s already frozen\n", HexStr(script));
+        }
     } else {
-        LogPrintf("Governance: Trying to revert unknown fee script update, database is corrupted\n");
-        return false;
+        LogPrintf("Governance: Freezing previously unknown script %s\n", HexStr(script));
+        changes.nFrozenChange++;
     }
 
-    return WriteBatch(batch);
+    changes.mapFreezeEntries[script] = true;
+    changes.mapEventEntries[CGovernanceEvent(height, GOVERNANCE_FREEZE, script)] = true;
+    return true;
 }
 
-unsigned int CGovernance::GetNumberOfAuthorizedScripts() {
-    unsigned int number;
+bool CGovernanceCache::UnfreezeScript(const CScript& script, int height) {
+    bool fFrozen;
 
-    Read(DB_NUMBER_AUTHORIZED, number);
+    if (ReadFreezeEntry(script, fFrozen)) {
+        if (fFrozen) {
+            LogPrintf("Governance: Removing script %s from freeze list\n", HexStr(script));
+            changes.nFrozenChange--;
+        } else {
+            LogPrintf("Governance: Script %s already unfrozen\n", HexStr(script));
+        }
+    } else {
+        LogPrintf("Governance: Unfreezing previously unknown script %s\n", HexStr(script));
+    }
 
-    return number;
+    changes.mapFreezeEntries[script] = false;
+    changes.mapEventEntries[CGovernanceEvent(height, GOVERNANCE_UNFREEZE, script)] = true;
+    return true;
 }
 
-bool CGovernance::AuthorizeScript(CScript script) {
-    AuthorityEntry entry(script);
-    AuthorityDetails details = AuthorityDetails();
-    CDBBatch batch(*this);
+bool CGovernanceCache::RevertFreezeScript(const CScript& script) {
+    // This is different from unfreezing
+    // Reverting immediately removes script from the freeze list,
+    // This routine only does so if scrip was only added to the list once
 
-    unsigned int number;
-    Read(DB_NUMBER_AUTHORIZED, number);
+    bool fFrozen;
 
-    if (Read(entry, details)) {
-        if (!details.authorized) {
-            LogPrintf("Governance: Adding script %s back to authorized list\n", HexStr(script));
+    if (ReadFreezeEntry(script, fFrozen)) {
+        if (fFrozen) {
+            LogPrintf("Governance: Revert adding of script %s to freeze list\n", HexStr(script));
 
-            details.authorized = true;
-            batch.Write(entry, details);
-            batch.Write(DB_NUMBER_AUTHORIZED, number + 1);
+            LogPrintf("Governance: Unfreezing script %s\n", HexStr(script));
+            changes.nFrozenChange--;
+            changes.mapFreezeEntries[script] = false;
         } else {
-            LogPrintf("Governance: Script %s already authorized\n", HexStr(script));
-            batch.Write(entry, details);
+            LogPrintf("Trying to revert freezing of script, database is corrupted\n");
+            return false;
         }
     } else {
-        LogPrintf("Governance: Authorizing previously unknown script %s\n", HexStr(script));
+        LogPrintf("Trying to revert freezing of unknown script, database is corrupted\n");
+        return false;
+    }
 
-        batch.Write(entry, AuthorityDetails());
-        batch.Write(DB_NUMBER_AUTHORIZED, number + 1);
+    return true;
+}
+
+bool CGovernanceCache::RevertUnfreezeScript(const CScript& script) {
+    // This is different from freezing
+    // Reverting immediately adds script to the freeze list,
+    // This routine only does so if script was only removed from the list once
+
+    bool fFrozen;
+
+    if (ReadFreezeEntry(script, fFrozen)) {
+        if (!fFrozen) {
+            LogPrintf("Governance: Revert disabling of script %s\n", HexStr(script));
+
+            LogPrintf("Governance: Freezing script %s\n", HexStr(script));
+            changes.nFrozenChange++;
+            changes.mapFreezeEntries[script] = true;
+        } else {
+            LogPrintf("Trying to revert unfreezing of script, database is corrupted\n");
+            return false;
+        }
+    } else {
+        LogPrintf("Governance: Trying to revert unfreezing of unknown script, database is corrupted\n");
+        return false;
     }
 
-    return WriteBatch(batch);
+    return true;
 }
 
-bool CGovernance::UnauthorizeScript(CScript script) {
-    AuthorityEntry entry(script);
-    AuthorityDetails details = AuthorityDetails();
-    CDBBatch batch(*this);
+bool CGovernanceCache::AuthorizeScript(const CScript& script, int height) {
+    bool fAuthorized;
 
-    unsigned int number;
-    Read(DB_NUMBER_AUTHORIZED, number);
+    if (ReadAuthorityEntry(script, fAuthorized)) {
+        if (!fAuthorized) {
+            LogPrintf("Governance: Adding script %s back to authorized list\n", HexStr(script));
+            changes.nAuthorizedChange++;
+        } else {
+            LogPrintf("Governance: Script %s already authorized\n", HexStr(script));
+        }
+    } else {
+        LogPrintf("Governance: Authorizing previously unknown script %s\n", HexStr(script));
+        changes.nAuthorizedChange++;
+    }
 
-    if (Read(entry, details)) {
-        if (details.authorized) {
-            LogPrintf("Governance: Removing script %s from authorization list\n", HexStr(script));
+    changes.mapAuthorityEntries[script] = true;
+    changes.mapEventEntries[CGovernanceEvent(height, GOVERNANCE_AUTHORIZATION, script)] = true;
+    return true;
+}
+
+bool CGovernanceCache::UnauthorizeScript(const CScript& script, int height) {
+    bool fAuthorized;
 
-            details.authorized = false;
-            batch.Write(entry, details);
-            batch.Write(DB_NUMBER_AUTHORIZED, number - 1);
+    if (ReadAuthorityEntry(script, fAuthorized)) {
+        if (fAuthorized) {
+            LogPrintf("Governance: Removing script %s from authorization list\n", HexStr(script));
+            changes.nAuthorizedChange--;
         } else {
             LogPrintf("Governance: Script %s already unauthorized\n", HexStr(script));
-            batch.Write(entry, details);
         }
     } else {
         LogPrintf("Governance: Unauthorizing previously unknown script %s\n", HexStr(script));
-        batch.Write(entry, AuthorityDetails(false));
     }
 
-    return WriteBatch(batch);
+    changes.mapAuthorityEntries[script] = false;
+    changes.mapEventEntries[CGovernanceEvent(height, GOVERNANCE_UNAUTHORIZATION, script)] = true;
+    return true;
 }
 
-bool CGovernance::RevertAuthorizeScript(CScript script) {
+bool CGovernanceCache::RevertAuthorizeScript(const CScript& script) {
     // This is different from unauthorizing
     // Reverting immediately removes script from the authorization list,
     // This routine only does so if script was only added to the list once
 
-    AuthorityEntry entry(script);
-    AuthorityDetails details = AuthorityDetails();
-    CDBBatch batch(*this);
-
-    unsigned int number;
-    Read(DB_NUMBER_AUTHORIZED, number);
+    bool fAuthorized;
 
-    if (Read(entry, details)) {
-        if (details.authorized) {
+    if (ReadAuthorityEntry(script, fAuthorized)) {
+        if (fAuthorized) {
             LogPrintf("Governance: Revert adding of script %s to authorized list\n", HexStr(script));
 
             LogPrintf("Governance: Unauthorizing script %s\n", HexStr(script));
-            details.authorized = false;
-            batch.Write(DB_NUMBER_AUTHORIZED, number - 1);
-
-            batch.Write(entry, details);
+            changes.nAuthorizedChange--;
+            changes.mapAuthorityEntries[script] = false;
         } else {
             LogPrintf("Trying to revert authorization of script, database is corrupted\n");
             return false;
@@ -636,30 +977,23 @@ bool CGovernance::RevertAuthorizeScript(CScript script) {
         return false;
     }
 
-    return WriteBatch(batch);
+    return true;
 }
 
-bool CGovernance::RevertUnauthorizeScript(CScript script) {
+bool CGovernanceCache::RevertUnauthorizeScript(const CScript& script) {
     // This is different from authorizing
     // Reverting immediately adds script to the authorize list,
     // This routine only does so if script was only removed from the list once
 
-    AuthorityEntry entry(script);
-    AuthorityDetails details = AuthorityDetails();
-    CDBBatch batch(*this);
-
-    unsigned int number;
-    Read(DB_NUMBER_AUTHORIZED, number);
+    bool fAuthorized;
 
-    if (Read(entry, details)) {
-        if (!details.authorized) {
+    if (ReadAuthorityEntry(script, fAuthorized)) {
+        if (!fAuthorized) {
             LogPrintf("Governance: Revert unauthorization of script %s\n", HexStr(script));
 
             LogPrintf("Governance: Authorizing script %s\n", HexStr(script));
-            details.authorized = true;
-            batch.Write(DB_NUMBER_AUTHORIZED, number + 1);
-
-            batch.Write(entry, details);
+            changes.nAuthorizedChange++;
+            changes.mapAuthorityEntries[script] = true;
         } else {
             LogPrintf("Trying to revert unauthorization of script, database is corrupted\n");
             return false;
@@ -669,48 +1003,133 @@ bool CGovernance::RevertUnauthorizeScript(CScript script) {
         return false;
     }
 
-    return WriteBatch(batch);
+    return true;
 }
 
-bool CGovernance::AuthorityExist(CScript script) {
-    return Exists(AuthorityEntry(script));
+static std::string GetCostTypeName(int type) {
+    if (type == GOVERNANCE_COST_ROOT) {
+        return "root";
+    } else if (type == GOVERNANCE_COST_REISSUE) {
+        return "reissue";
+    } else if (type == GOVERNANCE_COST_UNIQUE) {
+        return "unique";
+    } else if (type == GOVERNANCE_COST_SUB) {
+        return "sub";
+    } else if (type == GOVERNANCE_COST_USERNAME) {
+        return "username";
+    }
+    return "";
 }
 
-bool CGovernance::CanStake(CScript script) {
-    // Handle pay-to-public-key outputs properly
-    if (script.IsPayToPublicKey()) {
-        uint160 hashBytes(Hash160(script.begin() + 1, script.end() - 1));
-        script = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hashBytes) << OP_EQUALVERIFY << OP_CHECKSIG;
+bool CGovernanceCache::UpdateCost(CAmount cost, int type, int height) {
+    std::string type_name = GetCostTypeName(type);
+    if (type_name.empty()) {
+        LogPrintf("Governance: Trying to update issuance cost for unknow type\n");
+        return false;
     }
 
-    AuthorityEntry entry(script);
-    AuthorityDetails details = AuthorityDetails();
+    // An update already recorded at this height stays in force
+    auto it = changes.mapCostEntries.find(std::make_pair(type, height));
+    CAmount existing;
+    if (it != changes.mapCostEntries.end() ? it->second.first : (base && base->ReadCostEntry(type, height, existing)))
+        return true;
+
+    LogPrintf("Governance: Updating issuance cost for \"%s\" to %s AOK\n", type_name, ValueFromAmountString(cost, 8));
+    changes.mapCostEntries[std::make_pair(type, height)] = std::make_pair(true, cost);
+    CGovernanceEvent event(height, GOVERNANCE_COST, CScript(), type, cost);
+    changes.mapEventEntries.erase(event);
+    changes.mapEventEntries.emplace(event, true);
+    return true;
+}
+
+bool CGovernanceCache::RevertUpdateCost(int type, int height) {
+    std::string type_name = GetCostTypeName(type);
+
+    auto it = changes.mapCostEntries.find(std::make_pair(type, height));
+    CAmount cost;
+    bool fFound = false;
+    if (it != changes.mapCostEntries.end()) {
+        fFound = it->second.first;
+        cost = it->second.second;
+    } else {
+        fFound = base && base->ReadCostEntry(type, height, cost);
+    }
 
-    if (!Exists(entry)) {
+    if (fFound) {
+        LogPrintf("Governance: Revert updating issuance cost for \"%s\" to %s AOK\n", type_name, ValueFromAmountString(cost, 8));
+        changes.mapCostEntries[std::make_pair(type, height)] = std::make_pair(false, CAmount(0));
+    } else {
+        LogPrintf("Governance: Trying to revert unknown issuance cost update, database is corrupted\n");
         return false;
     }
 
-    Read(entry, details);
-    return details.authorized;
+    return true;
 }
 
-bool CGovernance::GetActiveValidators(std::vector< CScript > *ValidatorsVector) {
-    if (IsEmpty())
-        LogPrintf("Governance: DB is empty\n");
+bool CGovernanceCache::UpdateFeeScript(const CScript& script, int height) {
+    // An update already recorded at this height stays in force
+    auto it = changes.mapFeeEntries.find(height);
+    CScript existing;
+    if (it != changes.mapFeeEntries.end() ? it->second.first : (base && base->ReadFeeEntry(height, existing)))
+        return true;
 
-    std::unique_ptr<CDBIterator> it(NewIterator());
-    for (it->Seek(AuthorityEntry(DUMMY_SCRIPT)); it->Valid(); it->Next()) {
-        AuthorityEntry entry;
-        if (it->GetKey(entry) && entry.key == DB_AUTORIZATION) {
-            AuthorityDetails details;
-            it->GetValue(details);
+    LogPrintf("Governance: Updating fee script to %s\n", HexStr(script));
+    changes.mapFeeEntries[height] = std::make_pair(true, script);
+    changes.mapEventEntries[CGovernanceEvent(height, GOVERNANCE_FEE, script)] = true;
+    return true;
+}
 
-            if (details.authorized)
-                ValidatorsVector->emplace_back(entry.script);
-        } else {
-            break; // we are done with the scripts.
-        }
+bool CGovernanceCache::RevertUpdateFeeScript(int height) {
+    auto it = changes.mapFeeEntries.find(height);
+    CScript script;
+    bool fFound = false;
+    if (it != changes.mapFeeEntries.end()) {
+        fFound = it->second.first;
+        script = it->second.second;
+    } else {
+        fFound = base && base->ReadFeeEntry(height, script);
+    }
+
+    if (fFound) {
+        LogPrintf("Governance: Revert updating fee script to %s\n", HexStr(script));
+        changes.mapFeeEntries[height] = std::make_pair(false, CScript());
+    } else {
+        LogPrintf("Governance: Trying to revert unknown fee script update, database is corrupted\n");
+        return false;
     }
 
     return true;
 }
+
+bool CGovernanceCache::RevertEvents(int height) {
+    // The events of the block in the log, and those this cache is still holding
+    std::vector<CGovernanceEvent> vEvents;
+    if (base) {
+        // No event has type 0, so every event of the block comes after it
+        CGovernanceEvent start(height, 0, CScript());
+        auto fnCollect = [&vEvents](const CGovernanceEvent& event) { vEvents.push_back(event); return true; };
+        if (!base->ForEachEvent(&start, height, fnCollect))
+            return false;
+    }
+    for (const auto& item : changes.mapEventEntries) {
+        if (item.first.nHeight == height)
+            vEvents.push_back(item.first);
+    }
+
+    for (const auto& event : vEvents)
+        changes.mapEventEntries[event] = false;
+    return true;
+}
+
+bool CGovernanceCache::Flush() {
+    TRACE_SPAN("CGovernanceCache::Flush");
+    if (changes.IsEmpty())
+        return true;
+
+    if (!base)
+        return error("%s: Couldn't find the governance database while trying to flush governance cache", __func__);
+
+    base->ApplyChanges(changes);
+    changes.Clear();
+    return true;
+}
@@ -9,6 +9,15 @@
 #include <chainparams.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <hash.h>
+#include <sync.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <unordered_set>
 
 #define GOVERNANCE_MARKER 71
 #define GOVERNANCE_ACTION 65
@@ -31,49 +40,241 @@
 #define GOVERNANCE_COST_NULL_QUALIFIER 9
 #define GOVERNANCE_COST_RESTRICTED 10
 
+class SaltedScriptHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher();
+
+    size_t operator()(const CScript& script) const {
+        return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
+/** Immutable snapshot of the authorized validator scripts. Every change to the authorization list publishes a new
+ *  snapshot with a higher generation, so holders can keep one by reference and compare generations to detect changes */
+class CValidatorSet
+{
+public:
+    uint64_t nGeneration;
+    std::unordered_set<CScript, SaltedScriptHasher> setScripts;
+
+    CValidatorSet() : nGeneration(0) {}
+    CValidatorSet(uint64_t nGenerationIn, const std::unordered_set<CScript, SaltedScriptHasher>& setScriptsIn) : nGeneration(nGenerationIn), setScripts(setScriptsIn) {}
+
+    bool Contains(const CScript& script) const { return setScripts.count(script) > 0; }
+    size_t Size() const { return setScripts.size(); }
+};
+
+typedef std::shared_ptr<const CValidatorSet> CValidatorSetRef;
+
+/** Immutable snapshot of the issuance costs and the fee script in force, with the height of the update that set each
+ *  (-1 for the default). Published the same way as CValidatorSet, a new generation for every cost or fee change */
+class CCostTable
+{
+public:
+    uint64_t nGeneration;
+    std::map<int, std::pair<CAmount, int> > mapCosts;
+    CScript feeScript;
+    int nFeeHeight;
+
+    CCostTable() : nGeneration(0), nFeeHeight(-1) {}
+
+    CAmount GetCost(int type, int* pHeight = nullptr) const;
+    const CScript& GetFeeScript(int* pHeight = nullptr) const;
+};
+
+typedef std::shared_ptr<const CCostTable> CCostTableRef;
+
+/** A governance action taken by a block, as kept in the event log by height and type (the GOVERNANCE_ action). Freeze
+ *  and authorization events carry the script acted on, cost events the cost type and amount and fee events the new
+ *  fee script */
+struct CGovernanceEvent
+{
+    int nHeight;
+    int nType;
+    int nCostType;
+    CScript script;
+    CAmount nCost;
+
+    CGovernanceEvent() : nHeight(0), nType(0), nCostType(0), nCost(0) {}
+    CGovernanceEvent(int nHeightIn, int nTypeIn, const CScript& scriptIn, int nCostTypeIn = 0, CAmount nCostIn = 0)
+        : nHeight(nHeightIn), nType(nTypeIn), nCostType(nCostTypeIn), script(scriptIn), nCost(nCostIn) {}
+
+    /** The order of the event log in the database */
+    bool operator<(const CGovernanceEvent& other) const {
+        return std::tie(nHeight, nType, nCostType, script) < std::tie(other.nHeight, other.nType, other.nCostType, other.script);
+    }
+};
+
+/** The governance state in force at a height, rebuilt from the event log */
+struct CGovernanceState
+{
+    std::set<CScript> setFrozen;
+    std::set<CScript> setAuthorized;
+    std::map<int, std::pair<CAmount, int> > mapCosts;
+    CScript feeScript;
+    int nFeeHeight;
+
+    CGovernanceState() : nFeeHeight(-1) {}
+};
+
+/** Governance database changes not written yet. Freeze and authority entries map to the flag they will be written
+ *  with, cost and fee entries to whether they will be written (true) or erased (false) and the value written */
+struct CGovernanceChanges
+{
+    std::map<CScript, bool> mapFreezeEntries;
+    std::map<CScript, bool> mapAuthorityEntries;
+    std::map<std::pair<int, int>, std::pair<bool, CAmount> > mapCostEntries;
+    std::map<int, std::pair<bool, CScript> > mapFeeEntries;
+    /** Event log entries, written (true) or erased (false) */
+    std::map<CGovernanceEvent, bool> mapEventEntries;
+
+    /** Change to the frozen and authorized script counters */
+    int nFrozenChange;
+    int nAuthorizedChange;
+
+    CGovernanceChanges() : nFrozenChange(0), nAuthorizedChange(0) {}
+
+    bool IsEmpty() const;
+    void Clear();
+};
+
 class CGovernance : CDBWrapper 
 {
+private:
+    /** In-memory mirror of the frozen and authorized scripts, loaded by Init and kept in step with every change applied
+     *  below so CanSend and CanStake never need a database lookup */
+    CCriticalSection cs_mirror;
+    std::unordered_set<CScript, SaltedScriptHasher> setFrozenScripts;
+    std::unordered_set<CScript, SaltedScriptHasher> setAuthorizedScripts;
+
+    /** Every cost update by type and height, and every fee script update by height, mirrored the same way so
+     *  GetCost and GetFeeScript read the latest entry instead of scanning the database */
+    std::map<int, std::map<int, CAmount> > mapCostHistory;
+    std::map<int, CScript> mapFeeScriptHistory;
+
+    /** Frozen and authorized script counters, as they will be written */
+    unsigned int nFrozenScripts;
+    unsigned int nAuthorizedScripts;
+
+    /** Generation of the authorization list, bumped on every change, and the snapshot built for it (if any) */
+    uint64_t nValidatorGeneration;
+    CValidatorSetRef validatorSet;
+
+    /** Generation of the cost and fee script history, and the snapshot built for it (if any) */
+    uint64_t nCostGeneration;
+    CCostTableRef costTable;
+
+    /** Changes applied by connected and disconnected blocks since the last Flush */
+    CGovernanceChanges dirty;
+
+    /** Whether the event log goes back to the genesis block, false for databases created before it existed */
+    bool fEventLogComplete;
+
+    void LoadMirror();
+    void UpdateMirror(std::unordered_set<CScript, SaltedScriptHasher>& setScripts, const CScript& script, bool fInSet);
+
 public:
-    CGovernance(size_t nCacheSize, bool fMemory, bool fWipe);
+    CGovernance(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv = nullptr);
     bool Init(bool fWipe, const CChainParams& chainparams);
 
+    /** Apply the changes made by a block to the in-memory state, they are written by the next Flush */
+    void ApplyChanges(const CGovernanceChanges& changes);
+
+    /** Write every change applied since the last call in one synced batch */
+    bool Flush();
+
+    // Current database entries, including changes not flushed yet
+    bool ReadFreezeEntry(const CScript& script, bool& fFrozen);
+    bool ReadAuthorityEntry(const CScript& script, bool& fAuthorized);
+    bool ReadCostEntry(int type, int height, CAmount& cost);
+    bool ReadFeeEntry(int height, CScript& script);
+
     // Statistics
     unsigned int GetNumberOfAuthorizedScripts();
     unsigned int GetNumberOfFrozenScripts();
     
     // Managing freeze list
-    bool FreezeScript(CScript script);
-    bool UnfreezeScript(CScript script);
-    bool RevertFreezeScript(CScript script);
-    bool RevertUnfreezeScript(CScript script);
-    bool ScriptExist(CScript script);
-    bool CanSend(CScript script);
+    bool ScriptExist(const CScript& script);
+    bool CanSend(const CScript& script);
 
     // Managing authorization list
     bool GetActiveValidators(std::vector< CScript > *ValidatorsVector);
-    bool AuthorizeScript(CScript script);
-    bool UnauthorizeScript(CScript script);
-    bool RevertAuthorizeScript(CScript script);
-    bool RevertUnauthorizeScript(CScript script);
-    bool AuthorityExist(CScript script);
-    bool CanStake(CScript script);
+    bool AuthorityExist(const CScript& script);
+    bool CanStake(const CScript& script);
+    CValidatorSetRef GetValidatorSet();
 
     // Managing issuance cost
-    bool UpdateCost(CAmount cost, int type, int height);
-    bool RevertUpdateCost(int type, int height);
-    CAmount GetCost(int type);
+    CAmount GetCost(int type, int* pHeight = nullptr);
 
     // Managing fee address
-    bool UpdateFeeScript(CScript script, int height);
-    bool RevertUpdateFeeScript(int height);
-    CScript GetFeeScript();
+    CScript GetFeeScript(int* pHeight = nullptr);
+
+    // Costs and fee script in force, shared until the next change to either
+    CCostTableRef GetCostTable();
+
+    // Event log
+    /** Call fn with the events after pAfter (from the first event when null) up to nEndHeight, in log order, including
+     *  changes not flushed yet, until it returns false */
+    bool ForEachEvent(const CGovernanceEvent* pAfter, int nEndHeight, const std::function<bool(const CGovernanceEvent&)>& fn);
+    /** Replay the event log up to nHeight */
+    bool GetStateAtHeight(int nHeight, CGovernanceState& state);
+    bool IsEventLogComplete();
 
     // Misc
     bool DumpFreezeStats(std::vector< std::pair< CScript, bool > > *FreezeVector);
     bool GetFrozenScripts(std::vector< CScript > *FreezeVector);
 
     using CDBWrapper::Sync;
+    using CDBWrapper::GetDiskUsage;
+    using CDBWrapper::NewIterator;
   
 };
 
+/** Governance changes made while connecting or disconnecting blocks, layered over CGovernance the way CTokensCache is
+ *  layered over ptokens: lookups fall through to the base and nothing reaches it until Flush. A cache that is never
+ *  flushed, as in TestBlockValidity and VerifyDB, leaves the governance state untouched */
+class CGovernanceCache
+{
+private:
+    CGovernance* base;
+    CGovernanceChanges changes;
+
+    bool ReadFreezeEntry(const CScript& script, bool& fFrozen);
+    bool ReadAuthorityEntry(const CScript& script, bool& fAuthorized);
+
+public:
+    explicit CGovernanceCache(CGovernance* baseIn) : base(baseIn) {}
+
+    // Managing freeze list
+    bool FreezeScript(const CScript& script, int height);
+    bool UnfreezeScript(const CScript& script, int height);
+    bool RevertFreezeScript(const CScript& script);
+    bool RevertUnfreezeScript(const CScript& script);
+
+    // Managing authorization list
+    bool AuthorizeScript(const CScript& script, int height);
+    bool UnauthorizeScript(const CScript& script, int height);
+    bool RevertAuthorizeScript(const CScript& script);
+    bool RevertUnauthorizeScript(const CScript& script);
+
+    // Managing issuance cost
+    bool UpdateCost(CAmount cost, int type, int height);
+    bool RevertUpdateCost(int type, int height);
+
+    // Managing fee address
+    bool UpdateFeeScript(const CScript& script, int height);
+    bool RevertUpdateFeeScript(int height);
+
+    /** Take the events of a disconnected block out of the event log */
+    bool RevertEvents(int height);
+
+    /** Hand the changes to the base, which writes them with the next FlushStateToDisk */
+    bool Flush();
+};
+
 #endif /* PALADEUM_GOVERNANCE_H */
@@ -172,6 +172,8 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
+    // Set once a streamed result has started going out, errors can't be reported after that
+    bool fStreaming = false;
     try {
         // Parse request
         UniValue valRequest;
@@ -186,8 +188,28 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            // The reply is only started when the first chunk of a streamed result is ready
+            JSONStreamWriter stream([&](const std::string& strChunk) {
+                if (!fStreaming) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->WriteReplyStart(HTTP_OK);
+                    fStreaming = true;
+                    return req->WriteReplyChunk("{\"result\":" + strChunk);
+                }
+                return req->WriteReplyChunk(strChunk);
+            });
+            jreq.stream = &stream;
+
             UniValue result = tableRPC.execute(jreq);
 
+            if (stream.Started()) {
+                // Same layout as JSONRPCReply
+                stream.Flush();
+                req->WriteReplyChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                req->WriteReplyEnd();
+                return true;
+            }
+
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
 
@@ -200,9 +222,19 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
+        if (fStreaming) {
+            LogPrintf("%s: %s failed while streaming its result: %s\n", __func__, jreq.strMethod, objError.write());
+            req->WriteReplyEnd();
+            return false;
+        }
         JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (const std::exception& e) {
+        if (fStreaming) {
+            LogPrintf("%s: %s failed while streaming its result: %s\n", __func__, jreq.strMethod, e.what());
+            req->WriteReplyEnd();
+            return false;
+        }
         JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
@@ -22,6 +22,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <atomic>
 #include <future>
 
 #include <event2/thread.h>
@@ -539,12 +540,37 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+/** State of a chunked reply. Only touched from the http thread, except fOpen which workers poll. */
+struct HTTPChunkedState
+{
+    struct evhttp_request* req;
+    std::atomic<bool> fOpen;
+    //! Argument registered as the connection close callback, freed by whichever of close or end comes first
+    std::shared_ptr<HTTPChunkedState>* pCloseArg;
+
+    explicit HTTPChunkedState(struct evhttp_request* _req) : req(_req), fOpen(true), pCloseArg(nullptr) {}
+};
+
+static void http_chunked_close_cb(struct evhttp_connection*, void* arg)
+{
+    // libevent frees the request with the connection, later chunk events must not touch it
+    std::shared_ptr<HTTPChunkedState>* pstate = (std::shared_ptr<HTTPChunkedState>*)arg;
+    (*pstate)->fOpen = false;
+    (*pstate)->pCloseArg = nullptr;
+    delete pstate;
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
                                                        replySent(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
+    if (chunked) {
+        // A handler that bailed out in the middle of a chunked reply still has to end it
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        WriteReplyEnd();
+    }
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
@@ -610,6 +636,63 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = nullptr; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && req && !chunked);
+    std::shared_ptr<HTTPChunkedState> state = std::make_shared<HTTPChunkedState>(req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [state, nStatus]() {
+        struct evhttp_connection* con = evhttp_request_get_connection(state->req);
+        if (con) {
+            state->pCloseArg = new std::shared_ptr<HTTPChunkedState>(state);
+            evhttp_connection_set_closecb(con, http_chunked_close_cb, state->pCloseArg);
+        }
+        evhttp_send_reply_start(state->req, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    chunked = state;
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(chunked);
+    if (!chunked->fOpen)
+        return false;
+    if (strChunk.empty())
+        return true;
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    std::shared_ptr<HTTPChunkedState> state = chunked;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [state, evb]() {
+        if (state->fOpen)
+            evhttp_send_reply_chunk(state->req, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+    return true;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(chunked);
+    std::shared_ptr<HTTPChunkedState> state = chunked;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [state]() {
+        if (!state->fOpen)
+            return;
+        if (state->pCloseArg) {
+            // The connection may be kept alive for further requests, stop watching it
+            evhttp_connection_set_closecb(evhttp_request_get_connection(state->req), nullptr, nullptr);
+            delete state->pCloseArg;
+            state->pCloseArg = nullptr;
+        }
+        evhttp_send_reply_end(state->req);
+    });
+    ev->trigger(nullptr);
+    chunked.reset();
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -9,6 +9,7 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -18,6 +19,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedState;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -60,6 +62,8 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! Set between WriteReplyStart and WriteReplyEnd, shared with the http thread
+    std::shared_ptr<HTTPChunkedState> chunked;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -115,6 +119,27 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for bodies that are produced incrementally
+     * instead of being built in memory first. Follow with any number of
+     * WriteReplyChunk calls and a single WriteReplyEnd.
+     *
+     * @note Use instead of WriteReply, headers must be written before.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Queue the next part of a chunked reply. Returns false once the client
+     * has gone away, in which case the remaining output can be skipped.
+     */
+    bool WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Finish a chunked reply. As with WriteReply, do not call any other
+     * HTTPRequest methods afterwards.
+     */
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
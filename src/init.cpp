@@ -12,16 +12,22 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockcompression.h"
+#include "blockfilemap.h"
+#include "blockfilterindex.h"
+#include "cachebudget.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/blake2b_headers.h"
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
 #include "validation.h"
+#include "metricsserver.h"
 #include "miner.h"
 #include "netbase.h"
 #include "net.h"
@@ -38,16 +44,21 @@
 #include "script/sigcache.h"
 #include "scheduler.h"
 #include "timedata.h"
+#include "tokentxindex.h"
 #include "txdb.h"
+#include "txreconciliation.h"
 #include "txmempool.h"
 #include "torcontrol.h"
+#include "trace.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #include "tokens/tokens.h"
 #include "tokens/tokendb.h"
+#include "tokens/messages.h"
 #include "tokens/snapshotrequestdb.h"
+#include "tokens/tokensnapshotdb.h"
 #ifdef ENABLE_WALLET
 #include "wallet/init.h"
 #include <wallet/wallet.h>
@@ -57,6 +68,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <memory>
+#include <thread>
 
 #ifndef WIN32
 #include <signal.h>
@@ -73,6 +85,7 @@ using namespace boost::placeholders;
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
 #endif
 
@@ -201,6 +214,7 @@ void PrepareShutdown()
     StopREST();
     StopRPC();
     StopHTTPServer();
+    StopMetricsServer();
 #ifdef ENABLE_WALLET
     FlushWallets();
 #endif
@@ -236,14 +250,26 @@ void PrepareShutdown()
         FlushStateToDisk();
     }
 
-    if (governance != nullptr) {
-        governance->Sync();
+    if (pdbenv != nullptr) {
+        pdbenv->Sync();
     }
 
     // After there are no more peers/RPC left to give us new data which may generate
     // CValidationInterface callbacks, flush them...
     GetMainSignals().FlushBackgroundCallbacks();
 
+    // Write the token ownership snapshots that are still queued before the token databases go away
+    StopTokenSnapshotWorker();
+
+    // Stop reading blocks ahead before the governance state their checks look at goes away
+    StopBlockPrefetch();
+
+    // Write the index changes that are still queued before the block tree database goes away
+    StopIndexBuilder();
+    StopIndexWriter();
+    StopBlockFilterIndex();
+    StopTokenTxIndex();
+
     // Any future callbacks will be dropped. This should absolutely be safe - if
     // missing a callback results in an unrecoverable situation, unclean shutdown
     // would too. The only reason to do the above flushes is to let the wallet catch
@@ -255,8 +281,8 @@ void PrepareShutdown()
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
-        if (governance != nullptr) {
-            governance->Sync();
+        if (pdbenv != nullptr) {
+            pdbenv->Sync();
         }
         delete pcoinsTip;
         pcoinsTip = nullptr;
@@ -270,6 +296,14 @@ void PrepareShutdown()
         delete pblocktree;
         pblocktree = nullptr;
 
+        delete pblockfilterindex;
+        pblockfilterindex = nullptr;
+
+        delete ptokentxindex;
+        ptokentxindex = nullptr;
+
+        g_blockfilemap.Clear();
+
         /** TOKENS START */
         delete ptokens;
         ptokens = nullptr;
@@ -328,6 +362,10 @@ void PrepareShutdown()
         delete governance;
         governance = nullptr;
 
+        // After all of its databases
+        delete pdbenv;
+        pdbenv = nullptr;
+
         /** TOKENS END */
     }
 #ifdef ENABLE_WALLET
@@ -441,6 +479,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-blockfilemaps=<n>", strprintf("Keep up to <n> block files mapped into memory for reading blocks, 0 to read them through stdio (default: %u)", DEFAULT_BLOCKFILE_MAPS));
+    strUsage += HelpMessageOpt("-blockcompression", strprintf(_("Store new blocks and undo data LZ4 compressed. Block files written this way cannot be read by older versions (default: %u)"), DEFAULT_BLOCK_COMPRESSION));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -454,6 +495,7 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     if (showDebug) {
+        strUsage += HelpMessageOpt("-dbbackgroundflush", strprintf("Write the UTXO cache to disk from a background thread on flushes that don't need it there right away (default: %u)", DEFAULT_DB_BACKGROUND_FLUSH));
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
@@ -465,6 +507,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-messagegc", strprintf(_("Erase expired messages, and orphaned messages %d blocks deep, from the message database in the background (default: %u)"), MESSAGE_ORPHAN_KEEP_DEPTH, DEFAULT_MESSAGE_GC));
     if (showDebug) {
         strUsage += HelpMessageOpt("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()));
     }
@@ -472,6 +515,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-schedulerthreads=<n>", strprintf(_("Set the number of threads for background tasks and notifications (1 to %d, default: %d)"), MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS));
     strUsage += HelpMessageOpt("-autofixmempool", strprintf(_("When set, if the CreateNewBlock fails because of a transaction. The mempool will be cleared. (default: %d)"), false));
     strUsage += HelpMessageOpt("-bypassdownload", strprintf(_("When set, if the chain is in initialblockdownload the getblocktemplate rpc call will still return block data (default: %d)"), false));
 #ifndef WIN32
@@ -482,15 +526,19 @@ std::string HelpMessage(HelpMessageMode mode)
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
+    strUsage += HelpMessageOpt("-reindexthreads=<n>", strprintf(_("Number of threads reading and checking blk*.dat files ahead of the -reindex import, 0 to read them on the import thread (default: number of cores minus one, at most %d)"), MAX_REINDEX_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain the basic compact filters of the blocks, with the token names of their token outputs, used by the getblockfilter rpc call and -peerblockfilters. They are built in the background (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-tokentxindex", strprintf(_("Maintain the token outputs created and spent by the transactions of each token by height, used by the gettokentransactions rpc call and the REST interface. They are built in the background (default: %u)"), DEFAULT_TOKENTXINDEX));
     strUsage += HelpMessageOpt("-tokenindex", _("Keep an index of tokens, used by the requestsnapshot rpc call. Requires a -reindex."));
 
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-utxostats", strprintf(_("Follow the totals, token supplies and MuHash of the UTXO set as blocks connect, used by gettxoutsetinfo and gettokensupplyinfo. They are computed from the chainstate once when first enabled (default: %u)"), DEFAULT_UTXOSTATS));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info)"));
@@ -507,12 +555,15 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf(_("Set the number of threads processing peer messages, each peer handled by one thread at a time (1 to %d, default: %d)"), MAX_MSG_HANDLER_THREADS, DEFAULT_MSG_HANDLER_THREADS));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
+    strUsage += HelpMessageOpt("-txreconciliation", strprintf(_("Reconcile the sets of transactions announced with peers that support it, instead of sending an inv for every transaction (default: %u)"), DEFAULT_TXRECONCILIATION));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve compact block filters to peers per BIP 157, needs -blockfilterindex (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
@@ -543,6 +594,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawmessage=<address>", _("Enable publish raw token messages in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubtokenevent=<address>", _("Enable publish decoded token issuances, reissuances and transfers in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrestrictedevent=<address>", _("Enable publish decoded tags, freezes and verifiers of restricted tokens in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsequence=<address>", _("Enable publish hash block and tx sequence in <address>"));
+    strUsage += HelpMessageOpt("-zmqpub<type>hwm=<n>", strprintf(_("Set the outbound message high water mark of a zmq publish notifier; a subscriber further behind loses messages (default: %d)"), CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqtokenfilter=<token>", _("Only publish token and restricted events of this token (can be specified multiple times, default: all tokens)"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -551,9 +607,11 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
+        strUsage += HelpMessageOpt("-verifyblockindex=<n>", strprintf("Recompute the hash of every <n>th block index entry at startup, and the work hash of those that are proof of work, on all cores (default: %u, 0 = none, 1 = all)", DEFAULT_VERIFY_BLOCK_INDEX));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-earlystakerelay", strprintf("Announce proof-of-stake blocks to high-bandwidth peers once their header, signature and stake are checked, before their transactions (default: %u)", DEFAULT_EARLY_STAKE_RELAY));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-deprecatedrpc=<method>", "Allows deprecated RPC method(s) to be used");
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
@@ -577,8 +635,11 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
+        strUsage += HelpMessageOpt("-lockprofiling", "Record how long locks are waited for and held where they are taken, see getlockstats (default: 0)");
+        strUsage += HelpMessageOpt("-tracing", "Record how long the phases of block connection, token validation and the database flushes take, see gettracestats and dumptrace (default: 0)");
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-sigcacheautosize", strprintf("Double the signature cache or the script execution cache when it hits less than %u%% of its lookups while connecting blocks, up to %u times its size at startup (default: %u)", (int)(SIG_CACHE_AUTOSIZE_TARGET_HIT_RATE * 100), SIG_CACHE_AUTOSIZE_MAX_GROWTH, DEFAULT_SIG_CACHE_AUTOSIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees (in %s) to use in a single wallet transaction or raw transaction; setting this too low may abort large transactions (default: %s)"),
@@ -606,6 +667,9 @@ std::string HelpMessage(HelpMessageMode mode)
         CURRENCY_UNIT, FormatMoney(DEFAULT_MIN_RELAY_TX_FEE)));
     strUsage += HelpMessageOpt("-whitelistrelay", strprintf(_("Accept relayed transactions received from whitelisted peers even when not relaying transactions (default: %d)"), DEFAULT_WHITELISTRELAY));
     strUsage += HelpMessageOpt("-whitelistforcerelay", strprintf(_("Force relay of transactions from whitelisted peers even if they violate local relay policy (default: %d)"), DEFAULT_WHITELISTFORCERELAY));
+    strUsage += HelpMessageOpt("-txrelayshare=<class>:<n>", strprintf(_("Share of each transaction announcement to a peer given to a class of transactions (payment, issue, admin or transfer) before the rest goes to the classes with more to send; can be specified multiple times (default: payment:%u, issue:%u, admin:%u, transfer:%u)"),
+        DEFAULT_TX_RELAY_SHARES[TX_RELAY_PAYMENT], DEFAULT_TX_RELAY_SHARES[TX_RELAY_TOKEN_ISSUE], DEFAULT_TX_RELAY_SHARES[TX_RELAY_RESTRICTED_ADMIN], DEFAULT_TX_RELAY_SHARES[TX_RELAY_TOKEN_TRANSFER]));
+    strUsage += HelpMessageOpt("-txrelaylimit=<class>:<n>", strprintf(_("Announce at most <n> transactions of a class per second to each peer, 0 = unlimited; can be specified multiple times (default: %u)"), DEFAULT_TX_RELAY_LIMIT));
 
     strUsage += HelpMessageGroup(_("Block creation options:"));
     strUsage += HelpMessageOpt("-blockmaxweight=<n>", strprintf(_("Set maximum BIP141 block weight (default: %d)"), MAX_BLOCK_WEIGHT - 4000));
@@ -626,6 +690,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcserialversion", strprintf(_("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"), DEFAULT_RPC_SERIALIZE_VERSION));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpctxcache=<n>", strprintf(_("Keep the decoded results of up to <n> transactions for getrawtransaction and decoderawtransaction (default: %d)"), DEFAULT_RPC_TX_CACHE));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the number of threads that execute the calls of one JSON-RPC batch in parallel. Calls that depend on an earlier call of the same batch need the default (default: %d)"), DEFAULT_RPC_BATCH_THREADS));
+    strUsage += HelpMessageOpt("-metricsport=<port>", _("Serve metrics in the Prometheus text format at /metrics on <port>, without needing -server (default: 0, off)"));
+    strUsage += HelpMessageOpt("-metricsbind=<addr>", strprintf(_("Bind the metrics listener to the given address (default: %s)"), DEFAULT_METRICS_BIND));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
@@ -748,18 +816,8 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        const int nThreads = gArgs.GetArg("-reindexthreads", std::max(0, std::min(GetNumCores() - 1, MAX_REINDEX_THREADS)));
+        ReindexBlockFiles(chainparams, std::max(0, std::min(nThreads, MAX_REINDEX_THREADS)));
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -933,6 +991,8 @@ void InitLogging()
     fLogTimestamps = gArgs.GetBoolArg("-logtimestamps", DEFAULT_LOGTIMESTAMPS);
     fLogTimeMicros = gArgs.GetBoolArg("-logtimemicros", DEFAULT_LOGTIMEMICROS);
     fLogIPs = gArgs.GetBoolArg("-logips", DEFAULT_LOGIPS);
+    SetLockProfiling(gArgs.GetBoolArg("-lockprofiling", false));
+    SetTracing(gArgs.GetBoolArg("-tracing", false));
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Paladeum version %s\n", FormatFullVersion());
@@ -1019,6 +1079,10 @@ bool AppInitParameterInteraction()
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+        if (gArgs.GetBoolArg("-tokentxindex", DEFAULT_TOKENTXINDEX))
+            return InitError(_("Prune mode is incompatible with -tokentxindex."));
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1033,7 +1097,10 @@ bool AppInitParameterInteraction()
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
+#ifndef USE_SOCKET_EVENTS
+    // select() cannot wait on sockets numbered FD_SETSIZE or above
     nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+#endif
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1095,6 +1162,8 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fEarlyStakeRelay = gArgs.GetBoolArg("-earlystakerelay", DEFAULT_EARLY_STAKE_RELAY);
+    fSigCacheAutoSize = gArgs.GetBoolArg("-sigcacheautosize", DEFAULT_SIG_CACHE_AUTOSIZE);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1158,6 +1227,8 @@ bool AppInitParameterInteraction()
         fPruneMode = true;
     }
 
+    fBlockCompression = gArgs.GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
+
     RegisterAllCoreRPCCommands(tableRPC);
 #ifdef ENABLE_WALLET
     RegisterWalletRPC(tableRPC);
@@ -1204,6 +1275,10 @@ bool AppInitParameterInteraction()
         return InitError(strprintf("acceptnonstdtxn is not currently supported for %s chain", chainparams.NetworkIDString()));
     nBytesPerSigOp = gArgs.GetArg("-bytespersigop", nBytesPerSigOp);
 
+    std::string strTxRelayError;
+    if (!InitTxRelayClasses(strTxRelayError))
+        return InitError(strTxRelayError);
+
 #ifdef ENABLE_WALLET
     if (!WalletParameterInteraction())
         return false;
@@ -1219,6 +1294,12 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     if (gArgs.GetArg("-rpcserialversion", DEFAULT_RPC_SERIALIZE_VERSION) < 0)
         return InitError("rpcserialversion must be non-negative.");
 
@@ -1302,6 +1383,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string blake2b_algo = Blake2bAutoDetect();
+    LogPrintf("Using the '%s' BLAKE2b header implementation\n", blake2b_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1328,6 +1411,50 @@ bool AppInitLockDataDirectory()
     return true;
 }
 
+/** Run the loaders side by side and wait for all of them. An exception one throws is rethrown once all are done */
+static void RunLoadersInParallel(const std::vector<std::function<void()> >& vLoaders)
+{
+    std::vector<std::exception_ptr> vErrors(vLoaders.size());
+    std::vector<std::thread> vThreads;
+    for (size_t i = 0; i < vLoaders.size(); i++) {
+        vThreads.emplace_back([&vLoaders, &vErrors, i] {
+            try {
+                vLoaders[i]();
+            } catch (...) {
+                vErrors[i] = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& thread : vThreads)
+        thread.join();
+    for (const std::exception_ptr& error : vErrors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+//! How often the queue depths and latencies of the scheduler and the asynchronous validation listeners are logged, in seconds
+static const int64_t BACKGROUND_STATS_INTERVAL = 10 * 60;
+
+static void LogBackgroundStats(CScheduler* scheduler)
+{
+    if (!LogAcceptCategory(BCLog::BENCH))
+        return;
+    static const char* const PRIORITY_NAMES[CScheduler::NUM_PRIORITIES] = {"high", "normal", "low"};
+    std::vector<CScheduler::PriorityStats> vStats = scheduler->getPriorityStats();
+    for (int priority = 0; priority < CScheduler::NUM_PRIORITIES; priority++) {
+        const CScheduler::PriorityStats& stats = vStats[priority];
+        LogPrint(BCLog::BENCH, "scheduler %s priority: %u queued, %u run, delay %.2fms avg %.2fms max, run %.2fms avg %.2fms max\n", PRIORITY_NAMES[priority],
+            stats.nQueued, stats.nTasks, stats.nTasks ? 0.001 * stats.nTotalDelayMicros / stats.nTasks : 0, 0.001 * stats.nMaxDelayMicros,
+            stats.nTasks ? 0.001 * stats.nTotalRunMicros / stats.nTasks : 0, 0.001 * stats.nMaxRunMicros);
+    }
+    for (const ValidationQueueStats& stats : GetValidationQueueStats()) {
+        LogPrint(BCLog::BENCH, "%s notifications: %u queued, %u at most, %u delivered, %u overflows, delay %.2fms avg %.2fms max\n", stats.strName,
+            stats.nQueued, stats.nPeakQueued, stats.nDelivered, stats.nOverflows, stats.nDelivered ? 0.001 * stats.nTotalDelayMicros / stats.nDelivered : 0,
+            0.001 * stats.nMaxDelayMicros);
+    }
+}
+
 bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 {
     const CChainParams& chainparams = GetParams();
@@ -1360,9 +1487,13 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads
+    int nSchedulerThreads = std::max(1, std::min((int)gArgs.GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), MAX_SCHEDULER_THREADS));
+    LogPrintf("Using %u threads for the scheduler\n", nSchedulerThreads);
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    scheduler.scheduleEvery(std::bind(&LogBackgroundStats, &scheduler), BACKGROUND_STATS_INTERVAL * 1000, CScheduler::PRIORITY_LOW);
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
 
@@ -1493,9 +1624,13 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     pzmqNotificationInterface = CZMQNotificationInterface::Create();
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        // Publishing must not wait for the wallets, nor they for a slow subscriber
+        RegisterAsyncValidationInterface(pzmqNotificationInterface, "zmqnotify");
     }
 #endif
+
+    if (!StartMetricsServer())
+        return InitError(strprintf(_("Unable to start the metrics listener on port %d"), gArgs.GetArg("-metricsport", DEFAULT_METRICS_PORT)));
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
     uint64_t nMaxOutboundTimeframe = MAX_UPLOAD_TIMEFRAME;
 
@@ -1521,18 +1656,35 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nBlockFilterIndexCache = 0;
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        nBlockFilterIndexCache = std::min(nTotalCache / 8, nMaxBlockFilterIndexCache << 20);
+    nTotalCache -= nBlockFilterIndexCache;
+    int64_t nTokenTxIndexCache = 0;
+    if (gArgs.GetBoolArg("-tokentxindex", DEFAULT_TOKENTXINDEX))
+        nTokenTxIndexCache = std::min(nTotalCache / 8, nMaxTokenTxIndexCache << 20);
+    nTotalCache -= nTokenTxIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
-        int64_t nGovernanceDBCache = nTotalCache / 2;
+    int64_t nGovernanceDBCache = nTotalCache / 2;
     nTotalCache -= nGovernanceDBCache;
+    // The token, messaging, rewards and governance databases read through one block cache, which takes
+    // the half of the governance budget the governance database used for a cache of its own
+    int64_t nSharedDBCache = nGovernanceDBCache / 2;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nBlockFilterIndexCache)
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nBlockFilterIndexCache * (1.0 / 1024 / 1024));
+    if (nTokenTxIndexCache)
+        LogPrintf("* Using %.1fMiB for token transaction index database\n", nTokenTxIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for governance database\n", nGovernanceDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB of it for the block cache shared with the token databases\n", nSharedDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    g_blockfilemap.SetMaxFiles(std::max<int64_t>(0, gArgs.GetArg("-blockfilemaps", DEFAULT_BLOCKFILE_MAPS)));
 
     bool fLoaded = false;
     while (!fLoaded && !fRequestShutdown) {
@@ -1583,48 +1735,43 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     // Governance
                     delete governance;
 
+                    // After all of its databases
+                    delete pdbenv;
+                    pdbenv = new CDBEnvironment(nSharedDBCache);
+
                     // Basic tokens
-                    ptokensdb = new CTokensDB(nBlockTreeDBCache, false, fReset);
+                    ptokensdb = new CTokensDB(nBlockTreeDBCache, false, fReset, pdbenv);
                     ptokens = new CTokensCache();
-                    ptokensCache = new CLRUCache<std::string, CDatabasedTokenData>(MAX_CACHE_TOKENS_SIZE);
+                    ptokensCache = new CShardedLRUCache<std::string, CDatabasedTokenData>(MAX_CACHE_TOKENS_SIZE);
 
                     // Messaging tokens
                     pMessagesCache = new CLRUCache<std::string, CMessage>(1000);
                     pMessageSubscribedChannelsCache = new CLRUCache<std::string, int>(1000);
                     pMessagesSeenAddressCache = new CLRUCache<std::string, int>(1000);
-                    pmessagedb = new CMessageDB(nBlockTreeDBCache, false, false);
-                    pmessagechanneldb = new CMessageChannelDB(nBlockTreeDBCache, false, false);
+                    pmessagedb = new CMessageDB(nBlockTreeDBCache, false, false, pdbenv);
+                    pmessagechanneldb = new CMessageChannelDB(nBlockTreeDBCache, false, false, pdbenv);
 
                     // My restricted tokens
-                    pmyrestricteddb = new CMyRestrictedDB(nBlockTreeDBCache, false, false);
+                    pmyrestricteddb = new CMyRestrictedDB(nBlockTreeDBCache, false, false, pdbenv);
 
                     // Restricted tokens
-                    prestricteddb = new CRestrictedDB(nBlockTreeDBCache, false, fReset);
+                    prestricteddb = new CRestrictedDB(nBlockTreeDBCache, false, fReset, pdbenv);
                     ptokensVerifierCache = new CLRUCache<std::string, CNullTokenTxVerifierString>(
                             MAX_CACHE_TOKENS_SIZE);
-                    ptokensQualifierCache = new CLRUCache<std::string, int8_t>(MAX_CACHE_TOKENS_SIZE);
-                    ptokensRestrictionCache = new CLRUCache<std::string, int8_t>(MAX_CACHE_TOKENS_SIZE);
-                    ptokensGlobalRestrictionCache = new CLRUCache<std::string, int8_t>(MAX_CACHE_TOKENS_SIZE);
+                    ptokensQualifierCache = new CRestrictedLRUCache(MAX_CACHE_TOKENS_SIZE);
+                    ptokensRestrictionCache = new CRestrictedLRUCache(MAX_CACHE_TOKENS_SIZE);
+                    ptokensGlobalRestrictionCache = new CRestrictedLRUCache(MAX_CACHE_TOKENS_SIZE);
 
                     // Rewards
-                    pSnapshotRequestDb = new CSnapshotRequestDB(nBlockTreeDBCache, false, false);
-                    pTokenSnapshotDb = new CTokenSnapshotDB(nBlockTreeDBCache, false, false);
-                    pDistributeSnapshotDb = new CDistributeSnapshotRequestDB(nBlockTreeDBCache, false, false);
+                    pSnapshotRequestDb = new CSnapshotRequestDB(nBlockTreeDBCache, false, false, pdbenv);
+                    pTokenSnapshotDb = new CTokenSnapshotDB(nBlockTreeDBCache, false, false, pdbenv);
+                    pDistributeSnapshotDb = new CDistributeSnapshotRequestDB(nBlockTreeDBCache, false, false, pdbenv);
+
+                    // Governance
+                    governance = new CGovernance(nGovernanceDBCache, false, fReset, pdbenv);
 
                     // Read for fTokenIndex to make sure that we only load token address balances if it if true
                     pblocktree->ReadFlag("tokenindex", fTokenIndex);
-                    // Need to load tokens before we verify the database
-                    if (!ptokensdb->LoadTokens()) {
-                        strLoadError = _("Failed to load Tokens Database");
-                        break;
-                    }
-
-                    if (!ptokensdb->ReadReissuedMempoolState())
-                        LogPrintf(
-                                "Database failed to load last Reissued Mempool State. Will have to start from empty state");
-
-                    LogPrintf("Successfully loaded tokens from database.\nCache of tokens size: %d\n",
-                              ptokensCache->Size());
 
                     // Check for changed -disablemessaging state
                     if (gArgs.GetArg("-disablemessaging", false)) {
@@ -1633,6 +1780,54 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     } else {
                         LogPrintf("Messaging is enabled\n");
                     }
+
+                    // The token, message and governance databases don't depend on each other, load them side by side
+                    bool fTokensLoaded = false;
+                    bool fMessagesIndexed = false;
+                    bool fQualifiersIndexed = false;
+                    int64_t nTokensTime = 0;
+                    int64_t nMessagesTime = 0;
+                    int64_t nGovernanceTime = 0;
+                    const int64_t nLoadersStart = GetTimeMillis();
+                    RunLoadersInParallel({
+                        [&] {
+                            // Need to load tokens before we verify the database
+                            fTokensLoaded = ptokensdb->LoadTokens();
+                            fQualifiersIndexed = prestricteddb->BuildRootQualifierIndex();
+                            if (fTokensLoaded && !ptokensdb->ReadReissuedMempoolState())
+                                LogPrintf(
+                                        "Database failed to load last Reissued Mempool State. Will have to start from empty state");
+                            nTokensTime = GetTimeMillis() - nLoadersStart;
+                        },
+                        [&] {
+                            fMessagesIndexed = pmessagedb->BuildMessageIndexes();
+                            if (fMessagesIndexed && fMessaging && !LoadMessageFilters())
+                                LogPrintf("Failed to load the message filters, channel and address lookups will read the database\n");
+                            nMessagesTime = GetTimeMillis() - nLoadersStart;
+                        },
+                        [&] {
+                            governance->Init(fReset, chainparams);
+                            nGovernanceTime = GetTimeMillis() - nLoadersStart;
+                        },
+                    });
+                    LogPrintf("Loaded the token, message and governance databases in %dms (tokens %dms, messages %dms, governance %dms)\n",
+                              GetTimeMillis() - nLoadersStart, nTokensTime, nMessagesTime, nGovernanceTime);
+
+                    if (!fTokensLoaded) {
+                        strLoadError = _("Failed to load Tokens Database");
+                        break;
+                    }
+                    if (!fQualifiersIndexed) {
+                        strLoadError = _("Failed to index the Restricted Database");
+                        break;
+                    }
+                    if (!fMessagesIndexed) {
+                        strLoadError = _("Failed to index the Messages Database");
+                        break;
+                    }
+
+                    LogPrintf("Successfully loaded tokens from database.\nCache of tokens size: %d\n",
+                              ptokensCache->Size());
                 }
                 /** TOKENS END */
 
@@ -1666,20 +1861,20 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                // Check for changed -addressindex state
-                if (fAddressIndex != gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                // Check for changed -addressindex state, the index builder writes an index that has been switched on
+                if (fAddressIndex != gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) && (fAddressIndex || !ScheduleIndexBuild("addressindex"))) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -addressindex");
                     break;
                 }
 
-                // Check for changed -spentindex state
-                if (fSpentIndex != gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                // Check for changed -spentindex state, the index builder writes an index that has been switched on
+                if (fSpentIndex != gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) && (fSpentIndex || !ScheduleIndexBuild("spentindex"))) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -spentindex");
                     break;
                 }
 
-                // Check for changed -timestampindex state
-                if (fTimestampIndex != gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+                // Check for changed -timestampindex state, the index builder writes an index that has been switched on
+                if (fTimestampIndex != gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX) && (fTimestampIndex || !ScheduleIndexBuild("timestampindex"))) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -timestampindex");
                     break;
                 }
@@ -1706,9 +1901,6 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
 
-                governance = new CGovernance(nGovernanceDBCache, false, fReset);
-                governance->Init(fReset, chainparams);
-
                 // If necessary, upgrade from older database format.
                 // This is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
                 if (!pcoinsdbview->Upgrade()) {
@@ -1716,6 +1908,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Older binaries can't read the token transfer scripts of this format and refuse a database marked with it
+                if (!pcoinsdbview->WriteFormatVersion()) {
+                    strLoadError = _("Unsupported chainstate database format");
+                    break;
+                }
+
                 // ReplayBlocks is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
                 if (!ReplayBlocks(chainparams, pcoinsdbview)) {
                     strLoadError = _("Unable to replay blocks. You will need to rebuild the database using -reindex-chainstate.");
@@ -1771,6 +1969,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                         break;
                     }
                 }
+
+                uiInterface.InitMessage(_("Loading UTXO set statistics..."));
+                if (!LoadUTXOSetStats(chainparams)) {
+                    strLoadError = _("Error loading the UTXO set statistics");
+                    break;
+                }
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1812,6 +2016,11 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
     }
 
+    if (nBlockFilterIndexCache)
+        pblockfilterindex = new CBlockFilterIndex(nBlockFilterIndexCache, false, fReindex);
+    if (nTokenTxIndexCache)
+        ptokentxindex = new CTokenTxIndex(nTokenTxIndexCache, false, fReindex);
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1864,6 +2073,16 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         vImportFiles.push_back(strFile);
     }
 
+    StartTokenSnapshotWorker();
+    StartIndexWriter();
+    StartIndexBuilder();
+    StartBlockFilterIndex();
+    StartTokenTxIndex();
+    StartBlockPrefetch();
+    StartCacheBudget(scheduler);
+    if (fMessaging && gArgs.GetBoolArg("-messagegc", DEFAULT_MESSAGE_GC))
+        StartMessageGC(scheduler);
+
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
     // Wait for genesis block to be processed
@@ -1906,6 +2125,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.m_msgproc = peerLogic.get();
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nMsgHandlerThreads = gArgs.GetArg("-msghandlerthreads", DEFAULT_MSG_HANDLER_THREADS);
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
@@ -1966,13 +2186,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (!fReindex && fLoaded && fMessaging && pmessagechanneldb && !gArgs.GetBoolArg("-disablewallet", false)) {
         bool found;
         if (!pmessagechanneldb->ReadFlag("init", found)) {
-            uiInterface.InitMessage(_("Init Message Channels - Scanning Token Transactions"));
-            std::string strLoadError;
-            if (!ScanForMessageChannels(strLoadError)) {
-                LogPrintf("%s : Failed to scan for message channels, %s\n", __func__, strLoadError);
-            } else {
-                pmessagechanneldb->WriteFlag("init", true);
-            }
+            // Scanning the whole chain takes a while, the node does not wait for it
+            threadGroup.create_thread(&ThreadScanForMessageChannels);
         }
     }
 #endif
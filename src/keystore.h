@@ -13,6 +13,8 @@
 #include "script/standard.h"
 #include "sync.h"
 
+#include <atomic>
+
 #include <boost/signals2/signal.hpp>
 
 /** A virtual base class for key stores */
@@ -59,6 +61,8 @@ protected:
     WatchKeyMap mapWatchKeys;
     ScriptMap mapScripts;
     WatchOnlySet setWatchOnly;
+    //! Bumped whenever a key, script or watch-only entry is added or removed
+    std::atomic<uint64_t> nKeyStoreGeneration{0};
 
     uint256 nWordHash;
     std::vector<unsigned char> vchWords;
@@ -7,11 +7,15 @@
 #define PLB_MEMUSAGE_H
 
 #include "indirectmap.h"
+#include "prevector.h"
+#include "support/allocators/pool.h"
 
 #include <stdlib.h>
 
+#include <list>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -81,6 +85,31 @@ struct stl_shared_counter
     size_t weak_count;
 };
 
+template<typename X>
+struct stl_list_node
+{
+private:
+    void* next;
+    void* prev;
+    X x;
+};
+
+static inline size_t DynamicUsage(const std::string& s)
+{
+    // Short strings live inside the object itself and own no heap allocation.
+    const char* data = s.data();
+    const char* self = reinterpret_cast<const char*>(&s);
+    if (data >= self && data < self + sizeof(s))
+        return 0;
+    return MallocUsage(s.capacity() + 1);
+}
+
+template<typename X, typename Y>
+static inline size_t DynamicUsage(const std::pair<X, Y>& p)
+{
+    return DynamicUsage(p.first) + DynamicUsage(p.second);
+}
+
 template<typename X>
 static inline size_t DynamicUsage(const std::vector<X>& v)
 {
@@ -93,6 +122,12 @@ static inline size_t DynamicUsage(const prevector<N, X, S, D>& v)
     return MallocUsage(v.allocated_memory());
 }
 
+template<typename X>
+static inline size_t DynamicUsage(const std::list<X>& l)
+{
+    return MallocUsage(sizeof(stl_list_node<X>)) * l.size();
+}
+
 template<typename X, typename Y>
 static inline size_t DynamicUsage(const std::set<X, Y>& s)
 {
@@ -165,6 +200,17 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename E, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    const PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>* resource = m.get_allocator().resource();
+    if (resource == nullptr)
+        return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
+    // The nodes live in the chunks of the pool, used or free
+    return MallocUsage(resource->ChunkSizeBytes()) * resource->NumAllocatedChunks() + MallocUsage(sizeof(void*) * resource->NumAllocatedChunks()) +
+           MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 }
 
 #endif // PLB_MEMUSAGE_H
@@ -0,0 +1,106 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+
+#include "tinyformat.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <boost/thread/mutex.hpp>
+
+namespace {
+struct MetricRegistry {
+    boost::mutex cs;
+    std::vector<CMetric*> vMetrics;
+};
+
+//! Metrics are static objects of many files, so the registry is made on first use
+MetricRegistry& GetMetricRegistry()
+{
+    static MetricRegistry registry;
+    return registry;
+}
+} // namespace
+
+CMetric::CMetric(const char* pszName, const char* pszHelp, const char* pszType) : m_name(pszName), m_help(pszHelp), m_type(pszType)
+{
+    MetricRegistry& registry = GetMetricRegistry();
+    boost::unique_lock<boost::mutex> lock(registry.cs);
+    registry.vMetrics.push_back(this);
+}
+
+CMetric::~CMetric()
+{
+    MetricRegistry& registry = GetMetricRegistry();
+    boost::unique_lock<boost::mutex> lock(registry.cs);
+    registry.vMetrics.erase(std::remove(registry.vMetrics.begin(), registry.vMetrics.end(), this), registry.vMetrics.end());
+}
+
+void CMetric::Render(std::string& strOut) const
+{
+    strOut += strprintf("# HELP %s %s\n# TYPE %s %s\n", m_name, m_help, m_name, m_type);
+    RenderSamples(strOut);
+}
+
+void CMetricCounter::RenderSamples(std::string& strOut) const
+{
+    strOut += strprintf("%s %u\n", GetName(), Get());
+}
+
+void CMetricGauge::RenderSamples(std::string& strOut) const
+{
+    strOut += strprintf("%s %d\n", GetName(), Get());
+}
+
+CMetricHistogram::CMetricHistogram(const char* pszName, const char* pszHelp, std::vector<int64_t> vBounds, double dScale)
+    : CMetric(pszName, pszHelp, "histogram"), m_bounds(std::move(vBounds)), m_scale(dScale), m_buckets(new std::atomic<uint64_t>[m_bounds.size() + 1]), m_count(0), m_sum(0)
+{
+    for (size_t i = 0; i <= m_bounds.size(); i++)
+        m_buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void CMetricHistogram::Observe(int64_t n)
+{
+    const size_t nBucket = std::lower_bound(m_bounds.begin(), m_bounds.end(), n) - m_bounds.begin();
+    m_buckets[nBucket].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(n, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CMetricHistogram::RenderSamples(std::string& strOut) const
+{
+    // The buckets are read one at a time while being fed, so +Inf is their own sum
+    // rather than m_count; that keeps the cumulative counts consistent
+    uint64_t nCumulative = 0;
+    for (size_t i = 0; i < m_bounds.size(); i++) {
+        nCumulative += m_buckets[i].load(std::memory_order_relaxed);
+        strOut += strprintf("%s_bucket{le=\"%g\"} %u\n", GetName(), m_bounds[i] * m_scale, nCumulative);
+    }
+    nCumulative += m_buckets[m_bounds.size()].load(std::memory_order_relaxed);
+    strOut += strprintf("%s_bucket{le=\"+Inf\"} %u\n", GetName(), nCumulative);
+    strOut += strprintf("%s_sum %g\n", GetName(), m_sum.load(std::memory_order_relaxed) * m_scale);
+    strOut += strprintf("%s_count %u\n", GetName(), nCumulative);
+}
+
+std::vector<int64_t> MetricDurationBounds()
+{
+    return {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 60000000};
+}
+
+std::string RenderMetrics()
+{
+    MetricRegistry& registry = GetMetricRegistry();
+    boost::unique_lock<boost::mutex> lock(registry.cs);
+    std::vector<const CMetric*> vMetrics(registry.vMetrics.begin(), registry.vMetrics.end());
+    std::sort(vMetrics.begin(), vMetrics.end(), [](const CMetric* a, const CMetric* b) {
+        return strcmp(a->GetName(), b->GetName()) < 0;
+    });
+
+    std::string strOut;
+    for (const CMetric* metric : vMetrics)
+        metric->Render(strOut);
+    return strOut;
+}
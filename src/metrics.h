@@ -0,0 +1,108 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_METRICS_H
+#define PLB_METRICS_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Metrics for monitoring, rendered in the Prometheus text exposition format by
+ * RenderMetrics. A metric is usually a static object of the file that feeds it;
+ * it registers itself when constructed. Feeding one is a relaxed atomic
+ * operation and takes no lock, and rendering only reads the atomics, so scraping
+ * never waits for cs_main or the code being measured. The registry's own lock is
+ * only taken to add or remove a metric and to render.
+ */
+class CMetric
+{
+public:
+    //! pszName and pszHelp must outlive the metric, they are kept as is
+    CMetric(const char* pszName, const char* pszHelp, const char* pszType);
+    virtual ~CMetric();
+    CMetric(const CMetric&) = delete;
+    CMetric& operator=(const CMetric&) = delete;
+
+    const char* GetName() const { return m_name; }
+    /** Append the metric's HELP, TYPE and sample lines */
+    void Render(std::string& strOut) const;
+
+protected:
+    virtual void RenderSamples(std::string& strOut) const = 0;
+
+private:
+    const char* m_name;
+    const char* m_help;
+    const char* m_type;
+};
+
+/** A count that only goes up */
+class CMetricCounter : public CMetric
+{
+public:
+    CMetricCounter(const char* pszName, const char* pszHelp) : CMetric(pszName, pszHelp, "counter"), m_value(0) {}
+
+    void Inc(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Get() const { return m_value.load(std::memory_order_relaxed); }
+
+protected:
+    void RenderSamples(std::string& strOut) const override;
+
+private:
+    std::atomic<uint64_t> m_value;
+};
+
+/** A value that is set, like a height or a size */
+class CMetricGauge : public CMetric
+{
+public:
+    CMetricGauge(const char* pszName, const char* pszHelp) : CMetric(pszName, pszHelp, "gauge"), m_value(0) {}
+
+    void Set(int64_t n) { m_value.store(n, std::memory_order_relaxed); }
+    void Add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t Get() const { return m_value.load(std::memory_order_relaxed); }
+
+protected:
+    void RenderSamples(std::string& strOut) const override;
+
+private:
+    std::atomic<int64_t> m_value;
+};
+
+/**
+ * Observations counted into buckets by upper bound. The bounds and the sum are
+ * rendered multiplied by dScale, so durations observed in microseconds can be
+ * exposed in seconds.
+ */
+class CMetricHistogram : public CMetric
+{
+public:
+    CMetricHistogram(const char* pszName, const char* pszHelp, std::vector<int64_t> vBounds, double dScale = 1.0);
+
+    void Observe(int64_t n);
+    uint64_t GetCount() const { return m_count.load(std::memory_order_relaxed); }
+
+protected:
+    void RenderSamples(std::string& strOut) const override;
+
+private:
+    const std::vector<int64_t> m_bounds;
+    const double m_scale;
+    //! One per bound and one for the observations above the last, not cumulative
+    std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+    std::atomic<uint64_t> m_count;
+    std::atomic<int64_t> m_sum;
+};
+
+//! Upper bounds in microseconds from 1ms to 60s, for histograms of durations rendered in seconds
+std::vector<int64_t> MetricDurationBounds();
+
+/** All the registered metrics in the text exposition format, sorted by name */
+std::string RenderMetrics();
+
+#endif // PLB_METRICS_H
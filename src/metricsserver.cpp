@@ -0,0 +1,96 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metricsserver.h"
+
+#include "metrics.h"
+#include "util.h"
+
+#include <string.h>
+#include <thread>
+
+#include <event2/buffer.h>
+#include <event2/http.h>
+#include <event2/keyvalq_struct.h>
+#include <event2/thread.h>
+
+#include "support/events.h"
+
+static struct event_base* eventBaseMetrics = nullptr;
+static struct evhttp* eventHTTPMetrics = nullptr;
+static std::thread threadMetrics;
+
+static void metrics_request_cb(struct evhttp_request* req, void*)
+{
+    const char* pszPath = evhttp_uri_get_path(evhttp_request_get_evhttp_uri(req));
+    if (!pszPath || strcmp(pszPath, "/metrics") != 0) {
+        evhttp_send_error(req, HTTP_NOTFOUND, nullptr);
+        return;
+    }
+    const std::string strBody = RenderMetrics();
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    evbuffer_add(evb, strBody.data(), strBody.size());
+    evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "text/plain; version=0.0.4");
+    evhttp_send_reply(req, HTTP_OK, "OK", evb);
+}
+
+static void ThreadMetrics(struct event_base* base)
+{
+    RenameThread("paladeum-metrics");
+    event_base_dispatch(base);
+}
+
+bool StartMetricsServer()
+{
+    const int nPort = gArgs.GetArg("-metricsport", DEFAULT_METRICS_PORT);
+    if (nPort <= 0)
+        return true;
+    if (nPort > 65535) {
+        LogPrintf("Invalid -metricsport %d\n", nPort);
+        return false;
+    }
+    const std::string strBind = gArgs.GetArg("-metricsbind", DEFAULT_METRICS_BIND);
+
+    // Stopping breaks the loop from another thread
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+
+    raii_event_base base_ctr = obtain_event_base();
+    raii_evhttp http_ctr = obtain_evhttp(base_ctr.get());
+    if (!http_ctr) {
+        LogPrintf("couldn't create evhttp for the metrics server\n");
+        return false;
+    }
+    // libevent refuses anything but GET and HEAD
+    evhttp_set_allowed_methods(http_ctr.get(), EVHTTP_REQ_GET | EVHTTP_REQ_HEAD);
+    evhttp_set_timeout(http_ctr.get(), 30);
+    evhttp_set_gencb(http_ctr.get(), metrics_request_cb, nullptr);
+    if (evhttp_bind_socket(http_ctr.get(), strBind.c_str(), nPort) != 0) {
+        LogPrintf("Binding metrics server on address %s port %i failed.\n", strBind, nPort);
+        return false;
+    }
+
+    eventBaseMetrics = base_ctr.release();
+    eventHTTPMetrics = http_ctr.release();
+    threadMetrics = std::thread(ThreadMetrics, eventBaseMetrics);
+    LogPrintf("Serving metrics on %s:%d/metrics\n", strBind, nPort);
+    return true;
+}
+
+void StopMetricsServer()
+{
+    if (!eventBaseMetrics)
+        return;
+    // A scrape is answered in one callback, nothing is left to finish
+    event_base_loopbreak(eventBaseMetrics);
+    if (threadMetrics.joinable())
+        threadMetrics.join();
+    evhttp_free(eventHTTPMetrics);
+    eventHTTPMetrics = nullptr;
+    event_base_free(eventBaseMetrics);
+    eventBaseMetrics = nullptr;
+}
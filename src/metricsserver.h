@@ -0,0 +1,23 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_METRICSSERVER_H
+#define PLB_METRICSSERVER_H
+
+#include <string>
+
+//! Off unless a port is given
+static const int DEFAULT_METRICS_PORT = 0;
+static const char* const DEFAULT_METRICS_BIND = "127.0.0.1";
+
+/**
+ * Serve RenderMetrics at GET /metrics on -metricsbind:-metricsport. The listener
+ * has its own event loop and thread, apart from the RPC server, so a scrape
+ * neither waits for nor holds up an RPC worker, and it runs without -server.
+ * Returns false only if a port was given and could not be bound.
+ */
+bool StartMetricsServer();
+void StopMetricsServer();
+
+#endif // PLB_METRICSSERVER_H
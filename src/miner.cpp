@@ -16,6 +16,7 @@
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "hash.h"
+#include "metrics.h"
 #include "validation.h"
 #include "net.h"
 #include "policy/feerate.h"
@@ -24,7 +25,9 @@
 #include "primitives/transaction.h"
 #include "script/standard.h"
 #include "timedata.h"
+#include "tokens/tokens.h"
 #include "txmempool.h"
+#include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
@@ -37,6 +40,7 @@
 
 #include <boost/thread.hpp>
 #include <algorithm>
+#include <list>
 #include <queue>
 #include <utility>
 
@@ -59,8 +63,64 @@ uint64_t nMiningTimeStart = 0;
 uint64_t nHashesPerSec = 0;
 uint64_t nHashesDone = 0;
 
+// Nonces the solo miner hashes at once, the work hash has a four-way kernel
+static const int MINER_WORK_HASH_BATCH = 4;
+
 unsigned int nMinerSleep = STAKER_POLLING_PERIOD;
 
+// The staking thread, for all wallets together
+static CMetricCounter metricStakeTemplatesBuilt("paladeum_stake_templates_built_total", "Block templates assembled by the staking threads");
+static CMetricCounter metricStakeBlocksSigned("paladeum_stake_blocks_signed_total", "Proof of stake blocks signed");
+static CMetricCounter metricStakeBlocksExpired("paladeum_stake_blocks_expired_total", "Signed proof of stake blocks dropped because their timestamp expired");
+
+// Staking threads wait on cvStakerWake between attempts. A new tip, a change in connections
+// or a wallet unlock can each let a waiting staker make progress, so they bump
+// nStakerWakeups and wake them all
+static CWaitableCriticalSection csStakerWake;
+static CConditionVariable cvStakerWake;
+static uint64_t nStakerWakeups = 0;
+
+static void WakeStakers()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csStakerWake);
+        nStakerWakeups++;
+    }
+    cvStakerWake.notify_all();
+}
+
+// Wait up to nMilliseconds for WakeStakers, returning right away if it ran since nWakeups was last updated
+static void WaitForStakerWakeup(uint64_t& nWakeups, int64_t nMilliseconds)
+{
+    boost::unique_lock<boost::mutex> lock(csStakerWake);
+    cvStakerWake.timed_wait(lock, boost::posix_time::milliseconds(nMilliseconds), [&nWakeups]() { return nStakerWakeups != nWakeups; });
+    nWakeups = nStakerWakeups;
+}
+
+class CStakerWakeups : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override
+    {
+        WakeStakers();
+    }
+};
+
+// Connected once for all wallets, the validation interface is dropped again at shutdown
+static void InitStakerWakeups()
+{
+    static CStakerWakeups wakeups;
+    static bool fInitialized = false;
+
+    boost::unique_lock<boost::mutex> lock(csStakerWake);
+    if (fInitialized)
+        return;
+    fInitialized = true;
+
+    RegisterValidationInterface(&wakeups);
+    uiInterface.NotifyNumConnectionsChanged.connect([](int nNumConnections) { WakeStakers(); });
+}
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -104,7 +164,7 @@ bool CheckFirstCoinstakeOutput(const CBlock& block){
 
 #ifdef ENABLE_WALLET
 // novacoin: attempt to generate suitable proof-of-stake
-bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees, const CBlockIndex* pindexPrev, std::vector< CScript > validatorVector)
+bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees, const CBlockIndex* pindexPrev, const CValidatorSet& validators, const std::vector<uint256>& vMerkleBranch)
 {
     // if we are trying to sign
     //    something except proof-of-stake block template
@@ -120,7 +180,7 @@ bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& n
     CMutableTransaction txCoinStake(*pblock->vtx[1]);
     txCoinStake.nTime = pblock->nTime;
 
-    if (wallet.CreateCoinStake(wallet, pblock->nBits, nTotalFees, pblock->nTime, txCoinStake, key, validatorVector))
+    if (wallet.CreateCoinStake(wallet, pblock->nBits, nTotalFees, pblock->nTime, txCoinStake, key, validators))
     {
         if (txCoinStake.nTime >= pindexPrev->GetMedianTimePast() + 1)
         {
@@ -128,7 +188,11 @@ bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& n
             //    as it would be the same as the block timestamp
             // pblock->nTime = txCoinStake.nTime;
             pblock->vtx[1] = MakeTransactionRef(std::move(txCoinStake));
-            pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+            // Only the coinstake changed, so its path is all that needs hashing again
+            if (vMerkleBranch.empty())
+                pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+            else
+                pblock->hashMerkleRoot = ComputeMerkleRootFromBranch(pblock->vtx[1]->GetHash(), vMerkleBranch, 1);
 
             // Check timestamp against prev
             if (pblock->GetBlockTime() <= pindexPrev->GetBlockTime() ||
@@ -190,6 +254,9 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    templateTokens.reset();
+    setTemplateReissues.clear();
 }
 
 void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
@@ -230,6 +297,72 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::AddPackageTokens(const CTxMemPool::setEntries& package)
+{
+    // Every name looks taken while reindexing, and no template is built then anyway
+    if (!AreTokensDeployed() || !ptokens || fReindex)
+        return true;
+
+    std::set<std::string> setIssues;
+    std::set<std::string> setReissues;
+    std::map<std::string, int> mapOps;
+    for (const CTxMemPool::txiter it : package) {
+        for (const CTxOut& out : it->GetTx().vout) {
+            if (!out.scriptPubKey.IsTokenScript())
+                continue;
+            CTokenOutputEntry data;
+            if (!GetTokenData(out.scriptPubKey, data))
+                continue;
+
+            if (data.type == TX_NEW_TOKEN) {
+                if (IsTokenNameAnOwner(data.tokenName)) {
+                    mapOps["owner"]++;
+                    continue;
+                }
+                mapOps["issue"]++;
+                setIssues.insert(data.tokenName);
+            } else if (data.type == TX_REISSUE_TOKEN) {
+                mapOps["reissue"]++;
+                setReissues.insert(data.tokenName);
+            } else if (data.type == TX_TRANSFER_TOKEN) {
+                mapOps["transfer"]++;
+            }
+        }
+    }
+
+    if (setIssues.empty() && setReissues.empty()) {
+        for (const auto& op : mapOps)
+            pblocktemplate->mapTokenOps[op.first] += op.second;
+        return true;
+    }
+
+    // Issuing a name that is already taken, on chain or in the block, makes the whole block invalid
+    if (!templateTokens)
+        templateTokens = std::make_shared<CTokensCache>();
+    for (const std::string& name : setIssues) {
+        if (templateTokens->CheckIfTokenExists(name)) {
+            pblocktemplate->mapSkippedTokenPackages["token-exists"]++;
+            return false;
+        }
+    }
+    for (const std::string& name : setReissues) {
+        if (setTemplateReissues.count(name)) {
+            pblocktemplate->mapSkippedTokenPackages["token-reissued"]++;
+            return false;
+        }
+    }
+
+    for (const std::string& name : setIssues) {
+        CNewToken token;
+        token.strName = name;
+        templateTokens->AddNewToken(token, "", nHeight, uint256());
+    }
+    setTemplateReissues.insert(setReissues.begin(), setReissues.end());
+    for (const auto& op : mapOps)
+        pblocktemplate->mapTokenOps[op.first] += op.second;
+    return true;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -422,6 +555,15 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
+        // Leave out packages whose token operations conflict with the ones already in the block
+        if (!AddPackageTokens(ancestors)) {
+            if (fUsingModified) {
+                mapModifiedTx.get<ancestor_score>().erase(modit);
+                failedTx.insert(iter);
+            }
+            continue;
+        }
+
         // This transaction will make it in; reset the failed counter.
         nConsecutiveFailed = 0;
 
@@ -514,36 +656,110 @@ bool CheckStake(const std::shared_ptr<const CBlock> pblock, CWallet& wallet)
 }
 
 
-void ThreadStakeMiner(CWallet *pwallet)
+// Move a proof-of-stake template to another timestamp slot. The coinbase carries the time too,
+// and as the coinstake's sibling it is the first hash of the coinstake's merkle branch
+static void UpdateStakeTemplateTime(CBlockTemplate& blocktemplate, uint32_t nTime)
+{
+    CBlock& block = blocktemplate.block;
+    if (block.nTime == nTime)
+        return;
+
+    block.nTime = nTime;
+    CMutableTransaction coinbaseTx(*block.vtx[0]);
+    coinbaseTx.nTime = nTime;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    if (!blocktemplate.vCoinstakeMerkleBranch.empty())
+        blocktemplate.vCoinstakeMerkleBranch[0] = block.vtx[0]->GetHash();
+}
+
+// Wallets staking, in the order they started. One engine thread stakes for all of them and is
+// restarted whenever the list changes, so it never holds on to a wallet that stopped
+static CCriticalSection csStakingWallets;
+static std::vector<CWallet*> vStakingWallets;
+static boost::thread_group* stakeThread = nullptr;
+
+// Search the slots from nTimeBegin to nTimeEnd (both masked) for the earliest kernel of any of the
+// wallets. Every wallet's kernels are prepared once and each slot hashes all of them before the
+// next, so the search ends at the first winning slot of all wallets together
+static bool FindStakeKernel(const std::vector<CWallet*>& vWallets, CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBegin, uint32_t nTimeEnd,
+                            const CValidatorSet& validators, uint32_t& nTimeKernel, CWallet*& pwalletKernel)
+{
+    std::vector<std::pair<CWallet*, std::vector<CStakeKernel> > > vCandidates;
+    for (CWallet* pwallet : vWallets) {
+        pwallet->m_last_coin_stake_search_time = GetAdjustedTime();
+        pwallet->m_last_coin_stake_search_interval = nTimeEnd - nTimeBegin + STAKE_TIMESTAMP_MASK + 1;
+        std::vector<CStakeKernel> vKernels;
+        if (pwallet->GetStakeKernelCandidates(pindexPrev, validators, vKernels))
+            vCandidates.emplace_back(pwallet, std::move(vKernels));
+    }
+
+    int nThreads = gArgs.GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+    for (uint32_t nTimeBlock = nTimeBegin; !vCandidates.empty() && nTimeBlock <= nTimeEnd; nTimeBlock += STAKE_TIMESTAMP_MASK + 1) {
+        for (const auto& candidate : vCandidates) {
+            if (candidate.first->SearchStakeKernel(candidate.second, nBits, nTimeBlock, nThreads) >= 0) {
+                nTimeKernel = nTimeBlock;
+                pwalletKernel = candidate.first;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void ThreadStakeMiner(const std::vector<CWallet*>& vWallets)
 {
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
 
     // Make this thread recognisable as the mining thread
-    std::string threadName = "aok-stake";
-    if(pwallet && pwallet->GetName() != "")
-    {
-        threadName = threadName + "-" + pwallet->GetName();
-    }
-    RenameThread(threadName.c_str());
+    RenameThread("aok-stake");
 
-    CReserveKey reservekey(pwallet);
+    uint64_t nWakeups = 0;
+    std::list<boost::signals2::scoped_connection> lUnlocked;
+    for (CWallet* pwallet : vWallets)
+        lUnlocked.emplace_back(pwallet->NotifyStatusChanged.connect([](CCryptoKeyStore* wallet) { WakeStakers(); }));
 
     bool fTryToSync = true;
 
-    std::vector< CScript > validatorVector;
-    int nValidatorHeight;
+    std::shared_ptr<const CValidatorSet> validators;
+
+    // Kernel search state for one (tip, validator set, unlocked wallets and their coins): the slots up to
+    // nSearchedUntil are done, and nTimeKernel is the earliest winning one among them or 0,
+    // won by pwalletKernel. The kernel hash is a function of tip, slot and coin alone, so a
+    // searched slot can't turn into a hit later
+    const CBlockIndex* pindexSearch = nullptr;
+    uint64_t nSearchGeneration = 0;
+    std::vector<CWallet*> vSearchWallets;
+    std::vector<uint64_t> vSearchCoinsGenerations;
+    uint32_t nSearchedUntil = 0;
+    uint32_t nTimeKernel = 0;
+    CWallet* pwalletKernel = nullptr;
+
+    // The block template is kept across slots until the tip or the mempool changes,
+    // retiming it for the slot is all a new kernel needs. It doesn't depend on the wallet,
+    // the coinstake of the winner replaces the placeholder one
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    int64_t nTotalFees = 0;
+    unsigned int nTemplateTransactionsUpdated = 0;
 
     while (true) {
-        while (pwallet->IsLocked())
-        {
-            MilliSleep(10000);
+        // Only unlocked wallets can sign, the timeouts only back up the wake-ups
+        std::vector<CWallet*> vUnlockedWallets;
+        while (true) {
+            for (CWallet* pwallet : vWallets) {
+                if (!pwallet->IsLocked())
+                    vUnlockedWallets.push_back(pwallet);
+            }
+            if (!vUnlockedWallets.empty())
+                break;
+            WaitForStakerWakeup(nWakeups, 10000);
         }
 
         // Don't disable PoS mining for no connections if in regtest mode
         if (!gArgs.GetBoolArg("-emergencystaking", false)) {
             while (g_connman->vNodes.size() == 0 || IsInitialBlockDownload()) {
                 fTryToSync = true;
-                MilliSleep(1000);
+                WaitForStakerWakeup(nWakeups, 10000);
             }
 
             if (fTryToSync) {
@@ -557,28 +773,104 @@ void ThreadStakeMiner(CWallet *pwallet)
         }
 
         CBlockIndex* pindexPrev = chainActive.Tip();
-
-        if (nValidatorHeight != pindexPrev->nHeight) {
-            LogPrintf("ThreadStakeMiner: Detected new block, updating list of validators\n");
-            governance->GetActiveValidators(&validatorVector);
-            nValidatorHeight = pindexPrev->nHeight;
+        for (CWallet* pwallet : vUnlockedWallets)
+            pwallet->m_staker_stats.nIterations++;
+
+        // Every wallet holds the same published validator set, only log when it actually changed
+        std::shared_ptr<const CValidatorSet> latest = vUnlockedWallets[0]->GetValidatorSet();
+        if (!validators || validators->nGeneration != latest->nGeneration) {
+            LogPrintf("ThreadStakeMiner: Validator set changed, %u authorized scripts\n", latest->Size());
+            validators = latest;
         }
 
         //
-        // Create new block
+        // Search the upcoming timestamp slots for a kernel before assembling a block,
+        // nearly every slot misses and the template would be thrown away
         //
 
-        if (pwallet->HaveAvailableCoinsForStaking(validatorVector)) {
-            int64_t nTotalFees = 0;
-            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(GetParams()).CreateNewBlock(reservekey.reserveScript, true, &nTotalFees));
-            if (!pblocktemplate.get())
-                return;
+        // A coin received or spent since the search changes the kernels, the slots are searched again with it
+        std::vector<uint64_t> vCoinsGenerations;
+        for (CWallet* pwallet : vUnlockedWallets)
+            vCoinsGenerations.push_back(pwallet->GetStakeCoinsGeneration());
+
+        if (pindexPrev != pindexSearch || validators->nGeneration != nSearchGeneration || vUnlockedWallets != vSearchWallets ||
+            vCoinsGenerations != vSearchCoinsGenerations) {
+            pindexSearch = pindexPrev;
+            nSearchGeneration = validators->nGeneration;
+            vSearchWallets = vUnlockedWallets;
+            vSearchCoinsGenerations = vCoinsGenerations;
+            nSearchedUntil = 0;
+            nTimeKernel = 0;
+        }
 
+        uint32_t nTimeNow = GetAdjustedTime() & ~STAKE_TIMESTAMP_MASK;
+        if (nTimeKernel != 0 && nTimeKernel < nTimeNow) {
+            LogPrint(BCLog::COINSTAKE, "ThreadStakeMiner: Missed the kernel slot %u\n", nTimeKernel);
+            nTimeKernel = 0;
+        }
+
+        if (nTimeKernel == 0) {
+            // The block has to be later than its parent, and only slots that don't need a
+            // later search to reach are looked at now
+            uint32_t nTimeBegin = std::max({nTimeNow, nSearchedUntil + STAKE_TIMESTAMP_MASK + 1, (uint32_t)(pindexPrev->GetBlockTime() | STAKE_TIMESTAMP_MASK) + 1});
+            uint32_t nTimeEnd = nTimeNow + MAX_STAKE_LOOKAHEAD;
+            if (nTimeBegin <= nTimeEnd) {
+                unsigned int nBits = GetNextTargetRequired(pindexPrev, nullptr, true, GetParams().GetConsensus());
+                if (FindStakeKernel(vUnlockedWallets, pindexPrev, nBits, nTimeBegin, nTimeEnd, *validators, nTimeKernel, pwalletKernel)) {
+                    LogPrint(BCLog::COINSTAKE, "ThreadStakeMiner: Kernel found for slot %u by wallet %s, %d seconds ahead\n", nTimeKernel, pwalletKernel->GetName(), nTimeKernel - nTimeNow);
+                    nSearchedUntil = nTimeKernel;
+                } else {
+                    nSearchedUntil = nTimeEnd;
+                }
+            }
+        }
+
+        // Produce the block once its slot is the current one. Until then sleep till the slot
+        // starts, or till the next unsearched slot enters the look-ahead window
+        if (nTimeKernel == 0 || nTimeKernel > nTimeNow) {
+            int64_t nWakeTime = nTimeKernel != 0 ? nTimeKernel : nSearchedUntil + STAKE_TIMESTAMP_MASK + 1 - MAX_STAKE_LOOKAHEAD;
+            int64_t nWait = (nWakeTime - GetAdjustedTime()) * 1000;
+            WaitForStakerWakeup(nWakeups, std::max<int64_t>(50, std::min<int64_t>(nWait, (STAKE_TIMESTAMP_MASK + 1) * 1000)));
+            continue;
+        }
+        nTimeKernel = 0;
+
+        //
+        // Create new block, signed by the wallet that found the kernel
+        //
+
+        {
+            CWallet* pwallet = pwalletKernel;
+            CStakerStats& stats = pwallet->m_staker_stats;
             CBlockIndex* pindexPrev = chainActive.Tip();
 
+            // Read the counter first, a transaction arriving during the build leaves it stale
+            unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+            if (!pblocktemplate || pblocktemplate->block.hashPrevBlock != pindexPrev->GetIndexHash() ||
+                nTemplateTransactionsUpdated != nTransactionsUpdated) {
+                int64_t nTimeStart = GetTimeMicros();
+                pblocktemplate = BlockAssembler(GetParams()).CreateNewBlock(CScript(), true, &nTotalFees);
+                if (!pblocktemplate.get())
+                    return;
+                stats.nCreateNewBlockTime += GetTimeMicros() - nTimeStart;
+                stats.nTemplatesBuilt++;
+                metricStakeTemplatesBuilt.Inc();
+                nTemplateTransactionsUpdated = nTransactionsUpdated;
+                pindexPrev = chainActive.Tip();
+            } else {
+                stats.nTemplatesReused++;
+            }
+            UpdateStakeTemplateTime(*pblocktemplate, nTimeNow);
+
             // Try to sign a block (this also checks for a PoS stake)
             std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
-            if (SignBlock(pblock, *pwallet, nTotalFees, pindexPrev, validatorVector)) {
+            int64_t nTimeStart = GetTimeMicros();
+            bool fSigned = SignBlock(pblock, *pwallet, nTotalFees, pindexPrev, *validators, pblocktemplate->vCoinstakeMerkleBranch);
+            stats.nSignBlockTime += GetTimeMicros() - nTimeStart;
+            if (fSigned) {
+                stats.nBlocksSigned++;
+                metricStakeBlocksSigned.Inc();
+
                 // Increase priority so we can build the full PoS block ASAP to ensure the timestamp doesn't expire
                 SetThreadPriority(THREAD_PRIORITY_ABOVE_NORMAL);
 
@@ -588,6 +880,9 @@ void ThreadStakeMiner(CWallet *pwallet)
                 if (pblock->GetBlockTime() <= pindexPrev->GetBlockTime() ||
                     FutureDrift(pblock->GetBlockTime()) < pindexPrev->GetBlockTime()) {
                     LogPrintf("ThreadStakeMiner: Valid PoS block took too long to create and has expired\n");
+                    stats.nBlocksExpired++;
+                    metricStakeBlocksExpired.Inc();
+                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
                     continue; //timestamp too late, so ignore
                 }
 
@@ -596,32 +891,45 @@ void ThreadStakeMiner(CWallet *pwallet)
                 SetThreadPriority(THREAD_PRIORITY_LOWEST);
                 MilliSleep(500);
             } else {
+                stats.nTemplatesDiscarded++;
+
                 // Wait till next stake
-                MilliSleep(nMinerSleep);
+                WaitForStakerWakeup(nWakeups, nMinerSleep);
             }
         }
     }
 }
 
-void StakeCoins(bool fStake, CWallet *pwallet, boost::thread_group*& stakeThread)
+void StakeCoins(bool fStake, CWallet *pwallet)
 {
+    LOCK(csStakingWallets);
+
+    std::vector<CWallet*>::iterator it = std::find(vStakingWallets.begin(), vStakingWallets.end(), pwallet);
+    if (fStake == (it != vStakingWallets.end()))
+        return;
+
     if (fStake) {
-        LogPrintf("Start staking thread\n");
+        LogPrintf("Start staking with wallet %s\n", pwallet->GetName());
+        vStakingWallets.push_back(pwallet);
     } else {
-        LogPrintf("Stop staking thread\n");
+        LogPrintf("Stop staking with wallet %s\n", pwallet->GetName());
+        vStakingWallets.erase(it);
     }
 
+    // Wait for the thread to let go of the wallets before it's started again with the new list
     if (stakeThread != nullptr)
     {
         stakeThread->interrupt_all();
+        stakeThread->join_all();
         delete stakeThread;
         stakeThread = nullptr;
     }
 
-    if(fStake)
+    if (!vStakingWallets.empty())
     {
+        InitStakerWakeups();
         stakeThread = new boost::thread_group();
-        stakeThread->create_thread(boost::bind(&ThreadStakeMiner, pwallet));
+        stakeThread->create_thread(boost::bind(&ThreadStakeMiner, vStakingWallets));
     }
 }
 
@@ -722,6 +1030,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
 
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus(), fProofOfStake);
+    if (fProofOfStake)
+        pblocktemplate->vCoinstakeMerkleBranch = BlockMerkleBranch(*pblock, 1);
     pblocktemplate->vTxFees[0] = -nFees;
 
     if (pTotalFees)
@@ -884,12 +1194,20 @@ void static SoloMiner(const CChainParams& chainparams)
             {
 
                 uint256 hash;
+                uint256 hashes[MINER_WORK_HASH_BATCH];
                 while (true)
                 {
-                    hash = pblock->GetWorkHash();
-                    if (UintToArith256(hash) <= hashTarget)
+                    pblock->GetWorkHashes(hashes, MINER_WORK_HASH_BATCH);
+                    int nFound = -1;
+                    for (int i = 0; i < MINER_WORK_HASH_BATCH && nFound < 0; i++) {
+                        if (UintToArith256(hashes[i]) <= hashTarget)
+                            nFound = i;
+                    }
+                    if (nFound >= 0)
                     {
                         // Found a solution
+                        pblock->nNonce += nFound;
+                        hash = hashes[nFound];
                         SetThreadPriority(THREAD_PRIORITY_NORMAL);
                         LogPrintf("SoloMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
                         ProcessBlockFound(pblock, chainparams);
@@ -903,12 +1221,12 @@ void static SoloMiner(const CChainParams& chainparams)
 
                         break;
                     }
-                    pblock->nNonce += 1;
-                    nHashesDone += 1;
-                    if (nHashesDone % 500000 == 0) {   //Calculate hashing speed
+                    pblock->nNonce += MINER_WORK_HASH_BATCH;
+                    nHashesDone += MINER_WORK_HASH_BATCH;
+                    if (nHashesDone % 500000 < MINER_WORK_HASH_BATCH) {   //Calculate hashing speed
                         nHashesPerSec = nHashesDone / (((GetTimeMicros() - nMiningTimeStart) / 1000000) + 1);
                     } 
-                    if ((pblock->nNonce & 0xFF) == 0)
+                    if ((pblock->nNonce & 0xFF) < MINER_WORK_HASH_BATCH)
                         break;
                 }
 
@@ -12,7 +12,10 @@
 #include "txmempool.h"
 
 #include <stdint.h>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/thread.hpp>
@@ -20,6 +23,7 @@
 class CBlockIndex;
 class CChainParams;
 class CScript;
+class CTokensCache;
 
 namespace Consensus { struct Params; };
 
@@ -51,6 +55,11 @@ struct CBlockTemplate
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCost;
     std::vector<unsigned char> vchCoinbaseCommitment;
+    //! Merkle branch of the coinstake at position 1, only set for proof-of-stake templates
+    std::vector<uint256> vCoinstakeMerkleBranch;
+    //! Token outputs in the block by operation, and the packages left out for conflicting token operations by reason
+    std::map<std::string, int> mapTokenOps;
+    std::map<std::string, int> mapSkippedTokenPackages;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -172,6 +181,10 @@ private:
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
 
+    // Tokens issued in the block, as an overlay of the active token cache, and tokens reissued in it
+    std::shared_ptr<CTokensCache> templateTokens;
+    std::set<std::string> setTemplateReissues;
+
     // Chain context for the block
     int nHeight;
     int64_t nLockTimeCutoff;
@@ -217,6 +230,9 @@ private:
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    /** Check the token operations of a package against the ones already in the block, so a package
+      * TestBlockValidity would reject is left out, and record them if it can be added */
+    bool AddPackageTokens(const CTxMemPool::setEntries& package);
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
     bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
@@ -228,8 +244,9 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
-/** Stake coins */
-void StakeCoins(bool fStake, CWallet *pwallet, boost::thread_group*& stakeThread);
+/** Start or stop staking with a wallet. One thread searches the kernels of all staking wallets
+ *  together and has the wallet that found one sign the block */
+void StakeCoins(bool fStake, CWallet *pwallet);
 
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
@@ -17,8 +17,10 @@
 #include "crypto/common.h"
 #include "crypto/sha256.h"
 #include "hash.h"
+#include "metrics.h"
 #include "primitives/transaction.h"
 #include "netbase.h"
+#include "netevents.h"
 #include "scheduler.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
@@ -27,6 +29,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -77,7 +80,7 @@ enum BindFlags {
     BF_WHITELIST    = (1U << 2),
 };
 
-const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
+const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
@@ -94,6 +97,10 @@ std::string strSubVersion;
 
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
+static CMetricGauge metricPeers("paladeum_peers", "Connected peers");
+static CMetricCounter metricBytesRecv("paladeum_net_received_bytes_total", "Bytes received from peers");
+static CMetricCounter metricBytesSent("paladeum_net_sent_bytes_total", "Bytes sent to peers");
+
 void CConnman::AddOneShot(const std::string& strDest)
 {
     LOCK(cs_vOneShots);
@@ -738,7 +745,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(GetParams().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(GetParams().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -833,6 +840,11 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    // Allocate up to 256 KiB ahead, but never more than the total message size.
+    // Beyond that the data grows as it arrives.
+    g_recv_buffer_pool.Acquire(vRecv, hdr.nMessageSize);
+    vRecv.reserve(std::min(hdr.nMessageSize, (unsigned int)(256 * 1024)));
+
     return nCopy;
 }
 
@@ -841,18 +853,56 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
-
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // Appended rather than written into a resized buffer, so nothing is
+    // zeroed first and growth reallocates geometrically
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+CNetMessageBufferPool g_recv_buffer_pool;
+
+void CNetMessageBufferPool::Acquire(CDataStream& stream, size_t nSize)
+{
+    std::lock_guard<std::mutex> lock(mutexPool);
+    if (vBuffers.empty())
+        return;
+    auto itBest = vBuffers.begin();
+    for (auto it = vBuffers.begin(); it != vBuffers.end(); ++it) {
+        bool fFits = it->capacity() >= nSize;
+        bool fBestFits = itBest->capacity() >= nSize;
+        if ((fFits && (!fBestFits || it->capacity() < itBest->capacity())) ||
+            (!fFits && !fBestFits && it->capacity() > itBest->capacity()))
+            itBest = it;
+    }
+    nPoolBytes -= itBest->capacity();
+    stream.SwapData(*itBest);
+    stream.clear();
+    std::swap(*itBest, vBuffers.back());
+    vBuffers.pop_back();
+}
+
+void CNetMessageBufferPool::Release(CDataStream& stream)
+{
+    CSerializeData data;
+    stream.SwapData(data);
+    if (data.capacity() == 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutexPool);
+    if (vBuffers.size() < MAX_RECV_BUFFER_POOL_SIZE && nPoolBytes + data.capacity() <= MAX_RECV_BUFFER_POOL_BYTES) {
+        nPoolBytes += data.capacity();
+        vBuffers.push_back(std::move(data));
+    }
+}
+
+size_t CNetMessageBufferPool::Size()
+{
+    std::lock_guard<std::mutex> lock(mutexPool);
+    return vBuffers.size();
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -870,33 +920,62 @@ const uint256& CNetMessage::GetMessageHash() const
 
 
 // requires LOCK(cs_vSend)
+/** Most messages passed to the kernel by one send */
+static const int SEND_IOV_MAX = 64;
+
 size_t CConnman::SocketSendData(CNode *pnode) const
 {
     auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert(it->size() > pnode->nSendOffset);
         int nBytes = 0;
+        size_t nTrySize = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nTrySize = it->size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(it->data()) + pnode->nSendOffset, nTrySize, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand the kernel several queued messages at once, the header and
+            // payload of each being separate entries of vSendMsg
+            struct iovec iov[SEND_IOV_MAX];
+            int nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto itIov = it; itIov != pnode->vSendMsg.end() && nIov < SEND_IOV_MAX; ++itIov, ++nIov) {
+                iov[nIov].iov_base = const_cast<unsigned char*>(itIov->data()) + nOffset;
+                iov[nIov].iov_len = itIov->size() - nOffset;
+                nTrySize += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nRemaining = it->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nTrySize) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1152,6 +1231,9 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
+    CSocketEvents socketEvents;
+    LogPrintf("Waiting on sockets with %s\n", CSocketEvents::Backend());
     while (!interruptNet)
     {
         //
@@ -1211,6 +1293,7 @@ void CConnman::ThreadSocketHandler()
         }
         if(vNodesSize != nPrevNodeCount) {
             nPrevNodeCount = vNodesSize;
+            metricPeers.Set(nPrevNodeCount);
             if(clientInterface)
                 clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
         }
@@ -1218,23 +1301,12 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        const int64_t nTimeoutMs = 50; // frequency to poll pnode->vSend
 
+        std::map<SOCKET, CSocketEvents::Interest> mapWanted;
+        std::map<SOCKET, CNode*> mapSocketNodes;
         for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+            mapWanted[hListenSocket.socket] = {-1, CSocketEvents::RECV};
         }
 
         {
@@ -1242,12 +1314,12 @@ void CConnman::ThreadSocketHandler()
             for (CNode* pnode : vNodes)
             {
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
+                // * Otherwise, if there is space left in the receive buffer, wait for
                 //   receiving data.
                 // * Hand off all complete messages to the processor, to be handled without
                 //   blocking here.
@@ -1263,37 +1335,31 @@ void CConnman::ThreadSocketHandler()
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
 
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
+                uint8_t nEvents = CSocketEvents::NONE;
                 if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
+                    nEvents = CSocketEvents::SEND;
+                } else if (select_recv) {
+                    nEvents = CSocketEvents::RECV;
                 }
+                mapWanted[pnode->hSocket] = {pnode->GetId(), nEvents};
+                mapSocketNodes[pnode->hSocket] = pnode;
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        socketEvents.Update(mapWanted);
+        std::map<SOCKET, uint8_t> mapReady;
+        bool fWaited = socketEvents.Wait(nTimeoutMs, mapReady);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
+        if (!fWaited)
         {
-            if (have_fds)
+            if (!mapWanted.empty())
             {
                 int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+                LogPrintf("socket %s error %s\n", CSocketEvents::Backend(), NetworkErrorString(nErr));
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(nTimeoutMs)))
                 return;
         }
 
@@ -1302,27 +1368,32 @@ void CConnman::ThreadSocketHandler()
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && mapReady.count(hListenSocket.socket))
             {
                 AcceptConnection(hListenSocket);
             }
         }
 
         //
-        // Service each socket
+        // Service each ready socket
         //
-        std::vector<CNode*> vNodesCopy;
+        std::vector<std::pair<CNode*, uint8_t> > vReadyNodes;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
-                pnode->AddRef();
+            for (const auto& ready : mapReady) {
+                auto it = mapSocketNodes.find(ready.first);
+                if (it == mapSocketNodes.end())
+                    continue;
+                it->second->AddRef();
+                vReadyNodes.emplace_back(it->second, ready.second);
+            }
         }
-        for (CNode* pnode : vNodesCopy)
+        for (const auto& ready : vReadyNodes)
         {
             if (interruptNet)
                 return;
 
+            CNode* pnode = ready.first;
             //
             // Receive
             //
@@ -1333,9 +1404,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = ready.second & CSocketEvents::RECV;
+                sendSet = ready.second & CSocketEvents::SEND;
+                errorSet = ready.second & CSocketEvents::ERR;
             }
             if (recvSet || errorSet)
             {
@@ -1403,45 +1474,53 @@ void CConnman::ThreadSocketHandler()
                     RecordBytesSent(nBytes);
                 }
             }
+        }
+        {
+            LOCK(cs_vNodes);
+            for (const auto& ready : vReadyNodes)
+                ready.first->Release();
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetSystemTimeInSeconds();
-            if (nTime - pnode->nTimeConnected > 60)
+        //
+        // Inactivity checking
+        //
+        int64_t nTime = GetSystemTimeInSeconds();
+        if (nTime != nLastInactivityCheck)
+        {
+            nLastInactivityCheck = nTime;
+            LOCK(cs_vNodes);
+            for (CNode* pnode : vNodes)
             {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-                else if (!pnode->fSuccessfullyConnected)
+                if (nTime - pnode->nTimeConnected > 60)
                 {
-                    LogPrintf("version handshake timeout from %d\n", pnode->GetId());
-                    pnode->fDisconnect = true;
+                    if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+                    {
+                        LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
+                        pnode->fDisconnect = true;
+                    }
+                    else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+                    {
+                        LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+                        pnode->fDisconnect = true;
+                    }
+                    else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+                    {
+                        LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+                        pnode->fDisconnect = true;
+                    }
+                    else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+                    {
+                        LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+                        pnode->fDisconnect = true;
+                    }
+                    else if (!pnode->fSuccessfullyConnected)
+                    {
+                        LogPrintf("version handshake timeout from %d\n", pnode->GetId());
+                        pnode->fDisconnect = true;
+                    }
                 }
             }
         }
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodesCopy)
-                pnode->Release();
-        }
     }
 }
 
@@ -2021,6 +2100,56 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     return true;
 }
 
+// Takes nodes of the current round until none are left; returns false if interrupted
+bool CConnman::ProcessMessageRound()
+{
+    for (size_t i = nMsgRoundNext++; i < vMsgRoundNodes.size(); i = nMsgRoundNext++)
+    {
+        CNode* pnode = vMsgRoundNodes[i];
+        if (pnode->fDisconnect)
+            continue;
+
+        // Receive messages
+        bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
+        if (fMoreNodeWork && !pnode->fPauseSend)
+            fMsgRoundMoreWork = true;
+        if (flagInterruptMsgProc)
+            return false;
+        // Send messages
+        {
+            LOCK(pnode->cs_sendProcessing);
+            m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
+        }
+
+        if (flagInterruptMsgProc)
+            return false;
+    }
+    return true;
+}
+
+void CConnman::ThreadMessageHandlerWorker()
+{
+    uint64_t nLastRound = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutexMsgRound);
+            condMsgRound.wait(lock, [this, nLastRound] { return fMsgWorkersStop || nMsgRound != nLastRound; });
+            if (fMsgWorkersStop)
+                return;
+            nLastRound = nMsgRound;
+        }
+
+        ProcessMessageRound();
+
+        {
+            std::lock_guard<std::mutex> lock(mutexMsgRound);
+            if (--nMsgRoundWorkersBusy == 0)
+                condMsgRoundDone.notify_all();
+        }
+    }
+}
+
 void CConnman::ThreadMessageHandler()
 {
     while (!flagInterruptMsgProc)
@@ -2034,27 +2163,26 @@ void CConnman::ThreadMessageHandler()
             }
         }
 
-        bool fMoreWork = false;
-
-        for (CNode* pnode : vNodesCopy)
-        {
-            if (pnode->fDisconnect)
-                continue;
-
-            // Receive messages
-            bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
-            // Send messages
+        vMsgRoundNodes.swap(vNodesCopy);
+        nMsgRoundNext = 0;
+        fMsgRoundMoreWork = false;
+        if (!threadMessageHandlerWorkers.empty()) {
             {
-                LOCK(pnode->cs_sendProcessing);
-                m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
+                std::lock_guard<std::mutex> lock(mutexMsgRound);
+                nMsgRoundWorkersBusy = (int)threadMessageHandlerWorkers.size();
+                nMsgRound++;
             }
+            condMsgRound.notify_all();
+        }
 
-            if (flagInterruptMsgProc)
-                return;
+        ProcessMessageRound();
+
+        if (!threadMessageHandlerWorkers.empty()) {
+            std::unique_lock<std::mutex> lock(mutexMsgRound);
+            condMsgRoundDone.wait(lock, [this] { return nMsgRoundWorkersBusy == 0; });
         }
+        vMsgRoundNodes.swap(vNodesCopy);
+        bool fMoreWork = fMsgRoundMoreWork;
 
         {
             LOCK(cs_vNodes);
@@ -2062,6 +2190,9 @@ void CConnman::ThreadMessageHandler()
                 pnode->Release();
         }
 
+        if (flagInterruptMsgProc)
+            return;
+
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
             condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
@@ -2257,6 +2388,9 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     semOutbound = nullptr;
     semAddnode = nullptr;
     flagInterruptMsgProc = false;
+    nMsgRound = 0;
+    nMsgRoundWorkersBusy = 0;
+    fMsgWorkersStop = false;
     SetTryNewOutboundPeer(false);
 
     Options connOptions;
@@ -2416,10 +2550,15 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
+    fMsgWorkersStop = false;
+    nMsgRound = 0;
+    nMsgRoundWorkersBusy = 0;
+    for (int i = 1; i < nMsgHandlerThreads; i++)
+        threadMessageHandlerWorkers.emplace_back(&TraceThread<std::function<void()> >, "msgwork", std::function<void()>(std::bind(&CConnman::ThreadMessageHandlerWorker, this)));
     threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
 
     // Dump network addresses
-    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
+    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000, CScheduler::PRIORITY_LOW);
 
     return true;
 }
@@ -2475,6 +2614,14 @@ void CConnman::Stop()
 {
     if (threadMessageHandler.joinable())
         threadMessageHandler.join();
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgRound);
+        fMsgWorkersStop = true;
+    }
+    condMsgRound.notify_all();
+    for (std::thread& thread : threadMessageHandlerWorkers)
+        thread.join();
+    threadMessageHandlerWorkers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2629,12 +2776,14 @@ bool CConnman::DisconnectNode(NodeId id)
 
 void CConnman::RecordBytesRecv(uint64_t bytes)
 {
+    metricBytesRecv.Inc(bytes);
     LOCK(cs_totalBytesRecv);
     nTotalBytesRecv += bytes;
 }
 
 void CConnman::RecordBytesSent(uint64_t bytes)
 {
+    metricBytesSent.Inc(bytes);
     LOCK(cs_totalBytesSent);
     nTotalBytesSent += bytes;
 
@@ -29,6 +29,7 @@
 #include <thread>
 #include <memory>
 #include <condition_variable>
+#include <mutex>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -78,6 +79,10 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** Default for -msghandlerthreads, the number of threads processing peer messages */
+static const int DEFAULT_MSG_HANDLER_THREADS = 1;
+/** Maximum number of threads processing peer messages */
+static const int MAX_MSG_HANDLER_THREADS = 16;
 /** The default for -maxuploadtarget. 0 = Unlimited */
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 /** The default timeframe for -maxuploadtarget. 1 day. */
@@ -142,6 +147,7 @@ public:
         NetEventsInterface* m_msgproc = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        int nMsgHandlerThreads = DEFAULT_MSG_HANDLER_THREADS;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         std::vector<std::string> vSeedNodes;
@@ -163,6 +169,7 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        nMsgHandlerThreads = std::max(1, std::min(connOptions.nMsgHandlerThreads, MAX_MSG_HANDLER_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -338,6 +345,8 @@ private:
     void ProcessOneShot();
     void ThreadOpenConnections();
     void ThreadMessageHandler();
+    void ThreadMessageHandlerWorker();
+    bool ProcessMessageRound();
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -432,6 +441,23 @@ private:
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
+    /** Message handler threads, including the msghand thread itself */
+    int nMsgHandlerThreads;
+    /**
+     * Nodes of the current message handler round. They are handed out one at a
+     * time, so no two threads ever process the same peer and its messages keep
+     * their order; the handlers serialize on cs_main only where they need it.
+     */
+    std::vector<CNode*> vMsgRoundNodes;
+    std::atomic<size_t> nMsgRoundNext;
+    std::atomic<bool> fMsgRoundMoreWork;
+    uint64_t nMsgRound;
+    int nMsgRoundWorkersBusy;
+    bool fMsgWorkersStop;
+    std::mutex mutexMsgRound;
+    std::condition_variable condMsgRound;
+    std::condition_variable condMsgRoundDone;
+
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
@@ -439,6 +465,7 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlerWorkers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -530,6 +557,8 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
+/** Key of the per-command statistics for messages of unknown commands */
+extern const std::string NET_MESSAGE_COMMAND_OTHER;
 
 class CNodeStats
 {
@@ -566,6 +595,36 @@ public:
 
 
 
+/** Most bytes of processed message data kept for new messages to receive into */
+static const size_t MAX_RECV_BUFFER_POOL_BYTES = 16 * 1000 * 1000;
+/** Most buffers kept for new messages to receive into */
+static const size_t MAX_RECV_BUFFER_POOL_SIZE = 256;
+
+/**
+ * Storage of processed messages, handed to new ones as they are received.
+ * This spares the allocation per message, and the zeroing of a freed
+ * zero_after_free_allocator buffer, for the whole of a block or a tx burst.
+ */
+class CNetMessageBufferPool
+{
+private:
+    std::mutex mutexPool;
+    std::vector<CSerializeData> vBuffers;
+    size_t nPoolBytes;
+
+public:
+    CNetMessageBufferPool() : nPoolBytes(0) {}
+
+    /** Gives the empty stream the smallest kept buffer holding nSize bytes, or the largest if none does */
+    void Acquire(CDataStream& stream, size_t nSize);
+    /** Keeps the storage of stream if there is room, leaving stream empty */
+    void Release(CDataStream& stream);
+    /** Number of buffers kept */
+    size_t Size();
+};
+
+extern CNetMessageBufferPool g_recv_buffer_pool;
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -590,6 +649,11 @@ public:
         nTime = 0;
     }
 
+    ~CNetMessage()
+    {
+        g_recv_buffer_pool.Release(vRecv);
+    }
+
     bool complete() const
     {
         if (!in_data)
@@ -684,6 +748,8 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // Addresses are pushed from the message handler thread of another peer
+    CCriticalSection cs_addrSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -809,6 +875,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -817,6 +884,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] = _addr;
@@ -9,7 +9,9 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockfilterindex.h"
 #include "chainparams.h"
+#include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "hash.h"
 #include "init.h"
@@ -27,6 +29,7 @@
 #include "scheduler.h"
 #include "tinyformat.h"
 #include "txmempool.h"
+#include "txreconciliation.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -61,6 +64,26 @@ void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 static size_t vExtraTxnForCompactIt = 0;
 static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(cs_main);
 
+/** Reconstruction counters of the compact blocks of all peers */
+static CCompactBlockStats g_compact_block_stats GUARDED_BY(cs_main);
+
+/** Message handling costs of all peers */
+static mapMsgCmdCost g_message_costs GUARDED_BY(cs_main);
+
+/** Reconciliation counters of the peers that disconnected */
+static CTxReconciliationStats g_tx_reconciliation_stats GUARDED_BY(cs_main);
+
+/** Share of each inv trickle, and per-peer invs per second (0 = unlimited), of each TxRelayClass. Set at startup */
+static unsigned int g_tx_relay_share[TX_RELAY_CLASSES] = {
+    DEFAULT_TX_RELAY_SHARES[TX_RELAY_PAYMENT],
+    DEFAULT_TX_RELAY_SHARES[TX_RELAY_TOKEN_ISSUE],
+    DEFAULT_TX_RELAY_SHARES[TX_RELAY_RESTRICTED_ADMIN],
+    DEFAULT_TX_RELAY_SHARES[TX_RELAY_TOKEN_TRANSFER],
+};
+static unsigned int g_tx_relay_limit[TX_RELAY_CLASSES] = {DEFAULT_TX_RELAY_LIMIT, DEFAULT_TX_RELAY_LIMIT, DEFAULT_TX_RELAY_LIMIT, DEFAULT_TX_RELAY_LIMIT};
+/** Seconds of its rate limit a relay class can save up while a peer has nothing of the class to send */
+static const int64_t TX_RELAY_ALLOWANCE_SECONDS = 2 * INVENTORY_BROADCAST_INTERVAL;
+
 static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
 
 /// Age after which a stale block will no longer be served if requested as
@@ -114,6 +137,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds)
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -126,6 +150,10 @@ namespace {
     /** Number of peers from which we're downloading blocks. */
     int nPeersWithValidatedDownloads = 0;
 
+    /** Times a peer stalled the block download window, and blocks given to other peers for it. */
+    uint64_t g_block_download_stalls = 0;
+    uint64_t g_blocks_reassigned = 0;
+
     /** Number of outbound peers with m_chain_sync.m_protect. */
     int g_outbound_peers_with_protect_from_disconnect = 0;
 
@@ -153,6 +181,31 @@ struct CBlockReject {
  * processing of incoming data is done after the ProcessMessage call returns,
  * and we're no longer holding the node's locks.
  */
+/**
+ * Set reconciliation of the transactions to announce to a peer, once both ends sent sendtxrcncl.
+ * Instead of an inv for every transaction, the outbound end asks for a sketch of the queued set of
+ * the other every few seconds, and the two announce only what the sketches show the other lacks.
+ */
+struct CTxReconciliationState {
+    //! Salt sent in our sendtxrcncl, 0 if we didn't offer reconciliation
+    uint64_t nLocalSalt = 0;
+    bool fRegistered = false;
+    //! Whether we ask for the sketches, which the outbound end of a link does
+    bool fInitiator = false;
+    //! SipHash keys of the short ids of the link
+    uint64_t k0 = 0;
+    uint64_t k1 = 0;
+    //! Transactions queued for the next round, by short id
+    std::map<uint32_t, uint256> mapLocalSet;
+    //! Responder: the set the last sketch was built from, until the peer says what it lacks
+    std::map<uint32_t, uint256> mapSnapshot;
+    bool fSnapshotPending = false;
+    //! Initiator: when to ask for the next sketch, and when the pending request was sent (0 if none), in microseconds
+    int64_t nNextRequest = 0;
+    int64_t nRequestSent = 0;
+    CTxReconciliationStats stats;
+};
+
 struct CNodeState {
     //! The peer's address
     const CService address;
@@ -187,6 +240,22 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! How many blocks may be in flight from this peer, adapted to its throughput and latency
+    int nBlockRequestLimit;
+    //! The least nBlockRequestLimit can fall to, halved each time the peer stalls the download
+    int nBlockRequestFloor;
+    //! Blocks received as requested, and the average and least time from request to receipt (in microseconds)
+    uint64_t nBlocksReceived;
+    int64_t nBlockLatencyAvg;
+    int64_t nBlockLatencyMin;
+    //! Average time between blocks received while more were in flight (in microseconds), or 0
+    int64_t nBlockIntervalAvg;
+    //! When the last requested block was received, if more were in flight then, or 0
+    int64_t nLastBlockReceived;
+    //! Times the peer stalled the download window, the blocks given to other peers for it, and until when it may not request more
+    int nBlockStalls;
+    uint64_t nBlocksReassigned;
+    int64_t nBlockRequestsPausedUntil;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -239,6 +308,21 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Reconstruction counters of the compact blocks this peer sent us
+    CCompactBlockStats compactBlockStats;
+
+    //! What handling the messages of this peer took, by command
+    mapMsgCmdCost mapMessageCost;
+
+    //! Transaction announcements of each relay class
+    CTxRelayClassStats txRelayStats[TX_RELAY_CLASSES];
+    //! Invs each rate limited relay class may still send, and when that was last topped up
+    double txRelayAllowance[TX_RELAY_CLASSES];
+    int64_t nTxRelayAllowanceTime;
+
+    //! Set reconciliation of the transactions announced to this peer
+    CTxReconciliationState txReconciliation;
+
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
         nMisbehavior = 0;
@@ -254,6 +338,16 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlockRequestLimit = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        nBlockRequestFloor = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        nBlocksReceived = 0;
+        nBlockLatencyAvg = 0;
+        nBlockLatencyMin = 0;
+        nBlockIntervalAvg = 0;
+        nLastBlockReceived = 0;
+        nBlockStalls = 0;
+        nBlocksReassigned = 0;
+        nBlockRequestsPausedUntil = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -263,6 +357,9 @@ struct CNodeState {
         fSupportsDesiredCmpctVersion = false;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
+        for (double& allowance : txRelayAllowance)
+            allowance = 0;
+        nTxRelayAllowanceTime = 0;
     }
 };
 
@@ -354,7 +451,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -370,6 +467,65 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     return true;
 }
 
+/** Number of blocks received from a peer before its in-flight limit is adapted */
+static const uint64_t BLOCK_REQUEST_LIMIT_MIN_SAMPLES = 8;
+
+// Requires cs_main.
+// Measures the delivery of a block that was requested from nodeid, before MarkBlockAsReceived.
+// The in-flight limit of the peer is set to twice the blocks it delivers within the latency of an
+// unqueued request, so a peer limited by its round trips rather than its bandwidth is asked for more.
+void RecordBlockDelivery(NodeId nodeid, const uint256& hash) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    const int64_t nNow = GetTimeMicros();
+    const int64_t nLatency = std::max<int64_t>(1, nNow - itInFlight->second.second->nTimeRequested);
+
+    state->nBlocksReceived++;
+    state->nBlockLatencyAvg = state->nBlockLatencyAvg ? (state->nBlockLatencyAvg * 7 + nLatency) / 8 : nLatency;
+    state->nBlockLatencyMin = state->nBlockLatencyMin ? std::min(state->nBlockLatencyMin, nLatency) : nLatency;
+    if (state->nLastBlockReceived) {
+        const int64_t nInterval = std::max<int64_t>(1, nNow - state->nLastBlockReceived);
+        state->nBlockIntervalAvg = state->nBlockIntervalAvg ? (state->nBlockIntervalAvg * 7 + nInterval) / 8 : nInterval;
+    }
+    // Only the gaps between blocks that were queued behind each other measure the peer's throughput
+    state->nLastBlockReceived = state->nBlocksInFlight > 1 ? nNow : 0;
+
+    if (state->nBlocksReceived >= BLOCK_REQUEST_LIMIT_MIN_SAMPLES && state->nBlockIntervalAvg) {
+        const int64_t nLimit = 2 * state->nBlockLatencyMin / state->nBlockIntervalAvg + 1;
+        state->nBlockRequestLimit = std::max<int64_t>(state->nBlockRequestFloor, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE, nLimit));
+    }
+}
+
+// Requires cs_main.
+// Gives the blocks in flight from a peer that stalls the download window to the other peers,
+// and keeps it from requesting them again before they had the chance.
+void ReassignStalledBlocks(NodeId nodeid) {
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    std::vector<uint256> vHashes;
+    for (const QueuedBlock& entry : state->vBlocksInFlight)
+        vHashes.push_back(entry.hash);
+    for (const uint256& hash : vHashes)
+        MarkBlockAsReceived(hash);
+
+    state->nBlockStalls++;
+    state->nBlocksReassigned += vHashes.size();
+    state->nBlockRequestFloor = std::max(1, state->nBlockRequestFloor / 2);
+    state->nBlockRequestLimit = state->nBlockRequestFloor;
+    state->nBlockRequestsPausedUntil = GetTimeMicros() + 1000000 * BLOCK_STALLING_TIMEOUT;
+    state->nLastBlockReceived = 0;
+    g_block_download_stalls++;
+    g_blocks_reassigned += vHashes.size();
+}
+
+/** The download window of a peer, grown in proportion to its in-flight limit */
+static int BlockDownloadWindow(const CNodeState* state) {
+    return BLOCK_DOWNLOAD_WINDOW * std::max(MAX_BLOCKS_IN_TRANSIT_PER_PEER, state->nBlockRequestLimit) / MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -493,10 +649,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than its download window + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BlockDownloadWindow(state);
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -587,6 +743,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    g_tx_reconciliation_stats += state->txReconciliation.stats;
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -617,9 +774,205 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.compactBlockStats = state->compactBlockStats;
+    for (int i = 0; i < TX_RELAY_CLASSES; i++)
+        stats.txRelayStats[i] = state->txRelayStats[i];
+    stats.mapMessageCost = state->mapMessageCost;
+    return true;
+}
+
+void GetBlockDownloadStats(CBlockDownloadStats& stats)
+{
+    LOCK(cs_main);
+    stats.nBlocksInFlight = mapBlocksInFlight.size();
+    stats.nPeersDownloading = nPeersWithValidatedDownloads;
+    stats.nStalls = g_block_download_stalls;
+    stats.nBlocksReassigned = g_blocks_reassigned;
+    for (const auto& entry : mapNodeState) {
+        const CNodeState& state = entry.second;
+        for (const QueuedBlock& queue : state.vBlocksInFlight) {
+            if (queue.pindex)
+                stats.nHighestInFlight = std::max(stats.nHighestInFlight, queue.pindex->nHeight);
+        }
+        if (state.nBlocksInFlight == 0 && state.nBlocksReceived == 0)
+            continue;
+        CBlockDownloadPeerStats peer;
+        peer.nodeid = entry.first;
+        peer.nBlocksInFlight = state.nBlocksInFlight;
+        peer.nBlockRequestLimit = state.nBlockRequestLimit;
+        peer.nWindow = BlockDownloadWindow(&state);
+        peer.nBlocksReceived = state.nBlocksReceived;
+        peer.nLatencyAvgMicros = state.nBlockLatencyAvg;
+        peer.nLatencyMinMicros = state.nBlockLatencyMin;
+        peer.nIntervalAvgMicros = state.nBlockIntervalAvg;
+        peer.nStalls = state.nBlockStalls;
+        peer.nBlocksReassigned = state.nBlocksReassigned;
+        stats.vPeers.push_back(peer);
+    }
+}
+
+bool InitTxRelayClasses(std::string& strError)
+{
+    const std::pair<const char*, unsigned int*> options[] = {{"-txrelayshare", g_tx_relay_share}, {"-txrelaylimit", g_tx_relay_limit}};
+    for (const auto& option : options) {
+        for (const std::string& strArg : gArgs.GetArgs(option.first)) {
+            size_t nColon = strArg.find(':');
+            TxRelayClass nClass;
+            uint32_t nValue;
+            if (nColon == std::string::npos || !ParseTxRelayClass(strArg.substr(0, nColon), nClass) || !ParseUInt32(strArg.substr(nColon + 1), &nValue)) {
+                strError = strprintf(_("Invalid %s=<class>:<n> '%s', the classes are payment, issue, admin and transfer"), option.first, strArg);
+                return false;
+            }
+            option.second[nClass] = nValue;
+        }
+    }
+    for (int i = 0; i < TX_RELAY_CLASSES; i++) {
+        if (g_tx_relay_share[i] != DEFAULT_TX_RELAY_SHARES[i] || g_tx_relay_limit[i] != DEFAULT_TX_RELAY_LIMIT)
+            LogPrintf("Transaction relay class %s: share %u, limit %u/s\n", GetTxRelayClassName((TxRelayClass)i), g_tx_relay_share[i], g_tx_relay_limit[i]);
+    }
     return true;
 }
 
+/** The invs of a trickle given to each relay class before the rest goes round the classes still having some to send */
+static unsigned int TxRelayQuota(int nClass)
+{
+    unsigned int nTotalShare = 0;
+    for (unsigned int nShare : g_tx_relay_share)
+        nTotalShare += nShare;
+    if (g_tx_relay_share[nClass] == 0)
+        return 0;
+    return std::max<unsigned int>(1, (uint64_t)INVENTORY_BROADCAST_MAX * g_tx_relay_share[nClass] / nTotalShare);
+}
+
+static void TopUpTxRelayAllowance(CNodeState& state, int64_t nNow) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const double nElapsed = state.nTxRelayAllowanceTime ? (nNow - state.nTxRelayAllowanceTime) / 1000000.0 : TX_RELAY_ALLOWANCE_SECONDS;
+    state.nTxRelayAllowanceTime = nNow;
+    for (int i = 0; i < TX_RELAY_CLASSES; i++) {
+        if (g_tx_relay_limit[i])
+            state.txRelayAllowance[i] = std::min<double>(state.txRelayAllowance[i] + nElapsed * g_tx_relay_limit[i], (double)g_tx_relay_limit[i] * TX_RELAY_ALLOWANCE_SECONDS);
+    }
+}
+
+static bool HasTxRelayAllowance(const CNodeState& state, int nClass) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    return g_tx_relay_limit[nClass] == 0 || state.txRelayAllowance[nClass] >= 1;
+}
+
+CCompactBlockStats& CCompactBlockStats::operator+=(const CCompactBlockStats& other)
+{
+    nBlocks += other.nBlocks;
+    nReconstructed += other.nReconstructed;
+    nRoundTrips += other.nRoundTrips;
+    nShortIdCollisions += other.nShortIdCollisions;
+    nTxPrefilled += other.nTxPrefilled;
+    nTxFromMempool += other.nTxFromMempool;
+    nTxFromExtra += other.nTxFromExtra;
+    nTxMissing += other.nTxMissing;
+    nReconstructionMicros += other.nReconstructionMicros;
+    nStakedReconstructed += other.nStakedReconstructed;
+    nStakedReconstructionMicros += other.nStakedReconstructionMicros;
+    return *this;
+}
+
+int64_t CTxReconciliationStats::GetBytesSaved() const
+{
+    static const int64_t INV_ENTRY_SIZE = 36;
+    return ((int64_t)nTxQueued - (int64_t)nTxAnnounced) * INV_ENTRY_SIZE - (int64_t)nBytes;
+}
+
+CTxReconciliationStats& CTxReconciliationStats::operator+=(const CTxReconciliationStats& other)
+{
+    nRounds += other.nRounds;
+    nFailures += other.nFailures;
+    nTxQueued += other.nTxQueued;
+    nTxAnnounced += other.nTxAnnounced;
+    nBytes += other.nBytes;
+    return *this;
+}
+
+void GetTxReconciliationStats(CTxReconciliationStats& stats, std::vector<std::pair<NodeId, CTxReconciliationStats>>& vPeers)
+{
+    LOCK(cs_main);
+    stats = g_tx_reconciliation_stats;
+    vPeers.clear();
+    for (const auto& entry : mapNodeState) {
+        if (!entry.second.txReconciliation.fRegistered)
+            continue;
+        stats += entry.second.txReconciliation.stats;
+        vPeers.emplace_back(entry.first, entry.second.txReconciliation.stats);
+    }
+}
+
+static void RecordCompactBlockStats(CNodeState* nodestate, const CCompactBlockStats& delta) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    nodestate->compactBlockStats += delta;
+    g_compact_block_stats += delta;
+}
+
+/** The counters of a compact block as InitData left it, nMissing transactions still to be requested */
+static CCompactBlockStats CompactBlockInitStats(const PartiallyDownloadedBlock& partialBlock, size_t nMissing)
+{
+    CCompactBlockStats delta;
+    delta.nBlocks = 1;
+    delta.nRoundTrips = nMissing > 0 ? 1 : 0;
+    delta.nTxPrefilled = partialBlock.GetPrefilledCount();
+    delta.nTxFromMempool = partialBlock.GetMempoolCount();
+    delta.nTxFromExtra = partialBlock.GetExtraCount();
+    delta.nTxMissing = nMissing;
+    return delta;
+}
+
+static void SetReconstructionTime(CCompactBlockStats& delta, const PartiallyDownloadedBlock& partialBlock, int64_t nMicros)
+{
+    delta.nReconstructed = 1;
+    delta.nReconstructionMicros = nMicros;
+    if (partialBlock.IsProofOfStake()) {
+        delta.nStakedReconstructed = 1;
+        delta.nStakedReconstructionMicros = nMicros;
+    }
+}
+
+void CMessageCost::Add(int64_t nMicrosIn, int64_t nCsMainMicrosIn, int64_t nDeserializeMicrosIn)
+{
+    nMessages++;
+    nMicros += nMicrosIn;
+    nMaxMicros = std::max(nMaxMicros, nMicrosIn);
+    nCsMainMicros += nCsMainMicrosIn;
+    nDeserializeMicros += nDeserializeMicrosIn;
+    int nBucket = 0;
+    while (nBucket < MSG_COST_BUCKETS - 1 && nMicrosIn >= MSG_COST_BUCKET_BOUNDS[nBucket])
+        nBucket++;
+    vBuckets[nBucket]++;
+}
+
+static void RecordMessageCost(CNodeState* nodestate, const std::string& strCommand, int64_t nMicros, int64_t nCsMainMicros, int64_t nDeserializeMicros) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    // Peers choose the commands, so only known ones get an entry of their own
+    static const std::set<std::string> setKnownCommands(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    const std::string& strKey = setKnownCommands.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+    if (nodestate)
+        nodestate->mapMessageCost[strKey].Add(nMicros, nCsMainMicros, nDeserializeMicros);
+    g_message_costs[strKey].Add(nMicros, nCsMainMicros, nDeserializeMicros);
+}
+
+void GetMessageCosts(mapMsgCmdCost& mapCosts)
+{
+    LOCK(cs_main);
+    mapCosts = g_message_costs;
+}
+
+void GetCompactBlockStats(CCompactBlockStats& stats, size_t& nExtraTxn, size_t& nExtraTxnCapacity)
+{
+    LOCK(cs_main);
+    stats = g_compact_block_stats;
+    nExtraTxn = 0;
+    for (const auto& extra : vExtraTxnForCompact)
+        if (extra.second)
+            nExtraTxn++;
+    nExtraTxnCapacity = vExtraTxnForCompact.size();
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -633,7 +986,32 @@ void AddToCompactExtraTransactions(const CTransactionRef& tx)
     if (!vExtraTxnForCompact.size())
         vExtraTxnForCompact.resize(max_extra_txn);
     vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
-    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
+    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % vExtraTxnForCompact.size();
+}
+
+/** Make room in the extra txn pool for the nMissing transactions a reconstruction had to request */
+static void GrowCompactExtraTransactions(size_t nMissing) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    size_t max_extra_txn = gArgs.GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN);
+    if (max_extra_txn <= 0 || vExtraTxnForCompact.empty())
+        return;
+    size_t nCapacity = std::min(vExtraTxnForCompact.size() + nMissing, max_extra_txn * BLOCK_RECONSTRUCTION_EXTRA_TXN_MAX_GROWTH);
+    if (nCapacity <= vExtraTxnForCompact.size())
+        return;
+    // The new slots go just before the oldest entry, so they are filled before anything is overwritten
+    vExtraTxnForCompact.insert(vExtraTxnForCompact.begin() + vExtraTxnForCompactIt, nCapacity - vExtraTxnForCompact.size(),
+                               std::make_pair(uint256(), CTransactionRef()));
+}
+
+/** Token transactions evicted from a full mempool are often still mined, after distribution bursts especially */
+static void AddEvictedTokenTxToCompactExtra(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    if ((reason != MemPoolRemovalReason::SIZELIMIT && reason != MemPoolRemovalReason::EXPIRY) || !tx->HasTokenOutputs())
+        return;
+    // Evictions only happen while the mempool is limited, under cs_main
+    AssertLockHeld(cs_main);
+    if (RecursiveDynamicUsage(*tx) < 100000)
+        AddToCompactExtraTransactions(tx);
 }
 
 bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -794,6 +1172,8 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
     // timer.
     static_assert(EXTRA_PEER_CHECK_INTERVAL < STALE_CHECK_INTERVAL, "peer eviction timer should be less than stale tip check timer");
     scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000);
+
+    m_evicted_connection = mempool.NotifyEntryRemoved.connect(&AddEvictedTokenTxToCompactExtra);
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
@@ -1098,7 +1478,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     std::shared_ptr<const CBlock> pblock;
                     if (a_recent_block && a_recent_block->GetIndexHash() == (*mi).second->GetIndexHash()) {
                         pblock = a_recent_block;
-                    } else {
+                    } else if (inv.type != MSG_WITNESS_BLOCK) {
                         // Send block from disk
                         std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
                         if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
@@ -1107,8 +1487,17 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     }
                     if (inv.type == MSG_BLOCK)
                         connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-                    else if (inv.type == MSG_WITNESS_BLOCK)
+                    else if (inv.type == MSG_WITNESS_BLOCK && pblock)
                         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                    else if (inv.type == MSG_WITNESS_BLOCK)
+                    {
+                        // Blocks are stored the way witness blocks are sent, pass the bytes on from disk without
+                        // deserializing them
+                        std::vector<unsigned char> block_data;
+                        if (!ReadRawBlockFromDisk(block_data, (*mi).second->GetBlockPos(), GetParams().MessageStart()))
+                            assert(!"cannot load block from disk");
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, CFlatData(block_data)));
+                    }
                     else if (inv.type == MSG_FILTERED_BLOCK)
                     {
                         bool sendMerkleBlock = false;
@@ -1466,7 +1855,7 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= nodestate->nBlockRequestLimit) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -1524,7 +1913,56 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
-bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
+/** Reads obj from vRecv, adding the time it took to nMicros */
+template <typename T>
+static void ReadTimed(CDataStream& vRecv, T& obj, int64_t& nMicros)
+{
+    const int64_t nStart = GetTimeMicros();
+    vRecv >> obj;
+    nMicros += GetTimeMicros() - nStart;
+}
+
+/**
+ * Check a compact filter request and find its stop block, disconnecting a peer that asks for a
+ * filter type we don't serve, an unknown or stale block or too many blocks. False when the request
+ * gets no answer.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, const CChainParams& chainparams, uint8_t nFilterType, uint32_t nStartHeight, const uint256& hashStop, uint32_t nMaxHeightDiff, const CBlockIndex*& pindexStop)
+{
+    if (static_cast<BlockFilterType>(nFilterType) != BlockFilterType::BASIC || !(pfrom->GetLocalServices() & NODE_COMPACT_FILTERS)) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n", pfrom->GetId(), nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashStop);
+        if (it == mapBlockIndex.end() || !(chainActive.Contains(it->second) ||
+                (it->second->IsValid(BLOCK_VALID_SCRIPTS) && StaleBlockRequestAllowed(it->second, chainparams.GetConsensus())))) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n", pfrom->GetId(), hashStop.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        pindexStop = it->second;
+    }
+
+    uint32_t nStopHeight = pindexStop->nHeight;
+    if (nStartHeight > nStopHeight) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with start height %d and stop height %d\n", pfrom->GetId(), nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (nStopHeight - nStartHeight >= nMaxHeightDiff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n", pfrom->GetId(), nStopHeight - nStartHeight + 1, nMaxHeightDiff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    return pblockfilterindex != nullptr;
+}
+
+bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, int64_t& nDeserializeMicros)
 {
     bool fBIP37 = false;
 
@@ -1673,6 +2111,16 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         if (pfrom->fInbound)
             PushNodeVersion(pfrom, connman, GetAdjustedTime());
 
+        // Offer to reconcile the transactions we announce, which has to come before verack
+        if (fRelay && fRelayTxes && nVersion >= TXRECONCILIATION_PROTO_VERSION && gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION)) {
+            uint64_t nSalt = GetRand(std::numeric_limits<uint64_t>::max() - 1) + 1;
+            {
+                LOCK(cs_main);
+                State(pfrom->GetId())->txReconciliation.nLocalSalt = nSalt;
+            }
+            connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_VERSION, nSalt));
+        }
+
         connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERACK));
 
         pfrom->nServices = nServices;
@@ -1765,7 +2213,31 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     // At this point, the outgoing message serialization version can't change.
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
 
-    if (strCommand == NetMsgType::VERACK)
+    if (strCommand == NetMsgType::SENDTXRCNCL)
+    {
+        uint32_t nPeerVersion;
+        uint64_t nRemoteSalt;
+        vRecv >> nPeerVersion >> nRemoteSalt;
+
+        LOCK(cs_main);
+        CTxReconciliationState& recon = State(pfrom->GetId())->txReconciliation;
+        if (pfrom->fSuccessfullyConnected || recon.fRegistered || nPeerVersion < 1) {
+            LogPrint(BCLog::NET, "peer=%d sent sendtxrcncl after verack, twice or with version %d, disconnecting\n", pfrom->GetId(), nPeerVersion);
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        // Reconcile only if we offered it too
+        if (recon.nLocalSalt == 0)
+            return true;
+
+        recon.fRegistered = true;
+        recon.fInitiator = !pfrom->fInbound;
+        ComputeReconciliationSalt(recon.nLocalSalt, nRemoteSalt, recon.k0, recon.k1);
+        recon.nNextRequest = PoissonNextSend(GetTimeMicros(), RECON_REQUEST_INTERVAL);
+        LogPrint(BCLog::NET, "reconciling transaction announcements with peer=%d as %s\n", pfrom->GetId(), recon.fInitiator ? "initiator" : "responder");
+    }
+
+    else if (strCommand == NetMsgType::VERACK)
     {
         pfrom->SetRecvVersion(std::min(pfrom->nVersion.load(), PROTOCOL_VERSION));
 
@@ -1809,7 +2281,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::ADDR)
     {
         std::vector<CAddress> vAddr;
-        vRecv >> vAddr;
+        ReadTimed(vRecv, vAddr, nDeserializeMicros);
 
         // Don't want addr from older versions unless seeding
         if (pfrom->nVersion < CADDR_TIME_VERSION && connman->GetAddressCount() > 1000)
@@ -1889,7 +2361,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::INV)
     {
         std::vector<CInv> vInv;
-        vRecv >> vInv;
+        ReadTimed(vRecv, vInv, nDeserializeMicros);
         if (vInv.size() > MAX_INV_SZ)
         {
             LOCK(cs_main);
@@ -1946,7 +2418,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::GETDATA)
     {
         std::vector<CInv> vInv;
-        vRecv >> vInv;
+        ReadTimed(vRecv, vInv, nDeserializeMicros);
         if (vInv.size() > MAX_INV_SZ)
         {
             LOCK(cs_main);
@@ -1972,7 +2444,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
 
         std::vector<CInvToken> vInvToken;
-        vRecv >> vInvToken;
+        ReadTimed(vRecv, vInvToken, nDeserializeMicros);
 
         if (vInvToken.size() > MAX_TOKEN_INV_SZ)
         {
@@ -2066,10 +2538,227 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
+    else if (strCommand == NetMsgType::REQRECON)
+    {
+        const size_t nPayload = vRecv.size();
+        uint16_t nRemoteSetSize;
+        uint16_t nQ;
+        ReadTimed(vRecv, nRemoteSetSize, nDeserializeMicros);
+        ReadTimed(vRecv, nQ, nDeserializeMicros);
+
+        LOCK(cs_main);
+        CTxReconciliationState& recon = State(pfrom->GetId())->txReconciliation;
+        // Only the outbound end of a link asks for sketches
+        if (!recon.fRegistered || recon.fInitiator) {
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
+        }
+        recon.stats.nBytes += nPayload;
+
+        // The transactions of a round the peer gave up on go into this one
+        if (!recon.fSnapshotPending)
+            recon.mapSnapshot.clear();
+        recon.mapSnapshot.insert(recon.mapLocalSet.begin(), recon.mapLocalSet.end());
+        recon.mapLocalSet.clear();
+        recon.fSnapshotPending = true;
+
+        CTxSketch sketch(EstimateSketchCells(recon.mapSnapshot.size(), nRemoteSetSize, nQ));
+        for (const auto& entry : recon.mapSnapshot)
+            sketch.Add(entry.first);
+        CSerializedNetMsg msg = msgMaker.Make(NetMsgType::SKETCH, sketch);
+        recon.stats.nBytes += msg.data.size();
+        connman->PushMessage(pfrom, std::move(msg));
+    }
+
+
+    else if (strCommand == NetMsgType::SKETCH)
+    {
+        const size_t nPayload = vRecv.size();
+        CTxSketch remoteSketch;
+        ReadTimed(vRecv, remoteSketch, nDeserializeMicros);
+
+        std::vector<CInv> vInv;
+        {
+            LOCK(cs_main);
+            CTxReconciliationState& recon = State(pfrom->GetId())->txReconciliation;
+            if (!recon.fRegistered || !recon.fInitiator || recon.nRequestSent == 0) {
+                // A sketch we didn't ask for
+                Misbehaving(pfrom->GetId(), 10);
+                return false;
+            }
+            recon.stats.nBytes += nPayload;
+            recon.nRequestSent = 0;
+            recon.stats.nRounds++;
+
+            std::vector<uint32_t> vOurs, vAsk;
+            bool fSuccess = true;
+            if (remoteSketch.GetCells() > 0) {
+                CTxSketch localSketch(remoteSketch.GetCells());
+                for (const auto& entry : recon.mapLocalSet)
+                    localSketch.Add(entry.first);
+                fSuccess = localSketch.Subtract(remoteSketch) && localSketch.Decode(vOurs, vAsk);
+            }
+            // An empty sketch means the peer has nothing queued, so it lacks everything we have, as it
+            // may when the sketch didn't decode
+            if (remoteSketch.GetCells() == 0 || !fSuccess) {
+                vOurs.clear();
+                vAsk.clear();
+                for (const auto& entry : recon.mapLocalSet)
+                    vOurs.push_back(entry.first);
+            }
+            if (!fSuccess)
+                recon.stats.nFailures++;
+
+            for (uint32_t nShortId : vOurs) {
+                auto it = recon.mapLocalSet.find(nShortId);
+                if (it != recon.mapLocalSet.end())
+                    vInv.push_back(CInv(MSG_TX, it->second));
+            }
+            recon.stats.nTxAnnounced += vInv.size();
+            recon.mapLocalSet.clear();
+
+            CSerializedNetMsg msg = msgMaker.Make(NetMsgType::RECONCILDIFF, fSuccess, vAsk);
+            recon.stats.nBytes += msg.data.size();
+            connman->PushMessage(pfrom, std::move(msg));
+        }
+
+        for (size_t i = 0; i < vInv.size(); i += MAX_INV_SZ) {
+            std::vector<CInv> vChunk(vInv.begin() + i, vInv.begin() + std::min(vInv.size(), i + MAX_INV_SZ));
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vChunk));
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::RECONCILDIFF)
+    {
+        const size_t nPayload = vRecv.size();
+        bool fSuccess;
+        std::vector<uint32_t> vAsk;
+        ReadTimed(vRecv, fSuccess, nDeserializeMicros);
+        ReadTimed(vRecv, vAsk, nDeserializeMicros);
+
+        std::vector<CInv> vInv;
+        {
+            LOCK(cs_main);
+            CTxReconciliationState& recon = State(pfrom->GetId())->txReconciliation;
+            if (!recon.fRegistered || recon.fInitiator || !recon.fSnapshotPending) {
+                Misbehaving(pfrom->GetId(), 10);
+                return false;
+            }
+            recon.stats.nBytes += nPayload;
+            recon.stats.nRounds++;
+
+            if (fSuccess) {
+                for (uint32_t nShortId : vAsk) {
+                    auto it = recon.mapSnapshot.find(nShortId);
+                    if (it != recon.mapSnapshot.end())
+                        vInv.push_back(CInv(MSG_TX, it->second));
+                }
+            } else {
+                recon.stats.nFailures++;
+                for (const auto& entry : recon.mapSnapshot)
+                    vInv.push_back(CInv(MSG_TX, entry.second));
+            }
+            recon.stats.nTxAnnounced += vInv.size();
+            recon.mapSnapshot.clear();
+            recon.fSnapshotPending = false;
+        }
+
+        for (size_t i = 0; i < vInv.size(); i += MAX_INV_SZ) {
+            std::vector<CInv> vChunk(vInv.begin() + i, vInv.begin() + std::min(vInv.size(), i + MAX_INV_SZ));
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vChunk));
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFILTERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        ReadTimed(vRecv, nFilterType, nDeserializeMicros);
+        ReadTimed(vRecv, nStartHeight, nDeserializeMicros);
+        ReadTimed(vRecv, hashStop, nDeserializeMicros);
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, chainparams, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        std::vector<BlockFilter> vFilters;
+        if (!pblockfilterindex->LookupFilterRange(nStartHeight, pindexStop, vFilters)) {
+            LogPrint(BCLog::NET, "Failed to find block filters for block %s, the filter index is still being built\n", hashStop.ToString());
+            return true;
+        }
+
+        const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+        for (const BlockFilter& filter : vFilters)
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        ReadTimed(vRecv, nFilterType, nDeserializeMicros);
+        ReadTimed(vRecv, nStartHeight, nDeserializeMicros);
+        ReadTimed(vRecv, hashStop, nDeserializeMicros);
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, chainparams, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        uint256 prevHeader;
+        if (nStartHeight > 0) {
+            const CBlockIndex* pindexPrev = pindexStop->GetAncestor(nStartHeight - 1);
+            if (!pblockfilterindex->LookupFilterHeader(pindexPrev, prevHeader)) {
+                LogPrint(BCLog::NET, "Failed to find block filter header for block %s, the filter index is still being built\n", pindexPrev->GetIndexHash().ToString());
+                return true;
+            }
+        }
+
+        std::vector<uint256> vFilterHashes;
+        if (!pblockfilterindex->LookupFilterHashRange(nStartHeight, pindexStop, vFilterHashes)) {
+            LogPrint(BCLog::NET, "Failed to find block filter hashes for block %s, the filter index is still being built\n", hashStop.ToString());
+            return true;
+        }
+
+        const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFHEADERS, nFilterType, hashStop, prevHeader, vFilterHashes));
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        uint8_t nFilterType;
+        uint256 hashStop;
+        ReadTimed(vRecv, nFilterType, nDeserializeMicros);
+        ReadTimed(vRecv, hashStop, nDeserializeMicros);
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, chainparams, nFilterType, 0, hashStop, std::numeric_limits<uint32_t>::max(), pindexStop))
+            return true;
+
+        std::vector<uint256> vHeaders(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+        const CBlockIndex* pindex = pindexStop;
+        for (int i = vHeaders.size() - 1; i >= 0; i--) {
+            pindex = pindex->GetAncestor((i + 1) * CFCHECKPT_INTERVAL);
+            if (!pblockfilterindex->LookupFilterHeader(pindex, vHeaders[i])) {
+                LogPrint(BCLog::NET, "Failed to find block filter header for block %s, the filter index is still being built\n", pindex->GetIndexHash().ToString());
+                return true;
+            }
+        }
+
+        const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFCHECKPT, nFilterType, hashStop, vHeaders));
+    }
+
+
     else if (strCommand == NetMsgType::GETBLOCKTXN)
     {
         BlockTransactionsRequest req;
-        vRecv >> req;
+        ReadTimed(vRecv, req, nDeserializeMicros);
 
         std::shared_ptr<const CBlock> recent_block;
         {
@@ -2198,12 +2887,17 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         std::deque<COutPoint> vWorkQueue;
         std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
-        vRecv >> ptx;
+        ReadTimed(vRecv, ptx, nDeserializeMicros);
         const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // The context-free checks need no chain state, so a malformed transaction is
+        // turned away before this handler thread waits for cs_main
+        CValidationState stateCheck;
+        bool fCheckedTx = CheckTransaction(tx, stateCheck, true, true);
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
@@ -2214,7 +2908,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         std::list<CTransactionRef> lRemovedTxn;
 
-        if (!AlreadyHave(inv) &&
+        bool fAlreadyHave = AlreadyHave(inv);
+        if (!fAlreadyHave && !fCheckedTx)
+            state = stateCheck;
+
+        if (!fAlreadyHave && fCheckedTx &&
             AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx, connman);
@@ -2375,7 +3073,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlockHeaderAndShortTxIDs cmpctblock;
-        vRecv >> cmpctblock;
+        ReadTimed(vRecv, cmpctblock, nDeserializeMicros);
 
         bool received_new_header = false;
 
@@ -2490,6 +3188,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     LogPrintf("Peer %d sent us invalid compact block\n", pfrom->GetId());
                     return true;
                 } else if (status == READ_STATUS_FAILED) {
+                    CCompactBlockStats delta;
+                    delta.nBlocks = 1;
+                    delta.nShortIdCollisions = 1;
+                    RecordCompactBlockStats(nodestate, delta);
+
                     // Duplicate txindexes, the block is now in-flight, so just request it
                     std::vector<CInv> vInv(1);
                     vInv[0] = CInv(MSG_BLOCK | GetFetchFlags(pfrom), cmpctblock.header.GetIndexHash());
@@ -2502,6 +3205,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     if (!partialBlock.IsTxAvailable(i))
                         req.indexes.push_back(i);
                 }
+                RecordCompactBlockStats(nodestate, CompactBlockInitStats(partialBlock, req.indexes.size()));
+                if (!req.indexes.empty())
+                    GrowCompactExtraTransactions(req.indexes.size());
                 if (req.indexes.empty()) {
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
@@ -2521,14 +3227,31 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 PartiallyDownloadedBlock tempBlock(&mempool);
                 ReadStatus status = tempBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status != READ_STATUS_OK) {
+                    if (status == READ_STATUS_FAILED) {
+                        CCompactBlockStats delta;
+                        delta.nBlocks = 1;
+                        delta.nShortIdCollisions = 1;
+                        RecordCompactBlockStats(nodestate, delta);
+                    }
                     // TODO: don't ignore failures
                     return true;
                 }
+                size_t nMissing = 0;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!tempBlock.IsTxAvailable(i))
+                        nMissing++;
+                }
+                // Nothing is requested here, the block comes from the peer it is in flight from
+                CCompactBlockStats delta = CompactBlockInitStats(tempBlock, nMissing);
+                delta.nRoundTrips = 0;
+                int64_t nTimeInit = tempBlock.GetTimeInit();
                 std::vector<CTransactionRef> dummy;
                 status = tempBlock.FillBlock(*pblock, dummy);
                 if (status == READ_STATUS_OK) {
                     fBlockReconstructed = true;
+                    SetReconstructionTime(delta, tempBlock, GetTimeMicros() - nTimeInit);
                 }
+                RecordCompactBlockStats(nodestate, delta);
             }
         } else {
             if (fAlreadyInFlight) {
@@ -2546,7 +3269,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         } // cs_main
 
         if (fProcessBLOCKTXN)
-            return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, connman, interruptMsgProc);
+            return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, connman, interruptMsgProc, nDeserializeMicros);
 
         if (fRevertToHeaderProcessing) {
             // Headers received from HB compact block peers are permitted to be
@@ -2596,7 +3319,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         BlockTransactions resp;
-        vRecv >> resp;
+        ReadTimed(vRecv, resp, nDeserializeMicros);
 
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         bool fBlockRead = false;
@@ -2611,7 +3334,13 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             }
 
             PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+            int64_t nTimeInit = partialBlock.GetTimeInit();
             ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn);
+            if (status != READ_STATUS_INVALID && status != READ_STATUS_FAILED) {
+                CCompactBlockStats delta;
+                SetReconstructionTime(delta, partialBlock, GetTimeMicros() - nTimeInit);
+                RecordCompactBlockStats(State(pfrom->GetId()), delta);
+            }
             if (status == READ_STATUS_INVALID) {
                 MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
                 Misbehaving(pfrom->GetId(), 100);
@@ -2680,12 +3409,14 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             Misbehaving(pfrom->GetId(), 20);
             return error("headers message size = %u", nCount);
         }
+        const int64_t nReadStart = GetTimeMicros();
         headers.resize(nCount);
         for (unsigned int n = 0; n < nCount; n++) {
             vRecv >> headers[n];
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
             ReadCompactSize(vRecv); // ignore ref count; assume it is 0.
         }
+        nDeserializeMicros += GetTimeMicros() - nReadStart;
 
         // Headers received via a HEADERS message should be valid, and reflect
         // the chain the peer is on. If we receive a known-invalid header,
@@ -2698,7 +3429,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-        vRecv >> *pblock;
+        ReadTimed(vRecv, *pblock, nDeserializeMicros);
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetIndexHash().ToString(), pfrom->GetId());
 
@@ -2708,6 +3439,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
+            RecordBlockDelivery(pfrom->GetId(), hash);
             forceProcessing |= MarkBlockAsReceived(hash);
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
@@ -2744,7 +3476,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr)
@@ -2855,7 +3590,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::FILTERLOAD && fBIP37)
     {
         CBloomFilter filter;
-        vRecv >> filter;
+        ReadTimed(vRecv, filter, nDeserializeMicros);
 
         if (!filter.IsWithinSizeConstraints())
         {
@@ -3044,9 +3779,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
+    int64_t nDeserializeMicros = 0;
+    CLockHoldTimer csMainTimer;
     try
     {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
+        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc, nDeserializeMicros);
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -3084,8 +3822,10 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (!fRet) {
         LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->GetId());
     }
+    const int64_t nProcessMicros = GetTimeMicros() - nProcessStart;
 
     LOCK(cs_main);
+    RecordMessageCost(State(pfrom->GetId()), strCommand, nProcessMicros, csMainTimer.GetMicros(), nDeserializeMicros);
     SendRejectsAndCheckIfBanned(pfrom, connman);
 
     return fMoreWork;
@@ -3297,6 +4037,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3348,8 +4089,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         }
 
         // Start block sync
-        if (pindexBestHeader == nullptr)
+        if (pindexBestHeader == nullptr) {
             pindexBestHeader = chainActive.Tip();
+            nBestHeaderHeight = chainActive.Height();
+        }
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
         if (!state.fSyncStarted && !pto->fClient && !fImporting && !fReindex) {
             // Only actively request headers from a single peer, unless we're close to today.
@@ -3588,11 +4331,19 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
+                // Produce a queue of candidates for each relay class, dropping the ones no longer in the mempool
+                std::vector<std::set<uint256>::iterator> vInvTx[TX_RELAY_CLASSES];
+                {
+                    LOCK(mempool.cs);
+                    for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); ) {
+                        auto mi = mempool.mapTx.find(*it);
+                        if (mi == mempool.mapTx.end()) {
+                            it = pto->setInventoryTxToSend.erase(it);
+                            continue;
+                        }
+                        vInvTx[mi->GetRelayClass()].push_back(it);
+                        it++;
+                    }
                 }
                 CAmount filterrate = 0;
                 {
@@ -3600,70 +4351,133 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     filterrate = pto->minFeeFilter;
                 }
                 // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
-                // A heap is used so that not all items need sorting if only a few are being sent.
+                // Heaps are used so that not all items need sorting if only a few are being sent.
                 CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                for (auto& vQueue : vInvTx)
+                    std::make_heap(vQueue.begin(), vQueue.end(), compareInvMempoolOrder);
+                TopUpTxRelayAllowance(state, nNow);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    uint256 hash = *it;
-                    // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
-                    // Check if not in the filter already
-                    if (pto->filterInventoryKnown.contains(hash)) {
-                        continue;
-                    }
-                    // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
-                    if (!txinfo.tx) {
-                        continue;
-                    }
-                    if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
-                        continue;
-                    }
-                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
-                    // Send
-                    vInv.push_back(CInv(MSG_TX, hash));
-                    nRelayedTransactions++;
-                    {
-                        // Expire old relay messages
-                        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
-                        {
-                            mapRelay.erase(vRelayExpiration.front().second);
-                            vRelayExpiration.pop_front();
+                // Sends the best transaction of a class that the peer wants, false once the class has none left
+                auto relayFromClass = [&](int nClass) {
+                    std::vector<std::set<uint256>::iterator>& vQueue = vInvTx[nClass];
+                    while (!vQueue.empty()) {
+                        // Fetch the top element from the heap
+                        std::pop_heap(vQueue.begin(), vQueue.end(), compareInvMempoolOrder);
+                        std::set<uint256>::iterator it = vQueue.back();
+                        vQueue.pop_back();
+                        uint256 hash = *it;
+                        // Remove it from the to-be-sent set
+                        pto->setInventoryTxToSend.erase(it);
+                        // Check if not in the filter already
+                        if (pto->filterInventoryKnown.contains(hash)) {
+                            continue;
+                        }
+                        // Not in the mempool anymore? don't bother sending it.
+                        auto txinfo = mempool.info(hash);
+                        if (!txinfo.tx) {
+                            continue;
                         }
+                        if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
+                            continue;
+                        }
+                        if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                        // Send, or queue for the next reconciliation with the peer
+                        CTxReconciliationState& recon = state.txReconciliation;
+                        if (recon.fRegistered && recon.mapLocalSet.size() < MAX_RECON_SET_SIZE &&
+                                recon.mapLocalSet.emplace(GetReconciliationShortId(recon.k0, recon.k1, hash), hash).second) {
+                            recon.stats.nTxQueued++;
+                        } else {
+                            vInv.push_back(CInv(MSG_TX, hash));
+                        }
+                        nRelayedTransactions++;
+                        state.txRelayStats[nClass].nSent++;
+                        if (g_tx_relay_limit[nClass])
+                            state.txRelayAllowance[nClass]--;
+                        {
+                            // Expire old relay messages
+                            while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
+                            {
+                                mapRelay.erase(vRelayExpiration.front().second);
+                                vRelayExpiration.pop_front();
+                            }
 
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
-                        if (ret.second) {
-                            vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
+                            auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                            if (ret.second) {
+                                vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
+                            }
                         }
+                        if (vInv.size() == MAX_INV_SZ) {
+                            connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+                            vInv.clear();
+                        }
+                        pto->filterInventoryKnown.insert(hash);
+                        return true;
                     }
-                    if (vInv.size() == MAX_INV_SZ) {
-                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
-                        vInv.clear();
+                    return false;
+                };
+                // Each class gets its share of the trickle first, so a flood of one class
+                // cannot hold back the others; what a class leaves goes round the rest
+                for (int nClass = 0; nClass < TX_RELAY_CLASSES; nClass++) {
+                    for (unsigned int nQuota = TxRelayQuota(nClass); nQuota > 0 && nRelayedTransactions < INVENTORY_BROADCAST_MAX && HasTxRelayAllowance(state, nClass); nQuota--) {
+                        if (!relayFromClass(nClass))
+                            break;
                     }
-                    pto->filterInventoryKnown.insert(hash);
+                }
+                bool fRelayed = true;
+                while (fRelayed && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
+                    fRelayed = false;
+                    for (int nClass = 0; nClass < TX_RELAY_CLASSES && nRelayedTransactions < INVENTORY_BROADCAST_MAX; nClass++) {
+                        if (HasTxRelayAllowance(state, nClass) && relayFromClass(nClass))
+                            fRelayed = true;
+                    }
+                }
+                for (int nClass = 0; nClass < TX_RELAY_CLASSES; nClass++) {
+                    state.txRelayStats[nClass].nQueued = vInvTx[nClass].size();
+                    if (!vInvTx[nClass].empty() && !HasTxRelayAllowance(state, nClass))
+                        state.txRelayStats[nClass].nRateLimited++;
                 }
             }
         }
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reconciliation request
+        //
+        CTxReconciliationState& recon = state.txReconciliation;
+        if (recon.fRegistered && recon.fInitiator) {
+            // The queued transactions stay for the next request when the peer never answers
+            if (recon.nRequestSent && recon.nRequestSent < nNow - RECON_RESPONSE_TIMEOUT * 1000000LL) {
+                LogPrint(BCLog::NET, "peer=%d did not answer the reconciliation request\n", pto->GetId());
+                recon.nRequestSent = 0;
+            }
+            if (!recon.nRequestSent && recon.nNextRequest < nNow) {
+                uint16_t nSetSize = std::min<size_t>(recon.mapLocalSet.size(), std::numeric_limits<uint16_t>::max());
+                CSerializedNetMsg msg = msgMaker.Make(NetMsgType::REQRECON, nSetSize, (uint16_t)(RECON_Q * RECON_Q_PRECISION));
+                recon.stats.nBytes += msg.data.size();
+                connman->PushMessage(pto, std::move(msg));
+                recon.nRequestSent = nNow;
+                recon.nNextRequest = PoissonNextSend(nNow, RECON_REQUEST_INTERVAL);
+            }
+        }
+
         // Detect whether we're stalling
         nNow = GetTimeMicros();
         if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
-            // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
-            // should only happen during initial block download.
-            LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->GetId());
-            pto->fDisconnect = true;
-            return true;
+            // the download window should be much larger than the to-be-downloaded set of blocks, so this
+            // should only happen during initial block download. The blocks of the peer go to the other
+            // peers, and a peer that keeps stalling is disconnected.
+            if (state.nBlockStalls >= MAX_BLOCK_STALLS) {
+                LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->GetId());
+                pto->fDisconnect = true;
+                return true;
+            }
+            LogPrint(BCLog::NET, "Peer=%d is stalling block download, giving its %d blocks in flight to other peers\n", pto->GetId(), state.nBlocksInFlight);
+            ReassignStalledBlocks(pto->GetId());
         }
         // In case there is a block that has been in flight from this peer for 2 + 0.5 * N times the block interval
         // (with N the number of peers from which we're downloading validated blocks), disconnect due to timeout.
@@ -3720,10 +4534,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nBlockRequestLimit && nNow >= state.nBlockRequestsPausedUntil) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), state.nBlockRequestLimit - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetIndexHash()));
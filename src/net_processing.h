@@ -10,6 +10,9 @@
 #include "net.h"
 #include "validationinterface.h"
 #include "consensus/params.h"
+#include "policy/policy.h"
+
+#include <boost/signals2/connection.hpp>
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
@@ -19,6 +22,8 @@ static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** The extra txn pool grows after reconstructions that needed a round trip, up to this many times its configured size */
+static const unsigned int BLOCK_RECONSTRUCTION_EXTRA_TXN_MAX_GROWTH = 4;
 /** Headers download timeout expressed in microseconds
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
@@ -68,17 +73,112 @@ public:
 
 private:
     int64_t m_stale_tip_check_time; //!< Next time to check for stale tip
+    boost::signals2::scoped_connection m_evicted_connection; //!< Keeps evicted token transactions for reconstruction
+};
+
+/** Compact block reconstruction counters, of one peer or of all of them */
+struct CCompactBlockStats {
+    uint64_t nBlocks = 0;              //!< compact blocks reconstruction was started for
+    uint64_t nReconstructed = 0;       //!< blocks reconstructed from a compact block
+    uint64_t nRoundTrips = 0;          //!< getblocktxn requests needed for missing transactions
+    uint64_t nShortIdCollisions = 0;   //!< compact blocks given up for a full block because short ids collided
+    uint64_t nTxPrefilled = 0;
+    uint64_t nTxFromMempool = 0;
+    uint64_t nTxFromExtra = 0;         //!< transactions found in the extra txn pool only
+    uint64_t nTxMissing = 0;
+    int64_t nReconstructionMicros = 0; //!< total time from receiving compact blocks to having them reconstructed
+    uint64_t nStakedReconstructed = 0; //!< of nReconstructed, the proof-of-stake blocks sent with their coinstake
+    int64_t nStakedReconstructionMicros = 0;
+
+    CCompactBlockStats& operator+=(const CCompactBlockStats& other);
+};
+
+/** Transaction announcements to one peer of one TxRelayClass */
+struct CTxRelayClassStats {
+    uint64_t nSent = 0;        //!< invs sent
+    uint64_t nRateLimited = 0; //!< trickles that left invs waiting for the rate limit of the class
+    uint64_t nQueued = 0;      //!< invs waiting after the last trickle
+};
+
+/** Transaction set reconciliation with one peer, or with all of them */
+struct CTxReconciliationStats {
+    uint64_t nRounds = 0;      //!< reconciliation rounds finished
+    uint64_t nFailures = 0;    //!< rounds whose sketch didn't decode, which announced the whole sets
+    uint64_t nTxQueued = 0;    //!< transactions queued for reconciliation instead of announced by inv
+    uint64_t nTxAnnounced = 0; //!< invs sent once reconciliation found the peer lacked them
+    uint64_t nBytes = 0;       //!< payload of the reqrecon, sketch and reconcildiff messages sent and received
+
+    //! What the invs of the queued transactions would have taken, less the invs and messages reconciling took
+    int64_t GetBytesSaved() const;
+
+    CTxReconciliationStats& operator+=(const CTxReconciliationStats& other);
 };
 
+/** Upper bounds, in microseconds, of the buckets of the message handling time histogram; the last bucket takes the rest */
+static const int64_t MSG_COST_BUCKET_BOUNDS[] = {10, 100, 1000, 10000, 100000, 1000000};
+static const int MSG_COST_BUCKETS = sizeof(MSG_COST_BUCKET_BOUNDS) / sizeof(MSG_COST_BUCKET_BOUNDS[0]) + 1;
+
+/** What handling the messages of one command took, of one peer or of all of them */
+struct CMessageCost {
+    uint64_t nMessages = 0;
+    int64_t nMicros = 0;            //!< handling time, deserialization and waiting for locks included
+    int64_t nMaxMicros = 0;
+    int64_t nCsMainMicros = 0;      //!< time cs_main was held while handling
+    int64_t nDeserializeMicros = 0; //!< time reading the payload of the larger messages
+    uint64_t vBuckets[MSG_COST_BUCKETS] = {};
+
+    void Add(int64_t nMicrosIn, int64_t nCsMainMicrosIn, int64_t nDeserializeMicrosIn);
+};
+
+/** Message handling costs by command, messages of unknown commands counted as NET_MESSAGE_COMMAND_OTHER */
+typedef std::map<std::string, CMessageCost> mapMsgCmdCost;
+
 struct CNodeStateStats {
     int nMisbehavior;
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    CCompactBlockStats compactBlockStats;
+    CTxRelayClassStats txRelayStats[TX_RELAY_CLASSES];
+    mapMsgCmdCost mapMessageCost;
+};
+
+/** Block download from one peer */
+struct CBlockDownloadPeerStats {
+    NodeId nodeid;
+    int nBlocksInFlight;
+    int nBlockRequestLimit;      //!< blocks the peer may have in flight
+    int nWindow;                 //!< how far beyond its last block in common with us the peer is asked for blocks
+    uint64_t nBlocksReceived;
+    int64_t nLatencyAvgMicros;   //!< from request to receipt of a block
+    int64_t nLatencyMinMicros;
+    int64_t nIntervalAvgMicros;  //!< between blocks received while more were in flight
+    int nStalls;                 //!< times the peer stalled the download window
+    uint64_t nBlocksReassigned;  //!< blocks given to other peers for it
+};
+
+/** Block download from all peers */
+struct CBlockDownloadStats {
+    int nBlocksInFlight = 0;
+    int nHighestInFlight = -1;   //!< height of the highest block in flight, or -1
+    int nPeersDownloading = 0;
+    uint64_t nStalls = 0;
+    uint64_t nBlocksReassigned = 0;
+    std::vector<CBlockDownloadPeerStats> vPeers;
 };
 
+/** Get the block download statistics, of the peers that have received or have blocks in flight */
+void GetBlockDownloadStats(CBlockDownloadStats& stats);
+/** Set up the shares and rate limits of the transaction relay classes from -txrelayshare and -txrelaylimit */
+bool InitTxRelayClasses(std::string& strError);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/** Get the message handling costs of all peers, disconnected ones included */
+void GetMessageCosts(mapMsgCmdCost& mapCosts);
+/** Get the reconciliation statistics of all peers, disconnected ones included, and of each connected peer that reconciles */
+void GetTxReconciliationStats(CTxReconciliationStats& stats, std::vector<std::pair<NodeId, CTxReconciliationStats>>& vPeers);
+/** Get the compact block statistics of all peers, and the size and capacity of the extra txn pool */
+void GetCompactBlockStats(CCompactBlockStats& stats, size_t& nExtraTxn, size_t& nExtraTxnCapacity);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
@@ -0,0 +1,200 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netevents.h"
+
+#include "netbase.h"
+#include "util.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+/** Fewest events taken from the kernel per wait */
+static const size_t MIN_SOCKET_EVENTS = 64;
+
+const char* CSocketEvents::Backend()
+{
+#if defined(USE_EPOLL)
+    return "epoll";
+#elif defined(USE_KQUEUE)
+    return "kqueue";
+#else
+    return "select";
+#endif
+}
+
+CSocketEvents::CSocketEvents()
+{
+#if defined(USE_EPOLL)
+    fdEvents = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(USE_KQUEUE)
+    fdEvents = kqueue();
+#endif
+#ifdef USE_SOCKET_EVENTS
+    if (fdEvents < 0)
+        LogPrintf("%s: cannot create the %s instance: %s\n", __func__, Backend(), NetworkErrorString(WSAGetLastError()));
+#endif
+}
+
+CSocketEvents::~CSocketEvents()
+{
+#ifdef USE_SOCKET_EVENTS
+    if (fdEvents >= 0)
+        close(fdEvents);
+#endif
+}
+
+void CSocketEvents::Register(SOCKET s, uint8_t nOldEvents, bool fNew, uint8_t nEvents)
+{
+#if defined(USE_EPOLL)
+    struct epoll_event event = {};
+    event.data.fd = s;
+    if (nEvents & RECV)
+        event.events |= EPOLLIN;
+    if (nEvents & SEND)
+        event.events |= EPOLLOUT;
+    // The kernel drops a socket once it is closed, so the number may be
+    // registered to a new socket or to nothing by now
+    if (epoll_ctl(fdEvents, fNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, s, &event) != 0) {
+        if (errno == EEXIST)
+            epoll_ctl(fdEvents, EPOLL_CTL_MOD, s, &event);
+        else if (errno == ENOENT)
+            epoll_ctl(fdEvents, EPOLL_CTL_ADD, s, &event);
+    }
+#elif defined(USE_KQUEUE)
+    if (fNew)
+        nOldEvents = NONE;
+    const std::pair<uint8_t, short> filters[] = {{RECV, EVFILT_READ}, {SEND, EVFILT_WRITE}};
+    for (const auto& filter : filters) {
+        if ((nEvents & filter.first) == (nOldEvents & filter.first))
+            continue;
+        struct kevent change;
+        EV_SET(&change, s, filter.second, (nEvents & filter.first) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        // Deleting a filter the kernel already dropped with the closed socket fails harmlessly
+        kevent(fdEvents, &change, 1, nullptr, 0, nullptr);
+    }
+#endif
+}
+
+void CSocketEvents::Unregister(SOCKET s, uint8_t nOldEvents)
+{
+#if defined(USE_EPOLL)
+    // Fails harmlessly for a socket that is closed already
+    struct epoll_event event = {};
+    epoll_ctl(fdEvents, EPOLL_CTL_DEL, s, &event);
+#elif defined(USE_KQUEUE)
+    Register(s, nOldEvents, false, NONE);
+#endif
+}
+
+void CSocketEvents::Update(const std::map<SOCKET, Interest>& mapWanted)
+{
+    auto itOld = mapRegistered.begin();
+    for (const auto& wanted : mapWanted) {
+        while (itOld != mapRegistered.end() && itOld->first < wanted.first) {
+            Unregister(itOld->first, itOld->second.nEvents);
+            itOld = mapRegistered.erase(itOld);
+        }
+        if (itOld != mapRegistered.end() && itOld->first == wanted.first) {
+            const bool fNew = itOld->second.nOwner != wanted.second.nOwner;
+            if (fNew || itOld->second.nEvents != wanted.second.nEvents) {
+                Register(wanted.first, itOld->second.nEvents, fNew, wanted.second.nEvents);
+                itOld->second = wanted.second;
+            }
+            ++itOld;
+        } else {
+            Register(wanted.first, NONE, true, wanted.second.nEvents);
+            mapRegistered.emplace_hint(itOld, wanted);
+        }
+    }
+    while (itOld != mapRegistered.end()) {
+        Unregister(itOld->first, itOld->second.nEvents);
+        itOld = mapRegistered.erase(itOld);
+    }
+}
+
+bool CSocketEvents::Wait(int64_t nTimeoutMs, std::map<SOCKET, uint8_t>& mapReady)
+{
+    mapReady.clear();
+#if defined(USE_EPOLL)
+    if (fdEvents < 0)
+        return false;
+    std::vector<struct epoll_event> vEvents(std::max(MIN_SOCKET_EVENTS, mapRegistered.size()));
+    int nEvents = epoll_wait(fdEvents, vEvents.data(), vEvents.size(), nTimeoutMs);
+    if (nEvents < 0)
+        return errno == EINTR;
+    for (int i = 0; i < nEvents; i++) {
+        uint8_t& nReady = mapReady[vEvents[i].data.fd];
+        if (vEvents[i].events & EPOLLIN)
+            nReady |= RECV;
+        if (vEvents[i].events & EPOLLOUT)
+            nReady |= SEND;
+        if (vEvents[i].events & (EPOLLERR | EPOLLHUP))
+            nReady |= ERR;
+    }
+#elif defined(USE_KQUEUE)
+    if (fdEvents < 0)
+        return false;
+    std::vector<struct kevent> vEvents(std::max(MIN_SOCKET_EVENTS, 2 * mapRegistered.size()));
+    struct timespec timeout;
+    timeout.tv_sec = nTimeoutMs / 1000;
+    timeout.tv_nsec = (nTimeoutMs % 1000) * 1000000;
+    int nEvents = kevent(fdEvents, nullptr, 0, vEvents.data(), vEvents.size(), &timeout);
+    if (nEvents < 0)
+        return errno == EINTR;
+    for (int i = 0; i < nEvents; i++) {
+        uint8_t& nReady = mapReady[vEvents[i].ident];
+        if (vEvents[i].filter == EVFILT_READ)
+            nReady |= RECV;
+        if (vEvents[i].filter == EVFILT_WRITE)
+            nReady |= SEND;
+        if (vEvents[i].flags & (EV_EOF | EV_ERROR))
+            nReady |= ERR;
+    }
+#else
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    for (const auto& registered : mapRegistered) {
+        if (registered.second.nEvents & RECV)
+            FD_SET(registered.first, &fdsetRecv);
+        if (registered.second.nEvents & SEND)
+            FD_SET(registered.first, &fdsetSend);
+        FD_SET(registered.first, &fdsetError);
+        hSocketMax = std::max(hSocketMax, registered.first);
+    }
+
+    struct timeval timeout = MillisToTimeval(nTimeoutMs);
+    int nSelect = select(mapRegistered.empty() ? 0 : hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (nSelect == SOCKET_ERROR) {
+        // Have every socket read, so the one that broke the wait finds out
+        for (const auto& registered : mapRegistered)
+            mapReady[registered.first] = RECV;
+        return false;
+    }
+    for (const auto& registered : mapRegistered) {
+        uint8_t nReady = NONE;
+        if (FD_ISSET(registered.first, &fdsetRecv))
+            nReady |= RECV;
+        if (FD_ISSET(registered.first, &fdsetSend))
+            nReady |= SEND;
+        if (FD_ISSET(registered.first, &fdsetError))
+            nReady |= ERR;
+        if (nReady != NONE)
+            mapReady[registered.first] = nReady;
+    }
+#endif
+    return true;
+}
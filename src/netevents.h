@@ -0,0 +1,65 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_NETEVENTS_H
+#define PLB_NETEVENTS_H
+
+#include "compat.h"
+
+#include <map>
+#include <stdint.h>
+
+/**
+ * Waits for the sockets of the socket handler to become readable or writable.
+ *
+ * With epoll (Linux) or kqueue (BSD, macOS) the sockets stay registered with the
+ * kernel between waits and only a change in what a socket waits for costs a
+ * system call, so idle connections add nothing to a wait. Elsewhere the fd_sets
+ * of select() are rebuilt for every wait.
+ */
+class CSocketEvents
+{
+public:
+    enum : uint8_t {
+        NONE = 0,
+        RECV = (1U << 0),
+        SEND = (1U << 1),
+        ERR  = (1U << 2),
+    };
+
+    /** What a socket is waited for, and who it belongs to; a socket number reused by a new owner is registered afresh */
+    struct Interest
+    {
+        int64_t nOwner;
+        uint8_t nEvents;
+    };
+
+    CSocketEvents();
+    ~CSocketEvents();
+    CSocketEvents(const CSocketEvents&) = delete;
+    CSocketEvents& operator=(const CSocketEvents&) = delete;
+
+    /** "epoll", "kqueue" or "select" */
+    static const char* Backend();
+
+    /**
+     * Makes mapWanted the sockets waited on, each for RECV, SEND or only for
+     * errors (NONE). Sockets left out are no longer waited on.
+     */
+    void Update(const std::map<SOCKET, Interest>& mapWanted);
+
+    /** Waits up to nTimeoutMs for the sockets; mapReady gets the events of each ready one. False on failure */
+    bool Wait(int64_t nTimeoutMs, std::map<SOCKET, uint8_t>& mapReady);
+
+private:
+    std::map<SOCKET, Interest> mapRegistered;
+#ifdef USE_SOCKET_EVENTS
+    int fdEvents;
+#endif
+
+    void Register(SOCKET s, uint8_t nOldEvents, bool fNew, uint8_t nEvents);
+    void Unregister(SOCKET s, uint8_t nOldEvents);
+};
+
+#endif // PLB_NETEVENTS_H
@@ -16,6 +16,7 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <ctype.h>
 #include <stdio.h>
 
 #include <event2/buffer.h>
@@ -27,6 +28,9 @@
 static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
 static const bool DEFAULT_NAMED=false;
+static const int DEFAULT_BATCH_SIZE=1;
+//! Requests -batch queues on its connection before waiting for the replies
+static const int BATCH_PIPELINE_DEPTH=16;
 static const int CONTINUE_EXECUTION=-1;
 
 std::string HelpMessageCli()
@@ -49,6 +53,8 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcclienttimeout=<n>", strprintf(_("Timeout in seconds during HTTP requests, or 0 for no timeout. (default: %d)"), DEFAULT_HTTP_CLIENT_TIMEOUT));
     strUsage += HelpMessageOpt("-stdinrpcpass", strprintf(_("Read RPC password from standard input as a single line.  When combined with -stdin, the first line from standard input is used for the RPC password.")));
     strUsage += HelpMessageOpt("-stdin", _("Read extra arguments from standard input, one per line until EOF/Ctrl-D (recommended for sensitive information such as passphrases).  When combined with -stdinrpcpass, the first line from standard input is used for the RPC password."));
+    strUsage += HelpMessageOpt("-batch", _("Read commands from standard input, one per line with its arguments separated by spaces and quoted with ' or \" where needed, until EOF/Ctrl-D. They are sent over one connection and their results printed in order; lines that are empty or start with # are skipped"));
+    strUsage += HelpMessageOpt("-batchsize=<n>", strprintf(_("With -batch, send up to <n> commands per JSON-RPC batch request (default: %d)"), DEFAULT_BATCH_SIZE));
     strUsage += HelpMessageOpt("-rpcwallet=<walletname>", _("Send RPC for non-default wallet on RPC server (argument is wallet filename in paladeumd directory, required if paladeumd/-Qt runs with multiple wallets)"));
 
     return strUsage;
@@ -131,11 +137,14 @@ static int AppInitRPC(int argc, char* argv[])
 /** Reply structure for request_done to fill in */
 struct HTTPReply
 {
-    HTTPReply(): status(0), error(-1) {}
+    HTTPReply(): status(0), error(-1), base(nullptr), pnPending(nullptr) {}
 
     int status;
     int error;
     std::string body;
+    //! When set, the event loop of base is left once the last of *pnPending requests is done
+    struct event_base* base;
+    int* pnPending;
 };
 
 const char *http_errorstring(int code)
@@ -169,20 +178,23 @@ static void http_request_done(struct evhttp_request *req, void *ctx)
          * error code will have been passed to http_error_cb.
          */
         reply->status = 0;
-        return;
+    } else {
+        reply->status = evhttp_request_get_response_code(req);
+
+        struct evbuffer *buf = evhttp_request_get_input_buffer(req);
+        if (buf)
+        {
+            size_t size = evbuffer_get_length(buf);
+            const char *data = (const char*)evbuffer_pullup(buf, size);
+            if (data)
+                reply->body = std::string(data, size);
+            evbuffer_drain(buf, size);
+        }
     }
 
-    reply->status = evhttp_request_get_response_code(req);
-
-    struct evbuffer *buf = evhttp_request_get_input_buffer(req);
-    if (buf)
-    {
-        size_t size = evbuffer_get_length(buf);
-        const char *data = (const char*)evbuffer_pullup(buf, size);
-        if (data)
-            reply->body = std::string(data, size);
-        evbuffer_drain(buf, size);
-    }
+    // A kept alive connection stays in the event loop, which would not return by itself
+    if (reply->pnPending && --*reply->pnPending == 0)
+        event_base_loopexit(reply->base, nullptr);
 }
 
 #if LIBEVENT_VERSION_NUMBER >= 0x02010300
@@ -283,31 +295,25 @@ public:
     }
 };
 
-static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+/** Where the RPC server is and how to authenticate to it */
+struct RPCServer
 {
     std::string host;
+    int port;
+    std::string strAuthorization;
+    std::string strEndpoint;
+};
+
+static RPCServer GetRPCServer()
+{
+    RPCServer server;
     // In preference order, we choose the following for the port:
     //     1. -rpcport
     //     2. port in -rpcconnect (ie following : in ipv4 or ]: in ipv6)
     //     3. default port for chain
-    int port = BaseParams().RPCPort();
-    SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), port, host);
-    port = gArgs.GetArg("-rpcport", port);
-
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
-
-    // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
-    evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
-
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == nullptr)
-        throw std::runtime_error("create http request failed");
-#if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
-#endif
+    server.port = BaseParams().RPCPort();
+    SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), server.port, server.host);
+    server.port = gArgs.GetArg("-rpcport", server.port);
 
     // Get credentials
     std::string strRPCUserColonPass;
@@ -322,40 +328,55 @@ static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, co
     } else {
         strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
     }
-
-    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = rh->PrepareRequest(strMethod, args).write() + "\n";
-    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+    server.strAuthorization = std::string("Basic ") + EncodeBase64(strRPCUserColonPass);
 
     // check if we should use a special wallet endpoint
-    std::string endpoint = "/";
+    server.strEndpoint = "/";
     std::string walletName = gArgs.GetArg("-rpcwallet", "");
     if (!walletName.empty()) {
         char *encodedURI = evhttp_uriencode(walletName.c_str(), walletName.size(), false);
         if (encodedURI) {
-            endpoint = "/wallet/"+ std::string(encodedURI);
+            server.strEndpoint = "/wallet/"+ std::string(encodedURI);
             free(encodedURI);
         }
         else {
             throw CConnectionFailed("uri-encode failed");
         }
     }
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
+    return server;
+}
+
+/** Queue a JSON-RPC request on evcon; reply is filled in by the event loop */
+static void SendRPCRequest(struct evhttp_connection* evcon, const RPCServer& server, const std::string& strRequest, HTTPReply* reply, bool fKeepAlive)
+{
+    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)reply);
+    if (req == nullptr)
+        throw std::runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+    evhttp_request_set_error_cb(req.get(), http_error_cb);
+#endif
+
+    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+    assert(output_headers);
+    evhttp_add_header(output_headers, "Host", server.host.c_str());
+    evhttp_add_header(output_headers, "Connection", fKeepAlive ? "keep-alive" : "close");
+    evhttp_add_header(output_headers, "Authorization", server.strAuthorization.c_str());
+
+    // Attach request data
+    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+    assert(output_buffer);
+    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+    int r = evhttp_make_request(evcon, req.get(), EVHTTP_REQ_POST, server.strEndpoint.c_str());
     req.release(); // ownership moved to evcon in above call
     if (r != 0) {
         throw CConnectionFailed("send http request failed");
     }
+}
 
-    event_base_dispatch(base.get());
-
+/** Throw if the request failed on the way, otherwise parse the JSON of the reply */
+static UniValue ParseHTTPReply(const HTTPReply& response)
+{
     if (response.status == 0)
         throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
     else if (response.status == HTTP_UNAUTHORIZED)
@@ -369,13 +390,193 @@ static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, co
     UniValue valReply(UniValue::VSTR);
     if (!valReply.read(response.body))
         throw std::runtime_error("couldn't parse reply from server");
-    const UniValue reply = rh->ProcessReply(valReply);
+    return valReply;
+}
+
+static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+{
+    const RPCServer server = GetRPCServer();
+
+    // Obtain event base
+    raii_event_base base = obtain_event_base();
+
+    // Synchronously look up hostname
+    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), server.host, server.port);
+    evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+
+    HTTPReply response;
+    SendRPCRequest(evcon.get(), server, rh->PrepareRequest(strMethod, args).write() + "\n", &response, false);
+
+    event_base_dispatch(base.get());
+
+    const UniValue reply = rh->ProcessReply(ParseHTTPReply(response));
     if (reply.empty())
         throw std::runtime_error("expected reply to have result, error and id properties");
 
     return reply;
 }
 
+/** Print form of a JSON-RPC reply, and the exit code it stands for */
+static int FormatReply(const UniValue& reply, std::string& strPrint)
+{
+    const UniValue& result = find_value(reply, "result");
+    const UniValue& error  = find_value(reply, "error");
+
+    if (!error.isNull()) {
+        // Error
+        int code = error["code"].get_int();
+        strPrint = "error: " + error.write();
+        if (error.isObject())
+        {
+            UniValue errCode = find_value(error, "code");
+            UniValue errMsg  = find_value(error, "message");
+            strPrint = errCode.isNull() ? "" : "error code: "+errCode.getValStr()+"\n";
+
+            if (errMsg.isStr())
+                strPrint += "error message:\n"+errMsg.get_str();
+
+            if (errCode.isNum() && errCode.get_int() == RPC_WALLET_NOT_SPECIFIED) {
+                strPrint += "\nTry adding \"-rpcwallet=<filename>\" option to paladeum-cli command line.";
+            }
+        }
+        return abs(code);
+    }
+
+    // Result
+    if (result.isNull())
+        strPrint = "";
+    else if (result.isStr())
+        strPrint = result.get_str();
+    else
+        strPrint = result.write(2);
+    return 0;
+}
+
+/** Split a -batch line into its words, taking quoted parts as they are; false on an unclosed quote */
+static bool SplitCommandLine(const std::string& line, std::vector<std::string>& args)
+{
+    args.clear();
+    std::string word;
+    bool fWord = false;
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+        const char c = line[i];
+        if (quote) {
+            if (c == quote)
+                quote = 0;
+            else if (quote == '"' && c == '\\' && i + 1 < line.size() && (line[i + 1] == '"' || line[i + 1] == '\\'))
+                word += line[++i];
+            else
+                word += c;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            fWord = true;
+        } else if (isspace((unsigned char)c)) {
+            if (fWord)
+                args.push_back(word);
+            word.clear();
+            fWord = false;
+        } else {
+            word += c;
+            fWord = true;
+        }
+    }
+    if (fWord)
+        args.push_back(word);
+    return quote == 0;
+}
+
+/**
+ * Run the commands on standard input over one kept alive connection. Up to BATCH_PIPELINE_DEPTH
+ * requests, of -batchsize commands each, are queued on it at a time, so reading input and
+ * authenticating are not paid once per command; the replies come back in order. A command that
+ * fails prints its error and the rest still run; the exit code is that of the last failure.
+ */
+static int CommandLineBatchRPC()
+{
+    const RPCServer server = GetRPCServer();
+    raii_event_base base = obtain_event_base();
+    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), server.host, server.port);
+    evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+
+    const size_t nBatchSize = std::max<int64_t>(gArgs.GetArg("-batchsize", DEFAULT_BATCH_SIZE), 1);
+    const bool fNamed = gArgs.GetBoolArg("-named", DEFAULT_NAMED);
+    int nRet = 0;
+    bool fEOF = false;
+    while (!fEOF) {
+        // The replies of a window of commands, by position; those that could not be sent are filled in up front
+        std::vector<UniValue> vReplies;
+        std::vector<std::vector<size_t>> vRequestCommands;
+        std::vector<UniValue> vRequests;
+        std::string line;
+        while (vReplies.size() < BATCH_PIPELINE_DEPTH * nBatchSize) {
+            if (!std::getline(std::cin, line)) {
+                fEOF = true;
+                break;
+            }
+            std::vector<std::string> args;
+            const bool fQuoted = SplitCommandLine(line, args);
+            if (fQuoted && (args.empty() || args[0][0] == '#'))
+                continue;
+
+            const size_t nCommand = vReplies.size();
+            vReplies.push_back(NullUniValue);
+            try {
+                if (!fQuoted)
+                    throw std::runtime_error("unterminated quote");
+                const std::string method = args[0];
+                args.erase(args.begin());
+                const UniValue params = fNamed ? RPCConvertNamedValues(method, args) : RPCConvertValues(method, args);
+                if (vRequestCommands.empty() || vRequestCommands.back().size() >= nBatchSize) {
+                    vRequestCommands.emplace_back();
+                    vRequests.emplace_back(UniValue::VARR);
+                }
+                vRequestCommands.back().push_back(nCommand);
+                vRequests.back().push_back(JSONRPCRequestObj(method, params, (int)nCommand));
+            } catch (const std::exception& e) {
+                vReplies[nCommand] = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_INVALID_PARAMETER, e.what()), (int)nCommand);
+            }
+        }
+
+        std::vector<HTTPReply> vResponses(vRequests.size());
+        int nPending = vRequests.size();
+        for (size_t i = 0; i < vRequests.size(); i++) {
+            vResponses[i].base = base.get();
+            vResponses[i].pnPending = &nPending;
+            const UniValue& request = nBatchSize == 1 ? vRequests[i][0] : vRequests[i];
+            SendRPCRequest(evcon.get(), server, request.write() + "\n", &vResponses[i], true);
+        }
+        if (nPending > 0)
+            event_base_dispatch(base.get());
+
+        for (size_t i = 0; i < vRequests.size(); i++) {
+            const UniValue valReply = ParseHTTPReply(vResponses[i]);
+            if (nBatchSize == 1) {
+                vReplies[vRequestCommands[i][0]] = valReply;
+                continue;
+            }
+            std::vector<UniValue> vBatch = JSONRPCProcessBatchReply(valReply, vReplies.size());
+            for (size_t nCommand : vRequestCommands[i]) {
+                vReplies[nCommand] = vBatch[nCommand];
+                if (vReplies[nCommand].isNull())
+                    vReplies[nCommand] = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_MISC_ERROR, "no reply in the batch"), (int)nCommand);
+            }
+        }
+
+        for (const UniValue& reply : vReplies) {
+            std::string strPrint;
+            const int nReplyRet = FormatReply(reply, strPrint);
+            if (nReplyRet != 0)
+                nRet = nReplyRet;
+            if (strPrint != "")
+                fprintf((nReplyRet == 0 ? stdout : stderr), "%s\n", strPrint.c_str());
+        }
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return nRet;
+}
+
 int CommandLineRPC(int argc, char *argv[])
 {
     std::string strPrint;
@@ -393,6 +594,11 @@ int CommandLineRPC(int argc, char *argv[])
             }
             gArgs.ForceSetArg("-rpcpassword", rpcPass);
         }
+        if (gArgs.GetBoolArg("-batch", false)) {
+            if (gArgs.GetBoolArg("-stdin", false) || gArgs.GetBoolArg("-getinfo", false) || argc > 1)
+                throw std::runtime_error("-batch takes its commands from standard input, not with -stdin, -getinfo or on the command line");
+            return CommandLineBatchRPC();
+        }
         std::vector<std::string> args = std::vector<std::string>(&argv[1], &argv[argc]);
         if (gArgs.GetBoolArg("-stdin", false)) {
             // Read one arg per line from stdin and append
@@ -421,39 +627,10 @@ int CommandLineRPC(int argc, char *argv[])
             try {
                 const UniValue reply = CallRPC(rh.get(), method, args);
 
-                // Parse reply
-                const UniValue& result = find_value(reply, "result");
-                const UniValue& error  = find_value(reply, "error");
-
-                if (!error.isNull()) {
-                    // Error
-                    int code = error["code"].get_int();
-                    if (fWait && code == RPC_IN_WARMUP)
-                        throw CConnectionFailed("server in warmup");
-                    strPrint = "error: " + error.write();
-                    nRet = abs(code);
-                    if (error.isObject())
-                    {
-                        UniValue errCode = find_value(error, "code");
-                        UniValue errMsg  = find_value(error, "message");
-                        strPrint = errCode.isNull() ? "" : "error code: "+errCode.getValStr()+"\n";
-
-                        if (errMsg.isStr())
-                            strPrint += "error message:\n"+errMsg.get_str();
-
-                        if (errCode.isNum() && errCode.get_int() == RPC_WALLET_NOT_SPECIFIED) {
-                            strPrint += "\nTry adding \"-rpcwallet=<filename>\" option to paladeum-cli command line.";
-                        }
-                    }
-                } else {
-                    // Result
-                    if (result.isNull())
-                        strPrint = "";
-                    else if (result.isStr())
-                        strPrint = result.get_str();
-                    else
-                        strPrint = result.write(2);
-                }
+                const UniValue& error = find_value(reply, "error");
+                if (fWait && !error.isNull() && error["code"].get_int() == RPC_IN_WARMUP)
+                    throw CConnectionFailed("server in warmup");
+                nRet = FormatReply(reply, strPrint);
                 // Connection succeeded, no need to retry.
                 break;
             }
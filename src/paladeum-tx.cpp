@@ -18,11 +18,13 @@
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "tokens/tokens.h"
 #include <univalue.h>
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 
+#include <ctype.h>
 #include <stdio.h>
 
 #include <boost/algorithm/string.hpp>
@@ -59,6 +61,7 @@ static int AppInitRawTx(int argc, char* argv[])
             _("Usage:") + "\n" +
               "  paladeum-tx [options] <hex-tx> [commands]  " + _("Update hex-encoded paladeum transaction") + "\n" +
               "  paladeum-tx [options] -create [commands]   " + _("Create hex-encoded paladeum transaction") + "\n" +
+              "  paladeum-tx [options] -stream <hex-tx|-create> [commands]  " + _("Apply the commands of every line of standard input to the transaction") + "\n" +
               "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
@@ -67,6 +70,8 @@ static int AppInitRawTx(int argc, char* argv[])
         strUsage += HelpMessageOpt("-?", _("This help message"));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
+        strUsage += HelpMessageOpt("-stream", _("Read commands from standard input, one transaction per line, the commands of a line separated by commas. "
+            "Each line starts from the transaction the command line builds, and every result is written on its own line"));
         strUsage += HelpMessageOpt("-txid", _("Output only the hex-encoded transaction id of the resultant transaction."));
         AppendParamsHelpMessages(strUsage);
 
@@ -90,6 +95,15 @@ static int AppInitRawTx(int argc, char* argv[])
         strUsage += HelpMessageOpt("outmultisig=VALUE:REQUIRED:PUBKEYS:PUBKEY1:PUBKEY2:....[:FLAGS]", _("Add Pay To n-of-m Multi-sig output to TX. n = REQUIRED, m = PUBKEYS") + ". " +
             _("Optionally add the \"W\" flag to produce a pay-to-witness-script-hash output") + ". " +
             _("Optionally add the \"S\" flag to wrap the output in a pay-to-script-hash."));
+        strUsage += HelpMessageOpt("outtoken=NAME:AMOUNT:ADDRESS[:TIMELOCK]", _("Add token transfer output to TX"));
+        strUsage += HelpMessageOpt("outowner=NAME:ADDRESS", _("Add the owner token output of token NAME to TX"));
+        strUsage += HelpMessageOpt("outissue=NAME:AMOUNT:ADDRESS[:UNITS[:REISSUABLE[:IPFS]]]", _("Add new token output to TX, which must be the last output") + ". " +
+            _("The burn output and, for root and sub tokens, the owner outputs must be added with outaddr and outowner"));
+        strUsage += HelpMessageOpt("outreissue=NAME:AMOUNT:ADDRESS[:REISSUABLE[:UNITS[:IPFS]]]", _("Add token reissue output to TX, which must be the last output") + ". " +
+            _("UNITS of -1 keep the current units"));
+        strUsage += HelpMessageOpt("outtag=TOKEN:ADDRESS:FLAG", _("Add output tagging (FLAG 1) or untagging (FLAG 0) ADDRESS with qualifier TOKEN, or freezing it for restricted TOKEN"));
+        strUsage += HelpMessageOpt("outfreeze=TOKEN:FLAG", _("Add output freezing (FLAG 1) or unfreezing (FLAG 0) restricted TOKEN globally"));
+        strUsage += HelpMessageOpt("outverifier=STRING", _("Add restricted token verifier string output to TX"));
         strUsage += HelpMessageOpt("sign=SIGHASH-FLAGS", _("Add zero or more signatures to transaction") + ". " +
             _("This command requires JSON registers:") +
             _("prevtxs=JSON object") + ", " +
@@ -470,6 +484,164 @@ static void MutateTxAddOutScript(CMutableTransaction& tx, const std::string& str
     tx.vout.push_back(txout);
 }
 
+static CScript ExtractAndValidateTokenDestination(const std::string& strAddr)
+{
+    CTxDestination destination = DecodeDestination(strAddr);
+    if (!IsValidDestination(destination))
+        throw std::runtime_error("invalid TX output address");
+    return GetScriptForDestination(destination);
+}
+
+static CAmount ExtractAndValidateTokenAmount(const std::string& strAmount)
+{
+    CAmount nAmount;
+    if (!ParseMoney(strAmount, nAmount) || nAmount <= 0)
+        throw std::runtime_error("invalid token amount");
+    return nAmount;
+}
+
+static int ExtractAndValidateFlag(const std::string& strFlag, int nMin, int nMax, const std::string& strWhat)
+{
+    int64_t n = atoi64(strFlag);
+    if (strFlag.empty() || !isdigit((unsigned char)strFlag[0]) || n < nMin || n > nMax)
+        throw std::runtime_error("invalid " + strWhat);
+    return (int)n;
+}
+
+static std::string ExtractAndValidateIPFS(const std::string& strIPFS)
+{
+    std::string strDecoded = DecodeTokenData(strIPFS);
+    if (strDecoded.empty())
+        throw std::runtime_error("invalid IPFS hash, expected 46 base58 characters or a 64 character txid");
+    return strDecoded;
+}
+
+static void MutateTxAddOutToken(CMutableTransaction& tx, const std::string& strInput)
+{
+    // Separate into NAME:AMOUNT:ADDRESS[:TIMELOCK]
+    std::vector<std::string> vStrInputParts;
+    boost::split(vStrInputParts, strInput, boost::is_any_of(":"));
+    if (vStrInputParts.size() < 3 || vStrInputParts.size() > 4)
+        throw std::runtime_error("TX token output missing or too many separators");
+
+    uint32_t nTimeLock = 0;
+    if (vStrInputParts.size() == 4)
+        nTimeLock = ExtractAndValidateFlag(vStrInputParts[3], 0, std::numeric_limits<int>::max(), "token timelock");
+
+    CScript scriptPubKey = ExtractAndValidateTokenDestination(vStrInputParts[2]);
+    CTokenTransfer transfer(vStrInputParts[0], ExtractAndValidateTokenAmount(vStrInputParts[1]), nTimeLock);
+    transfer.ConstructTransaction(scriptPubKey);
+    tx.vout.push_back(CTxOut(0, scriptPubKey));
+}
+
+static void MutateTxAddOutOwner(CMutableTransaction& tx, const std::string& strInput)
+{
+    // Separate into NAME:ADDRESS
+    std::vector<std::string> vStrInputParts;
+    boost::split(vStrInputParts, strInput, boost::is_any_of(":"));
+    if (vStrInputParts.size() != 2)
+        throw std::runtime_error("TX owner output missing or too many separators");
+
+    CScript scriptPubKey = ExtractAndValidateTokenDestination(vStrInputParts[1]);
+    CNewToken(vStrInputParts[0], 0).ConstructOwnerTransaction(scriptPubKey);
+    tx.vout.push_back(CTxOut(0, scriptPubKey));
+}
+
+static void MutateTxAddOutIssue(CMutableTransaction& tx, const std::string& strInput)
+{
+    // Separate into NAME:AMOUNT:ADDRESS[:UNITS[:REISSUABLE[:IPFS]]]
+    std::vector<std::string> vStrInputParts;
+    boost::split(vStrInputParts, strInput, boost::is_any_of(":"));
+    if (vStrInputParts.size() < 3 || vStrInputParts.size() > 6)
+        throw std::runtime_error("TX issue output missing or too many separators");
+
+    int nUnits = DEFAULT_UNITS;
+    if (vStrInputParts.size() > 3)
+        nUnits = ExtractAndValidateFlag(vStrInputParts[3], MIN_UNIT, MAX_UNIT, "token units");
+    int nReissuable = DEFAULT_REISSUABLE;
+    if (vStrInputParts.size() > 4)
+        nReissuable = ExtractAndValidateFlag(vStrInputParts[4], 0, 1, "token reissuable flag");
+    std::string strIPFS = DEFAULT_IPFS;
+    if (vStrInputParts.size() > 5)
+        strIPFS = ExtractAndValidateIPFS(vStrInputParts[5]);
+
+    CScript scriptPubKey = ExtractAndValidateTokenDestination(vStrInputParts[2]);
+    CNewToken token(vStrInputParts[0], ExtractAndValidateTokenAmount(vStrInputParts[1]), nUnits, nReissuable, !strIPFS.empty(), strIPFS,
+                    DEFAULT_HAS_ROYALTIES, DEFAULT_ROYALTIES_ADDRESS, DEFAULT_ROYALTIES_AMOUNT);
+    token.ConstructTransaction(scriptPubKey);
+    tx.vout.push_back(CTxOut(0, scriptPubKey));
+}
+
+static void MutateTxAddOutReissue(CMutableTransaction& tx, const std::string& strInput)
+{
+    // Separate into NAME:AMOUNT:ADDRESS[:REISSUABLE[:UNITS[:IPFS]]]
+    std::vector<std::string> vStrInputParts;
+    boost::split(vStrInputParts, strInput, boost::is_any_of(":"));
+    if (vStrInputParts.size() < 3 || vStrInputParts.size() > 6)
+        throw std::runtime_error("TX reissue output missing or too many separators");
+
+    // An amount of 0 only changes the other fields, and units of -1 keep the current ones
+    CAmount nAmount = 0;
+    if (vStrInputParts[1] != "0")
+        nAmount = ExtractAndValidateTokenAmount(vStrInputParts[1]);
+    int nReissuable = 1;
+    if (vStrInputParts.size() > 3)
+        nReissuable = ExtractAndValidateFlag(vStrInputParts[3], 0, 1, "token reissuable flag");
+    int nUnits = -1;
+    if (vStrInputParts.size() > 4 && vStrInputParts[4] != "-1")
+        nUnits = ExtractAndValidateFlag(vStrInputParts[4], MIN_UNIT, MAX_UNIT, "token units");
+    std::string strIPFS;
+    if (vStrInputParts.size() > 5)
+        strIPFS = ExtractAndValidateIPFS(vStrInputParts[5]);
+
+    CScript scriptPubKey = ExtractAndValidateTokenDestination(vStrInputParts[2]);
+    CReissueToken reissue(vStrInputParts[0], nAmount, nUnits, nReissuable, strIPFS,
+                          DEFAULT_HAS_ROYALTIES, DEFAULT_ROYALTIES_ADDRESS, DEFAULT_ROYALTIES_AMOUNT);
+    reissue.ConstructTransaction(scriptPubKey);
+    tx.vout.push_back(CTxOut(0, scriptPubKey));
+}
+
+static void MutateTxAddOutTag(CMutableTransaction& tx, const std::string& strInput)
+{
+    // Separate into TOKEN:ADDRESS:FLAG
+    std::vector<std::string> vStrInputParts;
+    boost::split(vStrInputParts, strInput, boost::is_any_of(":"));
+    if (vStrInputParts.size() != 3)
+        throw std::runtime_error("TX tag output missing or too many separators");
+
+    CTxDestination destination = DecodeDestination(vStrInputParts[1]);
+    if (!IsValidDestination(destination))
+        throw std::runtime_error("invalid TX output address");
+    CScript scriptPubKey = GetScriptForNullTokenDataDestination(destination);
+    CNullTokenTxData data(vStrInputParts[0], ExtractAndValidateFlag(vStrInputParts[2], 0, 1, "tag flag"));
+    data.ConstructTransaction(scriptPubKey);
+    tx.vout.push_back(CTxOut(0, scriptPubKey));
+}
+
+static void MutateTxAddOutFreeze(CMutableTransaction& tx, const std::string& strInput)
+{
+    // Separate into TOKEN:FLAG
+    std::vector<std::string> vStrInputParts;
+    boost::split(vStrInputParts, strInput, boost::is_any_of(":"));
+    if (vStrInputParts.size() != 2)
+        throw std::runtime_error("TX freeze output missing or too many separators");
+
+    CScript scriptPubKey;
+    CNullTokenTxData data(vStrInputParts[0], ExtractAndValidateFlag(vStrInputParts[1], 0, 1, "freeze flag"));
+    data.ConstructGlobalRestrictionTransaction(scriptPubKey);
+    tx.vout.push_back(CTxOut(0, scriptPubKey));
+}
+
+static void MutateTxAddOutVerifier(CMutableTransaction& tx, const std::string& strInput)
+{
+    if (strInput.empty())
+        throw std::runtime_error("TX verifier output missing verifier string");
+
+    CScript scriptPubKey;
+    CNullTokenTxVerifierString(strInput).ConstructTransaction(scriptPubKey);
+    tx.vout.push_back(CTxOut(0, scriptPubKey));
+}
+
 static void MutateTxDelInput(CMutableTransaction& tx, const std::string& strInIdx)
 {
     // parse requested deletion index
@@ -679,10 +851,8 @@ public:
 };
 
 static void MutateTx(CMutableTransaction& tx, const std::string& command,
-                     const std::string& commandVal)
+                     const std::string& commandVal, std::unique_ptr<Secp256k1Init>& ecc)
 {
-    std::unique_ptr<Secp256k1Init> ecc;
-
     if (command == "nversion")
         MutateTxVersion(tx, commandVal);
     else if (command == "locktime")
@@ -704,18 +874,35 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
     else if (command == "outaddr")
         MutateTxAddOutAddr(tx, commandVal);
     else if (command == "outpubkey") {
-        ecc.reset(new Secp256k1Init());
+        if (!ecc)
+            ecc.reset(new Secp256k1Init());
         MutateTxAddOutPubKey(tx, commandVal);
     } else if (command == "outmultisig") {
-        ecc.reset(new Secp256k1Init());
+        if (!ecc)
+            ecc.reset(new Secp256k1Init());
         MutateTxAddOutMultiSig(tx, commandVal);
     } else if (command == "outscript")
         MutateTxAddOutScript(tx, commandVal);
     else if (command == "outdata")
         MutateTxAddOutData(tx, commandVal);
+    else if (command == "outtoken")
+        MutateTxAddOutToken(tx, commandVal);
+    else if (command == "outowner")
+        MutateTxAddOutOwner(tx, commandVal);
+    else if (command == "outissue")
+        MutateTxAddOutIssue(tx, commandVal);
+    else if (command == "outreissue")
+        MutateTxAddOutReissue(tx, commandVal);
+    else if (command == "outtag")
+        MutateTxAddOutTag(tx, commandVal);
+    else if (command == "outfreeze")
+        MutateTxAddOutFreeze(tx, commandVal);
+    else if (command == "outverifier")
+        MutateTxAddOutVerifier(tx, commandVal);
 
     else if (command == "sign") {
-        ecc.reset(new Secp256k1Init());
+        if (!ecc)
+            ecc.reset(new Secp256k1Init());
         MutateTxSign(tx, commandVal);
     }
 
@@ -782,6 +969,74 @@ static std::string readStdin()
     return ret;
 }
 
+static void MutateTxArg(CMutableTransaction& tx, const std::string& arg, std::unique_ptr<Secp256k1Init>& ecc)
+{
+    std::string key, value;
+    size_t eqpos = arg.find('=');
+    if (eqpos == std::string::npos)
+        key = arg;
+    else {
+        key = arg.substr(0, eqpos);
+        value = arg.substr(eqpos + 1);
+    }
+
+    MutateTx(tx, key, value, ecc);
+}
+
+//
+// Applies the commands of every line of standard input to a copy of txBase and outputs the
+// result, so a batch of transactions is built in one process. A line that fails is reported
+// on stderr and skipped, and makes the exit code EXIT_FAILURE.
+//
+static int StreamRawTx(const CMutableTransaction& txBase, std::unique_ptr<Secp256k1Init>& ecc)
+{
+    int nRet = EXIT_SUCCESS;
+    std::string strLine;
+    char buf[4096];
+    unsigned int nLine = 0;
+    bool fEOF = false;
+
+    while (!fEOF) {
+        strLine.clear();
+        while (true) {
+            if (!fgets(buf, sizeof(buf), stdin)) {
+                if (ferror(stdin))
+                    throw std::runtime_error("error reading stdin");
+                fEOF = true;
+                break;
+            }
+            strLine.append(buf);
+            if (!strLine.empty() && strLine.back() == '\n')
+                break;
+        }
+        if (fEOF && strLine.empty())
+            break;
+        nLine++;
+
+        boost::algorithm::trim(strLine);
+        if (strLine.empty() || strLine[0] == '#')
+            continue;
+
+        try {
+            std::vector<std::string> vArgs;
+            boost::split(vArgs, strLine, boost::is_any_of(","));
+            CMutableTransaction tx(txBase);
+            for (std::string& arg : vArgs) {
+                boost::algorithm::trim(arg);
+                if (!arg.empty())
+                    MutateTxArg(tx, arg, ecc);
+            }
+            OutputTx(tx);
+        } catch (const std::exception& e) {
+            fprintf(stderr, "error: line %u: %s\n", nLine, e.what());
+            nRet = EXIT_FAILURE;
+        }
+    }
+    fflush(stdout);
+
+    return nRet;
+}
+
 static int CommandLineRawTx(int argc, char* argv[])
 {
     std::string strPrint;
@@ -804,8 +1059,11 @@ static int CommandLineRawTx(int argc, char* argv[])
 
             // param: hex-encoded paladeum transaction
             std::string strHexTx(argv[1]);
-            if (strHexTx == "-")                 // "-" implies standard input
+            if (strHexTx == "-") {               // "-" implies standard input
+                if (gArgs.GetBoolArg("-stream", false))
+                    throw std::runtime_error("-stream reads commands from standard input, the transaction must be on the command line");
                 strHexTx = readStdin();
+            }
 
             if (!DecodeHexTx(tx, strHexTx, true))
                 throw std::runtime_error("invalid transaction encoding");
@@ -814,21 +1072,15 @@ static int CommandLineRawTx(int argc, char* argv[])
         } else
             startArg = 1;
 
-        for (int i = startArg; i < argc; i++) {
-            std::string arg = argv[i];
-            std::string key, value;
-            size_t eqpos = arg.find('=');
-            if (eqpos == std::string::npos)
-                key = arg;
-            else {
-                key = arg.substr(0, eqpos);
-                value = arg.substr(eqpos + 1);
-            }
-
-            MutateTx(tx, key, value);
-        }
+        // Held for the whole run, so streamed lines don't start and stop the context every time
+        std::unique_ptr<Secp256k1Init> ecc;
+        for (int i = startArg; i < argc; i++)
+            MutateTxArg(tx, argv[i], ecc);
 
-        OutputTx(tx);
+        if (gArgs.GetBoolArg("-stream", false))
+            nRet = StreamRawTx(tx, ecc);
+        else
+            OutputTx(tx);
     }
 
     catch (const boost::thread_interrupted&) {
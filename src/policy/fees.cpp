@@ -41,7 +41,8 @@ std::string StringForFeeReason(FeeReason reason) {
         {FeeReason::PAYTXFEE, "PayTxFee set"},
         {FeeReason::FALLBACK, "Fallback fee"},
         {FeeReason::REQUIRED, "Minimum Required Fee"},
-        {FeeReason::MAXTXFEE, "MaxTxFee limit"}
+        {FeeReason::MAXTXFEE, "MaxTxFee limit"},
+        {FeeReason::TOKEN_ESTIMATE, "Token Target 85% Threshold"}
     };
     auto reason_string = fee_reason_strings.find(reason);
 
@@ -64,6 +65,30 @@ bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_esti
     return true;
 }
 
+bool FeeClassFromString(const std::string& class_string, FeeEstimateClass& fee_estimate_class) {
+    static const std::map<std::string, FeeEstimateClass> fee_classes = {
+        {"ANY", FeeEstimateClass::ANY},
+        {"TOKEN", FeeEstimateClass::TOKEN},
+    };
+    auto estimate_class = fee_classes.find(class_string);
+
+    if (estimate_class == fee_classes.end()) return false;
+
+    fee_estimate_class = estimate_class->second;
+    return true;
+}
+
+/** Whether a transaction issues, reissues, transfers or restricts a token */
+static bool IsTokenFeeClass(const CTransaction& tx)
+{
+    if (tx.HasTokenOutputs())
+        return true;
+    for (const CTxOut& txout : tx.vout)
+        if (txout.scriptPubKey.IsNullToken())
+            return true;
+    return false;
+}
+
 /**
  * We will instantiate an instance of this class to track transactions that were
  * included in a block. We will lump transactions into a bucket according to their
@@ -529,6 +554,8 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        if (pos->second.fToken)
+            tokenStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         mapMemPoolTxs.erase(hash);
         return true;
     } else {
@@ -552,6 +579,7 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE);
     shortStats = new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE);
     longStats = new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE);
+    tokenStats = new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE);
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -559,6 +587,7 @@ CBlockPolicyEstimator::~CBlockPolicyEstimator()
     delete feeStats;
     delete shortStats;
     delete longStats;
+    delete tokenStats;
 }
 
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
@@ -598,10 +627,17 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     assert(bucketIndex == bucketIndex2);
     unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     assert(bucketIndex == bucketIndex3);
+    if (IsTokenFeeClass(entry.GetTx())) {
+        mapMemPoolTxs[hash].fToken = true;
+        unsigned int bucketIndex4 = tokenStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+        assert(bucketIndex == bucketIndex4);
+    }
 }
 
 bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
 {
+    auto pos = mapMemPoolTxs.find(entry->GetTx().GetHash());
+    bool fToken = pos != mapMemPoolTxs.end() && pos->second.fToken;
     if (!removeTx(entry->GetTx().GetHash(), true)) {
         // This transaction wasn't being tracked for fee estimation
         return false;
@@ -624,6 +660,8 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    if (fToken)
+        tokenStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     return true;
 }
 
@@ -649,11 +687,13 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     feeStats->ClearCurrent(nBlockHeight);
     shortStats->ClearCurrent(nBlockHeight);
     longStats->ClearCurrent(nBlockHeight);
+    tokenStats->ClearCurrent(nBlockHeight);
 
     // Decay all exponential averages
     feeStats->UpdateMovingAverages();
     shortStats->UpdateMovingAverages();
     longStats->UpdateMovingAverages();
+    tokenStats->UpdateMovingAverages();
 
     unsigned int countedTxs = 0;
     // Update averages with data points from current block
@@ -832,7 +872,8 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  * estimates, however, required the 95% threshold at 2 * target be met for any
  * longer time horizons also.
  */
-CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative,
+                                                 FeeEstimateClass estimateClass) const
 {
     LOCK(cs_feeEstimator);
 
@@ -905,11 +946,42 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
         }
     }
 
+    // Token transactions get the estimate of their own class once it has enough data, above or below the general one
+    if (estimateClass == FeeEstimateClass::TOKEN) {
+        double tokenEst = estimateTokenFee(confTarget, conservative, &tempResult);
+        if (tokenEst > 0) {
+            median = tokenEst;
+            if (feeCalc) {
+                feeCalc->est = tempResult;
+                feeCalc->reason = FeeReason::TOKEN_ESTIMATE;
+            }
+        }
+    }
+
     if (median < 0) return CFeeRate(0); // error condition
 
     return CFeeRate(llround(median));
 }
 
+/** Estimate from token transactions only: 85% at the target, and for
+ * conservative estimates 95% at double the target as well, both capped to
+ * the medium horizon. Returns -1 if there is not enough data.
+ */
+double CBlockPolicyEstimator::estimateTokenFee(unsigned int confTarget, bool conservative, EstimationResult *result) const
+{
+    unsigned int maxTarget = tokenStats->GetMaxConfirms();
+    double estimate = tokenStats->EstimateMedianVal(std::min(confTarget, maxTarget), SUFFICIENT_FEETXS, SUCCESS_PCT, true, nBestSeenHeight, result);
+    if (estimate > 0 && conservative) {
+        EstimationResult tempResult;
+        double doubleEst = tokenStats->EstimateMedianVal(std::min(2 * confTarget, maxTarget), SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, &tempResult);
+        if (doubleEst > estimate) {
+            estimate = doubleEst;
+            if (result) *result = tempResult;
+        }
+    }
+    return estimate;
+}
+
 
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
@@ -928,6 +1000,7 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
         feeStats->Write(fileout);
         shortStats->Write(fileout);
         longStats->Write(fileout);
+        tokenStats->Write(fileout);
     }
     catch (const std::exception&) {
         LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
@@ -993,6 +1066,13 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             fileFeeStats->Read(filein, nVersionThatWrote, numBuckets);
             fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
             fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
+            // Files written before token transactions were tracked on their own end here, start those from scratch
+            std::unique_ptr<TxConfirmStats> fileTokenStats(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+            try {
+                fileTokenStats->Read(filein, nVersionThatWrote, numBuckets);
+            } catch (const std::ios_base::failure&) {
+                fileTokenStats.reset(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+            }
 
             // Fee estimates file parsed correctly
             // Copy buckets from file and refresh our bucketmap
@@ -1006,9 +1086,11 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             delete feeStats;
             delete shortStats;
             delete longStats;
+            delete tokenStats;
             feeStats = fileFeeStats.release();
             shortStats = fileShortStats.release();
             longStats = fileLongStats.release();
+            tokenStats = fileTokenStats.release();
 
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
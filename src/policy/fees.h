@@ -78,6 +78,15 @@ enum FeeEstimateHorizon {
 
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon);
 
+/* Class of transactions a fee estimate is asked for. Token transactions are
+ * also tracked on their own, since their sizes and fees differ from payments */
+enum class FeeEstimateClass {
+    ANY,   //!< Estimate from all transactions
+    TOKEN, //!< Estimate from transactions with token outputs, falling back to ANY
+};
+
+bool FeeClassFromString(const std::string& class_string, FeeEstimateClass& fee_estimate_class);
+
 /* Enumeration of reason for returned fee estimate */
 enum class FeeReason {
     NONE,
@@ -90,6 +99,7 @@ enum class FeeReason {
     FALLBACK,
     REQUIRED,
     MAXTXFEE,
+    TOKEN_ESTIMATE,
 };
 
 std::string StringForFeeReason(FeeReason reason);
@@ -210,7 +220,8 @@ public:
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
      */
-    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative,
+                              FeeEstimateClass estimateClass = FeeEstimateClass::ANY) const;
 
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
@@ -240,7 +251,8 @@ private:
     {
         unsigned int blockHeight;
         unsigned int bucketIndex;
-        TxStatsInfo() : blockHeight(0), bucketIndex(0) {}
+        bool fToken;
+        TxStatsInfo() : blockHeight(0), bucketIndex(0), fToken(false) {}
     };
 
     // map of txids to information about that transaction
@@ -250,6 +262,8 @@ private:
     TxConfirmStats* feeStats;
     TxConfirmStats* shortStats;
     TxConfirmStats* longStats;
+    /** Medium horizon of token transactions only, they are a small share of all so one horizon is enough */
+    TxConfirmStats* tokenStats;
 
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
@@ -266,6 +280,8 @@ private:
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
     /** Helper for estimateSmartFee */
     double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
+    /** Helper for estimateSmartFee */
+    double estimateTokenFee(unsigned int confTarget, bool conservative, EstimationResult *result) const;
     /** Number of blocks of data recorded while fee estimates have been running */
     unsigned int BlockSpan() const;
     /** Number of blocks of recorded fee estimate data represented in saved data file */
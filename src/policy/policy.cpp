@@ -17,6 +17,44 @@
 #include "utilstrencodings.h"
 
 
+TxRelayClass GetTxRelayClass(const CTransaction& tx)
+{
+    bool fTransfer = false;
+    bool fAdmin = false;
+    for (const CTxOut& txout : tx.vout) {
+        int nType;
+        bool fIsOwner;
+        if (txout.scriptPubKey.IsTokenScript(nType, fIsOwner)) {
+            if (nType == TX_NEW_TOKEN || nType == TX_REISSUE_TOKEN)
+                return TX_RELAY_TOKEN_ISSUE;
+            fTransfer = true;
+        } else if (txout.scriptPubKey.IsNullToken()) {
+            fAdmin = true;
+        }
+    }
+    if (fTransfer)
+        return TX_RELAY_TOKEN_TRANSFER;
+    return fAdmin ? TX_RELAY_RESTRICTED_ADMIN : TX_RELAY_PAYMENT;
+}
+
+static const char* const TX_RELAY_CLASS_NAMES[TX_RELAY_CLASSES] = {"payment", "issue", "admin", "transfer"};
+
+const char* GetTxRelayClassName(TxRelayClass nClass)
+{
+    return nClass < TX_RELAY_CLASSES ? TX_RELAY_CLASS_NAMES[nClass] : "unknown";
+}
+
+bool ParseTxRelayClass(const std::string& strName, TxRelayClass& nClass)
+{
+    for (int i = 0; i < TX_RELAY_CLASSES; i++) {
+        if (strName == TX_RELAY_CLASS_NAMES[i]) {
+            nClass = (TxRelayClass)i;
+            return true;
+        }
+    }
+    return false;
+}
+
 CAmount GetDustThreshold(const CTxOut& txout, const CFeeRate& dustRelayFeeIn)
 {
     // "Dust" is defined in terms of dustRelayFee,
@@ -69,6 +69,28 @@ static const unsigned int STANDARD_NOT_MANDATORY_VERIFY_FLAGS = STANDARD_SCRIPT_
 /** Used as the flags parameter to sequence and nLocktime checks in non-consensus code. */
 static const unsigned int STANDARD_LOCKTIME_VERIFY_FLAGS = 0;
 
+/**
+ * Classes of transactions that are announced to each peer from queues of
+ * their own, so a flood of one class cannot hold back the others. Ordered
+ * so that a class usually comes before the classes spending from it.
+ */
+enum TxRelayClass : uint8_t {
+    TX_RELAY_PAYMENT = 0,      //!< Moves PLB only
+    TX_RELAY_TOKEN_ISSUE,      //!< Issues or reissues a token
+    TX_RELAY_RESTRICTED_ADMIN, //!< Tags addresses, freezes or sets verifier strings without moving tokens
+    TX_RELAY_TOKEN_TRANSFER,   //!< Moves tokens
+    TX_RELAY_CLASSES
+};
+/** Default share of each inv trickle given to each TxRelayClass */
+static const unsigned int DEFAULT_TX_RELAY_SHARES[TX_RELAY_CLASSES] = {4, 1, 1, 2};
+/** Default per-peer limit on the invs of each TxRelayClass, per second (0 = unlimited) */
+static const unsigned int DEFAULT_TX_RELAY_LIMIT = 0;
+
+TxRelayClass GetTxRelayClass(const CTransaction& tx);
+/** "payment", "issue", "admin" or "transfer" */
+const char* GetTxRelayClassName(TxRelayClass nClass);
+bool ParseTxRelayClass(const std::string& strName, TxRelayClass& nClass);
+
 CAmount GetDustThreshold(const CTxOut& txout, const CFeeRate& dustRelayFee);
 
 bool IsDust(const CTxOut& txout, const CFeeRate& dustRelayFee);
@@ -13,6 +13,12 @@
 #include <chainparams.h>
 #include <script/sign.h>
 #include <consensus/consensus.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
@@ -51,7 +57,14 @@ uint256 ComputeStakeModifier(const CBlockIndex* pindexPrev, const uint256& kerne
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, unsigned int nBits, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, unsigned int nTimeTxPoS)
+uint256 GetStakeKernelHash(const CBlockIndex* pindexPrev, const COutPoint& prevout, unsigned int nTimeTx, unsigned int nTimeTxPoS)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pindexPrev->nStakeModifier << nTimeTxPoS << prevout.hash << prevout.n << nTimeTx;
+    return ss.GetHash();
+}
+
+bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, unsigned int nBits, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, unsigned int nTimeTxPoS, uint256* phashProofOfStake)
 {
     if (!pindexPrev)
         return false;
@@ -64,13 +77,117 @@ bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, unsigned int nBits, CAm
     bnTarget.SetCompact(nBits);
 
     // Calculate hash
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << pindexPrev->nStakeModifier << nTimeTxPoS << prevout.hash << prevout.n << nTimeTx;
-    uint256 hashProofOfStake = ss.GetHash();
+    uint256 hashProofOfStake = GetStakeKernelHash(pindexPrev, prevout, nTimeTx, nTimeTxPoS);
+    if (phashProofOfStake)
+        *phashProofOfStake = hashProofOfStake;
 
     return (UintToArith256(hashProofOfStake) / nValueIn) <= bnTarget;
 }
 
+// UintToArith256(hash) / nValue <= bnTarget as CheckStakeKernelHash computes it, without the
+// 256-bit division: floor(hash / nValue) <= bnTarget exactly when hash < (bnTarget + 1) * nValue
+static bool KernelMeetsTarget(const arith_uint256& hash, CAmount nValue, const arith_uint256& bnTarget)
+{
+    arith_uint256 bnLimit = bnTarget + 1;
+    arith_uint256 bnValue(nValue);
+
+    // A product of at least 2^256 exceeds any hash, at exactly 257 bits it may or may not wrap
+    unsigned int nProductBits = bnLimit.bits() + bnValue.bits();
+    if (bnLimit == 0 || nProductBits > 257)
+        return true;
+    if (nProductBits == 257)
+        return (hash / nValue) <= bnTarget;
+
+    return hash < bnLimit * bnValue;
+}
+
+CStakeKernel::CStakeKernel(const CBlockIndex* pindexPrev, const COutPoint& prevoutIn, CAmount nValueIn, unsigned int nTimeTxPoS) :
+    prevout(prevoutIn), nValue(nValueIn)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << pindexPrev->nStakeModifier << nTimeTxPoS << prevout.hash << prevout.n;
+    assert(ss.size() == 64 + sizeof(tail));
+
+    SHA256Midstate(midstate, (const unsigned char*)ss.data(), 1);
+    memcpy(tail, ss.data() + 64, sizeof(tail));
+}
+
+void CStakeKernel::GetHashes(const CStakeKernel* pkernels, size_t count, unsigned int nTimeTx, uint256* phashes)
+{
+    uint32_t states[LANES * 8];
+    unsigned char blocks[LANES * 64];
+    unsigned char out[LANES * CSHA256::OUTPUT_SIZE];
+
+    // Final block: tail | nTimeTx | padding, for 76 bytes hashed in total
+    memset(blocks, 0, sizeof(blocks));
+    for (size_t n = 0; n < LANES; n++) {
+        unsigned char* block = blocks + 64 * n;
+        WriteLE32(block + sizeof(tail), nTimeTx);
+        block[sizeof(tail) + 4] = 0x80;
+        WriteBE64(block + 56, (64 + sizeof(tail) + 4) * 8);
+    }
+
+    while (count > 0) {
+        size_t nLanes = std::min(count, LANES);
+        for (size_t n = 0; n < nLanes; n++) {
+            memcpy(states + 8 * n, pkernels[n].midstate, sizeof(midstate));
+            memcpy(blocks + 64 * n, pkernels[n].tail, sizeof(tail));
+        }
+
+        SHA256DFinal(out, states, blocks, nLanes);
+        for (size_t n = 0; n < nLanes; n++)
+            memcpy(phashes[n].begin(), out + CSHA256::OUTPUT_SIZE * n, CSHA256::OUTPUT_SIZE);
+
+        pkernels += nLanes;
+        phashes += nLanes;
+        count -= nLanes;
+    }
+}
+
+bool CStakeKernel::Check(const arith_uint256& bnTarget, unsigned int nTimeTx) const
+{
+    uint256 hashProofOfStake;
+    GetHashes(this, 1, nTimeTx, &hashProofOfStake);
+
+    return KernelMeetsTarget(UintToArith256(hashProofOfStake), nValue, bnTarget);
+}
+
+int SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, unsigned int nBits, unsigned int nTimeTx, int nThreads)
+{
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+
+    // Worker n takes every nThreads-th group of LANES kernels starting at group n and gives
+    // up once a lower index has hit, so the lowest hit wins just as in a sequential scan
+    const size_t nLanes = CStakeKernel::LANES;
+    size_t nGroups = (vKernels.size() + nLanes - 1) / nLanes;
+    nThreads = std::max(1, std::min(nThreads, (int)nGroups));
+    std::atomic<size_t> nFound(vKernels.size());
+    auto worker = [&](size_t nStart) {
+        uint256 hashes[CStakeKernel::LANES];
+        for (size_t i = nStart * nLanes; i < nFound.load(std::memory_order_relaxed); i += nThreads * nLanes) {
+            size_t nCount = std::min(nLanes, vKernels.size() - i);
+            CStakeKernel::GetHashes(&vKernels[i], nCount, nTimeTx, hashes);
+            for (size_t n = 0; n < nCount; n++) {
+                if (KernelMeetsTarget(UintToArith256(hashes[n]), vKernels[i + n].nValue, bnTarget)) {
+                    size_t nPrev = nFound.load();
+                    while (i + n < nPrev && !nFound.compare_exchange_weak(nPrev, i + n)) {}
+                    return;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; i++)
+        vThreads.emplace_back(worker, i);
+    worker(0);
+    for (auto& thread : vThreads)
+        thread.join();
+
+    return nFound == vKernels.size() ? -1 : (int)nFound;
+}
+
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx)
 {
@@ -83,6 +200,13 @@ bool CheckStakeBlockTimestamp(int64_t nTimeBlock)
    return CheckCoinStakeTimestamp(nTimeBlock, nTimeBlock);
 }
 
+bool IsStakeCacheValid(const CBlockIndex* pindexPrev, const CStakeCache& stake)
+{
+    AssertLockHeld(cs_main);
+    // A reorg past the coin's height takes its block off the active chain
+    return pindexPrev == chainActive.Tip() && chainActive.Contains(stake.pindexFrom);
+}
+
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, CCoinsViewCache& view)
 {
     std::map<COutPoint, CStakeCache> tmp;
@@ -96,22 +220,19 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBloc
 
     auto it = cache.find(prevout);
 
-    if (it == cache.end()) {
+    if (it == cache.end() || !IsStakeCacheValid(pindexPrev, it->second)) {
         // not found in cache (shouldn't happen during staking, only during verification which does not use cache)
         Coin coinPrev;
         if (!view.GetCoin(prevout, coinPrev)) {
             return false;
         }
 
+        // A mature coin is at least a block below pindexPrev so it has an ancestor there,
+        // the skiplist walk of GetAncestor isn't needed to know that
         if (pindexPrev->nHeight + 1 - coinPrev.nHeight < COINSTAKE_MATURITY) {
             return false;
         }
 
-        CBlockIndex* blockFrom = pindexPrev->GetAncestor(coinPrev.nHeight);
-        if(!blockFrom) {
-            return false;
-        }
-        
         if(coinPrev.IsSpent()){
             return false;
         }
@@ -119,16 +240,15 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBloc
         return CheckStakeKernelHash(pindexPrev, nBits, coinPrev.out.nValue, prevout,
                                     nTimeBlock, coinPrev.nTime);
     } else {
-        Coin coinPrev;
-        if(!view.GetCoin(prevout, coinPrev)){
+        // found in cache
+        const CStakeCache& stake = it->second;
+        if (pindexPrev->nHeight + 1 - stake.pindexFrom->nHeight < COINSTAKE_MATURITY) {
             return false;
         }
 
-        // found in cache
-        const CStakeCache& stake = it->second;
         if (CheckStakeKernelHash(pindexPrev, nBits, stake.amount, prevout,
-                                    nTimeBlock, coinPrev.nTime)) {
-            // Cache could potentially cause false positive stakes in the event of deep reorgs, so check without cache also
+                                    nTimeBlock, stake.nTime)) {
+            // The cache doesn't know whether the coin was spent since, so check without cache also
             return CheckKernel(pindexPrev, nBits, nTimeBlock, prevout, view);
         }
     }
@@ -158,20 +278,57 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const C
         return state.DoS(100, error("CheckProofOfStake() : Stake prevout is not mature, expecting %i and only matured to %i", COINSTAKE_MATURITY, pindexPrev->nHeight + 1 - coinPrev.nHeight));
     }
 
-    CBlockIndex* blockFrom = pindexPrev->GetAncestor(coinPrev.nHeight);
-    if (!blockFrom) {
-        return state.DoS(100, error("CheckProofOfStake() : Block at height %i for prevout can not be loaded", coinPrev.nHeight));
-    }
+    // The prevout is in the view at pindexPrev and mature, so its block is an ancestor of
+    // pindexPrev and GetAncestor would always find it
 
     // Verify signature
     if (!VerifySignature(coinPrev, txin.prevout.hash, tx, 0, SCRIPT_VERIFY_NONE)) {
         return state.DoS(100, error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString()));
     }
 
-    if (!CheckStakeKernelHash(pindexPrev, nBits, coinPrev.out.nValue, txin.prevout, nTimeBlock, coinPrev.nTime)) {
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+    targetProofOfStake = ArithToUint256(bnTarget);
+    if (!CheckStakeKernelHash(pindexPrev, nBits, coinPrev.out.nValue, txin.prevout, nTimeBlock, coinPrev.nTime, &hashProofOfStake)) {
         return state.DoS(1, error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", tx.GetHash().ToString(), hashProofOfStake.ToString())); // may occur during initial download or if behind on block chain sync
     }
 
     return true;
 }
 
+namespace {
+struct CStakeProofEntry
+{
+    const CBlockIndex* pindex;
+    uint256 hashProofOfStake;
+};
+
+std::mutex csStakeProofCache;
+CStakeProofEntry stakeProofCache[STAKE_PROOF_CACHE_SIZE];
+}
+
+bool GetCachedStakeProof(const CBlockIndex* pindex, uint256& hashProofOfStake)
+{
+    std::lock_guard<std::mutex> lock(csStakeProofCache);
+    const CStakeProofEntry& entry = stakeProofCache[pindex->nHeight % STAKE_PROOF_CACHE_SIZE];
+    if (entry.pindex != pindex)
+        return false;
+    hashProofOfStake = entry.hashProofOfStake;
+    return true;
+}
+
+void CacheStakeProof(const CBlockIndex* pindex, const uint256& hashProofOfStake)
+{
+    // A competing block at the same height takes the slot over, the one connected last is the likelier to be again
+    std::lock_guard<std::mutex> lock(csStakeProofCache);
+    CStakeProofEntry& entry = stakeProofCache[pindex->nHeight % STAKE_PROOF_CACHE_SIZE];
+    entry.pindex = pindex;
+    entry.hashProofOfStake = hashProofOfStake;
+}
+
+void ClearStakeProofCache()
+{
+    std::lock_guard<std::mutex> lock(csStakeProofCache);
+    for (CStakeProofEntry& entry : stakeProofCache)
+        entry = CStakeProofEntry();
+}
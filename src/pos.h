@@ -21,19 +21,70 @@
 // Supposed to be 2^n-1
 static const uint32_t STAKE_TIMESTAMP_MASK = 15;
 
+// What the kernel needs of a coin, so a cached coin takes neither GetCoin nor GetAncestor.
+// pindexFrom is the block that created the coin, the entry only holds while it is on the
+// active chain
 struct CStakeCache{
-    CStakeCache(uint32_t blockFromTime_, CAmount amount_) : blockFromTime(blockFromTime_), amount(amount_){
+    CStakeCache(const CBlockIndex* pindexFrom_, uint32_t nTime_, CAmount amount_) : pindexFrom(pindexFrom_), nTime(nTime_), amount(amount_){
     }
-    uint32_t blockFromTime;
+    const CBlockIndex* pindexFrom;
+    uint32_t nTime;
     CAmount amount;
 };
 
+// Whether a cache entry still describes the coin on top of pindexPrev, which must be the active tip
+bool IsStakeCacheValid(const CBlockIndex* pindexPrev, const CStakeCache& stake);
+
+// Default number of threads a kernel search is split across
+static const int DEFAULT_STAKE_THREADS = 1;
+
+// Kernel hash of one stake candidate. Everything but nTimeTx is fixed for a tip and coin, so
+// the SHA256 midstate of that prefix is kept and each timestamp tried only hashes the final
+// block; build it only for coins CheckKernel would consider
+class CStakeKernel
+{
+public:
+    // Kernels hashed together by SearchStakeKernels, see SHA256DFinal
+    static const size_t LANES = 4;
+
+    CStakeKernel(const CBlockIndex* pindexPrev, const COutPoint& prevoutIn, CAmount nValueIn, unsigned int nTimeTxPoS);
+
+    // Same result as CheckStakeKernelHash for the coin this kernel was built from
+    bool Check(const arith_uint256& bnTarget, unsigned int nTimeTx) const;
+
+    // Kernel hashes of count kernels at nTimeTx
+    static void GetHashes(const CStakeKernel* pkernels, size_t count, unsigned int nTimeTx, uint256* phashes);
+
+    COutPoint prevout;
+    CAmount nValue;
+
+private:
+    // Serialized prefix is nStakeModifier (32) | nTimeTxPoS (4) | prevout (36), one block and 8 bytes
+    uint32_t midstate[8];
+    unsigned char tail[8];
+};
+
+// Index of the first kernel meeting nBits at nTimeTx, or -1; the result doesn't depend on nThreads
+int SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, unsigned int nBits, unsigned int nTimeTx, int nThreads);
+
 // Compute the hash modifier for proof-of-stake
 uint256 ComputeStakeModifier(const CBlockIndex* pindexPrev, const uint256& kernel);
-bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, unsigned int nBits, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, unsigned int nTimeTxPoS);
+// Kernel hash of the coin at prevout staked at nTimeTx on top of pindexPrev
+uint256 GetStakeKernelHash(const CBlockIndex* pindexPrev, const COutPoint& prevout, unsigned int nTimeTx, unsigned int nTimeTxPoS);
+bool CheckStakeKernelHash(const CBlockIndex* pindexPrev, unsigned int nBits, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, unsigned int nTimeTxPoS, uint256* phashProofOfStake = nullptr);
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
 bool CheckStakeBlockTimestamp(int64_t nTimeBlock);
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, CCoinsViewCache& view);
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, CCoinsViewCache& view, const std::map<COutPoint, CStakeCache>& cache);
 bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const CTransaction& tx, unsigned int nBits, uint32_t nTimeBlock, uint256& hashProofOfStake, uint256& targetProofOfStake, CCoinsViewCache& view);
+
+// Kernel hashes of recently connected proof-of-stake blocks, in a ring by height keyed by block index. A
+// kernel only depends on the block and its parent, so one that met the target does again when a reorg
+// connects the same block a second time
+static const unsigned int STAKE_PROOF_CACHE_SIZE = 1024;
+bool GetCachedStakeProof(const CBlockIndex* pindex, uint256& hashProofOfStake);
+void CacheStakeProof(const CBlockIndex* pindex, const uint256& hashProofOfStake);
+// Forget every entry, before the block index entries they point to are freed
+void ClearStakeProofCache();
+
 #endif // AOKCHAIN_POS_H
@@ -10,6 +10,7 @@
 #include <hash.h>
 #include "tinyformat.h"
 #include "utilstrencodings.h"
+#include "crypto/blake2b_headers.h"
 #include "crypto/common.h"
 
 BlockNetwork bNetwork = BlockNetwork();
@@ -36,7 +37,18 @@ uint256 CBlockHeader::GetIndexHash() const
 
 uint256 CBlockHeader::GetWorkHash() const
 {
-    return blake2b(BEGIN(nVersion), END(nNonce));
+    static_assert(sizeof(CBlockHeader) == BLAKE2B_HEADER_SIZE, "the work hash covers the header fields, packed");
+    uint256 hash;
+    Blake2b256Headers(hash.begin(), (const unsigned char*)BEGIN(nVersion), 1);
+    return hash;
+}
+
+void CBlockHeader::GetWorkHashes(uint256* hashes, size_t count) const
+{
+    std::vector<CBlockHeader> vHeaders(count, *this);
+    for (size_t i = 0; i < count; i++)
+        vHeaders[i].nNonce = nNonce + i;
+    Blake2b256Headers(hashes[0].begin(), (const unsigned char*)BEGIN(vHeaders[0].nVersion), count);
 }
 
 std::string CBlockHeader::ToString() const
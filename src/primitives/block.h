@@ -82,6 +82,9 @@ public:
 
     uint256 GetWorkHash() const;
 
+    /** Work hashes of this header with the nonces nNonce to nNonce + count - 1, hashed together */
+    void GetWorkHashes(uint256* hashes, size_t count) const;
+
     std::string ToString() const;
 
     int64_t GetBlockTime() const
@@ -80,6 +80,23 @@ uint256 CTransaction::ComputeHash() const
     return SerializeHash(*this, SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS);
 }
 
+std::shared_ptr<CTxTokenOutputs> CTransaction::ComputeTokenOutputs() const
+{
+    std::shared_ptr<CTxTokenOutputs> outputs;
+    for (size_t n = 0; n < vout.size(); n++) {
+        CTxTokenOutput token;
+        if (!vout[n].scriptPubKey.IsTokenScript(token.nType, token.nScriptType, token.fIsOwner, token.nStartingIndex))
+            continue;
+        if (!outputs) {
+            outputs = std::make_shared<CTxTokenOutputs>();
+            outputs->vOutputs.resize(vout.size());
+        }
+        token.fIsToken = true;
+        outputs->vOutputs[n] = std::move(token);
+    }
+    return outputs;
+}
+
 uint256 CTransaction::GetWitnessHash() const
 {
     if (!HasWitness()) {
@@ -89,9 +106,9 @@ uint256 CTransaction::GetWitnessHash() const
 }
 
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), nTime(0), nMessage(), hash() {}
-CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), nTime(tx.nTime), nMessage(tx.nMessage), hash(ComputeHash()) {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), nTime(tx.nTime), nMessage(tx.nMessage), hash(ComputeHash()) {}
+CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), nTime(0), nMessage(), hash(), tokenOutputs() {}
+CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), nTime(tx.nTime), nMessage(tx.nMessage), hash(ComputeHash()), tokenOutputs(ComputeTokenOutputs()) {}
+CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), nTime(tx.nTime), nMessage(tx.nMessage), hash(ComputeHash()), tokenOutputs(ComputeTokenOutputs()) {}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -15,12 +15,16 @@
 #include "uint256.h"
 
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 static const int32_t MESSAGE_VERSION = 2;
 
 class CCoinsViewCache;
 class CNullTokenTxVerifierString;
+class CNewToken;
+class CTokenTransfer;
 
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
@@ -298,6 +302,29 @@ inline void SerializeTransaction(const TxType& tx, Stream& s) {
 }
 
 
+/** An output's token script as CScript::IsTokenScript classifies it. The transfer or new token it carries
+ *  is decoded along with the rest of the transaction's on first use, see GetTxTokenOutput */
+struct CTxTokenOutput
+{
+    bool fIsToken = false;
+    int nType = 0;
+    int nScriptType = 0;
+    bool fIsOwner = false;
+    int nStartingIndex = 0;
+
+    //! Set when decoding a transfer or a new (non-owner) token whose data deserializes
+    std::shared_ptr<const CTokenTransfer> transfer;
+    std::shared_ptr<const CNewToken> token;
+    std::string strAddress;
+};
+
+/** The token outputs of a transaction, one entry per output, shared by the copies of the transaction */
+struct CTxTokenOutputs
+{
+    std::vector<CTxTokenOutput> vOutputs;
+    std::once_flag decoded;
+};
+
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
  */
@@ -328,8 +355,11 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    /** Memory only, null unless an output is a token script. */
+    const std::shared_ptr<CTxTokenOutputs> tokenOutputs;
 
     uint256 ComputeHash() const;
+    std::shared_ptr<CTxTokenOutputs> ComputeTokenOutputs() const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -360,6 +390,23 @@ public:
     // Compute a hash that includes both transaction and witness data
     uint256 GetWitnessHash() const;
 
+    /** TOKENS START */
+    // Classification of output n, null if it isn't a token output
+    const CTxTokenOutput* GetTokenOutput(uint32_t n) const {
+        if (!tokenOutputs || n >= tokenOutputs->vOutputs.size() || !tokenOutputs->vOutputs[n].fIsToken)
+            return nullptr;
+        return &tokenOutputs->vOutputs[n];
+    }
+
+    bool HasTokenOutputs() const {
+        return tokenOutputs != nullptr;
+    }
+
+    CTxTokenOutputs* GetTokenOutputs() const {
+        return tokenOutputs.get();
+    }
+    /** TOKENS END */
+
     // Return sum of txouts.
     CAmount GetValueOut() const;
     // GetValueIn() is a method on CCoinsViewCache, because
@@ -262,6 +262,63 @@ extern const char *TOKENDATA;
  * @since protocol version 70018.
  */
     extern const char *TOKENNOTFOUND;
+
+/**
+ * getcfilters requests the compact filters of a range of blocks (BIP 157).
+ * Only available with service bit NODE_COMPACT_FILTERS.
+ */
+extern const char *GETCFILTERS;
+
+/**
+ * cfilter holds the compact filter of one block, sent in response to getcfilters.
+ */
+extern const char *CFILTER;
+
+/**
+ * getcfheaders requests the filter hashes of a range of blocks and the filter header before them.
+ * Only available with service bit NODE_COMPACT_FILTERS.
+ */
+extern const char *GETCFHEADERS;
+
+/**
+ * cfheaders holds the filter hashes and previous filter header asked for by getcfheaders.
+ */
+extern const char *CFHEADERS;
+
+/**
+ * getcfcheckpt requests the filter headers of every CFCHECKPT_INTERVAL-th block up to a block.
+ * Only available with service bit NODE_COMPACT_FILTERS.
+ */
+extern const char *GETCFCHECKPT;
+
+/**
+ * cfcheckpt holds the filter headers asked for by getcfcheckpt.
+ */
+extern const char *CFCHECKPT;
+
+/**
+ * sendtxrcncl offers set reconciliation of transaction announcements, with the
+ * protocol version and a salt for the short ids. Sent between version and verack.
+ * @since protocol version 70029, when -txreconciliation is set.
+ */
+extern const char *SENDTXRCNCL;
+
+/**
+ * reqrecon asks the inbound end of a reconciling link for a sketch of the transactions
+ * it has queued, with the size of the set of the sender.
+ */
+extern const char *REQRECON;
+
+/**
+ * sketch holds the sketch of the queued transactions asked for by reqrecon.
+ */
+extern const char *SKETCH;
+
+/**
+ * reconcildiff tells whether the sketch decoded, and the short ids of the transactions
+ * the sender lacks, which the other end then announces by inv.
+ */
+extern const char *RECONCILDIFF;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -289,6 +346,9 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_COMPACT_FILTERS means the node will serve basic block filters and filter headers
+    // (BIP 157/158), which include the token names of token outputs.
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -164,14 +164,9 @@ static int ecdsa_signature_parse_der_lax(const secp256k1_context* ctx, secp256k1
     return 1;
 }
 
-bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
-    if (!IsValid())
-        return false;
-    secp256k1_pubkey pubkey;
+/** Verify a DER signature with a parsed key, shared by CPubKey and CParsedPubKey. */
+static bool VerifyParsed(const secp256k1_pubkey& pubkey, const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     secp256k1_ecdsa_signature sig;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
-        return false;
-    }
     if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, vchSig.data(), vchSig.size())) {
         return false;
     }
@@ -181,6 +176,34 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
     return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
 }
 
+bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    if (!IsValid())
+        return false;
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
+        return false;
+    }
+    return VerifyParsed(pubkey, hash, vchSig);
+}
+
+static_assert(sizeof(secp256k1_pubkey) == 64, "CParsedPubKey holds a secp256k1_pubkey");
+
+bool CParsedPubKey::Parse(const CPubKey& pubkey) {
+    if (!pubkey.IsValid())
+        return false;
+    secp256k1_pubkey parsed;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parsed, pubkey.begin(), pubkey.size()))
+        return false;
+    memcpy(vch, &parsed, sizeof(vch));
+    return true;
+}
+
+bool CParsedPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    secp256k1_pubkey pubkey;
+    memcpy(&pubkey, vch, sizeof(vch));
+    return VerifyParsed(pubkey, hash, vchSig);
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != 65)
         return false;
@@ -198,6 +198,25 @@ public:
     bool Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 };
 
+/**
+ * A public key in the form libsecp256k1 verifies with. Parsing a compressed
+ * key takes a square root, which verifying many signatures of one key can
+ * skip by parsing it once.
+ */
+class CParsedPubKey
+{
+private:
+    //! the secp256k1_pubkey, whose 64 bytes are opaque
+    unsigned char vch[64];
+
+public:
+    //! Parse pubkey, false if it is not a fully valid public key.
+    bool Parse(const CPubKey& pubkey);
+
+    //! Same as CPubKey::Verify for the key parsed.
+    bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
+};
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
@@ -30,6 +30,7 @@
 #include <QIcon>
 #include <QSettings>
 #include <QString>
+#include <QTimer>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
 
@@ -37,6 +38,42 @@ QList<CAmount> CoinControlDialog::payAmounts;
 CCoinControl* CoinControlDialog::coinControl = new CCoinControl();
 bool CoinControlDialog::fSubtractFeeFromAmount = false;
 
+/** Value and estimated input size of a selected output. They never change for an outpoint, so
+ *  updateLabels only asks the wallet for outputs it has not seen selected before. */
+struct CoinControlInput
+{
+    CAmount nValue;
+    unsigned int nBytes;
+    bool fWitness;
+};
+static std::map<COutPoint, CoinControlInput> mapSelectedInputs;
+
+static CoinControlInput GetCoinControlInput(WalletModel *model, const COutput& out)
+{
+    const CTxOut& txout = out.tx->tx->vout[out.i];
+    CoinControlInput input;
+    input.nValue = txout.nValue;
+    input.nBytes = 148; // in all error cases, simply assume 148 here
+    input.fWitness = false;
+
+    CTxDestination address;
+    int witnessversion = 0;
+    std::vector<unsigned char> witnessprogram;
+    if (txout.scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram))
+    {
+        input.nBytes = (32 + 4 + 1 + (107 / WITNESS_SCALE_FACTOR) + 4);
+        input.fWitness = true;
+    }
+    else if(ExtractDestination(txout.scriptPubKey, address))
+    {
+        CPubKey pubkey;
+        CKeyID *keyid = boost::get<CKeyID>(&address);
+        if (keyid && model->getPubKey(*keyid, pubkey))
+            input.nBytes = (pubkey.IsCompressed() ? 148 : 180);
+    }
+    return input;
+}
+
 bool CCoinControlWidgetItem::operator<(const QTreeWidgetItem &other) const {
     int column = treeWidget()->sortColumn();
     if (column == CoinControlDialog::COLUMN_AMOUNT || column == CoinControlDialog::COLUMN_DATE || column == CoinControlDialog::COLUMN_CONFIRMATIONS)
@@ -48,7 +85,8 @@ CoinControlDialog::CoinControlDialog(const PlatformStyle *_platformStyle, QWidge
     QDialog(parent),
     ui(new Ui::CoinControlDialog),
     model(0),
-    platformStyle(_platformStyle)
+    platformStyle(_platformStyle),
+    fLabelsPending(false)
 {
     ui->setupUi(this);
 
@@ -111,6 +149,9 @@ CoinControlDialog::CoinControlDialog(const PlatformStyle *_platformStyle, QWidge
     // click on checkbox
     connect(ui->treeWidget, SIGNAL(itemChanged(QTreeWidgetItem*, int)), this, SLOT(viewItemChanged(QTreeWidgetItem*, int)));
 
+    // expand an address in tree mode
+    connect(ui->treeWidget, SIGNAL(itemExpanded(QTreeWidgetItem*)), this, SLOT(viewItemExpanded(QTreeWidgetItem*)));
+
     // click on header
 #if QT_VERSION < 0x050000
     ui->treeWidget->header()->setClickable(true);
@@ -390,7 +431,31 @@ void CoinControlDialog::viewItemChanged(QTreeWidgetItem* item, int column)
 
         // selection changed -> update labels
         if (ui->treeWidget->isEnabled()) // do not update on every click for (un)select all
-            CoinControlDialog::updateLabels(model, this);
+            scheduleLabelUpdate();
+    }
+
+    // tree mode: an address whose outputs are not listed yet was (un)checked, select them without listing them
+    else if (column == COLUMN_CHECKBOX && mapPendingOutputs.count(item))
+    {
+        Qt::CheckState state = item->checkState(COLUMN_CHECKBOX);
+        if (state == Qt::PartiallyChecked) // set below when some of the outputs are locked
+            return;
+
+        bool fLocked = false;
+        for (const COutPoint& outpt : mapPendingOutputs[item])
+        {
+            if (state == Qt::Unchecked)
+                coinControl->UnSelect(outpt);
+            else if (model->isLockedCoin(outpt.hash, outpt.n))
+                fLocked = true;
+            else
+                coinControl->Select(outpt);
+        }
+        if (fLocked)
+            item->setCheckState(COLUMN_CHECKBOX, Qt::PartiallyChecked);
+
+        if (ui->treeWidget->isEnabled())
+            scheduleLabelUpdate();
     }
 
     // TODO: Remove this temporary qt5 fix after Qt5.3 and Qt5.4 are no longer used.
@@ -404,6 +469,28 @@ void CoinControlDialog::viewItemChanged(QTreeWidgetItem* item, int column)
 #endif
 }
 
+// tree mode: list the outputs of an address the first time it is expanded
+void CoinControlDialog::viewItemExpanded(QTreeWidgetItem* item)
+{
+    if (mapPendingOutputs.count(item))
+        populateAddressItem(item);
+}
+
+// checking an address in tree mode changes the state of every output under it, update the labels once for all of them
+void CoinControlDialog::scheduleLabelUpdate()
+{
+    if (fLabelsPending)
+        return;
+    fLabelsPending = true;
+    QTimer::singleShot(0, this, SLOT(updatePendingLabels()));
+}
+
+void CoinControlDialog::updatePendingLabels()
+{
+    fLabelsPending = false;
+    CoinControlDialog::updateLabels(model, this);
+}
+
 // shows count of locked unspent outputs
 void CoinControlDialog::updateLabelLocked()
 {
@@ -448,18 +535,28 @@ void CoinControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
     bool fWitness               = false;
 
     std::vector<COutPoint> vCoinControl;
+    std::vector<COutPoint> vNewInputs;
     std::vector<COutput>   vOutputs;
     coinControl->ListSelected(vCoinControl);
-    model->getOutputs(vCoinControl, vOutputs);
+    for (const COutPoint& outpt : vCoinControl)
+        if (!mapSelectedInputs.count(outpt))
+            vNewInputs.push_back(outpt);
+    if (!vNewInputs.empty())
+        model->getOutputs(vNewInputs, vOutputs);
+    for (const COutput& out : vOutputs)
+        mapSelectedInputs[COutPoint(out.tx->GetHash(), out.i)] = GetCoinControlInput(model, out);
+
+    for (const COutPoint& outpt : vCoinControl) {
+        auto it = mapSelectedInputs.find(outpt);
+        if (it == mapSelectedInputs.end()) // not in the wallet
+            continue;
 
-    for (const COutput& out : vOutputs) {
         // unselect already spent, very unlikely scenario, this could happen
         // when selected are spent elsewhere, like rpc or another computer
-        uint256 txhash = out.tx->GetHash();
-        COutPoint outpt(txhash, out.i);
         if (model->isSpent(outpt))
         {
             coinControl->UnSelect(outpt);
+            mapSelectedInputs.erase(it);
             continue;
         }
 
@@ -467,29 +564,11 @@ void CoinControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
         nQuantity++;
 
         // Amount
-        nAmount += out.tx->tx->vout[out.i].nValue;
+        nAmount += it->second.nValue;
 
         // Bytes
-        CTxDestination address;
-        int witnessversion = 0;
-        std::vector<unsigned char> witnessprogram;
-        if (out.tx->tx->vout[out.i].scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram))
-        {
-            nBytesInputs += (32 + 4 + 1 + (107 / WITNESS_SCALE_FACTOR) + 4);
-            fWitness = true;
-        }
-        else if(ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, address))
-        {
-            CPubKey pubkey;
-            CKeyID *keyid = boost::get<CKeyID>(&address);
-            if (keyid && model->getPubKey(*keyid, pubkey))
-            {
-                nBytesInputs += (pubkey.IsCompressed() ? 148 : 180);
-            }
-            else
-                nBytesInputs += 148; // in all error cases, simply assume 148 here
-        }
-        else nBytesInputs += 148;
+        nBytesInputs += it->second.nBytes;
+        fWitness |= it->second.fWitness;
     }
     // calculation
     if (nQuantity > 0)
@@ -602,6 +681,103 @@ void CoinControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
         label->setVisible(nChange < 0);
 }
 
+CCoinControlWidgetItem* CoinControlDialog::newOutputItem(const COutput& out, const QString& sWalletAddress, const QString& sWalletLabel, bool treeMode, const std::set<COutPoint>& setLocked)
+{
+    // built without a parent and added in one go, so filling it in emits no itemChanged
+    CCoinControlWidgetItem *itemOutput = new CCoinControlWidgetItem();
+    itemOutput->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+    itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Unchecked);
+
+    int nDisplayUnit = model->getOptionsModel()->getDisplayUnit();
+
+    // address
+    CTxDestination outputAddress;
+    QString sAddress = "";
+    if(ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, outputAddress))
+    {
+        sAddress = QString::fromStdString(EncodeDestination(outputAddress));
+
+        // if listMode or change => show paladeum address. In tree mode, address is not shown again for direct wallet address outputs
+        if (!treeMode || (!(sAddress == sWalletAddress)))
+            itemOutput->setText(COLUMN_ADDRESS, sAddress);
+    }
+
+    // label
+    if (!(sAddress == sWalletAddress)) // change
+    {
+        // tooltip from where the change comes from
+        itemOutput->setToolTip(COLUMN_LABEL, tr("change from %1 (%2)").arg(sWalletLabel).arg(sWalletAddress));
+        itemOutput->setText(COLUMN_LABEL, tr("(change)"));
+    }
+    else if (!treeMode)
+    {
+        itemOutput->setText(COLUMN_LABEL, sWalletLabel);
+    }
+
+    // amount
+    itemOutput->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, out.tx->tx->vout[out.i].nValue));
+    itemOutput->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)out.tx->tx->vout[out.i].nValue)); // padding so that sorting works correctly
+
+    // date
+    itemOutput->setText(COLUMN_DATE, GUIUtil::dateTimeStr(out.tx->GetTxTime()));
+    itemOutput->setData(COLUMN_DATE, Qt::UserRole, QVariant((qlonglong)out.tx->GetTxTime()));
+
+    // confirmations
+    itemOutput->setText(COLUMN_CONFIRMATIONS, QString::number(out.nDepth));
+    itemOutput->setData(COLUMN_CONFIRMATIONS, Qt::UserRole, QVariant((qlonglong)out.nDepth));
+
+    // transaction hash
+    uint256 txhash = out.tx->GetHash();
+    itemOutput->setText(COLUMN_TXHASH, QString::fromStdString(txhash.GetHex()));
+
+    // vout index
+    itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.i));
+
+    // disable locked coins
+    COutPoint outpt(txhash, out.i);
+    if (setLocked.count(outpt))
+    {
+        coinControl->UnSelect(outpt); // just to be sure
+        itemOutput->setDisabled(true);
+        itemOutput->setIcon(COLUMN_CHECKBOX, platformStyle->SingleColorIcon(":/icons/lock_closed"));
+    }
+
+    // set checkbox
+    if (coinControl->IsSelected(outpt))
+        itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Checked);
+
+    return itemOutput;
+}
+
+// tree mode: list the outputs of an address item
+void CoinControlDialog::populateAddressItem(QTreeWidgetItem* item)
+{
+    auto it = mapPendingOutputs.find(item);
+    if (it == mapPendingOutputs.end())
+        return;
+
+    std::vector<COutput> vOutputs;
+    model->getOutputs(it->second, vOutputs);
+    mapPendingOutputs.erase(it);
+
+    std::vector<COutPoint> vLocked;
+    model->listLockedCoins(vLocked);
+    std::set<COutPoint> setLocked(vLocked.begin(), vLocked.end());
+
+    QString sWalletAddress = item->text(COLUMN_ADDRESS);
+    QString sWalletLabel = item->text(COLUMN_LABEL);
+
+    bool fEnabled = ui->treeWidget->isEnabled();
+    ui->treeWidget->setEnabled(false);
+    QList<QTreeWidgetItem*> children;
+    for (const COutput& out : vOutputs)
+        children.append(newOutputItem(out, sWalletAddress, sWalletLabel, true, setLocked));
+    item->addChildren(children);
+    item->sortChildren(sortColumn, sortOrder);
+    item->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
+    ui->treeWidget->setEnabled(fEnabled);
+}
+
 void CoinControlDialog::updateView()
 {
     if (!model || !model->getOptionsModel() || !model->getAddressTableModel())
@@ -610,9 +786,9 @@ void CoinControlDialog::updateView()
     bool treeMode = ui->radioTreeMode->isChecked();
 
     ui->treeWidget->clear();
+    mapPendingOutputs.clear();
     ui->treeWidget->setEnabled(false); // performance, otherwise updateLabels would be called for every checked checkbox
     ui->treeWidget->setAlternatingRowColors(!treeMode);
-    QFlags<Qt::ItemFlag> flgCheckbox = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable;
     QFlags<Qt::ItemFlag> flgTristate = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsTristate;
 
     int nDisplayUnit = model->getOptionsModel()->getDisplayUnit();
@@ -620,119 +796,75 @@ void CoinControlDialog::updateView()
     std::map<QString, std::vector<COutput> > mapCoins;
     model->listCoins(mapCoins);
 
+    std::vector<COutPoint> vLocked;
+    model->listLockedCoins(vLocked);
+    std::set<COutPoint> setLocked(vLocked.begin(), vLocked.end());
+
+    // In tree mode only the address items are built here. Their outputs are listed the first time they are
+    // expanded, so a wallet with a great many coins on a few addresses opens without building an item for each.
+    QList<QTreeWidgetItem*> items;
+    std::vector<QTreeWidgetItem*> vExpand;
     for (const std::pair<QString, std::vector<COutput>>& coins : mapCoins) {
-        CCoinControlWidgetItem *itemWalletAddress = new CCoinControlWidgetItem();
-        itemWalletAddress->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
         QString sWalletAddress = coins.first;
         QString sWalletLabel = model->getAddressTableModel()->labelForAddress(sWalletAddress);
         if (sWalletLabel.isEmpty())
             sWalletLabel = tr("(no label)");
 
-        if (treeMode)
+        if (!treeMode)
         {
-            // wallet address
-            ui->treeWidget->addTopLevelItem(itemWalletAddress);
+            for (const COutput& out : coins.second)
+                items.append(newOutputItem(out, sWalletAddress, sWalletLabel, false, setLocked));
+            continue;
+        }
 
-            itemWalletAddress->setFlags(flgTristate);
-            itemWalletAddress->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
+        // wallet address
+        CCoinControlWidgetItem *itemWalletAddress = new CCoinControlWidgetItem();
+        itemWalletAddress->setFlags(flgTristate);
 
-            // label
-            itemWalletAddress->setText(COLUMN_LABEL, sWalletLabel);
+        // label
+        itemWalletAddress->setText(COLUMN_LABEL, sWalletLabel);
 
-            // address
-            itemWalletAddress->setText(COLUMN_ADDRESS, sWalletAddress);
-        }
+        // address
+        itemWalletAddress->setText(COLUMN_ADDRESS, sWalletAddress);
 
         CAmount nSum = 0;
         int nChildren = 0;
+        int nSelected = 0;
+        std::vector<COutPoint>& vPending = mapPendingOutputs[itemWalletAddress];
         for (const COutput& out : coins.second) {
             nSum += out.tx->tx->vout[out.i].nValue;
             nChildren++;
 
-            CCoinControlWidgetItem *itemOutput;
-            if (treeMode)    itemOutput = new CCoinControlWidgetItem(itemWalletAddress);
-            else             itemOutput = new CCoinControlWidgetItem(ui->treeWidget);
-            itemOutput->setFlags(flgCheckbox);
-            itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Unchecked);
-
-            // address
-            CTxDestination outputAddress;
-            QString sAddress = "";
-            if(ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, outputAddress))
-            {
-                sAddress = QString::fromStdString(EncodeDestination(outputAddress));
-
-                // if listMode or change => show paladeum address. In tree mode, address is not shown again for direct wallet address outputs
-                if (!treeMode || (!(sAddress == sWalletAddress)))
-                    itemOutput->setText(COLUMN_ADDRESS, sAddress);
-            }
-
-            // label
-            if (!(sAddress == sWalletAddress)) // change
-            {
-                // tooltip from where the change comes from
-                itemOutput->setToolTip(COLUMN_LABEL, tr("change from %1 (%2)").arg(sWalletLabel).arg(sWalletAddress));
-                itemOutput->setText(COLUMN_LABEL, tr("(change)"));
-            }
-            else if (!treeMode)
-            {
-                QString sLabel = model->getAddressTableModel()->labelForAddress(sAddress);
-                if (sLabel.isEmpty())
-                    sLabel = tr("(no label)");
-                itemOutput->setText(COLUMN_LABEL, sLabel);
-            }
-
-            // amount
-            itemOutput->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, out.tx->tx->vout[out.i].nValue));
-            itemOutput->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)out.tx->tx->vout[out.i].nValue)); // padding so that sorting works correctly
-
-            // date
-            itemOutput->setText(COLUMN_DATE, GUIUtil::dateTimeStr(out.tx->GetTxTime()));
-            itemOutput->setData(COLUMN_DATE, Qt::UserRole, QVariant((qlonglong)out.tx->GetTxTime()));
-
-            // confirmations
-            itemOutput->setText(COLUMN_CONFIRMATIONS, QString::number(out.nDepth));
-            itemOutput->setData(COLUMN_CONFIRMATIONS, Qt::UserRole, QVariant((qlonglong)out.nDepth));
-
-            // transaction hash
-            uint256 txhash = out.tx->GetHash();
-            itemOutput->setText(COLUMN_TXHASH, QString::fromStdString(txhash.GetHex()));
-
-            // vout index
-            itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.i));
-
-             // disable locked coins
-            if (model->isLockedCoin(txhash, out.i))
-            {
-                COutPoint outpt(txhash, out.i);
+            COutPoint outpt(out.tx->GetHash(), out.i);
+            if (setLocked.count(outpt))
                 coinControl->UnSelect(outpt); // just to be sure
-                itemOutput->setDisabled(true);
-                itemOutput->setIcon(COLUMN_CHECKBOX, platformStyle->SingleColorIcon(":/icons/lock_closed"));
-            }
-
-            // set checkbox
-            if (coinControl->IsSelected(COutPoint(txhash, out.i)))
-                itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Checked);
+            else if (coinControl->IsSelected(outpt))
+                nSelected++;
+            vPending.push_back(outpt);
         }
 
+        // the checkbox follows the outputs under it, like it does once they are listed
+        itemWalletAddress->setCheckState(COLUMN_CHECKBOX, nSelected == 0 ? Qt::Unchecked : (nSelected == nChildren ? Qt::Checked : Qt::PartiallyChecked));
+        itemWalletAddress->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+
         // amount
-        if (treeMode)
-        {
-            itemWalletAddress->setText(COLUMN_CHECKBOX, "(" + QString::number(nChildren) + ")");
-            itemWalletAddress->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, nSum));
-            itemWalletAddress->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)nSum));
-        }
-    }
+        itemWalletAddress->setText(COLUMN_CHECKBOX, "(" + QString::number(nChildren) + ")");
+        itemWalletAddress->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, nSum));
+        itemWalletAddress->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)nSum));
 
-    // expand all partially selected
-    if (treeMode)
-    {
-        for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
-            if (ui->treeWidget->topLevelItem(i)->checkState(COLUMN_CHECKBOX) == Qt::PartiallyChecked)
-                ui->treeWidget->topLevelItem(i)->setExpanded(true);
+        items.append(itemWalletAddress);
+
+        // expand all partially selected
+        if (nSelected > 0 && nSelected < nChildren)
+            vExpand.push_back(itemWalletAddress);
     }
+    ui->treeWidget->addTopLevelItems(items);
 
     // sort view
     sortView(sortColumn, sortOrder);
+
+    for (QTreeWidgetItem* item : vExpand)
+        item->setExpanded(true);
+
     ui->treeWidget->setEnabled(true);
 }
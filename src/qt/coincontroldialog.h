@@ -7,6 +7,11 @@
 #define PLB_QT_COINCONTROLDIALOG_H
 
 #include "amount.h"
+#include "primitives/transaction.h"
+
+#include <map>
+#include <set>
+#include <vector>
 
 #include <QAbstractButton>
 #include <QAction>
@@ -17,6 +22,7 @@
 #include <QString>
 #include <QTreeWidgetItem>
 
+class COutput;
 class PlatformStyle;
 class WalletModel;
 
@@ -70,8 +76,15 @@ private:
 
     const PlatformStyle *platformStyle;
 
+    // tree mode: outputs of the address items that have not been expanded or checked yet
+    std::map<QTreeWidgetItem*, std::vector<COutPoint> > mapPendingOutputs;
+    bool fLabelsPending;
+
     void sortView(int, Qt::SortOrder);
     void updateView();
+    CCoinControlWidgetItem* newOutputItem(const COutput& out, const QString& sWalletAddress, const QString& sWalletLabel, bool treeMode, const std::set<COutPoint>& setLocked);
+    void populateAddressItem(QTreeWidgetItem* item);
+    void scheduleLabelUpdate();
 
     enum
     {
@@ -104,6 +117,8 @@ private Q_SLOTS:
     void radioTreeMode(bool);
     void radioListMode(bool);
     void viewItemChanged(QTreeWidgetItem*, int);
+    void viewItemExpanded(QTreeWidgetItem*);
+    void updatePendingLabels();
     void headerSectionClicked(int);
     void buttonBoxClicked(QAbstractButton*);
     void buttonSelectAllClicked();
@@ -39,6 +39,9 @@ static int column_alignments[] = {
         Qt::AlignLeft|Qt::AlignVCenter /* tokenName */
 };
 
+//! Number of entries read from the database each time the view asks for more
+static const size_t MY_RESTRICTED_TOKENS_PAGE_SIZE = 500;
+
 // Comparison operator for sort/binary search of model tx list
 struct TxLessThan
 {
@@ -62,7 +65,9 @@ class MyRestrictedTokensTablePriv
 public:
     MyRestrictedTokensTablePriv(CWallet *_wallet, MyRestrictedTokensTableModel *_parent) :
             wallet(_wallet),
-            parent(_parent)
+            parent(_parent),
+            fTaggedDone(false),
+            fRestrictedDone(false)
     {
     }
 
@@ -76,35 +81,72 @@ public:
     QMap<QPair<QString,QString>,MyRestrictedTokenRecord> cacheMyTokenData;
     QList<QPair<QString, QString> > vectTokenData;
 
-    /* Query entire wallet anew from core.
+    /* Where fetchMore continues: the tagged addresses first, then the restricted ones.
+     */
+    bool fTaggedDone;
+    bool fRestrictedDone;
+    std::pair<std::string, std::string> keyNext;
+
+    /* Load the first page from the database, the view asks for the rest when it is scrolled down.
      */
     void refreshWallet()
     {
         qDebug() << "MyRestrictedTokensTablePriv::refreshWallet";
         cacheMyTokenData.clear();
         vectTokenData.clear();
-        {
-            std::vector<std::tuple<std::string, std::string, bool, uint32_t> > myTaggedAddresses;
-            std::vector<std::tuple<std::string, std::string, bool, uint32_t> > myRestrictedAddresses;
-            pmyrestricteddb->LoadMyTaggedAddresses(myTaggedAddresses);
-            pmyrestricteddb->LoadMyRestrictedAddresses(myRestrictedAddresses);
-            myTaggedAddresses.insert(myTaggedAddresses.end(), myRestrictedAddresses.begin(), myRestrictedAddresses.end());
-            if(myTaggedAddresses.size()) {
-                for (auto item : myTaggedAddresses) {
-                    MyRestrictedTokenRecord sub;
-                    sub.address = std::get<0>(item);
-                    sub.tokenName = std::get<1>(item);
-                    sub.time = std::get<3>(item);
-                    if (IsTokenNameAQualifier(sub.tokenName))
-                        sub.type = std::get<2>(item) ? MyRestrictedTokenRecord::Type::Tagged : MyRestrictedTokenRecord::Type::UnTagged;
-                    else if (IsTokenNameAnRestricted(sub.tokenName))
-                        sub.type = std::get<2>(item) ? MyRestrictedTokenRecord::Type::Frozen : MyRestrictedTokenRecord::Type::UnFrozen;
-                    sub.involvesWatchAddress = this->wallet->IsMineDest(DecodeDestination(sub.address)) & ISMINE_WATCH_ONLY;
-                    vectTokenData.push_back(qMakePair(QString::fromStdString(std::get<0>(item)), QString::fromStdString(std::get<1>(item))));
-                    cacheMyTokenData[qMakePair(QString::fromStdString(std::get<0>(item)), QString::fromStdString(std::get<1>(item)))] = sub;
-                }
-            }
+        fTaggedDone = false;
+        fRestrictedDone = false;
+        keyNext = std::pair<std::string, std::string>();
+        fetchMore();
+    }
+
+    bool canFetchMore() const
+    {
+        return !fRestrictedDone;
+    }
+
+    void fetchMore()
+    {
+        if (!pmyrestricteddb || fRestrictedDone)
+            return;
+
+        std::vector<std::tuple<std::string, std::string, bool, uint32_t> > page;
+        std::pair<std::string, std::string> keyAfter = keyNext;
+        if (!fTaggedDone) {
+            pmyrestricteddb->LoadMyTaggedAddressesFrom(keyAfter, MY_RESTRICTED_TOKENS_PAGE_SIZE, page, keyNext);
+            fTaggedDone = keyNext.first.empty();
+        } else {
+            pmyrestricteddb->LoadMyRestrictedAddressesFrom(keyAfter, MY_RESTRICTED_TOKENS_PAGE_SIZE, page, keyNext);
+            fRestrictedDone = keyNext.first.empty();
+        }
+
+        QList<MyRestrictedTokenRecord> records;
+        for (const auto& item : page) {
+            QPair<QString, QString> pair(QString::fromStdString(std::get<0>(item)), QString::fromStdString(std::get<1>(item)));
+            // Already shown, added by a notification before its page was loaded
+            if (cacheMyTokenData.contains(pair))
+                continue;
+            MyRestrictedTokenRecord sub;
+            sub.address = std::get<0>(item);
+            sub.tokenName = std::get<1>(item);
+            sub.time = std::get<3>(item);
+            if (IsTokenNameAQualifier(sub.tokenName))
+                sub.type = std::get<2>(item) ? MyRestrictedTokenRecord::Type::Tagged : MyRestrictedTokenRecord::Type::UnTagged;
+            else if (IsTokenNameAnRestricted(sub.tokenName))
+                sub.type = std::get<2>(item) ? MyRestrictedTokenRecord::Type::Frozen : MyRestrictedTokenRecord::Type::UnFrozen;
+            sub.involvesWatchAddress = this->wallet->IsMineDest(DecodeDestination(sub.address)) & ISMINE_WATCH_ONLY;
+            records.append(sub);
+        }
+        if (records.isEmpty())
+            return;
+
+        parent->beginInsertRows(QModelIndex(), vectTokenData.size(), vectTokenData.size() + records.size() - 1);
+        for (const MyRestrictedTokenRecord& rec : records) {
+            QPair<QString, QString> pair(QString::fromStdString(rec.address), QString::fromStdString(rec.tokenName));
+            vectTokenData.push_back(pair);
+            cacheMyTokenData[pair] = rec;
         }
+        parent->endInsertRows();
     }
 
     void updateMyRestrictedTokens(const QString &address, const QString& token_name, const int type, const qint64& date) {
@@ -212,6 +254,19 @@ int MyRestrictedTokensTableModel::rowCount(const QModelIndex &parent) const
     return priv->size();
 }
 
+bool MyRestrictedTokensTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return false;
+    return priv->canFetchMore();
+}
+
+void MyRestrictedTokensTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid())
+        priv->fetchMore();
+}
+
 int MyRestrictedTokensTableModel::columnCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
@@ -30,6 +30,7 @@
 #include <QIcon>
 #include <QSettings>
 #include <QString>
+#include <QTimer>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
 #include <QStringListModel>
@@ -41,6 +42,46 @@ QList<CAmount> TokenControlDialog::payAmounts;
 CCoinControl* TokenControlDialog::tokenControl = new CCoinControl();
 bool TokenControlDialog::fSubtractFeeFromAmount = false;
 
+/** Token amount and estimated input size of a selected output. They never change for an outpoint,
+ *  so updateLabels only asks the wallet for outputs it has not seen selected before. */
+struct TokenControlInput
+{
+    std::string strTokenName;
+    CAmount nAmount;
+    unsigned int nBytes;
+    bool fWitness;
+};
+static std::map<COutPoint, TokenControlInput> mapSelectedInputs;
+
+static TokenControlInput GetTokenControlInput(WalletModel *model, const COutput& out)
+{
+    const CTxOut& txout = out.tx->tx->vout[out.i];
+    TokenControlInput input;
+    input.nAmount = 0;
+    input.nBytes = 148; // in all error cases, simply assume 148 here
+    input.fWitness = false;
+
+    uint32_t nTimeLock;
+    GetTokenInfoFromScript(txout.scriptPubKey, input.strTokenName, input.nAmount, nTimeLock);
+
+    CTxDestination address;
+    int witnessversion = 0;
+    std::vector<unsigned char> witnessprogram;
+    if (txout.scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram))
+    {
+        input.nBytes = (32 + 4 + 1 + (107 / WITNESS_SCALE_FACTOR) + 4);
+        input.fWitness = true;
+    }
+    else if(ExtractDestination(txout.scriptPubKey, address))
+    {
+        CPubKey pubkey;
+        CKeyID *keyid = boost::get<CKeyID>(&address);
+        if (keyid && model->getPubKey(*keyid, pubkey))
+            input.nBytes = (pubkey.IsCompressed() ? 148 : 180);
+    }
+    return input;
+}
+
 bool CTokenControlWidgetItem::operator<(const QTreeWidgetItem &other) const {
     int column = treeWidget()->sortColumn();
     if (column == TokenControlDialog::COLUMN_AMOUNT || column == TokenControlDialog::COLUMN_DATE || column == TokenControlDialog::COLUMN_CONFIRMATIONS)
@@ -52,7 +93,8 @@ TokenControlDialog::TokenControlDialog(const PlatformStyle *_platformStyle, QWid
     QDialog(parent),
     ui(new Ui::TokenControlDialog),
     model(0),
-    platformStyle(_platformStyle)
+    platformStyle(_platformStyle),
+    fLabelsPending(false)
 {
     ui->setupUi(this);
 
@@ -115,6 +157,9 @@ TokenControlDialog::TokenControlDialog(const PlatformStyle *_platformStyle, QWid
     // click on checkbox
     connect(ui->treeWidget, SIGNAL(itemChanged(QTreeWidgetItem*, int)), this, SLOT(viewItemChanged(QTreeWidgetItem*, int)));
 
+    // expand an address in tree mode
+    connect(ui->treeWidget, SIGNAL(itemExpanded(QTreeWidgetItem*)), this, SLOT(viewItemExpanded(QTreeWidgetItem*)));
+
     // click on header
 #if QT_VERSION < 0x050000
     ui->treeWidget->header()->setClickable(true);
@@ -418,7 +463,31 @@ void TokenControlDialog::viewItemChanged(QTreeWidgetItem* item, int column)
 
         // selection changed -> update labels
         if (ui->treeWidget->isEnabled()) // do not update on every click for (un)select all
-            TokenControlDialog::updateLabels(model, this);
+            scheduleLabelUpdate();
+    }
+
+    // tree mode: an address whose outputs are not listed yet was (un)checked, select them without listing them
+    else if (column == COLUMN_CHECKBOX && mapPendingOutputs.count(item))
+    {
+        Qt::CheckState state = item->checkState(COLUMN_CHECKBOX);
+        if (state == Qt::PartiallyChecked) // set below when some of the outputs are locked
+            return;
+
+        bool fLocked = false;
+        for (const COutPoint& outpt : mapPendingOutputs[item])
+        {
+            if (state == Qt::Unchecked)
+                tokenControl->UnSelectToken(outpt);
+            else if (model->isLockedCoin(outpt.hash, outpt.n))
+                fLocked = true;
+            else
+                tokenControl->SelectToken(outpt);
+        }
+        if (fLocked)
+            item->setCheckState(COLUMN_CHECKBOX, Qt::PartiallyChecked);
+
+        if (ui->treeWidget->isEnabled())
+            scheduleLabelUpdate();
     }
 
     // TODO: Remove this temporary qt5 fix after Qt5.3 and Qt5.4 are no longer used.
@@ -432,6 +501,28 @@ void TokenControlDialog::viewItemChanged(QTreeWidgetItem* item, int column)
 #endif
 }
 
+// tree mode: list the outputs of an address the first time it is expanded
+void TokenControlDialog::viewItemExpanded(QTreeWidgetItem* item)
+{
+    if (mapPendingOutputs.count(item))
+        populateAddressItem(item);
+}
+
+// checking an address in tree mode changes the state of every output under it, update the labels once for all of them
+void TokenControlDialog::scheduleLabelUpdate()
+{
+    if (fLabelsPending)
+        return;
+    fLabelsPending = true;
+    QTimer::singleShot(0, this, SLOT(updatePendingLabels()));
+}
+
+void TokenControlDialog::updatePendingLabels()
+{
+    fLabelsPending = false;
+    TokenControlDialog::updateLabels(model, this);
+}
+
 // shows count of locked unspent outputs
 void TokenControlDialog::updateLabelLocked()
 {
@@ -478,18 +569,28 @@ void TokenControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
     bool fWitness               = false;
 
     std::vector<COutPoint> vCoinControl;
+    std::vector<COutPoint> vNewInputs;
     std::vector<COutput>   vOutputs;
     tokenControl->ListSelectedTokens(vCoinControl);
-    model->getOutputs(vCoinControl, vOutputs);
+    for (const COutPoint& outpt : vCoinControl)
+        if (!mapSelectedInputs.count(outpt))
+            vNewInputs.push_back(outpt);
+    if (!vNewInputs.empty())
+        model->getOutputs(vNewInputs, vOutputs);
+    for (const COutput& out : vOutputs)
+        mapSelectedInputs[COutPoint(out.tx->GetHash(), out.i)] = GetTokenControlInput(model, out);
+
+    for (const COutPoint& outpt : vCoinControl) {
+        auto it = mapSelectedInputs.find(outpt);
+        if (it == mapSelectedInputs.end()) // not in the wallet
+            continue;
 
-    for (const COutput& out : vOutputs) {
         // unselect already spent, very unlikely scenario, this could happen
         // when selected are spent elsewhere, like rpc or another computer
-        uint256 txhash = out.tx->GetHash();
-        COutPoint outpt(txhash, out.i);
         if (model->isSpent(outpt))
         {
             tokenControl->UnSelectToken(outpt);
+            mapSelectedInputs.erase(it);
             continue;
         }
 
@@ -497,32 +598,12 @@ void TokenControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
         nQuantity++;
 
         // Amount
-        CAmount nCoinAmount;
-        uint32_t nTimeLock;
-        GetTokenInfoFromScript(out.tx->tx->vout[out.i].scriptPubKey, strTokenName, nCoinAmount, nTimeLock);
-        nTokenAmount += nCoinAmount;
+        strTokenName = it->second.strTokenName;
+        nTokenAmount += it->second.nAmount;
 
         // Bytes
-        CTxDestination address;
-        int witnessversion = 0;
-        std::vector<unsigned char> witnessprogram;
-        if (out.tx->tx->vout[out.i].scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram))
-        {
-            nBytesInputs += (32 + 4 + 1 + (107 / WITNESS_SCALE_FACTOR) + 4);
-            fWitness = true;
-        }
-        else if(ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, address))
-        {
-            CPubKey pubkey;
-            CKeyID *keyid = boost::get<CKeyID>(&address);
-            if (keyid && model->getPubKey(*keyid, pubkey))
-            {
-                nBytesInputs += (pubkey.IsCompressed() ? 148 : 180);
-            }
-            else
-                nBytesInputs += 148; // in all error cases, simply assume 148 here
-        }
-        else nBytesInputs += 148;
+        nBytesInputs += it->second.nBytes;
+        fWitness |= it->second.fWitness;
     }
 
     // calculation
@@ -619,6 +700,113 @@ void TokenControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
         label->setVisible(nChange < 0);
 }
 
+CTokenControlWidgetItem* TokenControlDialog::newOutputItem(const COutput& out, const QString& sWalletAddress, const QString& sWalletLabel, bool treeMode, const std::set<COutPoint>& setLocked)
+{
+    std::string strTokenName;
+    CAmount nAmount;
+    uint32_t nTokenLockTime;
+    if (!GetTokenInfoFromScript(out.tx->tx->vout[out.i].scriptPubKey, strTokenName, nAmount, nTokenLockTime))
+        return nullptr;
+
+    // built without a parent and added in one go, so filling it in emits no itemChanged
+    CTokenControlWidgetItem *itemOutput = new CTokenControlWidgetItem();
+    itemOutput->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+    itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
+
+    int nDisplayUnit = model->getOptionsModel()->getDisplayUnit();
+
+    // address
+    CTxDestination outputAddress;
+    QString sAddress = "";
+    if (ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, outputAddress)) {
+        sAddress = QString::fromStdString(EncodeDestination(outputAddress));
+
+        // if listMode or change => show paladeum address. In tree mode, address is not shown again for direct wallet address outputs
+        if (!treeMode || (!(sAddress == sWalletAddress))) {
+            itemOutput->setText(COLUMN_ADDRESS, sAddress);
+            // token name
+            itemOutput->setText(COLUMN_TOKEN_NAME, QString::fromStdString(strTokenName));
+        }
+    }
+
+    // label
+    if (!(sAddress == sWalletAddress)) // change
+    {
+        // tooltip from where the change comes from
+        itemOutput->setToolTip(COLUMN_LABEL,
+                               tr("change from %1 (%2)").arg(sWalletLabel).arg(sWalletAddress));
+        itemOutput->setText(COLUMN_LABEL, tr("(change)"));
+    } else if (!treeMode) {
+        itemOutput->setText(COLUMN_LABEL, sWalletLabel);
+    }
+
+    // amount
+    itemOutput->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, nAmount));
+    itemOutput->setData(COLUMN_AMOUNT, Qt::UserRole,
+                        QVariant((qlonglong) nAmount)); // padding so that sorting works correctly
+
+    // date
+    itemOutput->setText(COLUMN_DATE, GUIUtil::dateTimeStr(out.tx->GetTxTime()));
+    itemOutput->setData(COLUMN_DATE, Qt::UserRole, QVariant((qlonglong) out.tx->GetTxTime()));
+
+    // confirmations
+    itemOutput->setText(COLUMN_CONFIRMATIONS, QString::number(out.nDepth));
+    itemOutput->setData(COLUMN_CONFIRMATIONS, Qt::UserRole, QVariant((qlonglong) out.nDepth));
+
+    // transaction hash
+    uint256 txhash = out.tx->GetHash();
+    itemOutput->setText(COLUMN_TXHASH, QString::fromStdString(txhash.GetHex()));
+
+    // vout index
+    itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.i));
+
+    // disable locked coins
+    COutPoint outpt(txhash, out.i);
+    if (setLocked.count(outpt)) {
+        tokenControl->UnSelectToken(outpt); // just to be sure
+        itemOutput->setDisabled(true);
+        itemOutput->setIcon(COLUMN_CHECKBOX, platformStyle->SingleColorIcon(":/icons/lock_closed"));
+    }
+
+    // set checkbox
+    if (tokenControl->IsTokenSelected(outpt))
+        itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Checked);
+
+    return itemOutput;
+}
+
+// tree mode: list the outputs of an address item
+void TokenControlDialog::populateAddressItem(QTreeWidgetItem* item)
+{
+    auto it = mapPendingOutputs.find(item);
+    if (it == mapPendingOutputs.end())
+        return;
+
+    std::vector<COutput> vOutputs;
+    model->getOutputs(it->second, vOutputs);
+    mapPendingOutputs.erase(it);
+
+    std::vector<COutPoint> vLocked;
+    model->listLockedCoins(vLocked);
+    std::set<COutPoint> setLocked(vLocked.begin(), vLocked.end());
+
+    QString sWalletAddress = item->text(COLUMN_ADDRESS);
+    QString sWalletLabel = item->text(COLUMN_LABEL);
+
+    bool fEnabled = ui->treeWidget->isEnabled();
+    ui->treeWidget->setEnabled(false);
+    QList<QTreeWidgetItem*> children;
+    for (const COutput& out : vOutputs) {
+        CTokenControlWidgetItem *itemOutput = newOutputItem(out, sWalletAddress, sWalletLabel, true, setLocked);
+        if (itemOutput)
+            children.append(itemOutput);
+    }
+    item->addChildren(children);
+    item->sortChildren(sortColumn, sortOrder);
+    item->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
+    ui->treeWidget->setEnabled(fEnabled);
+}
+
 void TokenControlDialog::updateView()
 {
     if (!model || !model->getOptionsModel() || !model->getAddressTableModel())
@@ -627,9 +815,9 @@ void TokenControlDialog::updateView()
     bool treeMode = ui->radioTreeMode->isChecked();
 
     ui->treeWidget->clear();
+    mapPendingOutputs.clear();
     ui->treeWidget->setEnabled(false); // performance, otherwise updateLabels would be called for every checked checkbox
     ui->treeWidget->setAlternatingRowColors(!treeMode);
-    QFlags<Qt::ItemFlag> flgCheckbox = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable;
     QFlags<Qt::ItemFlag> flgTristate = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsTristate;
 
     int nDisplayUnit = model->getOptionsModel()->getDisplayUnit();
@@ -645,35 +833,48 @@ void TokenControlDialog::updateView()
 
     // For now we only support for one tokens coins being shown at a time
     // So we only loop through coins for that specific token
-    auto mapTokenCoins = mapCoins.at(tokenToDisplay);
+    const std::map<QString, std::vector<COutput> >& mapTokenCoins = mapCoins.at(tokenToDisplay);
 
+    std::vector<COutPoint> vLocked;
+    model->listLockedCoins(vLocked);
+    std::set<COutPoint> setLocked(vLocked.begin(), vLocked.end());
+
+    // In tree mode only the address items are built here. Their outputs are listed the first time they are
+    // expanded, so a wallet with a great many token outputs on a few addresses opens without building an item for each.
+    QList<QTreeWidgetItem*> items;
+    std::vector<QTreeWidgetItem*> vExpand;
     for (const std::pair<QString, std::vector<COutput>> &coins : mapTokenCoins) {
-        CTokenControlWidgetItem *itemWalletAddress = new CTokenControlWidgetItem();
-        itemWalletAddress->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
         QString sWalletAddress = coins.first;
         QString sWalletLabel = model->getAddressTableModel()->labelForAddress(sWalletAddress);
         if (sWalletLabel.isEmpty())
             sWalletLabel = tr("(no label)");
 
-        if (treeMode) {
-            // wallet address
-            ui->treeWidget->addTopLevelItem(itemWalletAddress);
+        if (!treeMode) {
+            for (const COutput &out : coins.second) {
+                CTokenControlWidgetItem *itemOutput = newOutputItem(out, sWalletAddress, sWalletLabel, false, setLocked);
+                if (itemOutput)
+                    items.append(itemOutput);
+            }
+            continue;
+        }
 
-            itemWalletAddress->setFlags(flgTristate);
-            itemWalletAddress->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
+        // wallet address
+        CTokenControlWidgetItem *itemWalletAddress = new CTokenControlWidgetItem();
+        itemWalletAddress->setFlags(flgTristate);
 
-            // label
-            itemWalletAddress->setText(COLUMN_LABEL, sWalletLabel);
+        // label
+        itemWalletAddress->setText(COLUMN_LABEL, sWalletLabel);
 
-            // address
-            itemWalletAddress->setText(COLUMN_ADDRESS, sWalletAddress);
+        // address
+        itemWalletAddress->setText(COLUMN_ADDRESS, sWalletAddress);
 
-            // token name
-            itemWalletAddress->setText(COLUMN_TOKEN_NAME, tokenToDisplay);
-        }
+        // token name
+        itemWalletAddress->setText(COLUMN_TOKEN_NAME, tokenToDisplay);
 
         CAmount nSum = 0;
         int nChildren = 0;
+        int nSelected = 0;
+        std::vector<COutPoint>& vPending = mapPendingOutputs[itemWalletAddress];
         for (const COutput &out : coins.second) {
             std::string strTokenName;
             CAmount nAmount;
@@ -687,91 +888,37 @@ void TokenControlDialog::updateView()
             nSum += nAmount;
             nChildren++;
 
-            CTokenControlWidgetItem *itemOutput;
-            if (treeMode) itemOutput = new CTokenControlWidgetItem(itemWalletAddress);
-            else itemOutput = new CTokenControlWidgetItem(ui->treeWidget);
-            itemOutput->setFlags(flgCheckbox);
-            itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
-
-            // address
-            CTxDestination outputAddress;
-            QString sAddress = "";
-            if (ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, outputAddress)) {
-                sAddress = QString::fromStdString(EncodeDestination(outputAddress));
-
-                // if listMode or change => show paladeum address. In tree mode, address is not shown again for direct wallet address outputs
-                if (!treeMode || (!(sAddress == sWalletAddress))) {
-                    itemOutput->setText(COLUMN_ADDRESS, sAddress);
-                    // token name
-                    itemOutput->setText(COLUMN_TOKEN_NAME, QString::fromStdString(strTokenName));
-                }
-            }
-
-            // label
-            if (!(sAddress == sWalletAddress)) // change
-            {
-                // tooltip from where the change comes from
-                itemOutput->setToolTip(COLUMN_LABEL,
-                                       tr("change from %1 (%2)").arg(sWalletLabel).arg(sWalletAddress));
-                itemOutput->setText(COLUMN_LABEL, tr("(change)"));
-            } else if (!treeMode) {
-                QString sLabel = model->getAddressTableModel()->labelForAddress(sAddress);
-                if (sLabel.isEmpty())
-                    sLabel = tr("(no label)");
-                itemOutput->setText(COLUMN_LABEL, sLabel);
-            }
-
-            // amount
-            itemOutput->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, nAmount));
-            itemOutput->setData(COLUMN_AMOUNT, Qt::UserRole,
-                                QVariant((qlonglong) nAmount)); // padding so that sorting works correctly
-
-            // date
-            itemOutput->setText(COLUMN_DATE, GUIUtil::dateTimeStr(out.tx->GetTxTime()));
-            itemOutput->setData(COLUMN_DATE, Qt::UserRole, QVariant((qlonglong) out.tx->GetTxTime()));
-
-            // confirmations
-            itemOutput->setText(COLUMN_CONFIRMATIONS, QString::number(out.nDepth));
-            itemOutput->setData(COLUMN_CONFIRMATIONS, Qt::UserRole, QVariant((qlonglong) out.nDepth));
-
-            // transaction hash
-            uint256 txhash = out.tx->GetHash();
-            itemOutput->setText(COLUMN_TXHASH, QString::fromStdString(txhash.GetHex()));
-
-            // vout index
-            itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.i));
-
-            // disable locked coins
-            if (model->isLockedCoin(txhash, out.i)) {
-                COutPoint outpt(txhash, out.i);
+            COutPoint outpt(out.tx->GetHash(), out.i);
+            if (setLocked.count(outpt))
                 tokenControl->UnSelectToken(outpt); // just to be sure
-                itemOutput->setDisabled(true);
-                itemOutput->setIcon(COLUMN_CHECKBOX, platformStyle->SingleColorIcon(":/icons/lock_closed"));
-            }
-
-            // set checkbox
-            if (tokenControl->IsTokenSelected(COutPoint(txhash, out.i)))
-                itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Checked);
+            else if (tokenControl->IsTokenSelected(outpt))
+                nSelected++;
+            vPending.push_back(outpt);
         }
 
+        // the checkbox follows the outputs under it, like it does once they are listed
+        itemWalletAddress->setCheckState(COLUMN_CHECKBOX, nSelected == 0 ? Qt::Unchecked : (nSelected == nChildren ? Qt::Checked : Qt::PartiallyChecked));
+        itemWalletAddress->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+
         // amount
-        if (treeMode) {
-            itemWalletAddress->setText(COLUMN_CHECKBOX, "(" + QString::number(nChildren) + ")");
-            itemWalletAddress->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, nSum));
-            itemWalletAddress->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong) nSum));
-        }
-    }
+        itemWalletAddress->setText(COLUMN_CHECKBOX, "(" + QString::number(nChildren) + ")");
+        itemWalletAddress->setText(COLUMN_AMOUNT, PaladeumUnits::format(nDisplayUnit, nSum));
+        itemWalletAddress->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong) nSum));
 
-    // expand all partially selected
-    if (treeMode)
-    {
-        for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
-            if (ui->treeWidget->topLevelItem(i)->checkState(COLUMN_CHECKBOX) == Qt::PartiallyChecked)
-                ui->treeWidget->topLevelItem(i)->setExpanded(true);
+        items.append(itemWalletAddress);
+
+        // expand all partially selected
+        if (nSelected > 0 && nSelected < nChildren)
+            vExpand.push_back(itemWalletAddress);
     }
+    ui->treeWidget->addTopLevelItems(items);
 
     // sort view
     sortView(sortColumn, sortOrder);
+
+    for (QTreeWidgetItem* item : vExpand)
+        item->setExpanded(true);
+
     ui->treeWidget->setEnabled(true);
 }
 
@@ -7,6 +7,11 @@
 #define PLB_QT_TOKENCONTROLDIALOG_H
 
 #include "amount.h"
+#include "primitives/transaction.h"
+
+#include <map>
+#include <set>
+#include <vector>
 
 #include <QAbstractButton>
 #include <QAction>
@@ -17,7 +22,7 @@
 #include <QString>
 #include <QTreeWidgetItem>
 
-
+class COutput;
 class PlatformStyle;
 class WalletModel;
 
@@ -82,8 +87,15 @@ private:
 
     const PlatformStyle *platformStyle;
 
+    // tree mode: outputs of the address items that have not been expanded or checked yet
+    std::map<QTreeWidgetItem*, std::vector<COutPoint> > mapPendingOutputs;
+    bool fLabelsPending;
+
     void sortView(int, Qt::SortOrder);
     void updateView();
+    CTokenControlWidgetItem* newOutputItem(const COutput& out, const QString& sWalletAddress, const QString& sWalletLabel, bool treeMode, const std::set<COutPoint>& setLocked);
+    void populateAddressItem(QTreeWidgetItem* item);
+    void scheduleLabelUpdate();
 
     enum
     {
@@ -117,6 +129,8 @@ private Q_SLOTS:
     void radioTreeMode(bool);
     void radioListMode(bool);
     void viewItemChanged(QTreeWidgetItem*, int);
+    void viewItemExpanded(QTreeWidgetItem*);
+    void updatePendingLabels();
     void headerSectionClicked(int);
     void buttonBoxClicked(QAbstractButton*);
     void buttonSelectAllClicked();
@@ -21,7 +21,117 @@
 #include <QDebug>
 #include <QStringList>
 
+#include <algorithm>
 
+Q_DECLARE_METATYPE(TokenRecord)
+
+//! Rows are kept sorted: the spendable balances by name, then the locked ones by name
+static bool TokenRecordLessThan(const TokenRecord& a, const TokenRecord& b)
+{
+    if (a.fIsLocked != b.fIsLocked)
+        return b.fIsLocked;
+    return a.name < b.name;
+}
+
+// loads all current balances into records, sorted by TokenRecordLessThan
+#ifdef ENABLE_WALLET
+static bool FetchTokenRecords(QList<TokenRecord>& records)
+{
+    auto currentActiveTokenCache = GetCurrentTokenCache();
+    if (!currentActiveTokenCache)
+        return true;
+
+    LOCK(cs_main);
+    std::map<std::string, CAmount> balances;
+    std::map<std::string, CAmount> locked_balances;
+    std::map<std::string, std::vector<COutput> > outputs_locked;
+
+    if (!GetAllMyTokenBalances(balances)) {
+        qWarning("FetchTokenRecords: Error retrieving token balances");
+        return false;
+    }
+
+    if (!GetAllMyLockedTokenBalances(outputs_locked, locked_balances)) {
+        qWarning("FetchTokenRecords: Error retrieving locked token balances");
+        return false;
+    }
+
+    std::set<std::string> setTokensToSkip;
+    auto bal = balances.begin();
+    for (; bal != balances.end(); bal++) {
+        // retrieve units for token
+        uint8_t units = OWNER_UNITS;
+        bool fIsAdministrator = true;
+        std::string ipfsHash = "";
+
+        if (setTokensToSkip.count(bal->first))
+            continue;
+
+        if (!IsTokenNameAnOwner(bal->first)) {
+            // Token is not an administrator token
+            CNewToken tokenData;
+            if (!currentActiveTokenCache->GetTokenMetaDataIfExists(bal->first, tokenData)) {
+                qWarning("FetchTokenRecords: Error retrieving token data");
+                return false;
+            }
+            units = tokenData.units;
+            ipfsHash = tokenData.strIPFSHash;
+            // If we have the administrator token, add it to the skip list
+            if (balances.count(bal->first + OWNER_TAG)) {
+                setTokensToSkip.insert(bal->first + OWNER_TAG);
+            } else {
+                fIsAdministrator = false;
+            }
+        } else {
+            // Token is an administrator token, if we own tokens that is administrators, skip this balance
+            std::string name = bal->first;
+            name.pop_back();
+            if (balances.count(name)) {
+                setTokensToSkip.insert(bal->first);
+                continue;
+            }
+        }
+        records.append(TokenRecord(bal->first, bal->second, units, fIsAdministrator, false, EncodeTokenData(ipfsHash)));
+    }
+
+    auto lbal = locked_balances.begin();
+    for (; lbal != locked_balances.end(); lbal++) {
+        CNewToken tokenData;
+        if (!currentActiveTokenCache->GetTokenMetaDataIfExists(lbal->first, tokenData)) {
+            qWarning("FetchTokenRecords: Error retrieving locked token data");
+            return false;
+        }
+        records.append(TokenRecord(lbal->first + " (LOCKED)", lbal->second, tokenData.units, false, true, EncodeTokenData(tokenData.strIPFSHash)));
+    }
+
+    std::sort(records.begin(), records.end(), TokenRecordLessThan);
+    return true;
+}
+#endif
+
+/* Reads the token balances on the model's worker thread, so the GUI thread
+   never waits for cs_main or the wallet while a block is connected.
+*/
+class TokenTableWorker : public QObject
+{
+    Q_OBJECT
+
+public Q_SLOTS:
+    void refresh()
+    {
+        QList<TokenRecord> records;
+        bool fSuccess = false;
+#ifdef ENABLE_WALLET
+        fSuccess = FetchTokenRecords(records);
+#endif
+        Q_EMIT refreshed(fSuccess, records);
+    }
+
+Q_SIGNALS:
+    void refreshed(bool fSuccess, const QList<TokenRecord>& records);
+};
+
+#include "tokentablemodel.moc"
 
 class TokenTablePriv {
 public:
@@ -34,82 +144,43 @@ public:
 
     QList<TokenRecord> cachedBalances;
 
-    // loads all current balances into cache
-#ifdef ENABLE_WALLET
-    void refreshWallet() {
-        qDebug() << "TokenTablePriv::refreshWallet";
-        cachedBalances.clear();
-        auto currentActiveTokenCache = GetCurrentTokenCache();
-        if (currentActiveTokenCache) {
-            {
-                LOCK(cs_main);
-                std::map<std::string, CAmount> balances;
-                std::map<std::string, CAmount> locked_balances;
-                std::map<std::string, std::vector<COutput> > outputs;
-                std::map<std::string, std::vector<COutput> > outputs_locked;
-
-                if (!GetAllMyTokenBalances(outputs, balances)) {
-                    qWarning("TokenTablePriv::refreshWallet: Error retrieving token balances");
-                    return;
-                }
-
-                if (!GetAllMyLockedTokenBalances(outputs_locked, locked_balances)) {
-                    qWarning("TokenTablePriv::refreshWallet: Error retrieving locked token balances");
-                    return;
-                }
-
-                std::set<std::string> setTokensToSkip;
-                auto bal = balances.begin();
-                for (; bal != balances.end(); bal++) {
-                    // retrieve units for token
-                    uint8_t units = OWNER_UNITS;
-                    bool fIsAdministrator = true;
-                    std::string ipfsHash = "";
-
-                    if (setTokensToSkip.count(bal->first))
-                        continue;
-
-                    if (!IsTokenNameAnOwner(bal->first)) {
-                        // Token is not an administrator token
-                        CNewToken tokenData;
-                        if (!currentActiveTokenCache->GetTokenMetaDataIfExists(bal->first, tokenData)) {
-                            qWarning("TokenTablePriv::refreshWallet: Error retrieving token data");
-                            return;
-                        }
-                        units = tokenData.units;
-                        ipfsHash = tokenData.strIPFSHash;
-                        // If we have the administrator token, add it to the skip listå
-                        if (balances.count(bal->first + OWNER_TAG)) {
-                            setTokensToSkip.insert(bal->first + OWNER_TAG);
-                        } else {
-                            fIsAdministrator = false;
-                        }
-                    } else {
-                        // Token is an administrator token, if we own tokens that is administrators, skip this balance
-                        std::string name = bal->first;
-                        name.pop_back();
-                        if (balances.count(name)) {
-                            setTokensToSkip.insert(bal->first);
-                            continue;
-                        }
-                    }
-                    cachedBalances.append(TokenRecord(bal->first, bal->second, units, fIsAdministrator, false, EncodeTokenData(ipfsHash)));
-                }
+    /* Brings the cache in line with records, which must be sorted like it,
+       with a row signal for each row that is removed, inserted or changed
+       instead of resetting the whole table.
+    */
+    void updateBalances(const QList<TokenRecord>& records)
+    {
+        int row = 0;
+        for (const TokenRecord& rec : records) {
+            int removed = 0;
+            while (row + removed < cachedBalances.size() && TokenRecordLessThan(cachedBalances[row + removed], rec))
+                removed++;
+            if (removed > 0) {
+                parent->beginRemoveRows(QModelIndex(), row, row + removed - 1);
+                cachedBalances.erase(cachedBalances.begin() + row, cachedBalances.begin() + row + removed);
+                parent->endRemoveRows();
+            }
 
-                auto lbal = locked_balances.begin();
-                for (; lbal != locked_balances.end(); lbal++) {
-                    CNewToken tokenData;
-                    if (!currentActiveTokenCache->GetTokenMetaDataIfExists(lbal->first, tokenData)) {
-                        qWarning("TokenTablePriv::refreshWallet: Error retrieving locked token data");
-                        return;
-                    }
-                    cachedBalances.append(TokenRecord(lbal->first + " (LOCKED)", lbal->second, tokenData.units, false, true, EncodeTokenData(tokenData.strIPFSHash)));
+            if (row < cachedBalances.size() && !TokenRecordLessThan(rec, cachedBalances[row])) {
+                TokenRecord& cached = cachedBalances[row];
+                if (cached.quantity != rec.quantity || cached.units != rec.units || cached.fIsAdministrator != rec.fIsAdministrator || cached.ipfshash != rec.ipfshash) {
+                    cached = rec;
+                    Q_EMIT parent->dataChanged(parent->index(row, 0), parent->index(row, parent->columns.length() - 1));
                 }
+            } else {
+                parent->beginInsertRows(QModelIndex(), row, row);
+                cachedBalances.insert(row, rec);
+                parent->endInsertRows();
             }
+            row++;
         }
-    }
-#endif
 
+        if (row < cachedBalances.size()) {
+            parent->beginRemoveRows(QModelIndex(), row, cachedBalances.size() - 1);
+            cachedBalances.erase(cachedBalances.begin() + row, cachedBalances.end());
+            parent->endRemoveRows();
+        }
+    }
 
     int size() {
         return cachedBalances.size();
@@ -127,28 +198,48 @@ public:
 TokenTableModel::TokenTableModel(WalletModel *parent) :
         QAbstractTableModel(parent),
         walletModel(parent),
-        priv(new TokenTablePriv(this))
+        priv(new TokenTablePriv(this)),
+        fRefreshRunning(false),
+        fRefreshPending(false)
 {
     columns << tr("Name") << tr("Quantity");
 #ifdef ENABLE_WALLET
-    priv->refreshWallet();
+    FetchTokenRecords(priv->cachedBalances);
 #endif
+
+    qRegisterMetaType<QList<TokenRecord> >("QList<TokenRecord>");
+    TokenTableWorker *worker = new TokenTableWorker();
+    worker->moveToThread(&workerThread);
+    connect(this, &TokenTableModel::refreshRequested, worker, &TokenTableWorker::refresh);
+    connect(worker, &TokenTableWorker::refreshed, this, [this](bool fSuccess, const QList<TokenRecord>& records) {
+        if (fSuccess)
+            priv->updateBalances(records);
+        fRefreshRunning = false;
+        if (fRefreshPending) {
+            fRefreshPending = false;
+            checkBalanceChanged();
+        }
+    });
+    connect(&workerThread, &QThread::finished, worker, &QObject::deleteLater, Qt::DirectConnection);
+    workerThread.start();
 };
 
 TokenTableModel::~TokenTableModel()
 {
+    workerThread.quit();
+    workerThread.wait();
     delete priv;
 };
 
 void TokenTableModel::checkBalanceChanged() {
     qDebug() << "TokenTableModel::CheckBalanceChanged";
-    // TODO: optimize by 1) updating cache incrementally; and 2) emitting more specific dataChanged signals
-    Q_EMIT layoutAboutToBeChanged();
-#ifdef ENABLE_WALLET
-    priv->refreshWallet();
-#endif
-    Q_EMIT dataChanged(index(0, 0, QModelIndex()), index(priv->size(), columns.length()-1, QModelIndex()));
-    Q_EMIT layoutChanged();
+    // A block connected while the worker reads the balances is picked up by one more read when it is done
+    if (fRefreshRunning) {
+        fRefreshPending = true;
+        return;
+    }
+    fRefreshRunning = true;
+    Q_EMIT refreshRequested();
 }
 
 int TokenTableModel::rowCount(const QModelIndex &parent) const
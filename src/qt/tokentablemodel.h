@@ -10,6 +10,7 @@
 
 #include <QAbstractTableModel>
 #include <QStringList>
+#include <QThread>
 
 class TokenTablePriv;
 class WalletModel;
@@ -62,12 +63,19 @@ public:
     QString formatTokenName(const TokenRecord *wtx) const;
     QString formatTokenQuantity(const TokenRecord *wtx) const;
 
+    /** Reads the balances again on the worker thread, the rows are updated when it is done */
     void checkBalanceChanged();
 
+Q_SIGNALS:
+    void refreshRequested();
+
 private:
     WalletModel *walletModel;
     QStringList columns;
     TokenTablePriv *priv;
+    QThread workerThread;
+    bool fRefreshRunning;
+    bool fRefreshPending;
 
     friend class TokenTablePriv;
 };
@@ -37,9 +37,6 @@ bool TransactionFilterProxy::filterAcceptsRow(int sourceRow, const QModelIndex &
 
     int type = index.data(TransactionTableModel::TypeRole).toInt();
     QDateTime datetime = index.data(TransactionTableModel::DateRole).toDateTime();
-    bool involvesWatchAddress = index.data(TransactionTableModel::WatchonlyRole).toBool();
-    QString address = index.data(TransactionTableModel::AddressRole).toString();
-    QString label = index.data(TransactionTableModel::LabelRole).toString();
     qint64 amount = llabs(index.data(TransactionTableModel::AmountRole).toLongLong());
     int status = index.data(TransactionTableModel::StatusRole).toInt();
     QString tokenName = index.data(TransactionTableModel::TokenNameRole).toString();
@@ -48,19 +45,28 @@ bool TransactionFilterProxy::filterAcceptsRow(int sourceRow, const QModelIndex &
         return false;
     if(!(TYPE(type) & typeFilter))
         return false;
-    if (involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_No)
-        return false;
-    if (!involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_Yes)
-        return false;
     if(datetime < dateFrom || datetime > dateTo)
         return false;
-    if (!address.contains(addrPrefix, Qt::CaseInsensitive) && !label.contains(addrPrefix, Qt::CaseInsensitive))
-        return false;
     if(amount < minAmount)
         return false;
     if(!tokenName.contains(tokenNamePrefix, Qt::CaseInsensitive))
         return false;
 
+    // Only asked for when filtered on, the model looks the addresses of coinstakes up when they are first needed
+    if (watchOnlyFilter != WatchOnlyFilter_All) {
+        bool involvesWatchAddress = index.data(TransactionTableModel::WatchonlyRole).toBool();
+        if (involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_No)
+            return false;
+        if (!involvesWatchAddress && watchOnlyFilter == WatchOnlyFilter_Yes)
+            return false;
+    }
+    if (!addrPrefix.isEmpty()) {
+        QString address = index.data(TransactionTableModel::AddressRole).toString();
+        QString label = index.data(TransactionTableModel::LabelRole).toString();
+        if (!address.contains(addrPrefix, Qt::CaseInsensitive) && !label.contains(addrPrefix, Qt::CaseInsensitive))
+            return false;
+    }
+
     return true;
 }
 
@@ -25,6 +25,27 @@ bool TransactionRecord::showTransaction(const CWalletTx &wtx)
 }
 
 
+/*
+ * A coinstake with a positive net credit always decomposes into a single
+ * Generated record for that net credit. Staking wallets are mostly made of
+ * these, so their rows skip the address lookups until they are shown.
+ */
+bool TransactionRecord::decomposeLater(const CWalletTx &wtx, TransactionRecord &rec)
+{
+    if (!wtx.IsCoinStake())
+        return false;
+
+    isminefilter filter = wtx.tx->vout[1].scriptPubKey.IsOfflineStaking() ? ISMINE_SPENDABLE : ISMINE_ALL;
+    CAmount nNet = wtx.GetCredit(filter) - wtx.GetDebit(filter);
+    if (nNet <= 0)
+        return false;
+
+    rec = TransactionRecord(wtx.GetHash(), wtx.GetTxTime(), TransactionRecord::Generated, "", 0, nNet);
+    rec.involvesWatchAddress = false;
+    rec.fDecomposed = false;
+    return true;
+}
+
 /*
  * Decompose CWallet transaction to model transaction records.
  */
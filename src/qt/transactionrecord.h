@@ -86,13 +86,13 @@ public:
     static const int RecommendedNumConfirmations = 6;
 
     TransactionRecord():
-            hash(), time(0), type(Other), address(""), debit(0), credit(0), tokenName("PLB"), units(8), idx(0)
+            hash(), time(0), type(Other), address(""), debit(0), credit(0), tokenName("PLB"), units(8), idx(0), fDecomposed(true)
     {
     }
 
     TransactionRecord(uint256 _hash, qint64 _time):
             hash(_hash), time(_time), type(Other), address(""), debit(0),
-            credit(0), tokenName("PLB"), units(8), idx(0)
+            credit(0), tokenName("PLB"), units(8), idx(0), fDecomposed(true)
     {
     }
 
@@ -100,7 +100,7 @@ public:
                 Type _type, const std::string &_address,
                 const CAmount& _debit, const CAmount& _credit):
             hash(_hash), time(_time), type(_type), address(_address), debit(_debit), credit(_credit),
-            tokenName("PLB"), units(8), idx(0)
+            tokenName("PLB"), units(8), idx(0), fDecomposed(true)
     {
     }
 
@@ -109,6 +109,12 @@ public:
     static bool showTransaction(const CWalletTx &wtx);
     static QList<TransactionRecord> decomposeTransaction(const CWallet *wallet, const CWalletTx &wtx);
 
+    /** Fill rec with the time, type and amount of a coinstake that decomposes into a single
+        record, leaving its address for decomposeTransaction when the row is first shown.
+        Returns false if the transaction has to be decomposed right away.
+     */
+    static bool decomposeLater(const CWalletTx &wtx, TransactionRecord &rec);
+
     /** @name Immutable transaction attributes
       @{*/
     uint256 hash;
@@ -130,6 +136,9 @@ public:
     /** Whether the transaction was sent/received with a watch-only address */
     bool involvesWatchAddress;
 
+    /** False until the address, output index and watch-only flag of a decomposeLater record are filled in */
+    bool fDecomposed;
+
     /** Return the unique identifier for this transaction (part) */
     QString getTxID() const;
 
@@ -86,9 +86,16 @@ public:
         cachedWallet.clear();
         {
             LOCK2(cs_main, wallet->cs_wallet);
+            cachedWallet.reserve(wallet->mapWallet.size());
             for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
             {
-                if(TransactionRecord::showTransaction(it->second))
+                if(!TransactionRecord::showTransaction(it->second))
+                    continue;
+                // Coinstakes get their addresses when they are shown, see decompose()
+                TransactionRecord rec;
+                if(TransactionRecord::decomposeLater(it->second, rec))
+                    cachedWallet.append(rec);
+                else
                     cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
             }
         }
@@ -217,6 +224,35 @@ public:
         return 0;
     }
 
+    /* Fill in the address of a record from decomposeLater. The record
+       stays a single row, so this is safe to do while the view reads it.
+     */
+    void decompose(TransactionRecord *rec)
+    {
+        if(rec->fDecomposed)
+            return;
+
+        TRY_LOCK(cs_main, lockMain);
+        if(!lockMain)
+            return;
+        TRY_LOCK(wallet->cs_wallet, lockWallet);
+        if(!lockWallet)
+            return;
+
+        rec->fDecomposed = true;
+        std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
+        if(mi == wallet->mapWallet.end())
+            return;
+        QList<TransactionRecord> parts = TransactionRecord::decomposeTransaction(wallet, mi->second);
+        if(parts.size() != 1)
+            return;
+        TransactionStatus status = rec->status;
+        *rec = parts.first();
+        rec->status = status;
+        // The sort key includes the output index
+        rec->status.needsUpdate = true;
+    }
+
     QString describe(TransactionRecord *rec, int unit)
     {
         {
@@ -556,6 +592,9 @@ QVariant TransactionTableModel::data(const QModelIndex &index, int role) const
     TransactionRecord *rec = static_cast<TransactionRecord*>(index.internalPointer());
 
     const auto column = static_cast<ColumnIndex>(index.column());
+    if(!rec->fDecomposed && (column == ToAddress || column == Watchonly || role == Qt::ToolTipRole || role == WatchonlyRole ||
+        role == WatchonlyDecorationRole || role == AddressRole || role == LabelRole || role == TxPlainTextRole))
+        priv->decompose(rec);
     switch (role) {
     case RawDecorationRole:
         switch (column) {
@@ -4,6 +4,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "core_io.h"
@@ -15,6 +16,9 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "tokens/tokendb.h"
+#include "tokens/tokens.h"
+#include "tokentxindex.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
@@ -24,6 +28,7 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t REST_CHUNK_SIZE = 64 * 1024; //streamed replies are sent in chunks of about this size
 
 enum RetFormat {
     RF_UNDEF,
@@ -564,6 +569,328 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     }
 }
 
+static bool WriteRESTReply(HTTPRequest* req, RetFormat rf, const CDataStream& ss, const UniValue& json)
+{
+    switch (rf) {
+    case RF_BINARY: {
+        std::string binary = ss.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binary);
+        return true;
+    }
+
+    case RF_HEX: {
+        std::string strHex = HexStr(ss.begin(), ss.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        std::string strJSON = json.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+//! Units that amounts of the token are shown with, returns false if the token doesn't exist
+static bool GetRESTTokenUnits(const std::string& strName, int8_t& units)
+{
+    CNewToken token;
+    if (IsTokenNameAnOwner(strName)) {
+        units = OWNER_UNITS;
+        return GetConfirmedTokenMetaData(strName.substr(0, strName.size() - 1), token);
+    }
+
+    if (!GetConfirmedTokenMetaData(strName, token))
+        return false;
+    units = token.units;
+    return true;
+}
+
+/**
+ * Every <address, amount> holding the token. The directory is walked from a snapshot without holding cs_main and
+ * written out in chunks as it goes, so the size of the reply doesn't depend on the number of holders.
+ * Binary and hex output are the serialized (address, amount) records back to back, there is no count up front.
+ */
+static bool rest_token_holders(HTTPRequest* req, const std::string& strName, const RetFormat rf)
+{
+    if (rf != RF_BINARY && rf != RF_HEX && rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    int8_t units;
+    if (!GetRESTTokenUnits(strName, units))
+        return RESTERR(req, HTTP_NOT_FOUND, strName + " not found");
+
+    if (!ptokensdb)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Token database not available");
+
+    std::unique_ptr<CTokenAddressDirView> view = ptokensdb->SnapshotTokenAddressDir(strName);
+
+    switch (rf) {
+    case RF_BINARY: req->WriteHeader("Content-Type", "application/octet-stream"); break;
+    case RF_HEX: req->WriteHeader("Content-Type", "text/plain"); break;
+    default: req->WriteHeader("Content-Type", "application/json"); break;
+    }
+    req->WriteReplyStart(HTTP_OK);
+
+    CDataStream ssEntry(SER_NETWORK, PROTOCOL_VERSION);
+    std::string strChunk;
+    bool fFirst = true;
+    bool fOpen = true;
+    view->Walk([&](const std::string& address, const CAmount& amount) {
+        if (rf == RF_JSON) {
+            strChunk += fFirst ? "{" : ",";
+            strChunk += UniValue(address).write() + ":" + ValueFromAmountString(amount, units);
+        } else {
+            ssEntry << address << amount;
+            strChunk += rf == RF_BINARY ? ssEntry.str() : HexStr(ssEntry.begin(), ssEntry.end());
+            ssEntry.clear();
+        }
+        fFirst = false;
+
+        if (strChunk.size() >= REST_CHUNK_SIZE) {
+            fOpen = req->WriteReplyChunk(strChunk);
+            strChunk.clear();
+        }
+        return fOpen;
+    });
+
+    if (rf == RF_JSON)
+        strChunk += fFirst ? "{}\n" : "}\n";
+    else if (rf == RF_HEX)
+        strChunk += "\n";
+    req->WriteReplyChunk(strChunk);
+    req->WriteReplyEnd();
+    return true;
+}
+
+/**
+ * The token outputs the transactions created and spent of a token from nStartHeight on, in height order, from the
+ * token transaction index. Written out in chunks like the holders. Binary and hex output are the serialized
+ * (txid, height, spent, vout or vin, address, amount) records back to back.
+ */
+static bool rest_token_transactions(HTTPRequest* req, const std::string& strName, int nStartHeight, const RetFormat rf)
+{
+    if (rf != RF_BINARY && rf != RF_HEX && rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    if (!ptokentxindex)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Token transaction index not enabled (start with -tokentxindex)");
+
+    int8_t units;
+    if (!GetRESTTokenUnits(strName, units))
+        return RESTERR(req, HTTP_NOT_FOUND, strName + " not found");
+
+    switch (rf) {
+    case RF_BINARY: req->WriteHeader("Content-Type", "application/octet-stream"); break;
+    case RF_HEX: req->WriteHeader("Content-Type", "text/plain"); break;
+    default: req->WriteHeader("Content-Type", "application/json"); break;
+    }
+    req->WriteReplyStart(HTTP_OK);
+
+    CDataStream ssEntry(SER_NETWORK, PROTOCOL_VERSION);
+    std::string strChunk;
+    bool fFirst = true;
+    bool fOpen = true;
+    ptokentxindex->Walk(strName, nStartHeight, [&](const CTokenTxIndexKey& key, const CTokenTxIndexValue& value) {
+        if (rf == RF_JSON) {
+            strChunk += fFirst ? "[" : ",";
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("txid", key.txid.GetHex()));
+            entry.push_back(Pair("height", key.nHeight));
+            entry.push_back(Pair("direction", key.fSpend ? "sent" : "received"));
+            entry.push_back(Pair(key.fSpend ? "vin" : "vout", (int64_t)key.n));
+            entry.push_back(Pair("address", value.strAddress));
+            entry.push_back(Pair("amount", ValueFromAmount(value.nAmount, units)));
+            strChunk += entry.write();
+        } else {
+            ssEntry << key.txid << key.nHeight << key.fSpend << key.n << value.strAddress << value.nAmount;
+            strChunk += rf == RF_BINARY ? ssEntry.str() : HexStr(ssEntry.begin(), ssEntry.end());
+            ssEntry.clear();
+        }
+        fFirst = false;
+
+        if (strChunk.size() >= REST_CHUNK_SIZE) {
+            fOpen = req->WriteReplyChunk(strChunk);
+            strChunk.clear();
+        }
+        return fOpen;
+    });
+
+    if (rf == RF_JSON)
+        strChunk += fFirst ? "[]\n" : "]\n";
+    else if (rf == RF_HEX)
+        strChunk += "\n";
+    req->WriteReplyChunk(strChunk);
+    req->WriteReplyEnd();
+    return true;
+}
+
+static bool rest_token(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::string strName = urlDecode(param);
+
+    // Token names are upper case, so a lower case suffix can't be part of a sub token name
+    const std::string strHolders = "/holders";
+    if (strName.size() > strHolders.size() && strName.compare(strName.size() - strHolders.size(), strHolders.size(), strHolders) == 0)
+        return rest_token_holders(req, strName.substr(0, strName.size() - strHolders.size()), rf);
+
+    // <name>/transactions or <name>/transactions/<start height>
+    const std::string strTransactions = "/transactions";
+    size_t nTransactions = strName.rfind(strTransactions);
+    if (nTransactions != std::string::npos && nTransactions > 0) {
+        const std::string strHeight = strName.substr(nTransactions + strTransactions.size());
+        int nStartHeight = 0;
+        if (strHeight.empty() || (strHeight[0] == '/' && ParseInt32(strHeight.substr(1), &nStartHeight) && nStartHeight >= 0))
+            return rest_token_transactions(req, strName.substr(0, nTransactions), nStartHeight, rf);
+    }
+
+    CNewToken token;
+    int nHeight;
+    uint256 blockHash;
+    if (!GetConfirmedTokenMetaData(strName, token, nHeight, blockHash))
+        return RESTERR(req, HTTP_NOT_FOUND, strName + " not found");
+
+    std::string strVerifier;
+    if (IsTokenNameAnRestricted(token.strName)) {
+        LOCK(cs_main);
+        CNullTokenTxVerifierString verifier;
+        if (ptokens && ptokens->GetTokenVerifierStringIfExists(token.strName, verifier))
+            strVerifier = verifier.verifier_string;
+    }
+
+    CDataStream ssToken(SER_NETWORK, PROTOCOL_VERSION);
+    UniValue objToken(UniValue::VOBJ);
+    if (rf == RF_JSON) {
+        objToken.push_back(Pair("name", token.strName));
+        objToken.push_back(Pair("amount", ValueFromAmount(token.nAmount, token.units)));
+        objToken.push_back(Pair("units", token.units));
+        objToken.push_back(Pair("reissuable", token.nReissuable));
+        objToken.push_back(Pair("has_ipfs", token.nHasIPFS));
+        if (token.nHasIPFS) {
+            if (token.strIPFSHash.size() == 32) {
+                objToken.push_back(Pair("txid", EncodeTokenData(token.strIPFSHash)));
+            } else {
+                objToken.push_back(Pair("ipfs_hash", EncodeTokenData(token.strIPFSHash)));
+            }
+        }
+        objToken.push_back(Pair("height", nHeight));
+        objToken.push_back(Pair("blockhash", blockHash.GetHex()));
+        if (IsTokenNameAnRestricted(token.strName))
+            objToken.push_back(Pair("verifier_string", strVerifier));
+    } else {
+        ssToken << token << nHeight << blockHash << strVerifier;
+    }
+
+    return WriteRESTReply(req, rf, ssToken, objToken);
+}
+
+static bool rest_address(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 2 || path[1] != "tokens")
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/address/<address>/tokens.<ext>");
+
+    const std::string& address = path[0];
+    if (!IsValidDestination(DecodeDestination(address)))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + address);
+
+    if (!ptokensdb)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Token database not available");
+
+    std::vector<std::pair<std::string, CAmount> > vecTokenAmounts;
+    int nTotalEntries = 0;
+    if (!ptokensdb->AddressDir(vecTokenAmounts, nTotalEntries, false, address, INT_MAX, 0))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Couldn't retrieve address token directory");
+
+    CDataStream ssTokens(SER_NETWORK, PROTOCOL_VERSION);
+    UniValue objTokens(UniValue::VOBJ);
+    if (rf == RF_JSON) {
+        for (const auto& pair : vecTokenAmounts) {
+            int8_t units;
+            if (!GetRESTTokenUnits(pair.first, units))
+                units = MAX_UNIT;
+            objTokens.push_back(Pair(pair.first, ValueFromAmount(pair.second, units)));
+        }
+    } else {
+        ssTokens << vecTokenAmounts;
+    }
+
+    return WriteRESTReply(req, rf, ssTokens, objTokens);
+}
+
+/**
+ * /rest/restricted/<restricted> returns the verifier string and global freeze of a restricted token,
+ * /rest/restricted/<restricted>/<address> whether the address is frozen and
+ * /rest/restricted/<qualifier>/<address> whether the address has been tagged with the qualifier.
+ */
+static bool rest_restricted(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::string strName = urlDecode(param);
+
+    // Qualifier names contain '/' themselves, the address is only split off when it is one
+    std::string address;
+    const std::string::size_type pos = strName.rfind('/');
+    if (pos != std::string::npos && IsValidDestination(DecodeDestination(strName.substr(pos + 1)))) {
+        address = strName.substr(pos + 1);
+        strName = strName.substr(0, pos);
+    }
+
+    const bool fQualifier = IsTokenNameAQualifier(strName);
+    if (!fQualifier && !IsTokenNameAnRestricted(strName))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Not a restricted or qualifier token: " + strName);
+    if (fQualifier && address.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/restricted/<qualifier>/<address>.<ext>");
+
+    CNewToken token;
+    if (!GetConfirmedTokenMetaData(strName, token))
+        return RESTERR(req, HTTP_NOT_FOUND, strName + " not found");
+
+    if (!prestricteddb || !ptokens || !ptokensQualifierCache || !ptokensRestrictionCache || !ptokensGlobalRestrictionCache)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Restricted token database not available");
+
+    CDataStream ssRestricted(SER_NETWORK, PROTOCOL_VERSION);
+    UniValue objRestricted(UniValue::VOBJ);
+    objRestricted.push_back(Pair("name", strName));
+
+    LOCK(cs_main);
+    if (!address.empty()) {
+        const bool fResult = fQualifier ? ptokens->CheckForAddressQualifier(strName, address) : ptokens->CheckForAddressRestriction(strName, address);
+        objRestricted.push_back(Pair("address", address));
+        objRestricted.push_back(Pair(fQualifier ? "tagged" : "frozen", fResult));
+        ssRestricted << fResult;
+    } else {
+        CNullTokenTxVerifierString verifier;
+        ptokens->GetTokenVerifierStringIfExists(strName, verifier);
+        const bool fFrozen = ptokens->CheckForGlobalRestriction(strName, true);
+        objRestricted.push_back(Pair("verifier_string", verifier.verifier_string));
+        objRestricted.push_back(Pair("globally_frozen", fFrozen));
+        ssRestricted << verifier.verifier_string << fFrozen;
+    }
+
+    return WriteRESTReply(req, rf, ssRestricted, objRestricted);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -576,6 +903,9 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/token/", rest_token},
+      {"/rest/address/", rest_address},
+      {"/rest/restricted/", rest_restricted},
 };
 
 bool StartREST()
@@ -8,8 +8,10 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "blockfilterindex.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "chainstatesnapshot.h"
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
@@ -21,14 +23,17 @@
 #include "rpc/server.h"
 #include "script/script.h"
 #include "script/script_error.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "script/standard.h"
 #include "streams.h"
 #include "sync.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "undo.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utxostats.h"
 #include "hash.h"
 #include "warnings.h"
 #include <pos.h>
@@ -149,115 +154,151 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
+/**
+ * The address a delta of script is reported under, with the token name and amount of a token script. Spent outputs
+ * are classified the way the spent index records them, created ones as the plain and token script types only.
+ */
+static bool GetDeltaAddress(const CScript& script, bool fSpent, std::string& strAddress, std::string& strTokenName, CAmount& nTokenAmount)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", block.GetIndexHash().GetHex()));
-    int confirmations = -1;
-    // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex)) {
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    strTokenName.clear();
+    if (script.IsPayToScriptHash()) {
+        strAddress = CPaladeumAddress(CScriptID(uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22)))).ToString();
+    } else if (script.IsPayToPublicKeyHash()) {
+        strAddress = CPaladeumAddress(CKeyID(uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23)))).ToString();
+    } else if (fSpent && script.IsPayToPublicKeyHashLocked()) {
+        const int offset = script.size() - 25;
+        strAddress = CPaladeumAddress(CKeyID(uint160(std::vector<unsigned char>(script.begin() + (3 + offset), script.begin() + (23 + offset))))).ToString();
+    } else if (fSpent && script.IsPayToPublicKey()) {
+        strAddress = CPaladeumAddress(CKeyID(Hash160(script.begin() + 1, script.end() - 1))).ToString();
     } else {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block is an orphan");
-    }
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    result.pushKV("flags", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work");
-
-    if (block.IsProofOfStake()) {
-        result.pushKV("flags", HexStr(block.vchBlockSig.begin(), block.vchBlockSig.end()));
+        uint160 hashBytes;
+        int nScriptType;
+        uint32_t nTimeLock;
+        if (!AreTokensDeployed() || !ParseTokenScript(script, hashBytes, nScriptType, strTokenName, nTokenAmount, nTimeLock))
+            return false;
+        if (nScriptType == TX_PUBKEYHASH)
+            strAddress = CPaladeumAddress(CKeyID(hashBytes)).ToString();
+        else if (nScriptType == TX_SCRIPTHASH)
+            strAddress = CPaladeumAddress(CScriptID(hashBytes)).ToString();
+        else
+            return false;
     }
+    return true;
+}
 
-    UniValue deltas(UniValue::VARR);
-
-    for (unsigned int i = 0; i < block.vtx.size(); i++) {
-        const CTransaction &tx = *(block.vtx[i]);
-        const uint256 txhash = tx.GetHash();
-
-        UniValue entry(UniValue::VOBJ);
-        entry.push_back(Pair("txid", txhash.GetHex()));
-        entry.push_back(Pair("index", (int)i));
-
-        UniValue inputs(UniValue::VARR);
-
-        if (!tx.IsCoinBase()) {
-
-            for (size_t j = 0; j < tx.vin.size(); j++) {
-                const CTxIn input = tx.vin[j];
-
-                UniValue delta(UniValue::VOBJ);
-
-                CSpentIndexValue spentInfo;
-                CSpentIndexKey spentKey(input.prevout.hash, input.prevout.n);
-
-                if (GetSpentIndex(spentKey, spentInfo)) {
-                    if (spentInfo.addressType == 1) {
-                        delta.push_back(Pair("address", CPaladeumAddress(CKeyID(spentInfo.addressHash)).ToString()));
-                    } else if (spentInfo.addressType == 2)  {
-                        delta.push_back(Pair("address", CPaladeumAddress(CScriptID(spentInfo.addressHash)).ToString()));
-                    } else {
-                        continue;
-                    }
-                    delta.push_back(Pair("satoshis", -1 * spentInfo.satoshis));
-                    delta.push_back(Pair("index", (int)j));
-                    delta.push_back(Pair("prevtxid", input.prevout.hash.GetHex()));
-                    delta.push_back(Pair("prevout", (int)input.prevout.n));
-
-                    inputs.push_back(delta);
-                } else {
-                    throw JSONRPCError(RPC_INTERNAL_ERROR, "Spent information not available");
-                }
-
-            }
-        }
-
-        entry.push_back(Pair("inputs", inputs));
-
-        UniValue outputs(UniValue::VARR);
-
-        for (unsigned int k = 0; k < tx.vout.size(); k++) {
-            const CTxOut &out = tx.vout[k];
+/** The deltas of transaction nIndex of a block, with the outputs it spends from txundo */
+static UniValue txToDeltasJSON(const CTransaction& tx, int nIndex, const CTxUndo* txundo)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.push_back(Pair("txid", tx.GetHash().GetHex()));
+    entry.push_back(Pair("index", nIndex));
+
+    std::string strAddress, strTokenName;
+    CAmount nTokenAmount;
+    UniValue inputs(UniValue::VARR);
+    if (!tx.IsCoinBase()) {
+        if (!txundo || txundo->vprevout.size() != tx.vin.size())
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block undo data inconsistent");
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txundo->vprevout[j];
+            if (!GetDeltaAddress(coin.out.scriptPubKey, true, strAddress, strTokenName, nTokenAmount))
+                continue;
 
             UniValue delta(UniValue::VOBJ);
-
-            if (out.scriptPubKey.IsPayToScriptHash()) {
-                std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-                delta.push_back(Pair("address", CPaladeumAddress(CScriptID(uint160(hashBytes))).ToString()));
-
-            } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-                delta.push_back(Pair("address", CPaladeumAddress(CKeyID(uint160(hashBytes))).ToString()));
+            delta.push_back(Pair("address", strAddress));
+            if (!strTokenName.empty()) {
+                delta.push_back(Pair("tokenName", strTokenName));
+                delta.push_back(Pair("satoshis", -1 * nTokenAmount));
             } else {
-                continue;
+                delta.push_back(Pair("satoshis", -1 * coin.out.nValue));
             }
+            delta.push_back(Pair("index", (int)j));
+            delta.push_back(Pair("prevtxid", tx.vin[j].prevout.hash.GetHex()));
+            delta.push_back(Pair("prevout", (int)tx.vin[j].prevout.n));
+            inputs.push_back(delta);
+        }
+    }
+    entry.push_back(Pair("inputs", inputs));
 
-            delta.push_back(Pair("satoshis", out.nValue));
-            delta.push_back(Pair("index", (int)k));
+    UniValue outputs(UniValue::VARR);
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut& out = tx.vout[k];
+        if (!GetDeltaAddress(out.scriptPubKey, false, strAddress, strTokenName, nTokenAmount))
+            continue;
 
-            outputs.push_back(delta);
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("address", strAddress));
+        if (!strTokenName.empty()) {
+            delta.push_back(Pair("tokenName", strTokenName));
+            delta.push_back(Pair("satoshis", nTokenAmount));
+        } else {
+            delta.push_back(Pair("satoshis", out.nValue));
         }
+        delta.push_back(Pair("index", (int)k));
+        outputs.push_back(delta);
+    }
+    entry.push_back(Pair("outputs", outputs));
+    return entry;
+}
+
+/**
+ * The deltas of a block on the active chain, with the spent outputs taken from its undo data. With a stream the
+ * transactions are written one at a time and NullUniValue is returned.
+ */
+UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex, const CBlockUndo& blockUndo, JSONStreamWriter* stream)
+{
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block undo data inconsistent");
 
-        entry.push_back(Pair("outputs", outputs));
-        deltas.push_back(entry);
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("hash", block.GetIndexHash().GetHex()));
+    result.push_back(Pair("confirmations", chainActive.Height() - blockindex->nHeight + 1));
+    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+    result.push_back(Pair("height", blockindex->nHeight));
+    result.push_back(Pair("version", block.nVersion));
+    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+    result.pushKV("flags", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work");
 
+    if (block.IsProofOfStake()) {
+        result.pushKV("flags", HexStr(block.vchBlockSig.begin(), block.vchBlockSig.end()));
     }
-    result.push_back(Pair("deltas", deltas));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetPastTimeLimit()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
-    result.pushKV("modifier", blockindex->nStakeModifier.GetHex());
+
+    UniValue trailer(UniValue::VOBJ);
+    trailer.push_back(Pair("time", block.GetBlockTime()));
+    trailer.push_back(Pair("mediantime", (int64_t)blockindex->GetPastTimeLimit()));
+    trailer.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    trailer.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    trailer.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    trailer.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    trailer.pushKV("modifier", blockindex->nStakeModifier.GetHex());
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetIndexHash().GetHex()));
+        trailer.push_back(Pair("previousblockhash", blockindex->pprev->GetIndexHash().GetHex()));
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetIndexHash().GetHex()));
+        trailer.push_back(Pair("nextblockhash", pnext->GetIndexHash().GetHex()));
+
+    if (stream) {
+        stream->BeginObject();
+        for (size_t i = 0; i < result.size(); i++)
+            stream->KeyValue(result.getKeys()[i], result.getValues()[i]);
+        stream->Key("deltas");
+        stream->BeginArray();
+        for (unsigned int i = 0; i < block.vtx.size() && stream->IsOpen(); i++)
+            stream->Value(txToDeltasJSON(*block.vtx[i], i, i > 0 ? &blockUndo.vtxundo[i - 1] : nullptr));
+        stream->EndArray();
+        for (size_t i = 0; i < trailer.size(); i++)
+            stream->KeyValue(trailer.getKeys()[i], trailer.getValues()[i]);
+        stream->EndObject();
+        return NullUniValue;
+    }
+
+    UniValue deltas(UniValue::VARR);
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        deltas.push_back(txToDeltasJSON(*block.vtx[i], i, i > 0 ? &blockUndo.vtxundo[i - 1] : nullptr));
+    result.push_back(Pair("deltas", deltas));
+    for (size_t i = 0; i < trailer.size(); i++)
+        result.push_back(Pair(trailer.getKeys()[i], trailer.getValues()[i]));
     return result;
 }
 
@@ -320,8 +361,8 @@ UniValue getblockcount(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    return tip ? tip->nHeight : -1;
 }
 
 UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -337,8 +378,10 @@ UniValue getbestblockhash(const JSONRPCRequest& request)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetIndexHash().GetHex();
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    if (!tip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No active chain");
+    return tip->hashBlock.GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
@@ -486,8 +529,8 @@ UniValue getdifficulty(const JSONRPCRequest& request)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    LOCK(cs_main);
-    return GetDifficulty();
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    return tip ? GetDifficulty(tip->pindex) : 1.0;
 }
 
 std::string EntryDescriptionString()
@@ -542,7 +585,7 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("depends", depends));
 }
 
-UniValue mempoolToJSON(bool fVerbose)
+UniValue mempoolToJSON(bool fVerbose, bool fIncludeMempoolSequence)
 {
     if (fVerbose)
     {
@@ -560,25 +603,38 @@ UniValue mempoolToJSON(bool fVerbose)
     else
     {
         std::vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
+        uint64_t nMempoolSequence;
+        {
+            // The sequence of the txids they are, for a zmq sequence subscriber to pick up from
+            LOCK(mempool.cs);
+            mempool.queryHashes(vtxid);
+            nMempoolSequence = mempool.GetSequence();
+        }
 
         UniValue a(UniValue::VARR);
         for (const uint256& hash : vtxid)
             a.push_back(hash.ToString());
 
-        return a;
+        if (!fIncludeMempoolSequence)
+            return a;
+
+        UniValue o(UniValue::VOBJ);
+        o.push_back(Pair("txids", a));
+        o.push_back(Pair("mempool_sequence", nMempoolSequence));
+        return o;
     }
 }
 
 UniValue getrawmempool(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() > 1)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "getrawmempool ( verbose )\n"
+            "getrawmempool ( verbose mempool_sequence )\n"
             "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
             "\nHint: use getmempoolentry to fetch a specific transaction from the mempool.\n"
             "\nArguments:\n"
             "1. verbose (boolean, optional, default=false) True for a json object, false for array of transaction ids\n"
+            "2. mempool_sequence (boolean, optional, default=false) If verbose=false, returns a json object with transaction list and mempool sequence number attached.\n"
             "\nResult: (for verbose = false):\n"
             "[                     (json array of string)\n"
             "  \"transactionid\"     (string) The transaction id\n"
@@ -599,7 +655,26 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    bool fIncludeMempoolSequence = false;
+    if (!request.params[1].isNull())
+        fIncludeMempoolSequence = request.params[1].get_bool();
+    if (fVerbose && fIncludeMempoolSequence)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+
+    if (fVerbose && request.stream) {
+        LOCK(mempool.cs);
+        request.stream->BeginObject();
+        for (const CTxMemPoolEntry& e : mempool.mapTx)
+        {
+            UniValue info(UniValue::VOBJ);
+            entryToJSON(info, e);
+            request.stream->KeyValue(e.GetTx().GetHash().ToString(), info);
+        }
+        request.stream->EndObject();
+        return NullUniValue;
+    }
+
+    return mempoolToJSON(fVerbose, fIncludeMempoolSequence);
 }
 
 UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -768,6 +843,8 @@ UniValue getblockdeltas(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size() != 1)
         throw std::runtime_error("");
 
+    LOCK(cs_main);
+
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -777,13 +854,22 @@ UniValue getblockdeltas(const JSONRPCRequest& request)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+    // Only blocks on the main chain have deltas
+    if (!chainActive.Contains(pblockindex))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block is an orphan");
+
+    if (fHavePruned && (pblockindex->nStatus & BLOCK_HAVE_MASK) != BLOCK_HAVE_MASK && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
     if(!ReadBlockFromDisk(block, pblockindex, GetParams().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    return blockToDeltasJSON(block, pblockindex);
+    // The outputs the block spends, in one read rather than a spent index lookup per input
+    CBlockUndo blockUndo;
+    if (pblockindex->pprev && !UndoReadFromDisk(blockUndo, pblockindex->GetUndoPos(), pblockindex->pprev->GetIndexHash()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block undo data from disk");
+
+    return blockToDeltasJSON(block, pblockindex, blockUndo, request.stream);
 }
 
 UniValue GetIndexHashes(const JSONRPCRequest& request)
@@ -834,28 +920,37 @@ UniValue GetIndexHashes(const JSONRPCRequest& request)
         }
     }
 
-    std::vector<std::pair<uint256, unsigned int> > blockHashes;
-
-    if (fActiveOnly)
-        LOCK(cs_main);
-
-    if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
+    if (!fTimestampIndex) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
 
+    // Written as the index is walked, a wide range doesn't have to be held in memory
     UniValue result(UniValue::VARR);
-
-    for (std::vector<std::pair<uint256, unsigned int> >::const_iterator it=blockHashes.begin(); it!=blockHashes.end(); it++) {
+    if (request.stream)
+        request.stream->BeginArray();
+    bool fWalked = WalkTimestampIndex(high, low, fActiveOnly, [&](const uint256& hash, unsigned int timestamp) {
+        UniValue item(UniValue::VSTR, hash.GetHex());
         if (fLogicalTS) {
-            UniValue item(UniValue::VOBJ);
-            item.push_back(Pair("blockhash", it->first.GetHex()));
-            item.push_back(Pair("logicalts", (int)it->second));
-            result.push_back(item);
-        } else {
-            result.push_back(it->first.GetHex());
+            item = UniValue(UniValue::VOBJ);
+            item.push_back(Pair("blockhash", hash.GetHex()));
+            item.push_back(Pair("logicalts", (int)timestamp));
         }
+        if (request.stream) {
+            request.stream->Value(item);
+            return request.stream->IsOpen();
+        }
+        result.push_back(item);
+        return true;
+    });
+
+    if (!fWalked) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
 
+    if (request.stream) {
+        request.stream->EndArray();
+        return NullUniValue;
+    }
     return result;
 }
 
@@ -874,13 +969,14 @@ UniValue getblockhash(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockhash", "1000")
         );
 
-    LOCK(cs_main);
+    // Walks back from the published tip, ancestors of a block index entry never change
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
 
     int nHeight = request.params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (!tip || nHeight < 0 || nHeight > tip->nHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    const CBlockIndex* pblockindex = tip->pindex->GetAncestor(nHeight);
     return pblockindex->GetIndexHash().GetHex();
 }
 
@@ -942,6 +1038,58 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block. Needs -blockfilterindex.\n"
+            "The basic filter holds the output scripts the block creates and spends, and the token names of its token outputs.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=\"basic\") The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"    (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hash = ParseHashV(request.params[0], "blockhash");
+    std::string strFilterType = BlockFilterTypeName(BlockFilterType::BASIC);
+    if (!request.params[1].isNull())
+        strFilterType = request.params[1].get_str();
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(strFilterType, filterType))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+
+    if (!pblockfilterindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + strFilterType);
+
+    const CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = it->second;
+    }
+
+    BlockFilter filter;
+    uint256 header;
+    if (!pblockfilterindex->LookupFilter(pblockindex, filter) || !pblockfilterindex->LookupFilterHeader(pblockindex, header))
+        throw JSONRPCError(RPC_MISC_ERROR, "Filter not found. The block filter index is still being built, or the block is not on a chain it has followed");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", header.GetHex()));
+    return ret;
+}
+
 UniValue getblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -1029,6 +1177,28 @@ UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
+    if (verbosity >= 2 && request.stream) {
+        // Same fields as blockToJSON, with the decoded transactions written one at a time
+        UniValue header = blockToJSON(block, pblockindex, false);
+        request.stream->BeginObject();
+        for (size_t i = 0; i < header.size(); i++) {
+            if (header.getKeys()[i] != "tx") {
+                request.stream->KeyValue(header.getKeys()[i], header.getValues()[i]);
+                continue;
+            }
+            request.stream->Key("tx");
+            request.stream->BeginArray();
+            for (const auto& tx : block.vtx) {
+                UniValue objTx(UniValue::VOBJ);
+                TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
+                request.stream->Value(objTx);
+            }
+            request.stream->EndArray();
+        }
+        request.stream->EndObject();
+        return NullUniValue;
+    }
+
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
@@ -1155,29 +1325,54 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time with the default hash_type, the others are answered from the statistics\n"
+            "followed as blocks connect (-utxostats).\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"          (string, optional, default=\"hash_serialized_2\") Which UTXO set hash to return: \"hash_serialized_2\",\n"
+            "                       computed by reading the whole chainstate, \"muhash\" or \"none\"\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions (only with hash_serialized_2)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only with hash_serialized_2)\n"
+            "  \"muhash\": \"hash\",       (string) The MuHash3072 of the unspent outputs (only with muhash)\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "muhash")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    const std::string strHashType = request.params.size() > 0 && !request.params[0].isNull() ? request.params[0].get_str() : "hash_serialized_2";
+    if (strHashType != "hash_serialized_2" && strHashType != "muhash" && strHashType != "none")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", strHashType));
+
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType != "hash_serialized_2") {
+        CUTXOSetStats stats;
+        if (!GetTipUTXOSetStats(stats))
+            throw JSONRPCError(RPC_MISC_ERROR, "The UTXO set statistics are not followed, restart with -utxostats");
+        ret.push_back(Pair("height", (int64_t)stats.nHeight));
+        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+        ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
+        if (strHashType == "muhash")
+            ret.push_back(Pair("muhash", stats.GetMuHash().GetHex()));
+        ret.push_back(Pair("disk_size", (uint64_t)pcoinsdbview->EstimateSize()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview, stats)) {
@@ -1390,6 +1585,18 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"size_on_disk\": xxxxxx,   (numeric) the estimated size of the block and undo files on disk\n"
+            "  \"disk_usage\": {          (object) bytes on disk by what they hold\n"
+            "     \"blocks\": xxxxxx,      (numeric) the block files\n"
+            "     \"undo\": xxxxxx,        (numeric) the undo files\n"
+            "     \"block_index\": xxxxxx, (numeric) the block index database\n"
+            "     \"chainstate\": xxxxxx,  (numeric) the UTXO database\n"
+            "     \"tokens\": xxxxxx,      (numeric) the token database\n"
+            "     \"token_undo\": xxxxxx,  (numeric) the estimated share of the token database that is token undo data of blocks connected before it moved to the undo files\n"
+            "     \"restricted\": xxxxxx,  (numeric) the restricted token databases\n"
+            "     \"messages\": xxxxxx,    (numeric) the message databases\n"
+            "     \"rewards\": xxxxxx,     (numeric) the snapshot request, token snapshot and distribution databases\n"
+            "     \"governance\": xxxxxx,  (numeric) the governance database\n"
+            "  },\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
             "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,  (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
@@ -1426,27 +1633,39 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockchaininfo", "")
         );
 
-    LOCK(cs_main);
+    // Everything but the prune height comes from the published tip, so monitoring doesn't wait on validation
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    if (!tip)
+        throw JSONRPCError(RPC_IN_WARMUP, "No chain loaded");
 
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain", GetParams().NetworkIDString()));
-    obj.push_back(Pair("blocks",                (int)chainActive.Height()));
-    obj.push_back(Pair("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash",         chainActive.Tip()->GetIndexHash().GetHex()));
-    obj.push_back(Pair("difficulty",            (double)GetDifficulty()));
-    obj.push_back(Pair("mediantime",            (int64_t)chainActive.Tip()->GetMedianTimePast()));
-    obj.push_back(Pair("verificationprogress",  GuessVerificationProgress(GetParams().TxData(), chainActive.Tip())));
-    obj.push_back(Pair("chainwork",             chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("blocks",                tip->nHeight));
+    obj.push_back(Pair("headers",               nBestHeaderHeight.load()));
+    obj.push_back(Pair("bestblockhash",         tip->hashBlock.GetHex()));
+    obj.push_back(Pair("difficulty",            (double)GetDifficulty(tip->pindex)));
+    obj.push_back(Pair("mediantime",            tip->nMedianTimePast));
+    obj.push_back(Pair("verificationprogress",  GuessVerificationProgress(GetParams().TxData(), tip->pindex)));
+    obj.push_back(Pair("chainwork",             tip->nChainWork.GetHex()));
     obj.push_back(Pair("size_on_disk",          CalculateCurrentUsage()));
+    UniValue usage(UniValue::VOBJ);
+    for (const auto& subsystem : CalculateDiskUsageBySubsystem())
+        usage.push_back(Pair(subsystem.first, subsystem.second));
+    obj.push_back(Pair("disk_usage",            usage));
     obj.push_back(Pair("pruned",                fPruneMode));
     if (fPruneMode) {
-        CBlockIndex* block = chainActive.Tip();
-        assert(block);
-        while (block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA)) {
-            block = block->pprev;
+        int nPruneHeight;
+        {
+            // Pruning clears the block status flags under cs_main
+            LOCK(cs_main);
+            const CBlockIndex* block = tip->pindex;
+            while (block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA)) {
+                block = block->pprev;
+            }
+            nPruneHeight = block->nHeight;
         }
 
-        obj.push_back(Pair("pruneheight",        block->nHeight));
+        obj.push_back(Pair("pruneheight",        nPruneHeight));
 
         // if 0, execution bypasses the whole if block.
         bool automatic_pruning = (gArgs.GetArg("-prune", 0) != 1);
@@ -1596,7 +1815,23 @@ UniValue mempoolInfoToJSON()
     UniValue ret(UniValue::VOBJ);
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
-    ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    const MemPoolUsage usage = mempool.GetUsageBreakdown();
+    ret.push_back(Pair("usage", (int64_t) usage.Total()));
+    {
+        LOCK(mempool.cs);
+        ret.push_back(Pair("restricted_entries", (int64_t) mempool.restrictedStateIndex.Size()));
+    }
+    ret.push_back(Pair("restricted_usage", (int64_t) usage.nRestrictedState));
+    UniValue breakdown(UniValue::VOBJ);
+    breakdown.push_back(Pair("transactions", (int64_t) usage.nTransactions));
+    breakdown.push_back(Pair("links", (int64_t) usage.nLinks));
+    breakdown.push_back(Pair("spends", (int64_t) usage.nSpends));
+    breakdown.push_back(Pair("deltas", (int64_t) usage.nDeltas));
+    breakdown.push_back(Pair("tx_hashes", (int64_t) usage.nTxHashes));
+    breakdown.push_back(Pair("token_issues", (int64_t) usage.nTokenIssues));
+    breakdown.push_back(Pair("restricted_state", (int64_t) usage.nRestrictedState));
+    breakdown.push_back(Pair("token_outputs", (int64_t) usage.nTokenOutputs));
+    ret.push_back(Pair("usage_breakdown", breakdown));
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
@@ -1615,6 +1850,18 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"size\": xxxxx,               (numeric) Current tx count\n"
             "  \"bytes\": xxxxx,              (numeric) Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
+            "  \"restricted_entries\": xxxxx, (numeric) Restricted token states touched by mempool transactions\n"
+            "  \"restricted_usage\": xxxxx,   (numeric) Memory usage of the restricted token state index\n"
+            "  \"usage_breakdown\": {         (json object) Memory usage by structure, adding up to usage\n"
+            "    \"transactions\": xxxxx,     (numeric) The transactions with their entries\n"
+            "    \"links\": xxxxx,            (numeric) The parent and child links between them\n"
+            "    \"spends\": xxxxx,           (numeric) The outpoints they spend\n"
+            "    \"deltas\": xxxxx,           (numeric) The prioritised fee deltas\n"
+            "    \"tx_hashes\": xxxxx,        (numeric) The witness hashes for compact blocks\n"
+            "    \"token_issues\": xxxxx,     (numeric) The tokens issued by the transactions\n"
+            "    \"restricted_state\": xxxxx, (numeric) The restricted token state index\n"
+            "    \"token_outputs\": xxxxx     (numeric) The token output index\n"
+            "  },\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted\n"
             "}\n"
@@ -1739,6 +1986,55 @@ UniValue reconsiderblock(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue SignatureCacheStatsToJSON(const CSignatureCacheStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("inserts", stats.nInserts));
+    obj.push_back(Pair("evictions", stats.nEvictions));
+    obj.push_back(Pair("entries", (uint64_t)stats.nMaxEntries));
+    obj.push_back(Pair("entries_at_startup", (uint64_t)stats.nBaseEntries));
+    obj.push_back(Pair("bytes", (uint64_t)stats.nMaxEntries * sizeof(uint256)));
+    return obj;
+}
+
+UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns the lookups and sizes of the signature cache and the script execution cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"autosize\": xx,                  (boolean) whether the caches grow when they miss while connecting blocks (-sigcacheautosize)\n"
+            "  \"signature_cache\": {            (object) the cache of valid signatures\n"
+            "    \"hits\": xxxxx,                 (numeric) lookups that found the signature\n"
+            "    \"misses\": xxxxx,               (numeric) lookups that did not\n"
+            "    \"inserts\": xxxxx,              (numeric) signatures added\n"
+            "    \"evictions\": xxxxx,            (numeric) signatures dropped to make room for others\n"
+            "    \"entries\": xxxxx,              (numeric) signatures the cache can hold\n"
+            "    \"entries_at_startup\": xxxxx,   (numeric) signatures the cache could hold at startup\n"
+            "    \"bytes\": xxxxx                 (numeric) memory the entries take\n"
+            "  },\n"
+            "  \"script_execution_cache\": {...} (object) the cache of transactions whose scripts passed, same fields\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+        );
+
+    CSignatureCacheStats sigCacheStats, scriptExecutionCacheStats;
+    GetSignatureCacheStats(sigCacheStats);
+    GetScriptExecutionCacheStats(scriptExecutionCacheStats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("autosize", fSigCacheAutoSize));
+    ret.push_back(Pair("signature_cache", SignatureCacheStatsToJSON(sigCacheStats)));
+    ret.push_back(Pair("script_execution_cache", SignatureCacheStatsToJSON(scriptExecutionCacheStats)));
+    return ret;
+}
+
 UniValue getchaintxstats(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2)
@@ -1837,6 +2133,86 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue ChainStateSnapshotToJSON(const CChainStateSnapshotInfo& info)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("bestblock", info.hashBlock.GetHex()));
+    ret.push_back(Pair("height", info.nHeight));
+    ret.push_back(Pair("coins", (int64_t)info.nCoins));
+    ret.push_back(Pair("token_records", (int64_t)info.nTokenRecords));
+    ret.push_back(Pair("restricted_records", (int64_t)info.nRestrictedRecords));
+    ret.push_back(Pair("governance_records", (int64_t)info.nGovernanceRecords));
+    ret.push_back(Pair("hash_contents", info.hashContents.GetHex()));
+    ret.push_back(Pair("assumevalid", IsAssumeValidSnapshot(GetParams(), info)));
+    return ret;
+}
+
+static const std::string CHAINSTATE_SNAPSHOT_RESULT_HELP =
+    "{\n"
+    "  \"bestblock\": \"hex\",        (string) the block the snapshot was taken at\n"
+    "  \"height\": n,                (numeric) the height of that block\n"
+    "  \"coins\": n,                 (numeric) the number of unspent outputs\n"
+    "  \"token_records\": n,         (numeric) the number of token definitions\n"
+    "  \"restricted_records\": n,    (numeric) the number of verifier, qualifier and restriction records\n"
+    "  \"governance_records\": n,    (numeric) the number of governance records\n"
+    "  \"hash_contents\": \"hex\",    (string) the hash of the snapshot contents\n"
+    "  \"assumevalid\": true|false   (boolean) whether the chain parameters commit to this snapshot\n"
+    "}\n";
+
+UniValue dumpchainstatesnapshot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumpchainstatesnapshot \"path\"\n"
+            "\nWrites the coins, token, restricted token and governance state at the tip to a file.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) the file to write, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            + CHAINSTATE_SNAPSHOT_RESULT_HELP +
+            "\nExamples:\n"
+            + HelpExampleCli("dumpchainstatesnapshot", "\"chainstate.snapshot\"")
+            + HelpExampleRpc("dumpchainstatesnapshot", "\"chainstate.snapshot\"")
+        );
+    }
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CChainStateSnapshotInfo info;
+    std::string strError;
+    if (!WriteChainStateSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write the snapshot: " + strError);
+
+    return ChainStateSnapshotToJSON(info);
+}
+
+UniValue checkchainstatesnapshot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "checkchainstatesnapshot \"path\"\n"
+            "\nReads a snapshot written by dumpchainstatesnapshot and checks its contents against its hash.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) the file to read, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            + CHAINSTATE_SNAPSHOT_RESULT_HELP +
+            "\nExamples:\n"
+            + HelpExampleCli("checkchainstatesnapshot", "\"chainstate.snapshot\"")
+            + HelpExampleRpc("checkchainstatesnapshot", "\"chainstate.snapshot\"")
+        );
+    }
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+
+    CChainStateSnapshotInfo info;
+    std::string strError;
+    if (!ReadChainStateSnapshotInfo(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, "Invalid snapshot: " + strError);
+
+    return ChainStateSnapshotToJSON(info);
+}
+
 UniValue clearmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0) {
@@ -1911,30 +2287,318 @@ UniValue issuanceinfo(const JSONRPCRequest& request) {
         );
     }
 
+    // The costs in force at the published tip, which don't need the governance mirror lock
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    CCostTableRef table = tip && tip->costTable ? tip->costTable : governance->GetCostTable();
+
     UniValue result(UniValue::VOBJ);
     UniValue cost(UniValue::VOBJ);
 
-    cost.push_back(Pair("root", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_ROOT))));
-    cost.push_back(Pair("reissue", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_REISSUE))));
-    cost.push_back(Pair("unique", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_UNIQUE))));
-    cost.push_back(Pair("sub", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_SUB))));
-    cost.push_back(Pair("username", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_USERNAME))));
-    cost.push_back(Pair("msg_channel", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_MSG_CHANNEL))));
-    cost.push_back(Pair("qualifier", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_QUALIFIER))));
-    cost.push_back(Pair("sub_qualifier", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_SUB_QUALIFIER))));
-    cost.push_back(Pair("null_qualifier", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_NULL_QUALIFIER))));
-    cost.push_back(Pair("restricted", ValueFromAmount(governance->GetCost(GOVERNANCE_COST_RESTRICTED))));
+    cost.push_back(Pair("root", ValueFromAmount(table->GetCost(GOVERNANCE_COST_ROOT))));
+    cost.push_back(Pair("reissue", ValueFromAmount(table->GetCost(GOVERNANCE_COST_REISSUE))));
+    cost.push_back(Pair("unique", ValueFromAmount(table->GetCost(GOVERNANCE_COST_UNIQUE))));
+    cost.push_back(Pair("sub", ValueFromAmount(table->GetCost(GOVERNANCE_COST_SUB))));
+    cost.push_back(Pair("username", ValueFromAmount(table->GetCost(GOVERNANCE_COST_USERNAME))));
+    cost.push_back(Pair("msg_channel", ValueFromAmount(table->GetCost(GOVERNANCE_COST_MSG_CHANNEL))));
+    cost.push_back(Pair("qualifier", ValueFromAmount(table->GetCost(GOVERNANCE_COST_QUALIFIER))));
+    cost.push_back(Pair("sub_qualifier", ValueFromAmount(table->GetCost(GOVERNANCE_COST_SUB_QUALIFIER))));
+    cost.push_back(Pair("null_qualifier", ValueFromAmount(table->GetCost(GOVERNANCE_COST_NULL_QUALIFIER))));
+    cost.push_back(Pair("restricted", ValueFromAmount(table->GetCost(GOVERNANCE_COST_RESTRICTED))));
     
     result.push_back(Pair("cost", cost));
 
     CTxDestination dest;
-    if (ExtractDestination(governance->GetFeeScript(), dest)) {
+    if (ExtractDestination(table->GetFeeScript(), dest)) {
         result.push_back(Pair("address", EncodeDestination(dest)));
     }
 
     return result;
 }
 
+static const std::vector<std::pair<std::string, int> > vGovernanceCostTypes = {
+    {"root", GOVERNANCE_COST_ROOT},
+    {"reissue", GOVERNANCE_COST_REISSUE},
+    {"unique", GOVERNANCE_COST_UNIQUE},
+    {"sub", GOVERNANCE_COST_SUB},
+    {"username", GOVERNANCE_COST_USERNAME},
+    {"msg_channel", GOVERNANCE_COST_MSG_CHANNEL},
+    {"qualifier", GOVERNANCE_COST_QUALIFIER},
+    {"sub_qualifier", GOVERNANCE_COST_SUB_QUALIFIER},
+    {"null_qualifier", GOVERNANCE_COST_NULL_QUALIFIER},
+    {"restricted", GOVERNANCE_COST_RESTRICTED},
+};
+
+/** The address a governance script pays to, or the script in hex when it has none */
+static std::string GovernanceScriptToString(const CScript& script)
+{
+    CTxDestination dest;
+    if (ExtractDestination(script, dest))
+        return EncodeDestination(dest);
+    return HexStr(script.begin(), script.end());
+}
+
+UniValue getgovernanceinfo(const JSONRPCRequest& request) {
+    if (request.fHelp || request.params.size() > 0) {
+        throw std::runtime_error(
+            "getgovernanceinfo\n"
+            "\nReturns the governance parameters currently in force and the height they were set at.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"cost\": {\n"
+            "    \"root\": {\n"
+            "      \"amount\": x.xxx,       (numeric) issuance cost\n"
+            "      \"height\": n            (numeric) height of the update in force\n"
+            "    },\n"
+            "    ...\n"
+            "  },\n"
+            "  \"address\": \"address\",     (string) token fee address\n"
+            "  \"address_height\": n,       (numeric) height of the fee address update in force\n"
+            "  \"frozen\": n,               (numeric) number of frozen scripts\n"
+            "  \"authorized\": n            (numeric) number of authorized scripts\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getgovernanceinfo", "")
+            + HelpExampleRpc("getgovernanceinfo", "")
+        );
+    }
+
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    CCostTableRef table = tip && tip->costTable ? tip->costTable : governance->GetCostTable();
+
+    UniValue result(UniValue::VOBJ);
+    UniValue cost(UniValue::VOBJ);
+
+    for (const auto& type : vGovernanceCostTypes) {
+        int height;
+        CAmount amount = table->GetCost(type.second, &height);
+
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("amount", ValueFromAmount(amount)));
+        entry.push_back(Pair("height", height));
+        cost.push_back(Pair(type.first, entry));
+    }
+
+    result.push_back(Pair("cost", cost));
+
+    int nFeeHeight;
+    CTxDestination dest;
+    if (ExtractDestination(table->GetFeeScript(&nFeeHeight), dest)) {
+        result.push_back(Pair("address", EncodeDestination(dest)));
+        result.push_back(Pair("address_height", nFeeHeight));
+    }
+
+    result.push_back(Pair("frozen", (uint64_t)governance->GetNumberOfFrozenScripts()));
+    result.push_back(Pair("authorized", (uint64_t)governance->GetNumberOfAuthorizedScripts()));
+
+    return result;
+}
+
+static std::string GovernanceEventName(int nType)
+{
+    switch (nType) {
+        case GOVERNANCE_FREEZE: return "freeze";
+        case GOVERNANCE_UNFREEZE: return "unfreeze";
+        case GOVERNANCE_AUTHORIZATION: return "authorize";
+        case GOVERNANCE_UNAUTHORIZATION: return "unauthorize";
+        case GOVERNANCE_COST: return "cost";
+        case GOVERNANCE_FEE: return "fee_address";
+    }
+    return "unknown";
+}
+
+/** Paging cursors are the last event returned, as <height>:<type>:<cost type>:<script hex> */
+static std::string GovernanceEventCursor(const CGovernanceEvent& event)
+{
+    return strprintf("%d:%d:%d:%s", event.nHeight, event.nType, event.nCostType, HexStr(event.script.begin(), event.script.end()));
+}
+
+static bool ParseGovernanceEventCursor(const std::string& strCursor, CGovernanceEvent& event)
+{
+    std::vector<std::string> vParts;
+    size_t nStart = 0;
+    for (size_t nPos; vParts.size() < 3 && (nPos = strCursor.find(':', nStart)) != std::string::npos; nStart = nPos + 1)
+        vParts.push_back(strCursor.substr(nStart, nPos - nStart));
+    vParts.push_back(strCursor.substr(nStart));
+
+    if (vParts.size() != 4 || !ParseInt32(vParts[0], &event.nHeight) || !ParseInt32(vParts[1], &event.nType) ||
+        !ParseInt32(vParts[2], &event.nCostType) || (!vParts[3].empty() && !IsHex(vParts[3])))
+        return false;
+    std::vector<unsigned char> vchScript = ParseHex(vParts[3]);
+    event.script = CScript(vchScript.begin(), vchScript.end());
+    return true;
+}
+
+/** Height of the published tip the request reads */
+static int GetGovernanceTipHeight(const JSONRPCRequest& request)
+{
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    return tip ? tip->nHeight : -1;
+}
+
+UniValue getgovernanceevents(const JSONRPCRequest& request) {
+    if (request.fHelp || request.params.size() > 4) {
+        throw std::runtime_error(
+            "getgovernanceevents ( start_height end_height count \"after\" )\n"
+            "\nReturns the governance actions taken by the blocks of the active chain, in height order.\n"
+
+            "\nArguments:\n"
+            "1. start_height     (numeric, optional, default=0) first height to return events for\n"
+            "2. end_height       (numeric, optional, default=tip) last height to return events for\n"
+            "3. count            (numeric, optional, default=1000) most events to return\n"
+            "4. \"after\"          (string, optional) the \"next\" cursor of the previous page, continues after it\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"events\": [\n"
+            "    {\n"
+            "      \"height\": n,              (numeric) height of the block that took the action\n"
+            "      \"action\": \"action\",       (string) freeze, unfreeze, authorize, unauthorize, cost or fee_address\n"
+            "      \"address\": \"address\",     (string) the address acted on or set as fee address, the script in hex if it has none\n"
+            "      \"cost_type\": \"type\",      (string) for cost updates, the issuance cost updated\n"
+            "      \"amount\": x.xxx           (numeric) for cost updates, the new cost\n"
+            "    },\n"
+            "    ...\n"
+            "  ],\n"
+            "  \"next\": \"cursor\",          (string) pass as \"after\" for the next page, left out on the last page\n"
+            "  \"complete\": true|false      (boolean) whether the log goes back to the genesis block, -reindex to rebuild it\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getgovernanceevents", "")
+            + HelpExampleCli("getgovernanceevents", "1000 2000 100")
+            + HelpExampleRpc("getgovernanceevents", "1000, 2000, 100")
+        );
+    }
+
+    int nStartHeight = request.params.size() > 0 && !request.params[0].isNull() ? request.params[0].get_int() : 0;
+    int nEndHeight = request.params.size() > 1 && !request.params[1].isNull() ? request.params[1].get_int() : GetGovernanceTipHeight(request);
+    int nCount = request.params.size() > 2 && !request.params[2].isNull() ? request.params[2].get_int() : 1000;
+    if (nStartHeight < 0 || nEndHeight < nStartHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    if (nCount <= 0 || nCount > 10000)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be between 1 and 10000");
+
+    // Start just before the first event of start_height, no event has type 0
+    CGovernanceEvent after(nStartHeight, 0, CScript());
+    if (request.params.size() > 3 && !request.params[3].isNull()) {
+        if (!ParseGovernanceEventCursor(request.params[3].get_str(), after))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        if (after.nHeight < nStartHeight)
+            after = CGovernanceEvent(nStartHeight, 0, CScript());
+    }
+
+    UniValue events(UniValue::VARR);
+    CGovernanceEvent last;
+    bool fMore = false;
+    governance->ForEachEvent(&after, nEndHeight, [&](const CGovernanceEvent& event) {
+        if ((int)events.size() == nCount) {
+            fMore = true;
+            return false;
+        }
+
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("height", event.nHeight));
+        entry.push_back(Pair("action", GovernanceEventName(event.nType)));
+        if (event.nType == GOVERNANCE_COST) {
+            std::string strCostType = std::to_string(event.nCostType);
+            for (const auto& type : vGovernanceCostTypes) {
+                if (type.second == event.nCostType)
+                    strCostType = type.first;
+            }
+            entry.push_back(Pair("cost_type", strCostType));
+            entry.push_back(Pair("amount", ValueFromAmount(event.nCost)));
+        } else {
+            entry.push_back(Pair("address", GovernanceScriptToString(event.script)));
+        }
+        events.push_back(entry);
+        last = event;
+        return true;
+    });
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("events", events));
+    if (fMore)
+        result.push_back(Pair("next", GovernanceEventCursor(last)));
+    result.push_back(Pair("complete", governance->IsEventLogComplete()));
+
+    return result;
+}
+
+UniValue getgovernancestate(const JSONRPCRequest& request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "getgovernancestate height\n"
+            "\nReturns the frozen and authorized addresses, issuance costs and fee address in force at a height,\n"
+            "rebuilt from the governance event log.\n"
+
+            "\nArguments:\n"
+            "1. height           (numeric, required) the height to rebuild the state at\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": n,                (numeric) the height asked for\n"
+            "  \"frozen\": [ \"address\", ... ],      (array) addresses frozen at the height\n"
+            "  \"authorized\": [ \"address\", ... ],  (array) addresses authorized to stake at the height\n"
+            "  \"cost\": {\n"
+            "    \"root\": {\n"
+            "      \"amount\": x.xxx,       (numeric) issuance cost\n"
+            "      \"height\": n            (numeric) height of the update in force\n"
+            "    },\n"
+            "    ...\n"
+            "  },\n"
+            "  \"address\": \"address\",     (string) token fee address\n"
+            "  \"address_height\": n,       (numeric) height of the fee address update in force\n"
+            "  \"complete\": true|false    (boolean) whether the log goes back to the genesis block, -reindex to rebuild it\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getgovernancestate", "1000")
+            + HelpExampleRpc("getgovernancestate", "1000")
+        );
+    }
+
+    int nHeight = request.params[0].get_int();
+    if (nHeight < 0 || nHeight > GetGovernanceTipHeight(request))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+
+    CGovernanceState state;
+    if (!governance->GetStateAtHeight(nHeight, state))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the governance event log");
+
+    UniValue frozen(UniValue::VARR);
+    for (const CScript& script : state.setFrozen)
+        frozen.push_back(GovernanceScriptToString(script));
+    UniValue authorized(UniValue::VARR);
+    for (const CScript& script : state.setAuthorized)
+        authorized.push_back(GovernanceScriptToString(script));
+
+    UniValue cost(UniValue::VOBJ);
+    for (const auto& type : vGovernanceCostTypes) {
+        auto it = state.mapCosts.find(type.second);
+        if (it == state.mapCosts.end())
+            continue;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("amount", ValueFromAmount(it->second.first)));
+        entry.push_back(Pair("height", it->second.second));
+        cost.push_back(Pair(type.first, entry));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("height", nHeight));
+    result.push_back(Pair("frozen", frozen));
+    result.push_back(Pair("authorized", authorized));
+    result.push_back(Pair("cost", cost));
+    if (state.nFeeHeight >= 0) {
+        result.push_back(Pair("address", GovernanceScriptToString(state.feeScript)));
+        result.push_back(Pair("address_height", state.nFeeHeight));
+    }
+    result.push_back(Pair("complete", governance->IsEventLogComplete()));
+
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1948,17 +2612,21 @@ static const CRPCCommand commands[] =
     { "blockchain",         "GetIndexHashes",         &GetIndexHashes,         {} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash","filtertype"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose","mempool_sequence"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
+    { "blockchain",         "getsigcacheinfo",        &getsigcacheinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
+    { "blockchain",         "dumpchainstatesnapshot", &dumpchainstatesnapshot, {"path"} },
+    { "blockchain",         "checkchainstatesnapshot", &checkchainstatesnapshot, {"path"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
@@ -1966,6 +2634,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "freezelist",             &freezelist,             {} },
     { "blockchain",         "issuanceinfo",           &issuanceinfo,           {} },
     { "blockchain",         "checkfreeze",            &checkfreeze,            {} },
+    { "blockchain",         "getgovernanceinfo",      &getgovernanceinfo,      {} },
+    { "blockchain",         "getgovernanceevents",    &getgovernanceevents,    {"start_height", "end_height", "count", "after"} },
+    { "blockchain",         "getgovernancestate",     &getgovernancestate,     {"height"} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
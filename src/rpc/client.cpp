@@ -51,6 +51,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "transferfromaddress", 2, "qty"},
     { "transferfromaddress", 4, "timelock" },
     { "transferfromaddress", 7, "expire_time"},
+    { "sendmanytokens", 0, "transfers"},
     { "transferfromaddresses", 1, "from_addresses"},
     { "transferfromaddresses", 2, "qty"},
     { "transferfromaddresses", 4, "timelock" },
@@ -151,6 +152,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "sendrawtransaction", 1, "allowhighfees" },
     { "testmempoolaccept", 0, "rawtxs" },
     { "testmempoolaccept", 1, "allowhighfees" },
+    { "submitrawtransactions", 0, "rawtxs" },
+    { "submitrawtransactions", 1, "allowhighfees" },
+    { "checkrawtransactions", 0, "rawtxs" },
     { "combinerawtransaction", 0, "txs" },
     { "fundrawtransaction", 1, "options" },
     { "gettxout", 1, "n" },
@@ -167,8 +171,13 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "verifychain", 0, "checklevel" },
     { "verifychain", 1, "nblocks" },
     { "pruneblockchain", 0, "height" },
+    { "getgovernanceevents", 0, "start_height" },
+    { "getgovernanceevents", 1, "end_height" },
+    { "getgovernanceevents", 2, "count" },
+    { "getgovernancestate", 0, "height" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
+    { "getrawmempool", 1, "mempool_sequence" },
     { "estimatefee", 0, "nblocks" },
     { "estimatesmartfee", 0, "conf_target" },
     { "estimaterawfee", 0, "conf_target" },
@@ -204,13 +213,25 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "echojson", 9, "arg9" },
     { "rescanblockchain", 0, "start_height"},
     { "rescanblockchain", 1, "stop_height"},
+    { "gettokentransactions", 1, "start_height"},
+    { "gettokentransactions", 2, "count"},
+    { "gettokentransactions", 3, "skip"},
     { "listaddressesbytoken", 1, "totalonly"},
     { "listaddressesbytoken", 2, "count"},
     { "listaddressesbytoken", 3, "start"},
     { "listtokenbalancesbyaddress", 1, "totalonly"},
     { "listtokenbalancesbyaddress", 2, "count"},
     { "listtokenbalancesbyaddress", 3, "start"},
+    { "getaddressestokenbalances", 0, "addresses"},
+    { "listaddressesfortag", 1, "count"},
+    { "listtagsforaddress", 1, "count"},
+    { "listaddressrestrictions", 1, "count"},
     { "sendmessage", 2, "expire_time"},
+    { "viewallmessages", 1, "start_time"},
+    { "viewallmessages", 2, "end_time"},
+    { "viewallmessages", 3, "skip"},
+    { "viewallmessages", 4, "count"},
+    { "clearmessages", 0, "expired_only"},
     { "requestsnapshot", 1, "block_height"},
     { "getsnapshotrequest", 1, "block_height"},
     { "listsnapshotrequests", 1, "block_height"},
@@ -39,11 +39,18 @@ std::string MessageActivationWarning()
 }
 
 UniValue viewallmessages(const JSONRPCRequest& request) {
-    if (request.fHelp || !AreMessagesDeployed() || request.params.size() != 0)
+    if (request.fHelp || !AreMessagesDeployed() || request.params.size() > 5)
         throw std::runtime_error(
-                "viewallmessages \n"
+                "viewallmessages ( \"channel_name\" start_time end_time skip count )\n"
                 + MessageActivationWarning() +
-                "\nView all messages that the wallet contains\n"
+                "\nView the messages that the wallet contains, ordered by channel and then by time\n"
+
+                "\nArguments:\n"
+                "1. \"channel_name\"             (string, optional, default=\"\") Only show the messages of this channel\n"
+                "2. start_time                 (numeric, optional, default=0) Only show the messages sent at or after this UTC timestamp\n"
+                "3. end_time                   (numeric, optional) Only show the messages sent at or before this UTC timestamp\n"
+                "4. skip                       (numeric, optional, default=0) The number of matching messages to skip\n"
+                "5. count                      (numeric, optional, default=0) The most messages to show, 0 for all of them\n"
 
                 "\nResult:\n"
                 "\"Token Name:\"                     (string) The name of the token the message was sent on\n"
@@ -57,7 +64,8 @@ UniValue viewallmessages(const JSONRPCRequest& request) {
 
                 "\nExamples:\n"
                 + HelpExampleCli("viewallmessages", "")
-                + HelpExampleRpc("viewallmessages", "")
+                + HelpExampleCli("viewallmessages", "\"TOKEN_NAME!\" 1546300800 1577836800 0 100")
+                + HelpExampleRpc("viewallmessages", "\"TOKEN_NAME!\", 1546300800, 1577836800, 0, 100")
         );
 
     if (!fMessaging) {
@@ -72,32 +80,26 @@ UniValue viewallmessages(const JSONRPCRequest& request) {
         return ret;
     }
 
-    std::set<CMessage> setMessages;
-
-    pmessagedb->LoadMessages(setMessages);
-
-    for (auto pair : mapDirtyMessagesOrphaned) {
-        CMessage message = pair.second;
-        message.status = MessageStatus::ORPHAN;
-        if (setMessages.count(message))
-            setMessages.erase(message);
-        setMessages.insert(message);
-    }
-
-    for (auto out : setDirtyMessagesRemove) {
-        CMessage message;
-        message.out = out;
-        setMessages.erase(message);
-    }
-
-    for (auto pair : mapDirtyMessagesAdd) {
-        setMessages.erase(pair.second);
-        setMessages.insert(pair.second);
+    std::string strChannel = request.params.size() > 0 ? request.params[0].get_str() : "";
+    int64_t nStartTime = request.params.size() > 1 ? request.params[1].get_int64() : 0;
+    int64_t nEndTime = request.params.size() > 2 ? request.params[2].get_int64() : std::numeric_limits<int64_t>::max();
+    int64_t nSkip = request.params.size() > 3 ? request.params[3].get_int64() : 0;
+    int64_t nCount = request.params.size() > 4 ? request.params[4].get_int64() : 0;
+    if (nSkip < 0 || nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "skip and count can't be negative");
+
+    std::vector<CMessage> vMessages;
+    {
+        LOCK(cs_messaging);
+        // The dirty caches go to the database first, so the indexes cover them
+        if (!pmessagedb->Flush())
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to flush the messages");
+        pmessagedb->LoadChannelMessages(strChannel, nStartTime, nEndTime, nSkip, nCount, vMessages);
     }
 
     UniValue messages(UniValue::VARR);
 
-    for (auto message : setMessages) {
+    for (auto message : vMessages) {
         UniValue obj(UniValue::VOBJ);
 
         obj.push_back(Pair("Token Name", message.strName));
@@ -271,17 +273,21 @@ UniValue unsubscribefromchannel(const JSONRPCRequest& request) {
 }
 
 UniValue clearmessages(const JSONRPCRequest& request) {
-    if (request.fHelp || !AreMessagesDeployed() || request.params.size() != 0)
+    if (request.fHelp || !AreMessagesDeployed() || request.params.size() > 1)
         throw std::runtime_error(
-                "clearmessages \n"
+                "clearmessages ( expired_only )\n"
                 + MessageActivationWarning() +
                 "\nDelete current database of messages\n"
 
+                "\nArguments:\n"
+                "1. expired_only               (boolean, optional, default=false) Only delete the messages whose expire time has passed\n"
+
                 "\nResult:[\n"
                 "\n]\n"
                 "\nExamples:\n"
                 + HelpExampleCli("clearmessages", "")
-                + HelpExampleRpc("clearmessages", "")
+                + HelpExampleCli("clearmessages", "true")
+                + HelpExampleRpc("clearmessages", "true")
         );
 
     if (!fMessaging) {
@@ -293,6 +299,15 @@ UniValue clearmessages(const JSONRPCRequest& request) {
     }
 
     int count = 0;
+    if (request.params.size() > 0 && request.params[0].get_bool()) {
+        LOCK(cs_messaging);
+        std::vector<COutPoint> vErased;
+        if (!pmessagedb->Flush() || !pmessagedb->EraseExpiredMessages(GetTime(), vErased))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to erase the expired messages");
+        pMessagesCache->Clear();
+        return "Erased " + std::to_string(vErased.size()) + " expired Messages from the database";
+    }
+
     count += mapDirtyMessagesAdd.size();
 
     pMessagesCache->Clear();
@@ -488,7 +503,7 @@ UniValue viewmyrestrictedaddresses(const JSONRPCRequest& request) {
 static const CRPCCommand commands[] =
     {           //  category    name                          actor (function)             argNames
                 //  ----------- ------------------------      -----------------------      ----------
-            { "messages",       "viewallmessages",            &viewallmessages,            {}},
+            { "messages",       "viewallmessages",            &viewallmessages,            {"channel_name", "start_time", "end_time", "skip", "count"}},
             { "messages",       "viewallmessagechannels",     &viewallmessagechannels,     {}},
             { "messages",       "subscribetochannel",         &subscribetochannel,         {"channel_name"}},
             { "messages",       "unsubscribefromchannel",     &unsubscribefromchannel,     {"channel_name"}},
@@ -497,7 +512,7 @@ static const CRPCCommand commands[] =
             {"restricted",        "viewmytaggedaddresses",      &viewmytaggedaddresses,       {}},
             {"restricted",        "viewmyrestrictedaddresses",  &viewmyrestrictedaddresses,   {}},
 #endif
-            { "messages",       "clearmessages",              &clearmessages,              {}},
+            { "messages",       "clearmessages",              &clearmessages,              {"expired_only"}},
     };
 
 void RegisterMessageRPCCommands(CRPCTable &t)
@@ -248,7 +248,14 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size() != 0)
         throw std::runtime_error(
             "getstakinginfo\n"
-            "Returns an object containing staking-related information.");
+            "Returns an object containing staking-related information.\n"
+            "The \"stats\" object counts the work of the wallet's staking thread since startup:\n"
+            "  \"iterations\", \"kernelschecked\", \"kernelspersecond\", \"templatesbuilt\", \"templatesreused\",\n"
+            "  \"templatesdiscarded\", \"blockssigned\", \"blocksexpired\" and \"time\", the milliseconds spent in\n"
+            "  \"availablecoins\", \"kernelsearch\", \"createnewblock\", \"signblock\" and waiting for \"locks\".\n"
+            "The \"rewards\" object holds, for \"last24h\", \"last7d\", \"last30d\" and \"total\", the number of\n"
+            "  \"stakes\" the wallet found in the main chain and the \"amount\" they earned it, by block time rounded\n"
+            "  down to the hour.");
 
     LOCK(cs_main);
 
@@ -288,6 +295,45 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
 
     obj.pushKV("expectedtime", nExpectedTime);
 
+#ifdef ENABLE_WALLET
+    if (pwallet)
+    {
+        const CStakerStats& stats = pwallet->m_staker_stats;
+        uint64_t nKernelsChecked = stats.nKernelsChecked;
+        int64_t nKernelSearchTime = stats.nKernelSearchTime;
+
+        UniValue time(UniValue::VOBJ);
+        time.pushKV("availablecoins", stats.nAvailableCoinsTime / 1000);
+        time.pushKV("kernelsearch", nKernelSearchTime / 1000);
+        time.pushKV("createnewblock", stats.nCreateNewBlockTime / 1000);
+        time.pushKV("signblock", stats.nSignBlockTime / 1000);
+        time.pushKV("locks", stats.nLockWaitTime / 1000);
+
+        UniValue statsObj(UniValue::VOBJ);
+        statsObj.pushKV("iterations", (uint64_t)stats.nIterations);
+        statsObj.pushKV("kernelschecked", nKernelsChecked);
+        statsObj.pushKV("kernelspersecond", nKernelSearchTime > 0 ? (uint64_t)(nKernelsChecked * 1000000.0 / nKernelSearchTime) : 0);
+        statsObj.pushKV("templatesbuilt", (uint64_t)stats.nTemplatesBuilt);
+        statsObj.pushKV("templatesreused", (uint64_t)stats.nTemplatesReused);
+        statsObj.pushKV("templatesdiscarded", (uint64_t)stats.nTemplatesDiscarded);
+        statsObj.pushKV("blockssigned", (uint64_t)stats.nBlocksSigned);
+        statsObj.pushKV("blocksexpired", (uint64_t)stats.nBlocksExpired);
+        statsObj.pushKV("time", time);
+        obj.pushKV("stats", statsObj);
+
+        UniValue rewards(UniValue::VOBJ);
+        int64_t nNow = GetTime();
+        for (const std::pair<std::string, int64_t>& window : std::vector<std::pair<std::string, int64_t> >{{"last24h", 1}, {"last7d", 7}, {"last30d", 30}, {"total", 0}}) {
+            CStakeRewardPeriod period = pwallet->GetStakeRewards(window.second ? nNow - window.second * 24 * 60 * 60 : 0);
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("stakes", (uint64_t)period.nCount);
+            entry.pushKV("amount", ValueFromAmount(period.nReward));
+            rewards.pushKV(window.first, entry);
+        }
+        obj.pushKV("rewards", rewards);
+    }
+#endif
+
     return obj;
 }
 
@@ -425,7 +471,15 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "  \"weightlimit\" : n,                (numeric) limit of block weight\n"
             "  \"curtime\" : ttt,                  (numeric) current timestamp in seconds since epoch (Jan 1 1970 GMT)\n"
             "  \"bits\" : \"xxxxxxxx\",              (string) compressed target of next block\n"
-            "  \"height\" : n                      (numeric) The height of the next block\n"
+            "  \"height\" : n,                     (numeric) The height of the next block\n"
+            "  \"tokenops\" : {                    (json object) token outputs in the block by operation (issue, owner, reissue, transfer)\n"
+            "      \"operation\" : n\n"
+            "      ,...\n"
+            "  },\n"
+            "  \"skippedtokenpackages\" : {        (json object) packages left out because their token operations conflict with the block, by reason\n"
+            "      \"reason\" : n\n"
+            "      ,...\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n"
@@ -752,6 +806,15 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     result.push_back(Pair("bits", strprintf("%08x", pblock->nBits)));
     result.push_back(Pair("height", (int64_t)(pindexPrev->nHeight+1)));
 
+    UniValue tokenOps(UniValue::VOBJ);
+    for (const auto& op : pblocktemplate->mapTokenOps)
+        tokenOps.push_back(Pair(op.first, op.second));
+    result.push_back(Pair("tokenops", tokenOps));
+    UniValue skippedTokenPackages(UniValue::VOBJ);
+    for (const auto& skipped : pblocktemplate->mapSkippedTokenPackages)
+        skippedTokenPackages.push_back(Pair(skipped.first, skipped.second));
+    result.push_back(Pair("skippedtokenpackages", skippedTokenPackages));
+
     if (!pblocktemplate->vchCoinbaseCommitment.empty() && fSupportsSegwit) {
         result.push_back(Pair("default_witness_commitment", HexStr(pblocktemplate->vchCoinbaseCommitment.begin(), pblocktemplate->vchCoinbaseCommitment.end())));
     }
@@ -892,9 +955,9 @@ UniValue estimatefee(const JSONRPCRequest& request)
 
 UniValue estimatesmartfee(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-            "estimatesmartfee conf_target (\"estimate_mode\")\n"
+            "estimatesmartfee conf_target (\"estimate_mode\" \"estimate_class\")\n"
             "\nEstimates the approximate fee per kilobyte needed for a transaction to begin\n"
             "confirmation within conf_target blocks if possible and return the number of blocks\n"
             "for which the estimate is valid. Uses virtual transaction size as defined\n"
@@ -910,6 +973,11 @@ UniValue estimatesmartfee(const JSONRPCRequest& request)
             "       \"UNSET\" (defaults to CONSERVATIVE)\n"
             "       \"ECONOMICAL\"\n"
             "       \"CONSERVATIVE\"\n"
+            "3. \"estimate_class\" (string, optional, default=ANY) The transactions to estimate from.\n"
+            "                   Token transactions are also tracked on their own, and once enough\n"
+            "                   of them have confirmed their estimate is used instead.  Must be one of:\n"
+            "       \"ANY\"\n"
+            "       \"TOKEN\"\n"
             "\nResult:\n"
             "{\n"
             "  \"feerate\" : x.x,     (numeric, optional) estimate fee rate in " + CURRENCY_UNIT + "/kB\n"
@@ -925,7 +993,7 @@ UniValue estimatesmartfee(const JSONRPCRequest& request)
             + HelpExampleCli("estimatesmartfee", "6")
             );
 
-    RPCTypeCheck(request.params, {UniValue::VNUM, UniValue::VSTR});
+    RPCTypeCheck(request.params, {UniValue::VNUM, UniValue::VSTR, UniValue::VSTR});
     RPCTypeCheckArgument(request.params[0], UniValue::VNUM);
     unsigned int conf_target = ParseConfirmTarget(request.params[0]);
     bool conservative = true;
@@ -936,11 +1004,17 @@ UniValue estimatesmartfee(const JSONRPCRequest& request)
         }
         if (fee_mode == FeeEstimateMode::ECONOMICAL) conservative = false;
     }
+    FeeEstimateClass fee_class = FeeEstimateClass::ANY;
+    if (!request.params[2].isNull()) {
+        if (!FeeClassFromString(request.params[2].get_str(), fee_class)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid estimate_class parameter");
+        }
+    }
 
     UniValue result(UniValue::VOBJ);
     UniValue errors(UniValue::VARR);
     FeeCalculation feeCalc;
-    CFeeRate feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative);
+    CFeeRate feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative, fee_class);
     if (feeRate != CFeeRate(0)) {
         result.push_back(Pair("feerate", ValueFromAmount(feeRate.GetFeePerK())));
     } else {
@@ -1116,7 +1190,7 @@ static const CRPCCommand commands[] =
     { "generating",         "setgenerate",            &setgenerate,            {"generate", "genproclimit"}  },
 
     { "util",               "estimatefee",            &estimatefee,            {"nblocks"} },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode", "estimate_class"} },
 
     { "hidden",             "estimaterawfee",         &estimaterawfee,         {"conf_target", "threshold"} },
 };
@@ -16,6 +16,7 @@
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "trace.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -608,6 +609,171 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getlockstats (\"mode\")\n"
+            "Returns where locks are taken and how long they were waited for and held, as recorded by the lock profiler.\n"
+            "The profiler is off unless started here or with -lockprofiling.\n"
+            "Arguments:\n"
+            "1. \"mode\" what to do before the statistics are returned. This argument is optional, the default mode is \"stats\".\n"
+            "  - \"stats\" only returns the statistics.\n"
+            "  - \"start\" starts recording.\n"
+            "  - \"stop\" stops recording, keeping what was recorded.\n"
+            "  - \"reset\" drops what was recorded.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,     (boolean) Whether the profiler is recording\n"
+            "  \"sites\": [                 (json array) The places locks were taken, most waited for first\n"
+            "    {\n"
+            "      \"lock\": \"name\",         (string) The lock, as written where it is taken\n"
+            "      \"site\": \"file:line\",    (string) Where it is taken\n"
+            "      \"count\": n,             (numeric) Times it was taken; a thread taking a lock it holds is not counted\n"
+            "      \"contended\": n,         (numeric) Times it had to wait for another thread\n"
+            "      \"wait_ms\": x.xxx,       (numeric) Milliseconds waited\n"
+            "      \"max_wait_ms\": x.xxx,   (numeric) Longest wait in milliseconds\n"
+            "      \"hold_ms\": x.xxx,       (numeric) Milliseconds held\n"
+            "      \"max_hold_ms\": x.xxx    (numeric) Longest hold in milliseconds\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "\"start\"")
+            + HelpExampleRpc("getlockstats", "")
+        );
+
+    std::string mode = request.params[0].isNull() ? "stats" : request.params[0].get_str();
+    if (mode == "start") {
+        SetLockProfiling(true);
+    } else if (mode == "stop") {
+        SetLockProfiling(false);
+    } else if (mode == "reset") {
+        ResetLockStats();
+    } else if (mode != "stats") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown mode " + mode);
+    }
+
+    UniValue sites(UniValue::VARR);
+    for (const LockSiteStats& stats : GetLockStats()) {
+        UniValue site(UniValue::VOBJ);
+        site.push_back(Pair("lock", stats.strName));
+        site.push_back(Pair("site", strprintf("%s:%d", stats.strFile, stats.nLine)));
+        site.push_back(Pair("count", stats.nCount));
+        site.push_back(Pair("contended", stats.nContended));
+        site.push_back(Pair("wait_ms", 0.001 * stats.nWaitMicros));
+        site.push_back(Pair("max_wait_ms", 0.001 * stats.nMaxWaitMicros));
+        site.push_back(Pair("hold_ms", 0.001 * stats.nHoldMicros));
+        site.push_back(Pair("max_hold_ms", 0.001 * stats.nMaxHoldMicros));
+        sites.push_back(site);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("enabled", fLockProfiling.load()));
+    obj.push_back(Pair("sites", sites));
+    return obj;
+}
+
+UniValue gettracestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "gettracestats (\"mode\")\n"
+            "Returns how long the traced phases of block connection, token validation and the database flushes took.\n"
+            "Tracing is off unless started here or with -tracing.\n"
+            "Arguments:\n"
+            "1. \"mode\" what to do before the statistics are returned. This argument is optional, the default mode is \"stats\".\n"
+            "  - \"stats\" only returns the statistics.\n"
+            "  - \"start\" starts tracing.\n"
+            "  - \"stop\" stops tracing, keeping what was recorded.\n"
+            "  - \"reset\" drops what was recorded.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,     (boolean) Whether tracing is on\n"
+            "  \"spans\": [                 (json array) The traced phases, the most time first\n"
+            "    {\n"
+            "      \"name\": \"name\",         (string) The phase\n"
+            "      \"count\": n,             (numeric) Times it ran\n"
+            "      \"total_ms\": x.xxx,      (numeric) Milliseconds it took in all\n"
+            "      \"max_ms\": x.xxx,        (numeric) Its longest run in milliseconds\n"
+            "      \"histogram\": [          (json array) The runs by duration, for the durations that occurred\n"
+            "        [us, n], ...           (numeric, numeric) n runs took less than us microseconds, and at least half of that\n"
+            "      ]\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettracestats", "\"start\"")
+            + HelpExampleRpc("gettracestats", "")
+        );
+
+    std::string mode = request.params[0].isNull() ? "stats" : request.params[0].get_str();
+    if (mode == "start") {
+        SetTracing(true);
+    } else if (mode == "stop") {
+        SetTracing(false);
+    } else if (mode == "reset") {
+        ResetTraceStats();
+    } else if (mode != "stats") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown mode " + mode);
+    }
+
+    UniValue spans(UniValue::VARR);
+    for (const TraceSpanStats& stats : GetTraceStats()) {
+        UniValue histogram(UniValue::VARR);
+        for (int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+            if (!stats.vBuckets[i])
+                continue;
+            UniValue bucket(UniValue::VARR);
+            bucket.push_back(int64_t(1) << i);
+            bucket.push_back(stats.vBuckets[i]);
+            histogram.push_back(bucket);
+        }
+        UniValue span(UniValue::VOBJ);
+        span.push_back(Pair("name", stats.strName));
+        span.push_back(Pair("count", stats.nCount));
+        span.push_back(Pair("total_ms", 0.001 * stats.nTotalMicros));
+        span.push_back(Pair("max_ms", 0.001 * stats.nMaxMicros));
+        span.push_back(Pair("histogram", histogram));
+        spans.push_back(span);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("enabled", fTracing.load()));
+    obj.push_back(Pair("spans", spans));
+    return obj;
+}
+
+UniValue dumptrace(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptrace \"filename\"\n"
+            "Writes the latest traced spans, up to " + std::to_string(TRACE_EVENT_BUFFER_SIZE) + ", to a file in the Chrome trace event format,\n"
+            "which chrome://tracing and Perfetto open. See gettracestats.\n"
+            "Arguments:\n"
+            "1. \"filename\"    (string, required) The file to write, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filename\": \"path\",    (string) The file written\n"
+            "  \"spans\": n              (numeric) The spans written\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptrace", "\"trace.json\"")
+            + HelpExampleRpc("dumptrace", "\"trace.json\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    int64_t nSpans = WriteTraceEvents(path);
+    if (nSpans < 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Could not write " + path.string());
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("filename", path.string()));
+    obj.push_back(Pair("spans", nSpans));
+    return obj;
+}
+
 uint32_t getCategoryMask(UniValue cats) {
     cats = cats.get_array();
     uint32_t mask = 0;
@@ -1112,46 +1278,27 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         includeTokens = request.params[1].get_bool();
     }
 
+    // Timelocks are judged against the request's tip, which stays the same across a batch
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    if (!tip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No active chain");
+
     if (includeTokens) {
         if (!AreTokensDeployed())
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Tokens aren't active.  includeTokens can't be true.");
 
-        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::map<std::string, CAddressIndexBalance> balances;
 
         for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+            if (!GetAddressIndexBalances((*it).first, (*it).second, "", tip->nHeight, tip->nMedianTimePast, balances)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
 
-        //tokenName -> (received, balance)
-        std::map<std::string, std::pair<CAmount, CAmount>> balances;
-        std::map<std::string, CAmount> locked;
-
-        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin();
-            it != addressIndex.end(); it++) {
-                std::string tokenName = it->first.token;
-                if (balances.count(tokenName) == 0) {
-                    balances[tokenName] = std::make_pair(0, 0);
-                    locked[tokenName] = 0;
-                }
-
-                if (it->second > 0) {
-                    balances[tokenName].first += it->second;
-                }
-
-                if (it->first.timeLock < ((int64_t)it->first.timeLock < LOCKTIME_THRESHOLD ? (int64_t)chainActive.Height() : (int64_t)chainActive.Tip()->GetMedianTimePast()))
-                {
-                    balances[tokenName].second += it->second;
-                } else {
-                    locked[tokenName] += it->second;
-                }
-            }
-
         UniValue result(UniValue::VARR);
         auto currentActiveTokenCache = GetCurrentTokenCache();
 
-        for (std::map<std::string, std::pair<CAmount, CAmount>>::const_iterator it = balances.begin();
+        for (std::map<std::string, CAddressIndexBalance>::const_iterator it = balances.begin();
                 it != balances.end(); it++) {
 
             CNewToken token;
@@ -1159,9 +1306,9 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
 
             UniValue balance(UniValue::VOBJ);
             balance.pushKV("tokenName", it->first);
-            balance.pushKV("balance", it->second.second);
-            balance.pushKV("received", it->second.first);
-            balance.pushKV("locked", locked[it->first]);
+            balance.pushKV("balance", it->second.balance);
+            balance.pushKV("received", it->second.received);
+            balance.pushKV("locked", it->second.locked);
             balance.pushKV("units", token.units);
             result.push_back(balance);
         }
@@ -1169,34 +1316,19 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         return result;
 
     } else {
-        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::map<std::string, CAddressIndexBalance> balances;
 
         for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-            if (!GetAddressIndex((*it).first, (*it).second, PLB, addressIndex)) {
+            if (!GetAddressIndexBalances((*it).first, (*it).second, PLB, tip->nHeight, tip->nMedianTimePast, balances)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
 
-        CAmount balance = 0;
-        CAmount received = 0;
-        CAmount locked = 0;
-
-        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin();
-             it != addressIndex.end(); it++) {
-            if (it->second > 0) {
-                received += it->second;
-            }
-            if (it->first.timeLock < ((int64_t)it->first.timeLock < LOCKTIME_THRESHOLD ? (int64_t)chainActive.Height() : (int64_t)chainActive.Tip()->GetMedianTimePast())) {
-                balance += it->second;
-            } else {
-                locked += it->second;
-            }
-        }
-
+        const CAddressIndexBalance& balance = balances[PLB];
         UniValue result(UniValue::VOBJ);
-        result.pushKV("balance", balance);
-        result.pushKV("received", received);
-        result.pushKV("locked", locked);
+        result.pushKV("balance", balance.balance);
+        result.pushKV("received", balance.received);
+        result.pushKV("locked", balance.locked);
 
         return result;
     }
@@ -1300,10 +1432,34 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
 
 }
 
+static void ParseSpentInfoKey(const UniValue& param, CSpentIndexKey& key)
+{
+    UniValue txidValue = find_value(param.get_obj(), "txid");
+    UniValue indexValue = find_value(param.get_obj(), "index");
+
+    if (!txidValue.isStr() || !indexValue.isNum()) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
+    }
+
+    key = CSpentIndexKey(ParseHashV(txidValue, "txid"), indexValue.get_int());
+}
+
+static UniValue SpentInfoToJSON(const CSpentIndexValue& value)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+    return obj;
+}
+
+// Enough outpoints for a block's worth of inputs, few enough to keep one reply bounded
+static const size_t MAX_SPENT_INFO_OUTPOINTS = 50000;
+
 UniValue getspentinfo(const JSONRPCRequest& request)
 {
 
-    if (request.fHelp || request.params.size() != 1 || !request.params[0].isObject())
+    if (request.fHelp || request.params.size() != 1 || !(request.params[0].isObject() || request.params[0].isArray()))
         throw std::runtime_error(
             "getspentinfo\n"
             "\nReturns the txid and index where an output is spent.\n"
@@ -1312,40 +1468,65 @@ UniValue getspentinfo(const JSONRPCRequest& request)
             "  \"txid\" (string) The hex string of the txid\n"
             "  \"index\" (number) The start block height\n"
             "}\n"
+            "or an array of up to " + std::to_string(MAX_SPENT_INFO_OUTPOINTS) + " of those objects\n"
             "\nResult:\n"
             "{\n"
             "  \"txid\"  (string) The transaction id\n"
             "  \"index\"  (number) The spending input index\n"
             "  ,...\n"
             "}\n"
+            "or for an array, an array of those results in the same order, null for the outputs that aren't spent\n"
             "\nExamples:\n"
             + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleCli("getspentinfo", "'[{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}, {\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 1}]'")
             + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
         );
 
-    UniValue txidValue = find_value(request.params[0].get_obj(), "txid");
-    UniValue indexValue = find_value(request.params[0].get_obj(), "index");
+    if (request.params[0].isObject()) {
+        CSpentIndexKey key;
+        ParseSpentInfoKey(request.params[0], key);
+        CSpentIndexValue value;
 
-    if (!txidValue.isStr() || !indexValue.isNum()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
+        if (!GetSpentIndex(key, value)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+        }
+
+        return SpentInfoToJSON(value);
     }
 
-    uint256 txid = ParseHashV(txidValue, "txid");
-    int outputIndex = indexValue.get_int();
+    // Many outputs at once, looked up in key order from one snapshot of the index
+    const UniValue& outpoints = request.params[0].get_array();
+    if (outpoints.size() > MAX_SPENT_INFO_OUTPOINTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u outpoints can be queried at once.", MAX_SPENT_INFO_OUTPOINTS));
 
-    CSpentIndexKey key(txid, outputIndex);
-    CSpentIndexValue value;
+    std::vector<CSpentIndexKey> vKeys(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        if (!outpoints[i].isObject())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
+        ParseSpentInfoKey(outpoints[i], vKeys[i]);
+    }
 
-    if (!GetSpentIndex(key, value)) {
+    std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapValues;
+    if (!GetSpentIndex(std::set<CSpentIndexKey, CSpentIndexKeyCompare>(vKeys.begin(), vKeys.end()), mapValues)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
     }
 
-    UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("txid", value.txid.GetHex()));
-    obj.push_back(Pair("index", (int)value.inputIndex));
-    obj.push_back(Pair("height", value.blockHeight));
-
-    return obj;
+    UniValue result(UniValue::VARR);
+    if (request.stream)
+        request.stream->BeginArray();
+    for (const CSpentIndexKey& key : vKeys) {
+        auto it = mapValues.find(key);
+        UniValue obj = it != mapValues.end() ? SpentInfoToJSON(it->second) : NullUniValue;
+        if (request.stream)
+            request.stream->Value(obj);
+        else
+            result.push_back(obj);
+    }
+    if (request.stream) {
+        request.stream->EndArray();
+        return NullUniValue;
+    }
+    return result;
 }
 
 static const CRPCCommand commands[] =
@@ -1353,6 +1534,9 @@ static const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getinfo",                &getinfo,                {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getlockstats",           &getlockstats,           {"mode"} },
+    { "control",            "gettracestats",          &gettracestats,          {"mode"} },
+    { "control",            "dumptrace",              &dumptrace,              {"filename"} },
     { "util",               "validateaddress",        &validateaddress,        {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"} },
     { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"} },
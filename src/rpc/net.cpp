@@ -89,6 +89,53 @@ UniValue ping(const JSONRPCRequest& request)
 //}
 
 
+static UniValue CompactBlockStatsToJSON(const CCompactBlockStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", stats.nBlocks));
+    obj.push_back(Pair("reconstructed", stats.nReconstructed));
+    obj.push_back(Pair("roundtrips", stats.nRoundTrips));
+    obj.push_back(Pair("shortid_collisions", stats.nShortIdCollisions));
+    obj.push_back(Pair("tx_prefilled", stats.nTxPrefilled));
+    obj.push_back(Pair("tx_mempool", stats.nTxFromMempool));
+    obj.push_back(Pair("tx_extra", stats.nTxFromExtra));
+    obj.push_back(Pair("tx_missing", stats.nTxMissing));
+    obj.push_back(Pair("avg_reconstruction_ms", stats.nReconstructed ? stats.nReconstructionMicros / 1000.0 / stats.nReconstructed : 0.0));
+    obj.push_back(Pair("staked_reconstructed", stats.nStakedReconstructed));
+    obj.push_back(Pair("avg_staked_reconstruction_ms", stats.nStakedReconstructed ? stats.nStakedReconstructionMicros / 1000.0 / stats.nStakedReconstructed : 0.0));
+    return obj;
+}
+
+static UniValue TxRelayStatsToJSON(const CTxRelayClassStats (&stats)[TX_RELAY_CLASSES])
+{
+    UniValue obj(UniValue::VOBJ);
+    for (int i = 0; i < TX_RELAY_CLASSES; i++) {
+        UniValue cls(UniValue::VOBJ);
+        cls.push_back(Pair("sent", stats[i].nSent));
+        cls.push_back(Pair("queued", stats[i].nQueued));
+        cls.push_back(Pair("ratelimited", stats[i].nRateLimited));
+        obj.push_back(Pair(GetTxRelayClassName((TxRelayClass)i), cls));
+    }
+    return obj;
+}
+
+static UniValue MessageCostToJSON(const CMessageCost& cost, bool fHistogram)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", cost.nMessages));
+    obj.push_back(Pair("time_ms", cost.nMicros / 1000.0));
+    obj.push_back(Pair("max_ms", cost.nMaxMicros / 1000.0));
+    obj.push_back(Pair("cs_main_ms", cost.nCsMainMicros / 1000.0));
+    obj.push_back(Pair("deserialize_ms", cost.nDeserializeMicros / 1000.0));
+    if (fHistogram) {
+        UniValue buckets(UniValue::VARR);
+        for (int i = 0; i < MSG_COST_BUCKETS; i++)
+            buckets.push_back(cost.vBuckets[i]);
+        obj.push_back(Pair("histogram", buckets));
+    }
+    return obj;
+}
+
 UniValue getpeerinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -125,6 +172,25 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"compactblocks\": {         (json object) Reconstruction of the compact blocks this peer sent us\n"
+            "       \"blocks\": n,            (numeric) Compact blocks received\n"
+            "       ...                       (see getcompactblockstats)\n"
+            "    },\n"
+            "    \"txrelay\": {               (json object) Transaction announcements to the peer by class\n"
+            "       \"payment\": {            (json object) Likewise for \"issue\", \"admin\" and \"transfer\"\n"
+            "          \"sent\": n,           (numeric) Transactions announced\n"
+            "          \"queued\": n,         (numeric) Transactions waiting to be announced after the last announcement\n"
+            "          \"ratelimited\": n     (numeric) Announcements that left transactions waiting for the class's -txrelaylimit\n"
+            "       },\n"
+            "       ...\n"
+            "    },\n"
+            "    \"msgcost_per_msg\": {       (json object) What handling the peer's messages took, by message type\n"
+            "       \"tx\": {                 (json object)\n"
+            "          \"count\": n,          (numeric) Messages handled\n"
+            "          ...                    (see getnetstats)\n"
+            "       },\n"
+            "       ...\n"
+            "    },\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -191,6 +257,12 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("compactblocks", CompactBlockStatsToJSON(statestats.compactBlockStats)));
+            obj.push_back(Pair("txrelay", TxRelayStatsToJSON(statestats.txRelayStats)));
+            UniValue costPerMsgCmd(UniValue::VOBJ);
+            for (const auto& cost : statestats.mapMessageCost)
+                costPerMsgCmd.push_back(Pair(cost.first, MessageCostToJSON(cost.second, false)));
+            obj.push_back(Pair("msgcost_per_msg", costPerMsgCmd));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -214,6 +286,163 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue TxReconciliationStatsToJSON(const CTxReconciliationStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("rounds", stats.nRounds));
+    obj.push_back(Pair("failures", stats.nFailures));
+    obj.push_back(Pair("tx_queued", stats.nTxQueued));
+    obj.push_back(Pair("tx_announced", stats.nTxAnnounced));
+    obj.push_back(Pair("bytes", stats.nBytes));
+    obj.push_back(Pair("bytes_saved", stats.GetBytesSaved()));
+    return obj;
+}
+
+UniValue getnetstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getnetstats\n"
+            "\nReturns what handling the messages of all peers took, by message type, peers that disconnected included.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"tx\": {                       (json object) Likewise for every message type received\n"
+            "    \"count\": n,                 (numeric) Messages handled\n"
+            "    \"time_ms\": x.xxx,           (numeric) Time handling them, deserializing and waiting for locks included\n"
+            "    \"max_ms\": x.xxx,            (numeric) Longest time handling one of them\n"
+            "    \"cs_main_ms\": x.xxx,        (numeric) Time cs_main was held while handling them\n"
+            "    \"deserialize_ms\": x.xxx,    (numeric) Time reading their payload (addr, inv, getdata, tx, block, headers, compact block messages and filterload only)\n"
+            "    \"histogram\": [              (json array) Messages handled in under 10us, 100us, 1ms, 10ms, 100ms, 1s, and longer\n"
+            "      n,\n"
+            "      ...\n"
+            "    ]\n"
+            "  },\n"
+            "  ...\n"
+            "  \"txreconciliation\": {        (json object) Set reconciliation of transaction announcements (-txreconciliation), disconnected peers included\n"
+            "    \"rounds\": n,                (numeric) Reconciliation rounds finished\n"
+            "    \"failures\": n,              (numeric) Rounds whose sketch didn't decode, which announced the whole sets\n"
+            "    \"tx_queued\": n,             (numeric) Transactions reconciled instead of announced by inv\n"
+            "    \"tx_announced\": n,          (numeric) Invs sent once reconciliation found the peer lacked them\n"
+            "    \"bytes\": n,                 (numeric) Payload of the reconciliation messages sent and received\n"
+            "    \"bytes_saved\": n,           (numeric) What invs for the queued transactions would have taken, less the invs and messages reconciling took\n"
+            "    \"peers\": [                  (json array) Likewise for each connected peer that reconciles\n"
+            "      {\n"
+            "        \"id\": n,                (numeric) Peer index\n"
+            "        ...\n"
+            "      }\n"
+            "      ,...\n"
+            "    ]\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetstats", "")
+            + HelpExampleRpc("getnetstats", "")
+        );
+
+    mapMsgCmdCost mapCosts;
+    GetMessageCosts(mapCosts);
+
+    UniValue obj(UniValue::VOBJ);
+    for (const auto& cost : mapCosts)
+        obj.push_back(Pair(cost.first, MessageCostToJSON(cost.second, true)));
+
+    CTxReconciliationStats reconStats;
+    std::vector<std::pair<NodeId, CTxReconciliationStats>> vPeerReconStats;
+    GetTxReconciliationStats(reconStats, vPeerReconStats);
+    UniValue recon = TxReconciliationStatsToJSON(reconStats);
+    UniValue peers(UniValue::VARR);
+    for (const auto& peer : vPeerReconStats) {
+        UniValue peerObj(UniValue::VOBJ);
+        peerObj.push_back(Pair("id", peer.first));
+        peerObj.pushKVs(TxReconciliationStatsToJSON(peer.second));
+        peers.push_back(peerObj);
+    }
+    recon.push_back(Pair("peers", peers));
+    obj.push_back(Pair("txreconciliation", recon));
+    return obj;
+}
+
+UniValue getsyncstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getsyncstats\n"
+            "\nReturns how blocks are being downloaded, and what each peer downloading them contributes.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": n,                 (numeric) The current number of blocks processed in the server\n"
+            "  \"headers\": n,                (numeric) The current number of headers we have validated\n"
+            "  \"inflight\": n,               (numeric) Blocks requested and not yet received\n"
+            "  \"highest_inflight\": n,       (numeric) Height of the highest block requested, or -1\n"
+            "  \"window_used\": n,            (numeric) How far beyond the tip blocks are being requested\n"
+            "  \"peers_downloading\": n,      (numeric) Peers with blocks of validated headers in flight\n"
+            "  \"stalls\": n,                 (numeric) Times a peer stalled the download window\n"
+            "  \"reassigned\": n,             (numeric) Blocks given to other peers for it\n"
+            "  \"peers\": [                   (json array) The peers that have sent or have blocks in flight\n"
+            "    {\n"
+            "      \"id\": n,                 (numeric) Peer index\n"
+            "      \"inflight\": n,           (numeric) Blocks in flight from the peer\n"
+            "      \"inflight_limit\": n,     (numeric) Blocks the peer may have in flight, adapted to its throughput and latency\n"
+            "      \"window\": n,             (numeric) How far beyond its last block in common with us the peer is asked for blocks\n"
+            "      \"received\": n,           (numeric) Requested blocks received from the peer\n"
+            "      \"share\": x.xxx,          (numeric) Fraction of all the requested blocks received that came from the peer\n"
+            "      \"avg_latency_ms\": x.xxx, (numeric) Average time from request to receipt of a block\n"
+            "      \"min_latency_ms\": x.xxx, (numeric) Least time from request to receipt of a block\n"
+            "      \"blocks_per_sec\": x.xxx, (numeric) Blocks received per second while more were in flight\n"
+            "      \"stalls\": n,             (numeric) Times the peer stalled the download window\n"
+            "      \"reassigned\": n          (numeric) Blocks given to other peers for it\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsyncstats", "")
+            + HelpExampleRpc("getsyncstats", "")
+        );
+
+    CBlockDownloadStats stats;
+    GetBlockDownloadStats(stats);
+    int nHeight;
+    int nHeaders;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+        nHeaders = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+    }
+
+    uint64_t nReceived = 0;
+    for (const CBlockDownloadPeerStats& peer : stats.vPeers)
+        nReceived += peer.nBlocksReceived;
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", nHeight));
+    obj.push_back(Pair("headers", nHeaders));
+    obj.push_back(Pair("inflight", stats.nBlocksInFlight));
+    obj.push_back(Pair("highest_inflight", stats.nHighestInFlight));
+    obj.push_back(Pair("window_used", std::max(0, stats.nHighestInFlight - nHeight)));
+    obj.push_back(Pair("peers_downloading", stats.nPeersDownloading));
+    obj.push_back(Pair("stalls", stats.nStalls));
+    obj.push_back(Pair("reassigned", stats.nBlocksReassigned));
+    UniValue peers(UniValue::VARR);
+    for (const CBlockDownloadPeerStats& peer : stats.vPeers) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("id", peer.nodeid));
+        entry.push_back(Pair("inflight", peer.nBlocksInFlight));
+        entry.push_back(Pair("inflight_limit", peer.nBlockRequestLimit));
+        entry.push_back(Pair("window", peer.nWindow));
+        entry.push_back(Pair("received", peer.nBlocksReceived));
+        entry.push_back(Pair("share", nReceived ? (double)peer.nBlocksReceived / nReceived : 0.0));
+        entry.push_back(Pair("avg_latency_ms", peer.nLatencyAvgMicros / 1000.0));
+        entry.push_back(Pair("min_latency_ms", peer.nLatencyMinMicros / 1000.0));
+        entry.push_back(Pair("blocks_per_sec", peer.nIntervalAvgMicros ? 1000000.0 / peer.nIntervalAvgMicros : 0.0));
+        entry.push_back(Pair("stalls", peer.nStalls));
+        entry.push_back(Pair("reassigned", peer.nBlocksReassigned));
+        peers.push_back(entry);
+    }
+    obj.push_back(Pair("peers", peers));
+    return obj;
+}
+
 UniValue addnode(const JSONRPCRequest& request)
 {
     std::string strCommand;
@@ -371,6 +600,43 @@ UniValue getaddednodeinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getcompactblockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getcompactblockstats\n"
+            "\nReturns how the compact blocks received from all peers were reconstructed.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": n,                 (numeric) Compact blocks received\n"
+            "  \"reconstructed\": n,          (numeric) Blocks reconstructed from their compact form\n"
+            "  \"roundtrips\": n,             (numeric) Blocks that needed a getblocktxn round trip\n"
+            "  \"shortid_collisions\": n,     (numeric) Blocks dropped for colliding short ids, downloaded in full instead\n"
+            "  \"tx_prefilled\": n,           (numeric) Transactions prefilled by the sender\n"
+            "  \"tx_mempool\": n,             (numeric) Transactions found in the mempool\n"
+            "  \"tx_extra\": n,               (numeric) Transactions found in the extra transaction pool\n"
+            "  \"tx_missing\": n,             (numeric) Transactions that had to be requested\n"
+            "  \"avg_reconstruction_ms\": n,  (numeric) Average time from receiving a compact block to its reconstruction\n"
+            "  \"staked_reconstructed\": n,   (numeric) Proof-of-stake blocks among the reconstructed ones\n"
+            "  \"avg_staked_reconstruction_ms\": n, (numeric) Average reconstruction time of the proof-of-stake blocks\n"
+            "  \"extratxn_size\": n,          (numeric) Transactions in the extra transaction pool\n"
+            "  \"extratxn_capacity\": n       (numeric) Capacity of the extra transaction pool\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcompactblockstats", "")
+            + HelpExampleRpc("getcompactblockstats", "")
+        );
+
+    CCompactBlockStats stats;
+    size_t nExtraTxn, nExtraTxnCapacity;
+    GetCompactBlockStats(stats, nExtraTxn, nExtraTxnCapacity);
+
+    UniValue obj = CompactBlockStatsToJSON(stats);
+    obj.push_back(Pair("extratxn_size", (uint64_t)nExtraTxn));
+    obj.push_back(Pair("extratxn_capacity", (uint64_t)nExtraTxnCapacity));
+    return obj;
+}
+
 UniValue getnettotals(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 0)
@@ -654,6 +920,9 @@ static const CRPCCommand commands[] =
     { "network",            "getconnectioncount",     &getconnectioncount,     {} },
     { "network",            "ping",                   &ping,                   {} },
     { "network",            "getpeerinfo",            &getpeerinfo,            {} },
+    { "network",            "getcompactblockstats",   &getcompactblockstats,   {} },
+    { "network",            "getsyncstats",           &getsyncstats,           {} },
+    { "network",            "getnetstats",            &getnetstats,            {} },
     { "network",            "addnode",                &addnode,                {"node","command"} },
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
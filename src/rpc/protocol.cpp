@@ -9,6 +9,7 @@
 #include "random.h"
 #include "tinyformat.h"
 #include "util.h"
+#include "utilmoneystr.h"
 #include "utilstrencodings.h"
 #include "utiltime.h"
 #include "version.h"
@@ -155,3 +156,102 @@ std::vector<UniValue> JSONRPCProcessBatchReply(const UniValue &in, size_t num)
     }
     return batch;
 }
+
+JSONStreamWriter::JSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn) :
+    sink(sinkIn), nChunkSize(nChunkSizeIn), fAfterKey(false), fStarted(false), fOpen(true)
+{
+}
+
+void JSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vNeedSeparator.empty()) {
+        if (vNeedSeparator.back())
+            strBuffer += ',';
+        vNeedSeparator.back() = true;
+    }
+}
+
+void JSONStreamWriter::Append(const std::string& str)
+{
+    fStarted = true;
+    strBuffer += str;
+    if (strBuffer.size() >= nChunkSize)
+        Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    vNeedSeparator.push_back(false);
+    Append("{");
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vNeedSeparator.empty() && !fAfterKey);
+    vNeedSeparator.pop_back();
+    Append("}");
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    vNeedSeparator.push_back(false);
+    Append("[");
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vNeedSeparator.empty() && !fAfterKey);
+    vNeedSeparator.pop_back();
+    Append("]");
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vNeedSeparator.empty() && !fAfterKey);
+    Separate();
+    Append(UniValue(key).write() + ":");
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    Append(value.write());
+}
+
+void JSONStreamWriter::RawValue(const std::string& json)
+{
+    Separate();
+    Append(json);
+}
+
+void JSONStreamWriter::KeyValue(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    Value(value);
+}
+
+void JSONStreamWriter::KeyAmount(const std::string& key, const CAmount& amount, int nDecimals)
+{
+    Key(key);
+    Separate();
+    fStarted = true;
+    AppendAmount(strBuffer, amount, nDecimals);
+    if (strBuffer.size() >= nChunkSize)
+        Flush();
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    if (fOpen)
+        fOpen = sink(strBuffer);
+    strBuffer.clear();
+}
@@ -7,12 +7,15 @@
 #ifndef PLB_RPCPROTOCOL_H
 #define PLB_RPCPROTOCOL_H
 
+#include "amount.h"
 #include "fs.h"
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <univalue.h>
 
@@ -102,4 +105,54 @@ void DeleteAuthCookie();
 /** Parse JSON-RPC batch reply into a vector */
 std::vector<UniValue> JSONRPCProcessBatchReply(const UniValue &in, size_t num);
 
+static const size_t DEFAULT_JSON_STREAM_CHUNK = 64 * 1024;
+
+/**
+ * Writes one JSON value piece by piece, so large results don't have to be built as a
+ * UniValue tree and written into a single string first. Output is buffered and handed
+ * to the sink in pieces of about nChunkSize bytes. The sink returns false once the
+ * output can no longer be delivered, after which everything written is dropped.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<bool(const std::string&)> Sink;
+
+    explicit JSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn = DEFAULT_JSON_STREAM_CHUNK);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! Key of the next value, only inside an object
+    void Key(const std::string& key);
+    //! A complete value, either an array element or the value of the last Key
+    void Value(const UniValue& value);
+    //! A complete value that is already serialized JSON
+    void RawValue(const std::string& json);
+    void KeyValue(const std::string& key, const UniValue& value);
+    //! A key and an amount with nDecimals decimals, formatted straight into the buffer
+    void KeyAmount(const std::string& key, const CAmount& amount, int nDecimals);
+
+    //! Hand everything buffered to the sink
+    void Flush();
+    //! Whether anything has been written
+    bool Started() const { return fStarted; }
+    //! False once the sink stopped accepting output
+    bool IsOpen() const { return fOpen; }
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+    //! One entry per open object or array, whether the next element needs a separator
+    std::vector<bool> vNeedSeparator;
+    bool fAfterKey;
+    bool fStarted;
+    bool fOpen;
+
+    void Separate();
+    void Append(const std::string& str);
+};
+
 #endif // PLB_RPCPROTOCOL_H
@@ -7,8 +7,10 @@
 #include "base58.h"
 #include "chain.h"
 #include "coins.h"
+#include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "hash.h"
 #include "init.h"
 #include "keystore.h"
 #include "validation.h"
@@ -38,62 +40,83 @@
 #include <tinyformat.h>
 #include <timedata.h>
 
-void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, bool expanded = false)
+// Add the input values and addresses the spent index has, and the output values in satoshis. These don't change
+// while the transaction stays in the mempool or block it is in.
+static void ExpandTxJSON(const CTransaction& tx, UniValue& entry)
 {
-    // Call into TxToUniv() in paladeum-common to decode the transaction hex.
-    //
-    // Blockchain contextual information (confirmations and blocktime) is not
-    // available to code in paladeum-common, so we query them here and push the
-    // data into the returned UniValue.
-    TxToUniv(tx, uint256(), entry, true, RPCSerializationFlags());
-
-    if (expanded) {
-        uint256 txid = tx.GetHash();
-        if (!(tx.IsCoinBase())) {
-            const UniValue& oldVin = entry["vin"];
-            UniValue newVin(UniValue::VARR);
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                const CTxIn& txin = tx.vin[i];
-                UniValue in = oldVin[i];
-
-                // Add address and value info if spentindex enabled
-                CSpentIndexValue spentInfo;
-                CSpentIndexKey spentKey(txin.prevout.hash, txin.prevout.n);
-                if (GetSpentIndex(spentKey, spentInfo)) {
-                    in.pushKV("value", ValueFromAmount(spentInfo.satoshis));
-                    in.pushKV("valueSat", spentInfo.satoshis);
-                    if (spentInfo.addressType == 1) {
-                        in.pushKV("address", CPaladeumAddress(CKeyID(spentInfo.addressHash)).ToString());
-                    } else if (spentInfo.addressType == 2) {
-                        in.pushKV("address", CPaladeumAddress(CScriptID(spentInfo.addressHash)).ToString());
-                    }
+    if (!(tx.IsCoinBase())) {
+        const UniValue& oldVin = entry["vin"];
+        UniValue newVin(UniValue::VARR);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const CTxIn& txin = tx.vin[i];
+            UniValue in = oldVin[i];
+
+            // Add address and value info if spentindex enabled
+            CSpentIndexValue spentInfo;
+            CSpentIndexKey spentKey(txin.prevout.hash, txin.prevout.n);
+            if (GetSpentIndex(spentKey, spentInfo)) {
+                in.pushKV("value", ValueFromAmount(spentInfo.satoshis));
+                in.pushKV("valueSat", spentInfo.satoshis);
+                if (spentInfo.addressType == 1) {
+                    in.pushKV("address", CPaladeumAddress(CKeyID(spentInfo.addressHash)).ToString());
+                } else if (spentInfo.addressType == 2) {
+                    in.pushKV("address", CPaladeumAddress(CScriptID(spentInfo.addressHash)).ToString());
                 }
-                newVin.push_back(in);
             }
-            entry.pushKV("vin", newVin);
+            newVin.push_back(in);
         }
+        entry.pushKV("vin", newVin);
+    }
 
-        const UniValue& oldVout = entry["vout"];
-        UniValue newVout(UniValue::VARR);
-        for (unsigned int i = 0; i < tx.vout.size(); i++) {
-            const CTxOut& txout = tx.vout[i];
-            UniValue out = oldVout[i];
+    const UniValue& oldVout = entry["vout"];
+    UniValue newVout(UniValue::VARR);
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        UniValue out = oldVout[i];
+        out.pushKV("valueSat", tx.vout[i].nValue);
+        newVout.push_back(out);
+    }
+    entry.pushKV("vout", newVout);
+}
 
-            // Add spent information if spentindex is enabled
-            CSpentIndexValue spentInfo;
-            CSpentIndexKey spentKey(txid, i);
-            if (GetSpentIndex(spentKey, spentInfo)) {
-                out.pushKV("spentTxId", spentInfo.txid.GetHex());
-                out.pushKV("spentIndex", (int)spentInfo.inputIndex);
-                out.pushKV("spentHeight", spentInfo.blockHeight);
-            }
+// Where the outputs of txid are spent, by output index, if spentindex is enabled
+static void GetOutputSpends(const uint256& txid, uint32_t nOutputs, std::map<uint32_t, CSpentIndexValue>& spends)
+{
+    if (!fSpentIndex)
+        return;
+
+    std::set<CSpentIndexKey, CSpentIndexKeyCompare> keys;
+    for (uint32_t i = 0; i < nOutputs; i++)
+        keys.insert(keys.end(), CSpentIndexKey(txid, i));
+    std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> values;
+    GetSpentIndex(keys, values);
+    for (const auto& value : values)
+        spends.emplace(value.first.outputIndex, value.second);
+}
 
-            out.pushKV("valueSat", txout.nValue);
-            newVout.push_back(out);
+// Add the spent information to the outputs of an expanded entry
+static void AddOutputSpendsJSON(const std::map<uint32_t, CSpentIndexValue>& spends, UniValue& entry)
+{
+    if (spends.empty())
+        return;
+
+    const UniValue& oldVout = entry["vout"];
+    UniValue newVout(UniValue::VARR);
+    for (unsigned int i = 0; i < oldVout.size(); i++) {
+        UniValue out = oldVout[i];
+        auto it = spends.find(i);
+        if (it != spends.end()) {
+            out.pushKV("spentTxId", it->second.txid.GetHex());
+            out.pushKV("spentIndex", (int)it->second.inputIndex);
+            out.pushKV("spentHeight", it->second.blockHeight);
         }
-        entry.pushKV("vout", newVout);
+        newVout.push_back(out);
     }
+    entry.pushKV("vout", newVout);
+}
 
+// Add where the block the transaction is in stands in the chain
+static void BlockContextToJSON(const uint256& hashBlock, UniValue& entry)
+{
     if (!hashBlock.IsNull()) {
         entry.pushKV("blockhash", hashBlock.GetHex());
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
@@ -112,6 +135,106 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry,
     }
 }
 
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, bool expanded = false)
+{
+    // Call into TxToUniv() in paladeum-common to decode the transaction hex.
+    //
+    // Blockchain contextual information (confirmations and blocktime) is not
+    // available to code in paladeum-common, so we query them here and push the
+    // data into the returned UniValue.
+    TxToUniv(tx, uint256(), entry, true, RPCSerializationFlags());
+
+    if (expanded) {
+        ExpandTxJSON(tx, entry);
+        std::map<uint32_t, CSpentIndexValue> spends;
+        GetOutputSpends(tx.GetHash(), tx.vout.size(), spends);
+        AddOutputSpendsJSON(spends, entry);
+    }
+
+    BlockContextToJSON(hashBlock, entry);
+}
+
+/**
+ * A transaction result of getrawtransaction or decoderawtransaction: the hex, or the serialized JSON without what
+ * changes while the transaction stays where it is, which is where its outputs are spent and its confirmations.
+ * Shared by the RPC threads; hashBlock is where the transaction was read from, the entry is used only while it is
+ * still there, so a reorg or the transaction leaving the mempool invalidates it.
+ */
+struct CTxResultCacheEntry
+{
+    uint256 hashBlock;
+    uint32_t nOutputs;
+    std::shared_ptr<const std::string> result;
+
+    CTxResultCacheEntry() : nOutputs(0) {}
+};
+
+static const char TX_RESULT_HEX = 'h';
+static const char TX_RESULT_VERBOSE = 'v';
+static const char TX_RESULT_DECODED = 'd';
+
+static CShardedLRUCache<std::string, CTxResultCacheEntry>& TxResultCache()
+{
+    static CShardedLRUCache<std::string, CTxResultCacheEntry> cache(std::max<int64_t>(0, gArgs.GetArg("-rpctxcache", DEFAULT_RPC_TX_CACHE)));
+    return cache;
+}
+
+static std::string TxResultKey(char kind, const uint256& hash)
+{
+    std::string key(1, kind);
+    key.append(hash.begin(), hash.end());
+    return key;
+}
+
+// The cached result of the transaction, if it is still in the mempool or block it was read from. GetTransaction
+// looks in the mempool first, and finds a transaction in the block the transaction index has for it.
+static bool LookupTxResult(char kind, const uint256& txid, CTxResultCacheEntry& entry)
+{
+    AssertLockHeld(cs_main);
+    if (!TxResultCache().Lookup(TxResultKey(kind, txid), entry))
+        return false;
+
+    if (entry.hashBlock.IsNull())
+        return mempool.exists(txid);
+    if (mempool.exists(txid))
+        return false;
+    BlockMap::iterator mi = mapBlockIndex.find(entry.hashBlock);
+    return mi != mapBlockIndex.end() && chainActive.Contains(mi->second);
+}
+
+// Complete a cached result with the spent information and block context of now. A streamed reply without spent
+// outputs is copied out as it is serialized.
+static UniValue CachedTxResultToJSON(const JSONRPCRequest& request, const uint256& txid, const CTxResultCacheEntry& entry)
+{
+    std::map<uint32_t, CSpentIndexValue> spends;
+    GetOutputSpends(txid, entry.nOutputs, spends);
+
+    if (request.stream && spends.empty()) {
+        UniValue context(UniValue::VOBJ);
+        BlockContextToJSON(entry.hashBlock, context);
+        if (context.empty()) {
+            request.stream->RawValue(*entry.result);
+        } else {
+            // Both are objects, the members of the context go before the closing brace of the result
+            std::string strContext = context.write();
+            std::string strResult;
+            strResult.reserve(entry.result->size() + strContext.size());
+            strResult.append(*entry.result, 0, entry.result->size() - 1);
+            strResult += ',';
+            strResult.append(strContext, 1, std::string::npos);
+            request.stream->RawValue(strResult);
+        }
+        return NullUniValue;
+    }
+
+    UniValue result;
+    if (!result.read(*entry.result))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Cached transaction result is not valid JSON");
+    AddOutputSpendsJSON(spends, result);
+    BlockContextToJSON(entry.hashBlock, result);
+    return result;
+}
+
 UniValue getrawtransaction(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -206,21 +329,34 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
         }
     }
 
-    CTransactionRef tx;
+    char kind = fVerbose ? TX_RESULT_VERBOSE : TX_RESULT_HEX;
+    CTxResultCacheEntry cached;
+    if (!LookupTxResult(kind, hash, cached)) {
+        CTransactionRef tx;
 
-    uint256 hashBlock;
-    if (!GetTransaction(hash, tx, GetParams().GetConsensus(), hashBlock, true))
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string(fTxIndex ? "No such mempool or blockchain transaction"
-            : "No such mempool transaction. Use -txindex to enable blockchain transaction queries") +
-            ". Use gettransaction for wallet transactions.");
+        uint256 hashBlock;
+        if (!GetTransaction(hash, tx, GetParams().GetConsensus(), hashBlock, true))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string(fTxIndex ? "No such mempool or blockchain transaction"
+                : "No such mempool transaction. Use -txindex to enable blockchain transaction queries") +
+                ". Use gettransaction for wallet transactions.");
+
+        cached.hashBlock = hashBlock;
+        cached.nOutputs = tx->vout.size();
+        if (fVerbose) {
+            UniValue result(UniValue::VOBJ);
+            TxToUniv(*tx, uint256(), result, true, RPCSerializationFlags());
+            ExpandTxJSON(*tx, result);
+            cached.result = std::make_shared<const std::string>(result.write());
+        } else {
+            cached.result = std::make_shared<const std::string>(EncodeHexTx(*tx, RPCSerializationFlags()));
+        }
+        TxResultCache().Put(TxResultKey(kind, hash), cached);
+    }
 
     if (!fVerbose)
-        return EncodeHexTx(*tx, RPCSerializationFlags());
-
-    UniValue result(UniValue::VOBJ);
-    TxToJSON(*tx, hashBlock, result, true);
+        return *cached.result;
 
-    return result;
+    return CachedTxResultToJSON(request, hash, cached);
 }
 
 UniValue gettxoutproof(const JSONRPCRequest& request)
@@ -1573,14 +1709,32 @@ UniValue decoderawtransaction(const JSONRPCRequest& request)
     LOCK(cs_main);
     RPCTypeCheck(request.params, {UniValue::VSTR});
 
-    CMutableTransaction mtx;
+    // The decoding only depends on the hex, which is what the result is cached by
+    const std::string& strHex = request.params[0].get_str();
+    std::string key = TxResultKey(TX_RESULT_DECODED, Hash(strHex.begin(), strHex.end()));
+    CTxResultCacheEntry cached;
+    if (!TxResultCache().Lookup(key, cached)) {
+        CMutableTransaction mtx;
 
-    if (!DecodeHexTx(mtx, request.params[0].get_str(), true))
-        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed");
+        if (!DecodeHexTx(mtx, strHex, true))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed");
 
-    UniValue result(UniValue::VOBJ);
-    TxToUniv(CTransaction(std::move(mtx)), uint256(), result, false);
+        UniValue result(UniValue::VOBJ);
+        TxToUniv(CTransaction(std::move(mtx)), uint256(), result, false);
+        cached.result = std::make_shared<const std::string>(result.write());
+        TxResultCache().Put(key, cached);
+
+        return result;
+    }
+
+    if (request.stream) {
+        request.stream->RawValue(*cached.result);
+        return NullUniValue;
+    }
 
+    UniValue result;
+    if (!result.read(*cached.result))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Cached transaction result is not valid JSON");
     return result;
 }
 
@@ -2151,6 +2305,109 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue submitrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "submitrawtransactions [\"rawtxs\"] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The batch is checked under one lock, and each transaction after any of the batch it spends from,\n"
+            "so the transactions may be given in any order.\n"
+            "\nSee sendrawtransaction call.\n"
+            "\nArguments:\n"
+            "1. [\"rawtxs\"]       (array, required) An array of hex strings of raw transactions.\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array) The result for each raw transaction in the input array, in the same order.\n"
+            " {\n"
+            "  \"txid\"           (string) The transaction hash in hex\n"
+            "  \"accepted\"       (boolean) If the transaction is in the mempool after the call\n"
+            "  \"reject-reason\"  (string) Rejection string (only present when 'accepted' is false)\n"
+            " }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("submitrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("submitrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    ObserveSafeMode();
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& rawtxs = request.params[0].get_array();
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(rawtxs.size());
+    for (size_t i = 0; i < rawtxs.size(); i++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Transactions already in the mempool count as accepted and are relayed again, like sendrawtransaction does
+    std::vector<bool> vKnown(vtx.size(), false);
+    std::vector<CTransactionRef> vtxSubmit;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const uint256& hashTx = vtx[i]->GetHash();
+            bool fHaveChain = false;
+            for (size_t o = 0; !fHaveChain && o < vtx[i]->vout.size(); o++)
+                fHaveChain = !view.AccessCoin(COutPoint(hashTx, o)).IsSpent();
+            if (fHaveChain)
+                throw JSONRPCError(RPC_TRANSACTION_ALREADY_IN_CHAIN, strprintf("transaction %s already in block chain", hashTx.GetHex()));
+            vKnown[i] = mempool.exists(hashTx);
+            if (!vKnown[i])
+                vtxSubmit.push_back(vtx[i]);
+        }
+    }
+
+    std::vector<CValidationState> states;
+    std::vector<bool> vMissingInputs;
+    AcceptToMemoryPoolBatch(mempool, states, vtxSubmit, vMissingInputs, false /* bypass_limits */, nMaxRawTxFee);
+
+    if (!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0, nSubmit = 0; i < vtx.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        const uint256& hashTx = vtx[i]->GetHash();
+        entry.pushKV("txid", hashTx.GetHex());
+
+        bool fAccepted = vKnown[i];
+        if (!vKnown[i]) {
+            const CValidationState& state = states[nSubmit];
+            fAccepted = state.IsValid();
+            if (!fAccepted) {
+                if (state.IsInvalid())
+                    entry.pushKV("reject-reason", strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason()));
+                else if (vMissingInputs[nSubmit])
+                    entry.pushKV("reject-reason", "missing-inputs");
+                else
+                    entry.pushKV("reject-reason", state.GetRejectReason());
+            }
+            nSubmit++;
+        }
+        entry.pushKV("accepted", fAccepted);
+
+        if (fAccepted) {
+            CInv inv(MSG_TX, hashTx);
+            g_connman->ForEachNode([&inv](CNode* pnode)
+            {
+                pnode->PushInventory(inv);
+            });
+        }
+        result.push_back(entry);
+    }
+    return result;
+}
+
 UniValue testmempoolaccept(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
@@ -2232,6 +2489,72 @@ UniValue testmempoolaccept(const JSONRPCRequest& request)
     return result;
 }
 
+UniValue checkrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+                // clang-format off
+                "checkrawtransactions [\"rawtxs\"]\n"
+                "\nRuns the checks that don't depend on the chain or the mempool on many raw transactions (serialized,\n"
+                "hex-encoded) side by side: structure and amounts, and the decoding of every token script with its\n"
+                "name, amount, units and verifier string syntax. Inputs, signatures and token ownership aren't checked.\n"
+                "\nArguments:\n"
+                "1. [\"rawtxs\"]       (array, required) An array of hex strings of raw transactions.\n"
+                "\nResult:\n"
+                "[                   (array) The result of the checks for each raw transaction in the input array.\n"
+                " {\n"
+                "  \"txid\"           (string) The transaction hash in hex (only present when the transaction decodes)\n"
+                "  \"valid\"          (boolean) If the transaction passes the checks\n"
+                "  \"reject-reason\"  (string) Rejection string (only present when 'valid' is false)\n"
+                " }\n"
+                "]\n"
+                "\nExamples:\n"
+                + HelpExampleCli("checkrawtransactions", "\"[\\\"signedhex\\\"]\"")
+                + HelpExampleRpc("checkrawtransactions", "[\"signedhex\"]")
+                // clang-format on
+        );
+    }
+
+    RPCTypeCheck(request.params, {UniValue::VARR});
+    const UniValue& rawtxs = request.params[0].get_array();
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<size_t> vIndex;
+    for (size_t i = 0; i < rawtxs.size(); i++) {
+        CMutableTransaction mtx;
+        if (rawtxs[i].isStr() && DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            vtx.push_back(MakeTransactionRef(std::move(mtx)));
+            vIndex.push_back(i);
+        }
+    }
+
+    std::vector<CValidationState> vState;
+    {
+        // The offline staking check reads the best header
+        LOCK(cs_main);
+        CheckTransactions(vtx, vState, GetNumCores(), true);
+    }
+
+    std::vector<UniValue> vResults(rawtxs.size(), UniValue(UniValue::VOBJ));
+    for (size_t i = 0; i < rawtxs.size(); i++) {
+        vResults[i].pushKV("valid", false);
+        vResults[i].pushKV("reject-reason", "TX decode failed");
+    }
+    for (size_t k = 0; k < vtx.size(); k++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", vtx[k]->GetHash().GetHex());
+        entry.pushKV("valid", vState[k].IsValid());
+        if (!vState[k].IsValid())
+            entry.pushKV("reject-reason", strprintf("%i: %s", vState[k].GetRejectCode(), vState[k].GetRejectReason()));
+        vResults[vIndex[k]] = std::move(entry);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (UniValue& entry : vResults)
+        result.push_back(std::move(entry));
+    return result;
+}
+
 UniValue decoderawblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -2271,6 +2594,8 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
     { "rawtransactions",    "testmempoolaccept",      &testmempoolaccept,      {"rawtxs","allowhighfees"} },
+    { "rawtransactions",    "checkrawtransactions",   &checkrawtransactions,   {"rawtxs"} },
+    { "rawtransactions",    "submitrawtransactions",  &submitrawtransactions,  {"rawtxs","allowhighfees"} },
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          {"txids", "blockhash"} },
     { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       {"proof"} },
 };
@@ -69,6 +69,13 @@
 //    }
 //};
 
+/** Height of the published tip, -1 before a chain is loaded */
+static int GetTipHeight(const JSONRPCRequest& request)
+{
+    std::shared_ptr<const CChainTipState> tip = GetRequestChainTip(request);
+    return tip ? tip->nHeight : -1;
+}
+
 UniValue requestsnapshot(const JSONRPCRequest& request) {
     if (request.fHelp || request.params.size() < 2)
         throw std::runtime_error(
@@ -112,7 +119,7 @@ UniValue requestsnapshot(const JSONRPCRequest& request) {
     if (!currentActiveTokenCache->GetTokenMetaDataIfExists(token_name, token))
         throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid token_name: token does not exist."));
 
-    if (block_height <= chainActive.Height()) {
+    if (block_height <= GetTipHeight(request)) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid block_height: block height should be greater than current active chain height"));
     }
 
@@ -131,6 +138,30 @@ UniValue requestsnapshot(const JSONRPCRequest& request) {
     throw JSONRPCError(RPC_MISC_ERROR, std::string("Failed to add requested snapshot to database"));
 }
 
+//  Where the ownership snapshot of a token at a height is: "pending" until the height connects, then "queued" and
+//      "writing" while the background worker materializes it, and "complete" once it can be read (or "missing")
+static std::string GetSnapshotStatus(const std::string& token_name, int height, size_t& owners_written)
+{
+    owners_written = 0;
+    std::shared_ptr<const CChainTipState> tip = GetChainTipState();
+    if (!tip || height > tip->nHeight)
+        return "pending";
+
+    CTokenSnapshotProgress progress;
+    if (GetTokenSnapshotProgress(token_name, height, progress)) {
+        owners_written = progress.owners;
+        switch (progress.state) {
+            case CTokenSnapshotProgress::QUEUED: return "queued";
+            case CTokenSnapshotProgress::WRITING: return "writing";
+            case CTokenSnapshotProgress::FAILED: return "failed";
+        }
+    }
+
+    if (pTokenSnapshotDb && pTokenSnapshotDb->HasOwnershipSnapshot(token_name, height))
+        return "complete";
+    return "missing";
+}
+
 UniValue getsnapshotrequest(const JSONRPCRequest& request) {
     if (request.fHelp || request.params.size() < 2)
         throw std::runtime_error(
@@ -145,6 +176,8 @@ UniValue getsnapshotrequest(const JSONRPCRequest& request) {
                 "{\n"
                 "  token_name: (string),\n"
                 "  block_height: (number),\n"
+                "  snapshot_status: (string), pending, queued, writing, complete, failed or missing\n"
+                "  owners_written: (number), the owners written so far while the snapshot is queued or writing\n"
                 "}\n"
 
                 "\nExamples:\n"
@@ -172,6 +205,12 @@ UniValue getsnapshotrequest(const JSONRPCRequest& request) {
         obj.push_back(Pair("token_name", snapshotRequest.tokenName));
         obj.push_back(Pair("block_height", snapshotRequest.heightForSnapshot));
 
+        size_t owners_written;
+        std::string status = GetSnapshotStatus(snapshotRequest.tokenName, snapshotRequest.heightForSnapshot, owners_written);
+        obj.push_back(Pair("snapshot_status", status));
+        if (status == "queued" || status == "writing")
+            obj.push_back(Pair("owners_written", (uint64_t)owners_written));
+
         return obj;
     }
     else {
@@ -222,11 +261,20 @@ UniValue listsnapshotrequests(const JSONRPCRequest& request) {
     UniValue result(UniValue::VARR);
     std::set<CSnapshotRequestDBEntry> entries;
     if (pSnapshotRequestDb->RetrieveSnapshotRequestsForHeight(token_name, block_height, entries)) {
+        if (request.stream)
+            request.stream->BeginArray();
         for (auto const &entry : entries) {
             UniValue item(UniValue::VOBJ);
             item.push_back(Pair("token_name", entry.tokenName));
             item.push_back(Pair("block_height", entry.heightForSnapshot));
-            result.push_back(item);
+            if (request.stream)
+                request.stream->Value(item);
+            else
+                result.push_back(item);
+        }
+        if (request.stream) {
+            request.stream->EndArray();
+            return NullUniValue;
         }
         return result;
     }
@@ -374,7 +422,8 @@ UniValue distributereward(const JSONRPCRequest& request) {
     if (ownershipKnownTokenType == KnownTokenType::UNIQUE || ownershipKnownTokenType == KnownTokenType::OWNER || ownershipKnownTokenType == KnownTokenType::MSGCHANNEL)
         throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid token_name: OWNER, UNQIUE, MSGCHANNEL tokens are not allowed for this call"));
 
-    if (snapshot_height > chainActive.Height()) {
+    const int nTipHeight = GetTipHeight(request);
+    if (snapshot_height > nTipHeight) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid snapshot_height: block height should be less than or equal to the current active chain height"));
     }
 
@@ -390,7 +439,7 @@ UniValue distributereward(const JSONRPCRequest& request) {
             throw JSONRPCError(RPC_INVALID_REQUEST, std::string("Wallet doesn't have the ownership token(!) for the distribution token"));
     }
 
-    if (chainActive.Height() - snapshot_height < gArgs.GetArg("-minrewardheight", MINIMUM_REWARDS_PAYOUT_HEIGHT)) {
+    if (nTipHeight - snapshot_height < gArgs.GetArg("-minrewardheight", MINIMUM_REWARDS_PAYOUT_HEIGHT)) {
         throw JSONRPCError(RPC_INVALID_REQUEST, std::string(
                 "For security of the rewards payout, it is recommended to wait until chain is 60 blocks ahead of the snapshot height. You can modify this by using the -minrewardsheight."));
     }
@@ -480,6 +529,13 @@ UniValue getdistributestatus(const JSONRPCRequest& request) {
     responseObj.push_back(std::make_pair("Distribution Amount", ValueFromAmount(temp.nDistributionAmount)));
     responseObj.push_back(std::make_pair("Status", temp.nStatus));
 
+    //  The distribution waits for the ownership snapshot, which is written in the background
+    size_t owners_written;
+    std::string snapshot_status = GetSnapshotStatus(temp.strOwnershipToken, temp.nHeight, owners_written);
+    responseObj.push_back(std::make_pair("Snapshot Status", snapshot_status));
+    if (snapshot_status == "queued" || snapshot_status == "writing")
+        responseObj.push_back(std::make_pair("Snapshot Owners Written", (uint64_t)owners_written));
+
     return responseObj;
 }
 #endif
@@ -27,7 +27,9 @@ using namespace boost::placeholders;
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <atomic>
 #include <memory> // for unique_ptr
+#include <thread>
 #include <unordered_map>
 #include <validation.h>
 
@@ -500,13 +502,42 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
 
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
+    // All calls of the batch see the same tip, however many blocks connect while it runs
+    JSONRPCRequest batchReq = jreq;
+    batchReq.tip = GetChainTipState();
+
+    std::vector<UniValue> vResults(vReq.size());
+    size_t nThreads = std::min((size_t)std::max(gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), (int64_t)1), vReq.size());
+    if (nThreads <= 1) {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            vResults[reqIdx] = JSONRPCExecOne(batchReq, vReq[reqIdx]);
+    } else {
+        // Each thread takes the next unclaimed call, results go to the call's own slot so the order is kept
+        std::atomic<size_t> nNext(0);
+        auto worker = [&]() {
+            for (size_t reqIdx = nNext++; reqIdx < vReq.size(); reqIdx = nNext++)
+                vResults[reqIdx] = JSONRPCExecOne(batchReq, vReq[reqIdx]);
+        };
+        std::vector<std::thread> vThreads;
+        for (size_t i = 1; i < nThreads; i++)
+            vThreads.emplace_back(worker);
+        worker();
+        for (auto& thread : vThreads)
+            thread.join();
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    for (UniValue& result : vResults)
+        ret.push_back(result);
 
     return ret.write() + "\n";
 }
 
+std::shared_ptr<const CChainTipState> GetRequestChainTip(const JSONRPCRequest& request)
+{
+    return request.tip ? request.tip : GetChainTipState();
+}
+
 /**
  * Process named arguments into a vector of positional arguments, based on the
  * passed-in specification for the RPC call's arguments.
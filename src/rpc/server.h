@@ -13,14 +13,20 @@
 
 #include <list>
 #include <map>
+#include <memory>
 #include <stdint.h>
 #include <string>
 
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+//! Number of threads that execute the calls of one JSON-RPC batch, 1 runs them in order on the request thread
+static const int DEFAULT_RPC_BATCH_THREADS = 1;
+//! Number of transaction results getrawtransaction and decoderawtransaction keep, decoded and serialized
+static const int64_t DEFAULT_RPC_TX_CACHE = 10000;
 
 class CRPCCommand;
+struct CChainTipState;
 
 namespace RPCServer
 {
@@ -46,8 +52,13 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /** Set when the transport can stream the result. Handlers with large results may write
+     *  their result there as a single JSON value and return NullUniValue instead. */
+    JSONStreamWriter* stream;
+    /** Chain tip every call of a batch is answered against, see GetRequestChainTip. */
+    std::shared_ptr<const CChainTipState> tip;
 
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), stream(nullptr) {}
     void parse(const UniValue& valRequest);
 };
 
@@ -198,6 +209,9 @@ void InterruptRPC();
 void StopRPC();
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
 
+/** The tip pinned for the request's batch, or the currently published one for single requests. */
+std::shared_ptr<const CChainTipState> GetRequestChainTip(const JSONRPCRequest& request);
+
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
 
@@ -14,6 +14,7 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "cachebudget.h"
 #include "chain.h"
 #include "consensus/validation.h"
 #include "core_io.h"
@@ -29,10 +30,13 @@
 #include "rpc/server.h"
 #include "script/sign.h"
 #include "timedata.h"
+#include "tokentxindex.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxostats.h"
 #include "wallet/coincontrol.h"
 #include "wallet/feebumper.h"
+#include "wallet/fees.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 
@@ -94,9 +98,9 @@ std::string KnownTokenTypeToString(KnownTokenType& tokenType)
     }
 }
 
-UniValue UnitValueFromAmount(const CAmount& amount, const std::string token_name)
+//! The decimals amounts of token_name are shown with, looked up once for a whole listing of one token
+static int8_t TokenDisplayUnits(const std::string& token_name)
 {
-
     auto currentActiveTokenCache = GetCurrentTokenCache();
     if (!currentActiveTokenCache)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Token cache isn't available.");
@@ -104,14 +108,19 @@ UniValue UnitValueFromAmount(const CAmount& amount, const std::string token_name
     uint8_t units = OWNER_UNITS;
     if (!IsTokenNameAnOwner(token_name)) {
         CNewToken tokenData;
-        if (!currentActiveTokenCache->GetTokenMetaDataIfExists(token_name, tokenData))
+        if (!GetConfirmedTokenMetaData(token_name, tokenData))
             units = MAX_UNIT;
             //throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't load token from cache: " + token_name);
         else
             units = tokenData.units;
     }
 
-    return ValueFromAmount(amount, units);
+    return units;
+}
+
+UniValue UnitValueFromAmount(const CAmount& amount, const std::string& token_name)
+{
+    return ValueFromAmount(amount, TokenDisplayUnits(token_name));
 }
 
 #ifdef ENABLE_WALLET
@@ -363,11 +372,11 @@ UniValue UpdateGlobalRestrictedToken(const JSONRPCRequest &request, const int8_t
         throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Unsupported token type: ") + KnownTokenTypeToString(tokenType));
     }
 
-    if (flag == 1 && mempool.mapGlobalFreezingTokenTransactions.count(restricted_name)){
+    if (flag == 1 && mempool.restrictedStateIndex.Exists(CRestrictedStateIndex::GLOBAL_FREEZING, restricted_name)){
         throw JSONRPCError(RPC_TRANSACTION_REJECTED, std::string("Freezing transaction already in mempool"));
     }
 
-    if (flag == 0 && mempool.mapGlobalUnFreezingTokenTransactions.count(restricted_name)){
+    if (flag == 0 && mempool.restrictedStateIndex.Exists(CRestrictedStateIndex::GLOBAL_UNFREEZING, restricted_name)){
         throw JSONRPCError(RPC_TRANSACTION_REJECTED, std::string("Unfreezing transaction already in mempool"));
     }
 
@@ -645,7 +654,7 @@ UniValue issueunique(const JSONRPCRequest& request)
                 "5. \"change_address\"        (string, optional, default=\"\"), address the the paladeum change will be sent to, if it is empty, change address will be generated for you\n"
 
                 "\nResult:\n"
-                "\"txid\"                     (string) The transaction id\n"
+                "[\"txid\", ...]              (array) The transaction ids, more than one when the tokens don't fit in a single transaction\n"
 
                 "\nExamples:\n"
                 + HelpExampleCli("issueunique", "\"MY_TOKEN\" \'[\"primo\",\"secundo\"]\'")
@@ -756,26 +765,38 @@ UniValue issueunique(const JSONRPCRequest& request)
         tokens.push_back(token);
     }
 
-    CReserveKey reservekey(pwallet);
-    CWalletTx transaction;
-    CAmount nRequiredFee;
-    std::pair<int, std::string> error;
-
-    CCoinControl crtl;
-
-    crtl.destChange = DecodeDestination(changeAddress);
-
-    // Create the Transaction
-    if (!CreateTokenTransaction(pwallet, crtl, tokens, address, error, transaction, reservekey, nRequiredFee))
-        throw JSONRPCError(error.first, error.second);
-
-    // Send the Transaction to the network
-    std::string txid;
-    if (!SendTokenTransaction(pwallet, transaction, reservekey, error, txid))
-        throw JSONRPCError(error.first, error.second);
+    // A collection too large for one transaction is issued in several, each spending the owner token change of the
+    // one before. Every tag is checked up front so a bad one can't leave the collection half issued
+    std::vector<std::vector<CNewToken> > vBatches;
+    PackUniqueTokenIssues(tokens, address, vBatches);
+    if (vBatches.size() > 1) {
+        std::string strError;
+        if (!ContextualCheckNewTokens(GetCurrentTokenCache(), tokens, strError, true))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strError);
+    }
 
     UniValue result(UniValue::VARR);
-    result.push_back(txid);
+    for (const auto& batch : vBatches) {
+        CReserveKey reservekey(pwallet);
+        CWalletTx transaction;
+        CAmount nRequiredFee;
+        std::pair<int, std::string> error;
+
+        CCoinControl crtl;
+
+        crtl.destChange = DecodeDestination(changeAddress);
+
+        // Create the Transaction, and send it to the network
+        std::string txid;
+        if (!CreateTokenTransaction(pwallet, crtl, batch, address, error, transaction, reservekey, nRequiredFee) ||
+                !SendTokenTransaction(pwallet, transaction, reservekey, error, txid)) {
+            if (!result.empty())
+                error.second += strprintf("\nThe first %u transactions were sent: %s", result.size(), result.write());
+            throw JSONRPCError(error.first, error.second);
+        }
+
+        result.push_back(txid);
+    }
     return result;
 }
 
@@ -888,7 +909,7 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
 
     if (request.fHelp || !AreTokensDeployed() || request.params.size() < 1)
         throw std::runtime_error(
-            "listtokenbalancesbyaddress \"address\" (onlytotal) (count) (start)\n"
+            "listtokenbalancesbyaddress \"address\" (onlytotal) (count) (start) (\"after\")\n"
             + TokenActivationWarning() +
             "\nReturns a list of all token balances for an address.\n"
 
@@ -897,6 +918,7 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
             "2. \"onlytotal\"                (boolean, optional, default=false) when false result is just a list of tokens balances -- when true the result is just a single number representing the number of tokens\n"
             "3. \"count\"                    (integer, optional, default=50000, MAX=50000) truncates results to include only the first _count_ tokens found\n"
             "4. \"start\"                    (integer, optional, default=0) results skip over the first _start_ tokens found (if negative it skips back from the end)\n"
+            "5. \"after\"                    (string, optional) resume after this token name, the last one returned by the previous page (start must be 0)\n"
 
             "\nResult:\n"
             "{\n"
@@ -907,6 +929,7 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
 
             "\nExamples:\n"
             + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\" false 2 0")
+            + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\" false 100 0 \"LAST_TOKEN_NAME\"")
             + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\" true")
             + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\"")
         );
@@ -935,13 +958,23 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
         start = request.params[3].get_int();
     }
 
+    std::string after;
+    if (request.params.size() > 4) {
+        after = request.params[4].get_str();
+        if (!after.empty() && start != 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "start must be 0 when after is given.");
+    }
+
     if (!ptokensdb)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "token db unavailable.");
 
-    LOCK(cs_main);
     std::vector<std::pair<std::string, CAmount> > vecTokenAmounts;
     int nTotalEntries = 0;
-    if (!ptokensdb->AddressDir(vecTokenAmounts, nTotalEntries, fOnlyTotal, address, count, start))
+    if (!fOnlyTotal && !after.empty()) {
+        std::string next;
+        if (!ptokensdb->AddressDirFrom(vecTokenAmounts, address, after, count, next))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directory.");
+    } else if (!ptokensdb->AddressDir(vecTokenAmounts, nTotalEntries, fOnlyTotal, address, count, start))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directory.");
 
     // If only the number of addresses is wanted return it
@@ -957,6 +990,80 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
     return result;
 }
 
+// Enough for an explorer to fill a page of addresses, few enough to keep one reply bounded
+static const size_t MAX_ADDRESSES_TOKEN_BALANCES = 10000;
+
+UniValue getaddressestokenbalances(const JSONRPCRequest& request)
+{
+    if (!fTokenIndex) {
+        return "_This rpc call is not functional unless -tokenindex is enabled. To enable, please run the wallet with -tokenindex, this will require a reindex to occur";
+    }
+
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressestokenbalances [\"address\",...]\n"
+            + TokenActivationWarning() +
+            "\nReturns the token balances of many addresses, read from one consistent view of the token index.\n"
+
+            "\nArguments:\n"
+            "1. \"addresses\"                (array, required) up to " + std::to_string(MAX_ADDRESSES_TOKEN_BALANCES) + " paladeum addresses\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  (address) : {\n"
+            "    (token_name) : (quantity),\n"
+            "    ...\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressestokenbalances", "'[\"myaddress\",\"myotheraddress\"]'")
+            + HelpExampleRpc("getaddressestokenbalances", "[\"myaddress\",\"myotheraddress\"]")
+        );
+
+    ObserveSafeMode();
+
+    const UniValue& addresses = request.params[0].get_array();
+    if (addresses.size() > MAX_ADDRESSES_TOKEN_BALANCES)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u addresses can be queried at once.", MAX_ADDRESSES_TOKEN_BALANCES));
+
+    std::set<std::string> setAddresses;
+    for (size_t i = 0; i < addresses.size(); i++) {
+        const std::string& address = addresses[i].get_str();
+        if (!IsValidDestination(DecodeDestination(address)))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid Paladeum address: ") + address);
+        setAddresses.insert(address);
+    }
+
+    if (!ptokensdb)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "token db unavailable.");
+
+    // generate output, streamed one address at a time when the transport supports it
+    UniValue result(UniValue::VOBJ);
+    if (request.stream)
+        request.stream->BeginObject();
+    bool fRead = ptokensdb->AddressesDir(setAddresses, [&](const std::string& address, const std::vector<std::pair<std::string, CAmount> >& vecTokenAmounts) {
+        UniValue balances(UniValue::VOBJ);
+        for (const auto& pair : vecTokenAmounts)
+            balances.push_back(Pair(pair.first, UnitValueFromAmount(pair.second, pair.first)));
+        if (request.stream) {
+            request.stream->KeyValue(address, balances);
+            return request.stream->IsOpen();
+        }
+        result.push_back(Pair(address, balances));
+        return true;
+    });
+    if (!fRead)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directories.");
+
+    if (request.stream) {
+        request.stream->EndObject();
+        return NullUniValue;
+    }
+    return result;
+}
+
 UniValue gettokendata(const JSONRPCRequest& request)
 {
     if (request.fHelp || !AreTokensDeployed() || request.params.size() != 1)
@@ -988,13 +1095,13 @@ UniValue gettokendata(const JSONRPCRequest& request)
 
     std::string token_name = request.params[0].get_str();
 
-    LOCK(cs_main);
     UniValue result (UniValue::VOBJ);
 
     auto currentActiveTokenCache = GetCurrentTokenCache();
     if (currentActiveTokenCache) {
+        // Metadata is resolved from the shared cache, cs_main is only needed on a miss and for the verifier string
         CNewToken token;
-        if (!currentActiveTokenCache->GetTokenMetaDataIfExists(token_name, token))
+        if (!GetConfirmedTokenMetaData(token_name, token))
             return NullUniValue;
 
         result.push_back(Pair("name", token.strName));
@@ -1011,9 +1118,12 @@ UniValue gettokendata(const JSONRPCRequest& request)
             }
         }
 
-        CNullTokenTxVerifierString verifier;
-        if (currentActiveTokenCache->GetTokenVerifierStringIfExists(token.strName, verifier)) {
-            result.push_back(Pair("verifier_string", verifier.verifier_string));
+        if (IsTokenNameAnRestricted(token.strName)) {
+            LOCK(cs_main);
+            CNullTokenTxVerifierString verifier;
+            if (currentActiveTokenCache->GetTokenVerifierStringIfExists(token.strName, verifier)) {
+                result.push_back(Pair("verifier_string", verifier.verifier_string));
+            }
         }
 
         return result;
@@ -1116,26 +1226,23 @@ UniValue listmytokens(const JSONRPCRequest &request)
         confs = request.params[4].get_int();
     }
 
-    // retrieve balances
-    std::map<std::string, CAmount> balances;
-    std::map<std::string, std::vector<COutput> > outputs;
-    if (filter == "*") {
-        if (!GetAllMyTokenBalances(outputs, balances, confs))
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't get token balances. For all tokens");
-    }
-    else if (filter.back() == '*') {
-        std::vector<std::string> tokenNames;
+    std::string prefix;
+    if (filter.back() == '*') {
         filter.pop_back();
-        if (!GetAllMyTokenBalances(outputs, balances, confs, filter))
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't get token balances. For all tokens");
+        prefix = filter;
     }
     else {
         if (!IsTokenNameValid(filter))
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid token name.");
-        if (!GetAllMyTokenBalances(outputs, balances, confs, filter))
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't get token balances. For all tokens");
+        prefix = filter;
     }
 
+    // retrieve balances, only the verbose listing needs the outputs behind them
+    std::map<std::string, CAmount> balances;
+    std::map<std::string, std::vector<COutput> > outputs;
+    if (verbose ? !GetAllMyTokenBalances(outputs, balances, confs, prefix) : !GetAllMyTokenBalances(balances, confs, prefix))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't get token balances. For all tokens");
+
     // pagination setup
     auto bal = balances.begin();
     if (start >= 0)
@@ -1145,8 +1252,10 @@ UniValue listmytokens(const JSONRPCRequest &request)
     auto end = bal;
     safe_advance(end, balances.end(), count);
 
-    // generate output
+    // generate output, streamed one token at a time when the transport supports it
     UniValue result(UniValue::VOBJ);
+    if (request.stream)
+        request.stream->BeginObject();
     if (verbose) {
         for (; bal != end && bal != balances.end(); bal++) {
             UniValue token(UniValue::VOBJ);
@@ -1203,14 +1312,24 @@ UniValue listmytokens(const JSONRPCRequest &request)
                 outpoints.push_back(tempOut);
             }
             token.push_back(Pair("outpoints", outpoints));
-            result.push_back(Pair(bal->first, token));
+            if (request.stream)
+                request.stream->KeyValue(bal->first, token);
+            else
+                result.push_back(Pair(bal->first, token));
         }
     }
     else {
         for (; bal != end && bal != balances.end(); bal++) {
-            result.push_back(Pair(bal->first, UnitValueFromAmount(bal->second, bal->first)));
+            if (request.stream)
+                request.stream->KeyAmount(bal->first, bal->second, TokenDisplayUnits(bal->first));
+            else
+                result.push_back(Pair(bal->first, UnitValueFromAmount(bal->second, bal->first)));
         }
     }
+    if (request.stream) {
+        request.stream->EndObject();
+        return NullUniValue;
+    }
     return result;
 }
 
@@ -1397,9 +1516,9 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
         return "_This rpc call is not functional unless -tokenindex is enabled. To enable, please run the wallet with -tokenindex, this will require a reindex to occur";
     }
 
-    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 4 || request.params.size() < 1)
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 5 || request.params.size() < 1)
         throw std::runtime_error(
-                "listaddressesbytoken \"token_name\" (onlytotal) (count) (start)\n"
+                "listaddressesbytoken \"token_name\" (onlytotal) (count) (start) (\"after\")\n"
                 + TokenActivationWarning() +
                 "\nReturns a list of all address that own the given token (with balances)"
                 "\nOr returns the total size of how many address own the given token"
@@ -1409,6 +1528,7 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
                 "2. \"onlytotal\"                (boolean, optional, default=false) when false result is just a list of addresses with balances -- when true the result is just a single number representing the number of addresses\n"
                 "3. \"count\"                    (integer, optional, default=50000, MAX=50000) truncates results to include only the first _count_ tokens found\n"
                 "4. \"start\"                    (integer, optional, default=0) results skip over the first _start_ tokens found (if negative it skips back from the end)\n"
+                "5. \"after\"                    (string, optional) resume after this address, the last one returned by the previous page (start must be 0)\n"
 
                 "\nResult:\n"
                 "[ "
@@ -1418,12 +1538,12 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
 
                 "\nExamples:\n"
                 + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\" false 2 0")
+                + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\" false 100 0 \"LAST_ADDRESS\"")
                 + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\" true")
                 + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\"")
         );
 
-    LOCK(cs_main);
-
+    // The directory lookups only hold cs_main while capturing a database snapshot
     std::string token_name = request.params[0].get_str();
     bool fOnlyTotal = false;
     if (request.params.size() > 1)
@@ -1441,13 +1561,37 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
         start = request.params[3].get_int();
     }
 
+    std::string after;
+    if (request.params.size() > 4) {
+        after = request.params[4].get_str();
+        if (!after.empty() && start != 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "start must be 0 when after is given.");
+    }
+
     if (!IsTokenNameValid(token_name))
         return "_Not a valid token name";
 
-    LOCK(cs_main);
+    // The whole directory is streamed from a snapshot, without collecting it first
+    if (request.stream && !fOnlyTotal && count == INT_MAX && start == 0 && after.empty()) {
+        std::unique_ptr<CTokenAddressDirView> view = ptokensdb->SnapshotTokenAddressDir(token_name);
+        const int8_t units = TokenDisplayUnits(token_name);
+        request.stream->BeginObject();
+        if (!view->Walk([&request, units](const std::string& address, const CAmount& amount) {
+                request.stream->KeyAmount(address, amount, units);
+                return request.stream->IsOpen();
+            }))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directory.");
+        request.stream->EndObject();
+        return NullUniValue;
+    }
+
     std::vector<std::pair<std::string, CAmount> > vecAddressAmounts;
     int nTotalEntries = 0;
-    if (!ptokensdb->TokenAddressDir(vecAddressAmounts, nTotalEntries, fOnlyTotal, token_name, count, start))
+    if (!fOnlyTotal && !after.empty()) {
+        std::string next;
+        if (!ptokensdb->TokenAddressDirFrom(vecAddressAmounts, token_name, after, count, next))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directory.");
+    } else if (!ptokensdb->TokenAddressDir(vecAddressAmounts, nTotalEntries, fOnlyTotal, token_name, count, start))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directory.");
 
     // If only the number of addresses is wanted return it
@@ -1455,9 +1599,10 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
         return nTotalEntries;
     }
 
+    const int8_t units = TokenDisplayUnits(token_name);
     UniValue result(UniValue::VOBJ);
     for (auto& pair : vecAddressAmounts) {
-        result.push_back(Pair(pair.first, UnitValueFromAmount(pair.second, token_name)));
+        result.push_back(Pair(pair.first, ValueFromAmount(pair.second, units)));
     }
 
 
@@ -1614,6 +1759,156 @@ UniValue transfer(const JSONRPCRequest& request)
     return result;
 }
 
+// Token transfers sendmanytokens puts in one transaction before trying smaller batches, their outputs take well under MAX_STANDARD_TX_WEIGHT
+static const size_t MAX_TOKEN_TRANSFERS_PER_TX = 500;
+
+UniValue sendmanytokens(const JSONRPCRequest& request)
+{
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() < 1 || request.params.size() > 4)
+        throw std::runtime_error(
+                "sendmanytokens {\"token_name\":{\"address\":qty,...},...} \"message\" \"change_address\" \"token_change_address\"\n"
+                + TokenActivationWarning() +
+                "\nTransfers owned tokens to many addresses at once. Inputs are selected for all the transfers under one wallet\n"
+                "lock and the transfers are packed into as few transactions as the standard size limit allows."
+
+                "\nArguments:\n"
+                "1. \"transfers\"                (object, required) A json object with token names as keys\n"
+                "    {\n"
+                "      \"token_name\":           (object) A json object with addresses or usernames as keys and quantities as values\n"
+                "        {\n"
+                "          \"address\":qty       (numeric) The number of tokens to send to the address\n"
+                "          ,...\n"
+                "        }\n"
+                "      ,...\n"
+                "    }\n"
+                "2. \"message\"                  (string, optional, default="") Message attached to every transaction\n"
+                "3. \"change_address\"           (string, optional, default = \"\") the transactions PLB change will be sent to this address\n"
+                "4. \"token_change_address\"     (string, optional, default = \"\") the transactions Token change will be sent to this address\n"
+
+                "\nResult:\n"
+                "[ \n"
+                "txid\n"
+                "]\n"
+
+                "\nExamples:\n"
+                + HelpExampleCli("sendmanytokens", "\"{\\\"TOKEN_NAME\\\":{\\\"address1\\\":20,\\\"address2\\\":5}}\"")
+                + HelpExampleRpc("sendmanytokens", "{\"TOKEN_NAME\":{\"address1\":20,\"address2\":5}}, \"payout\"")
+        );
+
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    ObserveSafeMode();
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    EnsureWalletIsUnlocked(pwallet);
+
+    const UniValue& transfers = request.params[0].get_obj();
+    std::vector< std::pair<CTokenTransfer, std::string> >vTransfers;
+    for (const std::string& token_name : transfers.getKeys()) {
+        if (IsTokenNameAQualifier(token_name))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Please use the rpc call transferqualifiertoken to send qualifier tokens from this wallet.");
+
+        const UniValue& recipients = transfers[token_name].get_obj();
+        if (recipients.empty())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("No recipients given for token: ") + token_name);
+
+        for (const std::string& address : recipients.getKeys()) {
+            std::string to_address = address;
+            if (IsUsernameValid(to_address)) {
+                to_address = ptokensdb->UsernameAddress(to_address);
+                if (to_address == "") {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "You specified invalid username.");
+                }
+            }
+
+            if (!IsValidDestination(DecodeDestination(to_address)))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid Paladeum address: ") + to_address);
+
+            CAmount nAmount = AmountFromValue(recipients[address]);
+            vTransfers.emplace_back(std::make_pair(CTokenTransfer(token_name, nAmount, 0), to_address));
+        }
+    }
+    if (vTransfers.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No transfers given");
+
+    std::string message;
+    if (request.params.size() > 1) {
+        message = request.params[1].get_str();
+
+        if (message.length() > MAX_MESSAGE_LEN)
+            throw JSONRPCError(RPC_TYPE_ERROR,
+                strprintf("Transaction message max length is %s", MAX_MESSAGE_LEN));
+    }
+
+    std::string paladeum_change_address = "";
+    if (request.params.size() > 2) {
+        paladeum_change_address = request.params[2].get_str();
+    }
+
+    std::string token_change_address = "";
+    if (request.params.size() > 3) {
+        token_change_address = request.params[3].get_str();
+    }
+
+    CTxDestination paladeum_change_dest = DecodeDestination(paladeum_change_address);
+    if (!paladeum_change_address.empty() && !IsValidDestination(paladeum_change_dest))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("PLB change address must be a valid address. Invalid address: ") + paladeum_change_address);
+
+    CTxDestination token_change_dest = DecodeDestination(token_change_address);
+    if (!token_change_address.empty() && !IsValidDestination(token_change_dest))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Token change address must be a valid address. Invalid address: ") + token_change_address);
+
+    CCoinControl ctrl;
+    ctrl.destChange = paladeum_change_dest;
+    ctrl.tokenDestChange = token_change_dest;
+
+    // Each batch is committed before the next one selects its inputs, so they never pick the same coins.
+    // A batch that comes out too large is retried with half as many transfers.
+    UniValue result(UniValue::VARR);
+    size_t nBatch = std::min(vTransfers.size(), MAX_TOKEN_TRANSFERS_PER_TX);
+    size_t nPos = 0;
+    while (nPos < vTransfers.size()) {
+        nBatch = std::min(nBatch, vTransfers.size() - nPos);
+        std::vector< std::pair<CTokenTransfer, std::string> > vBatch(vTransfers.begin() + nPos, vTransfers.begin() + nPos + nBatch);
+
+        std::pair<int, std::string> error;
+        CReserveKey reservekey(pwallet);
+        CWalletTx transaction;
+        CAmount nRequiredFee;
+        if (!CreateTransferTokenTransaction(pwallet, ctrl, vBatch, "", error, transaction, reservekey, nRequiredFee, message)) {
+            if (nBatch > 1 && error.second.find(_("Transaction too large")) != std::string::npos) {
+                nBatch /= 2;
+                continue;
+            }
+            if (!result.empty())
+                error.second += strprintf(" (already sent: %s)", result.write());
+            throw JSONRPCError(error.first, error.second);
+        }
+
+        // Do a validity check before commiting the transaction
+        std::set<std::string> setNames;
+        for (const auto& transfer : vBatch)
+            if (setNames.insert(transfer.first.strName).second)
+                CheckRestrictedTokenTransferInputs(transaction, transfer.first.strName);
+
+        // Send the Transaction to the network
+        std::string txid;
+        if (!SendTokenTransaction(pwallet, transaction, reservekey, error, txid)) {
+            if (!result.empty())
+                error.second += strprintf(" (already sent: %s)", result.write());
+            throw JSONRPCError(error.first, error.second);
+        }
+
+        result.push_back(txid);
+        nPos += nBatch;
+    }
+
+    return result;
+}
+
 UniValue transferfromaddresses(const JSONRPCRequest& request)
 {
     if (request.fHelp || !AreTokensDeployed() || request.params.size() < 4 || request.params.size() > 10)
@@ -2065,6 +2360,196 @@ UniValue reissue(const JSONRPCRequest& request)
  * PLB, but can be limited to either all of the PLB or one token type by passing
  * the optional argument `token_filter`.
  */
+// Inputs in one sweep transaction, which keeps it well under MAX_STANDARD_TX_WEIGHT even with an output per token
+static const size_t SWEEP_MAX_INPUTS_PER_TX = 300;
+// Inputs of a token batch left free for the PLB that pays its fee
+static const size_t SWEEP_FEE_INPUTS = 20;
+// What signing adds to an input: a compressed key and its signature
+static const unsigned int SWEEP_SCRIPTSIG_SIZE = 107;
+
+struct CSweepCoin
+{
+    COutPoint outpoint;
+    CTxOut txout;
+    //! PLB for plain coins
+    std::string strToken;
+    //! Token amount, or nValue for PLB
+    CAmount nAmount;
+};
+
+//! Everything the sweep spends and where it sends it, built up one transaction at a time
+struct CSweepContext
+{
+    CWallet* pwallet;
+    CBasicKeyStore keystore;
+    bool fSweepPlb;
+    std::string strToken;
+    std::string strSwept;
+    CScript scriptSwept;
+    CScript scriptTokenDest;
+    CScript scriptPlbDest;
+    CCoinControl coinControl;
+
+    //! PLB of the swept key, largest first, and how many are used
+    std::vector<CSweepCoin> vPlbCoins;
+    size_t nPlbUsed = 0;
+    //! The wallet's own coins for fees, loaded on first need
+    std::vector<CSweepCoin> vWalletCoins;
+    size_t nWalletUsed = 0;
+    bool fWalletCoinsLoaded = false;
+    std::set<COutPoint> setSwept;
+
+    std::vector<std::pair<CMutableTransaction, std::vector<CTxOut> > > vTxs;
+};
+
+static void GetSweepCoins(const CKeyID& keyID, const std::string& token_name, std::vector<CSweepCoin>& vTokenCoins, std::vector<CSweepCoin>& vPlbCoins)
+{
+    // Two index reads: the tokens of the key, all of them or the one asked for, and its PLB
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    bool fRead = (token_name.empty() ? GetAddressUnspent(keyID, 1, unspentOutputs) : GetAddressUnspent(keyID, 1, token_name, unspentOutputs)) &&
+                 (token_name == PLB || GetAddressUnspent(keyID, 1, PLB, unspentOutputs));
+    if (!fRead)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address, sweep needs -addressindex");
+
+    // The published tip, chainActive isn't safe to read here without cs_main
+    std::shared_ptr<const CChainTipState> tip = GetChainTipState();
+    if (!tip)
+        throw JSONRPCError(RPC_IN_WARMUP, "No chain loaded");
+    const int nHeight = tip->nHeight;
+    const int64_t nMedianTimePast = tip->nMedianTimePast;
+    for (const auto& unspent : unspentOutputs) {
+        CSweepCoin coin{COutPoint(unspent.first.txhash, unspent.first.index), CTxOut(unspent.second.satoshis, unspent.second.script), PLB, unspent.second.satoshis};
+        if (mempool.isSpent(coin.outpoint))
+            continue;
+
+        // Only outputs the key alone can spend right away: no timelocked scripts, no P2SH
+        std::vector<std::vector<unsigned char> > vSolutions;
+        txnouttype whichType, scriptType;
+        if (!Solver(coin.txout.scriptPubKey, whichType, scriptType, vSolutions))
+            continue;
+        if (whichType == TX_NEW_TOKEN || whichType == TX_REISSUE_TOKEN || whichType == TX_TRANSFER_TOKEN) {
+            uint32_t nTimeLock;
+            if (scriptType != TX_PUBKEYHASH || !GetTokenInfoFromScript(coin.txout.scriptPubKey, coin.strToken, coin.nAmount, nTimeLock))
+                continue;
+            if (nTimeLock && (int64_t)nTimeLock >= ((int64_t)nTimeLock < LOCKTIME_THRESHOLD ? nHeight : nMedianTimePast))
+                continue;
+            // Transfers of these depend on the qualifiers of the destination
+            if (IsTokenNameAnRestricted(coin.strToken) || IsTokenNameAQualifier(coin.strToken))
+                continue;
+            if (!token_name.empty() && coin.strToken != token_name)
+                continue;
+            vTokenCoins.push_back(coin);
+        } else if (whichType == TX_PUBKEYHASH || whichType == TX_PUBKEY) {
+            vPlbCoins.push_back(coin);
+        }
+    }
+
+    // Coins of one token end up next to each other, so most tokens need one output
+    std::stable_sort(vTokenCoins.begin(), vTokenCoins.end(), [](const CSweepCoin& a, const CSweepCoin& b) { return a.strToken < b.strToken; });
+    std::sort(vPlbCoins.begin(), vPlbCoins.end(), [](const CSweepCoin& a, const CSweepCoin& b) { return a.nAmount > b.nAmount; });
+}
+
+static void LoadSweepWalletCoins(CSweepContext& ctx)
+{
+    EnsureWalletIsUnlocked(ctx.pwallet);
+
+    std::vector<COutput> vCoins;
+    ctx.pwallet->AvailableCoins(vCoins);
+    for (const COutput& out : vCoins) {
+        const CTxOut& txout = out.tx->tx->vout[out.i];
+        CTxDestination dest;
+        CKey key;
+        if (!out.fSpendable || !ExtractDestination(txout.scriptPubKey, dest) || !boost::get<CKeyID>(&dest))
+            continue;
+        if (ctx.setSwept.count(COutPoint(out.tx->GetHash(), out.i)) || !ctx.pwallet->GetKey(boost::get<CKeyID>(dest), key))
+            continue;
+        ctx.keystore.AddKeyPubKey(key, key.GetPubKey());
+        ctx.vWalletCoins.push_back(CSweepCoin{COutPoint(out.tx->GetHash(), out.i), txout, PLB, txout.nValue});
+    }
+    std::sort(ctx.vWalletCoins.begin(), ctx.vWalletCoins.end(), [](const CSweepCoin& a, const CSweepCoin& b) { return a.nAmount > b.nAmount; });
+    ctx.fWalletCoinsLoaded = true;
+}
+
+/**
+ * Build one sweep transaction from vCoins: an output per token to the token destination, and the
+ * PLB left after the fee to the PLB destination. When vCoins doesn't cover the fee, PLB of the
+ * swept key is added, then the wallet's own. False if there is nothing worth sending.
+ */
+static bool AddSweepTransaction(CSweepContext& ctx, const std::vector<CSweepCoin>& vCoins)
+{
+    CMutableTransaction tx;
+    std::vector<CTxOut> vPrevOuts;
+    std::map<std::string, CAmount> mapTokenTotals;
+    CAmount nSweptPlb = 0;
+    CAmount nWalletPlb = 0;
+    for (const CSweepCoin& coin : vCoins) {
+        tx.vin.emplace_back(coin.outpoint);
+        vPrevOuts.push_back(coin.txout);
+        if (coin.strToken == PLB)
+            nSweptPlb += coin.nAmount;
+        else
+            mapTokenTotals[coin.strToken] += coin.nAmount;
+    }
+    for (const auto& total : mapTokenTotals) {
+        CScript scriptTransfer = ctx.scriptTokenDest;
+        CTokenTransfer(total.first, total.second, 0).ConstructTransaction(scriptTransfer);
+        tx.vout.emplace_back(0, scriptTransfer);
+    }
+
+    // A PLB output to each destination at most
+    const CTxOut txoutPlb(0, ctx.scriptPlbDest);
+    const unsigned int nPlbOutputsSize = 2 * ::GetSerializeSize(txoutPlb, SER_NETWORK, PROTOCOL_VERSION);
+    CAmount nFee;
+    while (true) {
+        unsigned int nBytes = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) + tx.vin.size() * SWEEP_SCRIPTSIG_SIZE + nPlbOutputsSize;
+        nFee = GetMinimumFee(nBytes, ctx.coinControl, ::mempool, ::feeEstimator, nullptr);
+        if (nSweptPlb + nWalletPlb >= nFee)
+            break;
+        // Sweeping PLB alone, coins too small to pay for themselves are left where they are
+        if (tx.vin.size() >= SWEEP_MAX_INPUTS_PER_TX && mapTokenTotals.empty())
+            return false;
+        if (tx.vin.size() >= SWEEP_MAX_INPUTS_PER_TX)
+            throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "The coins left to pay the sweep fee are too small and too many");
+
+        if (ctx.nPlbUsed < ctx.vPlbCoins.size()) {
+            const CSweepCoin& coin = ctx.vPlbCoins[ctx.nPlbUsed++];
+            tx.vin.emplace_back(coin.outpoint);
+            vPrevOuts.push_back(coin.txout);
+            nSweptPlb += coin.nAmount;
+            continue;
+        }
+        if (mapTokenTotals.empty())
+            return false;
+        if (!ctx.fWalletCoinsLoaded)
+            LoadSweepWalletCoins(ctx);
+        if (ctx.nWalletUsed == ctx.vWalletCoins.size())
+            throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, strprintf("Please add PLB to address '%s' to be able to sweep token '%s'", ctx.strSwept, ctx.strToken));
+        const CSweepCoin& coin = ctx.vWalletCoins[ctx.nWalletUsed++];
+        tx.vin.emplace_back(coin.outpoint);
+        vPrevOuts.push_back(coin.txout);
+        nWalletPlb += coin.nAmount;
+    }
+
+    // Unless PLB is swept as well, what the swept key paid in beyond the fee goes back to it
+    CAmount nLeft = nSweptPlb + nWalletPlb - nFee;
+    CAmount nBack = ctx.fSweepPlb ? 0 : std::min(nLeft, nSweptPlb);
+    if (nBack > 0) {
+        CTxOut txout(nBack, ctx.scriptSwept);
+        if (!IsDust(txout, ::dustRelayFee))
+            tx.vout.push_back(txout);
+    }
+    if (nLeft - nBack > 0) {
+        CTxOut txout(nLeft - nBack, ctx.scriptPlbDest);
+        if (!IsDust(txout, ::dustRelayFee))
+            tx.vout.push_back(txout);
+    }
+    if (tx.vout.empty())
+        return false;
+
+    ctx.vTxs.emplace_back(std::move(tx), std::move(vPrevOuts));
+    return true;
+}
+
 UniValue sweep(const JSONRPCRequest& request)
 {
     // Ensure that we have a wallet to sweep into
@@ -2079,18 +2564,23 @@ UniValue sweep(const JSONRPCRequest& request)
         throw std::runtime_error(
                 "sweep \"privkey\" ( \"token_name\" | \"PLB\" ) \n"
                 + TokenActivationWarning() +
-                "\nCreates a transaction to transfer all PLB, and all Tokens from a given address -- with only the private key as input.\n"
+                "\nCreates transactions to transfer all PLB, and all Tokens from a given address -- with only the private key as input.\n"
                 "\nDefault to funding from PLB held in the address, fallback to using PLB held in wallet for transaction fee."
                 "\nDefault to sweeping all tokens, but can also all with PLB to sweep only PLB, or to sweep only one token."
+                "\nAs many tokens as fit go into each transaction; restricted and qualifier tokens are left in the address."
                 "\nThis differs from import because a paper certficate provided with artwork or a one-of-a-kind item can include a paper"
                 " certficate-of-authenticity. Once swept it the paper certificate can be safely discarded as the token is secured by the new address.\n"
+                "\nRequires -addressindex.\n"
 
                 "\nArguments:\n"
                 "1. \"privkey\"               (string, required) private key of addresses from which to sweep\n"
                 "2. \"token_name\"            (string, optional, default=\"\") name of the token to sweep or PLB"
 
                 "\nResult:\n"
-                "\"txhex\"                    (string) The transaction hash in hex\n"
+                "[\n"
+                "  \"txid\"                   (string) The transaction id of each sweep transaction\n"
+                "  ,...\n"
+                "]\n"
 
                 "\nExamples:\n"
                 + HelpExampleCli("sweep", "\"privkey\"")
@@ -2099,7 +2589,6 @@ UniValue sweep(const JSONRPCRequest& request)
         );
 
     // See whether we should sweep everything or only a specific token
-    // Default is to sweep everything (TODO: Should default be `PLB`?)
     std::string token_name = "";
     if (!request.params[1].isNull()) {
         token_name = request.params[1].get_str();
@@ -2118,319 +2607,87 @@ UniValue sweep(const JSONRPCRequest& request)
     CPubKey pub_key = sweep_key.GetPubKey();
     assert(sweep_key.VerifyPubKey(pub_key));
     CKeyID addr = pub_key.GetID();
-    std::string addr_str = EncodeDestination(addr);
-
-    // Keep track of the private keys necessary for the transaction
-    std::set<std::string> signatures = {private_key};
-
-    // Create a base JSONRPCRequest to use for all subsequent operations as a copy
-    //   of the original request
-    JSONRPCRequest base_request = request;
-
-    // Helper method for calling RPC calls
-    auto CallRPC = [&base_request](const std::string& method, const UniValue& params)
-    {
-        base_request.strMethod = method;
-        base_request.params = params;
-
-        return tableRPC.execute(base_request);
-    };
-
-    // Get the balance for both ourselves and the swept address
-    CAmount our_balance = pwallet->GetBalance();
-    CAmount swept_balance;
-    {
-        UniValue swept_params = UniValue(UniValue::VARR);
-        UniValue swept_nested = UniValue(UniValue::VOBJ);
-        UniValue swept_addresses = UniValue(UniValue::VARR);
 
-        swept_addresses.push_back(addr_str);
-        swept_nested.pushKV("addresses", swept_addresses);
-        swept_params.push_back(swept_nested);
+    if (!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
 
-        // Get the balances
-        UniValue balance = CallRPC("getaddressbalance", swept_params);
-
-        if (!ParseInt64(balance["balance"].getValStr(), &swept_balance)) {
-            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Invalid balance for swept address!");
-        }
-    }
-
-    // Make sure that we can fund this transaction first
-    // TODO: I think that there is a more accurate way to calculate the fee,
-    //   as just always using the min transaction fee seems wrong.
-    if (swept_balance + our_balance < DEFAULT_MIN_RELAY_TX_FEE) {
-        throw JSONRPCError(
-            RPC_WALLET_INSUFFICIENT_FUNDS,
-            tfm::format(
-                "Please add PLB to address '%s' to be able to sweep token '%s'",
-                addr_str,
-                token_name
-            )
-        );
-    }
-
-    // Get two new addresses to sweep into: one for all of the tokens and another
-    //   for the PLB
-    // TODO: Does generating multiple addresses which may not be used cause a performance hit?
-    std::string dest_ast_str = CallRPC("getnewaddress", UniValue(UniValue::VOBJ)).getValStr();
-    std::string dest_paladeum_str = CallRPC("getnewaddress", UniValue(UniValue::VOBJ)).getValStr();
-
-    // Request the unspent transactions
-    // TODO: Should this be replaced with a call to the api.paladeumcoin.network?
-    // Format of params is as follows:
-    // {
-    //    addresses: ["PUB ADDR"],
-    //    tokenName: "TOKEN NAME"
-    // }
-    UniValue unspent;
-    UniValue unspent_paladeum;
-    UniValue unspent_our_paladeum;
-    {
-        // Helper method for getting UTXOs from an address of a specific token
-        auto get_unspent = [&CallRPC](const std::string& addr, const std::string& token) {
-            UniValue utxo_params = UniValue(UniValue::VARR);
-            UniValue utxo_inner  = UniValue(UniValue::VOBJ);
-            UniValue utxo_addrs  = UniValue(UniValue::VARR);
-            utxo_addrs.push_back(addr);
-            utxo_inner.pushKV("addresses", utxo_addrs);
-            utxo_inner.pushKV("tokenName", token);
-            utxo_params.push_back(utxo_inner);
-
-            return CallRPC("getaddressutxos", utxo_params);
-        };
-
-        // Get the specified token UTXOs
-        unspent = get_unspent(addr_str, token_name);
-
-        // We also get just the unspent PLB from the swept address for potential fee funding
-        unspent_paladeum = get_unspent(addr_str, PLB);
+    LOCK2(cs_main, pwallet->cs_wallet);
 
-        // Get our unspent PLB for funding if the swept address does not have enough
-        unspent_our_paladeum = CallRPC("listunspent", UniValue(UniValue::VNULL));
-    }
+    CSweepContext ctx;
+    ctx.pwallet = pwallet;
+    ctx.keystore.AddKeyPubKey(sweep_key, pub_key);
+    ctx.fSweepPlb = token_name.empty() || token_name == PLB;
+    ctx.strToken = token_name;
+    ctx.strSwept = EncodeDestination(addr);
+    ctx.scriptSwept = GetScriptForDestination(addr);
+
+    std::vector<CSweepCoin> vTokenCoins;
+    GetSweepCoins(addr, token_name, vTokenCoins, ctx.vPlbCoins);
+    for (const CSweepCoin& coin : vTokenCoins)
+        ctx.setSwept.insert(coin.outpoint);
+    for (const CSweepCoin& coin : ctx.vPlbCoins)
+        ctx.setSwept.insert(coin.outpoint);
 
     // Short out if there is nothing to sweep
-    if (unspent.size() == 0) {
+    if (vTokenCoins.empty() && (!ctx.fSweepPlb || ctx.vPlbCoins.empty()))
         throw JSONRPCError(RPC_TRANSACTION_REJECTED, "No tokens to sweep!");
-    }
-
-    // Create a raw transaction with all of the unspent transactions
-    UniValue created_transaction;
-    {
-        UniValue create_params = UniValue(UniValue::VARR);
-        UniValue create_input = UniValue(UniValue::VARR);
-        UniValue create_dest = UniValue(UniValue::VOBJ);
-
-        // Keep track of how much more PLB we will need from either the swept
-        //   address or our own wallet.
-        // TODO: I think that there is a more accurate way to calculate the fee,
-        //   as just always using the min transaction fee seems wrong.
-        CAmount fee_left = DEFAULT_MIN_RELAY_TX_FEE;
-        CAmount fee_paid_by_us = 0;
-
-        // Calculate totals for the output of the transaction and map the inputs
-        //   into the correct format of {txid, vout}
-        std::map<std::string, CAmount> token_totals;
-        for (size_t i = 0; i != unspent.size(); ++i) {
-            UniValue current_input = UniValue(UniValue::VOBJ);
-
-            const UniValue& current = unspent[i];
-            std::string curr_token_name = current["tokenName"].getValStr();
-            CAmount curr_amount;
-
-            // Parse the amount safely
-            if (!ParseInt64(current["satoshis"].getValStr(), &curr_amount)) {
-                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Invalid amount in UTXOs!");
-            }
-
-            // Subtract from the fee if PLB is being added to the list of inputs and
-            //   subtract from the total sent.
-            // Note: We do this because this allows for any PLB being swept to pay
-            //   the fee rather than our own address.
-            if (fee_left != 0 && curr_token_name == PLB) {
-                CAmount fee_diff = fee_left - curr_amount;
-
-                fee_paid_by_us += (fee_diff > 0) ? curr_amount : fee_left;
-                fee_left = (fee_diff > 0) ? fee_diff : 0;
-            }
-
-            // Update the total
-            // Note: [] access creates a default value if not in map
-            token_totals[curr_token_name] += curr_amount;
-
-            // Add to input
-            current_input.pushKV("txid", current["txid"]);
-            current_input.pushKV("vout", current["outputIndex"]);
-            create_input.push_back(current_input);
-        }
-
-        // If we still have some fee left, then try to fund from the swept address
-        //   first (assumming we haven't swept for PLB or everything [which includes PLB])
-        //   and then try to fund from our own wallets. Since we checked above
-        //   if the balances worked out, then there is no way it will fail here.
-        if (fee_left != 0) {
-            if (
-                (token_name != PLB && token_name != "") && // We haven't already considered PLB in our sweep above
-                swept_balance != 0                         // We have funds to try
-            ) {
-                // Add as many UTXOs as needed until we either run out or successfully
-                //   fund the transaction
-                for (size_t i = 0; i != unspent_paladeum.size() && fee_left != 0; ++i) {
-                    UniValue current_input = UniValue(UniValue::VOBJ);
-
-                    const UniValue& current = unspent_paladeum[i];
-                    CAmount curr_amount;
-
-                    // Parse the amount safely
-                    if (!ParseInt64(current["satoshis"].getValStr(), &curr_amount)) {
-                        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Invalid amount in UTXOs!");
-                    }
 
-                    // Add it to the input
-                    current_input.pushKV("txid", current["txid"]);
-                    current_input.pushKV("vout", current["outputIndex"]);
-                    create_input.push_back(current_input);
-
-                    // Update the fee and keep any change that may be incurred
-                    if (fee_left >= curr_amount) {
-                        fee_left -= curr_amount;
-                    } else {
-                        // Send change back to the swept address
-                        CAmount change = curr_amount - fee_left;
-
-                        create_dest.pushKV(addr_str, ValueFromAmount(change));
-                        fee_left = 0;
-                    }
-                }
-            }
-
-            // Fund the rest with our wallet, if needed
-            if (fee_left != 0) {
-                // Add as many UTXOs as needed until we either run out or successfully
-                //   fund the transaction
-                for (size_t i = 0; i != unspent_our_paladeum.size() && fee_left != 0; ++i) {
-                    UniValue current_input = UniValue(UniValue::VOBJ);
-
-                    const UniValue& current = unspent_our_paladeum[i];
-                    CAmount curr_amount = AmountFromValue(current["amount"]);
-                    bool is_safe = current["safe"].getBool();
-
-                    // Skip unsafe coins
-                    // TODO: Is this wanted behaviour?
-                    if (!is_safe) continue;
-
-                    // Add it to the input
-                    current_input.pushKV("txid", current["txid"]);
-                    current_input.pushKV("vout", current["vout"]);
-                    create_input.push_back(current_input);
-
-                    // Add it to the totals
-                    token_totals[PLB] += curr_amount;
-
-                    // Add our private key to the transaction for signing
-                    UniValue utxo_nested = UniValue(UniValue::VARR);
-                    utxo_nested.push_back(current["address"].getValStr());
-                    UniValue utxo_privkey = CallRPC("dumpprivkey", utxo_nested);
-                    signatures.insert(utxo_privkey.getValStr());
-
-                    // Update the fee and keep track of how much to pay off at the end
-                    if (fee_left > curr_amount) {
-                        fee_left -= curr_amount;
-                        fee_paid_by_us += curr_amount;
-                    } else {
-                        fee_paid_by_us += fee_left;
-                        fee_left = 0;
-                    }
-                }
-
-                // Sanity check
-                if (fee_left != 0) {
-                    throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "Funds available does not match funds required. Do you have unsafe transactions?");
-                }
-            }
-        }
-
-        // Convert the totals into their corresponding object types
-        // Note: Structure of complete output is as follows
-        // {
-        //     "DESTINATION ADDRESS": {
-        //         "transfer": {
-        //             "PLB": Total PLB to sweep,
-        //             "Example Token": Total Token count,
-        //             ...
-        //         }
-        //     }
-        // }
-        UniValue curr_transfer = UniValue(UniValue::VOBJ);
-        for (const auto& it : token_totals) {
-            std::string curr_token_name = it.first;
-            CAmount curr_amount = it.second;
-
-            // We skip PLB here becuase we need to send that to another of our addresses
-            if (curr_token_name == PLB) continue;
-
-            curr_transfer.pushKV(curr_token_name, ValueFromAmount(curr_amount));
-        }
-
-        // Add the PLB output, if available
-        if (token_totals.find(PLB) != token_totals.end()) {
-            CAmount paladeum_amount = token_totals[PLB] - fee_paid_by_us;
-
-            // Only add PLB to the output if there is some left over after the fee
-            if (paladeum_amount != 0) {
-                create_dest.pushKV(dest_paladeum_str, ValueFromAmount(paladeum_amount));
-            }
-        }
-
-        // Finish wrapping the transfer, if there are any
-        if (curr_transfer.size() != 0) {
-            UniValue nested_transfer = UniValue(UniValue::VOBJ);
-            nested_transfer.pushKV("transfer", curr_transfer);
-            create_dest.pushKV(dest_ast_str, nested_transfer);
-        }
-
-        // Add the inputs and outputs
-        create_params.push_back(create_input);
-        create_params.push_back(create_dest);
-
-        // Call the RPC to create the transaction
-        created_transaction = CallRPC("createrawtransaction", create_params);
+    // One new address for all of the tokens and another for the PLB
+    for (CScript* script : {&ctx.scriptTokenDest, &ctx.scriptPlbDest}) {
+        if (!pwallet->IsLocked())
+            pwallet->TopUpKeyPool();
+        CPubKey newKey;
+        if (!pwallet->GetKeyFromPool(newKey))
+            throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, "Error: Keypool ran out, please call keypoolrefill first");
+        pwallet->SetAddressBook(newKey.GetID(), "", "receive");
+        *script = GetScriptForDestination(newKey.GetID());
     }
 
-    // Sign the transaction with the swept private key
-    UniValue signed_transaction;
-    {
-        UniValue signed_params = UniValue(UniValue::VARR);
-        UniValue signed_privkeys = UniValue(UniValue::VARR);
-
-        // Use the supplied private key to allow for the transaction to occur
-        for (const auto& it : signatures) {
-            signed_privkeys.push_back(it);
+    // Token coins in batches that leave room for their fee, then whatever PLB is left in batches of its own
+    for (size_t nPos = 0; nPos < vTokenCoins.size(); nPos += SWEEP_MAX_INPUTS_PER_TX - SWEEP_FEE_INPUTS) {
+        size_t nEnd = std::min(vTokenCoins.size(), nPos + SWEEP_MAX_INPUTS_PER_TX - SWEEP_FEE_INPUTS);
+        AddSweepTransaction(ctx, std::vector<CSweepCoin>(vTokenCoins.begin() + nPos, vTokenCoins.begin() + nEnd));
+    }
+    if (ctx.fSweepPlb) {
+        while (ctx.nPlbUsed < ctx.vPlbCoins.size()) {
+            size_t nEnd = std::min(ctx.vPlbCoins.size(), ctx.nPlbUsed + SWEEP_MAX_INPUTS_PER_TX);
+            std::vector<CSweepCoin> vBatch(ctx.vPlbCoins.begin() + ctx.nPlbUsed, ctx.vPlbCoins.begin() + nEnd);
+            ctx.nPlbUsed = nEnd;
+            AddSweepTransaction(ctx, vBatch);
         }
-
-        signed_params.push_back(created_transaction);
-        signed_params.push_back(UniValue(UniValue::VNULL)); // We use NULL for prevtxs since there aren't any
-        signed_params.push_back(signed_privkeys);
-
-        // Call the RPC to sign the transaction
-        signed_transaction = CallRPC("signrawtransaction", signed_params);
     }
+    if (ctx.vTxs.empty())
+        throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "The PLB in the address doesn't cover the fee to sweep it");
 
-    // Commit the transaction to the network
-    UniValue completed_transaction;
-    {
-        UniValue completed_params = UniValue(UniValue::VARR);
+    // Every input of every transaction is signed on the signing threads
+    for (auto& sweepTx : ctx.vTxs) {
+        unsigned int nFailedIn;
+        if (!SignTransactionInputs(ctx.keystore, sweepTx.first, sweepTx.second, nFailedIn))
+            throw JSONRPCError(RPC_WALLET_ERROR, strprintf("Signing sweep transaction input %u failed", nFailedIn));
+    }
 
-        // Only use the hex from the previous RPC
-        // TODO: Should we allow high fees?
-        completed_params.push_back(signed_transaction["hex"].getValStr());
+    // The transactions spend disjoint coins, they are accepted and relayed in order
+    UniValue result(UniValue::VARR);
+    for (auto& sweepTx : ctx.vTxs) {
+        CTransactionRef tx = MakeTransactionRef(std::move(sweepTx.first));
+        CValidationState state;
+        bool fMissingInputs;
+        if (!AcceptToMemoryPool(mempool, state, tx, &fMissingInputs, nullptr /* plTxnReplaced */, false /* bypass_limits */, maxTxFee)) {
+            std::string strError = fMissingInputs ? "Missing inputs" : strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason());
+            if (!result.empty())
+                strError += strprintf(" (already sent: %s)", result.write());
+            throw JSONRPCError(state.IsInvalid() ? RPC_TRANSACTION_REJECTED : RPC_TRANSACTION_ERROR, strError);
+        }
 
-        // Call the RPC to complete the transaction
-        completed_transaction = CallRPC("sendrawtransaction", completed_params);
+        CInv inv(MSG_TX, tx->GetHash());
+        g_connman->ForEachNode([&inv](CNode* pnode)
+        {
+            pnode->PushInventory(inv);
+        });
+        result.push_back(tx->GetHash().GetHex());
     }
 
-    return completed_transaction;
+    return result;
 }
 #endif
 
@@ -2441,10 +2698,10 @@ UniValue listtokens(const JSONRPCRequest& request)
                 "listtokens \"( token )\" ( verbose ) ( count ) ( start )\n"
                 + TokenActivationWarning() +
                 "\nReturns a list of all tokens\n"
-                "\nThis could be a slow/expensive operation as it reads from the database\n"
+                "\nNames are filtered and paged in memory, only the metadata of the returned tokens is read from the database when verbose\n"
 
                 "\nArguments:\n"
-                "1. \"token\"                    (string, optional, default=\"*\") filters results -- must be an token name or a partial token name followed by '*' ('*' matches all trailing characters)\n"
+                "1. \"token\"                    (string, optional, default=\"*\") filters results -- must be an token name or a partial token name followed by '*' ('*' matches all trailing characters), a leading '*' matches any leading characters (\"*PART*\" finds names containing PART)\n"
                 "2. \"verbose\"                  (boolean, optional, default=false) when false result is just a list of token names -- when true results are token name mapped to metadata\n"
                 "3. \"count\"                    (integer, optional, default=ALL) truncates results to include only the first _count_ tokens found\n"
                 "4. \"start\"                    (integer, optional, default=0) results skip over the first _start_ tokens found (if negative it skips back from the end)\n"
@@ -2473,6 +2730,7 @@ UniValue listtokens(const JSONRPCRequest& request)
                 + HelpExampleRpc("listtokens", "")
                 + HelpExampleCli("listtokens", "TOKEN")
                 + HelpExampleCli("listtokens", "\"TOKEN*\" true 10 20")
+                + HelpExampleCli("listtokens", "\"*COIN*\" false 10")
         );
 
     ObserveSafeMode();
@@ -2503,37 +2761,112 @@ UniValue listtokens(const JSONRPCRequest& request)
         start = request.params[3].get_int();
     }
 
+    if (!verbose) {
+        std::vector<std::string> names;
+        if (!ptokensdb->TokenNameDir(names, filter, count, start))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve token directory.");
+        UniValue result(UniValue::VARR);
+        if (request.stream)
+            request.stream->BeginArray();
+        for (const std::string& name : names) {
+            if (request.stream)
+                request.stream->Value(name);
+            else
+                result.push_back(name);
+        }
+        if (request.stream) {
+            request.stream->EndArray();
+            return NullUniValue;
+        }
+        return result;
+    }
+
     std::vector<CDatabasedTokenData> tokens;
     if (!ptokensdb->TokenDir(tokens, filter, count, start))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve token directory.");
 
-    UniValue result;
-    result = verbose ? UniValue(UniValue::VOBJ) : UniValue(UniValue::VARR);
+    UniValue result(UniValue::VOBJ);
+    if (request.stream)
+        request.stream->BeginObject();
 
     for (auto data : tokens) {
         CNewToken token = data.token;
-        if (verbose) {
-            UniValue detail(UniValue::VOBJ);
-            detail.push_back(Pair("name", token.strName));
-            detail.push_back(Pair("amount", UnitValueFromAmount(token.nAmount, token.strName)));
-            detail.push_back(Pair("units", token.units));
-            detail.push_back(Pair("reissuable", token.nReissuable));
-            detail.push_back(Pair("has_ipfs", token.nHasIPFS));
-            detail.push_back(Pair("block_height", data.nHeight));
-            detail.push_back(Pair("blockhash", data.blockHash.GetHex()));
-            if (token.nHasIPFS) {
-                if (token.strIPFSHash.size() == 32) {
-                    detail.push_back(Pair("txid_hash", EncodeTokenData(token.strIPFSHash)));
-                } else {
-                    detail.push_back(Pair("ipfs_hash", EncodeTokenData(token.strIPFSHash)));
-                }
+        UniValue detail(UniValue::VOBJ);
+        detail.push_back(Pair("name", token.strName));
+        detail.push_back(Pair("amount", UnitValueFromAmount(token.nAmount, token.strName)));
+        detail.push_back(Pair("units", token.units));
+        detail.push_back(Pair("reissuable", token.nReissuable));
+        detail.push_back(Pair("has_ipfs", token.nHasIPFS));
+        detail.push_back(Pair("block_height", data.nHeight));
+        detail.push_back(Pair("blockhash", data.blockHash.GetHex()));
+        if (token.nHasIPFS) {
+            if (token.strIPFSHash.size() == 32) {
+                detail.push_back(Pair("txid_hash", EncodeTokenData(token.strIPFSHash)));
+            } else {
+                detail.push_back(Pair("ipfs_hash", EncodeTokenData(token.strIPFSHash)));
             }
-            result.push_back(Pair(token.strName, detail));
-        } else {
-            result.push_back(token.strName);
         }
+        if (request.stream)
+            request.stream->KeyValue(token.strName, detail);
+        else
+            result.push_back(Pair(token.strName, detail));
     }
 
+    if (request.stream) {
+        request.stream->EndObject();
+        return NullUniValue;
+    }
+    return result;
+}
+
+UniValue gettokensupplyinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 1)
+        throw std::runtime_error(
+                "gettokensupplyinfo ( \"token_name\" )\n"
+                + TokenActivationWarning() +
+                "\nReturns how much of a token, or of every token, the unspent outputs at the chain tip hold.\n"
+                "Answered from the UTXO set statistics followed as blocks connect (-utxostats), without reading the chainstate.\n"
+
+                "\nArguments:\n"
+                "1. \"token_name\"               (string, optional) only report this token\n"
+
+                "\nResult:\n"
+                "{\n"
+                "  \"height\": n,                  (numeric) The current block height\n"
+                "  \"bestblock\": \"hex\",         (string) The best block hash\n"
+                "  \"total_amount\": x.xxx,        (numeric) The PLB held by the unspent outputs\n"
+                "  \"tokens\": {                   (object) The supply of every token that is held, or only of token_name\n"
+                "    (token_name): x.xxx,\n"
+                "    ...\n"
+                "  }\n"
+                "}\n"
+
+                "\nExamples:\n"
+                + HelpExampleCli("gettokensupplyinfo", "")
+                + HelpExampleCli("gettokensupplyinfo", "\"TOKEN\"")
+                + HelpExampleRpc("gettokensupplyinfo", "\"TOKEN\"")
+        );
+
+    CUTXOSetStats stats;
+    if (!GetTipUTXOSetStats(stats))
+        throw JSONRPCError(RPC_MISC_ERROR, "The UTXO set statistics are not followed, restart with -utxostats");
+
+    UniValue tokens(UniValue::VOBJ);
+    if (request.params.size() > 0) {
+        const std::string strName = request.params[0].get_str();
+        auto it = stats.mapTokenSupply.find(strName);
+        tokens.push_back(Pair(strName, ValueFromAmount(it != stats.mapTokenSupply.end() ? it->second : 0)));
+    } else {
+        for (const auto& supply : stats.mapTokenSupply)
+            tokens.push_back(Pair(supply.first, ValueFromAmount(supply.second)));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("height", stats.nHeight));
+    result.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    result.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    result.push_back(Pair("tokens", tokens));
     return result;
 }
 
@@ -2547,14 +2880,31 @@ UniValue getcacheinfo(const JSONRPCRequest& request)
                 "\nResult:\n"
                 "[\n"
                 "  uxto cache size:\n"
-                "  token total (exclude dirty):\n"
-                "  token address map:\n"
-                "  token address balance:\n"
-                "  my unspent token:\n"
-                "  reissue data:\n"
-                "  token metadata map:\n"
-                "  token metadata list (est):\n"
-                "  dirty cache (est):\n"
+                "  token total:\n"
+                "  token data:\n"
+                "    token address balance:\n"
+                "    reissue data:\n"
+                "  reissue tracking (memory only):\n"
+                "  token metadata cache:\n"
+                "  token metadata cache stats:\n"
+                "    hits:\n"
+                "    misses:\n"
+                "    evictions:\n"
+                "  verifier cache:\n"
+                "  qualifier cache:\n"
+                "  restriction cache:\n"
+                "  global restriction cache:\n"
+                "  dirty cache:\n"
+                "  cache budget:\n"
+                "    utxo budget at startup:\n"
+                "    utxo budget:\n"
+                "    grows:\n"
+                "    shrinks:\n"
+                "    last decision time:\n"
+                "    last decision:\n"
+                "    caches: [\n"
+                "      {name, entries at startup, entries, bytes taken from utxo budget, hit rate}\n"
+                "    ]\n"
 
 
                 "]\n"
@@ -2578,19 +2928,55 @@ UniValue getcacheinfo(const JSONRPCRequest& request)
 
     UniValue info(UniValue::VOBJ);
     info.push_back(Pair("uxto cache size", (int)pcoinsTip->DynamicMemoryUsage()));
-    info.push_back(Pair("token total (exclude dirty)", (int)currentActiveTokenCache->DynamicMemoryUsage()));
+    info.push_back(Pair("token total", (int)currentActiveTokenCache->DynamicMemoryUsage()));
+
+    size_t nReissueDataUsage = memusage::DynamicUsage(currentActiveTokenCache->mapReissuedTokenData);
+    for (const auto& item : currentActiveTokenCache->mapReissuedTokenData)
+        nReissueDataUsage += memusage::DynamicUsage(item.first) + memusage::DynamicUsage(item.second);
 
     UniValue descendants(UniValue::VOBJ);
 
-    descendants.push_back(Pair("token address balance",   (int)memusage::DynamicUsage(currentActiveTokenCache->mapTokensAddressAmount)));
-    descendants.push_back(Pair("reissue data",   (int)memusage::DynamicUsage(currentActiveTokenCache->mapReissuedTokenData)));
+    descendants.push_back(Pair("token address balance",   (int)memusage::DeepDynamicUsage(currentActiveTokenCache->mapTokensAddressAmount)));
+    descendants.push_back(Pair("reissue data",   (int)nReissueDataUsage));
 
     info.push_back(Pair("reissue tracking (memory only)", (int)memusage::DynamicUsage(mapReissuedTokens) + (int)memusage::DynamicUsage(mapReissuedTx)));
     info.push_back(Pair("token data", descendants));
-    info.push_back(Pair("token metadata map",  (int)memusage::DynamicUsage(ptokensCache->GetItemsMap())));
-    info.push_back(Pair("token metadata list (est)",  (int)ptokensCache->GetItemsList().size() * (32 + 80))); // Max 32 bytes for token name, 80 bytes max for token data
-    info.push_back(Pair("dirty cache (est)",  (int)currentActiveTokenCache->GetCacheSize()));
-    info.push_back(Pair("dirty cache V2 (est)",  (int)currentActiveTokenCache->GetCacheSizeV2()));
+    info.push_back(Pair("token metadata cache",  (int)ptokensCache->DynamicMemoryUsage()));
+
+    UniValue stats(UniValue::VOBJ);
+    stats.push_back(Pair("hits", (uint64_t)ptokensCache->Hits()));
+    stats.push_back(Pair("misses", (uint64_t)ptokensCache->Misses()));
+    stats.push_back(Pair("evictions", (uint64_t)ptokensCache->Evictions()));
+    info.push_back(Pair("token metadata cache stats", stats));
+
+    info.push_back(Pair("verifier cache",  ptokensVerifierCache ? (int)ptokensVerifierCache->DynamicMemoryUsage() : 0));
+    info.push_back(Pair("qualifier cache",  ptokensQualifierCache ? (int)ptokensQualifierCache->DynamicMemoryUsage() : 0));
+    info.push_back(Pair("restriction cache",  ptokensRestrictionCache ? (int)ptokensRestrictionCache->DynamicMemoryUsage() : 0));
+    info.push_back(Pair("global restriction cache",  ptokensGlobalRestrictionCache ? (int)ptokensGlobalRestrictionCache->DynamicMemoryUsage() : 0));
+    info.push_back(Pair("dirty cache",  (int)currentActiveTokenCache->GetCacheSize()));
+
+    CCacheBudgetStats budgetStats;
+    GetCacheBudgetStats(budgetStats);
+    UniValue budget(UniValue::VOBJ);
+    budget.push_back(Pair("utxo budget at startup", budgetStats.nInitialCoinBudget));
+    budget.push_back(Pair("utxo budget", budgetStats.nCoinBudget));
+    budget.push_back(Pair("grows", budgetStats.nGrows));
+    budget.push_back(Pair("shrinks", budgetStats.nShrinks));
+    budget.push_back(Pair("last decision time", budgetStats.nLastDecisionTime));
+    budget.push_back(Pair("last decision", budgetStats.strLastDecision));
+    UniValue caches(UniValue::VARR);
+    for (const CCacheBudgetEntry& entry : budgetStats.vCaches) {
+        UniValue cache(UniValue::VOBJ);
+        cache.push_back(Pair("name", entry.strName));
+        cache.push_back(Pair("entries at startup", (uint64_t)entry.nBaseSize));
+        cache.push_back(Pair("entries", (uint64_t)entry.nMaxSize));
+        cache.push_back(Pair("bytes taken from utxo budget", entry.nBytesTaken));
+        if (entry.dHitRate >= 0)
+            cache.push_back(Pair("hit rate", entry.dHitRate));
+        caches.push_back(cache);
+    }
+    budget.push_back(Pair("caches", caches));
+    info.push_back(Pair("cache budget", budget));
 
     result.push_back(info);
     return result;
@@ -2793,25 +3179,77 @@ UniValue unfreezerestrictedtoken(const JSONRPCRequest& request)
 }
 #endif
 
+//! Whether a restricted token listing was given the (count) or (after) paging arguments
+static bool IsRestrictedListPaged(const JSONRPCRequest& request)
+{
+    return request.params.size() > 1;
+}
+
+//! Read the optional (count) (after) paging arguments shared by the restricted token listings
+static void ParseRestrictedListPaging(const JSONRPCRequest& request, size_t& count, std::string& after)
+{
+    count = INT_MAX;
+    if (request.params.size() > 1) {
+        if (request.params[1].get_int() < 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be greater than 1.");
+        count = request.params[1].get_int();
+    }
+
+    after.clear();
+    if (request.params.size() > 2)
+        after = request.params[2].get_str();
+}
+
+//! The whole listing as an array, or with paging arguments one page and the cursor of the next
+static UniValue RestrictedListToJSON(const JSONRPCRequest& request, const std::vector<std::string>& entries, const std::string& next)
+{
+    UniValue results(UniValue::VARR);
+    for (const auto& item : entries)
+        results.push_back(item);
+
+    if (!IsRestrictedListPaged(request))
+        return results;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("results", results));
+    if (!next.empty())
+        ret.push_back(Pair("next", next));
+    return ret;
+}
+
+static const std::string RESTRICTED_LIST_PAGING_ARGS =
+        "2. \"count\"            (integer, optional, MAX=50000) return a page of at most _count_ entries\n"
+        "3. \"after\"            (string, optional) resume after this entry, the \"next\" of the previous page\n";
+
+static const std::string RESTRICTED_LIST_PAGED_RESULT =
+        "\nResult with count or after:\n"
+        "{\n"
+        "  \"results\": [ ... ],  (array) The entries of this page, as above\n"
+        "  \"next\": \"entry\",     (string) Pass as after to get the following page, absent on the last page\n"
+        "}\n";
+
 UniValue listtagsforaddress(const JSONRPCRequest &request)
 {
-    if (request.fHelp || !AreRestrictedTokensDeployed() || request.params.size() !=1)
+    if (request.fHelp || !AreRestrictedTokensDeployed() || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-                "listtagsforaddress address\n"
+                "listtagsforaddress address (count) (\"after\")\n"
                 + RestrictedActivationWarning() +
                 "\nList all tags assigned to an address\n"
 
                 "\nArguments:\n"
                 "1. \"address\"          (string, required) the address to list tags for\n"
+                + RESTRICTED_LIST_PAGING_ARGS +
 
                 "\nResult:\n"
                 "["
                 "\"tag_name\",        (string) The tag name\n"
                 "...,\n"
                 "]\n"
+                + RESTRICTED_LIST_PAGED_RESULT +
 
                 "\nExamples:\n"
                 + HelpExampleCli("listtagsforaddress", "\"address\"")
+                + HelpExampleCli("listtagsforaddress", "\"address\" 100 \"#LAST_TAG\"")
                 + HelpExampleRpc("listtagsforaddress", "\"address\"")
         );
 
@@ -2825,40 +3263,44 @@ UniValue listtagsforaddress(const JSONRPCRequest &request)
     if (!IsValidDestination(dest))
         throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Not valid PLB address: ") + address);
 
+    size_t count;
+    std::string after;
+    ParseRestrictedListPaging(request, count, after);
+
     std::vector<std::string> qualifiers;
+    std::string next;
 
     // This function forces a FlushStateToDisk so that a database scan and occur
-    if (!prestricteddb->GetAddressQualifiers(address, qualifiers)) {
+    bool fFound = IsRestrictedListPaged(request) ? prestricteddb->GetAddressQualifiersFrom(address, after, count, qualifiers, next) : prestricteddb->GetAddressQualifiers(address, qualifiers);
+    if (!fFound) {
         throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to search the database");
     }
 
-    UniValue ret(UniValue::VARR);
-    for (auto item : qualifiers) {
-        ret.push_back(item);
-    }
-
-    return ret;
+    return RestrictedListToJSON(request, qualifiers, next);
 }
 
 UniValue listaddressesfortag(const JSONRPCRequest& request)
 {
-    if (request.fHelp || !AreRestrictedTokensDeployed() || request.params.size() !=1)
+    if (request.fHelp || !AreRestrictedTokensDeployed() || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-                "listaddressesfortag tag_name\n"
+                "listaddressesfortag tag_name (count) (\"after\")\n"
                 + RestrictedActivationWarning() +
                 "\nList all addresses that have been assigned a given tag\n"
 
                 "\nArguments:\n"
                 "1. \"tag_name\"          (string, required) the tag token name to search for\n"
+                + RESTRICTED_LIST_PAGING_ARGS +
 
                 "\nResult:\n"
                 "["
                 "\"address\",        (string) The address\n"
                 "...,\n"
                 "]\n"
+                + RESTRICTED_LIST_PAGED_RESULT +
 
                 "\nExamples:\n"
                 + HelpExampleCli("listaddressesfortag", "\"#TAG\"")
+                + HelpExampleCli("listaddressesfortag", "\"#TAG\" 100 \"LAST_ADDRESS\"")
                 + HelpExampleRpc("listaddressesfortag", "\"#TAG\"")
         );
 
@@ -2870,41 +3312,44 @@ UniValue listaddressesfortag(const JSONRPCRequest& request)
     if (!IsTokenNameAQualifier(qualifier_name))
         throw JSONRPCError(RPC_INVALID_PARAMETER, "You must use qualifier token names only, qualifier tokens start with '#'");
 
+    size_t count;
+    std::string after;
+    ParseRestrictedListPaging(request, count, after);
 
     std::vector<std::string> addresses;
+    std::string next;
 
     // This function forces a FlushStateToDisk so that a database scan and occur
-    if (!prestricteddb->GetQualifierAddresses(qualifier_name, addresses)) {
+    bool fFound = IsRestrictedListPaged(request) ? prestricteddb->GetQualifierAddressesFrom(qualifier_name, after, count, addresses, next) : prestricteddb->GetQualifierAddresses(qualifier_name, addresses);
+    if (!fFound) {
         throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to search the database");
     }
 
-    UniValue ret(UniValue::VARR);
-    for (auto item : addresses) {
-        ret.push_back(item);
-    }
-
-    return ret;
+    return RestrictedListToJSON(request, addresses, next);
 }
 
 UniValue listaddressrestrictions(const JSONRPCRequest& request)
 {
-    if (request.fHelp || !AreRestrictedTokensDeployed() || request.params.size() !=1)
+    if (request.fHelp || !AreRestrictedTokensDeployed() || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-                "listaddressrestrictions address\n"
+                "listaddressrestrictions address (count) (\"after\")\n"
                 + RestrictedActivationWarning() +
                 "\nList all tokens that have frozen this address\n"
 
                 "\nArguments:\n"
                 "1. \"address\"          (string), required) the address to list restrictions for\n"
+                + RESTRICTED_LIST_PAGING_ARGS +
 
                 "\nResult:\n"
                 "["
                 "\"token_name\",        (string) The restriction name\n"
                 "...,\n"
                 "]\n"
+                + RESTRICTED_LIST_PAGED_RESULT +
 
                 "\nExamples:\n"
                 + HelpExampleCli("listaddressrestrictions", "\"address\"")
+                + HelpExampleCli("listaddressrestrictions", "\"address\" 100 \"$LAST_TOKEN\"")
                 + HelpExampleRpc("listaddressrestrictions", "\"address\"")
         );
 
@@ -2918,18 +3363,19 @@ UniValue listaddressrestrictions(const JSONRPCRequest& request)
     if (!IsValidDestination(dest))
         throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Not valid PLB address: ") + address);
 
+    size_t count;
+    std::string after;
+    ParseRestrictedListPaging(request, count, after);
+
     std::vector<std::string> restrictions;
+    std::string next;
 
-    if (!prestricteddb->GetAddressRestrictions(address, restrictions)) {
+    bool fFound = IsRestrictedListPaged(request) ? prestricteddb->GetAddressRestrictionsFrom(address, after, count, restrictions, next) : prestricteddb->GetAddressRestrictions(address, restrictions);
+    if (!fFound) {
         throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to search the database");
     }
 
-    UniValue ret(UniValue::VARR);
-    for (auto item : restrictions) {
-        ret.push_back(item);
-    }
-
-    return ret;
+    return RestrictedListToJSON(request, restrictions, next);
 }
 
 UniValue listglobalrestrictions(const JSONRPCRequest& request)
@@ -3771,6 +4217,155 @@ UniValue isvalidverifierstring(const JSONRPCRequest& request)
     return _("Valid Verifier");
 }
 
+UniValue listmempooltokenoutputs(const JSONRPCRequest& request)
+{
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+                "listmempooltokenoutputs \"token_name\" ( \"address\" )\n"
+                + TokenActivationWarning() +
+                "\nReturns the unconfirmed token outputs in the mempool of a token, of a token to an address, or of any token to an address\n"
+
+                "\nArguments:\n"
+                "1. \"token_name\"               (string, required) the name of the token, or \"\" for every token sent to the address\n"
+                "2. \"address\"                  (string, optional) only return the outputs to this address\n"
+
+                "\nResult:\n"
+                "[\n"
+                "  {\n"
+                "    \"token_name\": (string),\n"
+                "    \"address\": (string),\n"
+                "    \"txid\": (string),\n"
+                "    \"vout\": (number),\n"
+                "    \"amount\": (number)\n"
+                "  },...\n"
+                "]\n"
+
+                "\nExamples:\n"
+                + HelpExampleCli("listmempooltokenoutputs", "\"TOKEN_NAME\"")
+                + HelpExampleCli("listmempooltokenoutputs", "\"\" \"ADDRESS\"")
+                + HelpExampleRpc("listmempooltokenoutputs", "\"TOKEN_NAME\", \"ADDRESS\"")
+        );
+
+    std::string token_name = request.params[0].get_str();
+    std::string address;
+    if (request.params.size() > 1)
+        address = request.params[1].get_str();
+
+    if (!address.empty() && !IsValidDestinationString(address))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + address);
+    if (token_name.empty() && address.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Either a token name or an address is required");
+
+    std::vector<CTokenOutputIndex::Output> vOutputs;
+    {
+        LOCK(mempool.cs);
+        vOutputs = token_name.empty() ? mempool.tokenOutputIndex.GetByAddress(address) : mempool.tokenOutputIndex.GetByToken(token_name, address);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const auto& output : vOutputs) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("token_name", output.strToken));
+        entry.push_back(Pair("address", output.strAddress));
+        entry.push_back(Pair("txid", output.outpoint.hash.GetHex()));
+        entry.push_back(Pair("vout", (int)output.outpoint.n));
+        entry.push_back(Pair("amount", UnitValueFromAmount(output.nAmount, output.strToken)));
+        result.push_back(entry);
+    }
+
+    return result;
+}
+
+UniValue gettokentransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() < 1 || request.params.size() > 4)
+        throw std::runtime_error(
+                "gettokentransactions \"token_name\" ( start_height count skip )\n"
+                + TokenActivationWarning() +
+                "\nReturns the token outputs the confirmed transactions created and spent of a token, by height. Needs -tokentxindex.\n"
+
+                "\nArguments:\n"
+                "1. \"token_name\"               (string, required) the name of the token\n"
+                "2. \"start_height\"             (integer, optional, default=0) the height to start from\n"
+                "3. \"count\"                    (integer, optional, default=1000, MAX=" + std::to_string(MAX_TOKEN_TRANSACTIONS_COUNT) + ") the most entries to return\n"
+                "4. \"skip\"                     (integer, optional, default=0) skip over the first _skip_ entries from start_height on\n"
+
+                "\nResult:\n"
+                "{\n"
+                "  \"indexed_height\": (number)  the last block in the index, the entries are complete up to it\n"
+                "  \"transactions\": [\n"
+                "    {\n"
+                "      \"txid\": (string),\n"
+                "      \"height\": (number),\n"
+                "      \"direction\": (string)    \"received\" for an output of the transaction, \"sent\" for an output one of its inputs spent\n"
+                "      \"vout\": (number)         the output, for received\n"
+                "      \"vin\": (number)          the input, for sent\n"
+                "      \"address\": (string)      the address of the output\n"
+                "      \"amount\": (number)\n"
+                "    },...\n"
+                "  ]\n"
+                "}\n"
+
+                "\nExamples:\n"
+                + HelpExampleCli("gettokentransactions", "\"TOKEN_NAME\"")
+                + HelpExampleCli("gettokentransactions", "\"TOKEN_NAME\" 1000 100 0")
+                + HelpExampleRpc("gettokentransactions", "\"TOKEN_NAME\", 1000, 100, 0")
+        );
+
+    if (!ptokentxindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "The token transaction index is not enabled, start with -tokentxindex");
+
+    std::string token_name = request.params[0].get_str();
+
+    int nStartHeight = 0;
+    if (request.params.size() > 1) {
+        nStartHeight = request.params[1].get_int();
+        if (nStartHeight < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "start_height must not be negative.");
+    }
+
+    int count = 1000;
+    if (request.params.size() > 2) {
+        count = request.params[2].get_int();
+        if (count < 1 || count > MAX_TOKEN_TRANSACTIONS_COUNT)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 1 and %d.", MAX_TOKEN_TRANSACTIONS_COUNT));
+    }
+
+    int skip = 0;
+    if (request.params.size() > 3) {
+        skip = request.params[3].get_int();
+        if (skip < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "skip must not be negative.");
+    }
+
+    const int8_t units = TokenDisplayUnits(token_name);
+    // Taken before the entries are read, so it never claims more than they hold
+    const int nIndexedHeight = GetTokenTxIndexHeight();
+    UniValue transactions(UniValue::VARR);
+    bool fOk = ptokentxindex->Walk(token_name, nStartHeight, [&](const CTokenTxIndexKey& key, const CTokenTxIndexValue& value) {
+        if (skip > 0) {
+            skip--;
+            return true;
+        }
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", key.txid.GetHex()));
+        entry.push_back(Pair("height", key.nHeight));
+        entry.push_back(Pair("direction", key.fSpend ? "sent" : "received"));
+        entry.push_back(Pair(key.fSpend ? "vin" : "vout", (int64_t)key.n));
+        entry.push_back(Pair("address", value.strAddress));
+        entry.push_back(Pair("amount", ValueFromAmount(value.nAmount, units)));
+        transactions.push_back(entry);
+        return (int)transactions.size() < count;
+    });
+    if (!fOk)
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Couldn't read the token transaction index");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("indexed_height", nIndexedHeight));
+    result.push_back(Pair("transactions", transactions));
+    return result;
+}
+
 UniValue getsnapshot(const JSONRPCRequest& request)
 {
     if (request.fHelp || !AreTokensDeployed() || request.params.size() < 2)
@@ -3891,17 +4486,20 @@ static const CRPCCommand commands[] =
     { "tokens",   "listmytokens",               &listmytokens,               {"token", "verbose", "count", "start", "confs"}},
     { "tokens",   "listmylockedtokens",         &listmylockedtokens,         {"token", "verbose", "count", "start"}},
 #endif
-    { "tokens",   "listtokenbalancesbyaddress", &listtokenbalancesbyaddress, {"address", "onlytotal", "count", "start"} },
+    { "tokens",   "listtokenbalancesbyaddress", &listtokenbalancesbyaddress, {"address", "onlytotal", "count", "start", "after"} },
+    { "tokens",   "getaddressestokenbalances",  &getaddressestokenbalances,  {"addresses"} },
     { "tokens",   "gettokendata",               &gettokendata,               {"token_name"}},
-    { "tokens",   "listaddressesbytoken",       &listaddressesbytoken,       {"token_name", "onlytotal", "count", "start"}},
+    { "tokens",   "listaddressesbytoken",       &listaddressesbytoken,       {"token_name", "onlytotal", "count", "start", "after"}},
 #ifdef ENABLE_WALLET
     { "tokens",   "transferfromaddress",        &transferfromaddress,        {"token_name", "from_address", "qty", "to_address", "timelock", "message", "token_message", "expire_time", "paladeum_change_address", "token_change_address"}},
     { "tokens",   "transferfromaddresses",      &transferfromaddresses,      {"token_name", "from_addresses", "qty", "to_address", "timelock", "message", "token_message", "expire_time", "paladeum_change_address", "token_change_address"}},
     { "tokens",   "transfer",                   &transfer,                   {"token_name", "qty", "to_address", "timelock", "message", "token_message", "expire_time", "change_address", "token_change_address"}},
+    { "tokens",   "sendmanytokens",             &sendmanytokens,             {"transfers", "message", "change_address", "token_change_address"}},
     { "tokens",   "reissue",                    &reissue,                    {"token_name", "qty", "to_address", "change_address", "reissuable", "new_units", "new_ipfs"}},
     { "tokens",   "sweep",                      &sweep,                      {"privkey", "token_name"}},
 #endif
     { "tokens",   "listtokens",                 &listtokens,                 {"token", "verbose", "count", "start"}},
+    { "tokens",   "gettokensupplyinfo",         &gettokensupplyinfo,         {"token_name"}},
     { "tokens",   "getcacheinfo",               &getcacheinfo,               {}},
 
 #ifdef ENABLE_WALLET
@@ -3916,9 +4514,9 @@ static const CRPCCommand commands[] =
     { "restricted tokens",   "freezerestrictedtoken",      &freezerestrictedtoken,      {"token_name", "change_address", "token_data"}},
     { "restricted tokens",   "unfreezerestrictedtoken",    &unfreezerestrictedtoken,    {"token_name", "change_address", "token_data"}},
 #endif
-    { "restricted tokens",   "listaddressesfortag",        &listaddressesfortag,        {"tag_name"}},
-    { "restricted tokens",   "listtagsforaddress",         &listtagsforaddress,         {"address"}},
-    { "restricted tokens",   "listaddressrestrictions",    &listaddressrestrictions,    {"address"}},
+    { "restricted tokens",   "listaddressesfortag",        &listaddressesfortag,        {"tag_name", "count", "after"}},
+    { "restricted tokens",   "listtagsforaddress",         &listtagsforaddress,         {"address", "count", "after"}},
+    { "restricted tokens",   "listaddressrestrictions",    &listaddressrestrictions,    {"address", "count", "after"}},
     { "restricted tokens",   "listglobalrestrictions",     &listglobalrestrictions,     {}},
     { "restricted tokens",   "getverifierstring",          &getverifierstring,          {"restricted_name"}},
     { "restricted tokens",   "checkaddresstag",            &checkaddresstag,            {"address", "tag_name"}},
@@ -3926,6 +4524,8 @@ static const CRPCCommand commands[] =
     { "restricted tokens",   "checkglobalrestriction",     &checkglobalrestriction,     {"restricted_name"}},
     { "restricted tokens",   "isvalidverifierstring",      &isvalidverifierstring,      {"verifier_string"}},
 
+    { "tokens",   "listmempooltokenoutputs",    &listmempooltokenoutputs,    {"token_name", "address"}},
+    { "tokens",   "gettokentransactions",       &gettokentransactions,       {"token_name", "start_height", "count", "skip"}},
     { "tokens",   "getsnapshot",                &getsnapshot,                {"token_name", "block_height"}},
     { "tokens",   "purgesnapshot",              &purgesnapshot,              {"token_name", "block_height"}},
 };
@@ -8,13 +8,14 @@
 #include "random.h"
 #include "reverselock.h"
 
+#include <algorithm>
 #include <assert.h>
 // Fixing Boost 1.73 compile errors
 #include <boost/bind/bind.hpp>
 using namespace boost::placeholders;
 #include <utility>
 
-CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
+CScheduler::CScheduler() : nThreadsServicingQueue(0), nThreadsRunningLowerPriority(0), stopRequested(false), stopWhenEmpty(false)
 {
 }
 
@@ -33,6 +34,44 @@ static boost::system_time toPosixTime(const boost::chrono::system_clock::time_po
 }
 #endif
 
+bool CScheduler::empty() const
+{
+    for (int priority = 0; priority < NUM_PRIORITIES; priority++) {
+        if (!taskQueue[priority].empty())
+            return false;
+    }
+    return true;
+}
+
+int CScheduler::nextTask(boost::chrono::system_clock::time_point &t) const
+{
+    // Keep a thread for high priority tasks, unless this is the only one
+    const bool fLowerAllowed = nThreadsServicingQueue == 1 || nThreadsRunningLowerPriority + 1 < nThreadsServicingQueue;
+    const boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+
+    int next = NUM_PRIORITIES;
+    for (int priority = 0; priority < NUM_PRIORITIES; priority++) {
+        if (taskQueue[priority].empty() || (priority != PRIORITY_HIGH && !fLowerAllowed))
+            continue;
+        const boost::chrono::system_clock::time_point& time = taskQueue[priority].begin()->first;
+        // A task that is due goes before the tasks of lower priorities, whenever those were due
+        if (time <= now) {
+            t = time;
+            return priority;
+        }
+        if (next == NUM_PRIORITIES || time < t) {
+            t = time;
+            next = priority;
+        }
+    }
+    return next;
+}
+
+static int64_t MicrosSince(const boost::chrono::system_clock::time_point& t, const boost::chrono::system_clock::time_point& now)
+{
+    return std::max<int64_t>(0, boost::chrono::duration_cast<boost::chrono::microseconds>(now - t).count());
+}
+
 void CScheduler::serviceQueue()
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
@@ -43,48 +82,82 @@ void CScheduler::serviceQueue()
     // is called.
     while (!shouldStop()) {
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && empty()) {
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 // Use this chance to get a tiny bit more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
+            while (!shouldStop() && empty()) {
                 // Wait until there is something to do.
                 newTaskScheduled.wait(lock);
             }
 
             // Wait until either there is a new task, or until
-            // the time of the first item on the queue:
+            // the time of the first task this thread may run:
+            int priority = NUM_PRIORITIES;
+            boost::chrono::system_clock::time_point timeToWaitFor;
+            while (!shouldStop() && !empty()) {
+                priority = nextTask(timeToWaitFor);
+                if (priority == NUM_PRIORITIES) {
+                    // Only lower priority tasks are left and the other threads
+                    // are running those, wait for one of them to finish
+                    newTaskScheduled.wait(lock);
+                    continue;
+                }
+                if (timeToWaitFor <= boost::chrono::system_clock::now())
+                    break;
+                priority = NUM_PRIORITIES;
 
 // wait_until needs boost 1.50 or later; older versions have timed_wait:
 #if BOOST_VERSION < 105000
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.timed_wait(lock, toPosixTime(taskQueue.begin()->first))) {
-                // Keep waiting until timeout
-            }
+                newTaskScheduled.timed_wait(lock, toPosixTime(timeToWaitFor));
 #else
-            // Some boost versions have a conflicting overload of wait_until that returns void.
-            // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
-                boost::chrono::system_clock::time_point timeToWaitFor = taskQueue.begin()->first;
-                if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
-                    break; // Exit loop after timeout, it means we reached the time of the event
-            }
+                // Some boost versions have a conflicting overload of wait_until that returns void.
+                // Explicitly use a template here to avoid hitting that overload.
+                newTaskScheduled.wait_until<>(lock, timeToWaitFor);
 #endif
+            }
             // If there are multiple threads, the queue can empty while we're waiting (another
             // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (shouldStop() || priority == NUM_PRIORITIES)
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            Function f = taskQueue[priority].begin()->second;
+            taskQueue[priority].erase(taskQueue[priority].begin());
+
+            // Counted while the task runs, and uncounted with the lock held again even if it throws
+            struct LowerPriorityTask {
+                CScheduler* scheduler;
+                bool fLower;
+                LowerPriorityTask(CScheduler* _scheduler, bool _fLower) : scheduler(_scheduler), fLower(_fLower) {
+                    if (fLower)
+                        ++scheduler->nThreadsRunningLowerPriority;
+                }
+                ~LowerPriorityTask() {
+                    if (fLower) {
+                        --scheduler->nThreadsRunningLowerPriority;
+                        scheduler->newTaskScheduled.notify_one();
+                    }
+                }
+            } lowerPriorityTask(this, priority != PRIORITY_HIGH);
 
+            const boost::chrono::system_clock::time_point timeStart = boost::chrono::system_clock::now();
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 f();
             }
+            const boost::chrono::system_clock::time_point timeEnd = boost::chrono::system_clock::now();
+
+            PriorityStats& stats = priorityStats[priority];
+            const int64_t nDelayMicros = MicrosSince(timeToWaitFor, timeStart);
+            const int64_t nRunMicros = MicrosSince(timeStart, timeEnd);
+            stats.nTasks++;
+            stats.nTotalDelayMicros += nDelayMicros;
+            stats.nMaxDelayMicros = std::max(stats.nMaxDelayMicros, nDelayMicros);
+            stats.nTotalRunMicros += nRunMicros;
+            stats.nMaxRunMicros = std::max(stats.nMaxRunMicros, nRunMicros);
         } catch (...) {
             --nThreadsServicingQueue;
             throw;
@@ -106,43 +179,58 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Priority priority)
 {
+    assert(priority >= 0 && priority < NUM_PRIORITIES);
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue[priority].insert(std::make_pair(t, f));
     }
     newTaskScheduled.notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds), priority);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds, CScheduler::Priority priority)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds), deltaMilliSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds, priority), deltaMilliSeconds, priority);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds), deltaMilliSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds, priority), deltaMilliSeconds, priority);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    for (int priority = 0; priority < NUM_PRIORITIES; priority++) {
+        if (taskQueue[priority].empty())
+            continue;
+        if (result == 0 || taskQueue[priority].begin()->first < first)
+            first = taskQueue[priority].begin()->first;
+        if (result == 0 || taskQueue[priority].rbegin()->first > last)
+            last = taskQueue[priority].rbegin()->first;
+        result += taskQueue[priority].size();
     }
     return result;
 }
 
+std::vector<CScheduler::PriorityStats> CScheduler::getPriorityStats() const
+{
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    std::vector<PriorityStats> result(priorityStats, priorityStats + NUM_PRIORITIES);
+    for (int priority = 0; priority < NUM_PRIORITIES; priority++)
+        result[priority].nQueued = taskQueue[priority].size();
+    return result;
+}
+
 bool CScheduler::AreThreadsServicingQueue() const {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
     return nThreadsServicingQueue;
@@ -158,7 +246,7 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         if (m_are_callbacks_running) return;
         if (m_callbacks_pending.empty()) return;
     }
-    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this));
+    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now(), m_priority);
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
@@ -14,6 +14,7 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
 #include <map>
+#include <vector>
 
 #include "sync.h"
 
@@ -35,6 +36,10 @@
 // delete s; // Must be done after thread is interrupted/joined.
 //
 
+//! Threads servicing the scheduler queue, see -schedulerthreads
+static const int DEFAULT_SCHEDULER_THREADS = 2;
+static const int MAX_SCHEDULER_THREADS = 8;
+
 class CScheduler
 {
 public:
@@ -43,18 +48,38 @@ public:
 
     typedef std::function<void(void)> Function;
 
+    // Tasks that are due run in priority order. When more than one
+    // thread services the queue, one of them is kept for PRIORITY_HIGH
+    // tasks, so a slow task of a lower priority cannot hold those up.
+    enum Priority {
+        PRIORITY_HIGH,
+        PRIORITY_NORMAL,
+        PRIORITY_LOW,
+        NUM_PRIORITIES
+    };
+
+    // What the tasks of a priority waited and ran for, since the scheduler was created
+    struct PriorityStats {
+        size_t nQueued = 0;
+        uint64_t nTasks = 0;
+        int64_t nTotalDelayMicros = 0; // from the time a task was due to the time it started
+        int64_t nMaxDelayMicros = 0;
+        int64_t nTotalRunMicros = 0;
+        int64_t nMaxRunMicros = 0;
+    };
+
     // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now());
+    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now(), Priority priority=PRIORITY_NORMAL);
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    void scheduleFromNow(Function f, int64_t deltaMilliSeconds, Priority priority=PRIORITY_NORMAL);
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaMilliSeconds);
+    void scheduleEvery(Function f, int64_t deltaMilliSeconds, Priority priority=PRIORITY_NORMAL);
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -72,17 +97,25 @@ public:
     size_t getQueueInfo(boost::chrono::system_clock::time_point &first,
                         boost::chrono::system_clock::time_point &last) const;
 
+    // Returns the queue depth and task latencies, indexed by Priority
+    std::vector<PriorityStats> getPriorityStats() const;
+
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue[NUM_PRIORITIES];
+    PriorityStats priorityStats[NUM_PRIORITIES];
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
+    int nThreadsRunningLowerPriority; // threads running a task below PRIORITY_HIGH
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() const { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool empty() const;
+    bool shouldStop() const { return stopRequested || (stopWhenEmpty && empty()); }
+    // The priority of the next task this thread may run and when it is due, NUM_PRIORITIES if there is none
+    int nextTask(boost::chrono::system_clock::time_point &t) const;
 };
 
 /**
@@ -94,6 +127,7 @@ private:
 class SingleThreadedSchedulerClient {
 private:
     CScheduler *m_pscheduler;
+    const CScheduler::Priority m_priority;
 
     CCriticalSection m_cs_callbacks_pending;
     std::list<std::function<void (void)>> m_callbacks_pending;
@@ -103,7 +137,8 @@ private:
     void ProcessQueue();
 
 public:
-    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn) : m_pscheduler(pschedulerIn) {}
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn, CScheduler::Priority priorityIn = CScheduler::PRIORITY_NORMAL)
+        : m_pscheduler(pschedulerIn), m_priority(priorityIn) {}
     void AddToProcessQueue(std::function<void (void)> func);
 
     // Processes all remaining queue members on the calling thread, blocking until queue is empty
@@ -298,7 +298,132 @@ bool static CheckMinimalPush(const valtype &data, opcodetype opcode)
     return true;
 }
 
+namespace
+{
+
+    bool IsPayToPublicKeyHashAt(const CScript &script, size_t n)
+    {
+        return script.size() >= n + 25 &&
+               script[n] == OP_DUP &&
+               script[n + 1] == OP_HASH160 &&
+               script[n + 2] == 0x14 &&
+               script[n + 23] == OP_EQUALVERIFY &&
+               script[n + 24] == OP_CHECKSIG;
+    }
+
+    /**
+     * Matches what may follow the standard part of an output script: nothing, or
+     * OP_PLB_TOKEN and the token data. GetOp reads everything after OP_PLB_TOKEN
+     * as its data, so nTokenData is what the interpreter would push, -1 without a token.
+     */
+    bool MatchTokenSuffix(const CScript &script, CScript::const_iterator pc, int64_t &nTokenData)
+    {
+        nTokenData = -1;
+        if (pc == script.end())
+            return true;
+        if (*pc != OP_PLB_TOKEN)
+            return false;
+        nTokenData = script.end() - pc - 1;
+        return true;
+    }
+
+    /** DUP HASH160 <hash> EQUALVERIFY CHECKSIG over a stack with at least two elements */
+    bool EvalPayToPublicKeyHash(std::vector<valtype> &stack, const CScript &script, CScript::const_iterator pHash, unsigned int flags, const BaseSignatureChecker &checker, ScriptError *serror)
+    {
+        static const valtype vchFalse(0);
+        static const valtype vchTrue(1, 1);
+
+        valtype &vchSig = stacktop(-2);
+        valtype &vchPubKey = stacktop(-1);
+
+        unsigned char vchHash[20];
+        CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(vchHash);
+        if (!std::equal(vchHash, vchHash + sizeof(vchHash), pHash))
+            return set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+
+        CScript scriptCode(script.begin(), script.end());
+        scriptCode.FindAndDelete(CScript(vchSig));
+
+        if (!CheckSignatureEncoding(vchSig, flags, serror) ||
+            !CheckPubKeyEncoding(vchPubKey, flags, SIGVERSION_BASE, serror))
+        {
+            //serror is set
+            return false;
+        }
+        bool fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptCode, SIGVERSION_BASE);
+
+        if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
+            return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+
+        popstack(stack);
+        popstack(stack);
+        stack.push_back(fSuccess ? vchTrue : vchFalse);
+        return true;
+    }
+
+    /**
+     * Runs the standard output scripts (P2PKH and P2SH, with or without a token,
+     * and offline staking) without stepping through their opcodes. Returns false
+     * when the script isn't one of them or the stack is too short for it, so the
+     * generic interpreter runs it and reports the error. Otherwise fResult, the
+     * stack and serror end up as EvalScriptGeneric would leave them.
+     */
+    bool EvalStandardScript(std::vector<valtype> &stack, const CScript &script, unsigned int flags, const BaseSignatureChecker &checker, ScriptError *serror, bool &fResult)
+    {
+        static const valtype vchFalse(0);
+        static const valtype vchTrue(1, 1);
+
+        // The generic interpreter checks the stack size after every opcode, these push up to three
+        if (script.size() > MAX_SCRIPT_SIZE || stack.size() + 3 > MAX_STACK_SIZE)
+            return false;
+
+        int64_t nTokenData;
+        if (IsPayToPublicKeyHashAt(script, 0) && MatchTokenSuffix(script, script.begin() + 25, nTokenData)) {
+            if (stack.size() < 2)
+                return false;
+            fResult = EvalPayToPublicKeyHash(stack, script, script.begin() + 3, flags, checker, serror);
+        } else if (script.size() >= 23 && script[0] == OP_HASH160 && script[1] == 0x14 && script[22] == OP_EQUAL &&
+                   MatchTokenSuffix(script, script.begin() + 23, nTokenData)) {
+            if (stack.empty())
+                return false;
+            valtype &vch = stacktop(-1);
+            unsigned char vchHash[20];
+            CHash160().Write(vch.data(), vch.size()).Finalize(vchHash);
+            const bool fEqual = std::equal(vchHash, vchHash + sizeof(vchHash), script.begin() + 2);
+            popstack(stack);
+            stack.push_back(fEqual ? vchTrue : vchFalse);
+            fResult = true;
+        } else if (script.IsOfflineStaking()) {
+            nTokenData = -1;
+            if (stack.size() < 2)
+                return false;
+            // OP_OFFLINE_STAKE OP_IF <staker P2PKH> OP_ELSE <owner P2PKH> OP_ENDIF
+            fResult = EvalPayToPublicKeyHash(stack, script, script.begin() + (checker.IsCoinStake() ? 5 : 31), flags, checker, serror);
+        } else {
+            return false;
+        }
+        if (!fResult)
+            return true;
+
+        // OP_PLB_TOKEN does nothing, only the size of its data is checked
+        if (nTokenData > (int64_t)MAX_SCRIPT_ELEMENT_SIZE)
+            fResult = set_error(serror, SCRIPT_ERR_PUSH_SIZE);
+        else
+            fResult = set_success(serror);
+        return true;
+    }
+
+} // namespace
+
 bool EvalScript(std::vector<std::vector<unsigned char> > &stack, const CScript &script, unsigned int flags, const BaseSignatureChecker &checker, SigVersion sigversion, ScriptError *serror)
+{
+    bool fResult;
+    if (sigversion == SIGVERSION_BASE && EvalStandardScript(stack, script, flags, checker, serror, fResult))
+        return fResult;
+    return EvalScriptGeneric(stack, script, flags, checker, sigversion, serror);
+}
+
+bool EvalScriptGeneric(std::vector<std::vector<unsigned char> > &stack, const CScript &script, unsigned int flags, const BaseSignatureChecker &checker, SigVersion sigversion, ScriptError *serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -204,7 +204,13 @@ bool IsCompressedOrUncompressedPubKey(const std::vector<unsigned char> &vchPubKe
 bool IsLowDERSignature(const std::vector<unsigned char> &vchSig, ScriptError* serror, bool haveHashType = true);
 bool IsDERSignature(const std::vector<unsigned char> &vchSig, ScriptError* serror, bool haveHashType = true);
 
+/**
+ * Runs a script on the stack. Standard P2PKH, P2SH and offline staking scripts,
+ * also with a token, are matched as a whole and skip the opcode loop.
+ */
 bool EvalScript(std::vector<std::vector<unsigned char> > &stack, const CScript &script, unsigned int flags, const BaseSignatureChecker &checker, SigVersion sigversion, ScriptError *error = nullptr);
+/** EvalScript stepping through every opcode, also of the standard scripts */
+bool EvalScriptGeneric(std::vector<std::vector<unsigned char> > &stack, const CScript &script, unsigned int flags, const BaseSignatureChecker &checker, SigVersion sigversion, ScriptError *error = nullptr);
 
 bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey, const CScriptWitness *witness, unsigned int flags, const BaseSignatureChecker &checker, ScriptError *serror = nullptr);
 
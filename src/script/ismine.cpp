@@ -231,6 +231,29 @@ isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey, CBlock
     return ISMINE_NO;
 }
 
+bool GetIsMineFilterHash(const CScript& scriptPubKey, uint160& hash)
+{
+    const size_t nSize = scriptPubKey.size();
+
+    // A token transfer keeps the P2PKH or P2SH script in front of OP_PLB_TOKEN
+    if (nSize >= 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 0x14 &&
+            scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG && (nSize == 25 || scriptPubKey[25] == OP_PLB_TOKEN)) {
+        memcpy(hash.begin(), &scriptPubKey[3], 20);
+        return true;
+    }
+    if (nSize >= 23 && scriptPubKey[0] == OP_HASH160 && scriptPubKey[1] == 0x14 && scriptPubKey[22] == OP_EQUAL &&
+            (nSize == 23 || scriptPubKey[23] == OP_PLB_TOKEN)) {
+        memcpy(hash.begin(), &scriptPubKey[2], 20);
+        return true;
+    }
+    // Compressed or uncompressed key push followed by OP_CHECKSIG
+    if ((nSize == 35 || nSize == 67) && scriptPubKey[0] == nSize - 2 && scriptPubKey[nSize - 1] == OP_CHECKSIG) {
+        hash = CPubKey(scriptPubKey.begin() + 1, scriptPubKey.end() - 1).GetID();
+        return true;
+    }
+    return false;
+}
+
 bool IsTimeLock(const CKeyStore &keystore, const CScript& scriptPubKey, CScriptNum& nLockTime)
 {
     std::vector<valtype> vSolutions;
@@ -42,6 +42,11 @@ isminetype IsMine(const CKeyStore& keystore, const CScript& scriptPubKey, CBlock
 isminetype IsMine(const CKeyStore& keystore, const CTxDestination& dest, CBlockIndex* bestBlock, bool& isInvalid, SigVersion = SIGVERSION_BASE);
 isminetype IsMine(const CKeyStore& keystore, const CTxDestination& dest, CBlockIndex* bestBlock, SigVersion = SIGVERSION_BASE);
 
+/** The 20-byte hash a P2PKH, P2SH or P2PK scriptPubKey pays to, token transfers to them included, found by comparing
+ * bytes instead of running the solver. False for every other script form. IsMine() can only return something other
+ * than ISMINE_NO for these scripts if the keystore holds a key, script or watch-only entry with that hash. */
+bool GetIsMineFilterHash(const CScript& scriptPubKey, uint160& hash);
+
 bool IsTimeLock(const CKeyStore &keystore, const CScript& scriptPubKey, CScriptNum& nLockTime);
 bool IsTimeLock(const CScript& scriptPubKey, CScriptNum& nLockTime);
 
@@ -12,7 +12,9 @@
 #include "uint256.h"
 #include "util.h"
 
+#include "crypto/common.h"
 #include "cuckoocache.h"
+#include <atomic>
 #include <boost/thread.hpp>
 
 namespace {
@@ -30,8 +32,15 @@ private:
     map_type setValid;
     boost::shared_mutex cs_sigcache;
 
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
+    uint32_t nMaxEntries;
+    uint32_t nBaseEntries;
+
 public:
-    CSignatureCache()
+    CSignatureCache() : nHits(0), nMisses(0), nInserts(0), nEvictions(0), nMaxEntries(0), nBaseEntries(0)
     {
         GetRandBytes(nonce.begin(), 32);
     }
@@ -46,20 +55,85 @@ public:
     Get(const uint256& entry, const bool erase)
     {
         boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        const bool fFound = setValid.contains(entry, erase);
+        (fFound ? nHits : nMisses).fetch_add(1, std::memory_order_relaxed);
+        return fFound;
     }
 
     void Set(uint256& entry)
     {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        if (setValid.insert(entry))
+            nEvictions.fetch_add(1, std::memory_order_relaxed);
+        nInserts.fetch_add(1, std::memory_order_relaxed);
     }
     uint32_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nMaxEntries = nBaseEntries = setValid.setup_bytes(n);
+        return nMaxEntries;
+    }
+
+    uint32_t resize(uint32_t nEntries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nMaxEntries = setValid.resize(nEntries);
+        return nMaxEntries;
+    }
+
+    void GetStats(CSignatureCacheStats& stats)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        stats.nHits = nHits.load(std::memory_order_relaxed);
+        stats.nMisses = nMisses.load(std::memory_order_relaxed);
+        stats.nInserts = nInserts.load(std::memory_order_relaxed);
+        stats.nEvictions = nEvictions.load(std::memory_order_relaxed);
+        stats.nMaxEntries = nMaxEntries;
+        stats.nBaseEntries = nBaseEntries;
     }
 };
 
+/**
+ * Public keys parsed for verification. Coinstakes and distributions sign many
+ * inputs with the same few keys, so the script checks of a block keep parsing
+ * them again. Each thread has a cache of its own, so the script check workers
+ * share no lock. Direct mapped on the x coordinate of the key: a key that
+ * lands on a slot in use takes it over.
+ */
+class CParsedPubKeyCache
+{
+private:
+    struct Entry
+    {
+        CPubKey pubkey;
+        CParsedPubKey parsed;
+    };
+    std::vector<Entry> vEntries;
+
+public:
+    static const size_t SIZE = 1024;
+
+    CParsedPubKeyCache() : vEntries(SIZE) {}
+
+    /** The key parsed, nullptr if it is not a valid key */
+    const CParsedPubKey* Get(const CPubKey& pubkey)
+    {
+        if (!pubkey.IsValid())
+            return nullptr;
+        Entry& entry = vEntries[ReadLE32(pubkey.begin() + 1) % SIZE];
+        if (entry.pubkey == pubkey)
+            return &entry.parsed;
+        if (!entry.parsed.Parse(pubkey)) {
+            entry.pubkey = CPubKey();
+            return nullptr;
+        }
+        entry.pubkey = pubkey;
+        return &entry.parsed;
+    }
+};
+
+static boost::thread_specific_ptr<CParsedPubKeyCache> parsedPubKeyCache;
+
 /* In previous versions of this code, signatureCache was a local static variable
  * in CachingTransactionSignatureChecker::VerifySignature.  We initialize
  * signatureCache outside of VerifySignature to avoid the atomic operation per
@@ -81,13 +155,57 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void GetSignatureCacheStats(CSignatureCacheStats& stats)
+{
+    signatureCache.GetStats(stats);
+}
+
+uint32_t ResizeSignatureCache(uint32_t nEntries)
+{
+    return signatureCache.resize(nEntries);
+}
+
+CSignatureCacheStats CSignatureCacheStats::Since(const CSignatureCacheStats& earlier) const
+{
+    CSignatureCacheStats interval(*this);
+    interval.nHits -= earlier.nHits;
+    interval.nMisses -= earlier.nMisses;
+    interval.nInserts -= earlier.nInserts;
+    interval.nEvictions -= earlier.nEvictions;
+    return interval;
+}
+
+CSignatureCacheStats& CSignatureCacheStats::operator+=(const CSignatureCacheStats& other)
+{
+    nHits += other.nHits;
+    nMisses += other.nMisses;
+    nInserts += other.nInserts;
+    nEvictions += other.nEvictions;
+    nMaxEntries = other.nMaxEntries;
+    nBaseEntries = other.nBaseEntries;
+    return *this;
+}
+
+bool ShouldGrowSignatureCache(const CSignatureCacheStats& interval, uint32_t nMaxEntries, uint32_t nBaseEntries)
+{
+    const uint64_t nLookups = interval.nHits + interval.nMisses;
+    const uint64_t nLimit = std::min<uint64_t>((uint64_t)nBaseEntries * SIG_CACHE_AUTOSIZE_MAX_GROWTH,
+                                               ((uint64_t)MAX_MAX_SIG_CACHE_SIZE << 20) / 2 / sizeof(uint256));
+    return nLookups >= SIG_CACHE_AUTOSIZE_MIN_LOOKUPS && interval.nEvictions > 0 &&
+           interval.nHits < SIG_CACHE_AUTOSIZE_TARGET_HIT_RATE * nLookups && 2 * (uint64_t)nMaxEntries <= nLimit;
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
     if (signatureCache.Get(entry, !store))
         return true;
-    if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
+    // Same as TransactionSignatureChecker::VerifySignature, without parsing the key again
+    if (!parsedPubKeyCache.get())
+        parsedPubKeyCache.reset(new CParsedPubKeyCache());
+    const CParsedPubKey* parsed = parsedPubKeyCache->Get(pubkey);
+    if (!parsed || !parsed->Verify(sighash, vchSig))
         return false;
     if (store)
         signatureCache.Set(entry);
@@ -18,8 +18,35 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
+static const bool DEFAULT_SIG_CACHE_AUTOSIZE = false;
+// With -sigcacheautosize, a cache that hit less than this share of the lookups
+// of the blocks connected lately while evicting doubles
+static const double SIG_CACHE_AUTOSIZE_TARGET_HIT_RATE = 0.9;
+// Fewest lookups over the blocks connected lately for the hit rate to count
+static const uint64_t SIG_CACHE_AUTOSIZE_MIN_LOOKUPS = 2000;
+// A cache grows to at most this many times its size at startup
+static const uint32_t SIG_CACHE_AUTOSIZE_MAX_GROWTH = 8;
+
 class CPubKey;
 
+/** Lookups and size of the signature cache or the script execution cache */
+struct CSignatureCacheStats
+{
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nInserts;
+    //! entries that had to make room for others
+    uint64_t nEvictions;
+    uint32_t nMaxEntries;
+    uint32_t nBaseEntries;
+
+    CSignatureCacheStats() : nHits(0), nMisses(0), nInserts(0), nEvictions(0), nMaxEntries(0), nBaseEntries(0) {}
+
+    /** The lookups since earlier, a snapshot of the same cache */
+    CSignatureCacheStats Since(const CSignatureCacheStats& earlier) const;
+    CSignatureCacheStats& operator+=(const CSignatureCacheStats& other);
+};
+
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
  * blinding in the set hash computation.
@@ -54,4 +81,16 @@ public:
 
 void InitSignatureCache();
 
+void GetSignatureCacheStats(CSignatureCacheStats& stats);
+
+/** Resize the signature cache to nEntries, keeping what it holds. Returns the entries it can hold */
+uint32_t ResizeSignatureCache(uint32_t nEntries);
+
+/**
+ * Whether a cache should double given its lookups over the blocks connected
+ * since it was last looked at: it missed more than the target hit rate allows
+ * while it evicted, and it is below the most it may grow to.
+ */
+bool ShouldGrowSignatureCache(const CSignatureCacheStats& interval, uint32_t nMaxEntries, uint32_t nBaseEntries);
+
 #endif // PLB_SCRIPT_SIGCACHE_H
@@ -13,10 +13,16 @@
 #include "script/standard.h"
 #include "uint256.h"
 #include "coins.h"
+#include "util.h"
+
+#include <atomic>
+#include <thread>
 
 typedef std::vector<unsigned char> valtype;
 
-TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), checker(txTo, nIn, amountIn) {}
+TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), txdata(nullptr), checker(txTo, nIn, amountIn) {}
+
+TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData& txdataIn, int nHashTypeIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), txdata(&txdataIn), checker(txTo, nIn, amountIn, txdataIn) {}
 
 bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& address, const CScript& scriptCode, SigVersion sigversion) const
 {
@@ -28,7 +34,7 @@ bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig,
     if (sigversion == SIGVERSION_WITNESS_V0 && !key.IsCompressed())
         return false;
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion);
+    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, txdata);
     if (!key.Sign(hash, vchSig))
         return false;
     vchSig.push_back((unsigned char)nHashType);
@@ -283,6 +289,43 @@ bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CMutabl
     return ret;
 }
 
+bool SignTransactionInputs(const CKeyStore& keystore, CMutableTransaction& txTo, const std::vector<CTxOut>& vPrevOuts, unsigned int& nFailedIn, int nThreads)
+{
+    assert(vPrevOuts.size() == txTo.vin.size());
+
+    const CTransaction txToConst(txTo);
+    const PrecomputedTransactionData txdata(txToConst);
+    std::vector<SignatureData> vSigData(vPrevOuts.size());
+    std::vector<char> vfSigned(vPrevOuts.size(), false);
+
+    // Each thread takes the next unsigned input; the keystore calls lock cs_KeyStore on their own
+    std::atomic<unsigned int> nNext(0);
+    auto worker = [&]() {
+        unsigned int nIn;
+        while ((nIn = nNext++) < vPrevOuts.size())
+            vfSigned[nIn] = ProduceSignature(TransactionSignatureCreator(&keystore, &txToConst, nIn, vPrevOuts[nIn].nValue, txdata, SIGHASH_ALL), vPrevOuts[nIn].scriptPubKey, vSigData[nIn]);
+    };
+
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    nThreads = std::max(1, std::min(nThreads, (int)(vPrevOuts.size() / MIN_INPUTS_PER_SIGN_THREAD)));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; i++)
+        vThreads.emplace_back(worker);
+    worker();
+    for (auto& thread : vThreads)
+        thread.join();
+
+    for (unsigned int nIn = 0; nIn < vPrevOuts.size(); nIn++) {
+        if (!vfSigned[nIn]) {
+            nFailedIn = nIn;
+            return false;
+        }
+        UpdateTransaction(txTo, nIn, vSigData[nIn]);
+    }
+    return true;
+}
+
 bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType, bool fCoinStake)
 {
     assert(nIn < txTo.vin.size());
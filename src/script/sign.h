@@ -38,10 +38,13 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     int nHashType;
     CAmount amount;
+    const PrecomputedTransactionData* txdata;
     const TransactionSignatureChecker checker;
 
 public:
     TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn=SIGHASH_ALL);
+    /** Signature hashes of witness inputs reuse the midstates in txdataIn, which must outlive the creator */
+    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData& txdataIn, int nHashTypeIn=SIGHASH_ALL);
     const BaseSignatureChecker& Checker() const override { return checker; }
     bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode, SigVersion sigversion) const override;
 };
@@ -77,6 +80,16 @@ bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CMutabl
 bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType, bool fCoinStake = false);
 bool VerifySignature(const Coin& coin, uint256 txFromHash, const CTransaction& txTo, unsigned int nIn, unsigned int flags);
 
+/** Inputs each extra thread must have to sign before SignTransactionInputs() starts it */
+static const unsigned int MIN_INPUTS_PER_SIGN_THREAD = 8;
+
+/**
+ * Sign every input of txTo with SIGHASH_ALL, vPrevOuts holding the outputs they spend. Large
+ * transactions are signed on up to nThreads threads (0 for one per core), and all inputs share
+ * one PrecomputedTransactionData. nFailedIn is the first input that couldn't be signed.
+ */
+bool SignTransactionInputs(const CKeyStore& keystore, CMutableTransaction& txTo, const std::vector<CTxOut>& vPrevOuts, unsigned int& nFailedIn, int nThreads = 0);
+
 /** Combine two script signatures using a generic signature checker, intelligently, possibly with OP_0 placeholders. */
 SignatureData CombineSignatures(const CScript& scriptPubKey, const BaseSignatureChecker& checker, const SignatureData& scriptSig1, const SignatureData& scriptSig2);
 
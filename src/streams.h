@@ -16,6 +16,7 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -139,6 +140,137 @@ private:
     size_t nPos;
 };
 
+/* Minimal stream for reading from a range of memory the caller keeps alive,
+ * like a mapped file, without copying it into a buffer first.
+ */
+class CMemoryReader
+{
+public:
+    CMemoryReader(int nTypeIn, int nVersionIn, const unsigned char* pbeginIn, const unsigned char* pendIn) : nType(nTypeIn), nVersion(nVersionIn), pcur(pbeginIn), pend(pendIn) {}
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::read(): end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+    }
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::ignore(): end of data");
+        pcur += nSize;
+    }
+    template<typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    size_t size() const
+    {
+        return pend - pcur;
+    }
+    bool empty() const
+    {
+        return pcur == pend;
+    }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pcur;
+    const unsigned char* const pend;
+};
+
+/** Reads bits from a stream, most significant bit of each byte first */
+template <typename IStream>
+class BitStreamReader
+{
+private:
+    IStream& m_istream;
+    //! The byte the bits come from, and how many of its bits were read already
+    uint8_t m_buffer;
+    int m_offset;
+
+public:
+    explicit BitStreamReader(IStream& istream) : m_istream(istream), m_buffer(0), m_offset(8) {}
+
+    //! Read nbits (at most 64) as the low bits of the result
+    uint64_t Read(int nbits)
+    {
+        if (nbits < 0 || nbits > 64)
+            throw std::out_of_range("nbits must be between 0 and 64");
+
+        uint64_t data = 0;
+        while (nbits > 0) {
+            if (m_offset == 8) {
+                m_istream >> m_buffer;
+                m_offset = 0;
+            }
+            int bits = std::min(8 - m_offset, nbits);
+            data <<= bits;
+            data |= static_cast<uint8_t>(m_buffer << m_offset) >> (8 - bits);
+            m_offset += bits;
+            nbits -= bits;
+        }
+        return data;
+    }
+};
+
+/** Writes bits to a stream, most significant bit of each byte first; a partial last byte is padded with zeros */
+template <typename OStream>
+class BitStreamWriter
+{
+private:
+    OStream& m_ostream;
+    //! The byte being filled, and how many of its bits are written
+    uint8_t m_buffer;
+    int m_offset;
+
+public:
+    explicit BitStreamWriter(OStream& ostream) : m_ostream(ostream), m_buffer(0), m_offset(0) {}
+
+    ~BitStreamWriter()
+    {
+        Flush();
+    }
+
+    //! Write the low nbits (at most 64) of data
+    void Write(uint64_t data, int nbits)
+    {
+        if (nbits < 0 || nbits > 64)
+            throw std::out_of_range("nbits must be between 0 and 64");
+
+        while (nbits > 0) {
+            int bits = std::min(8 - m_offset, nbits);
+            m_buffer |= (data << (64 - nbits)) >> (64 - 8 + m_offset);
+            m_offset += bits;
+            nbits -= bits;
+            if (m_offset == 8)
+                Flush();
+        }
+    }
+
+    //! Write out the byte being filled, padded with zeros
+    void Flush()
+    {
+        if (m_offset == 0)
+            return;
+        m_ostream << m_buffer;
+        m_buffer = 0;
+        m_offset = 0;
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -414,6 +546,12 @@ public:
         clear();
     }
 
+    /** Exchanges the whole storage with d without copying; reading starts over at the beginning */
+    void SwapData(CSerializeData &d) {
+        vch.swap(d);
+        nReadPos = 0;
+    }
+
     /**
      * XOR the contents of this stream with a certain key.
      *
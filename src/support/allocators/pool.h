@@ -0,0 +1,205 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_SUPPORT_ALLOCATORS_POOL_H
+#define PLB_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * Memory for the nodes of node based containers like std::unordered_map, which
+ * allocate and free one small node at a time.
+ *
+ * Blocks up to MAX_BLOCK_SIZE_BYTES are cut from large chunks, rounded up to a
+ * multiple of the alignment. A freed block goes on a free list for its size and
+ * is handed out again before the chunk is cut any further, so a container that
+ * keeps about the same size stops allocating. Chunks are only given back when
+ * the resource is destroyed: dropping a whole container and its resource frees
+ * everything in a few calls instead of one per node. Larger blocks and blocks
+ * that need a stricter alignment come from operator new.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolResource
+{
+private:
+    //! A free block, linked into the free list of its size
+    struct ListNode
+    {
+        ListNode* m_next;
+        explicit ListNode(ListNode* next) : m_next(next) {}
+    };
+
+    static const size_t ELEM_ALIGN_BYTES = alignof(ListNode) > ALIGN_BYTES ? alignof(ListNode) : ALIGN_BYTES;
+    static_assert((ELEM_ALIGN_BYTES & (ELEM_ALIGN_BYTES - 1)) == 0, "the alignment must be a power of two");
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES, "a free block must hold a list node");
+    static_assert(MAX_BLOCK_SIZE_BYTES >= ELEM_ALIGN_BYTES, "the largest block must hold at least one alignment");
+    static_assert(ELEM_ALIGN_BYTES <= alignof(std::max_align_t), "chunks come from operator new, which aligns to max_align_t");
+
+    const size_t m_chunk_size_bytes;
+
+    std::vector<void*> m_allocated_chunks;
+
+    //! Free list n holds the free blocks of n * ELEM_ALIGN_BYTES
+    std::array<ListNode*, (MAX_BLOCK_SIZE_BYTES + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + 1> m_free_lists;
+
+    //! The part of the newest chunk that was never handed out
+    char* m_available_memory_it;
+    char* m_available_memory_end;
+
+    static size_t NumElemAlignBytes(size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    static bool IsFreeListUsable(size_t bytes, size_t alignment)
+    {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PushFree(void* p, size_t num_alignments)
+    {
+        m_free_lists[num_alignments] = new (p) ListNode(m_free_lists[num_alignments]);
+    }
+
+    void AllocateChunk()
+    {
+        // What is left of the current chunk is smaller than the block asked for, so it fits a free list
+        const size_t remaining_bytes = m_available_memory_end - m_available_memory_it;
+        if (remaining_bytes > 0)
+            PushFree(m_available_memory_it, remaining_bytes / ELEM_ALIGN_BYTES);
+
+        void* storage = ::operator new(m_chunk_size_bytes);
+        m_allocated_chunks.push_back(storage);
+        m_available_memory_it = static_cast<char*>(storage);
+        m_available_memory_end = m_available_memory_it + m_chunk_size_bytes;
+    }
+
+public:
+    static const size_t DEFAULT_CHUNK_SIZE_BYTES = 256 << 10;
+
+    explicit PoolResource(size_t chunk_size_bytes = DEFAULT_CHUNK_SIZE_BYTES)
+        : m_chunk_size_bytes(NumElemAlignBytes(chunk_size_bytes) * ELEM_ALIGN_BYTES),
+          m_available_memory_it(nullptr), m_available_memory_end(nullptr)
+    {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+        m_free_lists.fill(nullptr);
+    }
+
+    ~PoolResource()
+    {
+        for (void* chunk : m_allocated_chunks)
+            ::operator delete(chunk);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(size_t bytes, size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment))
+            return ::operator new(bytes);
+
+        const size_t num_alignments = NumElemAlignBytes(bytes);
+        if (m_free_lists[num_alignments] != nullptr) {
+            ListNode* node = m_free_lists[num_alignments];
+            m_free_lists[num_alignments] = node->m_next;
+            return node;
+        }
+        if (num_alignments * ELEM_ALIGN_BYTES > size_t(m_available_memory_end - m_available_memory_it))
+            AllocateChunk();
+        void* p = m_available_memory_it;
+        m_available_memory_it += num_alignments * ELEM_ALIGN_BYTES;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t alignment) noexcept
+    {
+        if (IsFreeListUsable(bytes, alignment))
+            PushFree(p, NumElemAlignBytes(bytes));
+        else
+            ::operator delete(p);
+    }
+
+    size_t NumAllocatedChunks() const
+    {
+        return m_allocated_chunks.size();
+    }
+
+    size_t ChunkSizeBytes() const
+    {
+        return m_chunk_size_bytes;
+    }
+};
+
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+const size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::ELEM_ALIGN_BYTES;
+
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+const size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::DEFAULT_CHUNK_SIZE_BYTES;
+
+/**
+ * Allocator that takes single objects from a PoolResource. Arrays, like the
+ * bucket array of a hash map, come from operator new, and so does everything
+ * for an allocator without a resource (the default constructed one).
+ */
+template <typename T, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() noexcept : m_resource(nullptr) {}
+
+    PoolAllocator(ResourceType* resource) noexcept : m_resource(resource) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : m_resource(other.resource()) {}
+
+    T* allocate(size_t n)
+    {
+        if (m_resource != nullptr && n == 1)
+            return static_cast<T*>(m_resource->Allocate(sizeof(T), alignof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (m_resource != nullptr && n == 1)
+            m_resource->Deallocate(p, sizeof(T), alignof(T));
+        else
+            ::operator delete(p);
+    }
+
+    ResourceType* resource() const noexcept
+    {
+        return m_resource;
+    }
+
+private:
+    ResourceType* m_resource;
+};
+
+template <typename T1, typename T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <typename T1, typename T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // PLB_SUPPORT_ALLOCATORS_POOL_H
@@ -7,11 +7,130 @@
 
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 
+#include <algorithm>
+#include <map>
 #include <stdio.h>
 
 #include <boost/thread.hpp>
 
+static void NoLockHoldTimerCleanup(CLockHoldTimer*) {}
+
+//! The innermost timer of each thread; timers live on the stack and remove themselves
+static boost::thread_specific_ptr<CLockHoldTimer> lockHoldTimer(NoLockHoldTimerCleanup);
+
+CLockHoldTimer::CLockHoldTimer() : nMicros(0), pOuter(lockHoldTimer.get())
+{
+    lockHoldTimer.reset(this);
+}
+
+CLockHoldTimer::~CLockHoldTimer()
+{
+    lockHoldTimer.reset(pOuter);
+    if (pOuter)
+        pOuter->nMicros += nMicros;
+}
+
+std::atomic<bool> fLockProfiling(false);
+
+namespace {
+//! The lock sites, by the __FILE__ literal and line they were recorded with
+boost::mutex csLockStats;
+std::map<std::pair<const char*, int>, LockSiteStats> mapLockStats;
+} // namespace
+
+static void RecordLockHold(const CCriticalSection& cs, int64_t nHoldMicros)
+{
+    boost::unique_lock<boost::mutex> lock(csLockStats);
+    LockSiteStats& stats = mapLockStats[std::make_pair(cs.pszHoldFile, cs.nHoldLine)];
+    if (stats.nCount == 0) {
+        stats.strName = cs.pszHoldName;
+        stats.strFile = cs.pszHoldFile;
+        stats.nLine = cs.nHoldLine;
+    }
+    stats.nCount++;
+    if (cs.fHoldContended)
+        stats.nContended++;
+    stats.nWaitMicros += cs.nHoldWaitMicros;
+    stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, cs.nHoldWaitMicros);
+    stats.nHoldMicros += nHoldMicros;
+    stats.nMaxHoldMicros = std::max(stats.nMaxHoldMicros, nHoldMicros);
+}
+
+int64_t LockProfileMicros()
+{
+    return GetTimeMicros();
+}
+
+void LockHoldStarted(CCriticalSection& cs, const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros)
+{
+    cs.nHoldStart = GetTimeMicros();
+    if (cs.fHoldProfiled) {
+        cs.pszHoldName = pszName;
+        cs.pszHoldFile = pszFile;
+        cs.nHoldLine = nLine;
+        cs.fHoldContended = fContended;
+        cs.nHoldWaitMicros = nWaitMicros;
+    }
+}
+
+void LockHoldEnded(CCriticalSection& cs)
+{
+    const int64_t nHoldMicros = GetTimeMicros() - cs.nHoldStart;
+    if (cs.fTimeHold) {
+        CLockHoldTimer* pTimer = lockHoldTimer.get();
+        if (pTimer)
+            pTimer->nMicros += nHoldMicros;
+    }
+    if (cs.fHoldProfiled)
+        RecordLockHold(cs, nHoldMicros);
+}
+
+void SetLockProfiling(bool fEnable)
+{
+    fLockProfiling.store(fEnable, std::memory_order_relaxed);
+}
+
+std::vector<LockSiteStats> GetLockStats()
+{
+    // A file's literal may differ between translation units, so sites are merged by name
+    std::map<std::pair<std::string, int>, LockSiteStats> mapSites;
+    {
+        boost::unique_lock<boost::mutex> lock(csLockStats);
+        for (const auto& entry : mapLockStats) {
+            const LockSiteStats& stats = entry.second;
+            auto it = mapSites.find(std::make_pair(stats.strFile, stats.nLine));
+            if (it == mapSites.end()) {
+                mapSites.emplace(std::make_pair(stats.strFile, stats.nLine), stats);
+                continue;
+            }
+            LockSiteStats& merged = it->second;
+            merged.nCount += stats.nCount;
+            merged.nContended += stats.nContended;
+            merged.nWaitMicros += stats.nWaitMicros;
+            merged.nMaxWaitMicros = std::max(merged.nMaxWaitMicros, stats.nMaxWaitMicros);
+            merged.nHoldMicros += stats.nHoldMicros;
+            merged.nMaxHoldMicros = std::max(merged.nMaxHoldMicros, stats.nMaxHoldMicros);
+        }
+    }
+
+    std::vector<LockSiteStats> vStats;
+    vStats.reserve(mapSites.size());
+    for (const auto& site : mapSites)
+        vStats.push_back(site.second);
+    std::sort(vStats.begin(), vStats.end(), [](const LockSiteStats& a, const LockSiteStats& b) {
+        return a.nWaitMicros != b.nWaitMicros ? a.nWaitMicros > b.nWaitMicros : a.nHoldMicros > b.nHoldMicros;
+    });
+    return vStats;
+}
+
+void ResetLockStats()
+{
+    boost::unique_lock<boost::mutex> lock(csLockStats);
+    mapLockStats.clear();
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
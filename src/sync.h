@@ -9,6 +9,11 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
@@ -92,11 +97,111 @@ void static inline DeleteLock(void* cs) {}
 class CCriticalSection : public AnnotatedMixin<boost::recursive_mutex>
 {
 public:
+    /** Whether the time this lock is held for is added to the holder's CLockHoldTimer */
+    const bool fTimeHold;
+    //! Lock depth of the holder and when its outermost lock was taken; only touched while held
+    int nHoldDepth;
+    int64_t nHoldStart;
+    //! Where the outermost lock was taken and how long it waited, if the lock profiler was on then
+    bool fHoldProfiled;
+    const char* pszHoldName;
+    const char* pszHoldFile;
+    int nHoldLine;
+    bool fHoldContended;
+    int64_t nHoldWaitMicros;
+
+    explicit CCriticalSection(bool fTimeHoldIn = false) : fTimeHold(fTimeHoldIn), nHoldDepth(0), nHoldStart(0), fHoldProfiled(false),
+        pszHoldName(nullptr), pszHoldFile(nullptr), nHoldLine(0), fHoldContended(false), nHoldWaitMicros(0) {}
+
     ~CCriticalSection() {
         DeleteLock((void*)this);
     }
 };
 
+/** Whether the lock profiler records the locking of CCriticalSections; see SetLockProfiling */
+extern std::atomic<bool> fLockProfiling;
+
+void LockHoldStarted(CCriticalSection& cs, const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros);
+void LockHoldEnded(CCriticalSection& cs);
+//! The clock lock waits are measured with, in microseconds
+int64_t LockProfileMicros();
+
+template <typename Mutex>
+bool static inline IsLockProfiled(Mutex& cs) { return false; }
+template <typename Mutex>
+void static inline OnLockAcquired(Mutex& cs, const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros) {}
+template <typename Mutex>
+void static inline OnLockReleased(Mutex& cs) {}
+
+bool static inline IsLockProfiled(CCriticalSection& cs)
+{
+    return fLockProfiling.load(std::memory_order_relaxed);
+}
+
+void static inline OnLockAcquired(CCriticalSection& cs, const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros)
+{
+    if (cs.nHoldDepth++ == 0) {
+        cs.fHoldProfiled = fLockProfiling.load(std::memory_order_relaxed);
+        if (cs.fTimeHold || cs.fHoldProfiled)
+            LockHoldStarted(cs, pszName, pszFile, nLine, fContended, nWaitMicros);
+    }
+}
+
+void static inline OnLockReleased(CCriticalSection& cs)
+{
+    if (--cs.nHoldDepth == 0 && (cs.fTimeHold || cs.fHoldProfiled))
+        LockHoldEnded(cs);
+}
+
+/** What the lock profiler recorded for one place a lock is taken */
+struct LockSiteStats {
+    std::string strName;
+    std::string strFile;
+    int nLine;
+    //! Outermost acquisitions; a recursive lock of a lock the thread holds is not counted
+    uint64_t nCount;
+    //! Acquisitions that had to wait for another thread
+    uint64_t nContended;
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    int64_t nHoldMicros;
+    int64_t nMaxHoldMicros;
+
+    LockSiteStats() : nLine(0), nCount(0), nContended(0), nWaitMicros(0), nMaxWaitMicros(0), nHoldMicros(0), nMaxHoldMicros(0) {}
+};
+
+/**
+ * Turn the lock profiler on or off. While it is on, every outermost acquisition
+ * of a CCriticalSection through LOCK, LOCK2, TRY_LOCK or ENTER_CRITICAL_SECTION
+ * records the time waited and the time held under the file and line it was taken at.
+ * While it is off, locking pays one relaxed atomic load.
+ */
+void SetLockProfiling(bool fEnable);
+/** The recorded lock sites, most waited for first */
+std::vector<LockSiteStats> GetLockStats();
+void ResetLockStats();
+
+/**
+ * Sums how long the calling thread holds locks created with fTimeHold while
+ * the timer is in scope. A nested timer's time is also counted by the outer one.
+ */
+class CLockHoldTimer
+{
+public:
+    CLockHoldTimer();
+    ~CLockHoldTimer();
+    CLockHoldTimer(const CLockHoldTimer&) = delete;
+    CLockHoldTimer& operator=(const CLockHoldTimer&) = delete;
+
+    /** Microseconds the timed locks were held, counting holds that ended already */
+    int64_t GetMicros() const { return nMicros; }
+
+private:
+    friend void LockHoldEnded(CCriticalSection& cs);
+    int64_t nMicros;
+    CLockHoldTimer* pOuter;
+};
+
 /** Wrapped boost mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<boost::mutex> CWaitableCriticalSection;
 
@@ -117,14 +222,22 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
+        bool fContended = false;
+        int64_t nWaitMicros = 0;
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
-            lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            fContended = true;
+            if (IsLockProfiled(*lock.mutex())) {
+                const int64_t nWaitStart = LockProfileMicros();
+                lock.lock();
+                nWaitMicros = LockProfileMicros() - nWaitStart;
+            } else {
+                lock.lock();
+            }
         }
-#endif
+        OnLockAcquired(*lock.mutex(), pszName, pszFile, nLine, fContended, nWaitMicros);
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -133,6 +246,8 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else
+            OnLockAcquired(*lock.mutex(), pszName, pszFile, nLine, false, 0);
         return lock.owns_lock();
     }
 
@@ -158,8 +273,10 @@ public:
 
     ~CMutexLock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            OnLockReleased(*lock.mutex());
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -177,14 +294,16 @@ typedef CMutexLock<CCriticalSection> CCriticalBlock;
 #define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__), criticalblock2(cs2, #cs2, __FILE__, __LINE__)
 #define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true)
 
-#define ENTER_CRITICAL_SECTION(cs)                            \
-    {                                                         \
-        EnterCritical(#cs, __FILE__, __LINE__, (void*)(&cs)); \
-        (cs).lock();                                          \
+#define ENTER_CRITICAL_SECTION(cs)                             \
+    {                                                          \
+        EnterCritical(#cs, __FILE__, __LINE__, (void*)(&cs));  \
+        (cs).lock();                                           \
+        OnLockAcquired(cs, #cs, __FILE__, __LINE__, false, 0); \
     }
 
 #define LEAVE_CRITICAL_SECTION(cs) \
     {                              \
+        OnLockReleased(cs);        \
         (cs).unlock();             \
         LeaveCritical();           \
     }
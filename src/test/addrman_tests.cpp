@@ -31,7 +31,6 @@ public:
     void MakeDeterministic()
     {
         nKey.SetNull();
-        insecure_rand = FastRandomContext(true);
     }
 
     int RandomInt(int nMax) override
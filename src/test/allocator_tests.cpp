@@ -5,6 +5,8 @@
 
 #include "util.h"
 
+#include "memusage.h"
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
 #include "test/test_paladeum.h"
 
@@ -251,4 +253,78 @@ BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
         BOOST_CHECK(pool.stats().used == initial.used);
     }
 
+    BOOST_AUTO_TEST_CASE(pool_resource_test)
+    {
+        PoolResource<128, 8> resource(1024);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+        // Blocks are rounded up to the alignment and cut one after the other from a chunk
+        char* a = static_cast<char*>(resource.Allocate(10, 8));
+        char* b = static_cast<char*>(resource.Allocate(16, 8));
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+        BOOST_CHECK(b == a + 16);
+
+        // A freed block is handed out again for the same size only
+        resource.Deallocate(a, 10, 8);
+        void* c = resource.Allocate(24, 8);
+        BOOST_CHECK(c != a);
+        BOOST_CHECK(resource.Allocate(12, 8) == a);
+
+        // Larger or more aligned blocks don't come from the chunks
+        void* big = resource.Allocate(129, 8);
+        void* aligned = resource.Allocate(16, 16);
+        resource.Deallocate(big, 129, 8);
+        resource.Deallocate(aligned, 16, 16);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+        // A block that doesn't fit the rest of the chunk starts a new one, the rest goes to a free list
+        for (int i = 0; i < 7; i++)
+            resource.Allocate(128, 8);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+        resource.Allocate(128, 8);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+        BOOST_CHECK(resource.Allocate(72, 8) == a + 952);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    }
+
+    BOOST_AUTO_TEST_CASE(pool_allocator_map_test)
+    {
+        typedef PoolAllocator<std::pair<const int, std::string>, sizeof(std::pair<const int, std::string>) + sizeof(void*) * 4, alignof(void*)> Allocator;
+        typedef std::unordered_map<int, std::string, std::hash<int>, std::equal_to<int>, Allocator> Map;
+
+        Allocator::ResourceType resource;
+        std::map<int, std::string> expected;
+        {
+            Map map(0, std::hash<int>(), std::equal_to<int>(), &resource);
+            for (int i = 0; i < 100000; i++) {
+                const int key = InsecureRandRange(20000);
+                if (InsecureRandBool()) {
+                    map[key] = std::to_string(i);
+                    expected[key] = std::to_string(i);
+                } else {
+                    BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+                }
+            }
+            BOOST_CHECK_EQUAL(map.size(), expected.size());
+            for (const auto& item : expected)
+                BOOST_CHECK(map.at(item.first) == item.second);
+
+            // Freed nodes are reused, so the pool stops growing once the map size settles
+            const size_t nChunks = resource.NumAllocatedChunks();
+            BOOST_CHECK(nChunks > 0);
+            for (int i = 0; i < 1000; i++) {
+                map.erase(i);
+                map.emplace(i, "");
+            }
+            BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+            BOOST_CHECK(memusage::DynamicUsage(map) >= nChunks * resource.ChunkSizeBytes());
+        }
+
+        // Without a resource the map uses plain allocations
+        Map plain;
+        plain[1] = "one";
+        BOOST_CHECK_EQUAL(plain.at(1), "one");
+        BOOST_CHECK(memusage::DynamicUsage(plain) > 0);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,92 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompression.h"
+#include "random.h"
+
+#include "test/test_paladeum.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcompression_tests, BasicTestingSetup)
+
+    static void CheckRoundtrip(const std::vector<unsigned char>& data)
+    {
+        std::vector<unsigned char> compressed;
+        LZ4CompressBlock(data.data(), data.size(), compressed);
+        std::vector<unsigned char> out(data.size());
+        BOOST_CHECK(LZ4DecompressBlock(compressed.data(), compressed.size(), out.data(), out.size()));
+        BOOST_CHECK(out == data);
+        // The exact size has to be asked for
+        std::vector<unsigned char> longer(data.size() + 1);
+        BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), compressed.size(), longer.data(), longer.size()));
+    }
+
+    BOOST_AUTO_TEST_CASE(lz4_roundtrip_test)
+    {
+        CheckRoundtrip({});
+        CheckRoundtrip({42});
+        CheckRoundtrip(std::vector<unsigned char>(13, 7));
+        CheckRoundtrip(std::vector<unsigned char>(100000, 0));
+
+        std::vector<unsigned char> random = insecure_rand_ctx.randbytes(70000);
+        CheckRoundtrip(random);
+
+        // Repeats of a short script with a changing byte, like the outputs of a block
+        std::vector<unsigned char> repeats;
+        for (int i = 0; i < 5000; i++) {
+            unsigned char script[] = {0x76, 0xa9, 0x14, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x88, 0xac};
+            script[3] = (unsigned char)i;
+            repeats.insert(repeats.end(), script, script + sizeof(script));
+        }
+        CheckRoundtrip(repeats);
+        std::vector<unsigned char> compressed;
+        LZ4CompressBlock(repeats.data(), repeats.size(), compressed);
+        BOOST_CHECK(compressed.size() < repeats.size() / 2);
+    }
+
+    BOOST_AUTO_TEST_CASE(lz4_malformed_test)
+    {
+        std::vector<unsigned char> data(1000);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = i % 17;
+        std::vector<unsigned char> compressed;
+        LZ4CompressBlock(data.data(), data.size(), compressed);
+        std::vector<unsigned char> out(data.size());
+
+        // Cut short anywhere
+        for (size_t n = 0; n < compressed.size(); n++)
+            BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), n, out.data(), out.size()));
+
+        // Damaged bytes never read or write out of bounds
+        for (int i = 0; i < 1000; i++) {
+            std::vector<unsigned char> damaged = compressed;
+            damaged[insecure_rand_ctx.randrange(damaged.size())] = insecure_rand_ctx.randbits(8);
+            LZ4DecompressBlock(damaged.data(), damaged.size(), out.data(), out.size());
+        }
+
+        // A match reaching back before the start of the output
+        const unsigned char before[] = {0x10, 'a', 0x10, 0x00, 0x00};
+        BOOST_CHECK(!LZ4DecompressBlock(before, sizeof(before), out.data(), 24));
+    }
+
+    BOOST_AUTO_TEST_CASE(block_record_test)
+    {
+        std::vector<unsigned char> data(4000, 0xab);
+        std::vector<unsigned char> payload;
+        BOOST_REQUIRE(CompressBlockRecord(data.data(), data.size(), payload));
+        BOOST_CHECK(payload.size() < data.size());
+
+        std::vector<unsigned char> out;
+        BOOST_CHECK(DecompressBlockRecord(payload.data(), payload.size(), out, data.size()));
+        BOOST_CHECK(out == data);
+        BOOST_CHECK(!DecompressBlockRecord(payload.data(), payload.size(), out, data.size() - 1));
+        BOOST_CHECK(!DecompressBlockRecord(payload.data(), 3, out, data.size()));
+
+        // Data that doesn't get smaller is stored as it is
+        std::vector<unsigned char> random = insecure_rand_ctx.randbytes(4000);
+        BOOST_CHECK(!CompressBlockRecord(random.data(), random.size(), payload));
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -330,6 +330,56 @@ BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, RegtestingSetup)
         }
     }
 
+    BOOST_AUTO_TEST_CASE(staked_block_prefill_test)
+    {
+        BOOST_TEST_MESSAGE("Running Staked Block Prefill Test");
+
+        CTxMemPool pool;
+        TestMemPoolEntryHelper entry;
+        CBlock block(BuildBlockTestCase());
+
+        CKey key;
+        key.MakeNewKey(true);
+        CMutableTransaction coinstake;
+        coinstake.vin.resize(1);
+        coinstake.vin[0].prevout.hash = InsecureRand256();
+        coinstake.vin[0].prevout.n = 0;
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1].nValue = 42;
+        coinstake.vout[1].scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+        block.vtx[1] = MakeTransactionRef(coinstake);
+        BOOST_CHECK(block.IsProofOfStake());
+
+        bool mutated;
+        block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+        BOOST_CHECK(key.Sign(block.GetIndexHash(), block.vchBlockSig));
+
+        pool.addUnchecked(block.vtx[2]->GetHash(), entry.FromTx(*block.vtx[2]));
+
+        // The coinstake is prefilled, so only the mempool transaction goes by short id
+        {
+            CBlockHeaderAndShortTxIDs shortIDs(block, true);
+            BOOST_CHECK_EQUAL(TestHeaderAndShortIDs(shortIDs).prefilledtxn.size(), 2U);
+
+            PartiallyDownloadedBlock partialBlock(&pool);
+            BOOST_CHECK(partialBlock.InitData(shortIDs, extra_txn) == READ_STATUS_OK);
+            BOOST_CHECK(partialBlock.IsProofOfStake());
+            BOOST_CHECK(partialBlock.IsTxAvailable(0));
+            BOOST_CHECK(partialBlock.IsTxAvailable(1));
+            BOOST_CHECK(partialBlock.IsTxAvailable(2));
+            BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 2U);
+        }
+
+        // A bad signature is caught before anything would be requested
+        {
+            block.vchBlockSig.back() ^= 1;
+            CBlockHeaderAndShortTxIDs shortIDs(block, true);
+            PartiallyDownloadedBlock partialBlock(&pool);
+            BOOST_CHECK(partialBlock.InitData(shortIDs, extra_txn) == READ_STATUS_INVALID);
+        }
+    }
+
     BOOST_AUTO_TEST_CASE(transactions_request_serialization_test)
     {
         BOOST_TEST_MESSAGE("Running Transaction Request Serialization Test");
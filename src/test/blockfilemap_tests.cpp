@@ -0,0 +1,60 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "streams.h"
+#include "validation.h"
+
+#include "test/test_paladeum.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+    BOOST_AUTO_TEST_CASE(blockfilemap_read_test)
+    {
+        const CChainParams& chainparams = GetParams();
+        const CBlockIndex* pindex = chainActive.Genesis();
+        BOOST_REQUIRE(pindex);
+
+        // Read through stdio, then from the mapped file
+        g_blockfilemap.SetMaxFiles(0);
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+        std::vector<unsigned char> raw;
+        BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex->GetBlockPos(), chainparams.MessageStart()));
+
+        g_blockfilemap.SetMaxFiles(DEFAULT_BLOCKFILE_MAPS);
+        std::shared_ptr<const CMappedFile> file = g_blockfilemap.Get(pindex->GetBlockPos().nFile, pindex->GetBlockPos().nPos);
+        if (!file) {
+            // Mapping isn't available on this platform
+            return;
+        }
+        BOOST_CHECK(g_blockfilemap.Get(pindex->GetBlockPos().nFile, file->size() + 1) == nullptr);
+
+        CBlock blockMapped;
+        BOOST_CHECK(ReadBlockFromDisk(blockMapped, pindex, chainparams.GetConsensus()));
+        BOOST_CHECK(blockMapped.GetIndexHash() == block.GetIndexHash());
+        std::vector<unsigned char> rawMapped;
+        BOOST_CHECK(ReadRawBlockFromDisk(rawMapped, pindex->GetBlockPos(), chainparams.MessageStart()));
+        BOOST_CHECK(rawMapped == raw);
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == raw);
+
+        // A wrong message start is noticed
+        CMessageHeader::MessageStartChars wrongStart = {0, 0, 0, 0};
+        BOOST_CHECK(!ReadRawBlockFromDisk(rawMapped, pindex->GetBlockPos(), wrongStart));
+
+        // The reader doesn't go past the range it was given
+        CMemoryReader reader(SER_DISK, CLIENT_VERSION, raw.data(), raw.data() + 4);
+        int32_t nVersion;
+        reader >> nVersion;
+        BOOST_CHECK(reader.empty());
+        BOOST_CHECK_THROW(reader >> nVersion, std::ios_base::failure);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
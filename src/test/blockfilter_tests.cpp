@@ -0,0 +1,193 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "blockfilterindex.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "tokens/tokens.h"
+#include "undo.h"
+#include "validation.h"
+
+#include "test/test_paladeum.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, TestingSetup)
+
+    BOOST_AUTO_TEST_CASE(bitstream_test)
+    {
+        std::vector<unsigned char> data;
+        {
+            CVectorWriter stream(SER_NETWORK, 0, data, 0);
+            BitStreamWriter<CVectorWriter> bitwriter(stream);
+            bitwriter.Write(0, 1);
+            bitwriter.Write(2, 2);
+            bitwriter.Write(6, 3);
+            bitwriter.Write(11, 4);
+            bitwriter.Write(1, 5);
+            bitwriter.Write(32, 6);
+            bitwriter.Write(7, 7);
+            bitwriter.Write(30497, 16);
+            bitwriter.Write(0xFFFFFFFFFFFFFFFFULL, 64);
+        }
+        // 108 bits, padded with zeros to 14 bytes
+        BOOST_CHECK_EQUAL(data.size(), 14U);
+
+        CMemoryReader stream(SER_NETWORK, 0, data.data(), data.data() + data.size());
+        BitStreamReader<CMemoryReader> bitreader(stream);
+        BOOST_CHECK_EQUAL(bitreader.Read(1), 0U);
+        BOOST_CHECK_EQUAL(bitreader.Read(2), 2U);
+        BOOST_CHECK_EQUAL(bitreader.Read(3), 6U);
+        BOOST_CHECK_EQUAL(bitreader.Read(4), 11U);
+        BOOST_CHECK_EQUAL(bitreader.Read(5), 1U);
+        BOOST_CHECK_EQUAL(bitreader.Read(6), 32U);
+        BOOST_CHECK_EQUAL(bitreader.Read(7), 7U);
+        BOOST_CHECK_EQUAL(bitreader.Read(16), 30497U);
+        BOOST_CHECK_EQUAL(bitreader.Read(64), 0xFFFFFFFFFFFFFFFFULL);
+        BOOST_CHECK_EQUAL(bitreader.Read(4), 0U);
+        BOOST_CHECK_THROW(bitreader.Read(1), std::ios_base::failure);
+    }
+
+    BOOST_AUTO_TEST_CASE(gcsfilter_test)
+    {
+        GCSFilter::ElementSet included_elements, excluded_elements;
+        for (int i = 0; i < 100; ++i) {
+            GCSFilter::Element element1(32);
+            element1[0] = i;
+            included_elements.insert(std::move(element1));
+
+            GCSFilter::Element element2(32);
+            element2[1] = i;
+            excluded_elements.insert(std::move(element2));
+        }
+
+        GCSFilter filter(GCSFilter::Params(0, 0, 10, 1 << 10), included_elements);
+        BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+        for (const GCSFilter::Element& element : included_elements) {
+            BOOST_CHECK(filter.Match(element));
+
+            GCSFilter::ElementSet query = excluded_elements;
+            query.insert(element);
+            BOOST_CHECK(filter.MatchAny(query));
+        }
+
+        // The filter decodes back from its encoding and matches the same
+        GCSFilter filter2(filter.GetParams(), filter.GetEncoded());
+        BOOST_CHECK_EQUAL(filter2.GetN(), 100U);
+        BOOST_CHECK(filter2.GetEncoded() == filter.GetEncoded());
+        for (const GCSFilter::Element& element : included_elements)
+            BOOST_CHECK(filter2.Match(element));
+
+        // Bad encodings are refused
+        std::vector<unsigned char> truncated(filter.GetEncoded().begin(), filter.GetEncoded().end() - 1);
+        BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), truncated), std::ios_base::failure);
+        std::vector<unsigned char> padded = filter.GetEncoded();
+        padded.push_back(0);
+        BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), padded), std::ios_base::failure);
+
+        // An empty filter is the element count alone and matches nothing
+        GCSFilter empty(GCSFilter::Params(0, 0, 10, 1 << 10), GCSFilter::ElementSet());
+        BOOST_CHECK(empty.GetEncoded() == std::vector<unsigned char>(1, 0));
+        BOOST_CHECK(!empty.MatchAny(included_elements));
+    }
+
+    BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+    {
+        CKeyID keyID;
+        memset(keyID.begin(), 0x42, keyID.size());
+        CScript included_script = GetScriptForDestination(keyID);
+        CScript included_token_script = GetScriptForDestination(CScriptID(included_script));
+        CTokenTransfer("FILTER_TOKEN", 10 * COIN, 0).ConstructTransaction(included_token_script);
+        CScript included_spent_script = CScript() << OP_1 << std::vector<unsigned char>(20, 1) << OP_EQUAL;
+        CScript excluded_script = CScript() << OP_1 << std::vector<unsigned char>(20, 2) << OP_EQUAL;
+        CScript excluded_op_return = CScript() << OP_RETURN << std::vector<unsigned char>(4, 3);
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.emplace_back(100, included_script);
+        tx.vout.emplace_back(200, included_token_script);
+        tx.vout.emplace_back(0, excluded_op_return);
+        tx.vout.emplace_back(300, CScript());
+
+        CBlock block;
+        block.vtx.push_back(MakeTransactionRef(tx));
+
+        CBlockUndo block_undo;
+        block_undo.vtxundo.emplace_back();
+        block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(400, included_spent_script), 1000, false, false, 0);
+
+        BlockFilter block_filter(BlockFilterType::BASIC, block, block_undo);
+        const GCSFilter& filter = block_filter.GetFilter();
+
+        BOOST_CHECK(filter.Match(GCSFilter::Element(included_script.begin(), included_script.end())));
+        BOOST_CHECK(filter.Match(GCSFilter::Element(included_token_script.begin(), included_token_script.end())));
+        BOOST_CHECK(filter.Match(GCSFilter::Element(included_spent_script.begin(), included_spent_script.end())));
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(excluded_script.begin(), excluded_script.end())));
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(excluded_op_return.begin(), excluded_op_return.end())));
+
+        // A light client finds the transfers of a token by its name
+        std::string strName = "FILTER_TOKEN";
+        BOOST_CHECK(filter.Match(GCSFilter::Element(strName.begin(), strName.end())));
+        strName = "OTHER_TOKEN";
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(strName.begin(), strName.end())));
+
+        // The filter is rebuilt from its parts, and round trips through the network encoding
+        BlockFilter block_filter2(BlockFilterType::BASIC, block.GetIndexHash(), block_filter.GetEncodedFilter());
+        BOOST_CHECK(block_filter2.GetFilter().Match(GCSFilter::Element(included_script.begin(), included_script.end())));
+        BOOST_CHECK(block_filter2.GetHash() == block_filter.GetHash());
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << block_filter;
+        BlockFilter block_filter3;
+        stream >> block_filter3;
+        BOOST_CHECK(block_filter3.GetFilterType() == BlockFilterType::BASIC);
+        BOOST_CHECK(block_filter3.GetBlockHash() == block.GetIndexHash());
+        BOOST_CHECK(block_filter3.GetEncodedFilter() == block_filter.GetEncodedFilter());
+
+        // The header commits to the previous header
+        BOOST_CHECK(block_filter.ComputeHeader(uint256()) != block_filter.ComputeHeader(GetRandHash()));
+
+        BlockFilterType filter_type;
+        BOOST_CHECK(BlockFilterTypeByName("basic", filter_type) && filter_type == BlockFilterType::BASIC);
+        BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+    }
+
+    BOOST_AUTO_TEST_CASE(blockfilterindex_test)
+    {
+        const CBlockIndex* pindex = chainActive.Genesis();
+        BOOST_REQUIRE(pindex);
+
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, GetParams().GetConsensus()));
+        BlockFilter filter(BlockFilterType::BASIC, block, CBlockUndo());
+
+        CBlockFilterIndex index(1 << 20, true);
+        BlockFilter found;
+        BOOST_CHECK(!index.LookupFilter(pindex, found));
+
+        BOOST_CHECK(index.WriteFilter(filter, pindex));
+        uint256 hashBest;
+        BOOST_CHECK(index.ReadBestBlock(hashBest) && hashBest == pindex->GetIndexHash());
+
+        BOOST_CHECK(index.LookupFilter(pindex, found));
+        BOOST_CHECK(found.GetEncodedFilter() == filter.GetEncodedFilter());
+        uint256 header;
+        BOOST_CHECK(index.LookupFilterHeader(pindex, header));
+        BOOST_CHECK(header == filter.ComputeHeader(uint256()));
+
+        std::vector<BlockFilter> vFilters;
+        BOOST_CHECK(index.LookupFilterRange(0, pindex, vFilters));
+        BOOST_CHECK_EQUAL(vFilters.size(), 1U);
+        std::vector<uint256> vHashes;
+        BOOST_CHECK(index.LookupFilterHashRange(0, pindex, vHashes));
+        BOOST_CHECK(vHashes.size() == 1 && vHashes[0] == filter.GetHash());
+        BOOST_CHECK(!index.LookupFilterRange(1, pindex, vFilters));
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 #include "undo.h"
 #include "utilstrencodings.h"
 #include "test/test_paladeum.h"
+#include "txdb.h"
 #include "validation.h"
 #include "consensus/validation.h"
 
@@ -945,4 +946,69 @@ BOOST_FIXTURE_TEST_SUITE(coins_tests, BasicTestingSetup)
                         CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
     }
 
+    BOOST_AUTO_TEST_CASE(ccoins_format_version_test)
+    {
+        CCoinsViewDB base(1 << 20, true);
+        CCoinsViewCache cache(&base);
+        COutPoint outpoint(InsecureRand256(), 0);
+        CTxOut txout;
+        txout.nValue = 1;
+        txout.scriptPubKey = CScript() << OP_TRUE;
+        cache.AddCoin(outpoint, Coin(txout, 1, false, false, 0), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+
+        // The version is written once and isn't taken for a legacy coins record
+        BOOST_CHECK(base.WriteFormatVersion());
+        BOOST_CHECK(base.WriteFormatVersion());
+        BOOST_CHECK(base.Upgrade());
+
+        CCoinsViewCache check(&base);
+        BOOST_CHECK_EQUAL(check.AccessCoin(outpoint).out.nValue, 1);
+    }
+
+    BOOST_AUTO_TEST_CASE(ccoins_background_flush_test)
+    {
+        CCoinsViewDB base(1 << 20, true);
+        CCoinsViewCache cache(&base);
+
+        std::vector<COutPoint> outpoints;
+        for (int i = 0; i < 1000; i++) {
+            COutPoint outpoint(InsecureRand256(), i);
+            CTxOut txout;
+            txout.nValue = i + 1;
+            txout.scriptPubKey.assign(InsecureRandBits(4) + 1, 0);
+            cache.AddCoin(outpoint, Coin(txout, 1, false, false, 0), false);
+            outpoints.push_back(outpoint);
+        }
+        uint256 hashFirst = InsecureRand256();
+        cache.SetBestBlock(hashFirst);
+        BOOST_CHECK(base.BatchWriteBackground(cache.DetachCache()));
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+        // The coins are served while they are written and after, the cache refills from the base
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            BOOST_CHECK(cache.HaveCoin(outpoints[i]));
+            BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, (CAmount)i + 1);
+        }
+        BOOST_CHECK(cache.GetBestBlock() == hashFirst);
+
+        // Spend half of them and hand the next batch over while the first may still be in flight
+        for (size_t i = 0; i < outpoints.size(); i += 2)
+            BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+        uint256 hashSecond = InsecureRand256();
+        cache.SetBestBlock(hashSecond);
+        BOOST_CHECK(base.BatchWriteBackground(cache.DetachCache()));
+        for (size_t i = 0; i < outpoints.size(); i++)
+            BOOST_CHECK_EQUAL(base.HaveCoin(outpoints[i]), i % 2 == 1);
+
+        BOOST_CHECK(base.SyncBackgroundWrite());
+        BOOST_CHECK(base.GetBestBlock() == hashSecond);
+        BOOST_CHECK(base.GetHeadBlocks().empty());
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            Coin coin;
+            BOOST_CHECK_EQUAL(base.GetCoin(outpoints[i], coin), i % 2 == 1);
+        }
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
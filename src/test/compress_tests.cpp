@@ -4,6 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "compressor.h"
+#include "pubkey.h"
+#include "streams.h"
+#include "tokens/tokens.h"
 #include "util.h"
 #include "test/test_paladeum.h"
 
@@ -68,4 +71,69 @@ BOOST_FIXTURE_TEST_SUITE(compress_tests, BasicTestingSetup)
             BOOST_CHECK(TestDecode(i));
     }
 
+    static CScript RoundtripScript(const CScript& script, size_t& nSize)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        CScript in(script);
+        ss << CScriptCompressor(in);
+        nSize = ss.size();
+        CScript out;
+        ss >> REF(CScriptCompressor(out));
+        BOOST_CHECK(ss.empty());
+        return out;
+    }
+
+    BOOST_AUTO_TEST_CASE(compress_token_transfer_script_test)
+    {
+        BOOST_TEST_MESSAGE("Running Compress Token Transfer Script Test");
+
+        CKeyID keyID;
+        memset(keyID.begin(), 0x42, keyID.size());
+        CScript p2pkh = GetScriptForDestination(keyID);
+        CScript p2sh = GetScriptForDestination(CScriptID(p2pkh));
+
+        size_t nSize;
+        for (const CScript& prefix : {p2pkh, p2sh}) {
+            CScript script = prefix;
+            CTokenTransfer("TOKEN_NAME", 10 * COIN, 0).ConstructTransaction(script);
+            BOOST_CHECK(RoundtripScript(script, nSize) == script);
+            // code, hash, name, amount and time lock
+            BOOST_CHECK_EQUAL(nSize, 2 + 20 + 11 + 1 + 1);
+            BOOST_CHECK(nSize < script.size());
+
+            script = prefix;
+            CTokenTransfer("UNIQUE#TAG", 1, 1700000000).ConstructTransaction(script);
+            BOOST_CHECK(RoundtripScript(script, nSize) == script);
+
+            // An odd amount compresses worse but still comes back
+            script = prefix;
+            CTokenTransfer("TOKEN_NAME", 123456789, 0).ConstructTransaction(script);
+            BOOST_CHECK(RoundtripScript(script, nSize) == script);
+        }
+
+        // A transfer with a message is stored as it is
+        CScript script = p2pkh;
+        CTokenTransfer("TOKEN_NAME", COIN, 0, std::string(32, 'a'), 0).ConstructTransaction(script);
+        BOOST_CHECK(RoundtripScript(script, nSize) == script);
+        BOOST_CHECK(nSize > script.size());
+
+        // So is one with bytes after the OP_DROP, or a push that isn't minimal
+        script = p2pkh;
+        CTokenTransfer("TOKEN_NAME", COIN, 0).ConstructTransaction(script);
+        script << OP_TRUE;
+        BOOST_CHECK(RoundtripScript(script, nSize) == script);
+        BOOST_CHECK(nSize > script.size());
+
+        CScript nonMinimal(p2pkh.begin(), p2pkh.end());
+        CScript plain;
+        CTokenTransfer("TOKEN_NAME", COIN, 0).ConstructTransaction(plain);
+        std::vector<unsigned char> vchMessage(plain.begin() + 2, plain.end() - 1);
+        nonMinimal << OP_PLB_TOKEN << OP_PUSHDATA1;
+        nonMinimal.push_back((unsigned char)vchMessage.size());
+        nonMinimal.insert(nonMinimal.end(), vchMessage.begin(), vchMessage.end());
+        nonMinimal << OP_DROP;
+        BOOST_CHECK(RoundtripScript(nonMinimal, nSize) == nonMinimal);
+        BOOST_CHECK(nSize > nonMinimal.size());
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
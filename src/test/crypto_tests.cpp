@@ -4,14 +4,22 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypto/aes.h"
+#include "crypto/blake2b.h"
+#include "crypto/blake2b_headers.h"
 #include "crypto/chacha20.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/pbkdf2_hmac_sha512.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
 #include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
 #include "test/test_paladeum.h"
 
@@ -115,6 +123,13 @@ BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
         TestVector(CHMAC_SHA256(key.data(), key.size()), ParseHex(hexin), ParseHex(hexout));
     }
 
+    void TestPBKDF2HMACSHA512(const std::string &password, const std::string &salt, unsigned int nIterations, const std::string &hexout)
+    {
+        std::vector<unsigned char> out(hexout.size() / 2);
+        PBKDF2_HMAC_SHA512((const unsigned char*)password.data(), password.size(), (const unsigned char*)salt.data(), salt.size(), nIterations, out.data(), out.size());
+        BOOST_CHECK_EQUAL(HexStr(out), hexout);
+    }
+
     void TestHMACSHA512(const std::string &hexkey, const std::string &hexin, const std::string &hexout)
     {
         std::vector<unsigned char> key = ParseHex(hexkey);
@@ -460,6 +475,27 @@ BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
                        "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
     }
 
+    BOOST_AUTO_TEST_CASE(pbkdf2_hmac_sha512_testvectors_test)
+    {
+        BOOST_TEST_MESSAGE("Running pbkdf2 hmac sha512 TestVectors Test");
+
+        TestPBKDF2HMACSHA512("password", "salt", 1,
+                             "867f70cf1ade02cff3752599a3a53dc4af34c7a669815ae5d513554e1c8cf252"
+                             "c02d470a285a0501bad999bfe943c08f050235d7d68b1da55e63f73b60a57fce");
+        TestPBKDF2HMACSHA512("password", "salt", 2,
+                             "e1d9c16aa681708a45f5c7c4e215ceb66e011a2e9f0040713f18aefdb866d53c"
+                             "f76cab2868a39b9f7840edce4fef5a82be67335c77a6068e04112754f27ccf4e");
+        TestPBKDF2HMACSHA512("password", "salt", 4096,
+                             "d197b1b33db0143e018b12f3d1d1479e6cdebdcc97c5c0f87f6902e072f457b5"
+                             "143f30602641b3d55cd335988cb36b84376060ecd532e039b742a239434af2d5");
+        // Output longer than one HMAC block
+        TestPBKDF2HMACSHA512("passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+                             "8c0511f4c6e597c6ac6315d8f0362e225f3c501495ba23b868c005174dc4ee71"
+                             "115b59f9e60cd9532fa33e0f75aefe30225c583a186cd82bd4daea9724a3d3b8"
+                             "04f75bdd41494fa324cab24bcc680fb3b96a30cf5d21fac3c2875913919f3399"
+                             "b1d9ce7e");
+    }
+
     BOOST_AUTO_TEST_CASE(aes_testvectors_test)
     {
         BOOST_TEST_MESSAGE("Running aes TestVectors Test");
@@ -565,6 +601,169 @@ BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
                      "fab78c9");
     }
 
+    BOOST_AUTO_TEST_CASE(sha256dfinal_test)
+    {
+        BOOST_TEST_MESSAGE("Running SHA256DFinal Test");
+
+        // Messages of one full block plus 0 to 55 bytes, so the rest pads into a single block
+        for (size_t count = 1; count <= 9; count++) {
+            std::vector<uint32_t> states(8 * count);
+            std::vector<unsigned char> blocks(64 * count, 0);
+            std::vector<uint256> expected(count);
+            for (size_t n = 0; n < count; n++) {
+                size_t nTail = InsecureRandRange(56);
+                std::vector<unsigned char> msg(64 + nTail);
+                for (unsigned char& c : msg)
+                    c = InsecureRandBits(8);
+                CHash256().Write(msg.data(), msg.size()).Finalize(expected[n].begin());
+
+                SHA256Midstate(&states[8 * n], msg.data(), 1);
+                unsigned char* block = &blocks[64 * n];
+                memcpy(block, msg.data() + 64, nTail);
+                block[nTail] = 0x80;
+                WriteBE64(block + 56, msg.size() * 8);
+            }
+
+            std::vector<uint256> out(count);
+            SHA256DFinal(out[0].begin(), states.data(), blocks.data(), count);
+            for (size_t n = 0; n < count; n++)
+                BOOST_CHECK(out[n] == expected[n]);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(sha256d64_test)
+    {
+        BOOST_TEST_MESSAGE("Running SHA256D64 Test");
+
+        // Counts that fill the eight, four and two way kernels and leave some for the smaller ones
+        for (size_t count = 0; count <= 34; count++) {
+            std::vector<unsigned char> in(64 * count);
+            for (unsigned char& c : in)
+                c = InsecureRandBits(8);
+            std::vector<uint256> expected(count);
+            for (size_t n = 0; n < count; n++)
+                CHash256().Write(&in[64 * n], 64).Finalize(expected[n].begin());
+
+            std::vector<uint256> out(count);
+            SHA256D64(count ? out[0].begin() : nullptr, in.data(), count);
+            for (size_t n = 0; n < count; n++)
+                BOOST_CHECK(out[n] == expected[n]);
+
+            // In place, like the levels of a merkle tree
+            SHA256D64(in.data(), in.data(), count);
+            for (size_t n = 0; n < count; n++)
+                BOOST_CHECK(memcmp(&in[32 * n], expected[n].begin(), 32) == 0);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(blake2b_headers_test)
+    {
+        BOOST_TEST_MESSAGE("Running BLAKE2b Headers Test");
+
+        // Batches that fill the four-way kernel, and leave one to three headers for the single path
+        for (size_t count = 1; count <= 9; count++) {
+            std::vector<unsigned char> in(count * BLAKE2B_HEADER_SIZE);
+            for (unsigned char& c : in)
+                c = InsecureRandBits(8);
+
+            std::vector<uint256> out(count);
+            Blake2b256Headers(out[0].begin(), in.data(), count);
+            for (size_t n = 0; n < count; n++) {
+                uint256 expected;
+                blake2b_hash(expected.begin(), &in[n * BLAKE2B_HEADER_SIZE], BLAKE2B_HEADER_SIZE);
+                BOOST_CHECK(out[n] == expected);
+            }
+        }
+
+        // The work hash of a header, alone and with the nonces after it
+        CBlockHeader header;
+        header.nVersion = 7;
+        header.hashPrevBlock = InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1650000000;
+        header.nBits = 0x1d00ffff;
+        header.nNonce = 42;
+        BOOST_CHECK(header.GetWorkHash() == blake2b(BEGIN(header.nVersion), END(header.nNonce)));
+
+        std::vector<uint256> hashes(6);
+        header.GetWorkHashes(hashes.data(), hashes.size());
+        for (size_t i = 0; i < hashes.size(); i++) {
+            CBlockHeader next = header;
+            next.nNonce = header.nNonce + i;
+            BOOST_CHECK(hashes[i] == next.GetWorkHash());
+        }
+    }
+
+    static MuHash3072 MuHashFromInt(unsigned char i)
+    {
+        unsigned char tmp[32] = {i, 0};
+        return MuHash3072(tmp, 32);
+    }
+
+    static uint256 MuHashFinal(MuHash3072 hash)
+    {
+        uint256 out;
+        hash.Finalize(out.begin());
+        return out;
+    }
+
+    BOOST_AUTO_TEST_CASE(muhash_tests)
+    {
+        BOOST_TEST_MESSAGE("Running MuHash3072 Test");
+
+        // The empty set, and {0, 1} / {2}, as other MuHash3072 implementations compute them
+        BOOST_CHECK_EQUAL(MuHashFinal(MuHash3072()).GetHex(), "dd5ad2a105c2d29495f577245c357409002329b9f4d6182c0af3dc2f462555c8");
+        MuHash3072 acc = MuHashFromInt(0);
+        acc *= MuHashFromInt(1);
+        acc /= MuHashFromInt(2);
+        BOOST_CHECK_EQUAL(MuHashFinal(acc).GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+        // The same set in any order of inserts and removes
+        std::vector<std::vector<unsigned char> > vElements(8);
+        for (auto& element : vElements) {
+            element.resize(1 + InsecureRandRange(100));
+            for (unsigned char& c : element)
+                c = InsecureRandBits(8);
+        }
+        MuHash3072 forward, backward, churned;
+        for (size_t i = 0; i < vElements.size(); i++) {
+            forward.Insert(vElements[i].data(), vElements[i].size());
+            backward.Insert(vElements[vElements.size() - 1 - i].data(), vElements[vElements.size() - 1 - i].size());
+        }
+        for (size_t i = 0; i < vElements.size(); i += 2)
+            churned.Remove(vElements[i].data(), vElements[i].size());
+        for (const auto& element : vElements)
+            churned.Insert(element.data(), element.size());
+        for (size_t i = 0; i < vElements.size(); i += 2)
+            churned.Insert(vElements[i].data(), vElements[i].size());
+        BOOST_CHECK(MuHashFinal(forward) == MuHashFinal(backward));
+        BOOST_CHECK(MuHashFinal(forward) == MuHashFinal(churned));
+        BOOST_CHECK(MuHashFinal(forward) != MuHashFinal(MuHash3072()));
+
+        // Removing an element changes the hash, and it round trips through serialization unfinalized
+        MuHash3072 partial = forward;
+        partial.Remove(vElements[3].data(), vElements[3].size());
+        BOOST_CHECK(MuHashFinal(partial) != MuHashFinal(forward));
+        CDataStream ss(SER_DISK, 0);
+        ss << partial;
+        BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+        MuHash3072 read;
+        ss >> read;
+        read.Insert(vElements[3].data(), vElements[3].size());
+        BOOST_CHECK(MuHashFinal(read) == MuHashFinal(forward));
+
+        // The inverse of a value times the value is one
+        Num3072 num;
+        unsigned char bytes[Num3072::BYTE_SIZE];
+        for (unsigned char& c : bytes)
+            c = InsecureRandBits(8);
+        num = Num3072(bytes);
+        num.Multiply(num.GetInverse());
+        unsigned char one[Num3072::BYTE_SIZE] = {1};
+        num.ToBytes(bytes);
+        BOOST_CHECK(memcmp(bytes, one, sizeof(one)) == 0);
+    }
+
     BOOST_AUTO_TEST_CASE(countbits_test)
     {
         BOOST_TEST_MESSAGE("Running CoutBits Test");
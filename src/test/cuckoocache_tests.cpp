@@ -402,4 +402,71 @@ BOOST_AUTO_TEST_SUITE(cuckoocache_tests);
         test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
     }
 
+    /** Test that only a full cache reports losing entries and that growing a
+     * cache keeps the entries it held and not the erased ones */
+    BOOST_AUTO_TEST_CASE(cuckoocache_resize_test)
+    {
+        BOOST_TEST_MESSAGE("Running CuckooCache Resize Test");
+
+        local_rand_ctx = FastRandomContext(true);
+        CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+        const uint32_t nSize = cc.setup(1000);
+        // Less than an epoch, nothing ages out
+        std::vector<uint256> hashes(nSize * 4 / 10);
+        for (uint256& hash : hashes) {
+            insecure_GetRandHash(hash);
+            BOOST_CHECK(!cc.insert(hash));
+        }
+
+        std::vector<uint256> kept, erased;
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            if (i % 2) {
+                BOOST_CHECK(cc.contains(hashes[i], true));
+                erased.push_back(hashes[i]);
+            } else {
+                kept.push_back(hashes[i]);
+            }
+        }
+        BOOST_CHECK_EQUAL(cc.resize(nSize * 4), nSize * 4);
+        for (const uint256& hash : kept)
+            BOOST_CHECK(cc.contains(hash, false));
+        for (const uint256& hash : erased)
+            BOOST_CHECK(!cc.contains(hash, false));
+
+        // Once full, new entries take the place of old ones
+        size_t nEvicted = 0;
+        uint256 hash;
+        for (uint32_t i = 0; i < nSize * 8; ++i) {
+            insecure_GetRandHash(hash);
+            nEvicted += cc.insert(hash);
+        }
+        BOOST_CHECK(nEvicted >= nSize * 2);
+    }
+
+    BOOST_AUTO_TEST_CASE(sigcache_autosize_decision_test)
+    {
+        BOOST_TEST_MESSAGE("Running Sigcache Autosize Decision Test");
+
+        CSignatureCacheStats interval;
+        interval.nHits = SIG_CACHE_AUTOSIZE_MIN_LOOKUPS / 2;
+        interval.nMisses = SIG_CACHE_AUTOSIZE_MIN_LOOKUPS / 2;
+        interval.nEvictions = 1;
+        BOOST_CHECK(ShouldGrowSignatureCache(interval, 1000, 1000));
+        // Not past the most it may grow to
+        BOOST_CHECK(ShouldGrowSignatureCache(interval, 4000, 1000));
+        BOOST_CHECK(!ShouldGrowSignatureCache(interval, 8000, 1000));
+        // Misses that growing would not have helped with
+        interval.nEvictions = 0;
+        BOOST_CHECK(!ShouldGrowSignatureCache(interval, 1000, 1000));
+        // Hit often enough
+        interval.nEvictions = 1;
+        interval.nHits = SIG_CACHE_AUTOSIZE_MIN_LOOKUPS;
+        interval.nMisses = 0;
+        BOOST_CHECK(!ShouldGrowSignatureCache(interval, 1000, 1000));
+        // Too few lookups to tell
+        interval.nHits = 0;
+        interval.nMisses = SIG_CACHE_AUTOSIZE_MIN_LOOKUPS - 1;
+        BOOST_CHECK(!ShouldGrowSignatureCache(interval, 1000, 1000));
+    }
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -3,7 +3,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chain.h"
+#include "chainparams.h"
 #include "dbwrapper.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "random.h"
 #include "test/test_paladeum.h"
@@ -85,6 +88,44 @@ BOOST_FIXTURE_TEST_SUITE(dbwrapper_tests, BasicTestingSetup)
         }
     }
 
+// Test databases sharing an environment
+    BOOST_AUTO_TEST_CASE(dbwrapper_environment_test)
+    {
+        CDBEnvironment dbenv(1 << 20);
+        {
+            CDBWrapper dbw1(fs::temp_directory_path() / fs::unique_path(), (1 << 20), true, false, false, 2 << 20, &dbenv);
+            CDBWrapper dbw2(fs::temp_directory_path() / fs::unique_path(), (1 << 20), true, false, false, 2 << 20, &dbenv);
+            BOOST_CHECK_EQUAL(dbenv.GetDirtyCount(), 0U);
+
+            uint256 in = InsecureRand256();
+            uint256 res;
+            BOOST_CHECK(dbw2.Write('k', in));
+            BOOST_CHECK(dbw1.Write('k', in));
+            BOOST_CHECK(dbw1.Write('l', in));
+            BOOST_CHECK_EQUAL(dbenv.GetDirtyCount(), 2U);
+
+            // A synced write leaves nothing for the environment to sync
+            BOOST_CHECK(dbw2.Write('l', in, true));
+            BOOST_CHECK_EQUAL(dbenv.GetDirtyCount(), 1U);
+
+            BOOST_CHECK(dbenv.Sync());
+            BOOST_CHECK_EQUAL(dbenv.GetDirtyCount(), 0U);
+            BOOST_CHECK(dbenv.Sync());
+
+            // Both read through the shared block cache
+            BOOST_CHECK(dbw1.Read('k', res));
+            BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+            BOOST_CHECK(dbw2.Read('l', res));
+            BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+
+            BOOST_CHECK(dbw1.Erase('k'));
+            BOOST_CHECK_EQUAL(dbenv.GetDirtyCount(), 1U);
+        }
+        // Closed members are no longer synced
+        BOOST_CHECK_EQUAL(dbenv.GetDirtyCount(), 0U);
+        BOOST_CHECK(dbenv.Sync());
+    }
+
     BOOST_AUTO_TEST_CASE(dbwrapper_iterator_test)
     {
         BOOST_TEST_MESSAGE("Running dbWrapper Iterator Test");
@@ -128,6 +169,49 @@ BOOST_FIXTURE_TEST_SUITE(dbwrapper_tests, BasicTestingSetup)
         }
     }
 
+    BOOST_AUTO_TEST_CASE(dbwrapper_iterator_options_test)
+    {
+        BOOST_TEST_MESSAGE("Running dbWrapper Iterator Options Test");
+
+        fs::path ph = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, true);
+        for (char key = 'a'; key < 'f'; key++)
+            BOOST_CHECK(dbw.Write(key, (uint32_t)key));
+
+        std::unique_ptr<CDBSnapshot> snapshot = dbw.NewSnapshot();
+        BOOST_CHECK(dbw.Erase('b'));
+        BOOST_CHECK(dbw.Write('c', (uint32_t)0));
+        BOOST_CHECK(dbw.Write('f', (uint32_t)'f'));
+
+        // Iterators on the snapshot see the database as it was, whenever they are made
+        for (int i = 0; i < 2; i++) {
+            std::unique_ptr<CDBIterator> it(dbw.NewIterator(CDBIteratorOptions::AtSnapshot(*snapshot)));
+            it->Seek('a');
+            for (char key = 'a'; key < 'f'; key++) {
+                char key_res;
+                uint32_t val_res;
+                BOOST_CHECK(it->Valid() && it->GetKey(key_res) && it->GetValue(val_res));
+                BOOST_CHECK_EQUAL(key_res, key);
+                BOOST_CHECK_EQUAL(val_res, (uint32_t)key);
+                it->Next();
+            }
+            BOOST_CHECK(!it->Valid());
+        }
+
+        // The others see it as it is now
+        std::unique_ptr<CDBIterator> it(dbw.NewIterator(CDBIteratorOptions::Lookup()));
+        it->Seek('b');
+        char key_res;
+        uint32_t val_res;
+        BOOST_CHECK(it->Valid() && it->GetKey(key_res) && it->GetValue(val_res));
+        BOOST_CHECK_EQUAL(key_res, 'c');
+        BOOST_CHECK_EQUAL(val_res, 0U);
+        it.reset(dbw.NewIterator());
+        it->Seek('f');
+        BOOST_CHECK(it->Valid() && it->GetKey(key_res));
+        BOOST_CHECK_EQUAL(key_res, 'f');
+    }
+
 // Test that we do not obfuscation if there is existing data.
     BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate_test)
     {
@@ -360,5 +444,98 @@ BOOST_FIXTURE_TEST_SUITE(dbwrapper_tests, BasicTestingSetup)
         }
     }
 
+    BOOST_AUTO_TEST_CASE(blocktree_load_index_test)
+    {
+        CBlockTreeDB blocktree(1 << 20, true);
+
+        // More entries than one chunk, so that they are decoded in more than one go
+        const size_t nBlocks = BLOCK_INDEX_LOAD_CHUNK + 100;
+        std::vector<uint256> vHashes(nBlocks);
+        std::vector<CBlockIndex> vIndexes(nBlocks);
+        std::vector<const CBlockIndex*> vWrite;
+        for (size_t i = 0; i < nBlocks; i++) {
+            vHashes[i] = InsecureRand256();
+            vIndexes[i].phashBlock = &vHashes[i];
+            vIndexes[i].pprev = i ? &vIndexes[i - 1] : nullptr;
+            vIndexes[i].nHeight = i;
+            vIndexes[i].nTime = 1600000000 + i;
+            vIndexes[i].nNonce = InsecureRand32();
+            vIndexes[i].nStatus = BLOCK_VALID_TREE;
+            vIndexes[i].nStakeModifier = InsecureRand256();
+            vWrite.push_back(&vIndexes[i]);
+        }
+        BOOST_REQUIRE(blocktree.WriteBatchSync({}, 0, vWrite));
+
+        std::map<uint256, std::unique_ptr<CBlockIndex> > mapLoaded;
+        BOOST_REQUIRE(blocktree.LoadBlockIndexGuts(GetParams().GetConsensus(), [&mapLoaded](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull())
+                return nullptr;
+            std::unique_ptr<CBlockIndex>& pindex = mapLoaded[hash];
+            if (!pindex)
+                pindex.reset(new CBlockIndex());
+            return pindex.get();
+        }));
+
+        BOOST_CHECK_EQUAL(mapLoaded.size(), nBlocks);
+        for (size_t i = 0; i < nBlocks; i++) {
+            const CBlockIndex* pindex = mapLoaded[vHashes[i]].get();
+            BOOST_REQUIRE(pindex);
+            BOOST_CHECK_EQUAL(pindex->nHeight, (int)i);
+            BOOST_CHECK_EQUAL(pindex->nTime, vIndexes[i].nTime);
+            BOOST_CHECK_EQUAL(pindex->nNonce, vIndexes[i].nNonce);
+            BOOST_CHECK_EQUAL(pindex->nStatus, vIndexes[i].nStatus);
+            BOOST_CHECK(pindex->nStakeModifier == vIndexes[i].nStakeModifier);
+            BOOST_CHECK(pindex->pprev == (i ? mapLoaded[vHashes[i - 1]].get() : nullptr));
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(blocktree_spent_timestamp_range_test)
+    {
+        CBlockTreeDB blocktree(1 << 20, true);
+
+        // Every other output of a few transactions is spent
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+        std::set<CSpentIndexKey, CSpentIndexKeyCompare> setKeys;
+        for (int i = 0; i < 5; i++) {
+            const uint256 txid = InsecureRand256();
+            for (unsigned int n = 0; n < 300; n++) {
+                setKeys.insert(CSpentIndexKey(txid, n));
+                if (n % 2 == 0)
+                    vSpent.emplace_back(CSpentIndexKey(txid, n), CSpentIndexValue(InsecureRand256(), n, i, n * 10, 1, uint160()));
+            }
+        }
+        BOOST_REQUIRE(blocktree.UpdateSpentIndex(vSpent));
+
+        std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapValues;
+        BOOST_REQUIRE(blocktree.ReadSpentIndex(setKeys, mapValues));
+        BOOST_CHECK_EQUAL(mapValues.size(), vSpent.size());
+        for (const auto& spent : vSpent) {
+            auto it = mapValues.find(spent.first);
+            BOOST_REQUIRE(it != mapValues.end());
+            BOOST_CHECK(it->second.txid == spent.second.txid);
+            BOOST_CHECK_EQUAL(it->second.inputIndex, spent.second.inputIndex);
+            BOOST_CHECK_EQUAL(it->second.satoshis, spent.second.satoshis);
+        }
+
+        // The walk stops at high, and when asked to
+        std::vector<uint256> vHashes;
+        for (unsigned int t = 0; t < 10; t++) {
+            vHashes.push_back(InsecureRand256());
+            BOOST_REQUIRE(blocktree.WriteTimestampIndex(CTimestampIndexKey(1000 + t, vHashes.back())));
+        }
+        std::vector<unsigned int> vTimes;
+        BOOST_CHECK(blocktree.WalkTimestampIndex(1007, 1002, [&](const uint256& hash, unsigned int timestamp) {
+            BOOST_CHECK(hash == vHashes[timestamp - 1000]);
+            vTimes.push_back(timestamp);
+            return true;
+        }));
+        BOOST_CHECK(vTimes == std::vector<unsigned int>({1002, 1003, 1004, 1005, 1006}));
+        vTimes.clear();
+        BOOST_CHECK(blocktree.WalkTimestampIndex(2000, 0, [&](const uint256&, unsigned int timestamp) {
+            vTimes.push_back(timestamp);
+            return vTimes.size() < 3;
+        }));
+        BOOST_CHECK_EQUAL(vTimes.size(), 3);
+    }
 
 BOOST_AUTO_TEST_SUITE_END()
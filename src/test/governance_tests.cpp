@@ -0,0 +1,200 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "governance/governance.h"
+#include "test/test_paladeum.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(governance_tests, BasicTestingSetup)
+
+    BOOST_AUTO_TEST_CASE(governance_cache_layering_test)
+    {
+        CGovernance gov(1 << 20, true, true);
+        gov.Init(true, GetParams());
+
+        CScript frozenScript = CScript() << OP_1 << OP_2;
+        CScript authorizedScript = CScript() << OP_3;
+        unsigned int nAuthorized = gov.GetNumberOfAuthorizedScripts();
+        CAmount rootCost = gov.GetCost(GOVERNANCE_COST_ROOT);
+
+        // A cache that is never flushed leaves the governance state untouched
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.FreezeScript(frozenScript, 10));
+            BOOST_CHECK(cache.AuthorizeScript(authorizedScript, 10));
+            BOOST_CHECK(cache.UpdateCost(5 * COIN, GOVERNANCE_COST_ROOT, 10));
+        }
+        BOOST_CHECK(gov.CanSend(frozenScript));
+        BOOST_CHECK(!gov.CanStake(authorizedScript));
+        BOOST_CHECK_EQUAL(gov.GetCost(GOVERNANCE_COST_ROOT), rootCost);
+
+        // Connecting: later operations see the earlier ones of the same block
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.FreezeScript(frozenScript, 10));
+            BOOST_CHECK(cache.FreezeScript(frozenScript, 10));
+            BOOST_CHECK(cache.AuthorizeScript(authorizedScript, 10));
+            BOOST_CHECK(cache.UpdateCost(5 * COIN, GOVERNANCE_COST_ROOT, 10));
+            BOOST_CHECK(!cache.UpdateCost(5 * COIN, GOVERNANCE_COST_QUALIFIER, 10));
+            BOOST_CHECK(cache.UpdateFeeScript(authorizedScript, 10));
+            BOOST_CHECK(cache.Flush());
+        }
+        BOOST_CHECK(!gov.CanSend(frozenScript));
+        BOOST_CHECK(gov.CanStake(authorizedScript));
+        BOOST_CHECK_EQUAL(gov.GetCost(GOVERNANCE_COST_ROOT), 5 * COIN);
+        BOOST_CHECK(gov.GetFeeScript() == authorizedScript);
+        BOOST_CHECK_EQUAL(gov.GetNumberOfFrozenScripts(), 1U);
+        BOOST_CHECK_EQUAL(gov.GetNumberOfAuthorizedScripts(), nAuthorized + 1);
+        BOOST_CHECK(gov.Flush());
+
+        // Disconnecting reverts every operation once
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.RevertFreezeScript(frozenScript));
+            BOOST_CHECK(!cache.RevertFreezeScript(frozenScript));
+            BOOST_CHECK(cache.RevertAuthorizeScript(authorizedScript));
+            BOOST_CHECK(cache.RevertUpdateCost(GOVERNANCE_COST_ROOT, 10));
+            BOOST_CHECK(cache.RevertUpdateFeeScript(10));
+            BOOST_CHECK(!cache.RevertUpdateFeeScript(10));
+            BOOST_CHECK(cache.Flush());
+        }
+        BOOST_CHECK(gov.CanSend(frozenScript));
+        BOOST_CHECK(!gov.CanStake(authorizedScript));
+        BOOST_CHECK_EQUAL(gov.GetCost(GOVERNANCE_COST_ROOT), rootCost);
+        BOOST_CHECK(gov.Flush());
+
+        // The database agrees with the in-memory state once reloaded
+        gov.Init(false, GetParams());
+        BOOST_CHECK(gov.CanSend(frozenScript));
+        BOOST_CHECK(gov.ScriptExist(frozenScript));
+        BOOST_CHECK(gov.AuthorityExist(authorizedScript));
+        BOOST_CHECK_EQUAL(gov.GetCost(GOVERNANCE_COST_ROOT), rootCost);
+        BOOST_CHECK_EQUAL(gov.GetNumberOfFrozenScripts(), 0U);
+        BOOST_CHECK_EQUAL(gov.GetNumberOfAuthorizedScripts(), nAuthorized);
+    }
+
+    BOOST_AUTO_TEST_CASE(governance_cost_table_test)
+    {
+        CGovernance gov(1 << 20, true, true);
+        gov.Init(true, GetParams());
+
+        CScript feeScript = CScript() << OP_4;
+        CAmount subCost = gov.GetCost(GOVERNANCE_COST_SUB);
+        CCostTableRef table = gov.GetCostTable();
+        BOOST_CHECK_EQUAL(table->GetCost(GOVERNANCE_COST_SUB), subCost);
+
+        // Shared until something changes, freezing a script isn't a cost change
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.FreezeScript(CScript() << OP_1, 20));
+            BOOST_CHECK(cache.Flush());
+        }
+        BOOST_CHECK(gov.GetCostTable() == table);
+
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.UpdateCost(7 * COIN, GOVERNANCE_COST_SUB, 20));
+            BOOST_CHECK(cache.UpdateFeeScript(feeScript, 20));
+            BOOST_CHECK(cache.Flush());
+        }
+        CCostTableRef updated = gov.GetCostTable();
+        BOOST_CHECK(updated != table);
+        BOOST_CHECK(updated->nGeneration > table->nGeneration);
+
+        // The old snapshot still holds what was in force when it was taken
+        int nHeight;
+        BOOST_CHECK_EQUAL(updated->GetCost(GOVERNANCE_COST_SUB, &nHeight), 7 * COIN);
+        BOOST_CHECK_EQUAL(nHeight, 20);
+        BOOST_CHECK(updated->GetFeeScript(&nHeight) == feeScript);
+        BOOST_CHECK_EQUAL(nHeight, 20);
+        BOOST_CHECK(table->GetFeeScript() != feeScript);
+        BOOST_CHECK_EQUAL(table->GetCost(GOVERNANCE_COST_SUB), subCost);
+    }
+
+    BOOST_AUTO_TEST_CASE(governance_event_log_test)
+    {
+        CGovernance gov(1 << 20, true, true);
+        gov.Init(true, GetParams());
+        BOOST_CHECK(gov.IsEventLogComplete());
+
+        CScript scriptA = CScript() << OP_1;
+        CScript scriptB = CScript() << OP_2;
+        CScript feeScript = CScript() << OP_4;
+
+        // Two blocks flushed to the database, a third still held by the mirror
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.FreezeScript(scriptA, 10));
+            BOOST_CHECK(cache.FreezeScript(scriptB, 10));
+            BOOST_CHECK(cache.Flush());
+        }
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.UnfreezeScript(scriptA, 20));
+            BOOST_CHECK(cache.UpdateCost(7 * COIN, GOVERNANCE_COST_SUB, 20));
+            BOOST_CHECK(cache.Flush());
+        }
+        BOOST_CHECK(gov.Flush());
+        {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.AuthorizeScript(scriptA, 30));
+            BOOST_CHECK(cache.UpdateFeeScript(feeScript, 30));
+            BOOST_CHECK(cache.Flush());
+        }
+
+        // The log is in height order, across the database and the changes not flushed yet
+        std::vector<CGovernanceEvent> vEvents;
+        CGovernanceEvent start(1, 0, CScript());
+        auto collect = [&vEvents](const CGovernanceEvent& event) { vEvents.push_back(event); return true; };
+        BOOST_CHECK(gov.ForEachEvent(&start, 100, collect));
+        BOOST_REQUIRE_EQUAL(vEvents.size(), 6U);
+        BOOST_CHECK_EQUAL(vEvents[0].nHeight, 10);
+        BOOST_CHECK_EQUAL(vEvents[2].nHeight, 20);
+        BOOST_CHECK_EQUAL(vEvents[2].nType, GOVERNANCE_COST);
+        BOOST_CHECK_EQUAL(vEvents[2].nCost, 7 * COIN);
+        BOOST_CHECK_EQUAL(vEvents[3].nType, GOVERNANCE_UNFREEZE);
+        BOOST_CHECK_EQUAL(vEvents[5].nHeight, 30);
+
+        // Paging continues after the last event returned
+        std::vector<CGovernanceEvent> vPage;
+        BOOST_CHECK(gov.ForEachEvent(&vEvents[2], 100, [&vPage](const CGovernanceEvent& event) { vPage.push_back(event); return vPage.size() < 2; }));
+        BOOST_REQUIRE_EQUAL(vPage.size(), 2U);
+        BOOST_CHECK(!(vPage[0] < vEvents[3]) && !(vEvents[3] < vPage[0]));
+
+        // Point in time state
+        CGovernanceState state;
+        BOOST_CHECK(gov.GetStateAtHeight(15, state));
+        BOOST_CHECK_EQUAL(state.setFrozen.size(), 2U);
+        BOOST_CHECK(!state.setAuthorized.count(scriptA));
+        BOOST_CHECK(state.mapCosts.count(GOVERNANCE_COST_SUB) && state.mapCosts[GOVERNANCE_COST_SUB].second == 0);
+
+        state = CGovernanceState();
+        BOOST_CHECK(gov.GetStateAtHeight(30, state));
+        BOOST_CHECK(state.setFrozen == std::set<CScript>({scriptB}));
+        BOOST_CHECK(state.setAuthorized.count(scriptA));
+        BOOST_CHECK(state.mapCosts[GOVERNANCE_COST_SUB] == std::make_pair(7 * COIN, 20));
+        BOOST_CHECK(state.feeScript == feeScript);
+        BOOST_CHECK_EQUAL(state.nFeeHeight, 30);
+
+        // Disconnecting a block takes its events out, flushed or not
+        for (int nHeight : {30, 20}) {
+            CGovernanceCache cache(&gov);
+            BOOST_CHECK(cache.RevertEvents(nHeight));
+            BOOST_CHECK(cache.Flush());
+        }
+        BOOST_CHECK(gov.Flush());
+        vEvents.clear();
+        BOOST_CHECK(gov.ForEachEvent(&start, 100, collect));
+        BOOST_CHECK_EQUAL(vEvents.size(), 2U);
+
+        // And the log survives a reload
+        gov.Init(false, GetParams());
+        vEvents.clear();
+        BOOST_CHECK(gov.ForEachEvent(&start, 100, collect));
+        BOOST_CHECK_EQUAL(vEvents.size(), 2U);
+        BOOST_CHECK(gov.IsEventLogComplete());
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -165,4 +165,43 @@ BOOST_FIXTURE_TEST_SUITE(key_tests, BasicTestingSetup)
         BOOST_CHECK(detsigc == ParseHex("2052d8a32079c11e79db95af63bb9600c5b04f21a9ca33dc129c2bfa8ac9dc1cd561d8ae5e0f6c1a16bde3719c64c2fd70e404b6428ab9a69566962e8771b5944d"));
     }
 
+    BOOST_AUTO_TEST_CASE(parsed_pubkey_test)
+    {
+        BOOST_TEST_MESSAGE("Running Parsed PubKey Test");
+
+        CPaladeumSecret bsecret1, bsecret1C, bsecret2C;
+        BOOST_CHECK(bsecret1.SetString(strSecret1));
+        BOOST_CHECK(bsecret1C.SetString(strSecret1C));
+        BOOST_CHECK(bsecret2C.SetString(strSecret2C));
+        CKey key1 = bsecret1.GetKey();
+        CKey key1C = bsecret1C.GetKey();
+        CKey key2C = bsecret2C.GetKey();
+        std::vector<CPubKey> vPubKeys = {key1.GetPubKey(), key1C.GetPubKey(), key2C.GetPubKey()};
+
+        for (int n = 0; n < 4; n++)
+        {
+            uint256 hashMsg = InsecureRand256();
+            std::vector<std::vector<unsigned char> > vSigs(3);
+            BOOST_CHECK(key1.Sign(hashMsg, vSigs[0]));
+            BOOST_CHECK(key1C.Sign(hashMsg, vSigs[1]));
+            BOOST_CHECK(key2C.Sign(hashMsg, vSigs[2]));
+
+            // A parsed key verifies exactly what the key does
+            for (const CPubKey& pubkey : vPubKeys) {
+                CParsedPubKey parsed;
+                BOOST_CHECK(parsed.Parse(pubkey));
+                for (const std::vector<unsigned char>& vchSig : vSigs)
+                    BOOST_CHECK_EQUAL(parsed.Verify(hashMsg, vchSig), pubkey.Verify(hashMsg, vchSig));
+                BOOST_CHECK(!parsed.Verify(hashMsg, std::vector<unsigned char>()));
+            }
+        }
+
+        // Keys that don't parse
+        CParsedPubKey parsed;
+        BOOST_CHECK(!parsed.Parse(CPubKey()));
+        std::vector<unsigned char> vchBad(vPubKeys[1].begin(), vPubKeys[1].end());
+        vchBad[0] = 0x05;
+        BOOST_CHECK(!parsed.Parse(CPubKey(vchBad)));
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
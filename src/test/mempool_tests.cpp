@@ -3,7 +3,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
 #include "policy/policy.h"
+#include "script/interpreter.h"
+#include "tokens/tokens.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -108,6 +111,43 @@ BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
         BOOST_CHECK_EQUAL(testPool.size(), (uint64_t)0);
     }
 
+    BOOST_AUTO_TEST_CASE(mempool_sequence_test)
+    {
+        TestMemPoolEntryHelper entry;
+        CMutableTransaction txParent;
+        txParent.vin.resize(1);
+        txParent.vin[0].scriptSig = CScript() << OP_11;
+        txParent.vout.resize(1);
+        txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[0].nValue = 33000LL;
+        CMutableTransaction txChild;
+        txChild.vin.resize(1);
+        txChild.vin[0].scriptSig = CScript() << OP_11;
+        txChild.vin[0].prevout.hash = txParent.GetHash();
+        txChild.vin[0].prevout.n = 0;
+        txChild.vout.resize(1);
+        txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild.vout[0].nValue = 11000LL;
+
+        CTxMemPool testPool;
+        BOOST_CHECK_EQUAL(testPool.GetSequence(), 1U);
+
+        // Additions are numbered as they are signalled, removals as they happen
+        testPool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+        BOOST_CHECK_EQUAL(testPool.GetAndIncrementSequence(), 1U);
+        testPool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild));
+        BOOST_CHECK_EQUAL(testPool.GetAndIncrementSequence(), 2U);
+        BOOST_CHECK_EQUAL(testPool.GetSequence(), 3U);
+
+        testPool.removeRecursive(txParent);
+        BOOST_CHECK_EQUAL(testPool.size(), 0U);
+        BOOST_CHECK_EQUAL(testPool.GetSequence(), 5U);
+
+        // Nothing removed, nothing numbered
+        testPool.removeRecursive(txParent);
+        BOOST_CHECK_EQUAL(testPool.GetSequence(), 5U);
+    }
+
     template<typename name>
     void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder)
     {
@@ -597,4 +637,260 @@ BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
         SetMockTime(0);
     }
 
+    BOOST_AUTO_TEST_CASE(mempool_restricted_state_index_test)
+    {
+        CRestrictedStateIndex index;
+        uint256 hashA = uint256S("01");
+        uint256 hashB = uint256S("02");
+
+        index.Add(CRestrictedStateIndex::MARKED_FROZEN, hashA, "$TOKEN", "address");
+        index.Add(CRestrictedStateIndex::MARKED_FROZEN, hashA, "$TOKEN", "address");
+        index.Add(CRestrictedStateIndex::MARKED_FROZEN, hashB, "$TOKEN", "address");
+        index.Add(CRestrictedStateIndex::MARKED_GLOBAL_FROZEN, hashB, "$TOKEN");
+        index.Add(CRestrictedStateIndex::GLOBAL_FREEZING, hashA, "$OTHER");
+
+        BOOST_CHECK_EQUAL(index.Get(CRestrictedStateIndex::MARKED_FROZEN, "$TOKEN", "address").size(), 2U);
+        BOOST_CHECK_EQUAL(index.Size(), 3U);
+        BOOST_CHECK(index.Exists(CRestrictedStateIndex::GLOBAL_FREEZING, "$OTHER"));
+        // Kinds and name order are part of the key
+        BOOST_CHECK(!index.Exists(CRestrictedStateIndex::GLOBAL_UNFREEZING, "$OTHER"));
+        BOOST_CHECK(!index.Exists(CRestrictedStateIndex::MARKED_FROZEN, "address", "$TOKEN"));
+
+        index.Remove(hashA);
+        BOOST_CHECK_EQUAL(index.Get(CRestrictedStateIndex::MARKED_FROZEN, "$TOKEN", "address").size(), 1U);
+        BOOST_CHECK(!index.Exists(CRestrictedStateIndex::GLOBAL_FREEZING, "$OTHER"));
+
+        index.Remove(hashB);
+        BOOST_CHECK_EQUAL(index.Size(), 0U);
+        BOOST_CHECK(index.Get(CRestrictedStateIndex::MARKED_GLOBAL_FROZEN, "$TOKEN").empty());
+
+        // Released names are interned again when reused
+        index.Add(CRestrictedStateIndex::ADDED_TAG, hashA, "#KYC", "address");
+        BOOST_CHECK(index.Exists(CRestrictedStateIndex::ADDED_TAG, "#KYC", "address"));
+    }
+
+    BOOST_AUTO_TEST_CASE(mempool_token_output_index_test)
+    {
+        CTxDestination destA = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+        CTxDestination destB = CKeyID(uint160(std::vector<unsigned char>(20, 2)));
+
+        CMutableTransaction mtx;
+        for (auto transfer : {std::make_pair(destA, "TOKEN"), std::make_pair(destB, "TOKEN"), std::make_pair(destA, "OTHER")}) {
+            CScript script = GetScriptForDestination(transfer.first);
+            CTokenTransfer(transfer.second, 5 * COIN, 0).ConstructTransaction(script);
+            mtx.vout.emplace_back(0, script);
+        }
+        // Plain outputs are not indexed
+        mtx.vout.emplace_back(COIN, GetScriptForDestination(destA));
+        CTransaction tx(mtx);
+
+        CTokenOutputIndex index;
+        index.Add(tx);
+        BOOST_CHECK_EQUAL(index.Size(), 3U);
+
+        std::vector<CTokenOutputIndex::Output> vOutputs = index.GetByToken("TOKEN");
+        BOOST_CHECK_EQUAL(vOutputs.size(), 2U);
+        vOutputs = index.GetByToken("TOKEN", EncodeDestination(destB));
+        BOOST_CHECK_EQUAL(vOutputs.size(), 1U);
+        BOOST_CHECK(vOutputs[0].outpoint == COutPoint(tx.GetHash(), 1));
+        BOOST_CHECK_EQUAL(vOutputs[0].nAmount, 5 * COIN);
+
+        vOutputs = index.GetByAddress(EncodeDestination(destA));
+        BOOST_CHECK_EQUAL(vOutputs.size(), 2U);
+        BOOST_CHECK_EQUAL(vOutputs[0].strToken, "OTHER");
+        BOOST_CHECK_EQUAL(vOutputs[1].strToken, "TOKEN");
+        BOOST_CHECK(index.GetByToken("TOKE").empty());
+
+        index.Remove(tx);
+        BOOST_CHECK_EQUAL(index.Size(), 0U);
+        BOOST_CHECK(index.GetByAddress(EncodeDestination(destA)).empty());
+    }
+
+    BOOST_AUTO_TEST_CASE(mempool_token_usage_test)
+    {
+        CTxMemPool pool;
+        TestMemPoolEntryHelper entry;
+        CTxDestination dest = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+
+        CMutableTransaction plainTx;
+        plainTx.vin.resize(1);
+        plainTx.vin[0].scriptSig = CScript() << OP_1;
+        plainTx.vout.emplace_back(COIN, GetScriptForDestination(dest));
+
+        CMutableTransaction tokenTx;
+        tokenTx.vin.resize(1);
+        tokenTx.vin[0].scriptSig = CScript() << OP_2;
+        for (const char* name : {"TOKEN", "OTHER", "THIRD"}) {
+            CScript script = GetScriptForDestination(dest);
+            CTokenTransfer(name, COIN, 0).ConstructTransaction(script);
+            tokenTx.vout.emplace_back(0, script);
+        }
+
+        // The token transaction pays the higher feerate by size
+        CTransaction plain(plainTx);
+        CTransaction token(tokenTx);
+        pool.addUnchecked(plain.GetHash(), entry.Fee(10 * GetVirtualTransactionSize(plain)).FromTx(plain));
+        pool.addUnchecked(token.GetHash(), entry.Fee(11 * GetVirtualTransactionSize(token)).FromTx(token));
+
+        MemPoolUsage usage = pool.GetUsageBreakdown();
+        BOOST_CHECK_EQUAL(usage.Total(), pool.DynamicMemoryUsage());
+        BOOST_CHECK(usage.nTokenOutputs > 0);
+        BOOST_CHECK_EQUAL(pool.mapTx.find(plain.GetHash())->GetTokenUsage(), 0U);
+        size_t nOutputUsage = pool.mapTx.find(token.GetHash())->GetTokenUsage();
+        BOOST_CHECK(nOutputUsage > 0);
+
+        // Restricted state and issues recorded after the insert are attributed once updated
+        pool.restrictedStateIndex.Add(CRestrictedStateIndex::MARKED_FROZEN, token.GetHash(), "$TOKEN", EncodeDestination(dest));
+        pool.AddNewToken("A_LONGER_TOKEN_NAME_THAN_FITS_INLINE", token.GetHash());
+        pool.UpdateTokenUsage(token.GetHash());
+        BOOST_CHECK(pool.mapTx.find(token.GetHash())->GetTokenUsage() > nOutputUsage);
+        BOOST_CHECK(pool.GetUsageBreakdown().nTokenIssues > 0);
+        BOOST_CHECK(pool.GetUsageBreakdown().nRestrictedState > usage.nRestrictedState);
+        BOOST_CHECK_EQUAL(pool.GetUsageBreakdown().Total(), pool.DynamicMemoryUsage());
+
+        // Counting its helper memory, the token transaction pays less for what it holds and goes first
+        pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+        BOOST_CHECK(pool.exists(plain.GetHash()));
+        BOOST_CHECK(!pool.exists(token.GetHash()));
+
+        usage = pool.GetUsageBreakdown();
+        BOOST_CHECK_EQUAL(usage.nTokenIssues, 0U);
+        BOOST_CHECK_EQUAL(usage.nTokenOutputs, 0U);
+        BOOST_CHECK_EQUAL(pool.restrictedStateIndex.Size(), 0U);
+    }
+
+    BOOST_AUTO_TEST_CASE(mempool_tx_relay_class_test)
+    {
+        CTxDestination dest = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+        TestMemPoolEntryHelper entry;
+
+        CMutableTransaction payment;
+        payment.vout.emplace_back(COIN, GetScriptForDestination(dest));
+        BOOST_CHECK_EQUAL(GetTxRelayClass(payment), TX_RELAY_PAYMENT);
+
+        CMutableTransaction transfer = payment;
+        CScript transferScript = GetScriptForDestination(dest);
+        CTokenTransfer("TOKEN", COIN, 0).ConstructTransaction(transferScript);
+        transfer.vout.emplace_back(0, transferScript);
+        BOOST_CHECK_EQUAL(GetTxRelayClass(transfer), TX_RELAY_TOKEN_TRANSFER);
+
+        CMutableTransaction admin = payment;
+        CScript tagScript = GetScriptForNullTokenDataDestination(dest);
+        CNullTokenTxData("#TAG", 1).ConstructTransaction(tagScript);
+        admin.vout.emplace_back(0, tagScript);
+        BOOST_CHECK_EQUAL(GetTxRelayClass(admin), TX_RELAY_RESTRICTED_ADMIN);
+
+        // Issuing wins over the transfers and tags that come with it
+        CMutableTransaction issue = transfer;
+        issue.vout.push_back(admin.vout.back());
+        CScript issueScript = GetScriptForDestination(dest);
+        CNewToken("NEWTOKEN", 1000 * COIN).ConstructTransaction(issueScript);
+        issue.vout.emplace_back(0, issueScript);
+        BOOST_CHECK_EQUAL(GetTxRelayClass(issue), TX_RELAY_TOKEN_ISSUE);
+
+        // Moving tokens wins over the tags
+        transfer.vout.push_back(admin.vout.back());
+        BOOST_CHECK_EQUAL(GetTxRelayClass(transfer), TX_RELAY_TOKEN_TRANSFER);
+        BOOST_CHECK_EQUAL(entry.FromTx(transfer).GetRelayClass(), TX_RELAY_TOKEN_TRANSFER);
+
+        TxRelayClass nClass;
+        BOOST_CHECK(ParseTxRelayClass("admin", nClass));
+        BOOST_CHECK_EQUAL(nClass, TX_RELAY_RESTRICTED_ADMIN);
+        BOOST_CHECK_EQUAL(GetTxRelayClassName(nClass), "admin");
+        BOOST_CHECK(!ParseTxRelayClass("Admin", nClass));
+    }
+
+    BOOST_AUTO_TEST_CASE(mempool_linear_chain_limits_test)
+    {
+        CTxMemPool pool;
+        TestMemPoolEntryHelper entry;
+        std::string dummy;
+
+        // A chain of 25, each spending the one before
+        std::vector<CTransactionRef> vChain;
+        for (int i = 0; i < 25; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            mtx.vin[0].prevout = i == 0 ? COutPoint(uint256S("ff"), 0) : COutPoint(vChain.back()->GetHash(), 0);
+            mtx.vin[0].scriptSig = CScript() << OP_11;
+            mtx.vout.resize(1);
+            mtx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+            mtx.vout[0].nValue = 10 * COIN;
+            CTransactionRef tx = MakeTransactionRef(mtx);
+
+            CTxMemPool::setEntries setAncestors;
+            BOOST_CHECK(pool.CalculateMemPoolAncestors(entry.FromTx(*tx), setAncestors, 25, 1000000, 25, 1000000, dummy));
+            BOOST_CHECK_EQUAL(setAncestors.size(), (size_t)i);
+            pool.addUnchecked(tx->GetHash(), entry.FromTx(*tx), setAncestors);
+            vChain.push_back(tx);
+        }
+
+        CMutableTransaction child;
+        child.vin.resize(1);
+        child.vin[0].prevout = COutPoint(vChain.back()->GetHash(), 0);
+        child.vin[0].scriptSig = CScript() << OP_11;
+        child.vout.resize(1);
+        child.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        child.vout[0].nValue = 10 * COIN;
+
+        // Rejected by the ancestor count of its parent, then by the descendant count of the root
+        CTxMemPool::setEntries setAncestors;
+        BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry.FromTx(child), setAncestors, 25, 1000000, 100, 1000000, dummy));
+        BOOST_CHECK(dummy.find("ancestors") != std::string::npos);
+        setAncestors.clear();
+        BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry.FromTx(child), setAncestors, 100, 1000000, 25, 1000000, dummy));
+        BOOST_CHECK(dummy.find(vChain.front()->GetHash().ToString()) != std::string::npos);
+
+        // Accepted with the whole chain as ancestors, the same set the general walk finds
+        setAncestors.clear();
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(entry.FromTx(child), setAncestors, 100, 1000000, 100, 1000000, dummy));
+        BOOST_CHECK_EQUAL(setAncestors.size(), 25U);
+        CTxMemPool::setEntries setAncestorsWalked;
+        pool.addUnchecked(child.GetHash(), entry.FromTx(child));
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(*pool.mapTx.find(child.GetHash()), setAncestorsWalked, 100, 1000000, 100, 1000000, dummy, false));
+        BOOST_CHECK(setAncestors == setAncestorsWalked);
+    }
+
+    BOOST_AUTO_TEST_CASE(mempool_txdata_test)
+    {
+        CTxMemPool pool;
+        TestMemPoolEntryHelper entry;
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(72, 1));
+        tx.vout.emplace_back(COIN, CScript() << OP_0 << std::vector<unsigned char>(20, 2));
+        const CTransaction txWitness(tx);
+
+        CTxMemPoolEntry txEntry = entry.FromTx(txWitness);
+        const size_t nUsage = txEntry.DynamicMemoryUsage();
+        std::shared_ptr<const PrecomputedTransactionData> txdata = std::make_shared<const PrecomputedTransactionData>(txWitness);
+        BOOST_CHECK(txdata->ready);
+        txEntry.SetTxData(txdata);
+        BOOST_CHECK_GT(txEntry.DynamicMemoryUsage(), nUsage);
+        pool.addUnchecked(txWitness.GetHash(), txEntry);
+
+        std::shared_ptr<const PrecomputedTransactionData> txdataPool = pool.GetTxData(txWitness.GetHash());
+        BOOST_CHECK(txdataPool == txdata);
+
+        // A copy of the transaction with another witness has the same midstates
+        tx.vin[0].scriptWitness.stack[0] = std::vector<unsigned char>(71, 3);
+        const PrecomputedTransactionData txdataMalleated{CTransaction(tx)};
+        BOOST_CHECK(txdataPool->hashPrevouts == txdataMalleated.hashPrevouts);
+        BOOST_CHECK(txdataPool->hashSequence == txdataMalleated.hashSequence);
+        BOOST_CHECK(txdataPool->hashOutputs == txdataMalleated.hashOutputs);
+
+        // Transactions without midstates and ones that aren't in the pool
+        CMutableTransaction txPlain;
+        txPlain.vout.emplace_back(COIN, CScript() << OP_TRUE);
+        pool.addUnchecked(txPlain.GetHash(), entry.FromTx(txPlain));
+        BOOST_CHECK(!pool.GetTxData(txPlain.GetHash()));
+        BOOST_CHECK(!pool.GetTxData(InsecureRand256()));
+
+        pool.removeRecursive(txWitness);
+        BOOST_CHECK(!pool.GetTxData(txWitness.GetHash()));
+        BOOST_CHECK_EQUAL(txdataPool.use_count(), 2);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -148,4 +148,34 @@ BOOST_FIXTURE_TEST_SUITE(merkle_tests, TestingSetup)
         }
     }
 
+    BOOST_AUTO_TEST_CASE(merkle_coinstake_branch_test)
+    {
+        // The staker caches the coinstake's branch and only rehashes that path when it swaps
+        // the coinstake in, or sets the first hash when it retimes the coinbase
+        for (int ntx = 2; ntx <= 40; ntx++)
+        {
+            CBlock block;
+            block.vtx.resize(ntx);
+            for (int j = 0; j < ntx; j++)
+            {
+                CMutableTransaction mtx;
+                mtx.nLockTime = j;
+                block.vtx[j] = MakeTransactionRef(std::move(mtx));
+            }
+            std::vector<uint256> branch = BlockMerkleBranch(block, 1);
+
+            CMutableTransaction coinbase(*block.vtx[0]);
+            coinbase.nTime = 1000 + ntx;
+            block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+            CMutableTransaction coinstake(*block.vtx[1]);
+            coinstake.nTime = 2000 + ntx;
+            block.vtx[1] = MakeTransactionRef(std::move(coinstake));
+
+            BOOST_CHECK(ComputeMerkleRootFromBranch(block.vtx[1]->GetHash(), branch, 1) != BlockMerkleRoot(block));
+            branch[0] = block.vtx[0]->GetHash();
+            BOOST_CHECK(branch == BlockMerkleBranch(block, 1));
+            BOOST_CHECK(ComputeMerkleRootFromBranch(block.vtx[1]->GetHash(), branch, 1) == BlockMerkleRoot(block));
+        }
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
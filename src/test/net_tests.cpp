@@ -11,6 +11,8 @@
 #include "streams.h"
 #include "net.h"
 #include "netbase.h"
+#include "netevents.h"
+#include "net_processing.h"
 #include "chainparams.h"
 #include "util.h"
 
@@ -23,7 +25,6 @@ public:
     void MakeDeterministic()
     {
         nKey.SetNull();
-        insecure_rand = FastRandomContext(true);
     }
 };
 
@@ -198,4 +199,128 @@ BOOST_FIXTURE_TEST_SUITE(net_tests, BasicTestingSetup)
         BOOST_CHECK(pnode2->fFeeler == false);
     }
 
+    BOOST_AUTO_TEST_CASE(cnetmessage_receive_test)
+    {
+        BOOST_TEST_MESSAGE("Running CNetMessage Receive Test");
+
+        std::vector<unsigned char> vPayload(300000);
+        for (size_t i = 0; i < vPayload.size(); i++)
+            vPayload[i] = (unsigned char)(i * 7);
+        CMessageHeader hdr(GetParams().MessageStart(), NetMsgType::PING, vPayload.size());
+        uint256 hash = Hash(vPayload.begin(), vPayload.end());
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+        CDataStream ssMsg(SER_NETWORK, INIT_PROTO_VERSION);
+        ssMsg << hdr;
+        ssMsg.write((const char*)vPayload.data(), vPayload.size());
+
+        // Fed in uneven pieces, the first splitting the header, the message arrives whole
+        const size_t nPoolBefore = g_recv_buffer_pool.Size();
+        {
+            CNetMessage msg(GetParams().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+            for (size_t nPos = 0; nPos < ssMsg.size(); ) {
+                unsigned int nPiece = std::min<size_t>(nPos == 0 ? 10 : 7919, ssMsg.size() - nPos);
+                int nHandled = msg.in_data ? msg.readData(&ssMsg[nPos], nPiece) : msg.readHeader(&ssMsg[nPos], nPiece);
+                BOOST_REQUIRE(nHandled > 0);
+                nPos += nHandled;
+                BOOST_CHECK(msg.complete() == (nPos == ssMsg.size()));
+            }
+            BOOST_CHECK(msg.hdr.GetCommand() == NetMsgType::PING);
+            BOOST_CHECK(msg.vRecv.size() == vPayload.size());
+            BOOST_CHECK(std::equal(vPayload.begin(), vPayload.end(), (const unsigned char*)&msg.vRecv[0]));
+            BOOST_CHECK(msg.GetMessageHash() == hash);
+        }
+
+        // Its storage goes back to the pool once processed, and the next message receives into it
+        BOOST_CHECK(g_recv_buffer_pool.Size() == nPoolBefore + 1);
+        CNetMessage msg(GetParams().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+        BOOST_CHECK(msg.readHeader(&ssMsg[0], CMessageHeader::HEADER_SIZE) == CMessageHeader::HEADER_SIZE);
+        BOOST_CHECK(g_recv_buffer_pool.Size() == nPoolBefore);
+        BOOST_CHECK(msg.vRecv.empty());
+        BOOST_CHECK(msg.readData(&ssMsg[CMessageHeader::HEADER_SIZE], 1000) == 1000);
+        BOOST_CHECK(std::equal(vPayload.begin(), vPayload.begin() + 1000, (const unsigned char*)&msg.vRecv[0]));
+        BOOST_CHECK(!msg.complete());
+    }
+
+#ifndef WIN32
+    BOOST_AUTO_TEST_CASE(socket_events_test)
+    {
+        BOOST_TEST_MESSAGE("Running socket events test with " << CSocketEvents::Backend());
+
+        int fds[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        SOCKET a = fds[0], b = fds[1];
+
+        CSocketEvents events;
+        std::map<SOCKET, uint8_t> mapReady;
+
+        // Nothing to read yet, and a socket waited on only for errors is never ready
+        events.Update({{a, {1, CSocketEvents::RECV}}, {b, {2, CSocketEvents::NONE}}});
+        BOOST_CHECK(events.Wait(0, mapReady));
+        BOOST_CHECK(mapReady.empty());
+
+        // Data waiting makes it readable, and stays so until it is read
+        BOOST_CHECK(send(b, "x", 1, 0) == 1);
+        BOOST_CHECK(events.Wait(1000, mapReady));
+        BOOST_CHECK(mapReady.size() == 1 && (mapReady[a] & CSocketEvents::RECV));
+        BOOST_CHECK(events.Wait(0, mapReady));
+        BOOST_CHECK(mapReady.count(a));
+        char ch;
+        BOOST_CHECK(recv(a, &ch, 1, 0) == 1);
+        BOOST_CHECK(events.Wait(0, mapReady));
+        BOOST_CHECK(mapReady.empty());
+
+        // Switching to send, an empty send buffer is writable at once
+        events.Update({{a, {1, CSocketEvents::SEND}}, {b, {2, CSocketEvents::NONE}}});
+        BOOST_CHECK(send(b, "x", 1, 0) == 1);
+        BOOST_CHECK(events.Wait(1000, mapReady));
+        BOOST_CHECK(mapReady.size() == 1 && mapReady[a] == CSocketEvents::SEND);
+
+        // A socket left out is no longer waited on
+        events.Update({{b, {2, CSocketEvents::RECV}}});
+        BOOST_CHECK(events.Wait(0, mapReady));
+        BOOST_CHECK(mapReady.empty());
+
+        // A closed socket whose number is reused by a new owner is waited on afresh
+        events.Update({{a, {1, CSocketEvents::RECV}}});
+        CloseSocket(a);
+        int fds2[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds2) == 0);
+        SOCKET c = fds2[0], d = fds2[1];
+        events.Update({{c, {3, CSocketEvents::RECV}}});
+        BOOST_CHECK(send(d, "x", 1, 0) == 1);
+        BOOST_CHECK(events.Wait(1000, mapReady));
+        BOOST_CHECK(mapReady.size() == 1 && (mapReady[c] & CSocketEvents::RECV));
+
+        // The peer hanging up wakes the reader
+        CloseSocket(d);
+        BOOST_CHECK(recv(c, &ch, 1, 0) == 1);
+        BOOST_CHECK(events.Wait(1000, mapReady));
+        BOOST_CHECK(mapReady.count(c));
+        BOOST_CHECK(recv(c, &ch, 1, 0) == 0);
+
+        CloseSocket(b);
+        CloseSocket(c);
+    }
+#endif
+
+BOOST_AUTO_TEST_CASE(message_cost_histogram)
+{
+    CMessageCost cost;
+    cost.Add(0, 0, 0);
+    cost.Add(9, 0, 0);
+    cost.Add(10, 5, 2);
+    cost.Add(999999, 500000, 0);
+    cost.Add(1000000, 0, 0);
+    cost.Add(60000000, 0, 0);
+
+    BOOST_CHECK_EQUAL(cost.nMessages, 6U);
+    BOOST_CHECK_EQUAL(cost.nMicros, 62000018);
+    BOOST_CHECK_EQUAL(cost.nMaxMicros, 60000000);
+    BOOST_CHECK_EQUAL(cost.nCsMainMicros, 500005);
+    BOOST_CHECK_EQUAL(cost.nDeserializeMicros, 2);
+    const uint64_t vExpected[MSG_COST_BUCKETS] = {2, 1, 0, 0, 0, 1, 2};
+    for (int i = 0; i < MSG_COST_BUCKETS; i++)
+        BOOST_CHECK_EQUAL(cost.vBuckets[i], vExpected[i]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
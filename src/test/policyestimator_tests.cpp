@@ -3,8 +3,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
+#include "chainparams.h"
 #include "policy/policy.h"
 #include "policy/fees.h"
+#include "tokens/tokens.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
@@ -205,4 +208,64 @@ BOOST_FIXTURE_TEST_SUITE(policyestimator_tests, BasicTestingSetup)
         }
     }
 
+    BOOST_AUTO_TEST_CASE(token_class_estimates_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Class Estimates Test");
+
+        CBlockPolicyEstimator feeEst;
+        CTxMemPool mpool(&feeEst);
+        TestMemPoolEntryHelper entry;
+        CAmount lowFee(4000);
+        CAmount highFee(40000);
+
+        CScript garbage;
+        for (unsigned int i = 0; i < 128; i++)
+            garbage.push_back('X');
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = garbage;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 0LL;
+
+        // A restricted token operation of the same size
+        CMutableTransaction tokenTx(tx);
+        CScript tagScript = GetScriptForNullTokenDataDestination(DecodeDestination(GetParams().GlobalFeeAddress()));
+        CNullTokenTxData("#ADDTAG", (int)QualifierType::ADD_QUALIFIER).ConstructTransaction(tagScript);
+        tokenTx.vout[0].scriptPubKey = tagScript;
+
+        // Plain transactions only confirm at the high fee, token transactions confirm at the low fee
+        std::vector<CTransactionRef> block;
+        int blocknum = 0;
+        while (blocknum < 100)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                tx.vin[0].prevout.n = 10000 * blocknum + k;
+                mpool.addUnchecked(tx.GetHash(), entry.Fee(highFee).Time(GetTime()).Height(blocknum).FromTx(tx));
+                block.push_back(mpool.get(tx.GetHash()));
+
+                tx.vin[0].prevout.n = 10000 * blocknum + 100 + k;
+                mpool.addUnchecked(tx.GetHash(), entry.Fee(lowFee).Time(GetTime()).Height(blocknum).FromTx(tx));
+
+                tokenTx.vin[0].prevout.n = 10000 * blocknum + 200 + k;
+                mpool.addUnchecked(tokenTx.GetHash(), entry.Fee(lowFee).Time(GetTime()).Height(blocknum).FromTx(tokenTx));
+                block.push_back(mpool.get(tokenTx.GetHash()));
+            }
+            mpool.removeForBlock(block, ++blocknum);
+            block.clear();
+        }
+
+        FeeCalculation feeCalc;
+        CFeeRate anyRate = feeEst.estimateSmartFee(4, &feeCalc, false, FeeEstimateClass::ANY);
+        CFeeRate tokenRate = feeEst.estimateSmartFee(4, &feeCalc, false, FeeEstimateClass::TOKEN);
+        BOOST_CHECK(feeCalc.reason == FeeReason::TOKEN_ESTIMATE);
+        BOOST_CHECK(anyRate > CFeeRate(0));
+        BOOST_CHECK(tokenRate > CFeeRate(0));
+        BOOST_CHECK(tokenRate < anyRate);
+
+        // Without token data the token class falls back to all transactions
+        CBlockPolicyEstimator emptyEst;
+        BOOST_CHECK(emptyEst.estimateSmartFee(4, nullptr, false, FeeEstimateClass::TOKEN) == emptyEst.estimateSmartFee(4, nullptr, false));
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "pos.h"
+#include "random.h"
+#include "test/test_paladeum.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pos_tests, BasicTestingSetup)
+
+    BOOST_AUTO_TEST_CASE(stake_kernel_search_test)
+    {
+        CBlockIndex indexPrev;
+        indexPrev.nStakeModifier = InsecureRand256();
+
+        std::vector<CStakeKernel> vKernels;
+        std::vector<unsigned int> vTimePrev;
+        for (int i = 0; i < 200; i++) {
+            COutPoint prevout(InsecureRand256(), InsecureRandRange(4));
+            CAmount nValue = 1 + InsecureRandRange(1000 * COIN);
+            vTimePrev.push_back(InsecureRand32());
+            vKernels.emplace_back(&indexPrev, prevout, nValue, vTimePrev.back());
+        }
+
+        // Targets from hopeless to generous, so both misses and several hits get exercised; with
+        // values of about 37 bits 0x1c0fffff puts the target times the value right at 2^256
+        for (unsigned int nBits : {0x03000001U, 0x1a00ffffU, 0x1b00ffffU, 0x1c0fffffU, 0x1d00ffffU, 0x1f00ffffU}) {
+            arith_uint256 bnTarget;
+            bnTarget.SetCompact(nBits);
+
+            for (unsigned int nTimeTx = 1600000000; nTimeTx < 1600000000 + 16 * 8; nTimeTx += 16) {
+                int nFirst = -1;
+                for (size_t i = 0; i < vKernels.size(); i++) {
+                    bool fHit = CheckStakeKernelHash(&indexPrev, nBits, vKernels[i].nValue, vKernels[i].prevout, nTimeTx, vTimePrev[i]);
+                    BOOST_CHECK_EQUAL(vKernels[i].Check(bnTarget, nTimeTx), fHit);
+                    if (fHit && nFirst < 0)
+                        nFirst = i;
+                }
+
+                // The lowest hit wins whatever the number of threads
+                for (int nThreads : {1, 2, 3, 8, 500})
+                    BOOST_CHECK_EQUAL(SearchStakeKernels(vKernels, nBits, nTimeTx, nThreads), nFirst);
+            }
+        }
+
+        BOOST_CHECK_EQUAL(SearchStakeKernels(std::vector<CStakeKernel>(), 0x1f00ffff, 1600000000, 4), -1);
+    }
+
+    BOOST_AUTO_TEST_CASE(stake_proof_cache_test)
+    {
+        ClearStakeProofCache();
+        std::vector<CBlockIndex> vIndex(3);
+        vIndex[0].nHeight = 10;
+        vIndex[1].nHeight = 10;
+        vIndex[2].nHeight = 10 + STAKE_PROOF_CACHE_SIZE;
+
+        uint256 hash = InsecureRand256();
+        uint256 hashCached;
+        BOOST_CHECK(!GetCachedStakeProof(&vIndex[0], hashCached));
+        CacheStakeProof(&vIndex[0], hash);
+        BOOST_CHECK(GetCachedStakeProof(&vIndex[0], hashCached) && hashCached == hash);
+
+        // Keyed by the block index, not its height
+        BOOST_CHECK(!GetCachedStakeProof(&vIndex[1], hashCached));
+
+        // A block a full ring higher takes the slot
+        CacheStakeProof(&vIndex[2], InsecureRand256());
+        BOOST_CHECK(!GetCachedStakeProof(&vIndex[0], hashCached));
+        BOOST_CHECK(GetCachedStakeProof(&vIndex[2], hashCached));
+
+        ClearStakeProofCache();
+        BOOST_CHECK(!GetCachedStakeProof(&vIndex[2], hashCached));
+    }
+
+    BOOST_AUTO_TEST_CASE(stake_kernel_hash_test)
+    {
+        CBlockIndex indexPrev;
+        indexPrev.nStakeModifier = InsecureRand256();
+        COutPoint prevout(InsecureRand256(), 1);
+
+        // The hash CheckStakeKernelHash reports is the one it compared against the target
+        uint256 hashProofOfStake;
+        CheckStakeKernelHash(&indexPrev, 0x1d00ffff, COIN, prevout, 1600000016, 1500000000, &hashProofOfStake);
+        BOOST_CHECK(hashProofOfStake == GetStakeKernelHash(&indexPrev, prevout, 1600000016, 1500000000));
+        BOOST_CHECK(hashProofOfStake != GetStakeKernelHash(&indexPrev, prevout, 1600000032, 1500000000));
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -213,6 +213,13 @@ BOOST_FIXTURE_TEST_SUITE(rpc_tests, TestingSetup)
         BOOST_CHECK_EQUAL(ValueFromAmount(COIN / 1000000).write(), "0.00000100");
         BOOST_CHECK_EQUAL(ValueFromAmount(COIN / 10000000).write(), "0.00000010");
         BOOST_CHECK_EQUAL(ValueFromAmount(COIN / 100000000).write(), "0.00000001");
+
+        // Token amounts are cut to the token's units
+        BOOST_CHECK_EQUAL(ValueFromAmount(COIN * 5 + 1, 0).write(), "5");
+        BOOST_CHECK_EQUAL(ValueFromAmount(-COIN / 2, 4).write(), "-0.5000");
+        BOOST_CHECK_EQUAL(ValueFromAmount(123456789, 1).write(), "1.2");
+        BOOST_CHECK_EQUAL(ValueFromAmount(std::numeric_limits<CAmount>::min()).write(), "-92233720368.54775808");
+        BOOST_CHECK_EQUAL(ValueFromAmount(std::numeric_limits<CAmount>::max()).write(), "92233720368.54775807");
     }
 
     static UniValue ValueFromString(const std::string &str)
@@ -390,4 +397,92 @@ BOOST_FIXTURE_TEST_SUITE(rpc_tests, TestingSetup)
         BOOST_CHECK_EQUAL(result[2].get_int(), 9);
     }
 
+    BOOST_AUTO_TEST_CASE(rpc_json_stream_writer_test)
+    {
+        BOOST_TEST_MESSAGE("Running RPC JSON Stream Writer Test");
+
+        UniValue inner(UniValue::VARR);
+        inner.push_back(1);
+        inner.push_back("two");
+        UniValue expected(UniValue::VOBJ);
+        expected.push_back(Pair("a", "x\"y"));
+        expected.push_back(Pair("list", inner));
+        expected.push_back(Pair("empty", UniValue(UniValue::VOBJ)));
+        expected.push_back(Pair("b", 2));
+        expected.push_back(Pair("c", ValueFromAmount(-COIN * 3 / 2, 2)));
+
+        // A tiny chunk size so every piece goes to the sink on its own
+        std::string strOutput;
+        int nChunks = 0;
+        JSONStreamWriter stream([&](const std::string& strChunk) {
+            strOutput += strChunk;
+            nChunks++;
+            return true;
+        }, 1);
+        BOOST_CHECK(!stream.Started());
+        stream.BeginObject();
+        stream.KeyValue("a", "x\"y");
+        stream.Key("list");
+        stream.BeginArray();
+        stream.Value(1);
+        stream.Value("two");
+        stream.EndArray();
+        stream.Key("empty");
+        stream.BeginObject();
+        stream.EndObject();
+        stream.KeyValue("b", 2);
+        stream.KeyAmount("c", -COIN * 3 / 2, 2);
+        stream.EndObject();
+        stream.Flush();
+
+        BOOST_CHECK(stream.Started());
+        BOOST_CHECK(nChunks > 1);
+        BOOST_CHECK_EQUAL(strOutput, expected.write());
+
+        // Output is dropped once the sink refuses it
+        strOutput.clear();
+        JSONStreamWriter closed([&](const std::string& strChunk) {
+            strOutput += strChunk;
+            return false;
+        }, 1);
+        closed.BeginArray();
+        closed.Value(1);
+        closed.EndArray();
+        BOOST_CHECK(!closed.IsOpen());
+        BOOST_CHECK_EQUAL(strOutput, "[");
+    }
+
+    BOOST_AUTO_TEST_CASE(rpc_batch_order_test)
+    {
+        BOOST_TEST_MESSAGE("Running RPC Batch Order Test");
+
+        if (RPCIsInWarmup(nullptr))
+            SetRPCWarmupFinished();
+
+        UniValue batch(UniValue::VARR);
+        for (int i = 0; i < 20; i++) {
+            UniValue call(UniValue::VOBJ);
+            call.push_back(Pair("method", i % 2 ? "getbestblockhash" : "getblockcount"));
+            call.push_back(Pair("params", UniValue(UniValue::VARR)));
+            call.push_back(Pair("id", i));
+            batch.push_back(call);
+        }
+
+        for (const char* strThreads : {"1", "4"}) {
+            gArgs.ForceSetArg("-rpcbatchthreads", strThreads);
+            UniValue reply;
+            BOOST_CHECK(reply.read(JSONRPCExecBatch(JSONRPCRequest(), batch)));
+            BOOST_CHECK_EQUAL(reply.size(), 20);
+            for (int i = 0; i < (int)reply.size(); i++) {
+                BOOST_CHECK_EQUAL(find_value(reply[i], "id").get_int(), i);
+                BOOST_CHECK(find_value(reply[i], "error").isNull());
+                if (i % 2)
+                    BOOST_CHECK_EQUAL(find_value(reply[i], "result").get_str(), chainActive.Tip()->GetIndexHash().GetHex());
+                else
+                    BOOST_CHECK_EQUAL(find_value(reply[i], "result").get_int(), chainActive.Height());
+            }
+        }
+        gArgs.ForceSetArg("-rpcbatchthreads", "1");
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -124,4 +124,80 @@ BOOST_AUTO_TEST_SUITE(scheduler_tests)
         BOOST_CHECK_EQUAL(counterSum, 200);
     }
 
+    BOOST_AUTO_TEST_CASE(priority_order_test)
+    {
+        BOOST_TEST_MESSAGE("Running Priority Order Test");
+
+        // Tasks that are all due run high priority first, whatever order they were scheduled in
+        CScheduler scheduler;
+        boost::mutex mutex;
+        std::vector<int> vOrder;
+        boost::chrono::system_clock::time_point past = boost::chrono::system_clock::now() - boost::chrono::seconds(1);
+        for (int priority : {CScheduler::PRIORITY_LOW, CScheduler::PRIORITY_NORMAL, CScheduler::PRIORITY_HIGH}) {
+            scheduler.schedule([&mutex, &vOrder, priority] {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                vOrder.push_back(priority);
+            }, past, (CScheduler::Priority)priority);
+        }
+
+        std::vector<CScheduler::PriorityStats> vStats = scheduler.getPriorityStats();
+        BOOST_CHECK_EQUAL(vStats[CScheduler::PRIORITY_LOW].nQueued, 1U);
+
+        scheduler.stop(true);
+        boost::thread thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+        thread.join();
+
+        BOOST_CHECK(vOrder == std::vector<int>({CScheduler::PRIORITY_HIGH, CScheduler::PRIORITY_NORMAL, CScheduler::PRIORITY_LOW}));
+        vStats = scheduler.getPriorityStats();
+        for (int priority = 0; priority < CScheduler::NUM_PRIORITIES; priority++) {
+            BOOST_CHECK_EQUAL(vStats[priority].nQueued, 0U);
+            BOOST_CHECK_EQUAL(vStats[priority].nTasks, 1U);
+            // They were all due a second before they could start
+            BOOST_CHECK(vStats[priority].nMaxDelayMicros >= 1000000);
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(priority_thread_test)
+    {
+        BOOST_TEST_MESSAGE("Running Priority Thread Test");
+
+        // A low priority task that blocks cannot hold up a high priority one,
+        // and a second low priority task waits for the first
+        CScheduler scheduler;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        bool fHighRan = false;
+        bool fLowSawHigh = false;
+        int nLowRunning = 0;
+        int nMaxLowRunning = 0;
+
+        auto lowTask = [&] {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nMaxLowRunning = std::max(nMaxLowRunning, ++nLowRunning);
+            fLowSawHigh = cond.wait_for(lock, boost::chrono::seconds(10), [&] { return fHighRan; });
+            nLowRunning--;
+        };
+        scheduler.schedule(lowTask, boost::chrono::system_clock::now(), CScheduler::PRIORITY_LOW);
+        scheduler.schedule(lowTask, boost::chrono::system_clock::now(), CScheduler::PRIORITY_LOW);
+
+        boost::thread_group threads;
+        for (int i = 0; i < 2; i++)
+            threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+
+        MicroSleep(50000);
+        scheduler.schedule([&] {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fHighRan = true;
+            cond.notify_all();
+        }, boost::chrono::system_clock::now(), CScheduler::PRIORITY_HIGH);
+
+        scheduler.stop(true);
+        threads.join_all();
+
+        BOOST_CHECK(fHighRan);
+        BOOST_CHECK(fLowSawHigh);
+        BOOST_CHECK_EQUAL(nMaxLowRunning, 1);
+        BOOST_CHECK_EQUAL(scheduler.getPriorityStats()[CScheduler::PRIORITY_LOW].nTasks, 2U);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include "core_io.h"
 #include "key.h"
 #include "keystore.h"
+#include "policy/policy.h"
 #include "script/script.h"
 #include "script/script_error.h"
 #include "script/sign.h"
@@ -1646,4 +1647,107 @@ BOOST_FIXTURE_TEST_SUITE(script_tests, BasicTestingSetup)
         BOOST_CHECK(s == d);
     }
 
+    class StandardScriptTestChecker : public BaseSignatureChecker
+    {
+    public:
+        bool fCoinStake = false;
+        std::vector<CScript> vScriptCodes;
+
+        bool CheckSig(const std::vector<unsigned char> &vchSig, const std::vector<unsigned char> &vchPubKey, const CScript &scriptCode, SigVersion sigversion) const override
+        {
+            const_cast<StandardScriptTestChecker*>(this)->vScriptCodes.push_back(scriptCode);
+            return vchSig.size() > 1 && vchSig[vchSig.size() - 2] == 0x01;
+        }
+
+        bool IsCoinStake() const override
+        {
+            return fCoinStake;
+        }
+    };
+
+    BOOST_AUTO_TEST_CASE(script_standard_fast_path_test)
+    {
+        BOOST_TEST_MESSAGE("Running Script Standard Fast Path Test");
+
+        CKey key;
+        key.MakeNewKey(true);
+        const std::vector<unsigned char> vchPubKey = ToByteVector(key.GetPubKey());
+        CKey keyOwner;
+        keyOwner.MakeNewKey(false);
+        const std::vector<unsigned char> vchPubKeyOwner = ToByteVector(keyOwner.GetPubKey());
+
+        // DER encoded, the checker passes signatures with 0x01 before the hash type
+        std::vector<unsigned char> vchSigGood = ParseHex("3006020101020101");
+        vchSigGood.push_back(SIGHASH_ALL);
+        std::vector<unsigned char> vchSigBad = ParseHex("3006020101020102");
+        vchSigBad.push_back(SIGHASH_ALL);
+
+        const CScript scriptP2PKH = GetScriptForDestination(key.GetPubKey().GetID());
+        const CScript scriptP2SH = GetScriptForDestination(CScriptID(scriptP2PKH));
+        const CScript scriptOffline = CScript() << OP_OFFLINE_STAKE << OP_IF << OP_DUP << OP_HASH160 << ToByteVector(key.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG
+                                                << OP_ELSE << OP_DUP << OP_HASH160 << ToByteVector(keyOwner.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG << OP_ENDIF;
+        BOOST_CHECK(scriptOffline.IsOfflineStaking());
+
+        std::vector<CScript> vScripts = {scriptP2PKH, scriptP2SH, scriptOffline};
+        const std::vector<unsigned char> vchToken(40, 'T');
+        for (const CScript& script : {scriptP2PKH, scriptP2SH}) {
+            vScripts.push_back(CScript(script) << OP_PLB_TOKEN << vchToken << OP_DROP);
+            // Everything after OP_PLB_TOKEN is its data, pushes in it aren't checked but its size is
+            CScript scriptNonMinimal(script);
+            scriptNonMinimal.push_back(OP_PLB_TOKEN);
+            scriptNonMinimal.push_back(OP_PUSHDATA1);
+            scriptNonMinimal.push_back(vchToken.size());
+            scriptNonMinimal.insert(scriptNonMinimal.end(), vchToken.begin(), vchToken.end());
+            scriptNonMinimal.push_back(OP_DROP);
+            vScripts.push_back(scriptNonMinimal);
+            vScripts.push_back(CScript(script) << OP_PLB_TOKEN << std::vector<unsigned char>(MAX_SCRIPT_ELEMENT_SIZE + 1, 'T') << OP_DROP);
+            vScripts.push_back(CScript(script) << OP_PLB_TOKEN << vchToken << OP_DROP << OP_TRUE);
+            vScripts.push_back(CScript(script) << OP_PLB_TOKEN);
+            // Not standard, take the generic path
+            vScripts.push_back(CScript(script) << OP_TRUE);
+            vScripts.push_back(CScript(script) << OP_OFFLINE_STAKE);
+        }
+
+        std::vector<std::vector<std::vector<unsigned char> > > vStacks = {
+            {},
+            {vchPubKey},
+            {vchSigGood, vchPubKey},
+            {vchSigBad, vchPubKey},
+            {std::vector<unsigned char>(), vchPubKey},
+            {ParseHex("3006020101020101"), vchPubKey},
+            {vchSigGood, vchPubKeyOwner},
+            {vchSigBad, vchPubKeyOwner},
+            {vchSigGood, std::vector<unsigned char>(vchPubKey.begin(), vchPubKey.end() - 1)},
+            {ToByteVector(scriptP2PKH)},
+            {vchSigGood, ToByteVector(scriptP2PKH)},
+        };
+
+        const std::vector<unsigned int> vFlags = {
+            SCRIPT_VERIFY_NONE,
+            STANDARD_SCRIPT_VERIFY_FLAGS,
+            STANDARD_SCRIPT_VERIFY_FLAGS & ~SCRIPT_VERIFY_NULLFAIL,
+            MANDATORY_SCRIPT_VERIFY_FLAGS,
+        };
+
+        for (const CScript& script : vScripts) {
+            for (const std::vector<std::vector<unsigned char> >& stackIn : vStacks) {
+                for (unsigned int flags : vFlags) {
+                    for (bool fCoinStake : {false, true}) {
+                        StandardScriptTestChecker checker, checkerGeneric;
+                        checker.fCoinStake = checkerGeneric.fCoinStake = fCoinStake;
+                        std::vector<std::vector<unsigned char> > stack = stackIn, stackGeneric = stackIn;
+                        ScriptError serror, serrorGeneric;
+                        const bool fResult = EvalScript(stack, script, flags, checker, SIGVERSION_BASE, &serror);
+                        const bool fResultGeneric = EvalScriptGeneric(stackGeneric, script, flags, checkerGeneric, SIGVERSION_BASE, &serrorGeneric);
+                        BOOST_CHECK_EQUAL(fResult, fResultGeneric);
+                        BOOST_CHECK_EQUAL(serror, serrorGeneric);
+                        if (fResult)
+                            BOOST_CHECK(stack == stackGeneric);
+                        BOOST_CHECK(checker.vScriptCodes == checkerGeneric.vScriptCodes);
+                    }
+                }
+            }
+        }
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -95,6 +95,12 @@ BOOST_FIXTURE_TEST_SUITE(skiplist_tests, BasicTestingSetup)
             CBlockIndex *tip = (r < 100000) ? &vBlocksMain[r] : &vBlocksSide[r - 100000];
             CBlockLocator locator = chain.GetLocator(tip);
 
+            // Ancestors come from the chain on the main branch and from the skip list off it, and agree either way
+            int nHeight = InsecureRandRange(tip->nHeight + 1);
+            BOOST_CHECK(chain.GetAncestor(tip, nHeight) == tip->GetAncestor(nHeight));
+            BOOST_CHECK(chain.GetAncestor(tip, tip->nHeight + 1) == nullptr);
+            BOOST_CHECK(chain.GetAncestor(tip, -1) == nullptr);
+
             // The first result must be the block itself, the last one must be genesis.
             BOOST_CHECK(locator.vHave.front() == tip->GetIndexHash());
             BOOST_CHECK(locator.vHave.back() == vBlocksMain[0].GetIndexHash());
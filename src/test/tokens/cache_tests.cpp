@@ -1,8 +1,11 @@
 
 #include "tokens/tokens.h"
+#include "cachebudget.h"
 #include <boost/test/unit_test.hpp>
 #include <test/test_paladeum.h>
 
+#include <thread>
+
 BOOST_FIXTURE_TEST_SUITE(cache_tests, BasicTestingSetup)
 
 
@@ -37,5 +40,174 @@ BOOST_AUTO_TEST_CASE(cache_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(cache_memusage_test)
+{
+    BOOST_TEST_MESSAGE("Running Cache Memusage Test");
+
+    // Heap allocated strings are accounted for, short ones are stored inline
+    std::string strLong(100, 'A');
+    BOOST_CHECK(memusage::DynamicUsage(strLong) >= strLong.size());
+
+    CTokensCache tokenCache;
+    BOOST_CHECK_EQUAL(tokenCache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(tokenCache.DynamicMemoryUsage(), 0U);
+
+    // Qualifier and restricted sets are part of the dirty cache
+    tokenCache.setNewQualifierAddressToAdd.insert(CTokenCacheQualifierAddress("#KYC", strLong, QualifierType::ADD_QUALIFIER));
+    size_t nQualifierSize = tokenCache.GetCacheSize();
+    BOOST_CHECK(nQualifierSize > strLong.size());
+
+    tokenCache.setNewRestrictedAddressToAdd.insert(CTokenCacheRestrictedAddress("$TOKEN", strLong, RestrictedType::FREEZE_ADDRESS));
+    BOOST_CHECK(tokenCache.GetCacheSize() > nQualifierSize);
+
+    tokenCache.mapTokensAddressAmount[std::make_pair(std::string("TOKEN"), strLong)] = 1;
+    BOOST_CHECK(tokenCache.DynamicMemoryUsage() > tokenCache.GetCacheSize() + strLong.size());
+
+    tokenCache.ClearDirtyCache();
+    BOOST_CHECK_EQUAL(tokenCache.GetCacheSize(), 0U);
+
+    CLRUCache<std::string, int8_t> cache(10);
+    size_t nEmptyUsage = cache.DynamicMemoryUsage();
+    cache.Put(strLong, 1);
+    size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > nEmptyUsage + 2 * strLong.size());
+    cache.Erase(strLong);
+    BOOST_CHECK(cache.DynamicMemoryUsage() < nUsage);
+}
+
+BOOST_AUTO_TEST_CASE(cache_lru_stats_test)
+{
+    BOOST_TEST_MESSAGE("Running Cache LRU Stats Test");
+
+    CLRUCache<std::string, int> cache(3);
+    cache.Put("A", 1);
+    cache.Put("B", 2);
+    cache.Put("C", 3);
+
+    // Touching A makes B the least recently used entry
+    BOOST_CHECK_EQUAL(cache.Get("A"), 1);
+    cache.Put("D", 4);
+    BOOST_CHECK(!cache.Exists("B"));
+    BOOST_CHECK(cache.Exists("A") && cache.Exists("C") && cache.Exists("D"));
+    BOOST_CHECK_EQUAL(cache.Size(), 3U);
+    BOOST_CHECK_EQUAL(cache.Evictions(), 1U);
+
+    // Overwriting a key keeps the size and updates the value
+    cache.Put("C", 30);
+    BOOST_CHECK_EQUAL(cache.Get("C"), 30);
+    BOOST_CHECK_EQUAL(cache.Size(), 3U);
+
+    BOOST_CHECK_THROW(cache.Get("B"), std::range_error);
+    BOOST_CHECK_EQUAL(cache.Hits(), 5U);
+    BOOST_CHECK_EQUAL(cache.Misses(), 2U);
+
+    // Lookup counts a single hit or miss
+    int nValue = 0;
+    BOOST_CHECK(cache.Lookup("D", nValue) && nValue == 4);
+    BOOST_CHECK(!cache.Lookup("B", nValue));
+    BOOST_CHECK_EQUAL(cache.Hits(), 6U);
+    BOOST_CHECK_EQUAL(cache.Misses(), 3U);
+
+    // Erased entries are reused without evicting
+    cache.Erase("A");
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    cache.Put("E", 5);
+    BOOST_CHECK_EQUAL(cache.Evictions(), 1U);
+    BOOST_CHECK(cache.Exists("C") && cache.Exists("D") && cache.Exists("E"));
+
+    // Shrinking keeps the most recently used entries
+    cache.SetSize(1);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK(cache.Exists("E"));
+    BOOST_CHECK_EQUAL(cache.Evictions(), 3U);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    BOOST_CHECK(!cache.Exists("E"));
+}
+
+BOOST_AUTO_TEST_CASE(cache_sharded_test)
+{
+    BOOST_TEST_MESSAGE("Running Sharded Cache Test");
+
+    CShardedLRUCache<std::string, int> cache(1600);
+    BOOST_CHECK_EQUAL(cache.MaxSize(), 1600U);
+
+    // Writers and readers on separate threads, every key belongs to one writer
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&cache, t]() {
+            for (int i = 0; i < 200; i++) {
+                std::string key = std::to_string(t) + "_" + std::to_string(i);
+                cache.Put(key, i);
+                int value = -1;
+                assert(cache.Lookup(key, value) && value == i);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    BOOST_CHECK_EQUAL(cache.Size(), 800U);
+    BOOST_CHECK_EQUAL(cache.Get("3_199"), 199);
+
+    int value = 0;
+    cache.Erase("3_199");
+    BOOST_CHECK(!cache.Lookup("3_199", value));
+    BOOST_CHECK(!cache.Exists("3_199"));
+    BOOST_CHECK_EQUAL(cache.Size(), 799U);
+    BOOST_CHECK(cache.Hits() >= 801U);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(cache_interned_keys_test)
+{
+    BOOST_TEST_MESSAGE("Running Interned Keys Cache Test");
+
+    CNameInterner names(4);
+    BOOST_CHECK_EQUAL(names.Find("$TOKEN"), CNameInterner::NONE);
+    uint32_t nToken = names.Intern("$TOKEN");
+    uint32_t nAddress = names.Intern("address");
+    BOOST_CHECK(nToken != nAddress);
+    BOOST_CHECK_EQUAL(names.Intern("$TOKEN"), nToken);
+    BOOST_CHECK_EQUAL(names.Find("address"), nAddress);
+    BOOST_CHECK_EQUAL(names.Size(), 2U);
+    BOOST_CHECK(!names.Full(2));
+    BOOST_CHECK(names.Full(3));
+
+    // Keys of one token with many addresses, and of one address with many tokens, all stay distinct
+    CRestrictedLRUCache cache(100);
+    for (uint64_t i = 0; i < 50; i++) {
+        cache.Put((uint64_t)nToken << 32 | i, 1);
+        cache.Put(i << 32 | nAddress, 1);
+    }
+    BOOST_CHECK_EQUAL(cache.Size(), 99U);
+    BOOST_CHECK(cache.Exists((uint64_t)nToken << 32 | 49));
+    BOOST_CHECK(!cache.Exists((uint64_t)nToken << 32 | 50));
+
+    names.Clear();
+    BOOST_CHECK_EQUAL(names.Find("$TOKEN"), CNameInterner::NONE);
+}
+
+BOOST_AUTO_TEST_CASE(cache_budget_decision_test)
+{
+    // A full cache missing a third of its lookups grows
+    BOOST_CHECK(DecideCacheBudget(2000, 1000, 500, 2500, 2500, 2500) == CacheBudgetAction::GROW);
+    // Too few lookups, or not full, or missing little: kept
+    BOOST_CHECK(DecideCacheBudget(200, 100, 50, 2500, 2500, 2500) == CacheBudgetAction::KEEP);
+    BOOST_CHECK(DecideCacheBudget(2000, 1000, 0, 2000, 2500, 2500) == CacheBudgetAction::KEEP);
+    BOOST_CHECK(DecideCacheBudget(9000, 1000, 500, 2500, 2500, 2500) == CacheBudgetAction::KEEP);
+    // Never past its growth limit
+    BOOST_CHECK(DecideCacheBudget(2000, 1000, 500, 2500 * CACHE_BUDGET_MAX_GROWTH, 2500 * CACHE_BUDGET_MAX_GROWTH, 2500) == CacheBudgetAction::KEEP);
+
+    // A grown cache holding less than half of its entries shrinks, one at its startup size never does
+    BOOST_CHECK(DecideCacheBudget(5000, 0, 0, 2000, 5000, 2500) == CacheBudgetAction::SHRINK);
+    BOOST_CHECK(DecideCacheBudget(5000, 0, 0, 3000, 5000, 2500) == CacheBudgetAction::KEEP);
+    BOOST_CHECK(DecideCacheBudget(5000, 0, 0, 100, 2500, 2500) == CacheBudgetAction::KEEP);
+    BOOST_CHECK(DecideCacheBudget(0, 0, 0, 0, 5000, 2500) == CacheBudgetAction::SHRINK);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
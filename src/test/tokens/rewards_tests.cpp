@@ -0,0 +1,71 @@
+// Copyright (c) 2021-2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <tokens/rewards.h>
+#include <test/test_paladeum.h>
+#include <boost/test/unit_test.hpp>
+
+static OwnerWalker WalkOwners(const std::vector<std::pair<std::string, CAmount>>& vOwners)
+{
+    return [&vOwners](const std::function<bool(const std::string&, const CAmount&)>& visitor) {
+        for (const auto& owner : vOwners) {
+            if (!visitor(owner.first, owner.second))
+                return false;
+        }
+        return true;
+    };
+}
+
+static CAmount SharesFor(const std::vector<OwnerAndAmount>& vShares, const std::string& address)
+{
+    for (const auto& share : vShares) {
+        if (share.address == address)
+            return share.amount;
+    }
+    return 0;
+}
+
+BOOST_FIXTURE_TEST_SUITE(rewards_tests, BasicTestingSetup)
+
+    BOOST_AUTO_TEST_CASE(distribution_shares_test)
+    {
+        BOOST_TEST_MESSAGE("Running Distribution Shares Test");
+
+        std::vector<OwnerAndAmount> vShares;
+
+        // An even split pays everyone the same
+        std::vector<std::pair<std::string, CAmount>> vEven = {{"addr0", 5}, {"addr1", 5}};
+        BOOST_CHECK(ComputeDistributionShares(WalkOwners(vEven), 10, COIN, vShares));
+        BOOST_CHECK_EQUAL(vShares.size(), 2U);
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr0"), 5 * COIN);
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr1"), 5 * COIN);
+
+        // 10 units over three equal owners: the leftover unit goes to the lowest address
+        std::vector<std::pair<std::string, CAmount>> vThirds = {{"addr2", 1}, {"addr0", 1}, {"addr1", 1}};
+        BOOST_CHECK(ComputeDistributionShares(WalkOwners(vThirds), 10, 1, vShares));
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr0"), 4);
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr1"), 3);
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr2"), 3);
+
+        // Leftover units go to the largest remainders, even to owners whose share rounds down to zero
+        std::vector<std::pair<std::string, CAmount>> vSmall = {{"addr0", 60}, {"addr1", 25}, {"addr2", 15}};
+        BOOST_CHECK(ComputeDistributionShares(WalkOwners(vSmall), 2, 100, vShares));
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr0"), 100);
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr1"), 100);
+        BOOST_CHECK_EQUAL(SharesFor(vShares, "addr2"), 0);
+
+        // Amounts near the money range don't overflow and the whole payment is handed out
+        std::vector<std::pair<std::string, CAmount>> vLarge = {{"addr0", MAX_MONEY / 3}, {"addr1", MAX_MONEY / 3}, {"addr2", MAX_MONEY / 3}};
+        BOOST_CHECK(ComputeDistributionShares(WalkOwners(vLarge), MAX_MONEY - 1, 1, vShares));
+        CAmount nTotal = 0;
+        for (const auto& share : vShares)
+            nTotal += share.amount;
+        BOOST_CHECK_EQUAL(nTotal, MAX_MONEY - 1);
+
+        // Nobody to pay
+        std::vector<std::pair<std::string, CAmount>> vNone = {{"addr0", 0}};
+        BOOST_CHECK(!ComputeDistributionShares(WalkOwners(vNone), 10, 1, vShares));
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
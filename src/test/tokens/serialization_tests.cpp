@@ -175,4 +175,130 @@ BOOST_FIXTURE_TEST_SUITE(serialization_tests, BasicTestingSetup)
         BOOST_CHECK_MESSAGE(IsScriptNewMsgChannelToken(scriptPubKey), "Script wasn't a message channel");
     }
 
+    //! A token script built the way the builders used to, through a CDataStream and a vector
+    template <typename T>
+    static CScript OldTokenScript(const CScript& script, const std::vector<unsigned char>& vchPrefix, const T& obj)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << obj;
+        std::vector<unsigned char> vchMessage(vchPrefix);
+        vchMessage.insert(vchMessage.end(), ss.begin(), ss.end());
+        return CScript(script) << vchMessage;
+    }
+
+    BOOST_AUTO_TEST_CASE(token_script_builder_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Script Builder Test");
+
+        SelectParams("test");
+
+        const CScript scriptDest = GetScriptForDestination(DecodeDestination("mfe7MqgYZgBuXzrT2QTFqZwBXwRDqagHTp"));
+        const std::string strIPFS = DecodeTokenData("QmacSRmrkVmvJfbCpmU6pK72furJ8E8fbKHindrLxmYMQo");
+        const std::vector<unsigned char> vchTransfer = {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_T};
+
+        // Names on both sides of the one and two byte push lengths
+        for (size_t nLength : {1, 30, 60, 75, 240, 300}) {
+            const std::string strName(nLength, 'A');
+
+            CTokenTransfer transfer(strName, 5 * COIN, 0);
+            CScript script = scriptDest;
+            transfer.ConstructTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(CScript(scriptDest) << OP_PLB_TOKEN, vchTransfer, transfer) << OP_DROP);
+
+            CTokenTransfer transferMessage(strName, 5 * COIN, 7, strIPFS, 1234567);
+            script = scriptDest;
+            transferMessage.ConstructTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(CScript(scriptDest) << OP_PLB_TOKEN, vchTransfer, transferMessage) << OP_DROP);
+
+            CNewToken token(strName, 100 * COIN, 2, 1, 1, strIPFS, 1, "mfe7MqgYZgBuXzrT2QTFqZwBXwRDqagHTp", COIN);
+            script = scriptDest;
+            token.ConstructTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(CScript(scriptDest) << OP_PLB_TOKEN, {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_Q}, token) << OP_DROP);
+
+            script = scriptDest;
+            token.ConstructOwnerTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(CScript(scriptDest) << OP_PLB_TOKEN, {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_O}, std::string(strName + OWNER_TAG)) << OP_DROP);
+
+            CReissueToken reissue(strName, COIN, 3, 1, strIPFS, 0, "", 0);
+            script = scriptDest;
+            reissue.ConstructTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(CScript(scriptDest) << OP_PLB_TOKEN, {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_R}, reissue) << OP_DROP);
+
+            CNullTokenTxData nullData(strName, 1);
+            script = scriptDest;
+            nullData.ConstructTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(scriptDest, {}, nullData));
+
+            script = CScript();
+            nullData.ConstructGlobalRestrictionTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(CScript() << OP_PLB_TOKEN << OP_RESERVED << OP_RESERVED, {}, nullData));
+
+            CNullTokenTxVerifierString verifier(strName);
+            script = CScript();
+            verifier.ConstructTransaction(script);
+            BOOST_CHECK(script == OldTokenScript(CScript() << OP_PLB_TOKEN << OP_RESERVED, {}, verifier));
+        }
+    }
+
+    BOOST_AUTO_TEST_CASE(tx_token_outputs_test)
+    {
+        BOOST_TEST_MESSAGE("Running Transaction Token Outputs Test");
+
+        SelectParams("test");
+
+        CScript scriptPlain = GetScriptForDestination(DecodeDestination("mfe7MqgYZgBuXzrT2QTFqZwBXwRDqagHTp"));
+        CScript scriptNew = scriptPlain;
+        CNewToken token("SERIALIZATION", 100000000);
+        token.ConstructTransaction(scriptNew);
+        CScript scriptTransfer = scriptPlain;
+        CTokenTransfer transfer("SERIALIZATION", 5000, 0);
+        transfer.ConstructTransaction(scriptTransfer);
+
+        CMutableTransaction mtx;
+        mtx.vout.emplace_back(1 * COIN, scriptPlain);
+        mtx.vout.emplace_back(0, scriptTransfer);
+        mtx.vout.emplace_back(0, scriptNew);
+
+        // Without token outputs no descriptor is kept
+        CMutableTransaction mtxPlain;
+        mtxPlain.vout.emplace_back(1 * COIN, scriptPlain);
+        BOOST_CHECK(!CTransaction(mtxPlain).HasTokenOutputs());
+
+        CTransaction tx(mtx);
+        BOOST_CHECK(tx.HasTokenOutputs());
+        BOOST_CHECK(tx.GetTokenOutput(0) == nullptr);
+        BOOST_CHECK(tx.GetTokenOutput(3) == nullptr);
+        for (uint32_t n = 1; n < tx.vout.size(); n++) {
+            int nType = 0, nScriptType = 0, nStartingIndex = 0;
+            bool fIsOwner = false;
+            BOOST_CHECK(tx.vout[n].scriptPubKey.IsTokenScript(nType, nScriptType, fIsOwner, nStartingIndex));
+            const CTxTokenOutput* output = tx.GetTokenOutput(n);
+            BOOST_REQUIRE(output != nullptr);
+            BOOST_CHECK_EQUAL(output->nType, nType);
+            BOOST_CHECK_EQUAL(output->nScriptType, nScriptType);
+            BOOST_CHECK_EQUAL(output->fIsOwner, fIsOwner);
+            BOOST_CHECK_EQUAL(output->nStartingIndex, nStartingIndex);
+        }
+
+        // The decoded data matches the script and is shared by copies of the transaction
+        CTokenTransfer transferTx, transferScript;
+        std::string addressTx, addressScript;
+        BOOST_CHECK(TransferTokenFromTx(tx, 1, transferTx, addressTx));
+        BOOST_CHECK(TransferTokenFromScript(scriptTransfer, transferScript, addressScript));
+        BOOST_CHECK_EQUAL(transferTx.strName, transferScript.strName);
+        BOOST_CHECK_EQUAL(transferTx.nAmount, transferScript.nAmount);
+        BOOST_CHECK_EQUAL(addressTx, addressScript);
+        BOOST_CHECK(!TokenFromTx(tx, 1, token, addressTx));
+
+        CNewToken tokenTx;
+        BOOST_CHECK(TokenFromTx(tx, 2, tokenTx, addressTx));
+        BOOST_CHECK_EQUAL(tokenTx.strName, "SERIALIZATION");
+        BOOST_CHECK_EQUAL(tokenTx.nAmount, 100000000);
+        BOOST_CHECK(!TransferTokenFromTx(tx, 2, transferTx, addressTx));
+        BOOST_CHECK(!TransferTokenFromTx(tx, 0, transferTx, addressTx));
+
+        CTransaction txCopy(tx);
+        BOOST_CHECK(GetTxTokenOutput(txCopy, 1)->transfer == GetTxTokenOutput(tx, 1)->transfer);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -15,6 +15,154 @@
 
 #include "LibBoolEE.h"
 
+#include <regex>
+
+#include <boost/algorithm/string.hpp>
+
+// The name rules as they were written with regular expressions, the reference the table driven ones are checked against
+namespace regex_names {
+static const std::regex ROOT_NAME_CHARACTERS("^[A-Z0-9._]{3,}$");
+static const std::regex SUB_NAME_CHARACTERS("^[A-Z0-9._]+$");
+static const std::regex UNIQUE_TAG_CHARACTERS("^[-A-Za-z0-9@$%&*()[\\]{}_.?:]+$");
+static const std::regex MSG_CHANNEL_TAG_CHARACTERS("^[A-Za-z0-9_]+$");
+static const std::regex VOTE_TAG_CHARACTERS("^[A-Z0-9._]+$");
+static const std::regex USERNAME_CHARACTERS("^@[A-Z0-9._]{4,}$");
+static const std::regex QUALIFIER_NAME_CHARACTERS("#[A-Z0-9._]{3,}$");
+static const std::regex SUB_QUALIFIER_NAME_CHARACTERS("#[A-Z0-9._]+$");
+static const std::regex RESTRICTED_NAME_CHARACTERS("\\$[A-Z0-9._]{3,}$");
+static const std::regex DOUBLE_PUNCTUATION("^.*[._]{2,}.*$");
+static const std::regex LEADING_PUNCTUATION("^[._].*$");
+static const std::regex TRAILING_PUNCTUATION("^.*[._]$");
+static const std::regex QUALIFIER_LEADING_PUNCTUATION("^[#\\$][._].*$");
+static const std::regex UNIQUE_INDICATOR(R"(^[^^~#!]+#[^~#!\/]+$)");
+static const std::regex MSG_CHANNEL_INDICATOR(R"(^[^^~#!]+~[^~#!\/]+$)");
+static const std::regex OWNER_INDICATOR(R"(^[^^~#!]+!$)");
+static const std::regex VOTE_INDICATOR(R"(^[^^~#!]+\^[^~#!\/]+$)");
+static const std::regex USERNAME_INDICATOR(R"(^@[A-Z0-9._]{4,}$)");
+static const std::regex QUALIFIER_INDICATOR("^[#][A-Z0-9._]{3,}$");
+static const std::regex SUB_QUALIFIER_INDICATOR("^#[A-Z0-9._]+\\/#[A-Z0-9._]+$");
+static const std::regex RESTRICTED_INDICATOR("^[\\$][A-Z0-9._]{3,}$");
+static const std::regex PLB_NAMES("^PLB$|^PLB$|^PLBCOIN$");
+
+static bool Punctuated(const std::string& name)
+{
+    return std::regex_match(name, DOUBLE_PUNCTUATION) || std::regex_match(name, LEADING_PUNCTUATION) || std::regex_match(name, TRAILING_PUNCTUATION);
+}
+
+static bool IsRootNameValid(const std::string& name) { return std::regex_match(name, ROOT_NAME_CHARACTERS) && !Punctuated(name) && !std::regex_match(name, PLB_NAMES); }
+static bool IsSubNameValid(const std::string& name) { return std::regex_match(name, SUB_NAME_CHARACTERS) && !Punctuated(name); }
+static bool IsQualifierNameValid(const std::string& name)
+{
+    return std::regex_match(name, QUALIFIER_NAME_CHARACTERS) && !std::regex_match(name, DOUBLE_PUNCTUATION) && !std::regex_match(name, QUALIFIER_LEADING_PUNCTUATION) &&
+           !std::regex_match(name, TRAILING_PUNCTUATION) && !std::regex_match(name, PLB_NAMES);
+}
+static bool IsRestrictedNameValid(const std::string& name) { return std::regex_match(name, RESTRICTED_NAME_CHARACTERS) && !Punctuated(name) && !std::regex_match(name, PLB_NAMES); }
+static bool IsSubQualifierNameValid(const std::string& name) { return std::regex_match(name, SUB_QUALIFIER_NAME_CHARACTERS) && !Punctuated(name); }
+static bool IsMsgChannelTagValid(const std::string& tag) { return std::regex_match(tag, MSG_CHANNEL_TAG_CHARACTERS) && !Punctuated(tag); }
+
+static std::vector<std::string> Split(const std::string& name, const char* delimiter)
+{
+    std::vector<std::string> parts;
+    boost::split(parts, name, boost::is_any_of(delimiter));
+    return parts;
+}
+
+static bool IsNameValidBeforeTag(const std::string& name)
+{
+    std::vector<std::string> parts = Split(name, "/");
+    if (!IsRootNameValid(parts.front())) return false;
+    for (size_t i = 1; i < parts.size(); i++)
+        if (!IsSubNameValid(parts[i])) return false;
+    return true;
+}
+
+static bool IsQualifierNameValidBeforeTag(const std::string& name)
+{
+    std::vector<std::string> parts = Split(name, "/");
+    if (!IsQualifierNameValid(parts.front())) return false;
+    if (parts.size() > 2) return false;
+    for (size_t i = 1; i < parts.size(); i++)
+        if (!IsSubQualifierNameValid(parts[i])) return false;
+    return true;
+}
+
+static bool IsTokenNameASubtoken(const std::string& name) { std::vector<std::string> parts = Split(name, "/"); return IsRootNameValid(parts.front()) && parts.size() > 1; }
+static bool IsTokenNameASubQualifier(const std::string& name) { std::vector<std::string> parts = Split(name, "/"); return IsQualifierNameValid(parts.front()) && parts.size() > 1; }
+
+static bool IsTypeCheckNameValid(const KnownTokenType type, const std::string& name, std::string& error)
+{
+    const std::string strMax = std::to_string(31);
+    if (type == KnownTokenType::UNIQUE) {
+        if (name.size() > 31) { error = "Name is greater than max length of " + strMax; return false; }
+        std::vector<std::string> parts = Split(name, "#");
+        if (!IsNameValidBeforeTag(parts.front()) || !std::regex_match(parts.back(), UNIQUE_TAG_CHARACTERS)) { error = "Unique name contains invalid characters (Valid characters are: A-Z a-z 0-9 @ $ % & * ( ) [ ] { } _ . ? : -)"; return false; }
+        return true;
+    } else if (type == KnownTokenType::MSGCHANNEL) {
+        if (name.size() > 31) { error = "Name is greater than max length of " + strMax; return false; }
+        std::vector<std::string> parts = Split(name, "~");
+        bool valid = IsNameValidBeforeTag(parts.front()) && IsMsgChannelTagValid(parts.back());
+        if (parts.back().size() > 12) { error = "Channel name is greater than max length of " + std::to_string(12); return false; }
+        if (!valid) { error = "Message Channel name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)"; return false; }
+        return true;
+    } else if (type == KnownTokenType::OWNER) {
+        if (name.size() > 31) { error = "Name is greater than max length of " + strMax; return false; }
+        if (!IsNameValidBeforeTag(name.substr(0, name.size() - 1))) { error = "Owner name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)"; return false; }
+        return true;
+    } else if (type == KnownTokenType::VOTE) {
+        if (name.size() > 31) { error = "Name is greater than max length of " + strMax; return false; }
+        std::vector<std::string> parts = Split(name, "^");
+        if (!IsNameValidBeforeTag(parts.front()) || !std::regex_match(parts.back(), VOTE_TAG_CHARACTERS)) { error = "Vote name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)"; return false; }
+        return true;
+    } else if (type == KnownTokenType::QUALIFIER || type == KnownTokenType::SUB_QUALIFIER) {
+        if (name.size() > 31) { error = "Name is greater than max length of " + strMax; return false; }
+        if (!IsQualifierNameValidBeforeTag(name)) { error = "Qualifier name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (# must be the first character, _ . special characters can't be the first or last characters)"; return false; }
+        return true;
+    } else if (type == KnownTokenType::RESTRICTED) {
+        if (name.size() > 31) { error = "Name is greater than max length of " + strMax; return false; }
+        if (!IsRestrictedNameValid(name)) { error = "Restricted name contains invalid characters (Valid characters are: A-Z 0-9 _ .) ($ must be the first character, _ . special characters can't be the first or last characters)"; return false; }
+        return true;
+    } else if (type == KnownTokenType::USERNAME) {
+        if (name.size() > 31) { error = "Name is greater than max length of " + strMax; return false; }
+        if (!std::regex_match(name, USERNAME_CHARACTERS)) { error = "Username contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)"; return false; }
+        return true;
+    } else {
+        if (name.size() > 30) { error = "Name is greater than max length of " + std::to_string(30); return false; }
+        if (!IsTokenNameASubtoken(name) && name.size() < MIN_TOKEN_LENGTH) { error = "Name must be contain " + std::to_string(MIN_TOKEN_LENGTH) + " characters"; return false; }
+        bool valid = IsNameValidBeforeTag(name);
+        if (!valid && IsTokenNameASubtoken(name) && name.size() < 3) { error = "Name must have at least 3 characters (Valid characters are: A-Z 0-9 _ .)"; return false; }
+        if (!valid) { error = "Name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)"; return false; }
+        return true;
+    }
+}
+
+static bool IsTokenNameValid(const std::string& name, KnownTokenType& tokenType, std::string& error)
+{
+    if (name.length() > 40)
+        return false;
+
+    tokenType = KnownTokenType::INVALID;
+    KnownTokenType type;
+    if (std::regex_match(name, UNIQUE_INDICATOR)) type = KnownTokenType::UNIQUE;
+    else if (std::regex_match(name, MSG_CHANNEL_INDICATOR)) type = KnownTokenType::MSGCHANNEL;
+    else if (std::regex_match(name, OWNER_INDICATOR)) type = KnownTokenType::OWNER;
+    else if (std::regex_match(name, VOTE_INDICATOR)) type = KnownTokenType::VOTE;
+    else if (std::regex_match(name, QUALIFIER_INDICATOR)) type = KnownTokenType::QUALIFIER;
+    else if (std::regex_match(name, SUB_QUALIFIER_INDICATOR)) type = KnownTokenType::SUB_QUALIFIER;
+    else if (std::regex_match(name, RESTRICTED_INDICATOR)) type = KnownTokenType::RESTRICTED;
+    else if (std::regex_match(name, USERNAME_INDICATOR)) type = KnownTokenType::USERNAME;
+    else type = IsTokenNameASubtoken(name) ? KnownTokenType::SUB : KnownTokenType::ROOT;
+
+    bool ret = regex_names::IsTypeCheckNameValid(type, name, error);
+    if (ret) {
+        if (type == KnownTokenType::QUALIFIER || type == KnownTokenType::SUB_QUALIFIER)
+            tokenType = IsTokenNameASubQualifier(name) ? KnownTokenType::SUB_QUALIFIER : type == KnownTokenType::QUALIFIER ? KnownTokenType::QUALIFIER : KnownTokenType::INVALID;
+        else
+            tokenType = type;
+    }
+    return ret;
+}
+} // namespace regex_names
+
 BOOST_FIXTURE_TEST_SUITE(token_tests, BasicTestingSetup)
 
     BOOST_AUTO_TEST_CASE(name_validation_tests)
@@ -220,6 +368,53 @@ BOOST_FIXTURE_TEST_SUITE(token_tests, BasicTestingSetup)
         BOOST_CHECK(!IsTokenNameValid("$ABC#NO"));
     }
 
+    BOOST_AUTO_TEST_CASE(name_validation_matches_regex_tests)
+    {
+        BOOST_TEST_MESSAGE("Running Name Validation Matches Regex Test");
+
+        // Names of every shape, which the random names below are mutations of
+        const std::vector<std::string> vSeeds = {
+            "", "A", "AB", "ABC", "PLB", "PLBCOIN", "PLB/SUB", "_ABC", "ABC_", "A..B", "A._B", "A.B_C", "MAX_TOKEN_IS_30_CHARACTERS_LNG",
+            "ABC/SUB", "ABC/SUB/SUB2", "ABC//SUB", "ABC/", "/ABC", "AB/C", "ABC/_S", "ABC#TAG", "ABC#tag@$%&*()[]{}_.?:-", "ABC/SUB#TAG",
+            "ABC#", "#ABC", "ABC#A#B", "ABC#T/G", "ABC^X#T", "ABC~CHANNEL", "ABC~chan_nel", "ABC~_C", "ABC~THIS_IS_TOO_LONG", "ABC~", "ABC!",
+            "ABC/SUB!", "!", "A!", "ABC!!", "ABC^VOTE", "ABC^V^W", "ABC^V/W", "ABC/S^V", "^ABC", "#ABC", "#AB", "#_ABC", "#ABC/#SUB",
+            "#ABC/#_SUB", "#ABC/#S/#T", "#ABC/SUB", "#ABC/#", "$ABC", "$_ABC", "$AB", "$ABC_", "$ABC/#S", "@ABCD", "@ABC", "@ABC.D", "@abcd",
+        };
+        const std::string strAlphabet = "AZB09._/#~!^$@az-:%&*()[]{}? \n";
+
+        for (int i = 0; i < 20000; i++) {
+            std::string name;
+            if (i < (int)vSeeds.size()) {
+                name = vSeeds[i];
+            } else {
+                name = vSeeds[InsecureRandRange(vSeeds.size())];
+                for (int nEdit = InsecureRandRange(4); nEdit >= 0; nEdit--) {
+                    const size_t nPos = name.empty() ? 0 : InsecureRandRange(name.size() + 1);
+                    const char c = InsecureRandBits(4) ? strAlphabet[InsecureRandRange(strAlphabet.size())] : (char)InsecureRandBits(8);
+                    switch (InsecureRandRange(4)) {
+                    case 0: name.insert(nPos, 1, c); break;
+                    case 1: if (nPos < name.size()) name[nPos] = c; break;
+                    case 2: if (nPos < name.size()) name.erase(nPos, 1); break;
+                    case 3: name += vSeeds[InsecureRandRange(vSeeds.size())]; break;
+                    }
+                }
+            }
+
+            KnownTokenType type = KnownTokenType::NULL_ADD_QUALIFIER, typeRegex = KnownTokenType::NULL_ADD_QUALIFIER;
+            std::string strError = "unset", strErrorRegex = "unset";
+            const bool fValid = IsTokenNameValid(name, type, strError);
+            const bool fValidRegex = regex_names::IsTokenNameValid(name, typeRegex, strErrorRegex);
+            BOOST_CHECK_MESSAGE(fValid == fValidRegex && type == typeRegex && strError == strErrorRegex, "name " + HexStr(name));
+
+            for (int nType = (int)KnownTokenType::ROOT; nType <= (int)KnownTokenType::OWNER; nType++) {
+                strError = strErrorRegex = "unset";
+                const bool fTypeValid = IsTypeCheckNameValid((KnownTokenType)nType, name, strError);
+                BOOST_CHECK_MESSAGE(fTypeValid == regex_names::IsTypeCheckNameValid((KnownTokenType)nType, name, strErrorRegex) && strError == strErrorRegex,
+                                    strprintf("name %s type %d", HexStr(name), nType));
+            }
+        }
+    }
+
     BOOST_AUTO_TEST_CASE(transfer_token_coin_test)
     {
         BOOST_TEST_MESSAGE("Running Transfer Token Coin Test");
@@ -731,4 +926,23 @@ BOOST_FIXTURE_TEST_SUITE(token_tests, BasicTestingSetup)
     }
 
 
+    BOOST_AUTO_TEST_CASE(encode_token_destination_test)
+    {
+        BOOST_TEST_MESSAGE("Running Encode Token Destination Test");
+
+        SelectParams(CBaseChainParams::MAIN);
+
+        // The same hash as a key and as a script, and a key that shares the first eight bytes of it
+        const uint160 hash(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+        const uint160 hashNear(ParseHex("0102030405060708ffffffffffffffffffffffff"));
+        std::vector<CTxDestination> vDests = {CKeyID(hash), CScriptID(hash), CKeyID(hashNear), CNoDestination()};
+
+        // Encoded and then found in the cache, in either order
+        for (int nRound = 0; nRound < 2; nRound++) {
+            for (const CTxDestination& dest : vDests)
+                BOOST_CHECK_EQUAL(EncodeTokenDestination(dest), EncodeDestination(dest));
+            std::reverse(vDests.begin(), vDests.end());
+        }
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,872 @@
+// Copyright (c) 2021-2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <tokens/tokens.h>
+#include <tokens/tokendb.h>
+#include <tokens/tokensnapshotdb.h>
+#include <tokens/restricteddb.h>
+#include <tokens/mytokensdb.h>
+#include <tokens/messages.h>
+#include <base58.h>
+#include <undo.h>
+#include <validation.h>
+#include <test/test_paladeum.h>
+#include <boost/test/unit_test.hpp>
+
+//! A token record as it was written before the fixed layout
+struct LegacyTokenRecord {
+    CNewToken token;
+    int nHeight;
+    uint256 blockHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(token);
+        READWRITE(nHeight);
+        READWRITE(blockHash);
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(tokendb_tests, TestingSetup)
+
+    BOOST_AUTO_TEST_CASE(token_address_dir_cursor_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Address Dir Cursor Test");
+
+        CTokensDB db(1 << 20, true, true);
+
+        std::vector<std::string> vAddresses = {"addr0", "addr1", "addr2", "addr3", "addr4"};
+        for (size_t i = 0; i < vAddresses.size(); i++) {
+            BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", vAddresses[i], i + 1));
+            BOOST_CHECK(db.WriteAddressTokenQuantity(vAddresses[i], "TOKEN", i + 1));
+        }
+        // Neighbouring prefixes must not leak into the pages
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEM", "addr9", 9));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKENS", "addr9", 9));
+        BOOST_CHECK(db.WriteAddressTokenQuantity("addr0", "OTHER", 7));
+
+        std::vector<std::pair<std::string, CAmount> > vPage;
+        std::vector<std::pair<std::string, CAmount> > vAll;
+        std::string strCursor, strNext;
+        int nPages = 0;
+        do {
+            vPage.clear();
+            BOOST_CHECK(db.TokenAddressDirFrom(vPage, "TOKEN", strCursor, 2, strNext));
+            BOOST_CHECK(vPage.size() <= 2);
+            vAll.insert(vAll.end(), vPage.begin(), vPage.end());
+            strCursor = strNext;
+            nPages++;
+        } while (!strCursor.empty());
+
+        BOOST_CHECK_EQUAL(nPages, 3);
+        BOOST_CHECK_EQUAL(vAll.size(), vAddresses.size());
+        for (size_t i = 0; i < vAll.size(); i++) {
+            BOOST_CHECK_EQUAL(vAll[i].first, vAddresses[i]);
+            BOOST_CHECK_EQUAL(vAll[i].second, (CAmount)(i + 1));
+        }
+
+        // An exactly full last page reports no further cursor
+        vPage.clear();
+        BOOST_CHECK(db.TokenAddressDirFrom(vPage, "TOKEN", "addr2", 2, strNext));
+        BOOST_CHECK_EQUAL(vPage.size(), 2);
+        BOOST_CHECK(strNext.empty());
+
+        // Resuming from a cursor that no longer exists continues with the following key
+        BOOST_CHECK(db.EraseTokenAddressQuantity("TOKEN", "addr1"));
+        vPage.clear();
+        BOOST_CHECK(db.TokenAddressDirFrom(vPage, "TOKEN", "addr1", 1, strNext));
+        BOOST_CHECK_EQUAL(vPage.size(), 1);
+        BOOST_CHECK_EQUAL(vPage[0].first, "addr2");
+        BOOST_CHECK_EQUAL(strNext, "addr2");
+
+        vPage.clear();
+        BOOST_CHECK(db.AddressDirFrom(vPage, "addr0", "", 10, strNext));
+        BOOST_CHECK_EQUAL(vPage.size(), 2);
+        BOOST_CHECK(strNext.empty());
+    }
+
+    BOOST_AUTO_TEST_CASE(token_address_dir_overlay_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Address Dir Overlay Test");
+
+        CTokensDB db(1 << 20, true, true);
+
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "addr" + std::to_string(i), 10));
+            BOOST_CHECK(db.WriteAddressTokenQuantity("addr" + std::to_string(i), "TOKEN", 10));
+        }
+
+        // Dirty entries in the global cache are read without flushing it to the database
+        LOCK(cs_main);
+        ptokens->mapTokensAddressAmount[std::make_pair("TOKEN", "addr1")] = 0;
+        ptokens->mapTokensAddressAmount[std::make_pair("TOKEN", "addr2")] = 25;
+        ptokens->mapTokensAddressAmount[std::make_pair("TOKEN", "addr5")] = 5;
+
+        std::vector<std::pair<std::string, CAmount> > vResult;
+        int nTotal = 0;
+        BOOST_CHECK(db.TokenAddressDir(vResult, nTotal, true, "TOKEN", 100, 0));
+        BOOST_CHECK_EQUAL(nTotal, 4);
+
+        BOOST_CHECK(db.TokenAddressDir(vResult, nTotal, false, "TOKEN", 100, 0));
+        BOOST_CHECK_EQUAL(vResult.size(), 4);
+        BOOST_CHECK_EQUAL(vResult[0].first, "addr0");
+        BOOST_CHECK_EQUAL(vResult[1].first, "addr2");
+        BOOST_CHECK_EQUAL(vResult[1].second, 25);
+        BOOST_CHECK_EQUAL(vResult[3].first, "addr5");
+
+        vResult.clear();
+        BOOST_CHECK(db.TokenAddressDir(vResult, nTotal, false, "TOKEN", 100, -1));
+        BOOST_CHECK_EQUAL(vResult.size(), 1);
+        BOOST_CHECK_EQUAL(vResult[0].first, "addr5");
+
+        vResult.clear();
+        std::string strNext;
+        BOOST_CHECK(db.TokenAddressDirFrom(vResult, "TOKEN", "addr0", 2, strNext));
+        BOOST_CHECK_EQUAL(vResult.size(), 2);
+        BOOST_CHECK_EQUAL(vResult[0].first, "addr2");
+        BOOST_CHECK_EQUAL(strNext, "addr3");
+
+        vResult.clear();
+        BOOST_CHECK(db.AddressDir(vResult, nTotal, false, "addr5", 100, 0));
+        BOOST_CHECK_EQUAL(vResult.size(), 1);
+
+        // Many addresses at once, each with its own dirty entries laid over the database
+        ptokens->mapTokensAddressAmount[std::make_pair("OTHER", "addr0")] = 7;
+        std::map<std::string, std::vector<std::pair<std::string, CAmount> > > mapBalances;
+        BOOST_CHECK(db.AddressesDir({"addr5", "addr1", "addr0", "addr9"}, [&mapBalances](const std::string& address, const std::vector<std::pair<std::string, CAmount> >& vecTokenAmounts) {
+            mapBalances[address] = vecTokenAmounts;
+            return true;
+        }));
+        BOOST_CHECK_EQUAL(mapBalances.size(), 4);
+        BOOST_CHECK_EQUAL(mapBalances["addr0"].size(), 2);
+        BOOST_CHECK_EQUAL(mapBalances["addr0"][0].first, "OTHER");
+        BOOST_CHECK_EQUAL(mapBalances["addr0"][0].second, 7);
+        BOOST_CHECK_EQUAL(mapBalances["addr0"][1].first, "TOKEN");
+        BOOST_CHECK(mapBalances["addr1"].empty());
+        BOOST_CHECK_EQUAL(mapBalances["addr5"].size(), 1);
+        BOOST_CHECK_EQUAL(mapBalances["addr5"][0].second, 5);
+        BOOST_CHECK(mapBalances["addr9"].empty());
+
+        ptokens->mapTokensAddressAmount.clear();
+    }
+
+    BOOST_AUTO_TEST_CASE(token_holder_stats_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Holder Stats Test");
+
+        CTokensDB db(1 << 20, true, true);
+        BOOST_CHECK(!db.HolderStatsReady());
+
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "addr0", 10));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "addr1", 20));
+        BOOST_CHECK(db.RebuildTokenHolderStats());
+        BOOST_CHECK(db.HolderStatsReady());
+
+        CTokenHolderStats stats;
+        BOOST_CHECK(db.ReadTokenHolderStats("TOKEN", stats));
+        BOOST_CHECK_EQUAL(stats.nHolders, 2);
+        BOOST_CHECK_EQUAL(stats.nCirculating, 30);
+
+        // Updates are tracked incrementally and written with the height of the flush, the stats are marked out of
+        // date on disk until the flush commits
+        BOOST_CHECK(db.BeginTokenHolderStatsUpdate());
+        BOOST_CHECK(!db.Exists('S'));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "addr2", 5));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "addr1", 0));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "addr1", 15));
+        BOOST_CHECK(db.EraseTokenAddressQuantity("TOKEN", "addr0"));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("OTHER", "addr0", 1));
+        BOOST_CHECK(db.FlushTokenHolderStats(10));
+        BOOST_CHECK(db.Exists('S'));
+
+        BOOST_CHECK(db.ReadTokenHolderStats("TOKEN", stats));
+        BOOST_CHECK_EQUAL(stats.nHolders, 2);
+        BOOST_CHECK_EQUAL(stats.nCirculating, 20);
+        BOOST_CHECK_EQUAL(stats.nLastChangeHeight, 10);
+
+        BOOST_CHECK(db.ReadTokenHolderStats("OTHER", stats));
+        BOOST_CHECK_EQUAL(stats.nHolders, 1);
+
+        // Totals combine the stats with the dirty entries of the global cache
+        LOCK(cs_main);
+        ptokens->mapTokensAddressAmount[std::make_pair("TOKEN", "addr1")] = 0;
+        ptokens->mapTokensAddressAmount[std::make_pair("TOKEN", "addr7")] = 3;
+        ptokens->mapTokensAddressAmount[std::make_pair("TOKEN", "addr8")] = 3;
+
+        std::vector<std::pair<std::string, CAmount> > vResult;
+        int nTotal = 0;
+        BOOST_CHECK(db.TokenAddressDir(vResult, nTotal, true, "TOKEN", 100, 0));
+        BOOST_CHECK_EQUAL(nTotal, 3);
+
+        ptokens->mapTokensAddressAmount.clear();
+    }
+
+    BOOST_AUTO_TEST_CASE(username_index_test)
+    {
+        BOOST_TEST_MESSAGE("Running Username Index Test");
+
+        CTokensDB db(1 << 20, true, true);
+        BOOST_CHECK(!db.UsernameIndexReady());
+
+        // Only usernames are indexed
+        BOOST_CHECK(db.WriteTokenAddressQuantity("@ALICE", "addr0", 1));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "addr1", 10));
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "addr0");
+        BOOST_CHECK_EQUAL(db.UsernameAddress("TOKEN"), "");
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@NOBODY"), "");
+
+        // A transfer writes the new holder and zeroes or erases the old one, in either order
+        BOOST_CHECK(db.WriteTokenAddressQuantity("@ALICE", "addr2", 1));
+        BOOST_CHECK(db.EraseTokenAddressQuantity("@ALICE", "addr0"));
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "addr2");
+        BOOST_CHECK(db.WriteTokenAddressQuantity("@ALICE", "addr3", 0));
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "addr2");
+        BOOST_CHECK(db.EraseTokenAddressQuantity("@ALICE", "addr2"));
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "");
+        BOOST_CHECK(db.WriteTokenAddressQuantity("@ALICE", "addr3", 1));
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "addr3");
+
+        // Databases from before the index are built from the address quantities
+        BOOST_CHECK(db.WriteTokenAddressQuantity("@BOBBY", "addr4", 1));
+        BOOST_CHECK(db.RebuildUsernameIndex());
+        BOOST_CHECK(db.UsernameIndexReady());
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "addr3");
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@BOBBY"), "addr4");
+
+        // Holders that are still dirty in the global cache come first
+        LOCK(cs_main);
+        ptokens->mapTokensAddressAmount[std::make_pair("@ALICE", "addr3")] = 0;
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "");
+        ptokens->mapTokensAddressAmount[std::make_pair("@ALICE", "addr5")] = 1;
+        BOOST_CHECK_EQUAL(db.UsernameAddress("@ALICE"), "addr5");
+
+        ptokens->mapTokensAddressAmount.clear();
+    }
+
+    BOOST_AUTO_TEST_CASE(token_name_index_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Name Index Test");
+
+        CTokensDB db(1 << 20, true, true);
+
+        // Written before the index is loaded, and after
+        for (const char* name : {"TOKEN", "TOKENS", "COIN", "BITCOIN"})
+            BOOST_CHECK(db.WriteTokenData(CNewToken(name, COIN), 1, uint256()));
+        std::vector<std::string> vNames;
+        BOOST_CHECK(db.TokenNameDir(vNames, "*", 100, 0));
+        BOOST_CHECK_EQUAL(vNames.size(), 4);
+        BOOST_CHECK(db.WriteTokenData(CNewToken("TOKEN/SUB", COIN), 1, uint256()));
+
+        // Names come in database key order, shortest first
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "*", 100, 0));
+        BOOST_CHECK(vNames == std::vector<std::string>({"COIN", "TOKEN", "TOKENS", "BITCOIN", "TOKEN/SUB"}));
+
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "TOKEN*", 100, 0));
+        BOOST_CHECK(vNames == std::vector<std::string>({"TOKEN", "TOKENS", "TOKEN/SUB"}));
+
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "TOKEN", 100, 0));
+        BOOST_CHECK(vNames == std::vector<std::string>({"TOKEN"}));
+
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "*COIN*", 100, 0));
+        BOOST_CHECK(vNames == std::vector<std::string>({"COIN", "BITCOIN"}));
+
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "*EN*", 100, 0));
+        BOOST_CHECK(vNames == std::vector<std::string>({"TOKEN", "TOKENS", "TOKEN/SUB"}));
+
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "*SUB", 100, 0));
+        BOOST_CHECK(vNames == std::vector<std::string>({"TOKEN/SUB"}));
+
+        // Paging, from either end
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "TOKEN*", 1, 1));
+        BOOST_CHECK(vNames == std::vector<std::string>({"TOKENS"}));
+
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "TOKEN*", 100, -1));
+        BOOST_CHECK(vNames == std::vector<std::string>({"TOKEN/SUB"}));
+
+        // Undoing an issue erases the name
+        BOOST_CHECK(db.EraseTokenData("TOKENS"));
+        vNames.clear();
+        BOOST_CHECK(db.TokenNameDir(vNames, "TOKEN*", 100, 0));
+        BOOST_CHECK(vNames == std::vector<std::string>({"TOKEN", "TOKEN/SUB"}));
+
+        // Existence checks are answered by the index
+        bool fExists = false;
+        BOOST_CHECK(db.HasTokenName("TOKEN/SUB", fExists) && fExists);
+        BOOST_CHECK(db.HasTokenName("TOKENS", fExists) && !fExists);
+        BOOST_CHECK(db.HasTokenName("TOKE", fExists) && !fExists);
+
+        // Issues and undos still waiting in the global cache are laid over the index
+        LOCK(cs_main);
+        ptokens->setNewTokensToAdd.insert(CTokenCacheNewToken(CNewToken("TOKENX", 2 * COIN), "addr0", 2, uint256()));
+        ptokens->setNewTokensToRemove.insert(CTokenCacheNewToken(CNewToken("TOKEN", COIN), "addr0", 1, uint256()));
+
+        std::vector<CDatabasedTokenData> vTokens;
+        BOOST_CHECK(db.TokenDir(vTokens, "TOKEN*", 100, 0));
+        BOOST_CHECK_EQUAL(vTokens.size(), 2);
+        BOOST_CHECK_EQUAL(vTokens[0].token.strName, "TOKENX");
+        BOOST_CHECK_EQUAL(vTokens[0].token.nAmount, 2 * COIN);
+        BOOST_CHECK_EQUAL(vTokens[1].token.strName, "TOKEN/SUB");
+        BOOST_CHECK_EQUAL(vTokens[1].token.nAmount, COIN);
+
+        ptokens->setNewTokensToAdd.clear();
+        ptokens->setNewTokensToRemove.clear();
+    }
+
+    BOOST_AUTO_TEST_CASE(token_record_layout_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Record Layout Test");
+
+        CTokensDB db(1 << 20, true, true);
+        const uint256 blockHash = uint256S("0x1234");
+        const std::string strIPFSHash = DecodeIPFS("QmTqu3Lk3gmTsQVtjU7rYYM37EAW4xNmbuEAp2Mjr4AV7E");
+
+        LegacyTokenRecord legacy;
+        legacy.token = CNewToken("OLD", 5 * COIN, 2, 1, 1, strIPFSHash, 1, "addr0", COIN);
+        legacy.nHeight = 7;
+        legacy.blockHash = blockHash;
+        BOOST_CHECK(db.Write(std::make_pair('A', std::string("OLD")), legacy));
+        BOOST_CHECK(db.WriteTokenData(CNewToken("NEW", 3 * COIN, 0, 0, 0, "", 0, "addr1", COIN), 9, blockHash));
+
+        // Both layouts read back the same token
+        for (const char* name : {"OLD", "NEW"}) {
+            CNewToken token;
+            int nHeight;
+            uint256 hash;
+            BOOST_CHECK(db.ReadTokenData(name, token, nHeight, hash));
+            BOOST_CHECK_EQUAL(token.strName, name);
+            BOOST_CHECK(hash == blockHash);
+
+            std::string strRecord;
+            BOOST_CHECK(db.ReadTokenRecord(name, strRecord));
+            CTokenRecordView view;
+            BOOST_CHECK(view.Parse((const unsigned char*)strRecord.data(), strRecord.size()));
+            BOOST_CHECK_EQUAL(view.GetUnits(), token.units);
+            BOOST_CHECK_EQUAL(view.IsReissuable(), token.nReissuable != 0);
+            BOOST_CHECK_EQUAL(view.HasIPFS(), token.nHasIPFS == 1);
+            BOOST_CHECK_EQUAL(view.HasRoyalties(), token.nHasRoyalties == 1);
+            BOOST_CHECK_EQUAL(view.GetAmount(), token.nAmount);
+            BOOST_CHECK_EQUAL(view.GetRoyaltiesAmount(), token.nRoyaltiesAmount);
+            BOOST_CHECK_EQUAL(view.GetHeight(), nHeight);
+            BOOST_CHECK(view.GetBlockHash() == blockHash);
+        }
+
+        // The legacy record and its rewrite decode to the same data
+        CNewToken fromLegacy, fromRecord;
+        int nHeight;
+        uint256 hash;
+        BOOST_CHECK(db.ReadTokenData("OLD", fromLegacy, nHeight, hash));
+        BOOST_CHECK(db.WriteTokenData(fromLegacy, nHeight, hash));
+        BOOST_CHECK(db.ReadTokenData("OLD", fromRecord, nHeight, hash));
+        BOOST_CHECK_EQUAL(fromRecord.nAmount, 5 * COIN);
+        BOOST_CHECK_EQUAL(fromRecord.units, 2);
+        BOOST_CHECK(fromRecord.strIPFSHash == fromLegacy.strIPFSHash);
+        BOOST_CHECK(fromRecord.strIPFSHash == strIPFSHash);
+        BOOST_CHECK_EQUAL(fromRecord.nRoyaltiesAddress, "addr0");
+        BOOST_CHECK_EQUAL(fromRecord.nRoyaltiesAmount, COIN);
+        BOOST_CHECK_EQUAL(nHeight, 7);
+
+        // Re-encoding the legacy bytes gives the rewritten record, as chain state snapshots hash them
+        CDataStream ssLegacy(SER_DISK, CLIENT_VERSION);
+        ssLegacy << legacy;
+        CDatabasedTokenData legacyData;
+        ssLegacy >> legacyData;
+        CDataStream ssCanonical(SER_DISK, CLIENT_VERSION);
+        ssCanonical << legacyData;
+        std::string strRewritten;
+        BOOST_CHECK(db.ReadTokenRecord("OLD", strRewritten));
+        BOOST_CHECK(std::string(ssCanonical.begin(), ssCanonical.end()) == strRewritten);
+
+        // Without royalties the address and amount aren't kept, as they weren't before
+        CNewToken token;
+        BOOST_CHECK(db.ReadTokenData("NEW", token, nHeight, hash));
+        BOOST_CHECK(token.nRoyaltiesAddress.empty());
+        BOOST_CHECK_EQUAL(token.nRoyaltiesAmount, 0);
+        BOOST_CHECK_EQUAL(nHeight, 9);
+
+        std::string strRecord;
+        CTokenRecordView view;
+        BOOST_CHECK(!db.ReadTokenRecord("MISSING", strRecord));
+        BOOST_CHECK(!view.Parse((const unsigned char*)"\x03OLD", 4));
+        BOOST_CHECK(view.IsNull());
+    }
+
+    BOOST_AUTO_TEST_CASE(token_ownership_snapshot_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Ownership Snapshot Test");
+
+        CTokensDB db(1 << 20, true, true);
+        CTokenSnapshotDB snapshotDb(1 << 20, true, true);
+
+        std::vector<std::string> vAddresses;
+        for (int i = 0; i < 2500; i++) {
+            uint160 hash;
+            *hash.begin() = i & 0xff;
+            *(hash.begin() + 1) = i >> 8;
+            vAddresses.push_back(EncodeDestination(CKeyID(hash)));
+            BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", vAddresses.back(), i + 1));
+        }
+
+        // The view keeps returning the directory as it was captured
+        std::unique_ptr<CTokenAddressDirView> view = db.SnapshotTokenAddressDir("TOKEN");
+        for (int i = 1500; i < 2500; i++)
+            BOOST_CHECK(db.EraseTokenAddressQuantity("TOKEN", vAddresses[i]));
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", "invalid address", 1));
+
+        BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot("TOKEN", 100, *view));
+        CTokenSnapshotDBEntry entry;
+        BOOST_CHECK(snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 100, entry));
+        BOOST_CHECK_EQUAL(entry.ownersAndAmounts.size(), 2500U);
+        BOOST_CHECK(entry.ownersAndAmounts.count(std::make_pair(vAddresses[2499], (CAmount)2500)));
+
+        // Rebuilding the snapshot at the same height drops the parts the first one had beyond it, invalid addresses are skipped
+        view = db.SnapshotTokenAddressDir("TOKEN");
+        BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot("TOKEN", 100, *view));
+        entry.SetNull();
+        BOOST_CHECK(snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 100, entry));
+        BOOST_CHECK_EQUAL(entry.ownersAndAmounts.size(), 1500U);
+        BOOST_CHECK(!entry.ownersAndAmounts.count(std::make_pair(vAddresses[2499], (CAmount)2500)));
+
+        BOOST_CHECK(snapshotDb.RemoveOwnershipSnapshot("TOKEN", 100));
+        entry.SetNull();
+        BOOST_CHECK(!snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 100, entry));
+
+        // A token without owners doesn't get a snapshot
+        view = db.SnapshotTokenAddressDir("NOTOKEN");
+        BOOST_CHECK(!snapshotDb.WriteTokenOwnershipSnapshot("NOTOKEN", 100, *view));
+        view.reset();
+
+        // Queued snapshots are followed until the worker has written them, failures stay visible
+        CTokensDB* ptokensdbSaved = ptokensdb;
+        ptokensdb = &db;
+        StartTokenSnapshotWorker();
+        BOOST_CHECK(snapshotDb.QueueTokenOwnershipSnapshot("TOKEN", 200));
+        BOOST_CHECK(snapshotDb.QueueTokenOwnershipSnapshot("NOTOKEN", 200));
+
+        // Readers wait for a queued snapshot, removing one drops it whether or not the worker got to it
+        BOOST_CHECK(snapshotDb.HasOwnershipSnapshot("TOKEN", 200));
+        BOOST_CHECK(snapshotDb.QueueTokenOwnershipSnapshot("TOKEN", 300));
+        BOOST_CHECK(snapshotDb.RemoveOwnershipSnapshot("TOKEN", 300));
+        StopTokenSnapshotWorker();
+        ptokensdb = ptokensdbSaved;
+
+        CTokenSnapshotProgress progress;
+        BOOST_CHECK(!GetTokenSnapshotProgress("TOKEN", 200, progress));
+        BOOST_CHECK(snapshotDb.HasOwnershipSnapshot("TOKEN", 200));
+        BOOST_CHECK(GetTokenSnapshotProgress("NOTOKEN", 200, progress));
+        BOOST_CHECK(progress.state == CTokenSnapshotProgress::FAILED);
+        BOOST_CHECK(!snapshotDb.HasOwnershipSnapshot("NOTOKEN", 200));
+        BOOST_CHECK(!GetTokenSnapshotProgress("TOKEN", 300, progress));
+        BOOST_CHECK(!snapshotDb.HasOwnershipSnapshot("TOKEN", 300));
+    }
+
+    BOOST_AUTO_TEST_CASE(token_snapshot_delta_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Snapshot Delta Test");
+
+        CTokensDB db(1 << 20, true, true);
+        CTokenSnapshotDB snapshotDb(1 << 20, true, true);
+
+        std::vector<std::string> vAddresses;
+        for (int i = 0; i < 3000; i++) {
+            uint160 hash;
+            *hash.begin() = i & 0xff;
+            *(hash.begin() + 1) = i >> 8;
+            vAddresses.push_back(i % 2 ? EncodeDestination(CKeyID(hash)) : EncodeDestination(CScriptID(hash)));
+            if (i < 2500)
+                BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", vAddresses.back(), i + 1));
+        }
+
+        auto snapshotOwners = [&](int nHeight) {
+            std::vector<std::pair<std::string, CAmount>> vOwners;
+            BOOST_CHECK(snapshotDb.WalkOwnershipSnapshot("TOKEN", nHeight, [&](const std::string& address, const CAmount& amount) {
+                vOwners.emplace_back(address, amount);
+                return true;
+            }));
+            return vOwners;
+        };
+        auto directoryOwners = [&]() {
+            std::vector<std::pair<std::string, CAmount>> vOwners;
+            BOOST_CHECK(db.SnapshotTokenAddressDir("TOKEN")->Walk([&](const std::string& address, const CAmount& amount) {
+                vOwners.emplace_back(address, amount);
+                return true;
+            }));
+            return vOwners;
+        };
+
+        std::unique_ptr<CTokenAddressDirView> view = db.SnapshotTokenAddressDir("TOKEN");
+        BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot("TOKEN", 100, *view));
+        std::vector<std::pair<std::string, CAmount>> vOwners100 = directoryOwners();
+
+        // Owners that changed, left and joined are stored as changes, and read back in directory order
+        for (int i = 0; i < 100; i++)
+            BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", vAddresses[i], 1));
+        for (int i = 1000; i < 1100; i++)
+            BOOST_CHECK(db.EraseTokenAddressQuantity("TOKEN", vAddresses[i]));
+        for (int i = 2500; i < 2600; i++)
+            BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", vAddresses[i], 7));
+        view = db.SnapshotTokenAddressDir("TOKEN");
+        BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot("TOKEN", 200, *view));
+        std::vector<std::pair<std::string, CAmount>> vOwners200 = directoryOwners();
+        BOOST_CHECK(snapshotOwners(100) == vOwners100);
+        BOOST_CHECK(snapshotOwners(200) == vOwners200);
+
+        // Most owners leave, the next snapshot is stored in full again
+        for (int i = 0; i < 2000; i++)
+            db.EraseTokenAddressQuantity("TOKEN", vAddresses[i]);
+        view = db.SnapshotTokenAddressDir("TOKEN");
+        BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot("TOKEN", 300, *view));
+        view = db.SnapshotTokenAddressDir("TOKEN");
+        BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot("TOKEN", 400, *view));
+        std::vector<std::pair<std::string, CAmount>> vOwners400 = directoryOwners();
+        BOOST_CHECK_EQUAL(vOwners400.size(), 600U);
+        BOOST_CHECK(snapshotOwners(300) == vOwners400);
+        BOOST_CHECK(snapshotOwners(400) == vOwners400);
+
+        // The base stays readable for the snapshots stored as changes from it once it is removed or rebuilt
+        BOOST_CHECK(snapshotDb.RemoveOwnershipSnapshot("TOKEN", 100));
+        BOOST_CHECK(!snapshotDb.HasOwnershipSnapshot("TOKEN", 100));
+        BOOST_CHECK(snapshotOwners(200) == vOwners200);
+        BOOST_CHECK(snapshotDb.RemoveOwnershipSnapshot("TOKEN", 300));
+        view = db.SnapshotTokenAddressDir("TOKEN");
+        BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot("TOKEN", 300, *view));
+        BOOST_CHECK(snapshotOwners(200) == vOwners200);
+        BOOST_CHECK(snapshotOwners(300) == vOwners400);
+        BOOST_CHECK(snapshotOwners(400) == vOwners400);
+
+        CTokenSnapshotDBEntry entry;
+        BOOST_CHECK(snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 200, entry));
+        BOOST_CHECK_EQUAL(entry.ownersAndAmounts.size(), vOwners200.size());
+        BOOST_CHECK(entry.ownersAndAmounts.count(std::make_pair(vAddresses[0], (CAmount)1)));
+        BOOST_CHECK(!entry.ownersAndAmounts.count(std::make_pair(vAddresses[1000], (CAmount)1001)));
+        BOOST_CHECK(entry.ownersAndAmounts.count(std::make_pair(vAddresses[2599], (CAmount)7)));
+
+        size_t nRemoved = 0;
+        BOOST_CHECK(snapshotDb.PruneOwnershipSnapshots(1000, [](const std::string&, int) { return false; }, nRemoved));
+        BOOST_CHECK_EQUAL(nRemoved, 3U);
+        BOOST_CHECK(!snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 200, entry));
+    }
+
+    BOOST_AUTO_TEST_CASE(token_prune_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Prune Test");
+
+        CTokensDB db(1 << 20, true, true);
+        CBlockTokenUndo undo;
+        undo.fChangedIPFS = false;
+        undo.fChangedUnits = true;
+        undo.nUnits = 2;
+        undo.version = 1;
+        undo.fChangedVerifierString = false;
+        std::vector<uint256> vHashes;
+        for (int i = 0; i < 10; i++) {
+            vHashes.push_back(uint256S(strprintf("%064x", i + 1)));
+            BOOST_CHECK(db.WriteBlockUndoTokenData(vHashes.back(), {std::make_pair("TOKEN", undo)}));
+        }
+
+        // Erases the undo data of the blocks it isn't asked to keep, and only those
+        size_t nErased = 0;
+        BOOST_CHECK(db.PruneBlockUndoTokenData([&vHashes](const uint256& hash) { return hash != vHashes[2] && hash != vHashes[7]; }, nErased));
+        BOOST_CHECK_EQUAL(nErased, 2U);
+        for (int i = 0; i < 10; i++) {
+            std::vector<std::pair<std::string, CBlockTokenUndo> > vUndo;
+            BOOST_CHECK(db.ReadBlockUndoTokenData(vHashes[i], vUndo));
+            BOOST_CHECK_EQUAL(vUndo.size(), (i == 2 || i == 7) ? 0U : 1U);
+        }
+        nErased = 0;
+        BOOST_CHECK(db.PruneBlockUndoTokenData([](const uint256&) { return true; }, nErased));
+        BOOST_CHECK_EQUAL(nErased, 0U);
+
+        CTokenSnapshotDB snapshotDb(1 << 20, true, true);
+        BOOST_CHECK(db.WriteTokenAddressQuantity("TOKEN", EncodeDestination(CKeyID(uint160())), 1));
+        for (int nHeight : {100, 200, 300}) {
+            for (const char* name : {"TOKEN", "OTHER"}) {
+                std::unique_ptr<CTokenAddressDirView> view = db.SnapshotTokenAddressDir("TOKEN");
+                BOOST_CHECK(snapshotDb.WriteTokenOwnershipSnapshot(name, nHeight, *view));
+            }
+        }
+
+        // Snapshots above the height and the ones still asked for stay
+        size_t nRemoved = 0;
+        BOOST_CHECK(snapshotDb.PruneOwnershipSnapshots(200, [](const std::string& name, int nHeight) { return name == "OTHER" && nHeight == 100; }, nRemoved));
+        BOOST_CHECK_EQUAL(nRemoved, 3U);
+        CTokenSnapshotDBEntry entry;
+        BOOST_CHECK(!snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 100, entry));
+        BOOST_CHECK(!snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 200, entry));
+        BOOST_CHECK(!snapshotDb.RetrieveOwnershipSnapshot("OTHER", 200, entry));
+        BOOST_CHECK(snapshotDb.RetrieveOwnershipSnapshot("OTHER", 100, entry));
+        BOOST_CHECK(snapshotDb.RetrieveOwnershipSnapshot("TOKEN", 300, entry));
+        BOOST_CHECK(snapshotDb.RetrieveOwnershipSnapshot("OTHER", 300, entry));
+    }
+
+    BOOST_AUTO_TEST_CASE(token_block_undo_record_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Block Undo Record Test");
+
+        CBlockUndo blockUndo;
+        blockUndo.vtxundo.resize(1);
+        blockUndo.vtxundo[0].vprevout.emplace_back(CTxOut(COIN, CScript() << OP_TRUE), 10, false, false, 0);
+
+        // Without token undo data the record is the one written before it moved out of the tokens database
+        CDataStream ssPlain(SER_DISK, CLIENT_VERSION);
+        ssPlain << blockUndo;
+        CDataStream ssTxUndo(SER_DISK, CLIENT_VERSION);
+        ssTxUndo << blockUndo.vtxundo;
+        BOOST_CHECK(ssPlain.str() == ssTxUndo.str());
+        CBlockUndo plainRead;
+        ssPlain >> plainRead;
+        BOOST_CHECK_EQUAL(plainRead.vtxundo.size(), 1U);
+        BOOST_CHECK(plainRead.vtokenundo.empty());
+
+        CBlockTokenUndo undo{true, false, "QmOldHash", 0, TOKEN_UNDO_INCLUDES_VERIFIER_STRING, true, "#KYC"};
+        blockUndo.vtokenundo.emplace_back("$TOKEN", undo);
+        blockUndo.vtokenundo.emplace_back("OTHER", undo);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << blockUndo;
+        CBlockUndo read;
+        ss >> read;
+        BOOST_CHECK(ss.empty());
+        BOOST_CHECK_EQUAL(read.vtxundo.size(), 1U);
+        BOOST_REQUIRE_EQUAL(read.vtokenundo.size(), 2U);
+        BOOST_CHECK_EQUAL(read.vtokenundo[0].first, "$TOKEN");
+        BOOST_CHECK_EQUAL(read.vtokenundo[1].first, "OTHER");
+        BOOST_CHECK(read.vtokenundo[1].second.fChangedIPFS);
+        BOOST_CHECK_EQUAL(read.vtokenundo[1].second.strIPFS, "QmOldHash");
+        BOOST_CHECK(read.vtokenundo[1].second.fChangedVerifierString);
+        BOOST_CHECK_EQUAL(read.vtokenundo[1].second.verifierString, "#KYC");
+    }
+
+    BOOST_AUTO_TEST_CASE(restricted_address_qualifiers_batch_test)
+    {
+        BOOST_TEST_MESSAGE("Running Restricted Address Qualifiers Batch Test");
+
+        CRestrictedDB db(1 << 20, true, true);
+        BOOST_CHECK(db.WriteAddressQualifier("addr0", "#KYC"));
+        BOOST_CHECK(db.WriteAddressQualifier("addr0", "#ROOT/#SUB"));
+        BOOST_CHECK(db.WriteAddressQualifier("addr1", "#ROOT"));
+        BOOST_CHECK(db.WriteAddressQualifier("addr10", "#KYC"));
+
+        std::set<std::pair<std::string, std::string>> setLookups = {
+            {"addr0", "#KYC"}, {"addr0", "#ROOT"}, {"addr0", "#OTHER"}, {"addr0", "#KY"},
+            {"addr1", "#ROOT"}, {"addr1", "#KYC"}, {"addr2", "#KYC"}
+        };
+        std::set<std::pair<std::string, std::string>> setExact, setHeld;
+        BOOST_CHECK(db.ReadAddressQualifiers(setLookups, setExact, setHeld));
+
+        // Every lookup agrees with the single lookups
+        for (const auto& lookup : setLookups) {
+            BOOST_CHECK_EQUAL(setExact.count(lookup) > 0, db.ReadAddressQualifier(lookup.first, lookup.second));
+            BOOST_CHECK_EQUAL(setHeld.count(lookup) > 0, db.ReadAddressQualifier(lookup.first, lookup.second) || db.CheckForAddressRootQualifier(lookup.first, lookup.second));
+        }
+        BOOST_CHECK_EQUAL(setExact.size(), 2U);
+        BOOST_CHECK_EQUAL(setHeld.size(), 3U);
+        BOOST_CHECK(setHeld.count(std::make_pair("addr0", "#ROOT")));
+    }
+
+    BOOST_AUTO_TEST_CASE(restricted_root_qualifier_index_test)
+    {
+        BOOST_TEST_MESSAGE("Running Restricted Root Qualifier Index Test");
+
+        CRestrictedDB db(1 << 20, true, true);
+        BOOST_CHECK(db.WriteAddressQualifier("addr0", "#ROOT/#SUB1"));
+        BOOST_CHECK(db.WriteAddressQualifier("addr0", "#ROOT/#SUB2"));
+        BOOST_CHECK(db.WriteAddressQualifier("addr0", "#ROOTS"));
+        BOOST_CHECK(db.WriteAddressQualifier("addr1", "#ROOT"));
+        BOOST_CHECK(db.WriteAddressQualifier("addr3", "#ROOT/#SUB/#DEEP"));
+
+        // Tags are indexed under every qualifier they start with followed by '/', plain qualifiers aren't indexed
+        BOOST_CHECK(db.HasSubQualifier("addr0", "#ROOT"));
+        BOOST_CHECK(!db.HasSubQualifier("addr1", "#ROOT"));
+        BOOST_CHECK(db.HasSubQualifier("addr3", "#ROOT"));
+        BOOST_CHECK(db.HasSubQualifier("addr3", "#ROOT/#SUB"));
+        BOOST_CHECK(db.CheckForAddressRootQualifier("addr0", "#ROOT"));
+        BOOST_CHECK(db.CheckForAddressRootQualifier("addr1", "#ROOT"));
+        BOOST_CHECK(db.CheckForAddressRootQualifier("addr3", "#ROOT/#SUB"));
+        BOOST_CHECK(!db.CheckForAddressRootQualifier("addr0", "#ROO"));
+        BOOST_CHECK(!db.CheckForAddressRootQualifier("addr3", "#ROOT/#SU"));
+
+        // Erasing a tag takes it out of the index, the root stays held while another tag is under it
+        BOOST_CHECK(db.EraseAddressQualifier("addr0", "#ROOT/#SUB1"));
+        BOOST_CHECK(db.HasSubQualifier("addr0", "#ROOT"));
+        BOOST_CHECK(db.EraseAddressQualifier("addr0", "#ROOT/#SUB2"));
+        BOOST_CHECK(!db.HasSubQualifier("addr0", "#ROOT"));
+        BOOST_CHECK(!db.CheckForAddressRootQualifier("addr0", "#ROOT"));
+
+        // Building the index from the address tags gives the same entries
+        BOOST_CHECK(db.WriteAddressQualifier("addr2", "#KYC/#US"));
+        BOOST_CHECK(db.WriteFlag("subqualifierindex", false));
+        BOOST_CHECK(db.BuildRootQualifierIndex());
+        bool fIndexed = false;
+        BOOST_CHECK(db.ReadFlag("subqualifierindex", fIndexed) && fIndexed);
+        BOOST_CHECK(db.HasSubQualifier("addr2", "#KYC"));
+        BOOST_CHECK(db.HasSubQualifier("addr3", "#ROOT/#SUB"));
+        BOOST_CHECK(!db.HasSubQualifier("addr0", "#ROOT"));
+    }
+
+    BOOST_AUTO_TEST_CASE(restricted_block_prefetch_batch_test)
+    {
+        BOOST_TEST_MESSAGE("Running Restricted Block Prefetch Batch Test");
+
+        CRestrictedDB db(1 << 20, true, true);
+        BOOST_CHECK(db.WriteRestrictedAddress("addr0", "$TOKEN"));
+        BOOST_CHECK(db.WriteRestrictedAddress("addr10", "$TOKEN"));
+        BOOST_CHECK(db.WriteRestrictedAddress("addr1", "$OTHER"));
+        BOOST_CHECK(db.WriteGlobalRestriction("$TOKEN"));
+
+        std::set<std::pair<std::string, std::string>> setLookups = {
+            {"$TOKEN", "addr0"}, {"$TOKEN", "addr1"}, {"$OTHER", "addr1"}, {"$TOKEN", "addr10"}, {"$TOKEN", "addr2"}
+        };
+        std::set<std::pair<std::string, std::string>> setFrozen;
+        BOOST_CHECK(db.ReadRestrictedAddresses(setLookups, setFrozen));
+
+        // Every lookup agrees with the single lookups
+        for (const auto& lookup : setLookups)
+            BOOST_CHECK_EQUAL(setFrozen.count(lookup) > 0, db.ReadRestrictedAddress(lookup.second, lookup.first));
+        BOOST_CHECK_EQUAL(setFrozen.size(), 3U);
+
+        std::set<std::string> setGlobalFrozen;
+        BOOST_CHECK(db.ReadGlobalRestrictions({"$TOKEN", "$OTHER"}, setGlobalFrozen));
+        BOOST_CHECK(setGlobalFrozen == std::set<std::string>({"$TOKEN"}));
+    }
+
+    BOOST_AUTO_TEST_CASE(restricted_paged_listing_test)
+    {
+        BOOST_TEST_MESSAGE("Running Restricted Paged Listing Test");
+
+        CRestrictedDB db(1 << 20, true, true);
+        std::vector<std::string> vecExpected;
+        for (int i = 0; i < 25; i++) {
+            std::string address = strprintf("addr%02d", i);
+            vecExpected.emplace_back(address);
+            BOOST_CHECK(db.WriteQualifierAddress(address, "#KYC"));
+        }
+        // Neighbouring prefixes must not leak into the listing
+        BOOST_CHECK(db.WriteQualifierAddress("addr99", "#KY"));
+        BOOST_CHECK(db.WriteQualifierAddress("addr99", "#KYCX"));
+
+        std::vector<std::string> vecAll;
+        std::string qualifier = "#KYC";
+        BOOST_CHECK(db.GetQualifierAddresses(qualifier, vecAll));
+        BOOST_CHECK(vecAll == vecExpected);
+
+        // Walk the listing in pages of 10 and check they add up to the full listing
+        std::vector<std::string> vecPaged;
+        std::string after, next;
+        int nPages = 0;
+        do {
+            std::vector<std::string> vecPage;
+            BOOST_CHECK(db.GetQualifierAddressesFrom("#KYC", after, 10, vecPage, next));
+            BOOST_CHECK(vecPage.size() <= 10);
+            vecPaged.insert(vecPaged.end(), vecPage.begin(), vecPage.end());
+            after = next;
+            nPages++;
+        } while (!next.empty() && nPages < 10);
+        BOOST_CHECK_EQUAL(nPages, 3);
+        BOOST_CHECK(vecPaged == vecExpected);
+
+        // An exact final page hands back no cursor
+        std::vector<std::string> vecLast;
+        BOOST_CHECK(db.GetQualifierAddressesFrom("#KYC", "addr14", 10, vecLast, next));
+        BOOST_CHECK_EQUAL(vecLast.size(), 10U);
+        BOOST_CHECK(next.empty());
+    }
+
+    BOOST_AUTO_TEST_CASE(my_restricted_paged_listing_test)
+    {
+        BOOST_TEST_MESSAGE("Running My Restricted Paged Listing Test");
+
+        CMyRestrictedDB db(1 << 20, true, true);
+        for (int i = 0; i < 12; i++) {
+            BOOST_CHECK(db.WriteTaggedAddress(strprintf("addr%02d", i), "#KYC", i % 2 == 0, i));
+            BOOST_CHECK(db.WriteTaggedAddress(strprintf("addr%02d", i), "#AML", true, i));
+        }
+        // Restricted entries use another key flag and must not show up in the tagged pages
+        BOOST_CHECK(db.WriteRestrictedAddress("addr00", "$TOKEN", true, 1));
+
+        std::vector<std::tuple<std::string, std::string, bool, uint32_t> > vecAll;
+        BOOST_CHECK(db.LoadMyTaggedAddresses(vecAll));
+        BOOST_CHECK_EQUAL(vecAll.size(), 24U);
+
+        std::vector<std::tuple<std::string, std::string, bool, uint32_t> > vecPaged;
+        std::pair<std::string, std::string> after, next;
+        int nPages = 0;
+        do {
+            std::vector<std::tuple<std::string, std::string, bool, uint32_t> > vecPage;
+            BOOST_CHECK(db.LoadMyTaggedAddressesFrom(after, 10, vecPage, next));
+            BOOST_CHECK(vecPage.size() <= 10);
+            vecPaged.insert(vecPaged.end(), vecPage.begin(), vecPage.end());
+            after = next;
+            nPages++;
+        } while (!next.first.empty() && nPages < 10);
+        BOOST_CHECK_EQUAL(nPages, 3);
+        BOOST_CHECK(vecPaged == vecAll);
+
+        std::vector<std::tuple<std::string, std::string, bool, uint32_t> > vecRestricted;
+        BOOST_CHECK(db.LoadMyRestrictedAddressesFrom(std::make_pair(std::string(), std::string()), 10, vecRestricted, next));
+        BOOST_CHECK_EQUAL(vecRestricted.size(), 1U);
+        BOOST_CHECK(next.first.empty());
+    }
+
+    BOOST_AUTO_TEST_CASE(message_gc_batch_test)
+    {
+        BOOST_TEST_MESSAGE("Running Message GC Batch Test");
+
+        CMessageDB db(1 << 20, true, true);
+        std::vector<COutPoint> vOuts;
+        for (int i = 0; i < 10; i++) {
+            COutPoint out(ArithToUint256(arith_uint256(i + 1)), 0);
+            // five expire at 100 to 104, three never expire and two are orphaned at heights 10 and 50
+            CMessage message(out, "CHANNEL!", "", i < 5 ? 100 + i : 0, 50 + i);
+            message.nBlockHeight = i < 8 ? 5 : (i == 8 ? 10 : 50);
+            if (i >= 8)
+                message.status = MessageStatus::ORPHAN;
+            BOOST_CHECK(db.WriteMessage(message));
+            vOuts.push_back(out);
+        }
+
+        // Bounded batches go oldest first
+        std::vector<COutPoint> vErased;
+        BOOST_CHECK(db.EraseExpiredMessages(102, vErased, 2));
+        BOOST_CHECK_EQUAL(vErased.size(), 2U);
+        BOOST_CHECK(vErased[0] == vOuts[0] && vErased[1] == vOuts[1]);
+        CMessage message;
+        BOOST_CHECK(!db.ReadMessage(vOuts[1], message));
+        BOOST_CHECK(db.ReadMessage(vOuts[2], message));
+
+        BOOST_CHECK(db.EraseExpiredMessages(102, vErased, 2));
+        BOOST_CHECK_EQUAL(vErased.size(), 3U);
+        BOOST_CHECK(!db.ReadMessage(vOuts[2], message));
+        BOOST_CHECK(db.ReadMessage(vOuts[3], message));
+
+        // Only the orphans of blocks at or below the height go
+        BOOST_CHECK(db.EraseOrphanedMessages(20, vErased));
+        BOOST_CHECK_EQUAL(vErased.size(), 4U);
+        BOOST_CHECK(vErased[3] == vOuts[8]);
+        BOOST_CHECK(db.ReadMessage(vOuts[9], message));
+        BOOST_CHECK(db.EraseOrphanedMessages(-1, vErased));
+        BOOST_CHECK_EQUAL(vErased.size(), 4U);
+
+        // A re-mined orphan leaves the orphan index
+        message.status = MessageStatus::UNREAD;
+        BOOST_CHECK(db.WriteMessage(message));
+        BOOST_CHECK(db.EraseOrphanedMessages(100, vErased));
+        BOOST_CHECK_EQUAL(vErased.size(), 4U);
+
+        db.CompactMessages();
+        std::vector<CMessage> vMessages;
+        BOOST_CHECK(db.LoadChannelMessages("CHANNEL!", 0, 1000, 0, 0, vMessages));
+        BOOST_CHECK_EQUAL(vMessages.size(), 6U);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,8 @@
 #include <amount.h>
 #include <base58.h>
 #include <chainparams.h>
+#include <consensus/validation.h>
+#include <policy/policy.h>
 
 BOOST_FIXTURE_TEST_SUITE(unique_tests, BasicTestingSetup)
 
@@ -61,4 +63,38 @@ BOOST_FIXTURE_TEST_SUITE(unique_tests, BasicTestingSetup)
     }
 
 
+#ifdef ENABLE_WALLET
+    BOOST_AUTO_TEST_CASE(unique_pack_issues_test)
+    {
+        BOOST_TEST_MESSAGE("Running Unique Pack Issues Test");
+
+        std::vector<CNewToken> tokens;
+        for (int i = 0; i < 2000; i++)
+            tokens.emplace_back(strprintf("ROOT#TAG%d", i), UNIQUE_TOKEN_AMOUNT, UNIQUE_TOKEN_UNITS, UNIQUE_TOKENS_REISSUABLE, 0, "",
+                                UNIQUE_TOKENS_HAS_ROYALTIES, UNIQUE_TOKENS_ROYALTIES_ADDRESS, UNIQUE_TOKENS_ROYALTIES_AMOUNT);
+
+        // A few fit in one transaction
+        std::vector<std::vector<CNewToken> > vBatches;
+        PackUniqueTokenIssues(std::vector<CNewToken>(tokens.begin(), tokens.begin() + 10), GetParams().GlobalFeeAddress(), vBatches);
+        BOOST_CHECK_EQUAL(vBatches.size(), 1U);
+        BOOST_CHECK_EQUAL(vBatches[0].size(), 10U);
+
+        // Many are split in order into batches that each stay below a standard transaction
+        PackUniqueTokenIssues(tokens, GetParams().GlobalFeeAddress(), vBatches);
+        BOOST_CHECK(vBatches.size() > 1);
+        size_t nIndex = 0;
+        for (const auto& batch : vBatches) {
+            CMutableTransaction mtx;
+            for (const auto& token : batch) {
+                BOOST_CHECK_EQUAL(token.strName, tokens[nIndex++].strName);
+                CScript script = GetScriptForDestination(DecodeDestination(GetParams().GlobalFeeAddress()));
+                token.ConstructTransaction(script);
+                mtx.vout.emplace_back(0, script);
+            }
+            BOOST_CHECK(GetTransactionWeight(CTransaction(mtx)) <= MAX_STANDARD_TX_WEIGHT - (UNIQUE_ISSUE_RESERVED_TX_SIZE - 20) * WITNESS_SCALE_FACTOR);
+        }
+        BOOST_CHECK_EQUAL(nIndex, tokens.size());
+    }
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
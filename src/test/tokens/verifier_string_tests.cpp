@@ -367,4 +367,42 @@ BOOST_FIXTURE_TEST_SUITE(verifier_string_tests, BasicTestingSetup)
     }
 
 
+    BOOST_AUTO_TEST_CASE(compiled_verifier_test)
+    {
+        BOOST_TEST_MESSAGE("Running Compiled Verifier Test");
+
+        std::vector<std::string> vVariables = {"KYC", "ABC", "DEF"};
+        std::vector<std::string> vFormulas = {
+            "KYC", "!KYC", "KYC&ABC", "KYC|ABC&DEF", "(KYC|ABC)&!DEF", "!(KYC&!ABC)|DEF&1", "((((KYC))))", "0|KYC&1"
+        };
+
+        // The compiled program agrees with the interpreter under every valuation
+        for (const auto& formula : vFormulas) {
+            LibBoolEE::Program program = LibBoolEE::compile(formula, vVariables);
+            for (uint64_t valuation = 0; valuation < 8; valuation++) {
+                LibBoolEE::Vals vals;
+                for (size_t i = 0; i < vVariables.size(); i++)
+                    vals.insert(std::make_pair(vVariables[i], ((valuation >> i) & 1) != 0));
+                BOOST_CHECK_MESSAGE(LibBoolEE::evaluate(program, valuation) == LibBoolEE::resolve(formula, vals), formula);
+            }
+        }
+
+        // Compiling fails on the same formulas, with the same report, as resolving them does
+        std::vector<std::string> vBadFormulas = {"KYC|MISS", "KYC^ABC", "(KYC", "KYC&", "&"};
+        LibBoolEE::Vals vals = {{"KYC", true}, {"ABC", true}, {"DEF", true}};
+        for (const auto& formula : vBadFormulas) {
+            ErrorReport compileReport, resolveReport;
+            BOOST_CHECK_THROW(LibBoolEE::compile(formula, vVariables, &compileReport), std::runtime_error);
+            BOOST_CHECK_THROW(LibBoolEE::resolve(formula, vals, &resolveReport), std::runtime_error);
+            BOOST_CHECK_MESSAGE(compileReport.type == resolveReport.type, formula);
+            BOOST_CHECK_MESSAGE(compileReport.strDevData == resolveReport.strDevData, formula);
+        }
+
+        // Leading characters of a (sub)expression that has an operator are skipped, as the recursive parser did
+        for (const auto& formula : {"|KYC|ABC", "+KYC&ABC", "!(-KYC&!ABC)", "KYC|&ABC&DEF"})
+            BOOST_CHECK_MESSAGE(LibBoolEE::evaluate(LibBoolEE::compile(formula, vVariables), 7), formula);
+        for (const auto& formula : {"+KYC", "(|KYC)", "KYC|&ABC", "KYC&+ABC", "KYC(ABC)"})
+            BOOST_CHECK_THROW(LibBoolEE::compile(formula, vVariables), std::runtime_error);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,127 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "base58.h"
+#include "chain.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "tokens/tokens.h"
+#include "tokentxindex.h"
+#include "undo.h"
+
+#include "test/test_paladeum.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(tokentxindex_tests, BasicTestingSetup)
+
+static CScript TokenScript(const CTxDestination& dest, const std::string& strName, CAmount nAmount)
+{
+    CScript script = GetScriptForDestination(dest);
+    CTokenTransfer(strName, nAmount, 0).ConstructTransaction(script);
+    return script;
+}
+
+/** A block with a coinbase and a transaction spending a token output of destA and paying destB */
+static void MakeBlock(const std::string& strName, const CTxDestination& destA, const CTxDestination& destB, uint32_t nSeed, CBlock& block, CBlockUndo& blockUndo)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << nSeed;
+    coinbase.vout.emplace_back(COIN, GetScriptForDestination(destA));
+
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = COutPoint(uint256S("01"), nSeed);
+    tx.vin[1].prevout = COutPoint(uint256S("02"), nSeed);
+    tx.vout.emplace_back(0, TokenScript(destB, strName, 3 * COIN));
+    tx.vout.emplace_back(COIN, GetScriptForDestination(destA));
+
+    block.vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(tx)};
+    blockUndo.vtxundo.resize(1);
+    blockUndo.vtxundo[0].vprevout.emplace_back(CTxOut(0, TokenScript(destA, strName, 3 * COIN)), 1, false, false, 0);
+    blockUndo.vtxundo[0].vprevout.emplace_back(CTxOut(COIN, GetScriptForDestination(destA)), 1, false, false, 0);
+}
+
+    BOOST_AUTO_TEST_CASE(tokentxindex_block_entries_test)
+    {
+        CTxDestination destA = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+        CTxDestination destB = CKeyID(uint160(std::vector<unsigned char>(20, 2)));
+        CBlock block;
+        CBlockUndo blockUndo;
+        MakeBlock("TOKEN", destA, destB, 1, block, blockUndo);
+
+        // The token output received and the token output spent, plain outputs and inputs are left out
+        std::vector<std::pair<CTokenTxIndexKey, CTokenTxIndexValue> > vEntries;
+        CTokenTxIndex::BlockEntries(block, blockUndo, 5, vEntries);
+        BOOST_REQUIRE_EQUAL(vEntries.size(), 2U);
+        BOOST_CHECK_EQUAL(vEntries[0].first.strToken, "TOKEN");
+        BOOST_CHECK_EQUAL(vEntries[0].first.nHeight, 5);
+        BOOST_CHECK(vEntries[0].first.txid == block.vtx[1]->GetHash());
+        BOOST_CHECK(!vEntries[0].first.fSpend);
+        BOOST_CHECK_EQUAL(vEntries[0].first.n, 0U);
+        BOOST_CHECK_EQUAL(vEntries[0].second.strAddress, EncodeDestination(destB));
+        BOOST_CHECK_EQUAL(vEntries[0].second.nAmount, 3 * COIN);
+        BOOST_CHECK(vEntries[1].first.fSpend);
+        BOOST_CHECK_EQUAL(vEntries[1].first.n, 0U);
+        BOOST_CHECK_EQUAL(vEntries[1].second.strAddress, EncodeDestination(destA));
+    }
+
+    BOOST_AUTO_TEST_CASE(tokentxindex_walk_rewind_test)
+    {
+        CTxDestination destA = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+        CTxDestination destB = CKeyID(uint160(std::vector<unsigned char>(20, 2)));
+
+        // Three blocks in a row, the second for another token
+        std::vector<uint256> vHashes = {uint256S("a1"), uint256S("a2"), uint256S("a3")};
+        std::vector<CBlockIndex> vIndex(3);
+        for (int i = 0; i < 3; i++) {
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].nHeight = i + 1;
+            vIndex[i].pprev = i ? &vIndex[i - 1] : nullptr;
+        }
+
+        CTokenTxIndex index(1 << 20, true);
+        for (int i = 0; i < 3; i++) {
+            CBlock block;
+            CBlockUndo blockUndo;
+            MakeBlock(i == 1 ? "OTHER" : "TOKEN", destA, destB, i, block, blockUndo);
+            BOOST_CHECK(index.WriteBlock(block, blockUndo, &vIndex[i]));
+        }
+        uint256 hashBest;
+        BOOST_CHECK(index.ReadBestBlock(hashBest) && hashBest == vHashes[2]);
+
+        std::vector<CTokenTxIndexKey> vKeys;
+        auto collect = [&vKeys](const CTokenTxIndexKey& key, const CTokenTxIndexValue&) { vKeys.push_back(key); return true; };
+        BOOST_CHECK(index.Walk("TOKEN", 0, collect));
+        BOOST_REQUIRE_EQUAL(vKeys.size(), 4U);
+        BOOST_CHECK_EQUAL(vKeys[0].nHeight, 1);
+        BOOST_CHECK_EQUAL(vKeys[3].nHeight, 3);
+
+        // A name that is a prefix of another doesn't see its entries
+        vKeys.clear();
+        BOOST_CHECK(index.Walk("TOKE", 0, collect));
+        BOOST_CHECK(vKeys.empty());
+
+        vKeys.clear();
+        BOOST_CHECK(index.Walk("TOKEN", 2, collect));
+        BOOST_CHECK_EQUAL(vKeys.size(), 2U);
+
+        // Stops when asked to
+        int nCalls = 0;
+        BOOST_CHECK(index.Walk("TOKEN", 0, [&nCalls](const CTokenTxIndexKey&, const CTokenTxIndexValue&) { return ++nCalls < 3; }));
+        BOOST_CHECK_EQUAL(nCalls, 3);
+
+        // Rewinding the tip takes its entries out
+        BOOST_CHECK(index.RewindBlock(&vIndex[2]));
+        BOOST_CHECK(index.ReadBestBlock(hashBest) && hashBest == vHashes[1]);
+        vKeys.clear();
+        BOOST_CHECK(index.Walk("TOKEN", 0, collect));
+        BOOST_CHECK_EQUAL(vKeys.size(), 2U);
+        vKeys.clear();
+        BOOST_CHECK(index.Walk("OTHER", 0, collect));
+        BOOST_CHECK_EQUAL(vKeys.size(), 2U);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
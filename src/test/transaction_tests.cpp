@@ -20,6 +20,7 @@
 #include "script/sign.h"
 #include "script/script_error.h"
 #include "script/standard.h"
+#include "tokens/tokens.h"
 #include "utilstrencodings.h"
 
 #include <map>
@@ -297,6 +298,39 @@ BOOST_FIXTURE_TEST_SUITE(transaction_tests, BasicTestingSetup)
         BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
     }
 
+    BOOST_AUTO_TEST_CASE(check_transactions_batch_test)
+    {
+        BOOST_TEST_MESSAGE("Running Check Transactions Batch Test");
+
+        CScript scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1))));
+        CScript scriptToken = scriptPubKey;
+        CTokenTransfer("PLBTEST", 1000, 0).ConstructTransaction(scriptToken);
+
+        // Plain transactions, token transfers, some without inputs and some with a negative output
+        std::vector<CTransactionRef> vtx;
+        for (int i = 0; i < 40; i++) {
+            CMutableTransaction mtx;
+            if (i % 4 != 2)
+                mtx.vin.emplace_back(COutPoint(uint256S(strprintf("%064x", i + 1)), 0));
+            mtx.vout.emplace_back(i % 4 == 3 ? -1 : COIN, i % 4 == 1 ? scriptToken : scriptPubKey);
+            vtx.push_back(MakeTransactionRef(std::move(mtx)));
+        }
+
+        // Every state is the one CheckTransaction gives on its own, in order
+        std::vector<CValidationState> vState;
+        CheckTransactions(vtx, vState, 4);
+        BOOST_REQUIRE_EQUAL(vState.size(), vtx.size());
+        for (size_t k = 0; k < vtx.size(); k++) {
+            CValidationState state;
+            bool fValid = CheckTransaction(*vtx[k], state);
+            BOOST_CHECK_EQUAL(vState[k].IsValid(), fValid);
+            BOOST_CHECK_EQUAL(vState[k].GetRejectReason(), state.GetRejectReason());
+        }
+        BOOST_CHECK(vState[0].IsValid());
+        BOOST_CHECK_EQUAL(vState[2].GetRejectReason(), "bad-txns-vin-empty");
+        BOOST_CHECK_EQUAL(vState[3].GetRejectReason(), "bad-txns-vout-negative");
+    }
+
     //
     // Helper: create two dummy transactions, each with
     // two outputs.  The first has 11 and 50 CENT outputs
@@ -0,0 +1,107 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "random.h"
+#include "streams.h"
+#include "txreconciliation.h"
+#include "version.h"
+
+#include "test/test_paladeum.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+    BOOST_AUTO_TEST_CASE(txreconciliation_salt_test)
+    {
+        // Both ends of a link get the same keys, and different links different ones
+        uint64_t k0, k1, k0Other, k1Other;
+        ComputeReconciliationSalt(1, 2, k0, k1);
+        ComputeReconciliationSalt(2, 1, k0Other, k1Other);
+        BOOST_CHECK(k0 == k0Other && k1 == k1Other);
+        ComputeReconciliationSalt(1, 3, k0Other, k1Other);
+        BOOST_CHECK(k0 != k0Other || k1 != k1Other);
+
+        uint256 txid = InsecureRand256();
+        BOOST_CHECK_EQUAL(GetReconciliationShortId(k0, k1, txid), GetReconciliationShortId(k0, k1, txid));
+    }
+
+    BOOST_AUTO_TEST_CASE(txreconciliation_sketch_test)
+    {
+        std::set<uint32_t> setCommon, setLocal, setRemote;
+        while (setCommon.size() < 500)
+            setCommon.insert(InsecureRand32());
+        while (setLocal.size() < 10)
+            setLocal.insert(InsecureRand32());
+        while (setRemote.size() < 15)
+            setRemote.insert(InsecureRand32());
+
+        const size_t nCells = EstimateSketchCells(setCommon.size() + setRemote.size(), setCommon.size() + setLocal.size(), (uint16_t)(RECON_Q * RECON_Q_PRECISION));
+        BOOST_CHECK(nCells >= 2 * (setLocal.size() + setRemote.size()));
+
+        CTxSketch local(nCells), remote(nCells);
+        BOOST_CHECK_EQUAL(local.GetCells() % CTxSketch::NUM_HASHES, 0U);
+        for (uint32_t nShortId : setCommon) {
+            local.Add(nShortId);
+            remote.Add(nShortId);
+        }
+        for (uint32_t nShortId : setLocal)
+            local.Add(nShortId);
+        for (uint32_t nShortId : setRemote)
+            remote.Add(nShortId);
+
+        // The sketch goes over the wire
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << remote;
+        CTxSketch received;
+        stream >> received;
+        BOOST_CHECK_EQUAL(received.GetCells(), remote.GetCells());
+
+        // A sketch that fails to decode falls back to announcing everything, so only a wrong result is an error
+        BOOST_CHECK(local.Subtract(received));
+        std::vector<uint32_t> vPositive, vNegative;
+        if (local.Decode(vPositive, vNegative)) {
+            BOOST_CHECK(std::set<uint32_t>(vPositive.begin(), vPositive.end()) == setLocal);
+            BOOST_CHECK(std::set<uint32_t>(vNegative.begin(), vNegative.end()) == setRemote);
+        }
+
+        // Sketches of different sizes don't subtract
+        CTxSketch other(nCells + CTxSketch::NUM_HASHES);
+        BOOST_CHECK(!other.Subtract(remote));
+
+        // Equal sets leave nothing
+        CTxSketch same(nCells);
+        for (uint32_t nShortId : setCommon)
+            same.Add(nShortId);
+        for (uint32_t nShortId : setRemote)
+            same.Add(nShortId);
+        BOOST_CHECK(same.Subtract(remote));
+        BOOST_CHECK(same.Decode(vPositive, vNegative));
+        BOOST_CHECK(vPositive.empty() && vNegative.empty());
+    }
+
+    BOOST_AUTO_TEST_CASE(txreconciliation_sketch_size_test)
+    {
+        // An empty set gets an empty sketch, the others one with room for the expected difference
+        BOOST_CHECK_EQUAL(EstimateSketchCells(0, 100, RECON_Q_PRECISION), 0U);
+        BOOST_CHECK_EQUAL(EstimateSketchCells(100, 100, 0), 2 + SKETCH_EXTRA_CELLS);
+        BOOST_CHECK(EstimateSketchCells(100, 100, RECON_Q_PRECISION) > EstimateSketchCells(100, 100, 0));
+        BOOST_CHECK_EQUAL(EstimateSketchCells(MAX_RECON_SET_SIZE, 1, 0), MAX_SKETCH_CELLS);
+
+        // Oversized or misaligned sketches are refused
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << CTxSketch(MAX_SKETCH_CELLS + CTxSketch::NUM_HASHES);
+        CTxSketch sketch;
+        BOOST_CHECK_THROW(stream >> sketch, std::ios_base::failure);
+
+        stream.clear();
+        WriteCompactSize(stream, 4);
+        stream << std::vector<unsigned char>(4 * 10);
+        BOOST_CHECK_THROW(stream >> sketch, std::ios_base::failure);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,16 +6,21 @@
 #include "util.h"
 
 #include "clientversion.h"
+#include "metrics.h"
 #include "primitives/transaction.h"
 #include "sync.h"
+#include "trace.h"
 #include "utilstrencodings.h"
 #include "utilmoneystr.h"
 #include "test/test_paladeum.h"
 
+#include <atomic>
+#include <fstream>
 #include <stdint.h>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(util_tests, BasicTestingSetup)
 
@@ -671,4 +676,211 @@ BOOST_FIXTURE_TEST_SUITE(util_tests, BasicTestingSetup)
         BOOST_CHECK(!ParseFixedPoint("42000000001", 8, &amount));
     }
 
+BOOST_AUTO_TEST_CASE(util_LockHoldTimer)
+{
+    CCriticalSection csTimed(/* fTimeHold */ true);
+    CCriticalSection csUntimed;
+
+    CLockHoldTimer outer;
+    {
+        LOCK(csUntimed);
+        MilliSleep(20);
+    }
+    BOOST_CHECK_EQUAL(outer.GetMicros(), 0);
+
+    {
+        CLockHoldTimer inner;
+        {
+            LOCK(csTimed);
+            {
+                // Recursive locking is counted once
+                LOCK(csTimed);
+                MilliSleep(20);
+            }
+            BOOST_CHECK_EQUAL(inner.GetMicros(), 0);
+        }
+        BOOST_CHECK(inner.GetMicros() >= 20000);
+        BOOST_CHECK_EQUAL(outer.GetMicros(), 0);
+    }
+    // The inner timer's time is the outer one's too
+    BOOST_CHECK(outer.GetMicros() >= 20000);
+    BOOST_CHECK_EQUAL(csTimed.nHoldDepth, 0);
+
+    {
+        TRY_LOCK(csTimed, lockTimed);
+        BOOST_CHECK((bool)lockTimed);
+        BOOST_CHECK_EQUAL(csTimed.nHoldDepth, 1);
+    }
+    BOOST_CHECK_EQUAL(csTimed.nHoldDepth, 0);
+}
+
+static const LockSiteStats* FindLockSite(const std::vector<LockSiteStats>& vStats, int nLine)
+{
+    for (const LockSiteStats& stats : vStats) {
+        if (stats.strFile == __FILE__ && stats.nLine == nLine)
+            return &stats;
+    }
+    return nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(util_LockProfiling)
+{
+    CCriticalSection cs;
+    ResetLockStats();
+
+    // Nothing is recorded while the profiler is off
+    const int nLineOff = __LINE__ + 1;
+    { LOCK(cs); }
+    BOOST_CHECK(!FindLockSite(GetLockStats(), nLineOff));
+
+    SetLockProfiling(true);
+    int nLineHold = 0, nLineRecursive = 0;
+    for (int i = 0; i < 2; i++) {
+        nLineHold = __LINE__ + 1;
+        LOCK(cs);
+        {
+            // Recursive locking is counted once
+            nLineRecursive = __LINE__ + 1;
+            LOCK(cs);
+            MilliSleep(10);
+        }
+    }
+
+    // Waiting for another thread's hold
+    std::atomic<bool> fHeld(false);
+    boost::thread holder([&cs, &fHeld] {
+        LOCK(cs);
+        fHeld = true;
+        MilliSleep(20);
+    });
+    while (!fHeld)
+        MilliSleep(1);
+    const int nLineWait = __LINE__ + 1;
+    { LOCK(cs); }
+    holder.join();
+    SetLockProfiling(false);
+
+    std::vector<LockSiteStats> vStats = GetLockStats();
+    const LockSiteStats* pHold = FindLockSite(vStats, nLineHold);
+    BOOST_REQUIRE(pHold);
+    BOOST_CHECK_EQUAL(pHold->strName, "cs");
+    BOOST_CHECK_EQUAL(pHold->nCount, 2U);
+    BOOST_CHECK_EQUAL(pHold->nContended, 0U);
+    BOOST_CHECK(pHold->nHoldMicros >= 20000);
+    BOOST_CHECK(pHold->nMaxHoldMicros >= 10000);
+    BOOST_CHECK(!FindLockSite(vStats, nLineRecursive));
+
+    const LockSiteStats* pWait = FindLockSite(vStats, nLineWait);
+    BOOST_REQUIRE(pWait);
+    BOOST_CHECK_EQUAL(pWait->nCount, 1U);
+    BOOST_CHECK_EQUAL(pWait->nContended, 1U);
+    BOOST_CHECK(pWait->nWaitMicros > 0);
+    BOOST_CHECK_EQUAL(pWait->nWaitMicros, pWait->nMaxWaitMicros);
+    // The most waited for site comes first
+    BOOST_CHECK(vStats[0].nWaitMicros >= pWait->nWaitMicros);
+
+    ResetLockStats();
+    BOOST_CHECK(GetLockStats().empty());
+}
+
+BOOST_AUTO_TEST_CASE(util_Tracing)
+{
+    ResetTraceStats();
+    { TRACE_SPAN("test.off"); }
+
+    SetTracing(true);
+    for (int i = 0; i < 3; i++) {
+        TRACE_SPAN("test.outer");
+        MilliSleep(2);
+        CTraceSpan inner("test.inner");
+        inner.End();
+        // Ending twice records once
+        inner.End();
+    }
+    SetTracing(false);
+
+    std::vector<TraceSpanStats> vStats = GetTraceStats();
+    BOOST_REQUIRE_EQUAL(vStats.size(), 2U);
+    // The most time first
+    BOOST_CHECK_EQUAL(vStats[0].strName, "test.outer");
+    BOOST_CHECK_EQUAL(vStats[0].nCount, 3U);
+    BOOST_CHECK(vStats[0].nTotalMicros >= 6000);
+    BOOST_CHECK(vStats[0].nMaxMicros >= 2000);
+    uint64_t nInBuckets = 0;
+    for (int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+        // Two milliseconds are more than 2^10 microseconds, so they are in the buckets after the one up to that
+        if (i <= 10)
+            BOOST_CHECK_EQUAL(vStats[0].vBuckets[i], 0U);
+        nInBuckets += vStats[0].vBuckets[i];
+    }
+    BOOST_CHECK_EQUAL(nInBuckets, 3U);
+    BOOST_CHECK_EQUAL(vStats[1].strName, "test.inner");
+    BOOST_CHECK_EQUAL(vStats[1].nCount, 3U);
+
+    const fs::path path = fs::temp_directory_path() / fs::unique_path();
+    BOOST_CHECK_EQUAL(WriteTraceEvents(path), 6);
+    std::ifstream file(path.string());
+    std::string strTrace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    fs::remove(path);
+    BOOST_CHECK_EQUAL(strTrace.compare(0, 16, "{\"traceEvents\":["), 0);
+    // The inner span ends first
+    BOOST_CHECK(strTrace.find("\"name\":\"test.inner\"") < strTrace.find("\"name\":\"test.outer\""));
+    BOOST_CHECK(strTrace.find("test.off") == std::string::npos);
+
+    ResetTraceStats();
+    BOOST_CHECK(GetTraceStats().empty());
+    BOOST_CHECK_EQUAL(WriteTraceEvents(path), 0);
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(util_Metrics)
+{
+    std::string strMetrics;
+    {
+        CMetricCounter counter("test_metric_counter_total", "A counter");
+        CMetricGauge gauge("test_metric_gauge", "A gauge");
+        CMetricHistogram histogram("test_metric_histogram_seconds", "A histogram", {1000, 10000}, 1e-6);
+
+        counter.Inc();
+        counter.Inc(41);
+        gauge.Set(10);
+        gauge.Add(-15);
+        for (int64_t n : {500, 1000, 1001, 20000})
+            histogram.Observe(n);
+        BOOST_CHECK_EQUAL(counter.Get(), 42U);
+        BOOST_CHECK_EQUAL(gauge.Get(), -5);
+        BOOST_CHECK_EQUAL(histogram.GetCount(), 4U);
+        strMetrics = RenderMetrics();
+    }
+
+    BOOST_CHECK(strMetrics.find("# HELP test_metric_counter_total A counter\n# TYPE test_metric_counter_total counter\ntest_metric_counter_total 42\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("# TYPE test_metric_gauge gauge\ntest_metric_gauge -5\n") != std::string::npos);
+    // Buckets are cumulative and the bounds are scaled, a bound itself counts into its bucket
+    BOOST_CHECK(strMetrics.find("# TYPE test_metric_histogram_seconds histogram\n"
+                                "test_metric_histogram_seconds_bucket{le=\"0.001\"} 2\n"
+                                "test_metric_histogram_seconds_bucket{le=\"0.01\"} 3\n"
+                                "test_metric_histogram_seconds_bucket{le=\"+Inf\"} 4\n"
+                                "test_metric_histogram_seconds_sum 0.022501\n"
+                                "test_metric_histogram_seconds_count 4\n") != std::string::npos);
+    // Sorted by name
+    BOOST_CHECK(strMetrics.find("test_metric_counter_total") < strMetrics.find("test_metric_gauge"));
+    BOOST_CHECK(strMetrics.find("test_metric_gauge") < strMetrics.find("test_metric_histogram_seconds"));
+
+    // Metrics leave the registry when destroyed
+    BOOST_CHECK(RenderMetrics().find("test_metric_") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(util_RunInParallel)
+{
+    for (size_t nItems : {0, 1, 7, 1000}) {
+        std::vector<std::atomic<int> > vCalls(nItems);
+        for (std::atomic<int>& calls : vCalls)
+            calls = 0;
+        RunInParallel(nItems, 4, [&vCalls](size_t k) { vCalls[k]++; });
+        for (const std::atomic<int>& calls : vCalls)
+            BOOST_CHECK_EQUAL(calls.load(), 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "scheduler.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include "test/test_paladeum.h"
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+namespace {
+/** Takes BlockFound notifications, each only once the test lets it through */
+class GatedListener : public CValidationInterface
+{
+public:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    int nAllowed = 0;
+    std::vector<uint256> vFound;
+    std::vector<boost::thread::id> vThreads;
+
+protected:
+    void BlockFound(const uint256& hash) override
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while ((int)vFound.size() >= nAllowed)
+            cond.wait(lock);
+        vFound.push_back(hash);
+        vThreads.push_back(boost::this_thread::get_id());
+    }
+};
+} // namespace
+
+BOOST_AUTO_TEST_CASE(async_listener_test)
+{
+    CScheduler scheduler;
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
+    GatedListener listener;
+    RegisterAsyncValidationInterface(&listener, "test", 2);
+
+    // Signalling returns while the listener is held up, and the queue runs past its bound
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 6; i++) {
+        vHashes.push_back(ArithToUint256(arith_uint256(i + 1)));
+        GetMainSignals().BlockFound(vHashes.back());
+    }
+    std::vector<ValidationQueueStats> vStats = GetValidationQueueStats();
+    BOOST_CHECK_EQUAL(vStats.size(), 1U);
+    BOOST_CHECK_EQUAL(vStats[0].strName, "test");
+    BOOST_CHECK(vStats[0].nOverflows >= 3);
+    BOOST_CHECK(vStats[0].nPeakQueued >= 5);
+    {
+        boost::unique_lock<boost::mutex> lock(listener.mutex);
+        BOOST_CHECK(listener.vFound.empty());
+        listener.nAllowed = vHashes.size();
+        listener.cond.notify_all();
+    }
+
+    // Unregistering delivers the rest, in order and on the listener's own thread
+    UnregisterValidationInterface(&listener);
+    BOOST_CHECK(listener.vFound == vHashes);
+    for (const boost::thread::id& id : listener.vThreads) {
+        BOOST_CHECK(id != boost::this_thread::get_id());
+        BOOST_CHECK(id == listener.vThreads[0]);
+    }
+    BOOST_CHECK(GetValidationQueueStats().empty());
+
+    // Nothing reaches it any more
+    GetMainSignals().BlockFound(uint256());
+    BOOST_CHECK_EQUAL(listener.vFound.size(), vHashes.size());
+
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
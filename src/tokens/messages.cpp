@@ -11,6 +11,12 @@
 #include "messages.h"
 #include "mytokensdb.h"
 #include <primitives/block.h>
+#include <bloom.h>
+#include <scheduler.h>
+
+#include <atomic>
+
+#include <boost/thread.hpp>
 
 
 std::set<COutPoint> setDirtyMessagesRemove;
@@ -26,6 +32,47 @@ std::set<std::string> setAddressAskedForFalse;
 
 CCriticalSection cs_messaging;
 
+/**
+ * A rolling bloom filter over every key of one kind in the channel database and its dirty cache, so the lookups of
+ * keys that were never added skip the database. The filter holds room for all the keys it is given and is dropped,
+ * falling back to the database, rather than let its oldest generation roll over.
+ */
+class CMessageKeyFilter
+{
+    std::unique_ptr<CRollingBloomFilter> filter;
+    unsigned int nCapacity = 0;
+    unsigned int nInserted = 0;
+
+public:
+    void Reset(size_t nKeys)
+    {
+        nCapacity = std::max<size_t>(nKeys * 2, MESSAGE_FILTER_MIN_ELEMENTS);
+        nInserted = 0;
+        filter.reset(new CRollingBloomFilter(nCapacity, MESSAGE_FILTER_FP_RATE));
+    }
+
+    void Insert(const std::string& key)
+    {
+        if (!filter)
+            return;
+        if (++nInserted > nCapacity) {
+            LogPrintf("%s : Message key filter is full, falling back to the database until restart\n", __func__);
+            filter.reset();
+            return;
+        }
+        filter->insert(std::vector<unsigned char>(key.begin(), key.end()));
+    }
+
+    //! False only for keys that were never inserted
+    bool MayContain(const std::string& key) const
+    {
+        return !filter || filter->contains(std::vector<unsigned char>(key.begin(), key.end()));
+    }
+};
+
+static CMessageKeyFilter subscribedChannelsFilter;
+static CMessageKeyFilter seenAddressFilter;
+
 
 int8_t IntFromMessageStatus(MessageStatus status)
 {
@@ -78,6 +125,10 @@ bool IsChannelSubscribed(const std::string &name)
     if (setDirtyChannelsRemove.count(name))
         return false;
 
+    // Channels that were never subscribed to, which is almost all of them
+    if (!subscribedChannelsFilter.MayContain(name))
+        return false;
+
     // Check the Channel Cache and see if it is in the Cache
     if (pMessageSubscribedChannelsCache->Exists(name))
         return true;
@@ -132,6 +183,7 @@ void AddChannel(const std::string &name)
 {
     // Add channel to dirty cache to add
     setDirtyChannelsAdd.insert(name);
+    subscribedChannelsFilter.Insert(name);
 
     // If the channel name is in the dirty remove cache. Remove it so it doesn't get deleted on flush
     setDirtyChannelsRemove.erase(name);
@@ -188,87 +240,152 @@ void OrphanMessage(const CMessage& message)
 }
 
 #ifdef ENABLE_WALLET
-bool ScanForMessageChannels(std::string& strError)
+/** Subscribe to the channel a token output of ours entitles us to */
+static void AddChannelsForOutput(const CTxOut& out)
 {
-    LOCK2(cs_messaging, cs_main);
+    AssertLockHeld(cs_messaging);
 
-    LogPrintf("%s : Start Scanning For Message Channels\n", __func__);
+    CTokenOutputEntry tokenData;
+    // Get the token data from the script
+    if (!GetTokenData(out.scriptPubKey, tokenData)) {
+        LogPrintf("%s : Failed to get GetTokenData call\n", __func__);
+        return;
+    }
 
-    if (vpwallets.size() == 0) {
-        strError = "Wallet isn't active on this client. Can't scan for MsgChannels";
-        return false;
+    int nType = 0;
+    bool fOwner = false;
+    out.scriptPubKey.IsTokenScript(nType, fOwner);
+
+    KnownTokenType type;
+    IsTokenNameValid(tokenData.tokenName, type);
+
+    if (tokenData.type == TX_TRANSFER_TOKEN) {
+        if (type == KnownTokenType::MSGCHANNEL || type == KnownTokenType::OWNER) { // Subscribe to any channels or owner tokens you own
+            AddChannel(tokenData.tokenName);
+            AddAddressSeen(EncodeDestination(tokenData.destination));
+        } else if (type == KnownTokenType::ROOT || type == KnownTokenType::SUB) { // Subscribe to any tokens you are sent, if they are sent to a new address
+            if (!IsChannelSubscribed(tokenData.tokenName + OWNER_TAG)) {
+                if (!IsAddressSeen(EncodeDestination(tokenData.destination))) {
+                    AddChannel(tokenData.tokenName + OWNER_TAG);
+                    AddAddressSeen(EncodeDestination(tokenData.destination));
+                }
+            }
+        }
+    } else if (tokenData.type == TX_NEW_TOKEN || tokenData.type == TX_REISSUE_TOKEN) {
+        if (fOwner || type == KnownTokenType::MSGCHANNEL) {
+            AddChannel(tokenData.tokenName);
+            AddAddressSeen(EncodeDestination(tokenData.destination));
+        } else if (type == KnownTokenType::ROOT || type == KnownTokenType::SUB || type == KnownTokenType::RESTRICTED) {
+            AddChannel(tokenData.tokenName + "!");
+            AddAddressSeen(EncodeDestination(tokenData.destination));
+        }
     }
+}
 
-    CBlockIndex* blockIndex = chainActive[0];
+/** Reads the blocks of vPos from disk, keeping only their token outputs; several of these run at once */
+static void ReadScanBatch(const std::vector<std::pair<CDiskBlockPos, uint256>>& vPos, std::vector<std::vector<CTxOut>>& vTokenOuts,
+                          size_t nStart, size_t nStride, std::atomic<bool>& fFailed)
+{
+    for (size_t i = nStart; i < vPos.size() && !fFailed; i += nStride) {
+        boost::this_thread::interruption_point();
 
-    while (blockIndex) {
         CBlock block;
-        if (!ReadBlockFromDisk(block, blockIndex, GetParams().GetConsensus())) {
-            strError = "Block not found on disk";
-            return false;
+        if (!ReadBlockFromDisk(block, vPos[i].first, GetParams().GetConsensus()) || block.GetIndexHash() != vPos[i].second) {
+            fFailed = true;
+            return;
         }
 
+        // Checking the script first spares the wallet lookup for the outputs that can never be a channel
         for (const auto& tx : block.vtx) {
-
-            auto ptx = tx.get();
-            if (!ptx) {
-                strError = "Failed to get transaction pointer";
-                return false;
-            }
-
-            for (auto out : ptx->vout) {
+            for (const auto& out : tx->vout) {
                 int nType = 0;
                 bool fOwner = false;
-                if (vpwallets[0]->IsMine(out) == ISMINE_SPENDABLE) { // Is the out mine
-                    if (out.scriptPubKey.IsTokenScript(nType, fOwner)) {
-                        CTokenOutputEntry tokenData;
-                        // Get the token data from the script
-                        if (GetTokenData(out.scriptPubKey, tokenData)) {
-                            KnownTokenType type;
-                            IsTokenNameValid(tokenData.tokenName, type);
-
-                            if (tokenData.type == TX_TRANSFER_TOKEN) {
-                                if (type == KnownTokenType::MSGCHANNEL || type == KnownTokenType::OWNER) { // Subscribe to any channels or owner tokens you own
-                                    AddChannel(tokenData.tokenName);
-                                    AddAddressSeen(EncodeDestination(tokenData.destination));
-                                } else if (type == KnownTokenType::ROOT || type == KnownTokenType::SUB) { // Subscribe to any tokens you are sent, if they are sent to a new address
-                                    if (!IsChannelSubscribed(tokenData.tokenName + OWNER_TAG)) {
-                                        if (!IsAddressSeen(EncodeDestination(tokenData.destination))) {
-                                            AddChannel(tokenData.tokenName + OWNER_TAG);
-                                            AddAddressSeen(EncodeDestination(tokenData.destination));
-                                        }
-                                    }
-                                }
-                            } else if (tokenData.type == TX_NEW_TOKEN || tokenData.type == TX_REISSUE_TOKEN) {
-                                if (fOwner || type == KnownTokenType::MSGCHANNEL) {
-                                    AddChannel(tokenData.tokenName);
-                                    AddAddressSeen(EncodeDestination(tokenData.destination));
-                                } else if (type == KnownTokenType::ROOT || type == KnownTokenType::SUB || type == KnownTokenType::RESTRICTED) {
-                                    AddChannel(tokenData.tokenName + "!");
-                                    AddAddressSeen(EncodeDestination(tokenData.destination));
-                                }
-                            }
-                        } else {
-                            LogPrintf("%s : Failed to get GetTokenData call\n", __func__);
-                        }
-                    }
-                }
+                if (out.scriptPubKey.IsTokenScript(nType, fOwner))
+                    vTokenOuts[i].push_back(out);
             }
         }
-        blockIndex = chainActive[blockIndex->nHeight + 1];
     }
+}
+
+bool ScanForMessageChannels(std::string& strError)
+{
+    if (vpwallets.size() == 0) {
+        strError = "Wallet isn't active on this client. Can't scan for MsgChannels";
+        return false;
+    }
+    CWallet* const pwallet = vpwallets[0];
+
+    // Resume after the last batch that was applied and flushed
+    int nHeight = 0;
+    if (pmessagechanneldb->ReadScanHeight(nHeight))
+        nHeight++;
+
+    LogPrintf("%s : Start Scanning For Message Channels at height %d\n", __func__, nHeight);
+
+    const int nThreads = std::max(1, std::min(MESSAGE_SCAN_MAX_THREADS, GetNumCores()));
+    size_t nChannelsFound = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
 
-    LogPrintf("%s : Finished Scanning For Message Channels. Subscribed Messages Channels Found: %u\n", __func__, setDirtyChannelsAdd.size());
-    
-    if (setDirtyChannelsAdd.size() > 0) {
-        for (auto item : setDirtyChannelsAdd) {
-            LogPrintf("%s, ",item);
+        std::vector<std::pair<CDiskBlockPos, uint256>> vPos;
+        {
+            LOCK(cs_main);
+            for (int h = nHeight; h < nHeight + MESSAGE_SCAN_BATCH_SIZE && h <= chainActive.Height(); h++)
+                vPos.emplace_back(chainActive[h]->GetBlockPos(), chainActive[h]->GetIndexHash());
         }
-        LogPrintf("\n");
+        if (vPos.empty())
+            break;
+
+        std::vector<std::vector<CTxOut>> vTokenOuts(vPos.size());
+        std::atomic<bool> fFailed{false};
+        boost::thread_group readers;
+        for (int t = 0; t < nThreads; t++)
+            readers.create_thread(std::bind(&ReadScanBatch, std::cref(vPos), std::ref(vTokenOuts), t, nThreads, std::ref(fFailed)));
+        try {
+            readers.join_all();
+        } catch (const boost::thread_interrupted&) {
+            readers.interrupt_all();
+            readers.join_all();
+            throw;
+        }
+        if (fFailed) {
+            strError = "Block not found on disk";
+            return false;
+        }
+
+        {
+            LOCK(cs_messaging);
+            for (const auto& vOuts : vTokenOuts)
+                for (const auto& out : vOuts)
+                    if (pwallet->IsMine(out) == ISMINE_SPENDABLE) // Is the out mine
+                        AddChannelsForOutput(out);
+            nChannelsFound += setDirtyChannelsAdd.size();
+
+            // The channels go to disk before the progress that covers them
+            if (!pmessagechanneldb->Flush() || !pmessagechanneldb->WriteScanHeight(nHeight + vPos.size() - 1)) {
+                strError = "Failed to write message channels";
+                return false;
+            }
+        }
+        nHeight += vPos.size();
     }
 
+    LogPrintf("%s : Finished Scanning For Message Channels. Subscribed Messages Channels Found: %u\n", __func__, nChannelsFound);
+
     return true;
 }
+
+void ThreadScanForMessageChannels()
+{
+    RenameThread("paladeum-msgscan");
+
+    std::string strError;
+    if (!ScanForMessageChannels(strError)) {
+        LogPrintf("%s : Failed to scan for message channels, %s\n", __func__, strError);
+        return;
+    }
+    pmessagechanneldb->WriteFlag("init", true);
+}
 #endif
 
 bool IsAddressSeen(const std::string &address)
@@ -279,6 +396,9 @@ bool IsAddressSeen(const std::string &address)
     if (setDirtySeenAddressAdd.count(address)) // Check dirty set
         return true;
 
+    if (!seenAddressFilter.MayContain(address))
+        return false;
+
     if (pMessagesSeenAddressCache->Exists(address)) {
         return true;
     }
@@ -300,9 +420,80 @@ bool IsAddressSeen(const std::string &address)
 void AddAddressSeen(const std::string &address)
 {
     setDirtySeenAddressAdd.insert(address);
+    seenAddressFilter.Insert(address);
     setSubscribedChannelsAskedForFalse.erase(address);
 }
 
+bool LoadMessageFilters()
+{
+    if (!pmessagechanneldb)
+        return false;
+
+    std::set<std::string> setChannels;
+    std::vector<std::string> vAddresses;
+    if (!pmessagechanneldb->LoadMyMessageChannels(setChannels) || !pmessagechanneldb->LoadUsedAddresses(vAddresses))
+        return false;
+
+    subscribedChannelsFilter.Reset(setChannels.size());
+    for (const auto& channel : setChannels)
+        subscribedChannelsFilter.Insert(channel);
+
+    seenAddressFilter.Reset(vAddresses.size());
+    for (const auto& address : vAddresses)
+        seenAddressFilter.Insert(address);
+
+    LogPrintf("%s : Loaded %u message channels and %u seen addresses\n", __func__, setChannels.size(), vAddresses.size());
+    return true;
+}
+
+size_t CollectMessageGarbage(int64_t nTime, int nOrphanHeight)
+{
+    size_t nErased = 0;
+    while (true) {
+        std::vector<COutPoint> vErased;
+        {
+            LOCK(cs_messaging);
+            if (!pmessagedb || !pMessagesCache)
+                return nErased;
+
+            // The dirty caches go to the database first, so the indexes cover them
+            if (!pmessagedb->Flush() ||
+                !pmessagedb->EraseExpiredMessages(nTime, vErased, MESSAGE_GC_BATCH_SIZE) ||
+                !pmessagedb->EraseOrphanedMessages(nOrphanHeight, vErased, MESSAGE_GC_BATCH_SIZE - vErased.size())) {
+                LogPrintf("%s : Failed to erase expired and orphaned messages\n", __func__);
+                break;
+            }
+            for (const auto& out : vErased)
+                pMessagesCache->Erase(out.ToSerializedString());
+        }
+
+        nErased += vErased.size();
+        if (vErased.size() < MESSAGE_GC_BATCH_SIZE)
+            break;
+    }
+
+    if (nErased > 0) {
+        pmessagedb->CompactMessages();
+        LogPrint(BCLog::DB, "%s : Erased %u expired and orphaned messages\n", __func__, nErased);
+    }
+    return nErased;
+}
+
+static void MessageGC()
+{
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+    }
+    CollectMessageGarbage(GetTime(), nHeight - MESSAGE_ORPHAN_KEEP_DEPTH);
+}
+
+void StartMessageGC(CScheduler& scheduler)
+{
+    scheduler.scheduleEvery(MessageGC, MESSAGE_GC_INTERVAL * 1000, CScheduler::PRIORITY_LOW);
+}
+
 size_t GetMessageDirtyCacheSize()
 {
     // COutPoint: 32 bytes
@@ -12,6 +12,7 @@
 
 class CMessage;
 class COutPoint;
+class CScheduler;
 
 // Message Database caches
 extern std::set<COutPoint> setDirtyMessagesRemove;
@@ -48,11 +49,44 @@ void OrphanMessage(const CMessage &message);
 void OrphanMessage(const COutPoint &out);
 
 #ifdef ENABLE_WALLET
+//! Blocks read from disk before the channels found in them are applied and the progress is saved
+static const int MESSAGE_SCAN_BATCH_SIZE = 1000;
+//! Threads reading the blocks of a batch
+static const int MESSAGE_SCAN_MAX_THREADS = 4;
+
+/** Scan the chain for the channels our token outputs subscribe us to, resuming from the last saved batch */
 bool ScanForMessageChannels(std::string& strError);
+/** Run ScanForMessageChannels in the background, marking the channel database initialised when it finishes */
+void ThreadScanForMessageChannels();
 #endif
 bool IsAddressSeen(const std::string &address); // Has this address already been sent an token before
 void AddAddressSeen(const std::string &address);
 
+//! Room for this many keys at least in each of the message key filters
+static const unsigned int MESSAGE_FILTER_MIN_ELEMENTS = 100000;
+static const double MESSAGE_FILTER_FP_RATE = 0.001;
+
+/** Fill the filters in front of IsChannelSubscribed and IsAddressSeen from the channel database */
+bool LoadMessageFilters();
+
+//! Seconds between two passes of the message garbage collector
+static const int64_t MESSAGE_GC_INTERVAL = 10 * 60;
+//! Messages the collector erases per batch, cs_messaging is released between batches
+static const size_t MESSAGE_GC_BATCH_SIZE = 1000;
+//! Orphaned messages are kept until the tip is this many blocks past their block, in case a reorg brings them back
+static const int MESSAGE_ORPHAN_KEEP_DEPTH = 100;
+//! Default for -messagegc
+static const bool DEFAULT_MESSAGE_GC = true;
+
+/**
+ * Erase the messages expired at nTime and the orphaned messages of blocks at or below nOrphanHeight, in batches
+ * of MESSAGE_GC_BATCH_SIZE through the expiry and orphan indexes, and compact the database when any were erased.
+ * Returns how many were erased.
+ */
+size_t CollectMessageGarbage(int64_t nTime, int nOrphanHeight);
+/** Collect the message garbage on the scheduler every MESSAGE_GC_INTERVAL */
+void StartMessageGC(CScheduler& scheduler);
+
 enum class MessageStatus {
     READ = 0,
     UNREAD = 1,
@@ -13,16 +13,111 @@ static const char MESSAGE_FLAG = 'Z'; // Message
 static const char MY_MESSAGE_CHANNEL = 'C'; // My followed Channels
 static const char MY_SEEN_ADDRESSES = 'S'; // Addresses that have been seen on the chain
 static const char DB_FLAG = 'D'; // Database Flags
+static const char MESSAGE_CHANNEL_INDEX = 'I'; // Messages by channel and time
+static const char MESSAGE_EXPIRY_INDEX = 'X'; // Messages by expiry time
+static const char MESSAGE_ORPHAN_INDEX = 'O'; // Orphaned messages by block height
+static const char MY_CHANNEL_SCAN_HEIGHT = 'H'; // Progress of the message channel scan
 
 static const char MY_TAGGED_ADDRESSES = 'T'; // Addresses that have been tagged
 static const char MY_RESTRICTED_ADDRESSES = 'R'; // Addresses that have been restricted
 
-CMessageDB::CMessageDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "messages" / "messages", nCacheSize, fMemory, fWipe) {
+// Times are stored big endian so the keys sort by them; they are clamped to the 32 bits that fits
+static uint32_t MessageIndexTime(int64_t nTime)
+{
+    return (uint32_t)std::max<int64_t>(0, std::min<int64_t>(nTime, std::numeric_limits<uint32_t>::max()));
+}
+
+struct CMessageChannelIndexKey {
+    std::string strName;
+    uint32_t nTime;
+    COutPoint out;
+
+    CMessageChannelIndexKey() : nTime(0) {}
+    CMessageChannelIndexKey(const std::string& strNameIn, int64_t nTimeIn, const COutPoint& outIn) :
+        strName(strNameIn), nTime(MessageIndexTime(nTimeIn)), out(outIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, strName);
+        ser_writedata32be(s, nTime);
+        ::Serialize(s, out);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, strName);
+        nTime = ser_readdata32be(s);
+        ::Unserialize(s, out);
+    }
+};
+
+struct CMessageExpiryIndexKey {
+    uint32_t nExpiredTime;
+    COutPoint out;
+
+    CMessageExpiryIndexKey() : nExpiredTime(0) {}
+    CMessageExpiryIndexKey(int64_t nExpiredTimeIn, const COutPoint& outIn) : nExpiredTime(MessageIndexTime(nExpiredTimeIn)), out(outIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, nExpiredTime);
+        ::Serialize(s, out);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        nExpiredTime = ser_readdata32be(s);
+        ::Unserialize(s, out);
+    }
+};
+
+// The expiry key with the block height in place of the expiry time
+typedef CMessageExpiryIndexKey CMessageOrphanIndexKey;
+
+static void WriteMessageIndexes(CDBBatch& batch, const CMessage& message)
+{
+    batch.Write(std::make_pair(MESSAGE_CHANNEL_INDEX, CMessageChannelIndexKey(message.strName, message.time, message.out)), '1');
+    if (message.nExpiredTime)
+        batch.Write(std::make_pair(MESSAGE_EXPIRY_INDEX, CMessageExpiryIndexKey(message.nExpiredTime, message.out)), '1');
+    if (message.status == MessageStatus::ORPHAN)
+        batch.Write(std::make_pair(MESSAGE_ORPHAN_INDEX, CMessageOrphanIndexKey(message.nBlockHeight, message.out)), '1');
+}
+
+static void EraseMessageIndexes(CDBBatch& batch, const CMessage& message)
+{
+    batch.Erase(std::make_pair(MESSAGE_CHANNEL_INDEX, CMessageChannelIndexKey(message.strName, message.time, message.out)));
+    if (message.nExpiredTime)
+        batch.Erase(std::make_pair(MESSAGE_EXPIRY_INDEX, CMessageExpiryIndexKey(message.nExpiredTime, message.out)));
+    if (message.status == MessageStatus::ORPHAN)
+        batch.Erase(std::make_pair(MESSAGE_ORPHAN_INDEX, CMessageOrphanIndexKey(message.nBlockHeight, message.out)));
+}
+
+CMessageDB::CMessageDB(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv) : CDBWrapper(GetDataDir() / "messages" / "messages", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv) {
+}
+
+void CMessageDB::BatchWriteMessage(CDBBatch& batch, const CMessage& message)
+{
+    // A message orphaned by a reorg comes back with the time of the block it is mined in again
+    CMessage oldMessage;
+    if (ReadMessage(message.out, oldMessage))
+        EraseMessageIndexes(batch, oldMessage);
+    batch.Write(std::make_pair(MESSAGE_FLAG, message.out), message);
+    WriteMessageIndexes(batch, message);
+}
+
+void CMessageDB::BatchEraseMessage(CDBBatch& batch, const COutPoint& out)
+{
+    CMessage message;
+    if (ReadMessage(out, message))
+        EraseMessageIndexes(batch, message);
+    batch.Erase(std::make_pair(MESSAGE_FLAG, out));
 }
 
 bool CMessageDB::WriteMessage(const CMessage &message)
 {
-    return Write(std::make_pair(MESSAGE_FLAG, message.out), message);
+    CDBBatch batch(*this);
+    BatchWriteMessage(batch, message);
+    return WriteBatch(batch);
 }
 
 bool CMessageDB::ReadMessage(const COutPoint &out, CMessage &message)
@@ -32,33 +127,122 @@ bool CMessageDB::ReadMessage(const COutPoint &out, CMessage &message)
 
 bool CMessageDB::EraseMessage(const COutPoint &out)
 {
-    return Erase(std::make_pair(MESSAGE_FLAG, out));
+    CDBBatch batch(*this);
+    BatchEraseMessage(batch, out);
+    return WriteBatch(batch);
 }
 
-bool CMessageDB::LoadMessages(std::set<CMessage>& setMessages)
+bool CMessageDB::LoadChannelMessages(const std::string& strChannel, int64_t nStartTime, int64_t nEndTime, size_t nSkip, size_t nCount, std::vector<CMessage>& vMessages)
 {
+    const uint32_t nStart = MessageIndexTime(nStartTime);
+    const uint32_t nEnd = MessageIndexTime(nEndTime);
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(MESSAGE_CHANNEL_INDEX, CMessageChannelIndexKey(strChannel, nStart, COutPoint())));
 
+    while (pcursor->Valid() && (nCount == 0 || vMessages.size() < nCount)) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CMessageChannelIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != MESSAGE_CHANNEL_INDEX)
+            break;
+        if (!strChannel.empty() && (key.second.strName != strChannel || key.second.nTime > nEnd))
+            break;
+        pcursor->Next();
+
+        // Without a channel every channel is walked, each from its first message
+        if (key.second.nTime < nStart || key.second.nTime > nEnd)
+            continue;
+        if (nSkip > 0) {
+            nSkip--;
+            continue;
+        }
+
+        CMessage message;
+        if (!ReadMessage(key.second.out, message)) {
+            LogPrintf("%s: failed to read message %s\n", __func__, key.second.out.ToString());
+            continue;
+        }
+        vMessages.push_back(message);
+    }
+    return true;
+}
+
+/** Erase the messages of one time ordered index up to nMaxTime, at most nMaxCount unless it is 0 */
+template<typename Key>
+static bool EraseIndexedMessages(CMessageDB& db, char chIndex, uint32_t nMaxTime, std::vector<COutPoint>& vErased, size_t nMaxCount,
+                                 const std::function<void(CDBBatch&, const COutPoint&)>& erase)
+{
+    std::vector<COutPoint> vOuts;
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(chIndex, Key()));
+
+    while (pcursor->Valid() && (nMaxCount == 0 || vOuts.size() < nMaxCount)) {
+        boost::this_thread::interruption_point();
+        std::pair<char, Key> key;
+        if (!pcursor->GetKey(key) || key.first != chIndex || key.second.nExpiredTime > nMaxTime)
+            break;
+        vOuts.push_back(key.second.out);
+        pcursor->Next();
+    }
+
+    CDBBatch batch(db);
+    for (const auto& out : vOuts)
+        erase(batch, out);
+    if (!db.WriteBatch(batch))
+        return error("%s: failed to erase %u messages", __func__, vOuts.size());
+    vErased.insert(vErased.end(), vOuts.begin(), vOuts.end());
+    return true;
+}
+
+bool CMessageDB::EraseExpiredMessages(int64_t nTime, std::vector<COutPoint>& vErased, size_t nMaxCount)
+{
+    return EraseIndexedMessages<CMessageExpiryIndexKey>(*this, MESSAGE_EXPIRY_INDEX, MessageIndexTime(nTime), vErased, nMaxCount,
+        [this](CDBBatch& batch, const COutPoint& out) { BatchEraseMessage(batch, out); });
+}
+
+bool CMessageDB::EraseOrphanedMessages(int nHeight, std::vector<COutPoint>& vErased, size_t nMaxCount)
+{
+    if (nHeight < 0)
+        return true;
+    return EraseIndexedMessages<CMessageOrphanIndexKey>(*this, MESSAGE_ORPHAN_INDEX, MessageIndexTime(nHeight), vErased, nMaxCount,
+        [this](CDBBatch& batch, const COutPoint& out) { BatchEraseMessage(batch, out); });
+}
+
+void CMessageDB::CompactMessages()
+{
+    // The indexes and the messages themselves, from MESSAGE_CHANNEL_INDEX to MESSAGE_FLAG
+    CompactRange(MESSAGE_CHANNEL_INDEX, (char)(MESSAGE_FLAG + 1));
+}
+
+bool CMessageDB::BuildMessageIndexes()
+{
+    // Databases indexed before the orphan index are indexed again, writing an index entry twice is harmless
+    bool fIndexed = false, fOrphansIndexed = false;
+    if (ReadFlag("messageindexes", fIndexed) && fIndexed && ReadFlag("messageorphanindex", fOrphansIndexed) && fOrphansIndexed)
+        return true;
+
+    LogPrintf("%s: Indexing stored messages by channel, expiry and orphan height\n", __func__);
+
+    CDBBatch batch(*this);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
     pcursor->Seek(std::make_pair(MESSAGE_FLAG, COutPoint()));
 
-    // Load messages
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char, COutPoint> key;
-        if (pcursor->GetKey(key) && key.first == MESSAGE_FLAG) {
-            CMessage message;
-            if (pcursor->GetValue(message)) {
-                setMessages.insert(message);
-                pcursor->Next();
-            } else {
-                LogPrintf("%s: failed to read message\n", __func__);
-                pcursor->Next();
-            }
-        } else {
+        if (!pcursor->GetKey(key) || key.first != MESSAGE_FLAG)
             break;
-        }
+        CMessage message;
+        if (pcursor->GetValue(message))
+            WriteMessageIndexes(batch, message);
+        else
+            LogPrintf("%s: failed to read message\n", __func__);
+        pcursor->Next();
     }
-    return true;
+
+    if (!WriteBatch(batch))
+        return error("%s: failed to write message indexes", __func__);
+    return WriteFlag("messageindexes", true) && WriteFlag("messageorphanindex", true);
 }
 
 bool CMessageDB::EraseAllMessages(int& count)
@@ -86,35 +270,38 @@ bool CMessageDB::EraseAllMessages(int& count)
         }
     }
 
+    CDBBatch batch(*this);
+    for (const auto& message : setMessages)
+        BatchEraseMessage(batch, message.out);
+    if (!WriteBatch(batch))
+        return error("%s: failed to erase messages", __func__);
     count += setMessages.size();
-    for (auto message : setMessages)
-        EraseMessage(message.out);
 
     return true;
 }
 
 bool CMessageDB::Flush() {
     try {
+        // Everything dirty goes in one batch, a single write to the database
+        CDBBatch batch(*this);
 
-        for (auto messageRemove : setDirtyMessagesRemove) {
-            if (!EraseMessage(messageRemove))
-                return error("%s: failed to erase message %s", __func__, messageRemove.ToString());
-        }
-
-        for (auto messageAdd : mapDirtyMessagesAdd) {
-            if (!WriteMessage(messageAdd.second))
-                return error("%s: failed to write message %s", __func__, messageAdd.second.ToString());
+        for (const auto& messageRemove : setDirtyMessagesRemove)
+            BatchEraseMessage(batch, messageRemove);
 
+        for (const auto& messageAdd : mapDirtyMessagesAdd) {
+            BatchWriteMessage(batch, messageAdd.second);
             mapDirtyMessagesOrphaned.erase(messageAdd.first);
         }
 
-        for (auto orphans : mapDirtyMessagesOrphaned) {
+        for (const auto& orphans : mapDirtyMessagesOrphaned) {
             CMessage msg = orphans.second;
             msg.status = MessageStatus::ORPHAN;
-            if (!WriteMessage(msg))
-                return error("%s: failed to write message orphan %s", __func__, msg.ToString());
+            BatchWriteMessage(batch, msg);
         }
 
+        if (!WriteBatch(batch))
+            return error("%s: failed to write %u messages", __func__, setDirtyMessagesRemove.size() + mapDirtyMessagesAdd.size() + mapDirtyMessagesOrphaned.size());
+
         setDirtyMessagesRemove.clear();
         mapDirtyMessagesAdd.clear();
         mapDirtyMessagesOrphaned.clear();
@@ -125,7 +312,7 @@ bool CMessageDB::Flush() {
     return true;
 }
 
-CMessageChannelDB::CMessageChannelDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "messages" / "channels", nCacheSize, fMemory, fWipe) {
+CMessageChannelDB::CMessageChannelDB(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv) : CDBWrapper(GetDataDir() / "messages" / "channels", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv) {
 }
 
 bool CMessageChannelDB::WriteMyMessageChannel(const std::string& channelname)
@@ -195,6 +382,37 @@ bool CMessageChannelDB::EraseUsedAddress(const std::string& address)
     return Erase(std::make_pair(MY_SEEN_ADDRESSES, address));
 }
 
+bool CMessageChannelDB::LoadUsedAddresses(std::vector<std::string>& vAddresses)
+{
+    vAddresses.clear();
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(MY_SEEN_ADDRESSES, std::string()));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        if (pcursor->GetKey(key) && key.first == MY_SEEN_ADDRESSES) {
+            vAddresses.push_back(key.second);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CMessageChannelDB::WriteScanHeight(int nHeight)
+{
+    return Write(MY_CHANNEL_SCAN_HEIGHT, nHeight);
+}
+
+bool CMessageChannelDB::ReadScanHeight(int& nHeight)
+{
+    return Read(MY_CHANNEL_SCAN_HEIGHT, nHeight);
+}
+
 bool CMessageChannelDB::WriteFlag(const std::string &name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -213,20 +431,19 @@ bool CMessageChannelDB::Flush() {
     try {
         LogPrintf("%s: Flushing messagechannelsdb addSize:%u, removeSize:%u, seenAddressSize:%u\n", __func__, setDirtyChannelsAdd.size(), setDirtyChannelsRemove.size(), setDirtySeenAddressAdd.size());
 
-        for (auto channelRemove : setDirtyChannelsRemove) {
-            if (!EraseMyMessageChannel(channelRemove))
-                return error("%s: failed to erase messagechannel %s", __func__, channelRemove);
-        }
+        CDBBatch batch(*this);
 
-        for (auto channelAdd : setDirtyChannelsAdd) {
-            if (!WriteMyMessageChannel(channelAdd))
-                return error("%s: failed to write messagechannel %s", __func__, channelAdd);
-        }
+        for (const auto& channelRemove : setDirtyChannelsRemove)
+            batch.Erase(std::make_pair(MY_MESSAGE_CHANNEL, channelRemove));
 
-        for (auto seenAddress : setDirtySeenAddressAdd) {
-            if (!WriteUsedAddress(seenAddress))
-                return error("%s: failed to write seenaddress %s", __func__, seenAddress);
-        }
+        for (const auto& channelAdd : setDirtyChannelsAdd)
+            batch.Write(std::make_pair(MY_MESSAGE_CHANNEL, channelAdd), 1);
+
+        for (const auto& seenAddress : setDirtySeenAddressAdd)
+            batch.Write(std::make_pair(MY_SEEN_ADDRESSES, seenAddress), 1);
+
+        if (!WriteBatch(batch))
+            return error("%s: failed to write message channels and seen addresses", __func__);
 
         setDirtyChannelsRemove.clear();
         setDirtyChannelsAdd.clear();
@@ -241,7 +458,7 @@ bool CMessageChannelDB::Flush() {
 }
 
 
-CMyRestrictedDB::CMyRestrictedDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "myrestricted", nCacheSize, fMemory, fWipe) {
+CMyRestrictedDB::CMyRestrictedDB(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv) : CDBWrapper(GetDataDir() / "myrestricted", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv) {
 }
 
 bool CMyRestrictedDB::WriteTaggedAddress(const std::string& address, const std::string& tag_name, const bool fAdd, const uint32_t& nHeight)
@@ -285,11 +502,63 @@ bool CMyRestrictedDB::LoadMyTaggedAddresses(std::vector<std::tuple<std::string,
     return true;
 }
 
+//! Load the <flag, <address, tag>> entries that follow keyAfter, see LoadMyTaggedAddressesFrom
+static bool LoadMyAddressesFrom(CDBWrapper& db, const char flag, const std::pair<std::string, std::string>& keyAfter, const size_t count,
+                                std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecAddresses, std::pair<std::string, std::string>& keyNext)
+{
+    vecAddresses.clear();
+    keyNext = std::pair<std::string, std::string>();
+    if (count == 0)
+        return true;
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(flag, keyAfter));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::pair<std::string, std::string>> key;
+        if (!pcursor->GetKey(key) || key.first != flag)
+            break;
+
+        // The cursor entry was already returned by the previous page
+        if (keyAfter.first.empty() || key.second != keyAfter) {
+            // There is at least one more entry, hand back a cursor for the next page
+            if (vecAddresses.size() >= count) {
+                keyNext = std::make_pair(std::get<0>(vecAddresses.back()), std::get<1>(vecAddresses.back()));
+                break;
+            }
+            std::pair<int, uint32_t> value;
+            if (pcursor->GetValue(value))
+                vecAddresses.emplace_back(std::make_tuple(key.second.first, key.second.second, value.first ? true : false, value.second));
+        }
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CMyRestrictedDB::LoadMyTaggedAddressesFrom(const std::pair<std::string, std::string>& keyAfter, const size_t count,
+                                                std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecTaggedAddresses, std::pair<std::string, std::string>& keyNext)
+{
+    return LoadMyAddressesFrom(*this, MY_TAGGED_ADDRESSES, keyAfter, count, vecTaggedAddresses, keyNext);
+}
+
 bool CMyRestrictedDB::WriteRestrictedAddress(const std::string& address, const std::string& tag_name, const bool fAdd, const uint32_t& nHeight)
 {
     return Write(std::make_pair(MY_RESTRICTED_ADDRESSES, std::make_pair(address, tag_name)), std::make_pair(fAdd ? 1 : 0, nHeight));
 }
 
+bool CMyRestrictedDB::WriteAddressEntries(const std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecTaggedAddresses,
+                                          const std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecRestrictedAddresses)
+{
+    CDBBatch batch(*this);
+    for (const auto& entry : vecTaggedAddresses)
+        batch.Write(std::make_pair(MY_TAGGED_ADDRESSES, std::make_pair(std::get<0>(entry), std::get<1>(entry))), std::make_pair(std::get<2>(entry) ? 1 : 0, std::get<3>(entry)));
+    for (const auto& entry : vecRestrictedAddresses)
+        batch.Write(std::make_pair(MY_RESTRICTED_ADDRESSES, std::make_pair(std::get<0>(entry), std::get<1>(entry))), std::make_pair(std::get<2>(entry) ? 1 : 0, std::get<3>(entry)));
+    return WriteBatch(batch);
+}
+
 bool CMyRestrictedDB::ReadRestrictedAddress(const std::string& address, const std::string& tag_name, bool& fAdd, uint32_t& nHeight)
 {
     std::pair<int, uint32_t> value;
@@ -329,6 +598,11 @@ bool CMyRestrictedDB::LoadMyRestrictedAddresses(std::vector<std::tuple<std::stri
     return true;
 }
 
+bool CMyRestrictedDB::LoadMyRestrictedAddressesFrom(const std::pair<std::string, std::string>& keyAfter, const size_t count,
+                                                    std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecRestrictedAddresses, std::pair<std::string, std::string>& keyNext)
+{
+    return LoadMyAddressesFrom(*this, MY_RESTRICTED_ADDRESSES, keyAfter, count, vecRestrictedAddresses, keyNext);
+}
 
 bool CMyRestrictedDB::WriteFlag(const std::string &name, bool fValue)
 {
@@ -14,28 +14,44 @@ class COutPoint;
 class CMessageDB  : public CDBWrapper {
 
 public:
-    explicit CMessageDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CMessageDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CMessageDB(const CMessageDB&) = delete;
     CMessageDB& operator=(const CMessageDB&) = delete;
 
-    // Database of messages
+    // Database of messages, indexed by channel and time, by expiry time and orphaned ones by block height
     bool WriteMessage(const CMessage& message);
     bool ReadMessage(const COutPoint& out, CMessage& message);
     bool EraseMessage(const COutPoint& out);
-    bool LoadMessages(std::set<CMessage>& setMessages);
     bool EraseAllMessages(int& count);
 
+    // Messages of strChannel (all channels if empty) sent between nStartTime and nEndTime, by channel and then time.
+    // The first nSkip are left out, and at most nCount are returned unless nCount is 0
+    bool LoadChannelMessages(const std::string& strChannel, int64_t nStartTime, int64_t nEndTime, size_t nSkip, size_t nCount, std::vector<CMessage>& vMessages);
+    // Erase the messages that expired at or before nTime, oldest first and at most nMaxCount unless it is 0.
+    // The outpoints erased are added to vErased
+    bool EraseExpiredMessages(int64_t nTime, std::vector<COutPoint>& vErased, size_t nMaxCount = 0);
+    // Erase the orphaned messages of blocks at or below nHeight, like EraseExpiredMessages
+    bool EraseOrphanedMessages(int nHeight, std::vector<COutPoint>& vErased, size_t nMaxCount = 0);
+    // Compact the messages and their indexes, after a lot of them were erased
+    void CompactMessages();
+    // Index the messages written before the indexes existed
+    bool BuildMessageIndexes();
+
     // Write / Read Database flags
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
 
     bool Flush();
+
+private:
+    void BatchWriteMessage(CDBBatch& batch, const CMessage& message);
+    void BatchEraseMessage(CDBBatch& batch, const COutPoint& out);
 };
 
 class CMessageChannelDB  : public CDBWrapper {
 public:
-    explicit CMessageChannelDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CMessageChannelDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CMessageChannelDB(const CMessageChannelDB&) = delete;
     CMessageChannelDB& operator=(const CMessageChannelDB&) = delete;
@@ -49,6 +65,11 @@ public:
     bool WriteUsedAddress(const std::string& address);
     bool ReadUsedAddress(const std::string& address);
     bool EraseUsedAddress(const std::string& address);
+    bool LoadUsedAddresses(std::vector<std::string>& vAddresses);
+
+    // Last height ScanForMessageChannels applied
+    bool WriteScanHeight(int nHeight);
+    bool ReadScanHeight(int& nHeight);
 
     // Write / Read Database flags
     bool WriteFlag(const std::string &name, bool fValue);
@@ -59,7 +80,7 @@ public:
 
 class CMyRestrictedDB : public CDBWrapper {
 public:
-    explicit CMyRestrictedDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CMyRestrictedDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CMyRestrictedDB(const CMyRestrictedDB&) = delete;
     CMyRestrictedDB& operator=(const CMyRestrictedDB&) = delete;
@@ -68,11 +89,21 @@ public:
     bool ReadTaggedAddress(const std::string& address, const std::string& tag_name, bool& fAdd, uint32_t& nHeight);
     bool EraseTaggedAddress(const std::string& address, const std::string& tag_name);
     bool LoadMyTaggedAddresses(std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecTaggedAddresses);
+    //! Load up to count entries after the <address, tag> key keyAfter (empty for the first page), and the key to continue from in keyNext (empty after the last page)
+    bool LoadMyTaggedAddressesFrom(const std::pair<std::string, std::string>& keyAfter, const size_t count,
+                                   std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecTaggedAddresses, std::pair<std::string, std::string>& keyNext);
 
     bool WriteRestrictedAddress(const std::string& address, const std::string& tag_name, const bool fAdd, const uint32_t& nHeight);
     bool ReadRestrictedAddress(const std::string& address, const std::string& tag_name, bool& fAdd, uint32_t& nHeight);
     bool EraseRestrictedAddress(const std::string& address, const std::string& tag_name);
     bool LoadMyRestrictedAddresses(std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecRestrictedAddresses);
+    //! See LoadMyTaggedAddressesFrom
+    bool LoadMyRestrictedAddressesFrom(const std::pair<std::string, std::string>& keyAfter, const size_t count,
+                                       std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecRestrictedAddresses, std::pair<std::string, std::string>& keyNext);
+
+    //! Write the tagged and restricted address entries of a block in one batch, as <address, tag or token, fAdd, time>
+    bool WriteAddressEntries(const std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecTaggedAddresses,
+                             const std::vector<std::tuple<std::string, std::string, bool, uint32_t> >& vecRestrictedAddresses);
 
     // Write / Read Database flags
     bool WriteFlag(const std::string &name, bool fValue);
@@ -5,6 +5,7 @@
 
 #include "restricteddb.h"
 #include "validation.h"
+#include "tokendb.h"
 
 #include <boost/thread.hpp>
 
@@ -14,10 +15,13 @@ static const char ADDRESS_QULAIFIER_FLAG = 'T';
 static const char QULAIFIER_ADDRESS_FLAG = 'Q';
 static const char RESTRICTED_ADDRESS_FLAG = 'R';
 static const char GLOBAL_RESTRICTION_FLAG = 'G';
+static const char SUB_QUALIFIER_FLAG = 'H';
 
+static const size_t MAX_DATABASE_RESULTS = 50000;
 
 
-CRestrictedDB::CRestrictedDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "tokens" / "restricted", nCacheSize, fMemory, fWipe) {
+
+CRestrictedDB::CRestrictedDB(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv) : CDBWrapper(GetDataDir() / "tokens" / "restricted", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv) {
 }
 
 // Restricted Verifier Strings
@@ -36,11 +40,36 @@ bool CRestrictedDB::EraseVerifier(const std::string& tokenName)
     return Erase(std::make_pair(VERIFIER_FLAG, tokenName));
 }
 
+// Sub qualifier index, an entry <Root, Address, Tag> for every qualifier a tag starts with followed by '/'
+static void IndexSubQualifier(CDBBatch& batch, const std::string &address, const std::string &tag, bool fHeld)
+{
+    for (size_t slash = tag.find('/'); slash != std::string::npos; slash = tag.find('/', slash + 1)) {
+        auto key = std::make_pair(SUB_QUALIFIER_FLAG, std::make_pair(tag.substr(0, slash), std::make_pair(address, tag)));
+        if (fHeld)
+            batch.Write(key, int8_t(1));
+        else
+            batch.Erase(key);
+    }
+}
+
+// Whether the address holds a tag under root, the cursor is positioned on the first one
+static bool SeekSubQualifier(CDBIterator& cursor, const std::string &address, const std::string &root)
+{
+    cursor.Seek(std::make_pair(SUB_QUALIFIER_FLAG, std::make_pair(root, std::make_pair(address, std::string()))));
+    std::pair<char, std::pair<std::string, std::pair<std::string, std::string> > > key;
+    return cursor.Valid() && cursor.GetKey(key) && key.first == SUB_QUALIFIER_FLAG && key.second.first == root &&
+           key.second.second.first == address;
+}
+
 // Address Tags
 bool CRestrictedDB::WriteAddressQualifier(const std::string &address, const std::string &tag)
 {
+    // The tag and its index entries go in one batch, so they are never out of step
+    CDBBatch batch(*this);
     int8_t i = 1;
-    return Write(std::make_pair(ADDRESS_QULAIFIER_FLAG, std::make_pair(address, tag)), i);
+    batch.Write(std::make_pair(ADDRESS_QULAIFIER_FLAG, std::make_pair(address, tag)), i);
+    IndexSubQualifier(batch, address, tag, true);
+    return WriteBatch(batch);
 }
 
 bool CRestrictedDB::ReadAddressQualifier(const std::string &address, const std::string &tag)
@@ -51,7 +80,53 @@ bool CRestrictedDB::ReadAddressQualifier(const std::string &address, const std::
 
 bool CRestrictedDB::EraseAddressQualifier(const std::string &address, const std::string &tag)
 {
-    return Erase(std::make_pair(ADDRESS_QULAIFIER_FLAG, std::make_pair(address, tag)));
+    CDBBatch batch(*this);
+    batch.Erase(std::make_pair(ADDRESS_QULAIFIER_FLAG, std::make_pair(address, tag)));
+    IndexSubQualifier(batch, address, tag, false);
+    return WriteBatch(batch);
+}
+
+bool CRestrictedDB::HasSubQualifier(const std::string &address, const std::string &root)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator(CDBIteratorOptions::Lookup()));
+    return SeekSubQualifier(*pcursor, address, root);
+}
+
+bool CRestrictedDB::BuildRootQualifierIndex()
+{
+    bool fIndexed = false;
+    if (ReadFlag("subqualifierindex", fIndexed) && fIndexed)
+        return true;
+
+    LogPrintf("%s: Indexing address qualifiers by root qualifier\n", __func__);
+
+    // Whatever is under the index flag is dropped first, the index is rebuilt from the address tags alone
+    CDBBatch batch(*this);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(SUB_QUALIFIER_FLAG);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        if (!pcursor->GetKey(key) || key.first != SUB_QUALIFIER_FLAG)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    pcursor->Seek(std::make_pair(ADDRESS_QULAIFIER_FLAG, std::make_pair(std::string(), std::string())));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::pair<std::string, std::string> > key;
+        if (!pcursor->GetKey(key) || key.first != ADDRESS_QULAIFIER_FLAG)
+            break;
+        IndexSubQualifier(batch, key.second.first, key.second.second, true);
+        pcursor->Next();
+    }
+
+    batch.Write(std::make_pair(DB_FLAG, std::string("subqualifierindex")), '1');
+    if (!WriteBatch(batch))
+        return error("%s: failed to write the root qualifier index", __func__);
+    return true;
 }
 
 // Address Tags
@@ -148,25 +223,61 @@ bool CRestrictedDB::GetQualifierAddresses(std::string& qualifier, std::vector<st
 
 bool CRestrictedDB::CheckForAddressRootQualifier(const std::string& address, const std::string& qualifier)
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(std::make_pair(ADDRESS_QULAIFIER_FLAG, std::make_pair(address, qualifier)));
+    return ReadAddressQualifier(address, qualifier) || HasSubQualifier(address, qualifier);
+}
 
-    // Load all qualifiers related to that given address
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, std::pair<std::string, std::string> > key;
-        if (pcursor->GetKey(key) && key.first == ADDRESS_QULAIFIER_FLAG && key.second.first == address) {
-            if (key.second.second == qualifier || key.second.second.rfind(std::string(qualifier + "/"), 0) == 0) {
-                return true;
+bool CRestrictedDB::ReadAddressQualifiers(const std::set<std::pair<std::string, std::string>>& setLookups,
+                                          std::set<std::pair<std::string, std::string>>& setExact,
+                                          std::set<std::pair<std::string, std::string>>& setHeld)
+{
+    // The address tags are keyed <Address, Qualifier>, so visit the lookups in the order they are laid out in the database
+    std::map<std::string, std::set<std::string, CDBKeyOrder>, CDBKeyOrder> mapAddressLookups;
+    for (const auto& lookup : setLookups)
+        mapAddressLookups[lookup.first].insert(lookup.second);
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator(CDBIteratorOptions::Lookup()));
+    for (const auto& addressLookups : mapAddressLookups) {
+        const std::string& address = addressLookups.first;
+        for (const auto& qualifier : addressLookups.second) {
+            if (ReadAddressQualifier(address, qualifier)) {
+                setExact.insert(std::make_pair(address, qualifier));
+                setHeld.insert(std::make_pair(address, qualifier));
+            } else if (SeekSubQualifier(*pcursor, address, qualifier)) {
+                setHeld.insert(std::make_pair(address, qualifier));
             }
-            pcursor->Next();
-        } else {
-            break;
         }
     }
 
-    return false;
+    return true;
+}
+
+bool CRestrictedDB::ReadRestrictedAddresses(const std::set<std::pair<std::string, std::string>>& setLookups,
+                                            std::set<std::pair<std::string, std::string>>& setFrozen)
+{
+    // The keys are <Address, Restricted token>, so visit the addresses in the order they are laid out in the database
+    std::map<std::string, std::set<std::string, CDBKeyOrder>, CDBKeyOrder> mapAddressLookups;
+    for (const auto& lookup : setLookups)
+        mapAddressLookups[lookup.second].insert(lookup.first);
+
+    for (const auto& addressLookups : mapAddressLookups) {
+        for (const auto& tokenName : addressLookups.second) {
+            if (ReadRestrictedAddress(addressLookups.first, tokenName))
+                setFrozen.insert(std::make_pair(tokenName, addressLookups.first));
+        }
+    }
+
+    return true;
+}
+
+bool CRestrictedDB::ReadGlobalRestrictions(const std::set<std::string>& setLookups, std::set<std::string>& setGlobalFrozen)
+{
+    std::set<std::string, CDBKeyOrder> setOrdered(setLookups.begin(), setLookups.end());
+    for (const auto& tokenName : setOrdered) {
+        if (ReadGlobalRestriction(tokenName))
+            setGlobalFrozen.insert(tokenName);
+    }
+
+    return true;
 }
 
 bool CRestrictedDB::GetAddressQualifiers(std::string& address, std::vector<std::string>& qualifiers)
@@ -215,6 +326,56 @@ bool CRestrictedDB::GetAddressRestrictions(std::string& address, std::vector<std
     return true;
 }
 
+//! Load the second halves of the <flag, <strPrefix, key>> keys that follow strAfter, see GetQualifierAddressesFrom
+static bool ListFrom(CDBWrapper& db, const char flag, const std::string& strPrefix, const std::string& strAfter, const size_t count,
+                     std::vector<std::string>& vecResult, std::string& strNext)
+{
+    strNext.clear();
+    if (count == 0)
+        return true;
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(flag, std::make_pair(strPrefix, strAfter)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::pair<std::string, std::string> > key;
+        if (!pcursor->GetKey(key) || key.first != flag || key.second.first != strPrefix)
+            break;
+
+        // The cursor entry was already returned by the previous page
+        if (strAfter.empty() || key.second.second != strAfter) {
+            // There is at least one more entry, hand back a cursor for the next page
+            if (vecResult.size() >= count || vecResult.size() >= MAX_DATABASE_RESULTS) {
+                strNext = vecResult.back();
+                break;
+            }
+            vecResult.emplace_back(key.second.second);
+        }
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CRestrictedDB::GetQualifierAddressesFrom(const std::string& qualifier, const std::string& strAfter, const size_t count, std::vector<std::string>& addresses, std::string& strNext)
+{
+    FlushStateToDisk();
+    return ListFrom(*this, QULAIFIER_ADDRESS_FLAG, qualifier, strAfter, count, addresses, strNext);
+}
+
+bool CRestrictedDB::GetAddressQualifiersFrom(const std::string& address, const std::string& strAfter, const size_t count, std::vector<std::string>& qualifiers, std::string& strNext)
+{
+    FlushStateToDisk();
+    return ListFrom(*this, ADDRESS_QULAIFIER_FLAG, address, strAfter, count, qualifiers, strNext);
+}
+
+bool CRestrictedDB::GetAddressRestrictionsFrom(const std::string& address, const std::string& strAfter, const size_t count, std::vector<std::string>& restrictions, std::string& strNext)
+{
+    FlushStateToDisk();
+    return ListFrom(*this, RESTRICTED_ADDRESS_FLAG, address, strAfter, count, restrictions, strNext);
+}
+
 bool CRestrictedDB::GetGlobalRestrictions(std::vector<std::string>& restrictions)
 {
     FlushStateToDisk();
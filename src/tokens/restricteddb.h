@@ -9,10 +9,12 @@
 
 #include <dbwrapper.h>
 
+#include <set>
+
 class CRestrictedDB  : public CDBWrapper {
 
 public:
-    explicit CRestrictedDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CRestrictedDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CRestrictedDB(const CRestrictedDB&) = delete;
     CRestrictedDB& operator=(const CRestrictedDB&) = delete;
@@ -27,6 +29,12 @@ public:
     bool ReadAddressQualifier(const std::string &address, const std::string &tag);
     bool EraseAddressQualifier(const std::string &address, const std::string &tag);
 
+    // Whether the address holds a tag starting with root followed by '/', from an index written in the same batch as
+    // the address tags above so a root qualifier check is a single seek
+    bool HasSubQualifier(const std::string &address, const std::string &root);
+    // Index the address tags written before the root qualifier index existed
+    bool BuildRootQualifierIndex();
+
     // Database of the Qualifier to the address that are assigned to them
     bool WriteQualifierAddress(const std::string &address, const std::string &tag);
     bool ReadQualifierAddress(const std::string &address, const std::string &tag);
@@ -51,9 +59,29 @@ public:
     bool GetAddressRestrictions(std::string& address, std::vector<std::string>& restrictions);
     bool GetGlobalRestrictions(std::vector<std::string>& restrictions);
 
+    /** Paged variants of the listings above. Seek directly past strAfter, the last entry of the previous page (an
+     *  empty strAfter starts at the beginning), and load at most count entries (and never more than 50000). strNext
+     *  is set to the cursor for the following page, or cleared when there are no more entries. */
+    bool GetQualifierAddressesFrom(const std::string& qualifier, const std::string& strAfter, const size_t count, std::vector<std::string>& addresses, std::string& strNext);
+    bool GetAddressQualifiersFrom(const std::string& address, const std::string& strAfter, const size_t count, std::vector<std::string>& qualifiers, std::string& strNext);
+    bool GetAddressRestrictionsFrom(const std::string& address, const std::string& strAfter, const size_t count, std::vector<std::string>& restrictions, std::string& strNext);
+
     bool CheckForAddressRootQualifier(const std::string& address, const std::string& qualifier);
 
+    // Resolve many <Address, Qualifier> lookups, in database key order. Adds the lookups the address holds exactly to setExact, and those it holds exactly or through a sub qualifier
+    // (what CheckForAddressRootQualifier checks) to setHeld
+    bool ReadAddressQualifiers(const std::set<std::pair<std::string, std::string>>& setLookups,
+                               std::set<std::pair<std::string, std::string>>& setExact,
+                               std::set<std::pair<std::string, std::string>>& setHeld);
+
+    // Read many address and global restrictions in database key order. Adds the <Restricted token, Address> lookups
+    // that are frozen to setFrozen, and the restricted tokens that are globally frozen to setGlobalFrozen
+    bool ReadRestrictedAddresses(const std::set<std::pair<std::string, std::string>>& setLookups,
+                                 std::set<std::pair<std::string, std::string>>& setFrozen);
+    bool ReadGlobalRestrictions(const std::set<std::string>& setLookups, std::set<std::string>& setGlobalFrozen);
+
     bool Flush();
+
 };
 
 
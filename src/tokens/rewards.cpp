@@ -19,6 +19,12 @@
 #include "tokens/rewards.h"
 #include "tokensnapshotdb.h"
 #include "wallet/wallet.h"
+#include "wallet/fees.h"
+#include "script/sign.h"
+
+#include <atomic>
+#include <queue>
+#include <thread>
 
 std::map<uint256, CRewardSnapshot> mapRewardSnapshots;
 
@@ -42,6 +48,113 @@ bool AddDistributeRewardSnapshot(CRewardSnapshot& p_rewardSnapshot)
     return true;
 }
 
+//  Powers of ten up to the number of decimal places of the smallest unit of a token
+static const CAmount POWERS_OF_TEN[MAX_UNIT + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+//  Compute floor(a * b / c) and (a * b) mod c without overflowing, for a <= c and b, c < 2^63
+static uint64_t MulDivRem(uint64_t a, uint64_t b, uint64_t c, uint64_t& rem)
+{
+    //  Full 128 bit product as hi:lo, from 32 bit halves
+    uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32, bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+    uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFF) + (hl & 0xFFFFFFFF);
+    uint64_t lo = (ll & 0xFFFFFFFF) | (mid << 32);
+    uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+    //  Long division, the quotient is known to fit in 64 bits because a <= c
+    uint64_t q = 0;
+    rem = 0;
+    for (int i = 127; i >= 0; i--) {
+        rem = (rem << 1) | (((i >= 64 ? hi >> (i - 64) : lo >> i)) & 1);
+        if (rem >= c) {
+            rem -= c;
+            if (i < 64)
+                q |= uint64_t(1) << i;
+        }
+    }
+    return q;
+}
+
+bool ComputeDistributionShares(const OwnerWalker& p_walkOwners, CAmount p_nPaymentUnits, CAmount p_nUnitScale,
+        std::vector<OwnerAndAmount>& vecDistributionList)
+{
+    vecDistributionList.clear();
+    if (p_nPaymentUnits < 0 || p_nUnitScale <= 0)
+        return false;
+
+    //  First pass: total amount owned by the payable owners
+    CAmount nTotalOwned = 0;
+    size_t nOwners = 0;
+    if (!p_walkOwners([&](const std::string& address, const CAmount& amount) {
+            if (amount <= 0)
+                return true;
+            nTotalOwned += amount;
+            nOwners++;
+            return MoneyRange(nTotalOwned);
+        }))
+        return false;
+
+    if (nOwners == 0)
+        return false;
+
+    //  Second pass: how many units are left over once every share is rounded down
+    CAmount nFlooredUnits = 0;
+    if (!p_walkOwners([&](const std::string& address, const CAmount& amount) {
+            uint64_t rem;
+            if (amount > 0)
+                nFlooredUnits += MulDivRem(amount, p_nPaymentUnits, nTotalOwned, rem);
+            return true;
+        }))
+        return false;
+    size_t nLeftoverUnits = p_nPaymentUnits - nFlooredUnits;
+
+    //  Third pass: write out the shares, keeping the owners that are owed the leftover units. These are the owners
+    //  with the largest remainders, ties going to the lowest address, so the result only depends on the snapshot.
+    struct LeftoverCandidate {
+        uint64_t rem;
+        std::string address;
+        int64_t nIndex;
+    };
+    auto fBetter = [](const LeftoverCandidate& a, const LeftoverCandidate& b) {
+        return a.rem != b.rem ? a.rem > b.rem : a.address < b.address;
+    };
+    std::priority_queue<LeftoverCandidate, std::vector<LeftoverCandidate>, decltype(fBetter)> heapLeftover(fBetter);
+
+    vecDistributionList.reserve(nOwners);
+    if (!p_walkOwners([&](const std::string& address, const CAmount& amount) {
+            if (amount <= 0)
+                return true;
+            uint64_t rem;
+            CAmount nUnits = MulDivRem(amount, p_nPaymentUnits, nTotalOwned, rem);
+            int64_t nIndex = -1;
+            if (nUnits > 0) {
+                nIndex = vecDistributionList.size();
+                vecDistributionList.emplace_back(address, nUnits * p_nUnitScale);
+            }
+            if (nLeftoverUnits > 0) {
+                LeftoverCandidate candidate = {rem, address, nIndex};
+                if (heapLeftover.size() < nLeftoverUnits) {
+                    heapLeftover.push(candidate);
+                } else if (fBetter(candidate, heapLeftover.top())) {
+                    heapLeftover.pop();
+                    heapLeftover.push(candidate);
+                }
+            }
+            return true;
+        }))
+        return false;
+
+    for (; !heapLeftover.empty(); heapLeftover.pop()) {
+        const LeftoverCandidate& candidate = heapLeftover.top();
+        if (candidate.nIndex >= 0)
+            vecDistributionList[candidate.nIndex].amount += p_nUnitScale;
+        else
+            vecDistributionList.emplace_back(candidate.address, p_nUnitScale);
+    }
+
+    return true;
+}
+
 bool GenerateDistributionList(const CRewardSnapshot& p_rewardSnapshot, std::vector<OwnerAndAmount>& vecDistributionList)
 {
     vecDistributionList.clear();
@@ -59,125 +172,304 @@ bool GenerateDistributionList(const CRewardSnapshot& p_rewardSnapshot, std::vect
         return false;
     }
 
-    //  Get details on the specified source token
-    CNewToken distributionToken;
-    UNUSED_VAR bool srcIsIndivisible = false;
-    CAmount srcUnitDivisor = COIN;  //  Default to divisor for PLB
-    const int8_t COIN_DIGITS_PAST_DECIMAL = 8;
-
-    //  This value is in indivisible units of the source token
-    CAmount modifiedPaymentInTokenUnits = p_rewardSnapshot.nDistributionAmount;
-
+    //  Get details on the specified source token, PLB has the same number of units as the most divisible token
+    int nDistributionUnits = MAX_UNIT;
     if (p_rewardSnapshot.strDistributionToken != "PLB") {
+        CNewToken distributionToken;
         if (!ptokens->GetTokenMetaDataIfExists(p_rewardSnapshot.strDistributionToken, distributionToken)) {
             LogPrint(BCLog::REWARDS, "%s: Failed to retrieve token details for '%s'\n", __func__, p_rewardSnapshot.strDistributionToken.c_str());
             return false;
         }
-
-        //  If the token is indivisible, signal this to later code with a zero divisor
-        if (distributionToken.units == 0) {
-            srcIsIndivisible = true;
-        }
-
-        srcUnitDivisor = static_cast<CAmount>(pow(10, distributionToken.units));
-
-        CAmount srcDivisor = pow(10, COIN_DIGITS_PAST_DECIMAL - distributionToken.units);
-        modifiedPaymentInTokenUnits /= srcDivisor;
-
-        LogPrint(BCLog::REWARDS, "%s: Distribution token '%s' has units %d and divisor %d\n", __func__,
-                 p_rewardSnapshot.strDistributionToken.c_str(), distributionToken.units, srcUnitDivisor);
+        nDistributionUnits = distributionToken.units;
     }
-    else {
-        LogPrint(BCLog::REWARDS, "%s: Distribution is PLB with divisor %d\n", __func__, srcUnitDivisor);
+    if (nDistributionUnits < 0 || nDistributionUnits > MAX_UNIT) {
+        LogPrint(BCLog::REWARDS, "%s: Distribution token '%s' has invalid units %d\n", __func__, p_rewardSnapshot.strDistributionToken.c_str(), nDistributionUnits);
+        return false;
     }
 
-    LogPrint(BCLog::REWARDS, "%s: Scaled payment amount in %s is %d\n", __func__,
-             p_rewardSnapshot.strDistributionToken.c_str(), modifiedPaymentInTokenUnits);
+    //  Rewards are paid in whole units of the distribution token, each worth this many satoshis
+    CAmount nUnitScale = POWERS_OF_TEN[MAX_UNIT - nDistributionUnits];
+    CAmount nPaymentUnits = p_rewardSnapshot.nDistributionAmount / nUnitScale;
 
-    //  Get details on the ownership token
+    LogPrint(BCLog::REWARDS, "%s: Distribution token '%s' has units %d, paying %d units of %d\n", __func__,
+             p_rewardSnapshot.strDistributionToken.c_str(), nDistributionUnits, nPaymentUnits, nUnitScale);
+
+    //  Make sure the ownership token exists
     CNewToken ownershipToken;
-    CAmount tgtUnitDivisor = 0;
     if (!ptokens->GetTokenMetaDataIfExists(p_rewardSnapshot.strOwnershipToken, ownershipToken)) {
         LogPrint(BCLog::REWARDS, "%s: Failed to retrieve token details for '%s'\n", __func__, p_rewardSnapshot.strOwnershipToken.c_str());
         return false;
     }
 
-    //  Save the ownership token's divisor
-    tgtUnitDivisor = static_cast<CAmount>(pow(10, COIN_DIGITS_PAST_DECIMAL - ownershipToken.units));
-
-    LogPrint(BCLog::REWARDS, "%s: Ownership token '%s' has units %d and divisor %d\n", __func__,
-             p_rewardSnapshot.strOwnershipToken.c_str(), ownershipToken.units, tgtUnitDivisor);
-
-    //  Remove exception addresses & amounts from the list
+    //  Exception and burn addresses are left out of the distribution
     std::set<std::string> exceptionAddressSet;
     boost::split(exceptionAddressSet, p_rewardSnapshot.strExceptionAddresses, boost::is_any_of(ADDRESS_COMMA_DELIMITER));
 
-    std::set<OwnerAndAmount> nonExceptionOwnerships;
-    CAmount totalAmtOwned = 0;
-
-    CTokenSnapshotDBEntry snapshotEntry;
-    if (!pTokenSnapshotDb->RetrieveOwnershipSnapshot(p_rewardSnapshot.strOwnershipToken, p_rewardSnapshot.nHeight, snapshotEntry)) {
-        LogPrint(BCLog::REWARDS, "%s: Failed to retrieve ownership snapshot list!\n", __func__);
+    bool fSnapshotMissing = false;
+    OwnerWalker walkOwners = [&](const std::function<bool(const std::string&, const CAmount&)>& visitor) {
+        bool fWalked = pTokenSnapshotDb->WalkOwnershipSnapshot(p_rewardSnapshot.strOwnershipToken, p_rewardSnapshot.nHeight,
+                [&](const std::string& address, const CAmount& amount) {
+                    if (exceptionAddressSet.count(address) || GetParams().IsFeeAddress(address))
+                        return true;
+                    return visitor(address, amount);
+                });
+        fSnapshotMissing |= !fWalked;
+        return fWalked;
+    };
+
+    if (!ComputeDistributionShares(walkOwners, nPaymentUnits, nUnitScale, vecDistributionList)) {
+        if (fSnapshotMissing)
+            LogPrint(BCLog::REWARDS, "%s: Failed to retrieve ownership snapshot list!\n", __func__);
+        else
+            LogPrint(BCLog::REWARDS, "%s: Ownership of '%s' includes only exception/burn addresses.\n", __func__,
+                     p_rewardSnapshot.strOwnershipToken.c_str());
+        vecDistributionList.clear();
         return false;
     }
 
-    for (auto const & currPair : snapshotEntry.ownersAndAmounts) {
-        //  Ignore exception and burn addresses
-        if (
-                exceptionAddressSet.find(currPair.first) == exceptionAddressSet.end()
-                && !GetParams().IsFeeAddress(currPair.first)
-                ) {
-            //  Address is valid so add it to the payment list
-            nonExceptionOwnerships.insert(OwnerAndAmount(currPair.first, currPair.second));
-            totalAmtOwned += currPair.second;
-        }
+    LogPrint(BCLog::REWARDS, "%s: Distributing %d units of '%s' to %u owners of '%s'\n", __func__,
+             nPaymentUnits, p_rewardSnapshot.strDistributionToken.c_str(), vecDistributionList.size(),
+             p_rewardSnapshot.strOwnershipToken.c_str());
+
+    return true;
+}
+
+#ifdef ENABLE_WALLET
+
+//  A distribution batch whose inputs were reserved up front, so it can be signed independently of the other batches
+struct CDistributionBatch
+{
+    int nBatch;
+    int nStart;
+    CCoinControl ctrl;
+    CWalletTx wtx;
+    std::shared_ptr<CReserveKey> reserveKey;
+    std::vector<CTxOut> vPrevOuts;
+    bool fSigned;
+
+    CDistributionBatch(int p_nBatch, int p_nStart) : nBatch(p_nBatch), nStart(p_nStart), fSigned(false) {}
+};
+
+//  Rough upper bound of the fee a batch pays, used to size the PLB inputs reserved for it
+static CAmount EstimateBatchFee(const CCoinControl& ctrl, int nOutputs, int nInputs, bool fToken)
+{
+    unsigned int nBytes = 10 + 148 * nInputs + (fToken ? 80 : 34) * (nOutputs + 2);
+    return GetMinimumFee(nBytes, ctrl, ::mempool, ::feeEstimator, nullptr);
+}
+
+/**
+ * Split the wallet's confirmed coins into disjoint input sets, one per pending batch, in batch order. Stops at the
+ * first batch that can't be covered by the coins left over; that batch and any after it are built the old way.
+ */
+static void ReserveDistributionInputs(CWallet * const p_wallet, const CRewardSnapshot& p_rewardSnapshot,
+        const std::vector<OwnerAndAmount>& p_payments, std::vector<CDistributionBatch>& vBatches)
+{
+    bool fToken = p_rewardSnapshot.strDistributionToken != "PLB";
+
+    std::vector<COutput> vCoins;
+    std::map<std::string, std::vector<COutput> > mapTokenCoins;
+    {
+        LOCK2(cs_main, p_wallet->cs_wallet);
+        if (fToken)
+            p_wallet->AvailableCoinsWithTokens(vCoins, mapTokenCoins, true, nullptr);
+        else
+            p_wallet->AvailableCoins(vCoins, true, nullptr);
     }
 
-    //  Make sure we have some addresses to pay to
-    if (nonExceptionOwnerships.size() == 0) {
-        LogPrint(BCLog::REWARDS, "%s: Ownership of '%s' includes only exception/burn addresses.\n", __func__,
-                 p_rewardSnapshot.strOwnershipToken.c_str());
-        return false;
+    //  Hand out the largest coins first so that each batch needs as few inputs as possible
+    auto fFilterAndSort = [](std::vector<std::pair<CAmount, COutPoint> >& vOut, const std::vector<COutput>& vIn, bool fTokenCoins) {
+        for (const auto& out : vIn) {
+            if (!out.fSpendable || out.nDepth < 1)
+                continue;
+            CAmount nValue = out.tx->tx->vout[out.i].nValue;
+            if (fTokenCoins) {
+                std::string strName;
+                uint32_t nTokenLockTime;
+                if (!GetTokenInfoFromScript(out.tx->tx->vout[out.i].scriptPubKey, strName, nValue, nTokenLockTime))
+                    continue;
+            }
+            vOut.emplace_back(nValue, COutPoint(out.tx->GetHash(), out.i));
+        }
+        std::sort(vOut.begin(), vOut.end(), [](const std::pair<CAmount, COutPoint>& a, const std::pair<CAmount, COutPoint>& b) {
+            return a.first > b.first;
+        });
+    };
+
+    std::vector<std::pair<CAmount, COutPoint> > vPLBCoins, vTokenCoins;
+    fFilterAndSort(vPLBCoins, vCoins, false);
+    if (fToken)
+        fFilterAndSort(vTokenCoins, mapTokenCoins[p_rewardSnapshot.strDistributionToken], true);
+
+    size_t nNextPLB = 0, nNextToken = 0;
+    for (size_t b = 0; b < vBatches.size(); b++) {
+        CDistributionBatch& batch = vBatches[b];
+        int nStop = std::min(batch.nStart + MAX_PAYMENTS_PER_TRANSACTION, (int)p_payments.size());
+
+        CAmount nPayment = 0;
+        for (int i = batch.nStart; i < nStop; i++)
+            nPayment += p_payments[i].amount;
+
+        CCoinControl ctrl;
+        ctrl.fAllowOtherInputs = false;
+        size_t nPLB = nNextPLB, nTokenNext = nNextToken;
+        int nInputs = 0;
+
+        if (fToken) {
+            CAmount nTokenIn = 0;
+            while (nTokenIn < nPayment && nTokenNext < vTokenCoins.size()) {
+                nTokenIn += vTokenCoins[nTokenNext].first;
+                ctrl.SelectToken(vTokenCoins[nTokenNext].second);
+                nTokenNext++;
+                nInputs++;
+            }
+            if (nTokenIn < nPayment) {
+                vBatches.erase(vBatches.begin() + b, vBatches.end());
+                break;
+            }
+            nPayment = 0;
+        }
+
+        CAmount nPLBIn = 0;
+        while (nPLBIn < nPayment + EstimateBatchFee(ctrl, nStop - batch.nStart, nInputs, fToken) && nPLB < vPLBCoins.size()) {
+            nPLBIn += vPLBCoins[nPLB].first;
+            ctrl.Select(vPLBCoins[nPLB].second);
+            nPLB++;
+            nInputs++;
+        }
+        if (nPLBIn < nPayment + EstimateBatchFee(ctrl, nStop - batch.nStart, nInputs, fToken)) {
+            vBatches.erase(vBatches.begin() + b, vBatches.end());
+            break;
+        }
+
+        batch.ctrl = ctrl;
+        nNextPLB = nPLB;
+        nNextToken = nTokenNext;
     }
+}
 
-    LogPrint(BCLog::REWARDS, "%s: Total amount owned %d\n", __func__,
-             totalAmtOwned);
-
-    LogPrint(BCLog::REWARDS, "%s: Total payout amount %d\n", __func__,
-             modifiedPaymentInTokenUnits);
-
-    CAmount totalSentAsRewards = 0;
-    //  Loop through token owners
-    for (auto & ownership : nonExceptionOwnerships) {
-        // Get percentage of total ownership
-        long double percent = (long double)ownership.amount / (long double)totalAmtOwned;
-        // Caculate the reward with potentional unit inaccurancies e.g with units 4, 90054100 satoshis = 0.90054100
-        CAmount rewardAmt = percent * modifiedPaymentInTokenUnits * static_cast<CAmount>(pow(10, COIN_DIGITS_PAST_DECIMAL - distributionToken.units));
-        // Remove all none accurate units e.g with units 4 90054100 => 9005
-        rewardAmt /= static_cast<CAmount>(pow(10, COIN_DIGITS_PAST_DECIMAL - distributionToken.units));
-        // Replace all none accurate units back with zeros e.g with units 4 9005 => 90050000 satoshis = 0.90050000
-        rewardAmt *= static_cast<CAmount>(pow(10, COIN_DIGITS_PAST_DECIMAL - distributionToken.units));
-
-        totalSentAsRewards += rewardAmt;
-
-        LogPrint(BCLog::REWARDS, "%s: Found ownership address for '%s': '%s' owns %d => reward %d\n", __func__,
-                 p_rewardSnapshot.strOwnershipToken.c_str(), ownership.address.c_str(),
-                 ownership.amount, rewardAmt);
-
-        //  Save it into our list if the reward payment is above zero
-        if (rewardAmt > 0)
-            vecDistributionList.push_back(OwnerAndAmount(ownership.address, rewardAmt));
+//  Create the unsigned transaction for a batch from its reserved inputs
+static bool CreateDistributionBatch(CWallet * const p_wallet, const CRewardSnapshot& p_rewardSnapshot,
+        const std::vector<OwnerAndAmount>& p_payments, CDistributionBatch& batch, const std::string& message)
+{
+    int nStop = std::min(batch.nStart + MAX_PAYMENTS_PER_TRANSACTION, (int)p_payments.size());
+    CAmount nFeeRequired = 0;
+    batch.reserveKey = std::make_shared<CReserveKey>(p_wallet);
+
+    if (p_rewardSnapshot.strDistributionToken == "PLB") {
+        std::vector<CRecipient> vDestinations;
+        for (int i = batch.nStart; i < nStop; i++) {
+            CScript scriptPubKey = GetScriptForDestination(DecodeDestination(p_payments[i].address));
+            vDestinations.push_back({scriptPubKey, p_payments[i].amount, false});
+        }
+
+        std::string strError;
+        int nChangePosRet = -1;
+        if (!p_wallet->CreateTransaction(vDestinations, batch.wtx, *batch.reserveKey, nFeeRequired, message, nChangePosRet, strError, batch.ctrl, false)) {
+            LogPrint(BCLog::REWARDS, "%s: Failed to create batch %d from its reserved inputs: %s\n", __func__, batch.nBatch, strError);
+            return false;
+        }
+    } else {
+        std::vector< std::pair<CTokenTransfer, std::string> > vDestinations;
+        for (int i = batch.nStart; i < nStop; i++) {
+            vDestinations.emplace_back(std::make_pair(
+                    CTokenTransfer(p_rewardSnapshot.strDistributionToken, p_payments[i].amount, 0, DecodeTokenData(""), 0), p_payments[i].address));
+        }
+
+        std::pair<int, std::string> error;
+        if (!CreateTransferTokenTransaction(p_wallet, batch.ctrl, vDestinations, "", error, batch.wtx, *batch.reserveKey, nFeeRequired, message, nullptr, nullptr, false)) {
+            LogPrint(BCLog::REWARDS, "%s: Failed to create batch %d from its reserved inputs: %s\n", __func__, batch.nBatch, error.second);
+            return false;
+        }
     }
 
-    CAmount change = totalAmtOwned - totalSentAsRewards;
-    if (change > 0) {
-        LogPrint(BCLog::REWARDS, "%s: Found change amount of %u\n", __func__, change);
+    //  Remember what every input spends so the batch can be signed without touching mapWallet
+    LOCK(p_wallet->cs_wallet);
+    for (const CTxIn& txin : batch.wtx.tx->vin) {
+        const CWalletTx* prev = p_wallet->GetWalletTx(txin.prevout.hash);
+        if (!prev || txin.prevout.n >= prev->tx->vout.size())
+            return false;
+        batch.vPrevOuts.push_back(prev->tx->vout[txin.prevout.n]);
     }
 
     return true;
 }
 
-#ifdef ENABLE_WALLET
+static void SignDistributionBatch(CWallet * const p_wallet, CDistributionBatch& batch)
+{
+    CMutableTransaction txNew(*batch.wtx.tx);
+    CTransaction txNewConst(txNew);
+    for (unsigned int nIn = 0; nIn < txNew.vin.size(); nIn++) {
+        SignatureData sigdata;
+        if (!ProduceSignature(TransactionSignatureCreator(p_wallet, &txNewConst, nIn, batch.vPrevOuts[nIn].nValue, SIGHASH_ALL), batch.vPrevOuts[nIn].scriptPubKey, sigdata))
+            return;
+        UpdateTransaction(txNew, nIn, sigdata);
+    }
+
+    batch.wtx.SetTx(MakeTransactionRef(std::move(txNew)));
+    batch.fSigned = true;
+}
+
+//  Sign the batches on a small pool of threads. The inputs are disjoint, so the batches don't depend on each other.
+static void SignDistributionBatches(CWallet * const p_wallet, std::vector<CDistributionBatch>& vBatches)
+{
+    std::atomic<size_t> nNext(0);
+    auto worker = [&]() {
+        size_t n;
+        while ((n = nNext++) < vBatches.size())
+            SignDistributionBatch(p_wallet, vBatches[n]);
+    };
+
+    int nThreads = std::max(1, std::min((int)vBatches.size(), GetNumCores()));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; i++)
+        vThreads.emplace_back(worker);
+    worker();
+    for (auto& thread : vThreads)
+        thread.join();
+}
+
+namespace {
+//  How far a distribution got, so a block only has to look at the one batch it is waiting for
+struct CDistributionProgress
+{
+    //  The batches below this one have confirmed
+    int nConfirmed;
+    //  The number of batches, -1 until the distribution list has been generated
+    int nBatches;
+
+    CDistributionProgress() : nConfirmed(0), nBatches(-1) {}
+};
+
+std::map<uint256, CDistributionProgress> mapDistributionProgress;
+}
+
+//  Move past the batches of a distribution that have confirmed. True when the next batch still has to be created,
+//      false while it waits to confirm (or conflicts) and once every batch has confirmed.
+static bool AdvanceDistribution(CWallet * p_wallet, const uint256& p_hash, CDistributionProgress& p_progress)
+{
+    while (p_progress.nBatches < 0 || p_progress.nConfirmed < p_progress.nBatches) {
+        uint256 txid;
+        if (!pDistributeSnapshotDb->GetDistributeTransaction(p_hash, p_progress.nConfirmed, txid))
+            return true;
+
+        auto walletTx = p_wallet->GetWalletTx(txid);
+        if (walletTx) {
+            int depth = walletTx->GetDepthInMainChain();
+            if (depth < 0) {
+                LogPrint(BCLog::REWARDS, "Failed distribution: Tx conflict with another tx: %s: number of block back %d!\n", txid.GetHex(), depth);
+                return false;
+            } else if (depth == 0) {
+                LogPrint(BCLog::REWARDS, "Tx is in the mempool! %s\n", txid.GetHex());
+                return false;
+            }
+            LogPrint(BCLog::REWARDS, "Distribution %s batch %d is in a block %s!\n", p_hash.GetHex(), p_progress.nConfirmed, txid.GetHex());
+        } else {
+            LogPrint(BCLog::REWARDS, "Failed to get wallet Tx: %s\n", txid.GetHex());
+        }
+        p_progress.nConfirmed++;
+    }
+    return false;
+}
 
 void DistributeRewardSnapshot(CWallet * p_wallet, const CRewardSnapshot& p_rewardSnapshot, std::string message)
 {
@@ -191,11 +483,17 @@ void DistributeRewardSnapshot(CWallet * p_wallet, const CRewardSnapshot& p_rewar
         return;
     }
 
-    //  Retrieve the token snapshot entry for the target token at the specified height
-    CTokenSnapshotDBEntry snapshotEntry;
+    auto rewardSnapshotHash = p_rewardSnapshot.GetHash();
+    CDistributionProgress& progress = mapDistributionProgress[rewardSnapshotHash];
 
-    if (!pTokenSnapshotDb->RetrieveOwnershipSnapshot(p_rewardSnapshot.strOwnershipToken, p_rewardSnapshot.nHeight, snapshotEntry)) {
-        LogPrint(BCLog::REWARDS, "Failed to retrieve ownership snapshot!\n");
+    //  The owners are only walked again when there are batches left to create
+    if (!AdvanceDistribution(p_wallet, rewardSnapshotHash, progress)) {
+        if (progress.nBatches >= 0 && progress.nConfirmed >= progress.nBatches) {
+            LogPrint(BCLog::REWARDS, "Distribution %s is complete, all %d batches are in a block\n", rewardSnapshotHash.GetHex(), progress.nBatches);
+            mapRewardSnapshots[rewardSnapshotHash].nStatus = CRewardSnapshot::COMPLETE;
+            pDistributeSnapshotDb->OverrideDistributeSnapshot(rewardSnapshotHash, mapRewardSnapshots.at(rewardSnapshotHash));
+            mapDistributionProgress.erase(rewardSnapshotHash);
+        }
         return;
     }
 
@@ -206,41 +504,68 @@ void DistributeRewardSnapshot(CWallet * p_wallet, const CRewardSnapshot& p_rewar
         return;
     }
 
+    //  The batches from the first one that hasn't been created on, which are created in order
     int nNumberOfTransactions = ((int)paymentDetails.size() / MAX_PAYMENTS_PER_TRANSACTION) + 1;
-    CRewardSnapshot copyRewardSnapshot = p_rewardSnapshot;
-    for (int i = 0; i < nNumberOfTransactions; i++) {
-        uint256 txid;
-        if (pDistributeSnapshotDb->GetDistributeTransaction(p_rewardSnapshot.GetHash(), i, txid)) {
-            CTransactionRef txRef;
-            uint256 hashBlock;
-            auto walletTx = p_wallet->GetWalletTx(txid);
-            if (walletTx) {
-                int depth = walletTx->GetDepthInMainChain();
-                if (depth < 0) {
-                    LogPrint(BCLog::REWARDS, "Failed distribution: Tx conflict with another tx: %s: number of block back %d!\n", txid.GetHex(), depth);
-                    return;
-                } else if (depth == 0) {
-                    LogPrint(BCLog::REWARDS, "Tx is in the mempool! %s\n", txid.GetHex());
-                    return;
-                } else if (depth > 0) {
-                    LogPrint(BCLog::REWARDS, "Tx is in a block %s!\n", txid.GetHex());
-                    continue;
-                }
-            } else {
-                LogPrint(BCLog::REWARDS, "Failed to get wallet Tx: %s\n", txid.GetHex());
+    progress.nBatches = nNumberOfTransactions;
+    std::vector<CDistributionBatch> vBatches;
+    for (int i = progress.nConfirmed; i < nNumberOfTransactions; i++) {
+        LogPrint(BCLog::REWARDS, "Didn't find transaction in database creating new transaction: %s %s %d %d\n", p_rewardSnapshot.strOwnershipToken, p_rewardSnapshot.strDistributionToken, p_rewardSnapshot.nDistributionAmount, i);
+        vBatches.emplace_back(i, i * MAX_PAYMENTS_PER_TRANSACTION);
+    }
+
+    if (vBatches.empty())
+        return;
+
+    if (p_wallet->GetBroadcastTransactions() && !g_connman) {
+        mapRewardSnapshots[rewardSnapshotHash].nStatus = CRewardSnapshot::NETWORK_ERROR;
+        pDistributeSnapshotDb->OverrideDistributeSnapshot(rewardSnapshotHash, mapRewardSnapshots.at(rewardSnapshotHash));
+        LogPrint(BCLog::REWARDS, "Error: Peer-to-peer functionality missing or disabled\n");
+        return;
+    }
+
+    //  Batches that got their own inputs are created unsigned, then signed in parallel
+    std::vector<CDistributionBatch> vPrepared = vBatches;
+    ReserveDistributionInputs(p_wallet, p_rewardSnapshot, paymentDetails, vPrepared);
+    for (size_t b = 0; b < vPrepared.size(); b++) {
+        if (!CreateDistributionBatch(p_wallet, p_rewardSnapshot, paymentDetails, vPrepared[b], message)) {
+            vPrepared.erase(vPrepared.begin() + b, vPrepared.end());
+            break;
+        }
+    }
+    SignDistributionBatches(p_wallet, vPrepared);
+
+    //  A batch that failed to sign is rebuilt sequentially, which may spend inputs reserved for later batches
+    for (size_t b = 0; b < vPrepared.size(); b++) {
+        if (!vPrepared[b].fSigned) {
+            vPrepared.erase(vPrepared.begin() + b, vPrepared.end());
+            break;
+        }
+    }
+
+    LogPrint(BCLog::REWARDS, "%s: Prepared %u of %u pending batches with reserved inputs\n", __func__, vPrepared.size(), vBatches.size());
+
+    //  Commit in batch order and record each txid as soon as its batch is out
+    for (size_t b = 0; b < vBatches.size(); b++) {
+        uint256 retTxid;
+        if (b < vPrepared.size()) {
+            CValidationState state;
+            if (!p_wallet->CommitTransaction(vPrepared[b].wtx, *vPrepared[b].reserveKey, g_connman.get(), state)) {
+                mapRewardSnapshots[rewardSnapshotHash].nStatus = CRewardSnapshot::FAILED_COMMIT_TRANSACTION;
+                pDistributeSnapshotDb->OverrideDistributeSnapshot(rewardSnapshotHash, mapRewardSnapshots.at(rewardSnapshotHash));
+                LogPrint(BCLog::REWARDS, "%s\n", state.GetRejectReason());
+                return;
             }
+            retTxid = vPrepared[b].wtx.GetHash();
+            LogPrint(BCLog::REWARDS, "Transaction generation succeeded : %s\n", retTxid.GetHex());
         } else {
-            LogPrint(BCLog::REWARDS, "Didn't find transaction in database creating new transaction: %s %s %d %d\n", p_rewardSnapshot.strOwnershipToken, p_rewardSnapshot.strDistributionToken, p_rewardSnapshot.nDistributionAmount, i);
-            // Create a new transaction and database it
-            int start = i * MAX_PAYMENTS_PER_TRANSACTION;
-            uint256 retTxid;
+            //  Create a new transaction the sequential way, spending whatever the wallet has left
             std::string change = "";
-            if (!BuildTransaction(p_wallet, p_rewardSnapshot, paymentDetails, start, change, retTxid, message)) {
+            if (!BuildTransaction(p_wallet, p_rewardSnapshot, paymentDetails, vBatches[b].nStart, change, retTxid, message)) {
                 LogPrint(BCLog::REWARDS, "Failed to build Tx: distribute: %s, amount: %d\n", p_rewardSnapshot.strDistributionToken, p_rewardSnapshot.nDistributionAmount);
                 return;
             }
-            pDistributeSnapshotDb->AddDistributeTransaction(p_rewardSnapshot.GetHash(), i, retTxid);
         }
+        pDistributeSnapshotDb->AddDistributeTransaction(rewardSnapshotHash, vBatches[b].nBatch, retTxid);
     }
 }
 
@@ -386,7 +711,10 @@ bool BuildTransaction(
 
 void CheckRewardDistributions(CWallet * p_wallet)
 {
-    for (auto item : mapRewardSnapshots) {
+    for (const auto& item : mapRewardSnapshots) {
+        //  A finished distribution has no work left
+        if (item.second.nStatus == CRewardSnapshot::COMPLETE)
+            continue;
         DistributeRewardSnapshot(p_wallet, item.second);
     }
 }
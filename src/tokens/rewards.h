@@ -10,6 +10,7 @@
 #include "tinyformat.h"
 #include "tokentypes.h"
 
+#include <functional>
 #include <string>
 #include <set>
 #include <map>
@@ -147,6 +148,18 @@ enum {
     FAILED_
 };
 
+//  Calls the given visitor for every owner taking part in a distribution, returns false if the owners can't be read
+typedef std::function<bool(const std::function<bool(const std::string&, const CAmount&)>&)> OwnerWalker;
+
+/**
+ * Split p_nPaymentUnits whole units between the owners in proportion to what they own, with exact integer math. Each
+ * share is rounded down, the units that leaves over go one each to the owners with the largest remainders (ties go to
+ * the lowest address). Amounts written out are in satoshis, p_nUnitScale per unit. The owners are streamed three
+ * times, so only the result and the owners owed a leftover unit are held in memory.
+ */
+bool ComputeDistributionShares(const OwnerWalker& p_walkOwners, CAmount p_nPaymentUnits, CAmount p_nUnitScale,
+        std::vector<OwnerAndAmount>& vecDistributionList);
+
 bool GenerateDistributionList(const CRewardSnapshot& p_rewardSnapshot, std::vector<OwnerAndAmount>& vecDistributionList);
 bool AddDistributeRewardSnapshot(CRewardSnapshot& p_rewardSnapshot);
 
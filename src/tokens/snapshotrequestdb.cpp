@@ -31,8 +31,8 @@ CSnapshotRequestDBEntry::CSnapshotRequestDBEntry(
 }
 
 CSnapshotRequestDB::CSnapshotRequestDB(
-    size_t nCacheSize, bool fMemory, bool fWipe)
-    : CDBWrapper(GetDataDir() / "rewards" / "snapshotrequest", nCacheSize, fMemory, fWipe) {
+    size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv)
+    : CDBWrapper(GetDataDir() / "rewards" / "snapshotrequest", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv) {
 }
 
 bool CSnapshotRequestDB::ScheduleSnapshot(
@@ -158,8 +158,8 @@ bool CSnapshotRequestDB::RetrieveSnapshotRequestsForHeight(
 }
 
 CDistributeSnapshotRequestDB::CDistributeSnapshotRequestDB(
-        size_t nCacheSize, bool fMemory, bool fWipe)
-        : CDBWrapper(GetDataDir() / "rewards" / "distributerequests", nCacheSize, fMemory, fWipe) {
+        size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv)
+        : CDBWrapper(GetDataDir() / "rewards" / "distributerequests", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv) {
 }
 
 // Schedule a distribution to occur
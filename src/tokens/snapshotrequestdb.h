@@ -57,7 +57,7 @@ public:
 class CSnapshotRequestDB  : public CDBWrapper
 {
 public:
-    explicit CSnapshotRequestDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CSnapshotRequestDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CSnapshotRequestDB(const CSnapshotRequestDB&) = delete;
     CSnapshotRequestDB& operator=(const CSnapshotRequestDB&) = delete;
@@ -90,7 +90,7 @@ public:
 class CDistributeSnapshotRequestDB  : public CDBWrapper
 {
 public:
-    explicit CDistributeSnapshotRequestDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CDistributeSnapshotRequestDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CDistributeSnapshotRequestDB(const CDistributeSnapshotRequestDB&) = delete;
     CDistributeSnapshotRequestDB& operator=(const CDistributeSnapshotRequestDB&) = delete;
@@ -13,26 +13,42 @@
 
 #include <boost/thread.hpp>
 
+#include <functional>
+
 static const char TOKEN_FLAG = 'A';
 static const char TOKEN_ADDRESS_QUANTITY_FLAG = 'B';
 static const char ADDRESS_TOKEN_QUANTITY_FLAG = 'C';
 static const char MY_TOKEN_FLAG = 'M';
 static const char BLOCK_TOKEN_UNDO_DATA = 'U';
 static const char MEMPOOL_REISSUED_TX = 'Z';
+static const char TOKEN_HOLDER_STATS_FLAG = 'H';
+static const char TOKEN_HOLDER_STATS_READY = 'S';
+static const char USERNAME_ADDRESS_FLAG = 'N';
+static const char USERNAME_INDEX_READY = 'O';
 
 static size_t MAX_DATABASE_RESULTS = 50000;
 
-CTokensDB::CTokensDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "tokens", nCacheSize, fMemory, fWipe) {
+CTokensDB::CTokensDB(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv) : CDBWrapper(GetDataDir() / "tokens", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv), usernameCache(MAX_CACHE_USERNAMES), fTokenNamesLoaded(false) {
+    fHolderStatsReady = Exists(TOKEN_HOLDER_STATS_READY);
+    fUsernameIndexReady = Exists(USERNAME_INDEX_READY);
 }
 
 bool CTokensDB::WriteTokenData(const CNewToken &token, const int nHeight, const uint256& blockHash)
 {
     CDatabasedTokenData data(token, nHeight, blockHash);
-    return Write(std::make_pair(TOKEN_FLAG, token.strName), data);
+    if (!Write(std::make_pair(TOKEN_FLAG, token.strName), data))
+        return false;
+
+    std::lock_guard<std::mutex> lock(cs_tokenNames);
+    if (fTokenNamesLoaded)
+        setTokenNames.insert(token.strName);
+    return true;
 }
 
 bool CTokensDB::WriteTokenAddressQuantity(const std::string &tokenName, const std::string &address, const CAmount &quantity)
 {
+    TrackHolderChange(tokenName, address, quantity);
+    TrackUsernameHolder(tokenName, address, quantity);
     return Write(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, address)), quantity);
 }
 
@@ -55,6 +71,40 @@ bool CTokensDB::ReadTokenData(const std::string& strName, CNewToken& token, int&
     return ret;
 }
 
+bool CTokensDB::ReadTokenRecord(const std::string& strName, std::string& strRecord)
+{
+    if (!ReadRaw(std::make_pair(TOKEN_FLAG, strName), strRecord))
+        return false;
+
+    CTokenRecordView view;
+    if (view.Parse((const unsigned char*)strRecord.data(), strRecord.size()))
+        return true;
+
+    CDatabasedTokenData data;
+    try {
+        CDataStream ssRecord(strRecord.data(), strRecord.data() + strRecord.size(), SER_DISK, CLIENT_VERSION);
+        ssRecord >> data;
+        ssRecord.clear();
+        ssRecord << data;
+        strRecord.assign(ssRecord.begin(), ssRecord.end());
+    } catch (const std::exception& e) {
+        return error("%s: failed to read the record of token %s: %s", __func__, strName, e.what());
+    }
+    return true;
+}
+
+bool CTokensDB::ReadTokensData(const std::set<std::string>& setNames, std::map<std::string, CDatabasedTokenData>& mapTokens)
+{
+    std::set<std::string, CDBKeyOrder> setOrdered(setNames.begin(), setNames.end());
+    for (const auto& name : setOrdered) {
+        CDatabasedTokenData data;
+        if (Read(std::make_pair(TOKEN_FLAG, name), data))
+            mapTokens.emplace(name, data);
+    }
+
+    return true;
+}
+
 bool CTokensDB::ReadTokenAddressQuantity(const std::string& tokenName, const std::string& address, CAmount& quantity)
 {
     return Read(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, address)), quantity);
@@ -66,7 +116,13 @@ bool CTokensDB::ReadAddressTokenQuantity(const std::string &address, const std::
 
 bool CTokensDB::EraseTokenData(const std::string& tokenName)
 {
-    return Erase(std::make_pair(TOKEN_FLAG, tokenName));
+    if (!Erase(std::make_pair(TOKEN_FLAG, tokenName)))
+        return false;
+
+    std::lock_guard<std::mutex> lock(cs_tokenNames);
+    if (fTokenNamesLoaded)
+        setTokenNames.erase(tokenName);
+    return true;
 }
 
 bool CTokensDB::EraseMyTokenData(const std::string& tokenName)
@@ -75,6 +131,8 @@ bool CTokensDB::EraseMyTokenData(const std::string& tokenName)
 }
 
 bool CTokensDB::EraseTokenAddressQuantity(const std::string &tokenName, const std::string &address) {
+    TrackHolderChange(tokenName, address, 0);
+    TrackUsernameHolder(tokenName, address, 0);
     return Erase(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, address)));
 }
 
@@ -99,6 +157,30 @@ bool CTokensDB::ReadBlockUndoTokenData(const uint256 &blockhash, std::vector<std
     return true;
 }
 
+bool CTokensDB::PruneBlockUndoTokenData(const std::function<bool(const uint256&)>& fKeep, size_t& nErased)
+{
+    nErased = 0;
+    CDBBatch batch(*this);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(BLOCK_TOKEN_UNDO_DATA, uint256()));
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != BLOCK_TOKEN_UNDO_DATA)
+            break;
+        if (!fKeep(key.second)) {
+            batch.Erase(key);
+            nErased++;
+        }
+        pcursor->Next();
+    }
+    return WriteBatch(batch);
+}
+
+uint64_t CTokensDB::EstimateBlockUndoTokenDataSize() const
+{
+    return EstimateSize(std::make_pair(BLOCK_TOKEN_UNDO_DATA, uint256()), std::make_pair((char)(BLOCK_TOKEN_UNDO_DATA + 1), uint256()));
+}
+
 bool CTokensDB::WriteReissuedMempoolState()
 {
     return Write(MEMPOOL_REISSUED_TX, mapReissuedTokens);
@@ -111,12 +193,221 @@ bool CTokensDB::ReadReissuedMempoolState()
     // If it exists, return the read value.
     bool rv = Read(MEMPOOL_REISSUED_TX, mapReissuedTokens);
     if (rv) {
-        for (auto pair : mapReissuedTokens)
+        for (const auto& pair : mapReissuedTokens)
             mapReissuedTx.insert(std::make_pair(pair.second, pair.first));
     }
     return rv;
 }
 
+void CTokensDB::TrackHolderChange(const std::string& tokenName, const std::string& address, const CAmount& quantity)
+{
+    if (!fHolderStatsReady)
+        return;
+
+    CAmount nOldQuantity = 0;
+    auto it = mapHolderQuantities.find(std::make_pair(tokenName, address));
+    if (it != mapHolderQuantities.end())
+        nOldQuantity = it->second;
+    else if (!ReadTokenAddressQuantity(tokenName, address, nOldQuantity))
+        nOldQuantity = 0;
+    mapHolderQuantities[std::make_pair(tokenName, address)] = quantity;
+
+    CTokenHolderStats& delta = mapHolderStatsDelta[tokenName];
+    if (nOldQuantity <= 0 && quantity > 0)
+        delta.nHolders += 1;
+    else if (nOldQuantity > 0 && quantity <= 0)
+        delta.nHolders -= 1;
+    delta.nCirculating += quantity - nOldQuantity;
+}
+
+//! Keep the username index and its cache in step with a username's quantity. A username is a single indivisible
+//! unit, so it has at most one holder and the last address it was written to with a quantity is that holder.
+void CTokensDB::TrackUsernameHolder(const std::string& tokenName, const std::string& address, const CAmount& quantity)
+{
+    if (!IsUsernameValid(tokenName))
+        return;
+
+    if (quantity > 0) {
+        Write(std::make_pair(USERNAME_ADDRESS_FLAG, tokenName), address);
+        usernameCache.Put(tokenName, address);
+        return;
+    }
+
+    std::string strHolder;
+    if (Read(std::make_pair(USERNAME_ADDRESS_FLAG, tokenName), strHolder) && strHolder == address) {
+        Erase(std::make_pair(USERNAME_ADDRESS_FLAG, tokenName));
+        usernameCache.Put(tokenName, std::string());
+    }
+}
+
+bool CTokensDB::ReadTokenHolderStats(const std::string& tokenName, CTokenHolderStats& stats)
+{
+    stats.SetNull();
+    if (!Exists(std::make_pair(TOKEN_HOLDER_STATS_FLAG, tokenName)))
+        return true;
+
+    return Read(std::make_pair(TOKEN_HOLDER_STATS_FLAG, tokenName), stats);
+}
+
+//! Mark the holder stats as out of date before the quantity writes of a flush. The writes land after this erase, so
+//! if the node stops before FlushTokenHolderStats commits, the stats are rebuilt from the quantities on the next start.
+bool CTokensDB::BeginTokenHolderStatsUpdate()
+{
+    if (!fHolderStatsReady)
+        return true;
+
+    return Erase(TOKEN_HOLDER_STATS_READY);
+}
+
+bool CTokensDB::FlushTokenHolderStats(const int nHeight)
+{
+    mapHolderQuantities.clear();
+    if (!fHolderStatsReady) {
+        mapHolderStatsDelta.clear();
+        return true;
+    }
+
+    CDBBatch batch(*this);
+    for (const auto& item : mapHolderStatsDelta) {
+        CTokenHolderStats stats;
+        if (!ReadTokenHolderStats(item.first, stats))
+            return error("%s: failed to read holder stats for %s", __func__, item.first);
+
+        stats.nHolders += item.second.nHolders;
+        stats.nCirculating += item.second.nCirculating;
+        stats.nLastChangeHeight = nHeight;
+        batch.Write(std::make_pair(TOKEN_HOLDER_STATS_FLAG, item.first), stats);
+    }
+    mapHolderStatsDelta.clear();
+    batch.Write(TOKEN_HOLDER_STATS_READY, true);
+
+    return WriteBatch(batch);
+}
+
+//! Build the holder stats of every token from its address quantities, needed once for databases created before they existed
+bool CTokensDB::RebuildTokenHolderStats()
+{
+    LogPrintf("%s: Building token holder stats from the address quantities\n", __func__);
+
+    std::map<std::string, CTokenHolderStats> mapStats;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(std::string(), std::string())));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+
+        std::pair<char, std::pair<std::string, std::string> > key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_ADDRESS_QUANTITY_FLAG)
+            break;
+
+        CAmount quantity;
+        if (!pcursor->GetValue(quantity))
+            return error("%s: failed to read token address quantity", __func__);
+
+        CTokenHolderStats& stats = mapStats[key.second.first];
+        if (quantity > 0)
+            stats.nHolders += 1;
+        stats.nCirculating += quantity;
+        pcursor->Next();
+    }
+
+    CDBBatch batch(*this);
+    std::unique_ptr<CDBIterator> pstats(NewIterator());
+    pstats->Seek(std::make_pair(TOKEN_HOLDER_STATS_FLAG, std::string()));
+    while (pstats->Valid()) {
+        std::pair<char, std::string> key;
+        if (!pstats->GetKey(key) || key.first != TOKEN_HOLDER_STATS_FLAG)
+            break;
+        batch.Erase(key);
+        pstats->Next();
+    }
+
+    for (const auto& item : mapStats)
+        batch.Write(std::make_pair(TOKEN_HOLDER_STATS_FLAG, item.first), item.second);
+    batch.Write(TOKEN_HOLDER_STATS_READY, true);
+
+    if (!WriteBatch(batch, true))
+        return error("%s: failed to write token holder stats", __func__);
+
+    mapHolderStatsDelta.clear();
+    mapHolderQuantities.clear();
+    fHolderStatsReady = true;
+
+    LogPrintf("%s: Built holder stats for %d tokens\n", __func__, mapStats.size());
+    return true;
+}
+
+//! Build the username index from the address quantities, needed once for databases created before it existed
+bool CTokensDB::RebuildUsernameIndex()
+{
+    LogPrintf("%s: Building the username index from the address quantities\n", __func__);
+
+    CDBBatch batch(*this);
+    std::unique_ptr<CDBIterator> pindex(NewIterator());
+    pindex->Seek(std::make_pair(USERNAME_ADDRESS_FLAG, std::string()));
+    while (pindex->Valid()) {
+        std::pair<char, std::string> key;
+        if (!pindex->GetKey(key) || key.first != USERNAME_ADDRESS_FLAG)
+            break;
+        batch.Erase(key);
+        pindex->Next();
+    }
+
+    size_t nUsernames = 0;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(std::string(), std::string())));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+
+        std::pair<char, std::pair<std::string, std::string> > key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_ADDRESS_QUANTITY_FLAG)
+            break;
+
+        const std::string& tokenName = key.second.first;
+        if (IsUsernameValid(tokenName)) {
+            CAmount quantity;
+            if (!pcursor->GetValue(quantity))
+                return error("%s: failed to read token address quantity", __func__);
+            if (quantity > 0) {
+                batch.Write(std::make_pair(USERNAME_ADDRESS_FLAG, tokenName), key.second.second);
+                nUsernames++;
+            }
+        }
+        pcursor->Next();
+    }
+    batch.Write(USERNAME_INDEX_READY, true);
+
+    if (!WriteBatch(batch, true))
+        return error("%s: failed to write the username index", __func__);
+
+    usernameCache.Clear();
+    fUsernameIndexReady = true;
+
+    LogPrintf("%s: Indexed %d usernames\n", __func__, nUsernames);
+    return true;
+}
+
+//! Read every token name into setTokenNames, must be called with cs_tokenNames held
+bool CTokensDB::LoadTokenNames()
+{
+    setTokenNames.clear();
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(TOKEN_FLAG, std::string()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_FLAG)
+            break;
+        // Names arrive in key order, so each insert goes at the end
+        setTokenNames.emplace_hint(setTokenNames.end(), key.second);
+        pcursor->Next();
+    }
+
+    fTokenNamesLoaded = true;
+    LogPrint(BCLog::DB, "%s: Loaded %d token names\n", __func__, setTokenNames.size());
+    return true;
+}
+
 bool CTokensDB::LoadTokens()
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -146,6 +437,22 @@ bool CTokensDB::LoadTokens()
     }
 
 
+    {
+        std::lock_guard<std::mutex> lock(cs_tokenNames);
+        if (!LoadTokenNames())
+            return false;
+    }
+
+    if (fTokenIndex && !fHolderStatsReady) {
+        if (!RebuildTokenHolderStats())
+            return false;
+    }
+
+    if (fTokenIndex && !fUsernameIndexReady) {
+        if (!RebuildUsernameIndex())
+            return false;
+    }
+
     if (fTokenIndex) {
         std::unique_ptr<CDBIterator> pcursor3(NewIterator());
         pcursor3->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(std::string(), std::string())));
@@ -174,249 +481,500 @@ bool CTokensDB::LoadTokens()
     return true;
 }
 
-std::string CTokensDB::UsernameAddress(const std::string& tokenName)
+// The directory lookups below never flush the chainstate. Instead the dirty entries that are still held in the global
+// ptokens cache are laid over the database iterator (which reads from an implicit LevelDB snapshot taken when it was
+// created), so the results match what would be read back after a flush. Must be called with cs_main held.
+// Since ptokens is only flushed under cs_main, an overlay and an iterator created under the same lock agree with
+// each other, and the directory can then be walked after cs_main was released.
+
+//! Dirty <Address, Quantity> entries for a token
+static void GetTokenAddressOverlay(const std::string& tokenName, CDirOverlay<CAmount>& overlay)
 {
-    FlushStateToDisk();
+    AssertLockHeld(cs_main);
+    if (!ptokens)
+        return;
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, std::string())));
+    const auto& mapAmounts = ptokens->mapTokensAddressAmount;
+    for (auto it = mapAmounts.lower_bound(std::make_pair(tokenName, std::string())); it != mapAmounts.end() && it->first.first == tokenName; ++it)
+        overlay[it->first.second] = std::make_pair(it->second > 0, it->second);
+}
 
-    std::string address = "";
-    size_t loaded = 0;
+//! Dirty <Token Name, Quantity> entries for an address
+static void GetAddressTokenOverlay(const std::string& address, CDirOverlay<CAmount>& overlay)
+{
+    AssertLockHeld(cs_main);
+    if (!ptokens)
+        return;
 
-    // Load tokens
-    while (pcursor->Valid() && loaded < MAX_DATABASE_RESULTS) {
+    ptokens->mapTokensAddressAmount.ForEachAddressEntry(address, [&overlay](const std::string& tokenName, const CAmount& amount) {
+        overlay[tokenName] = std::make_pair(amount > 0, amount);
+    });
+}
+
+//! Dirty <Token Name, Quantity> entries for each of many addresses
+static void GetAddressesTokenOverlay(const std::set<std::string, CDBKeyOrder>& setAddresses, std::map<std::string, CDirOverlay<CAmount> >& mapOverlays)
+{
+    AssertLockHeld(cs_main);
+    if (!ptokens)
+        return;
+
+    for (const std::string& address : setAddresses) {
+        ptokens->mapTokensAddressAmount.ForEachAddressEntry(address, [&mapOverlays, &address](const std::string& tokenName, const CAmount& amount) {
+            mapOverlays[address][tokenName] = std::make_pair(amount > 0, amount);
+        });
+    }
+}
+
+//! Dirty token meta data, applied in the same order DumpCacheToDatabase writes it
+static void GetTokenDataOverlay(CDirOverlay<CDatabasedTokenData>& overlay)
+{
+    AssertLockHeld(cs_main);
+    if (!ptokens)
+        return;
+
+    for (const auto& newToken : ptokens->setNewTokensToRemove)
+        overlay[newToken.token.strName] = std::make_pair(false, CDatabasedTokenData());
+
+    for (const auto& newToken : ptokens->setNewTokensToAdd)
+        overlay[newToken.token.strName] = std::make_pair(true, CDatabasedTokenData(newToken.token, newToken.blockHeight, newToken.blockHash));
+
+    for (const auto& newReissue : ptokens->setNewReissueToAdd) {
+        if (ptokens->mapReissuedTokenData.count(newReissue.reissue.strName))
+            overlay[newReissue.reissue.strName] = std::make_pair(true, CDatabasedTokenData(ptokens->mapReissuedTokenData.at(newReissue.reissue.strName), newReissue.blockHeight, newReissue.blockHash));
+    }
+
+    for (const auto& undoReissue : ptokens->setNewReissueToRemove) {
+        CTokenCacheNewToken removedToken(CNewToken(undoReissue.reissue.strName, 0), "", 0, uint256());
+        if (ptokens->setNewTokensToRemove.count(removedToken))
+            continue;
+
+        if (ptokens->mapReissuedTokenData.count(undoReissue.reissue.strName))
+            overlay[undoReissue.reissue.strName] = std::make_pair(true, CDatabasedTokenData(ptokens->mapReissuedTokenData.at(undoReissue.reissue.strName), undoReissue.blockHeight, undoReissue.blockHash));
+    }
+}
+
+/**
+ * Walk the merged view of a database directory and its in memory overlay in key order, starting at strFrom.
+ * The cursor must already be positioned at strFrom, readKey extracts the directory key of the cursor entry and
+ * returns false once the cursor left the directory. fn is called for every live entry and returns false to stop.
+ */
+template <typename V, typename KeyFn, typename Fn>
+static bool WalkDir(CDBIterator& cursor, KeyFn readKey, const CDirOverlay<V>& overlay, const std::string& strFrom, Fn fn)
+{
+    CDBKeyOrder keyOrder;
+    auto it = overlay.lower_bound(strFrom);
+
+    std::string strDBKey;
+    bool fDBValid = cursor.Valid() && readKey(cursor, strDBKey);
+    while (fDBValid || it != overlay.end()) {
         boost::this_thread::interruption_point();
 
-        std::pair<char, std::pair<std::string, std::string> > key;
-        if (pcursor->GetKey(key) && key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName) {
-            address = key.second.second;
-            loaded += 1;
+        if (fDBValid && (it == overlay.end() || keyOrder(strDBKey, it->first))) {
+            V value;
+            if (!cursor.GetValue(value))
+                return error("%s: failed to read directory entry '%s'", __func__, strDBKey);
 
-            break;
-        } else {
-            break;
+            if (!fn(strDBKey, value))
+                return true;
+
+            cursor.Next();
+            fDBValid = cursor.Valid() && readKey(cursor, strDBKey);
+            continue;
+        }
+
+        // The in memory entry replaces the database entry with the same key
+        if (fDBValid && strDBKey == it->first) {
+            cursor.Next();
+            fDBValid = cursor.Valid() && readKey(cursor, strDBKey);
         }
+
+        if (it->second.first && !fn(it->first, it->second.second))
+            return true;
+        ++it;
     }
 
-    return address;
+    return true;
 }
 
-bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const long start)
+//! Key reader for the <flag, <strPrefix, key>> directories
+static std::function<bool(CDBIterator&, std::string&)> PairKeyReader(const char flag, const std::string& strPrefix)
 {
-    FlushStateToDisk();
+    return [flag, strPrefix](CDBIterator& cursor, std::string& strKey) {
+        std::pair<char, std::pair<std::string, std::string> > key;
+        if (!cursor.GetKey(key) || key.first != flag || key.second.first != strPrefix)
+            return false;
+        strKey = key.second.second;
+        return true;
+    };
+}
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(TOKEN_FLAG, std::string()));
+// Shared implementation for the offset based directory lookups
+static bool Dir(CDBIterator* pcursor, const char flag, const CDirOverlay<CAmount>& overlay, std::vector<std::pair<std::string, CAmount> >& vecResult, int& totalEntries, const bool& fGetTotal, const std::string& strPrefix, const size_t count, const long start)
+{
+    auto readKey = PairKeyReader(flag, strPrefix);
 
-    auto prefix = filter;
-    bool wildcard = prefix.back() == '*';
-    if (wildcard)
-        prefix.pop_back();
+    pcursor->Seek(std::make_pair(flag, std::make_pair(strPrefix, std::string())));
 
     size_t skip = 0;
-    if (start >= 0) {
+    if (start >= 0 && !fGetTotal) {
         skip = start;
     }
     else {
-        // compute table size for backwards offset
         long table_size = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
+        if (!WalkDir(*pcursor, readKey, overlay, std::string(), [&table_size](const std::string&, const CAmount&) { table_size += 1; return true; }))
+            return false;
 
-            std::pair<char, std::string> key;
-            if (pcursor->GetKey(key) && key.first == TOKEN_FLAG) {
-                if (prefix == "" ||
-                    (wildcard && key.second.find(prefix) == 0) ||
-                    (!wildcard && key.second == prefix)) {
-                    table_size += 1;
-                }
-            }
-            pcursor->Next();
+        if (fGetTotal) {
+            totalEntries = table_size;
+            return true;
         }
+
+        // compute table size for backwards offset
+        if (table_size + start < 0)
+            return true;
         skip = table_size + start;
-        pcursor->SeekToFirst();
+        pcursor->Seek(std::make_pair(flag, std::make_pair(strPrefix, std::string())));
     }
 
-
     size_t loaded = 0;
     size_t offset = 0;
+    return WalkDir(*pcursor, readKey, overlay, std::string(), [&](const std::string& strKey, const CAmount& amount) {
+        if (loaded >= count || loaded >= MAX_DATABASE_RESULTS)
+            return false;
 
-    // Load tokens
-    while (pcursor->Valid() && loaded < count) {
-        boost::this_thread::interruption_point();
-
-        std::pair<char, std::string> key;
-        if (pcursor->GetKey(key) && key.first == TOKEN_FLAG) {
-            if (prefix == "" ||
-                    (wildcard && key.second.find(prefix) == 0) ||
-                    (!wildcard && key.second == prefix)) {
-                if (offset < skip) {
-                    offset += 1;
-                }
-                else {
-                    CDatabasedTokenData data;
-                    if (pcursor->GetValue(data)) {
-                        tokens.push_back(data);
-                        loaded += 1;
-                    } else {
-                        return error("%s: failed to read token", __func__);
-                    }
-                }
-            }
-            pcursor->Next();
+        if (offset < skip) {
+            offset += 1;
         } else {
-            break;
+            vecResult.emplace_back(std::make_pair(strKey, amount));
+            loaded += 1;
         }
-    }
+        return true;
+    });
+}
 
-    return true;
+// Shared implementation for the cursor based directory lookups. Seeking to <flag, <strPrefix, strAfter>> lands on
+// the cursor itself (or the entry right after it if it was removed)
+static bool DirFrom(CDBIterator* pcursor, const char flag, const CDirOverlay<CAmount>& overlay, std::vector<std::pair<std::string, CAmount> >& vecResult, const std::string& strPrefix, const std::string& strAfter, const size_t count, std::string& strNext)
+{
+    strNext.clear();
+    if (count == 0)
+        return true;
+
+    pcursor->Seek(std::make_pair(flag, std::make_pair(strPrefix, strAfter)));
+
+    size_t loaded = 0;
+    return WalkDir(*pcursor, PairKeyReader(flag, strPrefix), overlay, strAfter, [&](const std::string& strKey, const CAmount& amount) {
+        // The cursor entry was already returned by the previous page
+        if (!strAfter.empty() && strKey == strAfter)
+            return true;
+
+        // There is at least one more entry, hand back a cursor for the next page
+        if (loaded >= count || loaded >= MAX_DATABASE_RESULTS) {
+            strNext = vecResult.back().first;
+            return false;
+        }
+
+        vecResult.emplace_back(std::make_pair(strKey, amount));
+        loaded += 1;
+        return true;
+    });
 }
 
-bool CTokensDB::AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool& fGetTotal, const std::string& address, const size_t count, const long start)
+std::string CTokensDB::UsernameAddress(const std::string& username)
 {
-    FlushStateToDisk();
+    if (!IsUsernameValid(username))
+        return "";
+
+    // The quantity writes that keep the index and the cache run under cs_main too
+    LOCK(cs_main);
+
+    // A holder that isn't written yet is in the dirty quantities of ptokens, along with the quantity the
+    // previous holder was left with
+    CDirOverlay<CAmount> overlay;
+    GetTokenAddressOverlay(username, overlay);
+    for (const auto& item : overlay) {
+        if (item.second.first)
+            return item.first;
+    }
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, std::string())));
+    std::string address;
+    if (!usernameCache.Lookup(username, address)) {
+        if (!Read(std::make_pair(USERNAME_ADDRESS_FLAG, username), address))
+            address.clear();
+        usernameCache.Put(username, address);
+    }
 
-    if (fGetTotal) {
-        totalEntries = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
+    auto it = overlay.find(address);
+    if (it != overlay.end() && !it->second.first)
+        return "";
+    return address;
+}
 
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == ADDRESS_TOKEN_QUANTITY_FLAG && key.second.first == address) {
-                totalEntries++;
+/**
+ * Walk the names of setNames starting with strPrefix, merged with the overlay, in key order. Keys are ordered by
+ * length first, so the names with a prefix are one range for each length from the prefix's up to the longest name.
+ * fn returns false to stop.
+ */
+static void WalkTokenNames(const std::set<std::string, CDBKeyOrder>& setNames, const CDirOverlay<CDatabasedTokenData>& overlay, const std::string& strPrefix, const std::function<bool(const std::string&)>& fn)
+{
+    size_t nMaxLength = 0;
+    if (!setNames.empty())
+        nMaxLength = setNames.rbegin()->size();
+    if (!overlay.empty())
+        nMaxLength = std::max(nMaxLength, overlay.rbegin()->first.size());
+
+    for (size_t nLength = strPrefix.size(); nLength <= nMaxLength; nLength++) {
+        const std::string strFirst = strPrefix + std::string(nLength - strPrefix.size(), '\0');
+        auto inRange = [&strPrefix, nLength](const std::string& name) {
+            return name.size() == nLength && name.compare(0, strPrefix.size(), strPrefix) == 0;
+        };
+
+        auto itName = setNames.lower_bound(strFirst);
+        auto itOverlay = overlay.lower_bound(strFirst);
+        bool fName = itName != setNames.end() && inRange(*itName);
+        bool fOverlay = itOverlay != overlay.end() && inRange(itOverlay->first);
+        while (fName || fOverlay) {
+            // The overlay entry replaces the database name it equals
+            if (fName && (!fOverlay || *itName < itOverlay->first)) {
+                if (!fn(*itName))
+                    return;
+                ++itName;
+            } else {
+                if (fName && *itName == itOverlay->first)
+                    ++itName;
+                if (itOverlay->second.first && !fn(itOverlay->first))
+                    return;
+                ++itOverlay;
             }
-            pcursor->Next();
+            fName = itName != setNames.end() && inRange(*itName);
+            fOverlay = itOverlay != overlay.end() && inRange(itOverlay->first);
         }
-        return true;
     }
+}
+
+//! The page of names matching filter, see TokenNameDir. Must be called with cs_main held, for the overlay.
+bool CTokensDB::TokenNamePage(const CDirOverlay<CDatabasedTokenData>& overlay, const std::string& filter, const size_t count, const long start, std::vector<std::string>& vNames)
+{
+    std::lock_guard<std::mutex> lock(cs_tokenNames);
+    if (!fTokenNamesLoaded && !LoadTokenNames())
+        return false;
+
+    std::string pattern = filter;
+    const bool wildcard = !pattern.empty() && pattern.back() == '*';
+    if (wildcard)
+        pattern.pop_back();
+    // No token name starts with '*', so a leading one was never a prefix and now lets the rest match anywhere
+    const bool anywhere = !pattern.empty() && pattern.front() == '*';
+    if (anywhere)
+        pattern.erase(0, 1);
+
+    auto matches = [&pattern, wildcard, anywhere](const std::string& name) {
+        if (!anywhere)
+            return wildcard || pattern.empty() || name == pattern;
+        if (wildcard)
+            return name.find(pattern) != std::string::npos;
+        return name.size() >= pattern.size() && name.compare(name.size() - pattern.size(), pattern.size(), pattern) == 0;
+    };
+    const std::string strPrefix = anywhere ? std::string() : pattern;
 
     size_t skip = 0;
     if (start >= 0) {
         skip = start;
-    }
-    else {
+    } else {
         // compute table size for backwards offset
         long table_size = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
-
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == ADDRESS_TOKEN_QUANTITY_FLAG && key.second.first == address) {
+        WalkTokenNames(setTokenNames, overlay, strPrefix, [&](const std::string& name) {
+            if (matches(name))
                 table_size += 1;
-            }
-            pcursor->Next();
-        }
+            return true;
+        });
+
+        if (table_size + start < 0)
+            return true;
         skip = table_size + start;
-        pcursor->SeekToFirst();
     }
 
-
-    size_t loaded = 0;
     size_t offset = 0;
+    WalkTokenNames(setTokenNames, overlay, strPrefix, [&](const std::string& name) {
+        if (vNames.size() >= count)
+            return false;
 
-    // Load tokens
-    while (pcursor->Valid() && loaded < count && loaded < MAX_DATABASE_RESULTS) {
-        boost::this_thread::interruption_point();
-
-        std::pair<char, std::pair<std::string, std::string> > key;
-        if (pcursor->GetKey(key) && key.first == ADDRESS_TOKEN_QUANTITY_FLAG && key.second.first == address) {
-                if (offset < skip) {
-                    offset += 1;
-                }
-                else {
-                    CAmount amount;
-                    if (pcursor->GetValue(amount)) {
-                        vecTokenAmount.emplace_back(std::make_pair(key.second.second, amount));
-                        loaded += 1;
-                    } else {
-                        return error("%s: failed to Address Token Quanity", __func__);
-                    }
-                }
-            pcursor->Next();
-        } else {
-            break;
+        if (matches(name)) {
+            if (offset < skip)
+                offset += 1;
+            else
+                vNames.push_back(name);
         }
-    }
-
+        return true;
+    });
     return true;
 }
 
-// Can get to total count of addresses that belong to a certain token_name, or get you the list of all address that belong to a certain token_name
-bool CTokensDB::TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, int& totalEntries, const bool& fGetTotal, const std::string& tokenName, const size_t count, const long start)
+bool CTokensDB::TokenNameDir(std::vector<std::string>& names, const std::string& filter, const size_t count, const long start)
 {
-    FlushStateToDisk();
+    CDirOverlay<CDatabasedTokenData> overlay;
+    LOCK(cs_main);
+    GetTokenDataOverlay(overlay);
+    return TokenNamePage(overlay, filter, count, start, names);
+}
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, std::string())));
+bool CTokensDB::HasTokenName(const std::string& name, bool& fExists)
+{
+    std::lock_guard<std::mutex> lock(cs_tokenNames);
+    if (!fTokenNamesLoaded && !LoadTokenNames())
+        return false;
 
-    if (fGetTotal) {
-        totalEntries = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
+    fExists = setTokenNames.count(name) > 0;
+    return true;
+}
 
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName) {
-                totalEntries += 1;
-            }
-            pcursor->Next();
+bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const long start)
+{
+    CDirOverlay<CDatabasedTokenData> overlay;
+    std::vector<std::string> vNames;
+    std::unique_ptr<CDBIterator> pcursor;
+    {
+        LOCK(cs_main);
+        GetTokenDataOverlay(overlay);
+        if (!TokenNamePage(overlay, filter, count, start, vNames))
+            return false;
+        pcursor.reset(NewIterator());
+    }
+
+    // Only the page is read, from the snapshot of the iterator, which agrees with the names and the overlay
+    for (const std::string& name : vNames) {
+        auto it = overlay.find(name);
+        if (it != overlay.end()) {
+            tokens.push_back(it->second.second);
+            continue;
         }
-        return true;
+
+        std::pair<char, std::string> key;
+        CDatabasedTokenData data;
+        pcursor->Seek(std::make_pair(TOKEN_FLAG, name));
+        if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != TOKEN_FLAG || key.second != name || !pcursor->GetValue(data))
+            return error("%s: failed to read token '%s' of the name index", __func__, name);
+        tokens.push_back(data);
     }
+    return true;
+}
 
-    size_t skip = 0;
-    if (start >= 0) {
-        skip = start;
+bool CTokensDB::AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool& fGetTotal, const std::string& address, const size_t count, const long start)
+{
+    CDirOverlay<CAmount> overlay;
+    std::unique_ptr<CDBIterator> pcursor;
+    {
+        LOCK(cs_main);
+        GetAddressTokenOverlay(address, overlay);
+        pcursor.reset(NewIterator());
     }
-    else {
-        // compute table size for backwards offset
-        long table_size = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
 
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName) {
-                table_size += 1;
+    return Dir(pcursor.get(), ADDRESS_TOKEN_QUANTITY_FLAG, overlay, vecTokenAmount, totalEntries, fGetTotal, address, count, start);
+}
+
+// Can get to total count of addresses that belong to a certain token_name, or get you the list of all address that belong to a certain token_name
+bool CTokensDB::TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, int& totalEntries, const bool& fGetTotal, const std::string& tokenName, const size_t count, const long start)
+{
+    CDirOverlay<CAmount> overlay;
+    std::unique_ptr<CDBIterator> pcursor;
+    {
+        LOCK(cs_main);
+        GetTokenAddressOverlay(tokenName, overlay);
+
+        // The holder stats cover the database, so only the dirty entries have to be looked at
+        if (fGetTotal && fHolderStatsReady && mapHolderStatsDelta.empty()) {
+            CTokenHolderStats stats;
+            if (!ReadTokenHolderStats(tokenName, stats))
+                return false;
+
+            for (const auto& item : overlay) {
+                CAmount nDBQuantity = 0;
+                bool fInDB = ReadTokenAddressQuantity(tokenName, item.first, nDBQuantity);
+                bool fHolder = item.second.first;
+                if (fInDB && nDBQuantity > 0 && !fHolder)
+                    stats.nHolders -= 1;
+                else if ((!fInDB || nDBQuantity <= 0) && fHolder)
+                    stats.nHolders += 1;
             }
-            pcursor->Next();
+
+            totalEntries = stats.nHolders;
+            return true;
         }
-        skip = table_size + start;
-        pcursor->SeekToFirst();
+
+        pcursor.reset(NewIterator());
     }
 
-    size_t loaded = 0;
-    size_t offset = 0;
+    return Dir(pcursor.get(), TOKEN_ADDRESS_QUANTITY_FLAG, overlay, vecAddressAmount, totalEntries, fGetTotal, tokenName, count, start);
+}
 
-    // Load tokens
-    while (pcursor->Valid() && loaded < count && loaded < MAX_DATABASE_RESULTS) {
-        boost::this_thread::interruption_point();
+bool CTokensDB::AddressDirFrom(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, const std::string& address, const std::string& strAfter, const size_t count, std::string& strNext)
+{
+    CDirOverlay<CAmount> overlay;
+    std::unique_ptr<CDBIterator> pcursor;
+    {
+        LOCK(cs_main);
+        GetAddressTokenOverlay(address, overlay);
+        pcursor.reset(NewIterator());
+    }
 
-        std::pair<char, std::pair<std::string, std::string> > key;
-        if (pcursor->GetKey(key) && key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName) {
-            if (offset < skip) {
-                offset += 1;
-            }
-            else {
-                CAmount amount;
-                if (pcursor->GetValue(amount)) {
-                    vecAddressAmount.emplace_back(std::make_pair(key.second.second, amount));
-                    loaded += 1;
-                } else {
-                    return error("%s: failed to Token Address Quanity", __func__);
-                }
-            }
-            pcursor->Next();
-        } else {
-            break;
-        }
+    return DirFrom(pcursor.get(), ADDRESS_TOKEN_QUANTITY_FLAG, overlay, vecTokenAmount, address, strAfter, count, strNext);
+}
+
+bool CTokensDB::AddressesDir(const std::set<std::string>& setAddresses, const std::function<bool(const std::string&, const std::vector<std::pair<std::string, CAmount> >&)>& fn)
+{
+    const std::set<std::string, CDBKeyOrder> setOrdered(setAddresses.begin(), setAddresses.end());
+    std::map<std::string, CDirOverlay<CAmount> > mapOverlays;
+    std::unique_ptr<CDBIterator> pcursor;
+    {
+        LOCK(cs_main);
+        GetAddressesTokenOverlay(setOrdered, mapOverlays);
+        pcursor.reset(NewIterator());
     }
 
+    const CDirOverlay<CAmount> emptyOverlay;
+    for (const std::string& address : setOrdered) {
+        auto it = mapOverlays.find(address);
+        std::vector<std::pair<std::string, CAmount> > vecTokenAmount;
+        int totalEntries = 0;
+        if (!Dir(pcursor.get(), ADDRESS_TOKEN_QUANTITY_FLAG, it != mapOverlays.end() ? it->second : emptyOverlay, vecTokenAmount, totalEntries, false, address, MAX_DATABASE_RESULTS, 0))
+            return false;
+        if (!fn(address, vecTokenAmount))
+            break;
+    }
     return true;
 }
 
+bool CTokensDB::TokenAddressDirFrom(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, const std::string& tokenName, const std::string& strAfter, const size_t count, std::string& strNext)
+{
+    CDirOverlay<CAmount> overlay;
+    std::unique_ptr<CDBIterator> pcursor;
+    {
+        LOCK(cs_main);
+        GetTokenAddressOverlay(tokenName, overlay);
+        pcursor.reset(NewIterator());
+    }
+
+    return DirFrom(pcursor.get(), TOKEN_ADDRESS_QUANTITY_FLAG, overlay, vecAddressAmount, tokenName, strAfter, count, strNext);
+}
+
+std::unique_ptr<CTokenAddressDirView> CTokensDB::SnapshotTokenAddressDir(const std::string& tokenName)
+{
+    LOCK(cs_main);
+
+    std::unique_ptr<CTokenAddressDirView> view(new CTokenAddressDirView());
+    view->tokenName = tokenName;
+    GetTokenAddressOverlay(tokenName, view->overlay);
+    view->pcursor.reset(NewIterator());
+
+    return view;
+}
+
+bool CTokenAddressDirView::Walk(const std::function<bool(const std::string&, const CAmount&)>& fn)
+{
+    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, std::string())));
+    return WalkDir(*pcursor, PairKeyReader(TOKEN_ADDRESS_QUANTITY_FLAG, tokenName), overlay, std::string(), fn);
+}
+
 bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens)
 {
     return CTokensDB::TokenDir(tokens, "*", MAX_SIZE, 0);
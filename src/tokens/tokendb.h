@@ -6,62 +6,123 @@
 #ifndef PLB_TOKENDB_H
 #define PLB_TOKENDB_H
 
+#include "amount.h"
 #include "fs.h"
 #include "serialize.h"
 
+#include <functional>
 #include <string>
 #include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <dbwrapper.h>
+#include "tokentypes.h"
 
-const int8_t TOKEN_UNDO_INCLUDES_VERIFIER_STRING = -1;
+//! Usernames whose holding address is kept in memory in front of the username index
+static const size_t MAX_CACHE_USERNAMES = 10000;
 
 class CNewToken;
 class uint256;
 class COutPoint;
 class CDatabasedTokenData;
 
-struct CBlockTokenUndo
+/** Aggregate of all <Address, Quantity> entries of a token, maintained while the token cache is dumped to database */
+struct CTokenHolderStats
 {
-    bool fChangedIPFS;
-    bool fChangedUnits;
-    std::string strIPFS;
-    int32_t nUnits;
-    int8_t version;
-    bool fChangedVerifierString;
-    std::string verifierString;
+    int64_t nHolders;
+    CAmount nCirculating;
+    int32_t nLastChangeHeight;
+
+    CTokenHolderStats()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nHolders = 0;
+        nCirculating = 0;
+        nLastChangeHeight = -1;
+    }
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(fChangedUnits);
-        READWRITE(fChangedIPFS);
-        READWRITE(strIPFS);
-        READWRITE(nUnits);
-        if (ser_action.ForRead()) {
-            if (!s.empty() and s.size() >= 1) {
-                int8_t nVersionCheck;
-                ::Unserialize(s, nVersionCheck);
-
-                if (nVersionCheck == TOKEN_UNDO_INCLUDES_VERIFIER_STRING) {
-                    ::Unserialize(s, fChangedVerifierString);
-                    ::Unserialize(s, verifierString);
-                }
-                version = nVersionCheck;
-            }
-        } else {
-            ::Serialize(s, TOKEN_UNDO_INCLUDES_VERIFIER_STRING);
-            ::Serialize(s, fChangedVerifierString);
-            ::Serialize(s, verifierString);
-        }
+        READWRITE(nHolders);
+        READWRITE(nCirculating);
+        READWRITE(nLastChangeHeight);
+    }
+};
+
+//! Orders strings the way they are laid out in the database, where every string is serialized with its length first
+struct CDBKeyOrder
+{
+    bool operator()(const std::string& a, const std::string& b) const
+    {
+        return a.size() < b.size() || (a.size() == b.size() && a < b);
     }
 };
 
+//! In memory entries laid over a database directory, the bool is false when the entry was erased
+template <typename V>
+using CDirOverlay = std::map<std::string, std::pair<bool, V>, CDBKeyOrder>;
+
+/**
+ * Frozen view of the <Address, Quantity> directory of a token. It is captured under cs_main: the database iterator
+ * pins a LevelDB snapshot and the dirty entries still held in ptokens are copied, so it can be walked later from any
+ * thread while blocks keep connecting. It must be destroyed before the tokens database.
+ */
+class CTokenAddressDirView
+{
+public:
+    //! Call fn for every <Address, Quantity> of the token in database key order, fn returns false to stop
+    bool Walk(const std::function<bool(const std::string&, const CAmount&)>& fn);
+
+private:
+    friend class CTokensDB;
+
+    std::string tokenName;
+    std::unique_ptr<CDBIterator> pcursor;
+    CDirOverlay<CAmount> overlay;
+};
+
 /** Access to the block database (blocks/index/) */
 class CTokensDB : public CDBWrapper
 {
+private:
+    //! True once every token has a holder stats record that matches its address quantities
+    bool fHolderStatsReady;
+
+    //! Holder stats changes made by the quantity writes that haven't been written by FlushTokenHolderStats yet
+    std::map<std::string, CTokenHolderStats> mapHolderStatsDelta;
+
+    //! Token and address -> quantity last written since the previous FlushTokenHolderStats, so each pair is read once per flush
+    std::map<std::pair<std::string, std::string>, CAmount> mapHolderQuantities;
+
+    void TrackHolderChange(const std::string& tokenName, const std::string& address, const CAmount& quantity);
+
+    //! True once every username token that is held has its address in the username index
+    bool fUsernameIndexReady;
+
+    //! Username -> holding address, or "" when nobody holds it, in front of the username index
+    CShardedLRUCache<std::string, std::string> usernameCache;
+
+    void TrackUsernameHolder(const std::string& tokenName, const std::string& address, const CAmount& quantity);
+
+    //! Every token name in the database in key order, so names are filtered and paged without reading LevelDB.
+    //! Loaded on first use and then kept by WriteTokenData and EraseTokenData.
+    std::mutex cs_tokenNames;
+    bool fTokenNamesLoaded;
+    std::set<std::string, CDBKeyOrder> setTokenNames;
+
+    bool LoadTokenNames();
+    bool TokenNamePage(const CDirOverlay<CDatabasedTokenData>& overlay, const std::string& filter, const size_t count, const long start, std::vector<std::string>& vNames);
+
 public:
-    explicit CTokensDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CTokensDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CTokensDB(const CTokensDB&) = delete;
     CTokensDB& operator=(const CTokensDB&) = delete;
@@ -75,26 +136,75 @@ public:
 
     // Read from database functions
     bool ReadTokenData(const std::string& strName, CNewToken& token, int& nHeight, uint256& blockHash);
+    //! The record of a token in the fixed layout, for a CTokenRecordView; a record from before it is converted
+    bool ReadTokenRecord(const std::string& strName, std::string& strRecord);
     bool ReadTokenAddressQuantity(const std::string& tokenName, const std::string& address, CAmount& quantity);
     bool ReadAddressTokenQuantity(const std::string& address, const std::string& tokenName, CAmount& quantity);
+    //! Token undo data of a block connected before it moved into the block's undo record in the rev files
     bool ReadBlockUndoTokenData(const uint256& blockhash, std::vector<std::pair<std::string, CBlockTokenUndo> >& tokenUndoData);
     bool ReadReissuedMempoolState();
 
+    // Erase the token undo data of the blocks fKeep returns false for, nErased counts them
+    bool PruneBlockUndoTokenData(const std::function<bool(const uint256&)>& fKeep, size_t& nErased);
+    // Approximate bytes the token undo data takes on disk
+    uint64_t EstimateBlockUndoTokenDataSize() const;
+    bool ReadTokenHolderStats(const std::string& tokenName, CTokenHolderStats& stats);
+
+    // Read the metadata of many tokens in database key order, the tokens that aren't found are left out of mapTokens
+    bool ReadTokensData(const std::set<std::string>& setNames, std::map<std::string, CDatabasedTokenData>& mapTokens);
+
     // Erase from database functions
     bool EraseTokenData(const std::string& tokenName);
     bool EraseMyTokenData(const std::string& tokenName);
     bool EraseTokenAddressQuantity(const std::string &tokenName, const std::string &address);
     bool EraseAddressTokenQuantity(const std::string &address, const std::string &tokenName);
 
+    // Holder stats functions
+    bool HolderStatsReady() const { return fHolderStatsReady; }
+    bool RebuildTokenHolderStats();
+    bool BeginTokenHolderStatsUpdate();
+    bool FlushTokenHolderStats(const int nHeight);
+
+    // Username index functions
+    bool UsernameIndexReady() const { return fUsernameIndexReady; }
+    bool RebuildUsernameIndex();
+
     // Helper functions
     bool LoadTokens();
     bool TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const long start);
     bool TokenDir(std::vector<CDatabasedTokenData>& tokens);
 
+    /** The names TokenDir would return, read from the name index alone. A filter is a name, a partial name followed
+     *  by '*', or a part of a name between two '*' (or after one, for names ending with it). */
+    bool TokenNameDir(std::vector<std::string>& names, const std::string& filter, const size_t count, const long start);
+
+    /** Whether a token is in the database, answered from the name index without reading its metadata. False if the
+     *  index couldn't be loaded, in which case fExists is left unset. */
+    bool HasTokenName(const std::string& name, bool& fExists);
+
     bool AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool& fGetTotal, const std::string& address, const size_t count, const long start);
     bool TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, int& totalEntries, const bool& fGetTotal, const std::string& tokenName, const size_t count, const long start);
 
-    std::string UsernameAddress(const std::string& tokenName);
+    /** Cursor based variants of AddressDir and TokenAddressDir. Seek directly past the last key returned by the
+     *  previous page (an empty strAfter starts at the beginning) and load at most count entries, so each page costs
+     *  O(count) instead of walking over every skipped entry. strNext is set to the cursor for the following page,
+     *  or cleared when there are no more entries. */
+    bool AddressDirFrom(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, const std::string& address, const std::string& strAfter, const size_t count, std::string& strNext);
+    bool TokenAddressDirFrom(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, const std::string& tokenName, const std::string& strAfter, const size_t count, std::string& strNext);
+
+    /** The <Token Name, Quantity> directories of many addresses, at most MAX_DATABASE_RESULTS entries each, read from
+     *  one snapshot. cs_main is only held to gather the dirty entries of all the addresses, in a single pass over
+     *  ptokens, and to create the iterator. The addresses are visited in key order, so the iterator only moves
+     *  forward, and fn returns false to stop. */
+    bool AddressesDir(const std::set<std::string>& setAddresses, const std::function<bool(const std::string&, const std::vector<std::pair<std::string, CAmount> >&)>& fn);
+
+    //! Capture the current <Address, Quantity> directory of a token, see CTokenAddressDirView
+    std::unique_ptr<CTokenAddressDirView> SnapshotTokenAddressDir(const std::string& tokenName);
+
+    /** The address holding a username token, or "" if the name isn't a username or nobody holds it. Reads the
+     *  username index, kept by the quantity writes of DumpCacheToDatabase, through usernameCache, after the holders
+     *  in ptokens that are still waiting to be written. Takes cs_main. */
+    std::string UsernameAddress(const std::string& username);
 };
 
 
@@ -16,11 +16,13 @@
 #include <validation.h>
 #include <txmempool.h>
 #include <tinyformat.h>
+#include <trace.h>
 #include <wallet/wallet.h>
 #include <boost/algorithm/string.hpp>
 #include <consensus/validation.h>
 #include <rpc/protocol.h>
 #include <net.h>
+#include <policy/policy.h>
 #include "tokens.h"
 #include "tokendb.h"
 #include "tokentypes.h"
@@ -45,23 +47,46 @@ std::map<std::string, uint256> mapReissuedTokens;
 static const auto MAX_NAME_LENGTH = 31;
 static const auto MAX_CHANNEL_NAME_LENGTH = 12;
 
-// min lengths are expressed by quantifiers
-static const std::regex ROOT_NAME_CHARACTERS("^[A-Z0-9._]{3,}$");
-static const std::regex SUB_NAME_CHARACTERS("^[A-Z0-9._]+$");
-static const std::regex UNIQUE_TAG_CHARACTERS("^[-A-Za-z0-9@$%&*()[\\]{}_.?:]+$");
-static const std::regex MSG_CHANNEL_TAG_CHARACTERS("^[A-Za-z0-9_]+$");
-static const std::regex VOTE_TAG_CHARACTERS("^[A-Z0-9._]+$");
-static const std::regex USERNAME_CHARACTERS("^@[A-Z0-9._]{4,}$");
+// The character classes of the name rules, one bit each
+enum NameCharClass : uint8_t {
+    NAME_CHAR = 1 << 0,          // A-Z 0-9 . _
+    PUNCTUATION_CHAR = 1 << 1,   // . _, which can't be first, last or next to each other
+    UNIQUE_TAG_CHAR = 1 << 2,    // A-Z a-z 0-9 @ $ % & * ( ) [ ] { } _ . ? : -
+    MSG_CHANNEL_TAG_CHAR = 1 << 3, // A-Z a-z 0-9 _
+};
+
+class CNameCharTable
+{
+public:
+    CNameCharTable()
+    {
+        memset(m_classes, 0, sizeof(m_classes));
+        for (char c = 'A'; c <= 'Z'; c++)
+            Add(std::string(1, c), NAME_CHAR | UNIQUE_TAG_CHAR | MSG_CHANNEL_TAG_CHAR);
+        for (char c = '0'; c <= '9'; c++)
+            Add(std::string(1, c), NAME_CHAR | UNIQUE_TAG_CHAR | MSG_CHANNEL_TAG_CHAR);
+        for (char c = 'a'; c <= 'z'; c++)
+            Add(std::string(1, c), UNIQUE_TAG_CHAR | MSG_CHANNEL_TAG_CHAR);
+        Add("_", NAME_CHAR | PUNCTUATION_CHAR | UNIQUE_TAG_CHAR | MSG_CHANNEL_TAG_CHAR);
+        Add(".", NAME_CHAR | PUNCTUATION_CHAR | UNIQUE_TAG_CHAR);
+        Add("-@$%&*()[]{}?:", UNIQUE_TAG_CHAR);
+    }
 
-// Restricted tokens
-static const std::regex QUALIFIER_NAME_CHARACTERS("#[A-Z0-9._]{3,}$");
-static const std::regex SUB_QUALIFIER_NAME_CHARACTERS("#[A-Z0-9._]+$");
-static const std::regex RESTRICTED_NAME_CHARACTERS("\\$[A-Z0-9._]{3,}$");
+    bool Is(char c, uint8_t nClass) const { return m_classes[(unsigned char)c] & nClass; }
 
-static const std::regex DOUBLE_PUNCTUATION("^.*[._]{2,}.*$");
-static const std::regex LEADING_PUNCTUATION("^[._].*$");
-static const std::regex TRAILING_PUNCTUATION("^.*[._]$");
-static const std::regex QUALIFIER_LEADING_PUNCTUATION("^[#\\$][._].*$"); // Used for qualifier tokens, and restricted token only
+private:
+    uint8_t m_classes[256];
+
+    void Add(const std::string& chars, uint8_t nClass)
+    {
+        for (char c : chars)
+            m_classes[(unsigned char)c] |= nClass;
+    }
+};
+
+/** Names are checked against this table in a pass or two rather than against regular expressions, which cost
+ *  microseconds and allocations per match and ran several times over every token output that was validated */
+static const CNameCharTable nameChars;
 
 static const std::string SUB_NAME_DELIMITER = "/";
 static const std::string UNIQUE_TAG_DELIMITER = "#";
@@ -69,234 +94,273 @@ static const std::string MSG_CHANNEL_TAG_DELIMITER = "~";
 static const std::string VOTE_TAG_DELIMITER = "^";
 static const std::string RESTRICTED_TAG_DELIMITER = "$";
 
-static const std::regex UNIQUE_INDICATOR(R"(^[^^~#!]+#[^~#!\/]+$)");
-static const std::regex MSG_CHANNEL_INDICATOR(R"(^[^^~#!]+~[^~#!\/]+$)");
-static const std::regex OWNER_INDICATOR(R"(^[^^~#!]+!$)");
-static const std::regex VOTE_INDICATOR(R"(^[^^~#!]+\^[^~#!\/]+$)");
-static const std::regex USERNAME_INDICATOR(R"(^@[A-Z0-9._]{4,}$)");
+/** Ids of the token names and addresses the restricted caches are keyed by (protected by cs_main). The limit leaves room
+ *  for every name the three caches can hold, past it the ids are dropped along with the caches keyed by them */
+static CNameInterner restrictedCacheNames(8 * MAX_CACHE_TOKENS_SIZE);
 
-static const std::regex QUALIFIER_INDICATOR("^[#][A-Z0-9._]{3,}$"); // Starts with #
-static const std::regex SUB_QUALIFIER_INDICATOR("^#[A-Z0-9._]+\\/#[A-Z0-9._]+$"); // Starts with #
-static const std::regex RESTRICTED_INDICATOR("^[\\$][A-Z0-9._]{3,}$"); // Starts with $
+//! Make room for nCount new names, starting over with empty caches when the interner is full
+static void ReserveRestrictedCacheNames(size_t nCount)
+{
+    if (!restrictedCacheNames.Full(nCount))
+        return;
 
-static const std::regex PLB_NAMES("^PLB$|^PLB$|^PLBCOIN$");
+    restrictedCacheNames.Clear();
+    if (ptokensQualifierCache)
+        ptokensQualifierCache->Clear();
+    if (ptokensRestrictionCache)
+        ptokensRestrictionCache->Clear();
+    if (ptokensGlobalRestrictionCache)
+        ptokensGlobalRestrictionCache->Clear();
+}
 
-bool IsRootNameValid(const std::string& name)
+//! Cache key of a (token, address) pair, interning both names
+static uint64_t InternRestrictedKey(const std::string& tokenName, const std::string& address)
 {
-    return std::regex_match(name, ROOT_NAME_CHARACTERS)
-        && !std::regex_match(name, DOUBLE_PUNCTUATION)
-        && !std::regex_match(name, LEADING_PUNCTUATION)
-        && !std::regex_match(name, TRAILING_PUNCTUATION)
-        && !std::regex_match(name, PLB_NAMES);
+    ReserveRestrictedCacheNames(2);
+    return ((uint64_t)restrictedCacheNames.Intern(tokenName) << 32) | restrictedCacheNames.Intern(address);
 }
 
-bool IsQualifierNameValid(const std::string& name)
+//! Cache key of a token, interning its name
+static uint64_t InternRestrictedKey(const std::string& tokenName)
 {
-    return std::regex_match(name, QUALIFIER_NAME_CHARACTERS)
-           && !std::regex_match(name, DOUBLE_PUNCTUATION)
-           && !std::regex_match(name, QUALIFIER_LEADING_PUNCTUATION)
-           && !std::regex_match(name, TRAILING_PUNCTUATION)
-           && !std::regex_match(name, PLB_NAMES);
+    ReserveRestrictedCacheNames(1);
+    return restrictedCacheNames.Intern(tokenName);
 }
 
-bool IsRestrictedNameValid(const std::string& name)
+//! Cache key of a (token, address) pair for a lookup, false if either name was never cached
+static bool FindRestrictedKey(const std::string& tokenName, const std::string& address, uint64_t& key)
 {
-    return std::regex_match(name, RESTRICTED_NAME_CHARACTERS)
-           && !std::regex_match(name, DOUBLE_PUNCTUATION)
-           && !std::regex_match(name, LEADING_PUNCTUATION)
-           && !std::regex_match(name, TRAILING_PUNCTUATION)
-           && !std::regex_match(name, PLB_NAMES);
+    uint32_t nToken = restrictedCacheNames.Find(tokenName);
+    uint32_t nAddress = restrictedCacheNames.Find(address);
+    if (nToken == CNameInterner::NONE || nAddress == CNameInterner::NONE)
+        return false;
+
+    key = ((uint64_t)nToken << 32) | nAddress;
+    return true;
 }
 
-bool IsSubQualifierNameValid(const std::string& name)
+//! Cache key of a token for a lookup, false if the name was never cached
+static bool FindRestrictedKey(const std::string& tokenName, uint64_t& key)
 {
-    return std::regex_match(name, SUB_QUALIFIER_NAME_CHARACTERS)
-           && !std::regex_match(name, DOUBLE_PUNCTUATION)
-           && !std::regex_match(name, LEADING_PUNCTUATION)
-           && !std::regex_match(name, TRAILING_PUNCTUATION);
+    uint32_t nToken = restrictedCacheNames.Find(tokenName);
+    if (nToken == CNameInterner::NONE)
+        return false;
+
+    key = nToken;
+    return true;
 }
 
-bool IsSubNameValid(const std::string& name)
+//! [begin, end) is at least nMin characters of the class
+static bool IsAllOf(const char* begin, const char* end, uint8_t nClass, size_t nMin)
 {
-    return std::regex_match(name, SUB_NAME_CHARACTERS)
-        && !std::regex_match(name, DOUBLE_PUNCTUATION)
-        && !std::regex_match(name, LEADING_PUNCTUATION)
-        && !std::regex_match(name, TRAILING_PUNCTUATION);
+    if ((size_t)(end - begin) < nMin)
+        return false;
+    for (const char* p = begin; p < end; p++) {
+        if (!nameChars.Is(*p, nClass))
+            return false;
+    }
+    return true;
 }
 
-bool IsUniqueTagValid(const std::string& tag)
+/** [begin, end) is at least nMin (and at least one) characters of the class, without '.' or '_' next to each other
+ *  or last, nor first if fLeading is set */
+static bool IsNamePart(const char* begin, const char* end, uint8_t nClass, size_t nMin, bool fLeading)
 {
-    return std::regex_match(tag, UNIQUE_TAG_CHARACTERS);
+    if (begin == end || (size_t)(end - begin) < nMin)
+        return false;
+    if (fLeading && nameChars.Is(*begin, PUNCTUATION_CHAR))
+        return false;
+    bool fPunctuation = false;
+    for (const char* p = begin; p < end; p++) {
+        if (!nameChars.Is(*p, nClass))
+            return false;
+        const bool fThisPunctuation = nameChars.Is(*p, PUNCTUATION_CHAR);
+        if (fThisPunctuation && fPunctuation)
+            return false;
+        fPunctuation = fThisPunctuation;
+    }
+    return !fPunctuation;
 }
 
-bool IsVoteTagValid(const std::string& tag)
+static bool IsPlbName(const char* begin, const char* end)
 {
-    return std::regex_match(tag, VOTE_TAG_CHARACTERS);
+    const size_t nSize = end - begin;
+    return (nSize == 3 && memcmp(begin, "PLB", 3) == 0) || (nSize == 7 && memcmp(begin, "PLBCOIN", 7) == 0);
 }
 
-bool IsMsgChannelTagValid(const std::string &tag)
+static bool IsRootNameValid(const char* begin, const char* end)
 {
-    return std::regex_match(tag, MSG_CHANNEL_TAG_CHARACTERS)
-        && !std::regex_match(tag, DOUBLE_PUNCTUATION)
-        && !std::regex_match(tag, LEADING_PUNCTUATION)
-        && !std::regex_match(tag, TRAILING_PUNCTUATION);
+    return IsNamePart(begin, end, NAME_CHAR, 3, true) && !IsPlbName(begin, end);
 }
 
-bool IsUsernameValid(const std::string& username)
+static bool IsSubNameValid(const char* begin, const char* end)
 {
-    return std::regex_match(username, USERNAME_CHARACTERS);
+    return IsNamePart(begin, end, NAME_CHAR, 1, true);
 }
 
-bool IsNameValidBeforeTag(const std::string& name)
+// The part after the '#' may start with '.' or '_' in sub qualifiers, but not in qualifiers
+static bool IsQualifierNameValid(const char* begin, const char* end)
 {
-    std::vector<std::string> parts;
-    boost::split(parts, name, boost::is_any_of(SUB_NAME_DELIMITER));
+    return begin != end && *begin == '#' && IsNamePart(begin + 1, end, NAME_CHAR, 3, true);
+}
 
-    if (!IsRootNameValid(parts.front())) return false;
+static bool IsSubQualifierNameValid(const char* begin, const char* end)
+{
+    return begin != end && *begin == '#' && IsNamePart(begin + 1, end, NAME_CHAR, 1, false);
+}
 
-    if (parts.size() > 1)
-    {
-        for (unsigned long i = 1; i < parts.size(); i++)
-        {
-            if (!IsSubNameValid(parts[i])) return false;
-        }
-    }
+// As with sub qualifiers, the part after the '$' may start with '.' or '_'
+static bool IsRestrictedNameValid(const char* begin, const char* end)
+{
+    return begin != end && *begin == '$' && IsNamePart(begin + 1, end, NAME_CHAR, 3, false);
+}
 
-    return true;
+static bool IsUniqueTagValid(const char* begin, const char* end)
+{
+    return IsAllOf(begin, end, UNIQUE_TAG_CHAR, 1);
 }
 
-bool IsQualifierNameValidBeforeTag(const std::string& name)
+static bool IsVoteTagValid(const char* begin, const char* end)
 {
-    std::vector<std::string> parts;
-    boost::split(parts, name, boost::is_any_of(SUB_NAME_DELIMITER));
+    return IsAllOf(begin, end, NAME_CHAR, 1);
+}
 
-    if (!IsQualifierNameValid(parts.front())) return false;
+static bool IsMsgChannelTagValid(const char* begin, const char* end)
+{
+    return IsNamePart(begin, end, MSG_CHANNEL_TAG_CHAR, 1, true);
+}
 
-    // Qualifiers can only have one sub qualifier under it
-    if (parts.size() > 2) {
-        return false;
-    }
+static bool IsUsernameValid(const char* begin, const char* end)
+{
+    return begin != end && *begin == '@' && IsAllOf(begin + 1, end, NAME_CHAR, 4);
+}
 
-    if (parts.size() > 1)
-    {
+bool IsQualifierNameValid(const std::string& name)
+{
+    return IsQualifierNameValid(name.data(), name.data() + name.size());
+}
 
-        for (unsigned long i = 1; i < parts.size(); i++)
-        {
-            if (!IsSubQualifierNameValid(parts[i])) return false;
-        }
-    }
+bool IsUniqueTagValid(const std::string& tag)
+{
+    return IsUniqueTagValid(tag.data(), tag.data() + tag.size());
+}
+
+bool IsUsernameValid(const std::string& username)
+{
+    return IsUsernameValid(username.data(), username.data() + username.size());
+}
+
+//! A root name followed by any number of '/' separated sub names
+static bool IsNameValidBeforeTag(const char* begin, const char* end)
+{
+    const char* partEnd = std::find(begin, end, '/');
+    if (!IsRootNameValid(begin, partEnd))
+        return false;
 
+    while (partEnd != end) {
+        const char* partBegin = partEnd + 1;
+        partEnd = std::find(partBegin, end, '/');
+        if (!IsSubNameValid(partBegin, partEnd))
+            return false;
+    }
     return true;
 }
 
-bool IsTokenNameASubtoken(const std::string& name)
+//! A qualifier name, and at most one '/' separated sub qualifier under it
+static bool IsQualifierNameValidBeforeTag(const char* begin, const char* end)
 {
-    std::vector<std::string> parts;
-    boost::split(parts, name, boost::is_any_of(SUB_NAME_DELIMITER));
+    const char* slash = std::find(begin, end, '/');
+    if (!IsQualifierNameValid(begin, slash))
+        return false;
+    if (slash == end)
+        return true;
 
-    if (!IsRootNameValid(parts.front())) return false;
+    return std::find(slash + 1, end, '/') == end && IsSubQualifierNameValid(slash + 1, end);
+}
 
-    return parts.size() > 1;
+static bool IsTokenNameASubtoken(const char* begin, const char* end)
+{
+    const char* slash = std::find(begin, end, '/');
+    return IsRootNameValid(begin, slash) && slash != end;
 }
 
 bool IsTokenNameASubQualifier(const std::string& name)
 {
-    std::vector<std::string> parts;
-    boost::split(parts, name, boost::is_any_of(SUB_NAME_DELIMITER));
-
-    if (!IsQualifierNameValid(parts.front())) return false;
-
-    return parts.size() > 1;
+    const char* slash = std::find(name.data(), name.data() + name.size(), '/');
+    return IsQualifierNameValid(name.data(), slash) && slash != name.data() + name.size();
 }
 
+/**
+ * Which type a name is written as, from where its '#', '~', '!', '^', '/' and
+ * leading characters are. ROOT stands for both root and sub token names, the
+ * names without any of the other shapes; whether the name is valid as that type
+ * is checked afterwards. Where the shapes overlap the first in the order below
+ * wins.
+ */
+static KnownTokenType ClassifyTokenName(const std::string& name)
+{
+    const size_t npos = std::string::npos;
+    size_t nHash = 0, nTilde = 0, nBang = 0, nCaret = 0, nSlash = 0;
+    size_t nHashPos = npos, nTildePos = npos, nCaretPos = npos, nSlashPos = npos, nLastSlashPos = npos;
+    for (size_t i = 0; i < name.size(); i++) {
+        switch (name[i]) {
+        case '#': if (!nHash++) nHashPos = i; break;
+        case '~': if (!nTilde++) nTildePos = i; break;
+        case '!': nBang++; break;
+        case '^': if (!nCaret++) nCaretPos = i; break;
+        case '/': if (!nSlash++) nSlashPos = i; nLastSlashPos = i; break;
+        }
+    }
+    const char* begin = name.data();
+    const char* end = begin + name.size();
+
+    // ROOT#TAG: one '#' with something on both sides, no '^' before it and no '/' after it
+    if (nHash == 1 && !nTilde && !nBang && nHashPos > 0 && nHashPos + 1 < name.size() &&
+        (nCaretPos == npos || nCaretPos > nHashPos) && (nLastSlashPos == npos || nLastSlashPos < nHashPos))
+        return KnownTokenType::UNIQUE;
+    // ROOT~CHANNEL: the same with one '~'
+    if (nTilde == 1 && !nHash && !nBang && nTildePos > 0 && nTildePos + 1 < name.size() &&
+        (nCaretPos == npos || nCaretPos > nTildePos) && (nLastSlashPos == npos || nLastSlashPos < nTildePos))
+        return KnownTokenType::MSGCHANNEL;
+    // ROOT!
+    if (nBang == 1 && !nHash && !nTilde && !nCaret && name.size() > 1 && name.back() == '!')
+        return KnownTokenType::OWNER;
+    // ROOT^VOTE: the first '^' with something on both sides, no '/' after it
+    if (nCaret && !nHash && !nTilde && !nBang && nCaretPos > 0 && nCaretPos + 1 < name.size() &&
+        (nLastSlashPos == npos || nLastSlashPos < nCaretPos))
+        return KnownTokenType::VOTE;
+    if (name.empty())
+        return KnownTokenType::ROOT;
+    // #QUALIFIER and #QUALIFIER/#SUB
+    if (name[0] == '#' && IsAllOf(begin + 1, end, NAME_CHAR, 3))
+        return KnownTokenType::QUALIFIER;
+    if (name[0] == '#' && nSlash == 1 && nSlashPos + 1 < name.size() && name[nSlashPos + 1] == '#' &&
+        IsAllOf(begin + 1, begin + nSlashPos, NAME_CHAR, 1) && IsAllOf(begin + nSlashPos + 2, end, NAME_CHAR, 1))
+        return KnownTokenType::SUB_QUALIFIER;
+    // $RESTRICTED and @USERNAME
+    if (name[0] == '$' && IsAllOf(begin + 1, end, NAME_CHAR, 3))
+        return KnownTokenType::RESTRICTED;
+    if (name[0] == '@' && IsAllOf(begin + 1, end, NAME_CHAR, 4))
+        return KnownTokenType::USERNAME;
+    return KnownTokenType::ROOT;
+}
 
 bool IsTokenNameValid(const std::string& name, KnownTokenType& tokenType, std::string& error)
 {
-    // Do a max length check first to stop the possibility of a stack exhaustion.
-    // We check for a value that is larger than the max token name
+    // Do a max length check first, no name of any type is longer
     if (name.length() > 40)
         return false;
 
     tokenType = KnownTokenType::INVALID;
-    if (std::regex_match(name, UNIQUE_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::UNIQUE, name, error);
-        if (ret)
-            tokenType = KnownTokenType::UNIQUE;
-
-        return ret;
-    }
-    else if (std::regex_match(name, MSG_CHANNEL_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::MSGCHANNEL, name, error);
-        if (ret)
-            tokenType = KnownTokenType::MSGCHANNEL;
-
-        return ret;
-    }
-    else if (std::regex_match(name, OWNER_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::OWNER, name, error);
-        if (ret)
-            tokenType = KnownTokenType::OWNER;
-
-        return ret;
-    }
-    else if (std::regex_match(name, VOTE_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::VOTE, name, error);
-        if (ret)
-            tokenType = KnownTokenType::VOTE;
-
-        return ret;
-    }
-    else if (std::regex_match(name, QUALIFIER_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::QUALIFIER, name, error);
-        if (ret) {
-            if (IsTokenNameASubQualifier(name))
-                tokenType = KnownTokenType::SUB_QUALIFIER;
-            else
-                tokenType = KnownTokenType::QUALIFIER;
-        }
-
-        return ret;
-    }
-    else if (std::regex_match(name, SUB_QUALIFIER_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::SUB_QUALIFIER, name, error);
-        if (ret) {
-            if (IsTokenNameASubQualifier(name))
-                tokenType = KnownTokenType::SUB_QUALIFIER;
-        }
-
-        return ret;
-    }
-    else if (std::regex_match(name, RESTRICTED_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::RESTRICTED, name, error);
-        if (ret)
-            tokenType = KnownTokenType::RESTRICTED;
-
-        return ret;
-    }
-    else if (std::regex_match(name, USERNAME_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(KnownTokenType::USERNAME, name, error);
-        if (ret)
-            tokenType = KnownTokenType::USERNAME;
+    KnownTokenType type = ClassifyTokenName(name);
+    if (type == KnownTokenType::ROOT && IsTokenNameASubtoken(name.data(), name.data() + name.size()))
+        type = KnownTokenType::SUB;
 
-        return ret;
-    }
-    else
-    {
-        auto type = IsTokenNameASubtoken(name) ? KnownTokenType::SUB : KnownTokenType::ROOT;
-        bool ret = IsTypeCheckNameValid(type, name, error);
-        if (ret)
-            tokenType = type;
+    if (!IsTypeCheckNameValid(type, name, error))
+        return false;
 
-        return ret;
-    }
+    tokenType = type;
+    return true;
 }
 
 bool IsTokenNameValid(const std::string& name)
@@ -320,66 +384,73 @@ bool IsTokenNameARoot(const std::string& name)
 
 bool IsTokenNameAnOwner(const std::string& name)
 {
-    return IsTokenNameValid(name) && std::regex_match(name, OWNER_INDICATOR);
+    KnownTokenType type;
+    return IsTokenNameValid(name, type) && type == KnownTokenType::OWNER;
 }
 
 bool IsTokenNameAnRestricted(const std::string& name)
 {
-    return IsTokenNameValid(name) && std::regex_match(name, RESTRICTED_INDICATOR);
+    KnownTokenType type;
+    return IsTokenNameValid(name, type) && type == KnownTokenType::RESTRICTED;
 }
 
 bool IsTokenNameAQualifier(const std::string& name, bool fOnlyQualifiers)
 {
-    if (fOnlyQualifiers) {
-        return IsTokenNameValid(name) && std::regex_match(name, QUALIFIER_INDICATOR);
-    }
+    KnownTokenType type;
+    if (!IsTokenNameValid(name, type))
+        return false;
 
-    return IsTokenNameValid(name) && (std::regex_match(name, QUALIFIER_INDICATOR) || std::regex_match(name, SUB_QUALIFIER_INDICATOR));
+    return type == KnownTokenType::QUALIFIER || (!fOnlyQualifiers && type == KnownTokenType::SUB_QUALIFIER);
 }
 
 bool IsTokenNameAnMsgChannel(const std::string& name)
 {
-    return IsTokenNameValid(name) && std::regex_match(name, MSG_CHANNEL_INDICATOR);
+    KnownTokenType type;
+    return IsTokenNameValid(name, type) && type == KnownTokenType::MSGCHANNEL;
 }
 
 // TODO get the string translated below
 bool IsTypeCheckNameValid(const KnownTokenType type, const std::string& name, std::string& error)
 {
+    const char* begin = name.data();
+    const char* end = begin + name.size();
+    // The parts before the first and after the last delimiter
+    auto front = [&](char delimiter) { return std::find(begin, end, delimiter); };
+    auto back = [&](char delimiter) {
+        size_t nPos = name.rfind(delimiter);
+        return nPos == std::string::npos ? begin : begin + nPos + 1;
+    };
+
     if (type == KnownTokenType::UNIQUE) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        std::vector<std::string> parts;
-        boost::split(parts, name, boost::is_any_of(UNIQUE_TAG_DELIMITER));
-        bool valid = IsNameValidBeforeTag(parts.front()) && IsUniqueTagValid(parts.back());
+        bool valid = IsNameValidBeforeTag(begin, front('#')) && IsUniqueTagValid(back('#'), end);
         if (!valid) { error = "Unique name contains invalid characters (Valid characters are: A-Z a-z 0-9 @ $ % & * ( ) [ ] { } _ . ? : -)";  return false; }
         return true;
     } else if (type == KnownTokenType::MSGCHANNEL) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        std::vector<std::string> parts;
-        boost::split(parts, name, boost::is_any_of(MSG_CHANNEL_TAG_DELIMITER));
-        bool valid = IsNameValidBeforeTag(parts.front()) && IsMsgChannelTagValid(parts.back());
-        if (parts.back().size() > MAX_CHANNEL_NAME_LENGTH) { error = "Channel name is greater than max length of " + std::to_string(MAX_CHANNEL_NAME_LENGTH); return false; }
+        const char* channel = back('~');
+        bool valid = IsNameValidBeforeTag(begin, front('~')) && IsMsgChannelTagValid(channel, end);
+        if ((size_t)(end - channel) > MAX_CHANNEL_NAME_LENGTH) { error = "Channel name is greater than max length of " + std::to_string(MAX_CHANNEL_NAME_LENGTH); return false; }
         if (!valid) { error = "Message Channel name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
         return true;
     } else if (type == KnownTokenType::OWNER) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        bool valid = IsNameValidBeforeTag(name.substr(0, name.size() - 1));
+        bool valid = IsNameValidBeforeTag(begin, name.empty() ? end : end - 1);
         if (!valid) { error = "Owner name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
         return true;
     } else if (type == KnownTokenType::VOTE) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        std::vector<std::string> parts;
-        boost::split(parts, name, boost::is_any_of(VOTE_TAG_DELIMITER));
-        bool valid = IsNameValidBeforeTag(parts.front()) && IsVoteTagValid(parts.back());
+        bool valid = IsNameValidBeforeTag(begin, front('^')) && IsVoteTagValid(back('^'), end);
         if (!valid) { error = "Vote name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
         return true;
     } else if (type == KnownTokenType::QUALIFIER || type == KnownTokenType::SUB_QUALIFIER) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        bool valid = IsQualifierNameValidBeforeTag(name);
+        bool valid = IsQualifierNameValidBeforeTag(begin, end);
         if (!valid) { error = "Qualifier name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (# must be the first character, _ . special characters can't be the first or last characters)";  return false; }
         return true;
     } else if (type == KnownTokenType::RESTRICTED) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        bool valid = IsRestrictedNameValid(name);
+        bool valid = IsRestrictedNameValid(begin, end);
         if (!valid) { error = "Restricted name contains invalid characters (Valid characters are: A-Z 0-9 _ .) ($ must be the first character, _ . special characters can't be the first or last characters)";  return false; }
         return true;
     } else if (type == KnownTokenType::USERNAME) {
@@ -388,7 +459,7 @@ bool IsTypeCheckNameValid(const KnownTokenType type, const std::string& name, st
             return false;
         }
 
-        bool valid = IsUsernameValid(name);
+        bool valid = IsUsernameValid(begin, end);
         if (!valid) {
             error = "Username contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";
             return false;
@@ -397,10 +468,11 @@ bool IsTypeCheckNameValid(const KnownTokenType type, const std::string& name, st
         return true;
     } else {
         if (name.size() > MAX_NAME_LENGTH - 1) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH - 1); return false; }  //Tokens and sub-tokens need to leave one extra char for OWNER indicator
-        if (!IsTokenNameASubtoken(name) && name.size() < MIN_TOKEN_LENGTH) { error = "Name must be contain " + std::to_string(MIN_TOKEN_LENGTH) + " characters"; return false; }
-        bool valid = IsNameValidBeforeTag(name);
-        if (!valid && IsTokenNameASubtoken(name) && name.size() < 3) { error = "Name must have at least 3 characters (Valid characters are: A-Z 0-9 _ .)";  return false; }
-        if (!valid) { error = "Name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
+        const bool fSubtoken = IsTokenNameASubtoken(begin, end);
+        if (!fSubtoken && name.size() < MIN_TOKEN_LENGTH) { error = "Name must be contain " + std::to_string(MIN_TOKEN_LENGTH) + " characters"; return false; }
+        bool valid = IsNameValidBeforeTag(begin, end);
+        if (!valid && fSubtoken && name.size() < 3) { error = "Name must have at least 3 characters (Valid characters are: A-Z 0-9 _ .)";  return false; }
+        if (!valid) { error = "Name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)"; return false; }
         return true;
     }
 }
@@ -470,36 +542,6 @@ bool CNewToken::IsNull() const
     return strName == "";
 }
 
-CNewToken::CNewToken(const CNewToken& token)
-{
-    this->strName = token.strName;
-    this->nAmount = token.nAmount;
-    this->units = token.units;
-    this->nHasIPFS = token.nHasIPFS;
-    this->nReissuable = token.nReissuable;
-    this->strIPFSHash = token.strIPFSHash;
-
-    this->nHasRoyalties = token.nHasRoyalties;
-    this->nRoyaltiesAddress = token.nRoyaltiesAddress;
-    this->nRoyaltiesAmount = token.nRoyaltiesAmount;
-}
-
-CNewToken& CNewToken::operator=(const CNewToken& token)
-{
-    this->strName = token.strName;
-    this->nAmount = token.nAmount;
-    this->units = token.units;
-    this->nHasIPFS = token.nHasIPFS;
-    this->nReissuable = token.nReissuable;
-    this->strIPFSHash = token.strIPFSHash;
-
-    this->nHasRoyalties = token.nHasRoyalties;
-    this->nRoyaltiesAddress = token.nRoyaltiesAddress;
-    this->nRoyaltiesAmount = token.nRoyaltiesAmount;
-
-    return *this;
-}
-
 std::string CNewToken::ToString()
 {
     std::stringstream ss;
@@ -522,36 +564,6 @@ std::string CNewToken::ToString()
     return ss.str();
 }
 
-CNewToken::CNewToken(const std::string& strName, const CAmount& nAmount, const int& units, const int& nReissuable, const int& nHasIPFS, const std::string& strIPFSHash, const int& nHasRoyalties, const std::string& nRoyaltiesAddress, const CAmount& nRoyaltiesAmount)
-{
-    this->SetNull();
-    this->strName = strName;
-    this->nAmount = nAmount;
-    this->units = int8_t(units);
-    this->nReissuable = int8_t(nReissuable);
-    this->nHasIPFS = int8_t(nHasIPFS);
-    this->strIPFSHash = strIPFSHash;
-
-    this->nHasRoyalties = nHasRoyalties;
-    this->nRoyaltiesAddress = nRoyaltiesAddress;
-    this->nRoyaltiesAmount = nRoyaltiesAmount;
-}
-
-CNewToken::CNewToken(const std::string& strName, const CAmount& nAmount)
-{
-    this->SetNull();
-    this->strName = strName;
-    this->nAmount = nAmount;
-    this->units = int8_t(DEFAULT_UNITS);
-    this->nReissuable = int8_t(DEFAULT_REISSUABLE);
-    this->nHasIPFS = int8_t(DEFAULT_HAS_IPFS);
-    this->strIPFSHash = DEFAULT_IPFS;
-
-    this->nHasRoyalties = DEFAULT_HAS_ROYALTIES;
-    this->nRoyaltiesAddress = DEFAULT_ROYALTIES_ADDRESS;
-    this->nRoyaltiesAmount = DEFAULT_ROYALTIES_AMOUNT;
-}
-
 CDatabasedTokenData::CDatabasedTokenData(const CNewToken& token, const int& nHeight, const uint256& blockHash)
 {
     this->SetNull();
@@ -565,51 +577,14 @@ CDatabasedTokenData::CDatabasedTokenData()
     this->SetNull();
 }
 
-/**
- * Constructs a CScript that carries the token name and quantity and adds to to the end of the given script
- * @param dest - The destination that the token will belong to
- * @param script - This script needs to be a pay to address script
- */
-void CNewToken::ConstructTransaction(CScript& script) const
-{
-    CDataStream ssToken(SER_NETWORK, PROTOCOL_VERSION);
-    ssToken << *this;
-
-    std::vector<unsigned char> vchMessage;
-    vchMessage.push_back(TOKEN_Y); // y
-    vchMessage.push_back(TOKEN_N); // n
-    vchMessage.push_back(TOKEN_A); // a
-    vchMessage.push_back(TOKEN_Q); // q
-
-    vchMessage.insert(vchMessage.end(), ssToken.begin(), ssToken.end());
-    script << OP_PLB_TOKEN << ToByteVector(vchMessage) << OP_DROP;
-}
-
-void CNewToken::ConstructOwnerTransaction(CScript& script) const
-{
-    CDataStream ssOwner(SER_NETWORK, PROTOCOL_VERSION);
-    ssOwner << std::string(this->strName + OWNER_TAG);
-
-    std::vector<unsigned char> vchMessage;
-    vchMessage.push_back(TOKEN_Y); // y
-    vchMessage.push_back(TOKEN_N); // n
-    vchMessage.push_back(TOKEN_A); // a
-    vchMessage.push_back(TOKEN_O); // o
-
-    vchMessage.insert(vchMessage.end(), ssOwner.begin(), ssOwner.end());
-    script << OP_PLB_TOKEN << ToByteVector(vchMessage) << OP_DROP;
-}
-
 bool TokenFromTransaction(const CTransaction& tx, CNewToken& token, std::string& strAddress)
 {
     // Check to see if the transaction is an new token issue tx
     if (!tx.IsNewToken())
         return false;
 
-    // Get the scriptPubKey from the last tx in vout
-    CScript scriptPubKey = tx.vout[tx.vout.size() - 1].scriptPubKey;
-
-    return TokenFromScript(scriptPubKey, token, strAddress);
+    // Get the token from the last tx in vout
+    return TokenFromTx(tx, tx.vout.size() - 1, token, strAddress);
 }
 
 bool MsgChannelTokenFromTransaction(const CTransaction& tx, CNewToken& token, std::string& strAddress)
@@ -725,6 +700,55 @@ bool OwnerFromTransaction(const CTransaction& tx, std::string& ownerName, std::s
     return OwnerTokenFromScript(scriptPubKey, ownerName, strAddress);
 }
 
+static void DecodeTxTokenOutputs(const CTransaction& tx, CTxTokenOutputs& outputs)
+{
+    for (size_t n = 0; n < outputs.vOutputs.size(); n++) {
+        CTxTokenOutput& output = outputs.vOutputs[n];
+        if (!output.fIsToken)
+            continue;
+
+        if (output.nType == TX_TRANSFER_TOKEN) {
+            std::shared_ptr<CTokenTransfer> transfer = std::make_shared<CTokenTransfer>();
+            if (TransferTokenFromScript(tx.vout[n].scriptPubKey, *transfer, output.strAddress))
+                output.transfer = transfer;
+        } else if (output.nType == TX_NEW_TOKEN && !output.fIsOwner) {
+            std::shared_ptr<CNewToken> token = std::make_shared<CNewToken>();
+            if (TokenFromScript(tx.vout[n].scriptPubKey, *token, output.strAddress))
+                output.token = token;
+        }
+    }
+}
+
+const CTxTokenOutput* GetTxTokenOutput(const CTransaction& tx, uint32_t n)
+{
+    const CTxTokenOutput* output = tx.GetTokenOutput(n);
+    if (output)
+        std::call_once(tx.GetTokenOutputs()->decoded, DecodeTxTokenOutputs, std::cref(tx), std::ref(*tx.GetTokenOutputs()));
+    return output;
+}
+
+bool TransferTokenFromTx(const CTransaction& tx, uint32_t n, CTokenTransfer& tokenTransfer, std::string& strAddress)
+{
+    const CTxTokenOutput* output = GetTxTokenOutput(tx, n);
+    if (!output || !output->transfer)
+        return false;
+
+    tokenTransfer = *output->transfer;
+    strAddress = output->strAddress;
+    return true;
+}
+
+bool TokenFromTx(const CTransaction& tx, uint32_t n, CNewToken& token, std::string& strAddress)
+{
+    const CTxTokenOutput* output = GetTxTokenOutput(tx, n);
+    if (!output || !output->token)
+        return false;
+
+    token = *output->token;
+    strAddress = output->strAddress;
+    return true;
+}
+
 bool TransferTokenFromScript(const CScript& scriptPubKey, CTokenTransfer& tokenTransfer, std::string& strAddress)
 {
     int nStartingIndex = 0;
@@ -735,7 +759,7 @@ bool TransferTokenFromScript(const CScript& scriptPubKey, CTokenTransfer& tokenT
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchTransferToken;
 
@@ -762,7 +786,7 @@ bool TokenFromScript(const CScript& scriptPubKey, CNewToken& tokenNew, std::stri
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchNewToken;
     vchNewToken.insert(vchNewToken.end(), scriptPubKey.begin() + nStartingIndex, scriptPubKey.end());
@@ -787,7 +811,7 @@ bool MsgChannelTokenFromScript(const CScript& scriptPubKey, CNewToken& tokenNew,
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchNewToken;
     vchNewToken.insert(vchNewToken.end(), scriptPubKey.begin() + nStartingIndex, scriptPubKey.end());
@@ -812,7 +836,7 @@ bool QualifierTokenFromScript(const CScript& scriptPubKey, CNewToken& tokenNew,
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchNewToken;
     vchNewToken.insert(vchNewToken.end(), scriptPubKey.begin() + nStartingIndex, scriptPubKey.end());
@@ -837,7 +861,7 @@ bool RestrictedTokenFromScript(const CScript& scriptPubKey, CNewToken& tokenNew,
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchNewToken;
     vchNewToken.insert(vchNewToken.end(), scriptPubKey.begin() + nStartingIndex, scriptPubKey.end());
@@ -862,7 +886,7 @@ bool OwnerTokenFromScript(const CScript& scriptPubKey, std::string& tokenName, s
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchOwnerToken;
     vchOwnerToken.insert(vchOwnerToken.end(), scriptPubKey.begin() + nStartingIndex, scriptPubKey.end());
@@ -887,7 +911,7 @@ bool ReissueTokenFromScript(const CScript& scriptPubKey, CReissueToken& reissue,
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchReissueToken;
     vchReissueToken.insert(vchReissueToken.end(), scriptPubKey.begin() + nStartingIndex, scriptPubKey.end());
@@ -912,7 +936,7 @@ bool TokenNullDataFromScript(const CScript& scriptPubKey, CNullTokenTxData& toke
     CTxDestination destination;
     ExtractDestination(scriptPubKey, destination);
 
-    strAddress = EncodeDestination(destination);
+    strAddress = EncodeTokenDestination(destination);
 
     std::vector<unsigned char> vchTokenData;
     vchTokenData.insert(vchTokenData.end(), scriptPubKey.begin() + OFFSET_TWENTY_THREE, scriptPubKey.end());
@@ -1022,7 +1046,7 @@ bool CTransaction::VerifyNewUsername(std::string& strError) const
 
     // Check for the Burn CTxOut in one of the vouts ( This is needed because the change CTxOut is places in a random position in the CWalletTx
     bool fFoundIssueBurnTx = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckIssueBurnTx(out, tokenType)) {
             fFoundIssueBurnTx = true;
             break;
@@ -1088,7 +1112,7 @@ bool CTransaction::VerifyNewUniqueToken(std::string& strError) const
     std::string tokenRoot = "";
     int tokenOutpointCount = 0;
 
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (IsScriptNewUniqueToken(out.scriptPubKey)) {
             CNewToken token;
             std::string address;
@@ -1122,7 +1146,7 @@ bool CTransaction::VerifyNewUniqueToken(std::string& strError) const
 
     // check for burn outpoint (must account for each new token)
     bool fBurnOutpointFound = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckIssueBurnTx(out, KnownTokenType::UNIQUE, tokenOutpointCount)) {
             fBurnOutpointFound = true;
             break;
@@ -1136,7 +1160,7 @@ bool CTransaction::VerifyNewUniqueToken(std::string& strError) const
 
     // check for owner change outpoint that matches root
     bool fOwnerOutFound = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         CTokenTransfer transfer;
         std::string transferAddress;
         if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
@@ -1211,7 +1235,7 @@ bool CTransaction::VerifyNewToken(std::string& strError) const {
 
     // Check for the Burn CTxOut in one of the vouts ( This is needed because the change CTxOut is places in a random position in the CWalletTx
     bool fFoundIssueBurnTx = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckIssueBurnTx(out, tokenType)) {
             fFoundIssueBurnTx = true;
             break;
@@ -1226,7 +1250,7 @@ bool CTransaction::VerifyNewToken(std::string& strError) const {
     if (tokenType == KnownTokenType::SUB) {
         std::string root = GetParentName(token.strName);
         bool fOwnerOutFound = false;
-        for (auto out : this->vout) {
+        for (const CTxOut& out : this->vout) {
             CTokenTransfer transfer;
             std::string transferAddress;
             if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
@@ -1299,7 +1323,7 @@ bool CTransaction::VerifyNewMsgChannelToken(std::string &strError) const
 
     // Check for the Burn CTxOut in one of the vouts ( This is needed because the change CTxOut is places in a random position in the CWalletTx
     bool fFoundIssueBurnTx = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckIssueBurnTx(out, KnownTokenType::MSGCHANNEL)) {
             fFoundIssueBurnTx = true;
             break;
@@ -1314,7 +1338,7 @@ bool CTransaction::VerifyNewMsgChannelToken(std::string &strError) const
     // check for owner change outpoint that matches root
     std::string root = GetParentName(token.strName);
     bool fOwnerOutFound = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         CTokenTransfer transfer;
         std::string transferAddress;
         if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
@@ -1386,7 +1410,7 @@ bool CTransaction::VerifyNewQualfierToken(std::string &strError) const
 
     // Check for the Burn CTxOut in one of the vouts ( This is needed because the change CTxOut is places in a random position in the CWalletTx
     bool fFoundIssueBurnTx = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckIssueBurnTx(out, tokenType)) {
             fFoundIssueBurnTx = true;
             break;
@@ -1402,7 +1426,7 @@ bool CTransaction::VerifyNewQualfierToken(std::string &strError) const
         // Check that there is an token transfer with the parent name, qualifier use just the parent name, they don't use not parent + !
         bool fOwnerOutFound = false;
         std::string root = GetParentName(token.strName);
-        for (auto out : vout) {
+        for (const CTxOut& out : vout) {
             CTokenTransfer transfer;
             std::string transferAddress;
             if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
@@ -1474,7 +1498,7 @@ bool CTransaction::VerifyNewRestrictedToken(std::string& strError) const {
 
     // Check for the Burn CTxOut in one of the vouts ( This is needed because the change CTxOut is places in a random position in the CWalletTx
     bool fFoundIssueBurnTx = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckIssueBurnTx(out, tokenType)) {
             fFoundIssueBurnTx = true;
             break;
@@ -1490,7 +1514,7 @@ bool CTransaction::VerifyNewRestrictedToken(std::string& strError) const {
     bool fRootOwnerOutFound = false;
     std::string root = GetParentName(token.strName);
     std::string strippedRoot = root.substr(1, root.size() -1) + OWNER_TAG; // $TOKEN checks for TOKEN!
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         CTokenTransfer transfer;
         std::string transferAddress;
         if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
@@ -1534,7 +1558,7 @@ bool CTransaction::GetVerifierStringFromTx(CNullTokenTxVerifierString& verifier,
     fNotFound = false;
     bool found = false;
     int count = 0;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (out.scriptPubKey.IsNullTokenVerifierTxDataScript()) {
             count++;
 
@@ -1611,7 +1635,7 @@ bool CTransaction::VerifyReissueToken(std::string& strError) const
 
     // Check that there is an token transfer, this will be the owner token change
     bool fOwnerOutFound = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         CTokenTransfer transfer;
         std::string transferAddress;
         if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
@@ -1629,7 +1653,7 @@ bool CTransaction::VerifyReissueToken(std::string& strError) const
 
     // Check for the Burn CTxOut in one of the vouts ( This is needed because the change CTxOut is placed in a random position in the CWalletTx
     bool fFoundReissueBurnTx = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckReissueBurnTx(out)) {
             fFoundReissueBurnTx = true;
             break;
@@ -1660,7 +1684,7 @@ bool CTransaction::CheckAddingTagBurnFee(const int& count) const
 {
     // check for burn outpoint )
     bool fBurnOutpointFound = false;
-    for (auto out : vout) {
+    for (const CTxOut& out : vout) {
         if (CheckIssueBurnTx(out, KnownTokenType::NULL_ADD_QUALIFIER, count)) {
             fBurnOutpointFound = true;
             break;
@@ -1670,22 +1694,6 @@ bool CTransaction::CheckAddingTagBurnFee(const int& count) const
    return fBurnOutpointFound;
 }
 
-CTokenTransfer::CTokenTransfer(const std::string& strTokenName, const CAmount& nAmount, const uint32_t& nTimeLock, const std::string& message, const int64_t& nExpireTime)
-{
-    SetNull();
-    this->strName = strTokenName;
-    this->nAmount = nAmount;
-    this->nTimeLock = nTimeLock;
-    this->message = message;
-    if (!message.empty()) {
-        if (nExpireTime) {
-            this->nExpireTime = nExpireTime;
-        } else {
-            this->nExpireTime = 0;
-        }
-    }
-}
-
 bool CTokenTransfer::IsValid(std::string& strError) const
 {
     // Don't use this function with any sort of consensus checks
@@ -1738,52 +1746,6 @@ bool CTokenTransfer::ContextualCheckAgainstVerifyString(CTokensCache *tokenCache
     return true;
 }
 
-void CTokenTransfer::ConstructTransaction(CScript& script) const
-{
-    CDataStream ssTransfer(SER_NETWORK, PROTOCOL_VERSION);
-    ssTransfer << *this;
-
-    std::vector<unsigned char> vchMessage;
-    vchMessage.push_back(TOKEN_Y); // y
-    vchMessage.push_back(TOKEN_N); // n
-    vchMessage.push_back(TOKEN_A); // a
-    vchMessage.push_back(TOKEN_T); // t
-
-    vchMessage.insert(vchMessage.end(), ssTransfer.begin(), ssTransfer.end());
-    script << OP_PLB_TOKEN << ToByteVector(vchMessage) << OP_DROP;
-}
-
-CReissueToken::CReissueToken(const std::string &strTokenName, const CAmount &nAmount, const int &nUnits, const int &nReissuable,
-                            const std::string &strIPFSHash, const int& nHasRoyalties, const std::string& nRoyaltiesAddress,
-                            const CAmount& nRoyaltiesAmount)
-{
-    SetNull();
-    this->strName = strTokenName;
-    this->strIPFSHash = strIPFSHash;
-    this->nReissuable = int8_t(nReissuable);
-    this->nAmount = nAmount;
-    this->nUnits = nUnits;
-
-    this->nHasRoyalties = int8_t(nHasRoyalties);
-    this->nRoyaltiesAddress = nRoyaltiesAddress;
-    this->nRoyaltiesAmount = nRoyaltiesAmount;
-}
-
-void CReissueToken::ConstructTransaction(CScript& script) const
-{
-    CDataStream ssReissue(SER_NETWORK, PROTOCOL_VERSION);
-    ssReissue << *this;
-
-    std::vector<unsigned char> vchMessage;
-    vchMessage.push_back(TOKEN_Y); // y
-    vchMessage.push_back(TOKEN_N); // n
-    vchMessage.push_back(TOKEN_A); // a
-    vchMessage.push_back(TOKEN_R); // r
-
-    vchMessage.insert(vchMessage.end(), ssReissue.begin(), ssReissue.end());
-    script << OP_PLB_TOKEN << ToByteVector(vchMessage) << OP_DROP;
-}
-
 bool CReissueToken::IsNull() const
 {
     return strName == "" || nAmount < 0;
@@ -2130,7 +2092,7 @@ bool CTokensCache::RemoveReissueToken(const CReissueToken& reissue, const std::s
     bool fVerifierStringChanged = false;
     std::string verifierString = "";
     // Find the ipfs hash in the undoblock data and restore the ipfs hash to its previous hash
-    for (auto undoItem : vUndoIPFS) {
+    for (const auto& undoItem : vUndoIPFS) {
         if (undoItem.first == reissue.strName) {
             if (undoItem.second.fChangedIPFS)
                 tokenData.strIPFSHash = undoItem.second.strIPFS;
@@ -2409,12 +2371,18 @@ bool CTokensCache::RemoveRestrictedVerifier(const std::string& tokenName, const
 
 bool CTokensCache::DumpCacheToDatabase()
 {
+    TRACE_SPAN("CTokensCache::DumpCacheToDatabase");
     try {
         bool dirty = false;
         std::string message;
 
+        // Holder stats stay marked out of date until FlushTokenHolderStats writes them with the quantities below
+        if (fTokenIndex && !ptokensdb->BeginTokenHolderStatsUpdate()) {
+            return error("%s : %s", __func__, "_Failed Marking token holder stats out of date in database");
+        }
+
         // Remove new tokens from the database
-        for (auto newToken : setNewTokensToRemove) {
+        for (const auto& newToken : setNewTokensToRemove) {
             ptokensCache->Erase(newToken.token.strName);
             if (!ptokensdb->EraseTokenData(newToken.token.strName)) {
                 dirty = true;
@@ -2448,7 +2416,7 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Add the new tokens to the database
-        for (auto newToken : setNewTokensToAdd) {
+        for (const auto& newToken : setNewTokensToAdd) {
             ptokensCache->Put(newToken.token.strName, CDatabasedTokenData(newToken.token, newToken.blockHeight, newToken.blockHash));
             if (!ptokensdb->WriteTokenData(newToken.token, newToken.blockHeight, newToken.blockHash)) {
                 dirty = true;
@@ -2480,7 +2448,7 @@ bool CTokensCache::DumpCacheToDatabase()
 
         if (fTokenIndex) {
             // Remove the new owners from database
-            for (auto ownerToken : setNewOwnerTokensToRemove) {
+            for (const auto& ownerToken : setNewOwnerTokensToRemove) {
                 if (!ptokensdb->EraseTokenAddressQuantity(ownerToken.tokenName, ownerToken.address)) {
                     dirty = true;
                     message = "_Failed Erasing Owner Address Balance from database";
@@ -2497,7 +2465,7 @@ bool CTokensCache::DumpCacheToDatabase()
             }
 
             // Add the new owners to database
-            for (auto ownerToken : setNewOwnerTokensToAdd) {
+            for (const auto& ownerToken : setNewOwnerTokensToAdd) {
                 auto pair = std::make_pair(ownerToken.tokenName, ownerToken.address);
                 if (mapTokensAddressAmount.count(pair) && mapTokensAddressAmount.at(pair) > 0) {
                     if (!ptokensdb->WriteTokenAddressQuantity(ownerToken.tokenName, ownerToken.address,
@@ -2520,7 +2488,7 @@ bool CTokensCache::DumpCacheToDatabase()
 
             // Undo the transfering by updating the balances in the database
 
-            for (auto undoTransfer : setNewTransferTokensToRemove) {
+            for (const auto& undoTransfer : setNewTransferTokensToRemove) {
                 auto pair = std::make_pair(undoTransfer.transfer.strName, undoTransfer.address);
                 if (mapTokensAddressAmount.count(pair)) {
                     if (mapTokensAddressAmount.at(pair) == 0) {
@@ -2563,7 +2531,7 @@ bool CTokensCache::DumpCacheToDatabase()
 
 
             // Save the new transfers by updating the quantity in the database
-            for (auto newTransfer : setNewTransferTokensToAdd) {
+            for (const auto& newTransfer : setNewTransferTokensToAdd) {
                 auto pair = std::make_pair(newTransfer.transfer.strName, newTransfer.address);
                 // During init and reindex it disconnects and verifies blocks, can create a state where vNewTransfer will contain transfers that have already been spent. So if they aren't in the map, we can skip them.
                 if (mapTokensAddressAmount.count(pair)) {
@@ -2586,7 +2554,7 @@ bool CTokensCache::DumpCacheToDatabase()
             }
         }
 
-        for (auto newReissue : setNewReissueToAdd) {
+        for (const auto& newReissue : setNewReissueToAdd) {
             auto reissue_name = newReissue.reissue.strName;
             auto pair = make_pair(reissue_name, newReissue.address);
             if (mapReissuedTokenData.count(reissue_name)) {
@@ -2624,7 +2592,7 @@ bool CTokensCache::DumpCacheToDatabase()
             }
         }
 
-        for (auto undoReissue : setNewReissueToRemove) {
+        for (const auto& undoReissue : setNewReissueToRemove) {
             // In the case the the issue and reissue are both being removed
             // we can skip this call because the removal of the issue should remove all data pertaining the to token
             // Fixes the issue where the reissue data will write over the removed token meta data that was removed above
@@ -2679,7 +2647,7 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Add new verifier strings for restricted tokens
-        for (auto newVerifier : setNewRestrictedVerifierToAdd) {
+        for (const auto& newVerifier : setNewRestrictedVerifierToAdd) {
             auto tokenName = newVerifier.tokenName;
             if (!prestricteddb->WriteVerifier(tokenName, newVerifier.verifier)) {
                 dirty = true;
@@ -2694,7 +2662,7 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Undo verifier string for restricted tokens
-        for (auto undoVerifiers : setNewRestrictedVerifierToRemove) {
+        for (const auto& undoVerifiers : setNewRestrictedVerifierToRemove) {
             auto tokenName = undoVerifiers.tokenName;
 
             // If we are undoing a reissue, we need to save back the old verifier string to database
@@ -2718,9 +2686,9 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Add the new qualifier commands to the database
-        for (auto newQualifierAddress : setNewQualifierAddressToAdd) {
+        for (const auto& newQualifierAddress : setNewQualifierAddressToAdd) {
             if (newQualifierAddress.type == QualifierType::REMOVE_QUALIFIER) {
-                ptokensQualifierCache->Erase(newQualifierAddress.GetHash().GetHex());
+                ptokensQualifierCache->Erase(InternRestrictedKey(newQualifierAddress.tokenName, newQualifierAddress.address));
                 if (!prestricteddb->EraseAddressQualifier(newQualifierAddress.address, newQualifierAddress.tokenName)) {
                     dirty = true;
                     message = "_Failed Erasing address qualifier from database";
@@ -2733,7 +2701,7 @@ bool CTokensCache::DumpCacheToDatabase()
                     }
                 }
             } else if (newQualifierAddress.type == QualifierType::ADD_QUALIFIER) {
-                ptokensQualifierCache->Put(newQualifierAddress.GetHash().GetHex(), 1);
+                ptokensQualifierCache->Put(InternRestrictedKey(newQualifierAddress.tokenName, newQualifierAddress.address), 1);
                 if (!prestricteddb->WriteAddressQualifier(newQualifierAddress.address, newQualifierAddress.tokenName))
                 {
                     dirty = true;
@@ -2754,9 +2722,9 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Undo the qualifier commands
-        for (auto undoQualifierAddress : setNewQualifierAddressToRemove) {
+        for (const auto& undoQualifierAddress : setNewQualifierAddressToRemove) {
             if (undoQualifierAddress.type == QualifierType::REMOVE_QUALIFIER) { // If we are undoing a removal, we write the data to database
-                ptokensQualifierCache->Put(undoQualifierAddress.GetHash().GetHex(), 1);
+                ptokensQualifierCache->Put(InternRestrictedKey(undoQualifierAddress.tokenName, undoQualifierAddress.address), 1);
                 if (!prestricteddb->WriteAddressQualifier(undoQualifierAddress.address, undoQualifierAddress.tokenName)) {
                     dirty = true;
                     message = "_Failed undoing a removal of a address qualifier  from database";
@@ -2769,7 +2737,7 @@ bool CTokensCache::DumpCacheToDatabase()
                     }
                 }
             } else if (undoQualifierAddress.type == QualifierType::ADD_QUALIFIER) { // If we are undoing an addition, we remove the data from the database
-                ptokensQualifierCache->Erase(undoQualifierAddress.GetHash().GetHex());
+                ptokensQualifierCache->Erase(InternRestrictedKey(undoQualifierAddress.tokenName, undoQualifierAddress.address));
                 if (!prestricteddb->EraseAddressQualifier(undoQualifierAddress.address, undoQualifierAddress.tokenName))
                 {
                     dirty = true;
@@ -2790,15 +2758,15 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Add new restricted address commands
-        for (auto newRestrictedAddress : setNewRestrictedAddressToAdd) {
+        for (const auto& newRestrictedAddress : setNewRestrictedAddressToAdd) {
             if (newRestrictedAddress.type == RestrictedType::UNFREEZE_ADDRESS) {
-                ptokensRestrictionCache->Erase(newRestrictedAddress.GetHash().GetHex());
+                ptokensRestrictionCache->Erase(InternRestrictedKey(newRestrictedAddress.tokenName, newRestrictedAddress.address));
                 if (!prestricteddb->EraseRestrictedAddress(newRestrictedAddress.address, newRestrictedAddress.tokenName)) {
                     dirty = true;
                     message = "_Failed Erasing restricted address from database";
                 }
             } else if (newRestrictedAddress.type == RestrictedType::FREEZE_ADDRESS) {
-                ptokensRestrictionCache->Put(newRestrictedAddress.GetHash().GetHex(), 1);
+                ptokensRestrictionCache->Put(InternRestrictedKey(newRestrictedAddress.tokenName, newRestrictedAddress.address), 1);
                 if (!prestricteddb->WriteRestrictedAddress(newRestrictedAddress.address, newRestrictedAddress.tokenName))
                 {
                     dirty = true;
@@ -2812,15 +2780,15 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Undo the qualifier addresses from database
-        for (auto undoRestrictedAddress : setNewRestrictedAddressToRemove) {
+        for (const auto& undoRestrictedAddress : setNewRestrictedAddressToRemove) {
             if (undoRestrictedAddress.type == RestrictedType::UNFREEZE_ADDRESS) { // If we are undoing an unfreeze, we need to freeze the address
-                ptokensRestrictionCache->Put(undoRestrictedAddress.GetHash().GetHex(), 1);
+                ptokensRestrictionCache->Put(InternRestrictedKey(undoRestrictedAddress.tokenName, undoRestrictedAddress.address), 1);
                 if (!prestricteddb->WriteRestrictedAddress(undoRestrictedAddress.address, undoRestrictedAddress.tokenName)) {
                     dirty = true;
                     message = "_Failed undoing a removal of a restricted address from database";
                 }
             } else if (undoRestrictedAddress.type == RestrictedType::FREEZE_ADDRESS) { // If we are undoing a freeze, we need to unfreeze the address
-                ptokensRestrictionCache->Erase(undoRestrictedAddress.GetHash().GetHex());
+                ptokensRestrictionCache->Erase(InternRestrictedKey(undoRestrictedAddress.tokenName, undoRestrictedAddress.address));
                 if (!prestricteddb->EraseRestrictedAddress(undoRestrictedAddress.address, undoRestrictedAddress.tokenName))
                 {
                     dirty = true;
@@ -2834,15 +2802,15 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Add new global restriction commands
-        for (auto newGlobalRestriction : setNewRestrictedGlobalToAdd) {
+        for (const auto& newGlobalRestriction : setNewRestrictedGlobalToAdd) {
             if (newGlobalRestriction.type == RestrictedType::GLOBAL_UNFREEZE) {
-                ptokensGlobalRestrictionCache->Erase(newGlobalRestriction.tokenName);
+                ptokensGlobalRestrictionCache->Erase(InternRestrictedKey(newGlobalRestriction.tokenName));
                 if (!prestricteddb->EraseGlobalRestriction(newGlobalRestriction.tokenName)) {
                     dirty = true;
                     message = "_Failed Erasing global restriction from database";
                 }
             } else if (newGlobalRestriction.type == RestrictedType::GLOBAL_FREEZE) {
-                ptokensGlobalRestrictionCache->Put(newGlobalRestriction.tokenName, 1);
+                ptokensGlobalRestrictionCache->Put(InternRestrictedKey(newGlobalRestriction.tokenName), 1);
                 if (!prestricteddb->WriteGlobalRestriction(newGlobalRestriction.tokenName))
                 {
                     dirty = true;
@@ -2856,15 +2824,15 @@ bool CTokensCache::DumpCacheToDatabase()
         }
 
         // Undo the global restriction commands
-        for (auto undoGlobalRestriction : setNewRestrictedGlobalToRemove) {
+        for (const auto& undoGlobalRestriction : setNewRestrictedGlobalToRemove) {
             if (undoGlobalRestriction.type == RestrictedType::GLOBAL_UNFREEZE) { // If we are undoing an global unfreeze, we need to write a global freeze
-                ptokensGlobalRestrictionCache->Put(undoGlobalRestriction.tokenName, 1);
+                ptokensGlobalRestrictionCache->Put(InternRestrictedKey(undoGlobalRestriction.tokenName), 1);
                 if (!prestricteddb->WriteGlobalRestriction(undoGlobalRestriction.tokenName)) {
                     dirty = true;
                     message = "_Failed undoing a global unfreeze of a restricted token from database";
                 }
             } else if (undoGlobalRestriction.type == RestrictedType::GLOBAL_FREEZE) { // If we are undoing a global freeze, erase the freeze from the database
-                ptokensGlobalRestrictionCache->Erase(undoGlobalRestriction.tokenName);
+                ptokensGlobalRestrictionCache->Erase(InternRestrictedKey(undoGlobalRestriction.tokenName));
                 if (!prestricteddb->EraseGlobalRestriction(undoGlobalRestriction.tokenName))
                 {
                     dirty = true;
@@ -2879,7 +2847,7 @@ bool CTokensCache::DumpCacheToDatabase()
 
         if (fTokenIndex) {
             // Undo the token spends by updating there balance in the database
-            for (auto undoSpend : vUndoTokenAmount) {
+            for (const auto& undoSpend : vUndoTokenAmount) {
                 auto pair = std::make_pair(undoSpend.tokenName, undoSpend.address);
                 if (mapTokensAddressAmount.count(pair)) {
                     if (!ptokensdb->WriteTokenAddressQuantity(undoSpend.tokenName, undoSpend.address,
@@ -2902,7 +2870,7 @@ bool CTokensCache::DumpCacheToDatabase()
 
 
             // Save the tokens that have been spent by erasing the quantity in the database
-            for (auto spentToken : vSpentTokens) {
+            for (const auto& spentToken : vSpentTokens) {
                 auto pair = make_pair(spentToken.tokenName, spentToken.address);
                 if (mapTokensAddressAmount.count(pair)) {
                     if (mapTokensAddressAmount.at(pair) == 0) {
@@ -2938,6 +2906,11 @@ bool CTokensCache::DumpCacheToDatabase()
                     }
                 }
             }
+
+            // Write the holder count and circulating amount changes made by the quantity updates above
+            if (!ptokensdb->FlushTokenHolderStats(chainActive.Height())) {
+                return error("%s : %s", __func__, "_Failed Writing token holder stats to database");
+            }
         }
 
         ClearDirtyCache();
@@ -2952,6 +2925,7 @@ bool CTokensCache::DumpCacheToDatabase()
 //! Do not call this function on the ptokens pointer
 bool CTokensCache::Flush()
 {
+    TRACE_SPAN("CTokensCache::Flush");
 
     if (!ptokens)
         return error("%s: Couldn't find ptokens pointer while trying to flush tokens cache", __func__);
@@ -3116,17 +3090,31 @@ bool CTokensCache::Flush()
         }
 
         for (auto &item : mapRootQualifierAddressesAdd) {
-            for (auto token : item.second) {
+            for (const auto& token : item.second) {
                 ptokens->mapRootQualifierAddressesAdd[item.first].insert(token);
             }
         }
 
         for (auto &item : mapRootQualifierAddressesRemove) {
-            for (auto token : item.second) {
+            for (const auto& token : item.second) {
                 ptokens->mapRootQualifierAddressesAdd[item.first].insert(token);
             }
         }
 
+        // The metadata cache is read without cs_main, drop every token whose metadata ptokens now overrides
+        if (ptokensCache) {
+            for (auto &item : setNewTokensToAdd)
+                ptokensCache->Erase(item.token.strName);
+            for (auto &item : setNewTokensToRemove)
+                ptokensCache->Erase(item.token.strName);
+            for (auto &item : setNewReissueToAdd)
+                ptokensCache->Erase(item.reissue.strName);
+            for (auto &item : setNewReissueToRemove)
+                ptokensCache->Erase(item.reissue.strName);
+            for (auto &item : mapReissuedTokenData)
+                ptokensCache->Erase(item.first);
+        }
+
         return true;
 
     } catch (const std::runtime_error& e) {
@@ -3134,73 +3122,44 @@ bool CTokensCache::Flush()
     }
 }
 
-//! Get the amount of memory the cache is using
+//! Get the amount of memory the cache is using, including the dirty cache
 size_t CTokensCache::DynamicMemoryUsage() const
 {
-    // TODO make sure this is accurate
-    return memusage::DynamicUsage(mapTokensAddressAmount) + memusage::DynamicUsage(mapReissuedTokenData);
-}
-
-//! Get an estimated size of the cache in bytes that will be needed inorder to save to database
-size_t CTokensCache::GetCacheSize() const
-{
-    // COutPoint: 32 bytes
-    // CNewToken: Max 80 bytes
-    // CTokenTransfer: Token Name, CAmount ( 40 bytes)
-    // CReissueToken: Max 80 bytes
-    // CAmount: 8 bytes
-    // Token Name: Max 32 bytes
-    // Address: 40 bytes
-    // Block hash: 32 bytes
-    // CTxOut: CAmount + CScript (105 + 8 = 113 bytes)
-
-    size_t size = 0;
-
-    size += (32 + 40 + 8) * vUndoTokenAmount.size(); // Token Name, Address, CAmount
-
-    size += (40 + 40 + 32) * setNewTransferTokensToRemove.size(); // CTokenTrasnfer, Address, COutPoint
-    size += (40 + 40 + 32) * setNewTransferTokensToAdd.size(); // CTokenTrasnfer, Address, COutPoint
+    size_t usage = memusage::DeepDynamicUsage(mapTokensAddressAmount) + memusage::DynamicUsage(mapReissuedTokenData);
+    for (const auto& item : mapReissuedTokenData)
+        usage += memusage::DynamicUsage(item.first) + memusage::DynamicUsage(item.second);
 
-    size += 72 * setNewOwnerTokensToAdd.size(); // Token Name, Address
-    size += 72 * setNewOwnerTokensToRemove.size(); // Token Name, Address
-
-    size += (32 + 40 + 8) * vSpentTokens.size(); // Token Name, Address, CAmount
-
-    size += (80 + 40 + 32 + sizeof(int)) * setNewTokensToAdd.size(); // CNewToken, Address, Block hash, int
-    size += (80 + 40 + 32 + sizeof(int)) * setNewTokensToRemove.size(); // CNewToken, Address, Block hash, int
-
-    size += (80 + 40 + 32 + 32 + sizeof(int)) * setNewReissueToAdd.size(); // CReissueToken, Address, COutPoint, Block hash, int
-    size += (80 + 40 + 32 + 32 + sizeof(int)) * setNewReissueToRemove.size(); // CReissueToken, Address, COutPoint, Block hash, int
-
-    // TODO add the qualfier, and restricted sets into this calculation
-
-    return size;
+    return usage + GetCacheSize();
 }
 
-//! Get an estimated size of the cache in bytes that will be needed inorder to save to database
-size_t CTokensCache::GetCacheSizeV2() const
+//! Get the amount of memory held by the dirty entries that will be written to the database on flush
+size_t CTokensCache::GetCacheSize() const
 {
-    // COutPoint: 32 bytes
-    // CNewToken: Max 80 bytes
-    // CTokenTransfer: Token Name, CAmount ( 40 bytes)
-    // CReissueToken: Max 80 bytes
-    // CAmount: 8 bytes
-    // Token Name: Max 32 bytes
-    // Address: 40 bytes
-    // Block hash: 32 bytes
-    // CTxOut: CAmount + CScript (105 + 8 = 113 bytes)
-
     size_t size = 0;
-    size += memusage::DynamicUsage(vUndoTokenAmount);
-    size += memusage::DynamicUsage(setNewTransferTokensToRemove);
-    size += memusage::DynamicUsage(setNewTransferTokensToAdd);
-    size += memusage::DynamicUsage(setNewOwnerTokensToAdd);
-    size += memusage::DynamicUsage(setNewOwnerTokensToRemove);
-    size += memusage::DynamicUsage(vSpentTokens);
-    size += memusage::DynamicUsage(setNewTokensToAdd);
-    size += memusage::DynamicUsage(setNewTokensToRemove);
-    size += memusage::DynamicUsage(setNewReissueToAdd);
-    size += memusage::DynamicUsage(setNewReissueToRemove);
+    size += memusage::DeepDynamicUsage(vUndoTokenAmount);
+    size += memusage::DeepDynamicUsage(vSpentTokens);
+    size += memusage::DeepDynamicUsage(setNewTokensToAdd);
+    size += memusage::DeepDynamicUsage(setNewTokensToRemove);
+    size += memusage::DeepDynamicUsage(setNewReissueToAdd);
+    size += memusage::DeepDynamicUsage(setNewReissueToRemove);
+    size += memusage::DeepDynamicUsage(setNewOwnerTokensToAdd);
+    size += memusage::DeepDynamicUsage(setNewOwnerTokensToRemove);
+    size += memusage::DeepDynamicUsage(setNewTransferTokensToAdd);
+    size += memusage::DeepDynamicUsage(setNewTransferTokensToRemove);
+    size += memusage::DeepDynamicUsage(setNewQualifierAddressToAdd);
+    size += memusage::DeepDynamicUsage(setNewQualifierAddressToRemove);
+    size += memusage::DeepDynamicUsage(setNewRestrictedAddressToAdd);
+    size += memusage::DeepDynamicUsage(setNewRestrictedAddressToRemove);
+    size += memusage::DeepDynamicUsage(setNewRestrictedGlobalToAdd);
+    size += memusage::DeepDynamicUsage(setNewRestrictedGlobalToRemove);
+    size += memusage::DeepDynamicUsage(setNewRestrictedVerifierToAdd);
+    size += memusage::DeepDynamicUsage(setNewRestrictedVerifierToRemove);
+
+    for (const auto* map : {&mapRootQualifierAddressesAdd, &mapRootQualifierAddressesRemove}) {
+        size += memusage::DynamicUsage(*map);
+        for (const auto& item : *map)
+            size += memusage::DynamicUsage(item.first) + memusage::DeepDynamicUsage(item.second);
+    }
 
     return size;
 }
@@ -3556,11 +3515,17 @@ bool CTokensCache::CheckIfTokenExists(const std::string& name, bool fForceDuplic
             }
         } else {
             if (ptokensdb) {
-                CNewToken readToken;
-                int nHeight;
-                uint256 hash;
-                if (ptokensdb->ReadTokenData(name, readToken, nHeight, hash)) {
-                    ptokensCache->Put(readToken.strName, CDatabasedTokenData(readToken, nHeight, hash));
+                // The name index answers from memory, the metadata is only read if it can't be loaded
+                bool fExists = false;
+                if (!ptokensdb->HasTokenName(name, fExists)) {
+                    CNewToken readToken;
+                    int nHeight;
+                    uint256 hash;
+                    fExists = ptokensdb->ReadTokenData(name, readToken, nHeight, hash);
+                    if (fExists)
+                        ptokensCache->Put(readToken.strName, CDatabasedTokenData(readToken, nHeight, hash));
+                }
+                if (fExists) {
                     if (fForceDuplicateCheck) {
                         return true;
                     }
@@ -3630,9 +3595,8 @@ bool CTokensCache::GetTokenMetaDataIfExists(const std::string &name, CNewToken &
 
     // Check the cache, if it doesn't exist in the cache. Try and read it from database
     if (ptokensCache) {
-        if (ptokensCache->Exists(name)) {
-            CDatabasedTokenData data;
-            data = ptokensCache->Get(name);
+        CDatabasedTokenData data;
+        if (ptokensCache->Lookup(name, data)) {
             token = data.token;
             nHeight = data.nHeight;
             blockHash = data.blockHash;
@@ -3657,6 +3621,32 @@ bool CTokensCache::GetTokenMetaDataIfExists(const std::string &name, CNewToken &
     return false;
 }
 
+bool GetConfirmedTokenMetaData(const std::string& name, CNewToken& token, int& nHeight, uint256& blockHash)
+{
+    // ptokensCache only holds entries that agree with ptokens, so a hit needs no cs_main
+    CDatabasedTokenData data;
+    if (ptokensCache && ptokensCache->Lookup(name, data)) {
+        token = data.token;
+        nHeight = data.nHeight;
+        blockHash = data.blockHash;
+        return true;
+    }
+
+    LOCK(cs_main);
+    auto currentActiveTokenCache = GetCurrentTokenCache();
+    if (!currentActiveTokenCache)
+        return false;
+
+    return currentActiveTokenCache->GetTokenMetaDataIfExists(name, token, nHeight, blockHash);
+}
+
+bool GetConfirmedTokenMetaData(const std::string& name, CNewToken& token)
+{
+    int height;
+    uint256 hash;
+    return GetConfirmedTokenMetaData(name, token, height, hash);
+}
+
 bool GetTokenInfoFromScript(const CScript& scriptPubKey, std::string& strName, CAmount& nAmount, uint32_t& nTimeLock)
 {
     CTokenOutputEntry data;
@@ -3670,11 +3660,64 @@ bool GetTokenInfoFromScript(const CScript& scriptPubKey, std::string& strName, C
     return true;
 }
 
+bool TokenNameFromScript(const CScript& scriptPubKey, std::string& strName)
+{
+    int nType = 0;
+    int nScriptType = 0;
+    bool fIsOwner = false;
+    int nStartingIndex = 0;
+    if (!scriptPubKey.IsTokenScript(nType, nScriptType, fIsOwner, nStartingIndex))
+        return false;
+
+    // Every token payload is serialized starting with the token name
+    std::vector<unsigned char> vchToken(scriptPubKey.begin() + nStartingIndex, scriptPubKey.end());
+    CDataStream ssToken(vchToken, SER_NETWORK, PROTOCOL_VERSION);
+
+    try {
+        ssToken >> strName;
+    } catch(std::exception& e) {
+        return false;
+    }
+
+    return true;
+}
+
 bool GetTokenInfoFromCoin(const Coin& coin, std::string& strName, CAmount& nAmount, uint32_t& nTimeLock)
 {
     return GetTokenInfoFromScript(coin.out.scriptPubKey, strName, nAmount, nTimeLock);
 }
 
+namespace {
+//! What an encoded address was encoded from, so a hit is checked against the whole destination
+struct CEncodedTokenDestination
+{
+    CTxDestination dest;
+    std::string strAddress;
+};
+}
+
+std::string EncodeTokenDestination(const CTxDestination& dest)
+{
+    // Keyed by the first bytes of the hash, which an address that isn't a key or script hash has none of
+    uint64_t nKey;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest))
+        nKey = ReadLE64(keyID->begin());
+    else if (const CScriptID* scriptID = boost::get<CScriptID>(&dest))
+        nKey = ReadLE64(scriptID->begin());
+    else
+        return EncodeDestination(dest);
+
+    static CShardedLRUCache<uint64_t, CEncodedTokenDestination> cacheAddresses(MAX_CACHE_TOKEN_ADDRESSES);
+    CEncodedTokenDestination encoded;
+    if (cacheAddresses.Lookup(nKey, encoded) && encoded.dest == dest)
+        return encoded.strAddress;
+
+    encoded.dest = dest;
+    encoded.strAddress = EncodeDestination(dest);
+    cacheAddresses.Put(nKey, encoded);
+    return encoded.strAddress;
+}
+
 bool GetTokenData(const CScript& script, CTokenOutputEntry& data)
 {
     // Placeholder strings that will get set if you successfully get the transfer or token from the script
@@ -3700,23 +3743,23 @@ bool GetTokenData(const CScript& script, CTokenOutputEntry& data)
         if (TokenFromScript(script, token, address)) {
             data.type = TX_NEW_TOKEN;
             data.nAmount = token.nAmount;
-            data.destination = DecodeDestination(address);
+            ExtractDestination(script, data.destination);
             data.tokenName = token.strName;
             return true;
         } else if (MsgChannelTokenFromScript(script, token, address)) {
             data.type = TX_NEW_TOKEN;
             data.nAmount = token.nAmount;
-            data.destination = DecodeDestination(address);
+            ExtractDestination(script, data.destination);
             data.tokenName = token.strName;
         } else if (QualifierTokenFromScript(script, token, address)) {
             data.type = TX_NEW_TOKEN;
             data.nAmount = token.nAmount;
-            data.destination = DecodeDestination(address);
+            ExtractDestination(script, data.destination);
             data.tokenName = token.strName;
         } else if (RestrictedTokenFromScript(script, token, address)) {
             data.type = TX_NEW_TOKEN;
             data.nAmount = token.nAmount;
-            data.destination = DecodeDestination(address);
+            ExtractDestination(script, data.destination);
             data.tokenName = token.strName;
         }
     } else if (type == TX_TRANSFER_TOKEN) {
@@ -3724,7 +3767,7 @@ bool GetTokenData(const CScript& script, CTokenOutputEntry& data)
         if (TransferTokenFromScript(script, transfer, address)) {
             data.type = TX_TRANSFER_TOKEN;
             data.nAmount = transfer.nAmount;
-            data.destination = DecodeDestination(address);
+            ExtractDestination(script, data.destination);
             data.tokenName = transfer.strName;
             data.nTimeLock = transfer.nTimeLock;
             data.message = transfer.message;
@@ -3739,7 +3782,7 @@ bool GetTokenData(const CScript& script, CTokenOutputEntry& data)
         if (OwnerTokenFromScript(script, tokenName, address)) {
             data.type = TX_NEW_TOKEN;
             data.nAmount = OWNER_TOKEN_AMOUNT;
-            data.destination = DecodeDestination(address);
+            ExtractDestination(script, data.destination);
             data.tokenName = tokenName;
             return true;
         }
@@ -3750,7 +3793,7 @@ bool GetTokenData(const CScript& script, CTokenOutputEntry& data)
         if (ReissueTokenFromScript(script, reissue, address)) {
             data.type = TX_REISSUE_TOKEN;
             data.nAmount = reissue.nAmount;
-            data.destination = DecodeDestination(address);
+            ExtractDestination(script, data.destination);
             data.tokenName = reissue.strName;
             return true;
         }
@@ -3776,7 +3819,7 @@ void GetAllMyTokens(CWallet* pwallet, std::vector<std::string>& names, int nMinC
     std::map<std::string, std::vector<COutput> > mapTokens;
     pwallet->AvailableTokens(mapTokens, true, nullptr, 1, MAX_MONEY, MAX_MONEY, 0, nMinConf); // Set the mincof, set the rest to the defaults
 
-    for (auto item : mapTokens) {
+    for (const auto& item : mapTokens) {
         bool isOwner = IsTokenNameAnOwner(item.first);
 
         if (isOwner) {
@@ -3958,7 +4001,7 @@ bool GetAllMyTokenBalances(std::map<std::string, std::vector<COutput> >& outputs
     for (const auto& pair : outputs) {
         if (prefix.empty() || pair.first.find(prefix) == 0) { // Check for prefix
             CAmount balance = 0;
-            for (auto txout : pair.second) { // Compute balance of token by summing all Available Outputs
+            for (const auto& txout : pair.second) { // Compute balance of token by summing all Available Outputs
                 CTokenOutputEntry data;
                 if (GetTokenData(txout.tx->tx->vout[txout.i].scriptPubKey, data))
                     balance += data.nAmount;
@@ -3970,50 +4013,35 @@ bool GetAllMyTokenBalances(std::map<std::string, std::vector<COutput> >& outputs
     return true;
 }
 
-bool GetMyTokenBalance(const std::string& name, CAmount& balance, const int& confirmations) {
+bool GetAllMyTokenBalances(std::map<std::string, CAmount>& amounts, const int confirmations, const std::string& prefix) {
 
     // Return false if no wallet was found to compute token balances
     if (!vpwallets.size())
         return false;
 
-    // Get the map of tokennames to outputs
-    std::map<std::string, std::vector<COutput> > outputs;
-    vpwallets[0]->AvailableTokens(outputs, true, nullptr, 1, MAX_MONEY, MAX_MONEY, 0, confirmations);
-
-    // Loop through all pairs of Token Name -> vector<COutput>
-    if (outputs.count(name)) {
-        auto& ref = outputs.at(name);
-        for (const auto& txout : ref) {
-            CTokenOutputEntry data;
-            if (GetTokenData(txout.tx->tx->vout[txout.i].scriptPubKey, data)) {
-                balance += data.nAmount;
-            }
-        }
-    }
+    vpwallets[0]->GetTokenBalances(amounts, confirmations, prefix);
 
     return true;
 }
-#endif
 
-// 46 char base58 --> 34 char KAW compatible
-std::string DecodeTokenData(std::string encoded)
-{
-    if (encoded.size() == 46) {
-        std::vector<unsigned char> b;
-        DecodeBase58(encoded, b);
-        return std::string(b.begin(), b.end());
-    }
+bool GetMyTokenBalance(const std::string& name, CAmount& balance, const int& confirmations) {
 
-    else if (encoded.size() == 64 && IsHex(encoded)) {
-        std::vector<unsigned char> vec = ParseHex(encoded);
-        return std::string(vec.begin(), vec.end());
-    }
+    // Return false if no wallet was found to compute token balances
+    if (!vpwallets.size())
+        return false;
 
-    return "";
+    std::map<std::string, CAmount> amounts;
+    vpwallets[0]->GetTokenBalances(amounts, confirmations, name);
 
-};
+    auto it = amounts.find(name);
+    if (it != amounts.end())
+        balance += it->second;
 
-std::string EncodeTokenData(std::string decoded)
+    return true;
+}
+#endif
+
+std::string EncodeTokenData(const std::string& decoded)
 {
     if (decoded.size() == 34) {
         return EncodeIPFS(decoded);
@@ -4039,7 +4067,7 @@ bool GetAllMyLockedTokenBalances(std::map<std::string, std::vector<COutput> >& o
     for (const auto& pair : outputs) {
         if (prefix.empty() || pair.first.find(prefix) == 0) { // Check for prefix
             CAmount balance = 0;
-            for (auto txout : pair.second) { // Compute balance of asset by summing all Available Outputs
+            for (const auto& txout : pair.second) { // Compute balance of asset by summing all Available Outputs
                 CTokenOutputEntry data;
                 if (GetTokenData(txout.tx->tx->vout[txout.i].scriptPubKey, data))
                     balance += data.nAmount;
@@ -4052,7 +4080,7 @@ bool GetAllMyLockedTokenBalances(std::map<std::string, std::vector<COutput> >& o
 }
 
 // 46 char base58 --> 34 char KAW compatible
-std::string DecodeIPFS(std::string encoded)
+std::string DecodeIPFS(const std::string& encoded)
 {
     std::vector<unsigned char> b;
     DecodeBase58(encoded, b);
@@ -4060,12 +4088,8 @@ std::string DecodeIPFS(std::string encoded)
 };
 
 // 34 char KAW compatible --> 46 char base58
-std::string EncodeIPFS(std::string decoded){
-    std::vector<char> charData(decoded.begin(), decoded.end());
-    std::vector<unsigned char> unsignedCharData;
-    for (char c : charData)
-        unsignedCharData.push_back(static_cast<unsigned char>(c));
-    return EncodeBase58(unsignedCharData);
+std::string EncodeIPFS(const std::string& decoded){
+    return EncodeBase58(std::vector<unsigned char>(decoded.begin(), decoded.end()));
 };
 
 #ifdef ENABLE_WALLET
@@ -4076,18 +4100,16 @@ bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const C
     return CreateTokenTransaction(pwallet, coinControl, tokens, address, error, wtxNew, reservekey, nFeeRequired, message, verifier_string);
 }
 
-bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const std::vector<CNewToken> tokens, const std::string& address, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message, std::string* verifier_string)
+bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const std::vector<CNewToken>& tokens, const std::string& address, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message, std::string* verifier_string)
 {
     std::string change_address = EncodeDestination(coinControl.destChange);
 
     auto currentActiveTokenCache = GetCurrentTokenCache();
     // Validate the tokens data
     std::string strError;
-    for (auto token : tokens) {
-        if (!ContextualCheckNewToken(currentActiveTokenCache, token, strError)) {
-            error = std::make_pair(RPC_INVALID_PARAMETER, strError);
-            return false;
-        }
+    if (!ContextualCheckNewTokens(currentActiveTokenCache, tokens, strError)) {
+        error = std::make_pair(RPC_INVALID_PARAMETER, strError);
+        return false;
     }
 
     if (!change_address.empty()) {
@@ -4111,7 +4133,7 @@ bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const s
 
     KnownTokenType tokenType;
     std::string parentName;
-    for (auto token : tokens) {
+    for (const auto& token : tokens) {
         if (!IsTokenNameValid(token.strName, tokenType)) {
             error = std::make_pair(RPC_INVALID_PARAMETER, "Token name not valid");
             return false;
@@ -4181,21 +4203,17 @@ bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const s
 
     // Get the owner outpoints if this is a subtoken or unique token
     if (tokenType == KnownTokenType::SUB || tokenType == KnownTokenType::UNIQUE || tokenType == KnownTokenType::MSGCHANNEL) {
-        // Verify that this wallet is the owner for the token, and get the owner token outpoint
-        for (auto token : tokens) {
-            if (!VerifyWalletHasToken(parentName + OWNER_TAG, error)) {
-                return false;
-            }
+        // Verify that this wallet is the owner for the token, and get the owner token outpoint. All the tokens share it
+        if (!VerifyWalletHasToken(parentName + OWNER_TAG, error)) {
+            return false;
         }
     }
 
     // Get the owner outpoints if this is a sub_qualifier token
     if (tokenType == KnownTokenType::SUB_QUALIFIER) {
         // Verify that this wallet is the owner for the token, and get the owner token outpoint
-        for (auto token : tokens) {
-            if (!VerifyWalletHasToken(parentName, error)) {
-                return false;
-            }
+        if (!VerifyWalletHasToken(parentName, error)) {
+            return false;
         }
     }
 
@@ -4241,6 +4259,26 @@ bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const s
     return true;
 }
 
+void PackUniqueTokenIssues(const std::vector<CNewToken>& tokens, const std::string& address, std::vector<std::vector<CNewToken> >& vBatches)
+{
+    vBatches.clear();
+    const CScript scriptDest = GetScriptForDestination(DecodeDestination(address));
+    const size_t nMaxSize = MAX_STANDARD_TX_WEIGHT / WITNESS_SCALE_FACTOR - UNIQUE_ISSUE_RESERVED_TX_SIZE;
+
+    size_t nSize = 0;
+    for (const auto& token : tokens) {
+        CScript script = scriptDest;
+        token.ConstructTransaction(script);
+        size_t nOutputSize = ::GetSerializeSize(CTxOut(0, script), SER_NETWORK, PROTOCOL_VERSION);
+        if (vBatches.empty() || nSize + nOutputSize > nMaxSize) {
+            vBatches.emplace_back();
+            nSize = 0;
+        }
+        vBatches.back().push_back(token);
+        nSize += nOutputSize;
+    }
+}
+
 bool CreateReissueTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const CReissueToken& reissueToken, const std::string& address, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message, std::string* verifier_string)
 {
     // Create transaction variables
@@ -4427,7 +4465,7 @@ bool CreateReissueTokenTransaction(CWallet* pwallet, CCoinControl& coinControl,
 
 // nullTokenTxData -> Use this for freeze/unfreeze an address or adding a qualifier to an address
 // nullGlobalRestrictionData -> Use this to globally freeze/unfreeze a restricted token.
-bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinControl, const std::vector< std::pair<CTokenTransfer, std::string> >vTransfers, const std::string& changeAddress, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message, std::vector<std::pair<CNullTokenTxData, std::string> >* nullTokenTxData, std::vector<CNullTokenTxData>* nullGlobalRestrictionData)
+bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinControl, const std::vector< std::pair<CTokenTransfer, std::string> >vTransfers, const std::string& changeAddress, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message, std::vector<std::pair<CNullTokenTxData, std::string> >* nullTokenTxData, std::vector<CNullTokenTxData>* nullGlobalRestrictionData, bool sign)
 {
     // Initialize Values for transaction
     std::string strTxError;
@@ -4448,8 +4486,12 @@ bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinCo
         return false;
     }
 
+    // The tokens the wallet holds, looked up once for all the transfers
+    std::map<std::string, std::vector<COutput> > mapTokenCoins;
+    pwallet->AvailableTokens(mapTokenCoins);
+
     // Loop through all transfers and create scriptpubkeys for them
-    for (auto transfer : vTransfers) {
+    for (const auto& transfer : vTransfers) {
         std::string address = transfer.second;
         std::string token_name = transfer.first.strName;
         std::string message = transfer.first.message;
@@ -4467,8 +4509,10 @@ bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinCo
             return false;
         }
 
-        if (!VerifyWalletHasToken(token_name, error)) // Sets error if it fails
+        if (!mapTokenCoins.count(token_name)) {
+            error = std::make_pair(RPC_INVALID_REQUEST, strprintf("Wallet doesn't have token: %s", token_name));
             return false;
+        }
 
         // If it is an ownership transfer, make a quick check to make sure the amount is 1
         if (IsTokenNameAnOwner(token_name)) {
@@ -4525,7 +4569,7 @@ bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinCo
     if (nullTokenTxData) {
         std::string strError = "";
         int nAddTagCount = 0;
-        for (auto pair : *nullTokenTxData) {
+        for (const auto& pair : *nullTokenTxData) {
 
             if (IsTokenNameAQualifier(pair.first.token_name)) {
                 if (!VerifyQualifierChange(*ptokens, pair.first, pair.second, strError)) {
@@ -4559,7 +4603,7 @@ bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinCo
     // nullGlobalRestiotionData, the user wants to add OP_PLB_TOKEN OP_PLB_TOKEN OP_PLB_TOKENS data transaction to the transaction
     if (nullGlobalRestrictionData) {
         std::string strError = "";
-        for (auto dataObject : *nullGlobalRestrictionData) {
+        for (const auto& dataObject : *nullGlobalRestrictionData) {
 
             if (!VerifyGlobalRestrictedChange(*ptokens, dataObject, strError)) {
                 error = std::make_pair(RPC_INVALID_REQUEST, strError);
@@ -4574,7 +4618,7 @@ bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinCo
     }
 
     // Create and send the transaction
-    if (!pwallet->CreateTransactionWithTransferToken(vecSend, wtxNew, reservekey, nFeeRequired, message, nChangePosRet, strTxError, coinControl)) {
+    if (!pwallet->CreateTransactionWithTransferToken(vecSend, wtxNew, reservekey, nFeeRequired, message, nChangePosRet, strTxError, coinControl, sign)) {
         if (!fSubtractFeeFromAmount && nFeeRequired > curBalance) {
             error = std::make_pair(RPC_WALLET_ERROR, strprintf("Error: This transaction requires a transaction fee of at least %s", FormatMoney(nFeeRequired)));
             return false;
@@ -4645,7 +4689,7 @@ bool CheckEncoded(const std::string& hash, std::string& strError) {
 
 void GetTxOutKnownTokenTypes(const std::vector<CTxOut>& vout, int& issues, int& reissues, int& transfers, int& owners)
 {
-    for (auto out: vout) {
+    for (const CTxOut& out : vout) {
         int type;
         bool fIsOwner;
         if (out.scriptPubKey.IsTokenScript(type, fIsOwner)) {
@@ -4661,7 +4705,7 @@ void GetTxOutKnownTokenTypes(const std::vector<CTxOut>& vout, int& issues, int&
     }
 }
 
-bool ParseTokenScript(CScript scriptPubKey, uint160 &hashBytes, int& nScriptType, std::string &tokenName, CAmount &tokenAmount, uint32_t &nTimeLock) {
+bool ParseTokenScript(const CScript& scriptPubKey, uint160 &hashBytes, int& nScriptType, std::string &tokenName, CAmount &tokenAmount, uint32_t &nTimeLock) {
     int nType;
     bool fIsOwner;
     int _nStartingPoint;
@@ -4724,13 +4768,6 @@ bool ParseTokenScript(CScript scriptPubKey, uint160 &hashBytes, int& nScriptType
     return false;
 }
 
-CNullTokenTxData::CNullTokenTxData(const std::string &strTokenname, const int8_t &nFlag)
-{
-    SetNull();
-    this->token_name = strTokenname;
-    this->flag = nFlag;
-}
-
 bool CNullTokenTxData::IsValid(std::string &strError, CTokensCache &tokenCache, bool fForceCheckPrimaryTokenExists) const
 {
     KnownTokenType type;
@@ -4759,42 +4796,6 @@ bool CNullTokenTxData::IsValid(std::string &strError, CTokensCache &tokenCache,
     return true;
 }
 
-void CNullTokenTxData::ConstructTransaction(CScript &script) const
-{
-    CDataStream ssTokenTxData(SER_NETWORK, PROTOCOL_VERSION);
-    ssTokenTxData << *this;
-
-    std::vector<unsigned char> vchMessage;
-    vchMessage.insert(vchMessage.end(), ssTokenTxData.begin(), ssTokenTxData.end());
-    script << ToByteVector(vchMessage);
-}
-
-void CNullTokenTxData::ConstructGlobalRestrictionTransaction(CScript &script) const
-{
-    CDataStream ssTokenTxData(SER_NETWORK, PROTOCOL_VERSION);
-    ssTokenTxData << *this;
-
-    std::vector<unsigned char> vchMessage;
-    vchMessage.insert(vchMessage.end(), ssTokenTxData.begin(), ssTokenTxData.end());
-    script << OP_PLB_TOKEN << OP_RESERVED << OP_RESERVED << ToByteVector(vchMessage);
-}
-
-CNullTokenTxVerifierString::CNullTokenTxVerifierString(const std::string &verifier)
-{
-    SetNull();
-    this->verifier_string = verifier;
-}
-
-void CNullTokenTxVerifierString::ConstructTransaction(CScript &script) const
-{
-    CDataStream ssTokenTxData(SER_NETWORK, PROTOCOL_VERSION);
-    ssTokenTxData << *this;
-
-    std::vector<unsigned char> vchMessage;
-    vchMessage.insert(vchMessage.end(), ssTokenTxData.begin(), ssTokenTxData.end());
-    script << OP_PLB_TOKEN << OP_RESERVED << ToByteVector(vchMessage);
-}
-
 bool CTokensCache::GetTokenVerifierStringIfExists(const std::string &name, CNullTokenTxVerifierString& verifierString, bool fSkipTempCache)
 {
 
@@ -4919,17 +4920,25 @@ bool CTokensCache::CheckForAddressQualifier(const std::string &qualifier_name, c
     }
 
     // Check the cache, if it doesn't exist in the cache. Try and read it from database
-    if (ptokensQualifierCache) {
-        if (ptokensQualifierCache->Exists(cachedQualifierAddress.GetHash().GetHex())) {
+    uint64_t nCacheKey;
+    if (ptokensQualifierCache && FindRestrictedKey(qualifier_name, address, nCacheKey)) {
+        if (ptokensQualifierCache->Exists(nCacheKey)) {
             return true;
         }
     }
 
+    // The database answer may have been prefetched for the whole block
+    auto prefetched = mapPrefetchedAddressQualifiers.find(std::make_pair(address, qualifier_name));
+    if (prefetched != mapPrefetchedAddressQualifiers.end()) {
+        return prefetched->second;
+    }
+
     if (prestricteddb) {
 
         // Check for exact qualifier, and add to cache if it exists
         if (prestricteddb->ReadAddressQualifier(address, qualifier_name)) {
-            ptokensQualifierCache->Put(cachedQualifierAddress.GetHash().GetHex(), 1);
+            if (ptokensQualifierCache)
+                ptokensQualifierCache->Put(InternRestrictedKey(qualifier_name, address), 1);
             return true;
         }
 
@@ -4943,6 +4952,120 @@ bool CTokensCache::CheckForAddressQualifier(const std::string &qualifier_name, c
 }
 
 
+void CTokensCache::PrefetchAddressQualifiers(const std::set<std::pair<std::string, std::string>>& setLookups)
+{
+    if (!prestricteddb)
+        return;
+
+    // Lookups the qualifier cache already answers don't need the database
+    std::set<std::pair<std::string, std::string>> setMissing;
+    for (const auto& lookup : setLookups) {
+        if (mapPrefetchedAddressQualifiers.count(lookup))
+            continue;
+        uint64_t nCacheKey;
+        if (ptokensQualifierCache && FindRestrictedKey(lookup.second, lookup.first, nCacheKey) && ptokensQualifierCache->Exists(nCacheKey))
+            continue;
+        setMissing.insert(lookup);
+    }
+
+    if (setMissing.empty())
+        return;
+
+    std::set<std::pair<std::string, std::string>> setExact, setHeld;
+    if (!prestricteddb->ReadAddressQualifiers(setMissing, setExact, setHeld))
+        return;
+
+    for (const auto& lookup : setMissing) {
+        // Exact matches go into the qualifier cache, the same as a single lookup would put them there
+        if (ptokensQualifierCache && setExact.count(lookup))
+            ptokensQualifierCache->Put(InternRestrictedKey(lookup.second, lookup.first), 1);
+        mapPrefetchedAddressQualifiers[lookup] = setHeld.count(lookup) > 0;
+    }
+
+    LogPrint(BCLog::BENCH, "%s: Prefetched %u address qualifier lookups (%u held)\n", __func__, setMissing.size(), setHeld.size());
+}
+
+void CTokensCache::PrefetchBlockTokens(const CBlockTokenLookups& lookups)
+{
+    TRACE_SPAN("CTokensCache::PrefetchBlockTokens");
+    // ptokensCache must only hold entries that agree with ptokens, so leave out the tokens a dirty cache holds
+    std::set<std::string> setMissingTokens;
+    if (ptokensdb && ptokensCache) {
+        for (const auto& name : lookups.setTokens) {
+            if (mapReissuedTokenData.count(name) || ptokens->mapReissuedTokenData.count(name))
+                continue;
+
+            CNewToken token;
+            token.strName = name;
+            CTokenCacheNewToken cachedToken(token, "", 0, uint256());
+            if (setNewTokensToRemove.count(cachedToken) || ptokens->setNewTokensToRemove.count(cachedToken) ||
+                setNewTokensToAdd.count(cachedToken) || ptokens->setNewTokensToAdd.count(cachedToken))
+                continue;
+
+            if (!ptokensCache->Exists(name))
+                setMissingTokens.insert(name);
+        }
+    }
+
+    if (!setMissingTokens.empty()) {
+        std::map<std::string, CDatabasedTokenData> mapTokens;
+        if (ptokensdb->ReadTokensData(setMissingTokens, mapTokens)) {
+            for (const auto& item : mapTokens)
+                ptokensCache->Put(item.first, item.second);
+        }
+    }
+
+    PrefetchAddressQualifiers(lookups.setAddressQualifiers);
+
+    if (!prestricteddb)
+        return;
+
+    // Lookups the restriction caches already answer don't need the database
+    std::set<std::pair<std::string, std::string>> setMissingAddresses;
+    for (const auto& lookup : lookups.setAddressRestrictions) {
+        if (mapPrefetchedAddressRestrictions.count(lookup))
+            continue;
+        uint64_t nCacheKey;
+        if (ptokensRestrictionCache && FindRestrictedKey(lookup.first, lookup.second, nCacheKey) && ptokensRestrictionCache->Exists(nCacheKey))
+            continue;
+        setMissingAddresses.insert(lookup);
+    }
+
+    std::set<std::string> setMissingGlobals;
+    for (const auto& name : lookups.setGlobalRestrictions) {
+        if (mapPrefetchedGlobalRestrictions.count(name))
+            continue;
+        uint64_t nCacheKey;
+        if (ptokensGlobalRestrictionCache && FindRestrictedKey(name, nCacheKey) && ptokensGlobalRestrictionCache->Exists(nCacheKey))
+            continue;
+        setMissingGlobals.insert(name);
+    }
+
+    std::set<std::pair<std::string, std::string>> setFrozen;
+    if (!setMissingAddresses.empty() && prestricteddb->ReadRestrictedAddresses(setMissingAddresses, setFrozen)) {
+        for (const auto& lookup : setMissingAddresses) {
+            // Frozen addresses go into the restriction cache, the same as a single lookup would put them there
+            bool fFrozen = setFrozen.count(lookup) > 0;
+            if (fFrozen && ptokensRestrictionCache)
+                ptokensRestrictionCache->Put(InternRestrictedKey(lookup.first, lookup.second), 1);
+            mapPrefetchedAddressRestrictions[lookup] = fFrozen;
+        }
+    }
+
+    std::set<std::string> setGlobalFrozen;
+    if (!setMissingGlobals.empty() && prestricteddb->ReadGlobalRestrictions(setMissingGlobals, setGlobalFrozen)) {
+        for (const auto& name : setMissingGlobals) {
+            bool fFrozen = setGlobalFrozen.count(name) > 0;
+            if (fFrozen && ptokensGlobalRestrictionCache)
+                ptokensGlobalRestrictionCache->Put(InternRestrictedKey(name), 1);
+            mapPrefetchedGlobalRestrictions[name] = fFrozen;
+        }
+    }
+
+    LogPrint(BCLog::BENCH, "%s: Prefetched %u tokens, %u address restrictions and %u global restrictions\n", __func__,
+             setMissingTokens.size(), setMissingAddresses.size(), setMissingGlobals.size());
+}
+
 bool CTokensCache::CheckForAddressRestriction(const std::string &restricted_name, const std::string& address, bool fSkipTempCache)
 {
     /** There are circumstances where a blocks transactions could be removing or adding a restriction to an address,
@@ -4983,16 +5106,23 @@ bool CTokensCache::CheckForAddressRestriction(const std::string &restricted_name
     }
 
     // Check the cache, if it doesn't exist in the cache. Try and read it from database
-    if (ptokensRestrictionCache) {
-        if (ptokensRestrictionCache->Exists(cachedRestrictedAddress.GetHash().GetHex())) {
+    uint64_t nCacheKey;
+    if (ptokensRestrictionCache && FindRestrictedKey(restricted_name, address, nCacheKey)) {
+        if (ptokensRestrictionCache->Exists(nCacheKey)) {
             return true;
         }
     }
 
+    // The database answer may have been prefetched for the whole block
+    auto prefetched = mapPrefetchedAddressRestrictions.find(std::make_pair(restricted_name, address));
+    if (prefetched != mapPrefetchedAddressRestrictions.end()) {
+        return prefetched->second;
+    }
+
     if (prestricteddb) {
         if (prestricteddb->ReadRestrictedAddress(address, restricted_name)) {
             if (ptokensRestrictionCache) {
-                ptokensRestrictionCache->Put(cachedRestrictedAddress.GetHash().GetHex(), 1);
+                ptokensRestrictionCache->Put(InternRestrictedKey(restricted_name, address), 1);
             }
             return true;
         }
@@ -5042,16 +5172,23 @@ bool CTokensCache::CheckForGlobalRestriction(const std::string &restricted_name,
     }
 
     // Check the cache, if it doesn't exist in the cache. Try and read it from database
-    if (ptokensGlobalRestrictionCache) {
-        if (ptokensGlobalRestrictionCache->Exists(cachedRestrictedGlobal.tokenName)) {
+    uint64_t nCacheKey;
+    if (ptokensGlobalRestrictionCache && FindRestrictedKey(restricted_name, nCacheKey)) {
+        if (ptokensGlobalRestrictionCache->Exists(nCacheKey)) {
             return true;
         }
     }
 
+    // The database answer may have been prefetched for the whole block
+    auto prefetched = mapPrefetchedGlobalRestrictions.find(restricted_name);
+    if (prefetched != mapPrefetchedGlobalRestrictions.end()) {
+        return prefetched->second;
+    }
+
     if (prestricteddb) {
         if (prestricteddb->ReadGlobalRestriction(restricted_name)) {
             if (ptokensGlobalRestrictionCache)
-                ptokensGlobalRestrictionCache->Put(cachedRestrictedGlobal.tokenName, 1);
+                ptokensGlobalRestrictionCache->Put(InternRestrictedKey(restricted_name), 1);
             return true;
         }
     }
@@ -5067,7 +5204,7 @@ void ExtractVerifierStringQualifiers(const std::string& verifier, std::set<std::
     std::smatch match;
 
     while (std::regex_search(s,match,regexSearch)) {
-        for (auto str : match)
+        for (const auto& str : match)
             qualifiers.insert(str);
         s = match.suffix().str();
     }
@@ -5124,7 +5261,7 @@ bool CheckVerifierString(const std::string& verifier, std::set<std::string>& set
     // If the check address is empty
 
     // set all qualifiers in the verifier to true
-    for (auto qualifier : setFoundQualifiers) {
+    for (const auto& qualifier : setFoundQualifiers) {
 
         std::string edited_qualifier;
 
@@ -5351,6 +5488,132 @@ bool ContextualCheckVerifierTokenTxOut(const CTxOut& txout, CTokensCache* tokenC
     return true;
 }
 
+/**
+ * A verifier string together with the outcome of its non contextual checks, and compiled so that it can be evaluated
+ * against an address without parsing it again. Only depends on the string, so it is cached by the string itself.
+ */
+struct CCompiledVerifier
+{
+    //! Result of CheckVerifierString
+    bool fCheckPassed = false;
+    std::string strCheckError;
+    ErrorReport checkReport;
+
+    //! Qualifier names (with the '#') in the string, the qualifier at index i is bit i of the valuation
+    std::vector<std::string> vQualifiers;
+
+    //! Result of compiling the string. The length limit in CheckVerifierString keeps it well under the variable limit
+    bool fCompiled = false;
+    LibBoolEE::Program program;
+    ErrorReport compileReport;
+    std::string strCompileError;
+};
+
+static CShardedLRUCache<std::string, std::shared_ptr<const CCompiledVerifier>> compiledVerifierCache(MAX_CACHE_COMPILED_VERIFIERS_SIZE);
+
+static std::shared_ptr<const CCompiledVerifier> GetCompiledVerifier(const std::string& verifier)
+{
+    std::shared_ptr<const CCompiledVerifier> compiled;
+    if (compiledVerifierCache.Lookup(verifier, compiled))
+        return compiled;
+
+    auto entry = std::make_shared<CCompiledVerifier>();
+    std::set<std::string> setFoundQualifiers;
+    entry->fCheckPassed = CheckVerifierString(verifier, setFoundQualifiers, entry->strCheckError, &entry->checkReport);
+    if (entry->fCheckPassed) {
+        std::vector<std::string> vVariables(setFoundQualifiers.begin(), setFoundQualifiers.end());
+        for (const auto& qualifier : vVariables)
+            entry->vQualifiers.emplace_back(QUALIFIER_CHAR + qualifier);
+
+        try {
+            entry->program = LibBoolEE::compile(verifier, vVariables, &entry->compileReport);
+            entry->fCompiled = true;
+        } catch (const std::runtime_error& run_error) {
+            entry->strCompileError = run_error.what();
+        }
+    }
+
+    compiledVerifierCache.Put(verifier, entry);
+    return entry;
+}
+
+void GetBlockTokenLookups(CTokensCache* cache, const CCoinsViewCache& view, const std::vector<CTransactionRef>& vtx, CBlockTokenLookups& lookups)
+{
+    for (const auto& tx : vtx) {
+        if (!tx->IsCoinBase() && AreRestrictedTokensDeployed()) {
+            for (const auto& txin : tx->vin) {
+                // Coins created earlier in the block aren't in the view yet, those are looked up when they are spent
+                const Coin& coin = view.AccessCoin(txin.prevout);
+                if (coin.IsSpent() || !coin.IsToken())
+                    continue;
+
+                std::string strName;
+                if (!TokenNameFromScript(coin.out.scriptPubKey, strName) || !IsTokenNameAnRestricted(strName))
+                    continue;
+
+                CTokenOutputEntry data;
+                if (GetTokenData(coin.out.scriptPubKey, data))
+                    lookups.setAddressRestrictions.insert(std::make_pair(data.tokenName, EncodeDestination(data.destination)));
+            }
+        }
+
+        if (!tx->HasTokenOutputs())
+            continue;
+
+        for (unsigned int n = 0; n < tx->vout.size(); n++) {
+            const CTxTokenOutput* tokenOutput = tx->GetTokenOutput(n);
+            if (!tokenOutput)
+                continue;
+
+            if (tokenOutput->nType == TX_REISSUE_TOKEN) {
+                CReissueToken reissue;
+                std::string address;
+                if (ReissueTokenFromScript(tx->vout[n].scriptPubKey, reissue, address))
+                    lookups.setTokens.insert(reissue.strName);
+                continue;
+            }
+
+            CTokenTransfer transfer;
+            std::string address;
+            if (tokenOutput->nType != TX_TRANSFER_TOKEN || !TransferTokenFromTx(*tx, n, transfer, address))
+                continue;
+
+            // Transfers of owner tokens don't check the token metadata
+            if (!IsTokenNameAnOwner(transfer.strName))
+                lookups.setTokens.insert(transfer.strName);
+
+            if (!IsTokenNameAnRestricted(transfer.strName) || !AreRestrictedTokensDeployed())
+                continue;
+
+            lookups.setGlobalRestrictions.insert(transfer.strName);
+
+            // Restricted transfers are verified against the verifier string held by ptokens and the database
+            CNullTokenTxVerifierString verifier;
+            if (!cache->GetTokenVerifierStringIfExists(transfer.strName, verifier, true) || verifier.verifier_string == "true")
+                continue;
+
+            std::shared_ptr<const CCompiledVerifier> compiled = GetCompiledVerifier(verifier.verifier_string);
+            if (!compiled->fCheckPassed)
+                continue;
+            for (const auto& qualifier : compiled->vQualifiers) {
+                lookups.setTokens.insert(qualifier);
+                lookups.setAddressQualifiers.insert(std::make_pair(address, qualifier));
+            }
+        }
+    }
+}
+
+//  Fill in the caller's report the way the check that produced the cached report would have
+static void ApplyErrorReport(const ErrorReport& cached, ErrorReport* errorReport)
+{
+    if (!errorReport || cached.type == ErrorReport::ErrorType::NotSetError)
+        return;
+
+    errorReport->type = cached.type;
+    errorReport->strDevData = cached.strDevData;
+    errorReport->vecUserData.insert(errorReport->vecUserData.end(), cached.vecUserData.begin(), cached.vecUserData.end());
+}
+
 bool ContextualCheckVerifierString(CTokensCache* cache, const std::string& verifier, const std::string& check_address, std::string& strError, ErrorReport* errorReport)
 {
     // If verifier is set to true, return true
@@ -5358,13 +5621,15 @@ bool ContextualCheckVerifierString(CTokensCache* cache, const std::string& verif
         return true;
 
     // Check against the non contextual changes first
-    std::set<std::string> setFoundQualifiers;
-    if (!CheckVerifierString(verifier, setFoundQualifiers, strError, errorReport))
+    std::shared_ptr<const CCompiledVerifier> compiled = GetCompiledVerifier(verifier);
+    if (!compiled->fCheckPassed) {
+        strError = compiled->strCheckError;
+        ApplyErrorReport(compiled->checkReport, errorReport);
         return false;
+    }
 
     // Loop through each qualifier and make sure that the token exists
-    for(auto qualifier : setFoundQualifiers) {
-        std::string search = QUALIFIER_CHAR + qualifier;
+    for (const auto& search : compiled->vQualifiers) {
         if (!cache->CheckIfTokenExists(search, true)) {
             if (errorReport) {
                 errorReport->type = ErrorReport::ErrorType::TokenDoesntExist;
@@ -5381,50 +5646,42 @@ bool ContextualCheckVerifierString(CTokensCache* cache, const std::string& verif
     if (check_address.empty())
         return true;
 
-    // Create an object that stores if an address contains a qualifier
-    LibBoolEE::Vals vals;
-
-    // Add the qualifiers into the vals object
-    for (auto qualifier : setFoundQualifiers) {
-        std::string search = QUALIFIER_CHAR + qualifier;
-
-        // Check to see if the address contains the qualifier
-        bool has_qualifier = cache->CheckForAddressQualifier(search, check_address, true);
-
-        // Add the true or false value into the vals
-        vals.insert(std::make_pair(qualifier, has_qualifier));
-    }
-
-    try {
-        bool ret = LibBoolEE::resolve(verifier, vals, errorReport);
-        if (!ret) {
-            if (errorReport) {
-                if (errorReport->type == ErrorReport::ErrorType::NotSetError) {
-                    errorReport->type = ErrorReport::ErrorType::FailedToVerifyAgainstAddress;
-                    errorReport->vecUserData.emplace_back(check_address);
-                    errorReport->strDevData = "bad-txns-null-verifier-address-failed-verification";
-                }
+    if (!compiled->fCompiled) {
+        if (errorReport) {
+            ApplyErrorReport(compiled->compileReport, errorReport);
+            if (errorReport->type == ErrorReport::ErrorType::NotSetError) {
+                errorReport->type = ErrorReport::ErrorType::InvalidSyntax;
             }
 
-            error("%s : The address %s failed to verify against: %s. Is null %d", __func__, check_address, verifier, errorReport ? 0 : 1);
-            strError = "bad-txns-null-verifier-address-failed-verification";
+            errorReport->vecUserData.emplace_back(compiled->strCompileError);
+            errorReport->strDevData = "bad-txns-null-verifier-failed-contexual-syntax-check";
         }
-        return ret;
 
-    } catch (const std::runtime_error& run_error) {
+        strError = "bad-txns-null-verifier-failed-contexual-syntax-check";
+        return error("%s : Verifier string failed to resolve. Please check string syntax - exception: %s\n", __func__, compiled->strCompileError);
+    }
+
+    // Set a bit for every qualifier the address holds
+    uint64_t valuation = 0;
+    for (size_t i = 0; i < compiled->vQualifiers.size(); i++) {
+        if (cache->CheckForAddressQualifier(compiled->vQualifiers[i], check_address, true))
+            valuation |= uint64_t(1) << i;
+    }
 
+    bool ret = LibBoolEE::evaluate(compiled->program, valuation);
+    if (!ret) {
         if (errorReport) {
             if (errorReport->type == ErrorReport::ErrorType::NotSetError) {
-                errorReport->type = ErrorReport::ErrorType::InvalidSyntax;
+                errorReport->type = ErrorReport::ErrorType::FailedToVerifyAgainstAddress;
+                errorReport->vecUserData.emplace_back(check_address);
+                errorReport->strDevData = "bad-txns-null-verifier-address-failed-verification";
             }
-
-            errorReport->vecUserData.emplace_back(run_error.what());
-            errorReport->strDevData = "bad-txns-null-verifier-failed-contexual-syntax-check";
         }
 
-        strError = "bad-txns-null-verifier-failed-contexual-syntax-check";
-        return error("%s : Verifier string failed to resolve. Please check string syntax - exception: %s\n", __func__, run_error.what());
+        error("%s : The address %s failed to verify against: %s. Is null %d", __func__, check_address, verifier, errorReport ? 0 : 1);
+        strError = "bad-txns-null-verifier-address-failed-verification";
     }
+    return ret;
 }
 
 bool ContextualCheckTransferToken(CTokensCache* tokenCache, const CTokenTransfer& transfer, const std::string& address, std::string& strError)
@@ -5646,6 +5903,21 @@ bool CheckNewToken(const CNewToken& token, std::string& strError)
     return true;
 }
 
+bool ContextualCheckNewTokens(CTokensCache* tokenCache, const std::vector<CNewToken>& tokens, std::string& strError, bool fCheckMempool)
+{
+    std::set<std::string> setNames;
+    for (const auto& token : tokens) {
+        if (!setNames.insert(token.strName).second) {
+            strError = std::string(_("Invalid parameter: token_name '")) + token.strName + std::string(_("' is issued more than once"));
+            return false;
+        }
+        if (!ContextualCheckNewToken(tokenCache, token, strError, fCheckMempool))
+            return false;
+    }
+
+    return true;
+}
+
 bool ContextualCheckNewToken(CTokensCache* tokenCache, const CNewToken& token, std::string& strError, bool fCheckMempool)
 {
     if (!AreTokensDeployed() && !fUnitTest) {
@@ -5917,7 +6189,7 @@ bool ContextualCheckReissueToken(CTokensCache* tokenCache, const CReissueToken&
 
 bool ContextualCheckUniqueTokenTx(CTokensCache* tokenCache, std::string& strError, const CTransaction& tx)
 {
-    for (auto out : tx.vout)
+    for (const CTxOut& out : tx.vout)
     {
         if (IsScriptNewUniqueToken(out.scriptPubKey))
         {
@@ -5946,7 +6218,7 @@ bool ContextualCheckUniqueToken(CTokensCache* tokenCache, const CNewToken& uniqu
 
 bool ContextualCheckUsernameTokenTx(CTokensCache* tokenCache, std::string& strError, const CTransaction& tx)
 {
-    for (auto out : tx.vout)
+    for (const CTxOut& out : tx.vout)
     {
         if (IsScriptNewUsername(out.scriptPubKey))
         {
@@ -48,6 +48,9 @@
 #define UNIQUE_TOKENS_ROYALTIES_ADDRESS ""
 #define UNIQUE_TOKENS_ROYALTIES_AMOUNT 0
 
+//! Bytes of a unique issuance transaction kept for its inputs, burn, owner change and change outputs
+#define UNIQUE_ISSUE_RESERVED_TX_SIZE 20000
+
 #define RESTRICTED_CHAR '$'
 #define QUALIFIER_CHAR '#'
 
@@ -66,6 +69,7 @@ class CDataStream;
 class CTransaction;
 class CTxOut;
 class Coin;
+class CCoinsViewCache;
 class CWallet;
 class CReserveKey;
 class CWalletTx;
@@ -76,6 +80,10 @@ class COutput;
 
 // 2500 * 82 Bytes == 205 KB (kilobytes) of memory
 #define MAX_CACHE_TOKENS_SIZE 2500
+#define MAX_CACHE_TOKEN_ADDRESSES 50000
+
+// A compiled verifier string takes a few hundred bytes, so 4000 of them stay within about 2 MB
+#define MAX_CACHE_COMPILED_VERIFIERS_SIZE 4000
 
 // Create map that store that state of current reissued transaction that the mempool as accepted.
 // If an token name is in this map, any other reissue transactions wont be accepted into the mempool
@@ -84,7 +92,7 @@ extern std::map<std::string, uint256> mapReissuedTokens;
 
 class CTokens {
 public:
-    std::map<std::pair<std::string, std::string>, CAmount> mapTokensAddressAmount; // pair < Token Name , Address > -> Quantity of tokens in the address
+    CTokenAddressAmountMap mapTokensAddressAmount; // pair < Token Name , Address > -> Quantity of tokens in the address
 
     // Dirty, Gets wiped once flushed to database
     std::map<std::string, CNewToken> mapReissuedTokenData; // Token Name -> New Token Data
@@ -134,6 +142,22 @@ struct ErrorReport {
 
 std::string GetUserErrorString(const ErrorReport& report);
 
+/** The token state a block looks up while it is connected, gathered in one walk over the block */
+struct CBlockTokenLookups
+{
+    //! Tokens whose metadata the transfers and reissues check
+    std::set<std::string> setTokens;
+
+    //! Restricted tokens transferred, checked for a global freeze
+    std::set<std::string> setGlobalRestrictions;
+
+    //! <Restricted token, Address> pairs spent from, checked for a frozen address
+    std::set<std::pair<std::string, std::string>> setAddressRestrictions;
+
+    //! <Address, Qualifier> pairs the verifier strings of the restricted transfers check
+    std::set<std::pair<std::string, std::string>> setAddressQualifiers;
+};
+
 class CTokensCache : public CTokens
 {
 private:
@@ -181,6 +205,20 @@ public :
     std::map<CTokenCacheRootQualifierChecker, std::set<std::string> > mapRootQualifierAddressesAdd;
     std::map<CTokenCacheRootQualifierChecker, std::set<std::string> > mapRootQualifierAddressesRemove;
 
+    //! Database answers to <Address, Qualifier> lookups loaded by PrefetchAddressQualifiers, true when the address holds
+    //! the qualifier or one of its sub qualifiers. Memory only and never copied or flushed: it is only valid while the
+    //! restricted database isn't written, so it is filled on the block local cache ConnectBlock works on.
+    std::map<std::pair<std::string, std::string>, bool> mapPrefetchedAddressQualifiers;
+
+    //! Database answers to <Restricted token, Address> and global restriction lookups loaded by PrefetchBlockTokens,
+    //! true when frozen. Held under the same rules as mapPrefetchedAddressQualifiers.
+    std::map<std::pair<std::string, std::string>, bool> mapPrefetchedAddressRestrictions;
+    std::map<std::string, bool> mapPrefetchedGlobalRestrictions;
+
+    //! An empty cache acts as a copy-on-write overlay of the global ptokens cache: every lookup
+    //! falls through to ptokens (and then the database) and Flush() merges only the deltas
+    //! recorded here. Prefer it over copying GetCurrentTokenCache(), which duplicates every
+    //! dirty set held in memory.
     CTokensCache() : CTokens()
     {
         SetNull();
@@ -319,18 +357,25 @@ public :
     //! Return true if the address has the given qualifier assigned to it
     bool CheckForAddressQualifier(const std::string &qualifier_name, const std::string& address, bool fSkipTempCache = false);
 
+    //! Resolve a batch of <Address, Qualifier> lookups in one pass over the restricted database, so the
+    //! CheckForAddressQualifier calls that follow don't each go to the database
+    void PrefetchAddressQualifiers(const std::set<std::pair<std::string, std::string>>& setLookups);
+
+    //! Load everything a block looks up from the token and restricted databases up front, in key order, so
+    //! connecting its transactions doesn't stall on one cold database read after another
+    void PrefetchBlockTokens(const CBlockTokenLookups& lookups);
+
     //! Return true if the address is marked as frozen
     bool CheckForAddressRestriction(const std::string &restricted_name, const std::string& address, bool fSkipTempCache = false);
 
     //! Return true if the restricted token is globally freezing trading
     bool CheckForGlobalRestriction(const std::string &restricted_name, bool fSkipTempCache = false);
 
-    //! Calculate the size of the CTokens (in bytes)
+    //! Calculate the memory used by every container of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
-    //! Get the size of the none databased cache
+    //! Get the memory used by the none databased cache (in bytes)
     size_t GetCacheSize() const;
-    size_t GetCacheSizeV2() const;
 
     //! Flush all new cache entries into the ptokens global cache
     bool Flush();
@@ -373,6 +418,10 @@ public :
 
         mapRootQualifierAddressesAdd.clear();
         mapRootQualifierAddressesRemove.clear();
+
+        mapPrefetchedAddressQualifiers.clear();
+        mapPrefetchedAddressRestrictions.clear();
+        mapPrefetchedGlobalRestrictions.clear();
     }
 
    std::string CacheToString() const {
@@ -457,6 +506,12 @@ bool MsgChannelTokenFromTransaction(const CTransaction& tx, CNewToken& token, st
 bool QualifierTokenFromTransaction(const CTransaction& tx, CNewToken& token, std::string& strAddress);
 bool RestrictedTokenFromTransaction(const CTransaction& tx, CNewToken& token, std::string& strAddress);
 
+//! Token output n of tx with its transfer or new token decoded, null if it isn't a token output. The outputs
+//! of a transaction are decoded once and the result shared by every caller and every copy of the transaction
+const CTxTokenOutput* GetTxTokenOutput(const CTransaction& tx, uint32_t n);
+bool TransferTokenFromTx(const CTransaction& tx, uint32_t n, CTokenTransfer& tokenTransfer, std::string& strAddress);
+bool TokenFromTx(const CTransaction& tx, uint32_t n, CNewToken& token, std::string& strAddress);
+
 //! Get specific token type metadata from the given scripts
 bool TransferTokenFromScript(const CScript& scriptPubKey, CTokenTransfer& tokenTransfer, std::string& strAddress);
 bool TokenFromScript(const CScript& scriptPubKey, CNewToken& token, std::string& strAddress);
@@ -530,36 +585,52 @@ bool IsNewOwnerTxValid(const CTransaction& tx, const std::string& tokenName, con
 void GetAllAdministrativeTokens(CWallet *pwallet, std::vector<std::string> &names, int nMinConf = 1);
 void GetAllMyTokens(CWallet* pwallet, std::vector<std::string>& names, int nMinConf = 1, bool fIncludeAdministrator = false, bool fOnlyAdministrator = false);
 
+//! Get the metadata of an token from the active chain state. Hits in the metadata cache are served without cs_main,
+//! cs_main is only taken to resolve a miss
+bool GetConfirmedTokenMetaData(const std::string& name, CNewToken& token, int& nHeight, uint256& blockHash);
+bool GetConfirmedTokenMetaData(const std::string& name, CNewToken& token);
+
 bool GetTokenInfoFromCoin(const Coin& coin, std::string& strName, CAmount& nAmount, uint32_t& nTimeLock);
 bool GetTokenInfoFromScript(const CScript& scriptPubKey, std::string& strName, CAmount& nAmount, uint32_t& nTokenLockTime);
+/** Reads only the token name of a token script, without decoding its destination */
+bool TokenNameFromScript(const CScript& scriptPubKey, std::string& strName);
 
 bool GetTokenData(const CScript& script, CTokenOutputEntry& data);
 
+//! EncodeDestination for the addresses of token outputs, which remembers the addresses it encoded recently so the
+//! holders that keep receiving a token aren't base58check encoded again for every output
+std::string EncodeTokenDestination(const CTxDestination& dest);
+
 bool GetBestTokenAddressAmount(CTokensCache& cache, const std::string& tokenName, const std::string& address);
 
 
 //! Decode and Encode IPFS hashes, or OIP hashes
-std::string DecodeTokenData(std::string encoded);
-std::string EncodeTokenData(std::string decoded);
-std::string DecodeIPFS(std::string encoded);
-std::string EncodeIPFS(std::string decoded);
+std::string DecodeTokenData(const std::string& encoded);
+std::string EncodeTokenData(const std::string& decoded);
+std::string DecodeIPFS(const std::string& encoded);
+std::string EncodeIPFS(const std::string& decoded);
 
 #ifdef ENABLE_WALLET
 
 bool GetAllMyTokenBalances(std::map<std::string, std::vector<COutput> >& outputs, std::map<std::string, CAmount>& amounts, const int confirmations = 0, const std::string& prefix = "");
+//! Balances only, from the wallet's token ledger without collecting outputs
+bool GetAllMyTokenBalances(std::map<std::string, CAmount>& amounts, const int confirmations = 0, const std::string& prefix = "");
 bool GetAllMyLockedTokenBalances(std::map<std::string, std::vector<COutput> >& outputs, std::map<std::string, CAmount>& amounts, const std::string& prefix = "");
 bool GetMyTokenBalance(const std::string& name, CAmount& balance, const int& confirmations);
 
 //! Creates new token issuance transaction
 bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const CNewToken& token, const std::string& address, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message = "", std::string* verifier_string = nullptr);
-bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const std::vector<CNewToken> tokens, const std::string& address, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message = "", std::string* verifier_string = nullptr);
+bool CreateTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const std::vector<CNewToken>& tokens, const std::string& address, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message = "", std::string* verifier_string = nullptr);
+
+//! Split unique token issuances to address into batches, in order, that each fit in one standard transaction
+void PackUniqueTokenIssues(const std::vector<CNewToken>& tokens, const std::string& address, std::vector<std::vector<CNewToken> >& vBatches);
 
 //! Create a reissue token transaction
 bool CreateReissueTokenTransaction(CWallet* pwallet, CCoinControl& coinControl, const CReissueToken& token, const std::string& address, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message = "", std::string* verifier_string = nullptr);
 
 
 //! Create a transfer token transaction
-bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinControl, const std::vector< std::pair<CTokenTransfer, std::string> >vTransfers, const std::string& changeAddress, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message = "", std::vector<std::pair<CNullTokenTxData, std::string> >* nullTokenTxData = nullptr, std::vector<CNullTokenTxData>* nullGlobalRestrictionData = nullptr);
+bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinControl, const std::vector< std::pair<CTokenTransfer, std::string> >vTransfers, const std::string& changeAddress, std::pair<int, std::string>& error, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRequired, std::string message = "", std::vector<std::pair<CNullTokenTxData, std::string> >* nullTokenTxData = nullptr, std::vector<CNullTokenTxData>* nullGlobalRestrictionData = nullptr, bool sign = true);
 
 //! Send any type of token transaction to the network
 bool SendTokenTransaction(CWallet* pwallet, CWalletTx& transaction, CReserveKey& reserveKey, std::pair<int, std::string>& error, std::string& txid);
@@ -569,7 +640,7 @@ bool VerifyWalletHasToken(const std::string& token_name, std::pair<int, std::str
 #endif
 
 /** Helper method for extracting address bytes, token name and amount from an token script */
-bool ParseTokenScript(CScript scriptPubKey, uint160 &hashBytes, int& nScriptType, std::string &tokenName, CAmount &tokenAmount, uint32_t &nTimeLock);
+bool ParseTokenScript(const CScript& scriptPubKey, uint160 &hashBytes, int& nScriptType, std::string &tokenName, CAmount &tokenAmount, uint32_t &nTimeLock);
 
 /** Helper method for extracting #TAGS from a verifier string */
 void ExtractVerifierStringQualifiers(const std::string& verifier, std::set<std::string>& qualifiers);
@@ -591,8 +662,12 @@ bool CheckReissueToken(const CReissueToken& token, std::string& strError);
 bool ContextualCheckNullTokenTxOut(const CTxOut& txout, CTokensCache* tokenCache, std::string& strError, std::vector<std::pair<std::string, CNullTokenTxData>>* myNullTokenData = nullptr);
 bool ContextualCheckGlobalTokenTxOut(const CTxOut& txout, CTokensCache* tokenCache, std::string& strError);
 bool ContextualCheckVerifierTokenTxOut(const CTxOut& txout, CTokensCache* tokenCache, std::string& strError);
+//! Gather the token state the transactions in vtx will look up while they are connected, see CBlockTokenLookups
+void GetBlockTokenLookups(CTokensCache* cache, const CCoinsViewCache& view, const std::vector<CTransactionRef>& vtx, CBlockTokenLookups& lookups);
 bool ContextualCheckVerifierString(CTokensCache* cache, const std::string& verifier, const std::string& check_address, std::string& strError, ErrorReport* errorReport = nullptr);
 bool ContextualCheckNewToken(CTokensCache* tokenCache, const CNewToken& token, std::string& strError, bool fCheckMempool = false);
+//! ContextualCheckNewToken for every token of a bulk issuance, which also must not repeat a name
+bool ContextualCheckNewTokens(CTokensCache* tokenCache, const std::vector<CNewToken>& tokens, std::string& strError, bool fCheckMempool = false);
 bool ContextualCheckTransferToken(CTokensCache* tokenCache, const CTokenTransfer& transfer, const std::string& address, std::string& strError);
 bool ContextualCheckReissueToken(CTokensCache* tokenCache, const CReissueToken& reissue_token, std::string& strError, const CTransaction& tx);
 bool ContextualCheckReissueToken(CTokensCache* tokenCache, const CReissueToken& reissue_token, std::string& strError);
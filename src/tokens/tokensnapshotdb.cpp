@@ -4,13 +4,471 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "tokensnapshotdb.h"
+#include "tokendb.h"
 #include "validation.h"
 #include "base58.h"
+#include "blockcompression.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "util.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/thread.hpp>
 
-static const char SNAPSHOTCHECK_FLAG = 'C'; // Snapshot Check
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+static const char SNAPSHOTCHECK_FLAG = 'C'; // Snapshot Check, written by older versions
+static const char SNAPSHOTPART_FLAG = 'P'; // Snapshot owners of a snapshot check entry, written by older versions
+static const char SNAPSHOTHEADER_FLAG = 'H'; // Snapshot header, by height and name
+static const char SNAPSHOTDATA_FLAG = 'D'; // Snapshot owners or changes, by storage id and part
+static const char SNAPSHOTID_FLAG = 'I'; // Next snapshot storage id
+
+//  Owners per part, and the batch size at which the parts are written out while the snapshot is built
+static const size_t SNAPSHOT_PART_SIZE = 1000;
+static const size_t SNAPSHOT_BATCH_SIZE = 1 << 20;
+//  Largest part accepted when it is decompressed
+static const size_t SNAPSHOT_PART_MAX_BYTES = 1 << 20;
+
+//  A snapshot is stored in full again once the last one of the token changed more than 1/SNAPSHOT_REBASE_RATIO of its owners
+static const uint64_t SNAPSHOT_REBASE_RATIO = 2;
+
+//  The amount of an owner that a snapshot no longer has, in the changes from its base
+static const CAmount SNAPSHOT_REMOVED = -1;
+
+//  The first byte of a stored part: whether the records after it are LZ4 compressed
+static const unsigned char SNAPSHOT_PART_RAW = 0;
+static const unsigned char SNAPSHOT_PART_COMPRESSED = 1;
+
+namespace {
+struct CTokenSnapshotJob
+{
+    CTokenSnapshotDB* pdb;
+    std::string tokenName;
+    int height;
+    std::unique_ptr<CTokenAddressDirView> view;
+};
+
+std::mutex csSnapshotWorker;
+std::condition_variable condSnapshotWorker;
+std::deque<CTokenSnapshotJob> queueSnapshotJobs;
+std::thread threadSnapshotWorker;
+bool fSnapshotWorkerRunning = false;
+bool fSnapshotWorkerStop = false;
+//  The queued snapshots until they are written, and the ones that failed
+std::map<std::pair<std::string, int>, CTokenSnapshotProgress> mapSnapshotProgress;
+//  The snapshot the worker is writing, readers of a pending snapshot wait on condSnapshotWritten
+bool fSnapshotWriting = false;
+std::pair<std::string, int> keySnapshotWriting;
+std::condition_variable condSnapshotWritten;
+
+//  Held while snapshots are read, written or removed, the parts of a base are only dropped once no snapshot needs them.
+//      The worker takes its jobs with it held, so a removal either cancels a queued snapshot or comes after it is in.
+std::recursive_mutex csSnapshotStore;
+}
+
+/**
+ * Where and how a snapshot is stored. Its owners are the nParts parts under nId when nBaseId is 0. Otherwise those
+ * parts hold the changes from the full snapshot stored under nBaseId, in the same order: the owners that differ with
+ * their new amount, and the ones that are gone with SNAPSHOT_REMOVED. Parts are kept until no header refers to them.
+ */
+struct CTokenSnapshotHeader
+{
+    std::string tokenName;
+    int height;
+    uint32_t nId;
+    uint32_t nParts;
+    uint32_t nBaseId;
+    uint32_t nBaseParts;
+    uint64_t nOwners;
+    uint64_t nChanges;
+
+    CTokenSnapshotHeader() : height(0), nId(0), nParts(0), nBaseId(0), nBaseParts(0), nOwners(0), nChanges(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template<typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(tokenName);
+        READWRITE(height);
+        READWRITE(nId);
+        READWRITE(nParts);
+        READWRITE(nBaseId);
+        READWRITE(nBaseParts);
+        READWRITE(VARINT(nOwners));
+        READWRITE(VARINT(nChanges));
+    }
+};
+
+//  An owner in a stored part, the script of the address rather than its text
+struct CSnapshotOwnerRecord
+{
+    CScript script;
+    CAmount amount;
+
+    CSnapshotOwnerRecord() : amount(0) {}
+    CSnapshotOwnerRecord(const CScript & p_script, CAmount p_amount) : script(p_script), amount(p_amount) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template<typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(script);
+        //  Shifted by one so SNAPSHOT_REMOVED fits the varint
+        uint64_t nCode = amount + 1;
+        READWRITE(VARINT(nCode));
+        if (ser_action.ForRead())
+            amount = (CAmount)nCode - 1;
+    }
+};
+
+//  Read the value at exactly key through the cursor
+template <typename K, typename V>
+static bool ReadAtCursor(CDBIterator & p_cursor, const K & p_key, V & p_value)
+{
+    p_cursor.Seek(p_key);
+    K key;
+    return p_cursor.Valid() && p_cursor.GetKey(key) && key == p_key && p_cursor.GetValue(p_value);
+}
+
+static void WriteSnapshotPart(CDBBatch & p_batch, uint32_t p_id, uint32_t p_part, const std::vector<CSnapshotOwnerRecord> & p_records)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << p_records;
+
+    std::vector<unsigned char> vValue;
+    if (CompressBlockRecord((const unsigned char*)ss.data(), ss.size(), vValue)) {
+        vValue.insert(vValue.begin(), SNAPSHOT_PART_COMPRESSED);
+    } else {
+        vValue.assign(1, SNAPSHOT_PART_RAW);
+        vValue.insert(vValue.end(), (const unsigned char*)ss.data(), (const unsigned char*)ss.data() + ss.size());
+    }
+    p_batch.Write(std::make_pair(SNAPSHOTDATA_FLAG, std::make_pair(p_id, p_part)), vValue);
+}
+
+static bool ReadSnapshotPart(CDBIterator & p_cursor, uint32_t p_id, uint32_t p_part, std::vector<CSnapshotOwnerRecord> & p_records)
+{
+    std::vector<unsigned char> vValue;
+    if (!ReadAtCursor(p_cursor, std::make_pair(SNAPSHOTDATA_FLAG, std::make_pair(p_id, p_part)), vValue) || vValue.empty())
+        return false;
+
+    std::vector<unsigned char> vData;
+    if (vValue[0] == SNAPSHOT_PART_COMPRESSED) {
+        if (!DecompressBlockRecord(vValue.data() + 1, vValue.size() - 1, vData, SNAPSHOT_PART_MAX_BYTES))
+            return false;
+    } else if (vValue[0] == SNAPSHOT_PART_RAW) {
+        vData.assign(vValue.begin() + 1, vValue.end());
+    } else {
+        return false;
+    }
+
+    try {
+        CDataStream ss(vData, SER_DISK, CLIENT_VERSION);
+        ss >> p_records;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+static void EraseSnapshotParts(CDBBatch & p_batch, uint32_t p_id, uint32_t p_parts)
+{
+    for (uint32_t nPart = 0; nPart < p_parts; nPart++)
+        p_batch.Erase(std::make_pair(SNAPSHOTDATA_FLAG, std::make_pair(p_id, nPart)));
+}
+
+/**
+ * The owners, or changes, stored in the parts of a snapshot in the order they were written, with their addresses.
+ * One part is in memory at a time, read through a cursor of the caller.
+ */
+class CSnapshotOwnerStream
+{
+public:
+    CSnapshotOwnerStream(CDBIterator & p_cursor, uint32_t p_id, uint32_t p_parts)
+        : cursor(p_cursor), nId(p_id), nParts(p_parts), nPart(0), nPos(0), fFailed(false) {}
+
+    //  Whether there is a current owner, false at the end and once a part can't be read
+    bool Valid();
+    const std::string & Address() const { return vAddresses[nPos]; }
+    const CSnapshotOwnerRecord & Record() const { return vRecords[nPos]; }
+    void Next() { nPos++; }
+    bool Failed() const { return fFailed; }
+
+private:
+    CDBIterator & cursor;
+    uint32_t nId;
+    uint32_t nParts;
+    uint32_t nPart;
+    size_t nPos;
+    bool fFailed;
+    std::vector<CSnapshotOwnerRecord> vRecords;
+    std::vector<std::string> vAddresses;
+};
+
+bool CSnapshotOwnerStream::Valid()
+{
+    while (nPos == vRecords.size()) {
+        if (fFailed || nPart == nParts)
+            return false;
+
+        vRecords.clear();
+        vAddresses.clear();
+        nPos = 0;
+        if (!ReadSnapshotPart(cursor, nId, nPart, vRecords)) {
+            fFailed = true;
+            return error("%s : failed to read snapshot part %d of %d", __func__, nPart, nId);
+        }
+        vAddresses.reserve(vRecords.size());
+        for (const CSnapshotOwnerRecord & record : vRecords) {
+            CTxDestination dest;
+            if (!ExtractDestination(record.script, dest)) {
+                fFailed = true;
+                return error("%s : snapshot part %d of %d has an owner without an address", __func__, nPart, nId);
+            }
+            vAddresses.push_back(EncodeDestination(dest));
+        }
+        nPart++;
+    }
+    return true;
+}
+
+//  Visit the owners of a snapshot, merging the changes of a delta into its base in key order
+static bool WalkSnapshotOwners(CDBIterator & p_cursor, const CTokenSnapshotHeader & p_header,
+    const std::function<bool(const std::string &, const CAmount &)> & p_visitor)
+{
+    if (p_header.nBaseId == 0) {
+        CSnapshotOwnerStream owners(p_cursor, p_header.nId, p_header.nParts);
+        for (; owners.Valid(); owners.Next()) {
+            if (!p_visitor(owners.Address(), owners.Record().amount))
+                return false;
+        }
+        return !owners.Failed();
+    }
+
+    CSnapshotOwnerStream owners(p_cursor, p_header.nBaseId, p_header.nBaseParts);
+    CSnapshotOwnerStream changes(p_cursor, p_header.nId, p_header.nParts);
+    CDBKeyOrder keyOrder;
+    while (true) {
+        bool fOwner = owners.Valid();
+        bool fChange = changes.Valid();
+        if (!fOwner && !fChange)
+            break;
+
+        if (fChange && (!fOwner || !keyOrder(owners.Address(), changes.Address()))) {
+            //  The change replaces the owner at its address, or adds one
+            if (fOwner && owners.Address() == changes.Address())
+                owners.Next();
+            if (changes.Record().amount != SNAPSHOT_REMOVED && !p_visitor(changes.Address(), changes.Record().amount))
+                return false;
+            changes.Next();
+        } else {
+            if (!p_visitor(owners.Address(), owners.Record().amount))
+                return false;
+            owners.Next();
+        }
+    }
+    return !owners.Failed() && !changes.Failed();
+}
+
+//  The full snapshot below p_height that a new one of the token is stored as the changes from, false to store it in full
+static bool FindSnapshotBase(CDBIterator & p_cursor, const std::string & p_tokenName, int p_height, CTokenSnapshotHeader & p_base)
+{
+    CTokenSnapshotHeader newest;
+    bool fFound = false;
+
+    p_cursor.Seek(std::make_pair(SNAPSHOTHEADER_FLAG, std::string()));
+    for (; p_cursor.Valid(); p_cursor.Next()) {
+        std::pair<char, std::string> key;
+        if (!p_cursor.GetKey(key) || key.first != SNAPSHOTHEADER_FLAG)
+            break;
+        CTokenSnapshotHeader header;
+        if (!p_cursor.GetValue(header) || header.tokenName != p_tokenName || header.height >= p_height)
+            continue;
+        if (header.height > newest.height)
+            newest = header;
+        if (header.nBaseId == 0 && (!fFound || header.height > p_base.height)) {
+            p_base = header;
+            fFound = true;
+        }
+    }
+
+    //  Changes pile up against an old base, rebase once they are a large share of the owners
+    if (fFound && newest.nBaseId != 0 && newest.nChanges * SNAPSHOT_REBASE_RATIO > newest.nOwners)
+        return false;
+    return fFound;
+}
+
+//  Erase the parts of the given storage ids (to their part counts) that no snapshot header refers to anymore
+static bool CollectSnapshotParts(CDBWrapper & p_db, std::map<uint32_t, uint32_t> p_candidates)
+{
+    std::unique_ptr<CDBIterator> pcursor(p_db.NewIterator());
+    pcursor->Seek(std::make_pair(SNAPSHOTHEADER_FLAG, std::string()));
+    for (; pcursor->Valid() && !p_candidates.empty(); pcursor->Next()) {
+        std::pair<char, std::string> key;
+        if (!pcursor->GetKey(key) || key.first != SNAPSHOTHEADER_FLAG)
+            break;
+        CTokenSnapshotHeader header;
+        if (pcursor->GetValue(header)) {
+            p_candidates.erase(header.nId);
+            p_candidates.erase(header.nBaseId);
+        }
+    }
+
+    if (p_candidates.empty())
+        return true;
+    CDBBatch batch(p_db);
+    for (auto const & candidate : p_candidates)
+        EraseSnapshotParts(batch, candidate.first, candidate.second);
+    return p_db.WriteBatch(batch);
+}
+
+//  The parts a snapshot header refers to, for CollectSnapshotParts once it is gone
+static void AddSnapshotParts(const CTokenSnapshotHeader & p_header, std::map<uint32_t, uint32_t> & p_parts)
+{
+    p_parts[p_header.nId] = p_header.nParts;
+    if (p_header.nBaseId != 0)
+        p_parts[p_header.nBaseId] = p_header.nBaseParts;
+}
+
+//  Erase the snapshot at this height as older versions stored it
+static void EraseLegacySnapshot(CDBIterator & p_cursor, CDBBatch & p_batch, const std::string & p_heightAndName)
+{
+    p_batch.Erase(std::make_pair(SNAPSHOTCHECK_FLAG, p_heightAndName));
+
+    p_cursor.Seek(std::make_pair(SNAPSHOTPART_FLAG, std::make_pair(p_heightAndName, uint32_t(0))));
+    for (; p_cursor.Valid(); p_cursor.Next()) {
+        std::pair<char, std::pair<std::string, uint32_t>> key;
+        if (!p_cursor.GetKey(key) || key.first != SNAPSHOTPART_FLAG || key.second.first != p_heightAndName)
+            break;
+        p_batch.Erase(key);
+    }
+}
+
+//  Only snapshots that were queued are followed
+static void SetSnapshotOwners(const std::string & p_tokenName, int p_height, size_t p_owners)
+{
+    std::lock_guard<std::mutex> lock(csSnapshotWorker);
+    auto it = mapSnapshotProgress.find(std::make_pair(p_tokenName, p_height));
+    if (it != mapSnapshotProgress.end())
+        it->second.owners = p_owners;
+}
+
+bool GetTokenSnapshotProgress(const std::string & p_tokenName, int p_height, CTokenSnapshotProgress & p_progress)
+{
+    std::lock_guard<std::mutex> lock(csSnapshotWorker);
+    auto it = mapSnapshotProgress.find(std::make_pair(p_tokenName, p_height));
+    if (it == mapSnapshotProgress.end())
+        return false;
+    p_progress = it->second;
+    return true;
+}
+
+//  Whether the snapshot is queued or being written, csSnapshotWorker must be held
+static bool IsSnapshotPending(const std::pair<std::string, int> & p_key)
+{
+    if (fSnapshotWriting && keySnapshotWriting == p_key)
+        return true;
+    for (const auto & job : queueSnapshotJobs) {
+        if (job.tokenName == p_key.first && job.height == p_key.second)
+            return true;
+    }
+    return false;
+}
+
+//  Wait for the snapshot at this height to be written if it is queued, so it is read complete
+static void WaitForSnapshotJob(const std::string & p_tokenName, int p_height)
+{
+    std::unique_lock<std::mutex> lock(csSnapshotWorker);
+    auto key = std::make_pair(p_tokenName, p_height);
+    condSnapshotWritten.wait(lock, [&] { return !IsSnapshotPending(key); });
+}
+
+//  Drop the queued snapshots at this height. Called with csSnapshotStore held, so the worker isn't writing one.
+static void CancelSnapshotJobs(const std::string & p_tokenName, int p_height)
+{
+    {
+        std::lock_guard<std::mutex> lock(csSnapshotWorker);
+        queueSnapshotJobs.erase(std::remove_if(queueSnapshotJobs.begin(), queueSnapshotJobs.end(),
+            [&](const CTokenSnapshotJob & job) { return job.tokenName == p_tokenName && job.height == p_height; }),
+            queueSnapshotJobs.end());
+        mapSnapshotProgress.erase(std::make_pair(p_tokenName, p_height));
+    }
+    condSnapshotWritten.notify_all();
+}
+
+static void ThreadTokenSnapshotWorker()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(csSnapshotWorker);
+            condSnapshotWorker.wait(lock, [] { return fSnapshotWorkerStop || !queueSnapshotJobs.empty(); });
+            if (queueSnapshotJobs.empty())
+                return;
+        }
+
+        //  Removals cancel the jobs they find while holding the store, so the job is taken and written with it held
+        std::lock_guard<std::recursive_mutex> storeLock(csSnapshotStore);
+        CTokenSnapshotJob job;
+        {
+            std::lock_guard<std::mutex> lock(csSnapshotWorker);
+            if (queueSnapshotJobs.empty())
+                continue;
+            job = std::move(queueSnapshotJobs.front());
+            queueSnapshotJobs.pop_front();
+            fSnapshotWriting = true;
+            keySnapshotWriting = std::make_pair(job.tokenName, job.height);
+            mapSnapshotProgress[keySnapshotWriting].state = CTokenSnapshotProgress::WRITING;
+        }
+
+        bool fWritten = job.pdb->WriteTokenOwnershipSnapshot(job.tokenName, job.height, *job.view);
+        if (!fWritten) {
+            LogPrint(BCLog::REWARDS, "ThreadTokenSnapshotWorker: Failed to snapshot owners for '%s' at height %d!\n",
+                job.tokenName.c_str(), job.height);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(csSnapshotWorker);
+            fSnapshotWriting = false;
+            if (fWritten)
+                mapSnapshotProgress.erase(keySnapshotWriting);
+            else
+                mapSnapshotProgress[keySnapshotWriting].state = CTokenSnapshotProgress::FAILED;
+        }
+        condSnapshotWritten.notify_all();
+    }
+}
+
+void StartTokenSnapshotWorker()
+{
+    std::lock_guard<std::mutex> lock(csSnapshotWorker);
+    if (fSnapshotWorkerRunning)
+        return;
+
+    fSnapshotWorkerStop = false;
+    fSnapshotWorkerRunning = true;
+    threadSnapshotWorker = std::thread(&TraceThread<std::function<void()> >, "tokensnapshot", std::function<void()>(ThreadTokenSnapshotWorker));
+}
+
+void StopTokenSnapshotWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(csSnapshotWorker);
+        if (!fSnapshotWorkerRunning)
+            return;
+        fSnapshotWorkerStop = true;
+    }
+    condSnapshotWorker.notify_all();
+    threadSnapshotWorker.join();
+
+    std::lock_guard<std::mutex> lock(csSnapshotWorker);
+    fSnapshotWorkerRunning = false;
+}
 
 CTokenSnapshotDBEntry::CTokenSnapshotDBEntry()
 {
@@ -33,7 +491,7 @@ CTokenSnapshotDBEntry::CTokenSnapshotDBEntry(
     heightAndName = std::to_string(height) + tokenName;
 }
 
-CTokenSnapshotDB::CTokenSnapshotDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "rewards" / "tokensnapshot", nCacheSize, fMemory, fWipe) {
+CTokenSnapshotDB::CTokenSnapshotDB(size_t nCacheSize, bool fMemory, bool fWipe, CDBEnvironment* dbenv) : CDBWrapper(GetDataDir() / "rewards" / "tokensnapshot", nCacheSize, fMemory, fWipe, false, 2 << 20, dbenv) {
 }
 
 bool CTokenSnapshotDB::AddTokenOwnershipSnapshot(
@@ -48,66 +506,205 @@ bool CTokenSnapshotDB::AddTokenOwnershipSnapshot(
         return false;
     }
 
-    std::set<std::pair<std::string, CAmount>> ownersAndAmounts;
-    std::vector<std::pair<std::string, CAmount>> tempOwnersAndAmounts;
-    int totalEntryCount;
+    std::unique_ptr<CTokenAddressDirView> view = ptokensdb->SnapshotTokenAddressDir(p_tokenName);
+    return WriteTokenOwnershipSnapshot(p_tokenName, p_height, *view);
+}
 
-    if (!ptokensdb->TokenAddressDir(tempOwnersAndAmounts, totalEntryCount, true, p_tokenName, INT_MAX, 0)) {
-        LogPrint(BCLog::REWARDS, "AddTokenOwnershipSnapshot: Failed to retrieve tokens directory for '%s'\n", p_tokenName.c_str());
+bool CTokenSnapshotDB::QueueTokenOwnershipSnapshot(
+    const std::string & p_tokenName, int p_height)
+{
+    if (ptokensdb == nullptr) {
+        LogPrint(BCLog::REWARDS, "QueueTokenOwnershipSnapshot: Invalid tokens DB!\n");
         return false;
     }
 
-    //  Retrieve all of the addresses/amounts in batches
-    const int MAX_RETRIEVAL_COUNT = 100;
-    bool errorsOccurred = false;
+    //  The view pins the ownership at this height, the blocks connected afterwards don't change it
+    CTokenSnapshotJob job;
+    job.pdb = this;
+    job.tokenName = p_tokenName;
+    job.height = p_height;
+    job.view = ptokensdb->SnapshotTokenAddressDir(p_tokenName);
 
-    for (int retrievalOffset = 0; retrievalOffset < totalEntryCount; retrievalOffset += MAX_RETRIEVAL_COUNT) {
-        //  Retrieve the specified segment of addresses
-        if (!ptokensdb->TokenAddressDir(tempOwnersAndAmounts, totalEntryCount, false, p_tokenName, MAX_RETRIEVAL_COUNT, retrievalOffset)) {
-            LogPrint(BCLog::REWARDS, "AddTokenOwnershipSnapshot: Failed to retrieve tokens directory for '%s'\n", p_tokenName.c_str());
-            errorsOccurred = true;
-            break;
+    {
+        std::lock_guard<std::mutex> lock(csSnapshotWorker);
+        if (fSnapshotWorkerRunning) {
+            LogPrint(BCLog::REWARDS, "QueueTokenOwnershipSnapshot: Queued snapshot for '%s' at height %d\n",
+                p_tokenName.c_str(), p_height);
+            mapSnapshotProgress[std::make_pair(p_tokenName, p_height)] = CTokenSnapshotProgress();
+            queueSnapshotJobs.push_back(std::move(job));
+            condSnapshotWorker.notify_one();
+            return true;
         }
+    }
 
-        //  Verify that some addresses were returned
-        if (tempOwnersAndAmounts.size() == 0) {
-            LogPrint(BCLog::REWARDS, "AddTokenOwnershipSnapshot: No addresses were retrieved.\n");
-            continue;
-        }
+    return WriteTokenOwnershipSnapshot(p_tokenName, p_height, *job.view);
+}
 
-        //  Move these into the main set
-        for (auto const & currPair : tempOwnersAndAmounts) {
-            //  Verify that the address is valid
-            CTxDestination dest = DecodeDestination(currPair.first);
-            if (IsValidDestination(dest)) {
-                ownersAndAmounts.insert(currPair);
-            }
-            else {
-                LogPrint(BCLog::REWARDS, "AddTokenOwnershipSnapshot: Address '%s' is invalid.\n", currPair.first.c_str());
+bool CTokenSnapshotDB::WriteTokenOwnershipSnapshot(
+    const std::string & p_tokenName, int p_height,
+    CTokenAddressDirView & p_view)
+{
+    std::string heightAndName = std::to_string(p_height) + p_tokenName;
+
+    std::lock_guard<std::recursive_mutex> lock(csSnapshotStore);
+
+    //  The parts written below go under a new id, this cursor only reads the headers and the base
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    CTokenSnapshotHeader header;
+    header.tokenName = p_tokenName;
+    header.height = p_height;
+    if (!Read(SNAPSHOTID_FLAG, header.nId))
+        header.nId = 1;
+
+    CTokenSnapshotHeader base;
+    bool fDelta = FindSnapshotBase(*pcursor, p_tokenName, p_height, base);
+    if (fDelta) {
+        header.nBaseId = base.nId;
+        header.nBaseParts = base.nParts;
+    }
+
+    //  Owners, or the changes from the base, are written in parts as they are read, so only one batch is held in memory
+    CDBBatch batch(*this);
+    batch.Write(SNAPSHOTID_FLAG, header.nId + 1);
+    std::vector<CSnapshotOwnerRecord> vPart;
+    bool fWriteFailed = false;
+
+    auto addRecord = [&](const CScript & script, CAmount amount) {
+        vPart.emplace_back(script, amount);
+        if (vPart.size() < SNAPSHOT_PART_SIZE)
+            return true;
+
+        WriteSnapshotPart(batch, header.nId, header.nParts++, vPart);
+        vPart.clear();
+        if (batch.SizeEstimate() > SNAPSHOT_BATCH_SIZE) {
+            if (!WriteBatch(batch)) {
+                fWriteFailed = true;
+                return false;
             }
+            batch.Clear();
+            SetSnapshotOwners(p_tokenName, p_height, header.nOwners);
         }
+        return true;
+    };
 
-        tempOwnersAndAmounts.clear();
-    }
+    //  The owners of the base in key order, the directory is walked in the same order
+    CSnapshotOwnerStream baseOwners(*pcursor, base.nId, fDelta ? base.nParts : 0);
+    CDBKeyOrder keyOrder;
+    auto addRemoved = [&](const std::string * pUntil) {
+        for (; baseOwners.Valid() && (!pUntil || keyOrder(baseOwners.Address(), *pUntil)); baseOwners.Next()) {
+            header.nChanges++;
+            if (!addRecord(baseOwners.Record().script, SNAPSHOT_REMOVED))
+                return false;
+        }
+        return true;
+    };
+
+    bool fWalked = p_view.Walk([&](const std::string & address, const CAmount & amount) {
+        //  Verify that the address is valid
+        CTxDestination dest = DecodeDestination(address);
+        if (!IsValidDestination(dest)) {
+            LogPrint(BCLog::REWARDS, "WriteTokenOwnershipSnapshot: Address '%s' is invalid.\n", address.c_str());
+            return true;
+        }
 
-    if (errorsOccurred) {
-        LogPrint(BCLog::REWARDS, "AddTokenOwnershipSnapshot: Errors occurred while acquiring ownership info for token '%s'.\n", p_tokenName.c_str());
+        header.nOwners++;
+        if (!fDelta)
+            return addRecord(GetScriptForDestination(dest), amount);
+
+        if (!addRemoved(&address))
+            return false;
+        if (baseOwners.Valid() && baseOwners.Address() == address) {
+            bool fUnchanged = baseOwners.Record().amount == amount;
+            baseOwners.Next();
+            if (fUnchanged)
+                return true;
+        }
+        header.nChanges++;
+        return addRecord(GetScriptForDestination(dest), amount);
+    });
+    if (fWalked && !fWriteFailed)
+        addRemoved(nullptr);
+
+    if (!fWalked || fWriteFailed || baseOwners.Failed() || header.nOwners == 0) {
+        if (header.nOwners == 0 && fWalked && !fWriteFailed)
+            LogPrint(BCLog::REWARDS, "WriteTokenOwnershipSnapshot: No owners exist for token '%s'.\n", p_tokenName.c_str());
+        else
+            LogPrint(BCLog::REWARDS, "WriteTokenOwnershipSnapshot: Errors occurred while acquiring ownership info for token '%s'.\n", p_tokenName.c_str());
+
+        //  Drop the parts already written out, the id isn't used again
+        batch.Clear();
+        batch.Write(SNAPSHOTID_FLAG, header.nId + 1);
+        EraseSnapshotParts(batch, header.nId, header.nParts);
+        WriteBatch(batch);
         return false;
     }
-    if (ownersAndAmounts.size() == 0) {
-        LogPrint(BCLog::REWARDS, "AddTokenOwnershipSnapshot: No owners exist for token '%s'.\n", p_tokenName.c_str());
+
+    if (!vPart.empty())
+        WriteSnapshotPart(batch, header.nId, header.nParts++, vPart);
+
+    //  The snapshot this one replaces at this height (before a reorg), its parts go once nothing refers to them
+    std::map<uint32_t, uint32_t> replacedParts;
+    CTokenSnapshotHeader replaced;
+    if (ReadAtCursor(*pcursor, std::make_pair(SNAPSHOTHEADER_FLAG, heightAndName), replaced))
+        AddSnapshotParts(replaced, replacedParts);
+    EraseLegacySnapshot(*pcursor, batch, heightAndName);
+
+    //  The header is written last so the snapshot is only found once every part is in
+    batch.Write(std::make_pair(SNAPSHOTHEADER_FLAG, heightAndName), header);
+    if (!WriteBatch(batch))
         return false;
-    }
 
-    //  Write the snapshot to the database. We don't care if we overwrite, because it should be identical.
-    CTokenSnapshotDBEntry snapshotEntry(p_tokenName, p_height, ownersAndAmounts);
+    LogPrint(BCLog::REWARDS, "WriteTokenOwnershipSnapshot: Successfully added snapshot for '%s' at height %d (ownerCount = %d, %s).\n",
+        p_tokenName.c_str(), p_height, header.nOwners,
+        fDelta ? strprintf("%d changes from height %d", header.nChanges, base.height) : "full");
 
-    if (Write(std::make_pair(SNAPSHOTCHECK_FLAG, snapshotEntry.heightAndName), snapshotEntry)) {
-        LogPrint(BCLog::REWARDS, "AddTokenOwnershipSnapshot: Successfully added snapshot for '%s' at height %d (ownerCount = %d).\n",
-            p_tokenName.c_str(), p_height, ownersAndAmounts.size());
-        return true;
+    return CollectSnapshotParts(*this, replacedParts);
+}
+
+//  Visit the owners stored in parts by older versions, one part in memory at a time
+static bool WalkLegacySnapshotParts(CDBIterator & p_cursor, const std::string & p_heightAndName,
+    const std::function<bool(const std::string &, const CAmount &)> & p_visitor)
+{
+    p_cursor.Seek(std::make_pair(SNAPSHOTPART_FLAG, std::make_pair(p_heightAndName, uint32_t(0))));
+    while (p_cursor.Valid()) {
+        std::pair<char, std::pair<std::string, uint32_t>> key;
+        if (!p_cursor.GetKey(key) || key.first != SNAPSHOTPART_FLAG || key.second.first != p_heightAndName)
+            break;
+
+        std::vector<std::pair<std::string, CAmount>> vPart;
+        if (!p_cursor.GetValue(vPart))
+            return error("%s : failed to read snapshot part %d of '%s'", __func__, key.second.second, p_heightAndName);
+        for (const auto & owner : vPart) {
+            if (!p_visitor(owner.first, owner.second))
+                return false;
+        }
+        p_cursor.Next();
     }
-    return false;
+    return true;
+}
+
+//  Visit the owners of the snapshot stored either way, all of it read through the one cursor
+static bool WalkSnapshot(CDBIterator & p_cursor, const std::string & p_heightAndName,
+    const std::function<bool(const std::string &, const CAmount &)> & p_visitor)
+{
+    CTokenSnapshotHeader header;
+    if (ReadAtCursor(p_cursor, std::make_pair(SNAPSHOTHEADER_FLAG, p_heightAndName), header))
+        return WalkSnapshotOwners(p_cursor, header, p_visitor);
+
+    CTokenSnapshotDBEntry snapshotEntry;
+    return ReadAtCursor(p_cursor, std::make_pair(SNAPSHOTCHECK_FLAG, p_heightAndName), snapshotEntry)
+        && WalkLegacySnapshotParts(p_cursor, p_heightAndName, p_visitor);
+}
+
+bool CTokenSnapshotDB::HasOwnershipSnapshot(
+    const std::string & p_tokenName, int p_height)
+{
+    //  The header is written in the same batch as the last part
+    WaitForSnapshotJob(p_tokenName, p_height);
+    std::lock_guard<std::recursive_mutex> lock(csSnapshotStore);
+    std::string heightAndName = std::to_string(p_height) + p_tokenName;
+    return Exists(std::make_pair(SNAPSHOTHEADER_FLAG, heightAndName)) || Exists(std::make_pair(SNAPSHOTCHECK_FLAG, heightAndName));
 }
 
 bool CTokenSnapshotDB::RetrieveOwnershipSnapshot(
@@ -121,7 +718,15 @@ bool CTokenSnapshotDB::RetrieveOwnershipSnapshot(
         __func__,
         heightAndName.c_str());
 
-    bool succeeded = Read(std::make_pair(SNAPSHOTCHECK_FLAG, heightAndName), p_snapshotEntry);
+    p_snapshotEntry = CTokenSnapshotDBEntry(p_tokenName, p_height, std::set<std::pair<std::string, CAmount>>());
+
+    WaitForSnapshotJob(p_tokenName, p_height);
+    std::lock_guard<std::recursive_mutex> lock(csSnapshotStore);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    bool succeeded = WalkSnapshot(*pcursor, heightAndName, [&](const std::string & address, const CAmount & amount) {
+        p_snapshotEntry.ownersAndAmounts.insert(std::make_pair(address, amount));
+        return true;
+    });
 
     LogPrint(BCLog::REWARDS, "%s : Retrieval of snapshot for '%s' %s!\n",
         __func__,
@@ -131,6 +736,16 @@ bool CTokenSnapshotDB::RetrieveOwnershipSnapshot(
     return succeeded;
 }
 
+bool CTokenSnapshotDB::WalkOwnershipSnapshot(
+    const std::string & p_tokenName, int p_height,
+    const std::function<bool(const std::string &, const CAmount &)> & p_visitor)
+{
+    WaitForSnapshotJob(p_tokenName, p_height);
+    std::lock_guard<std::recursive_mutex> lock(csSnapshotStore);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    return WalkSnapshot(*pcursor, std::to_string(p_height) + p_tokenName, p_visitor);
+}
+
 bool CTokenSnapshotDB::RemoveOwnershipSnapshot(
     const std::string & p_tokenName, int p_height)
 {
@@ -141,7 +756,22 @@ bool CTokenSnapshotDB::RemoveOwnershipSnapshot(
         __func__,
         heightAndName.c_str());
 
-    bool succeeded = Erase(std::make_pair(SNAPSHOTCHECK_FLAG, heightAndName), true);
+    //  A snapshot of this height still queued would be written after the removal, it is dropped with it
+    std::lock_guard<std::recursive_mutex> lock(csSnapshotStore);
+    CancelSnapshotJobs(p_tokenName, p_height);
+
+    //  The parts stay while the snapshots stored as changes from this one need them
+    std::map<uint32_t, uint32_t> removedParts;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CTokenSnapshotHeader header;
+    if (ReadAtCursor(*pcursor, std::make_pair(SNAPSHOTHEADER_FLAG, heightAndName), header))
+        AddSnapshotParts(header, removedParts);
+
+    CDBBatch batch(*this);
+    batch.Erase(std::make_pair(SNAPSHOTHEADER_FLAG, heightAndName));
+    EraseLegacySnapshot(*pcursor, batch, heightAndName);
+
+    bool succeeded = WriteBatch(batch, true) && CollectSnapshotParts(*this, removedParts);
 
     LogPrint(BCLog::REWARDS, "%s : Removal of snapshot for '%s' %s!\n",
         __func__,
@@ -150,3 +780,50 @@ bool CTokenSnapshotDB::RemoveOwnershipSnapshot(
 
     return succeeded;
 }
+
+bool CTokenSnapshotDB::PruneOwnershipSnapshots(
+    int p_maxHeight,
+    const std::function<bool(const std::string &, int)> & p_keep,
+    size_t & p_removed)
+{
+    p_removed = 0;
+
+    //  Find them first, removing a snapshot reads with a cursor of its own
+    std::vector<std::pair<std::string, int>> toRemove;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    auto findSnapshots = [&](char flag, const std::function<bool(std::string &, int &)> & readSnapshot) {
+        pcursor->Seek(std::make_pair(flag, std::string()));
+        for (; pcursor->Valid(); pcursor->Next()) {
+            std::pair<char, std::string> key;
+            if (!pcursor->GetKey(key) || key.first != flag)
+                break;
+            std::string tokenName;
+            int height;
+            if (readSnapshot(tokenName, height) && height <= p_maxHeight && !p_keep(tokenName, height))
+                toRemove.push_back(std::make_pair(tokenName, height));
+        }
+    };
+    findSnapshots(SNAPSHOTHEADER_FLAG, [&](std::string & tokenName, int & height) {
+        CTokenSnapshotHeader header;
+        if (!pcursor->GetValue(header))
+            return false;
+        tokenName = header.tokenName;
+        height = header.height;
+        return true;
+    });
+    findSnapshots(SNAPSHOTCHECK_FLAG, [&](std::string & tokenName, int & height) {
+        CTokenSnapshotDBEntry snapshotEntry;
+        if (!pcursor->GetValue(snapshotEntry))
+            return false;
+        tokenName = snapshotEntry.tokenName;
+        height = snapshotEntry.height;
+        return true;
+    });
+
+    for (auto const & snapshot : toRemove) {
+        if (!RemoveOwnershipSnapshot(snapshot.first, snapshot.second))
+            return false;
+        p_removed++;
+    }
+    return true;
+}
@@ -6,11 +6,14 @@
 #ifndef TOKENSNAPSHOTDB_H
 #define TOKENSNAPSHOTDB_H
 
+#include <functional>
 #include <set>
 
 #include <dbwrapper.h>
 #include "amount.h"
 
+class CTokenAddressDirView;
+
 class CTokenSnapshotDBEntry
 {
 public:
@@ -54,9 +57,11 @@ public:
     }
 };
 
+//  Ownership snapshots by token and height. A snapshot is stored as the changes from the last full one of its token
+//      while they stay small, owners by address script in LZ4 compressed parts
 class CTokenSnapshotDB  : public CDBWrapper {
 public:
-    explicit CTokenSnapshotDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CTokenSnapshotDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, CDBEnvironment* dbenv = nullptr);
 
     CTokenSnapshotDB(const CTokenSnapshotDB&) = delete;
     CTokenSnapshotDB& operator=(const CTokenSnapshotDB&) = delete;
@@ -65,15 +70,64 @@ public:
     bool AddTokenOwnershipSnapshot(
         const std::string & p_tokenName, int p_height);
 
+    //  Capture the token ownership at the specified height now and write the snapshot on the
+    //      background worker (inline if the worker isn't running)
+    bool QueueTokenOwnershipSnapshot(
+        const std::string & p_tokenName, int p_height);
+
+    //  Stream the owners of a captured address directory into the snapshot, in batches of bounded size
+    bool WriteTokenOwnershipSnapshot(
+        const std::string & p_tokenName, int p_height,
+        CTokenAddressDirView & p_view);
+
+    //  Whether the snapshot at the specified height has been written completely. The readers wait for a snapshot
+    //      that is still queued at that height
+    bool HasOwnershipSnapshot(
+        const std::string & p_tokenName, int p_height);
+
     //  Read all of the entries at a specified height
     bool RetrieveOwnershipSnapshot(
         const std::string & p_tokenName, int p_height,
         CTokenSnapshotDBEntry & p_snapshotEntry);
 
-    //  Remove the token snapshot at the specified height
+    //  Visit the owners of the snapshot at the specified height without loading them all at once. Stops early
+    //      and returns false if the snapshot doesn't exist, can't be read, or the visitor returns false.
+    bool WalkOwnershipSnapshot(
+        const std::string & p_tokenName, int p_height,
+        const std::function<bool(const std::string &, const CAmount &)> & p_visitor);
+
+    //  Remove the token snapshot at the specified height, along with one still queued for it
     bool RemoveOwnershipSnapshot(
         const std::string & p_tokenName, int p_height);
+
+    //  Remove the snapshots at or below the specified height that p_keep returns false for,
+    //      p_removed counts them
+    bool PruneOwnershipSnapshots(
+        int p_maxHeight,
+        const std::function<bool(const std::string &, int)> & p_keep,
+        size_t & p_removed);
 };
 
 
+//  Where a snapshot queued by QueueTokenOwnershipSnapshot is, owners counts the owners written so far
+struct CTokenSnapshotProgress
+{
+    enum State { QUEUED, WRITING, FAILED };
+
+    State state;
+    size_t owners;
+
+    CTokenSnapshotProgress() : state(QUEUED), owners(0) {}
+};
+
+//  The progress of a queued snapshot that hasn't been written yet, or that failed. False once it is written, and for
+//      snapshots that were never queued (before a restart, or written inline)
+bool GetTokenSnapshotProgress(const std::string & p_tokenName, int p_height, CTokenSnapshotProgress & p_progress);
+
+//  Start the worker that writes the queued ownership snapshots
+void StartTokenSnapshotWorker();
+
+//  Stop the worker once every queued snapshot has been written
+void StopTokenSnapshotWorker();
+
 #endif //TOKENSNAPSHOTDB_H
@@ -4,7 +4,15 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "tokentypes.h"
+#include "tokens.h"
+#include "base58.h"
+#include "crypto/common.h"
 #include "hash.h"
+#include "script/script.h"
+#include "utilstrencodings.h"
+#include "version.h"
+
+#include <ios>
 
 int IntFromKnownTokenType(KnownTokenType type) {
     return (int)type;
@@ -25,3 +33,251 @@ uint256 CTokenCacheRestrictedAddress::GetHash() {
 uint256 CTokenCacheRootQualifierChecker::GetHash() {
     return Hash(rootTokenName.begin(), rootTokenName.end(), address.begin(), address.end());
 }
+
+CNewToken::CNewToken(const CNewToken& token)
+{
+    this->strName = token.strName;
+    this->nAmount = token.nAmount;
+    this->units = token.units;
+    this->nHasIPFS = token.nHasIPFS;
+    this->nReissuable = token.nReissuable;
+    this->strIPFSHash = token.strIPFSHash;
+
+    this->nHasRoyalties = token.nHasRoyalties;
+    this->nRoyaltiesAddress = token.nRoyaltiesAddress;
+    this->nRoyaltiesAmount = token.nRoyaltiesAmount;
+}
+
+CNewToken& CNewToken::operator=(const CNewToken& token)
+{
+    this->strName = token.strName;
+    this->nAmount = token.nAmount;
+    this->units = token.units;
+    this->nHasIPFS = token.nHasIPFS;
+    this->nReissuable = token.nReissuable;
+    this->strIPFSHash = token.strIPFSHash;
+
+    this->nHasRoyalties = token.nHasRoyalties;
+    this->nRoyaltiesAddress = token.nRoyaltiesAddress;
+    this->nRoyaltiesAmount = token.nRoyaltiesAmount;
+
+    return *this;
+}
+
+CNewToken::CNewToken(const std::string& strName, const CAmount& nAmount, const int& units, const int& nReissuable, const int& nHasIPFS, const std::string& strIPFSHash, const int& nHasRoyalties, const std::string& nRoyaltiesAddress, const CAmount& nRoyaltiesAmount)
+{
+    this->SetNull();
+    this->strName = strName;
+    this->nAmount = nAmount;
+    this->units = int8_t(units);
+    this->nReissuable = int8_t(nReissuable);
+    this->nHasIPFS = int8_t(nHasIPFS);
+    this->strIPFSHash = strIPFSHash;
+
+    this->nHasRoyalties = nHasRoyalties;
+    this->nRoyaltiesAddress = nRoyaltiesAddress;
+    this->nRoyaltiesAmount = nRoyaltiesAmount;
+}
+
+CNewToken::CNewToken(const std::string& strName, const CAmount& nAmount)
+{
+    this->SetNull();
+    this->strName = strName;
+    this->nAmount = nAmount;
+    this->units = int8_t(DEFAULT_UNITS);
+    this->nReissuable = int8_t(DEFAULT_REISSUABLE);
+    this->nHasIPFS = int8_t(DEFAULT_HAS_IPFS);
+    this->strIPFSHash = DEFAULT_IPFS;
+
+    this->nHasRoyalties = DEFAULT_HAS_ROYALTIES;
+    this->nRoyaltiesAddress = DEFAULT_ROYALTIES_ADDRESS;
+    this->nRoyaltiesAmount = DEFAULT_ROYALTIES_AMOUNT;
+}
+
+namespace {
+/**
+ * Serializes to the end of a script, or without one only counts the bytes. The token
+ * serializers read and write with the same code, so it has read(), empty() and size()
+ * too, which writing never calls.
+ */
+class CTokenScriptWriter
+{
+private:
+    CScript* pscript;
+    size_t nSize;
+
+public:
+    explicit CTokenScriptWriter(CScript* pscriptIn) : pscript(pscriptIn), nSize(0) {}
+
+    void write(const char* pch, size_t nWrite)
+    {
+        if (pscript)
+            pscript->insert(pscript->end(), (const unsigned char*)pch, (const unsigned char*)pch + nWrite);
+        nSize += nWrite;
+    }
+
+    template <typename T>
+    CTokenScriptWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+
+    void read(char* pch, size_t nRead)
+    {
+        throw std::ios_base::failure("CTokenScriptWriter::read(): write only");
+    }
+
+    int GetType() const { return SER_NETWORK; }
+    int GetVersion() const { return PROTOCOL_VERSION; }
+    bool empty() const { return nSize == 0; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Appends the opcodes before, a push of prefix followed by the serialization of obj, and the
+ * opcodes after to script. That is what pushing a vector built from a CDataStream appends,
+ * but the script grows once to its final size and nothing else is allocated.
+ */
+template <typename T>
+void AppendTokenScript(CScript& script, std::initializer_list<opcodetype> before, const std::vector<unsigned char>& prefix, const T& obj, std::initializer_list<opcodetype> after)
+{
+    CTokenScriptWriter sizer(nullptr);
+    sizer << obj;
+    const size_t nData = prefix.size() + sizer.size();
+    const size_t nHeader = nData < OP_PUSHDATA1 ? 1 : nData <= 0xff ? 2 : nData <= 0xffff ? 3 : 5;
+    script.reserve(script.size() + before.size() + nHeader + nData + after.size());
+
+    for (opcodetype opcode : before)
+        script << opcode;
+    // The same push header CScript::operator<< writes for a vector of nData bytes
+    unsigned char header[5];
+    if (nData < OP_PUSHDATA1) {
+        header[0] = (unsigned char)nData;
+    } else if (nData <= 0xff) {
+        header[0] = OP_PUSHDATA1;
+        header[1] = (unsigned char)nData;
+    } else if (nData <= 0xffff) {
+        header[0] = OP_PUSHDATA2;
+        WriteLE16(header + 1, nData);
+    } else {
+        header[0] = OP_PUSHDATA4;
+        WriteLE32(header + 1, nData);
+    }
+    script.insert(script.end(), header, header + nHeader);
+    script.insert(script.end(), prefix.begin(), prefix.end());
+    CTokenScriptWriter writer(&script);
+    writer << obj;
+    for (opcodetype opcode : after)
+        script << opcode;
+}
+
+const std::vector<unsigned char> NEW_TOKEN_PREFIX = {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_Q};
+const std::vector<unsigned char> OWNER_TOKEN_PREFIX = {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_O};
+const std::vector<unsigned char> TRANSFER_TOKEN_PREFIX = {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_T};
+const std::vector<unsigned char> REISSUE_TOKEN_PREFIX = {TOKEN_Y, TOKEN_N, TOKEN_A, TOKEN_R};
+const std::vector<unsigned char> NO_PREFIX;
+} // namespace
+
+/**
+ * Constructs a CScript that carries the token name and quantity and adds to to the end of the given script
+ * @param dest - The destination that the token will belong to
+ * @param script - This script needs to be a pay to address script
+ */
+void CNewToken::ConstructTransaction(CScript& script) const
+{
+    AppendTokenScript(script, {OP_PLB_TOKEN}, NEW_TOKEN_PREFIX, *this, {OP_DROP});
+}
+
+void CNewToken::ConstructOwnerTransaction(CScript& script) const
+{
+    AppendTokenScript(script, {OP_PLB_TOKEN}, OWNER_TOKEN_PREFIX, std::string(this->strName + OWNER_TAG), {OP_DROP});
+}
+
+CTokenTransfer::CTokenTransfer(const std::string& strTokenName, const CAmount& nAmount, const uint32_t& nTimeLock, const std::string& message, const int64_t& nExpireTime)
+{
+    SetNull();
+    this->strName = strTokenName;
+    this->nAmount = nAmount;
+    this->nTimeLock = nTimeLock;
+    this->message = message;
+    if (!message.empty()) {
+        if (nExpireTime) {
+            this->nExpireTime = nExpireTime;
+        } else {
+            this->nExpireTime = 0;
+        }
+    }
+}
+
+void CTokenTransfer::ConstructTransaction(CScript& script) const
+{
+    AppendTokenScript(script, {OP_PLB_TOKEN}, TRANSFER_TOKEN_PREFIX, *this, {OP_DROP});
+}
+
+CReissueToken::CReissueToken(const std::string &strTokenName, const CAmount &nAmount, const int &nUnits, const int &nReissuable,
+                            const std::string &strIPFSHash, const int& nHasRoyalties, const std::string& nRoyaltiesAddress,
+                            const CAmount& nRoyaltiesAmount)
+{
+    SetNull();
+    this->strName = strTokenName;
+    this->strIPFSHash = strIPFSHash;
+    this->nReissuable = int8_t(nReissuable);
+    this->nAmount = nAmount;
+    this->nUnits = nUnits;
+
+    this->nHasRoyalties = int8_t(nHasRoyalties);
+    this->nRoyaltiesAddress = nRoyaltiesAddress;
+    this->nRoyaltiesAmount = nRoyaltiesAmount;
+}
+
+void CReissueToken::ConstructTransaction(CScript& script) const
+{
+    AppendTokenScript(script, {OP_PLB_TOKEN}, REISSUE_TOKEN_PREFIX, *this, {OP_DROP});
+}
+
+CNullTokenTxData::CNullTokenTxData(const std::string &strTokenname, const int8_t &nFlag)
+{
+    SetNull();
+    this->token_name = strTokenname;
+    this->flag = nFlag;
+}
+
+void CNullTokenTxData::ConstructTransaction(CScript &script) const
+{
+    AppendTokenScript(script, {}, NO_PREFIX, *this, {});
+}
+
+void CNullTokenTxData::ConstructGlobalRestrictionTransaction(CScript &script) const
+{
+    AppendTokenScript(script, {OP_PLB_TOKEN, OP_RESERVED, OP_RESERVED}, NO_PREFIX, *this, {});
+}
+
+CNullTokenTxVerifierString::CNullTokenTxVerifierString(const std::string &verifier)
+{
+    SetNull();
+    this->verifier_string = verifier;
+}
+
+void CNullTokenTxVerifierString::ConstructTransaction(CScript &script) const
+{
+    AppendTokenScript(script, {OP_PLB_TOKEN, OP_RESERVED}, NO_PREFIX, *this, {});
+}
+
+// 46 char base58 --> 34 char KAW compatible
+std::string DecodeTokenData(const std::string& encoded)
+{
+    if (encoded.size() == 46) {
+        std::vector<unsigned char> b;
+        DecodeBase58(encoded, b);
+        return std::string(b.begin(), b.end());
+    }
+
+    else if (encoded.size() == 64 && IsHex(encoded)) {
+        std::vector<unsigned char> vec = ParseHex(encoded);
+        return std::string(vec.begin(), vec.end());
+    }
+
+    return "";
+
+};
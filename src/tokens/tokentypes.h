@@ -8,11 +8,21 @@
 
 #include <string>
 #include <sstream>
-#include <list>
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
 #include <unordered_map>
+#include <vector>
 #include "amount.h"
 #include "script/standard.h"
 #include "primitives/transaction.h"
+#include "memusage.h"
+#include "crypto/common.h"
 
 #define MAX_UNIT 8
 #define MIN_UNIT 0
@@ -173,6 +183,29 @@ public:
     }
 };
 
+//! First byte of a token record in the fixed layout. A record from before it starts with the length of the token
+//! name, which is a single byte below 0xfd for every name the chain allows.
+static const unsigned char TOKEN_RECORD_MARKER = 0xff;
+//! Later versions only append fields, so every version reads the fields of the ones before it
+static const unsigned char TOKEN_RECORD_VERSION = 1;
+//! Marker, version, units, reissuable, has IPFS, has royalties, amount, royalties amount, height and block hash
+static const size_t TOKEN_RECORD_HEADER_SIZE = 6 + 8 + 8 + 4 + 32;
+
+//! The IPFS hash as a record from before the fixed layout reads back, so both layouts agree on every token
+static inline std::string TokenRecordIPFSHash(const std::string& strIPFSHash)
+{
+    if (strIPFSHash.length() == 34)
+        return std::string{IPFS_SHA2_256, IPFS_SHA2_256_LEN} + strIPFSHash.substr(2);
+    if (strIPFSHash.length() == 32)
+        return strIPFSHash;
+    return "";
+}
+
+/**
+ * A token as the token database stores it. The numbers come first at fixed offsets (TOKEN_RECORD_HEADER_SIZE bytes,
+ * see CTokenRecordView) and the name, IPFS hash and royalties address follow. Records written before this layout
+ * are still read, and are rewritten in it the next time the token is.
+ */
 class CDatabasedTokenData
 {
 public:
@@ -190,14 +223,84 @@ public:
         blockHash = uint256();
     }
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        const bool fRoyalties = token.nHasRoyalties == 1;
+        ::Serialize(s, TOKEN_RECORD_MARKER);
+        ::Serialize(s, TOKEN_RECORD_VERSION);
+        ::Serialize(s, token.units);
+        ::Serialize(s, token.nReissuable);
+        ::Serialize(s, token.nHasIPFS);
+        ::Serialize(s, token.nHasRoyalties);
+        ::Serialize(s, token.nAmount);
+        ::Serialize(s, fRoyalties ? token.nRoyaltiesAmount : CAmount(0));
+        ::Serialize(s, nHeight);
+        ::Serialize(s, blockHash);
+        ::Serialize(s, token.strName);
+        ::Serialize(s, token.nHasIPFS == 1 ? TokenRecordIPFSHash(token.strIPFSHash) : std::string());
+        ::Serialize(s, fRoyalties ? token.nRoyaltiesAddress : std::string());
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action)
+    template <typename Stream>
+    void Unserialize(Stream& s)
     {
-        READWRITE(token);
-        READWRITE(nHeight);
-        READWRITE(blockHash);
+        SetNull();
+        if (s.empty() || (unsigned char)s[0] != TOKEN_RECORD_MARKER) {
+            s >> token;
+            s >> nHeight;
+            s >> blockHash;
+            return;
+        }
+
+        unsigned char nMarker, nVersion;
+        s >> nMarker >> nVersion;
+        if (nVersion < 1)
+            throw std::ios_base::failure("Unknown token record version");
+        s >> token.units >> token.nReissuable >> token.nHasIPFS >> token.nHasRoyalties;
+        s >> token.nAmount >> token.nRoyaltiesAmount >> nHeight >> blockHash;
+        s >> token.strName >> token.strIPFSHash >> token.nRoyaltiesAddress;
+    }
+};
+
+/**
+ * The numbers of a token record in the fixed layout, read where the record is without decoding the strings after
+ * them: for callers that need the units, the reissuable flag or the supply of a token and not the whole
+ * CDatabasedTokenData. The view must not outlive the bytes it was parsed from.
+ */
+class CTokenRecordView
+{
+private:
+    const unsigned char* pbegin;
+
+public:
+    CTokenRecordView() : pbegin(nullptr) {}
+
+    //! False when the bytes are not a record in the fixed layout
+    bool Parse(const unsigned char* pbeginIn, size_t nSize)
+    {
+        pbegin = nullptr;
+        if (nSize < TOKEN_RECORD_HEADER_SIZE || pbeginIn[0] != TOKEN_RECORD_MARKER || pbeginIn[1] < 1)
+            return false;
+        pbegin = pbeginIn;
+        return true;
+    }
+
+    bool IsNull() const { return pbegin == nullptr; }
+
+    int8_t GetUnits() const { return (int8_t)pbegin[2]; }
+    bool IsReissuable() const { return pbegin[3] != 0; }
+    bool HasIPFS() const { return pbegin[4] == 1; }
+    bool HasRoyalties() const { return pbegin[5] == 1; }
+    CAmount GetAmount() const { return (CAmount)ReadLE64(pbegin + 6); }
+    CAmount GetRoyaltiesAmount() const { return (CAmount)ReadLE64(pbegin + 14); }
+    int GetHeight() const { return (int32_t)ReadLE32(pbegin + 22); }
+
+    uint256 GetBlockHash() const
+    {
+        uint256 hash;
+        memcpy(hash.begin(), pbegin + 26, 32);
+        return hash;
     }
 };
 
@@ -364,6 +467,50 @@ public:
     void ConstructTransaction(CScript& script) const;
 };
 
+const int8_t TOKEN_UNDO_INCLUDES_VERIFIER_STRING = -1;
+
+/** Token metadata a reissue changed in a block, kept in the block's undo record */
+struct CBlockTokenUndo
+{
+    bool fChangedIPFS;
+    bool fChangedUnits;
+    std::string strIPFS;
+    int32_t nUnits;
+    int8_t version;
+    bool fChangedVerifierString;
+    std::string verifierString;
+
+    // Split so that only reading needs a stream that knows its end, the undo record is written through a hasher
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, fChangedUnits);
+        ::Serialize(s, fChangedIPFS);
+        ::Serialize(s, strIPFS);
+        ::Serialize(s, nUnits);
+        ::Serialize(s, TOKEN_UNDO_INCLUDES_VERIFIER_STRING);
+        ::Serialize(s, fChangedVerifierString);
+        ::Serialize(s, verifierString);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, fChangedUnits);
+        ::Unserialize(s, fChangedIPFS);
+        ::Unserialize(s, strIPFS);
+        ::Unserialize(s, nUnits);
+        if (!s.empty() and s.size() >= 1) {
+            int8_t nVersionCheck;
+            ::Unserialize(s, nVersionCheck);
+
+            if (nVersionCheck == TOKEN_UNDO_INCLUDES_VERIFIER_STRING) {
+                ::Unserialize(s, fChangedVerifierString);
+                ::Unserialize(s, verifierString);
+            }
+            version = nVersionCheck;
+        }
+    }
+};
+
 /** THESE ARE ONLY TO BE USED WHEN ADDING THINGS TO THE CACHE DURING CONNECT AND DISCONNECT BLOCK */
 struct CTokenCacheNewToken
 {
@@ -567,16 +714,197 @@ struct CTokenCacheRestrictedVerifiers
     }
 };
 
+/** <Token Name, Address> -> Quantity, with a second <Address, Token Name> index so that the entries of one address
+ *  can be found with a range scan. Entries are only ever added or cleared, never erased. */
+class CTokenAddressAmountMap
+{
+public:
+    typedef std::pair<std::string, std::string> key_type;
+    typedef std::map<key_type, CAmount> map_type;
+    typedef map_type::value_type value_type;
+    typedef map_type::iterator iterator;
+    typedef map_type::const_iterator const_iterator;
+
+    iterator begin() { return mapAmounts.begin(); }
+    iterator end() { return mapAmounts.end(); }
+    const_iterator begin() const { return mapAmounts.begin(); }
+    const_iterator end() const { return mapAmounts.end(); }
+
+    iterator find(const key_type& key) { return mapAmounts.find(key); }
+    const_iterator find(const key_type& key) const { return mapAmounts.find(key); }
+    const_iterator lower_bound(const key_type& key) const { return mapAmounts.lower_bound(key); }
+    size_t count(const key_type& key) const { return mapAmounts.count(key); }
+    size_t size() const { return mapAmounts.size(); }
+    bool empty() const { return mapAmounts.empty(); }
+
+    CAmount& at(const key_type& key) { return mapAmounts.at(key); }
+    const CAmount& at(const key_type& key) const { return mapAmounts.at(key); }
+
+    CAmount& operator[](const key_type& key)
+    {
+        return insert(std::make_pair(key, CAmount(0))).first->second;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        std::pair<iterator, bool> ret = mapAmounts.insert(value);
+        if (ret.second)
+            setAddressTokens.emplace(value.first.second, value.first.first);
+        return ret;
+    }
+
+    void clear()
+    {
+        mapAmounts.clear();
+        setAddressTokens.clear();
+    }
+
+    //! Call fn(tokenName, amount) for every entry of an address, in token name order
+    template<typename Callable>
+    void ForEachAddressEntry(const std::string& address, Callable fn) const
+    {
+        for (auto it = setAddressTokens.lower_bound(std::make_pair(address, std::string())); it != setAddressTokens.end() && it->first == address; ++it)
+            fn(it->second, mapAmounts.at(std::make_pair(it->second, it->first)));
+    }
+
+    const map_type& GetMap() const { return mapAmounts; }
+    const std::set<key_type>& GetAddressIndex() const { return setAddressTokens; }
+
+private:
+    map_type mapAmounts;
+    std::set<key_type> setAddressTokens; // pair < Address , Token Name >
+};
+
+/** Heap memory owned by the token types held in the token caches */
+namespace memusage
+{
+static inline size_t DynamicUsage(const CTokenAddressAmountMap& amounts)
+{
+    size_t usage = DynamicUsage(amounts.GetMap()) + DynamicUsage(amounts.GetAddressIndex());
+    for (const auto& key : amounts.GetAddressIndex())
+        usage += DynamicUsage(key);
+    return usage;
+}
+
+static inline size_t DynamicUsage(const CNewToken& token)
+{
+    return DynamicUsage(token.strName) + DynamicUsage(token.strIPFSHash) + DynamicUsage(token.nRoyaltiesAddress);
+}
+
+static inline size_t DynamicUsage(const CReissueToken& reissue)
+{
+    return DynamicUsage(reissue.strName) + DynamicUsage(reissue.strIPFSHash) + DynamicUsage(reissue.nRoyaltiesAddress);
+}
+
+static inline size_t DynamicUsage(const CTokenTransfer& transfer)
+{
+    return DynamicUsage(transfer.strName) + DynamicUsage(transfer.message);
+}
+
+static inline size_t DynamicUsage(const CDatabasedTokenData& data)
+{
+    return DynamicUsage(data.token);
+}
+
+static inline size_t DynamicUsage(const CNullTokenTxVerifierString& verifier)
+{
+    return DynamicUsage(verifier.verifier_string);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheNewToken& item)
+{
+    return DynamicUsage(item.token) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheReissueToken& item)
+{
+    return DynamicUsage(item.reissue) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheNewTransfer& item)
+{
+    return DynamicUsage(item.transfer) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheNewOwner& item)
+{
+    return DynamicUsage(item.tokenName) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheUndoTokenAmount& item)
+{
+    return DynamicUsage(item.tokenName) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheSpendToken& item)
+{
+    return DynamicUsage(item.tokenName) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheQualifierAddress& item)
+{
+    return DynamicUsage(item.tokenName) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheRootQualifierChecker& item)
+{
+    return DynamicUsage(item.rootTokenName) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheRestrictedAddress& item)
+{
+    return DynamicUsage(item.tokenName) + DynamicUsage(item.address);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheRestrictedGlobal& item)
+{
+    return DynamicUsage(item.tokenName);
+}
+
+static inline size_t DynamicUsage(const CTokenCacheRestrictedVerifiers& item)
+{
+    return DynamicUsage(item.tokenName) + DynamicUsage(item.verifier);
+}
+
+//! Container usage including the heap memory owned by each element
+template<typename C>
+static inline size_t DeepDynamicUsage(const C& container)
+{
+    size_t usage = DynamicUsage(container);
+    for (const auto& item : container)
+        usage += DynamicUsage(item);
+    return usage;
+}
+}
+
 // Least Recently Used Cache
-template<typename cache_key_t, typename cache_value_t>
+//
+// Entries live in a vector that is reserved up front and recycled on eviction, they are linked
+// into the recency list by index and found through an open addressing hash table of entry
+// indexes. Once the cache is full, Put reuses the evicted entry and never allocates for the
+// entry itself.
+template<typename cache_key_t, typename cache_value_t, typename cache_hasher_t = std::hash<cache_key_t> >
 class CLRUCache
 {
-public:
-    typedef typename std::pair<cache_key_t, cache_value_t> key_value_pair_t;
-    typedef typename std::list<key_value_pair_t>::iterator list_iterator_t;
+private:
+    static const uint32_t NIL = std::numeric_limits<uint32_t>::max();
 
-    CLRUCache(size_t max_size) : maxSize(max_size)
+    struct Entry
     {
+        cache_key_t key;
+        cache_value_t value;
+        size_t nHash;
+        uint32_t prev;
+        uint32_t next;
+
+        Entry(const cache_key_t& key, const cache_value_t& value, size_t nHash) : key(key), value(value), nHash(nHash), prev(NIL), next(NIL) {}
+    };
+
+public:
+    CLRUCache(size_t max_size)
+    {
+        SetNull();
+        SetSize(max_size);
     }
     CLRUCache()
     {
@@ -585,69 +913,134 @@ public:
 
     void Put(const cache_key_t& key, const cache_value_t& value)
     {
-        auto it = cacheItemsMap.find(key);
-        cacheItemsList.push_front(key_value_pair_t(key, value));
-        if (it != cacheItemsMap.end())
-        {
-            cacheItemsList.erase(it->second);
-            cacheItemsMap.erase(it);
+        if (maxSize == 0)
+            return;
+
+        size_t nHash = hasher(key);
+        size_t nPos = FindPos(key, nHash);
+        if (vTable[nPos] != NIL) {
+            uint32_t nIndex = vTable[nPos];
+            vEntries[nIndex].value = value;
+            MoveToFront(nIndex);
+            return;
         }
-        cacheItemsMap[key] = cacheItemsList.begin();
 
-        if (cacheItemsMap.size() > maxSize)
-        {
-            auto last = cacheItemsList.end();
-            last--;
-            cacheItemsMap.erase(last->first);
-            cacheItemsList.pop_back();
+        uint32_t nIndex;
+        if (nFree != NIL) {
+            nIndex = nFree;
+            nFree = vEntries[nIndex].next;
+            vEntries[nIndex].key = key;
+            vEntries[nIndex].value = value;
+            vEntries[nIndex].nHash = nHash;
+        } else if (vEntries.size() < maxSize) {
+            // Reserved on first use, so an unused cache holds no entries
+            if (vEntries.capacity() < maxSize)
+                vEntries.reserve(maxSize);
+            nIndex = vEntries.size();
+            vEntries.emplace_back(key, value, nHash);
+        } else {
+            // Full, recycle the least recently used entry
+            nIndex = nTail;
+            RemoveFromTable(nIndex);
+            Unlink(nIndex);
+            nSize--;
+            nEvictions++;
+            vEntries[nIndex].key = key;
+            vEntries[nIndex].value = value;
+            vEntries[nIndex].nHash = nHash;
+            nPos = FindPos(key, nHash);
         }
+
+        vTable[nPos] = nIndex;
+        PushFront(nIndex);
+        nSize++;
     }
 
     void Erase(const cache_key_t& key)
     {
-        auto it = cacheItemsMap.find(key);
-        if (it != cacheItemsMap.end())
-        {
-            cacheItemsList.erase(it->second);
-            cacheItemsMap.erase(it);
-        }
+        if (maxSize == 0)
+            return;
+
+        size_t nPos = FindPos(key, hasher(key));
+        if (vTable[nPos] == NIL)
+            return;
+
+        uint32_t nIndex = vTable[nPos];
+        RemoveFromTable(nIndex);
+        Unlink(nIndex);
+        // Release the memory the key and value own until the entry is reused
+        cache_key_t keyReleased;
+        cache_value_t valueReleased;
+        std::swap(vEntries[nIndex].key, keyReleased);
+        std::swap(vEntries[nIndex].value, valueReleased);
+        vEntries[nIndex].next = nFree;
+        nFree = nIndex;
+        nSize--;
     }
 
     const cache_value_t& Get(const cache_key_t& key)
     {
-        auto it = cacheItemsMap.find(key);
-        if (it == cacheItemsMap.end())
+        uint32_t nIndex = Find(key);
+        if (nIndex == NIL)
         {
+            nMisses++;
             throw std::range_error("There is no such key in cache");
         }
         else
         {
-            cacheItemsList.splice(cacheItemsList.begin(), cacheItemsList, it->second);
-            return it->second->second;
+            nHits++;
+            MoveToFront(nIndex);
+            return vEntries[nIndex].value;
         }
     }
 
     bool Exists(const cache_key_t& key) const
     {
-        return cacheItemsMap.find(key) != cacheItemsMap.end();
+        if (Find(key) != NIL) {
+            nHits++;
+            return true;
+        }
+
+        nMisses++;
+        return false;
+    }
+
+    //! Copy the value out and touch the entry if the key is cached, counting one hit or miss
+    bool Lookup(const cache_key_t& key, cache_value_t& value)
+    {
+        uint32_t nIndex = Find(key);
+        if (nIndex == NIL) {
+            nMisses++;
+            return false;
+        }
+        nHits++;
+        MoveToFront(nIndex);
+        value = vEntries[nIndex].value;
+        return true;
     }
 
     size_t Size() const
     {
-        return cacheItemsMap.size();
+        return nSize;
     }
 
 
     void Clear()
     {
-        cacheItemsMap.clear();
-        cacheItemsList.clear();
+        vEntries.clear();
+        std::fill(vTable.begin(), vTable.end(), NIL);
+        nHead = nTail = nFree = NIL;
+        nSize = 0;
     }
 
     void SetNull()
     {
         maxSize = 0;
-        Clear();
+        vEntries.clear();
+        vTable.clear();
+        nHead = nTail = nFree = NIL;
+        nSize = 0;
+        nHits = nMisses = nEvictions = 0;
     }
 
     size_t MaxSize() const
@@ -655,34 +1048,341 @@ public:
         return maxSize;
     }
 
+    //! Memory used by the cache, including the entries that are free for reuse
+    size_t DynamicMemoryUsage() const
+    {
+        size_t usage = memusage::DynamicUsage(vEntries) + memusage::DynamicUsage(vTable);
+        for (const auto& entry : vEntries)
+            usage += memusage::DynamicUsage(entry.key) + memusage::DynamicUsage(entry.value);
+        return usage;
+    }
+
+    //! Number of Get, Exists and Lookup calls that found the key
+    uint64_t Hits() const { return nHits; }
+
+    //! Number of Get, Exists and Lookup calls that didn't find the key
+    uint64_t Misses() const { return nMisses; }
+
+    //! Number of entries dropped to make room for a new one
+    uint64_t Evictions() const { return nEvictions; }
 
     void SetSize(const size_t size)
     {
+        assert(size < NIL);
+
+        // Keep the most recently used entries that still fit, in recency order
+        std::vector<std::pair<cache_key_t, cache_value_t> > vKeep;
+        for (uint32_t nIndex = nHead; nIndex != NIL && vKeep.size() < size; nIndex = vEntries[nIndex].next)
+            vKeep.emplace_back(vEntries[nIndex].key, vEntries[nIndex].value);
+        nEvictions += nSize - vKeep.size();
+
         maxSize = size;
+        std::vector<Entry>().swap(vEntries);
+
+        size_t nTableSize = 0;
+        if (maxSize) {
+            nTableSize = 1;
+            while (nTableSize < 2 * maxSize)
+                nTableSize <<= 1;
+        }
+        vTable.assign(nTableSize, NIL);
+        nHead = nTail = nFree = NIL;
+        nSize = 0;
+
+        for (auto it = vKeep.rbegin(); it != vKeep.rend(); ++it)
+            Put(it->first, it->second);
     }
 
-   const std::unordered_map<cache_key_t, list_iterator_t>& GetItemsMap()
+private:
+    //! Table slot holding the key, or the empty slot where it would be inserted
+    size_t FindPos(const cache_key_t& key, size_t nHash) const
     {
-        return cacheItemsMap;
-    };
+        size_t nMask = vTable.size() - 1;
+        size_t nPos = nHash & nMask;
+        while (vTable[nPos] != NIL && !(vEntries[vTable[nPos]].nHash == nHash && vEntries[vTable[nPos]].key == key))
+            nPos = (nPos + 1) & nMask;
+        return nPos;
+    }
 
-    const std::list<key_value_pair_t>& GetItemsList()
+    uint32_t Find(const cache_key_t& key) const
     {
-        return cacheItemsList;
-    };
+        if (vTable.empty())
+            return NIL;
+        return vTable[FindPos(key, hasher(key))];
+    }
+
+    //! Linear probing removal, shift back the entries that probed past the freed slot
+    void RemoveFromTable(uint32_t nIndex)
+    {
+        size_t nMask = vTable.size() - 1;
+        size_t nPos = FindPos(vEntries[nIndex].key, vEntries[nIndex].nHash);
+        size_t nNext = nPos;
+        while (true) {
+            nNext = (nNext + 1) & nMask;
+            if (vTable[nNext] == NIL)
+                break;
+            size_t nHome = vEntries[vTable[nNext]].nHash & nMask;
+            if (((nNext - nHome) & nMask) >= ((nNext - nPos) & nMask)) {
+                vTable[nPos] = vTable[nNext];
+                nPos = nNext;
+            }
+        }
+        vTable[nPos] = NIL;
+    }
+
+    void Unlink(uint32_t nIndex)
+    {
+        Entry& entry = vEntries[nIndex];
+        if (entry.prev != NIL)
+            vEntries[entry.prev].next = entry.next;
+        else
+            nHead = entry.next;
+        if (entry.next != NIL)
+            vEntries[entry.next].prev = entry.prev;
+        else
+            nTail = entry.prev;
+        entry.prev = entry.next = NIL;
+    }
+
+    void PushFront(uint32_t nIndex)
+    {
+        Entry& entry = vEntries[nIndex];
+        entry.prev = NIL;
+        entry.next = nHead;
+        if (nHead != NIL)
+            vEntries[nHead].prev = nIndex;
+        nHead = nIndex;
+        if (nTail == NIL)
+            nTail = nIndex;
+    }
+
+    void MoveToFront(uint32_t nIndex)
+    {
+        if (nHead == nIndex)
+            return;
+        Unlink(nIndex);
+        PushFront(nIndex);
+    }
+
+    std::vector<Entry> vEntries;
+    std::vector<uint32_t> vTable;
+    cache_hasher_t hasher;
+    uint32_t nHead;
+    uint32_t nTail;
+    uint32_t nFree;
+    size_t nSize;
+    size_t maxSize;
+    mutable uint64_t nHits;
+    mutable uint64_t nMisses;
+    uint64_t nEvictions;
+};
+
+template<typename cache_key_t, typename cache_value_t, typename cache_hasher_t>
+const uint32_t CLRUCache<cache_key_t, cache_value_t, cache_hasher_t>::NIL;
+
+// Compact ids for names, so caches can be keyed by integers instead of strings built on every lookup.
+// Ids are handed out in order and never reused until Clear, so anything keyed by them must be cleared with it.
+class CNameInterner
+{
+public:
+    static const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    explicit CNameInterner(size_t nMaxSize) : nMaxSize(nMaxSize) {}
+
+    //! Id of the name, assigning the next one if it wasn't interned yet
+    uint32_t Intern(const std::string& name)
+    {
+        auto it = mapIds.find(name);
+        if (it != mapIds.end())
+            return it->second;
+
+        uint32_t nId = mapIds.size();
+        mapIds.emplace(name, nId);
+        return nId;
+    }
+
+    //! Id of the name, or NONE if it was never interned
+    uint32_t Find(const std::string& name) const
+    {
+        auto it = mapIds.find(name);
+        return it == mapIds.end() ? NONE : it->second;
+    }
+
+    //! Whether interning nCount more names could go over the size limit
+    bool Full(size_t nCount) const { return mapIds.size() + nCount > nMaxSize; }
+
+    void Clear() { mapIds.clear(); }
+
+    size_t Size() const { return mapIds.size(); }
+
+    size_t DynamicMemoryUsage() const
+    {
+        size_t usage = memusage::DynamicUsage(mapIds);
+        for (const auto& item : mapIds)
+            usage += memusage::DynamicUsage(item.first);
+        return usage;
+    }
+
+private:
+    std::unordered_map<std::string, uint32_t> mapIds;
+    size_t nMaxSize;
+};
+
+//! Hasher for keys made of two interned ids, the low half alone would cluster every key of one name
+struct CInternedPairHasher
+{
+    size_t operator()(uint64_t key) const
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return key;
+    }
+};
+
+//! Caches of the restricted token subsystem, keyed by interned (token, address) ids or by an interned token id
+typedef CLRUCache<uint64_t, int8_t, CInternedPairHasher> CRestrictedLRUCache;
+
+// Least Recently Used Cache split into shards that are locked independently, so lookups
+// from several threads don't serialize on one lock. Recency is tracked per shard.
+template<typename cache_key_t, typename cache_value_t>
+class CShardedLRUCache
+{
+public:
+    static const size_t SHARDS = 16;
+
+    CShardedLRUCache(size_t max_size)
+    {
+        SetSize(max_size);
+    }
+    CShardedLRUCache()
+    {
+        SetNull();
+    }
+
+    void Put(const cache_key_t& key, const cache_value_t& value)
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        shard.cache.Put(key, value);
+    }
+
+    void Erase(const cache_key_t& key)
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        shard.cache.Erase(key);
+    }
+
+    //! Copy the value out if the key is cached, checking and reading under one lock
+    bool Lookup(const cache_key_t& key, cache_value_t& value)
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        return shard.cache.Lookup(key, value);
+    }
 
+    cache_value_t Get(const cache_key_t& key)
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        return shard.cache.Get(key);
+    }
+
+    bool Exists(const cache_key_t& key) const
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        return shard.cache.Exists(key);
+    }
 
-    CLRUCache(const CLRUCache& cache)
+    size_t Size() const
     {
-        this->cacheItemsList = cache.cacheItemsList;
-        this->cacheItemsMap = cache.cacheItemsMap;
-        this->maxSize = cache.maxSize;
+        return Sum([](const CLRUCache<cache_key_t, cache_value_t>& cache) { return (uint64_t)cache.Size(); });
+    }
+
+    void Clear()
+    {
+        for (auto& shard : vShards) {
+            std::lock_guard<std::mutex> lock(shard.cs);
+            shard.cache.Clear();
+        }
+    }
+
+    void SetNull()
+    {
+        maxSize = 0;
+        for (auto& shard : vShards) {
+            std::lock_guard<std::mutex> lock(shard.cs);
+            shard.cache.SetNull();
+        }
+    }
+
+    size_t MaxSize() const
+    {
+        return maxSize;
+    }
+
+    void SetSize(const size_t size)
+    {
+        maxSize = size;
+        for (auto& shard : vShards) {
+            std::lock_guard<std::mutex> lock(shard.cs);
+            shard.cache.SetSize((size + SHARDS - 1) / SHARDS);
+        }
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return Sum([](const CLRUCache<cache_key_t, cache_value_t>& cache) { return (uint64_t)cache.DynamicMemoryUsage(); });
+    }
+
+    uint64_t Hits() const
+    {
+        return Sum([](const CLRUCache<cache_key_t, cache_value_t>& cache) { return cache.Hits(); });
+    }
+
+    uint64_t Misses() const
+    {
+        return Sum([](const CLRUCache<cache_key_t, cache_value_t>& cache) { return cache.Misses(); });
+    }
+
+    uint64_t Evictions() const
+    {
+        return Sum([](const CLRUCache<cache_key_t, cache_value_t>& cache) { return cache.Evictions(); });
     }
 
 private:
-    std::list<key_value_pair_t> cacheItemsList;
-    std::unordered_map<cache_key_t, list_iterator_t> cacheItemsMap;
+    struct Shard
+    {
+        mutable std::mutex cs;
+        CLRUCache<cache_key_t, cache_value_t> cache;
+    };
+
+    //! The shard is picked from the high bits of the hash, the low bits index the table inside the shard
+    Shard& GetShard(const cache_key_t& key) const
+    {
+        uint64_t nHash = (uint64_t)hasher(key) * 0x9E3779B97F4A7C15ULL;
+        return vShards[(nHash >> 32) % SHARDS];
+    }
+
+    template<typename Fn>
+    uint64_t Sum(Fn fn) const
+    {
+        uint64_t nTotal = 0;
+        for (const auto& shard : vShards) {
+            std::lock_guard<std::mutex> lock(shard.cs);
+            nTotal += fn(shard.cache);
+        }
+        return nTotal;
+    }
+
+    mutable Shard vShards[SHARDS];
+    std::hash<cache_key_t> hasher;
     size_t maxSize;
 };
 
+template<typename cache_key_t, typename cache_value_t>
+const size_t CShardedLRUCache<cache_key_t, cache_value_t>::SHARDS;
+
 #endif //PLBCOIN_NEWTOKEN_H
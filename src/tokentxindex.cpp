@@ -0,0 +1,267 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "tokentxindex.h"
+
+#include "base58.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "tokens/tokens.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+static const char DB_TOKEN_TX = 't';
+static const char DB_BLOCK_KEYS = 'k';
+static const char DB_BEST_BLOCK = 'B';
+
+CTokenTxIndex* ptokentxindex = nullptr;
+
+/** The token, amount and address of a token output to an address */
+static bool ParseTokenOutput(const CTxOut& out, std::string& strToken, CTokenTxIndexValue& value)
+{
+    if (!out.scriptPubKey.IsTokenScript())
+        return false;
+
+    uint160 hashBytes;
+    int nScriptType;
+    uint32_t nTimeLock = 0;
+    if (!ParseTokenScript(out.scriptPubKey, hashBytes, nScriptType, strToken, value.nAmount, nTimeLock))
+        return false;
+
+    if (nScriptType == TX_PUBKEYHASH)
+        value.strAddress = EncodeDestination(CKeyID(hashBytes));
+    else if (nScriptType == TX_SCRIPTHASH)
+        value.strAddress = EncodeDestination(CScriptID(hashBytes));
+    else
+        return false;
+
+    return true;
+}
+
+CTokenTxIndex::CTokenTxIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+    : CDBWrapper(GetDataDir() / "indexes" / "tokentx", nCacheSize, fMemory, fWipe)
+{
+}
+
+void CTokenTxIndex::BlockEntries(const CBlock& block, const CBlockUndo& blockUndo, int nHeight, std::vector<std::pair<CTokenTxIndexKey, CTokenTxIndexValue> >& vEntries)
+{
+    vEntries.clear();
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        std::string strToken;
+        CTokenTxIndexValue value;
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            if (ParseTokenOutput(tx.vout[n], strToken, value))
+                vEntries.emplace_back(CTokenTxIndexKey(strToken, nHeight, txid, n, false), value);
+        }
+
+        // The undo data has the spent outputs of every transaction but the coinbase
+        if (i == 0 || i > blockUndo.vtxundo.size())
+            continue;
+        const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+        for (uint32_t n = 0; n < txundo.vprevout.size(); n++) {
+            if (ParseTokenOutput(txundo.vprevout[n].out, strToken, value))
+                vEntries.emplace_back(CTokenTxIndexKey(strToken, nHeight, txid, n, true), value);
+        }
+    }
+}
+
+bool CTokenTxIndex::WriteBlock(const CBlock& block, const CBlockUndo& blockUndo, const CBlockIndex* pindex)
+{
+    std::vector<std::pair<CTokenTxIndexKey, CTokenTxIndexValue> > vEntries;
+    BlockEntries(block, blockUndo, pindex->nHeight, vEntries);
+
+    CDBBatch batch(*this);
+    if (!vEntries.empty()) {
+        std::vector<CTokenTxIndexKey> vKeys;
+        vKeys.reserve(vEntries.size());
+        for (const auto& entry : vEntries) {
+            batch.Write(std::make_pair(DB_TOKEN_TX, entry.first), entry.second);
+            vKeys.push_back(entry.first);
+        }
+        batch.Write(std::make_pair(DB_BLOCK_KEYS, pindex->GetIndexHash()), vKeys);
+    }
+    batch.Write(DB_BEST_BLOCK, pindex->GetIndexHash());
+    return WriteBatch(batch);
+}
+
+bool CTokenTxIndex::RewindBlock(const CBlockIndex* pindex)
+{
+    CDBBatch batch(*this);
+    std::vector<CTokenTxIndexKey> vKeys;
+    if (Read(std::make_pair(DB_BLOCK_KEYS, pindex->GetIndexHash()), vKeys)) {
+        for (const CTokenTxIndexKey& key : vKeys)
+            batch.Erase(std::make_pair(DB_TOKEN_TX, key));
+        batch.Erase(std::make_pair(DB_BLOCK_KEYS, pindex->GetIndexHash()));
+    }
+    if (pindex->pprev)
+        batch.Write(DB_BEST_BLOCK, pindex->pprev->GetIndexHash());
+    else
+        batch.Erase(DB_BEST_BLOCK);
+    return WriteBatch(batch);
+}
+
+bool CTokenTxIndex::ReadBestBlock(uint256& hashBlock) const
+{
+    return Read(DB_BEST_BLOCK, hashBlock);
+}
+
+bool CTokenTxIndex::Walk(const std::string& strToken, int nStartHeight, const std::function<bool(const CTokenTxIndexKey&, const CTokenTxIndexValue&)>& fn)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_TOKEN_TX, CTokenTxIndexKey(strToken, std::max(nStartHeight, 0), uint256(), 0, false)));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CTokenTxIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TOKEN_TX || key.second.strToken != strToken)
+            break;
+        CTokenTxIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read the entry of %s at height %d", __func__, strToken, key.second.nHeight);
+        if (!fn(key.second, value))
+            break;
+    }
+    return true;
+}
+
+namespace {
+std::mutex csTokenTxIndex;
+std::condition_variable condTokenTxIndex;
+bool fTokenTxIndexStop = false;
+bool fTokenTxIndexRunning = false;
+std::thread threadTokenTxIndex;
+std::atomic<int> nTokenTxIndexHeight(-1);
+}
+
+/** Wait for up to a second, false once the thread has to stop */
+static bool TokenTxIndexWait()
+{
+    std::unique_lock<std::mutex> lock(csTokenTxIndex);
+    if (!fTokenTxIndexStop)
+        condTokenTxIndex.wait_for(lock, std::chrono::seconds(1));
+    return !fTokenTxIndexStop;
+}
+
+static bool TokenTxIndexStopping()
+{
+    std::lock_guard<std::mutex> lock(csTokenTxIndex);
+    return fTokenTxIndexStop;
+}
+
+static void ThreadTokenTxIndex()
+{
+    const Consensus::Params& consensusParams = GetParams().GetConsensus();
+
+    // Blocks being imported or reindexed aren't on the active chain yet
+    while (fImporting || fReindex) {
+        if (!TokenTxIndexWait())
+            return;
+    }
+
+    // The last block written to the index, null before the genesis block is
+    const CBlockIndex* pindexBest = nullptr;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (ptokentxindex->ReadBestBlock(hashBest)) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it != mapBlockIndex.end())
+                pindexBest = it->second;
+        }
+        LogPrintf("%s: building the token transaction index from height %d\n", __func__, pindexBest ? pindexBest->nHeight + 1 : 0);
+    }
+    nTokenTxIndexHeight = pindexBest ? pindexBest->nHeight : -1;
+
+    bool fSynced = false;
+    while (!TokenTxIndexStopping()) {
+        const CBlockIndex* pindexNext = nullptr;
+        bool fRewind;
+        {
+            LOCK(cs_main);
+            // Unlike block filters the entries are by height, so those of a block a reorg disconnected have to go
+            fRewind = pindexBest && !chainActive.Contains(pindexBest);
+            if (!fRewind)
+                pindexNext = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+        }
+        if (fRewind) {
+            // Lowered first, the entries of the block are about to go
+            nTokenTxIndexHeight = pindexBest->nHeight - 1;
+            if (!ptokentxindex->RewindBlock(pindexBest)) {
+                error("%s: failed to rewind block %s", __func__, pindexBest->GetIndexHash().ToString());
+                return;
+            }
+            pindexBest = pindexBest->pprev;
+            continue;
+        }
+        if (!pindexNext) {
+            if (!fSynced && pindexBest) {
+                LogPrintf("%s: token transaction index built up to height %d\n", __func__, pindexBest->nHeight);
+                fSynced = true;
+            }
+            TokenTxIndexWait();
+            continue;
+        }
+
+        CBlock block;
+        CBlockUndo blockUndo;
+        if (!ReadBlockFromDisk(block, pindexNext, consensusParams)) {
+            error("%s: failed to read block %s", __func__, pindexNext->GetIndexHash().ToString());
+            return;
+        }
+        if (pindexNext->pprev && !UndoReadFromDisk(blockUndo, pindexNext->GetUndoPos(), pindexNext->pprev->GetIndexHash())) {
+            error("%s: failed to read undo data of block %s", __func__, pindexNext->GetIndexHash().ToString());
+            return;
+        }
+
+        if (!ptokentxindex->WriteBlock(block, blockUndo, pindexNext)) {
+            error("%s: failed to write the entries of block %s", __func__, pindexNext->GetIndexHash().ToString());
+            return;
+        }
+        pindexBest = pindexNext;
+        nTokenTxIndexHeight = pindexBest->nHeight;
+        if (!fSynced && pindexBest->nHeight % 10000 == 0)
+            LogPrintf("%s: token transaction index built up to height %d\n", __func__, pindexBest->nHeight);
+    }
+}
+
+void StartTokenTxIndex()
+{
+    std::lock_guard<std::mutex> lock(csTokenTxIndex);
+    if (fTokenTxIndexRunning || !ptokentxindex)
+        return;
+
+    fTokenTxIndexStop = false;
+    fTokenTxIndexRunning = true;
+    threadTokenTxIndex = std::thread(&TraceThread<std::function<void()> >, "tokentxindex", std::function<void()>(ThreadTokenTxIndex));
+}
+
+void StopTokenTxIndex()
+{
+    {
+        std::lock_guard<std::mutex> lock(csTokenTxIndex);
+        if (!fTokenTxIndexRunning)
+            return;
+        fTokenTxIndexStop = true;
+    }
+    condTokenTxIndex.notify_all();
+    threadTokenTxIndex.join();
+
+    std::lock_guard<std::mutex> lock(csTokenTxIndex);
+    fTokenTxIndexRunning = false;
+}
+
+int GetTokenTxIndexHeight()
+{
+    return nTokenTxIndexHeight;
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_TOKENTXINDEX_H
+#define PLB_TOKENTXINDEX_H
+
+#include "amount.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+static const bool DEFAULT_TOKENTXINDEX = false;
+
+/** Most entries a gettokentransactions call returns */
+static const int MAX_TOKEN_TRANSACTIONS_COUNT = 10000;
+
+/** A token output a transaction created, or a token output one of its inputs spent, by token and height */
+struct CTokenTxIndexKey
+{
+    std::string strToken;
+    int nHeight;
+    uint256 txid;
+    uint32_t n;     //!< the output, or for a spend the input of txid
+    bool fSpend;
+
+    CTokenTxIndexKey() : nHeight(0), n(0), fSpend(false) {}
+    CTokenTxIndexKey(const std::string& strTokenIn, int nHeightIn, const uint256& txidIn, uint32_t nIn, bool fSpendIn)
+        : strToken(strTokenIn), nHeight(nHeightIn), txid(txidIn), n(nIn), fSpend(fSpendIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, strToken);
+        // Big endian so the entries of a token are in height order
+        ser_writedata32be(s, nHeight);
+        ::Serialize(s, txid);
+        ser_writedata32be(s, n);
+        ser_writedata8(s, fSpend);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, strToken);
+        nHeight = ser_readdata32be(s);
+        ::Unserialize(s, txid);
+        n = ser_readdata32be(s);
+        fSpend = ser_readdata8(s);
+    }
+};
+
+struct CTokenTxIndexValue
+{
+    CAmount nAmount;
+    std::string strAddress; //!< the address the output pays to
+
+    CTokenTxIndexValue() : nAmount(0) {}
+    CTokenTxIndexValue(CAmount nAmountIn, const std::string& strAddressIn) : nAmount(nAmountIn), strAddress(strAddressIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nAmount);
+        READWRITE(strAddress);
+    }
+};
+
+/**
+ * The token outputs created and spent by the transactions of the active chain, by token and height. Every block
+ * also keeps the list of its keys, so the blocks a reorg disconnects can be taken out again. Like the block filter
+ * index a background thread builds it from the blocks and undo data on disk and follows the tip.
+ */
+class CTokenTxIndex : public CDBWrapper
+{
+public:
+    explicit CTokenTxIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    CTokenTxIndex(const CTokenTxIndex&) = delete;
+    CTokenTxIndex& operator=(const CTokenTxIndex&) = delete;
+
+    //! Add the token outputs and spends of a block, whose parent is the best block, and make it the best block
+    bool WriteBlock(const CBlock& block, const CBlockUndo& blockUndo, const CBlockIndex* pindex);
+
+    //! Take out the entries of the best block, making its parent the best block
+    bool RewindBlock(const CBlockIndex* pindex);
+
+    //! The last block the entries were written for
+    bool ReadBestBlock(uint256& hashBlock) const;
+
+    //! Call fn with the entries of the token from nStartHeight on, in height order, until it returns false
+    bool Walk(const std::string& strToken, int nStartHeight, const std::function<bool(const CTokenTxIndexKey&, const CTokenTxIndexValue&)>& fn);
+
+    //! The token outputs and spends of a block, as WriteBlock adds them
+    static void BlockEntries(const CBlock& block, const CBlockUndo& blockUndo, int nHeight, std::vector<std::pair<CTokenTxIndexKey, CTokenTxIndexValue> >& vEntries);
+};
+
+/** The token transaction index, null unless -tokentxindex is set */
+extern CTokenTxIndex* ptokentxindex;
+
+/** Start the thread that adds the blocks ptokentxindex is missing */
+void StartTokenTxIndex();
+
+/** Stop the token transaction index thread, before ptokentxindex goes away */
+void StopTokenTxIndex();
+
+/** Height of the last block in the token transaction index, -1 before it has any */
+int GetTokenTxIndexHeight();
+
+#endif // PLB_TOKENTXINDEX_H
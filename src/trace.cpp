@@ -0,0 +1,128 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "trace.h"
+
+#include "tinyformat.h"
+
+#include <algorithm>
+#include <map>
+#include <thread>
+
+#include <boost/thread/mutex.hpp>
+
+std::atomic<bool> fTracing(false);
+
+namespace {
+struct TraceEvent {
+    const char* pszName;
+    int64_t nStartMicros;
+    int64_t nMicros;
+    uint32_t nThread;
+};
+
+boost::mutex csTrace;
+//! By the name literal the spans were recorded with
+std::map<const char*, TraceSpanStats> mapTraceStats;
+//! A ring of the latest spans, nTraceEventNext being where the next one goes
+std::vector<TraceEvent> vTraceEvents;
+size_t nTraceEventNext = 0;
+} // namespace
+
+static int HistogramBucket(int64_t nMicros)
+{
+    int nBucket = 0;
+    while (nBucket < TRACE_HISTOGRAM_BUCKETS - 1 && nMicros >= (int64_t(1) << nBucket))
+        nBucket++;
+    return nBucket;
+}
+
+void EndTraceSpan(const char* pszName, int64_t nStartMicros)
+{
+    const int64_t nMicros = GetTimeMicros() - nStartMicros;
+    const uint32_t nThread = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    boost::unique_lock<boost::mutex> lock(csTrace);
+    TraceSpanStats& stats = mapTraceStats[pszName];
+    stats.nCount++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+    stats.vBuckets[HistogramBucket(nMicros)]++;
+
+    TraceEvent event = {pszName, nStartMicros, nMicros, nThread};
+    if (vTraceEvents.size() < TRACE_EVENT_BUFFER_SIZE) {
+        vTraceEvents.push_back(event);
+    } else {
+        vTraceEvents[nTraceEventNext] = event;
+    }
+    nTraceEventNext = (nTraceEventNext + 1) % TRACE_EVENT_BUFFER_SIZE;
+}
+
+void SetTracing(bool fEnable)
+{
+    fTracing.store(fEnable, std::memory_order_relaxed);
+}
+
+std::vector<TraceSpanStats> GetTraceStats()
+{
+    // A name's literal may differ between translation units, so spans are merged by name
+    std::map<std::string, TraceSpanStats> mapSpans;
+    {
+        boost::unique_lock<boost::mutex> lock(csTrace);
+        for (const auto& entry : mapTraceStats) {
+            TraceSpanStats& merged = mapSpans[entry.first];
+            const TraceSpanStats& stats = entry.second;
+            merged.strName = entry.first;
+            merged.nCount += stats.nCount;
+            merged.nTotalMicros += stats.nTotalMicros;
+            merged.nMaxMicros = std::max(merged.nMaxMicros, stats.nMaxMicros);
+            for (int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++)
+                merged.vBuckets[i] += stats.vBuckets[i];
+        }
+    }
+
+    std::vector<TraceSpanStats> vStats;
+    vStats.reserve(mapSpans.size());
+    for (const auto& span : mapSpans)
+        vStats.push_back(span.second);
+    std::sort(vStats.begin(), vStats.end(), [](const TraceSpanStats& a, const TraceSpanStats& b) {
+        return a.nTotalMicros > b.nTotalMicros;
+    });
+    return vStats;
+}
+
+void ResetTraceStats()
+{
+    boost::unique_lock<boost::mutex> lock(csTrace);
+    mapTraceStats.clear();
+    vTraceEvents.clear();
+    nTraceEventNext = 0;
+}
+
+int64_t WriteTraceEvents(const fs::path& path)
+{
+    std::vector<TraceEvent> vEvents;
+    {
+        boost::unique_lock<boost::mutex> lock(csTrace);
+        vEvents.reserve(vTraceEvents.size());
+        // Oldest first; until the ring is full it starts at the front
+        const size_t nOldest = vTraceEvents.size() < TRACE_EVENT_BUFFER_SIZE ? 0 : nTraceEventNext;
+        for (size_t i = 0; i < vTraceEvents.size(); i++)
+            vEvents.push_back(vTraceEvents[(nOldest + i) % vTraceEvents.size()]);
+    }
+
+    FILE* file = fsbridge::fopen(path, "w");
+    if (!file)
+        return -1;
+    fputs("{\"traceEvents\":[\n", file);
+    for (size_t i = 0; i < vEvents.size(); i++) {
+        const TraceEvent& event = vEvents[i];
+        fputs(strprintf("{\"name\":\"%s\",\"cat\":\"paladeum\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":0,\"tid\":%u}%s\n", event.pszName,
+            event.nStartMicros, event.nMicros, event.nThread, i + 1 < vEvents.size() ? "," : "").c_str(), file);
+    }
+    fputs("],\"displayTimeUnit\":\"ms\"}\n", file);
+    const bool fOk = !ferror(file);
+    fclose(file);
+    return fOk ? (int64_t)vEvents.size() : -1;
+}
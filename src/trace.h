@@ -0,0 +1,79 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_TRACE_H
+#define PLB_TRACE_H
+
+#include "fs.h"
+#include "utiltime.h"
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Spans time the phases of hot code paths, like the token, governance and index
+ * work of ConnectBlock. TRACE_SPAN("name") times the rest of its scope. While
+ * tracing is off a span costs one relaxed atomic load. While it is on, the
+ * durations are added to a histogram per name, and the latest spans are kept
+ * for WriteTraceEvents, which writes them in the Chrome trace event format
+ * (chrome://tracing or Perfetto).
+ */
+extern std::atomic<bool> fTracing;
+
+void EndTraceSpan(const char* pszName, int64_t nStartMicros);
+
+class CTraceSpan
+{
+public:
+    //! pszName must outlive the process, it is kept as is
+    explicit CTraceSpan(const char* pszName) : m_name(fTracing.load(std::memory_order_relaxed) ? pszName : nullptr), m_start(m_name ? GetTimeMicros() : 0) {}
+    ~CTraceSpan() { End(); }
+    CTraceSpan(const CTraceSpan&) = delete;
+    CTraceSpan& operator=(const CTraceSpan&) = delete;
+
+    /** End the span before the end of its scope */
+    void End()
+    {
+        if (m_name) {
+            EndTraceSpan(m_name, m_start);
+            m_name = nullptr;
+        }
+    }
+
+private:
+    const char* m_name;
+    const int64_t m_start;
+};
+
+#define TRACE_PASTE(x, y) x ## y
+#define TRACE_PASTE2(x, y) TRACE_PASTE(x, y)
+#define TRACE_SPAN(name) CTraceSpan TRACE_PASTE2(tracespan, __COUNTER__)(name)
+
+//! Spans kept for WriteTraceEvents; older ones are dropped
+static const size_t TRACE_EVENT_BUFFER_SIZE = 1 << 16;
+static const int TRACE_HISTOGRAM_BUCKETS = 24;
+
+struct TraceSpanStats {
+    std::string strName;
+    uint64_t nCount;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    //! vBuckets[k] counts the spans of less than 2^k microseconds that are not in an earlier bucket; the last also counts the longer ones
+    std::array<uint64_t, TRACE_HISTOGRAM_BUCKETS> vBuckets;
+
+    TraceSpanStats() : nCount(0), nTotalMicros(0), nMaxMicros(0) { vBuckets.fill(0); }
+};
+
+void SetTracing(bool fEnable);
+/** The span histograms, the most time first */
+std::vector<TraceSpanStats> GetTraceStats();
+/** Drop the histograms and the kept spans */
+void ResetTraceStats();
+/** Write the kept spans as a Chrome trace; returns how many were written, or -1 if the file could not be written */
+int64_t WriteTraceEvents(const fs::path& path);
+
+#endif // PLB_TRACE_H
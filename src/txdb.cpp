@@ -10,13 +10,18 @@
 #include "chainparams.h"
 #include "hash.h"
 #include "random.h"
+#include "streams.h"
 #include "pow.h"
 #include "uint256.h"
 #include "util.h"
 #include "ui_interface.h"
 #include "init.h"
+#include "utxostats.h"
 #include "validation.h"
 
+#include <atomic>
+#include <functional>
+#include <limits>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -37,6 +42,16 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_BUILD = 'I';
+static const char DB_UTXO_SET_STATS = 'S';
+
+/**
+ * Chainstate format version. It is kept on the lowest legacy coins key, so binaries from before it fail to upgrade
+ * that "record" and refuse to open the database. Version 1 stores token transfer scripts with the codes
+ * CScriptCompressor added for them, in the coins and in the undo data.
+ */
+static const uint32_t COINS_FORMAT_VERSION = 1;
+static const std::pair<char, uint256> DB_COINS_FORMAT = std::make_pair(DB_COINS, uint256());
 
 namespace {
 
@@ -62,19 +77,57 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, 2 << 20)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, 2 << 20),
+    fBatchQueued(false), fBackgroundStop(false), fBackgroundFailed(false)
+{
+}
+
+CCoinsViewDB::~CCoinsViewDB()
 {
+    {
+        std::lock_guard<std::mutex> lock(csBackground);
+        fBackgroundStop = true;
+    }
+    condBackground.notify_all();
+    // A batch still queued is written before the thread exits
+    if (threadBackground.joinable())
+        threadBackground.join();
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        std::lock_guard<std::mutex> lock(csBackground);
+        if (pbatchWriting) {
+            CCoinsMap::const_iterator it = pbatchWriting->map.find(outpoint);
+            if (it != pbatchWriting->map.end()) {
+                if (it->second.coin.IsSpent())
+                    return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        std::lock_guard<std::mutex> lock(csBackground);
+        if (pbatchWriting) {
+            CCoinsMap::const_iterator it = pbatchWriting->map.find(outpoint);
+            if (it != pbatchWriting->map.end())
+                return !it->second.coin.IsSpent();
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        std::lock_guard<std::mutex> lock(csBackground);
+        if (pbatchWriting)
+            return pbatchWriting->hashBlock;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -82,6 +135,7 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    SyncBackgroundWrite();
     std::vector<uint256> vhashHeadBlocks;
     if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
         return std::vector<uint256>();
@@ -89,12 +143,7 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
-    CDBBatch batch(db);
-    size_t count = 0;
-    size_t changed = 0;
-    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
-    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+void CCoinsViewDB::BeginTransition(CDBBatch &batch, const uint256 &hashBlock) const {
     assert(!hashBlock.IsNull());
 
     uint256 old_tip = GetBestBlock();
@@ -113,6 +162,13 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     // interrupting after partial writes from multiple independent reorgs.
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+}
+
+bool CCoinsViewDB::WriteCoins(CDBBatch &batch, CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) {
+    size_t count = 0;
+    size_t changed = 0;
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -124,8 +180,13 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        // A batch written in the background answers reads until it is done, so it keeps its entries
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            ++it;
+        }
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -150,11 +211,106 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!SyncBackgroundWrite())
+        return false;
+
+    CDBBatch batch(db);
+    BeginTransition(batch, hashBlock);
+    return WriteCoins(batch, mapCoins, hashBlock, true);
+}
+
+bool CCoinsViewDB::BatchWriteBackground(std::unique_ptr<CCoinsMapBatch> pbatch) {
+    if (!SyncBackgroundWrite())
+        return false;
+
+    // The token and message databases are written right after this returns, the coins only later. Syncing the
+    // transition marker first means a crash before the coins are done is always seen and replayed on startup.
+    CDBBatch batch(db);
+    BeginTransition(batch, pbatch->hashBlock);
+    if (!db.WriteBatch(batch, true))
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(csBackground);
+        pbatchWriting = std::move(pbatch);
+        fBatchQueued = true;
+        if (!threadBackground.joinable())
+            threadBackground = std::thread(&TraceThread<std::function<void()> >, "coinswriter", std::function<void()>(std::bind(&CCoinsViewDB::ThreadBackgroundWrite, this)));
+    }
+    condBackground.notify_all();
+    return true;
+}
+
+void CCoinsViewDB::ThreadBackgroundWrite()
+{
+    while (true) {
+        CCoinsMapBatch* pbatch;
+        {
+            std::unique_lock<std::mutex> lock(csBackground);
+            condBackground.wait(lock, [this] { return fBackgroundStop || fBatchQueued; });
+            if (!fBatchQueued)
+                return;
+            fBatchQueued = false;
+            pbatch = pbatchWriting.get();
+        }
+
+        // Nothing changes the map while it is in flight, the readers only look entries up in it
+        bool fWritten = false;
+        try {
+            CDBBatch batch(db);
+            fWritten = WriteCoins(batch, pbatch->map, pbatch->hashBlock, false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+
+        std::unique_ptr<CCoinsMapBatch> pbatchDone;
+        {
+            std::lock_guard<std::mutex> lock(csBackground);
+            // A batch that failed to write keeps answering reads, the node shuts down on the failure anyway
+            if (fWritten)
+                pbatchDone = std::move(pbatchWriting);
+            else
+                fBackgroundFailed = true;
+        }
+        condBackground.notify_all();
+        // The map and its pool are freed here, outside of the lock
+    }
+}
+
+bool CCoinsViewDB::SyncBackgroundWrite() const
+{
+    std::unique_lock<std::mutex> lock(csBackground);
+    condBackground.wait(lock, [this] { return !pbatchWriting || fBackgroundFailed; });
+    return !fBackgroundFailed;
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
+bool CCoinsViewDB::WriteFormatVersion()
+{
+    uint32_t nVersion = 0;
+    if (db.Read(DB_COINS_FORMAT, nVersion) && nVersion > COINS_FORMAT_VERSION)
+        return error("%s: chainstate format %u is newer than the supported %u", __func__, nVersion, COINS_FORMAT_VERSION);
+    if (nVersion == COINS_FORMAT_VERSION)
+        return true;
+
+    return db.Write(DB_COINS_FORMAT, COINS_FORMAT_VERSION, true);
+}
+
+bool CCoinsViewDB::ReadUTXOSetStats(CUTXOSetStats& stats) const
+{
+    return db.Read(DB_UTXO_SET_STATS, stats);
+}
+
+bool CCoinsViewDB::WriteUTXOSetStats(const CUTXOSetStats& stats)
+{
+    return db.Write(DB_UTXO_SET_STATS, stats);
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, size_t maxFileSize) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, maxFileSize) {
 }
 
@@ -180,6 +336,7 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    SyncBackgroundWrite();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -259,6 +416,25 @@ bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     return Read(std::make_pair(DB_SPENTINDEX, key), value);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const std::set<CSpentIndexKey, CSpentIndexKeyCompare> &keys, std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> &values) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    for (const CSpentIndexKey& key : keys) {
+        boost::this_thread::interruption_point();
+        pcursor->Seek(std::make_pair(DB_SPENTINDEX, key));
+        std::pair<char, CSpentIndexKey> found;
+        if (!pcursor->Valid() || !pcursor->GetKey(found) || found.first != DB_SPENTINDEX || found.second.txid != key.txid || found.second.outputIndex != key.outputIndex)
+            continue;
+
+        CSpentIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get spent index value");
+        values.emplace(key, value);
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
@@ -352,17 +528,18 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, std::string tokenName,
-                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
-
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+/**
+ * Call fn with the address index entries of addressHash, of tokenName or of every token when it is empty,
+ * with a height from start to end (0 for no limit). The keys are ordered by token and then by height, so
+ * the entries of a token that are out of range are skipped with a seek instead of being read.
+ */
+template<typename Callback>
+static bool ScanAddressIndex(CDBWrapper& db, uint160 addressHash, int type, const std::string& tokenName, int start, int end, Callback fn)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
 
-    if (!tokenName.empty() && start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX,
-                                     CAddressIndexIteratorHeightKey(type, addressHash, tokenName, start)));
-    } else if (!tokenName.empty()) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorTokenKey(type, addressHash, tokenName)));
+    if (!tokenName.empty()) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, tokenName, start)));
     } else {
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
@@ -370,26 +547,51 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, std::string t
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash
-                && (tokenName.empty() || key.second.token == tokenName)) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
-            }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address index value");
-            }
-        } else {
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.type != (unsigned int)type || key.second.hashBytes != addressHash
+                || (!tokenName.empty() && key.second.token != tokenName)) {
             break;
         }
+
+        if (key.second.blockHeight < start) {
+            pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, key.second.token, start)));
+            continue;
+        }
+        if (end > 0 && key.second.blockHeight > end) {
+            if (!tokenName.empty())
+                break;
+            // On to the first entry of the next token
+            pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, key.second.token, std::numeric_limits<int>::max())));
+            continue;
+        }
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        fn(key.second, nValue);
+        pcursor->Next();
     }
 
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, std::string tokenName,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    int start, int end) {
+
+    return ScanAddressIndex(*this, addressHash, type, tokenName, start, end, [&addressIndex](const CAddressIndexKey& key, CAmount nValue) {
+        addressIndex.push_back(std::make_pair(key, nValue));
+    });
+}
+
+bool CBlockTreeDB::ReadAddressIndexBalances(uint160 addressHash, int type, std::string tokenName, int nLockHeight, int64_t nLockTime,
+                                            std::map<std::string, CAddressIndexBalance> &balances,
+                                            int start, int end) {
+
+    return ScanAddressIndex(*this, addressHash, type, tokenName, start, end, [&balances, nLockHeight, nLockTime](const CAddressIndexKey& key, CAmount nValue) {
+        balances[key.token].Add(key.timeLock, nValue, nLockHeight, nLockTime);
+    });
+}
+
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
@@ -404,6 +606,14 @@ bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex)
 }
 
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+    return WalkTimestampIndex(high, low, [&](const uint256& hash, unsigned int timestamp) {
+        if (!fActiveOnly || HashOnchainActive(hash))
+            hashes.push_back(std::make_pair(hash, timestamp));
+        return true;
+    });
+}
+
+bool CBlockTreeDB::WalkTimestampIndex(const unsigned int &high, const unsigned int &low, const std::function<bool(const uint256&, unsigned int)> &fn) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -413,13 +623,8 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
         boost::this_thread::interruption_point();
         std::pair<char, CTimestampIndexKey> key;
         if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high) {
-            if (fActiveOnly) {
-                if (HashOnchainActive(key.second.blockHash)) {
-                    hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-                }
-            } else {
-                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-            }
+            if (!fn(key.second.blockHash, key.second.timestamp))
+                break;
 
             pcursor->Next();
         } else {
@@ -458,44 +663,82 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteIndexBuildBest(const std::string &name, const uint256 &hash) {
+    return Write(std::make_pair(DB_INDEX_BUILD, name), hash);
+}
+
+bool CBlockTreeDB::ReadIndexBuildBest(const std::string &name, uint256 &hash) {
+    return Read(std::make_pair(DB_INDEX_BUILD, name), hash);
+}
+
+bool CBlockTreeDB::EraseIndexBuildBest(const std::string &name) {
+    return Erase(std::make_pair(DB_INDEX_BUILD, name));
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
+    const int64_t nStart = GetTimeMillis();
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    // Load mapBlockIndex a chunk at a time: the cursor reads the entries, they are decoded side
+    // by side, then linked into the map in the order they were read
+    const int nThreads = GetNumCores();
+    std::vector<std::vector<unsigned char> > vValues;
+    std::vector<CDiskBlockIndex> vDiskIndexes;
+    std::vector<unsigned char> vKey;
+    size_t nLoaded = 0;
+    bool fDone = false;
+    while (!fDone) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetIndexHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->nNonce         = diskindex.nNonce;
-
-                pcursor->Next();
-            } else {
+        vValues.clear();
+        while (vValues.size() < BLOCK_INDEX_LOAD_CHUNK) {
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                fDone = true;
+                break;
+            }
+            vValues.emplace_back();
+            if (!pcursor->GetRawEntry(vKey, vValues.back()))
                 return error("%s: failed to read value", __func__);
+            pcursor->Next();
+        }
+
+        vDiskIndexes.assign(vValues.size(), CDiskBlockIndex());
+        std::atomic<bool> fFailed(false);
+        RunInParallel(vValues.size(), nThreads, [&vValues, &vDiskIndexes, &fFailed](size_t k) {
+            try {
+                CMemoryReader reader(SER_DISK, CLIENT_VERSION, vValues[k].data(), vValues[k].data() + vValues[k].size());
+                reader >> vDiskIndexes[k];
+            } catch (const std::exception&) {
+                fFailed = true;
             }
-        } else {
-            break;
+        });
+        if (fFailed)
+            return error("%s: failed to read value", __func__);
+
+        for (const CDiskBlockIndex& diskindex : vDiskIndexes) {
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetIndexHash());
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->nNonce         = diskindex.nNonce;
         }
+        nLoaded += vDiskIndexes.size();
     }
 
+    LogPrintf("%s: read %u block index entries in %dms\n", __func__, nLoaded, GetTimeMillis() - nStart);
     return true;
 }
 
@@ -570,6 +813,11 @@ public:
 bool CCoinsViewDB::Upgrade() {
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+    std::pair<unsigned char, uint256> first_key;
+    if (pcursor->Valid() && pcursor->GetKey(first_key) && first_key.first == DB_COINS && first_key.second.IsNull()) {
+        // The format version, not a coins record
+        pcursor->Next();
+    }
     if (!pcursor->Valid()) {
         return true;
     }
@@ -15,14 +15,21 @@
 #include "spentindex.h"
 #include "timestampindex.h"
 
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
 class uint256;
+struct CUTXOSetStats;
 
 //! No need to periodic flush if at least this much space still available.
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
@@ -30,6 +37,10 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbbackgroundflush default
+static const bool DEFAULT_DB_BACKGROUND_FLUSH = true;
+//! Block index entries read before the chunk is decoded side by side
+static const size_t BLOCK_INDEX_LOAD_CHUNK = 16384;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -42,6 +53,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the block filter index cache, if -blockfilterindex (MiB)
+static const int64_t nMaxBlockFilterIndexCache = 1024;
+//! Max memory allocated to the token transaction index cache, if -tokentxindex (MiB)
+static const int64_t nMaxTokenTxIndexCache = 1024;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -73,8 +88,22 @@ class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! The background write: at most one batch is in flight, its entries answer reads until it is on disk
+    mutable std::mutex csBackground;
+    mutable std::condition_variable condBackground;
+    std::unique_ptr<CCoinsMapBatch> pbatchWriting;
+    bool fBatchQueued;
+    bool fBackgroundStop;
+    bool fBackgroundFailed;
+    std::thread threadBackground;
+
+    void BeginTransition(CDBBatch &batch, const uint256 &hashBlock) const;
+    bool WriteCoins(CDBBatch &batch, CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase);
+    void ThreadBackgroundWrite();
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -83,9 +112,28 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Write a batch taken from the cache on top (CCoinsViewCache::DetachCache) from a background thread, so
+     * the caller doesn't wait for the coins to hit the disk. Waits for the batch before it, then marks the
+     * database as moving to the new tip, synced, before handing the batch over: a crash while it is written
+     * leaves the head blocks behind for ReplayBlocks, as an interrupted BatchWrite does.
+     */
+    bool BatchWriteBackground(std::unique_ptr<CCoinsMapBatch> pbatch);
+    //! Wait for the batch in flight to be written. Returns false if a background write failed.
+    bool SyncBackgroundWrite() const;
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+    //! Record the format this binary writes the coins and undo data in, fails on a database from a newer format
+    bool WriteFormatVersion();
     size_t EstimateSize() const override;
+
+    //! The UTXO set statistics written at the last flush, they hold for the chainstate if their hashBlock is its best
+    bool ReadUTXOSetStats(CUTXOSetStats& stats) const;
+    bool WriteUTXOSetStats(const CUTXOSetStats& stats);
+
+    //! Bytes the chainstate takes on disk
+    uint64_t GetDiskUsage() const { return db.GetDiskUsage(); }
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -127,6 +175,8 @@ public:
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+    //! Read the entries of many keys from one snapshot, seeking in key order; keys that aren't indexed are left out
+    bool ReadSpentIndex(const std::set<CSpentIndexKey, CSpentIndexKeyCompare> &keys, std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> &values);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type, std::string tokenName,
@@ -141,12 +191,21 @@ public:
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    bool ReadAddressIndexBalances(uint160 addressHash, int type, std::string tokenName, int nLockHeight, int64_t nLockTime,
+                                  std::map<std::string, CAddressIndexBalance> &balances,
+                                  int start = 0, int end = 0);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
+    //! Call fn for every <block hash, timestamp> with low <= timestamp < high, in timestamp order; fn returns false to stop
+    bool WalkTimestampIndex(const unsigned int &high, const unsigned int &low, const std::function<bool(const uint256&, unsigned int)> &fn);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! The last block an index being built in the background has been written up to
+    bool WriteIndexBuildBest(const std::string &name, const uint256 &hash);
+    bool ReadIndexBuildBest(const std::string &name, uint256 &hash);
+    bool EraseIndexBuildBest(const std::string &name);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -6,6 +6,7 @@
 
 #include "txmempool.h"
 
+#include "base58.h"
 #include "consensus/consensus.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
@@ -13,21 +14,29 @@
 #include "policy/policy.h"
 #include "policy/fees.h"
 #include "reverse_iterator.h"
+#include "script/interpreter.h"
 #include "streams.h"
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utiltime.h"
+#include "validationinterface.h"
 #include "hash.h"
+#include "metrics.h"
+
+static CMetricGauge metricMempoolTransactions("paladeum_mempool_transactions", "Transactions in the mempool");
+static CMetricGauge metricMempoolBytes("paladeum_mempool_bytes", "Virtual size of the transactions in the mempool");
+static CMetricGauge metricMempoolUsage("paladeum_mempool_usage_bytes", "Memory used by the mempool");
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp):
     tx(_tx), nFee(_nFee), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp)
+    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), nTokenUsage(0)
 {
     nTxWeight = GetTransactionWeight(*tx);
     nUsageSize = RecursiveDynamicUsage(tx);
+    nRelayClass = GetTxRelayClass(*tx);
 
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -41,6 +50,13 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSigOpCostWithAncestors = sigOpCost;
 }
 
+void CTxMemPoolEntry::SetTxData(const std::shared_ptr<const PrecomputedTransactionData>& _txdata)
+{
+    nUsageSize -= memusage::DynamicUsage(txdata);
+    txdata = _txdata;
+    nUsageSize += memusage::DynamicUsage(txdata);
+}
+
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 {
     nModFeesWithDescendants += newFeeDelta - feeDelta;
@@ -179,6 +195,43 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         parentHashes = GetMemPoolParents(it);
     }
 
+    // A new transaction with one parent in the mempool, as the payouts of one wallet chain, is first checked against
+    // the ancestor limits from the parent's package statistics. If every ancestor also has a single parent, the root
+    // of the chain has all the others as descendants and is the only one that can hit the descendant limits.
+    if (fSearchForParents && parentHashes.size() == 1) {
+        txiter parentit = *parentHashes.begin();
+        if (parentit->GetCountWithAncestors() + 1 > limitAncestorCount) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+            return false;
+        }
+        if (parentit->GetSizeWithAncestors() + entry.GetTxSize() > limitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+            return false;
+        }
+
+        std::vector<txiter> vChain;
+        vChain.reserve(parentit->GetCountWithAncestors());
+        txiter chainit = parentit;
+        while (true) {
+            vChain.push_back(chainit);
+            const setEntries& setChainParents = GetMemPoolParents(chainit);
+            if (setChainParents.size() != 1)
+                break;
+            chainit = *setChainParents.begin();
+        }
+        if (GetMemPoolParents(chainit).empty()) {
+            if (chainit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+                errString = strprintf("exceeds descendant size limit for tx %s got: %u [limit: %u]", chainit->GetTx().GetHash().ToString(), chainit->GetSizeWithDescendants() + entry.GetTxSize(), limitDescendantSize);
+                return false;
+            } else if (chainit->GetCountWithDescendants() + 1 > limitDescendantCount) {
+                errString = strprintf("too many descendants for tx %s [limit: %u]", chainit->GetTx().GetHash().ToString(), limitDescendantCount);
+                return false;
+            }
+            setAncestors.insert(vChain.begin(), vChain.end());
+            return true;
+        }
+    }
+
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
@@ -331,7 +384,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), nSequenceNumber(1), minerPolicyEstimator(estimator)
 {
     _clear(); //lock free clear
 
@@ -359,6 +412,18 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+uint64_t CTxMemPool::GetSequence() const
+{
+    LOCK(cs);
+    return nSequenceNumber;
+}
+
+uint64_t CTxMemPool::GetAndIncrementSequence()
+{
+    LOCK(cs);
+    return nSequenceNumber++;
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
     NotifyEntryAdded(entry.GetSharedTx());
@@ -415,6 +480,10 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
 
+    tokenOutputIndex.Add(tx);
+    UpdateTokenUsage(hash);
+
+    UpdateMetrics();
     return true;
 }
 
@@ -655,9 +724,14 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     NotifyEntryRemoved(it->GetSharedTx(), reason);
+    // The transactions of a block go out with its BlockConnected
+    const uint64_t nSequence = GetAndIncrementSequence();
+    if (reason != MemPoolRemovalReason::BLOCK)
+        GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason, nSequence);
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
+    tokenOutputIndex.Remove(it->GetTx());
 
     if (vTxHashes.size() > 1) {
         vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
@@ -674,6 +748,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    UpdateMetrics();
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
     removeAddressIndex(hash);
     removeSpentIndex(hash);
@@ -688,77 +763,16 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     }
 
     // Erase from the token mempool maps if they match txid
-    if (mapHashToToken.count(hash)) {
-        mapTokenToHash.erase(mapHashToToken.at(hash));
-        mapHashToToken.erase(hash);
+    auto itToken = mapHashToToken.find(hash);
+    if (itToken != mapHashToToken.end()) {
+        if (mapTokenToHash.erase(itToken->second))
+            cachedTokenNameUsage -= memusage::DynamicUsage(itToken->second);
+        cachedTokenNameUsage -= memusage::DynamicUsage(itToken->second);
+        mapHashToToken.erase(itToken);
     }
 
-    // Erase from the restricted token mempool maps if they match txids
-    if (mapHashToAddressMarkedFrozen.count(hash)) {
-        for (auto item : mapHashToAddressMarkedFrozen.at(hash))
-            mapAddressesMarkedFrozen.at(item).erase(hash);
-        mapHashToAddressMarkedFrozen.erase(hash);
-    }
-
-    if (mapHashMarkedGlobalFrozen.count(hash)) {
-        for (auto item : mapHashMarkedGlobalFrozen.at(hash))
-            mapTokenMarkedGlobalFrozen.at(item).erase(hash);
-        mapHashMarkedGlobalFrozen.erase(hash);
-    }
-
-    if (mapHashQualifiersChanged.count(hash)) {
-        for (auto item : mapHashQualifiersChanged.at(hash))
-            mapAddressesQualifiersChanged.at(item).erase(hash);
-        mapHashQualifiersChanged.erase(hash);
-    }
-
-    if (mapHashVerifierChanged.count(hash)) {
-        for (auto item : mapHashVerifierChanged.at(hash))
-            mapTokenVerifierChanged.at(item).erase(hash);
-        mapHashVerifierChanged.erase(hash);
-    }
-
-    if (mapHashGlobalFreezingTokenTransactions.count(hash)) {
-        for (auto item : mapHashGlobalFreezingTokenTransactions.at(hash)) {
-            if (mapGlobalFreezingTokenTransactions.count(item)) {
-                mapGlobalFreezingTokenTransactions.at(item).erase(hash);
-                if (mapGlobalFreezingTokenTransactions.at(item).size() == 0)
-                    mapGlobalFreezingTokenTransactions.erase(item);
-            }
-        }
-        mapHashGlobalFreezingTokenTransactions.erase(hash);
-    }
-
-    if (mapHashGlobalUnFreezingTokenTransactions.count(hash)) {
-        for (auto item : mapHashGlobalUnFreezingTokenTransactions.at(hash)) {
-            if (mapGlobalUnFreezingTokenTransactions.count(item)) {
-                mapGlobalUnFreezingTokenTransactions.at(item).erase(hash);
-                if (mapGlobalUnFreezingTokenTransactions.at(item).size() == 0)
-                    mapGlobalUnFreezingTokenTransactions.erase(item);
-            }
-        }
-        mapHashGlobalUnFreezingTokenTransactions.erase(hash);
-    }
-
-    if (mapHashToAddressAddedTag.count(hash)) {
-        for (auto item : mapHashToAddressAddedTag.at(hash)) {
-            if (mapAddressAddedTag.count(item)) {
-                mapAddressAddedTag.at(item).erase(hash);
-                if (mapAddressAddedTag.at(item).size() == 0)
-                    mapAddressAddedTag.erase(item);
-            }
-        }
-    }
-
-    if (mapHashToAddressRemoveTag.count(hash)) {
-        for (auto item : mapHashToAddressRemoveTag.at(hash)) {
-            if (mapAddressRemoveTag.count(item)) {
-                mapAddressRemoveTag.at(item).erase(hash);
-                if (mapAddressRemoveTag.at(item).size() == 0)
-                    mapAddressRemoveTag.erase(item);
-            }
-        }
-    }
+    // Erase from the restricted token mempool index if they match txids
+    restrictedStateIndex.Remove(hash);
     /** TOKENS END */
 }
 
@@ -920,32 +934,28 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
 
     for (auto it : connectedBlockData.newVerifiersToAdd) {
-        if (mapTokenVerifierChanged.count(it.tokenName)) {
-            for (auto hash : mapTokenVerifierChanged.at(it.tokenName)) {
-                indexed_transaction_set::iterator i = mapTx.find(hash);
-                if (i != mapTx.end()) {
-                    CValidationState state;
-                    if (!setAlreadyRemoving.count(hash) && !CheckTransaction(i->GetTx(), state, ptokens)) {
-                        entries.push_back(&*i);
-                        trans.emplace_back(i->GetTx());
-                        setAlreadyRemoving.insert(hash);
-                    }
+        for (auto hash : restrictedStateIndex.Get(CRestrictedStateIndex::VERIFIER_CHANGED, it.tokenName)) {
+            indexed_transaction_set::iterator i = mapTx.find(hash);
+            if (i != mapTx.end()) {
+                CValidationState state;
+                if (!setAlreadyRemoving.count(hash) && !CheckTransaction(i->GetTx(), state, ptokens)) {
+                    entries.push_back(&*i);
+                    trans.emplace_back(i->GetTx());
+                    setAlreadyRemoving.insert(hash);
                 }
             }
         }
     }
 
     for (auto it : connectedBlockData.newQualifiersToAdd) {
-        if (mapAddressesQualifiersChanged.count(it.address)) {
-            for (auto hash : mapAddressesQualifiersChanged.at(it.address)) {
-                indexed_transaction_set::iterator i = mapTx.find(hash);
-                if (i != mapTx.end()) {
-                    CValidationState state;
-                    if (!setAlreadyRemoving.count(hash) && !CheckTransaction(i->GetTx(), state, ptokens)) {
-                        entries.push_back(&*i);
-                        trans.emplace_back(i->GetTx());
-                        setAlreadyRemoving.insert(hash);
-                    }
+        for (auto hash : restrictedStateIndex.Get(CRestrictedStateIndex::QUALIFIERS_CHANGED, it.address)) {
+            indexed_transaction_set::iterator i = mapTx.find(hash);
+            if (i != mapTx.end()) {
+                CValidationState state;
+                if (!setAlreadyRemoving.count(hash) && !CheckTransaction(i->GetTx(), state, ptokens)) {
+                    entries.push_back(&*i);
+                    trans.emplace_back(i->GetTx());
+                    setAlreadyRemoving.insert(hash);
                 }
             }
         }
@@ -953,44 +963,38 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
     for (auto it : connectedBlockData.newGlobalRestrictionsToAdd) {
         if (it.type == RestrictedType::GLOBAL_FREEZE) {
-            if (mapTokenMarkedGlobalFrozen.count(it.tokenName)) {
-                for (auto hash : mapTokenMarkedGlobalFrozen.at(it.tokenName)) {
-                    indexed_transaction_set::iterator i = mapTx.find(hash);
-                    if (i != mapTx.end()) {
-                        CValidationState state;
-                        if (!setAlreadyRemoving.count(hash) && !CheckTransaction(i->GetTx(), state, ptokens)) {
-                            entries.push_back(&*i);
-                            trans.emplace_back(i->GetTx());
-                            setAlreadyRemoving.insert(hash);
-                        }
+            for (auto hash : restrictedStateIndex.Get(CRestrictedStateIndex::MARKED_GLOBAL_FROZEN, it.tokenName)) {
+                indexed_transaction_set::iterator i = mapTx.find(hash);
+                if (i != mapTx.end()) {
+                    CValidationState state;
+                    if (!setAlreadyRemoving.count(hash) && !CheckTransaction(i->GetTx(), state, ptokens)) {
+                        entries.push_back(&*i);
+                        trans.emplace_back(i->GetTx());
+                        setAlreadyRemoving.insert(hash);
                     }
                 }
             }
 
-            if (mapGlobalFreezingTokenTransactions.count(it.tokenName)) {
-                for (auto hash : mapGlobalFreezingTokenTransactions.at(it.tokenName)) {
-                    indexed_transaction_set::iterator i = mapTx.find(hash);
-                    if (i != mapTx.end()) {
-                        CValidationState state;
-                        if (!setAlreadyRemoving.count(hash)) {
-                            entries.push_back(&*i);
-                            trans.emplace_back(i->GetTx());
-                            setAlreadyRemoving.insert(hash);
-                        }
+            for (auto hash : restrictedStateIndex.Get(CRestrictedStateIndex::GLOBAL_FREEZING, it.tokenName)) {
+                indexed_transaction_set::iterator i = mapTx.find(hash);
+                if (i != mapTx.end()) {
+                    CValidationState state;
+                    if (!setAlreadyRemoving.count(hash)) {
+                        entries.push_back(&*i);
+                        trans.emplace_back(i->GetTx());
+                        setAlreadyRemoving.insert(hash);
                     }
                 }
             }
         } else if (it.type == RestrictedType::GLOBAL_UNFREEZE) {
-            if (mapGlobalUnFreezingTokenTransactions.count(it.tokenName)) {
-                for (auto hash : mapGlobalUnFreezingTokenTransactions.at(it.tokenName)) {
-                    indexed_transaction_set::iterator i = mapTx.find(hash);
-                    if (i != mapTx.end()) {
-                        CValidationState state;
-                        if (!setAlreadyRemoving.count(hash)) {
-                            entries.push_back(&*i);
-                            trans.emplace_back(i->GetTx());
-                            setAlreadyRemoving.insert(hash);
-                        }
+            for (auto hash : restrictedStateIndex.Get(CRestrictedStateIndex::GLOBAL_UNFREEZING, it.tokenName)) {
+                indexed_transaction_set::iterator i = mapTx.find(hash);
+                if (i != mapTx.end()) {
+                    CValidationState state;
+                    if (!setAlreadyRemoving.count(hash)) {
+                        entries.push_back(&*i);
+                        trans.emplace_back(i->GetTx());
+                        setAlreadyRemoving.insert(hash);
                     }
                 }
             }
@@ -999,18 +1003,15 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
     for (auto it : connectedBlockData.newAddressRestrictionsToAdd) {
         if (it.type == RestrictedType::FREEZE_ADDRESS) {
-            auto pair = std::make_pair(it.address, it.tokenName);
-            if (mapAddressesMarkedFrozen.count(pair)) {
-                for (auto hash : mapAddressesMarkedFrozen.at(pair)) {
-                    indexed_transaction_set::iterator i = mapTx.find(hash);
-                    if (i != mapTx.end()) {
-                        CValidationState state;
-                        std::vector<std::pair<std::string, uint256>> vReissueTokens;
-                        if (!setAlreadyRemoving.count(hash) && !Consensus::CheckTxTokens(i->GetTx(), state, pcoinsTip, 0, 0, ptokens, false, vReissueTokens)) {
-                            entries.push_back(&*i);
-                            trans.emplace_back(i->GetTx());
-                            setAlreadyRemoving.insert(hash);
-                        }
+            for (auto hash : restrictedStateIndex.Get(CRestrictedStateIndex::MARKED_FROZEN, it.tokenName, it.address)) {
+                indexed_transaction_set::iterator i = mapTx.find(hash);
+                if (i != mapTx.end()) {
+                    CValidationState state;
+                    std::vector<std::pair<std::string, uint256>> vReissueTokens;
+                    if (!setAlreadyRemoving.count(hash) && !Consensus::CheckTxTokens(i->GetTx(), state, pcoinsTip, 0, 0, ptokens, false, vReissueTokens)) {
+                        entries.push_back(&*i);
+                        trans.emplace_back(i->GetTx());
+                        setAlreadyRemoving.insert(hash);
                     }
                 }
             }
@@ -1064,32 +1065,17 @@ void CTxMemPool::_clear()
     ++nTransactionsUpdated;
     mapTokenToHash.clear();
     mapHashToToken.clear();
+    cachedTokenNameUsage = 0;
 
-    mapAddressesMarkedFrozen.clear();
-    mapHashToAddressMarkedFrozen.clear();
-    mapTokenMarkedGlobalFrozen.clear();
-    mapHashMarkedGlobalFrozen.clear();
-    mapAddressesQualifiersChanged.clear();
-    mapHashQualifiersChanged.clear();
-    mapTokenVerifierChanged.clear();
-    mapHashVerifierChanged.clear();
-
-    mapHashToAddressAddedTag.clear();
-    mapAddressAddedTag.clear();
-    mapHashToAddressRemoveTag.clear();
-    mapAddressRemoveTag.clear();
-
-    mapGlobalFreezingTokenTransactions.clear();
-    mapHashGlobalFreezingTokenTransactions.clear();
-
-    mapGlobalUnFreezingTokenTransactions.clear();
-    mapHashGlobalUnFreezingTokenTransactions.clear();
+    restrictedStateIndex.Clear();
+    tokenOutputIndex.Clear();
 }
 
 void CTxMemPool::clear()
 {
     LOCK(cs);
     _clear();
+    UpdateMetrics();
 }
 
 static void CheckInputsAndUpdateCoins(const CTransaction& tx, CCoinsViewCache& mempoolDuplicate, const int64_t spendheight, const int64_t spendtime) {
@@ -1315,6 +1301,15 @@ CTransactionRef CTxMemPool::get(const uint256& hash) const
     return i->GetSharedTx();
 }
 
+std::shared_ptr<const PrecomputedTransactionData> CTxMemPool::GetTxData(const uint256& hash) const
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end())
+        return nullptr;
+    return i->GetTxData();
+}
+
 TxMempoolInfo CTxMemPool::info(const uint256& hash) const
 {
     LOCK(cs);
@@ -1396,10 +1391,62 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return base->GetCoin(outpoint, coin);
 }
 
+void CTxMemPool::UpdateMetrics() const
+{
+    if (this != &::mempool)
+        return;
+    metricMempoolTransactions.Set(mapTx.size());
+    metricMempoolBytes.Set(totalTxSize);
+    metricMempoolUsage.Set(DynamicMemoryUsage());
+}
+
 size_t CTxMemPool::DynamicMemoryUsage() const {
+    return GetUsageBreakdown().Total();
+}
+
+MemPoolUsage CTxMemPool::GetUsageBreakdown() const {
     LOCK(cs);
+    MemPoolUsage usage;
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    usage.nTransactions = memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + cachedInnerUsage;
+    usage.nLinks = memusage::DynamicUsage(mapLinks);
+    usage.nSpends = memusage::DynamicUsage(mapNextTx);
+    usage.nDeltas = memusage::DynamicUsage(mapDeltas);
+    usage.nTxHashes = memusage::DynamicUsage(vTxHashes);
+    // The token structures keep their inner usage up to date, so none of this walks them
+    usage.nTokenIssues = memusage::DynamicUsage(mapTokenToHash) + memusage::DynamicUsage(mapHashToToken) + cachedTokenNameUsage;
+    usage.nRestrictedState = restrictedStateIndex.DynamicMemoryUsage();
+    usage.nTokenOutputs = tokenOutputIndex.DynamicMemoryUsage();
+    return usage;
+}
+
+void CTxMemPool::AddNewToken(const std::string& name, const uint256& hash)
+{
+    LOCK(cs);
+    auto itHash = mapTokenToHash.find(name);
+    if (itHash == mapTokenToHash.end())
+        cachedTokenNameUsage += memusage::DynamicUsage(name);
+    mapTokenToHash[name] = hash;
+
+    auto itName = mapHashToToken.find(hash);
+    if (itName != mapHashToToken.end())
+        cachedTokenNameUsage -= memusage::DynamicUsage(itName->second);
+    mapHashToToken[hash] = name;
+    cachedTokenNameUsage += memusage::DynamicUsage(name);
+}
+
+void CTxMemPool::UpdateTokenUsage(const uint256& hash)
+{
+    LOCK(cs);
+    txiter it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return;
+
+    size_t nUsage = tokenOutputIndex.TxUsage(it->GetTx()) + restrictedStateIndex.TxUsage(hash);
+    auto itName = mapHashToToken.find(hash);
+    if (itName != mapHashToToken.end())
+        nUsage += memusage::IncrementalDynamicUsage(mapTokenToHash) + memusage::IncrementalDynamicUsage(mapHashToToken) + 2 * memusage::DynamicUsage(itName->second);
+    mapTx.modify(it, update_token_usage(nUsage));
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -1512,6 +1559,29 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
         indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
 
+        // Of the lowest scoring transactions, the one paying least for the memory it holds goes, its token helper
+        // memory counted like its size. Without token transactions among them that is the lowest scoring one.
+        {
+            CompareTxMemPoolEntryByDescendantScore compare;
+            auto weighedScore = [&compare](const CTxMemPoolEntry& e, double& fee, double& size) {
+                bool fUseDescendants = compare.UseDescendantScore(e);
+                fee = fUseDescendants ? e.GetModFeesWithDescendants() : e.GetModifiedFee();
+                size = (fUseDescendants ? e.GetSizeWithDescendants() : e.GetTxSize()) + e.GetTokenUsage();
+            };
+            double bestFee, bestSize;
+            weighedScore(*it, bestFee, bestSize);
+            auto candidate = it;
+            for (int i = 1; i < MEMPOOL_TRIM_CANDIDATES && ++candidate != mapTx.get<descendant_score>().end(); i++) {
+                double fee, size;
+                weighedScore(*candidate, fee, size);
+                if (fee * bestSize < bestFee * size) {
+                    it = candidate;
+                    bestFee = fee;
+                    bestSize = size;
+                }
+            }
+        }
+
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
@@ -1555,3 +1625,269 @@ bool CTxMemPool::TransactionWithinChainLimit(const uint256& txid, size_t chainLi
 }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+bool CRestrictedStateIndex::FindKey(Kind kind, const std::string& name, const std::string& address, Key& key) const
+{
+    auto itName = mapNames.find(name);
+    if (itName == mapNames.end())
+        return false;
+
+    key.nName = itName->second.nId;
+    key.nAddress = NONE;
+    key.kind = kind;
+
+    if (!address.empty()) {
+        auto itAddress = mapNames.find(address);
+        if (itAddress == mapNames.end())
+            return false;
+        key.nAddress = itAddress->second.nId;
+    }
+
+    return true;
+}
+
+uint32_t CRestrictedStateIndex::AcquireName(const std::string& name)
+{
+    auto it = mapNames.find(name);
+    if (it != mapNames.end()) {
+        it->second.nRefs++;
+        return it->second.nId;
+    }
+
+    uint32_t nId;
+    if (!vFreeIds.empty()) {
+        nId = vFreeIds.back();
+        vFreeIds.pop_back();
+    } else {
+        nId = vNames.size();
+        vNames.emplace_back(nullptr);
+    }
+
+    it = mapNames.emplace(name, Name{nId, 1}).first;
+    vNames[nId] = &it->first;
+    nInnerUsage += memusage::DynamicUsage(it->first);
+    return nId;
+}
+
+void CRestrictedStateIndex::ReleaseName(uint32_t nId)
+{
+    if (nId == NONE)
+        return;
+
+    auto it = mapNames.find(*vNames[nId]);
+    assert(it != mapNames.end());
+    if (--it->second.nRefs > 0)
+        return;
+
+    vNames[nId] = nullptr;
+    vFreeIds.push_back(nId);
+    nInnerUsage -= memusage::DynamicUsage(it->first);
+    mapNames.erase(it);
+}
+
+void CRestrictedStateIndex::Add(Kind kind, const uint256& hash, const std::string& name, const std::string& address)
+{
+    Key key;
+    if (FindKey(kind, name, address, key)) {
+        auto it = mapEntries.find(key);
+        if (it != mapEntries.end() && std::find(it->second.begin(), it->second.end(), hash) != it->second.end())
+            return;
+    }
+
+    // Every key a transaction is recorded under holds a reference to its names
+    key.nName = AcquireName(name);
+    key.nAddress = address.empty() ? NONE : AcquireName(address);
+    key.kind = kind;
+
+    TxList& vHashes = mapEntries[key];
+    nInnerUsage -= memusage::DynamicUsage(vHashes);
+    vHashes.push_back(hash);
+    nInnerUsage += memusage::DynamicUsage(vHashes);
+
+    KeyList& vKeys = mapKeysByTx[hash];
+    nInnerUsage -= memusage::DynamicUsage(vKeys);
+    vKeys.push_back(key);
+    nInnerUsage += memusage::DynamicUsage(vKeys);
+}
+
+bool CRestrictedStateIndex::Exists(Kind kind, const std::string& name, const std::string& address) const
+{
+    Key key;
+    return FindKey(kind, name, address, key) && mapEntries.count(key);
+}
+
+std::vector<uint256> CRestrictedStateIndex::Get(Kind kind, const std::string& name, const std::string& address) const
+{
+    Key key;
+    if (!FindKey(kind, name, address, key))
+        return std::vector<uint256>();
+
+    auto it = mapEntries.find(key);
+    if (it == mapEntries.end())
+        return std::vector<uint256>();
+
+    return std::vector<uint256>(it->second.begin(), it->second.end());
+}
+
+void CRestrictedStateIndex::Remove(const uint256& hash)
+{
+    auto itKeys = mapKeysByTx.find(hash);
+    if (itKeys == mapKeysByTx.end())
+        return;
+
+    for (const Key& key : itKeys->second) {
+        auto it = mapEntries.find(key);
+        if (it != mapEntries.end()) {
+            TxList& vHashes = it->second;
+            vHashes.erase(std::remove(vHashes.begin(), vHashes.end(), hash), vHashes.end());
+            if (vHashes.empty()) {
+                nInnerUsage -= memusage::DynamicUsage(vHashes);
+                mapEntries.erase(it);
+            }
+        }
+
+        ReleaseName(key.nName);
+        ReleaseName(key.nAddress);
+    }
+
+    nInnerUsage -= memusage::DynamicUsage(itKeys->second);
+    mapKeysByTx.erase(itKeys);
+}
+
+void CRestrictedStateIndex::Clear()
+{
+    mapEntries.clear();
+    mapKeysByTx.clear();
+    mapNames.clear();
+    vNames.clear();
+    vFreeIds.clear();
+    nInnerUsage = 0;
+}
+
+size_t CRestrictedStateIndex::DynamicMemoryUsage() const
+{
+    size_t usage = memusage::DynamicUsage(mapEntries) + memusage::DynamicUsage(mapKeysByTx) + memusage::DynamicUsage(mapNames) +
+                   memusage::DynamicUsage(vNames) + memusage::DynamicUsage(vFreeIds);
+    return usage + nInnerUsage;
+}
+
+size_t CRestrictedStateIndex::TxUsage(const uint256& hash) const
+{
+    auto itKeys = mapKeysByTx.find(hash);
+    if (itKeys == mapKeysByTx.end())
+        return 0;
+
+    size_t usage = memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const uint256, KeyList> >)) + memusage::DynamicUsage(itKeys->second);
+    for (const Key& key : itKeys->second) {
+        auto it = mapEntries.find(key);
+        if (it == mapEntries.end())
+            continue;
+        if (it->second.size() == 1)
+            usage += memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const Key, TxList> >)) + memusage::DynamicUsage(it->second);
+        else
+            usage += sizeof(uint256);
+    }
+    return usage;
+}
+
+bool CTokenOutputIndex::ParseOutput(const CTxOut& out, std::string& token, std::string& address, CAmount& amount)
+{
+    if (!out.scriptPubKey.IsTokenScript())
+        return false;
+
+    uint160 hashBytes;
+    int nScriptType;
+    uint32_t nTimeLock = 0;
+    if (!ParseTokenScript(out.scriptPubKey, hashBytes, nScriptType, token, amount, nTimeLock))
+        return false;
+
+    if (nScriptType == TX_PUBKEYHASH)
+        address = EncodeDestination(CKeyID(hashBytes));
+    else if (nScriptType == TX_SCRIPTHASH)
+        address = EncodeDestination(CScriptID(hashBytes));
+    else
+        return false;
+
+    return true;
+}
+
+void CTokenOutputIndex::Add(const CTransaction& tx)
+{
+    const uint256 hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        std::string token, address;
+        CAmount amount;
+        if (!ParseOutput(tx.vout[i], token, address, amount))
+            continue;
+
+        COutPoint outpoint(hash, i);
+        if (mapByToken.emplace(Key(token, address, outpoint), amount).second)
+            nStringUsage += 2 * (memusage::DynamicUsage(token) + memusage::DynamicUsage(address));
+        setByAddress.emplace(address, token, outpoint);
+    }
+}
+
+void CTokenOutputIndex::Remove(const CTransaction& tx)
+{
+    const uint256 hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        std::string token, address;
+        CAmount amount;
+        if (!ParseOutput(tx.vout[i], token, address, amount))
+            continue;
+
+        COutPoint outpoint(hash, i);
+        if (mapByToken.erase(Key(token, address, outpoint)))
+            nStringUsage -= 2 * (memusage::DynamicUsage(token) + memusage::DynamicUsage(address));
+        setByAddress.erase(Key(address, token, outpoint));
+    }
+}
+
+std::vector<CTokenOutputIndex::Output> CTokenOutputIndex::GetByToken(const std::string& token, const std::string& address) const
+{
+    std::vector<Output> vOutputs;
+    for (auto it = mapByToken.lower_bound(Key(token, address, COutPoint(uint256(), 0))); it != mapByToken.end(); ++it) {
+        if (std::get<0>(it->first) != token || (!address.empty() && std::get<1>(it->first) != address))
+            break;
+        vOutputs.push_back(Output{token, std::get<1>(it->first), std::get<2>(it->first), it->second});
+    }
+    return vOutputs;
+}
+
+std::vector<CTokenOutputIndex::Output> CTokenOutputIndex::GetByAddress(const std::string& address) const
+{
+    std::vector<Output> vOutputs;
+    for (auto it = setByAddress.lower_bound(Key(address, "", COutPoint(uint256(), 0))); it != setByAddress.end() && std::get<0>(*it) == address; ++it) {
+        const std::string& token = std::get<1>(*it);
+        auto itAmount = mapByToken.find(Key(token, address, std::get<2>(*it)));
+        assert(itAmount != mapByToken.end());
+        vOutputs.push_back(Output{token, address, std::get<2>(*it), itAmount->second});
+    }
+    return vOutputs;
+}
+
+void CTokenOutputIndex::Clear()
+{
+    mapByToken.clear();
+    setByAddress.clear();
+    nStringUsage = 0;
+}
+
+size_t CTokenOutputIndex::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(mapByToken) + memusage::DynamicUsage(setByAddress) + nStringUsage;
+}
+
+size_t CTokenOutputIndex::TxUsage(const CTransaction& tx) const
+{
+    const uint256 hash = tx.GetHash();
+    size_t usage = 0;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        std::string token, address;
+        CAmount amount;
+        if (ParseOutput(tx.vout[i], token, address, amount) && mapByToken.count(Key(token, address, COutPoint(hash, i))))
+            usage += memusage::IncrementalDynamicUsage(mapByToken) + memusage::IncrementalDynamicUsage(setByAddress) +
+                     2 * (memusage::DynamicUsage(token) + memusage::DynamicUsage(address));
+    }
+    return usage;
+}
@@ -10,9 +10,11 @@
 #include <memory>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
+#include <tuple>
 
 #include "addressindex.h"
 #include "spentindex.h"
@@ -20,6 +22,7 @@
 #include "coins.h"
 #include "indirectmap.h"
 #include "policy/feerate.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 #include "random.h"
@@ -32,6 +35,7 @@
 
 class CBlockIndex;
 struct ConnectedBlockTokenData;
+struct PrecomputedTransactionData;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
@@ -78,6 +82,9 @@ private:
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
+    uint8_t nRelayClass;       //!< TxRelayClass of the transaction, for the queues of the inv trickle
+    std::shared_ptr<const PrecomputedTransactionData> txdata; //!< Sighash midstates of a witness transaction, reused when a block connects it
+    size_t nTokenUsage;        //!< Memory of the token helper structures of the pool attributed to this transaction
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -109,6 +116,10 @@ public:
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
+    uint8_t GetRelayClass() const { return nRelayClass; }
+    const std::shared_ptr<const PrecomputedTransactionData>& GetTxData() const { return txdata; }
+    size_t GetTokenUsage() const { return nTokenUsage; }
+    void UpdateTokenUsage(size_t nTokenUsageIn) { nTokenUsage = nTokenUsageIn; }
 
     // Adjusts the descendant state.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
@@ -119,6 +130,8 @@ public:
     void UpdateFeeDelta(int64_t feeDelta);
     // Update the LockPoints after a reorg
     void UpdateLockPoints(const LockPoints& lp);
+    // Keeps the sighash midstates computed while checking the inputs, before the entry is added
+    void SetTxData(const std::shared_ptr<const PrecomputedTransactionData>& _txdata);
 
     uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
     uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
@@ -186,6 +199,16 @@ private:
     const LockPoints& lp;
 };
 
+struct update_token_usage
+{
+    explicit update_token_usage(size_t _nTokenUsage) : nTokenUsage(_nTokenUsage) { }
+
+    void operator() (CTxMemPoolEntry &e) { e.UpdateTokenUsage(nTokenUsage); }
+
+private:
+    size_t nTokenUsage;
+};
+
 // extracts a transaction hash from CTxMempoolEntry or CTransactionRef
 struct mempoolentry_txid
 {
@@ -341,6 +364,171 @@ public:
     }
 };
 
+/**
+ * Index of the restricted token state that mempool transactions change or depend on, so the conflict checks on
+ * accept and the transactions a connected block invalidates are found with hash lookups.
+ *
+ * Keys are a kind plus one or two names (a token, an address, or an address and a token). The names are
+ * interned with reference counts while any transaction uses them, so lookups never allocate and the ids are
+ * recycled once the last transaction using a name leaves the mempool.
+ */
+class CRestrictedStateIndex
+{
+public:
+    enum Kind : uint8_t {
+        QUALIFIERS_CHANGED,    //!< address receiving a restricted token, invalidated when its qualifiers change
+        VERIFIER_CHANGED,      //!< restricted token transferred, invalidated when its verifier changes
+        MARKED_GLOBAL_FROZEN,  //!< restricted token spent, invalidated when it is globally frozen
+        MARKED_FROZEN,         //!< (address, restricted token) spent from, invalidated when the address is frozen
+        GLOBAL_FREEZING,       //!< restricted token being globally frozen
+        GLOBAL_UNFREEZING,     //!< restricted token being globally unfrozen
+        ADDED_TAG,             //!< (address, qualifier) being tagged
+        REMOVED_TAG,           //!< (address, qualifier) being untagged
+    };
+
+    CRestrictedStateIndex() : nInnerUsage(0) {}
+
+    //! Record that the transaction touches the given state, adding it twice has no effect
+    void Add(Kind kind, const uint256& hash, const std::string& name, const std::string& address = "");
+
+    //! Whether any transaction touches the given state
+    bool Exists(Kind kind, const std::string& name, const std::string& address = "") const;
+
+    //! Transactions touching the given state
+    std::vector<uint256> Get(Kind kind, const std::string& name, const std::string& address = "") const;
+
+    //! Forget everything the transaction touches
+    void Remove(const uint256& hash);
+
+    void Clear();
+
+    size_t Size() const { return mapEntries.size(); }
+    size_t DynamicMemoryUsage() const;
+
+    //! Memory the state recorded for the transaction takes, counting the entries only it holds in full and
+    //! its place in the others. The names are shared and not counted.
+    size_t TxUsage(const uint256& hash) const;
+
+private:
+    static const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    struct Key {
+        uint32_t nName;
+        uint32_t nAddress;
+        uint8_t kind;
+
+        bool operator==(const Key& other) const { return nName == other.nName && nAddress == other.nAddress && kind == other.kind; }
+    };
+
+    struct KeyHasher {
+        size_t operator()(const Key& key) const {
+            uint64_t nHash = ((uint64_t)key.nName << 32 | key.nAddress) ^ ((uint64_t)key.kind << 59);
+            nHash ^= nHash >> 33;
+            nHash *= 0xff51afd7ed558ccdULL;
+            nHash ^= nHash >> 33;
+            return nHash;
+        }
+    };
+
+    //! Interned name, its id and how many keys use it
+    struct Name {
+        uint32_t nId;
+        uint32_t nRefs;
+    };
+
+    bool FindKey(Kind kind, const std::string& name, const std::string& address, Key& key) const;
+    uint32_t AcquireName(const std::string& name);
+    void ReleaseName(uint32_t nId);
+
+    //! Most state is touched by a single transaction and most transactions touch a few keys, so both lists are
+    //! stored inline in the table nodes and only spill to the heap when they grow past that
+    typedef prevector<1, uint256> TxList;
+    typedef prevector<4, Key> KeyList;
+
+    std::unordered_map<Key, TxList, KeyHasher> mapEntries;
+    std::unordered_map<uint256, KeyList, SaltedTxidHasher> mapKeysByTx;
+
+    std::unordered_map<std::string, Name> mapNames;
+    std::vector<const std::string*> vNames; //!< interned name by id, null once released
+    std::vector<uint32_t> vFreeIds;
+
+    //! Heap usage of the lists that spilled and of the names, kept as they change so usage is known without a walk
+    size_t nInnerUsage;
+};
+
+/**
+ * Index of the token outputs of the transactions in the mempool by token and by address, so the unconfirmed
+ * transfers of a token or to an address are found without decoding every output in mapTx.
+ *
+ * Entries are keyed on (token, address, outpoint) and (address, token, outpoint), so a lookup costs the
+ * number of matching outputs. Removing a transaction decodes its outputs again rather than remembering keys.
+ */
+class CTokenOutputIndex
+{
+public:
+    struct Output {
+        std::string strToken;
+        std::string strAddress;
+        COutPoint outpoint;
+        CAmount nAmount;
+    };
+
+    CTokenOutputIndex() : nStringUsage(0) {}
+
+    //! Record the token outputs of the transaction
+    void Add(const CTransaction& tx);
+
+    //! Forget the token outputs of the transaction
+    void Remove(const CTransaction& tx);
+
+    //! Outputs of the token, only those to the address if one is given
+    std::vector<Output> GetByToken(const std::string& token, const std::string& address = "") const;
+
+    //! Outputs of any token to the address
+    std::vector<Output> GetByAddress(const std::string& address) const;
+
+    void Clear();
+
+    size_t Size() const { return mapByToken.size(); }
+    size_t DynamicMemoryUsage() const;
+
+    //! Memory the token outputs of the transaction take in the index
+    size_t TxUsage(const CTransaction& tx) const;
+
+private:
+    typedef std::tuple<std::string, std::string, COutPoint> Key;
+
+    //! (token, address, outpoint) to the amount sent
+    std::map<Key, CAmount> mapByToken;
+    //! (address, token, outpoint) of every entry in mapByToken
+    std::set<Key> setByAddress;
+    //! Heap usage of the names and addresses in both, kept as they change
+    size_t nStringUsage;
+
+    static bool ParseOutput(const CTxOut& out, std::string& token, std::string& address, CAmount& amount);
+};
+
+/** Memory of the pool by structure, for getmempoolinfo */
+struct MemPoolUsage
+{
+    size_t nTransactions = 0;   //!< mapTx with the transactions and their link sets
+    size_t nLinks = 0;          //!< mapLinks
+    size_t nSpends = 0;         //!< mapNextTx
+    size_t nDeltas = 0;         //!< mapDeltas
+    size_t nTxHashes = 0;       //!< vTxHashes
+    size_t nTokenIssues = 0;    //!< mapTokenToHash and mapHashToToken
+    size_t nRestrictedState = 0;
+    size_t nTokenOutputs = 0;
+
+    size_t Total() const
+    {
+        return nTransactions + nLinks + nSpends + nDeltas + nTxHashes + nTokenIssues + nRestrictedState + nTokenOutputs;
+    }
+};
+
+/** How many of the lowest scoring transactions TrimToSize weighs against each other by their token helper memory */
+static const int MEMPOOL_TRIM_CANDIDATES = 8;
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -418,10 +606,12 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    uint64_t nSequenceNumber; //!< Counts the additions to and removals from the pool, for the zmq sequence topic
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    uint64_t cachedTokenNameUsage; //!< heap usage of the names in mapTokenToHash and mapHashToToken
 
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
@@ -468,40 +658,15 @@ public:
     mutable CCriticalSection cs;
     indexed_transaction_set mapTx;
 
+    //! New tokens issued in the pool, only changed through AddNewToken and removal so their memory is accounted
     std::map<std::string, uint256> mapTokenToHash;
     std::map<uint256, std::string> mapHashToToken;
 
-    /** Restricted tokens maps */
-    // Helper maps for when addresses are marked as frozen
-    std::map<std::pair<std::string, std::string>, std::set<uint256> > mapAddressesMarkedFrozen;
-    std::map<uint256, std::set<std::pair<std::string, std::string>>> mapHashToAddressMarkedFrozen;
-
-    // Helper maps for when restricted tokens are globally frozen
-    std::map<std::string, std::set<uint256>> mapTokenMarkedGlobalFrozen;
-    std::map<uint256, std::set<std::string>> mapHashMarkedGlobalFrozen;
-
-    // Helper maps for when qualifiers are added or removed from addresses
-    std::map<std::string, std::set<uint256>> mapAddressesQualifiersChanged;
-    std::map<uint256, std::set<std::string>> mapHashQualifiersChanged;
-
-    // Helper maps for when verifier string are changed
-    std::map<std::string, std::set<uint256>> mapTokenVerifierChanged;
-    std::map<uint256, std::set<std::string>> mapHashVerifierChanged;
-
-    // Helper map for when an token already in mempool that is globally freezing
-    std::map<std::string, std::set<uint256>> mapGlobalFreezingTokenTransactions;
-    std::map<uint256, std::set<std::string>> mapHashGlobalFreezingTokenTransactions;
+    /** Restricted tokens state touched by the transactions in the mempool */
+    CRestrictedStateIndex restrictedStateIndex;
 
-    // Helper map for when a qualfier is added to an address
-    std::map<std::pair<std::string, std::string>, std::set<uint256> > mapAddressAddedTag;
-    std::map<uint256, std::set<std::pair<std::string, std::string>>> mapHashToAddressAddedTag;
-
-    // Helper map for when a qualfier is added to an address
-    std::map<std::pair<std::string, std::string>, std::set<uint256> > mapAddressRemoveTag;
-    std::map<uint256, std::set<std::pair<std::string, std::string>>> mapHashToAddressRemoveTag;
-
-    std::map<std::string, std::set<uint256>> mapGlobalUnFreezingTokenTransactions;
-    std::map<uint256, std::set<std::string>> mapHashGlobalUnFreezingTokenTransactions;
+    /** Token outputs of the transactions in the mempool */
+    CTokenOutputIndex tokenOutputIndex;
 
     typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
     std::vector<std::pair<uint256, txiter> > vTxHashes; //!< All tx witness hashes/entries in mapTx, in random order
@@ -591,6 +756,10 @@ public:
     bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    //! The sequence number of the next addition or removal
+    uint64_t GetSequence() const;
+    //! Number an addition or removal, in the order they change the pool
+    uint64_t GetAndIncrementSequence();
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -679,10 +848,19 @@ public:
     }
 
     CTransactionRef get(const uint256& hash) const;
+    /** Sighash midstates kept for a transaction in the pool, nullptr if there are none */
+    std::shared_ptr<const PrecomputedTransactionData> GetTxData(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
     size_t DynamicMemoryUsage() const;
+    MemPoolUsage GetUsageBreakdown() const;
+
+    /** Record the token the transaction issues */
+    void AddNewToken(const std::string& name, const uint256& hash);
+
+    /** Attribute the memory the token helper structures hold for the transaction to its entry, once they are all updated */
+    void UpdateTokenUsage(const uint256& hash);
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
@@ -724,6 +902,8 @@ private:
      *  removal.
      */
     void removeUnchecked(txiter entry, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
+    /** Publish the size of the node's mempool to the metrics; other pools are left out */
+    void UpdateMetrics() const;
 };
 
 /** 
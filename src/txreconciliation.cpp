@@ -0,0 +1,127 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+void ComputeReconciliationSalt(uint64_t nSalt1, uint64_t nSalt2, uint64_t& k0, uint64_t& k1)
+{
+    // Both ends hash the salts in the same order
+    static const std::string strTag = "Tx Relay Salting";
+    uint64_t nLow = std::min(nSalt1, nSalt2), nHigh = std::max(nSalt1, nSalt2);
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << strTag << nLow << nHigh;
+    uint256 hash = ss.GetHash();
+    k0 = ReadLE64(hash.begin());
+    k1 = ReadLE64(hash.begin() + 8);
+}
+
+uint32_t GetReconciliationShortId(uint64_t k0, uint64_t k1, const uint256& txid)
+{
+    return (uint32_t)SipHashUint256(k0, k1, txid);
+}
+
+size_t EstimateSketchCells(size_t nLocal, size_t nRemote, uint16_t nQ)
+{
+    // An empty sketch tells the other side it has all the differences
+    if (nLocal == 0)
+        return 0;
+    const double q = (double)nQ / RECON_Q_PRECISION;
+    const size_t nDifference = std::max(nLocal, nRemote) - std::min(nLocal, nRemote) + (size_t)std::ceil(q * std::min(nLocal, nRemote)) + 1;
+    return std::min(MAX_SKETCH_CELLS, 2 * nDifference + SKETCH_EXTRA_CELLS);
+}
+
+/** A 32 bit hash of an id, a different function for every seed */
+static uint32_t MixShortId(uint32_t nShortId, uint32_t nSeed)
+{
+    uint64_t h = ((uint64_t)nSeed << 32 | nShortId) + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return (uint32_t)((h ^ (h >> 31)) >> 32);
+}
+
+//! The seed of the check hash, apart from those of the cell indexes
+static const uint32_t CHECK_SEED = CTxSketch::NUM_HASHES;
+
+CTxSketch::CTxSketch(size_t nCells) : vCells((nCells + NUM_HASHES - 1) / NUM_HASHES * NUM_HASHES)
+{
+}
+
+size_t CTxSketch::CellIndex(uint32_t nShortId, int nHash) const
+{
+    const size_t nPartition = vCells.size() / NUM_HASHES;
+    return nHash * nPartition + (size_t)(((uint64_t)MixShortId(nShortId, nHash) * nPartition) >> 32);
+}
+
+void CTxSketch::Update(uint32_t nShortId, int nDelta)
+{
+    if (vCells.empty())
+        return;
+    const uint32_t nCheck = MixShortId(nShortId, CHECK_SEED);
+    for (int i = 0; i < NUM_HASHES; i++) {
+        Cell& cell = vCells[CellIndex(nShortId, i)];
+        cell.nCount += nDelta;
+        cell.nIdSum ^= nShortId;
+        cell.nHashSum ^= nCheck;
+    }
+}
+
+bool CTxSketch::Subtract(const CTxSketch& other)
+{
+    if (other.vCells.size() != vCells.size())
+        return false;
+    for (size_t i = 0; i < vCells.size(); i++) {
+        vCells[i].nCount -= other.vCells[i].nCount;
+        vCells[i].nIdSum ^= other.vCells[i].nIdSum;
+        vCells[i].nHashSum ^= other.vCells[i].nHashSum;
+    }
+    return true;
+}
+
+bool CTxSketch::Decode(std::vector<uint32_t>& vPositive, std::vector<uint32_t>& vNegative) const
+{
+    vPositive.clear();
+    vNegative.clear();
+    CTxSketch sketch(*this);
+
+    auto isPure = [&sketch](size_t i) {
+        const Cell& cell = sketch.vCells[i];
+        return (cell.nCount == 1 || cell.nCount == -1) && cell.nHashSum == MixShortId(cell.nIdSum, CHECK_SEED);
+    };
+
+    std::vector<size_t> vPure;
+    for (size_t i = 0; i < sketch.vCells.size(); i++) {
+        if (isPure(i))
+            vPure.push_back(i);
+    }
+
+    // Every peel empties a cell for good, so a sketch that doesn't decode stops after as many
+    while (!vPure.empty() && vPositive.size() + vNegative.size() <= sketch.vCells.size()) {
+        size_t i = vPure.back();
+        vPure.pop_back();
+        if (!isPure(i))
+            continue;
+
+        const uint32_t nShortId = sketch.vCells[i].nIdSum;
+        const int nCount = sketch.vCells[i].nCount;
+        (nCount > 0 ? vPositive : vNegative).push_back(nShortId);
+        sketch.Update(nShortId, -nCount);
+        for (int h = 0; h < NUM_HASHES; h++) {
+            size_t j = sketch.CellIndex(nShortId, h);
+            if (isPure(j))
+                vPure.push_back(j);
+        }
+    }
+
+    for (const Cell& cell : sketch.vCells) {
+        if (cell.nCount != 0 || cell.nIdSum != 0 || cell.nHashSum != 0)
+            return false;
+    }
+    return true;
+}
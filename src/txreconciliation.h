@@ -0,0 +1,107 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_TXRECONCILIATION_H
+#define PLB_TXRECONCILIATION_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <ios>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** Version of the reconciliation protocol sent in sendtxrcncl */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Average interval between the reconciliation requests to one outbound peer, in seconds */
+static const int RECON_REQUEST_INTERVAL = 8;
+/** A request that got no sketch in this many seconds is given up */
+static const int RECON_RESPONSE_TIMEOUT = 60;
+/** Transactions queued for one peer beyond this are announced by inv */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Coefficient of the smaller set in the difference estimate, sent with RECON_Q_PRECISION */
+static const double RECON_Q = 0.25;
+static const uint16_t RECON_Q_PRECISION = (2 << 14) - 1;
+/** Cells a sketch has on top of two for every expected difference, which keeps small sketches decoding */
+static const size_t SKETCH_EXTRA_CELLS = 24;
+/** Most cells a sketch can have */
+static const size_t MAX_SKETCH_CELLS = 3 * 1024;
+
+/** The SipHash keys of the short ids of a link, the same at both ends */
+void ComputeReconciliationSalt(uint64_t nSalt1, uint64_t nSalt2, uint64_t& k0, uint64_t& k1);
+
+/** The 32 bit short id of a txid on a link */
+uint32_t GetReconciliationShortId(uint64_t k0, uint64_t k1, const uint256& txid);
+
+/** Cells a sketch needs for the difference between sets of nLocal and nRemote transactions to decode, 0 when nLocal is 0 */
+size_t EstimateSketchCells(size_t nLocal, size_t nRemote, uint16_t nQ);
+
+/**
+ * An invertible Bloom lookup table of short ids, the sketch two peers reconcile their queued
+ * transactions with. Every id goes to one cell in each of three partitions; subtracting the sketch
+ * of the other set leaves the ids of the symmetric difference, which are peeled off the cells that
+ * hold one of them alone. With twice as many cells as the difference, plus SKETCH_EXTRA_CELLS,
+ * about one in a hundred sketches fails to decode, whatever the size of the sets.
+ */
+class CTxSketch
+{
+public:
+    static const int NUM_HASHES = 3;
+
+private:
+    struct Cell
+    {
+        int16_t nCount;
+        uint32_t nIdSum;
+        uint32_t nHashSum;
+
+        Cell() : nCount(0), nIdSum(0), nHashSum(0) {}
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(nCount);
+            READWRITE(nIdSum);
+            READWRITE(nHashSum);
+        }
+    };
+
+    std::vector<Cell> vCells;
+
+    size_t CellIndex(uint32_t nShortId, int nHash) const;
+    void Update(uint32_t nShortId, int nDelta);
+
+public:
+    //! An empty sketch of nCells cells, rounded up to a multiple of NUM_HASHES
+    explicit CTxSketch(size_t nCells = 0);
+
+    size_t GetCells() const { return vCells.size(); }
+
+    void Add(uint32_t nShortId) { Update(nShortId, 1); }
+
+    //! Remove the ids of a sketch of the same size, false if the sizes differ
+    bool Subtract(const CTxSketch& other);
+
+    //! The ids left after Subtract, false if they don't all come out
+    bool Decode(std::vector<uint32_t>& vPositive, std::vector<uint32_t>& vNegative) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << vCells;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> vCells;
+        if (vCells.size() > MAX_SKETCH_CELLS || vCells.size() % NUM_HASHES != 0)
+            throw std::ios_base::failure("invalid sketch size");
+    }
+};
+
+#endif // PLB_TXRECONCILIATION_H
@@ -21,7 +21,15 @@ base_blob<BITS>::base_blob(const std::vector<unsigned char>& vch)
 template <unsigned int BITS>
 std::string base_blob<BITS>::GetHex() const
 {
-    return HexStr(std::reverse_iterator<const uint8_t*>(data + sizeof(data)), std::reverse_iterator<const uint8_t*>(data));
+    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    // Most significant byte first, written straight into a string of the final size
+    std::string str(sizeof(data) * 2, '0');
+    for (unsigned int i = 0; i < sizeof(data); i++) {
+        str[2 * i] = hexmap[data[sizeof(data) - 1 - i] >> 4];
+        str[2 * i + 1] = hexmap[data[sizeof(data) - 1 - i] & 15];
+    }
+    return str;
 }
 
 template <unsigned int BITS>
@@ -7,10 +7,12 @@
 #ifndef PLB_UNDO_H
 #define PLB_UNDO_H
 
-#include "compressor.h" 
+#include "coins.h"
+#include "compressor.h"
 #include "consensus/consensus.h"
 #include "primitives/transaction.h"
 #include "serialize.h"
+#include "tokens/tokentypes.h"
 
 /** Undo information for a CTxIn
  *
@@ -100,12 +102,23 @@ class CBlockUndo
 {
 public:
     std::vector<CTxUndo> vtxundo; // for all but the coinbase
+    //! Token metadata changed by reissues. Follows vtxundo only when there is any, so records without it are
+    //! the same as those written before it moved here from the tokens database, which still holds it for those.
+    std::vector<std::pair<std::string, CBlockTokenUndo> > vtokenundo;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, vtxundo);
+        if (!vtokenundo.empty())
+            ::Serialize(s, vtokenundo);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(vtxundo);
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, vtxundo);
+        vtokenundo.clear();
+        if (!s.empty())
+            ::Unserialize(s, vtokenundo);
     }
 };
 
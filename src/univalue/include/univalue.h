@@ -49,6 +49,12 @@ public:
         setStr(s);
     }
     ~UniValue() {}
+    // Declared because of the destructor, without which values would be copied
+    // instead of moved when a vector of them grows
+    UniValue(const UniValue&) = default;
+    UniValue(UniValue&&) = default;
+    UniValue& operator=(const UniValue&) = default;
+    UniValue& operator=(UniValue&&) = default;
 
     void clear();
 
@@ -156,6 +162,8 @@ private:
     std::vector<UniValue> values;
 
     bool findKey(const std::string& key, size_t& retIdx) const;
+    size_t writeSize(unsigned int prettyIndent, unsigned int indentLevel) const;
+    void writeTo(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
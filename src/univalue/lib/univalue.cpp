@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <iomanip>
 #include <sstream>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "univalue.h"
@@ -56,22 +57,27 @@ bool UniValue::setNumStr(const string& val_)
     return true;
 }
 
+// Integers are always valid numbers, so they skip the stream and the check of setNumStr
 bool UniValue::setInt(uint64_t val_)
 {
-    ostringstream oss;
-
-    oss << val_;
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%llu", (unsigned long long)val_);
 
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val.assign(buf, n);
+    return true;
 }
 
 bool UniValue::setInt(int64_t val_)
 {
-    ostringstream oss;
-
-    oss << val_;
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lld", (long long)val_);
 
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val.assign(buf, n);
+    return true;
 }
 
 bool UniValue::setFloat(double val_)
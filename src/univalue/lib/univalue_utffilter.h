@@ -45,6 +45,14 @@ public:
                 push_back_u(codepoint);
         }
     }
+    // Write a run of 7-bit ASCII chars, the same as pushing them one by one
+    void append_ascii(const char *first, const char *last)
+    {
+        if (state) // Not a continuation, invalid
+            is_valid = false;
+        else
+            str.append(first, last - first);
+    }
     // Write codepoint directly, possibly collating surrogate pairs
     void push_back_u(unsigned int codepoint_)
     {
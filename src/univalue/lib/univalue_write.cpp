@@ -2,54 +2,100 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#include <iomanip>
-#include <sstream>
 #include <stdio.h>
 #include "univalue.h"
 #include "univalue_escapes.h"
 
 using namespace std;
 
-static string json_escape(const string& inS)
+// Appends inS to outS with the characters JSON needs escaped replaced, copying the
+// runs between them in one go
+static void json_escape(const string& inS, string& outS)
 {
-    string outS;
-    outS.reserve(inS.size() * 2);
+    const char *run = inS.data();
+    const char *end = run + inS.size();
 
-    for (unsigned int i = 0; i < inS.size(); i++) {
-        unsigned char ch = inS[i];
-        const char *escStr = escapes[ch];
-
-        if (escStr)
+    for (const char *p = run; p != end; ++p) {
+        const char *escStr = escapes[(unsigned char)*p];
+        if (escStr) {
+            outS.append(run, p - run);
             outS += escStr;
-        else
-            outS += ch;
+            run = p + 1;
+        }
     }
+    outS.append(run, end - run);
+}
 
-    return outS;
+// An upper bound on the bytes a string takes escaped, without the quotes, close to
+// exact when little needs escaping
+static size_t json_escaped_size(const string& inS)
+{
+    size_t n = inS.size();
+    for (unsigned char ch : inS) {
+        if (escapes[ch])
+            n += 5;
+    }
+    return n;
+}
+
+size_t UniValue::writeSize(unsigned int prettyIndent, unsigned int indentLevel) const
+{
+    switch (typ) {
+    case VNULL:
+        return 4;
+    case VSTR:
+        return json_escaped_size(val) + 2;
+    case VNUM:
+        return val.size();
+    case VBOOL:
+        return 5;
+    case VOBJ:
+    case VARR:
+        break;
+    }
+
+    // Brackets, newlines and the indent of the closing one, then per entry the
+    // indent, separator and newline
+    size_t n = 2 + (prettyIndent ? 1 + prettyIndent * (indentLevel - 1) : 0);
+    for (unsigned int i = 0; i < values.size(); i++) {
+        n += 1 + (prettyIndent ? 1 + prettyIndent * indentLevel : 0);
+        if (typ == VOBJ)
+            n += json_escaped_size(keys[i]) + 3 + (prettyIndent ? 1 : 0);
+        n += values[i].writeSize(prettyIndent, indentLevel + 1);
+    }
+    return n;
 }
 
 string UniValue::write(unsigned int prettyIndent,
                        unsigned int indentLevel) const
 {
-    string s;
-    s.reserve(1024);
-
     unsigned int modIndent = indentLevel;
     if (modIndent == 0)
         modIndent = 1;
 
+    string s;
+    s.reserve(writeSize(prettyIndent, modIndent));
+    writeTo(prettyIndent, modIndent, s);
+
+    return s;
+}
+
+void UniValue::writeTo(unsigned int prettyIndent, unsigned int indentLevel, string& s) const
+{
     switch (typ) {
     case VNULL:
         s += "null";
         break;
     case VOBJ:
-        writeObject(prettyIndent, modIndent, s);
+        writeObject(prettyIndent, indentLevel, s);
         break;
     case VARR:
-        writeArray(prettyIndent, modIndent, s);
+        writeArray(prettyIndent, indentLevel, s);
         break;
     case VSTR:
-        s += "\"" + json_escape(val) + "\"";
+        s += '"';
+        json_escape(val, s);
+        s += '"';
         break;
     case VNUM:
         s += val;
@@ -58,8 +104,6 @@ string UniValue::write(unsigned int prettyIndent,
         s += (val == "1" ? "true" : "false");
         break;
     }
-
-    return s;
 }
 
 static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, string& s)
@@ -69,47 +113,48 @@ static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, strin
 
 void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, string& s) const
 {
-    s += "[";
+    s += '[';
     if (prettyIndent)
-        s += "\n";
+        s += '\n';
 
     for (unsigned int i = 0; i < values.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += values[i].write(prettyIndent, indentLevel + 1);
+        values[i].writeTo(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1)) {
-            s += ",";
+            s += ',';
         }
         if (prettyIndent)
-            s += "\n";
+            s += '\n';
     }
 
     if (prettyIndent)
         indentStr(prettyIndent, indentLevel - 1, s);
-    s += "]";
+    s += ']';
 }
 
 void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel, string& s) const
 {
-    s += "{";
+    s += '{';
     if (prettyIndent)
-        s += "\n";
+        s += '\n';
 
     for (unsigned int i = 0; i < keys.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += "\"" + json_escape(keys[i]) + "\":";
+        s += '"';
+        json_escape(keys[i], s);
+        s += "\":";
         if (prettyIndent)
-            s += " ";
-        s += values.at(i).write(prettyIndent, indentLevel + 1);
+            s += ' ';
+        values.at(i).writeTo(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1))
-            s += ",";
+            s += ',';
         if (prettyIndent)
-            s += "\n";
+            s += '\n';
     }
 
     if (prettyIndent)
         indentStr(prettyIndent, indentLevel - 1, s);
-    s += "}";
+    s += '}';
 }
-
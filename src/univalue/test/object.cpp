@@ -379,6 +379,18 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("[]{}"));
     BOOST_CHECK(!v.read("{}[]"));
     BOOST_CHECK(!v.read("{} 42"));
+
+    /* Escapes in the middle of plain runs, and a multi-byte sequence
+       cut by ASCII, which must still fail.  */
+    BOOST_CHECK(v.read("[\"ab\\\"cd\\n\\u00e9fg\", -12.5e+3, 18446744073709551615]"));
+    BOOST_CHECK_EQUAL(v[0].getValStr(), "ab\"cd\n\xc3\xa9" "fg");
+    BOOST_CHECK_EQUAL(v[1].getValStr(), "-12.5e+3");
+    BOOST_CHECK_EQUAL(v.write(), "[\"ab\\\"cd\\n\xc3\xa9" "fg\",-12.5e+3,18446744073709551615]");
+    BOOST_CHECK_EQUAL(v.write(2), "[\n  \"ab\\\"cd\\n\xc3\xa9" "fg\",\n  -12.5e+3,\n  18446744073709551615\n]");
+    BOOST_CHECK(!v.read("[\"\xc3" "a\"]"));
+
+    BOOST_CHECK_EQUAL(UniValue((int64_t)-9223372036854775807LL - 1).getValStr(), "-9223372036854775808");
+    BOOST_CHECK_EQUAL(UniValue((uint64_t)18446744073709551615ULL).getValStr(), "18446744073709551615");
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -17,7 +17,9 @@
 #include "utilstrencodings.h"
 #include "utiltime.h"
 
+#include <climits>
 #include <stdarg.h>
+#include <thread>
 
 #if (defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__DragonFly__))
 #include <pthread.h>
@@ -922,6 +924,20 @@ int GetNumCores()
 #endif
 }
 
+void RunInParallel(size_t nItems, int nMaxThreads, const std::function<void(size_t)>& fn)
+{
+    const int nThreads = std::max(1, std::min(std::min(GetNumCores(), nMaxThreads), (int)std::min<size_t>(nItems, INT_MAX)));
+    std::vector<std::thread> vThreads;
+    for (int t = 0; t < nThreads; t++) {
+        vThreads.emplace_back([&fn, nItems, t, nThreads] {
+            for (size_t k = t; k < nItems; k += nThreads)
+                fn(k);
+        });
+    }
+    for (std::thread& thread : vThreads)
+        thread.join();
+}
+
 std::string CopyrightHolders(const std::string &strPrefix)
 {
     std::string strCopyrightHolders = strPrefix + strprintf(_(COPYRIGHT_HOLDERS), _(COPYRIGHT_HOLDERS_SUBSTITUTION));
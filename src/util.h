@@ -23,6 +23,7 @@
 
 #include <atomic>
 #include <exception>
+#include <functional>
 #include <map>
 #include <stdint.h>
 #include <string>
@@ -326,6 +327,9 @@ std::string HelpMessageOpt(const std::string &option, const std::string &message
  */
 int GetNumCores();
 
+/** Call fn for every index below nItems, on up to nMaxThreads threads, returning once all calls have */
+void RunInParallel(size_t nItems, int nMaxThreads, const std::function<void(size_t)>& fn);
+
 void RenameThread(const char *name);
 
 /**
@@ -10,6 +10,8 @@
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+
 std::string FormatMoney(const CAmount& n)
 {
     // Note: not using straight sprintf here because we do NOT want
@@ -31,6 +33,34 @@ std::string FormatMoney(const CAmount& n)
     return str;
 }
 
+void AppendAmount(std::string& str, const CAmount& n, int nDecimals)
+{
+    static const int64_t pow10[] = {100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1};
+    nDecimals = std::max(0, std::min(8, nDecimals));
+
+    // Digits are written backwards into a buffer large enough for any int64
+    char buf[32];
+    char* p = buf + sizeof(buf);
+    uint64_t n_abs = n < 0 ? -(uint64_t)n : (uint64_t)n;
+    uint64_t quotient = n_abs / COIN;
+    uint64_t remainder = (n_abs % COIN) / pow10[nDecimals];
+
+    if (nDecimals > 0) {
+        for (int i = 0; i < nDecimals; i++) {
+            *--p = '0' + remainder % 10;
+            remainder /= 10;
+        }
+        *--p = '.';
+    }
+    do {
+        *--p = '0' + quotient % 10;
+        quotient /= 10;
+    } while (quotient);
+    if (n < 0)
+        *--p = '-';
+
+    str.append(p, buf + sizeof(buf) - p);
+}
 
 bool ParseMoney(const std::string& str, CAmount& nRet)
 {
@@ -22,4 +22,7 @@ std::string FormatMoney(const CAmount& n);
 bool ParseMoney(const std::string& str, CAmount& nRet);
 bool ParseMoney(const char* pszIn, CAmount& nRet);
 
+/** Append n with exactly nDecimals decimals (0 to 8) to str without any temporary string, the number ValueFromAmount and the RPC stream writer output */
+void AppendAmount(std::string& str, const CAmount& n, int nDecimals);
+
 #endif // PLB_UTILMONEYSTR_H
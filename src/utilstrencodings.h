@@ -107,17 +107,19 @@ bool ParseDouble(const std::string& str, double *out);
 template<typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
 {
-    std::string rv;
     static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
-    rv.reserve((itend-itbegin)*3);
+    const size_t nBytes = itend > itbegin ? itend - itbegin : 0;
+    // Sized once and filled in place, with a separator before every byte but the first
+    std::string rv(nBytes == 0 ? 0 : nBytes * 2 + (fSpaces ? nBytes - 1 : 0), ' ');
+    char* p = &rv[0];
     for(T it = itbegin; it < itend; ++it)
     {
         unsigned char val = (unsigned char)(*it);
         if(fSpaces && it != itbegin)
-            rv.push_back(' ');
-        rv.push_back(hexmap[val>>4]);
-        rv.push_back(hexmap[val&15]);
+            p++;
+        *p++ = hexmap[val>>4];
+        *p++ = hexmap[val&15];
     }
 
     return rv;
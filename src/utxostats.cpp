@@ -0,0 +1,107 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "coins.h"
+#include "streams.h"
+#include "tokens/tokens.h"
+#include "util.h"
+#include "version.h"
+
+#include <boost/thread.hpp>
+
+void CUTXOSetStats::SetNull()
+{
+    hashBlock.SetNull();
+    nHeight = -1;
+    nTransactionOutputs = 0;
+    nBogoSize = 0;
+    nTotalAmount = 0;
+    mapTokenSupply.clear();
+    muhash = MuHash3072();
+}
+
+//! The element a coin is in the MuHash3072: its outpoint, everything the chainstate keeps of it, and its output
+static void SerializeCoin(CDataStream& ss, const COutPoint& outpoint, const Coin& coin)
+{
+    ss << outpoint;
+    ss << (uint32_t)((coin.nHeight << 2) + (coin.fCoinBase ? 1 : 0) + (coin.fCoinStake ? 2 : 0));
+    ss << coin.nTime;
+    ss << coin.out;
+}
+
+static uint64_t CoinBogoSize(const Coin& coin)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CUTXOSetStats::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeCoin(ss, outpoint, coin);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+
+    nTransactionOutputs++;
+    nBogoSize += CoinBogoSize(coin);
+    nTotalAmount += coin.out.nValue;
+
+    std::string strName;
+    CAmount nAmount;
+    uint32_t nTimeLock;
+    if (GetTokenInfoFromCoin(coin, strName, nAmount, nTimeLock))
+        mapTokenSupply[strName] += nAmount;
+}
+
+void CUTXOSetStats::RemoveCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    SerializeCoin(ss, outpoint, coin);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+
+    nTransactionOutputs--;
+    nBogoSize -= CoinBogoSize(coin);
+    nTotalAmount -= coin.out.nValue;
+
+    std::string strName;
+    CAmount nAmount;
+    uint32_t nTimeLock;
+    if (GetTokenInfoFromCoin(coin, strName, nAmount, nTimeLock)) {
+        auto it = mapTokenSupply.find(strName);
+        if (it != mapTokenSupply.end()) {
+            it->second -= nAmount;
+            // A token that is no longer held, after an undone issue or a burn, leaves the map
+            if (it->second == 0)
+                mapTokenSupply.erase(it);
+        }
+    }
+}
+
+uint256 CUTXOSetStats::GetMuHash() const
+{
+    MuHash3072 hash = muhash;
+    uint256 result;
+    hash.Finalize(result.begin());
+    return result;
+}
+
+bool ComputeUTXOSetStats(CCoinsView* view, CUTXOSetStats& stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    assert(pcursor);
+
+    stats.SetNull();
+    stats.hashBlock = pcursor->GetBestBlock();
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            return error("%s: unable to read value", __func__);
+        stats.AddCoin(key, coin);
+        pcursor->Next();
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2022 The Paladeum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PLB_UTXOSTATS_H
+#define PLB_UTXOSTATS_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <string>
+
+class CCoinsView;
+class COutPoint;
+class Coin;
+
+/**
+ * Statistics of a UTXO set that follow it coin by coin: the totals gettxoutsetinfo reports, the supply of every
+ * token held in it, and a MuHash3072 of its coins, which commits to the whole set without walking it.
+ */
+struct CUTXOSetStats
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    std::map<std::string, CAmount> mapTokenSupply;
+    MuHash3072 muhash;
+
+    CUTXOSetStats()
+    {
+        SetNull();
+    }
+
+    void SetNull();
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void RemoveCoin(const COutPoint& outpoint, const Coin& coin);
+
+    //! The MuHash3072 of the coins, takes a few milliseconds
+    uint256 GetMuHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(mapTokenSupply);
+        READWRITE(muhash);
+    }
+};
+
+//! Compute the statistics of the whole UTXO set of view with a cursor, hashBlock is set to its best block
+bool ComputeUTXOSetStats(CCoinsView* view, CUTXOSetStats& stats);
+
+#endif // PLB_UTXOSTATS_H
@@ -9,6 +9,8 @@
 #include "validation.h"
 
 #include "arith_uint256.h"
+#include "blockcompression.h"
+#include "blockfilemap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -21,6 +23,7 @@
 #include "fs.h"
 #include "hash.h"
 #include "init.h"
+#include "metrics.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "policy/rbf.h"
@@ -35,6 +38,7 @@
 #include <script/interpreter.h>
 #include "timedata.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -42,6 +46,7 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
+#include "utxostats.h"
 #include "validationinterface.h"
 #include "versionbits.h"
 #include "warnings.h"
@@ -53,7 +58,13 @@
 #include "base58.h"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <algorithm>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -92,11 +103,13 @@ using namespace boost::placeholders;
  */
 
 
-CCriticalSection cs_main;
+CCriticalSection cs_main(/* fTimeHold */ true);
 
 BlockMap mapBlockIndex;
 CChain chainActive;
+static std::shared_ptr<const CChainTipState> chainTipState;
 CBlockIndex *pindexBestHeader = nullptr;
+std::atomic<int> nBestHeaderHeight(-1);
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
@@ -110,10 +123,13 @@ bool fTimestampIndex = false;
 bool fSpentIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fEarlyStakeRelay = DEFAULT_EARLY_STAKE_RELAY;
+bool fSigCacheAutoSize = DEFAULT_SIG_CACHE_AUTOSIZE;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -242,11 +258,15 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewDB *pcoinsdbview = nullptr;
 CCoinsViewCache *pcoinsTip = nullptr;
+
+//! Statistics of the pcoinsTip UTXO set, followed by ConnectTip and DisconnectTip while fUTXOSetStats is set
+static CUTXOSetStats utxoSetStats;
+static bool fUTXOSetStats = false;
 CBlockTreeDB *pblocktree = nullptr;
 
 CTokensDB *ptokensdb = nullptr;
 CTokensCache *ptokens = nullptr;
-CLRUCache<std::string, CDatabasedTokenData> *ptokensCache = nullptr;
+CShardedLRUCache<std::string, CDatabasedTokenData> *ptokensCache = nullptr;
 CLRUCache<std::string, CMessage> *pMessagesCache = nullptr;
 CLRUCache<std::string, int> *pMessageSubscribedChannelsCache = nullptr;
 CLRUCache<std::string, int> *pMessagesSeenAddressCache = nullptr;
@@ -258,13 +278,27 @@ CTokenSnapshotDB *pTokenSnapshotDb = nullptr;
 CDistributeSnapshotRequestDB *pDistributeSnapshotDb = nullptr;
 
 CGovernance *governance = nullptr;
+CDBEnvironment *pdbenv = nullptr;
 
 CLRUCache<std::string, CNullTokenTxVerifierString> *ptokensVerifierCache = nullptr;
-CLRUCache<std::string, int8_t> *ptokensQualifierCache = nullptr;
-CLRUCache<std::string, int8_t> *ptokensRestrictionCache = nullptr;
-CLRUCache<std::string, int8_t> *ptokensGlobalRestrictionCache = nullptr;
+CRestrictedLRUCache *ptokensQualifierCache = nullptr;
+CRestrictedLRUCache *ptokensRestrictionCache = nullptr;
+CRestrictedLRUCache *ptokensGlobalRestrictionCache = nullptr;
 CRestrictedDB *prestricteddb = nullptr;
 
+static CMetricGauge metricChainHeight("paladeum_chain_height", "Height of the active chain's tip");
+static CMetricGauge metricChainTipTime("paladeum_chain_tip_time_seconds", "Block time of the active chain's tip");
+static CMetricGauge metricInitialBlockDownload("paladeum_initial_block_download", "1 while the node is in initial block download");
+static CMetricGauge metricCoinsCacheBytes("paladeum_coins_cache_bytes", "Memory used by the coins cache");
+static CMetricGauge metricCoinsCacheEntries("paladeum_coins_cache_entries", "Coins in the coins cache");
+static CMetricGauge metricTokenCacheBytes("paladeum_token_cache_bytes", "Memory used by the token cache of the active chain");
+static CMetricGauge metricTokenCacheDirtyBytes("paladeum_token_cache_dirty_bytes", "Size of the token changes not yet written to the token database");
+static CMetricCounter metricBlocksConnected("paladeum_blocks_connected_total", "Blocks connected to the active chain");
+static CMetricCounter metricBlocksDisconnected("paladeum_blocks_disconnected_total", "Blocks disconnected from the active chain by reorganizations");
+static CMetricHistogram metricConnectBlockSeconds("paladeum_connect_block_seconds", "Time to connect a block to the active chain, from reading it to updating the tip", MetricDurationBounds(), 1e-6);
+static CMetricCounter metricChainstateFlushes("paladeum_chainstate_flushes_total", "Full flushes of the coins, token and governance caches to disk");
+static CMetricHistogram metricChainstateFlushSeconds("paladeum_chainstate_flush_seconds", "Time of a full flush of the coins, token and governance caches", MetricDurationBounds(), 1e-6);
+
 enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
@@ -275,6 +309,7 @@ enum FlushStateMode {
 // See definition for documentation
 static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight=0);
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
+static void PruneTokenData(int nSnapshotHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
@@ -393,7 +428,7 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
                     maxInputHeight = std::max(maxInputHeight, height);
                 }
             }
-            lp->maxInputBlock = tip->GetAncestor(maxInputHeight);
+            lp->maxInputBlock = chainActive.GetAncestor(tip, maxInputHeight);
         }
     }
     return EvaluateSequenceLocks(index, lockPair);
@@ -523,9 +558,44 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/**
+ * Transactions whose cache-independent token checks (Consensus::CheckTxTokenAmounts) passed when they entered the
+ * mempool, so ConnectBlock can skip them. The result only depends on the transaction and the coins it spends, which
+ * its witness hash commits to, except for timelocks: transactions spending time locked tokens are never added.
+ */
+static CuckooCache::cache<uint256, SignatureCacheHasher> tokenAmountsCache;
+static uint256 tokenAmountsCacheNonce(GetRandHash());
+
+static uint256 GetTokenAmountsCacheEntry(const CTransaction& tx)
+{
+    uint256 hashCacheEntry;
+    CSHA256().Write(tokenAmountsCacheNonce.begin(), 32).Write(tx.GetWitnessHash().begin(), 32).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+//! The token outputs spent by tx, in input order
+static void GetSpentTokens(const CTransaction& tx, const CCoinsViewCache& view, std::vector<CTxOut>& vSpentTokens)
+{
+    for (const CTxIn& txin : tx.vin) {
+        const Coin& coin = view.AccessCoin(txin.prevout);
+        if (coin.IsToken())
+            vSpentTokens.push_back(coin.out);
+    }
+}
+
+//! The script flags transactions are checked with before they enter the mempool
+static unsigned int GetMempoolScriptVerifyFlags(const CChainParams& chainparams)
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!chainparams.RequireStandard()) {
+        scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept)
+                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept, bool fTrustScripts)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -670,16 +740,26 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         /** TOKENS START */
         if (!AreTokensDeployed()) {
-            for (auto out : tx.vout) {
-                if (out.scriptPubKey.IsTokenScript())
-                    return state.DoS(100, false, REJECT_INVALID, "bad-txns-contained-token-when-not-active");
-            }
+            if (tx.HasTokenOutputs())
+                return state.DoS(100, false, REJECT_INVALID, "bad-txns-contained-token-when-not-active");
         }
 
         if (AreTokensDeployed()) {
-            if (!Consensus::CheckTxTokens(tx, state, view, GetSpendHeight(view), GetSpendTime(view), GetCurrentTokenCache(), true, vReissueTokens))
+            std::vector<CTxOut> vSpentTokens;
+            GetSpentTokens(tx, view, vSpentTokens);
+
+            bool fTimeLocked = false;
+            if (!Consensus::CheckTxTokenAmounts(tx, state, vSpentTokens, GetSpendHeight(view), GetSpendTime(view), &fTimeLocked))
+                return error("%s: Consensus::CheckTxTokenAmounts: %s, %s", __func__, tx.GetHash().ToString(),
+                             FormatStateMessage(state));
+
+            if (!Consensus::CheckTxTokens(tx, state, view, GetSpendHeight(view), GetSpendTime(view), GetCurrentTokenCache(), true, vReissueTokens, false, nullptr, 0, nullptr, true))
                 return error("%s: Consensus::CheckTxTokens: %s, %s", __func__, tx.GetHash().ToString(),
                              FormatStateMessage(state));
+
+            // The block that confirms the transaction doesn't need to run the amount checks again
+            if (!fTimeLocked && (!vSpentTokens.empty() || tx.HasTokenOutputs()))
+                tokenAmountsCache.insert(GetTokenAmountsCacheEntry(tx));
         }
         /** TOKENS END */
 
@@ -895,15 +975,13 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!chainparams.RequireStandard()) {
-            scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags(chainparams);
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+        // Transactions reloaded from our own mempool dump on the tip they were verified on skip only the scripts
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputs(tx, state, view, !fTrustScripts, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -932,7 +1010,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // invalid blocks (using TestBlockValidity), however allowing such
         // transactions into the mempool can be exploited as a DoS attack.
         unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), GetParams().GetConsensus());
-        if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata))
+        if (!fTrustScripts && !CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata))
         {
             // If we're using promiscuousmempoolflags, we may hit this normally
             // Check if current block has some flags that scriptVerifyFlags
@@ -975,6 +1053,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // - the transaction is not dependent on any other transactions in the mempool
         bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
 
+        // Keep the sighash midstates for when a block connects the transaction
+        if (txdata.ready)
+            entry.SetTxData(std::make_shared<const PrecomputedTransactionData>(txdata));
+
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
 
@@ -995,49 +1077,43 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
         }
 
-        for (auto out : vReissueTokens) {
+        for (const auto& out : vReissueTokens) {
             mapReissuedTokens.insert(out);
             mapReissuedTx.insert(std::make_pair(out.second, out.first));
         }
 
         if (AreTokensDeployed()) {
-            for (auto out : tx.vout) {
+            for (const CTxOut& out : tx.vout) {
                 if (out.scriptPubKey.IsTokenScript()) {
                     CTokenOutputEntry data;
                     if (!GetTokenData(out.scriptPubKey, data))
                         continue;
                     if (data.type == TX_NEW_TOKEN && !IsTokenNameAnOwner(data.tokenName)) {
-                        pool.mapTokenToHash[data.tokenName] = hash;
-                        pool.mapHashToToken[hash] = data.tokenName;
+                        pool.AddNewToken(data.tokenName, hash);
                     }
 
                     // Keep track of all restricted tokens tx that can become invalid if qualifier or verifiers are changed
                     if (AreRestrictedTokensDeployed()) {
                         if (IsTokenNameAnRestricted(data.tokenName)) {
-                            std::string address = EncodeDestination(data.destination);
-                            pool.mapAddressesQualifiersChanged[address].insert(hash);
-                            pool.mapHashQualifiersChanged[hash].insert(address);
-
-                            pool.mapTokenVerifierChanged[data.tokenName].insert(hash);
-                            pool.mapHashVerifierChanged[hash].insert(data.tokenName);
+                            std::string address = EncodeTokenDestination(data.destination);
+                            pool.restrictedStateIndex.Add(CRestrictedStateIndex::QUALIFIERS_CHANGED, hash, address);
+                            pool.restrictedStateIndex.Add(CRestrictedStateIndex::VERIFIER_CHANGED, hash, data.tokenName);
                         }
                     }
                 } else if (out.scriptPubKey.IsNullGlobalRestrictionTokenTxDataScript()) {
                     CNullTokenTxData globalNullData;
                     if (GlobalTokenNullDataFromScript(out.scriptPubKey, globalNullData)) {
                         if (globalNullData.flag == 1) {
-                            if (pool.mapGlobalFreezingTokenTransactions.count(globalNullData.token_name)) {
+                            if (pool.restrictedStateIndex.Exists(CRestrictedStateIndex::GLOBAL_FREEZING, globalNullData.token_name)) {
                                 return state.DoS(0, false, REJECT_INVALID, "bad-txns-global-freeze-already-in-mempool");
                             } else {
-                                pool.mapGlobalFreezingTokenTransactions[globalNullData.token_name].insert(tx.GetHash());
-                                pool.mapHashGlobalFreezingTokenTransactions[tx.GetHash()].insert(globalNullData.token_name);
+                                pool.restrictedStateIndex.Add(CRestrictedStateIndex::GLOBAL_FREEZING, tx.GetHash(), globalNullData.token_name);
                             }
                         } else if (globalNullData.flag == 0) {
-                            if (pool.mapGlobalUnFreezingTokenTransactions.count(globalNullData.token_name)) {
+                            if (pool.restrictedStateIndex.Exists(CRestrictedStateIndex::GLOBAL_UNFREEZING, globalNullData.token_name)) {
                                 return state.DoS(0, false, REJECT_INVALID, "bad-txns-global-unfreeze-already-in-mempool");
                             } else {
-                                pool.mapGlobalUnFreezingTokenTransactions[globalNullData.token_name].insert(tx.GetHash());
-                                pool.mapHashGlobalUnFreezingTokenTransactions[tx.GetHash()].insert(globalNullData.token_name);
+                                pool.restrictedStateIndex.Add(CRestrictedStateIndex::GLOBAL_UNFREEZING, tx.GetHash(), globalNullData.token_name);
                             }
                         }
                     }
@@ -1049,21 +1125,19 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                     if (TokenNullDataFromScript(out.scriptPubKey, addressNullData, address)) {
                         if (IsTokenNameAQualifier(addressNullData.token_name)) {
                             if (addressNullData.flag == (int) QualifierType::ADD_QUALIFIER) {
-                                if (pool.mapAddressAddedTag.count(std::make_pair(address, addressNullData.token_name))) {
+                                if (pool.restrictedStateIndex.Exists(CRestrictedStateIndex::ADDED_TAG, addressNullData.token_name, address)) {
                                     return state.DoS(0, false, REJECT_INVALID,
                                                      "bad-txns-adding-tag-already-in-mempool");
                                 }
                                 // Adding a qualifier to an address
-                                pool.mapAddressAddedTag[std::make_pair(address, addressNullData.token_name)].insert(tx.GetHash());
-                                pool.mapHashToAddressAddedTag[tx.GetHash()].insert(std::make_pair(address, addressNullData.token_name));
+                                pool.restrictedStateIndex.Add(CRestrictedStateIndex::ADDED_TAG, tx.GetHash(), addressNullData.token_name, address);
                             } else {
-                                    if (pool.mapAddressRemoveTag.count(std::make_pair(address, addressNullData.token_name))) {
+                                    if (pool.restrictedStateIndex.Exists(CRestrictedStateIndex::REMOVED_TAG, addressNullData.token_name, address)) {
                                         return state.DoS(0, false, REJECT_INVALID,
                                                          "bad-txns-remove-tag-already-in-mempool");
                                     }
 
-                                pool.mapAddressRemoveTag[std::make_pair(address, addressNullData.token_name)].insert(tx.GetHash());
-                                pool.mapHashToAddressRemoveTag[tx.GetHash()].insert(std::make_pair(address, addressNullData.token_name));
+                                pool.restrictedStateIndex.Add(CRestrictedStateIndex::REMOVED_TAG, tx.GetHash(), addressNullData.token_name, address);
                             }
                         }
                     }
@@ -1083,19 +1157,18 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 if (GetTokenData(coin.out.scriptPubKey, data)) {
 
                     if (IsTokenNameAnRestricted(data.tokenName)) {
-                        pool.mapTokenMarkedGlobalFrozen[data.tokenName].insert(hash);
-                        pool.mapHashMarkedGlobalFrozen[hash].insert(data.tokenName);
-
-                        auto pair = std::make_pair(EncodeDestination(data.destination), data.tokenName);
-                        pool.mapAddressesMarkedFrozen[pair].insert(hash);
-                        pool.mapHashToAddressMarkedFrozen[hash].insert(pair);
+                        pool.restrictedStateIndex.Add(CRestrictedStateIndex::MARKED_GLOBAL_FROZEN, hash, data.tokenName);
+                        pool.restrictedStateIndex.Add(CRestrictedStateIndex::MARKED_FROZEN, hash, data.tokenName, EncodeTokenDestination(data.destination));
                     }
                 }
             }
         }
+
+        // The entry pays for the helper memory recorded above when the pool is trimmed
+        pool.UpdateTokenUsage(hash);
     }
 
-    GetMainSignals().TransactionAddedToMempool(ptx);
+    GetMainSignals().TransactionAddedToMempool(ptx, pool.GetAndIncrementSequence());
 
     return true;
 }
@@ -1103,10 +1176,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept)
+                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept, bool fTrustScripts = false)
 {
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept);
+    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept, fTrustScripts);
     if (!res) {
         for (const COutPoint& hashTx : coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
@@ -1125,17 +1198,100 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, std::vector<CValidationState>& states, const std::vector<CTransactionRef>& txs,
+                                     std::vector<bool>& vMissingInputs, bool bypass_limits, const CAmount nAbsurdFee)
+{
+    const CChainParams& chainparams = GetParams();
+    states.assign(txs.size(), CValidationState());
+    vMissingInputs.assign(txs.size(), false);
+
+    // Order the batch so that every transaction comes after the ones it spends from, keeping the given order otherwise
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < txs.size(); i++)
+        mapIndex.emplace(txs[i]->GetHash(), i);
+    std::vector<std::vector<size_t>> vChildren(txs.size());
+    std::vector<size_t> vParents(txs.size(), 0);
+    for (size_t i = 0; i < txs.size(); i++) {
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : txs[i]->vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second != i)
+                setParents.insert(it->second);
+        }
+        for (size_t nParent : setParents)
+            vChildren[nParent].push_back(i);
+        vParents[i] = setParents.size();
+    }
+    std::vector<size_t> vOrder;
+    vOrder.reserve(txs.size());
+    std::set<size_t> setReady;
+    for (size_t i = 0; i < txs.size(); i++)
+        if (vParents[i] == 0)
+            setReady.insert(i);
+    while (!setReady.empty()) {
+        size_t i = *setReady.begin();
+        setReady.erase(setReady.begin());
+        vOrder.push_back(i);
+        for (size_t nChild : vChildren[i])
+            if (--vParents[nChild] == 0)
+                setReady.insert(nChild);
+    }
+
+    unsigned int nAccepted = 0;
+    {
+        LOCK2(cs_main, pool.cs);
+        // Transactions left out of the order spend each other in a cycle, none of them can be valid
+        for (size_t i = 0; i < txs.size(); i++)
+            if (vParents[i] != 0)
+                states[i].DoS(10, false, REJECT_INVALID, "bad-txns-batch-cycle");
+
+        int64_t nNow = GetTime();
+        for (size_t i : vOrder) {
+            std::vector<COutPoint> coins_to_uncache;
+            bool fMissingInputs = false;
+            if (AcceptToMemoryPoolWorker(chainparams, pool, states[i], txs[i], &fMissingInputs, nNow, nullptr /* plTxnReplaced */,
+                                         bypass_limits, nAbsurdFee, coins_to_uncache, false /* test_accept */, false /* fTrustScripts */)) {
+                nAccepted++;
+            } else {
+                for (const COutPoint& hashTx : coins_to_uncache)
+                    pcoinsTip->Uncache(hashTx);
+            }
+            vMissingInputs[i] = fMissingInputs;
+        }
+    }
+
+    // One size check of the coins cache for the whole batch instead of one per transaction
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return nAccepted;
+}
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
 {
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
+    SyncIndexWriter();
     if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
 }
 
+bool WalkTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, const std::function<bool(const uint256&, unsigned int)> &fn)
+{
+    if (!fTimestampIndex)
+        return error("Timestamp index not enabled");
+
+    SyncIndexWriter();
+    if (!pblocktree->WalkTimestampIndex(high, low, [&](const uint256& hash, unsigned int timestamp) {
+            return (fActiveOnly && !HashOnchainActive(hash)) || fn(hash, timestamp);
+        }))
+        return error("Unable to get hashes for timestamps");
+
+    return true;
+}
+
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
     if (!fSpentIndex)
@@ -1144,17 +1300,38 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
+    SyncIndexWriter();
     if (!pblocktree->ReadSpentIndex(key, value))
         return false;
 
     return true;
 }
 
+bool GetSpentIndex(const std::set<CSpentIndexKey, CSpentIndexKeyCompare> &keys, std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> &values)
+{
+    if (!fSpentIndex)
+        return false;
+
+    std::set<CSpentIndexKey, CSpentIndexKeyCompare> setConfirmed;
+    for (const CSpentIndexKey& key : keys) {
+        CSpentIndexKey mempoolKey(key);
+        CSpentIndexValue value;
+        if (mempool.getSpentIndex(mempoolKey, value))
+            values.emplace(key, value);
+        else
+            setConfirmed.insert(setConfirmed.end(), key);
+    }
+
+    SyncIndexWriter();
+    return pblocktree->ReadSpentIndex(setConfirmed, values);
+}
+
 bool HashOnchainActive(const uint256 &hash)
 {
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
 
-    if (!chainActive.Contains(pblockindex)) {
+    if (it == mapBlockIndex.end() || !chainActive.Contains(it->second)) {
         return false;
     }
 
@@ -1167,6 +1344,7 @@ bool GetAddressIndex(uint160 addressHash, int type, std::string tokenName,
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    SyncIndexWriter();
     if (!pblocktree->ReadAddressIndex(addressHash, type, tokenName, addressIndex, start, end))
         return error("unable to get txids for address");
 
@@ -1179,18 +1357,33 @@ bool GetAddressIndex(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    SyncIndexWriter();
     if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressIndexBalances(uint160 addressHash, int type, std::string tokenName, int nLockHeight, int64_t nLockTime,
+                             std::map<std::string, CAddressIndexBalance> &balances, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    SyncIndexWriter();
+    if (!pblocktree->ReadAddressIndexBalances(addressHash, type, tokenName, nLockHeight, nLockTime, balances, start, end))
+        return error("unable to get balances for address");
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type, std::string tokenName,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    SyncIndexWriter();
     if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, tokenName, unspentOutputs))
         return error("unable to get txids for address");
 
@@ -1203,12 +1396,16 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    SyncIndexWriter();
     if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
 
     return true;
 }
 
+static bool ReadBlockRecord(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars* pmessageStart, std::shared_ptr<const CMappedFile>& file,
+                            std::vector<unsigned char>& vData, const unsigned char*& pbegin, const unsigned char*& pend);
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1226,14 +1423,19 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
+            // The offset is into the serialized block, which a compressed record has to be decompressed for
+            std::shared_ptr<const CMappedFile> file;
+            std::vector<unsigned char> vData;
+            const unsigned char* pbegin;
+            const unsigned char* pend;
+            if (!ReadBlockRecord(postx, nullptr, file, vData, pbegin, pend))
+                return error("%s: ReadBlockRecord failed", __func__);
             CBlockHeader header;
             try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
+                CMemoryReader reader(SER_DISK, CLIENT_VERSION, pbegin, pend);
+                reader >> header;
+                reader.ignore(postx.nTxOffset);
+                reader >> txOut;
             } catch (const std::exception& e) {
                 return error("%s: Deserialize or I/O error - %s", __func__, e.what());
             }
@@ -1278,7 +1480,29 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
-static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+/** Message start and size in front of each block and undo record */
+static const unsigned int BLOCK_RECORD_HEADER_SIZE = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+
+/**
+ * The record obj gets in its file and the size that goes in front of it: obj serialized, or with -blockcompression
+ * its compressed payload when that is smaller, flagged with BLOCK_RECORD_COMPRESSED.
+ */
+template<typename T>
+static void SerializeRecord(const T& obj, std::vector<unsigned char>& vRecord, uint32_t& nSizeWord)
+{
+    vRecord.clear();
+    CVectorWriter(SER_DISK, CLIENT_VERSION, vRecord, 0, obj);
+    nSizeWord = vRecord.size();
+    if (!fBlockCompression)
+        return;
+    std::vector<unsigned char> vPayload;
+    if (CompressBlockRecord(vRecord.data(), vRecord.size(), vPayload)) {
+        vRecord.swap(vPayload);
+        nSizeWord = vRecord.size() | BLOCK_RECORD_COMPRESSED;
+    }
+}
+
+static bool WriteBlockToDisk(const std::vector<unsigned char>& vRecord, uint32_t nSizeWord, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1286,16 +1510,78 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << nSizeWord;
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout.write((const char*)vRecord.data(), vRecord.size());
+
+    return true;
+}
 
+/**
+ * The serialized block at pos, found through the record header in front of it. [pbegin, pend) points into the
+ * mapped block file, or into vData when the file isn't mapped or the record is compressed. With pmessageStart,
+ * the message start of the record has to match it.
+ */
+static bool ReadBlockRecord(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars* pmessageStart, std::shared_ptr<const CMappedFile>& file,
+                            std::vector<unsigned char>& vData, const unsigned char*& pbegin, const unsigned char*& pend)
+{
+    if (pos.IsNull() || pos.nPos < BLOCK_RECORD_HEADER_SIZE)
+        return error("%s: Invalid position %s", __func__, pos.ToString());
+
+    CMessageHeader::MessageStartChars blk_start;
+    uint32_t nSizeWord;
+    file = g_blockfilemap.Get(pos.nFile, pos.nPos);
+    if (file) {
+        const unsigned char* pheader = file->data() + pos.nPos - BLOCK_RECORD_HEADER_SIZE;
+        memcpy(blk_start, pheader, CMessageHeader::MESSAGE_START_SIZE);
+        nSizeWord = ReadLE32(pheader + CMessageHeader::MESSAGE_START_SIZE);
+        const uint32_t nStored = nSizeWord & ~BLOCK_RECORD_COMPRESSED;
+        if (nStored > GetMaxBlockSerializedSize())
+            return error("%s: Block data is larger than maximum deserialization size for %s", __func__, pos.ToString());
+        // The file may have grown since it was mapped
+        if ((uint64_t)pos.nPos + nStored > file->size()) {
+            file = g_blockfilemap.Get(pos.nFile, (uint64_t)pos.nPos + nStored);
+            if (!file)
+                return error("%s: Block data past the end of the file for %s", __func__, pos.ToString());
+        }
+        pbegin = file->data() + pos.nPos;
+        pend = pbegin + nStored;
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - BLOCK_RECORD_HEADER_SIZE), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        try {
+            filein >> FLATDATA(blk_start) >> nSizeWord;
+            const uint32_t nStored = nSizeWord & ~BLOCK_RECORD_COMPRESSED;
+            if (nStored > GetMaxBlockSerializedSize())
+                return error("%s: Block data is larger than maximum deserialization size for %s", __func__, pos.ToString());
+            vData.resize(nStored);
+            filein.read((char*)vData.data(), nStored);
+        }
+        catch (const std::exception& e) {
+            return error("%s: Read from block file failed - %s at %s", __func__, e.what(), pos.ToString());
+        }
+        pbegin = vData.data();
+        pend = pbegin + vData.size();
+    }
+
+    if (pmessageStart && memcmp(blk_start, *pmessageStart, CMessageHeader::MESSAGE_START_SIZE))
+        return error("%s: Block magic mismatch for %s", __func__, pos.ToString());
+
+    if (nSizeWord & BLOCK_RECORD_COMPRESSED) {
+        std::vector<unsigned char> vBlock;
+        if (!DecompressBlockRecord(pbegin, pend - pbegin, vBlock, GetMaxBlockSerializedSize()))
+            return error("%s: Corrupt compressed block at %s", __func__, pos.ToString());
+        vData.swap(vBlock);
+        pbegin = vData.data();
+        pend = pbegin + vData.size();
+    }
     return true;
 }
 
@@ -1303,17 +1589,20 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedFile> file;
+    std::vector<unsigned char> vData;
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    if (!ReadBlockRecord(pos, nullptr, file, vData, pbegin, pend))
+        return false;
 
     // Read block
     try {
-        filein >> block;
+        CMemoryReader reader(SER_DISK, CLIENT_VERSION, pbegin, pend);
+        reader >> block;
     }
     catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
     // Check the header
@@ -1334,6 +1623,21 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    std::shared_ptr<const CMappedFile> file;
+    std::vector<unsigned char> vData;
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    if (!ReadBlockRecord(pos, &messageStart, file, vData, pbegin, pend))
+        return false;
+    if (!vData.empty() && pbegin == vData.data())
+        block.swap(vData);
+    else
+        block.assign(pbegin, pend);
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     if (nHeight == 1) {
@@ -1561,6 +1865,15 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    if (fTokenCheck) {
+        CValidationState state;
+        return Consensus::CheckTxTokenAmounts(*ptxTo, state, vSpentTokens, nSpendHeight, nSpendTime);
+    }
+    if (fTxCheck) {
+        CValidationState state;
+        return CheckTransaction(*ptxTo, state, CHECK_DUPLICATE_TRANSACTION_TRUE, CHECK_MEMPOOL_TRANSACTION_FALSE, fBlockCheck);
+    }
+
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
@@ -1582,6 +1895,7 @@ int GetSpendTime(const CCoinsViewCache& inputs)
 
 static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
+static CSignatureCacheStats scriptExecutionCacheStats GUARDED_BY(cs_main);
 
 void InitScriptExecutionCache() {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
@@ -1590,6 +1904,65 @@ void InitScriptExecutionCache() {
     size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
     LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheStats = CSignatureCacheStats();
+        scriptExecutionCacheStats.nMaxEntries = scriptExecutionCacheStats.nBaseEntries = nElems;
+    }
+
+    // Only token transactions are cached, so a quarter of the script execution cache is plenty
+    nElems = tokenAmountsCache.setup_bytes(nMaxCacheSize / 4);
+    LogPrintf("Using %zu MiB for the token amounts cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nElems);
+}
+
+void GetScriptExecutionCacheStats(CSignatureCacheStats& stats)
+{
+    LOCK(cs_main);
+    stats = scriptExecutionCacheStats;
+}
+
+/** Lookups of the script caches over the blocks connected since -sigcacheautosize last looked at them */
+static CSignatureCacheStats sigCacheInterval GUARDED_BY(cs_main);
+static CSignatureCacheStats scriptExecutionCacheInterval GUARDED_BY(cs_main);
+
+/**
+ * Counts the lookups of the script caches while connecting a block and, with
+ * -sigcacheautosize, doubles a cache that hits too little of them.
+ */
+static void UpdateScriptCaches(const CSignatureCacheStats& sigCacheBefore, const CSignatureCacheStats& scriptExecutionCacheBefore)
+{
+    AssertLockHeld(cs_main);
+    CSignatureCacheStats sigCacheNow;
+    GetSignatureCacheStats(sigCacheNow);
+    const CSignatureCacheStats sigCacheBlock = sigCacheNow.Since(sigCacheBefore);
+    const CSignatureCacheStats scriptExecutionCacheBlock = scriptExecutionCacheStats.Since(scriptExecutionCacheBefore);
+    LogPrint(BCLog::BENCH, "    - Script caches: signatures %u/%u hit, %u evicted, script executions %u/%u hit, %u evicted\n",
+        sigCacheBlock.nHits, sigCacheBlock.nHits + sigCacheBlock.nMisses, sigCacheBlock.nEvictions,
+        scriptExecutionCacheBlock.nHits, scriptExecutionCacheBlock.nHits + scriptExecutionCacheBlock.nMisses, scriptExecutionCacheBlock.nEvictions);
+    if (!fSigCacheAutoSize)
+        return;
+
+    sigCacheInterval += sigCacheBlock;
+    if (sigCacheInterval.nHits + sigCacheInterval.nMisses >= SIG_CACHE_AUTOSIZE_MIN_LOOKUPS) {
+        if (ShouldGrowSignatureCache(sigCacheInterval, sigCacheNow.nMaxEntries, sigCacheNow.nBaseEntries)) {
+            const uint32_t nEntries = ResizeSignatureCache(2 * sigCacheNow.nMaxEntries);
+            LogPrintf("%s: signature cache hit %u of %u lookups, grown to %u elements (%zu MiB)\n", __func__,
+                sigCacheInterval.nHits, sigCacheInterval.nHits + sigCacheInterval.nMisses, nEntries, ((size_t)nEntries * sizeof(uint256)) >> 20);
+        }
+        sigCacheInterval = CSignatureCacheStats();
+    }
+
+    scriptExecutionCacheInterval += scriptExecutionCacheBlock;
+    if (scriptExecutionCacheInterval.nHits + scriptExecutionCacheInterval.nMisses >= SIG_CACHE_AUTOSIZE_MIN_LOOKUPS) {
+        if (ShouldGrowSignatureCache(scriptExecutionCacheInterval, scriptExecutionCacheStats.nMaxEntries, scriptExecutionCacheStats.nBaseEntries)) {
+            scriptExecutionCacheStats.nMaxEntries = scriptExecutionCache.resize(2 * scriptExecutionCacheStats.nMaxEntries);
+            LogPrintf("%s: script execution cache hit %u of %u lookups, grown to %u elements (%zu MiB)\n", __func__,
+                scriptExecutionCacheInterval.nHits, scriptExecutionCacheInterval.nHits + scriptExecutionCacheInterval.nMisses,
+                scriptExecutionCacheStats.nMaxEntries, ((size_t)scriptExecutionCacheStats.nMaxEntries * sizeof(uint256)) >> 20);
+        }
+        scriptExecutionCacheInterval = CSignatureCacheStats();
+    }
 }
 
 /**
@@ -1635,8 +2008,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+                scriptExecutionCacheStats.nHits++;
                 return true;
             }
+            scriptExecutionCacheStats.nMisses++;
 
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
@@ -1682,7 +2057,9 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             if (cacheFullScriptStore && !pvChecks) {
                 // We executed all of the provided scripts, and were told to
                 // cache the result. Do so now.
-                scriptExecutionCache.insert(hashCacheEntry);
+                if (scriptExecutionCache.insert(hashCacheEntry))
+                    scriptExecutionCacheStats.nEvictions++;
+                scriptExecutionCacheStats.nInserts++;
             }
         }
     }
@@ -1692,7 +2069,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+bool UndoWriteToDisk(const CBlockUndo& blockundo, const std::vector<unsigned char>& vRecord, uint32_t nSizeWord, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1700,15 +2077,14 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
         return error("%s: OpenUndoFile failed", __func__);
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << nSizeWord;
 
     // Write undo data
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("%s: ftell failed", __func__);
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    fileout.write((const char*)vRecord.data(), vRecord.size());
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
@@ -1719,32 +2095,54 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (pos.IsNull() || pos.nPos < BLOCK_RECORD_HEADER_SIZE)
+        return error("%s: Invalid position %s", __func__, pos.ToString());
+
+    // Open history file to read, at the size in front of the undo data
+    CAutoFile filein(OpenUndoFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
-    // Read block
-    uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    // Read the whole record, the token undo data at its end is only there if bytes are left after vtxundo
     try {
-        verifier << hashBlock;
-        verifier >> blockundo;
+        uint32_t nSizeWord;
+        filein >> nSizeWord;
+        if ((nSizeWord & ~BLOCK_RECORD_COMPRESSED) > MAX_SIZE)
+            return error("%s: Undo record too large", __func__);
+        std::vector<unsigned char> vData(nSizeWord & ~BLOCK_RECORD_COMPRESSED);
+        filein.read((char*)vData.data(), vData.size());
+        uint256 hashChecksum;
         filein >> hashChecksum;
+        if (nSizeWord & BLOCK_RECORD_COMPRESSED) {
+            // The checksum covers the undo data as serialized, before compression
+            std::vector<unsigned char> vPayload;
+            vPayload.swap(vData);
+            if (!DecompressBlockRecord(vPayload.data(), vPayload.size(), vData, MAX_SIZE))
+                return error("%s: Corrupt compressed undo data", __func__);
+        }
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << hashBlock;
+        hasher.write((const char*)vData.data(), vData.size());
+        if (hashChecksum != hasher.GetHash())
+            return error("%s: Checksum mismatch", __func__);
+        CMemoryReader reader(SER_DISK, CLIENT_VERSION, vData.data(), vData.data() + vData.size());
+        reader >> blockundo;
+        if (!reader.empty())
+            return error("%s: Trailing data after undo data", __func__);
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
 
-    // Verify checksum
-    if (hashChecksum != verifier.GetHash())
-        return error("%s: Checksum mismatch", __func__);
-
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1766,128 +2164,749 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 
 } // namespace
 
-enum DisconnectResult
+namespace {
+/** The address, spent and timestamp index changes of one connected or disconnected block */
+struct CIndexWriteJob
 {
-    DISCONNECT_OK,      // All good.
-    DISCONNECT_UNCLEAN, // Rolled back, but UTXO set was inconsistent with block.
-    DISCONNECT_FAILED   // Something else went wrong.
+    bool fConnect;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    //! Set when the block's logical timestamp is to be written
+    bool fTimestamp;
+    uint256 hashBlock;
+    uint256 hashPrevBlock;
+    unsigned int nTime;
+
+    CIndexWriteJob() : fConnect(true), fTimestamp(false), nTime(0) {}
 };
 
-/**
- * Restore the UTXO in a Coin at a given COutPoint
- * @param undo The Coin to be restored.
- * @param view The coins view to which to apply the changes.
- * @param out The out point that corresponds to the tx input.
- * @return A DisconnectResult as an int
- */
-int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out, CTokensCache* tokenCache = nullptr)
-{
-    bool fClean = true;
+std::mutex csIndexWriter;
+std::condition_variable condIndexWriter;
+std::deque<CIndexWriteJob> queueIndexJobs;
+std::thread threadIndexWriter;
+bool fIndexWriterRunning = false;
+bool fIndexWriterStop = false;
+bool fIndexWriterFailed = false;
+uint64_t nIndexJobsQueued = 0;
+uint64_t nIndexJobsWritten = 0;
+}
 
-    /** TOKENS START */
-    // This is needed because undo, is going to be cleared and moved when AddCoin is called. We need this for undo tokens
-    Coin tempCoin;
-    bool fIsToken = false;
-    if (undo.IsToken()) {
-        fIsToken = true;
-        tempCoin = undo;
+static bool WriteIndexJob(const CIndexWriteJob& job)
+{
+    if (!job.fConnect) {
+        if (!pblocktree->EraseAddressIndex(job.addressIndex))
+            return AbortNode("Failed to delete address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(job.addressUnspentIndex))
+            return AbortNode("Failed to write address unspent index");
+        return true;
     }
-    /** TOKENS END */
 
-    if (view.HaveCoin(out)) fClean = false; // overwriting transaction output
+    if (!job.addressIndex.empty() && !pblocktree->WriteAddressIndex(job.addressIndex))
+        return AbortNode("Failed to write address index");
 
-    if (undo.nHeight == 0) {
-        // Missing undo metadata (height and coinbase). Older versions included this
-        // information only in undo records for the last spend of a transactions'
-        // outputs. This implies that it must be present for some other output of the same tx.
-        const Coin& alternate = AccessByTxid(view, out.hash);
-        if (!alternate.IsSpent()) {
-            undo.nHeight = alternate.nHeight;
-            undo.fCoinBase = alternate.fCoinBase;
-            undo.fCoinStake = alternate.fCoinStake;
-            undo.nTime = alternate.nTime;
-        } else {
-            return DISCONNECT_FAILED; // adding output for transaction without known metadata
-        }
-    }
-    // The potential_overwrite parameter to AddCoin is only allowed to be false if we know for
-    // sure that the coin did not already exist in the cache. As we have queried for that above
-    // using HaveCoin, we don't need to guess. When fClean is false, a coin already existed and
-    // it is an overwrite.
-    view.AddCoin(out, std::move(undo), !fClean);
+    if (!job.addressUnspentIndex.empty() && !pblocktree->UpdateAddressUnspentIndex(job.addressUnspentIndex))
+        return AbortNode("Failed to write address unspent index");
 
-    /** TOKENS START */
-    if (AreTokensDeployed()) {
-        if (tokenCache && fIsToken) {
-            if (!tokenCache->UndoTokenCoin(tempCoin, out))
-                fClean = false;
+    if (!job.spentIndex.empty() && !pblocktree->UpdateSpentIndex(job.spentIndex))
+        return AbortNode("Failed to write transaction index");
+
+    if (job.fTimestamp) {
+        unsigned int logicalTS = job.nTime;
+        unsigned int prevLogicalTS = 0;
+
+        // retrieve logical timestamp of the previous block, the jobs are written in order so it is already there
+        if (!job.hashPrevBlock.IsNull())
+            if (!pblocktree->ReadTimestampBlockIndex(job.hashPrevBlock, prevLogicalTS))
+                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+        if (logicalTS <= prevLogicalTS) {
+            logicalTS = prevLogicalTS + 1;
+            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, job.nTime, prevLogicalTS, logicalTS);
         }
+
+        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, job.hashBlock)))
+            return AbortNode("Failed to write timestamp index");
+
+        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(job.hashBlock), CTimestampBlockIndexValue(logicalTS)))
+            return AbortNode("Failed to write blockhash index");
     }
-    /** TOKENS END */
 
-    return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
+    return true;
 }
 
-/** Undo the effects of this block (with given index) on the UTXO set represented by coins.
- *  When FAILED is returned, view is left in an indeterminate state. */
-static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CTokensCache* tokensCache = nullptr, bool ignoreAddressIndex = false, bool databaseMessaging = true)
+static void ThreadIndexWriter()
 {
-    bool fClean = true;
+    while (true) {
+        CIndexWriteJob job;
+        {
+            std::unique_lock<std::mutex> lock(csIndexWriter);
+            condIndexWriter.wait(lock, [] { return fIndexWriterStop || !queueIndexJobs.empty(); });
+            if (queueIndexJobs.empty())
+                return;
+            job = std::move(queueIndexJobs.front());
+            queueIndexJobs.pop_front();
+        }
 
-    CBlockUndo blockUndo;
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        error("DisconnectBlock(): no undo data available");
-        return DISCONNECT_FAILED;
-    }
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetIndexHash())) {
-        error("DisconnectBlock(): failure reading undo data");
-        return DISCONNECT_FAILED;
-    }
+        bool fWritten = WriteIndexJob(job);
 
-    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
-        error("DisconnectBlock(): block and undo data inconsistent");
-        return DISCONNECT_FAILED;
+        {
+            std::lock_guard<std::mutex> lock(csIndexWriter);
+            if (!fWritten)
+                fIndexWriterFailed = true;
+            nIndexJobsWritten++;
+        }
+        condIndexWriter.notify_all();
     }
+}
 
-    std::vector<std::pair<std::string, CBlockTokenUndo> > vUndoData;
-    if (!ptokensdb->ReadBlockUndoTokenData(block.GetIndexHash(), vUndoData)) {
-        error("DisconnectBlock(): block token undo data inconsistent");
-        return DISCONNECT_FAILED;
+/** Hand the index changes of a block to the index writer, or write them right away when it isn't running */
+static bool QueueIndexWrite(CIndexWriteJob&& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(csIndexWriter);
+        if (fIndexWriterRunning) {
+            queueIndexJobs.push_back(std::move(job));
+            nIndexJobsQueued++;
+            condIndexWriter.notify_all();
+            return true;
+        }
     }
-    
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-
-    CTxDestination destination = DecodeDestination(GetParams().GovernanceMasterAddress());
-    CScript masterKey = GetScriptForDestination(destination);
-
-    // undo transactions in reverse order
-    CTokensCache tempCache(*tokensCache);
-    for (int i = block.vtx.size() - 1; i >= 0; i--) {
-        const CTransaction &tx = *(block.vtx[i]);
-        uint256 hash = tx.GetHash();
-        bool is_coinbase = tx.IsCoinBase();
+    return WriteIndexJob(job);
+}
 
-        std::vector<int> vTokenTxIndex;
-        std::vector<int> vNullTokenTxIndex;
-        if (fAddressIndex) {
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
+void StartIndexWriter()
+{
+    std::lock_guard<std::mutex> lock(csIndexWriter);
+    if (fIndexWriterRunning)
+        return;
 
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
+    fIndexWriterStop = false;
+    fIndexWriterRunning = true;
+    threadIndexWriter = std::thread(&TraceThread<std::function<void()> >, "indexwriter", std::function<void()>(ThreadIndexWriter));
+}
 
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
+void StopIndexWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(csIndexWriter);
+        if (!fIndexWriterRunning)
+            return;
+        fIndexWriterStop = true;
+    }
+    condIndexWriter.notify_all();
+    threadIndexWriter.join();
 
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), hash, k), CAddressUnspentValue()));
+    std::lock_guard<std::mutex> lock(csIndexWriter);
+    fIndexWriterRunning = false;
+}
 
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
+bool SyncIndexWriter()
+{
+    std::unique_lock<std::mutex> lock(csIndexWriter);
+    const uint64_t nJobs = nIndexJobsQueued;
+    condIndexWriter.wait(lock, [nJobs] { return nIndexJobsWritten >= nJobs || !fIndexWriterRunning; });
+    return !fIndexWriterFailed;
+}
 
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
+/**
+ * Append the address and spent index entries of transaction i of the block at nHeight to job: the spends of
+ * vPrevouts, the outputs tx spends in input order, then the outputs it creates. ConnectBlock and the index
+ * builder share it, so that an index built in the background matches one kept while connecting.
+ */
+static void GetTxIndexEntries(const CTransaction& tx, unsigned int i, int nHeight, const std::vector<CTxOut>& vPrevouts, bool fAddress, bool fSpent, CIndexWriteJob& job)
+{
+    const uint256 txhash = tx.GetHash();
+
+    if (!tx.IsCoinBase()) {
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const CTxIn input = tx.vin[j];
+            const CTxOut &prevout = vPrevouts[j];
+            uint160 hashBytes;
+            int addressType;
+            bool isToken = false;
+            std::string tokenName;
+            CAmount tokenAmount;
+            int nScriptType = 0;
+            int timeLock = 0;
+
+            if (prevout.scriptPubKey.IsPayToScriptHash()) {
+                hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
+                addressType = 2;
+            } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
+                hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
+                addressType = 1;
+            } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked()) {
+                timeLock = prevout.GetLockTime();
+                int offset = prevout.scriptPubKey.size() - 25;
+                hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin() + (3 + offset), prevout.scriptPubKey.begin() + (23 + offset)));
+                addressType = 1;
+            } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
+                hashBytes = Hash160(prevout.scriptPubKey.begin() + 1, prevout.scriptPubKey.end() - 1);
+                addressType = 1;
+            } else {
+                /** TOKENS START */
+                if (AreTokensDeployed()) {
+                    hashBytes.SetNull();
+                    addressType = 0;
+                    uint32_t nTimeLock;
+
+                    if (ParseTokenScript(prevout.scriptPubKey, hashBytes, nScriptType, tokenName, tokenAmount, nTimeLock)) {
+                        if (nScriptType == TX_PUBKEYHASH) {
+                            addressType = 1;
+                        } else if (nScriptType == TX_SCRIPTHASH) {
+                            addressType = 2;
+                        }
+
+                        isToken = true;
+                        timeLock = nTimeLock;
+                    }
+                }
+                /** TOKENS END */
+            }
+
+            if (fAddress && addressType > 0) {
+                /** TOKENS START */
+                if (isToken) {
+                    // record spending activity
+                    job.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, tokenName, nHeight, i, txhash, j, true, timeLock), tokenAmount * -1));
+
+                    // remove address from unspent index
+                    job.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, tokenName, input.prevout.hash, input.prevout.n, timeLock), CAddressUnspentValue()));
+                /** TOKENS END */
+                } else {
+                    // record spending activity
+                    job.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true, timeLock), prevout.nValue * -1));
+
+                    // remove address from unspent index
+                    job.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n, timeLock), CAddressUnspentValue()));
+                }
+            }
+            /** TOKENS END */
+
+            if (fSpent) {
+                // add the spent index to determine the txid and input that spent an output
+                // and to find the amount and address from an input
+                job.spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, addressType, hashBytes)));
+            }
+        }
+    }
+
+    if (fAddress) {
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+
+            if (out.scriptPubKey.IsPayToScriptHash()) {
+                std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
+
+                // record receiving activity
+                job.addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+                // record unspent output
+                job.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight, tx.nTime)));
+
+            } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
+                std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
+
+                // record receiving activity
+                job.addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+                // record unspent output
+                job.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight, tx.nTime)));
+
+            } else if (out.scriptPubKey.IsPayToPublicKeyHashLocked()) {
+                int offset = out.scriptPubKey.size() - 25;
+                int timeLock = out.GetLockTime();
+
+                std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + (3 + offset), out.scriptPubKey.begin() + (23 + offset));
+
+                // record receiving activity
+                job.addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), nHeight, i, txhash, k, false, timeLock), out.nValue));
+
+                // record unspent output
+                job.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k, timeLock), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight, tx.nTime)));
+
+            } else if (out.scriptPubKey.IsPayToPublicKey()) {
+                uint160 hashBytes(Hash160(out.scriptPubKey.begin() + 1, out.scriptPubKey.end() - 1));
+                job.addressIndex.push_back(
+                        std::make_pair(CAddressIndexKey(1, hashBytes, nHeight, i, txhash, k, false),
+                                       out.nValue));
+                job.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, hashBytes, txhash, k),
+                                                             CAddressUnspentValue(out.nValue, out.scriptPubKey,
+                                                                                  nHeight, tx.nTime)));
+            } else {
+                /** TOKENS START */
+                if (AreTokensDeployed()) {
+                    std::string tokenName;
+                    CAmount tokenAmount;
+                    uint160 hashBytes;
+                    int nScriptType;
+                    int addressType = 0;
+                    uint32_t nTimeLock;
+
+                    if (ParseTokenScript(out.scriptPubKey, hashBytes, nScriptType, tokenName, tokenAmount, nTimeLock)) {
+                        if (nScriptType == TX_PUBKEYHASH) {
+                            addressType = 1;
+                        } else if (nScriptType == TX_SCRIPTHASH) {
+                            addressType = 2;
+                        }
+
+                        // record receiving activity
+                        job.addressIndex.push_back(std::make_pair(
+                                CAddressIndexKey(addressType, hashBytes, tokenName, nHeight, i, txhash, k, false, nTimeLock),
+                                tokenAmount));
+
+                        // record unspent output
+                        job.addressUnspentIndex.push_back(
+                                std::make_pair(CAddressUnspentKey(addressType, hashBytes, tokenName, txhash, k, nTimeLock),
+                                               CAddressUnspentValue(tokenAmount, out.scriptPubKey,
+                                                                    nHeight, tx.nTime)));
+                    }
+                } else {
+                    continue;
+                }
+                /** TOKENS END */
+            }
+        }
+    }
+}
+
+namespace {
+/** How far below the tip the index builder stays until it takes cs_main for the last blocks */
+static const int INDEX_BUILD_TIP_MARGIN = 100;
+/** Blocks the index builder reads from disk at a time */
+static const int INDEX_BUILD_BATCH_SIZE = 64;
+/** Threads reading the blocks of a batch */
+static const int MAX_INDEX_BUILD_READERS = 4;
+
+/** An optional index switched on since it was last written, built from the blocks on disk */
+struct CIndexBuild
+{
+    std::string strName;
+    bool* pfEnabled;
+    //! Height of the last block the index has been written up to
+    int nBestHeight;
+};
+
+std::mutex csIndexBuilder;
+std::condition_variable condIndexBuilder;
+std::set<std::string> setIndexBuildsScheduled;
+std::thread threadIndexBuilder;
+bool fIndexBuilderRunning = false;
+bool fIndexBuilderStop = false;
+
+/** A block of the active chain with its undo data, read by the index builder */
+struct CIndexBuildBlock
+{
+    const CBlockIndex* pindex;
+    CBlock block;
+    CBlockUndo blockUndo;
+    bool fRead;
+};
+}
+
+static bool IndexBuilderStopping()
+{
+    std::lock_guard<std::mutex> lock(csIndexBuilder);
+    return fIndexBuilderStop;
+}
+
+static bool ReadIndexBuildBlock(CIndexBuildBlock& entry, const Consensus::Params& consensusParams)
+{
+    if (!ReadBlockFromDisk(entry.block, entry.pindex, consensusParams))
+        return false;
+    CDiskBlockPos pos = entry.pindex->GetUndoPos();
+    if (pos.IsNull())
+        return error("%s: no undo data available for block %s", __func__, entry.pindex->GetIndexHash().ToString());
+    return UndoReadFromDisk(entry.blockUndo, pos, entry.pindex->pprev->GetIndexHash());
+}
+
+/** Write the entries of one block to the indexes of vBuilds that haven't got it yet */
+static bool WriteIndexBuildBlock(const CIndexBuildBlock& entry, std::vector<CIndexBuild>& vBuilds)
+{
+    const CBlockIndex* pindex = entry.pindex;
+    bool fAddress = false, fSpent = false, fTimestamp = false;
+    for (const CIndexBuild& build : vBuilds) {
+        if (build.nBestHeight >= pindex->nHeight)
+            continue;
+        fAddress |= build.pfEnabled == &fAddressIndex;
+        fSpent |= build.pfEnabled == &fSpentIndex;
+        fTimestamp |= build.pfEnabled == &fTimestampIndex;
+    }
+
+    if (entry.blockUndo.vtxundo.size() + 1 != entry.block.vtx.size())
+        return error("%s: block and undo data of %s are inconsistent", __func__, pindex->GetIndexHash().ToString());
+
+    CIndexWriteJob job;
+    if (fAddress || fSpent) {
+        std::vector<CTxOut> vPrevouts;
+        for (unsigned int i = 0; i < entry.block.vtx.size(); i++) {
+            const CTransaction& tx = *(entry.block.vtx[i]);
+            vPrevouts.clear();
+            if (i > 0) {
+                const CTxUndo& txundo = entry.blockUndo.vtxundo[i - 1];
+                if (txundo.vprevout.size() != tx.vin.size())
+                    return error("%s: transaction and undo data of %s are inconsistent", __func__, tx.GetHash().ToString());
+                for (const Coin& coin : txundo.vprevout)
+                    vPrevouts.push_back(coin.out);
+            }
+            GetTxIndexEntries(tx, i, pindex->nHeight, vPrevouts, fAddress, fSpent, job);
+        }
+    }
+    if (fTimestamp) {
+        job.fTimestamp = true;
+        job.hashBlock = pindex->GetIndexHash();
+        job.hashPrevBlock = pindex->pprev->GetIndexHash();
+        job.nTime = pindex->nTime;
+    }
+    if (!WriteIndexJob(job))
+        return false;
+
+    for (CIndexBuild& build : vBuilds)
+        build.nBestHeight = std::max(build.nBestHeight, pindex->nHeight);
+    return true;
+}
+
+/** Read the blocks of vBatch side by side and write them in order, false if building has to stop */
+static bool BuildIndexBatch(std::vector<CIndexBuildBlock>& vBatch, std::vector<CIndexBuild>& vBuilds, const Consensus::Params& consensusParams)
+{
+    RunInParallel(vBatch.size(), MAX_INDEX_BUILD_READERS, [&vBatch, &consensusParams](size_t k) {
+        vBatch[k].fRead = ReadIndexBuildBlock(vBatch[k], consensusParams);
+    });
+
+    for (const CIndexBuildBlock& entry : vBatch) {
+        if (!entry.fRead)
+            return error("%s: failed to read block %s", __func__, entry.pindex->GetIndexHash().ToString());
+        if (!WriteIndexBuildBlock(entry, vBuilds))
+            return false;
+    }
+
+    const uint256 hashBest = vBatch.back().pindex->GetIndexHash();
+    for (const CIndexBuild& build : vBuilds) {
+        if (!pblocktree->WriteIndexBuildBest(build.strName, hashBest))
+            return AbortNode("Failed to write index build progress");
+    }
+    return true;
+}
+
+/** The blocks of the active chain after nHeight up to nMaxHeight, at most INDEX_BUILD_BATCH_SIZE of them */
+static std::vector<CIndexBuildBlock> GetIndexBuildBatch(int nHeight, int nMaxHeight)
+{
+    AssertLockHeld(cs_main);
+    std::vector<CIndexBuildBlock> vBatch;
+    for (int nNext = nHeight + 1; nNext <= nMaxHeight && (int)vBatch.size() < INDEX_BUILD_BATCH_SIZE; nNext++) {
+        CIndexBuildBlock entry;
+        entry.pindex = chainActive[nNext];
+        entry.fRead = false;
+        vBatch.push_back(std::move(entry));
+    }
+    return vBatch;
+}
+
+static void ThreadIndexBuilder()
+{
+    const Consensus::Params& consensusParams = GetParams().GetConsensus();
+
+    // Blocks being imported or reindexed aren't on the active chain yet
+    {
+        std::unique_lock<std::mutex> lock(csIndexBuilder);
+        while (!fIndexBuilderStop && (fImporting || fReindex))
+            condIndexBuilder.wait_for(lock, std::chrono::seconds(1));
+        if (fIndexBuilderStop)
+            return;
+    }
+
+    std::vector<CIndexBuild> vBuilds;
+    // The last block written to every index being built, null before the first one
+    const CBlockIndex* pindexLast = nullptr;
+    {
+        LOCK(cs_main);
+        std::set<std::string> setScheduled;
+        {
+            std::lock_guard<std::mutex> lock(csIndexBuilder);
+            setScheduled = setIndexBuildsScheduled;
+        }
+        for (const std::string& strName : setScheduled) {
+            CIndexBuild build;
+            build.strName = strName;
+            build.pfEnabled = strName == "addressindex" ? &fAddressIndex : strName == "spentindex" ? &fSpentIndex : &fTimestampIndex;
+            build.nBestHeight = 0;
+            if (*build.pfEnabled)
+                continue;
+
+            uint256 hashBest;
+            if (pblocktree->ReadIndexBuildBest(strName, hashBest)) {
+                BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+                if (it == mapBlockIndex.end() || !chainActive.Contains(it->second)) {
+                    LogPrintf("%s: the %s built so far is not on the active chain, you need to rebuild the database using -reindex-chainstate\n", __func__, strName);
+                    continue;
+                }
+                build.nBestHeight = it->second->nHeight;
+            }
+            LogPrintf("%s: building the %s from height %d\n", __func__, strName, build.nBestHeight + 1);
+            vBuilds.push_back(build);
+        }
+        if (vBuilds.empty())
+            return;
+
+        int nHeight = vBuilds[0].nBestHeight;
+        for (const CIndexBuild& build : vBuilds)
+            nHeight = std::min(nHeight, build.nBestHeight);
+        if (nHeight > 0)
+            pindexLast = chainActive[nHeight];
+    }
+
+    // Catch up without cs_main while the blocks are well below the tip
+    while (true) {
+        if (IndexBuilderStopping())
+            return;
+
+        std::vector<CIndexBuildBlock> vBatch;
+        {
+            LOCK(cs_main);
+            if (pindexLast && !chainActive.Contains(pindexLast)) {
+                LogPrintf("%s: the active chain no longer contains the indexes built so far, you need to rebuild the database using -reindex-chainstate\n", __func__);
+                return;
+            }
+            vBatch = GetIndexBuildBatch(pindexLast ? pindexLast->nHeight : 0, chainActive.Height() - INDEX_BUILD_TIP_MARGIN);
+        }
+        if (vBatch.empty())
+            break;
+
+        if (!BuildIndexBatch(vBatch, vBuilds, consensusParams))
+            return;
+        pindexLast = vBatch.back().pindex;
+        if (pindexLast->nHeight % 10000 < INDEX_BUILD_BATCH_SIZE)
+            LogPrintf("%s: indexes built up to height %d\n", __func__, pindexLast->nHeight);
+    }
+
+    // Write the last blocks and switch the indexes on with no block being connected in between
+    LOCK(cs_main);
+    if (pindexLast && !chainActive.Contains(pindexLast)) {
+        LogPrintf("%s: the active chain no longer contains the indexes built so far, you need to rebuild the database using -reindex-chainstate\n", __func__);
+        return;
+    }
+    while ((pindexLast ? pindexLast->nHeight : 0) < chainActive.Height()) {
+        if (IndexBuilderStopping())
+            return;
+        std::vector<CIndexBuildBlock> vBatch = GetIndexBuildBatch(pindexLast ? pindexLast->nHeight : 0, chainActive.Height());
+        if (!BuildIndexBatch(vBatch, vBuilds, consensusParams))
+            return;
+        pindexLast = vBatch.back().pindex;
+    }
+
+    for (const CIndexBuild& build : vBuilds) {
+        if (!pblocktree->WriteFlag(build.strName, true) || !pblocktree->EraseIndexBuildBest(build.strName)) {
+            AbortNode("Failed to write index build progress");
+            return;
+        }
+        *build.pfEnabled = true;
+        LogPrintf("%s: %s built up to height %d and enabled\n", __func__, build.strName, chainActive.Height());
+    }
+}
+
+bool ScheduleIndexBuild(const std::string& strName)
+{
+    if (fHavePruned || fPruneMode)
+        return false;
+
+    std::lock_guard<std::mutex> lock(csIndexBuilder);
+    setIndexBuildsScheduled.insert(strName);
+    return true;
+}
+
+void StartIndexBuilder()
+{
+    std::lock_guard<std::mutex> lock(csIndexBuilder);
+    if (fIndexBuilderRunning || setIndexBuildsScheduled.empty())
+        return;
+
+    fIndexBuilderStop = false;
+    fIndexBuilderRunning = true;
+    threadIndexBuilder = std::thread(&TraceThread<std::function<void()> >, "indexbuilder", std::function<void()>(ThreadIndexBuilder));
+}
+
+void StopIndexBuilder()
+{
+    {
+        std::lock_guard<std::mutex> lock(csIndexBuilder);
+        if (!fIndexBuilderRunning)
+            return;
+        fIndexBuilderStop = true;
+    }
+    condIndexBuilder.notify_all();
+    threadIndexBuilder.join();
+
+    std::lock_guard<std::mutex> lock(csIndexBuilder);
+    fIndexBuilderRunning = false;
+}
+
+namespace {
+/** Blocks ActivateBestChainStep reads ahead of disconnecting them */
+static const int MAX_DISCONNECT_READ_AHEAD = 64;
+/** Threads reading the blocks to disconnect */
+static const int MAX_DISCONNECT_READERS = 4;
+
+/** A block to disconnect with the coin and token undo data DisconnectBlock needs, read ahead of DisconnectTip */
+struct CDisconnectBlockData
+{
+    const CBlockIndex* pindex;
+    std::shared_ptr<CBlock> pblock;
+    CBlockUndo blockUndo;
+    std::vector<std::pair<std::string, CBlockTokenUndo> > vTokenUndo;
+    bool fRead;
+
+    CDisconnectBlockData() : pindex(nullptr), pblock(std::make_shared<CBlock>()), fRead(false) {}
+};
+}
+
+static bool ReadDisconnectUndo(const CBlockIndex* pindex, CBlockUndo& blockUndo, std::vector<std::pair<std::string, CBlockTokenUndo> >& vTokenUndo)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull())
+        return error("DisconnectBlock(): no undo data available");
+    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetIndexHash()))
+        return error("DisconnectBlock(): failure reading undo data");
+    if (!blockUndo.vtokenundo.empty()) {
+        vTokenUndo.swap(blockUndo.vtokenundo);
+        return true;
+    }
+    // Blocks connected before the token undo data moved into the undo record have it in the tokens database
+    if (!ptokensdb->ReadBlockUndoTokenData(pindex->GetIndexHash(), vTokenUndo))
+        return error("DisconnectBlock(): block token undo data inconsistent");
+    return true;
+}
+
+/** Read the blocks from the tip down to pindexFork, but at most MAX_DISCONNECT_READ_AHEAD, with their undo data side by side */
+static void ReadDisconnectBlocks(const CBlockIndex* pindexFork, const Consensus::Params& consensusParams, std::vector<CDisconnectBlockData>& vBlocks)
+{
+    AssertLockHeld(cs_main);
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex != pindexFork && (int)vBlocks.size() < MAX_DISCONNECT_READ_AHEAD; pindex = pindex->pprev) {
+        vBlocks.emplace_back();
+        vBlocks.back().pindex = pindex;
+    }
+
+    RunInParallel(vBlocks.size(), MAX_DISCONNECT_READERS, [&vBlocks, &consensusParams](size_t k) {
+        CDisconnectBlockData& data = vBlocks[k];
+        data.fRead = ReadBlockFromDisk(*data.pblock, data.pindex, consensusParams) && ReadDisconnectUndo(data.pindex, data.blockUndo, data.vTokenUndo);
+    });
+}
+
+enum DisconnectResult
+{
+    DISCONNECT_OK,      // All good.
+    DISCONNECT_UNCLEAN, // Rolled back, but UTXO set was inconsistent with block.
+    DISCONNECT_FAILED   // Something else went wrong.
+};
+
+/**
+ * Restore the UTXO in a Coin at a given COutPoint
+ * @param undo The Coin to be restored.
+ * @param view The coins view to which to apply the changes.
+ * @param out The out point that corresponds to the tx input.
+ * @return A DisconnectResult as an int
+ */
+int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out, CTokensCache* tokenCache = nullptr)
+{
+    bool fClean = true;
+
+    /** TOKENS START */
+    // This is needed because undo, is going to be cleared and moved when AddCoin is called. We need this for undo tokens
+    Coin tempCoin;
+    bool fIsToken = false;
+    if (undo.IsToken()) {
+        fIsToken = true;
+        tempCoin = undo;
+    }
+    /** TOKENS END */
+
+    if (view.HaveCoin(out)) fClean = false; // overwriting transaction output
+
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height and coinbase). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (!alternate.IsSpent()) {
+            undo.nHeight = alternate.nHeight;
+            undo.fCoinBase = alternate.fCoinBase;
+            undo.fCoinStake = alternate.fCoinStake;
+            undo.nTime = alternate.nTime;
+        } else {
+            return DISCONNECT_FAILED; // adding output for transaction without known metadata
+        }
+    }
+    // The potential_overwrite parameter to AddCoin is only allowed to be false if we know for
+    // sure that the coin did not already exist in the cache. As we have queried for that above
+    // using HaveCoin, we don't need to guess. When fClean is false, a coin already existed and
+    // it is an overwrite.
+    view.AddCoin(out, std::move(undo), !fClean);
+
+    /** TOKENS START */
+    if (AreTokensDeployed()) {
+        if (tokenCache && fIsToken) {
+            if (!tokenCache->UndoTokenCoin(tempCoin, out))
+                fClean = false;
+        }
+    }
+    /** TOKENS END */
+
+    return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
+}
+
+/** Undo the effects of this block (with given index) on the UTXO set represented by coins.
+ *  When FAILED is returned, view is left in an indeterminate state. */
+/** Undo the changes block made to view and the caches, with the undo data in pdata if it was read already */
+static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CTokensCache* tokensCache = nullptr, CGovernanceCache* governanceCache = nullptr, bool ignoreAddressIndex = false, bool databaseMessaging = true, CDisconnectBlockData* pdata = nullptr)
+{
+    bool fClean = true;
+
+    CBlockUndo blockUndoRead;
+    std::vector<std::pair<std::string, CBlockTokenUndo> > vUndoDataRead;
+    if (!pdata && !ReadDisconnectUndo(pindex, blockUndoRead, vUndoDataRead))
+        return DISCONNECT_FAILED;
+    CBlockUndo& blockUndo = pdata ? pdata->blockUndo : blockUndoRead;
+    std::vector<std::pair<std::string, CBlockTokenUndo> >& vUndoData = pdata ? pdata->vTokenUndo : vUndoDataRead;
+
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+        error("DisconnectBlock(): block and undo data inconsistent");
+        return DISCONNECT_FAILED;
+    }
+    
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    CTxDestination destination = DecodeDestination(GetParams().GovernanceMasterAddress());
+    CScript masterKey = GetScriptForDestination(destination);
+
+    // undo transactions in reverse order
+    // The spend side effects recorded in tempCache are discarded, so an empty overlay is enough
+    CTokensCache tempCache;
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = *(block.vtx[i]);
+        uint256 hash = tx.GetHash();
+        bool is_coinbase = tx.IsCoinBase();
+
+        std::vector<int> vTokenTxIndex;
+        std::vector<int> vNullTokenTxIndex;
+        if (fAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut &out = tx.vout[k];
+
+                if (out.scriptPubKey.IsPayToScriptHash()) {
+                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
+
+                    // undo receiving activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
+
+                    // undo unspent index
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), hash, k), CAddressUnspentValue()));
+
+                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
+
+                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
 
                     // undo receiving activity
                     addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
@@ -1962,7 +2981,8 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
                 /** TOKENS START */
                 if (AreTokensDeployed()) {
                     if (tokensCache) {
-                        if (IsScriptTransferToken(tx.vout[o].scriptPubKey))
+                        const CTxTokenOutput* tokenOutput = tx.GetTokenOutput(o);
+                        if (tokenOutput && tokenOutput->nType == TX_TRANSFER_TOKEN)
                             vTokenTxIndex.emplace_back(o);
                     }
                 }
@@ -2120,7 +3140,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
                 for (auto index : vTokenTxIndex) {
                     CTokenTransfer transfer;
                     std::string strAddress;
-                    if (!TransferTokenFromScript(tx.vout[index].scriptPubKey, transfer, strAddress)) {
+                    if (!TransferTokenFromTx(tx, index, transfer, strAddress)) {
                         error("%s : Failed to get transfer token from transaction. CTxOut : %s", __func__,
                               tx.vout[index].ToString());
                         return DISCONNECT_FAILED;
@@ -2305,8 +3325,8 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
             }
 
             // Master key signature found
-            if (fCheckGovernance) {
-                for (auto out : tx.vout) {
+            if (fCheckGovernance && governanceCache) {
+                for (const CTxOut& out : tx.vout) {
                     // Check if output is OP_RETURN
                     if (out.scriptPubKey[0] == OP_RETURN and out.scriptPubKey.size() >= 5) {
                         if (out.scriptPubKey[2] == GOVERNANCE_MARKER && out.scriptPubKey[3] == GOVERNANCE_ACTION)
@@ -2322,7 +3342,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
 
                                     // Failsafe
                                     if (freezeScript != masterKey)
-                                        governance->RevertFreezeScript(freezeScript);
+                                        governanceCache->RevertFreezeScript(freezeScript);
                                 }
                             }
 
@@ -2336,7 +3356,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
 
                                     // Failsafe
                                     if (freezeScript != masterKey)
-                                        governance->RevertUnfreezeScript(freezeScript);
+                                        governanceCache->RevertUnfreezeScript(freezeScript);
                                 }
                             }
 
@@ -2355,7 +3375,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
                                     try {
                                         ssAmount >> costAmount;
 
-                                        governance->RevertUpdateCost(type, pindex->nHeight);
+                                        governanceCache->RevertUpdateCost(type, pindex->nHeight);
                                     } catch(std::exception& e) {
                                         std::cout << "Failed to get amount from the stream: " << e.what() << std::endl;
                                     }
@@ -2373,7 +3393,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
 
                                     // Failsafe
                                     if (feeScript != masterKey)
-                                        governance->RevertUpdateFeeScript(pindex->nHeight);
+                                        governanceCache->RevertUpdateFeeScript(pindex->nHeight);
                                 }
                             }
 
@@ -2388,7 +3408,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
 
                                     // Failsafe
                                     if (authorizeScript != masterKey)
-                                        governance->RevertAuthorizeScript(authorizeScript);
+                                        governanceCache->RevertAuthorizeScript(authorizeScript);
                                 }
                             }
 
@@ -2402,7 +3422,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
 
                                     // Failsafe
                                     if (authorizeScript != masterKey)
-                                        governance->RevertUnauthorizeScript(authorizeScript);
+                                        governanceCache->RevertUnauthorizeScript(authorizeScript);
                                 }
                             }
                         }
@@ -2415,16 +3435,22 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
     }
 
 
+    // The governance actions of the block leave the event log with it
+    if (governanceCache && !governanceCache->RevertEvents(pindex->nHeight)) {
+        error("DisconnectBlock(): failed to revert the governance events at height %d", pindex->nHeight);
+        return DISCONNECT_FAILED;
+    }
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetIndexHash());
 
     if (!ignoreAddressIndex && fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            error("Failed to delete address index");
-            return DISCONNECT_FAILED;
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            error("Failed to write address unspent index");
+        CIndexWriteJob job;
+        job.fConnect = false;
+        job.addressIndex = std::move(addressIndex);
+        job.addressUnspentIndex = std::move(addressUnspentIndex);
+        if (!QueueIndexWrite(std::move(job))) {
+            error("Failed to write address index");
             return DISCONNECT_FAILED;
         }
     }
@@ -2440,8 +3466,11 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        // A mapping of the preallocated file would reach past the end of the truncated one
+        if (fFinalize) {
+            g_blockfilemap.Invalidate(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2551,20 +3580,75 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
 
 
 
-static int64_t nTimeCheck = 0;
-static int64_t nTimeForks = 0;
-static int64_t nTimeVerify = 0;
-static int64_t nTimeConnect = 0;
-static int64_t nTimeIndex = 0;
-static int64_t nTimeCallbacks = 0;
-static int64_t nTimeTotal = 0;
-static int64_t nBlocksTotal = 0;
+static int64_t nTimeCheck = 0;
+static int64_t nTimeForks = 0;
+static int64_t nTimeVerify = 0;
+static int64_t nTimeConnect = 0;
+static int64_t nTimeIndex = 0;
+static int64_t nTimeCallbacks = 0;
+static int64_t nTimeTotal = 0;
+static int64_t nBlocksTotal = 0;
+
+/**
+ * The buffers ConnectBlock needs for each transaction. They are emptied for every
+ * transaction but keep their memory from one block to the next, so connecting a block
+ * mostly reuses what the blocks before it allocated instead of allocating and freeing
+ * it again per transaction.
+ */
+struct CConnectBlockBuffers
+{
+    //! Beyond this many elements a buffer gives its memory back at the next block
+    static const size_t MAX_KEPT_CAPACITY = 1024;
+
+    std::vector<CTxOut> vPrevouts;
+    std::vector<CScriptCheck> vChecks;
+    std::vector<CScriptCheck> vTokenChecks;
+    std::vector<std::pair<std::string, uint256>> vReissueTokens;
+
+    //! How often the current block made a buffer ready without allocating, and how often it had to allocate
+    unsigned int nReused = 0;
+    unsigned int nAllocated = 0;
+
+    template <typename T>
+    void Prepare(std::vector<T>& v, size_t n)
+    {
+        v.clear();
+        if (n <= v.capacity()) {
+            nReused++;
+        } else {
+            nAllocated++;
+            v.reserve(n);
+        }
+    }
+
+    template <typename T>
+    static void Trim(std::vector<T>& v)
+    {
+        if (v.capacity() > MAX_KEPT_CAPACITY)
+            std::vector<T>().swap(v);
+        else
+            v.clear();
+    }
+
+    /** Start a block. Buffers an unusually large transaction made grow give their memory back. */
+    void Reset()
+    {
+        Trim(vPrevouts);
+        Trim(vChecks);
+        Trim(vTokenChecks);
+        Trim(vReissueTokens);
+        nReused = 0;
+        nAllocated = 0;
+    }
+};
+
+static CConnectBlockBuffers connectBlockBuffers GUARDED_BY(cs_main);
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, CTokensCache* tokensCache = nullptr, bool fJustCheck = false, bool ignoreAddressIndex = false)
+                  CCoinsViewCache& view, const CChainParams& chainparams, CTokensCache* tokensCache = nullptr, CGovernanceCache* governanceCache = nullptr, bool fJustCheck = false, bool ignoreAddressIndex = false)
 {
     const uint256& hash = block.GetIndexHash();
 
@@ -2573,6 +3657,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     // pindex->phashBlock can be null if called by CreateNewBlock/TestBlockValidity
     assert((pindex->phashBlock == nullptr) ||
            (*pindex->phashBlock == block.GetIndexHash()));
+    TRACE_SPAN("ConnectBlock");
     int64_t nTimeStart = GetTimeMicros();
 
     // We recheck the hardened checkpoints here since ContextualCheckBlock(Header) is not called in ConnectBlock.
@@ -2630,18 +3715,18 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 error("%s: tried to stake at depth %d", __func__, pindex->nHeight - coin.nHeight),
                         REJECT_INVALID, "bad-cs-premature");
 
-        CTransactionRef txPrev;
-        uint256 hashPrevBlock = block.GetIndexHash();
-
-        if (!GetTransaction(prevout.hash, txPrev, GetParams().GetConsensus(), hashPrevBlock)) {
-            return state.DoS(100, error("%s: read txPrev failed", __func__),
-                        REJECT_INVALID, "read-txprev-failed");
+        // The coin carries the time of the transaction that created it, which is all the kernel needs of it.
+        // A block checked before, when it was relayed or as a reorg back to it does, met the target then and the kernel hasn't changed
+        uint256 hashProofOfStake;
+        if (fJustCheck || !GetCachedStakeProof(pindex, hashProofOfStake)) {
+            if (!CheckStakeKernelHash(pindex->pprev, block.nBits, coin.out.nValue, prevout, block.vtx[1]->nTime, coin.nTime, &hashProofOfStake))
+                return state.DoS(100, error("%s: proof-of-stake hash doesn't match nBits", __func__),
+                            REJECT_INVALID, "bad-cs-proofhash");
+            // The index of a block only checked is a temporary
+            if (!fJustCheck)
+                CacheStakeProof(pindex, hashProofOfStake);
         }
 
-        if (!CheckStakeKernelHash(pindex->pprev, block.nBits, coin.out.nValue, prevout, block.vtx[1]->nTime, txPrev->nTime))
-            return state.DoS(100, error("%s: proof-of-stake hash doesn't match nBits", __func__),
-                        REJECT_INVALID, "bad-cs-proofhash");
-
         if (coin.out.scriptPubKey.IsOfflineStaking()) {
             nRewardOffline = -coin.out.nValue;
             fCheckOffline = true;
@@ -2694,10 +3779,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
     CBlockUndo blockundo;
-    std::vector<std::pair<std::string, CBlockTokenUndo> > vUndoTokenData;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
+    CSignatureCacheStats sigCacheBefore;
+    GetSignatureCacheStats(sigCacheBefore);
+    const CSignatureCacheStats scriptExecutionCacheBefore = scriptExecutionCacheStats;
+
     std::vector<int> prevheights;
     CAmount nFees = 0;
     CAmount nActualStakeReward = 0;
@@ -2709,20 +3797,32 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    unsigned int nTxDataReused = 0;
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    CIndexWriteJob indexJob;
 
     CTxDestination destination = DecodeDestination(GetParams().GovernanceMasterAddress());
     CScript masterKey = GetScriptForDestination(destination);
 
     std::set<CMessage> setMessages;
     std::vector<std::pair<std::string, CNullTokenTxData>> myNullTokenData;
+
+    CConnectBlockBuffers& buffers = connectBlockBuffers;
+    buffers.Reset();
+
+    // Resolve the token, restriction and qualifier lookups of the block's transactions in one pass over the databases
+    if (tokensCache && AreTokensDeployed()) {
+        TRACE_SPAN("ConnectBlock.TokenPrefetch");
+        CBlockTokenLookups lookups;
+        GetBlockTokenLookups(tokensCache, view, block.vtx, lookups);
+        tokensCache->PrefetchBlockTokens(lookups);
+    }
+
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
-        const uint256 txhash = tx.GetHash();
+        std::vector<CTxOut>& vPrevouts = buffers.vPrevouts;
+        vPrevouts.clear();
 
         // Check TX version here
         if (pindex->nHeight < chainparams.GetConsensus().nTxMessages && tx.nVersion > 1)
@@ -2739,16 +3839,34 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
             /** TOKENS START */
             if (!AreTokensDeployed()) {
-                for (auto out : tx.vout)
-                    if (out.scriptPubKey.IsTokenScript())
+                for (unsigned int n = 0; n < tx.vout.size(); n++)
+                    if (tx.GetTokenOutput(n))
                         return state.DoS(100, error("%s : Received Block with tx that contained an token when tokens wasn't active", __func__), REJECT_INVALID, "bad-txns-tokens-not-active");
-                    else if (out.scriptPubKey.IsNullToken())
+                    else if (tx.vout[n].scriptPubKey.IsNullToken())
                         return state.DoS(100, error("%s : Received Block with tx that contained an null token data tx when tokens wasn't active", __func__), REJECT_INVALID, "bad-txns-null-data-tokens-not-active");
             }
 
             if (AreTokensDeployed()) {
-                std::vector<std::pair<std::string, uint256>> vReissueTokens;
-                if (!Consensus::CheckTxTokens(tx, state, view, pindex->nHeight, pindex->nTime, tokensCache, false, vReissueTokens, false, &setMessages, block.nTime, &myNullTokenData)) {
+                // The amount checks don't depend on the token cache. They are skipped for the transactions the
+                // mempool already checked, the others go to the script check threads while the contextual checks
+                // below stay in block order
+                bool fAmountsChecked = tokenAmountsCache.contains(GetTokenAmountsCacheEntry(tx), !fJustCheck);
+                if (!fAmountsChecked && fScriptChecks && nScriptCheckThreads) {
+                    std::vector<CTxOut> vSpentTokens;
+                    GetSpentTokens(tx, view, vSpentTokens);
+
+                    if (!vSpentTokens.empty() || tx.HasTokenOutputs()) {
+                        std::vector<CScriptCheck>& vTokenChecks = buffers.vTokenChecks;
+                        buffers.Prepare(vTokenChecks, 1);
+                        vTokenChecks.emplace_back(tx, std::move(vSpentTokens), pindex->nHeight, pindex->nTime);
+                        control.Add(vTokenChecks);
+                    }
+                    fAmountsChecked = true;
+                }
+
+                std::vector<std::pair<std::string, uint256>>& vReissueTokens = buffers.vReissueTokens;
+                vReissueTokens.clear();
+                if (!Consensus::CheckTxTokens(tx, state, view, pindex->nHeight, pindex->nTime, tokensCache, false, vReissueTokens, false, &setMessages, block.nTime, &myNullTokenData, fAmountsChecked)) {
                     state.SetFailedTransaction(tx.GetHash());
                     return error("%s: Consensus::CheckTxTokens: %s, %s", __func__, tx.GetHash().ToString(),
                                  FormatStateMessage(state));
@@ -2759,81 +3877,10 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
             nFees += txfee;
 
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.AccessCoin(tx.vin[j].prevout).out;
-                    uint160 hashBytes;
-                    int addressType;
-                    bool isToken = false;
-                    std::string tokenName;
-                    CAmount tokenAmount;
-                    int nScriptType = 0;
-                    int timeLock = 0;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-                        timeLock = prevout.GetLockTime();
-                        int offset = prevout.scriptPubKey.size() - 25;
-                        hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin() + (3 + offset), prevout.scriptPubKey.begin() + (23 + offset)));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-                        hashBytes = Hash160(prevout.scriptPubKey.begin() + 1, prevout.scriptPubKey.end() - 1);
-                        addressType = 1;
-                    } else {
-                        /** TOKENS START */
-                        if (AreTokensDeployed()) {
-                            hashBytes.SetNull();
-                            addressType = 0;
-                            uint32_t nTimeLock;
-
-                            if (ParseTokenScript(prevout.scriptPubKey, hashBytes, nScriptType, tokenName, tokenAmount, nTimeLock)) {
-                                if (nScriptType == TX_PUBKEYHASH) {
-                                    addressType = 1;
-                                } else if (nScriptType == TX_SCRIPTHASH) {
-                                    addressType = 2;
-                                }
-
-                                isToken = true;
-                                timeLock = nTimeLock;
-                            }
-                        }
-                        /** TOKENS END */
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        /** TOKENS START */
-                        if (isToken) {
-                            // record spending activity
-                            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, tokenName, pindex->nHeight, i, txhash, j, true, timeLock), tokenAmount * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, tokenName, input.prevout.hash, input.prevout.n, timeLock), CAddressUnspentValue()));
-                        /** TOKENS END */
-                        } else {
-                            // record spending activity
-                            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true, timeLock), prevout.nValue * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n, timeLock), CAddressUnspentValue()));
-                        }
-                    }
-                    /** TOKENS END */
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
-
+            if (fAddressIndex || fSpentIndex) {
+                buffers.Prepare(vPrevouts, tx.vin.size());
+                for (const CTxIn& txin : tx.vin)
+                    vPrevouts.push_back(view.AccessCoin(txin.prevout).out);
             }
         }
 
@@ -2850,10 +3897,20 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             nActualStakeReward = tx.GetValueOut() - view.GetValueIn(tx);
         }
 
-        txdata.emplace_back(tx);
+        // The midstates only hash what the txid commits to, so the mempool's are good for
+        // the transaction in the block even if its witness differs
+        std::shared_ptr<const PrecomputedTransactionData> txdataPool = tx.HasWitness() ? mempool.GetTxData(tx.GetHash()) : nullptr;
+        if (txdataPool) {
+            txdata.emplace_back(*txdataPool);
+            nTxDataReused++;
+        } else {
+            txdata.emplace_back(tx);
+        }
         if (!tx.IsCoinBase())
         {
-            std::vector<CScriptCheck> vChecks;
+            std::vector<CScriptCheck>& vChecks = buffers.vChecks;
+            if (nScriptCheckThreads)
+                buffers.Prepare(vChecks, tx.vin.size());
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
@@ -2861,86 +3918,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             control.Add(vChecks);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight, tx.nTime)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight, tx.nTime)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-                    int offset = out.scriptPubKey.size() - 25;
-                    int timeLock = out.GetLockTime();
-
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + (3 + offset), out.scriptPubKey.begin() + (23 + offset));
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, txhash, k, false, timeLock), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k, timeLock), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight, tx.nTime)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKey()) {
-                    uint160 hashBytes(Hash160(out.scriptPubKey.begin() + 1, out.scriptPubKey.end() - 1));
-                    addressIndex.push_back(
-                            std::make_pair(CAddressIndexKey(1, hashBytes, pindex->nHeight, i, txhash, k, false),
-                                           out.nValue));
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, hashBytes, txhash, k),
-                                                                 CAddressUnspentValue(out.nValue, out.scriptPubKey,
-                                                                                      pindex->nHeight, tx.nTime)));
-                } else {
-                    /** TOKENS START */
-                    if (AreTokensDeployed()) {
-                        std::string tokenName;
-                        CAmount tokenAmount;
-                        uint160 hashBytes;
-                        int nScriptType;
-                        int addressType = 0;
-                        uint32_t nTimeLock;
-
-                        if (ParseTokenScript(out.scriptPubKey, hashBytes, nScriptType, tokenName, tokenAmount, nTimeLock)) {
-                            if (nScriptType == TX_PUBKEYHASH) {
-                                addressType = 1;
-                            } else if (nScriptType == TX_SCRIPTHASH) {
-                                addressType = 2;
-                            }
-
-                            // record receiving activity
-                            addressIndex.push_back(std::make_pair(
-                                    CAddressIndexKey(addressType, hashBytes, tokenName, pindex->nHeight, i, txhash, k, false, nTimeLock),
-                                    tokenAmount));
-
-                            // record unspent output
-                            addressUnspentIndex.push_back(
-                                    std::make_pair(CAddressUnspentKey(addressType, hashBytes, tokenName, txhash, k, nTimeLock),
-                                                   CAddressUnspentValue(tokenAmount, out.scriptPubKey,
-                                                                        pindex->nHeight, tx.nTime)));
-                        }
-                    } else {
-                        continue;
-                    }
-                    /** TOKENS END */
-                }
-            }
+        if (fAddressIndex || fSpentIndex) {
+            TRACE_SPAN("ConnectBlock.AddressIndex");
+            GetTxIndexEntries(tx, i, pindex->nHeight, vPrevouts, fAddressIndex, fSpentIndex, indexJob);
         }
-
         // Check governance
         if (!tx.IsCoinBase() && !tx.IsCoinStake()) {
+            TRACE_SPAN("ConnectBlock.Governance");
             bool fCheckGovernance = false;
 
             // Make sure we have master key signature
@@ -2955,8 +3939,8 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             }
 
             // Master key signature found
-            if (fCheckGovernance) {
-                for (auto out : tx.vout) {
+            if (fCheckGovernance && governanceCache) {
+                for (const CTxOut& out : tx.vout) {
                     // Check if output is OP_RETURN
                     if (out.scriptPubKey[0] == OP_RETURN and out.scriptPubKey.size() >= 5) {
                         if (out.scriptPubKey[2] == GOVERNANCE_MARKER && out.scriptPubKey[3] == GOVERNANCE_ACTION)
@@ -2972,7 +3956,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
                                     // Failsafe
                                     if (freezeScript != masterKey)
-                                        governance->FreezeScript(freezeScript);
+                                        governanceCache->FreezeScript(freezeScript, pindex->nHeight);
                                 }
                             }
 
@@ -2986,7 +3970,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
                                     // Failsafe
                                     if (freezeScript != masterKey)
-                                        governance->UnfreezeScript(freezeScript);
+                                        governanceCache->UnfreezeScript(freezeScript, pindex->nHeight);
                                 }
                             }
 
@@ -3005,7 +3989,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                                     try {
                                         ssAmount >> costAmount;
 
-                                        governance->UpdateCost(costAmount, type, pindex->nHeight);
+                                        governanceCache->UpdateCost(costAmount, type, pindex->nHeight);
                                     } catch(std::exception& e) {
                                         std::cout << "Failed to get amount from the stream: " << e.what() << std::endl;
                                     }
@@ -3023,7 +4007,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
                                     // Failsafe
                                     if (feeScript != masterKey)
-                                        governance->UpdateFeeScript(feeScript, pindex->nHeight);
+                                        governanceCache->UpdateFeeScript(feeScript, pindex->nHeight);
                                 }
                             }
 
@@ -3038,7 +4022,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
                                     // Failsafe
                                     if (authorizeScript != masterKey)
-                                        governance->AuthorizeScript(authorizeScript);
+                                        governanceCache->AuthorizeScript(authorizeScript, pindex->nHeight);
                                 }
                             }
 
@@ -3052,7 +4036,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
                                     // Failsafe
                                     if (authorizeScript != masterKey)
-                                        governance->UnauthorizeScript(authorizeScript);
+                                        governanceCache->UnauthorizeScript(authorizeScript, pindex->nHeight);
                                 }
                             }
                         }
@@ -3071,11 +4055,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         std::pair<std::string, CBlockTokenUndo>* undoTokenData = &undoPair;
         /** TOKENS END */
 
+        CTraceSpan updateCoinsSpan("ConnectBlock.UpdateCoins");
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, block.GetIndexHash(), tokensCache, undoTokenData);
+        updateCoinsSpan.End();
 
         /** TOKENS START */
         if (!undoTokenData->first.empty()) {
-            vUndoTokenData.emplace_back(*undoTokenData);
+            blockundo.vtokenundo.emplace_back(*undoTokenData);
         }
         /** TOKENS END */
 
@@ -3084,6 +4070,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
+    if (nTxDataReused > 0)
+        LogPrint(BCLog::BENCH, "      - Sighash data reused from the mempool for %u transactions\n", nTxDataReused);
+    LogPrint(BCLog::BENCH, "      - Transaction buffers: reused %u times, allocated %u times\n", buffers.nReused, buffers.nAllocated);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
     
@@ -3123,8 +4112,14 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         }
     }
 
+    CTraceSpan scriptWaitSpan("ConnectBlock.ScriptWait");
+    if (!control.Wait())
+        return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    scriptWaitSpan.End();
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
+    if (fScriptChecks)
+        UpdateScriptCaches(sigCacheBefore, scriptExecutionCacheBefore);
 
     if (fJustCheck)
         return true;
@@ -3132,11 +4127,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
     {
+        TRACE_SPAN("ConnectBlock.WriteUndo");
         if (pindex->GetUndoPos().IsNull()) {
             CDiskBlockPos _pos;
-            if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+            std::vector<unsigned char> vUndoRecord;
+            uint32_t nUndoSizeWord;
+            SerializeRecord(blockundo, vUndoRecord, nUndoSizeWord);
+            if (!FindUndoPos(state, pindex->nFile, _pos, vUndoRecord.size() + 40))
                 return error("ConnectBlock(): FindUndoPos failed");
-            if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetIndexHash(), chainparams.MessageStart()))
+            if (!UndoWriteToDisk(blockundo, vUndoRecord, nUndoSizeWord, _pos, pindex->pprev->GetIndexHash(), chainparams.MessageStart()))
                 return AbortNode(state, "Failed to write undo data");
 
             // update nUndoPos in block index
@@ -3144,11 +4143,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             pindex->nStatus |= BLOCK_HAVE_UNDO;
         }
 
-        if (vUndoTokenData.size()) {
-            if (!ptokensdb->WriteBlockUndoTokenData(block.GetIndexHash(), vUndoTokenData))
-                return AbortNode(state, "Failed to write token undo data");
-        }
-
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
     }
@@ -3157,42 +4151,22 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
-    if (!ignoreAddressIndex && fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (!ignoreAddressIndex && fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
-    if (!ignoreAddressIndex && fTimestampIndex) {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetIndexHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
+    // The index writer writes the address, spent and timestamp indexes in the background, in block order
+    if (!ignoreAddressIndex && (fAddressIndex || fSpentIndex || fTimestampIndex)) {
+        TRACE_SPAN("ConnectBlock.QueueIndexWrite");
+        if (fTimestampIndex) {
+            indexJob.fTimestamp = true;
+            indexJob.hashBlock = pindex->GetIndexHash();
+            if (pindex->pprev)
+                indexJob.hashPrevBlock = pindex->pprev->GetIndexHash();
+            indexJob.nTime = pindex->nTime;
         }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetIndexHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetIndexHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+        if (!QueueIndexWrite(std::move(indexJob)))
+            return state.Error("Failed to write address, spent or timestamp index");
     }
 
     if (AreMessagesDeployed() && fMessaging && setMessages.size()) {
+        TRACE_SPAN("ConnectBlock.Messages");
         LOCK(cs_messaging);
         for (auto message : setMessages) {
             int nHeight = 0;
@@ -3210,18 +4184,23 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 #ifdef ENABLE_WALLET
     if (AreRestrictedTokensDeployed() && myNullTokenData.size() && pmyrestricteddb) {
-        for (auto item : myNullTokenData) {
+        TRACE_SPAN("ConnectBlock.MyRestricted");
+        // Written in one batch for the block, the wallet is told about them afterwards
+        std::vector<std::tuple<std::string, std::string, bool, uint32_t> > vecTaggedAddresses, vecRestrictedAddresses;
+        for (const auto& item : myNullTokenData) {
             if (IsTokenNameAQualifier(item.second.token_name)) {
                 // TODO we can add block height to this data also, and use it to pull more info on when this was tagged/untagged
-                pmyrestricteddb->WriteTaggedAddress(item.first, item.second.token_name, item.second.flag ? true : false, block.nTime);
+                vecTaggedAddresses.emplace_back(item.first, item.second.token_name, item.second.flag ? true : false, block.nTime);
             } else if (IsTokenNameAnRestricted(item.second.token_name)) {
-                pmyrestricteddb->WriteRestrictedAddress(item.first, item.second.token_name, item.second.flag ? true : false, block.nTime);
+                vecRestrictedAddresses.emplace_back(item.first, item.second.token_name, item.second.flag ? true : false, block.nTime);
             }
+        }
+        if (!pmyrestricteddb->WriteAddressEntries(vecTaggedAddresses, vecRestrictedAddresses))
+            LogPrintf("%s: Failed to write my restricted address entries\n", __func__);
 
-
-            if (vpwallets.size())
+        if (vpwallets.size()) {
+            for (auto item : myNullTokenData)
                 vpwallets[0]->UpdateMyRestrictedTokens(item.first, item.second.token_name, item.second.flag, block.nTime);
-
         }
     }
 #endif
@@ -3286,7 +4265,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastSetChain = nNow;
         }
 
-        // Get the size of the memory used by the token cache.
+        // Get the size of the memory used by the token cache, the dirty entries are part of the dynamic size.
         int64_t tokenDynamicSize = 0;
         int64_t tokenDirtyCacheSize = 0;
         size_t tokenMapAmountSize = 0;
@@ -3294,7 +4273,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             auto currentActiveTokenCache = GetCurrentTokenCache();
             if (currentActiveTokenCache) {
                 tokenDynamicSize = currentActiveTokenCache->DynamicMemoryUsage();
-                tokenDirtyCacheSize = currentActiveTokenCache->GetCacheSizeV2();
+                tokenDirtyCacheSize = currentActiveTokenCache->GetCacheSize();
                 tokenMapAmountSize = currentActiveTokenCache->mapTokensAddressAmount.size();
             }
         }
@@ -3306,7 +4285,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         }
 
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + tokenDynamicSize + tokenDirtyCacheSize + messageCacheSize;
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + tokenDynamicSize + messageCacheSize;
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -3317,6 +4296,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
 
+        metricTokenCacheBytes.Set(tokenDynamicSize);
+        metricTokenCacheDirtyBytes.Set(tokenDirtyCacheSize);
+
         // Combine all conditions that result in a full cache flush.
         fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
 
@@ -3334,6 +4316,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             FlushBlockFile();
             // Then update all block file information (which may refer to block and undo files).
             {
+                TRACE_SPAN("FlushStateToDisk.BlockIndex");
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
                 vFiles.reserve(setDirtyFileInfo.size());
                 for (std::set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); ) {
@@ -3350,13 +4333,16 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files, and the token data of their blocks
+            if (fFlushForPrune) {
                 UnlinkPrunedFiles(setFilesToPrune);
+                PruneTokenData(chainActive.Height() - (int)MIN_BLOCKS_TO_KEEP);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
         if (fDoFullFlush && !pcoinsTip->GetBestBlock().IsNull()) {
+            TRACE_SPAN("FlushStateToDisk.Chainstate");
             // Typical Coin structures on disk are around 48 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
@@ -3364,10 +4350,35 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace((48 * 2 * 2 * pcoinsTip->GetCacheSize()) + tokenDirtyCacheSize * 2)) /** TOKENS START */ /** TOKENS END */
                 return state.Error("out of disk space");
-
-            // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            const int64_t nFlushStart = GetTimeMicros();
+
+            // The chainstate on disk must not run ahead of the indexes, the blocks it doesn't reach are reconnected
+            // and write their index entries again
+            if (!SyncIndexWriter())
+                return AbortNode(state, "Failed to write address, spent or timestamp index");
+
+            // Flush the governance changes of the blocks connected since the last flush. They go first so that a crash
+            // in between leaves governance ahead of the chainstate, which reconnecting the blocks tolerates, as the old
+            // write per operation did
+            if (governance && !governance->Flush())
+                return AbortNode(state, "Failed to write to governance database");
+            if (pdbenv && !pdbenv->Sync())
+                return AbortNode(state, "Failed to sync the governance database");
+
+            // Flush the chainstate (which may refer to block index entries). Outside of shutdown and other callers
+            // that need it on disk, the coins are handed to the chainstate writer instead, which serves them to
+            // reads until they are written, and block processing goes on.
+            if (mode != FLUSH_STATE_ALWAYS && pcoinsdbview && gArgs.GetBoolArg("-dbbackgroundflush", DEFAULT_DB_BACKGROUND_FLUSH)) {
+                if (!pcoinsdbview->BatchWriteBackground(pcoinsTip->DetachCache()))
+                    return AbortNode(state, "Failed to write to coin database");
+            } else if (!pcoinsTip->Flush()) {
                 return AbortNode(state, "Failed to write to coin database");
+            }
+
+            // The statistics of the chainstate just handed over, whether or not it reached the disk yet: after a crash
+            // ReplayBlocks brings the chainstate to their block, or they don't match it and are computed again
+            if (fUTXOSetStats && pcoinsdbview && !pcoinsdbview->WriteUTXOSetStats(utxoSetStats))
+                return AbortNode(state, "Failed to write the UTXO set statistics");
 
             /** TOKENS START */
             // Flush the tokenstate
@@ -3385,21 +4396,24 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                 ptokensdb->WriteReissuedMempoolState();
 
             if (fMessaging) {
-                if (pmessagedb) {
-                    LOCK(cs_messaging);
-                    if (!pmessagedb->Flush())
-                        return AbortNode(state, "Failed to Flush the message database");
-                }
-
-                if (pmessagechanneldb) {
-                    LOCK(cs_messaging);
-                    if (!pmessagechanneldb->Flush())
-                        return AbortNode(state, "Failed to Flush the message channel database");
-                }
+                TRACE_SPAN("FlushStateToDisk.Messages");
+                // Each database gets its dirty entries in a single batch
+                LOCK(cs_messaging);
+                if (pmessagedb && !pmessagedb->Flush())
+                    return AbortNode(state, "Failed to Flush the message database");
+
+                if (pmessagechanneldb && !pmessagechanneldb->Flush())
+                    return AbortNode(state, "Failed to Flush the message channel database");
             }
+
+            // One sync pass over the token, restricted, messaging and rewards databases written above
+            if (pdbenv && !pdbenv->Sync())
+                return AbortNode(state, "Failed to sync the token databases");
             /** TOKENS END */
 
             nLastFlush = nNow;
+            metricChainstateFlushes.Inc();
+            metricChainstateFlushSeconds.Observe(GetTimeMicros() - nFlushStart);
         }
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -3424,6 +4438,10 @@ void PruneAndFlush() {
     fCheckForPruning = true;
     const CChainParams& chainparams = GetParams();
     FlushStateToDisk(chainparams, state, FLUSH_STATE_NONE);
+
+    // Token data of blocks pruned before it was pruned along with them
+    LOCK(cs_main);
+    PruneTokenData(chainActive.Height() - (int)MIN_BLOCKS_TO_KEEP);
 }
 
 static void DoWarning(const std::string& strWarning)
@@ -3436,15 +4454,50 @@ static void DoWarning(const std::string& strWarning)
     }
 }
 
+/** Publish the atomic snapshot of the tip that the RPC calls read without cs_main. */
+void PublishChainTipState()
+{
+    AssertLockHeld(cs_main);
+    std::shared_ptr<CChainTipState> state;
+    const CBlockIndex* pindex = chainActive.Tip();
+    if (pindex) {
+        state = std::make_shared<CChainTipState>();
+        state->pindex = pindex;
+        state->hashBlock = pindex->GetIndexHash();
+        state->nHeight = pindex->nHeight;
+        state->nTime = pindex->GetBlockTime();
+        state->nMedianTimePast = pindex->GetMedianTimePast();
+        state->nChainWork = pindex->nChainWork;
+        state->nChainTx = pindex->nChainTx;
+        // Shared with the previous snapshot unless a cost or fee update came in
+        if (governance)
+            state->costTable = governance->GetCostTable();
+    }
+
+    std::atomic_store(&chainTipState, std::shared_ptr<const CChainTipState>(state));
+}
+
+std::shared_ptr<const CChainTipState> GetChainTipState()
+{
+    return std::atomic_load(&chainTipState);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
+    PublishChainTipState();
 
     // New best block
     mempool.AddTransactionsUpdated(1);
 
     cvBlockChange.notify_all();
 
+    metricChainHeight.Set(pindexNew->nHeight);
+    metricChainTipTime.Set(pindexNew->GetBlockTime());
+    metricInitialBlockDownload.Set(IsInitialBlockDownload());
+    metricCoinsCacheBytes.Set(pcoinsTip->DynamicMemoryUsage());
+    metricCoinsCacheEntries.Set(pcoinsTip->GetCacheSize());
+
     std::vector<std::string> warningMessages;
     if (!IsInitialBlockDownload())
     {
@@ -3502,29 +4555,61 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
   * disconnectpool (note that the caller is responsible for mempool consistency
   * in any case).
   */
-bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool)
+/** Apply the changes a block made in view, before they are flushed into pcoinsTip, to the UTXO set statistics */
+static void UpdateUTXOSetStats(const CCoinsViewCache& view, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!fUTXOSetStats)
+        return;
+    TRACE_SPAN("UpdateUTXOSetStats");
+
+    if (utxoSetStats.hashBlock != pcoinsTip->GetBestBlock()) {
+        LogPrintf("%s: the UTXO set statistics of %s don't match the chainstate at %s, no longer keeping them\n", __func__,
+                  utxoSetStats.hashBlock.ToString(), pcoinsTip->GetBestBlock().ToString());
+        fUTXOSetStats = false;
+        return;
+    }
+
+    view.ForEachChange([](const COutPoint& outpoint, const Coin* coinOld, const Coin& coinNew) {
+        if (coinOld)
+            utxoSetStats.RemoveCoin(outpoint, *coinOld);
+        if (!coinNew.IsSpent())
+            utxoSetStats.AddCoin(outpoint, coinNew);
+    });
+    utxoSetStats.hashBlock = pindex->GetIndexHash();
+    utxoSetStats.nHeight = pindex->nHeight;
+}
+
+bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, CDisconnectBlockData* pdata = nullptr)
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (pdata && (pdata->pindex != pindexDelete || !pdata->fRead))
+        pdata = nullptr;
+    // Read block from disk, unless it was read ahead with its undo data
+    std::shared_ptr<CBlock> pblock = pdata ? pdata->pblock : std::make_shared<CBlock>();
     CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
+    if (!pdata && !ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
         return error("DisconnectTip() : Failed to read block");
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
         CTokensCache tokenCache;
+        CGovernanceCache governanceCache(governance);
 
         assert(view.GetBestBlock() == pindexDelete->GetIndexHash());
-        if (DisconnectBlock(block, pindexDelete, view, &tokenCache) != DISCONNECT_OK)
+        if (DisconnectBlock(block, pindexDelete, view, &tokenCache, &governanceCache, false, true, pdata) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetIndexHash().ToString());
+        UpdateUTXOSetStats(view, pindexDelete->pprev);
         bool flushed = view.Flush();
         assert(flushed);
 
         bool tokensFlushed = tokenCache.Flush();
         assert(tokensFlushed);
+
+        bool governanceFlushed = governanceCache.Flush();
+        assert(governanceFlushed);
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -3546,6 +4631,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
+    metricBlocksDisconnected.Inc();
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     GetMainSignals().BlockDisconnected(pblock);
@@ -3625,6 +4711,155 @@ public:
     }
 };
 
+namespace {
+/** Blocks ahead of the tip the block prefetcher reads and checks before ConnectTip gets to them */
+static const int BLOCK_PREFETCH_WINDOW = 16;
+/** Threads reading and checking the blocks ahead of the tip */
+static const int MAX_BLOCK_PREFETCH_THREADS = 4;
+
+/** A block of the chain being connected, read from disk and put through CheckBlock by the prefetcher */
+struct CPrefetchedBlock
+{
+    std::shared_ptr<CBlock> pblock;
+    bool fDone;
+    bool fRead;
+
+    CPrefetchedBlock() : pblock(std::make_shared<CBlock>()), fDone(false), fRead(false) {}
+};
+
+std::mutex csBlockPrefetch;
+std::condition_variable condBlockPrefetch;
+std::deque<const CBlockIndex*> queueBlockPrefetch;
+std::map<const CBlockIndex*, CPrefetchedBlock> mapPrefetchedBlocks;
+std::vector<std::thread> vBlockPrefetchThreads;
+bool fBlockPrefetchStop = false;
+uint64_t nBlocksPrefetched = 0;
+uint64_t nBlocksNotPrefetched = 0;
+int64_t nTimePrefetchWait = 0;
+}
+
+static void ThreadBlockPrefetch()
+{
+    const Consensus::Params& consensusParams = GetParams().GetConsensus();
+    while (true) {
+        const CBlockIndex* pindex;
+        std::shared_ptr<CBlock> pblock;
+        {
+            std::unique_lock<std::mutex> lock(csBlockPrefetch);
+            condBlockPrefetch.wait(lock, [] { return fBlockPrefetchStop || !queueBlockPrefetch.empty(); });
+            if (fBlockPrefetchStop)
+                return;
+            pindex = queueBlockPrefetch.front();
+            queueBlockPrefetch.pop_front();
+            pblock = mapPrefetchedBlocks[pindex].pblock;
+        }
+
+        // The context-free checks CheckBlock caches in fChecked, ConnectBlock repeats any that fail to report them
+        bool fRead = ReadBlockFromDisk(*pblock, pindex, consensusParams);
+        if (fRead) {
+            CValidationState state;
+            CheckBlock(*pblock, state, pindex->GetIndexHash(), consensusParams, true, true);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(csBlockPrefetch);
+            CPrefetchedBlock& entry = mapPrefetchedBlocks[pindex];
+            entry.fDone = true;
+            entry.fRead = fRead;
+        }
+        condBlockPrefetch.notify_all();
+    }
+}
+
+/**
+ * Have the prefetcher read and check the next blocks of vpindexToConnect, which is in descending height order,
+ * except for pindexMostWork when the caller already has it in memory.
+ */
+static void PrefetchBlocks(const std::vector<CBlockIndex*>& vpindexToConnect, const CBlockIndex* pindexMostWork, bool fHaveMostWork)
+{
+    AssertLockHeld(cs_main);
+    std::lock_guard<std::mutex> lock(csBlockPrefetch);
+    if (vBlockPrefetchThreads.empty())
+        return;
+
+    // Forget the blocks that were connected without being taken, or are no longer on the way to the best tip
+    for (auto it = mapPrefetchedBlocks.begin(); it != mapPrefetchedBlocks.end(); ) {
+        const CBlockIndex* pindex = it->first;
+        if (it->second.fDone && (pindex->nHeight <= chainActive.Height() || pindexMostWork->GetAncestor(pindex->nHeight) != pindex))
+            it = mapPrefetchedBlocks.erase(it);
+        else
+            it++;
+    }
+
+    int nQueued = 0;
+    for (auto it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend() && mapPrefetchedBlocks.size() < (size_t)BLOCK_PREFETCH_WINDOW; it++) {
+        if (!((*it)->nStatus & BLOCK_HAVE_DATA) || (fHaveMostWork && *it == pindexMostWork) || mapPrefetchedBlocks.count(*it))
+            continue;
+        mapPrefetchedBlocks.emplace(*it, CPrefetchedBlock());
+        queueBlockPrefetch.push_back(*it);
+        nQueued++;
+    }
+    if (nQueued > 0)
+        condBlockPrefetch.notify_all();
+}
+
+/** The block the prefetcher read for pindex, waiting for it if it is still being read, null if it wasn't asked to */
+static std::shared_ptr<const CBlock> TakePrefetchedBlock(const CBlockIndex* pindex)
+{
+    std::unique_lock<std::mutex> lock(csBlockPrefetch);
+    auto it = mapPrefetchedBlocks.find(pindex);
+    if (it == mapPrefetchedBlocks.end()) {
+        nBlocksNotPrefetched++;
+        return nullptr;
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    condBlockPrefetch.wait(lock, [pindex] { return fBlockPrefetchStop || mapPrefetchedBlocks[pindex].fDone; });
+    nTimePrefetchWait += GetTimeMicros() - nTimeStart;
+
+    it = mapPrefetchedBlocks.find(pindex);
+    std::shared_ptr<const CBlock> pblock;
+    if (it->second.fDone && it->second.fRead)
+        pblock = it->second.pblock;
+    if (it->second.fDone)
+        mapPrefetchedBlocks.erase(it);
+    if (pblock)
+        nBlocksPrefetched++;
+    else
+        nBlocksNotPrefetched++;
+    return pblock;
+}
+
+void StartBlockPrefetch()
+{
+    std::lock_guard<std::mutex> lock(csBlockPrefetch);
+    if (!vBlockPrefetchThreads.empty())
+        return;
+
+    fBlockPrefetchStop = false;
+    const int nThreads = std::max(1, std::min(GetNumCores() - 1, MAX_BLOCK_PREFETCH_THREADS));
+    for (int i = 0; i < nThreads; i++)
+        vBlockPrefetchThreads.emplace_back(&TraceThread<std::function<void()> >, "blockprefetch", std::function<void()>(ThreadBlockPrefetch));
+}
+
+void StopBlockPrefetch()
+{
+    {
+        std::lock_guard<std::mutex> lock(csBlockPrefetch);
+        if (vBlockPrefetchThreads.empty())
+            return;
+        fBlockPrefetchStop = true;
+    }
+    condBlockPrefetch.notify_all();
+    for (std::thread& thread : vBlockPrefetchThreads)
+        thread.join();
+
+    std::lock_guard<std::mutex> lock(csBlockPrefetch);
+    vBlockPrefetchThreads.clear();
+    queueBlockPrefetch.clear();
+    mapPrefetchedBlocks.clear();
+}
+
 /**
  * Connect a new block to chainActive. pblock is either nullptr or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -3634,14 +4869,18 @@ public:
 bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool)
 {
     assert(pindexNew->pprev == chainActive.Tip());
+    TRACE_SPAN("ConnectTip");
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
-            return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
+        pthisBlock = TakePrefetchedBlock(pindexNew);
+        if (!pthisBlock) {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            pthisBlock = pblockNew;
+        }
     } else {
         pthisBlock = pblock;
     }
@@ -3652,6 +4891,11 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime4;
     int64_t nTimeTokensFlush;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    if (LogAcceptCategory(BCLog::BENCH)) {
+        std::lock_guard<std::mutex> lock(csBlockPrefetch);
+        LogPrint(BCLog::BENCH, "    - Prefetched: %u of %u blocks, %u queued, %u held [%.2fs waiting]\n", nBlocksPrefetched, nBlocksPrefetched + nBlocksNotPrefetched,
+                 queueBlockPrefetch.size(), mapPrefetchedBlocks.size(), nTimePrefetchWait * MICRO);
+    }
 
     /** TOKENS START */
     // Initialize sets used from removing token entries from the mempool
@@ -3668,9 +4912,12 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         std::vector<std::pair<std::string, CNullTokenTxData>> myNullTokenData;
         /** TOKENS END */
 
+        // Governance changes are staged the same way and written with the chainstate
+        CGovernanceCache governanceCache(governance);
+
         int64_t nTimeConnectStart = GetTimeMicros();
 
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, &tokenCache);
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, &tokenCache, &governanceCache);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -3701,8 +4948,11 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
 
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        UpdateUTXOSetStats(view, pindexNew);
+        CTraceSpan flushSpan("ConnectTip.FlushCoins");
         bool flushed = view.Flush();
         assert(flushed);
+        flushSpan.End();
         nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
         LogPrint(BCLog::BENCH, "  - Flush PLB: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
 
@@ -3710,6 +4960,9 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         nTimeTokensFlush = GetTimeMicros();
         bool tokenFlushed = tokenCache.Flush();
         assert(tokenFlushed);
+
+        bool governanceFlushed = governanceCache.Flush();
+        assert(governanceFlushed);
         int64_t nTimeTokenFlushFinished = GetTimeMicros(); nTimeTokenFlush += nTimeTokenFlushFinished - nTimeTokensFlush;
         LogPrint(BCLog::BENCH, "  - Flush Tokens: %.2fms [%.2fs (%.2fms/blk)]\n", (nTimeTokenFlushFinished - nTimeTokensFlush) * MILLI, nTimeTokenFlush * MICRO, nTimeTokenFlush * MILLI / nBlocksTotal);
         /** TOKENS END */
@@ -3729,6 +4982,8 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
+    metricBlocksConnected.Inc();
+    metricConnectBlockSeconds.Observe(nTime6 - nTime1);
 
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
 
@@ -3742,8 +4997,8 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         if (pSnapshotRequestDb->RetrieveSnapshotRequestsForHeight("", pindexNew->nHeight, tokensToSnapshot)) {
             //  Loop through them
             for (auto const & tokenEntry : tokensToSnapshot) {
-                //  Add a snapshot entry for the target token ownership
-                if (!pTokenSnapshotDb->AddTokenOwnershipSnapshot(tokenEntry.tokenName, pindexNew->nHeight)) {
+                //  Capture the target token ownership, the snapshot entry is written by the background worker
+                if (!pTokenSnapshotDb->QueueTokenOwnershipSnapshot(tokenEntry.tokenName, pindexNew->nHeight)) {
                    LogPrint(BCLog::REWARDS, "ConnectTip: Failed to snapshot owners for '%s' at height %d!\n",
                        tokenEntry.tokenName.c_str(), pindexNew->nHeight);
                 }
@@ -3847,8 +5102,15 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
     DisconnectedBlockTransactions disconnectpool;
+    // A reorg of more than one block reads the blocks and their undo data side by side first
+    std::vector<CDisconnectBlockData> vDisconnect;
+    if (chainActive.Tip() && chainActive.Tip() != pindexFork && chainActive.Tip()->pprev != pindexFork)
+        ReadDisconnectBlocks(pindexFork, chainparams.GetConsensus(), vDisconnect);
+    size_t nDisconnected = 0;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+        CDisconnectBlockData* pdata = nDisconnected < vDisconnect.size() ? &vDisconnect[nDisconnected] : nullptr;
+        nDisconnected++;
+        if (!DisconnectTip(state, chainparams, &disconnectpool, pdata)) {
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
             UpdateMempoolForReorg(disconnectpool, false);
@@ -3880,6 +5142,9 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         nHeight = nTargetHeight;
 
+        // Read and check the blocks ahead on the prefetch threads while connecting these
+        PrefetchBlocks(vpindexToConnect, pindexMostWork, pblock != nullptr);
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
@@ -3998,6 +5263,16 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
                 assert(trace.pblock && trace.pindex);
                 GetMainSignals().BlockConnected(trace.pblock, trace.pindex, *trace.conflictedTxs);
             }
+
+            // Publish the validator set if the blocks changed the authorization list
+            if (governance) {
+                static uint64_t nNotifiedValidatorGeneration = 0;
+                CValidatorSetRef validators = governance->GetValidatorSet();
+                if (validators->nGeneration != nNotifiedValidatorGeneration) {
+                    nNotifiedValidatorGeneration = validators->nGeneration;
+                    GetMainSignals().ValidatorSetChanged(validators);
+                }
+            }
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
 
@@ -4172,8 +5447,10 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork) {
         pindexBestHeader = pindexNew;
+        nBestHeaderHeight = pindexNew->nHeight;
+    }
 
     setDirtyBlockIndex.insert(pindexNew);
 
@@ -4431,12 +5708,26 @@ static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
     return true;
 }
 
+/** Whether the staker of block is authorized by the current governance state, checked each time as it changes */
+static bool CheckBlockStakeAuthorization(const CBlock& block, CValidationState& state)
+{
+    if (block.IsProofOfStake()) {
+        const CScript& authorizationScript = block.vtx[1]->vout[1].scriptPubKey;
+
+        if (!governance->CanStake(authorizationScript))
+            return state.DoS(100, error("CheckBlock(): unauthorized proof-of-stake block signature"),
+                    REJECT_INVALID, "bad-block-unauthorized");
+    }
+    return true;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, const uint256& hash, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fDBCheck, bool fCheckSig)
 {
-    // These are checks that are independent of context.
+    // These are checks that are independent of context, apart from the stake authorization.
+    // fChecked only caches the former, so that a block checked ahead of time is authorized when connected.
 
     if (block.fChecked)
-        return true;
+        return CheckBlockStakeAuthorization(block, state);
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
@@ -4508,14 +5799,18 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const uint256& has
                 REJECT_INVALID, "bad-block-signature");
     }
 
-    // Check proof-of-stake authorization
-    if (block.IsProofOfStake()) {
-        const CTxOut& authorization_txout = block.vtx[1]->vout[1];
-        CScript authorizationScript = authorization_txout.scriptPubKey;
-
-        if (!governance->CanStake(authorizationScript))
-            return state.DoS(100, error("CheckBlock(): unauthorized proof-of-stake block signature"),
-                    REJECT_INVALID, "bad-block-unauthorized");
+    // The transaction checks below don't depend on each other, so those of a large block go to the
+    // script check threads first. The loop runs them again, in order, only if one of them failed,
+    // to report the first failure the same way the serial checks do.
+    bool fTransactionsChecked = false;
+    if (nScriptCheckThreads && block.vtx.size() >= PARALLEL_CHECK_BLOCK_MIN_TXS) {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        std::vector<CScriptCheck> vChecks;
+        vChecks.reserve(block.vtx.size());
+        for (const auto& tx : block.vtx)
+            vChecks.emplace_back(*tx, fDBCheck ? CHECK_BLOCK_TRANSACTION_FALSE : CHECK_BLOCK_TRANSACTION_TRUE);
+        control.Add(vChecks);
+        fTransactionsChecked = control.Wait();
     }
 
     // Check transactions
@@ -4535,7 +5830,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const uint256& has
         if (block.GetBlockTime() < (int64_t)tx->nTime)
             return state.DoS(100, false, REJECT_INVALID, "bad-tx-time", false, "block timestamp earlier than transaction timestamp");
 
-        if (!CheckTransaction(*tx, state, fCheckDuplicates, fCheckMempool, fCheckBlock))
+        if (!fTransactionsChecked && !CheckTransaction(*tx, state, fCheckDuplicates, fCheckMempool, fCheckBlock))
             return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
                                  strprintf("Transaction check failed (tx hash %s) %s %s", tx->GetHash().ToString(),
                                            state.GetDebugMessage(), state.GetRejectReason()));
@@ -4552,7 +5847,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const uint256& has
     if (fCheckPOW && fCheckMerkleRoot)
         block.fChecked = true;
 
-    return true;
+    return CheckBlockStakeAuthorization(block, state);
 }
 
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -4847,6 +6142,31 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
+/**
+ * Whether the stake of a proof-of-stake block on top of the tip is mature, signed for and meets the target the block
+ * has to have. The kernel proof is cached for ConnectBlock, which checks it once more otherwise.
+ */
+static bool CheckBlockStakeForRelay(const CBlock& block, CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    assert(pindex->pprev == chainActive.Tip());
+
+    uint256 hashProofOfStake, targetProofOfStake;
+    if (GetCachedStakeProof(pindex, hashProofOfStake))
+        return true;
+
+    if (chainActive.Height() > consensusParams.nLastPOWBlock && block.nBits != GetNextTargetRequired(pindex->pprev, &block, true, consensusParams))
+        return false;
+
+    // Full validation reports a bad stake, with the rest of the block
+    CValidationState state;
+    if (!CheckProofOfStake(pindex->pprev, state, *block.vtx[1], block.nBits, block.vtx[1]->nTime, hashProofOfStake, targetProofOfStake, *pcoinsTip))
+        return false;
+
+    CacheStakeProof(pindex, hashProofOfStake);
+    return true;
+}
+
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
 bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock, const uint256& hash, bool fFromLoad = false)
 {
@@ -4913,21 +6233,30 @@ bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState&
 
     // Header is valid/has work, merkle tree and segwit merkle tree are good...RELAY NOW
     // (but if it does not build on our best tip, let the SendMessages loop relay it)
-    if (!IsInitialBlockDownload() && chainActive.Tip() == pindex->pprev)
+    // A proof-of-stake block only once its stake meets the target, as it costs nothing to sign
+    if (!IsInitialBlockDownload() && chainActive.Tip() == pindex->pprev &&
+        (block.IsProofOfWork() || CheckBlockStakeForRelay(block, pindex, chainparams.GetConsensus())))
         GetMainSignals().NewPoWValidBlock(pindex, pblock);
 
     int nHeight = pindex->nHeight;
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        std::vector<unsigned char> vRecord;
+        uint32_t nSizeWord = 0;
+        unsigned int nBlockSize;
         CDiskBlockPos blockPos;
-        if (dbp != nullptr)
+        if (dbp != nullptr) {
             blockPos = *dbp;
+            nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        } else {
+            SerializeRecord(block, vRecord, nSizeWord);
+            nBlockSize = vRecord.size();
+        }
         if (!FindBlockPos(state, blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), dbp != nullptr))
             return error("AcceptBlock(): FindBlockPos failed");
         if (dbp == nullptr)
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!WriteBlockToDisk(vRecord, nSizeWord, blockPos, chainparams.MessageStart()))
                 AbortNode(state, "Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
@@ -4941,6 +6270,46 @@ bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState&
     return true;
 }
 
+/**
+ * Announce a proof-of-stake block on top of the tip to the peers that want it first, before its transactions are
+ * checked. Only its header, merkle root, signature and stake are: the kernel must meet the target the block has to have.
+ * A block that fails any of them is left to full validation, which punishes its sender as usual.
+ */
+static void RelayStakeBlockEarly(const std::shared_ptr<const CBlock>& pblock, const CChainParams& chainparams, const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+    const CBlock& block = *pblock;
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+
+    if (IsInitialBlockDownload() || block.hashPrevBlock != chainActive.Tip()->GetIndexHash())
+        return;
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi != mapBlockIndex.end() && (mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)))
+        return;
+
+    CValidationState state;
+    if (!CheckBlockHeader(block, state, consensusParams))
+        return;
+
+    bool mutated;
+    if (block.hashMerkleRoot != BlockMerkleRoot(block, &mutated) || mutated)
+        return;
+
+    if (!block.vtx[0]->IsCoinBase() || !CheckFirstCoinstakeOutput(block) ||
+        !CheckCoinStakeTimestamp(block.GetBlockTime(), block.vtx[1]->nTime))
+        return;
+
+    if (!CheckBlockSignature(block, hash) || !CheckBlockStakeAuthorization(block, state))
+        return;
+
+    CBlockIndex* pindex = nullptr;
+    if (!AcceptBlockHeader(block, state, hash, chainparams, &pindex) || !CheckBlockStakeForRelay(block, pindex, consensusParams))
+        return;
+
+    LogPrint(BCLog::BENCH, "%s: relaying %s before checking its transactions\n", __func__, hash.ToString());
+    GetMainSignals().NewPoWValidBlock(pindex, pblock);
+}
+
 bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool *fNewBlock, const uint256& hash)
 {
     {
@@ -4953,6 +6322,11 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
             return state.DoS(100, false, REJECT_INVALID, "bad-signature-encoding", false,"AcceptBlockHeader(): bad block signature encoding");
         }
 
+        if (fEarlyStakeRelay && pblock->IsProofOfStake()) {
+            LOCK(cs_main);
+            RelayStakeBlockEarly(pblock, chainparams, hash);
+        }
+
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
         // belt-and-suspenders.
         bool ret = CheckBlock(*pblock, state, hash, chainparams.GetConsensus(), true, true);
@@ -4989,9 +6363,13 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
     indexDummy.nHeight = pindexPrev->nHeight + 1;
 
     /** TOKENS START */
-    CTokensCache tokenCache = *GetCurrentTokenCache();
+    // Empty overlay of ptokens, the block is validated against it without copying the dirty sets
+    CTokensCache tokenCache;
     /** TOKENS END */
 
+    // Discarded once the block is checked, validating it leaves the governance state untouched
+    CGovernanceCache governanceCache(governance);
+
     uint256 hash = block.GetIndexHash();
 
     // NOTE: CheckBlockHeader is called by CheckBlock
@@ -5001,7 +6379,7 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
     if (!ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindexPrev, &tokenCache))
         return error("%s: Consensus::ContextualCheckBlock: %s", __func__, FormatStateMessage(state));
-    if (!ConnectBlock(block, state, &indexDummy, viewNew, chainparams, &tokenCache, true)) /** TOKENS START */ /*Add token to function */ /** TOKENS END*/
+    if (!ConnectBlock(block, state, &indexDummy, viewNew, chainparams, &tokenCache, &governanceCache, true)) /** TOKENS START */ /*Add token to function */ /** TOKENS END*/
         return error("%s: Consensus::ConnectBlock: %s", __func__, FormatStateMessage(state));
     assert(state.IsValid());
 
@@ -5024,6 +6402,36 @@ uint64_t CalculateCurrentUsage()
     return retval;
 }
 
+std::vector<std::pair<std::string, uint64_t> > CalculateDiskUsageBySubsystem()
+{
+    uint64_t nBlocks = 0;
+    uint64_t nUndo = 0;
+    {
+        LOCK(cs_LastBlockFile);
+        for (const CBlockFileInfo &file : vinfoBlockFile) {
+            nBlocks += file.nSize;
+            nUndo += file.nUndoSize;
+        }
+    }
+
+    std::vector<std::pair<std::string, uint64_t> > vUsage;
+    vUsage.emplace_back("blocks", nBlocks);
+    vUsage.emplace_back("undo", nUndo);
+    vUsage.emplace_back("block_index", pblocktree ? pblocktree->GetDiskUsage() : 0);
+    vUsage.emplace_back("chainstate", pcoinsdbview ? pcoinsdbview->GetDiskUsage() : 0);
+    vUsage.emplace_back("tokens", ptokensdb ? ptokensdb->GetDiskUsage() : 0);
+    vUsage.emplace_back("token_undo", ptokensdb ? ptokensdb->EstimateBlockUndoTokenDataSize() : 0);
+    vUsage.emplace_back("restricted", (prestricteddb ? prestricteddb->GetDiskUsage() : 0) +
+                                      (pmyrestricteddb ? pmyrestricteddb->GetDiskUsage() : 0));
+    vUsage.emplace_back("messages", (pmessagedb ? pmessagedb->GetDiskUsage() : 0) +
+                                    (pmessagechanneldb ? pmessagechanneldb->GetDiskUsage() : 0));
+    vUsage.emplace_back("rewards", (pSnapshotRequestDb ? pSnapshotRequestDb->GetDiskUsage() : 0) +
+                                   (pTokenSnapshotDb ? pTokenSnapshotDb->GetDiskUsage() : 0) +
+                                   (pDistributeSnapshotDb ? pDistributeSnapshotDb->GetDiskUsage() : 0));
+    vUsage.emplace_back("governance", governance ? governance->GetDiskUsage() : 0);
+    return vUsage;
+}
+
 /* Prune a block file (modify associated database entries)*/
 void PruneOneBlockFile(const int fileNumber)
 {
@@ -5063,12 +6471,41 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_blockfilemap.Invalidate(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
 }
 
+/**
+ * Erase what the token databases keep for blocks that can no longer be disconnected: the token undo data of
+ * blocks whose undo data is gone, and the ownership snapshots at or below nSnapshotHeight that no snapshot
+ * request asks for any more. Sweeps all of them, so entries a crash left behind go as well.
+ */
+static void PruneTokenData(int nSnapshotHeight)
+{
+    AssertLockHeld(cs_main);
+    size_t nUndoErased = 0;
+    if (ptokensdb && !ptokensdb->PruneBlockUndoTokenData([](const uint256& hash) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hash);
+            return it != mapBlockIndex.end() && (it->second->nStatus & BLOCK_HAVE_UNDO);
+        }, nUndoErased)) {
+        LogPrintf("Prune: %s failed to erase token undo data\n", __func__);
+    }
+
+    size_t nSnapshotsRemoved = 0;
+    if (pTokenSnapshotDb && pSnapshotRequestDb && nSnapshotHeight > 0 &&
+        !pTokenSnapshotDb->PruneOwnershipSnapshots(nSnapshotHeight, [](const std::string& tokenName, int nHeight) {
+            return pSnapshotRequestDb->ContainsSnapshotRequest(tokenName, nHeight);
+        }, nSnapshotsRemoved)) {
+        LogPrintf("Prune: %s failed to remove token snapshots\n", __func__);
+    }
+
+    LogPrint(BCLog::PRUNE, "Prune: erased the token undo data of %u blocks and %u token snapshots up to height %d\n",
+             nUndoErased, nSnapshotsRemoved, nSnapshotHeight);
+}
+
 /* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
 {
@@ -5227,6 +6664,39 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+/** Recompute the header hash of every nEvery-th entry of vSortedByHeight, and the work hash of those that are
+ *  proof of work, side by side. The index stores the hashes, so loading it doesn't. */
+static bool VerifyBlockIndexHashes(const std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight, int64_t nEvery, const Consensus::Params& consensusParams)
+{
+    int64_t nStart = GetTimeMillis();
+    std::vector<const CBlockIndex*> vCheck;
+    for (size_t i = 0; i < vSortedByHeight.size(); i += nEvery)
+        vCheck.push_back(vSortedByHeight[i].second);
+
+    std::atomic<bool> fFailed(false);
+    std::mutex csFailed;
+    const CBlockIndex* pindexFailed = nullptr;
+    RunInParallel(vCheck.size(), GetNumCores(), [&](size_t k) {
+        if (fFailed)
+            return;
+        const CBlockIndex* pindex = vCheck[k];
+        CBlockHeader header = pindex->GetBlockHeader();
+        if (header.GetIndexHash() == pindex->GetIndexHash() &&
+            (!pindex->pprev || pindex->IsProofOfStake() || CheckProofOfWork(header.GetWorkHash(), header.nBits, consensusParams)))
+            return;
+        std::lock_guard<std::mutex> lock(csFailed);
+        if (!pindexFailed)
+            pindexFailed = pindex;
+        fFailed = true;
+    });
+
+    if (pindexFailed)
+        return error("%s: block index entry %s at height %d does not match its header", __func__, pindexFailed->GetIndexHash().ToString(), pindexFailed->nHeight);
+
+    LogPrintf("%s: verified %u of %u block index entries in %dms\n", __func__, vCheck.size(), vSortedByHeight.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
     if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex))
@@ -5235,6 +6705,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
+    const int64_t nLinkStart = GetTimeMillis();
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
@@ -5272,9 +6743,16 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
-        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
+        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex))) {
             pindexBestHeader = pindex;
+            nBestHeaderHeight = pindex->nHeight;
+        }
     }
+    LogPrintf("%s: linked %u block index entries in %dms\n", __func__, vSortedByHeight.size(), GetTimeMillis() - nLinkStart);
+
+    int64_t nVerifyEvery = gArgs.GetArg("-verifyblockindex", DEFAULT_VERIFY_BLOCK_INDEX);
+    if (nVerifyEvery > 0 && !VerifyBlockIndexHashes(vSortedByHeight, nVerifyEvery, chainparams.GetConsensus()))
+        return false;
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -5342,6 +6820,62 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     return true;
 }
 
+bool LoadUTXOSetStats(const CChainParams& chainparams)
+{
+    LOCK(cs_main);
+    fUTXOSetStats = false;
+    utxoSetStats.SetNull();
+    if (!gArgs.GetBoolArg("-utxostats", DEFAULT_UTXOSTATS))
+        return true;
+
+    // An empty chainstate starts with empty statistics, as after -reindex
+    const uint256 hashTip = pcoinsTip->GetBestBlock();
+    if (hashTip.IsNull()) {
+        fUTXOSetStats = true;
+        return true;
+    }
+
+    CUTXOSetStats stats;
+    if (pcoinsdbview->ReadUTXOSetStats(stats) && stats.hashBlock == hashTip) {
+        utxoSetStats = stats;
+        fUTXOSetStats = true;
+        return true;
+    }
+
+    // Computed once from the coins on disk, which have to be at the tip for that
+    if (!pcoinsdbview->SyncBackgroundWrite())
+        return error("%s: failed to write the chainstate", __func__);
+    if (pcoinsdbview->GetBestBlock() != hashTip) {
+        CValidationState state;
+        if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+            return error("%s: failed to flush the chainstate: %s", __func__, FormatStateMessage(state));
+    }
+
+    LogPrintf("Computing the UTXO set statistics at %s, this can take a few minutes but is only done once...\n", hashTip.ToString());
+    const int64_t nStart = GetTimeMillis();
+    if (!ComputeUTXOSetStats(pcoinsdbview, stats))
+        return error("%s: failed to read the chainstate", __func__);
+    if (stats.hashBlock != hashTip)
+        return error("%s: the chainstate moved to %s while it was read", __func__, stats.hashBlock.ToString());
+    stats.nHeight = chainActive.Height();
+    if (!pcoinsdbview->WriteUTXOSetStats(stats))
+        return error("%s: failed to write the UTXO set statistics", __func__);
+    LogPrintf("Computed the UTXO set statistics of %u outputs and %u tokens in %dms\n", stats.nTransactionOutputs, stats.mapTokenSupply.size(), GetTimeMillis() - nStart);
+
+    utxoSetStats = stats;
+    fUTXOSetStats = true;
+    return true;
+}
+
+bool GetTipUTXOSetStats(CUTXOSetStats& stats)
+{
+    LOCK(cs_main);
+    if (!fUTXOSetStats || utxoSetStats.hashBlock != pcoinsTip->GetBestBlock())
+        return false;
+    stats = utxoSetStats;
+    return true;
+}
+
 bool LoadChainTip(const CChainParams& chainparams)
 {
     if (chainActive.Tip() && chainActive.Tip()->GetIndexHash() == pcoinsTip->GetBestBlock()) return true;
@@ -5361,6 +6895,7 @@ bool LoadChainTip(const CChainParams& chainparams)
     if (it == mapBlockIndex.end())
         return false;
     chainActive.SetTip(it->second);
+    PublishChainTipState();
 
     PruneBlockIndexCandidates();
 
@@ -5399,8 +6934,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     CValidationState state;
     int reportDone = 0;
 
-    auto currentActiveTokenCache = GetCurrentTokenCache();
-    CTokensCache tokenCache(*currentActiveTokenCache);
+    CTokensCache tokenCache;
+    CGovernanceCache governanceCache(governance);
     LogPrintf("[0%%]...");
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
@@ -5443,7 +6978,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetIndexHash());
-            DisconnectResult res = DisconnectBlock(block, pindex, coins, &tokenCache, true, false);
+            DisconnectResult res = DisconnectBlock(block, pindex, coins, &tokenCache, &governanceCache, true, false);
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetIndexHash().ToString());
             }
@@ -5471,7 +7006,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetIndexHash().ToString());
-            if (!ConnectBlock(block, state, pindex, coins, chainparams, &tokenCache, false, true))
+            if (!ConnectBlock(block, state, pindex, coins, chainparams, &tokenCache, &governanceCache, false, true))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetIndexHash().ToString());
         }
     }
@@ -5482,6 +7017,55 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     return true;
 }
 
+bool ReplayChainTip(const CChainParams& chainparams, int nDepth, int nRounds, CChainReplayStats& stats)
+{
+    LOCK(cs_main);
+    if (chainActive.Tip() == nullptr || chainActive.Tip()->pprev == nullptr)
+        return error("%s: no blocks to replay", __func__);
+    // The genesis block can't be disconnected
+    nDepth = std::max(1, std::min(nDepth, chainActive.Height()));
+
+    std::vector<std::pair<CBlockIndex*, CBlock> > vBlocks(nDepth);
+    CBlockIndex* pindex = chainActive.Tip();
+    for (auto& item : vBlocks) {
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO))
+            return error("%s: block or undo data missing at %d, hash=%s", __func__, pindex->nHeight, pindex->GetIndexHash().ToString());
+        if (!ReadBlockFromDisk(item.second, pindex, chainparams.GetConsensus()))
+            return error("%s: ReadBlockFromDisk failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetIndexHash().ToString());
+        item.first = pindex;
+        for (const CTransactionRef& tx : item.second.vtx) {
+            for (const CTxOut& txout : tx->vout) {
+                if (txout.scriptPubKey.IsTokenScript() || txout.scriptPubKey.IsNullToken())
+                    stats.nTokenOutputs++;
+            }
+        }
+        stats.nTransactions += item.second.vtx.size();
+        pindex = pindex->pprev;
+    }
+    stats.nBlocks = nDepth;
+
+    for (int nRound = 0; nRound < nRounds && !ShutdownRequested(); nRound++) {
+        CCoinsViewCache coins(pcoinsTip);
+        CTokensCache tokenCache;
+        CGovernanceCache governanceCache(governance);
+
+        int64_t nTimeStart = GetTimeMicros();
+        for (const auto& item : vBlocks) {
+            if (DisconnectBlock(item.second, item.first, coins, &tokenCache, &governanceCache, true, false) != DISCONNECT_OK)
+                return error("%s: failed to disconnect block at %d, hash=%s", __func__, item.first->nHeight, item.first->GetIndexHash().ToString());
+        }
+        int64_t nTimeDisconnected = GetTimeMicros();
+        for (auto it = vBlocks.rbegin(); it != vBlocks.rend(); ++it) {
+            CValidationState state;
+            if (!ConnectBlock(it->second, state, it->first, coins, chainparams, &tokenCache, &governanceCache, false, true))
+                return error("%s: failed to connect block at %d, hash=%s (%s)", __func__, it->first->nHeight, it->first->GetIndexHash().ToString(), FormatStateMessage(state));
+        }
+        stats.vDisconnectMicros.push_back(nTimeDisconnected - nTimeStart);
+        stats.vConnectMicros.push_back(GetTimeMicros() - nTimeDisconnected);
+    }
+    return true;
+}
+
 /** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
 static bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params, CTokensCache* tokensCache = nullptr)
 {
@@ -5508,8 +7092,8 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
     LOCK(cs_main);
 
     CCoinsViewCache cache(view);
-    auto currentActiveTokenCache = GetCurrentTokenCache();
-    CTokensCache tokensCache(*currentActiveTokenCache);
+    CTokensCache tokensCache;
+    CGovernanceCache governanceCache(governance);
 
     std::vector<uint256> hashHeads = view->GetHeadBlocks();
     if (hashHeads.empty()) return true; // We're already in a consistent state.
@@ -5544,7 +7128,7 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
                 return error("RollbackBlock(): ReadBlockFromDisk() failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetIndexHash().ToString());
             }
             LogPrintf("Rolling back %s (%i)\n", pindexOld->GetIndexHash().ToString(), pindexOld->nHeight);
-            DisconnectResult res = DisconnectBlock(block, pindexOld, cache, &tokensCache);
+            DisconnectResult res = DisconnectBlock(block, pindexOld, cache, &tokensCache, &governanceCache);
             if (res == DISCONNECT_FAILED) {
                 return error("RollbackBlock(): DisconnectBlock failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetIndexHash().ToString());
             }
@@ -5567,6 +7151,7 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
     cache.SetBestBlock(pindexNew->GetIndexHash());
     cache.Flush();
     tokensCache.Flush();
+    governanceCache.Flush();
     uiInterface.ShowProgress("", 100, false);
     return true;
 }
@@ -5672,8 +7257,13 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(nullptr);
+    PublishChainTipState();
+    fUTXOSetStats = false;
+    utxoSetStats.SetNull();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
+    nBestHeaderHeight = -1;
+    ClearStakeProofCache();
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -5758,12 +7348,14 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
         const uint256& hash = chainparams.GetConsensus().hashGenesisBlock;
 
         // Start new block file
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        std::vector<unsigned char> vRecord;
+        uint32_t nSizeWord;
+        SerializeRecord(block, vRecord, nSizeWord);
         CDiskBlockPos blockPos;
         CValidationState state;
-        if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
+        if (!FindBlockPos(state, blockPos, vRecord.size()+8, 0, block.GetBlockTime()))
             return error("%s: FindBlockPos failed", __func__);
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+        if (!WriteBlockToDisk(vRecord, nSizeWord, blockPos, chainparams.MessageStart()))
             return error("%s: writing genesis block to disk failed", __func__);
         CBlockIndex *pindex = AddToBlockIndex(block, hash);
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
@@ -5775,13 +7367,15 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
-{
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+/** Map of disk positions for blocks with unknown parent (only used for reindex) */
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
 
-    int nLoaded = 0;
+/**
+ * Read the block records of a block file, calling fn with each block once dbp (when given) is set to its position,
+ * until fn returns false or the file ends. Takes over fileIn.
+ */
+static void ReadBlockFileRecords(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp, const std::function<bool(const std::shared_ptr<CBlock>&)>& fn)
+{
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*GetMaxBlockSerializedSize(), GetMaxBlockSerializedSize()+8, SER_DISK, CLIENT_VERSION);
@@ -5803,7 +7397,8 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                     continue;
                 // read size
                 blkdat >> nSize;
-                if (nSize < 80 || nSize > GetMaxBlockSerializedSize())
+                const unsigned int nStored = nSize & ~BLOCK_RECORD_COMPRESSED;
+                if ((nStored < 80 && !(nSize & BLOCK_RECORD_COMPRESSED)) || nStored > GetMaxBlockSerializedSize())
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
@@ -5814,74 +7409,26 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
                     dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
+                const unsigned int nStored = nSize & ~BLOCK_RECORD_COMPRESSED;
+                blkdat.SetLimit(nBlockPos + nStored);
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetIndexHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr, hash, true)) {
-                        nLoaded++;
-                    }
-                    if (state.IsError()) {
-                        break;
-                    }
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
+                if (nSize & BLOCK_RECORD_COMPRESSED) {
+                    std::vector<unsigned char> vPayload(nStored);
+                    blkdat.read((char*)vPayload.data(), vPayload.size());
+                    std::vector<unsigned char> vData;
+                    if (!DecompressBlockRecord(vPayload.data(), vPayload.size(), vData, GetMaxBlockSerializedSize()))
+                        throw std::ios_base::failure("corrupt compressed block");
+                    CMemoryReader reader(SER_DISK, CLIENT_VERSION, vData.data(), vData.data() + vData.size());
+                    reader >> block;
+                } else {
+                    blkdat >> block;
                 }
+                nRewind = blkdat.GetPos();
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetIndexHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr, hash, true))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetIndexHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                if (!fn(pblock))
+                    break;
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
@@ -5889,11 +7436,249 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
+}
+
+/**
+ * Add a block read from a block file at dbp to the block index, followed by the blocks read earlier that were
+ * waiting for it as their parent. Returns false when the rest of the file should be skipped.
+ */
+static bool ImportBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, const uint256& hash, CDiskBlockPos *dbp, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+
+    // detect out of order blocks, and store them for later
+    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        LOCK(cs_main);
+        CValidationState state;
+        if (AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr, hash, true)) {
+            nLoaded++;
+        }
+        if (state.IsError()) {
+            return false;
+        }
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+            {
+                const uint256 hashRecursive = pblockrecursive->GetIndexHash();
+                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, hashRecursive.ToString(),
+                        head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr, hashRecursive, true))
+                {
+                    nLoaded++;
+                    queue.push_back(hashRecursive);
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    ReadBlockFileRecords(chainparams, fileIn, dbp, [&](const std::shared_ptr<CBlock>& pblock) {
+        return ImportBlock(chainparams, pblock, pblock->GetIndexHash(), dbp, nLoaded);
+    });
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
 }
 
+namespace {
+/** A block of a block file read, hashed and put through CheckBlock by a reindex scanner */
+struct CScannedBlock
+{
+    std::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+    uint256 hash;
+};
+
+/** The blocks of one block file, in the order they are stored */
+struct CScannedBlockFile
+{
+    std::vector<CScannedBlock> vBlocks;
+    bool fDone;
+    bool fFound;
+
+    CScannedBlockFile() : fDone(false), fFound(false) {}
+};
+
+/**
+ * Threads reading the blk files ahead of the one -reindex is importing. Each takes the next file, finds its block
+ * records and deserializes, hashes and checks the blocks, so the import thread only has to add them to the block
+ * index in file order. At most nThreads files are held ahead of the import.
+ */
+class CBlockFileScanner
+{
+private:
+    const CChainParams& chainparams;
+    const int nThreads;
+    std::mutex cs;
+    std::condition_variable cond;
+    std::map<int, CScannedBlockFile> mapFiles;
+    std::vector<std::thread> vThreads;
+    int nNextScan;
+    int nNextTake;
+    bool fStop;
+
+    /** Read, hash and check the blocks of block file nFile, false when it doesn't exist */
+    bool ScanFile(int nFile, std::vector<CScannedBlock>& vBlocks)
+    {
+        CDiskBlockPos pos(nFile, 0);
+        if (!fs::exists(GetBlockPosFilename(pos, "blk")))
+            return false; // No block files left to reindex
+        FILE *file = OpenBlockFile(pos, true);
+        if (!file)
+            return false; // This error is logged in OpenBlockFile
+
+        // The context-free checks CheckBlock caches in fChecked, AcceptBlock repeats any that fail to report them
+        ReadBlockFileRecords(chainparams, file, &pos, [&](const std::shared_ptr<CBlock>& pblock) {
+            const uint256 hash = pblock->GetIndexHash();
+            CValidationState state;
+            CheckBlock(*pblock, state, hash, chainparams.GetConsensus(), true, true);
+            vBlocks.push_back(CScannedBlock{pblock, pos, hash});
+            std::lock_guard<std::mutex> lock(cs);
+            return !fStop;
+        });
+        return true;
+    }
+
+    void ThreadScan()
+    {
+        while (true) {
+            int nFile;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                cond.wait(lock, [this] { return fStop || nNextScan < nNextTake + nThreads; });
+                if (fStop)
+                    return;
+                nFile = nNextScan++;
+            }
+
+            std::vector<CScannedBlock> vBlocks;
+            bool fFound = ScanFile(nFile, vBlocks);
+
+            {
+                std::lock_guard<std::mutex> lock(cs);
+                CScannedBlockFile& entry = mapFiles[nFile];
+                entry.vBlocks.swap(vBlocks);
+                entry.fDone = true;
+                entry.fFound = fFound;
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+    CBlockFileScanner(const CChainParams& chainparamsIn, int nThreadsIn) : chainparams(chainparamsIn), nThreads(nThreadsIn), nNextScan(0), nNextTake(0), fStop(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            vThreads.emplace_back(&TraceThread<std::function<void()> >, "reindexscan", std::function<void()>(std::bind(&CBlockFileScanner::ThreadScan, this)));
+    }
+
+    ~CBlockFileScanner()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        cond.notify_all();
+        for (std::thread& thread : vThreads)
+            thread.join();
+    }
+
+    /** The blocks of the next block file, scanning it here when there are no scanner threads, false past the last file */
+    bool TakeNext(int& nFile, std::vector<CScannedBlock>& vBlocks)
+    {
+        if (vThreads.empty()) {
+            nFile = nNextTake++;
+            return ScanFile(nFile, vBlocks);
+        }
+
+        std::unique_lock<std::mutex> lock(cs);
+        nFile = nNextTake;
+        while (!mapFiles[nFile].fDone) {
+            // Wake up now and then so the import thread can be interrupted on shutdown
+            lock.unlock();
+            boost::this_thread::interruption_point();
+            lock.lock();
+            cond.wait_for(lock, std::chrono::milliseconds(100), [this, nFile] { return mapFiles[nFile].fDone; });
+        }
+        CScannedBlockFile& entry = mapFiles[nFile];
+        bool fFound = entry.fFound;
+        vBlocks.swap(entry.vBlocks);
+        mapFiles.erase(nFile);
+        nNextTake++;
+        lock.unlock();
+        cond.notify_all();
+        return fFound;
+    }
+};
+}
+
+void ReindexBlockFiles(const CChainParams& chainparams, int nThreads)
+{
+    int64_t nStart = GetTimeMillis();
+    int nLoaded = 0;
+
+    CBlockFileScanner scanner(chainparams, nThreads);
+    int nFile;
+    std::vector<CScannedBlock> vBlocks;
+    while (scanner.TakeNext(nFile, vBlocks)) {
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        for (CScannedBlock& scanned : vBlocks) {
+            boost::this_thread::interruption_point();
+            try {
+                if (!ImportBlock(chainparams, scanned.pblock, scanned.hash, &scanned.pos, nLoaded))
+                    break;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+        vBlocks.clear();
+    }
+    LogPrintf("Reindexed %i blocks with %d scanner threads in %dms\n", nLoaded, nThreads, GetTimeMillis() - nStart);
+}
+
 void static CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -6108,13 +7893,84 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/**
+ * Version 3 dumps start with the client version, the mempool script flags and the tip they were written on, and end
+ * with a hash of everything before it keyed with this datadir's mempool dump key. Loading one written by the same
+ * client with the same flags on that same tip takes the scripts of its transactions as checked, since this node
+ * checked them against the same coins; every other mempool check, the token ones included, runs again. Older dumps
+ * are checked in full.
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION = 3;
+static const uint64_t MEMPOOL_DUMP_VERSION_UNKEYED = 2;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_TIP = 1;
+
+/** Read the secret mempool dumps of this datadir are hashed with, creating it the first time */
+static bool GetMempoolDumpKey(uint256& key)
+{
+    const fs::path path = GetDataDir() / "mempool.key";
+    FILE* filestr = fsbridge::fopen(path, "rb");
+    if (filestr) {
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        try {
+            file >> key;
+            return true;
+        } catch (const std::exception& e) {
+            LogPrintf("Failed to read mempool dump key: %s\n", e.what());
+            return false;
+        }
+    }
+
+    GetStrongRandBytes(key.begin(), key.size());
+    try {
+        filestr = fsbridge::fopen(GetDataDir() / "mempool.key.new", "wb");
+        if (!filestr)
+            return false;
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << key;
+        FileCommit(file.Get());
+        file.fclose();
+        return RenameOver(GetDataDir() / "mempool.key.new", path);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to write mempool dump key: %s\n", e.what());
+        return false;
+    }
+}
+
+/** Whether the mempool dump at path ends with the hash of its contents keyed with key, read in chunks */
+static bool CheckMempoolDumpHash(const fs::path& path, const uint256& key)
+{
+    FILE* filestr = fsbridge::fopen(path, "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+
+    if (fseek(file.Get(), 0, SEEK_END) != 0)
+        return false;
+    long nSize = ftell(file.Get());
+    if (nSize < (long)sizeof(uint256) || fseek(file.Get(), 0, SEEK_SET) != 0)
+        return false;
+
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    hasher << key;
+    std::vector<char> vBuffer(1 << 16);
+    for (long nLeft = nSize - sizeof(uint256); nLeft > 0; ) {
+        size_t nRead = std::min((long)vBuffer.size(), nLeft);
+        file.read(vBuffer.data(), nRead);
+        hasher.write(vBuffer.data(), nRead);
+        nLeft -= nRead;
+    }
+
+    uint256 hashContents;
+    file >> hashContents;
+    return hashContents == hasher.GetHash();
+}
 
 bool LoadMempool(void)
 {
     const CChainParams& chainparams = GetParams();
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
-    FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
+    const fs::path path = GetDataDir() / "mempool.dat";
+    FILE* filestr = fsbridge::fopen(path, "rb");
     CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
     if (file.IsNull()) {
         LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
@@ -6125,14 +7981,35 @@ bool LoadMempool(void)
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
+    int64_t trusted = 0;
     int64_t nNow = GetTime();
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_UNKEYED && version != MEMPOOL_DUMP_VERSION_NO_TIP) {
             return false;
         }
+        bool fTrustScripts = false;
+        uint256 hashTip;
+        if (version == MEMPOOL_DUMP_VERSION) {
+            int nDumpClientVersion;
+            unsigned int nDumpScriptFlags;
+            file >> nDumpClientVersion >> nDumpScriptFlags >> hashTip;
+            {
+                LOCK(cs_main);
+                fTrustScripts = nDumpClientVersion == CLIENT_VERSION &&
+                                nDumpScriptFlags == GetMempoolScriptVerifyFlags(chainparams) &&
+                                chainActive.Tip() && chainActive.Tip()->GetIndexHash() == hashTip;
+            }
+            uint256 key;
+            if (fTrustScripts && !(GetMempoolDumpKey(key) && CheckMempoolDumpHash(path, key))) {
+                LogPrintf("Mempool file from disk doesn't match its hash, checking all of it\n");
+                fTrustScripts = false;
+            }
+        } else if (version == MEMPOOL_DUMP_VERSION_UNKEYED) {
+            file >> hashTip;
+        }
         uint64_t num;
         file >> num;
         while (num--) {
@@ -6150,11 +8027,15 @@ bool LoadMempool(void)
             CValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
+                // The tip can move while loading, scripts are only trusted while it hasn't
+                bool fTrustTx = fTrustScripts && chainActive.Tip()->GetIndexHash() == hashTip;
                 AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
+                                           false /* test_accept */, fTrustTx);
                 if (state.IsValid()) {
                     ++count;
+                    if (fTrustTx)
+                        ++trusted;
                 } else {
                     // mempool may contain the transaction already, e.g. from
                     // wallet(s) having loaded it while we were processing
@@ -6183,7 +8064,7 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded (%i with trusted scripts), %i failed, %i expired, %i already there\n", count, trusted, failed, expired, already_there);
     return true;
 }
 
@@ -6193,13 +8074,16 @@ bool DumpMempool(void)
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    uint256 hashTip;
 
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
         vinfo = mempool.infoAll();
+        if (chainActive.Tip())
+            hashTip = chainActive.Tip()->GetIndexHash();
     }
 
     int64_t mid = GetTimeMicros();
@@ -6211,19 +8095,31 @@ bool DumpMempool(void)
         }
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+
+        // Without a key the dump is still written, its hash just never matches so it's checked in full on load
+        uint256 key;
+        if (!GetMempoolDumpKey(key))
+            LogPrintf("Failed to get the mempool dump key, the dump will be checked in full when loaded\n");
+        hasher << key;
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
-        file << version;
+        int nClientVersion = CLIENT_VERSION;
+        unsigned int nScriptFlags = GetMempoolScriptVerifyFlags(GetParams());
+        file << version << nClientVersion << nScriptFlags << hashTip;
+        hasher << version << nClientVersion << nScriptFlags << hashTip;
 
         file << (uint64_t)vinfo.size();
+        hasher << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
+            file << *(i.tx) << (int64_t)i.nTime << (int64_t)i.nFeeDelta;
+            hasher << *(i.tx) << (int64_t)i.nTime << (int64_t)i.nFeeDelta;
             mapDeltas.erase(i.tx->GetHash());
         }
 
         file << mapDeltas;
+        hasher << mapDeltas;
+        file << hasher.GetHash();
         FileCommit(file.Get());
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
@@ -6237,7 +8133,7 @@ bool DumpMempool(void)
 }
 
 //! Guess how far we are in the verification process at the given block index
-double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
+double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
     if (pindex == nullptr)
         return 0.0;
 
@@ -28,7 +28,9 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -57,9 +59,11 @@ class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
 class CTxUndo;
+class CBlockUndo;
 struct ChainTxData;
 
 struct CDiskTxPos;
+struct CUTXOSetStats;
 class CWallet;
 
 class CTokensDB;
@@ -104,10 +108,18 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Maximum number of threads reading block files ahead of the -reindex import */
+static const int MAX_REINDEX_THREADS = 4;
+/** CheckBlock runs the transaction checks of blocks with at least this many transactions on the script check threads */
+static const unsigned int PARALLEL_CHECK_BLOCK_MIN_TXS = 32;
+/** Number of blocks that can be requested at any given time from a single peer, until its throughput calls for more. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
-/** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
+/** Most blocks a single peer can have in flight once its measured throughput and latency call for more. */
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE = 128;
+/** Timeout in seconds during which a peer must stall block download progress before its blocks are given to other peers. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** Number of times a peer's blocks are given to other peers for stalling the download before it is disconnected. */
+static const int MAX_BLOCK_STALLS = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
@@ -118,8 +130,9 @@ static const int MAX_CMPCTBLOCK_DEPTH = 5;
 static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
- *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
- *  want to make this a per-peer adaptive value at some point. */
+ *  degree of disordering of blocks on disk (which make reindexing and pruning harder). The window of a
+ *  peer grows with its in-flight limit, up to MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE / MAX_BLOCKS_IN_TRANSIT_PER_PEER
+ *  times this size. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
@@ -155,11 +168,14 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -earlystakerelay */
+static const bool DEFAULT_EARLY_STAKE_RELAY = true;
 static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_TOKENINDEX = true;
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_UTXOSTATS = true;
 static const bool DEFAULT_REWARDS_ENABLED = false;
 /** Default for -dbmaxfilesize , in MB */
 static const int64_t DEFAULT_DB_MAX_FILE_SIZE = 2;
@@ -212,6 +228,10 @@ extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Whether proof-of-stake blocks on top of the tip are announced once their stake is checked, before their transactions */
+extern bool fEarlyStakeRelay;
+/** Whether the signature and script execution caches grow when they miss while connecting blocks */
+extern bool fSigCacheAutoSize;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -235,6 +255,9 @@ extern arith_uint256 nMinimumChainWork;
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
 
+/** Height of pindexBestHeader, -1 while there is none, for readers that don't take cs_main. */
+extern std::atomic<int> nBestHeaderHeight;
+
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
@@ -243,6 +266,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** Whether new block and undo records are written compressed (-blockcompression) */
+extern bool fBlockCompression;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -250,6 +275,8 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 500;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 4;
+/** Recompute the hashes of every n-th block index entry at startup, 0 for none */
+static const int64_t DEFAULT_VERIFY_BLOCK_INDEX = 0;
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -303,6 +330,8 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/** Rebuild the block index from the blk files on disk, nThreads threads reading and checking the files ahead of the import */
+void ReindexBlockFiles(const CChainParams& chainparams, int nThreads);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -324,11 +353,14 @@ bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams,
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 
 /** Guess verification progress (as a fraction between 0.0=genesis and 1.0=current tip). */
-double GuessVerificationProgress(const ChainTxData& data, CBlockIndex* pindex);
+double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex* pindex);
 
 /** Calculate the amount of disk space the block & undo files currently use */
 uint64_t CalculateCurrentUsage();
 
+/** Bytes on disk by what they hold: the block and undo files and each database */
+std::vector<std::pair<std::string, uint64_t> > CalculateDiskUsageBySubsystem();
+
 /**
  *  Mark one block file as pruned.
  */
@@ -354,6 +386,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false);
 
+/** (try to) add a batch of transactions to memory pool under a single lock, each one after any it spends from.
+ * states and vMissingInputs are filled in per transaction, in the order of txs. Returns the number accepted. **/
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, std::vector<CValidationState>& states, const std::vector<CTransactionRef>& txs,
+                                     std::vector<bool>& vMissingInputs, bool bypass_limits, const CAmount nAbsurdFee);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -404,6 +441,11 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp = null
 /**
  * Closure representing one script verification
  * Note that this stores references to the spending transaction 
+ *
+ * A check built from the token outputs a transaction spends runs its cache-independent
+ * token checks (Consensus::CheckTxTokenAmounts) instead, so that block validation can hand
+ * them to the same script check threads. One built from a transaction alone runs its
+ * context-free checks (CheckTransaction), for CheckBlock.
  */
 class CScriptCheck
 {
@@ -415,11 +457,21 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    bool fTokenCheck;
+    bool fTxCheck;
+    bool fBlockCheck;
+    std::vector<CTxOut> vSpentTokens;
+    int nSpendHeight;
+    int64_t nSpendTime;
 
 public:
-    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), fTokenCheck(false), fTxCheck(false), fBlockCheck(false), nSpendHeight(0), nSpendTime(0) {}
     CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), fTokenCheck(false), fTxCheck(false), fBlockCheck(false), nSpendHeight(0), nSpendTime(0) { }
+    CScriptCheck(const CTransaction& txToIn, std::vector<CTxOut>&& vSpentTokensIn, int nSpendHeightIn, int64_t nSpendTimeIn) :
+        ptxTo(&txToIn), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), fTokenCheck(true), fTxCheck(false), fBlockCheck(false), vSpentTokens(std::move(vSpentTokensIn)), nSpendHeight(nSpendHeightIn), nSpendTime(nSpendTimeIn) { }
+    CScriptCheck(const CTransaction& txToIn, bool fBlockCheckIn) :
+        ptxTo(&txToIn), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), fTokenCheck(false), fTxCheck(true), fBlockCheck(fBlockCheckIn), nSpendHeight(0), nSpendTime(0) { }
 
     bool operator()();
 
@@ -431,6 +483,12 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(fTokenCheck, check.fTokenCheck);
+        std::swap(fTxCheck, check.fTxCheck);
+        std::swap(fBlockCheck, check.fBlockCheck);
+        std::swap(vSpentTokens, check.vSpentTokens);
+        std::swap(nSpendHeight, check.nSpendHeight);
+        std::swap(nSpendTime, check.nSpendTime);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -439,8 +497,37 @@ public:
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+struct CSignatureCacheStats;
+void GetScriptExecutionCacheStats(CSignatureCacheStats& stats);
+
+/** Start the thread that writes the address, spent and timestamp indexes of the connected blocks */
+void StartIndexWriter();
+/** Stop the index writer once every queued index change has been written */
+void StopIndexWriter();
+/** Start the threads reading and checking the blocks ahead of the tip while connecting */
+void StartBlockPrefetch();
+/** Stop the block prefetch threads, ConnectTip reads the blocks itself again */
+void StopBlockPrefetch();
+/** Wait until the index changes queued so far have been written, false if one of them failed */
+bool SyncIndexWriter();
+
+/**
+ * Have the index builder write index name (addressindex, spentindex or timestampindex) from the blocks and
+ * undo data on disk, resuming where it stopped last time. The index is switched on once it reaches the tip.
+ * False when pruning, as the blocks it needs may be gone.
+ */
+bool ScheduleIndexBuild(const std::string& strName);
+/** Start the index builder if an index build has been scheduled */
+void StartIndexBuilder();
+/** Stop the index builder, the progress it made so far is kept */
+void StopIndexBuilder();
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
+/** Walk the timestamp index from low up to high, see CBlockTreeDB::WalkTimestampIndex. cs_main is only taken to check each block is on the active chain. */
+bool WalkTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, const std::function<bool(const uint256&, unsigned int)> &fn);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/** The spent index entries of many outputs, from the mempool and then from one database snapshot. Outputs that aren't spent are left out of values. */
+bool GetSpentIndex(const std::set<CSpentIndexKey, CSpentIndexKeyCompare> &keys, std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> &values);
 bool HashOnchainActive(const uint256 &hash);
 bool GetAddressIndex(uint160 addressHash, int type, std::string tokenName,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
@@ -448,6 +535,9 @@ bool GetAddressIndex(uint160 addressHash, int type, std::string tokenName,
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
+bool GetAddressIndexBalances(uint160 addressHash, int type, std::string tokenName, int nLockHeight, int64_t nLockTime,
+                             std::map<std::string, CAddressIndexBalance> &balances,
+                             int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type, std::string tokenName,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
 bool GetAddressUnspent(uint160 addressHash, int type,
@@ -456,9 +546,16 @@ bool GetAddressUnspent(uint160 addressHash, int type,
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the undo data of a block, checked against the hash of its parent hashBlock */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+/** The serialized block at pos, as stored on disk and sent to peers asking for witness blocks, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
+/** Check the signature of a proof-of-stake block against the key of its coinstake; proof-of-work blocks must have none */
+bool CheckBlockSignature(const CBlock& block, const uint256& hash);
+
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, CValidationState& state, const uint256& hash, const Consensus::Params& consensusParams, bool fCheckPOW = false, bool fCheckMerkleRoot = true, bool fDBCheck = false, bool fCheckSig = true);
 
@@ -491,6 +588,34 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
+/**
+ * Follow the statistics of the chain tip's UTXO set from here on, unless -utxostats is off: read them as the last
+ * flush wrote them, or compute them once from the chainstate. Called at startup once the chain tip is loaded.
+ */
+bool LoadUTXOSetStats(const CChainParams& chainparams);
+
+/** Copy the statistics of the chain tip's UTXO set, false if they aren't followed */
+bool GetTipUTXOSetStats(CUTXOSetStats& stats);
+
+/** What ReplayChainTip measured, one entry of the round vectors per round */
+struct CChainReplayStats {
+    int nBlocks = 0;
+    int64_t nTransactions = 0;
+    //! Token outputs of the replayed blocks: transfers, issues, reissues, owners and null token data
+    int64_t nTokenOutputs = 0;
+    std::vector<int64_t> vDisconnectMicros;
+    std::vector<int64_t> vConnectMicros;
+};
+
+/**
+ * Disconnect the last nDepth blocks of the active chain and connect them again,
+ * nRounds times, for benchmarking ConnectBlock and DisconnectBlock on real blocks.
+ * Like the reconnecting levels of VerifyDB this runs in caches over the coins,
+ * token and governance databases that are never flushed; each round starts from
+ * fresh caches. The blocks are read before the clock starts.
+ */
+bool ReplayChainTip(const CChainParams& chainparams, int nDepth, int nRounds, CChainReplayStats& stats);
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -506,6 +631,27 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/** The tip of chainActive as of its last change, for readers that don't take cs_main. Block index entries are
+ *  never freed while running, so pindex and its ancestors can be read through it. */
+struct CChainTipState
+{
+    const CBlockIndex* pindex;
+    uint256 hashBlock;
+    int nHeight;
+    int64_t nTime;
+    int64_t nMedianTimePast;
+    arith_uint256 nChainWork;
+    unsigned int nChainTx;
+    //! The governance costs and fee script in force at this tip, nullptr before governance is loaded
+    CCostTableRef costTable;
+};
+
+/** Publish the current tip of chainActive, called with cs_main held whenever it changes. The snapshot is replaced,
+ *  never modified, so a reader keeps a consistent view for as long as it holds one. */
+void PublishChainTipState();
+/** The last published tip, nullptr while no chain is loaded. */
+std::shared_ptr<const CChainTipState> GetChainTipState();
+
 /** Global variable that points to the coins database (protected by cs_main) */
 extern CCoinsViewDB *pcoinsdbview;
 
@@ -518,6 +664,9 @@ extern CBlockTreeDB *pblocktree;
 /** Global variable that points to the governance db (protected by cs_main) */
 extern CGovernance *governance;
 
+/** Global variable that points to the environment shared by the token, messaging, rewards and governance databases */
+extern CDBEnvironment *pdbenv;
+
 /** TOKENS START */
 
 /** Global variable that point to the active tokens database (protected by cs_main) */
@@ -526,8 +675,8 @@ extern CTokensDB *ptokensdb;
 /** Global variable that point to the active tokens (protected by cs_main) */
 extern CTokensCache *ptokens;
 
-/** Global variable that point to the tokens metadata LRU Cache (protected by cs_main) */
-extern CLRUCache<std::string, CDatabasedTokenData> *ptokensCache;
+/** Global variable that point to the tokens metadata LRU Cache (internally locked, mirrors the ptokens view so it can be read without cs_main) */
+extern CShardedLRUCache<std::string, CDatabasedTokenData> *ptokensCache;
 
 /** Global variable that points to the subscribed channel LRU Cache (protected by cs_main) */
 extern CLRUCache<std::string, CMessage> *pMessagesCache;
@@ -554,13 +703,13 @@ extern CRestrictedDB *prestricteddb;
 extern CLRUCache<std::string, CNullTokenTxVerifierString> *ptokensVerifierCache;
 
 /** Global variable that points to the token address qualifier LRU Cache (protected by cs_main) */
-extern CLRUCache<std::string, int8_t> *ptokensQualifierCache; // hash(address,qualifier_name) ->int8_t
+extern CRestrictedLRUCache *ptokensQualifierCache; // interned (qualifier_name, address) -> int8_t
 
 /** Global variable that points to the token address restriction LRU Cache (protected by cs_main) */
-extern CLRUCache<std::string, int8_t> *ptokensRestrictionCache; // hash(address,qualifier_name) ->int8_t
+extern CRestrictedLRUCache *ptokensRestrictionCache; // interned (restricted_name, address) -> int8_t
 
 /** Global variable that points to the global token restriction LRU Cache (protected by cs_main) */
-extern CLRUCache<std::string, int8_t> *ptokensGlobalRestrictionCache;
+extern CRestrictedLRUCache *ptokensGlobalRestrictionCache; // interned restricted_name -> int8_t
 
 /** Global variable that point to the active Snapshot Request database (protected by cs_main) */
 extern CSnapshotRequestDB *pSnapshotRequestDb;
@@ -10,20 +10,137 @@
 #include "primitives/block.h"
 #include "scheduler.h"
 #include "sync.h"
+#include "txmempool.h"
+#include "tokens/tokens.h"
+#include "tokens/messages.h"
 #include "util.h"
+#include "utiltime.h"
 
 #include <list>
 #include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
 
 #include <boost/signals2/signal.hpp>
+#include <boost/thread.hpp>
 
 // Fixing Boost 1.73 compile errors
 #include <boost/bind/bind.hpp>
 using namespace boost::placeholders;
 
+/**
+ * The notifications of one listener registered with RegisterAsyncValidationInterface,
+ * delivered in order by a thread of its own.
+ */
+class AsyncValidationQueue
+{
+private:
+    const std::string m_name;
+    const size_t m_nMaxQueued;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    //! The notifications and when they were signalled
+    std::deque<std::pair<int64_t, std::function<void ()>>> m_queue;
+    bool m_fStop;
+    bool m_fOverflowing;
+    ValidationQueueStats m_stats;
+    boost::thread m_thread;
+
+    void ThreadDeliver()
+    {
+        RenameThread(("paladeum-" + m_name).c_str());
+        while (true) {
+            std::function<void ()> f;
+            {
+                boost::unique_lock<boost::mutex> lock(m_mutex);
+                while (m_queue.empty() && !m_fStop)
+                    m_cond.wait(lock);
+                if (m_queue.empty())
+                    return;
+                const int64_t nDelay = GetTimeMicros() - m_queue.front().first;
+                m_stats.nTotalDelayMicros += nDelay;
+                m_stats.nMaxDelayMicros = std::max(m_stats.nMaxDelayMicros, nDelay);
+                f = std::move(m_queue.front().second);
+                m_queue.pop_front();
+                if (m_queue.empty())
+                    m_fOverflowing = false;
+            }
+            try {
+                f();
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, m_name.c_str());
+            } catch (...) {
+                PrintExceptionContinue(nullptr, m_name.c_str());
+            }
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            m_stats.nDelivered++;
+        }
+    }
+
+public:
+    AsyncValidationQueue(const std::string& name, size_t nMaxQueued) : m_name(name), m_nMaxQueued(std::max<size_t>(nMaxQueued, 1)), m_fStop(false), m_fOverflowing(false)
+    {
+        m_stats = ValidationQueueStats();
+        m_stats.strName = m_name;
+        m_stats.nMaxQueued = m_nMaxQueued;
+        m_thread = boost::thread(std::bind(&AsyncValidationQueue::ThreadDeliver, this));
+    }
+
+    ~AsyncValidationQueue()
+    {
+        Stop();
+    }
+
+    void Push(std::function<void ()> f)
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        // Whatever is signalled after Stop would never be delivered
+        if (m_fStop)
+            return;
+        if (m_queue.size() >= m_nMaxQueued) {
+            m_stats.nOverflows++;
+            if (!m_fOverflowing) {
+                LogPrintf("%s: more than %u validation notifications queued, the listener falls behind\n", m_name, m_nMaxQueued);
+                m_fOverflowing = true;
+            }
+        }
+        m_queue.emplace_back(GetTimeMicros(), std::move(f));
+        m_stats.nPeakQueued = std::max(m_stats.nPeakQueued, m_queue.size());
+        m_cond.notify_one();
+    }
+
+    /** Deliver what is queued, then stop the thread */
+    void Stop()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            m_fStop = true;
+            m_cond.notify_one();
+        }
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    ValidationQueueStats GetStats() const
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        ValidationQueueStats stats = m_stats;
+        stats.nQueued = m_queue.size();
+        return stats;
+    }
+};
+
+struct AsyncValidationSubscriber {
+    std::shared_ptr<AsyncValidationQueue> queue;
+    std::vector<boost::signals2::connection> vConnections;
+};
+
 struct MainSignalsInstance {
     boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
+    boost::signals2::signal<void (const CTransactionRef &, uint64_t)> TransactionAddedToMempool;
+    boost::signals2::signal<void (const CTransactionRef &, MemPoolRemovalReason, uint64_t)> TransactionRemovedFromMempool;
     boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&)> BlockConnected;
     boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
     boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
@@ -33,13 +150,18 @@ struct MainSignalsInstance {
     boost::signals2::signal<void (const uint256 &)> BlockFound;
     boost::signals2::signal<void (const CMessage &)> NewTokenMessage;
     boost::signals2::signal<void (const std::string &)> TokenInventory;
+    boost::signals2::signal<void (const std::shared_ptr<const CValidatorSet> &)> ValidatorSetChanged;
     
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
     // our own queue here :(
+    // The wallets and ZMQ are behind these, so they go before periodic chores.
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    CCriticalSection cs_asyncSubscribers;
+    std::map<CValidationInterface*, AsyncValidationSubscriber> m_asyncSubscribers;
+
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler, CScheduler::PRIORITY_HIGH) {}
 };
 
 static CMainSignals g_signals;
@@ -66,7 +188,8 @@ CMainSignals& GetMainSignals()
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.m_internals->UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
+    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1, _2));
+    g_signals.m_internals->TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1, _2, _3));
     g_signals.m_internals->BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
     g_signals.m_internals->BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
     g_signals.m_internals->SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
@@ -75,19 +198,104 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
     g_signals.m_internals->BlockFound.connect(boost::bind(&CValidationInterface::BlockFound, pwalletIn, _1));
     g_signals.m_internals->NewTokenMessage.connect(boost::bind(&CValidationInterface::NewTokenMessage, pwalletIn, _1));
+    g_signals.m_internals->ValidatorSetChanged.connect(boost::bind(&CValidationInterface::ValidatorSetChanged, pwalletIn, _1));
+}
+
+void RegisterAsyncValidationInterface(CValidationInterface* pwalletIn, const std::string& strName, size_t nMaxQueued) {
+    // The slots hold on to the queue, as a signal may still be in one while it is disconnected
+    std::shared_ptr<AsyncValidationQueue> queue = std::make_shared<AsyncValidationQueue>(strName, nMaxQueued);
+    AsyncValidationSubscriber subscriber;
+    subscriber.queue = queue;
+
+    MainSignalsInstance& signals = *g_signals.m_internals;
+    std::vector<boost::signals2::connection>& vConnections = subscriber.vConnections;
+    vConnections.push_back(signals.UpdatedBlockTip.connect([pwalletIn, queue](const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {
+        queue->Push([=] { pwalletIn->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload); });
+    }));
+    vConnections.push_back(signals.TransactionAddedToMempool.connect([pwalletIn, queue](const CTransactionRef &ptx, uint64_t nMempoolSequence) {
+        queue->Push([=] { pwalletIn->TransactionAddedToMempool(ptx, nMempoolSequence); });
+    }));
+    vConnections.push_back(signals.TransactionRemovedFromMempool.connect([pwalletIn, queue](const CTransactionRef &ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {
+        queue->Push([=] { pwalletIn->TransactionRemovedFromMempool(ptx, reason, nMempoolSequence); });
+    }));
+    vConnections.push_back(signals.BlockConnected.connect([pwalletIn, queue](const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef> &vtxConflicted) {
+        queue->Push([=] { pwalletIn->BlockConnected(pblock, pindex, vtxConflicted); });
+    }));
+    vConnections.push_back(signals.BlockDisconnected.connect([pwalletIn, queue](const std::shared_ptr<const CBlock> &pblock) {
+        queue->Push([=] { pwalletIn->BlockDisconnected(pblock); });
+    }));
+    vConnections.push_back(signals.SetBestChain.connect([pwalletIn, queue](const CBlockLocator &locator) {
+        queue->Push([=] { pwalletIn->SetBestChain(locator); });
+    }));
+    vConnections.push_back(signals.Broadcast.connect([pwalletIn, queue](int64_t nBestBlockTime, CConnman* connman) {
+        queue->Push([=] { pwalletIn->ResendWalletTransactions(nBestBlockTime, connman); });
+    }));
+    vConnections.push_back(signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2)));
+    vConnections.push_back(signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2)));
+    vConnections.push_back(signals.BlockFound.connect([pwalletIn, queue](const uint256 &hash) {
+        queue->Push([=] { pwalletIn->BlockFound(hash); });
+    }));
+    vConnections.push_back(signals.NewTokenMessage.connect([pwalletIn, queue](const CMessage &message) {
+        queue->Push([=] { pwalletIn->NewTokenMessage(message); });
+    }));
+    vConnections.push_back(signals.ValidatorSetChanged.connect([pwalletIn, queue](const std::shared_ptr<const CValidatorSet> &validators) {
+        queue->Push([=] { pwalletIn->ValidatorSetChanged(validators); });
+    }));
+
+    LOCK(signals.cs_asyncSubscribers);
+    signals.m_asyncSubscribers[pwalletIn] = std::move(subscriber);
+}
+
+std::vector<ValidationQueueStats> GetValidationQueueStats() {
+    std::vector<ValidationQueueStats> vStats;
+    if (!g_signals.m_internals) {
+        return vStats;
+    }
+    LOCK(g_signals.m_internals->cs_asyncSubscribers);
+    for (const auto& subscriber : g_signals.m_internals->m_asyncSubscribers) {
+        vStats.push_back(subscriber.second.queue->GetStats());
+    }
+    return vStats;
+}
+
+static void StopAsyncValidationSubscriber(AsyncValidationSubscriber& subscriber) {
+    for (boost::signals2::connection& connection : subscriber.vConnections) {
+        connection.disconnect();
+    }
+    subscriber.queue->Stop();
+    const ValidationQueueStats stats = subscriber.queue->GetStats();
+    LogPrint(BCLog::BENCH, "%s: %u validation notifications delivered, %u overflows, at most %u queued, delay %.2fms avg %.2fms max\n", stats.strName,
+        stats.nDelivered, stats.nOverflows, stats.nPeakQueued, stats.nDelivered ? 0.001 * stats.nTotalDelayMicros / stats.nDelivered : 0, 0.001 * stats.nMaxDelayMicros);
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    // Stopped outside the lock, as the listener may still be busy with its queue
+    AsyncValidationSubscriber subscriber;
+    {
+        LOCK(g_signals.m_internals->cs_asyncSubscribers);
+        auto it = g_signals.m_internals->m_asyncSubscribers.find(pwalletIn);
+        if (it != g_signals.m_internals->m_asyncSubscribers.end()) {
+            subscriber = std::move(it->second);
+            g_signals.m_internals->m_asyncSubscribers.erase(it);
+        }
+    }
+    if (subscriber.queue) {
+        StopAsyncValidationSubscriber(subscriber);
+        return;
+    }
+
     g_signals.m_internals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.m_internals->Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
     g_signals.m_internals->SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
+    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1, _2));
+    g_signals.m_internals->TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1, _2, _3));
     g_signals.m_internals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
     g_signals.m_internals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
     g_signals.m_internals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.m_internals->NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
     g_signals.m_internals->BlockFound.disconnect(boost::bind(&CValidationInterface::BlockFound, pwalletIn, _1));
     g_signals.m_internals->NewTokenMessage.disconnect(boost::bind(&CValidationInterface::NewTokenMessage, pwalletIn, _1));
+    g_signals.m_internals->ValidatorSetChanged.disconnect(boost::bind(&CValidationInterface::ValidatorSetChanged, pwalletIn, _1));
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -99,20 +307,39 @@ void UnregisterAllValidationInterfaces() {
     g_signals.m_internals->Broadcast.disconnect_all_slots();
     g_signals.m_internals->SetBestChain.disconnect_all_slots();
     g_signals.m_internals->TransactionAddedToMempool.disconnect_all_slots();
+    g_signals.m_internals->TransactionRemovedFromMempool.disconnect_all_slots();
     g_signals.m_internals->BlockConnected.disconnect_all_slots();
     g_signals.m_internals->BlockDisconnected.disconnect_all_slots();
     g_signals.m_internals->UpdatedBlockTip.disconnect_all_slots();
     g_signals.m_internals->NewPoWValidBlock.disconnect_all_slots();
     g_signals.m_internals->BlockFound.disconnect_all_slots();
     g_signals.m_internals->NewTokenMessage.disconnect_all_slots();
+    g_signals.m_internals->ValidatorSetChanged.disconnect_all_slots();
+
+    std::map<CValidationInterface*, AsyncValidationSubscriber> mapAsyncSubscribers;
+    {
+        LOCK(g_signals.m_internals->cs_asyncSubscribers);
+        mapAsyncSubscribers.swap(g_signals.m_internals->m_asyncSubscribers);
+    }
+    for (auto& subscriber : mapAsyncSubscribers) {
+        StopAsyncValidationSubscriber(subscriber.second);
+    }
 }
 
 void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {
     m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
 }
 
-void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->TransactionAddedToMempool(ptx);
+void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx, uint64_t nMempoolSequence) {
+    m_internals->TransactionAddedToMempool(ptx, nMempoolSequence);
+}
+
+void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {
+    // Pools that run without the signals, as in the benchmarks, still evict
+    if (!m_internals) {
+        return;
+    }
+    m_internals->TransactionRemovedFromMempool(ptx, reason, nMempoolSequence);
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) {
@@ -146,3 +373,7 @@ void CMainSignals::BlockFound(const uint256 &hash) {
 void CMainSignals::NewTokenMessage(const CMessage& message) {
     m_internals->NewTokenMessage(message);
 }
+
+void CMainSignals::ValidatorSetChanged(const std::shared_ptr<const CValidatorSet> &validators) {
+    m_internals->ValidatorSetChanged(validators);
+}
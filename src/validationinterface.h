@@ -8,6 +8,8 @@
 #define PLB_VALIDATIONINTERFACE_H
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "primitives/transaction.h" // CTransaction(Ref)
 
@@ -22,6 +24,8 @@ class CValidationState;
 class uint256;
 class CScheduler;
 class CMessage;
+class CValidatorSet;
+enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
@@ -32,6 +36,36 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
 
+static const size_t DEFAULT_VALIDATION_QUEUE_SIZE = 1000;
+
+/**
+ * Register a listener whose notifications are queued and delivered on a thread
+ * of its own, in the order they were signalled, so a slow listener does not hold
+ * up validation or the other listeners. BlockChecked and NewPoWValidBlock stay
+ * synchronous, as they are only meaningful while validation waits for them.
+ * A queue longer than nMaxQueued is counted and logged as an overflow; the
+ * signalling thread does not wait for room, as it may hold cs_main, which the
+ * listener may need to catch up. UnregisterValidationInterface delivers what is
+ * left in the queue and stops the thread.
+ */
+void RegisterAsyncValidationInterface(CValidationInterface* pwalletIn, const std::string& strName, size_t nMaxQueued = DEFAULT_VALIDATION_QUEUE_SIZE);
+
+/** Delivery counts of a listener registered with RegisterAsyncValidationInterface */
+struct ValidationQueueStats {
+    std::string strName;
+    size_t nQueued;
+    size_t nPeakQueued;
+    size_t nMaxQueued;
+    uint64_t nDelivered;
+    //! Notifications queued behind nMaxQueued others
+    uint64_t nOverflows;
+    //! From being signalled to being delivered
+    int64_t nTotalDelayMicros;
+    int64_t nMaxDelayMicros;
+};
+
+std::vector<ValidationQueueStats> GetValidationQueueStats();
+
 class CValidationInterface {
 protected:
     /**
@@ -42,8 +76,16 @@ protected:
     ~CValidationInterface() = default;
     /** Notifies listeners of updated block chain tip */
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {}
-    /** Notifies listeners of a transaction having been added to mempool. */
-    virtual void TransactionAddedToMempool(const CTransactionRef &ptxn) {}
+    /**
+     * Notifies listeners of a transaction having been added to mempool.
+     * nMempoolSequence numbers the additions and removals in the order they changed the pool.
+     */
+    virtual void TransactionAddedToMempool(const CTransactionRef &ptxn, uint64_t nMempoolSequence) {}
+    /**
+     * Notifies listeners of a transaction having left the mempool, for any reason but being
+     * included in a block, which BlockConnected covers.
+     */
+    virtual void TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {}
     /**
      * Notifies listeners of a block being connected.
      * Provides a vector of transactions evicted from the mempool as a result.
@@ -69,8 +111,11 @@ protected:
 
     virtual void BlockFound(const uint256 &hash) {};
     virtual void NewTokenMessage(const CMessage &message) {};
+    /** Notifies listeners of a new snapshot of the authorized validator scripts, after the blocks that changed it are connected or disconnected */
+    virtual void ValidatorSetChanged(const std::shared_ptr<const CValidatorSet> &validators) {};
 
     friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterAsyncValidationInterface(CValidationInterface*, const std::string&, size_t);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
 };
@@ -82,8 +127,10 @@ private:
     std::unique_ptr<MainSignalsInstance> m_internals;
 
     friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterAsyncValidationInterface(CValidationInterface*, const std::string&, size_t);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
+    friend std::vector<ValidationQueueStats> (::GetValidationQueueStats)();
 
 public:
     /** Register a CScheduler to give callbacks which should run in the background (may only be called once) */
@@ -94,7 +141,8 @@ public:
     void FlushBackgroundCallbacks();
 
     void UpdatedBlockTip(const CBlockIndex *, const CBlockIndex *, bool fInitialDownload);
-    void TransactionAddedToMempool(const CTransactionRef &);
+    void TransactionAddedToMempool(const CTransactionRef &, uint64_t nMempoolSequence);
+    void TransactionRemovedFromMempool(const CTransactionRef &, MemPoolRemovalReason, uint64_t nMempoolSequence);
     void BlockConnected(const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef> &);
     void BlockDisconnected(const std::shared_ptr<const CBlock> &);
     void SetBestChain(const CBlockLocator &);
@@ -103,6 +151,7 @@ public:
     void NewPoWValidBlock(const CBlockIndex *, const std::shared_ptr<const CBlock>&);
     void BlockFound(const uint256 &);
     void NewTokenMessage(const CMessage&);
+    void ValidatorSetChanged(const std::shared_ptr<const CValidatorSet> &);
 
 };
 
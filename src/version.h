@@ -10,7 +10,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70028;
+static const int PROTOCOL_VERSION = 70029;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -57,5 +57,8 @@ static const int TOKENDATA_VERSION_UPDATED = 70020;
 //! In this version messaging and restricted tokens was introduced
 static const int MESSAGING_RESTRICTED_TOKENS_VERSION = 70026;
 
+//! "sendtxrcncl" may be sent before verack, and transaction announcements reconciled, starting with this version
+static const int TXRECONCILIATION_PROTO_VERSION = 70029;
+
 
 #endif // PLB_VERSION_H
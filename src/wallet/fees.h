@@ -8,6 +8,7 @@
 #define PLB_WALLET_FEES_H
 
 #include "amount.h"
+#include "policy/fees.h"
 
 class CBlockPolicyEstimator;
 class CCoinControl;
@@ -25,7 +26,8 @@ CAmount GetRequiredFee(unsigned int nTxBytes);
  * Estimate the minimum fee considering user set parameters
  * and the required fee
  */
-CAmount GetMinimumFee(unsigned int nTxBytes, const CCoinControl& coin_control, const CTxMemPool& pool, const CBlockPolicyEstimator& estimator, FeeCalculation *feeCalc);
+CAmount GetMinimumFee(unsigned int nTxBytes, const CCoinControl& coin_control, const CTxMemPool& pool, const CBlockPolicyEstimator& estimator, FeeCalculation *feeCalc,
+                      FeeEstimateClass estimateClass = FeeEstimateClass::ANY);
 
 /**
  * Return the maximum feerate for discarding change.
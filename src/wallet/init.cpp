@@ -33,8 +33,15 @@ std::string GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-mnemonicpassphrase=<passphrase>", strprintf(_("Passphrase securing your 12-word mnemonic word-list")));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"), CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanaddressindex", strprintf(_("With -addressindex, only read the blocks it lists for the wallet's keys and scripts when rescanning. "
+                                                                     "Wallets holding offline staking or watch-only scripts without an address read every block (default: %u)"), DEFAULT_RESCAN_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Number of threads reading and matching blocks ahead when rescanning (default: %d)"), DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
+    strUsage += HelpMessageOpt("-stakecombinethreshold=<amt>", strprintf(_("Add outputs worth less than this (in %s) to the coinstake and, with -stakeconsolidate, combine them (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_STAKE_COMBINE_THRESHOLD)));
+    strUsage += HelpMessageOpt("-stakeconsolidate", strprintf(_("Periodically combine the stake outputs worth less than -stakecombinethreshold that pay the same address into one (default: %u)"), DEFAULT_STAKE_CONSOLIDATE));
+    strUsage += HelpMessageOpt("-stakesplitthreshold=<amt>", strprintf(_("Split coinstakes worth more than this (in %s) into outputs worth less, 0 to never split (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_STAKE_SPLIT_THRESHOLD)));
+    strUsage += HelpMessageOpt("-stakethreads=<n>", strprintf(_("Number of threads to search for a stake kernel on (default: %d)"), DEFAULT_STAKE_THREADS));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
     strUsage += HelpMessageOpt("-walletrbf", strprintf(_("Send transactions with full-RBF opt-in enabled (default: %u)"), DEFAULT_WALLET_RBF));
@@ -174,6 +181,19 @@ bool WalletParameterInteraction()
                                        gArgs.GetArg("-maxtxfee", ""), ::minRelayTxFee.ToString()));
         }
     }
+    if (gArgs.IsArgSet("-stakesplitthreshold"))
+    {
+        if (!ParseMoney(gArgs.GetArg("-stakesplitthreshold", ""), nStakeSplitThreshold))
+            return InitError(AmountErrMsg("stakesplitthreshold", gArgs.GetArg("-stakesplitthreshold", "")));
+    }
+    if (gArgs.IsArgSet("-stakecombinethreshold"))
+    {
+        if (!ParseMoney(gArgs.GetArg("-stakecombinethreshold", ""), nStakeCombineThreshold))
+            return InitError(AmountErrMsg("stakecombinethreshold", gArgs.GetArg("-stakecombinethreshold", "")));
+    }
+    // Split outputs are worth at least half the split threshold, they must not be combined again
+    if (nStakeSplitThreshold > 0 && nStakeCombineThreshold > nStakeSplitThreshold / 2)
+        return InitError(_("-stakecombinethreshold can be at most half of -stakesplitthreshold"));
     nTxConfirmTarget = gArgs.GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
     bSpendZeroConfChange = gArgs.GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     fWalletRbf = gArgs.GetBoolArg("-walletrbf", DEFAULT_WALLET_RBF);
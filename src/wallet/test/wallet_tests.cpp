@@ -12,9 +12,11 @@
 #include <vector>
 
 #include "consensus/validation.h"
+#include "policy/policy.h"
 #include "rpc/server.h"
 #include "test/test_paladeum.h"
 #include "validation.h"
+#include "tokens/tokens.h"
 #include "wallet/coincontrol.h"
 #include "wallet/test/wallet_test_fixture.h"
 
@@ -377,12 +379,160 @@ BOOST_FIXTURE_TEST_SUITE(wallet_tests, WalletTestingSetup)
         empty_wallet();
     }
 
+    // Token amounts are carried by the test coins' values, vCoins is filled largest first
+    static std::vector<CTokenInputCoin> token_bucket()
+    {
+        std::vector<CTokenInputCoin> vTokens;
+        for (const COutput& output : vCoins)
+            vTokens.emplace_back(output, output.tx->tx->vout[output.i].nValue);
+        return vTokens;
+    }
+
+    BOOST_AUTO_TEST_CASE(token_coin_selection_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token Coin Selection Test");
+
+        CoinSet setCoinsRet;
+        CAmount nValueRet;
+
+        LOCK(testWallet.cs_wallet);
+
+        for (int i = 0; i < RUN_TESTS; i++)
+        {
+            // an exact match needs no token change
+            empty_wallet();
+            add_coin(7 * COIN);
+            add_coin(5 * COIN);
+            add_coin(4 * COIN);
+            add_coin(3 * COIN);
+            BOOST_CHECK(testWallet.SelectTokensMinConf(8 * COIN, 1, 6, 0, "TOKEN", token_bucket(), setCoinsRet, nValueRet));
+            BOOST_CHECK_EQUAL(nValueRet, 8 * COIN);
+            BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+            // between exact matches the one with fewer inputs wins
+            empty_wallet();
+            add_coin(6 * COIN);
+            for (int j = 0; j < 4; j++)
+                add_coin(2 * COIN);
+            BOOST_CHECK(testWallet.SelectTokensMinConf(8 * COIN, 1, 6, 0, "TOKEN", token_bucket(), setCoinsRet, nValueRet));
+            BOOST_CHECK_EQUAL(nValueRet, 8 * COIN);
+            BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+            // a sweep of many equal coins is still exact
+            empty_wallet();
+            for (int j = 0; j < 50; j++)
+                add_coin(1 * COIN);
+            BOOST_CHECK(testWallet.SelectTokensMinConf(20 * COIN, 1, 6, 0, "TOKEN", token_bucket(), setCoinsRet, nValueRet));
+            BOOST_CHECK_EQUAL(nValueRet, 20 * COIN);
+            BOOST_CHECK_EQUAL(setCoinsRet.size(), 20U);
+
+            // without an exact match the smallest larger coin is taken
+            empty_wallet();
+            add_coin(10 * COIN);
+            add_coin(4 * COIN);
+            add_coin(4 * COIN);
+            BOOST_CHECK(testWallet.SelectTokensMinConf(9 * COIN, 1, 6, 0, "TOKEN", token_bucket(), setCoinsRet, nValueRet));
+            BOOST_CHECK_EQUAL(nValueRet, 10 * COIN);
+            BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+            // and nothing is selected when the coins can't reach the target
+            BOOST_CHECK(!testWallet.SelectTokensMinConf(19 * COIN, 1, 6, 0, "TOKEN", token_bucket(), setCoinsRet, nValueRet));
+        }
+
+        empty_wallet();
+    }
+
     static void AddKey(CWallet &wallet, const CKey &key)
     {
         LOCK(wallet.cs_wallet);
         wallet.AddKeyPubKey(key, key.GetPubKey());
     }
 
+    BOOST_AUTO_TEST_CASE(ismine_filter_test)
+    {
+        CWallet wallet;
+        LOCK2(cs_main, wallet.cs_wallet);
+
+        CKey key, keyOther, keyWatched;
+        key.MakeNewKey(true);
+        keyOther.MakeNewKey(true);
+        keyWatched.MakeNewKey(false);
+        wallet.AddKeyPubKey(key, key.GetPubKey());
+
+        CScript scriptToken = GetScriptForDestination(key.GetPubKey().GetID());
+        CTokenTransfer("TOKEN", COIN, 0).ConstructTransaction(scriptToken);
+        CScript scriptRedeem = GetScriptForMultisig(1, {key.GetPubKey()});
+        CScript scriptWatched = GetScriptForRawPubKey(keyWatched.GetPubKey());
+
+        std::vector<CScript> vScripts = {
+            GetScriptForDestination(key.GetPubKey().GetID()),
+            GetScriptForRawPubKey(key.GetPubKey()),
+            scriptToken,
+            GetScriptForDestination(keyOther.GetPubKey().GetID()),
+            GetScriptForRawPubKey(keyOther.GetPubKey()),
+            GetScriptForDestination(CScriptID(scriptRedeem)),
+            GetScriptForDestination(keyWatched.GetPubKey().GetID()),
+            scriptWatched,
+        };
+
+        // the filter never drops a script IsMine() would accept, and answers the rest
+        auto check = [&](const std::vector<bool>& vExpected) {
+            for (size_t i = 0; i < vScripts.size(); i++) {
+                BOOST_CHECK_EQUAL(wallet.MayBeMine(vScripts[i]), vExpected[i]);
+                BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(0, vScripts[i])) != ISMINE_NO, vExpected[i]);
+            }
+        };
+        check({true, true, true, false, false, false, false, false});
+
+        // scripts and watch-only entries added later are picked up
+        wallet.AddCScript(scriptRedeem);
+        wallet.AddWatchOnly(scriptWatched, 0);
+        check({true, true, true, false, false, true, false, true});
+
+        wallet.RemoveWatchOnly(scriptWatched);
+        check({true, true, true, false, false, true, false, false});
+
+        // forms the filter doesn't cover are left to IsMine()
+        BOOST_CHECK(wallet.MayBeMine(scriptRedeem));
+    }
+
+    BOOST_AUTO_TEST_CASE(sign_inputs_test)
+    {
+        CWallet wallet;
+        CKey key;
+        key.MakeNewKey(true);
+        wallet.LoadKey(key, key.GetPubKey());
+
+        CMutableTransaction tx;
+        std::vector<CTxOut> vPrevOuts;
+        for (int i = 0; i < 40; i++) {
+            CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+            if (i % 2)
+                CTokenTransfer("TOKEN", COIN, 0).ConstructTransaction(script);
+            vPrevOuts.emplace_back(i % 2 ? 0 : COIN, script);
+            tx.vin.emplace_back(COutPoint(uint256S(strprintf("%064x", i + 1)), 0));
+        }
+        tx.vout.emplace_back(COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+
+        // signatures are deterministic, so the threads must produce the serial result
+        CMutableTransaction txSerial(tx), txParallel(tx);
+        unsigned int nFailedIn;
+        BOOST_CHECK(wallet.SignInputs(txSerial, vPrevOuts, nFailedIn, 1));
+        BOOST_CHECK(wallet.SignInputs(txParallel, vPrevOuts, nFailedIn, 4));
+        BOOST_CHECK(CTransaction(txSerial) == CTransaction(txParallel));
+        const CTransaction txSigned(txParallel);
+        for (unsigned int i = 0; i < txSigned.vin.size(); i++)
+            BOOST_CHECK(VerifyScript(txSigned.vin[i].scriptSig, vPrevOuts[i].scriptPubKey, &txSigned.vin[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txSigned, i, vPrevOuts[i].nValue)));
+
+        // an input of a key the wallet doesn't hold is reported
+        CKey keyOther;
+        keyOther.MakeNewKey(true);
+        vPrevOuts[25].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+        CMutableTransaction txFailed(tx);
+        BOOST_CHECK(!wallet.SignInputs(txFailed, vPrevOuts, nFailedIn, 4));
+        BOOST_CHECK_EQUAL(nFailedIn, 25U);
+    }
+
     BOOST_FIXTURE_TEST_CASE(rescan_test, TestChain100Setup)
     {
 
@@ -549,6 +699,141 @@ BOOST_FIXTURE_TEST_SUITE(wallet_tests, WalletTestingSetup)
         BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 5000 * COIN);
     }
 
+// Coinstakes are counted in the stake ledger once confirmed and skipped by the
+// balance walks once mature and spent.
+    BOOST_FIXTURE_TEST_CASE(stake_ledger_test, TestChain100Setup)
+    {
+        BOOST_TEST_MESSAGE("Running Stake Ledger Test");
+
+        CWallet wallet;
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+
+        // A mature coinstake paying 10 to the wallet, and an immature one paying 20
+        std::vector<uint256> vStakes;
+        for (int nHeight : {50, chainActive.Height()}) {
+            CMutableTransaction stake;
+            stake.vin.resize(1);
+            stake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            stake.vout.resize(2);
+            stake.vout[0].SetEmpty();
+            stake.vout[1].nValue = (nHeight == 50 ? 10 : 20) * COIN;
+            stake.vout[1].scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+            CWalletTx wtx(&wallet, MakeTransactionRef(stake));
+            wtx.SetMerkleBranch(chainActive[nHeight], 1);
+            wallet.AddToWallet(wtx);
+            vStakes.push_back(wtx.GetHash());
+        }
+
+        BOOST_CHECK_EQUAL(wallet.GetStake(), 20 * COIN);
+        CStakeRewardPeriod rewards = wallet.GetStakeRewards(0);
+        BOOST_CHECK_EQUAL(rewards.nCount, 2U);
+        BOOST_CHECK_EQUAL(rewards.nReward, 30 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetStakeRewards(chainActive.Tip()->GetBlockTime() + STAKE_LEDGER_PERIOD).nCount, 0U);
+        BOOST_CHECK(!wallet.mapWallet.at(vStakes[0]).fStakeSettled);
+
+        // Spending the mature coinstake in a block settles it
+        CMutableTransaction spend;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(vStakes[0], 1);
+        spend.vout.resize(1);
+        spend.vout[0].nValue = 10 * COIN;
+        spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        CWalletTx wtxSpend(&wallet, MakeTransactionRef(spend));
+        wtxSpend.SetMerkleBranch(chainActive[60], 1);
+        wallet.AddToWallet(wtxSpend);
+
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+        BOOST_CHECK(wallet.mapWallet.at(vStakes[0]).fStakeSettled);
+        BOOST_CHECK(!wallet.mapWallet.at(vStakes[1]).fStakeSettled);
+        BOOST_CHECK_EQUAL(wallet.GetStakeRewards(0).nReward, 30 * COIN);
+
+        // A disconnect re-indexes the wallet to the same state
+        wallet.BlockDisconnected(std::make_shared<const CBlock>());
+        BOOST_CHECK_EQUAL(wallet.GetStakeRewards(0).nCount, 2U);
+        BOOST_CHECK(wallet.mapWallet.at(vStakes[0]).fStakeSettled);
+    }
+
+// Cached balances follow new transactions and keys without a tip change.
+    BOOST_AUTO_TEST_CASE(stake_split_outputs_test)
+    {
+        CAmount nOldThreshold = nStakeSplitThreshold;
+        nStakeSplitThreshold = 200 * COIN;
+
+        // Below the threshold the coinstake keeps one output, above it each is worth half of it to all of it
+        BOOST_CHECK_EQUAL(GetStakeSplitOutputs(199 * COIN), 1U);
+        BOOST_CHECK_EQUAL(GetStakeSplitOutputs(200 * COIN), 2U);
+        BOOST_CHECK_EQUAL(GetStakeSplitOutputs(399 * COIN), 2U);
+        BOOST_CHECK_EQUAL(GetStakeSplitOutputs(400 * COIN), 3U);
+        BOOST_CHECK_EQUAL(GetStakeSplitOutputs(1000000 * COIN), MAX_STAKE_SPLIT_OUTPUTS);
+
+        // Never split
+        nStakeSplitThreshold = 0;
+        BOOST_CHECK_EQUAL(GetStakeSplitOutputs(1000000 * COIN), 1U);
+
+        nStakeSplitThreshold = nOldThreshold;
+    }
+
+    BOOST_AUTO_TEST_CASE(wallet_write_batch_test)
+    {
+        LOCK(pwalletMain->cs_wallet);
+
+        std::vector<uint256> vHashes;
+        {
+            CWalletWriteBatch batch(*pwalletMain);
+            // A batch in the scope of another leaves the commit to it
+            CWalletWriteBatch nested(*pwalletMain);
+            for (int i = 0; i < 3; i++) {
+                CMutableTransaction tx;
+                tx.vin.emplace_back(COutPoint(uint256S(strprintf("%064x", i + 1)), 0));
+                tx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+                CWalletTx wtx(pwalletMain, MakeTransactionRef(std::move(tx)));
+                BOOST_CHECK(pwalletMain->AddToWallet(wtx, false));
+                vHashes.push_back(wtx.GetHash());
+            }
+        }
+
+        // Every transaction was written by the time the batch went out of scope
+        std::vector<uint256> vTxHash;
+        std::vector<CWalletTx> vWtx;
+        CWalletDB walletdb(pwalletMain->GetDBHandle());
+        BOOST_CHECK(walletdb.FindWalletTx(vTxHash, vWtx) == DB_LOAD_OK);
+        for (const uint256& hash : vHashes)
+            BOOST_CHECK_EQUAL(std::count(vTxHash.begin(), vTxHash.end(), hash), 1);
+    }
+
+    BOOST_FIXTURE_TEST_CASE(balance_cache_test, TestChain100Setup)
+    {
+        BOOST_TEST_MESSAGE("Running Balance Cache Test");
+
+        CWallet wallet;
+        LOCK2(cs_main, wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[0].scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+        CWalletTx wtx(&wallet, MakeTransactionRef(tx));
+        wtx.SetMerkleBranch(chainActive[50], 1);
+        wallet.AddToWallet(wtx);
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 10 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetBalances().nBalance, 10 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 0);
+
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout[0].nValue = 5 * COIN;
+        CWalletTx wtx2(&wallet, MakeTransactionRef(tx));
+        wtx2.SetMerkleBranch(chainActive[51], 1);
+        wallet.AddToWallet(wtx2);
+        BOOST_CHECK_EQUAL(wallet.GetBalance(), 15 * COIN);
+    }
+
     static int64_t AddTx(CWallet &wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
     {
         CMutableTransaction tx;
@@ -621,6 +906,43 @@ BOOST_FIXTURE_TEST_SUITE(wallet_tests, WalletTestingSetup)
         BOOST_CHECK_EQUAL(values[1], "val_rr1");
     }
 
+    BOOST_AUTO_TEST_CASE(GenerateNewKeys_Test)
+    {
+        BOOST_TEST_MESSAGE("Running GenerateNewKeys Test");
+
+        LOCK(pwalletMain->cs_wallet);
+        CKey seed;
+        seed.MakeNewKey(true);
+        BOOST_CHECK(pwalletMain->SetHDSeed(pwalletMain->DeriveNewSeed(seed)));
+
+        // The keys at m/0'/0'/<n>', derived one by one from the seed
+        const uint32_t nHardened = 0x80000000;
+        CExtKey masterKey, accountKey, chainKey;
+        masterKey.SetSeed(seed.begin(), seed.size());
+        masterKey.Derive(accountKey, nHardened);
+        accountKey.Derive(chainKey, nHardened);
+        std::vector<CPubKey> vExpected;
+        for (unsigned int n = 0; n < 6; n++) {
+            CExtKey childKey;
+            chainKey.Derive(childKey, nHardened | n);
+            vExpected.push_back(childKey.key.GetPubKey());
+        }
+
+        CWalletDB walletdb(pwalletMain->GetDBHandle());
+        std::vector<CPubKey> vPubKeys = pwalletMain->GenerateNewKeys(walletdb, 5);
+        vPubKeys.push_back(pwalletMain->GenerateNewKey(walletdb));
+        BOOST_CHECK(vPubKeys == vExpected);
+        for (unsigned int n = 0; n < vPubKeys.size(); n++) {
+            BOOST_CHECK(pwalletMain->HaveKey(vPubKeys[n].GetID()));
+            BOOST_CHECK_EQUAL(pwalletMain->mapKeyMetadata[vPubKeys[n].GetID()].hdKeypath, strprintf("m/0'/0'/%u'", n));
+        }
+        BOOST_CHECK(pwalletMain->GenerateNewKeys(walletdb, 0).empty());
+
+        // A batched top up fills the keypool with the next keys of the chain
+        BOOST_CHECK(pwalletMain->TopUpKeyPool(10));
+        BOOST_CHECK_EQUAL(pwalletMain->KeypoolCountExternalKeys(), 10U);
+    }
+
     class ListCoinsTestingSetup : public TestChain100Setup
     {
     public:
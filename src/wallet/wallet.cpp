@@ -17,6 +17,7 @@
 #include "init.h"
 #include "key.h"
 #include "keystore.h"
+#include "metrics.h"
 #include "validation.h"
 #include "net.h"
 #include "policy/fees.h"
@@ -37,6 +38,9 @@
 #include <miner.h>
 
 #include <assert.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -55,14 +59,18 @@ const char * DEFAULT_WALLET_DAT = "wallet.dat";
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
 
 CAmount nReserveBalance = 0;
+CAmount nStakeSplitThreshold = DEFAULT_STAKE_SPLIT_THRESHOLD;
+CAmount nStakeCombineThreshold = DEFAULT_STAKE_COMBINE_THRESHOLD;
 
 unsigned int GetStakeMaxCombineInputs() { return 100; }
 
-int64_t GetStakeCombineThreshold() { return 100 * COIN; }
-
-unsigned int GetStakeSplitOutputs() { return 2; }
-
-int64_t GetStakeSplitThreshold() { return GetStakeSplitOutputs() * GetStakeCombineThreshold(); }
+unsigned int GetStakeSplitOutputs(CAmount nCredit)
+{
+    // Each of the n outputs gets between half the split threshold and the threshold
+    if (nStakeSplitThreshold <= 0 || nCredit < nStakeSplitThreshold)
+        return 1;
+    return (unsigned int)std::min<CAmount>(MAX_STAKE_SPLIT_OUTPUTS, nCredit / nStakeSplitThreshold + 1);
+}
 
 std::string my_words;
 std::string my_passphrase;
@@ -97,15 +105,6 @@ struct CompareValueOnly
     }
 };
 
-struct CompareTokenValueOnly
-{
-    bool operator()(const std::pair<CInputCoin, CAmount>& t1,
-                    const std::pair<CInputCoin, CAmount>& t2) const
-    {
-        return t1.second < t2.second;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->tx->vout[i].nValue));
@@ -180,7 +179,7 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
 
     // Compressed public keys were introduced in version 0.6.0
     if (fCompressed) {
-        SetMinVersion(FEATURE_COMPRPUBKEY);
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
     }
 
     CPubKey pubkey = secret.GetPubKey();
@@ -195,7 +194,63 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
     return pubkey;
 }
 
+std::vector<CPubKey> CWallet::GenerateNewKeys(CWalletDB& walletdb, unsigned int nCount, bool internal)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    std::vector<CPubKey> vPubKeys;
+    vPubKeys.reserve(nCount);
+    if (!IsHDEnabled()) {
+        for (unsigned int i = 0; i < nCount; i++)
+            vPubKeys.push_back(GenerateNewKey(walletdb, internal));
+        return vPubKeys;
+    }
+    if (nCount == 0)
+        return vPubKeys;
+
+    internal = CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false;
+    int64_t nCreationTime = GetTime();
+    CExtKey chainChildKey;
+    DeriveChainKey(chainChildKey, internal);
+    // Compressed public keys were introduced in version 0.6.0
+    if (CanSupportFeature(FEATURE_COMPRPUBKEY)) {
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
+    }
+
+    for (unsigned int i = 0; i < nCount; i++) {
+        CKeyMetadata metadata(nCreationTime);
+        CKey secret;
+        CPubKey pubkey;
+        DeriveNextChildKey(chainChildKey, metadata, secret, pubkey, internal);
+        assert(secret.VerifyPubKey(pubkey));
+
+        mapKeyMetadata[pubkey.GetID()] = metadata;
+        if (!AddKeyPubKeyWithDB(walletdb, secret, pubkey)) {
+            throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+        }
+        vPubKeys.push_back(pubkey);
+    }
+    UpdateTimeFirstKey(nCreationTime);
+
+    // update the chain model in the database
+    if (!walletdb.WriteHDChain(hdChain))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+    return vPubKeys;
+}
+
 void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+{
+    CExtKey chainChildKey;
+    DeriveChainKey(chainChildKey, internal);
+    CPubKey pubkey;
+    DeriveNextChildKey(chainChildKey, metadata, secret, pubkey, internal);
+
+    // update the chain model in the database
+    if (!walletdb.WriteHDChain(hdChain))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+
+}
+
+void CWallet::DeriveChainKey(CExtKey& chainChildKey, bool internal)
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CExtKey masterKey;             //hd master key
@@ -204,9 +259,6 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
     CExtKey coinTypeKey;            //key at m/purpose'/coin_type'
 
     CExtKey accountKey;            //key at m/0'
-    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
-
 
     uint32_t nAccountIndex = 0; // TODO add HDAccounts management
 
@@ -220,41 +272,50 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
         masterKey.SetSeed(g_vchSeed.data(), g_vchSeed.size());
     }
 
+    if(hdChain.IsBip44())
+    {
+        // Use BIP44 keypath scheme i.e. m / purpose' / coin_type' / account' / change / address_index
+
+        // derive m/purpose'
+        masterKey.Derive(purposeKey, 44 | BIP32_HARDENED_KEY_LIMIT);
+        // derive m/purpose'/coin_type'
+        purposeKey.Derive(coinTypeKey, GetParams().ExtCoinType() | BIP32_HARDENED_KEY_LIMIT);
+        // derive m/purpose'/coin_type'/account'
+        coinTypeKey.Derive(accountKey, nAccountIndex | BIP32_HARDENED_KEY_LIMIT);
+        // derive m/purpose'/coin_type'/account'/change
+        accountKey.Derive(chainChildKey, internal ? 1 : 0);
+    }
+    else
+    {
+        // Use BIP32 keypath scheme i.e. m / account' / change' / address_index'
+
+        // derive m/account'
+        masterKey.Derive(accountKey, nAccountIndex | BIP32_HARDENED_KEY_LIMIT);
+        // derive m/account'/change
+        accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT + (internal ? 1 : 0));
+    }
+}
+
+void CWallet::DeriveNextChildKey(const CExtKey& chainChildKey, CKeyMetadata& metadata, CKey& secret, CPubKey& pubkey, bool internal)
+{
+    CExtKey childKey;              //key at m/0'/0'/<n>'
+    uint32_t nAccountIndex = 0;
+
     // Select which chain we are using depending on if this is a change address or not
     uint32_t& nChildIndex = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
 
     do {
-
-			if(hdChain.IsBip44())
-			{
-				// Use BIP44 keypath scheme i.e. m / purpose' / coin_type' / account' / change / address_index
-
-				// derive m/purpose'
-				masterKey.Derive(purposeKey, 44 | BIP32_HARDENED_KEY_LIMIT);
-				// derive m/purpose'/coin_type'
-				purposeKey.Derive(coinTypeKey, GetParams().ExtCoinType() | BIP32_HARDENED_KEY_LIMIT);
-				// derive m/purpose'/coin_type'/account'
-				coinTypeKey.Derive(accountKey, nAccountIndex | BIP32_HARDENED_KEY_LIMIT);
-				// derive m/purpose'/coin_type'/account'/change
-				accountKey.Derive(chainChildKey, internal ? 1 : 0);
-				// derive m/purpose'/coin_type'/account'/change/address_index
-				chainChildKey.Derive(childKey, nChildIndex);
-			}
-			else
-			{
-				// Use BIP32 keypath scheme i.e. m / account' / change' / address_index'
-
-				// derive m/account'
-				masterKey.Derive(accountKey, nAccountIndex | BIP32_HARDENED_KEY_LIMIT);
-				// derive m/account'/change
-				accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT + (internal ? 1 : 0));
-				// derive m/account'/change/address_index
-				chainChildKey.Derive(childKey, BIP32_HARDENED_KEY_LIMIT |  nChildIndex);
-			}
+        if(hdChain.IsBip44())
+            // derive m/purpose'/coin_type'/account'/change/address_index
+            chainChildKey.Derive(childKey, nChildIndex);
+        else
+            // derive m/account'/change/address_index
+            chainChildKey.Derive(childKey, BIP32_HARDENED_KEY_LIMIT |  nChildIndex);
 
         // increment childkey index
         nChildIndex++;
-    } while (HaveKey(childKey.key.GetPubKey().GetID()));
+        pubkey = childKey.key.GetPubKey();
+    } while (HaveKey(pubkey.GetID()));
 
     secret = childKey.key;
 
@@ -264,11 +325,6 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
         metadata.hdKeypath = strprintf("m/%d'/%d'/%d'", nAccountIndex, internal, nChildIndex - 1);
 
     metadata.hd_seed_id = hdChain.seed_id;
-
-    // update the chain model in the database
-    if (!walletdb.WriteHDChain(hdChain))
-        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
-
 }
 
 bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const CPubKey &pubkey)
@@ -292,11 +348,11 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
 
     if (!IsCrypted()) {
@@ -435,13 +491,19 @@ bool CWallet::AddWatchOnly(const CScript& dest, int64_t nCreateTime)
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
+{
+    CWalletDB walletdb(*dbw);
+    return RemoveWatchOnlyWithDB(walletdb, dest);
+}
+
+bool CWallet::RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest)
 {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (!CWalletDB(*dbw).EraseWatchOnly(dest))
+    if (!walletdb.EraseWatchOnly(dest))
         return false;
 
     return true;
@@ -1014,6 +1076,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        ++nBalancesTxGeneration;
     }
 }
 
@@ -1046,11 +1109,56 @@ bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
     return success;
 }
 
+CWalletDB& CWallet::GetWalletDB(std::unique_ptr<CWalletDB>& walletdbOwned, bool fFlushOnClose)
+{
+    AssertLockHeld(cs_wallet);
+    if (pwalletdbBatch)
+        return *pwalletdbBatch;
+
+    walletdbOwned.reset(new CWalletDB(*dbw, "r+", fFlushOnClose));
+    return *walletdbOwned;
+}
+
+void CWallet::CommitWriteBatch()
+{
+    AssertLockHeld(cs_wallet);
+    if (!pwalletdbBatch)
+        return;
+
+    if (fBatchTxn && !pwalletdbBatch->TxnCommit())
+        LogPrintf("%s: Committing the wallet write batch failed\n", __func__);
+    fBatchTxn = pwalletdbBatch->TxnBegin();
+}
+
+CWalletWriteBatch::CWalletWriteBatch(CWallet& walletIn) : wallet(walletIn)
+{
+    AssertLockHeld(wallet.cs_wallet);
+    if (wallet.pwalletdbBatch)
+        return;
+
+    // Not flushed on close, the periodic wallet flush takes care of it
+    walletdb.reset(new CWalletDB(*wallet.dbw, "r+", false));
+    wallet.fBatchTxn = walletdb->TxnBegin();
+    wallet.pwalletdbBatch = walletdb.get();
+}
+
+CWalletWriteBatch::~CWalletWriteBatch()
+{
+    if (!walletdb)
+        return;
+
+    if (wallet.fBatchTxn && !walletdb->TxnCommit())
+        LogPrintf("%s: Committing the wallet write batch failed\n", __func__);
+    wallet.fBatchTxn = false;
+    wallet.pwalletdbBatch = nullptr;
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 {
     LOCK(cs_wallet);
 
-    CWalletDB walletdb(*dbw, "r+", fFlushOnClose);
+    std::unique_ptr<CWalletDB> walletdbOwned;
+    CWalletDB& walletdb = GetWalletDB(walletdbOwned, fFlushOnClose);
 
     uint256 hash = wtxIn.GetHash();
 
@@ -1118,6 +1226,16 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     // Break debit/credit balance caches:
     wtx.MarkDirty();
+    ++nBalancesTxGeneration;
+
+    // Its outputs may have become (or stopped being) stake candidates
+    setStakePending.insert(hash);
+
+    // Its outputs, and the token outputs it spends, are re-indexed in the token ledger
+    setTokenLedgerPending.insert(hash);
+
+    // As is its entry in the stake ledger, and the coinstakes it spends
+    setStakeLedgerPending.insert(hash);
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -1134,15 +1252,16 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     return true;
 }
 
-bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
+bool CWallet::LoadToWallet(CWalletTx&& wtxIn)
 {
     uint256 hash = wtxIn.GetHash();
 
-    mapWallet[hash] = wtxIn;
     CWalletTx& wtx = mapWallet[hash];
+    wtx = std::move(wtxIn);
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
     AddToSpends(hash);
+    ++nBalancesTxGeneration;
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
@@ -1207,6 +1326,8 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockI
                     std::map<CKeyID, int64_t>::const_iterator mi = m_pool_key_to_index.find(keyid);
                     if (mi != m_pool_key_to_index.end()) {
                         LogPrintf("%s: Detected a used keypool key, mark all keypool key up to this key as used\n", __func__);
+                        // The keypool is written through handles of its own
+                        CommitWriteBatch();
                         MarkReserveKeysAsUsed(mi->second);
 
                         if (!TopUpKeyPool()) {
@@ -1239,7 +1360,8 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
 {
     LOCK2(cs_main, cs_wallet);
 
-    CWalletDB walletdb(*dbw, "r+");
+    std::unique_ptr<CWalletDB> walletdbOwned;
+    CWalletDB& walletdb = GetWalletDB(walletdbOwned);
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -1272,6 +1394,9 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.setAbandoned();
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
+            setTokenLedgerPending.insert(now);
+            setStakeLedgerPending.insert(now);
+            ++nBalancesTxGeneration;
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(hashTx, 0));
@@ -1315,7 +1440,8 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
         return;
 
     // Do not flush the wallet here for performance reasons
-    CWalletDB walletdb(*dbw, "r+", false);
+    std::unique_ptr<CWalletDB> walletdbOwned;
+    CWalletDB& walletdb = GetWalletDB(walletdbOwned, false);
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -1337,6 +1463,9 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
+            setTokenLedgerPending.insert(now);
+            setStakeLedgerPending.insert(now);
+            ++nBalancesTxGeneration;
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -1383,9 +1512,10 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pin
             it->second.MarkDirty();
         }
     }
+    ++nBalancesTxGeneration;
 }
 
-void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
+void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx, uint64_t nMempoolSequence) {
     LOCK2(cs_main, cs_wallet);
     SyncTransaction(ptx);
 }
@@ -1400,6 +1530,9 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     // to abandon a transaction and then have it inadvertently cleared by
     // the notification that the conflicted transaction was evicted.
 
+    // One database transaction for everything the block changes in the wallet
+    CWalletWriteBatch batch(*this);
+
     for (const CTransactionRef& ptx : vtxConflicted) {
         int posInBlock = ptx->IsCoinStake() ? -1 : 0;
         SyncTransaction(ptx, {} /* block hash */, posInBlock);
@@ -1412,12 +1545,32 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     LOCK2(cs_main, cs_wallet);
 
+    // Depths shift under transactions the block doesn't touch, so the token and stake ledgers are rebuilt
+    fTokenLedgerLoaded = false;
+    fStakeLedgerLoaded = false;
+
+    CWalletWriteBatch batch(*this);
     for (const CTransactionRef& ptx : pblock->vtx) {
         int posInBlock = ptx->IsCoinStake() ? -1 : 0;
         SyncTransaction(ptx, nullptr, posInBlock);
     }
 }
 
+void CWallet::ValidatorSetChanged(const std::shared_ptr<const CValidatorSet>& validators) {
+    LOCK(cs_wallet);
+    validatorSet = validators;
+}
+
+std::shared_ptr<const CValidatorSet> CWallet::GetValidatorSet() const {
+    LOCK(cs_wallet);
+
+    // Nothing published yet (no block has changed the authorization list since startup), take the current one
+    if (!validatorSet)
+        validatorSet = governance->GetValidatorSet();
+
+    return validatorSet;
+}
+
 
 
 isminetype CWallet::IsMine(const CTxIn &txin) const
@@ -1465,9 +1618,36 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter, CTokenO
 
 isminetype CWallet::IsMine(const CTxOut& txout) const
 {
+    if (!MayBeMine(txout.scriptPubKey))
+        return ISMINE_NO;
     return ::IsMine(*this, txout.scriptPubKey, chainActive.Tip());
 }
 
+bool CWallet::MayBeMine(const CScript& scriptPubKey) const
+{
+    uint160 hash;
+    if (!GetIsMineFilterHash(scriptPubKey, hash))
+        return true;
+
+    LOCK(cs_KeyStore);
+    if (nIsMineFilterGeneration != nKeyStoreGeneration) {
+        setIsMineFilter.clear();
+        setIsMineFilter.reserve(mapKeys.size() + mapCryptedKeys.size() + mapScripts.size() + setWatchOnly.size());
+        for (const auto& item : mapKeys)
+            setIsMineFilter.insert(item.first);
+        for (const auto& item : mapCryptedKeys)
+            setIsMineFilter.insert(item.first);
+        for (const auto& item : mapScripts)
+            setIsMineFilter.insert(item.first);
+        uint160 hashWatched;
+        for (const CScript& script : setWatchOnly)
+            if (GetIsMineFilterHash(script, hashWatched))
+                setIsMineFilter.insert(hashWatched);
+        nIsMineFilterGeneration = nKeyStoreGeneration;
+    }
+    return setIsMineFilter.count(hash) > 0;
+}
+
 isminetype CWallet::IsMineDest(const CTxDestination &dest) const
 {
     return ::IsMine(*this, dest, chainActive.Tip());
@@ -1849,28 +2029,60 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
         double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
-        while (pindex && !fAbortRescan)
-        {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        auto progress = [&](CBlockIndex* pindexScan) {
+            if (pindexScan->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindexScan) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexScan->nHeight, GuessVerificationProgress(chainParams.TxData(), pindexScan));
             }
-
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, GetParams().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+        };
+
+        int nThreads = std::max(1, (int)gArgs.GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS));
+        int nEndHeight = pindexStop ? pindexStop->nHeight : chainActive.Height();
+
+        // With the address index only the blocks it lists for our keys and scripts are read. Keys
+        // the rescan adds to the wallet are looked up in turn, from the block that added them on.
+        std::set<std::pair<int, uint160> > setQueried;
+        std::set<int> setHeights;
+        bool fUseAddressIndex = fAddressIndex && gArgs.GetBoolArg("-rescanaddressindex", DEFAULT_RESCAN_ADDRESSINDEX) &&
+                                chainActive.Contains(pindexStart) && GetRescanHeights(setQueried, pindexStart->nHeight, nEndHeight, setHeights);
+
+        std::vector<CBlockIndex*> vBlocks;
+        if (!chainActive.Contains(pindexStart)) {
+            vBlocks.push_back(pindexStart);
+        } else if (!fUseAddressIndex) {
+            for (int nHeight = pindexStart->nHeight; nHeight <= nEndHeight; nHeight++)
+                vBlocks.push_back(chainActive[nHeight]);
+        }
+
+        size_t nPos = 0;
+        if (!fUseAddressIndex) {
+            nPos = ScanBlocks(vBlocks, 0, nThreads, fUpdate, false, ret, progress);
+            pindex = nPos < vBlocks.size() ? vBlocks[nPos] : nullptr;
+        } else {
+            int nNextHeight = pindexStart->nHeight;
+            while (!fAbortRescan) {
+                vBlocks.clear();
+                for (auto it = setHeights.lower_bound(nNextHeight); it != setHeights.end() && *it <= nEndHeight; ++it)
+                    vBlocks.push_back(chainActive[*it]);
+                nPos = ScanBlocks(vBlocks, 0, nThreads, fUpdate, true, ret, progress);
+                if (nPos == vBlocks.size() || fAbortRescan)
+                    break;
+                nNextHeight = vBlocks[nPos - 1]->nHeight + 1;
+                if (!fAbortRescan && !GetRescanHeights(setQueried, nNextHeight, nEndHeight, setHeights)) {
+                    // Whatever the wallet gained keys for can't be found in the index, read the rest of the chain
+                    LogPrintf("Rescan continues without the address index from block %d\n", nNextHeight);
+                    vBlocks.clear();
+                    for (int nHeight = nNextHeight; nHeight <= nEndHeight; nHeight++)
+                        vBlocks.push_back(chainActive[nHeight]);
+                    nPos = ScanBlocks(vBlocks, 0, nThreads, fUpdate, false, ret, progress);
+                    break;
                 }
-            } else {
-                ret = pindex;
             }
-            if (pindex == pindexStop) {
-                break;
-            }
-            pindex = chainActive.Next(pindex);
+            pindex = nPos < vBlocks.size() ? vBlocks[nPos] : nullptr;
         }
+
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
         }
@@ -1881,6 +2093,202 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
     return ret;
 }
 
+size_t CWallet::KeyStoreSize() const
+{
+    LOCK(cs_KeyStore);
+    return mapKeys.size() + mapCryptedKeys.size() + mapWatchKeys.size() + mapScripts.size() + setWatchOnly.size();
+}
+
+bool CWallet::GetRescanHeights(std::set<std::pair<int, uint160> >& setQueried, int nStart, int nEnd, std::set<int>& setHeights) const
+{
+    AssertLockHeld(cs_wallet);
+
+    // The address index has no entries for offline staking scripts
+    if (setQueried.empty()) {
+        for (const std::pair<const uint256, CWalletTx>& item : mapWallet) {
+            for (const CTxOut& txout : item.second.tx->vout) {
+                if (txout.scriptPubKey.IsOfflineStaking())
+                    return false;
+            }
+        }
+    }
+
+    // Keys and P2PK outputs are indexed as type 1 under the key id, scripts as type 2
+    std::vector<std::pair<int, uint160> > vAddresses;
+    {
+        LOCK(cs_KeyStore);
+        for (const CKeyID& keyID : GetKeys())
+            vAddresses.emplace_back(1, keyID);
+        for (const std::pair<const CKeyID, CPubKey>& item : mapWatchKeys)
+            vAddresses.emplace_back(1, item.first);
+        for (const std::pair<const CScriptID, CScript>& item : mapScripts)
+            vAddresses.emplace_back(2, item.first);
+        for (const CScript& script : setWatchOnly) {
+            CTxDestination dest;
+            if (script.IsOfflineStaking() || !ExtractDestination(script, dest))
+                return false;
+            if (const CKeyID* keyID = boost::get<CKeyID>(&dest))
+                vAddresses.emplace_back(1, *keyID);
+            else if (const CScriptID* scriptID = boost::get<CScriptID>(&dest))
+                vAddresses.emplace_back(2, *scriptID);
+            else
+                return false;
+        }
+    }
+
+    for (const std::pair<int, uint160>& address : vAddresses) {
+        if (!setQueried.insert(address).second)
+            continue;
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+        if (!GetAddressIndex(address.second, address.first, vEntries, nStart, nEnd))
+            return false;
+        for (const std::pair<CAddressIndexKey, CAmount>& entry : vEntries)
+            setHeights.insert(entry.first.blockHeight);
+    }
+
+    return true;
+}
+
+namespace {
+//! A block read and matched ahead of the one being added to the wallet
+struct CRescanBlock
+{
+    CBlock block;
+    bool fRead = false;
+    //! Whether each transaction has an output IsMine returned something for
+    std::vector<char> vfMine;
+    //! KeyStoreSize() when matching started, matches with fewer keys are redone
+    size_t nKeys = 0;
+    size_t nPos = 0;
+    bool fDone = false;
+};
+}
+
+size_t CWallet::ScanBlocks(const std::vector<CBlockIndex*>& vBlocks, size_t nPos, int nThreads, bool fUpdate, bool fStopOnNewKeys,
+                           CBlockIndex*& pindexFailed, const std::function<void(CBlockIndex*)>& progress)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const Consensus::Params& consensusParams = GetParams().GetConsensus();
+    CBlockIndex* pindexTip = chainActive.Tip();
+
+    // Slot n % nAhead holds block n, a thread only takes a block once its slot was committed
+    const size_t nAhead = nThreads * RESCAN_BLOCKS_AHEAD_PER_THREAD;
+    std::vector<CRescanBlock> vSlots(nAhead);
+    std::mutex csSlots;
+    std::condition_variable condRead;
+    std::condition_variable condCommit;
+    size_t nNext = nPos;
+    size_t nCommitted = nPos;
+    bool fStop = false;
+
+    auto reader = [&]() {
+        while (true) {
+            size_t nRead;
+            {
+                std::unique_lock<std::mutex> lock(csSlots);
+                condRead.wait(lock, [&] { return fStop || nNext >= vBlocks.size() || nNext < nCommitted + nAhead; });
+                if (fStop || nNext >= vBlocks.size())
+                    return;
+                nRead = nNext++;
+            }
+
+            CRescanBlock& slot = vSlots[nRead % nAhead];
+            slot.nKeys = KeyStoreSize();
+            slot.fRead = ReadBlockFromDisk(slot.block, vBlocks[nRead], consensusParams);
+            slot.vfMine.assign(slot.block.vtx.size(), false);
+            if (slot.fRead) {
+                for (size_t i = 0; i < slot.block.vtx.size(); i++) {
+                    for (const CTxOut& txout : slot.block.vtx[i]->vout) {
+                        if (MayBeMine(txout.scriptPubKey) && ::IsMine(*this, txout.scriptPubKey, pindexTip) != ISMINE_NO) {
+                            slot.vfMine[i] = true;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(csSlots);
+                slot.nPos = nRead;
+                slot.fDone = true;
+            }
+            condCommit.notify_one();
+        }
+    };
+
+    std::vector<std::thread> vThreads;
+    auto stopReaders = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(csSlots);
+            fStop = true;
+        }
+        condRead.notify_all();
+        for (std::thread& thread : vThreads)
+            thread.join();
+        vThreads.clear();
+    };
+
+    for (int i = 0; i < nThreads; i++)
+        vThreads.emplace_back(reader);
+
+    try {
+        // The blocks are added in chunks, each written in one database transaction
+        std::unique_ptr<CWalletWriteBatch> batch;
+        for (; nPos < vBlocks.size() && !fAbortRescan; nPos++) {
+            if (!batch || nPos % RESCAN_BLOCKS_PER_WRITE_BATCH == 0) {
+                batch.reset();
+                batch.reset(new CWalletWriteBatch(*this));
+            }
+            CRescanBlock& slot = vSlots[nPos % nAhead];
+            {
+                std::unique_lock<std::mutex> lock(csSlots);
+                condCommit.wait(lock, [&] { return slot.fDone && slot.nPos == nPos; });
+            }
+
+            CBlockIndex* pindex = vBlocks[nPos];
+            progress(pindex);
+
+            size_t nKeys = KeyStoreSize();
+            if (slot.fRead) {
+                bool fMatched = slot.nKeys == nKeys;
+                for (size_t posInBlock = 0; posInBlock < slot.block.vtx.size(); ++posInBlock) {
+                    const CTransaction& tx = *slot.block.vtx[posInBlock];
+                    // Spending or conflicting with the wallet's transactions needs the wallet as of this block
+                    bool fInvolved = !fMatched || slot.vfMine[posInBlock] || mapWallet.count(tx.GetHash());
+                    for (size_t i = 0; i < tx.vin.size() && !fInvolved; i++)
+                        fInvolved = mapWallet.count(tx.vin[i].prevout.hash) || mapTxSpends.count(tx.vin[i].prevout);
+                    if (fInvolved)
+                        AddToWalletIfInvolvingMe(slot.block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                }
+            } else {
+                pindexFailed = pindex;
+            }
+            bool fNewKeys = KeyStoreSize() != nKeys;
+
+            {
+                std::lock_guard<std::mutex> lock(csSlots);
+                slot.fDone = false;
+                slot.block.SetNull();
+                nCommitted++;
+            }
+            condRead.notify_all();
+
+            if (fStopOnNewKeys && fNewKeys) {
+                nPos++;
+                break;
+            }
+        }
+    } catch (...) {
+        stopReaders();
+        throw;
+    }
+    stopReaders();
+
+    return nPos;
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     // If transactions aren't being broadcasted, don't let them into local mempool either
@@ -2165,18 +2573,7 @@ CAmount CWalletTx::GetImmatureWatchOnlyCredit(const bool& fUseCache) const
 
 CAmount CWallet::GetOfflineStakingBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableStakableCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nOfflineStaking;
 }
 
 CAmount CWalletTx::GetAvailableWatchOnlyCredit(const bool& fUseCache) const
@@ -2322,110 +2719,104 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+CWalletBalances CWallet::ComputeBalances() const
 {
-    CAmount nTotal = 0;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    CWalletBalances balances;
+    SyncStakeLedger();
+    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit(false);
+        const CWalletTx* pcoin = &(*it).second;
+        if (pcoin->fStakeSettled)
+            continue;
+        if (pcoin->IsTrusted()) {
+            balances.nBalance += pcoin->GetAvailableCredit(false);
+            balances.nLocked += pcoin->GetLockedCredit(false);
+            balances.nOfflineStaking += pcoin->GetAvailableStakableCredit();
+            balances.nWatchOnly += pcoin->GetAvailableWatchOnlyCredit(false);
+        } else if (pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool()) {
+            balances.nUnconfirmed += pcoin->GetAvailableCredit(false);
+            balances.nUnconfirmedWatchOnly += pcoin->GetAvailableWatchOnlyCredit(false);
         }
+        balances.nImmature += pcoin->GetImmatureCredit(false);
+        balances.nImmatureWatchOnly += pcoin->GetImmatureWatchOnlyCredit(false);
     }
 
-    return nTotal;
+    // ppcoin: total coins staked (non-spendable until maturity), immature coinstakes are never settled
+    for (const uint256& hash : setStakeLedgerVolatile)
+    {
+        const CWalletTx* pcoin = &mapWallet.at(hash);
+        if (pcoin->GetBlocksToMaturity() > 0) {
+            balances.nStake += CWallet::GetCredit(*(pcoin->tx), ISMINE_SPENDABLE);
+            balances.nWatchOnlyStake += CWallet::GetCredit(*(pcoin->tx), ISMINE_WATCH_ONLY);
+        }
+    }
+    return balances;
 }
 
-CAmount CWallet::GetLockedBalance() const
+CWalletBalances CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
+    // The balances follow the tip, the wallet's transactions and keys, and the mempool
+    std::shared_ptr<const CChainTipState> tip = GetChainTipState();
+    CWalletBalancesKey key{tip ? tip->hashBlock : uint256(), nBalancesTxGeneration, nKeyStoreGeneration, mempool.GetTransactionsUpdated()};
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetLockedCredit(false);
-        }
+        LOCK(cs_balances);
+        if (fBalancesCached && key == balancesKey)
+            return cachedBalances;
+    }
+
+    LOCK2(cs_main, cs_wallet);
+    // Nothing that moves the key can run while the locks are held
+    key = CWalletBalancesKey{chainActive.Tip() ? chainActive.Tip()->GetIndexHash() : uint256(), nBalancesTxGeneration, nKeyStoreGeneration, mempool.GetTransactionsUpdated()};
+    {
+        LOCK(cs_balances);
+        if (fBalancesCached && key == balancesKey)
+            return cachedBalances;
     }
 
-    return nTotal;
+    CWalletBalances balances = ComputeBalances();
+    LOCK(cs_balances);
+    cachedBalances = balances;
+    balancesKey = key;
+    fBalancesCached = true;
+    return balances;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nBalance;
+}
+
+CAmount CWallet::GetLockedBalance() const
+{
+    return GetBalances().nLocked;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit(false);
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit(false);
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit(false);
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit(false);
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit(false);
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmatureWatchOnly;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2542,11 +2933,17 @@ void CWallet::AvailableCoinsAll(std::vector<COutput>& vCoins, std::map<std::stri
         std::map<std::string, CAmount> mapTokenTotals;
         std::map<uint256, COutPoint> mapOutPoints;
         std::set<std::string> setTokenMaxFound;
+        // Settled coinstakes have no unspent outputs left
+        SyncStakeLedger();
+
         // Turn the OutPoints into a map that is easily interatable.
         for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const uint256 &wtxid = it->first;
             const CWalletTx *pcoin = &(*it).second;
 
+            if (pcoin->fStakeSettled)
+                continue;
+
             if (!CheckFinalTx(*pcoin))
                 continue;
 
@@ -2604,10 +3001,7 @@ void CWallet::AvailableCoinsAll(std::vector<COutput>& vCoins, std::map<std::stri
 
             for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
 
-                int nType;
-                int nScriptType;
-                bool fIsOwner;
-                bool isTokenScript = pcoin->tx->vout[i].scriptPubKey.IsTokenScript(nType, nScriptType, fIsOwner);
+                bool isTokenScript = pcoin->tx->GetTokenOutput(i) != nullptr;
                 if (coinControl && !isTokenScript && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint((*it).first, i)))
                     continue;
 
@@ -2774,55 +3168,350 @@ std::map<CTxDestination, std::vector<COutput>> CWallet::ListTokens() const
     return result;
 }
 
-/** TOKENS END */
-
-void CWallet::AvailableCoinsForStaking(std::vector<COutput>& vCoins, std::vector< CScript > validatorVector) const
+void CWallet::RemoveTokenLedger(const COutPoint& outpoint) const
 {
-    vCoins.clear();
+    auto it = mapTokenLedger.find(outpoint);
+    if (it == mapTokenLedger.end())
+        return;
 
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
-            int nDepth = pcoin->GetDepthInMainChain();
+    const CTokenLedgerEntry& entry = it->second;
+    if (entry.nHeight < 0) {
+        setTokenLedgerVolatile.erase(outpoint);
+    } else {
+        auto itBalance = mapTokenLedgerSettled.find(entry.strName);
+        if (itBalance != mapTokenLedgerSettled.end()) {
+            CTokenLedgerBalance& balance = itBalance->second;
+            balance.nTotal -= entry.nAmount;
+            auto itHeight = balance.mapByHeight.find(entry.nHeight);
+            if (itHeight != balance.mapByHeight.end()) {
+                itHeight->second -= entry.nAmount;
+                if (itHeight->second == 0)
+                    balance.mapByHeight.erase(itHeight);
+            }
+            if (balance.mapByHeight.empty())
+                mapTokenLedgerSettled.erase(itBalance);
+        }
+    }
+    mapTokenLedger.erase(it);
+}
 
-            if (nDepth < 1)
-                continue;
+void CWallet::UpdateTokenLedger(const COutPoint& outpoint, int nTipHeight) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
 
-            if (nDepth < COINSTAKE_MATURITY)
-                continue;
+    RemoveTokenLedger(outpoint);
+
+    auto it = mapWallet.find(outpoint.hash);
+    if (it == mapWallet.end())
+        return;
+
+    const CWalletTx& wtx = it->second;
+    if (outpoint.n >= wtx.tx->vout.size() || !wtx.tx->GetTokenOutput(outpoint.n))
+        return;
+
+    CTokenOutputEntry data;
+    if (!GetTokenData(wtx.tx->vout[outpoint.n].scriptPubKey, data))
+        return;
+
+    // Spent and locked outputs come back when their spender or lock is queued again
+    if (IsSpent(outpoint.hash, outpoint.n) || IsLockedCoin(outpoint.hash, outpoint.n) || IsMine(wtx.tx->vout[outpoint.n]) == ISMINE_NO)
+        return;
+
+    // Conflicted outputs come back through AddToWallet, or the re-index after a disconnect
+    int nDepth = wtx.GetDepthInMainChain();
+    if (nDepth < 0)
+        return;
+
+    bool fSettled = nDepth > 0 && data.nAmount > 0 && data.nTimeLock == 0 && !wtx.IsCoinBase() && !IsTokenNameAnRestricted(data.tokenName);
+    CTokenLedgerEntry entry{data.tokenName, data.nAmount, fSettled ? nTipHeight - nDepth + 1 : -1};
+    if (fSettled) {
+        CTokenLedgerBalance& balance = mapTokenLedgerSettled[entry.strName];
+        balance.nTotal += entry.nAmount;
+        balance.mapByHeight[entry.nHeight] += entry.nAmount;
+    } else {
+        setTokenLedgerVolatile.insert(outpoint);
+    }
+    mapTokenLedger.emplace(outpoint, std::move(entry));
+}
+
+bool CWallet::IsTokenLedgerOutputAvailable(const COutPoint& outpoint, int nMinDepth) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // The same checks AvailableCoinsAll makes for a token output with fOnlySafe set
+    auto it = mapWallet.find(outpoint.hash);
+    if (it == mapWallet.end())
+        return false;
+
+    const CWalletTx* pcoin = &it->second;
+    if (!CheckFinalTx(*pcoin))
+        return false;
 
-            if (pcoin->GetBlocksToMaturity() > 0)
+    if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+        return false;
+
+    int nDepth = pcoin->GetDepthInMainChain();
+    if (nDepth < 0 || nDepth < nMinDepth)
+        return false;
+
+    if (nDepth == 0 && (!pcoin->InMempool() || pcoin->mapValue.count("replaces_txid") || pcoin->mapValue.count("replaced_by_txid")))
+        return false;
+
+    if (!pcoin->IsTrusted())
+        return false;
+
+    if (IsLockedCoin(outpoint.hash, outpoint.n) || IsSpent(outpoint.hash, outpoint.n))
+        return false;
+
+    CTokenOutputEntry data;
+    if (!GetTokenData(pcoin->tx->vout[outpoint.n].scriptPubKey, data))
+        return false;
+
+    if ((int64_t)data.nTimeLock > ((int64_t)data.nTimeLock < LOCKTIME_THRESHOLD ? (int64_t)chainActive.Height() : GetTime()))
+        return false;
+
+    if (IsTokenNameAnRestricted(data.tokenName) && ptokens->CheckForAddressRestriction(data.tokenName, EncodeDestination(data.destination), true))
+        return false;
+
+    return true;
+}
+
+void CWallet::GetTokenBalances(std::map<std::string, CAmount>& mapBalances, int nMinDepth, const std::string& prefix) const
+{
+    if (!AreTokensDeployed())
+        return;
+
+    LOCK2(cs_main, cs_wallet);
+    int nTipHeight = chainActive.Height();
+
+    // Index the whole wallet on the first query, afterwards only what was queued
+    if (!fTokenLedgerLoaded) {
+        mapTokenLedger.clear();
+        mapTokenLedgerSettled.clear();
+        setTokenLedgerVolatile.clear();
+        for (const std::pair<const uint256, CWalletTx>& item : mapWallet)
+            setTokenLedgerPending.insert(item.first);
+        fTokenLedgerLoaded = true;
+    }
+
+    for (const uint256& hash : setTokenLedgerPending) {
+        auto it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+        const CTransaction& tx = *it->second.tx;
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+            UpdateTokenLedger(COutPoint(hash, i), nTipHeight);
+        // The outputs it spends follow its state
+        for (const CTxIn& txin : tx.vin) {
+            if (mapWallet.count(txin.prevout.hash))
+                UpdateTokenLedger(txin.prevout, nTipHeight);
+        }
+    }
+    setTokenLedgerPending.clear();
+
+    // Settled outputs are at least one block deep, the buckets above nMaxHeight are too shallow for nMinDepth
+    int nMaxHeight = nTipHeight - std::max(nMinDepth, 1) + 1;
+    for (const std::pair<const std::string, CTokenLedgerBalance>& pair : mapTokenLedgerSettled) {
+        if (!prefix.empty() && pair.first.find(prefix) != 0)
+            continue;
+
+        const CTokenLedgerBalance& balance = pair.second;
+        if (balance.mapByHeight.begin()->first > nMaxHeight)
+            continue;
+
+        CAmount nBalance = balance.nTotal;
+        for (auto it = balance.mapByHeight.rbegin(); it != balance.mapByHeight.rend() && it->first > nMaxHeight; ++it)
+            nBalance -= it->second;
+        mapBalances[pair.first] += nBalance;
+    }
+
+    for (const COutPoint& outpoint : setTokenLedgerVolatile) {
+        const CTokenLedgerEntry& entry = mapTokenLedger.at(outpoint);
+        if (!prefix.empty() && entry.strName.find(prefix) != 0)
+            continue;
+        if (IsTokenLedgerOutputAvailable(outpoint, nMinDepth))
+            mapBalances[entry.strName] += entry.nAmount;
+    }
+}
+
+/** TOKENS END */
+
+void CWallet::RemoveStakeCandidate(const COutPoint& outpoint) const
+{
+    auto it = mapStakeMaturity.find(outpoint);
+    if (it == mapStakeMaturity.end())
+        return;
+
+    setMatureStake.erase(outpoint);
+    auto itStaker = mapDelegatedStaker.find(outpoint);
+    if (itStaker != mapDelegatedStaker.end()) {
+        auto itGroup = mapDelegatedStake.find(itStaker->second);
+        if (itGroup != mapDelegatedStake.end()) {
+            itGroup->second.erase(outpoint);
+            if (itGroup->second.empty())
+                mapDelegatedStake.erase(itGroup);
+        }
+        mapDelegatedStaker.erase(itStaker);
+    }
+    auto range = mapImmatureStake.equal_range(it->second);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (iter->second == outpoint) {
+            mapImmatureStake.erase(iter);
+            break;
+        }
+    }
+    mapStakeMaturity.erase(it);
+}
+
+void CWallet::InsertMatureStake(const COutPoint& outpoint) const
+{
+    auto it = mapDelegatedStaker.find(outpoint);
+    if (it != mapDelegatedStaker.end())
+        mapDelegatedStake[it->second].insert(outpoint);
+    else
+        setMatureStake.insert(outpoint);
+}
+
+void CWallet::UpdateStakeCandidate(const COutPoint& outpoint, int nTipHeight) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    RemoveStakeCandidate(outpoint);
+
+    auto it = mapWallet.find(outpoint.hash);
+    if (it == mapWallet.end())
+        return;
+
+    const CWalletTx& wtx = it->second;
+    if (outpoint.n >= wtx.tx->vout.size())
+        return;
+
+    const CTxOut& txout = wtx.tx->vout[outpoint.n];
+    isminetype mine = IsMine(txout);
+    if (txout.nValue <= 0 || wtx.tx->GetTokenOutput(outpoint.n) || mine == ISMINE_NO)
+        return;
+
+    // Only the holder of the staking key can stake a delegation, an owner without it can't
+    CKeyID keyStaker;
+    bool fDelegated = txout.scriptPubKey.IsOfflineStaking();
+    if (fDelegated) {
+        if (!(mine & ISMINE_STAKABLE))
+            return;
+        std::vector<valtype> vSolutions;
+        txnouttype whichType, scriptType;
+        if (!Solver(txout.scriptPubKey, whichType, scriptType, vSolutions))
+            return;
+        keyStaker = CKeyID(uint160(vSolutions[0]));
+    }
+
+    // Unconfirmed and conflicted outputs come back through AddToWallet once they confirm
+    int nDepth = wtx.GetDepthInMainChain();
+    if (nDepth < 1)
+        return;
+
+    // First height at which both nDepth >= COINSTAKE_MATURITY and GetBlocksToMaturity() == 0 hold
+    int nHeightConfirmed = nTipHeight - nDepth + 1;
+    int nHeightMature = nHeightConfirmed + COINSTAKE_MATURITY - 1;
+    if (wtx.IsCoinBase())
+        nHeightMature = std::max(nHeightMature, nHeightConfirmed + COINBASE_MATURITY);
+    if (wtx.IsCoinStake())
+        nHeightMature = std::max(nHeightMature, nHeightConfirmed + COINSTAKE_MATURITY);
+
+    mapStakeMaturity[outpoint] = nHeightMature;
+    if (fDelegated)
+        mapDelegatedStaker[outpoint] = keyStaker;
+    if (nHeightMature <= nTipHeight)
+        InsertMatureStake(outpoint);
+    else
+        mapImmatureStake.insert(std::make_pair(nHeightMature, outpoint));
+}
+
+void CWallet::AvailableCoinsForStaking(std::vector<COutput>& vCoins, const CValidatorSet& validators) const
+{
+    vCoins.clear();
+
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        LOCK2(cs_main, cs_wallet);
+        m_staker_stats.nLockWaitTime += GetTimeMicros() - nTimeStart;
+        int nTipHeight = chainActive.Height();
+
+        // Index the whole wallet on the first pass, afterwards only what AddToWallet touched
+        if (!fStakeCandidatesLoaded) {
+            for (const std::pair<const uint256, CWalletTx>& item : mapWallet)
+                setStakePending.insert(item.first);
+            fStakeCandidatesLoaded = true;
+        }
+
+        for (const uint256& hash : setStakePending) {
+            auto it = mapWallet.find(hash);
+            if (it == mapWallet.end())
                 continue;
+            for (unsigned int i = 0; i < it->second.tx->vout.size(); i++)
+                UpdateStakeCandidate(COutPoint(hash, i), nTipHeight);
+        }
+        setStakePending.clear();
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-                isminetype mine = IsMine(pcoin->tx->vout[i]);
-                bool isTokenScript = pcoin->tx->vout[i].scriptPubKey.IsTokenScript();
-                bool solvable = (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE | ISMINE_STAKABLE)) != ISMINE_NO;
-                bool spendable = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (((mine & ISMINE_WATCH_ONLY) != ISMINE_NO) && solvable);
+        while (!mapImmatureStake.empty() && mapImmatureStake.begin()->first <= nTipHeight) {
+            InsertMatureStake(mapImmatureStake.begin()->second);
+            mapImmatureStake.erase(mapImmatureStake.begin());
+        }
 
-                bool authorized = false;
+        // Outputs a reorg moved, or whose transaction left the wallet, are re-indexed after the walk
+        std::vector<COutPoint> vStale;
+        auto addCandidate = [&](const COutPoint& outpoint, bool fDelegated) {
+            auto it = mapWallet.find(outpoint.hash);
+            if (it == mapWallet.end()) {
+                vStale.push_back(outpoint);
+                return;
+            }
 
-                if (std::find(validatorVector.begin(), validatorVector.end(), pcoin->tx->vout[i].scriptPubKey) != validatorVector.end()) {
-                    authorized = true;
-                }
+            const CWalletTx* pcoin = &it->second;
+            int nDepth = pcoin->GetDepthInMainChain();
 
-                if (authorized && !isTokenScript && !(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->tx->vout[i].nValue > 0))
-                {
-                    vCoins.push_back(COutput(pcoin, i, nDepth, spendable, solvable, pcoin->IsTrusted()));
-                }
+            if (nDepth < COINSTAKE_MATURITY || pcoin->GetBlocksToMaturity() > 0) {
+                vStale.push_back(outpoint);
+                return;
+            }
+
+            // A delegation's staking key is checked once for its whole group
+            const CTxOut& txout = pcoin->tx->vout[outpoint.n];
+            isminetype mine = fDelegated ? ISMINE_STAKABLE : IsMine(txout);
+            bool solvable = (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE | ISMINE_STAKABLE)) != ISMINE_NO;
+            bool spendable = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (((mine & ISMINE_WATCH_ONLY) != ISMINE_NO) && solvable);
+
+            bool authorized = validators.Contains(txout.scriptPubKey);
+
+            if (authorized && !IsSpent(outpoint.hash, outpoint.n) && mine != ISMINE_NO && !IsLockedCoin(outpoint.hash, outpoint.n))
+            {
+                vCoins.push_back(COutput(pcoin, outpoint.n, nDepth, spendable, solvable, pcoin->IsTrusted()));
             }
+        };
+
+        for (const COutPoint& outpoint : setMatureStake)
+            addCandidate(outpoint, false);
+
+        for (const std::pair<const CKeyID, std::set<COutPoint> >& group : mapDelegatedStake)
+        {
+            if (!HaveKey(group.first))
+                continue;
+            for (const COutPoint& outpoint : group.second)
+                addCandidate(outpoint, true);
         }
+
+        for (const COutPoint& outpoint : vStale)
+            UpdateStakeCandidate(outpoint, nTipHeight);
     }
+    m_staker_stats.nAvailableCoinsTime += GetTimeMicros() - nTimeStart;
 }
 
-bool CWallet::SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, std::vector< CScript > validatorVector) const
+bool CWallet::SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CValidatorSet& validators) const
 {
     std::vector<COutput> vCoins;
-    AvailableCoinsForStaking(vCoins, validatorVector);
+    AvailableCoinsForStaking(vCoins, validators);
 
     setCoinsRet.clear();
     nValueRet = 0;
@@ -2858,7 +3547,88 @@ bool CWallet::SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<co
     return true;
 }
 
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, std::vector< CScript > validatorVector)
+void CWallet::GetStakeKernels(CBlockIndex* pindexPrev, const std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<CStakeKernel>& vKernels, std::vector<std::pair<const CWalletTx*,unsigned int> >& vKernelCoins) const
+{
+    vKernels.clear();
+    vKernelCoins.clear();
+
+    if (!pindexPrev)
+        return;
+
+    // The coin checks of CheckKernel, done once per coin instead of once per timestamp tried.
+    // Coins already looked up keep their entry in mapStakeCache while their block stays on
+    // the active chain, the entries of coins no longer selected are dropped
+    int64_t nTimeStart = GetTimeMicros();
+    LOCK(cs_main);
+    m_staker_stats.nLockWaitTime += GetTimeMicros() - nTimeStart;
+    std::map<COutPoint, CStakeCache> mapCache;
+    for (const std::pair<const CWalletTx*,unsigned int> &pcoin : setCoins)
+    {
+        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        auto it = mapStakeCache.find(prevoutStake);
+        if (it != mapStakeCache.end() && IsStakeCacheValid(pindexPrev, it->second)) {
+            it = mapCache.insert(*it).first;
+        } else {
+            Coin coinPrev;
+            if (!pcoinsTip->GetCoin(prevoutStake, coinPrev) || coinPrev.IsSpent() || coinPrev.out.nValue == 0)
+                continue;
+
+            const CBlockIndex* pindexFrom = chainActive.GetAncestor(pindexPrev, coinPrev.nHeight);
+            if (!pindexFrom)
+                continue;
+
+            it = mapCache.emplace(prevoutStake, CStakeCache(pindexFrom, coinPrev.nTime, coinPrev.out.nValue)).first;
+        }
+
+        const CStakeCache& stake = it->second;
+        if (pindexPrev->nHeight + 1 - stake.pindexFrom->nHeight < COINSTAKE_MATURITY)
+            continue;
+
+        vKernels.emplace_back(pindexPrev, prevoutStake, stake.amount, stake.nTime);
+        vKernelCoins.push_back(pcoin);
+    }
+    mapStakeCache.swap(mapCache);
+}
+
+bool CWallet::GetStakeKernelCandidates(CBlockIndex* pindexPrev, const CValidatorSet& validators, std::vector<CStakeKernel>& vKernels)
+{
+    vKernels.clear();
+    CAmount nBalance = GetBalance() + GetOfflineStakingBalance();
+
+    if (nBalance <= nReserveBalance)
+        return false;
+
+    // Same selection as CreateCoinStake, so a hit here is a hit there for the same timestamp
+    std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
+    CAmount nValueIn = 0;
+    CAmount nTargetValue = nBalance - nReserveBalance;
+    if (!SelectCoinsForStaking(nTargetValue, setCoins, nValueIn, validators))
+        return false;
+
+    std::vector<std::pair<const CWalletTx*,unsigned int> > vKernelCoins;
+    GetStakeKernels(pindexPrev, setCoins, vKernels, vKernelCoins);
+    return !vKernels.empty();
+}
+
+static CMetricCounter metricStakeKernelsChecked("paladeum_stake_kernels_checked_total", "Stake kernels hashed against the target by the staking threads");
+static CMetricHistogram metricStakeKernelSearchSeconds("paladeum_stake_kernel_search_seconds", "Time to search the wallet's coins for a kernel for one timestamp", MetricDurationBounds(), 1e-6);
+
+int CWallet::SearchStakeKernel(const std::vector<CStakeKernel>& vKernels, unsigned int nBits, uint32_t nTimeBlock, int nThreads) const
+{
+    int64_t nTimeStart = GetTimeMicros();
+    int nKernel = SearchStakeKernels(vKernels, nBits, nTimeBlock, nThreads);
+    const int64_t nSearchTime = GetTimeMicros() - nTimeStart;
+    const uint64_t nChecked = nKernel >= 0 ? nKernel + 1 : vKernels.size();
+    m_staker_stats.nKernelSearchTime += nSearchTime;
+    m_staker_stats.nKernelsChecked += nChecked;
+    metricStakeKernelsChecked.Inc(nChecked);
+    metricStakeKernelSearchSeconds.Observe(nSearchTime);
+
+    boost::this_thread::interruption_point();
+    return nKernel;
+}
+
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, const CValidatorSet& validators)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
     arith_uint256 bnTargetPerCoinDay;
@@ -2886,116 +3656,113 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, con
 
     // Select coins with suitable depth
     CAmount nTargetValue = nBalance - nReserveBalance;
-    if (!SelectCoinsForStaking(nTargetValue, setCoins, nValueIn, validatorVector))
+    if (!SelectCoinsForStaking(nTargetValue, setCoins, nValueIn, validators))
         return false;
 
     if (setCoins.empty())
         return false;
 
-    if (stakeCache.size() > setCoins.size() + 100) {
-        //Determining if the cache is still valid is harder than just clearing it when it gets too big, so instead just clear it
-        //when it has more than 100 entries more than the actual setCoins.
-        stakeCache.clear();
-    }
-
     CAmount nCredit = 0;
     CAmount nOfflineReward = 0;
     CScript scriptPubKeyKernel;
     CScript scriptOfflineStaker;
     bool nOfflineStake = false;
 
-    for(const std::pair<const CWalletTx*,unsigned int> &pcoin : setCoins)
+    std::vector<CStakeKernel> vKernels;
+    std::vector<std::pair<const CWalletTx*,unsigned int> > vKernelCoins;
+    GetStakeKernels(pindexPrev, setCoins, vKernels, vKernelCoins);
+
+    int nKernel = SearchStakeKernel(vKernels, nBits, nTimeBlock, gArgs.GetArg("-stakethreads", DEFAULT_STAKE_THREADS));
+
+    if (nKernel >= 0)
     {
-        bool fKernelFound = false;
-        boost::this_thread::interruption_point();
-        // Search backward in time from the given txNew timestamp
-        // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        if (CheckKernel(pindexPrev, nBits, nTimeBlock, prevoutStake, *pcoinsTip, stakeCache))
+        const std::pair<const CWalletTx*,unsigned int> &pcoin = vKernelCoins[nKernel];
+        // Found a kernel
+        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel found\n");
         {
-            // Found a kernel
-            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel found\n");
-            std::vector<valtype> vSolutions;
-            txnouttype whichType;
-            txnouttype scriptType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, scriptType, vSolutions))
+            // A cached kernel coin wasn't looked up again, it may have been spent since
+            LOCK(cs_main);
+            if (!pcoinsTip->HaveCoin(vKernels[nKernel].prevout))
             {
-                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to parse kernel\n");
-                break;
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel coin was spent\n");
+                return false;
             }
-            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH && whichType != TX_OFFLINE_STAKING)
+        }
+        std::vector<valtype> vSolutions;
+        txnouttype whichType;
+        txnouttype scriptType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, scriptType, vSolutions))
+        {
+            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to parse kernel\n");
+            return false;
+        }
+        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH && whichType != TX_OFFLINE_STAKING)
+        {
+            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : no support for kernel type=%d\n", whichType);
+            return false;  // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            // convert to pay to public key type
+            uint160 hash160(vSolutions[0]);
+            CKeyID pubKeyHash(hash160);
+            if (!keystore.GetKey(pubKeyHash, key))
             {
-                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break;  // only support pay to public key and pay to address
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false;  // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
+            scriptPubKeyOut << key.GetPubKey().getvch() << OP_CHECKSIG;
+        }
+        if (whichType == TX_PUBKEY)
+        {
+            valtype& vchPubKey = vSolutions[0];
+            CPubKey pubKey(vchPubKey);
+            uint160 hash160(Hash160(vchPubKey));
+            CKeyID pubKeyHash(hash160);
+            if (!keystore.GetKey(pubKeyHash, key))
             {
-                // convert to pay to public key type
-                uint160 hash160(vSolutions[0]);
-                CKeyID pubKeyHash(hash160);
-                if (!keystore.GetKey(pubKeyHash, key))
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break;  // unable to find corresponding public key
-                }
-                scriptPubKeyOut << key.GetPubKey().getvch() << OP_CHECKSIG;
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false;  // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEY)
-            {
-                valtype& vchPubKey = vSolutions[0];
-                CPubKey pubKey(vchPubKey);
-                uint160 hash160(Hash160(vchPubKey));
-                CKeyID pubKeyHash(hash160);
-                if (!keystore.GetKey(pubKeyHash, key))
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break;  // unable to find corresponding public key
-                }
 
-                if (key.GetPubKey() != pubKey)
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                    break; // keys mismatch
-                }
-
-                scriptPubKeyOut = scriptPubKeyKernel;
-            }
-
-            if (whichType == TX_OFFLINE_STAKING) // offline staking
+            if (key.GetPubKey() != pubKey)
             {
-                uint160 hash160(vSolutions[0]);
-                CKeyID pubKeyHash(hash160);
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
+                return false; // keys mismatch
+            }
 
-                // try to find staking key
-                if (!keystore.GetKey(pubKeyHash, key))
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break;  // unable to find corresponding public key
-                } else {
-                    // we keep the same script
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                }
+            scriptPubKeyOut = scriptPubKeyKernel;
+        }
 
-                scriptOfflineStaker = GetScriptForDestination(pubKeyHash);
+        if (whichType == TX_OFFLINE_STAKING) // offline staking
+        {
+            uint160 hash160(vSolutions[0]);
+            CKeyID pubKeyHash(hash160);
 
-                nOfflineStake = true;
+            // try to find staking key
+            if (!keystore.GetKey(pubKeyHash, key))
+            {
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false;  // unable to find corresponding public key
+            } else {
+                // we keep the same script
+                scriptPubKeyOut = scriptPubKeyKernel;
             }
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+            scriptOfflineStaker = GetScriptForDestination(pubKeyHash);
 
-            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
+            nOfflineStake = true;
         }
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+
+        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : added kernel type=%d\n", whichType);
     }
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
@@ -3015,7 +3782,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, con
             if (nCredit + pcoin.first->tx->vout[pcoin.second].nValue > nBalance - nReserveBalance)
                 break;
             // Do not add additional significant input
-            if (pcoin.first->tx->vout[pcoin.second].nValue >= GetStakeCombineThreshold())
+            if (pcoin.first->tx->vout[pcoin.second].nValue >= nStakeCombineThreshold)
                 continue;
 
             txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
@@ -3039,19 +3806,17 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, con
         }
     }
 
-    if (nCredit >= GetStakeSplitThreshold())
-    {
-        for (unsigned int i = 0; i < GetStakeSplitOutputs() - 1; i++)
-            txNew.vout.push_back(CTxOut(0, txNew.vout[1].scriptPubKey)); //split stake
-    }
+    unsigned int nSplitOutputs = GetStakeSplitOutputs(nCredit);
+    for (unsigned int i = 1; i < nSplitOutputs; i++)
+        txNew.vout.push_back(CTxOut(0, txNew.vout[1].scriptPubKey)); //split stake
 
     // Set output amount
-    if (txNew.vout.size() == GetStakeSplitOutputs() + 1)
+    if (nSplitOutputs > 1)
     {
-        CAmount nValue = (nCredit / GetStakeSplitOutputs() / CENT) * CENT;
-        for(unsigned int i = 1; i < GetStakeSplitOutputs(); i++)
+        CAmount nValue = (nCredit / nSplitOutputs / CENT) * CENT;
+        for(unsigned int i = 1; i < nSplitOutputs; i++)
             txNew.vout[i].nValue = nValue;
-        txNew.vout[GetStakeSplitOutputs()].nValue = nCredit - nValue * (GetStakeSplitOutputs() - 1);
+        txNew.vout[nSplitOutputs].nValue = nCredit - nValue * (nSplitOutputs - 1);
     }
     else
         txNew.vout[1].nValue = nCredit;
@@ -3079,10 +3844,76 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, con
     return true;
 }
 
-bool CWallet::HaveAvailableCoinsForStaking(std::vector< CScript > validatorVector) const
+bool CWallet::ConsolidateStakeOutputs()
 {
+    if (IsLocked() || IsInitialBlockDownload())
+        return false;
+
+    LOCK2(cs_main, cs_wallet);
+    std::shared_ptr<const CValidatorSet> validators = GetValidatorSet();
     std::vector<COutput> vCoins;
-    AvailableCoinsForStaking(vCoins, validatorVector);
+    AvailableCoinsForStaking(vCoins, *validators);
+
+    // The small outputs we can spend, by the script they pay to
+    std::map<CScript, std::vector<const COutput*> > mapSmall;
+    const std::vector<const COutput*>* pvSmall = nullptr;
+    for (const COutput& out : vCoins) {
+        const CTxOut& txout = out.tx->tx->vout[out.i];
+        if (!out.fSpendable || txout.nValue >= nStakeCombineThreshold)
+            continue;
+        std::vector<const COutput*>& vSmall = mapSmall[txout.scriptPubKey];
+        vSmall.push_back(&out);
+        if (!pvSmall || vSmall.size() > pvSmall->size())
+            pvSmall = &vSmall;
+    }
+    if (!pvSmall || pvSmall->size() < STAKE_CONSOLIDATE_MIN_OUTPUTS)
+        return false;
+
+    // Smallest first, so the most outputs go into one that still won't be split
+    std::vector<const COutput*> vSmall = *pvSmall;
+    std::sort(vSmall.begin(), vSmall.end(), [](const COutput* a, const COutput* b) {
+        return a->tx->tx->vout[a->i].nValue < b->tx->tx->vout[b->i].nValue;
+    });
+
+    CCoinControl coin_control;
+    CAmount nTotal = 0;
+    unsigned int nInputs = 0;
+    for (const COutput* out : vSmall) {
+        CAmount nValue = out->tx->tx->vout[out->i].nValue;
+        if (nInputs >= GetStakeMaxCombineInputs() || (nStakeSplitThreshold > 0 && nTotal + nValue >= nStakeSplitThreshold))
+            break;
+        coin_control.Select(COutPoint(out->tx->GetHash(), out->i));
+        nTotal += nValue;
+        nInputs++;
+    }
+    if (nInputs < STAKE_CONSOLIDATE_MIN_OUTPUTS)
+        return false;
+
+    const CScript& scriptPubKey = vSmall[0]->tx->tx->vout[vSmall[0]->i].scriptPubKey;
+    std::vector<CRecipient> vecSend = {{scriptPubKey, nTotal, true}};
+    CWalletTx wtx;
+    CReserveKey reservekey(this);
+    CAmount nFee;
+    int nChangePos = -1;
+    std::string strError;
+    if (!CreateTransaction(vecSend, wtx, reservekey, nFee, "", nChangePos, strError, coin_control)) {
+        LogPrintf("%s: failed to combine %u stake outputs: %s\n", __func__, nInputs, strError);
+        return false;
+    }
+    CValidationState state;
+    if (!CommitTransaction(wtx, reservekey, g_connman.get(), state)) {
+        LogPrintf("%s: stake consolidation %s rejected: %s\n", __func__, wtx.GetHash().ToString(), FormatStateMessage(state));
+        return false;
+    }
+
+    LogPrintf("%s: combined %u stake outputs worth %s in %s\n", __func__, nInputs, FormatMoney(nTotal), wtx.GetHash().ToString());
+    return true;
+}
+
+bool CWallet::HaveAvailableCoinsForStaking(const CValidatorSet& validators) const
+{
+    std::vector<COutput> vCoins;
+    AvailableCoinsForStaking(vCoins, validators);
     return vCoins.size() > 0;
 }
 
@@ -3132,31 +3963,127 @@ std::map<CTxDestination, std::vector<COutput>> CWallet::ListCoins() const
     return result;
 }
 
-// ppcoin: total coins staked (non-spendable until maturity)
-CAmount CWallet::GetStake() const
+void CWallet::RemoveStakeLedger(const uint256& hash) const
 {
-    CAmount nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*(pcoin->tx), ISMINE_SPENDABLE);
+    auto it = mapStakeLedger.find(hash);
+    if (it == mapStakeLedger.end())
+        return;
+
+    const CStakeLedgerEntry& entry = it->second;
+    auto itPeriod = mapStakeRewards.find(entry.nPeriod);
+    if (itPeriod != mapStakeRewards.end()) {
+        itPeriod->second.nReward -= entry.nReward;
+        if (--itPeriod->second.nCount == 0)
+            mapStakeRewards.erase(itPeriod);
+    }
+    setStakeLedgerVolatile.erase(hash);
+    mapStakeLedger.erase(it);
+}
+
+void CWallet::UpdateStakeLedger(const uint256& hash) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    RemoveStakeLedger(hash);
+
+    auto it = mapWallet.find(hash);
+    if (it == mapWallet.end())
+        return;
+
+    const CWalletTx& wtx = it->second;
+    wtx.fStakeSettled = false;
+    if (!wtx.IsCoinStake())
+        return;
+
+    // Orphaned and unconfirmed coinstakes come back through AddToWallet, or the re-index after a disconnect
+    if (wtx.GetDepthInMainChain() <= 0)
+        return;
+
+    BlockMap::const_iterator itBlock = mapBlockIndex.find(wtx.hashBlock);
+    if (itBlock == mapBlockIndex.end())
+        return;
+
+    // Settled once mature and every output of ours has a confirmed spender
+    bool fSettled = wtx.GetBlocksToMaturity() == 0;
+    for (unsigned int i = 0; fSettled && i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) == ISMINE_NO)
+            continue;
+        fSettled = false;
+        auto range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (TxSpends::const_iterator iter = range.first; iter != range.second && !fSettled; ++iter) {
+            auto itSpender = mapWallet.find(iter->second);
+            fSettled = itSpender != mapWallet.end() && itSpender->second.GetDepthInMainChain() > 0;
+        }
+    }
+
+    CStakeLedgerEntry entry{itBlock->second->GetBlockTime() / STAKE_LEDGER_PERIOD, GetCredit(*wtx.tx, ISMINE_SPENDABLE) - GetDebit(*wtx.tx, ISMINE_SPENDABLE)};
+    CStakeRewardPeriod& period = mapStakeRewards[entry.nPeriod];
+    period.nCount++;
+    period.nReward += entry.nReward;
+    mapStakeLedger.emplace(hash, entry);
+
+    if (fSettled)
+        wtx.fStakeSettled = true;
+    else
+        setStakeLedgerVolatile.insert(hash);
+}
+
+void CWallet::SyncStakeLedger() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Index the whole wallet on the first call, afterwards only what was queued
+    if (!fStakeLedgerLoaded) {
+        mapStakeLedger.clear();
+        mapStakeRewards.clear();
+        setStakeLedgerVolatile.clear();
+        for (const std::pair<const uint256, CWalletTx>& item : mapWallet)
+            setStakeLedgerPending.insert(item.first);
+        fStakeLedgerLoaded = true;
+    }
+
+    // Maturity and the depth of spenders move with the tip
+    if (nStakeLedgerHeight != chainActive.Height()) {
+        setStakeLedgerPending.insert(setStakeLedgerVolatile.begin(), setStakeLedgerVolatile.end());
+        nStakeLedgerHeight = chainActive.Height();
+    }
+
+    for (const uint256& hash : setStakeLedgerPending) {
+        UpdateStakeLedger(hash);
+        auto it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+        // The coinstakes it spends follow its state
+        for (const CTxIn& txin : it->second.tx->vin) {
+            if (mapStakeLedger.count(txin.prevout.hash))
+                UpdateStakeLedger(txin.prevout.hash);
+        }
     }
-    return nTotal;
+    setStakeLedgerPending.clear();
+}
+
+CAmount CWallet::GetStake() const
+{
+    return GetBalances().nStake;
 }
 
 CAmount CWallet::GetWatchOnlyStake() const
 {
-    CAmount nTotal = 0;
+    return GetBalances().nWatchOnlyStake;
+}
+
+CStakeRewardPeriod CWallet::GetStakeRewards(int64_t nSince) const
+{
+    CStakeRewardPeriod result;
     LOCK2(cs_main, cs_wallet);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*(pcoin->tx), ISMINE_WATCH_ONLY);
+    SyncStakeLedger();
+    for (auto it = mapStakeRewards.lower_bound(nSince / STAKE_LEDGER_PERIOD); it != mapStakeRewards.end(); ++it) {
+        result.nCount += it->second.nCount;
+        result.nReward += it->second.nReward;
     }
-    return nTotal;
+    return result;
 }
 
 const CTxOut& CWallet::FindNonChangeParentOutput(const CTransaction& tx, int output) const
@@ -3222,7 +4149,7 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
-static void ApproximateBestTokenSubset(const std::vector<std::pair<CInputCoin, CAmount> >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
+static void ApproximateBestTokenSubset(const std::vector<const CTokenInputCoin*>& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
     std::vector<char> vfIncluded;
@@ -3249,7 +4176,7 @@ static void ApproximateBestTokenSubset(const std::vector<std::pair<CInputCoin, C
                 //the selection random.
                 if (nPass == 0 ? insecure_rand.randbool() : !vfIncluded[i])
                 {
-                    nTotal += vValue[i].second;
+                    nTotal += vValue[i]->nAmount;
                     vfIncluded[i] = true;
                     if (nTotal >= nTargetValue)
                     {
@@ -3259,7 +4186,7 @@ static void ApproximateBestTokenSubset(const std::vector<std::pair<CInputCoin, C
                             nBest = nTotal;
                             vfBest = vfIncluded;
                         }
-                        nTotal -= vValue[i].second;
+                        nTotal -= vValue[i]->nAmount;
                         vfIncluded[i] = false;
                     }
                 }
@@ -3268,6 +4195,65 @@ static void ApproximateBestTokenSubset(const std::vector<std::pair<CInputCoin, C
     }
 }
 
+static const size_t TOKEN_BNB_TOTAL_TRIES = 100000;
+
+// Depth first search over vValue, largest first, for a subset summing to exactly nTargetValue,
+// which needs no token change output. Fewer inputs win between exact matches.
+static bool SelectTokensBnB(const std::vector<const CTokenInputCoin*>& vValue, const CAmount& nTargetValue, std::vector<char>& vfBest)
+{
+    CAmount nAvailable = 0;
+    for (const CTokenInputCoin* input : vValue)
+        nAvailable += input->nAmount;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    std::vector<char> vfSelected;
+    vfSelected.reserve(vValue.size());
+    CAmount nValue = 0;
+    size_t nSelected = 0;
+    size_t nBestSelected = std::numeric_limits<size_t>::max();
+
+    for (size_t nTries = 0; nTries < TOKEN_BNB_TOTAL_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nValue + nAvailable < nTargetValue || nValue > nTargetValue || nSelected >= nBestSelected) {
+            fBacktrack = true;
+        } else if (nValue == nTargetValue) {
+            nBestSelected = nSelected;
+            vfBest = vfSelected;
+            vfBest.resize(vValue.size(), false);
+            if (nSelected == 1)
+                break;
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Walk back to the last included input and try the branch without it
+            while (!vfSelected.empty() && !vfSelected.back()) {
+                vfSelected.pop_back();
+                nAvailable += vValue[vfSelected.size()]->nAmount;
+            }
+            if (vfSelected.empty())
+                break;
+            vfSelected.back() = false;
+            nValue -= vValue[vfSelected.size() - 1]->nAmount;
+            nSelected--;
+        } else {
+            const CTokenInputCoin* input = vValue[vfSelected.size()];
+            nAvailable -= input->nAmount;
+            // Including an input of the same amount as the one just excluded gives the same sums again
+            if (!vfSelected.empty() && !vfSelected.back() && input->nAmount == vValue[vfSelected.size() - 1]->nAmount) {
+                vfSelected.push_back(false);
+            } else {
+                vfSelected.push_back(true);
+                nValue += input->nAmount;
+                nSelected++;
+            }
+        }
+    }
+
+    return nBestSelected != std::numeric_limits<size_t>::max();
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
                                  std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
 {
@@ -3469,146 +4455,95 @@ bool CWallet::CreateNewChangeAddress(CReserveKey& reservekey, CKeyID& keyID, std
     return true;
 }
 
-bool CWallet::SelectTokensMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const std::string& strTokenName, std::vector<COutput> vCoins,
+bool CWallet::SelectTokensMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const std::string& strTokenName, const std::vector<CTokenInputCoin>& vTokens,
                                  std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
-    // List of values less than target
-    boost::optional<CInputCoin> coinLowestLarger;
-    boost::optional<CAmount> coinLowestLargerAmount;
-    std::vector<std::pair<CInputCoin, CAmount> > vValue;
-    std::map<COutPoint, CAmount> mapValueAmount;
+    // List of values less than target, largest first like vTokens
+    const CTokenInputCoin* coinLowestLarger = nullptr;
+    std::vector<const CTokenInputCoin*> vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-    for (const COutput &output : vCoins)
+    for (const CTokenInputCoin& input : vTokens)
     {
-        if (!output.fSpendable)
-            continue;
-
-        const CWalletTx *pcoin = output.tx;
-
-        if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
-            continue;
-
-        if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
-            continue;
-
-        int i = output.i;
-
-        CInputCoin coin = CInputCoin(pcoin, i);
-
-        //-------------------------------
-
-        int nType = 0;
-        int nScriptType = 0;
-        bool fIsOwner = false;
-        if (!coin.txout.scriptPubKey.IsTokenScript(nType, nScriptType, fIsOwner)) {
+        if (input.nDepth < (input.fFromMe ? nConfMine : nConfTheirs))
             continue;
-        }
 
-        CAmount nTempAmount = 0;
-        if (nType == TX_NEW_TOKEN && !fIsOwner) { // Root/Sub Token
-            CNewToken tokenTemp;
-            std::string address;
-            if (!TokenFromScript(coin.txout.scriptPubKey, tokenTemp, address))
-                continue;
-            nTempAmount = tokenTemp.nAmount;
-        } else if (nType == TX_TRANSFER_TOKEN) { // Transfer Token
-            CTokenTransfer transferTemp;
-            std::string address;
-            if (!TransferTokenFromScript(coin.txout.scriptPubKey, transferTemp, address))
-                continue;
-            nTempAmount = transferTemp.nAmount;
-        } else if (nType == TX_NEW_TOKEN && fIsOwner) { // Owner Token
-            std::string ownerName;
-            std::string address;
-            if (!OwnerTokenFromScript(coin.txout.scriptPubKey, ownerName, address))
-                continue;
-            nTempAmount = OWNER_TOKEN_AMOUNT;
-        } else if (nType == TX_REISSUE_TOKEN) { // Reissue Token
-            CReissueToken reissueTemp;
-            std::string address;
-            if (!ReissueTokenFromScript(coin.txout.scriptPubKey, reissueTemp, address))
-                continue;
-            nTempAmount = reissueTemp.nAmount;
-        } else {
+        if (!mempool.TransactionWithinChainLimit(input.coin.outpoint.hash, nMaxAncestors))
             continue;
-        }
 
-        if (nTempAmount == nTargetValue)
+        if (input.nAmount == nTargetValue)
         {
-            setCoinsRet.insert(coin);
-            nValueRet += nTempAmount;
+            setCoinsRet.insert(input.coin);
+            nValueRet += input.nAmount;
             return true;
         }
-        else if (nTempAmount < nTargetValue + MIN_CHANGE)
+        else if (input.nAmount < nTargetValue + MIN_CHANGE)
         {
-            vValue.push_back(std::make_pair(coin, nTempAmount));
-            nTotalLower += nTempAmount;
+            vValue.push_back(&input);
+            nTotalLower += input.nAmount;
         }
-        else if (!coinLowestLarger || !coinLowestLargerAmount || nTempAmount < coinLowestLargerAmount)
+        else
         {
-            coinLowestLarger = coin;
-            coinLowestLargerAmount = nTempAmount;
+            // Later larger coins are smaller
+            coinLowestLarger = &input;
         }
     }
 
     if (nTotalLower == nTargetValue)
     {
-        for (const auto& pair : vValue)
+        for (const CTokenInputCoin* input : vValue)
         {
-            setCoinsRet.insert(pair.first);
-            nValueRet += pair.second;
+            setCoinsRet.insert(input->coin);
+            nValueRet += input->nAmount;
         }
         return true;
     }
 
     if (nTotalLower < nTargetValue)
     {
-        if (!coinLowestLarger || !coinLowestLargerAmount)
+        if (!coinLowestLarger)
             return false;
-        setCoinsRet.insert(coinLowestLarger.get());
-
-        #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-        nValueRet += coinLowestLargerAmount.get();
+        setCoinsRet.insert(coinLowestLarger->coin);
+        nValueRet += coinLowestLarger->nAmount;
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    std::sort(vValue.begin(), vValue.end(), CompareTokenValueOnly());
-    std::reverse(vValue.begin(), vValue.end());
+    // Look for an exact match first, then solve subset sum by stochastic approximation
     std::vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestTokenSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
-        ApproximateBestTokenSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+    if (SelectTokensBnB(vValue, nTargetValue, vfBest)) {
+        nBest = nTargetValue;
+    } else {
+        ApproximateBestTokenSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
+            ApproximateBestTokenSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+    }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger && coinLowestLargerAmount &&
-        ((nBest != nTargetValue && nBest < nTargetValue + MIN_CHANGE) || coinLowestLargerAmount <= nBest))
+    if (coinLowestLarger &&
+        ((nBest != nTargetValue && nBest < nTargetValue + MIN_CHANGE) || coinLowestLarger->nAmount <= nBest))
     {
-        setCoinsRet.insert(coinLowestLarger.get());
-        nValueRet += coinLowestLargerAmount.get();
+        setCoinsRet.insert(coinLowestLarger->coin);
+        nValueRet += coinLowestLarger->nAmount;
     }
     else {
         for (unsigned int i = 0; i < vValue.size(); i++)
             if (vfBest[i])
             {
-                setCoinsRet.insert(vValue[i].first);
-                nValueRet += vValue[i].second;
+                setCoinsRet.insert(vValue[i]->coin);
+                nValueRet += vValue[i]->nAmount;
             }
 
         if (LogAcceptCategory(BCLog::SELECTCOINS)) {
             LogPrint(BCLog::SELECTCOINS, "SelectTokens() best subset: ");
             for (unsigned int i = 0; i < vValue.size(); i++) {
                 if (vfBest[i]) {
-                    LogPrint(BCLog::SELECTCOINS, "%s : %s", strTokenName, FormatMoney(vValue[i].second));
+                    LogPrint(BCLog::SELECTCOINS, "%s : %s", strTokenName, FormatMoney(vValue[i]->nAmount));
                 }
             }
             LogPrint(BCLog::SELECTCOINS, "total %s : %s\n", strTokenName, FormatMoney(nBest));
@@ -3618,6 +4553,58 @@ bool CWallet::SelectTokensMinConf(const CAmount& nTargetValue, const int nConfMi
     return true;
 }
 
+// Decodes the spendable outputs of one token and sorts them by descending amount
+static void MakeTokenBucket(const std::vector<COutput>& vCoins, std::vector<CTokenInputCoin>& vTokens)
+{
+    vTokens.clear();
+    vTokens.reserve(vCoins.size());
+    for (const COutput& output : vCoins)
+    {
+        if (!output.fSpendable)
+            continue;
+
+        const CScript& scriptPubKey = output.tx->tx->vout[output.i].scriptPubKey;
+        int nType = 0;
+        int nScriptType = 0;
+        bool fIsOwner = false;
+        if (!scriptPubKey.IsTokenScript(nType, nScriptType, fIsOwner))
+            continue;
+
+        CAmount nTempAmount = 0;
+        std::string address;
+        if (nType == TX_NEW_TOKEN && !fIsOwner) { // Root/Sub Token
+            CNewToken tokenTemp;
+            if (!TokenFromScript(scriptPubKey, tokenTemp, address))
+                continue;
+            nTempAmount = tokenTemp.nAmount;
+        } else if (nType == TX_TRANSFER_TOKEN) { // Transfer Token
+            CTokenTransfer transferTemp;
+            if (!TransferTokenFromScript(scriptPubKey, transferTemp, address))
+                continue;
+            nTempAmount = transferTemp.nAmount;
+        } else if (nType == TX_NEW_TOKEN && fIsOwner) { // Owner Token
+            std::string ownerName;
+            if (!OwnerTokenFromScript(scriptPubKey, ownerName, address))
+                continue;
+            nTempAmount = OWNER_TOKEN_AMOUNT;
+        } else if (nType == TX_REISSUE_TOKEN) { // Reissue Token
+            CReissueToken reissueTemp;
+            if (!ReissueTokenFromScript(scriptPubKey, reissueTemp, address))
+                continue;
+            nTempAmount = reissueTemp.nAmount;
+        } else {
+            continue;
+        }
+
+        vTokens.emplace_back(output, nTempAmount);
+    }
+
+    // Shuffle first so equal amounts are not always taken in the same order
+    random_shuffle(vTokens.begin(), vTokens.end(), GetRandInt);
+    std::stable_sort(vTokens.begin(), vTokens.end(), [](const CTokenInputCoin& a, const CTokenInputCoin& b) {
+        return a.nAmount > b.nAmount;
+    });
+}
 
 bool CWallet::SelectTokens(const std::map<std::string, std::vector<COutput> >& mapAvailableTokens, const std::map<std::string, CAmount>& mapTokenTargetValue, std::set<CInputCoin>& setCoinsRet, std::map<std::string, CAmount>& mapValueRet) const
 {
@@ -3627,10 +4614,8 @@ bool CWallet::SelectTokens(const std::map<std::string, std::vector<COutput> >& m
     size_t nMaxChainLength = std::min(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT), gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT));
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
-    for (auto tokenVector : mapAvailableTokens) {
+    for (const auto& tokenVector : mapAvailableTokens) {
         // Setup temporay variables
-        std::vector<COutput> vTokens(tokenVector.second);
-
         std::set<CInputCoin> tempCoinsRet;
         CAmount nTempAmountRet;
         CAmount nTempTargetValue;
@@ -3646,6 +4631,10 @@ bool CWallet::SelectTokens(const std::map<std::string, std::vector<COutput> >& m
         if (mapTokenTargetValue.at(strTokenName) <= 0)
             continue;
 
+        // Decode and sort the token's outputs once for all the passes below
+        std::vector<CTokenInputCoin> vTokens;
+        MakeTokenBucket(tokenVector.second, vTokens);
+
         // Add the starting value into the mapValueRet
         if (!mapValueRet.count(strTokenName))
             mapValueRet.insert(std::make_pair(strTokenName, 0));
@@ -3681,23 +4670,22 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
     AssertLockHeld(cs_wallet); // mapWallet
 
     // sign the new tx
-    CTransaction txNewConst(tx);
-    int nIn = 0;
+    std::vector<CTxOut> vPrevOuts;
+    vPrevOuts.reserve(tx.vin.size());
     for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
         if(mi == mapWallet.end() || input.prevout.n >= mi->second.tx->vout.size()) {
             return false;
         }
-        const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
-        const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
-        SignatureData sigdata;
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
-            return false;
-        }
-        UpdateTransaction(tx, nIn, sigdata);
-        nIn++;
+        vPrevOuts.push_back(mi->second.tx->vout[input.prevout.n]);
     }
-    return true;
+    unsigned int nFailedIn;
+    return SignInputs(tx, vPrevOuts, nFailedIn);
+}
+
+bool CWallet::SignInputs(CMutableTransaction& tx, const std::vector<CTxOut>& vPrevOuts, unsigned int& nFailedIn, int nThreads) const
+{
+    return SignTransactionInputs(*this, tx, vPrevOuts, nFailedIn, nThreads);
 }
 
 bool CWallet::FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl coinControl)
@@ -3754,7 +4742,7 @@ bool CWallet::FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nC
 }
 
 bool CWallet::CreateTransactionWithTokens(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, std::string message, int& nChangePosInOut,
-                               std::string& strFailReason, const CCoinControl& coin_control, const std::vector<CNewToken> tokens, const CTxDestination destination, const KnownTokenType& type, bool sign)
+                               std::string& strFailReason, const CCoinControl& coin_control, const std::vector<CNewToken>& tokens, const CTxDestination& destination, const KnownTokenType& type, bool sign)
 {
     CReissueToken reissueToken;
     return CreateTransactionAll(vecSend, wtxNew, reservekey, nFeeRet, message, nChangePosInOut, strFailReason, coin_control, true, tokens, destination, false, false, reissueToken, type, sign);
@@ -3805,7 +4793,7 @@ bool CWallet::CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWall
 bool CWallet::CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey,
                                    CAmount& nFeeRet, std::string message, int& nChangePosInOut, std::string& strFailReason,
                                    const CCoinControl& coin_control, bool fNewToken,
-                                   const std::vector<CNewToken> tokens, const CTxDestination destination,
+                                   const std::vector<CNewToken>& tokens, const CTxDestination& destination,
                                    bool fTransferToken, bool fReissueToken, const CReissueToken& reissueToken,
                                    const KnownTokenType& tokenType, bool sign)
 {
@@ -3821,6 +4809,9 @@ bool CWallet::CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWall
 
     if (fReissueToken && (reissueToken.IsNull() || !IsValidDestination(destination)))
         return error("%s : Tried reissuing an token and the reissue data was null or the destination was invalid", __func__);
+
+    // Token transactions are estimated from their own class, whose fees differ from plain payments
+    const FeeEstimateClass fee_class = (fNewToken || fTransferToken || fReissueToken) ? FeeEstimateClass::TOKEN : FeeEstimateClass::ANY;
     /** TOKENS END */
 
     CAmount nValue = 0;
@@ -4237,7 +5228,7 @@ bool CWallet::CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWall
                     vin.scriptWitness.SetNull();
                 }
 
-                nFeeNeeded = GetMinimumFee(nBytes, coin_control, ::mempool, ::feeEstimator, &feeCalc);
+                nFeeNeeded = GetMinimumFee(nBytes, coin_control, ::mempool, ::feeEstimator, &feeCalc, fee_class);
 
                 // If we made it here and we aren't even able to meet the relay fee on the next pass, give up
                 // because we must be at the maximum allowed fee.
@@ -4260,7 +5251,7 @@ bool CWallet::CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWall
                     // change output. Only try this once.
                     if (nChangePosInOut == -1 && nSubtractFeeFromAmount == 0 && pick_new_inputs) {
                         unsigned int tx_size_with_change = nBytes + change_prototype_size + 2; // Add 2 as a buffer in case increasing # of outputs changes compact size
-                        CAmount fee_needed_with_change = GetMinimumFee(tx_size_with_change, coin_control, ::mempool, ::feeEstimator, nullptr);
+                        CAmount fee_needed_with_change = GetMinimumFee(tx_size_with_change, coin_control, ::mempool, ::feeEstimator, nullptr, fee_class);
                         CAmount minimum_value_for_change = GetDustThreshold(change_prototype_txout, discard_rate);
                         if (nFeeRet >= fee_needed_with_change + minimum_value_for_change) {
                             pick_new_inputs = false;
@@ -4315,42 +5306,21 @@ bool CWallet::CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWall
 
         if (sign)
         {
-            CTransaction txNewConst(txNew);
-            int nIn = 0;
+            std::vector<CTxOut> vPrevOuts;
             for (const auto& coin : setCoins)
-            {
-                const CScript& scriptPubKey = coin.txout.scriptPubKey;
-                SignatureData sigdata;
-
-                if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
-                {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
-                }
-
-                nIn++;
-            }
+                vPrevOuts.push_back(coin.txout);
             /** TOKENS START */
             if (AreTokensDeployed()) {
-                for (const auto &token : setTokens) {
-                    const CScript &scriptPubKey = token.txout.scriptPubKey;
-                    SignatureData sigdata;
-
-                    if (!ProduceSignature(
-                            TransactionSignatureCreator(this, &txNewConst, nIn, token.txout.nValue, SIGHASH_ALL),
-                            scriptPubKey, sigdata)) {
-                        strFailReason = _("Signing token transaction failed");
-                        return false;
-                    } else {
-                        UpdateTransaction(txNew, nIn, sigdata);
-                    }
-
-                    nIn++;
-                }
+                for (const auto& token : setTokens)
+                    vPrevOuts.push_back(token.txout);
             }
             /** TOKENS END */
+
+            unsigned int nFailedIn;
+            if (!SignInputs(txNew, vPrevOuts, nFailedIn)) {
+                strFailReason = nFailedIn < setCoins.size() ? _("Signing transaction failed") : _("Signing token transaction failed");
+                return false;
+            }
         }
 
         // Embed the constructed transaction data in wtxNew.
@@ -4447,10 +5417,9 @@ uint64_t CWallet::GetStakeWeight() const
 
     CAmount nTargetValue = nBalance - nReserveBalance;
 
-    std::vector< CScript > validatorVector;
-    governance->GetActiveValidators(&validatorVector);
+    std::shared_ptr<const CValidatorSet> validators = GetValidatorSet();
 
-    if (!SelectCoinsForStaking(nTargetValue, setCoins, nValueIn, validatorVector))
+    if (!SelectCoinsForStaking(nTargetValue, setCoins, nValueIn, *validators))
         return 0;
 
     if (setCoins.empty())
@@ -4534,6 +5503,9 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
     for (uint256 hash : vHashOut)
         mapWallet.erase(hash);
+    fTokenLedgerLoaded = false;
+    fStakeLedgerLoaded = false;
+    ++nBalancesTxGeneration;
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
@@ -4714,28 +5686,30 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
+        // Derive and write the keys of each chain as a batch in one database transaction
         CWalletDB walletdb(*dbw);
-        for (int64_t i = missingInternal + missingExternal; i--;)
+        const bool fTxn = (missingInternal + missingExternal > 0) && walletdb.TxnBegin();
+        for (bool internal : {false, true})
         {
-            if (i < missingInternal) {
-                internal = true;
-            }
-
-            assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
-            int64_t index = ++m_max_keypool_index;
+            for (const CPubKey& pubkey : GenerateNewKeys(walletdb, internal ? missingInternal : missingExternal, internal))
+            {
+                assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
+                int64_t index = ++m_max_keypool_index;
 
-            CPubKey pubkey(GenerateNewKey(walletdb, internal));
-            if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
-                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
-            }
+                if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
+                    throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
+                }
 
-            if (internal) {
-                setInternalKeyPool.insert(index);
-            } else {
-                setExternalKeyPool.insert(index);
+                if (internal) {
+                    setInternalKeyPool.insert(index);
+                } else {
+                    setExternalKeyPool.insert(index);
+                }
+                m_pool_key_to_index[pubkey.GetID()] = index;
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
+        }
+        if (fTxn && !walletdb.TxnCommit()) {
+            throw std::runtime_error(std::string(__func__) + ": committing generated keys failed");
         }
         if (missingInternal + missingExternal > 0) {
             LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size());
@@ -5100,17 +6074,21 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    setTokenLedgerPending.insert(output.hash);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    setTokenLedgerPending.insert(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    for (const COutPoint& output : setLockedCoins)
+        setTokenLedgerPending.insert(output.hash);
     setLockedCoins.clear();
 }
 
@@ -5540,6 +6518,13 @@ CWallet* CWallet:: CreateWalletFromFile(const std::string walletFile)
 }
 
 std::atomic<bool> CWallet::fFlushScheduled(false);
+std::atomic<bool> CWallet::fConsolidateScheduled(false);
+
+static void MaybeConsolidateStakeOutputs()
+{
+    for (CWalletRef pwallet : vpwallets)
+        pwallet->ConsolidateStakeOutputs();
+}
 
 void CWallet::postInitProcess(CScheduler& scheduler)
 {
@@ -5549,7 +6534,12 @@ void CWallet::postInitProcess(CScheduler& scheduler)
 
     // Run a thread to flush wallet periodically
     if (!CWallet::fFlushScheduled.exchange(true)) {
-        scheduler.scheduleEvery(MaybeCompactWalletDB, 500);
+        scheduler.scheduleEvery(MaybeCompactWalletDB, 500, CScheduler::PRIORITY_LOW);
+    }
+
+    // Keep the number of small stake outputs, and with it the kernel search, in check
+    if (gArgs.GetBoolArg("-stakeconsolidate", DEFAULT_STAKE_CONSOLIDATE) && !CWallet::fConsolidateScheduled.exchange(true)) {
+        scheduler.scheduleEvery(MaybeConsolidateStakeOutputs, STAKE_CONSOLIDATE_INTERVAL, CScheduler::PRIORITY_LOW);
     }
 }
 
@@ -5636,5 +6626,5 @@ bool CMerkleTx::AcceptToMemoryPool(const CAmount& nAbsurdFee, CValidationState&
 
 void CWallet::StakeCoins(bool fStake)
 {
-    ::StakeCoins(fStake, this, stakeThread);
+    ::StakeCoins(fStake, this);
 }
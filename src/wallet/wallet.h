@@ -25,11 +25,13 @@
 
 #include <algorithm>
 #include <atomic>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -46,6 +48,11 @@ extern bool bSpendZeroConfChange;
 extern bool fWalletRbf;
 
 extern CAmount nReserveBalance;
+extern CAmount nStakeSplitThreshold;
+extern CAmount nStakeCombineThreshold;
+
+/** Number of outputs a coinstake worth nCredit is split into under -stakesplitthreshold */
+unsigned int GetStakeSplitOutputs(CAmount nCredit);
 extern CAmount nMinimumInputValue;
 extern bool fWalletUnlockStakingOnly;
 
@@ -53,6 +60,18 @@ extern std::string my_words;
 extern std::string my_passphrase;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! -stakesplitthreshold default, coinstakes worth more are split into outputs below it
+static const CAmount DEFAULT_STAKE_SPLIT_THRESHOLD = 200 * COIN;
+//! -stakecombinethreshold default, outputs worth less are added to coinstakes and consolidated
+static const CAmount DEFAULT_STAKE_COMBINE_THRESHOLD = 100 * COIN;
+//! Most outputs a coinstake is split into
+static const unsigned int MAX_STAKE_SPLIT_OUTPUTS = 10;
+//! -stakeconsolidate default
+static const bool DEFAULT_STAKE_CONSOLIDATE = false;
+//! Fewest outputs below the combine threshold paying one script that a consolidation is worth a transaction for
+static const unsigned int STAKE_CONSOLIDATE_MIN_OUTPUTS = 10;
+//! How often (in milliseconds) -stakeconsolidate looks for stake outputs to combine
+static const int64_t STAKE_CONSOLIDATE_INTERVAL = 10 * 60 * 1000;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
 //! -fallbackfee default
@@ -75,6 +94,14 @@ static const bool DEFAULT_WALLET_REJECT_LONG_CHAINS = false;
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 //! -walletrbf default
 static const bool DEFAULT_WALLET_RBF = false;
+//! -rescanthreads default
+static const int DEFAULT_RESCAN_THREADS = 4;
+//! Blocks each rescan thread may read ahead of the one being added to the wallet
+static const int RESCAN_BLOCKS_AHEAD_PER_THREAD = 8;
+//! Blocks a rescan adds to the wallet in one database transaction
+static const int RESCAN_BLOCKS_PER_WRITE_BATCH = 100;
+//! -rescanaddressindex default
+static const bool DEFAULT_RESCAN_ADDRESSINDEX = true;
 static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 
@@ -365,6 +392,7 @@ public:
     mutable bool fAvailableWatchCreditCached;
     mutable bool fChangeCached;
     mutable bool fSpendsOfflineStaking;
+    mutable bool fStakeSettled; //!< set by the stake ledger, see CWallet::mapStakeLedger
     mutable CAmount nDebitCached;
     mutable CAmount nCreditCached;
     mutable CAmount nImmatureCreditCached;
@@ -413,6 +441,7 @@ public:
         fImmatureWatchCreditCached = false;
         fAvailableWatchCreditCached = false;
         fSpendsOfflineStaking = false;
+        fStakeSettled = false;
         fChangeCached = false;
         nDebitCached = 0;
         nCreditCached = 0;
@@ -591,6 +620,19 @@ public:
     std::string ToString() const;
 };
 
+/** A spendable token output, decoded once for all the passes of token coin selection */
+class CTokenInputCoin
+{
+public:
+    CInputCoin coin;
+    CAmount nAmount;
+    int nDepth;
+    bool fFromMe;
+
+    CTokenInputCoin(const COutput& output, const CAmount& nAmountIn) :
+        coin(output.tx, output.i), nAmount(nAmountIn), nDepth(output.nDepth), fFromMe(output.tx->IsFromMe(ISMINE_ALL)) {}
+};
+
 
 
 
@@ -704,6 +746,51 @@ private:
 };
 
 
+/** Counters of a wallet's staking thread, reported by getstakinginfo */
+struct CStakerStats
+{
+    std::atomic<uint64_t> nIterations{0};
+    std::atomic<uint64_t> nKernelsChecked{0};
+    std::atomic<uint64_t> nTemplatesBuilt{0};
+    std::atomic<uint64_t> nTemplatesDiscarded{0};
+    std::atomic<uint64_t> nTemplatesReused{0};
+    std::atomic<uint64_t> nBlocksSigned{0};
+    std::atomic<uint64_t> nBlocksExpired{0};
+
+    //! Time spent, in microseconds
+    std::atomic<int64_t> nAvailableCoinsTime{0};
+    std::atomic<int64_t> nKernelSearchTime{0};
+    std::atomic<int64_t> nCreateNewBlockTime{0};
+    std::atomic<int64_t> nSignBlockTime{0};
+    //! Waiting for cs_main and cs_wallet while preparing the stake
+    std::atomic<int64_t> nLockWaitTime{0};
+};
+
+/** Length, in seconds of block time, of the periods the stake ledger sums rewards over */
+static const int64_t STAKE_LEDGER_PERIOD = 60 * 60;
+
+/** Coinstakes found, and the net amount they paid to the wallet, over some periods */
+struct CStakeRewardPeriod
+{
+    unsigned int nCount = 0;
+    CAmount nReward = 0;
+};
+
+/** Every balance of a wallet, computed together in one walk of mapWallet */
+struct CWalletBalances
+{
+    CAmount nBalance = 0;
+    CAmount nUnconfirmed = 0;
+    CAmount nImmature = 0;
+    CAmount nLocked = 0;
+    CAmount nOfflineStaking = 0;
+    CAmount nStake = 0;
+    CAmount nWatchOnly = 0;
+    CAmount nUnconfirmedWatchOnly = 0;
+    CAmount nImmatureWatchOnly = 0;
+    CAmount nWatchOnlyStake = 0;
+};
+
 /** 
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -712,6 +799,7 @@ class CWallet final : public CCryptoKeyStore, public CValidationInterface
 {
 private:
     static std::atomic<bool> fFlushScheduled;
+    static std::atomic<bool> fConsolidateScheduled;
     std::atomic<bool> fAbortRescan;
     std::atomic<bool> fScanningWallet;
 
@@ -722,10 +810,19 @@ private:
      */
     bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr) const;
 
-    bool SelectTokens(const std::map<std::string, std::vector<COutput> >& mapAvailableTokens, const std::map<std::string, CAmount>& mapTokenTargetValue, std::set<CInputCoin>& setCoinsRet, std::map<std::string, CAmount>& nValueRet) const;
-
     CWalletDB *pwalletdbEncryption;
 
+    //! While a CWalletWriteBatch is in scope, the handle wallet transactions are written through and whether it has a
+    //! database transaction open
+    CWalletDB *pwalletdbBatch;
+    bool fBatchTxn;
+    friend class CWalletWriteBatch;
+
+    //! The write batch if there is one, otherwise a handle of its own kept in walletdbOwned
+    CWalletDB& GetWalletDB(std::unique_ptr<CWalletDB>& walletdbOwned, bool fFlushOnClose = true);
+    //! Commit what the write batch holds and open the next database transaction, before another handle writes
+    void CommitWriteBatch();
+
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
 
@@ -762,6 +859,10 @@ private:
 
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal = false);
+    /* HD derive the parent of the keys of the internal or external chain */
+    void DeriveChainKey(CExtKey& chainChildKey, bool internal);
+    /* HD derive the next child key of chainChildKey not in the wallet yet, advancing the chain counter but not writing it */
+    void DeriveNextChildKey(const CExtKey& chainChildKey, CKeyMetadata& metadata, CKey& secret, CPubKey& pubkey, bool internal);
 
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
@@ -783,9 +884,149 @@ private:
 
     std::unique_ptr<CWalletDBWrapper> dbw;
 
-    std::map<COutPoint, CStakeCache> stakeCache;
+    /**
+     * Stake candidates: wallet outputs that are ours, carry value and are not tokens.
+     * They wait in mapImmatureStake under the height they become stakable at and move to
+     * setMatureStake, which iterates in mapWallet order, once the tip reaches it. Anything
+     * AddToWallet touches is queued in setStakePending for the next staking pass.
+     */
+    mutable std::multimap<int, COutPoint> mapImmatureStake;
+    mutable std::set<COutPoint> setMatureStake;
+    mutable std::map<COutPoint, int> mapStakeMaturity;
+    mutable std::set<uint256> setStakePending;
+    mutable bool fStakeCandidatesLoaded = false;
+
+    /**
+     * Delegated stake: candidates paying to an offline staking script whose staking key we hold.
+     * Once mature they are kept in mapDelegatedStake under that key instead of setMatureStake,
+     * so a hot node staking for many delegators checks each staking key once per pass.
+     */
+    mutable std::map<CKeyID, std::set<COutPoint> > mapDelegatedStake;
+    mutable std::map<COutPoint, CKeyID> mapDelegatedStaker;
+
+    void UpdateStakeCandidate(const COutPoint& outpoint, int nTipHeight) const;
+    void RemoveStakeCandidate(const COutPoint& outpoint) const;
+    void InsertMatureStake(const COutPoint& outpoint) const;
+
+    //! Keys, scripts and watch-only entries in the keystore, to notice the ones a rescan adds
+    size_t KeyStoreSize() const;
+
+    struct IsMineFilterHasher {
+        size_t operator()(const uint160& hash) const { return hash.GetUint64(0); }
+    };
+
+    /**
+     * Every hash GetIsMineFilterHash() can return for a script of this wallet: key ids, script
+     * ids and the hashes of watch-only scripts. Rebuilt by MayBeMine() when
+     * nKeyStoreGeneration moves, guarded by cs_KeyStore.
+     */
+    mutable std::unordered_set<uint160, IsMineFilterHasher> setIsMineFilter;
+    mutable uint64_t nIsMineFilterGeneration = 0;
+
+    /**
+     * Adds the heights in [nStart, nEnd] at which the address index lists the keys and scripts
+     * of the wallet not in setQueried yet. False if the wallet holds scripts the index doesn't
+     * cover, offline staking ones or watch-only ones without an address, or the index failed.
+     */
+    bool GetRescanHeights(std::set<std::pair<int, uint160> >& setQueried, int nStart, int nEnd, std::set<int>& setHeights) const;
+
+    /**
+     * Scan vBlocks from nPos on: nThreads threads read the blocks ahead and run IsMine over
+     * their outputs, and the transactions they matched, or that touch the wallet's own, are
+     * added in block order. Returns the position after the last block added, early on abort
+     * or, with fStopOnNewKeys, after a block that added keys to the wallet.
+     */
+    size_t ScanBlocks(const std::vector<CBlockIndex*>& vBlocks, size_t nPos, int nThreads, bool fUpdate, bool fStopOnNewKeys,
+                      CBlockIndex*& pindexFailed, const std::function<void(CBlockIndex*)>& progress);
+
+    /**
+     * Token ledger: the unspent token outputs of the wallet. Confirmed outputs with no timelock,
+     * maturity or restriction to recheck are settled: their amount is summed per token under the
+     * height they confirmed at, so a balance is a total minus the few buckets too shallow for the
+     * asked depth. Every other output is kept in setTokenLedgerVolatile and checked per query.
+     * AddToWallet, conflicts, abandons and coin locks queue the transaction in
+     * setTokenLedgerPending; its outputs and the outputs it spends are re-indexed on the next query.
+     * A disconnected block re-indexes the whole wallet.
+     */
+    struct CTokenLedgerEntry
+    {
+        std::string strName;
+        CAmount nAmount;
+        int nHeight; //!< height the output confirmed at, -1 when volatile
+    };
+    struct CTokenLedgerBalance
+    {
+        CAmount nTotal = 0;
+        std::map<int, CAmount> mapByHeight;
+    };
+    mutable std::map<COutPoint, CTokenLedgerEntry> mapTokenLedger;
+    mutable std::map<std::string, CTokenLedgerBalance> mapTokenLedgerSettled;
+    mutable std::set<COutPoint> setTokenLedgerVolatile;
+    mutable std::set<uint256> setTokenLedgerPending;
+    mutable bool fTokenLedgerLoaded = false;
+
+    void UpdateTokenLedger(const COutPoint& outpoint, int nTipHeight) const;
+    void RemoveTokenLedger(const COutPoint& outpoint) const;
+    bool IsTokenLedgerOutputAvailable(const COutPoint& outpoint, int nMinDepth) const;
+
+    /**
+     * Stake ledger: the confirmed coinstakes of the wallet and what each earned, summed per
+     * STAKE_LEDGER_PERIOD of block time in mapStakeRewards. A coinstake that is mature and whose
+     * outputs are all spent by confirmed transactions is settled: fStakeSettled is set on it and
+     * the balance and AvailableCoins walks skip it. The others are kept in setStakeLedgerVolatile
+     * and rechecked when the tip moves. Queued and reset like the token ledger.
+     */
+    struct CStakeLedgerEntry
+    {
+        int64_t nPeriod;
+        CAmount nReward;
+    };
+    mutable std::map<uint256, CStakeLedgerEntry> mapStakeLedger;
+    mutable std::map<int64_t, CStakeRewardPeriod> mapStakeRewards;
+    mutable std::set<uint256> setStakeLedgerVolatile;
+    mutable std::set<uint256> setStakeLedgerPending;
+    mutable bool fStakeLedgerLoaded = false;
+    mutable int nStakeLedgerHeight = -1;
+
+    void UpdateStakeLedger(const uint256& hash) const;
+    void RemoveStakeLedger(const uint256& hash) const;
+    //! Brings the stake ledger up to date, called by the walks that rely on fStakeSettled
+    void SyncStakeLedger() const;
+
+    /**
+     * Balance cache: the last CWalletBalances and what they were computed against. A read whose
+     * key still matches returns them without taking cs_main or cs_wallet. Anything that changes
+     * the state of a wallet transaction bumps nBalancesTxGeneration under cs_wallet.
+     */
+    struct CWalletBalancesKey
+    {
+        uint256 hashTip;
+        uint64_t nTxGeneration;
+        uint64_t nKeyGeneration;
+        unsigned int nMempoolUpdated;
+
+        bool operator==(const CWalletBalancesKey& other) const
+        {
+            return hashTip == other.hashTip && nTxGeneration == other.nTxGeneration && nKeyGeneration == other.nKeyGeneration && nMempoolUpdated == other.nMempoolUpdated;
+        }
+    };
+    mutable CCriticalSection cs_balances;
+    mutable CWalletBalances cachedBalances;
+    mutable CWalletBalancesKey balancesKey;
+    mutable bool fBalancesCached = false;
+    std::atomic<uint64_t> nBalancesTxGeneration{0};
+
+    CWalletBalances ComputeBalances() const;
+
+    //! Coin metadata of the last GetStakeKernels, guarded by cs_main
+    mutable std::map<COutPoint, CStakeCache> mapStakeCache;
+
+    //! Kernels of the coins in setCoins that could stake on top of pindexPrev, with the coin each belongs to
+    void GetStakeKernels(CBlockIndex* pindexPrev, const std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<CStakeKernel>& vKernels, std::vector<std::pair<const CWalletTx*,unsigned int> >& vKernelCoins) const;
+
+    //! Latest validator set published through ValidatorSetChanged
+    mutable std::shared_ptr<const CValidatorSet> validatorSet;
 
-    boost::thread_group* stakeThread = nullptr;
     void StakeCoins(bool fStake);
 
 public:
@@ -848,6 +1089,8 @@ public:
         nWalletMaxVersion = FEATURE_BASE;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = nullptr;
+        pwalletdbBatch = nullptr;
+        fBatchTxn = false;
         nOrderPosNext = 0;
         nAccountingEntryNumber = 0;
         nNextResend = 0;
@@ -880,7 +1123,7 @@ public:
     bool CanSupportFeature(enum WalletFeature wf) const { AssertLockHeld(cs_wallet); return nWalletMaxVersion >= wf; }
 
     //! select coins for staking from the available coins for staking.
-    bool SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, std::vector< CScript > validatorVector) const;
+    bool SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CValidatorSet& validators) const;
 
     /**
      * populate vCoins with vector of available COutputs, and populates vTokenCoins in fWithTokens is set to true.
@@ -908,6 +1151,12 @@ public:
                          const CAmount &nMaximumAmount = MAX_MONEY, const CAmount &nMinimumSumAmount = MAX_MONEY,
                          const uint64_t &nMaximumCount = 0, const int &nMinDepth = 0, const int &nMaxDepth = 9999999) const;
 
+    /**
+     * Balance of every owned token whose name starts with prefix, from the token ledger.
+     * Counts the same outputs as AvailableTokens(mapTokenCoins, true, nullptr, 1, MAX_MONEY, MAX_MONEY, 0, nMinDepth).
+     */
+    void GetTokenBalances(std::map<std::string, CAmount>& mapBalances, int nMinDepth = 0, const std::string& prefix = "") const;
+
     /**
      * Helper function that calls AvailableCoinsAll, used to receive all coins, Tokens and PLB
      */
@@ -923,9 +1172,9 @@ public:
                         const CAmount& nMinimumSumAmount = MAX_MONEY, const uint64_t& nMaximumCount = 0,
                         const int& nMinDepth = 0, const int& nMaxDepth = 9999999) const;
 
-    void AvailableCoinsForStaking(std::vector<COutput>& vCoins, std::vector< CScript > validatorVector) const;
+    void AvailableCoinsForStaking(std::vector<COutput>& vCoins, const CValidatorSet& validators) const;
     uint64_t GetStakeWeight() const;
-    bool HaveAvailableCoinsForStaking(std::vector< CScript > validatorVector) const;
+    bool HaveAvailableCoinsForStaking(const CValidatorSet& validators) const;
 
     /**
      * Return list of available coins and locked coins grouped by non-change output address.
@@ -950,7 +1199,19 @@ public:
      * assembled
      */
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
-    bool SelectTokensMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const std::string& strTokenName, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
+
+    /**
+     * Select token outputs until nTargetValue is reached. vTokens must be sorted by
+     * descending amount. An exact match found by branch and bound needs no token change
+     * output and is preferred; otherwise the stochastic subset search picks the inputs.
+     */
+    bool SelectTokensMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const std::string& strTokenName, const std::vector<CTokenInputCoin>& vTokens, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
+
+    /**
+     * Select token outputs for every token in mapTokenTargetValue, relaxing the
+     * confirmation requirements pass by pass like SelectCoins does
+     */
+    bool SelectTokens(const std::map<std::string, std::vector<COutput> >& mapAvailableTokens, const std::map<std::string, CAmount>& mapTokenTargetValue, std::set<CInputCoin>& setCoinsRet, std::map<std::string, CAmount>& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -972,6 +1233,11 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey(CWalletDB& walletdb, bool internal = false);
+    /**
+     * Generate nCount new keys of one chain. HD keys share the derivation of
+     * their parent, and the chain counter is written once for all of them.
+     */
+    std::vector<CPubKey> GenerateNewKeys(CWalletDB& walletdb, unsigned int nCount, bool internal = false);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
     bool AddKeyPubKeyWithDB(CWalletDB &walletdb,const CKey& key, const CPubKey &pubkey);
@@ -1011,6 +1277,7 @@ public:
     //! Adds a watch-only address to the store, and saves it to disk.
     bool AddWatchOnly(const CScript& dest, int64_t nCreateTime);
     bool RemoveWatchOnly(const CScript &dest) override;
+    bool RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest);
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 
@@ -1035,10 +1302,12 @@ public:
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
-    bool LoadToWallet(const CWalletTx& wtxIn);
-    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    bool LoadToWallet(CWalletTx&& wtxIn);
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t nMempoolSequence) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
+    void ValidatorSetChanged(const std::shared_ptr<const CValidatorSet>& validators) override;
+    std::shared_ptr<const CValidatorSet> GetValidatorSet() const;
     bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
     int64_t RescanFromTime(int64_t startTime, bool update);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, bool fUpdate = false);
@@ -1046,6 +1315,8 @@ public:
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    //! Every balance below, from the balance cache when nothing they depend on has moved
+    CWalletBalances GetBalances() const;
     CAmount GetBalance() const;
     CAmount GetOfflineStakingBalance() const;
     CAmount GetUnconfirmedBalance() const;
@@ -1058,6 +1329,8 @@ public:
     CAmount GetWatchOnlyStake() const;
     CAmount GetLockedBalance() const;
     CAmount GetStake() const;
+    //! Coinstakes confirmed in the main chain with a block time at or after nSince
+    CStakeRewardPeriod GetStakeRewards(int64_t nSince) const;
 
     /**
      * Insert additional inputs into the transaction by
@@ -1065,10 +1338,12 @@ public:
      */
     bool FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl);
     bool SignTransaction(CMutableTransaction& tx);
+    /** SignTransactionInputs() with the wallet's keys */
+    bool SignInputs(CMutableTransaction& tx, const std::vector<CTxOut>& vPrevOuts, unsigned int& nFailedIn, int nThreads = 0) const;
 
     /** TOKENS START */
     bool CreateTransactionWithTokens(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, std::string message, int& nChangePosInOut,
-                                   std::string& strFailReason, const CCoinControl& coin_control, const std::vector<CNewToken> tokens, const CTxDestination destination, const KnownTokenType& tokenType, bool sign = true);
+                                   std::string& strFailReason, const CCoinControl& coin_control, const std::vector<CNewToken>& tokens, const CTxDestination& destination, const KnownTokenType& tokenType, bool sign = true);
 
     bool CreateTransactionWithTransferToken(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, std::string message, int& nChangePosInOut,
                                                      std::string& strFailReason, const CCoinControl& coin_control, bool sign = true);
@@ -1079,7 +1354,28 @@ public:
     bool CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, std::string message, int& nChangePosInOut,
                            std::string& strFailReason, const CCoinControl& coin_control, bool sign = true);
 
-    bool CreateCoinStake(const CKeyStore &keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, std::vector< CScript > validatorVector);
+    /**
+     * The kernels of the coins CreateCoinStake would consider on top of pindexPrev, prepared once
+     * so the staking engine can hash them for every timestamp slot it searches without building or
+     * signing anything. False if the wallet has nothing to stake.
+     */
+    bool GetStakeKernelCandidates(CBlockIndex* pindexPrev, const CValidatorSet& validators, std::vector<CStakeKernel>& vKernels);
+
+    //! Moves whenever the coins GetStakeKernelCandidates could pick from may have changed: a wallet transaction
+    //! changed state, or a key or script was added or removed
+    uint64_t GetStakeCoinsGeneration() const { return nBalancesTxGeneration + nKeyStoreGeneration; }
+
+    //! SearchStakeKernels, counted in m_staker_stats
+    int SearchStakeKernel(const std::vector<CStakeKernel>& vKernels, unsigned int nBits, uint32_t nTimeBlock, int nThreads) const;
+
+    bool CreateCoinStake(const CKeyStore &keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, const CValidatorSet& validators);
+
+    /**
+     * Combine the stake candidates below -stakecombinethreshold that pay one script into a single
+     * output to that script, keeping the total below -stakesplitthreshold. Only done for the script
+     * with the most of them, once there are at least STAKE_CONSOLIDATE_MIN_OUTPUTS.
+     */
+    bool ConsolidateStakeOutputs();
 
     /**
      * Create a new transaction paying the recipients with a set of coins
@@ -1090,7 +1386,7 @@ public:
                            std::string& strFailReason, const CCoinControl& coin_control, bool fNewToken, const CNewToken& token, const CTxDestination dest, bool fTransferToken, bool fReissueToken, const CReissueToken& reissueToken, const KnownTokenType& tokenType, bool sign = true);
 
     bool CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, std::string message,
-                              int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, bool fNewToken, const std::vector<CNewToken> tokens, const CTxDestination destination, bool fTransferToken, bool fReissueToken, const CReissueToken& reissueToken, const KnownTokenType& tokenType, bool sign);
+                              int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, bool fNewToken, const std::vector<CNewToken>& tokens, const CTxDestination& destination, bool fTransferToken, bool fReissueToken, const CReissueToken& reissueToken, const KnownTokenType& tokenType, bool sign);
 
     bool CreateNewChangeAddress(CReserveKey& reservekey, CKeyID& keyID, std::string& strFailReason);
 
@@ -1135,6 +1431,11 @@ public:
     CAmount GetDebit(const CTxIn& txin, const isminefilter& filter) const;
     CAmount GetDebit(const CTxIn& txin, const isminefilter& filter, CTokenOutputEntry& tokenData) const;
     isminetype IsMine(const CTxOut& txout) const;
+    /**
+     * False when scriptPubKey can't be mine. P2PKH, P2SH and P2PK scripts, token transfers to
+     * them included, are answered with one hash set lookup, anything else is left to IsMine().
+     */
+    bool MayBeMine(const CScript& scriptPubKey) const;
     isminetype IsMineDest(const CTxDestination &dest) const;
     CAmount GetCredit(const CTxOut& txout, const isminefilter& filter) const;
     bool IsChange(const CTxOut& txout) const;
@@ -1281,6 +1582,24 @@ public:
 
     int64_t m_last_coin_stake_search_time{0};
     int64_t m_last_coin_stake_search_interval{0};
+    mutable CStakerStats m_staker_stats;
+};
+
+/** Sends the wallet transaction writes made while in scope, those of a connected block or of a chunk of a rescan,
+ *  through one database transaction committed when it goes out of scope. cs_wallet has to be held throughout, and a
+ *  batch already in scope is left to commit them */
+class CWalletWriteBatch
+{
+private:
+    CWallet& wallet;
+    std::unique_ptr<CWalletDB> walletdb;
+
+public:
+    explicit CWalletWriteBatch(CWallet& walletIn);
+    ~CWalletWriteBatch();
+
+    CWalletWriteBatch(const CWalletWriteBatch&) = delete;
+    CWalletWriteBatch& operator=(const CWalletWriteBatch&) = delete;
 };
 
 /** A key allocated from the key pool. */
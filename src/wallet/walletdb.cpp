@@ -18,6 +18,7 @@
 #include "wallet/wallet.h"
 
 #include <atomic>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -241,6 +242,86 @@ public:
     }
 };
 
+// Decode and check a "tx" record whose type was read from ssKey already. fUpgraded is set when
+// the record was written by a version that serialized it differently and must be rewritten.
+static bool ReadTxRecord(CDataStream& ssKey, CDataStream& ssValue, uint256& hash, CWalletTx& wtx, bool& fUpgraded, std::string& strErr)
+{
+    fUpgraded = false;
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid())) {
+        // If a client has a wallet.dat that contains token transactions, but we are syncing the chain.
+        // we want to make sure that we don't fail to load this wallet transaction just because it is an token transaction
+        // before token are active
+        if (state.GetRejectReason() != "bad-txns-is-token-and-token-not-active" && state.GetRejectReason() != "bad-txns-transfer-token-bad-deserialize") {
+            strErr = state.GetRejectReason();
+            return false;
+        }
+    }
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
+//! A "tx" record put aside by LoadWallet() to be decoded with the others on several threads
+struct CWalletTxRecord
+{
+    CDataStream ssKey;
+    CDataStream ssValue;
+    uint256 hash;
+    CWalletTx wtx;
+    bool fRead = false;
+    bool fUpgraded = false;
+    std::string strErr;
+
+    CWalletTxRecord(CDataStream&& ssKeyIn, CDataStream&& ssValueIn) : ssKey(std::move(ssKeyIn)), ssValue(std::move(ssValueIn)) {}
+};
+
+static void ReadTxRecords(std::vector<CWalletTxRecord>& vRecords)
+{
+    std::atomic<size_t> nNext(0);
+    auto worker = [&]() {
+        size_t n;
+        while ((n = nNext++) < vRecords.size()) {
+            CWalletTxRecord& record = vRecords[n];
+            try {
+                std::string strType;
+                record.ssKey >> strType;
+                record.fRead = ReadTxRecord(record.ssKey, record.ssValue, record.hash, record.wtx, record.fUpgraded, record.strErr);
+            } catch (...) {
+                record.fRead = false;
+            }
+        }
+    };
+
+    int nThreads = std::max(1, std::min(GetNumCores(), (int)(vRecords.size() / MIN_TX_RECORDS_PER_LOAD_THREAD)));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; i++)
+        vThreads.emplace_back(worker);
+    worker();
+    for (auto& thread : vThreads)
+        thread.join();
+}
+
 bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr)
 {
@@ -264,44 +345,17 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         else if (strType == "tx")
         {
             uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid())) {
-                // If a client has a wallet.dat that contains token transactions, but we are syncing the chain.
-                // we want to make sure that we don't fail to load this wallet transaction just because it is an token transaction
-                // before token are active
-                if (state.GetRejectReason() != "bad-txns-is-token-and-token-not-active" && state.GetRejectReason() != "bad-txns-transfer-token-bad-deserialize") {
-                    strErr = state.GetRejectReason();
-                    return false;
-                }
-            }
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
+            bool fUpgraded;
+            if (!ReadTxRecord(ssKey, ssValue, hash, wtx, fUpgraded, strErr))
+                return false;
+            if (fUpgraded)
                 wss.vWalletUpgrade.push_back(hash);
-            }
 
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
 
-            pwallet->LoadToWallet(wtx);
+            pwallet->LoadToWallet(std::move(wtx));
         }
         else if (strType == "acentry")
         {
@@ -619,6 +673,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        std::vector<CWalletTxRecord> vTxRecords;
         while (true)
         {
             // Read next record
@@ -633,8 +688,15 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
-            // Try to be tolerant of single corrupt records:
+            // Transactions are put aside and decoded on several threads once the cursor is done
             std::string strType, strErr;
+            CDataStream(ssKey) >> strType;
+            if (strType == "tx") {
+                vTxRecords.emplace_back(std::move(ssKey), std::move(ssValue));
+                continue;
+            }
+
+            // Try to be tolerant of single corrupt records:
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
             {
                 // losing keys is considered a catastrophic error, anything else
@@ -656,6 +718,25 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        // The transactions are added in cursor order, as if they had been read in the loop above
+        ReadTxRecords(vTxRecords);
+        for (CWalletTxRecord& record : vTxRecords) {
+            if (!record.fRead) {
+                LogPrintf("DB failed to Read Key Value. Type: tx, Error: %s\n", record.strErr);
+                fNoncriticalErrors = true;
+                // Rescan if there is a bad transaction record:
+                gArgs.SoftSetBoolArg("-rescan", true);
+            } else {
+                if (!record.strErr.empty())
+                    LogPrintf("%s\n", record.strErr);
+                if (record.fUpgraded)
+                    wss.vWalletUpgrade.push_back(record.hash);
+                if (record.wtx.nOrderPos == -1)
+                    wss.fAnyUnordered = true;
+                pwallet->LoadToWallet(std::move(record.wtx));
+            }
+        }
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -35,6 +35,8 @@
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! Transaction records each extra thread must have to decode before LoadWallet() starts it
+static const unsigned int MIN_TX_RECORDS_PER_LOAD_THREAD = 256;
 
 class CAccount;
 class CAccountingEntry;
@@ -8,6 +8,8 @@
 
 #include "zmqconfig.h"
 
+#include <set>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
 class CMessage;
@@ -17,7 +19,9 @@ typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(nullptr) { }
+    static const int DEFAULT_ZMQ_SNDHWM {1000};
+
+    CZMQAbstractNotifier() : psocket(nullptr), outbound_message_high_water_mark(DEFAULT_ZMQ_SNDHWM) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -30,18 +34,36 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    //! Only publish the token events of these tokens, all of them if empty
+    void SetTokenFilter(const std::set<std::string> &s) { setTokenFilter = s; }
+    int GetOutboundMessageHighWaterMark() const { return outbound_message_high_water_mark; }
+    void SetOutboundMessageHighWaterMark(const int sndhwm) {
+        if (sndhwm >= 0) {
+            outbound_message_high_water_mark = sndhwm;
+        }
+    }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    //! pblock is the block of pindex when it is still in memory, nullptr otherwise
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
     virtual bool NotifyMessage(const CMessage& message);
+    //! The mempool and chain events of the sequence topic, in the order they happened
+    virtual bool NotifyBlockConnect(const uint256 &hash);
+    virtual bool NotifyBlockDisconnect(const uint256 &hash);
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence);
 
 protected:
+    bool IsTokenFiltered(const std::string &name) const { return !setTokenFilter.empty() && !setTokenFilter.count(name); }
+
     void *psocket;
     std::string type;
     std::string address;
+    std::set<std::string> setTokenFilter;
+    int outbound_message_high_water_mark; // aka SNDHWM
 };
 
 #endif // PLB_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -26,7 +26,8 @@ protected:
     void Shutdown();
 
     // CValidationInterface
-    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t nMempoolSequence) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
@@ -35,8 +36,13 @@ protected:
 private:
     CZMQNotificationInterface();
 
+    //! Publish a transaction on the transaction topics, when it enters the mempool or a block is connected or disconnected
+    void NotifyTransaction(const CTransactionRef& ptx);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    //! The block most recently connected, published from memory when it becomes the tip
+    std::shared_ptr<const CBlock> m_last_connected_block;
 };
 
 #endif // PLB_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -3,9 +3,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "streams.h"
+#include "script/standard.h"
+#include "tokens/tokens.h"
 #include "zmqpublishnotifier.h"
 #include "validation.h"
 #include "util.h"
@@ -18,6 +21,16 @@ static const char *MSG_HASHTX      = "hashtx";
 static const char *MSG_RAWBLOCK    = "rawblock";
 static const char *MSG_RAWTX       = "rawtx";
 static const char *MSG_RAWTOKENMSG = "rawmessage";
+static const char *MSG_TOKENEVENT  = "tokenevent";
+static const char *MSG_RESTRICTEDEVENT = "restrictedevent";
+static const char *MSG_SEQUENCE    = "sequence";
+
+//! Kinds of record the restrictedevent topic publishes
+enum RestrictedEventKind : uint8_t {
+    RESTRICTED_EVENT_ADDRESS = 0,   //!< a qualifier tag or a restricted token freeze on an address
+    RESTRICTED_EVENT_GLOBAL = 1,    //!< a restricted token frozen or unfrozen for everyone
+    RESTRICTED_EVENT_VERIFIER = 2,  //!< the verifier string of a restricted token set
+};
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -78,7 +91,17 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        // A subscriber that falls this far behind loses messages instead of growing our queue
+        LogPrint(BCLog::ZMQ, "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, outbound_message_high_water_mark);
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &outbound_message_high_water_mark, sizeof(outbound_message_high_water_mark));
+        if (rc != 0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -148,7 +171,51 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+static void zmq_free_stream(void * /*data*/, void *hint)
+{
+    delete static_cast<CDataStream*>(hint);
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, std::unique_ptr<CDataStream> data)
+{
+    assert(psocket);
+
+    if (zmq_send(psocket, command, strlen(command), ZMQ_SNDMORE) == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        return false;
+    }
+
+    // zmq owns the stream from here on and frees it once the message is out
+    zmq_msg_t msg;
+    CDataStream* pstream = data.release();
+    if (zmq_msg_init_data(&msg, pstream->data(), pstream->size(), zmq_free_stream, pstream) != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        delete pstream;
+        return false;
+    }
+    if (zmq_msg_send(&msg, psocket, ZMQ_SNDMORE) == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        zmq_msg_close(&msg);
+        return false;
+    }
+
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], nSequence);
+    if (zmq_send(psocket, msgseq, sizeof(msgseq), 0) == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        return false;
+    }
+
+    nSequence++;
+
+    return true;
+}
+
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CBlock * /*pblock*/)
 {
     uint256 hash = pindex->GetIndexHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashblock %s\n", hash.GetHex());
@@ -168,34 +235,153 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetIndexHash().GetHex());
 
-    const Consensus::Params& consensusParams = GetParams().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    {
-        LOCK(cs_main);
+    std::unique_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags()));
+    if (pblock) {
+        *ss << *pblock;
+    } else {
+        // Only when the tip was not connected in this session, such as after invalidateblock
+        const Consensus::Params& consensusParams = GetParams().GetConsensus();
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
         {
-            zmqError("Can't read block from disk");
-            return false;
+            LOCK(cs_main);
+            if(!ReadBlockFromDisk(block, pindex, consensusParams))
+            {
+                zmqError("Can't read block from disk");
+                return false;
+            }
         }
-
-        ss << block;
+        *ss << block;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, std::move(ss));
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    std::unique_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags()));
+    *ss << transaction;
+    return SendMessage(MSG_RAWTX, std::move(ss));
+}
+
+bool CZMQPublishTokenEventNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    const uint256 hash = transaction.GetHash();
+    for (uint32_t n = 0; n < transaction.vout.size(); n++) {
+        const CScript& script = transaction.vout[n].scriptPubKey;
+        int nType = 0;
+        bool fOwner = false;
+        if (!script.IsTokenScript(nType, fOwner))
+            continue;
+
+        std::string strName;
+        CAmount nAmount;
+        uint32_t nTimeLock;
+        if (!GetTokenInfoFromScript(script, strName, nAmount, nTimeLock) || IsTokenFiltered(strName))
+            continue;
+
+        CTxDestination dest;
+        ExtractDestination(script, dest);
+
+        LogPrint(BCLog::ZMQ, "zmq: Publish tokenevent %s:%u %s\n", hash.GetHex(), n, strName);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << hash << n << (uint8_t)nType << fOwner << strName << EncodeDestination(dest) << nAmount;
+        if (!SendMessage(MSG_TOKENEVENT, &(*ss.begin()), ss.size()))
+            return false;
+    }
+    return true;
+}
+
+bool CZMQPublishRestrictedEventNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    const uint256 hash = transaction.GetHash();
+
+    // A verifier is set in the transaction issuing or reissuing its restricted token
+    std::string strRestricted;
+    for (const auto& out : transaction.vout) {
+        std::string strName;
+        if (TokenNameFromScript(out.scriptPubKey, strName) && IsTokenNameAnRestricted(strName))
+            strRestricted = strName;
+    }
+
+    for (uint32_t n = 0; n < transaction.vout.size(); n++) {
+        const CScript& script = transaction.vout[n].scriptPubKey;
+        if (!script.IsNullToken())
+            continue;
+
+        uint8_t nKind;
+        std::string strName, strAddress, strVerifier;
+        int8_t nFlag = 0;
+        CNullTokenTxData data;
+        CNullTokenTxVerifierString verifier;
+        if (TokenNullDataFromScript(script, data, strAddress)) {
+            nKind = RESTRICTED_EVENT_ADDRESS;
+            strName = data.token_name;
+            nFlag = data.flag;
+        } else if (GlobalTokenNullDataFromScript(script, data)) {
+            nKind = RESTRICTED_EVENT_GLOBAL;
+            strName = data.token_name;
+            nFlag = data.flag;
+        } else if (TokenNullVerifierDataFromScript(script, verifier)) {
+            nKind = RESTRICTED_EVENT_VERIFIER;
+            strName = strRestricted;
+            strVerifier = verifier.verifier_string;
+        } else {
+            continue;
+        }
+        if (IsTokenFiltered(strName))
+            continue;
+
+        LogPrint(BCLog::ZMQ, "zmq: Publish restrictedevent %s:%u %s\n", hash.GetHex(), n, strName);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << hash << n << nKind << strName << strAddress << nFlag << strVerifier;
+        if (!SendMessage(MSG_RESTRICTEDEVENT, &(*ss.begin()), ss.size()))
+            return false;
+    }
+    return true;
+}
+
+/** Publish a sequence event: the hash, reversed as in the hash topics, the label and, for mempool events, the LE 8byte mempool sequence */
+static bool SendSequenceMsg(CZMQAbstractPublishNotifier& notifier, const uint256& hash, char label, const uint64_t* pnMempoolSequence = nullptr)
+{
+    unsigned char data[sizeof(uint256) + sizeof(label) + sizeof(uint64_t)];
+    for (unsigned int i = 0; i < sizeof(uint256); i++)
+        data[sizeof(uint256) - 1 - i] = hash.begin()[i];
+    data[sizeof(uint256)] = label;
+    if (pnMempoolSequence)
+        WriteLE64(data + sizeof(uint256) + sizeof(label), *pnMempoolSequence);
+    return notifier.SendMessage(MSG_SEQUENCE, data, pnMempoolSequence ? sizeof(data) : sizeof(uint256) + sizeof(label));
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const uint256 &hash)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block connect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const uint256 &hash)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block disconnect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence)
+{
+    const uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool acceptance %s %u\n", hash.GetHex(), nMempoolSequence);
+    return SendSequenceMsg(*this, hash, 'A', &nMempoolSequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence)
+{
+    const uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool removal %s %u\n", hash.GetHex(), nMempoolSequence);
+    return SendSequenceMsg(*this, hash, 'R', &nMempoolSequence);
 }
 
 bool CZMQPublishNewTokenMessageNotifier::NotifyMessage(const CMessage &message)
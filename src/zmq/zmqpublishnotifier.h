@@ -8,6 +8,10 @@
 
 #include "zmqabstractnotifier.h"
 
+#include "streams.h"
+
+#include <memory>
+
 class CBlockIndex;
 class CMessage;
 
@@ -25,6 +29,8 @@ public:
           * message sequence number
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    /* as above, but the data is handed to zmq without a copy and freed once sent */
+    bool SendMessage(const char *command, std::unique_ptr<CDataStream> data);
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
@@ -33,7 +39,7 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex) override;
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock) override;
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -45,7 +51,7 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex) override;
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock) override;
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -54,6 +60,34 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+/** Publishes one decoded record per token output: issuance, reissuance or transfer */
+class CZMQPublishTokenEventNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTransaction(const CTransaction &transaction) override;
+};
+
+/** Publishes one decoded record per restricted token data output: tags, freezes and verifiers */
+class CZMQPublishRestrictedEventNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTransaction(const CTransaction &transaction) override;
+};
+
+/**
+ * Publishes the additions to and removals from the mempool, numbered by the mempool sequence,
+ * and the blocks connected and disconnected, so a subscriber can keep a copy of the mempool
+ * without polling getrawmempool
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnect(const uint256 &hash) override;
+    bool NotifyBlockDisconnect(const uint256 &hash) override;
+    bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence) override;
+    bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence) override;
+};
+
 class CZMQPublishNewTokenMessageNotifier : public CZMQAbstractPublishNotifier
 {
 public:
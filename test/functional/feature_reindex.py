@@ -10,6 +10,7 @@ Test running paladeumd with -reindex and -reindex-chainstate options.
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has re-indexed up to block 3.
 - Stop the node and restart it with -reindex-chainstate. Verify that the node has re-indexed up to block 3.
+- Reindex again reading the block files on the import thread and on two scanner threads.
 """
 
 import time
@@ -22,11 +23,13 @@ class ReindexTest(PaladeumTestFramework):
         self.setup_clean_chain = True
         self.num_nodes = 1
 
-    def reindex(self, justchainstate=False):
+    def reindex(self, justchainstate=False, threads=None):
         self.nodes[0].generate(3)
         blockcount = self.nodes[0].getblockcount()
         self.stop_nodes()
         extra_args = [["-reindex-chainstate" if justchainstate else "-reindex", "-checkblockindex=1"]]
+        if threads is not None:
+            extra_args[0].append("-reindexthreads=%d" % threads)
         self.start_nodes(extra_args)
         while self.nodes[0].getblockcount() < blockcount:
             time.sleep(0.1)
@@ -38,6 +41,8 @@ class ReindexTest(PaladeumTestFramework):
         self.reindex(True)
         self.reindex(False)
         self.reindex(True)
+        self.reindex(False, threads=0)
+        self.reindex(False, threads=2)
 
 if __name__ == '__main__':
     ReindexTest().main()
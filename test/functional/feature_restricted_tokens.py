@@ -319,6 +319,13 @@ class RestrictedTokensTest(PaladeumTestFramework):
         assert_contains(tag, n0.listtagsforaddress(address))
         assert n0.checkaddresstag(address, tag)
 
+        # paged listings return one page and the cursor of the next
+        page = n0.listaddressesfortag(tag, 1)
+        assert_equal(n0.listaddressesfortag(tag)[:1], page["results"])
+        last_page = n0.listtagsforaddress(address, 1000)
+        assert_contains(tag, last_page["results"])
+        assert_does_not_contain_key("next", last_page)
+
         # viewmytaggedaddresses
         tagged = viewmytaggedaddresses()
         assert_equal(4, len(tagged))
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Paladeum developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Restricted token tag churn.
+
+Node 0 tags --scale addresses with a qualifier, mines the tags, removes
+them all again and mines that. Records the tag and untag rates, how long
+node 1 takes to connect the tagging blocks and the latency of the tag
+queries while the addresses are tagged."""
+
+import time
+
+from test_framework.perf import PaladeumPerfTestFramework, UNLIMITED_PACKAGE_ARGS
+
+
+class RestrictedTagsPerfTest(PaladeumPerfTestFramework):
+    default_scale = 500
+
+    def set_perf_params(self):
+        self.num_nodes = 2
+        self.extra_args = [UNLIMITED_PACKAGE_ARGS] * self.num_nodes
+
+    def tag_all(self, method, tag, addresses, name):
+        node = self.nodes[0]
+        start = time.time()
+        for address in addresses:
+            getattr(node, method)(tag, address)
+        self.results.record_rate(name + "_tx_per_s", len(addresses), time.time() - start, "tx/s")
+        with self.connect_window(name + "_block_connect_ms", 1):
+            self.mine_mempool(node)
+
+    def run_scenario(self):
+        n0, n1 = self.nodes[0], self.nodes[1]
+        scale = self.options.scale
+
+        self.log.info("Issuing the qualifier")
+        n0.generate(20)
+        n0.issuequalifiertoken("#CHURN")
+        self.mine_mempool(n0)
+
+        addresses = [n1.getnewaddress() for _ in range(scale)]
+
+        self.log.info("Tagging %d addresses" % scale)
+        self.tag_all("addtagtoaddress", "#CHURN", addresses, "tag")
+        assert n1.checkaddresstag(addresses[-1], "#CHURN")
+
+        self.log.info("Measuring tag queries")
+        self.rpc_latency("checkaddresstag_ms", n1, "checkaddresstag", addresses[0], "#CHURN")
+        self.rpc_latency("listtagsforaddress_ms", n1, "listtagsforaddress", addresses[0])
+        self.rpc_latency("listaddressesfortag_ms", n1, "listaddressesfortag", "#CHURN", samples=5)
+
+        self.log.info("Untagging %d addresses" % scale)
+        self.tag_all("removetagfromaddress", "#CHURN", addresses, "untag")
+        assert not n1.checkaddresstag(addresses[-1], "#CHURN")
+
+
+if __name__ == '__main__':
+    RestrictedTagsPerfTest().main()
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Paladeum developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Reward distribution to many holders.
+
+Node 0 hands one unit of a token to each of --scale holder addresses of
+node 1, takes a snapshot of the holders and distributes PLB to all of them.
+Records how long the holders take to set up, the snapshot and distribution
+times, the blocks the payout takes to connect on node 1 and the latency of
+the snapshot queries."""
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.perf import PaladeumPerfTestFramework, UNLIMITED_PACKAGE_ARGS
+from test_framework.util import assert_equal, wait_until
+
+REWARD_COMPLETE = 2
+MAX_DISTRIBUTION_BLOCKS = 100
+
+
+class RewardsPerfTest(PaladeumPerfTestFramework):
+    default_scale = 10000
+
+    def set_perf_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-tokenindex", "-minrewardheight=5"] + UNLIMITED_PACKAGE_ARGS] * self.num_nodes
+
+    def run_scenario(self):
+        n0, n1 = self.nodes[0], self.nodes[1]
+        scale = self.options.scale
+
+        self.log.info("Issuing the token")
+        n0.generate(20)
+        owner = n0.getnewaddress()
+        n0.issue(token_name="PAYOUT", qty=scale, to_address=owner)
+        self.mine_mempool(n0)
+
+        self.log.info("Handing the token to %d holders" % scale)
+        holders = [n1.getnewaddress() for _ in range(scale)]
+        with self.results.timer("holder_transfers_ms"):
+            n0.sendmanytokens({"PAYOUT": {address: 1 for address in holders}})
+        with self.connect_window("holder_block_connect_ms", 1):
+            self.mine_mempool(n0)
+
+        self.log.info("Taking the snapshot")
+        snapshot_height = n0.getblockcount() + 1
+        n0.requestsnapshot(token_name="PAYOUT", block_height=snapshot_height)
+        with self.results.timer("snapshot_ms"):
+            n0.generate(10)
+            wait_until(lambda: self.snapshot_taken(snapshot_height), err_msg="snapshot taken", timeout=600)
+        assert_equal(len(n0.getsnapshot(token_name="PAYOUT", block_height=snapshot_height)["owners"]), scale)
+        self.sync_all()
+        self.rpc_latency("getsnapshot_ms", n0, "getsnapshot", "PAYOUT", snapshot_height, samples=5)
+
+        self.log.info("Distributing the reward")
+        with self.connect_window("payout_block_connect_ms", 1):
+            with self.results.timer("distribution_ms"):
+                n0.distributereward("PAYOUT", snapshot_height, "PLB", scale)
+                blocks = 0
+                while n0.getdistributestatus("PAYOUT", snapshot_height, "PLB", scale)["Status"] != REWARD_COMPLETE:
+                    assert blocks < MAX_DISTRIBUTION_BLOCKS, "distribution not complete after %d blocks" % blocks
+                    n0.generate(1)
+                    blocks += 1
+                self.mine_mempool(n0)
+        self.results.record("distribution_blocks", blocks, "blocks")
+        self.results.record_rate("distribution_holders_per_s", scale, self.results.metrics["distribution_ms"]["value"] / 1000, "holders/s")
+
+    def snapshot_taken(self, height):
+        try:
+            self.nodes[0].getsnapshot(token_name="PAYOUT", block_height=height)
+            return True
+        except JSONRPCException:
+            return False
+
+
+if __name__ == '__main__':
+    RewardsPerfTest().main()
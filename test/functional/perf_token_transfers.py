@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Paladeum developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Token transfer flood.
+
+Node 0 sends --scale single token transfers as fast as its wallet builds
+them, they are relayed to node 1 and mined. Records the transfer rate and
+RPC latency, the relay time, the mempool of node 1 and how long node 1
+takes to connect the blocks, then the latency of the token queries."""
+
+import time
+
+from test_framework.perf import PaladeumPerfTestFramework, UNLIMITED_PACKAGE_ARGS
+from test_framework.util import sync_mempools
+
+
+class TokenTransferPerfTest(PaladeumPerfTestFramework):
+    default_scale = 500
+
+    def set_perf_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-tokenindex"] + UNLIMITED_PACKAGE_ARGS] * self.num_nodes
+
+    def run_scenario(self):
+        n0, n1 = self.nodes[0], self.nodes[1]
+        scale = self.options.scale
+
+        self.log.info("Issuing the token")
+        n0.generate(20)
+        n0.issue(token_name="FLOOD", qty=scale * 10)
+        self.mine_mempool(n0)
+
+        addresses = [n1.getnewaddress() for _ in range(min(scale, 100))]
+
+        self.log.info("Sending %d transfers" % scale)
+        latencies = []
+        start = time.time()
+        for i in range(scale):
+            sent = time.time()
+            n0.transfer("FLOOD", 1, addresses[i % len(addresses)])
+            latencies.append((time.time() - sent) * 1000)
+        self.results.record_rate("transfer_tx_per_s", scale, time.time() - start, "tx/s")
+        self.results.record_samples("transfer_rpc_ms", latencies, "ms")
+
+        with self.results.timer("mempool_relay_ms"):
+            sync_mempools(self.nodes, timeout=600)
+        self.record_mempool("mempool", n1)
+
+        self.log.info("Mining the transfers")
+        with self.connect_window("block_connect_ms", 1):
+            with self.results.timer("mine_and_sync_ms"):
+                blocks = self.mine_mempool(n0)
+        self.results.record("blocks", blocks, "blocks")
+
+        self.log.info("Measuring token queries")
+        self.rpc_latency("gettokendata_ms", n1, "gettokendata", "FLOOD")
+        self.rpc_latency("listmytokens_ms", n1, "listmytokens")
+        self.rpc_latency("listaddressesbytoken_ms", n1, "listaddressesbytoken", "FLOOD")
+        self.rpc_latency("listtokenbalancesbyaddress_ms", n1, "listtokenbalancesbyaddress", addresses[0])
+
+
+if __name__ == '__main__':
+    TokenTransferPerfTest().main()
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Paladeum developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Block production rotating over many validators.
+
+Eight nodes connected in a line take turns producing --scale blocks, each
+carrying payments from every node. Records how long each block takes to
+reach every node, the connect times on the far end of the line and the
+latency of the staking and chain queries.
+
+Regtest blocks are always proof of work, so the validators produce their
+blocks with generate rather than by staking."""
+
+import time
+
+from test_framework.perf import PaladeumPerfTestFramework
+from test_framework.util import sync_blocks, sync_mempools
+
+NUM_VALIDATORS = 8
+
+
+class ValidatorsPerfTest(PaladeumPerfTestFramework):
+    default_scale = 50
+
+    def set_perf_params(self):
+        self.num_nodes = NUM_VALIDATORS
+
+    def run_scenario(self):
+        scale = self.options.scale
+
+        self.log.info("Funding %d validators" % self.num_nodes)
+        self.nodes[0].generate(20)
+        addresses = [node.getnewaddress() for node in self.nodes]
+        for address in addresses:
+            for _ in range(10):
+                self.nodes[0].sendtoaddress(address, 1000)
+        self.mine_mempool(self.nodes[0])
+
+        self.log.info("Producing %d blocks" % scale)
+        propagation = []
+        with self.connect_window("block_connect_ms", self.num_nodes - 1):
+            for height in range(scale):
+                producer = self.nodes[height % self.num_nodes]
+                for i, node in enumerate(self.nodes):
+                    node.sendtoaddress(addresses[(i + 1) % self.num_nodes], 1)
+                sync_mempools(self.nodes, timeout=120)
+                start = time.time()
+                producer.generate(1)
+                sync_blocks(self.nodes, wait=0.05, timeout=120)
+                propagation.append((time.time() - start) * 1000)
+        self.results.record_samples("block_propagation_ms", propagation, "ms")
+
+        self.log.info("Measuring chain queries")
+        self.rpc_latency("getstakinginfo_ms", self.nodes[-1], "getstakinginfo")
+        self.rpc_latency("getblockchaininfo_ms", self.nodes[-1], "getblockchaininfo")
+        self.rpc_latency("getgovernanceinfo_ms", self.nodes[-1], "getgovernanceinfo")
+
+
+if __name__ == '__main__':
+    ValidatorsPerfTest().main()
@@ -190,6 +190,14 @@ class RawTransactionsTest(PaladeumTestFramework):
         # 5. valid parameters - supply txid and True for non-verbose
         assert_equal(self.nodes[0].getrawtransaction(txHash, True)["hex"], rawTxSigned['hex'])
 
+        # Repeated calls are answered from the result cache, which keeps the confirmations current
+        verbose = self.nodes[0].getrawtransaction(txHash, True)
+        self.nodes[0].generate(1)
+        self.sync_all()
+        verbose['confirmations'] += 1
+        assert_equal(self.nodes[0].getrawtransaction(txHash, True), verbose)
+        assert_equal(self.nodes[0].decoderawtransaction(rawTxSigned['hex']), self.nodes[0].decoderawtransaction(rawTxSigned['hex']))
+
         # 6. invalid parameters - supply txid and string "Flase"
         assert_raises_rpc_error(-3,"Invalid type", self.nodes[0].getrawtransaction, txHash, "Flase")
 
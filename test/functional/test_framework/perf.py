@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Paladeum developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Performance scenario support.
+
+PaladeumPerfTestFramework runs a workload on a regtest network like any
+functional test, and records what it measures into a PerfResults. The
+results are written as JSON to --perfoutput (or printed when it isn't
+given), so the numbers of two releases can be compared:
+
+    {
+      "scenario": "perf_token_transfers",
+      "version": 1000000,
+      "subversion": "/Paladeum:1.0.0/",
+      "scale": 500,
+      "timestamp": 1650000000,
+      "metrics": {
+        "transfer_tx_per_s": {"value": 212.5, "unit": "tx/s"},
+        "block_connect_ms": {"value": 3.1, "unit": "ms", "count": 12, "min": ..., "max": ..., "p50": ..., "p90": ...},
+        ...
+      }
+    }
+
+Test nodes log every debug category, so the block connect times of the
+bench category are collected from their debug logs."""
+
+from contextlib import contextmanager
+import json
+import os
+import re
+import sys
+import time
+
+from .test_framework import PaladeumTestFramework
+from .util import sync_blocks
+
+CONNECT_BLOCK_RE = re.compile(r"- Connect block: ([0-9.]+)ms")
+
+# Floods chain every transaction on the change of the one before, far past the default package limits
+UNLIMITED_PACKAGE_ARGS = ["-limitancestorcount=1000000", "-limitancestorsize=1000000",
+                          "-limitdescendantcount=1000000", "-limitdescendantsize=1000000"]
+
+
+def summarize(samples):
+    """Mean, min, max and percentiles of a list of samples, None when it is empty."""
+    if not samples:
+        return None
+    ordered = sorted(samples)
+
+    def percentile(p):
+        return ordered[min(len(ordered) - 1, int(p * len(ordered)))]
+
+    return {"value": sum(ordered) / len(ordered), "count": len(ordered), "min": ordered[0], "max": ordered[-1],
+            "p50": percentile(0.5), "p90": percentile(0.9), "p99": percentile(0.99)}
+
+
+class PerfResults():
+    """The metrics of one scenario run, by name."""
+
+    def __init__(self, scenario):
+        self.scenario = scenario
+        self.metrics = {}
+        self.info = {}
+
+    def record(self, name, value, unit):
+        self.metrics[name] = {"value": value, "unit": unit}
+
+    def record_samples(self, name, samples, unit):
+        summary = summarize(samples)
+        if summary is not None:
+            summary["unit"] = unit
+            self.metrics[name] = summary
+
+    def record_rate(self, name, count, seconds, unit):
+        self.record(name, count / seconds if seconds > 0 else 0, unit)
+
+    @contextmanager
+    def timer(self, name):
+        """Record the wall time of the block in milliseconds."""
+        start = time.time()
+        yield
+        self.record(name, (time.time() - start) * 1000, "ms")
+
+    def to_json(self):
+        result = {"scenario": self.scenario, "timestamp": int(time.time())}
+        result.update(self.info)
+        result["metrics"] = self.metrics
+        return json.dumps(result, indent=2, sort_keys=True)
+
+
+class PaladeumPerfTestFramework(PaladeumTestFramework):
+    """Base class of the perf_ scenarios.
+
+    Subclasses implement set_perf_params() instead of set_test_params() and run_scenario() instead of run_test(),
+    recording into self.results. self.options.scale is the size of the workload."""
+
+    default_scale = 100
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.set_perf_params()
+
+    def set_perf_params(self):
+        """Override to change num_nodes or set extra_args"""
+        pass
+
+    def add_options(self, parser):
+        parser.add_option("--scale", dest="scale", default=self.default_scale, type='int',
+                          help="Size of the workload (default: %default)")
+        parser.add_option("--perfoutput", dest="perfoutput", default=None,
+                          help="Write the results as JSON to this file instead of the log")
+
+    def run_test(self):
+        self.results = PerfResults(os.path.splitext(os.path.basename(sys.argv[0]))[0])
+        network = self.nodes[0].getnetworkinfo()
+        self.results.info.update({"version": network["version"], "subversion": network["subversion"],
+                                  "scale": self.options.scale, "nodes": self.num_nodes})
+
+        self.run_scenario()
+
+        output = self.results.to_json()
+        if self.options.perfoutput:
+            with open(self.options.perfoutput, "w", encoding="utf8") as f:
+                f.write(output + "\n")
+            self.log.info("Results written to %s" % self.options.perfoutput)
+        else:
+            self.log.info("Results:\n%s" % output)
+
+    def run_scenario(self):
+        raise NotImplementedError
+
+    # Measurement helpers
+
+    def rpc_latency(self, name, node, method, *args, samples=20):
+        """Call an RPC samples times and record its latency in milliseconds."""
+        latencies = []
+        for _ in range(samples):
+            start = time.time()
+            getattr(node, method)(*args)
+            latencies.append((time.time() - start) * 1000)
+        self.results.record_samples(name, latencies, "ms")
+
+    def record_mempool(self, name, node):
+        """Record the transactions in the mempool of node and the memory they take."""
+        info = node.getmempoolinfo()
+        self.results.record(name + "_txs", info["size"], "tx")
+        self.results.record(name + "_usage", info["usage"], "bytes")
+
+    def connect_times(self, node_index):
+        """Block connect times of a node so far, in milliseconds, from its debug log."""
+        path = os.path.join(self.options.tmpdir, "node%d" % node_index, "regtest", "debug.log")
+        with open(path, encoding="utf8", errors="replace") as f:
+            return [float(m.group(1)) for m in CONNECT_BLOCK_RE.finditer(f.read())]
+
+    def mine_mempool(self, node):
+        """Generate blocks on node until its mempool is empty and every node has them, the number of blocks."""
+        blocks = 0
+        while node.getmempoolinfo()["size"] > 0:
+            node.generate(1)
+            blocks += 1
+        sync_blocks(self.nodes, timeout=600)
+        return blocks
+
+    @contextmanager
+    def connect_window(self, name, node_index):
+        """Record the connect times of the blocks node_index connects within the block."""
+        before = len(self.connect_times(node_index))
+        yield
+        self.results.record_samples(name, self.connect_times(node_index)[before:], "ms")
@@ -200,6 +200,15 @@ SKIPPED_TESTS = [
 # Place EXTENDED_SCRIPTS first since it has the 3 longest running tests
 ALL_SCRIPTS = EXTENDED_SCRIPTS + BASE_SCRIPTS
 
+PERF_SCRIPTS = [
+    # Performance scenarios: not run by default, only with --perf or when named.
+    # Each writes its metrics as JSON to --perfoutput.
+    'perf_token_transfers.py',
+    'perf_rewards.py',
+    'perf_restricted_tags.py',
+    'perf_validators.py',
+]
+
 NON_SCRIPTS = [
     # These are python files that live in the functional tests directory, but are not test scripts.
     "combine_logs.py",
@@ -226,6 +235,7 @@ def main():
     parser.add_argument('--list', action='store_true', help='Print list of tests and exit.')
     parser.add_argument('--loop', type=int, metavar='n', default=1, help='Run(loop) the tests n number of times.')
     parser.add_argument('--onlyextended', action='store_true', help='Run only the extended test suite.')
+    parser.add_argument('--perf', action='store_true', help='Run the performance scenarios in addition to the selected tests.')
     parser.add_argument('--quiet',  action='store_true', help='Only print results summary and failure logs.')
     parser.add_argument('--tmpdirprefix', metavar='', default=tempfile.gettempdir(), help='Root directory for data.')
 
@@ -299,7 +309,7 @@ def main():
             for test in tests:
                 script = test.split("/")[-1]
                 script = script + ".py" if ".py" not in script else script
-                if script in ALL_SCRIPTS:
+                if script in ALL_SCRIPTS + PERF_SCRIPTS:
                     test_list.append(script)
                 else:
                     print("{}WARNING!{} Test '{}' not found in full test list.".format(BOLD[1], BOLD[0], test))
@@ -310,6 +320,9 @@ def main():
             # Run base tests only
             test_list += BASE_SCRIPTS
 
+        if args.perf:
+            test_list += [script for script in PERF_SCRIPTS if script not in test_list]
+
         # Remove the test cases that the user has explicitly asked to exclude.
         if args.exclude:
             exclude_tests = [test.split('.py')[0] for test in args.exclude.split(',')]
@@ -630,7 +643,7 @@ def check_script_prefixes():
     # that introduce new tests that don't conform with the naming
     # convention don't immediately cause the tests to fail.
     leeway = 1
-    good_prefixes_re = re.compile("(example|feature|interface|mempool|mining|p2p|rpc|wallet)_")
+    good_prefixes_re = re.compile("(example|feature|interface|mempool|mining|p2p|perf|rpc|wallet)_")
     bad_script_names = [script for script in ALL_SCRIPTS if good_prefixes_re.match(script) is None]
     if len(bad_script_names) < expected_violation_count:
         print("{}HURRAY!{} Number of functional tests violating naming convention reduced!".format(BOLD[1], BOLD[0]))
@@ -648,7 +661,7 @@ def check_script_list(src_dir):
     not being run by pull-tester.py."""
     script_dir = src_dir + '/test/functional/'
     python_files = set([t for t in os.listdir(script_dir) if t[-3:] == ".py"])
-    missed_tests = list(python_files - set(map(lambda x: x.split()[0], ALL_SCRIPTS + NON_SCRIPTS + SKIPPED_TESTS)))
+    missed_tests = list(python_files - set(map(lambda x: x.split()[0], ALL_SCRIPTS + PERF_SCRIPTS + NON_SCRIPTS + SKIPPED_TESTS)))
     if len(missed_tests) != 0:
         print("%sWARNING!%s The following scripts are not being run:\n%s \nCheck the test lists in test_runner.py." % (BOLD[1], BOLD[0], "\n".join(missed_tests)))
 